@@ -0,0 +1,376 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/string_util.h"
+#include "common/thread.h"
+#include "common/timer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "citra/batch_runner.h"
+
+namespace BatchRunner {
+
+static const int kPollIntervalMs = 50;
+
+/// Handle of a running process
+#ifdef _WIN32
+typedef HANDLE Process;
+#else
+typedef pid_t Process;
+#endif
+
+/// How a title ran
+enum Status {
+    STATUS_PENDING,
+    STATUS_RUNNING,
+    STATUS_OK,              ///< Ran its budget
+    STATUS_LOAD_FAILED,     ///< Couldn't be loaded
+    STATUS_CRASHED,         ///< Exited without finishing the benchmark
+    STATUS_TIMEOUT,         ///< Killed after running out of real time
+};
+
+/// A title of the list and what its run reported
+struct Job {
+    Job() : status(STATUS_PENDING), slot(-1), start_ms(0), exit_code(0), frames(0), seconds(0.0),
+        fps(0.0), mips(0.0) {}
+
+    std::string title;
+    std::string log_filename;   ///< Output of the process
+    Status      status;
+    Process     process;
+    int         slot;           ///< Of the processes running at a time, the --instance it ran as
+    u32         start_ms;
+    int         exit_code;
+
+    // Read back from the output of the benchmark
+    u64         frames;
+    double      seconds;
+    double      fps;
+    double      mips;
+    std::string frame_hash;
+};
+
+/**
+ * Gets the name of a status, as written in the report
+ * @param status Status to get the name of
+ * @return Name of the status
+ */
+static const char* GetStatusName(Status status) {
+    switch (status) {
+    case STATUS_PENDING:        return "pending";
+    case STATUS_RUNNING:        return "running";
+    case STATUS_OK:             return "ok";
+    case STATUS_LOAD_FAILED:    return "load failed";
+    case STATUS_CRASHED:        return "crashed";
+    case STATUS_TIMEOUT:        return "timeout";
+    default:                    return "unknown";
+    }
+}
+
+/**
+ * Reads the titles of a list
+ * @param filename List to read
+ * @param jobs Receives a job per title
+ * @return True on success
+ */
+static bool ReadList(const std::string& filename, std::vector<Job>& jobs) {
+    std::string list;
+    if (!File::ReadFileToString(true, filename.c_str(), list)) {
+        ERROR_LOG(BOOT, "Couldn't read the title list %s", filename.c_str());
+        return false;
+    }
+    std::vector<std::string> lines;
+    SplitString(list, '\n', lines);
+    for (std::string& line : lines) {
+        line = StripSpaces(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Job job;
+        job.title = line;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+/**
+ * Starts a process with its output going to a file
+ * @param args Executable and its arguments
+ * @param log_filename File the output of the process is written to, truncated
+ * @param process Receives the handle of the process
+ * @return True on success
+ */
+static bool StartProcess(const std::vector<std::string>& args, const std::string& log_filename,
+    Process& process) {
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES security = { sizeof(security), NULL, TRUE };
+    HANDLE log = CreateFileA(log_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &security,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (log == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    std::string command_line;
+    for (const std::string& arg : args) {
+        command_line += (command_line.empty() ? "\"" : " \"") + arg + "\"";
+    }
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    startup.hStdOutput = log;
+    startup.hStdError = log;
+    PROCESS_INFORMATION info;
+    const BOOL started = CreateProcessA(NULL, &command_line[0], NULL, NULL, TRUE, 0, NULL, NULL,
+        &startup, &info);
+    CloseHandle(log);
+    if (!started) {
+        return false;
+    }
+    CloseHandle(info.hThread);
+    process = info.hProcess;
+    return true;
+#else
+    const int log = open(log_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log < 0) {
+        return false;
+    }
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(NULL);
+    process = fork();
+    if (process == 0) {
+        dup2(log, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        close(log);
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    close(log);
+    return process > 0;
+#endif
+}
+
+/**
+ * Checks whether a process exited, without waiting
+ * @param process Process to check
+ * @param exit_code Receives the exit status of the process once it exited, -1 if it crashed
+ * @return True if the process exited
+ */
+static bool PollProcess(Process process, int& exit_code) {
+#ifdef _WIN32
+    if (WaitForSingleObject(process, 0) != WAIT_OBJECT_0) {
+        return false;
+    }
+    DWORD code;
+    GetExitCodeProcess(process, &code);
+    CloseHandle(process);
+    // Exceptions end processes with their NTSTATUS code, which has the top bits set
+    exit_code = code >= 0xC0000000 ? -1 : (int)code;
+    return true;
+#else
+    int status;
+    if (waitpid(process, &status, WNOHANG) != process) {
+        return false;
+    }
+    exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return true;
+#endif
+}
+
+/**
+ * Kills a process and waits for it to exit
+ * @param process Process to kill
+ */
+static void KillProcess(Process process) {
+#ifdef _WIN32
+    TerminateProcess(process, 1);
+    WaitForSingleObject(process, INFINITE);
+    CloseHandle(process);
+#else
+    kill(process, SIGKILL);
+    waitpid(process, NULL, 0);
+#endif
+}
+
+/**
+ * Reads back what the benchmark of a job printed, and how the job ended
+ * @param job Job that exited, with its exit code
+ */
+static void ReadResults(Job& job) {
+    std::string output;
+    File::ReadFileToString(true, job.log_filename.c_str(), output);
+    std::vector<std::string> lines;
+    SplitString(output, '\n', lines);
+    bool finished = false;
+    for (const std::string& line : lines) {
+        unsigned long long frames;
+        char hash[17];
+        if (sscanf(line.c_str(), "frames: %llu", &frames) == 1) {
+            job.frames = frames;
+            finished = true;
+        } else if (sscanf(line.c_str(), "seconds: %lf", &job.seconds) == 1 ||
+                   sscanf(line.c_str(), "fps: %lf", &job.fps) == 1 ||
+                   sscanf(line.c_str(), "mips: %lf", &job.mips) == 1) {
+            continue;
+        } else if (sscanf(line.c_str(), "frame_hash: %16s", hash) == 1) {
+            job.frame_hash = hash;
+        }
+    }
+    if (job.exit_code == 0 && finished) {
+        job.status = STATUS_OK;
+    } else if (job.exit_code == 1 && !finished) {
+        job.status = STATUS_LOAD_FAILED;
+    } else {
+        job.status = STATUS_CRASHED;
+    }
+}
+
+/**
+ * Quotes a field of the report, if it needs to be
+ * @param field Field to quote
+ * @return The field, in double quotes if it has a comma or a quote
+ */
+static std::string QuoteField(const std::string& field) {
+    if (field.find_first_of(",\"") == std::string::npos) {
+        return field;
+    }
+    std::string quoted = "\"";
+    for (char c : field) {
+        quoted += c == '"' ? "\"\"" : std::string(1, c);
+    }
+    return quoted + "\"";
+}
+
+/**
+ * Writes the report, a line of comma separated values per title
+ * @param filename File to write the report to
+ * @param jobs Titles that ran
+ * @return True on success
+ */
+static bool WriteReport(const std::string& filename, const std::vector<Job>& jobs) {
+    std::string report = "title,status,exit_code,frames,seconds,fps,mips,frame_hash,log\n";
+    for (const Job& job : jobs) {
+        report += StringFromFormat("%s,%s,%d,%llu,%.3f,%.2f,%.2f,%s,%s\n",
+            QuoteField(job.title).c_str(), GetStatusName(job.status), job.exit_code,
+            (unsigned long long)job.frames, job.seconds, job.fps, job.mips,
+            job.frame_hash.c_str(), QuoteField(job.log_filename).c_str());
+    }
+    if (!File::WriteStringToFile(true, report, filename.c_str())) {
+        ERROR_LOG(BOOT, "Couldn't write the batch report %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Runs the titles of a list and writes the report
+ * @param config What to run and where to report it
+ * @return Exit status of citra, 0 if every title ran its budget
+ */
+int Run(const Config& config) {
+    std::vector<Job> jobs;
+    if (!ReadList(config.list_filename, jobs)) {
+        return 1;
+    }
+    int num_physical_cores;
+    Common::GetCpuOrder(&num_physical_cores);
+    const int max_running = config.jobs > 0 ? config.jobs : num_physical_cores;
+    NOTICE_LOG(BOOT, "running %d titles, %d at a time", (int)jobs.size(), max_running);
+
+    // Each process pins its emulation thread to the physical core of its slot
+    std::vector<bool> slot_used(max_running, false);
+    size_t next = 0;
+    int running = 0;
+    while (next < jobs.size() || running > 0) {
+        // Fill the free slots first, then reap what finished
+        while (running < max_running && next < jobs.size()) {
+            Job& job = jobs[next];
+            job.slot = (int)(std::find(slot_used.begin(), slot_used.end(), false) -
+                slot_used.begin());
+            job.log_filename = StringFromFormat("%s.%d.log", config.report_filename.c_str(),
+                (int)next);
+            std::vector<std::string> args;
+            args.push_back(config.executable);
+            if (!config.config_filename.empty()) {
+                args.push_back("--config");
+                args.push_back(config.config_filename);
+            }
+            args.push_back("--instance");
+            args.push_back(StringFromFormat("%d", job.slot));
+            if (config.boot_frames > 0) {
+                args.push_back("--boot-snapshot");
+                args.push_back(StringFromFormat("%u", config.boot_frames));
+            }
+            args.push_back("--benchmark");
+            args.push_back(config.budget);
+            args.push_back(job.title);
+            next++;
+            if (!StartProcess(args, job.log_filename, job.process)) {
+                ERROR_LOG(BOOT, "Couldn't start %s for %s", config.executable.c_str(),
+                    job.title.c_str());
+                job.status = STATUS_CRASHED;
+                job.exit_code = -1;
+                continue;
+            }
+            job.status = STATUS_RUNNING;
+            job.start_ms = Common::Timer::GetTimeMs();
+            slot_used[job.slot] = true;
+            running++;
+        }
+
+        Common::SleepCurrentThread(kPollIntervalMs);
+        for (Job& job : jobs) {
+            if (job.status != STATUS_RUNNING) {
+                continue;
+            }
+            if (PollProcess(job.process, job.exit_code)) {
+                ReadResults(job);
+            } else if (Common::Timer::GetTimeMs() - job.start_ms >= (u32)config.timeout * 1000) {
+                KillProcess(job.process);
+                ReadResults(job);
+                job.status = STATUS_TIMEOUT;
+                job.exit_code = -1;
+            } else {
+                continue;
+            }
+            slot_used[job.slot] = false;
+            running--;
+            NOTICE_LOG(BOOT, "%s: %s, %.2f fps", job.title.c_str(), GetStatusName(job.status),
+                job.fps);
+        }
+    }
+
+    int counts[STATUS_TIMEOUT + 1] = {};
+    for (const Job& job : jobs) {
+        counts[job.status]++;
+    }
+    printf("titles: %d\nok: %d\nload failed: %d\ncrashed: %d\ntimeout: %d\n", (int)jobs.size(),
+        counts[STATUS_OK], counts[STATUS_LOAD_FAILED], counts[STATUS_CRASHED],
+        counts[STATUS_TIMEOUT]);
+    if (!WriteReport(config.report_filename, jobs)) {
+        return 1;
+    }
+    return counts[STATUS_OK] == (int)jobs.size() ? 0 : 1;
+}
+
+} // namespace
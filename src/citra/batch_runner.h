@@ -0,0 +1,37 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+/**
+ * Runs a list of titles for compatibility and performance sweeps. Every title runs as a benchmark
+ * in a citra process of its own, the emulator keeping its state in globals, with as many
+ * processes at a time as the host has physical cores, each with its emulation thread pinned to a
+ * core of its own. The output of each process goes to a log next to the report, which sums up
+ * how every title ran, how fast, and the hash of its last frame.
+ */
+namespace BatchRunner {
+
+/// What to run and where to report it
+struct Config {
+    std::string executable;     ///< citra executable the titles are run with
+    std::string list_filename;  ///< Titles, one path per line, blank lines and # comments skipped
+    std::string report_filename;
+    std::string budget;         ///< Argument of --benchmark, emulated frames or seconds per title
+    std::string config_filename;///< Settings the titles run with, the user's if empty
+    int         jobs;           ///< Processes run at a time, 0 for one per physical core
+    int         timeout;        ///< Real seconds a title may run before it's killed
+    u32         boot_frames;    ///< Frames of the boot snapshot the titles start from, 0 for none
+};
+
+/**
+ * Runs the titles of a list and writes the report
+ * @param config What to run and where to report it
+ * @return Exit status of citra, 0 if every title ran its budget
+ */
+int Run(const Config& config);
+
+} // namespace
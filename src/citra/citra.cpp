@@ -2,27 +2,421 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <map>
+#include <thread>
+
 #include "common/common.h"
+#include "common/compressed_image.h"
 #include "common/log_manager.h"
 #include "common/file_util.h"
+#include "common/hash.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
+#include "common/thread.h"
+#include "common/timer.h"
 
+#include "core/audio_output.h"
+#include "core/boot_snapshot.h"
 #include "core/system.h"
 #include "core/core.h"
+#include "core/gdb_stub.h"
 #include "core/loader.h"
+#include "core/mem_map.h"
+#include "core/movie.h"
+#include "core/run_ahead.h"
+#include "core/savestate.h"
+#include "core/settings.h"
+#include "core/speed_limiter.h"
+#include "core/statistics.h"
+#include "core/arm/exec_trace.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hw/gpu.h"
+
+#include "video_core/frame_dumper.h"
+#include "video_core/frame_golden.h"
+#include "video_core/pica_trace.h"
+#include "video_core/video_core.h"
 
 #include "citra/emu_window/emu_window_glfw.h"
+#include "citra/emu_window/emu_window_headless.h"
 
+#include "citra/batch_runner.h"
 #include "citra/citra.h"
 
+static std::string s_profile_filename; ///< Where to write the guest profile, empty if not profiling
+static u64 s_startup_us = 0;            ///< Real time from the system init to the loaded ROM
+
+/// Writes the profile of the application core when citra exits, once
+static void WriteProfile() {
+    if (s_profile_filename.empty() || Core::g_app_core == NULL) {
+        return;
+    }
+    const ARM_Profiler* profiler = Core::g_app_core->GetProfiler();
+    if (profiler->WriteFlatProfile(s_profile_filename) &&
+        profiler->WritePprofProfile(s_profile_filename + ".pprof")) {
+        NOTICE_LOG(MASTER_LOG, "wrote profile to %s", s_profile_filename.c_str());
+    }
+    s_profile_filename.clear();
+}
+
+/// Time a profiler category took over a benchmark
+struct BenchmarkCategory {
+    BenchmarkCategory() : total_ns(0), self_ns(0) {}
+
+    u64 total_ns;
+    u64 self_ns;
+};
+
+/**
+ * Hashes the frame the LCDs show, as a screenshot would show it, to compare runs
+ * @return FNV-1 of the top screen in the high half, of the bottom screen in the low half, 0 for a
+ *         screen that can't be read
+ */
+static u64 HashLastFrame() {
+    const u8* top = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_top_left_1);
+    const u8* bottom = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_sub_left_1);
+    const u32 top_hash = top != NULL ? HashFNV(top,
+        VideoCore::kScreenTopWidth * VideoCore::kScreenTopHeight * 3) : 0;
+    const u32 bottom_hash = bottom != NULL ? HashFNV(bottom,
+        VideoCore::kScreenBottomWidth * VideoCore::kScreenBottomHeight * 3) : 0;
+    return ((u64)top_hash << 32) | bottom_hash;
+}
+
+/**
+ * Runs the application unthrottled for a number of emulated frames, then prints how fast it ran:
+ * the emulated frames per second, the MIPS of the application core, the hash of the last frame,
+ * and where the time went by profiler category
+ * @param frames Number of frames to run
+ * @return Exit status of citra, 0 once the frames ran
+ */
+static int RunBenchmark(u64 frames) {
+    Common::Profiler::g_enabled.store(true, std::memory_order_relaxed);
+
+    // Every frame is added up from the report of the frame before, which the vertical blank of
+    // the top screen ends just before it counts the frame
+    std::map<std::string, BenchmarkCategory> categories;
+    Common::Profiler::FrameReport report;
+    u64 profiled_ns = 0;
+    const u64 start_frame = GPU::GetFrameCount();
+    const u64 start_instructions = Core::g_app_core->GetNumInstructions();
+    const u64 start = Common::Timer::GetTimeUs();
+    u64 frame = start_frame;
+    while (frame - start_frame < frames) {
+        Core::RunSlice();
+        if (GPU::GetFrameCount() == frame) {
+            continue;
+        }
+        frame = GPU::GetFrameCount();
+        Common::Profiler::GetLastFrame(report);
+        profiled_ns += report.frame_ns;
+        for (const auto& stats : report.categories) {
+            BenchmarkCategory& category = categories[stats.name];
+            category.total_ns += stats.total_ns;
+            category.self_ns += stats.self_ns;
+        }
+    }
+    const double seconds = std::max<u64>(Common::Timer::GetTimeUs() - start, 1) / 1e6;
+    const u64 instructions = Core::g_app_core->GetNumInstructions() - start_instructions;
+
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("seconds: %.3f\n", seconds);
+    printf("fps: %.2f\n", frames / seconds);
+    printf("mips: %.2f\n", instructions / seconds / 1e6);
+    printf("frame_hash: %016llx\n", (unsigned long long)HashLastFrame());
+    printf("startup_seconds: %.3f\n", s_startup_us / 1e6);
+
+    // Categories by their share of the time of the frames, nested ones count in their parents too
+    std::vector<std::pair<std::string, BenchmarkCategory>> sorted(categories.begin(),
+                                                                  categories.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, BenchmarkCategory>& a,
+                                               const std::pair<std::string, BenchmarkCategory>& b) {
+        return a.second.total_ns > b.second.total_ns;
+    });
+    for (const auto& category : sorted) {
+        printf("profile: %-32s %7.3f ms/frame total %7.3f ms/frame self %5.1f%%\n",
+            category.first.c_str(), category.second.total_ns / 1e6 / frames,
+            category.second.self_ns / 1e6 / frames,
+            profiled_ns > 0 ? category.second.total_ns * 100.0 / profiled_ns : 0.0);
+    }
+    return 0;
+}
+
+/**
+ * Raises the priority of the emulation thread, the one running the CPU, and pins it to a physical
+ * core for instances sharing the host. Threads the system started before keep their CPUs.
+ * @param instance Instance of citra on the host, -1 to leave the thread unpinned
+ */
+static void SetUpEmulationThread(int instance) {
+    if (!Common::SetCurrentThreadPriority(Common::PRIORITY_HIGH)) {
+        INFO_LOG(BOOT, "the emulation thread runs at normal priority, the host refused more");
+    }
+    if (instance < 0) {
+        return;
+    }
+    int num_physical_cores;
+    const std::vector<int> cpus = Common::GetCpuOrder(&num_physical_cores);
+    const int cpu = cpus[instance % num_physical_cores];
+    if (Common::PinCurrentThreadToCpu(cpu)) {
+        NOTICE_LOG(BOOT, "instance %d emulates on CPU %d, of %d physical cores", instance, cpu,
+            num_physical_cores);
+    } else {
+        WARN_LOG(BOOT, "couldn't pin the emulation thread of instance %d to CPU %d", instance, cpu);
+    }
+}
+
 /// Application entry point
 int __cdecl main(int argc, char **argv) {
     std::string program_dir = File::GetCurrentDir();
 
     LogManager::Init();
+    Settings::Load();
 
-    EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
+    // Leading options: --config <file> reads the settings of a file instead of the user's emu.ini,
+    // the options before it are overridden by it and those after it override it,
+    // --cpu-backend <name>, --renderer-backend <name> and --audio-backend <name> pick the
+    // backends the settings would, --list-backends prints them with their capabilities and exits,
+    // --no-title-profile ignores the profile of the title, which otherwise applies over the
+    // settings and the options,
+    // --headless runs without a window or graphics context, e.g. on machines
+    // without a display, --dump-frames <directory> writes every frame shown to the directory,
+    // --resolution-scale <1-4> renders draws on the host GPU at a multiple of the resolution,
+    // --mono skips rendering the right eye of the top screen, which isn't presented,
+    // --frameskip skips presenting and rendering frames while the host can't keep up,
+    // --layout <stacked|side-by-side|single> arranges the screens in the window (stacked by
+    // default, single shows the top screen alone, the CPU fallback of old hosts always stacks),
+    // --translation-cache keeps the code translated by the JIT on disk for the next runs,
+    // --warm-up implies it, and has the image read ahead and the cached code translated at load,
+    // --speed <50-400|unlimited> sets the emulation speed in percent of real time, headless runs
+    // are unlimited by default, --run-ahead <0-6> runs frames ahead of the one that counts and
+    // shows the last, hiding frames of input lag of the application,
+    // --load-state <file> resumes from a savestate of the application,
+    // --boot-snapshot <frames> starts the title from a savestate cached that many frames into its
+    // boot, which the first run writes, batch runs pass it on,
+    // --record-movie <file> records the input of the session from its start, --play-movie <file>
+    // plays a movie of the application back, --seek-frame <frame> runs it unthrottled to a frame,
+    // --record-trace <file> <frames> records the GPU work of frames for citra_replay,
+    // --record-golden <file> writes the hashes of the frames shown to a file at exit,
+    // --check-golden <file> <directory> compares the frames shown to the hashes of a file, dumps
+    // those that differ to the directory (created if needed) and makes --benchmark fail on them,
+    // --exec-trace <file> records every instruction the CPU runs for citra_trace,
+    // --gdb-port <port> waits for GDB on a TCP port to debug the application with,
+    // --memory-stats counts the guest memory accesses of every region and logs them at exit,
+    // --huge-pages backs FCRAM and VRAM with 2 MiB host pages, where the host has them,
+    // --stats logs the speed, frame rates, call rates and host memory of the emulation each second,
+    // --stats-json <file> writes them to a file as a line of JSON every second,
+    // --perf-counters adds the host cycles, instructions and misses of the CPU, memory, GPU and
+    // rasterizer to them, where the host grants the performance counters,
+    // --benchmark <frames>|<seconds>s runs headless and unthrottled for a number of emulated frames
+    // or seconds, prints the speed and profile of the run for scripts and exits,
+    // --batch <title list> <report> runs every title of the list as a benchmark in a process of
+    // its own, --jobs <n> processes at a time (one per physical core by default), each for the
+    // --benchmark budget (60s by default) and at most --batch-timeout <seconds> of real time
+    // (600 by default), and writes how every title ran to the report,
+    // --instance <n> pins the emulation thread to the n-th physical core of the host (wrapping
+    // around), for instances sharing a host, batch runs pass every process the slot it runs in,
+    // --compress-image <image> <compressed image> writes a compressed CXI or CCI and exits,
+    // --binary-log <file> writes the log to a binary file for citra_logdump instead of emu.log
+    std::string dump_directory;
+    std::string state_filename;
+    std::string record_filename;
+    std::string movie_filename;
+    std::string trace_filename;
+    std::string exec_trace_filename;
+    std::string golden_filename;
+    std::string golden_diff_directory;
+    bool golden_check = false;
+    int trace_frames = 0;
+    int seek_frame = 0;
+    int gdb_port = 0;
+    u64 benchmark_frames = 0;
+    int instance = -1;
+    bool title_profile = true;
+    BatchRunner::Config batch;
+    batch.executable = argv[0];
+    batch.budget = "60s";
+    batch.jobs = 0;
+    batch.timeout = 600;
+    batch.boot_frames = 0;
+    bool speed_set = false;
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--config") == 0 && argc >= 3) {
+            Settings::Load(argv[2]);
+            batch.config_filename = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--cpu-backend") == 0 && argc >= 3) {
+            Core::g_cpu_backend = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--renderer-backend") == 0 && argc >= 3) {
+            VideoCore::g_renderer_backend = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--audio-backend") == 0 && argc >= 3) {
+            AudioOutput::g_sink_backend = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--list-backends") == 0) {
+            Settings::PrintBackends();
+            return 0;
+        } else if (strcmp(argv[1], "--no-title-profile") == 0) {
+            title_profile = false;
+        } else if (strcmp(argv[1], "--headless") == 0) {
+            VideoCore::g_headless_enabled = true;
+        } else if (strcmp(argv[1], "--dump-frames") == 0 && argc >= 3) {
+            dump_directory = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--resolution-scale") == 0 && argc >= 3) {
+            VideoCore::g_renderer_backend = "opengl";
+            VideoCore::g_resolution_scale = atoi(argv[2]);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--mono") == 0) {
+            VideoCore::g_mono_enabled = true;
+        } else if (strcmp(argv[1], "--frameskip") == 0) {
+            SpeedLimiter::g_frameskip_enabled = true;
+        } else if (strcmp(argv[1], "--layout") == 0 && argc >= 3) {
+            if (strcmp(argv[2], "side-by-side") == 0) {
+                VideoCore::g_screen_layout = VideoCore::ScreenLayout::SideBySide;
+            } else if (strcmp(argv[2], "single") == 0) {
+                VideoCore::g_screen_layout = VideoCore::ScreenLayout::SingleScreen;
+            } else {
+                VideoCore::g_screen_layout = VideoCore::ScreenLayout::Stacked;
+            }
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--translation-cache") == 0) {
+            Core::g_translation_cache_enabled = true;
+        } else if (strcmp(argv[1], "--warm-up") == 0) {
+            Core::g_translation_cache_enabled = true;
+            Core::g_warm_up_enabled = true;
+        } else if (strcmp(argv[1], "--speed") == 0 && argc >= 3) {
+            if (strcmp(argv[2], "unlimited") == 0) {
+                SpeedLimiter::SetSpeed(SpeedLimiter::UNLIMITED);
+            } else {
+                SpeedLimiter::SetSpeed(std::max(atoi(argv[2]), (int)SpeedLimiter::MIN_SPEED));
+            }
+            speed_set = true;
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--run-ahead") == 0 && argc >= 3) {
+            RunAhead::SetFrames(atoi(argv[2]));
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--load-state") == 0 && argc >= 3) {
+            state_filename = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--boot-snapshot") == 0 && argc >= 3) {
+            batch.boot_frames = (u32)std::max(atoi(argv[2]), 0);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--record-movie") == 0 && argc >= 3) {
+            record_filename = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--play-movie") == 0 && argc >= 3) {
+            movie_filename = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--seek-frame") == 0 && argc >= 3) {
+            seek_frame = atoi(argv[2]);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--record-trace") == 0 && argc >= 4) {
+            trace_filename = argv[2];
+            trace_frames = std::max(atoi(argv[3]), 1);
+            argv += 2;
+            argc -= 2;
+        } else if (strcmp(argv[1], "--record-golden") == 0 && argc >= 3) {
+            golden_filename = argv[2];
+            golden_check = false;
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--check-golden") == 0 && argc >= 4) {
+            golden_filename = argv[2];
+            golden_diff_directory = argv[3];
+            golden_check = true;
+            argv += 2;
+            argc -= 2;
+        } else if (strcmp(argv[1], "--exec-trace") == 0 && argc >= 3) {
+            exec_trace_filename = argv[2];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--gdb-port") == 0 && argc >= 3) {
+            gdb_port = atoi(argv[2]);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--memory-stats") == 0) {
+            Memory::g_access_stats_enabled = true;
+            atexit(Memory::LogAccessStats);
+        } else if (strcmp(argv[1], "--huge-pages") == 0) {
+            Memory::g_huge_pages_requested = true;
+        } else if (strcmp(argv[1], "--stats") == 0) {
+            Statistics::g_log_enabled = true;
+        } else if (strcmp(argv[1], "--stats-json") == 0 && argc >= 3) {
+            Statistics::SetJsonOutput(argv[2]);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--perf-counters") == 0) {
+            Common::PerfCounters::Enable();
+        } else if (strcmp(argv[1], "--benchmark") == 0 && argc >= 3) {
+            // A count of seconds has an "s" after it, at 60 frames per second
+            char* end;
+            benchmark_frames = strtoull(argv[2], &end, 10);
+            if (*end == 's') {
+                benchmark_frames *= 60;
+            }
+            benchmark_frames = std::max<u64>(benchmark_frames, 1);
+            batch.budget = argv[2];
+            VideoCore::g_headless_enabled = true;
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--batch") == 0 && argc >= 4) {
+            batch.list_filename = argv[2];
+            batch.report_filename = argv[3];
+            argv += 2;
+            argc -= 2;
+        } else if (strcmp(argv[1], "--instance") == 0 && argc >= 3) {
+            instance = std::max(atoi(argv[2]), 0);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--jobs") == 0 && argc >= 3) {
+            batch.jobs = std::max(atoi(argv[2]), 1);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--batch-timeout") == 0 && argc >= 3) {
+            batch.timeout = std::max(atoi(argv[2]), 1);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--binary-log") == 0 && argc >= 3) {
+            if (!LogManager::GetInstance()->OpenBinaryLog(argv[2])) {
+                ERROR_LOG(BOOT, "Couldn't create the binary log %s", argv[2]);
+            }
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--compress-image") == 0 && argc >= 4) {
+            return Common::CompressedImage::Create(argv[2], argv[3]) ? 0 : 1;
+        } else {
+            ERROR_LOG(BOOT, "Unknown option %s", argv[1]);
+        }
+        argv++;
+        argc--;
+    }
+    if (!batch.list_filename.empty()) {
+        return BatchRunner::Run(batch);
+    }
+    if (benchmark_frames > 0 || (VideoCore::g_headless_enabled && !speed_set)) {
+        SpeedLimiter::SetSpeed(SpeedLimiter::UNLIMITED);
+    }
 
-    System::Init(emu_window);
+    EmuWindow_Headless headless_window;
+    EmuWindow_GLFW* emu_window = NULL;
+    if (!VideoCore::g_headless_enabled) {
+        emu_window = new EmuWindow_GLFW;
+    }
 
     std::string boot_filename;
 
@@ -32,16 +426,101 @@ int __cdecl main(int argc, char **argv) {
     else {
         boot_filename = argv[1];
     }
+    if (title_profile && !boot_filename.empty()) {
+        Settings::LoadTitleProfile(Loader::ReadTitleId(boot_filename));
+        atexit(Settings::SaveTitleSuggestions);
+    }
+
+    // The ROM is mapped while the system initializes, the load then only parses it
+    const u64 startup_start = Common::Timer::GetTimeUs();
+    std::thread map_thread;
+    if (!boot_filename.empty()) {
+        map_thread = std::thread(Loader::MapFile, boot_filename);
+    }
+    const bool initialized = System::Init(emu_window != NULL ? (EmuWindow*)emu_window :
+        &headless_window);
+    if (map_thread.joinable()) {
+        map_thread.join();
+    }
+    if (!initialized) {
+        return 1;
+    }
+
+    // An optional second argument turns on the guest profiler, written out when the window closes
+    if (argc >= 3) {
+        s_profile_filename = argv[2];
+        Core::g_app_core->EnableProfiling();
+        atexit(WriteProfile);
+    }
+    if (!dump_directory.empty()) {
+        FrameDumper::Start(dump_directory);
+        atexit(FrameDumper::Stop);
+    }
+
     std::string error_str;
 
+    const u64 load_start = Common::Timer::GetTimeUs();
     bool res = Loader::LoadFile(boot_filename, &error_str);
+    const u64 load_end = Common::Timer::GetTimeUs();
+    s_startup_us = load_end - startup_start;
+    NOTICE_LOG(BOOT, "loaded in %.1f ms, started in %.1f ms", (load_end - load_start) / 1000.0,
+        s_startup_us / 1000.0);
 
     if (!res) {
         ERROR_LOG(BOOT, "Failed to load ROM: %s", error_str.c_str());
+    } else {
+        if (!state_filename.empty()) {
+            SaveState::Load(state_filename);
+        } else if (movie_filename.empty() && record_filename.empty()) {
+            BootSnapshot::Start(Loader::ReadTitleId(boot_filename), batch.boot_frames);
+        }
+        if (!movie_filename.empty()) {
+            if (Movie::StartPlayback(movie_filename) && seek_frame > 0) {
+                Movie::Seek(seek_frame);
+            }
+        } else if (!record_filename.empty()) {
+            Movie::StartRecording(record_filename);
+        }
+        if (!trace_filename.empty()) {
+            PicaTrace::StartRecording(trace_filename, trace_frames);
+        }
+        if (!golden_filename.empty() && !golden_check) {
+            FrameGolden::StartRecording(golden_filename);
+            atexit(FrameGolden::Stop);
+        } else if (!golden_filename.empty()) {
+            File::CreateFullPath(golden_diff_directory + DIR_SEP);
+            if (!FrameGolden::StartChecking(golden_filename, golden_diff_directory)) {
+                return 1;
+            }
+            atexit(FrameGolden::Stop);
+        }
+        if (!exec_trace_filename.empty() &&
+            ExecTrace::Start(exec_trace_filename, Kernel::GetCurrentThreadHandle())) {
+            atexit(ExecTrace::Stop);
+        }
+        if (gdb_port > 0 && GDBStub::Init((u16)gdb_port)) {
+            atexit(GDBStub::Shutdown);
+        }
+    }
+
+    SetUpEmulationThread(instance);
+    if (benchmark_frames > 0) {
+        int status = res ? RunBenchmark(benchmark_frames) : 1;
+        FrameGolden::CheckResult golden;
+        if (status == 0 && FrameGolden::GetCheckResult(golden)) {
+            printf("golden_checked: %u\n", golden.checked);
+            printf("golden_divergent: %u\n", golden.divergent);
+            printf("golden_first_divergent: %lld\n", (long long)golden.first_divergent);
+            status = golden.divergent == 0 ? 0 : 1;
+        }
+        return status;
     }
 
     Core::RunLoop();
 
+    // The window was closed, the profile is written while the core still exists
+    WriteProfile();
+    System::Shutdown();
     delete emu_window;
 
     return 0;
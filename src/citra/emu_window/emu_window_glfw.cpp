@@ -4,13 +4,45 @@
 
 #include "common/common.h"
 
+#include "core/core.h"
+#include "core/hle/service/hid.h"
+
 #include "video_core/video_core.h"
 
 #include "citra/citra.h"
 #include "citra/emu_window/emu_window_glfw.h"
 
-static void OnKeyEvent(GLFWwindow* win, int key, int action) {
-    // TODO(bunnei): ImplementMe
+/// Keyboard keys of the pad buttons
+static const struct {
+    int key;
+    u32 button;
+} s_key_map[] = {
+    { GLFW_KEY_X,               HID_User::PAD_A },
+    { GLFW_KEY_Z,               HID_User::PAD_B },
+    { GLFW_KEY_S,               HID_User::PAD_X },
+    { GLFW_KEY_A,               HID_User::PAD_Y },
+    { GLFW_KEY_Q,               HID_User::PAD_L },
+    { GLFW_KEY_W,               HID_User::PAD_R },
+    { GLFW_KEY_ENTER,           HID_User::PAD_START },
+    { GLFW_KEY_RIGHT_SHIFT,     HID_User::PAD_SELECT },
+    { GLFW_KEY_UP,              HID_User::PAD_UP },
+    { GLFW_KEY_DOWN,            HID_User::PAD_DOWN },
+    { GLFW_KEY_LEFT,            HID_User::PAD_LEFT },
+    { GLFW_KEY_RIGHT,           HID_User::PAD_RIGHT },
+};
+
+static void OnKeyEvent(GLFWwindow* win, int key, int scancode, int action, int mods) {
+    static u32 pad_state = 0;
+    for (const auto& it : s_key_map) {
+        if (it.key == key) {
+            if (action == GLFW_PRESS) {
+                pad_state |= it.button;
+            } else if (action == GLFW_RELEASE) {
+                pad_state &= ~it.button;
+            }
+            HID_User::SetPadState(pad_state);
+        }
+    }
 }
 
 static void OnWindowSizeEvent(GLFWwindow* win, int width, int height) {
@@ -39,11 +71,16 @@ EmuWindow_GLFW::EmuWindow_GLFW() {
         exit(1);
     }
     
-    // Setup callbacks
+    // Setup callbacks, frames are scaled to fill the window
     glfwSetWindowUserPointer(m_render_window, this);
-    //glfwSetKeyCallback(m_render_window, OnKeyEvent);
-    //glfwSetWindowSizeCallback(m_render_window, OnWindowSizeEvent);
+    glfwSetKeyCallback(m_render_window, OnKeyEvent);
+    glfwSetWindowSizeCallback(m_render_window, OnWindowSizeEvent);
+    SetClientAreaWidth(VideoCore::kScreenTopWidth);
+    SetClientAreaHeight(VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight);
 
+    // Swapping buffers waits for the display to refresh, which paces the presenter thread
+    MakeCurrent();
+    glfwSwapInterval(1);
     DoneCurrent();
 }
 
@@ -60,6 +97,10 @@ void EmuWindow_GLFW::SwapBuffers() {
 /// Polls window events
 void EmuWindow_GLFW::PollEvents() {
     glfwPollEvents();
+    // citra shuts the system down once the CPU loop returns
+    if (glfwWindowShouldClose(m_render_window)) {
+        Core::Stop();
+    }
 }
 
 /// Makes the GLFW OpenGL context current for the caller thread
@@ -0,0 +1,33 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/emu_window.h"
+
+/// Window of batch runs with no display, used with the headless renderer
+class EmuWindow_Headless : public EmuWindow {
+public:
+    EmuWindow_Headless() {
+    }
+
+    ~EmuWindow_Headless() {
+    }
+
+    /// Swap buffers to display the next frame
+    void SwapBuffers() {
+    }
+
+    /// Polls window events
+    void PollEvents() {
+    }
+
+    /// Makes the graphics context current for the caller thread, there is none
+    void MakeCurrent() {
+    }
+
+    /// Releases the graphics context from the caller thread, there is none
+    void DoneCurrent() {
+    }
+};
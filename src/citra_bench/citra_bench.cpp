@@ -0,0 +1,530 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/log_manager.h"
+#include "common/timer.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/arm/arm_interface.h"
+#include "core/hle/hle.h"
+#include "core/hle/svc.h"
+#include "core/hw/gpu.h"
+#include "core/hw/hw.h"
+
+#include "video_core/texture_decoder.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+enum {
+    CODE_VADDR      = 0x08000000,   ///< Each kernel has its page of code from here, on the heap
+    CODE_STRIDE     = 0x00001000,
+    DATA_VADDR      = 0x08100000,   ///< Buffer the kernels load from and store to
+    DATA_SIZE       = 0x00010000,
+    COPY_VADDR      = 0x08110000,   ///< Destination of the LDM/STM copy
+    SLICE           = 100000,       ///< Instructions per Run, as the emulation loop slices them
+    WARM_UP         = 1000000,      ///< Instructions run before the timing, to fill the caches
+    DEFAULT_INSTRUCTIONS = 50000000,
+    DEFAULT_ACCESSES     = 20000000,
+    DEFAULT_DECODES      = 200,
+    TEXTURE_SIZE         = 512,     ///< Width and height of the textures decoded
+};
+
+/// Hand-assembled guest kernel, an endless loop run for a number of instructions
+struct Kernel {
+    const char* name;
+    const char* description;
+    const u32*  code;
+    size_t      num_words;
+    void        (*setup)(ThreadContext& ctx);   ///< Sets up the registers the loop starts with
+};
+
+// ALU: data processing with immediate and shifted register operands
+const u32 kAluCode[] = {
+    0xE0800001,     // add  r0, r0, r1
+    0xE0222180,     // eor  r2, r2, r0, lsl #3
+    0xE04330A2,     // sub  r3, r3, r2, lsr #1
+    0xE1844003,     // orr  r4, r4, r3
+    0xE20450FF,     // and  r5, r4, #0xFF
+    0xE1A003E0,     // mov  r0, r0, ror #7
+    0xE2911001,     // adds r1, r1, #1
+    0xEAFFFFF7,     // b    loop
+};
+
+// Load/store: words, bytes and halfwords streamed through the data buffer
+const u32 kLoadStoreCode[] = {
+    0xE5902000,     // ldr  r2, [r0]
+    0xE5903004,     // ldr  r3, [r0, #4]
+    0xE0822003,     // add  r2, r2, r3
+    0xE5802008,     // str  r2, [r0, #8]
+    0xE5D0400C,     // ldrb r4, [r0, #12]
+    0xE1C040BE,     // strh r4, [r0, #14]
+    0xE2800010,     // add  r0, r0, #16
+    0xE1500001,     // cmp  r0, r1
+    0x21A00005,     // movhs r0, r5
+    0xEAFFFFF5,     // b    loop
+};
+
+// Branches: a conditional branch taken every other iteration, a call and its return
+const u32 kBranchCode[] = {
+    0xE2112001,     // ands r2, r1, #1
+    0x1A000001,     // bne  odd
+    0xE2833001,     // add  r3, r3, #1
+    0xEA000000,     // b    call
+    0xE2433001,     // odd: sub r3, r3, #1
+    0xEB000002,     // call: bl func
+    0xE2811001,     // add  r1, r1, #1
+    0xEAFFFFF7,     // b    loop
+    0xE1A00000,     // nop
+    0xE0244001,     // func: eor r4, r4, r1
+    0xE12FFF1E,     // bx   lr
+};
+
+// Thumb: the ALU loop of Thumb code, entered through a BX from ARM. The loop closes with a BX too,
+// the interpreter asserts on the Thumb B it handles as a branch of its own.
+const u32 kThumbCode[] = {
+    0xE28F7001,     // add  r7, pc, #1
+    0xE12FFF17,     // bx   r7
+    0x00C21840,     // adds r0, r0, r1          lsls r2, r0, #3
+    0x1E5C4053,     // eors r3, r2              subs r4, r3, #1
+    0x3101400C,     // ands r4, r1              adds r1, #1
+    0x46C04738,     // bx   r7                  nop
+};
+
+// VFP: single and double precision arithmetic, with a multiply-accumulate
+const u32 kVfpCode[] = {
+    0xEE300A20,     // vadd.f32 s0, s0, s1
+    0xEE201A21,     // vmul.f32 s2, s0, s3
+    0xEE312A60,     // vsub.f32 s4, s2, s1
+    0xEE422A21,     // vmla.f32 s5, s4, s3
+    0xEE388B09,     // vadd.f64 d8, d8, d9
+    0xEE28AB09,     // vmul.f64 d10, d8, d9
+    0xEAFFFFF8,     // b        loop
+};
+
+// LDM/STM: a block copy of eight registers at a time out of the data buffer
+const u32 kLoadStoreMultipleCode[] = {
+    0xE8B003FC,     // ldmia r0!, {r2-r9}
+    0xE8A103FC,     // stmia r1!, {r2-r9}
+    0xE150000A,     // cmp   r0, r10
+    0x21A0000B,     // movhs r0, r11
+    0x21A0100C,     // movhs r1, r12
+    0xEAFFFFF9,     // b     loop
+};
+
+void SetupAlu(ThreadContext& ctx) {
+    ctx.cpu_registers[1] = 0x12345678;
+}
+
+void SetupLoadStore(ThreadContext& ctx) {
+    ctx.cpu_registers[0] = DATA_VADDR;
+    ctx.cpu_registers[1] = DATA_VADDR + DATA_SIZE;
+    ctx.cpu_registers[5] = DATA_VADDR;
+}
+
+void SetupBranch(ThreadContext& ctx) {
+}
+
+void SetupThumb(ThreadContext& ctx) {
+    ctx.cpu_registers[1] = 0x12345678;
+}
+
+void SetupVfp(ThreadContext& ctx) {
+    const float singles[] = { 1.0f, 1e-7f, 0.0f, 0.999f, 0.0f, 0.0f };
+    const double doubles[] = { 1.0, 1.0000001 };
+    memcpy(&ctx.fpu_registers[0], singles, sizeof(singles));
+    memcpy(&ctx.fpu_registers[16], doubles, sizeof(doubles));
+    ctx.fpexc = 0x40000000;     // VFP enabled
+}
+
+void SetupLoadStoreMultiple(ThreadContext& ctx) {
+    ctx.cpu_registers[0] = DATA_VADDR;
+    ctx.cpu_registers[1] = COPY_VADDR;
+    ctx.cpu_registers[10] = DATA_VADDR + DATA_SIZE / 2;
+    ctx.cpu_registers[11] = DATA_VADDR;
+    ctx.cpu_registers[12] = COPY_VADDR;
+}
+
+#define KERNEL(name, description, code, setup) { name, description, code, ARRAY_SIZE(code), setup }
+
+const Kernel kKernels[] = {
+    KERNEL("alu",       "ARM data processing",      kAluCode,               SetupAlu),
+    KERNEL("ldst",      "ARM loads and stores",     kLoadStoreCode,         SetupLoadStore),
+    KERNEL("branch",    "ARM branches and calls",   kBranchCode,            SetupBranch),
+    KERNEL("thumb",     "Thumb data processing",    kThumbCode,             SetupThumb),
+    KERNEL("vfp",       "VFP arithmetic",           kVfpCode,               SetupVfp),
+    KERNEL("ldm",       "ARM LDM/STM block copy",   kLoadStoreMultipleCode, SetupLoadStoreMultiple),
+};
+
+#undef KERNEL
+
+/**
+ * Runs a kernel and measures its speed
+ * @param index Index of the kernel in kKernels, which gives the page of its code
+ * @param num_instructions Number of instructions to time, after the warm-up
+ * @param seconds Receives the time they took
+ * @return Number of instructions the core ran in that time
+ */
+u64 RunKernel(int index, u64 num_instructions, double& seconds) {
+    const Kernel& kernel = kKernels[index];
+    const u32 code_vaddr = CODE_VADDR + index * CODE_STRIDE;
+    for (size_t i = 0; i < kernel.num_words; i++) {
+        Memory::Write32(code_vaddr + i * 4, kernel.code[i]);
+    }
+
+    // The core keeps a pointer to the context it loaded, for the lazy VFP switch
+    static ThreadContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.pc = code_vaddr;
+    ctx.cpsr = 0x10;            // User mode, ARM state
+    ctx.sp = DATA_VADDR;
+    kernel.setup(ctx);
+    Core::g_app_core->LoadContext(ctx);
+
+    for (u64 run = 0; run < WARM_UP; run += SLICE) {
+        Core::g_app_core->Run(SLICE);
+    }
+
+    const u64 start_instructions = Core::g_app_core->GetNumInstructions();
+    const u64 start = Common::Timer::GetTimeUs();
+    for (u64 run = 0; run < num_instructions; run += SLICE) {
+        Core::g_app_core->Run((int)std::min<u64>(SLICE, num_instructions - run));
+    }
+    seconds = (Common::Timer::GetTimeUs() - start) / 1e6;
+    return Core::g_app_core->GetNumInstructions() - start_instructions;
+}
+
+/// Guest region the memory benchmark accesses through Memory::Read* and Memory::Write*
+struct MemoryRegion {
+    const char* name;
+    u32         vaddr;
+    u32         size;           ///< Power of two, the accesses wrap around in it
+    bool        writable;
+    bool        words_only;     ///< Whether the handler only decodes 32-bit accesses
+};
+
+const MemoryRegion kMemoryRegions[] = {
+    { "exefs",      Memory::EXEFS_CODE_VADDR,     0x10000, true,  false },
+    { "system",     Memory::SYSTEM_MEMORY_VADDR,  0x10000, true,  false },
+    { "heap",       Memory::HEAP_VADDR,           0x10000, true,  false },
+    { "shared",     Memory::SHARED_MEMORY_VADDR,  0x10000, true,  false },
+    { "gsp_heap",   Memory::HEAP_GSP_VADDR,       0x10000, true,  false },
+    { "vram",       Memory::VRAM_VADDR,           0x10000, true,  false },
+    { "config",     Memory::CONFIG_MEMORY_VADDR,  0x1000,  false, false },
+    // Handler region, on one register it decodes, HW only decodes the first page of the GPU
+    { "io",         GPU::Registers::FramebufferTopLeft1, 4, false, true },
+};
+
+/// Kind of access the memory benchmark makes
+enum AccessKind {
+    ACCESS_READ8, ACCESS_READ16, ACCESS_READ32, ACCESS_WRITE8, ACCESS_WRITE16, ACCESS_WRITE32,
+    NUM_ACCESS_KINDS,
+};
+
+const char* const kAccessKindNames[NUM_ACCESS_KINDS] = {
+    "read8", "read16", "read32", "write8", "write16", "write32",
+};
+
+/**
+ * Makes accesses of one kind to a region and measures their speed
+ * @param region Region accessed, sequentially and wrapping around
+ * @param kind Kind of the accesses
+ * @param num_accesses Number of accesses
+ * @return Time they took in seconds
+ */
+double RunMemoryAccesses(const MemoryRegion& region, AccessKind kind, u64 num_accesses) {
+    static const int sizes[NUM_ACCESS_KINDS] = { 1, 2, 4, 1, 2, 4 };
+    const u32 mask = region.size - 1;
+    const u32 size = sizes[kind];
+
+    // The sum of what was read is kept, so that the reads can't be left out
+    u32 sum = 0;
+    u32 offset = 0;
+    const u64 start = Common::Timer::GetTimeUs();
+    switch (kind) {
+    case ACCESS_READ8:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            sum += Memory::Read8(region.vaddr + offset);
+        break;
+    case ACCESS_READ16:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            sum += Memory::Read16(region.vaddr + offset);
+        break;
+    case ACCESS_READ32:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            sum += Memory::Read32(region.vaddr + offset);
+        break;
+    case ACCESS_WRITE8:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            Memory::Write8(region.vaddr + offset, (u8)i);
+        break;
+    case ACCESS_WRITE16:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            Memory::Write16(region.vaddr + offset, (u16)i);
+        break;
+    case ACCESS_WRITE32:
+        for (u64 i = 0; i < num_accesses; i++, offset = (offset + size) & mask)
+            Memory::Write32(region.vaddr + offset, (u32)i);
+        break;
+    default:
+        break;
+    }
+    const double seconds = (Common::Timer::GetTimeUs() - start) / 1e6;
+
+    static volatile u32 sink;
+    sink = sum;
+    return seconds;
+}
+
+typedef Pica::TextureDecoder::TextureFormat TextureFormat;
+
+/// Guest texture format the texture benchmark decodes
+struct TextureFormatInfo {
+    const char*     name;
+    TextureFormat   format;
+};
+
+const TextureFormatInfo kTextureFormats[] = {
+    { "rgba8",  TextureFormat::RGBA8 },
+    { "rgb8",   TextureFormat::RGB8 },
+    { "rgb5a1", TextureFormat::RGB5A1 },
+    { "rgb565", TextureFormat::RGB565 },
+    { "rgba4",  TextureFormat::RGBA4 },
+    { "ia8",    TextureFormat::IA8 },
+    { "rg8",    TextureFormat::RG8 },
+    { "i8",     TextureFormat::I8 },
+    { "a8",     TextureFormat::A8 },
+    { "ia4",    TextureFormat::IA4 },
+    { "i4",     TextureFormat::I4 },
+    { "a4",     TextureFormat::A4 },
+    { "etc1",   TextureFormat::ETC1 },
+    { "etc1a4", TextureFormat::ETC1A4 },
+};
+
+/**
+ * Decodes a texture of random texels over and over and measures the speed of the decoder
+ * @param format Format of the texture
+ * @param num_decodes Number of times to decode it
+ * @return Time the decodes took in seconds
+ */
+double RunTextureDecodes(TextureFormat format, u64 num_decodes) {
+    // Random data is a valid texture of any format, ETC1 blocks included
+    std::vector<u8> data(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+    std::vector<u8> texels(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+    u32 seed = 0x12345678;
+    for (u8& byte : data) {
+        seed = seed * 1103515245 + 12345;
+        byte = (u8)(seed >> 16);
+    }
+
+    Pica::TextureDecoder::Decode(data.data(), TEXTURE_SIZE, TEXTURE_SIZE, format, texels.data());
+    const u64 start = Common::Timer::GetTimeUs();
+    for (u64 i = 0; i < num_decodes; i++) {
+        Pica::TextureDecoder::Decode(data.data(), TEXTURE_SIZE, TEXTURE_SIZE, format,
+            texels.data());
+    }
+    return (Common::Timer::GetTimeUs() - start) / 1e6;
+}
+
+/**
+ * Tells whether a kernel or region was asked for on the command line
+ * @param name Name of the kernel or region
+ * @param argc Number of names, plus one
+ * @param argv Names, from argv[1]
+ * @return True if it was, or if none were
+ */
+bool IsSelected(const char* name, int argc, char** argv) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs the memory benchmark on the regions asked for
+ * @return Number of regions run
+ */
+int RunMemoryBenchmark(u64 num_accesses, bool csv, int argc, char** argv) {
+    if (csv) {
+        printf("region,access,accesses,seconds,maccesses\n");
+    }
+    int num_run = 0;
+    for (int i = 0; i < (int)ARRAY_SIZE(kMemoryRegions); i++) {
+        const MemoryRegion& region = kMemoryRegions[i];
+        if (!IsSelected(region.name, argc, argv)) {
+            continue;
+        }
+        for (int kind = 0; kind < NUM_ACCESS_KINDS; kind++) {
+            const bool write = kind >= ACCESS_WRITE8;
+            const bool word = kind == ACCESS_READ32 || kind == ACCESS_WRITE32;
+            if ((write && !region.writable) || (!word && region.words_only)) {
+                continue;
+            }
+            const double seconds = RunMemoryAccesses(region, (AccessKind)kind, num_accesses);
+            const double maccesses = seconds > 0 ? num_accesses / seconds / 1e6 : 0;
+            if (csv) {
+                printf("%s,%s,%llu,%.6f,%.3f\n", region.name, kAccessKindNames[kind],
+                    (unsigned long long)num_accesses, seconds, maccesses);
+            } else {
+                printf("%-8s %-8s %9.3f M accesses/s (%llu in %.3f s)\n", region.name,
+                    kAccessKindNames[kind], maccesses, (unsigned long long)num_accesses,
+                    seconds);
+            }
+        }
+        num_run++;
+    }
+    return num_run;
+}
+
+/**
+ * Runs the texture benchmark on the formats asked for
+ * @return Number of formats run
+ */
+int RunTextureBenchmark(u64 num_decodes, bool csv, int argc, char** argv) {
+    if (csv) {
+        printf("format,decodes,seconds,mtexels\n");
+    }
+    const u64 num_texels = num_decodes * TEXTURE_SIZE * TEXTURE_SIZE;
+    int num_run = 0;
+    for (int i = 0; i < (int)ARRAY_SIZE(kTextureFormats); i++) {
+        const TextureFormatInfo& info = kTextureFormats[i];
+        if (!IsSelected(info.name, argc, argv)) {
+            continue;
+        }
+        const double seconds = RunTextureDecodes(info.format, num_decodes);
+        const double mtexels = seconds > 0 ? num_texels / seconds / 1e6 : 0;
+        if (csv) {
+            printf("%s,%llu,%.6f,%.3f\n", info.name, (unsigned long long)num_decodes, seconds,
+                mtexels);
+        } else {
+            printf("%-8s %9.3f M texels/s (%llu %dx%d decodes in %.3f s)\n", info.name, mtexels,
+                (unsigned long long)num_decodes, TEXTURE_SIZE, TEXTURE_SIZE, seconds);
+        }
+        num_run++;
+    }
+    return num_run;
+}
+
+/**
+ * Runs the CPU kernels asked for
+ * @return Number of kernels run
+ */
+int RunCPUBenchmark(u64 num_instructions, bool csv, int argc, char** argv) {
+    if (csv) {
+        printf("kernel,core,instructions,seconds,mips\n");
+    }
+    const char* core = Core::g_cpu_backend.c_str();
+    int num_run = 0;
+    for (int i = 0; i < (int)ARRAY_SIZE(kKernels); i++) {
+        const Kernel& kernel = kKernels[i];
+        if (!IsSelected(kernel.name, argc, argv)) {
+            continue;
+        }
+
+        double seconds;
+        const u64 instructions = RunKernel(i, num_instructions, seconds);
+        const double mips = seconds > 0 ? instructions / seconds / 1e6 : 0;
+        if (csv) {
+            printf("%s,%s,%llu,%.6f,%.3f\n", kernel.name, core, (unsigned long long)instructions,
+                seconds, mips);
+        } else {
+            printf("%-8s %-24s %9.3f MIPS (%llu instructions in %.3f s)\n", kernel.name,
+                kernel.description, mips, (unsigned long long)instructions, seconds);
+        }
+        num_run++;
+    }
+    return num_run;
+}
+
+} // namespace
+
+/// Measures the speed of the CPU core on hand-assembled guest kernels, in MIPS, of the guest
+/// memory accesses of every region or of the texture decoders
+int __cdecl main(int argc, char **argv) {
+    LogManager::Init();
+
+    // Leading options: --jit measures the JIT instead of the interpreter, --instructions <count>
+    // sets the number of instructions timed per kernel, --memory measures Memory::Read* and
+    // Memory::Write* on every region instead, --accesses <count> sets the number of accesses
+    // timed per region and kind, --textures measures the texture decoders on every format
+    // instead, --decodes <count> sets the number of decodes timed per format, --csv prints one
+    // comma-separated line per measure for scripts comparing runs. The arguments left name the
+    // kernels, regions or formats to run, all of them by default.
+    Core::g_cpu_backend = "interpreter";
+    u64 num_instructions = DEFAULT_INSTRUCTIONS;
+    u64 num_accesses = DEFAULT_ACCESSES;
+    u64 num_decodes = DEFAULT_DECODES;
+    bool memory = false;
+    bool textures = false;
+    bool csv = false;
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--jit") == 0) {
+            Core::g_cpu_backend = "jit";
+        } else if (strcmp(argv[1], "--instructions") == 0 && argc >= 3) {
+            num_instructions = std::max(strtoull(argv[2], NULL, 0), (unsigned long long)SLICE);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--memory") == 0) {
+            memory = true;
+        } else if (strcmp(argv[1], "--accesses") == 0 && argc >= 3) {
+            num_accesses = std::max(strtoull(argv[2], NULL, 0), 1ULL);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--textures") == 0) {
+            textures = true;
+        } else if (strcmp(argv[1], "--decodes") == 0 && argc >= 3) {
+            num_decodes = std::max(strtoull(argv[2], NULL, 0), 1ULL);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--csv") == 0) {
+            csv = true;
+        } else {
+            ERROR_LOG(BOOT, "Unknown option %s", argv[1]);
+        }
+        argv++;
+        argc--;
+    }
+
+    // Only the modules the CPU core and the memory accesses run through, the kernels make no SVCs
+    CoreTiming::Init();
+    Memory::Init();
+    HW::Init();
+    HLE::Init();
+    Core::Init();
+
+    int num_run;
+    if (textures) {
+        num_run = RunTextureBenchmark(num_decodes, csv, argc, argv);
+    } else if (memory) {
+        num_run = RunMemoryBenchmark(num_accesses, csv, argc, argv);
+    } else {
+        num_run = RunCPUBenchmark(num_instructions, csv, argc, argv);
+    }
+    if (num_run == 0) {
+        ERROR_LOG(BOOT, "Nothing of that name to run");
+    }
+
+    Core::Shutdown();
+    HLE::Shutdown();
+    HW::Shutdown();
+    Memory::Shutdown();
+    CoreTiming::Shutdown();
+    return num_run > 0 ? 0 : 1;
+}
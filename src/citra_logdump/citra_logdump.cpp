@@ -0,0 +1,19 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+
+#include "common/common.h"
+#include "common/log_manager.h"
+
+/// Prints a binary log written by citra --binary-log, one message per line as in the text log
+int __cdecl main(int argc, char **argv) {
+    LogManager::Init();
+
+    if (argc < 2) {
+        ERROR_LOG(BOOT, "No binary log specified");
+        return 1;
+    }
+    return LogManager::DecodeBinaryLog(argv[1], stdout) ? 0 : 1;
+}
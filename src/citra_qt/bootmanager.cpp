@@ -1,12 +1,18 @@
 #include <QHBoxLayout>
 #include <QKeyEvent>
+#include <QResizeEvent>
 
 #include "common/common.h"
 #include "bootmanager.hxx"
 
 #include "core/core.h"
 #include "core/loader.h"
-#include "core/hw/hw.h"
+#include "core/mem_map.h"
+#include "core/movie.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
+#include "core/arm/arm_interface.h"
+#include "core/hle/service/hid.h"
 
 #include "video_core/video_core.h"
 
@@ -17,8 +23,39 @@
 #define APP_TITLE       APP_NAME " " APP_VERSION
 #define COPYRIGHT       "Copyright (C) 2013-2014 Citra Team"
 
-EmuThread::EmuThread(GRenderWindow* render_window) : exec_cpu_step(false), cpu_running(false), render_window(render_window)
+/**
+ * Reads a word through the page table, where I/O registers aren't mapped
+ *
+ * @param address Address of the word, word aligned
+ * @return The word, zero if its page isn't mapped
+ */
+static u32 PeekMemory32(u32 address)
 {
+    const u8* page = Memory::g_page_table[address >> Memory::PAGE_BITS];
+    if (page == NULL)
+        return 0;
+    u32 value;
+    memcpy(&value, page + (address & Memory::PAGE_MASK), sizeof(value));
+    return value;
+}
+
+u32 CpuSnapshot::Read32(u32 address) const
+{
+    if (address - stack_address < STACK_WORDS * 4)
+        return stack[(address - stack_address) / 4];
+    if (address - code_address < CODE_WORDS * 4)
+        return code[(address - code_address) / 4];
+    return PeekMemory32(address);
+}
+
+u16 CpuSnapshot::Read16(u32 address) const
+{
+    return (u16)(Read32(address & ~3) >> ((address & 2) * 8));
+}
+
+EmuThread::EmuThread(GRenderWindow* render_window) : exec_cpu_step(false), cpu_running(false), request(REQUEST_NONE), request_frame(0), step_back(false), generation(0), render_window(render_window)
+{
+    Core::g_breakpoints = &breakpoints;
 }
 
 void EmuThread::SetFilename(const char* filename)
@@ -26,23 +63,182 @@ void EmuThread::SetFilename(const char* filename)
     strcpy(this->filename, filename);
 }
 
+bool EmuThread::ToggleBreakPoint(u32 address)
+{
+    QMutexLocker lock(&breakpoints_mutex);
+    if (breakpoints.IsAddressBreakPoint(address))
+    {
+        breakpoints.Remove(address);
+        Core::InvalidateBreakPoint(address);
+        return false;
+    }
+    breakpoints.Add(address);
+    Core::InvalidateBreakPoint(address);
+    return true;
+}
+
+void EmuThread::Publish()
+{
+    // Filled on the emu thread's stack, the readers never see it half written
+    ARM_Interface* app_core = Core::g_app_core;
+    CpuSnapshot snapshot;
+    snapshot.generation = generation.load(std::memory_order_relaxed) + 1;
+    for (int i = 0; i < 16; ++i)
+        snapshot.regs[i] = app_core->GetReg(i);
+    snapshot.cpsr = app_core->GetCPSR();
+    snapshot.pc = app_core->GetPC();
+
+    snapshot.stack_address = snapshot.regs[13] & ~3;
+    for (int i = 0; i < CpuSnapshot::STACK_WORDS; ++i)
+        snapshot.stack[i] = PeekMemory32(snapshot.stack_address + i * 4);
+    snapshot.code_address = (snapshot.pc & ~3) - CpuSnapshot::CODE_WORDS / 2 * 4;
+    for (int i = 0; i < CpuSnapshot::CODE_WORDS; ++i)
+        snapshot.code[i] = PeekMemory32(snapshot.code_address + i * 4);
+
+    published.Write(snapshot);
+    generation.store(snapshot.generation, std::memory_order_release);
+}
+
+void EmuThread::SaveState(const QString& filename)
+{
+    PostRequest(REQUEST_SAVE_STATE, filename);
+}
+
+void EmuThread::LoadState(const QString& filename)
+{
+    PostRequest(REQUEST_LOAD_STATE, filename);
+}
+
+void EmuThread::RecordMovie(const QString& filename)
+{
+    PostRequest(REQUEST_RECORD_MOVIE, filename);
+}
+
+void EmuThread::PlayMovie(const QString& filename)
+{
+    PostRequest(REQUEST_PLAY_MOVIE, filename);
+}
+
+void EmuThread::StopMovie()
+{
+    PostRequest(REQUEST_STOP_MOVIE);
+}
+
+void EmuThread::SeekMovie(int frame)
+{
+    PostRequest(REQUEST_SEEK_MOVIE, QString(), frame);
+}
+
+void EmuThread::SetProfiling(bool enable)
+{
+    PostRequest(enable ? REQUEST_ENABLE_PROFILING : REQUEST_DISABLE_PROFILING);
+}
+
+void EmuThread::SaveProfile(const QString& filename)
+{
+    PostRequest(REQUEST_SAVE_PROFILE, filename);
+}
+
+void EmuThread::PostRequest(Request request, const QString& filename, int frame)
+{
+    QMutexLocker lock(&request_mutex);
+    this->request = request;
+    request_filename = filename;
+    request_frame = frame;
+}
+
+void EmuThread::RunRequest()
+{
+    // Savestates and movies are taken between two slices, where the whole system is consistent.
+    // The profiler is only sampled by the running CPU, so it's changed and read here as well.
+    QMutexLocker lock(&request_mutex);
+    const std::string filename = request_filename.toStdString();
+    switch (request)
+    {
+    case REQUEST_SAVE_STATE:
+        SaveState::BeginSave(filename);
+        break;
+    case REQUEST_LOAD_STATE:
+        SaveState::Load(filename);
+        Publish();
+        break;
+    case REQUEST_RECORD_MOVIE:
+        Movie::StartRecording(filename);
+        break;
+    case REQUEST_PLAY_MOVIE:
+        Movie::StartPlayback(filename);
+        break;
+    case REQUEST_STOP_MOVIE:
+        Movie::Stop();
+        break;
+    case REQUEST_SEEK_MOVIE:
+        // Runs unthrottled until the CPU stops at the frame
+        Movie::Seek(request_frame);
+        break;
+    case REQUEST_ENABLE_PROFILING:
+        Core::g_app_core->EnableProfiling();
+        break;
+    case REQUEST_DISABLE_PROFILING:
+        Core::g_app_core->DisableProfiling();
+        break;
+    case REQUEST_SAVE_PROFILE:
+    {
+        const ARM_Profiler* profiler = Core::g_app_core->GetProfiler();
+        if (profiler == NULL || !profiler->WriteFlatProfile(filename) ||
+            !profiler->WritePprofProfile(filename + ".pprof"))
+            emit ProfileSaveFailed();
+        break;
+    }
+    default:
+        break;
+    }
+    request = REQUEST_NONE;
+}
+
 void EmuThread::run()
 {
+    // The debugger views show the state the game booted with until the CPU runs
+    Publish();
     while (true)
     {
-        for (int tight_loop = 0; tight_loop < 10000; ++tight_loop)
+        RunRequest();
+        if (step_back)
         {
-            if (cpu_running || exec_cpu_step)
+            step_back = false;
+            if (Rewind::StepBack())
             {
-                if (exec_cpu_step)
-                    exec_cpu_step = false;
-
-                Core::SingleStep();
+                Publish();
                 if (!cpu_running)
                     emit CPUStepped();
             }
         }
-        HW::Update();
+
+        if (cpu_running)
+        {
+            // Whole slices up to the next event, as in the citra frontend
+            QMutexLocker lock(&breakpoints_mutex);
+            const bool stopped = Core::RunSlice();
+            Publish();
+            if (stopped)
+            {
+                cpu_running = false;
+                emit CPUStepped();
+            }
+        }
+        else if (exec_cpu_step)
+        {
+            exec_cpu_step = false;
+            QMutexLocker lock(&breakpoints_mutex);
+            Core::SingleStep();
+            Publish();
+            emit CPUStepped();
+        }
+        else
+        {
+            // Paused, wait for the debugger without burning a host core
+            SaveState::Update();
+            msleep(1);
+        }
     }
 
     Core::Stop();
@@ -71,26 +267,29 @@ void EmuThread::Stop()
 }
 
 
-// This class overrides paintEvent and resizeEvent to prevent the GUI thread from stealing GL context.
-// The corresponding functionality is handled in EmuThread instead
+// This class overrides paintEvent and resizeEvent to keep the GUI thread from ever touching the GL
+// context. All GL work happens on the thread owning the context: the presenter thread of the
+// renderer, or EmuThread when the hardware rasterizer draws there. Window events are posted to it
+// and handled before it next draws, so a resize neither waits for a frame nor stalls one.
 class GGLWidgetInternal : public QGLWidget
 {
 public:
     GGLWidgetInternal(QGLFormat fmt, GRenderWindow* parent) : QGLWidget(parent)
     {
+        setAutoBufferSwap(false);
         doneCurrent();
         parent_ = parent;
     }
 
     void paintEvent(QPaintEvent* ev)
     {
-        // Apparently, Windows doesn't display anything if we don't call this here.
-        // TODO: Breaks linux though because we aren't calling doneCurrent() ... -.-
-//        makeCurrent();
+        // The next frame presented repaints the widget
     }
     void resizeEvent(QResizeEvent* ev) {
-        parent_->SetClientAreaWidth(size().width());
-        parent_->SetClientAreaHeight(size().height());
+        GRenderWindow::RenderMessage message = {
+            GRenderWindow::RenderMessage::RESIZE, ev->size().width(), ev->size().height()
+        };
+        parent_->PostRenderMessage(message);
     }
 private:
     GRenderWindow* parent_;
@@ -102,7 +301,7 @@ EmuThread& GRenderWindow::GetEmuThread()
     return emu_thread;
 }
 
-GRenderWindow::GRenderWindow(QWidget* parent) : QWidget(parent), emu_thread(this)
+GRenderWindow::GRenderWindow(QWidget* parent) : QWidget(parent), emu_thread(this), pad_state(0)
 {
     // TODO: One of these flags might be interesting: WA_OpaquePaintEvent, WA_NoBackground, WA_DontShowOnScreen, WA_DeleteOnClose
     QGLFormat fmt;
@@ -118,6 +317,10 @@ GRenderWindow::GRenderWindow(QWidget* parent) : QWidget(parent), emu_thread(this
     layout->setMargin(0);
     setLayout(layout);
 
+    // No thread owns the context yet, the size is set until the first resize is handled
+    SetClientAreaWidth(child->width());
+    SetClientAreaHeight(child->height());
+
     BackupGeometry();
 }
 
@@ -128,7 +331,7 @@ GRenderWindow::~GRenderWindow()
 
 void GRenderWindow::SwapBuffers()
 {
-    child->makeCurrent(); // TODO: Not necessary?
+    // Called by the thread owning the context, it's current already
     child->swapBuffers();
 }
 
@@ -141,6 +344,35 @@ void GRenderWindow::closeEvent(QCloseEvent* event)
 void GRenderWindow::MakeCurrent()
 {
     child->makeCurrent();
+    ProcessRenderMessages();
+}
+
+void GRenderWindow::PostRenderMessage(const RenderMessage& message)
+{
+    QMutexLocker lock(&render_messages_mutex);
+    render_messages.enqueue(message);
+}
+
+void GRenderWindow::ProcessRenderMessages()
+{
+    // Taken all at once, the GUI thread never waits on the drawing
+    QQueue<RenderMessage> messages;
+    {
+        QMutexLocker lock(&render_messages_mutex);
+        messages.swap(render_messages);
+    }
+    while (!messages.isEmpty())
+    {
+        const RenderMessage message = messages.dequeue();
+        switch (message.type)
+        {
+        case RenderMessage::RESIZE:
+            // The renderer fits the screens to the client area every time it draws
+            SetClientAreaWidth(message.width);
+            SetClientAreaHeight(message.height);
+            break;
+        }
+    }
 }
 
 void GRenderWindow::DoneCurrent()
@@ -187,28 +419,52 @@ QByteArray GRenderWindow::saveGeometry()
         return geometry;
 }
 
+/// Keyboard keys of the pad buttons
+static const struct {
+    int key;
+    u32 button;
+} key_map[] = {
+    { Qt::Key_X,        HID_User::PAD_A },
+    { Qt::Key_Z,        HID_User::PAD_B },
+    { Qt::Key_S,        HID_User::PAD_X },
+    { Qt::Key_A,        HID_User::PAD_Y },
+    { Qt::Key_Q,        HID_User::PAD_L },
+    { Qt::Key_W,        HID_User::PAD_R },
+    { Qt::Key_Return,   HID_User::PAD_START },
+    { Qt::Key_Shift,    HID_User::PAD_SELECT },
+    { Qt::Key_Up,       HID_User::PAD_UP },
+    { Qt::Key_Down,     HID_User::PAD_DOWN },
+    { Qt::Key_Left,     HID_User::PAD_LEFT },
+    { Qt::Key_Right,    HID_User::PAD_RIGHT },
+};
+
 void GRenderWindow::keyPressEvent(QKeyEvent* event)
 {
-    /*
-    bool key_processed = false;
-    for (unsigned int channel = 0; channel < 4 && controller_interface(); ++channel)
-        if (controller_interface()->SetControllerStatus(channel, event->key(), input_common::GCController::PRESSED))
-            key_processed = true;
-
-    if (!key_processed)
-        QWidget::keyPressEvent(event);
-    */
+    for (const auto& it : key_map)
+    {
+        if (it.key == event->key())
+        {
+            pad_state |= it.button;
+            HID_User::SetPadState(pad_state);
+            return;
+        }
+    }
+    QWidget::keyPressEvent(event);
 }
 
 void GRenderWindow::keyReleaseEvent(QKeyEvent* event)
 {
-    /*
-    bool key_processed = false;
-    for (unsigned int channel = 0; channel < 4 && controller_interface(); ++channel)
-        if (controller_interface()->SetControllerStatus(channel, event->key(), input_common::GCController::RELEASED))
-            key_processed = true;
-
-    if (!key_processed)
-        QWidget::keyPressEvent(event);
-    */
+    for (const auto& it : key_map)
+    {
+        if (it.key == event->key())
+        {
+            if (!event->isAutoRepeat())
+            {
+                pad_state &= ~it.button;
+                HID_User::SetPadState(pad_state);
+            }
+            return;
+        }
+    }
+    QWidget::keyReleaseEvent(event);
 }
\ No newline at end of file
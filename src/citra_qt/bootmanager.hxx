@@ -1,11 +1,55 @@
+#include <atomic>
+
+#include <QMutex>
+#include <QQueue>
+#include <QString>
 #include <QThread>
 #include <QGLWidget>
 #include "common/common.h"
+#include "common/break_points.h"
+#include "common/seqlock.h"
 #include "common/emu_window.h"
 
 class GRenderWindow;
 class QKeyEvent;
 
+/**
+ * CPU state the emu thread publishes after each slice or step, for the debugger views to read
+ * from the GUI thread while the CPU runs. Memory is copied through the page table, unmapped
+ * words and I/O registers read as zero.
+ */
+struct CpuSnapshot
+{
+    enum {
+        STACK_WORDS     = 1024,         ///< Words of the stack copied, from SP up
+        CODE_WORDS      = 256,          ///< Words of code copied, centered on the PC
+    };
+
+    u32 generation;                 ///< Generation the state was published in
+    u32 regs[16];                   ///< R0 to R15
+    u32 cpsr;
+    u32 pc;                         ///< Address of the instruction about to run
+    u32 stack_address;              ///< Address of stack[0], the SP
+    u32 stack[STACK_WORDS];
+    u32 code_address;               ///< Address of code[0]
+    u32 code[CODE_WORDS];
+
+    /**
+     * Reads a word, from the windows copied when it's in them. Outside of them it's read through
+     * the page table as the CPU runs, which is only off for code the game rewrites meanwhile.
+     *
+     * @param address Address of the word, word aligned
+     */
+    u32 Read32(u32 address) const;
+
+    /**
+     * Reads a halfword, as Read32
+     *
+     * @param address Address of the halfword, halfword aligned
+     */
+    u16 Read16(u32 address) const;
+};
+
 class EmuThread : public QThread
 {
     Q_OBJECT
@@ -47,6 +91,102 @@ public:
     */
     bool IsCpuRunning() { return cpu_running; }
 
+    /**
+     * Sets a code breakpoint, or removes it if there is one at the address
+     *
+     * @param address Guest address of the instruction
+     * @return True if there is a breakpoint at the address now
+     * @note This function is thread-safe
+     */
+    bool ToggleBreakPoint(u32 address);
+
+    /**
+     * Saves the state to a file in the background, from the next pause between two CPU slices
+     *
+     * @param filename Path of the savestate
+     * @note This function is thread-safe
+     */
+    void SaveState(const QString& filename);
+
+    /**
+     * Loads the state from a file, at the next pause between two CPU slices
+     *
+     * @param filename Path of the savestate
+     * @note This function is thread-safe
+     */
+    void LoadState(const QString& filename);
+
+    /**
+     * Steps back to the last rewind snapshot, at the next pause between two CPU slices
+     *
+     * @note This function is thread-safe
+     */
+    void StepBack() { step_back = true; }
+
+    /**
+     * Starts recording an input movie, at the next pause between two CPU slices
+     *
+     * @param filename Path of the movie
+     * @note This function is thread-safe
+     */
+    void RecordMovie(const QString& filename);
+
+    /**
+     * Starts playing an input movie back, at the next pause between two CPU slices
+     *
+     * @param filename Path of the movie
+     * @note This function is thread-safe
+     */
+    void PlayMovie(const QString& filename);
+
+    /**
+     * Stops recording or playing back the movie, at the next pause between two CPU slices
+     *
+     * @note This function is thread-safe
+     */
+    void StopMovie();
+
+    /**
+     * Seeks the movie played back to a frame, the CPU stops once it gets there
+     *
+     * @param frame Frame to seek to
+     * @note This function is thread-safe
+     */
+    void SeekMovie(int frame);
+
+    /**
+     * Starts or stops sampling the app core with the ARM profiler, at the next pause between two
+     * CPU slices
+     *
+     * @param enable Whether to sample
+     * @note This function is thread-safe
+     */
+    void SetProfiling(bool enable);
+
+    /**
+     * Writes the flat and pprof profiles of the ARM profiler, at the next pause between two CPU
+     * slices so that the samples don't change meanwhile. ProfileSaveFailed is emitted if it fails.
+     *
+     * @param filename Path of the flat profile, the pprof one gets ".pprof" appended
+     * @note This function is thread-safe
+     */
+    void SaveProfile(const QString& filename);
+
+    /**
+     * Gets the number of times the CPU state changed, after a slice or a step, for the debugger
+     * views to poll at their own rate instead of refreshing on every change
+     *
+     * @note This function is thread-safe
+     */
+    u32 GetGeneration() const { return generation.load(std::memory_order_acquire); }
+
+    /**
+     * Gets the CPU state as of its last change, without waiting on the emulation
+     *
+     * @param snapshot Filled with the state
+     * @note This function is thread-safe
+     */
+    void GetSnapshot(CpuSnapshot& snapshot) const { published.Read(snapshot); }
 
 public slots:
     /**
@@ -67,6 +207,48 @@ private:
     bool exec_cpu_step;
     bool cpu_running;
 
+    BreakPoints breakpoints;        ///< Checked by the running CPU, guarded by breakpoints_mutex
+    QMutex breakpoints_mutex;
+
+    /// Savestate, movie and profiler operations, run between two CPU slices
+    enum Request {
+        REQUEST_NONE,
+        REQUEST_SAVE_STATE,
+        REQUEST_LOAD_STATE,
+        REQUEST_RECORD_MOVIE,
+        REQUEST_PLAY_MOVIE,
+        REQUEST_STOP_MOVIE,
+        REQUEST_SEEK_MOVIE,
+        REQUEST_ENABLE_PROFILING,
+        REQUEST_DISABLE_PROFILING,
+        REQUEST_SAVE_PROFILE,
+    };
+
+    /**
+     * Queues a savestate or movie operation, replacing the one not run yet
+     *
+     * @param request Operation to run
+     * @param filename Savestate or movie to operate on
+     * @param frame Frame to seek to
+     */
+    void PostRequest(Request request, const QString& filename = QString(), int frame = 0);
+
+    /// Runs the queued savestate or movie operation, if there is one
+    void RunRequest();
+
+    Request request;                ///< Guarded by request_mutex, as are its arguments
+    QString request_filename;
+    int request_frame;
+    QMutex request_mutex;
+
+    bool step_back;
+
+    /// Publishes the CPU state to the debugger views and bumps the generation
+    void Publish();
+
+    std::atomic<u32> generation;
+    Common::SeqLock<CpuSnapshot> published;
+
     GRenderWindow* render_window;
 
 signals:
@@ -77,6 +259,9 @@ signals:
      * @warning When connecting to this signal from other threads, make sure to specify either Qt::QueuedConnection (invoke slot within the destination object's message thread) or even Qt::BlockingQueuedConnection (additionally block source thread until slot returns)
      */
     void CPUStepped();
+
+    /// Emitted when SaveProfile couldn't write the profile
+    void ProfileSaveFailed();
 };
 
 class GRenderWindow : public QWidget, public EmuWindow
@@ -103,10 +288,40 @@ public:
     void keyPressEvent(QKeyEvent* event);
     void keyReleaseEvent(QKeyEvent* event);
 
+    /// Window event for the thread owning the GL context, the GUI thread never handles them itself
+    struct RenderMessage
+    {
+        enum Type
+        {
+            RESIZE,     ///< The GL widget got a new size
+        };
+
+        Type type;
+        int width;
+        int height;
+    };
+
+    /**
+     * Queues a window event for the thread owning the GL context, which handles it before it next
+     * draws. Never waits for that thread.
+     *
+     * @param message Event to queue
+     * @note This function is thread-safe
+     */
+    void PostRenderMessage(const RenderMessage& message);
+
 private:
+    /// Handles the window events queued, from the thread owning the GL context
+    void ProcessRenderMessages();
+
     QGLWidget* child;
 
+    QQueue<RenderMessage> render_messages;  ///< Guarded by render_messages_mutex
+    QMutex render_messages_mutex;
+
     EmuThread emu_thread;
 
     QByteArray geometry;
+
+    u32 pad_state;                  ///< Pad buttons held down on the keyboard
 };
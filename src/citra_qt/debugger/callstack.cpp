@@ -2,13 +2,13 @@
 
 #include "callstack.hxx"
 
-#include "core/core.h"
-#include "core/arm/arm_interface.h"
-#include "core/mem_map.h"
+#include "../bootmanager.hxx"
+
 #include "common/symbols.h"
+#include "core/arm/shadow_stack.h"
 #include "core/arm/disassembler/arm_disasm.h"
 
-CallstackWidget::CallstackWidget(QWidget* parent): QDockWidget(parent)
+CallstackWidget::CallstackWidget(QWidget* parent, EmuThread& emu_thread): QDockWidget(parent), emu_thread(emu_thread)
 {
     ui.setupUi(this);
 
@@ -19,48 +19,73 @@ CallstackWidget::CallstackWidget(QWidget* parent): QDockWidget(parent)
     callstack_model->setHeaderData(1, Qt::Horizontal, "Call address");
     callstack_model->setHeaderData(3, Qt::Horizontal, "Function");
     ui.treeView->setModel(callstack_model);
+
+    connect(this, SIGNAL(visibilityChanged(bool)), this, SLOT(OnVisibilityChanged(bool)));
+}
+
+void CallstackWidget::OnVisibilityChanged(bool visible)
+{
+    ShadowStack::SetEnabled(visible);
+}
+
+void CallstackWidget::SetRow(int row, u32 sp, u32 ret_addr, u32 call_addr, u32 func_addr)
+{
+    callstack_model->setItem(row, 0, new QStandardItem(QString("0x%1").arg(sp, 8, 16, QLatin1Char('0'))));
+    callstack_model->setItem(row, 1, new QStandardItem(QString("0x%1").arg(ret_addr, 8, 16, QLatin1Char('0'))));
+    callstack_model->setItem(row, 2, new QStandardItem(QString("0x%1").arg(call_addr, 8, 16, QLatin1Char('0'))));
+
+    std::string name = Symbols::HasSymbol(func_addr) ? Symbols::GetSymbol(func_addr).name : "unknown";
+    callstack_model->setItem(row, 3, new QStandardItem(QString("%1_%2").arg(QString::fromStdString(name))
+        .arg(QString("0x%1").arg(func_addr, 8, 16, QLatin1Char('0')))));
 }
 
 void CallstackWidget::OnCPUStepped()
 {
-    ARM_Disasm* disasm = new ARM_Disasm();
-    ARM_Interface* app_core = Core::g_app_core;
+    callstack_model->removeRows(0, callstack_model->rowCount());
 
-    u32 sp = app_core->GetReg(13); //stack pointer
-    u32 addr, ret_addr, call_addr, func_addr;
-    
-    int counter = 0;
-    for (int addr = 0x10000000; addr >= sp; addr -= 4)
+    // The shadow stack is exact and only as deep as the calls, innermost first
+    if (ShadowStack::IsEnabled())
     {
-        ret_addr = Memory::Read32(addr);
-        call_addr = ret_addr - 4; //get call address???
-
-        /* TODO (mattvail) clean me, move to debugger interface */
-        u32 insn = Memory::Read32(call_addr);
-        if (disasm->decode(insn) == OP_BL)
+        const std::vector<ShadowStack::Frame>& frames = ShadowStack::GetFrames();
+        for (int i = 0; i < (int)frames.size(); ++i)
         {
-            std::string name;
-            // ripped from disasm
-            uint8_t cond = (insn >> 28) & 0xf;
-            uint32_t i_offset = insn & 0xffffff;
-            // Sign-extend the 24-bit offset
-            if ((i_offset >> 23) & 1)
-                i_offset |= 0xff000000;
+            const ShadowStack::Frame& frame = frames[frames.size() - 1 - i];
+            SetRow(i, frame.sp, frame.return_address, frame.call_address, frame.function & ~1);
+        }
+        return;
+    }
 
-            // Pre-compute the left-shift and the prefetch offset
-            i_offset <<= 2;
-            i_offset += 8;
-            func_addr = call_addr + i_offset;
+    // Otherwise, guess from the words of the stack that look like return addresses, outermost
+    // first, as of the last state the emu thread published
+    CpuSnapshot snapshot;
+    emu_thread.GetSnapshot(snapshot);
+    u32 ret_addr, call_addr;
 
-            callstack_model->setItem(counter, 0, new QStandardItem(QString("0x%1").arg(addr, 8, 16, QLatin1Char('0'))));
-            callstack_model->setItem(counter, 1, new QStandardItem(QString("0x%1").arg(ret_addr, 8, 16, QLatin1Char('0'))));
-            callstack_model->setItem(counter, 2, new QStandardItem(QString("0x%1").arg(call_addr, 8, 16, QLatin1Char('0'))));
-            
-            name = Symbols::HasSymbol(func_addr) ? Symbols::GetSymbol(func_addr).name : "unknown";
-            callstack_model->setItem(counter, 3, new QStandardItem(QString("%1_%2").arg(QString::fromStdString(name))
-                .arg(QString("0x%1").arg(func_addr, 8, 16, QLatin1Char('0')))));
+    int counter = 0;
+    for (int i = CpuSnapshot::STACK_WORDS - 1; i >= 0; --i)
+    {
+        const u32 addr = snapshot.stack_address + i * 4;
+        if (addr > 0x10000000)
+            continue;
+        ret_addr = snapshot.stack[i];
 
+        // Return addresses of Thumb code have bit 0 set, their BL is a pair of halfwords
+        ARM_Instruction instr;
+        if (ret_addr & 1)
+        {
+            call_addr = (ret_addr & ~1) - 4;
+            ARM_Disasm::decode_insn_thumb(call_addr, snapshot.Read16(call_addr), snapshot.Read16(call_addr + 2), &instr);
+        }
+        else
+        {
+            call_addr = ret_addr - 4;
+            ARM_Disasm::decode_insn(call_addr, snapshot.Read32(call_addr), &instr);
+        }
+
+        if ((instr.flags & ARM_Instruction::kLink) && (instr.flags & ARM_Instruction::kBranch))
+        {
+            SetRow(counter, addr, ret_addr, call_addr, instr.target);
             counter++;
         }
     }
-}
\ No newline at end of file
+}
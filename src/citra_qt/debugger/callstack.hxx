@@ -1,19 +1,39 @@
 #include <QDockWidget>
 #include "../ui_callstack.h"
 
+#include "common/common_types.h"
+
 class QStandardItemModel;
+class EmuThread;
 
 class CallstackWidget : public QDockWidget
 {
     Q_OBJECT
 
 public:
-    CallstackWidget(QWidget* parent = 0);
+    CallstackWidget(QWidget* parent, EmuThread& emu_thread);
 
 public slots:
     void OnCPUStepped();
 
+private slots:
+    /// Has the CPU core keep shadow call stacks while the widget is shown
+    void OnVisibilityChanged(bool visible);
+
 private:
+    /**
+     * Adds a row for a call
+     *
+     * @param row Row of the call
+     * @param sp Stack pointer at the call
+     * @param ret_addr Return address of the call
+     * @param call_addr Address of the calling instruction
+     * @param func_addr Address called
+     */
+    void SetRow(int row, u32 sp, u32 ret_addr, u32 call_addr, u32 func_addr);
+
     Ui::CallStack ui;
     QStandardItemModel* callstack_model;
+
+    EmuThread& emu_thread;
 };
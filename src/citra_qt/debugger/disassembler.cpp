@@ -6,22 +6,159 @@
 #include "../hotkeys.hxx"
 
 #include "common/common.h"
-#include "core/mem_map.h"
 
 #include "core/core.h"
-#include "common/break_points.h"
 #include "common/symbols.h"
 #include "core/arm/interpreter/armdefs.h"
 #include "core/arm/disassembler/arm_disasm.h"
 
-DisassemblerWidget::DisassemblerWidget(QWidget* parent, EmuThread& emu_thread) : QDockWidget(parent), base_addr(0), emu_thread(emu_thread)
+DisassemblerModel::DisassemblerModel(QObject* parent)
+    : QAbstractItemModel(parent), base_address(0), current_address(0)
 {
-    disasm_ui.setupUi(this);
+    memset(&snapshot, 0, sizeof(snapshot));
+}
+
+QModelIndex DisassemblerModel::index(int row, int column, const QModelIndex& parent) const
+{
+    return createIndex(row, column);
+}
+
+QModelIndex DisassemblerModel::parent(const QModelIndex& child) const
+{
+    return QModelIndex();
+}
+
+int DisassemblerModel::columnCount(const QModelIndex& parent) const
+{
+    return 3;
+}
+
+int DisassemblerModel::rowCount(const QModelIndex& parent) const
+{
+    // Flat list, rows have no children
+    return parent.isValid() ? 0 : NUM_ROWS;
+}
+
+QVariant DisassemblerModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const u32 address = GetAddress(index.row());
+    if (role == Qt::DisplayRole)
+    {
+        switch (index.column()) {
+        case 0:
+            return QString("0x%1").arg(address, 8, 16, QLatin1Char('0'));
+        case 1:
+            return GetLine(address);
+        case 2:
+            if (Symbols::HasSymbol(address))
+            {
+                TSymbol symbol = Symbols::GetSymbol(address);
+                return QString("%1 - Size:%2").arg(QString::fromStdString(symbol.name))
+                                              .arg(symbol.size / 4); // divide by 4 to get instruction count
+            }
+            break;
+        }
+    }
+    else if (role == Qt::BackgroundRole && index.column() < 2)
+    {
+        if (breakpoints.count(address))
+            return QBrush(QColor(0xFF, 0x99, 0x99));
+        if (address == current_address)
+            return QBrush(QColor(0x99, 0xCC, 0xFF));
+    }
+    return QVariant();
+}
+
+/**
+ * Gets the disassembly of an instruction, decoding it unless the cache has it
+ * @param address Address of the instruction
+ * @return Disassembly, valid until the next call
+ */
+const QString& DisassemblerModel::GetLine(u32 address) const
+{
+    const u32 instruction = snapshot.Read32(address);
+    auto it = line_map.find(address);
+    if (it != line_map.end())
+    {
+        // Most recently used goes to the front, decoded again if the code changed meanwhile
+        lines.splice(lines.begin(), lines, it->second);
+        Line& line = lines.front();
+        if (line.instruction != instruction)
+        {
+            char result[255];
+            ARM_Disasm::disasm(address, instruction, result);
+            line.instruction = instruction;
+            line.text = QString(result);
+        }
+        return line.text;
+    }
+
+    if (lines.size() >= CACHE_CAPACITY)
+    {
+        line_map.erase(lines.back().address);
+        lines.pop_back();
+    }
+    char result[255];
+    ARM_Disasm::disasm(address, instruction, result);
+    const Line line = { address, instruction, QString(result) };
+    lines.push_front(line);
+    line_map[address] = lines.begin();
+    return lines.front().text;
+}
 
-	breakpoints = new BreakPoints();
+void DisassemblerModel::RowChanged(int row)
+{
+    if (row >= 0 && row < NUM_ROWS)
+        emit dataChanged(index(row, 0), index(row, columnCount() - 1));
+}
+
+void DisassemblerModel::SetBaseAddress(u32 address)
+{
+    beginResetModel();
+    base_address = address & ~3;
+    lines.clear();
+    line_map.clear();
+    endResetModel();
+}
+
+int DisassemblerModel::SetCurrentAddress(u32 address)
+{
+    if (address - base_address >= NUM_ROWS * 4)
+        SetBaseAddress(address);
+
+    // Only the rows of the old and the new instruction need repainting
+    const int old_row = (int)((current_address - base_address) / 4);
+    current_address = address;
+    RowChanged(old_row);
+    const int row = (int)((address - base_address) / 4);
+    RowChanged(row);
+    return row;
+}
+
+void DisassemblerModel::SetSnapshot(const CpuSnapshot& snapshot)
+{
+    // The decoded lines check the instruction they came from, stale ones get decoded again
+    this->snapshot = snapshot;
+}
+
+void DisassemblerModel::SetBreakpoint(int row, bool enabled)
+{
+    if (enabled)
+        breakpoints.insert(GetAddress(row));
+    else
+        breakpoints.erase(GetAddress(row));
+    RowChanged(row);
+}
+
+DisassemblerWidget::DisassemblerWidget(QWidget* parent, EmuThread& emu_thread) : QDockWidget(parent), emu_thread(emu_thread)
+{
+    disasm_ui.setupUi(this);
 
-    model = new QStandardItemModel(this);
-    model->setColumnCount(3);
+    model = new DisassemblerModel(this);
+    disasm_ui.treeView->setUniformRowHeights(true);
     disasm_ui.treeView->setModel(model);
 
     RegisterHotkey("Disassembler", "Start/Stop", QKeySequence(Qt::Key_F5), Qt::ApplicationShortcut);
@@ -42,31 +179,16 @@ DisassemblerWidget::DisassemblerWidget(QWidget* parent, EmuThread& emu_thread) :
 
 void DisassemblerWidget::Init()
 {
-    ARM_Disasm* disasm = new ARM_Disasm();
-
-    base_addr = Core::g_app_core->GetPC();
-    unsigned int curInstAddr = base_addr;
-    char result[255];
-
-    for (int i = 0; i < 10000; i++) // fixed for now
-    {
-        disasm->disasm(curInstAddr, Memory::Read32(curInstAddr), result);
-        model->setItem(i, 0, new QStandardItem(QString("0x%1").arg((uint)(curInstAddr), 8, 16, QLatin1Char('0'))));
-        model->setItem(i, 1, new QStandardItem(QString(result)));
-        if (Symbols::HasSymbol(curInstAddr))
-        {
-            TSymbol symbol = Symbols::GetSymbol(curInstAddr);
-            model->setItem(i, 2, new QStandardItem(QString("%1 - Size:%2").arg(QString::fromStdString(symbol.name))
-                                                                          .arg(symbol.size / 4))); // divide by 4 to get instruction count
-
-        }
-        curInstAddr += 4;
-    }
+    CpuSnapshot snapshot;
+    emu_thread.GetSnapshot(snapshot);
+    model->SetSnapshot(snapshot);
+    model->SetBaseAddress(snapshot.pc);
+    const int row = model->SetCurrentAddress(snapshot.pc);
     disasm_ui.treeView->resizeColumnToContents(0);
     disasm_ui.treeView->resizeColumnToContents(1);
     disasm_ui.treeView->resizeColumnToContents(2);
 
-    QModelIndex model_index = model->index(0, 0);
+    QModelIndex model_index = model->index(row, 0);
     disasm_ui.treeView->scrollTo(model_index);
     disasm_ui.treeView->selectionModel()->setCurrentIndex(model_index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
 }
@@ -78,19 +200,8 @@ void DisassemblerWidget::OnSetBreakpoint()
     if (selected_row == -1)
         return;
 	
-    u32 address = base_addr + (selected_row * 4);
-    if (breakpoints->IsAddressBreakPoint(address))
-    {
-		breakpoints->Remove(address);
-        model->item(selected_row, 0)->setBackground(QBrush());
-        model->item(selected_row, 1)->setBackground(QBrush());
-    }
-    else
-    {
-        breakpoints->Add(address);
-        model->item(selected_row, 0)->setBackground(QBrush(QColor(0xFF, 0x99, 0x99)));
-        model->item(selected_row, 1)->setBackground(QBrush(QColor(0xFF, 0x99, 0x99)));
-    }
+    u32 address = model->GetAddress(selected_row);
+    model->SetBreakpoint(selected_row, emu_thread.ToggleBreakPoint(address));
 }
 
 void DisassemblerWidget::OnContinue()
@@ -121,15 +232,14 @@ void DisassemblerWidget::OnToggleStartStop()
 
 void DisassemblerWidget::OnCPUStepped()
 {
-    ARMword next_instr = Core::g_app_core->GetPC();
-
-    if (breakpoints->IsAddressBreakPoint(next_instr))
-    {
-        emu_thread.SetCpuRunning(false);
-    }
-
-    unsigned int index = (next_instr - base_addr) / 4;
-    QModelIndex model_index = model->index(index, 0);
+    // The emu thread stops at breakpoints on its own
+    CpuSnapshot snapshot;
+    emu_thread.GetSnapshot(snapshot);
+    model->SetSnapshot(snapshot);
+    ARMword next_instr = snapshot.pc;
+
+    const int row = model->SetCurrentAddress(next_instr);
+    QModelIndex model_index = model->index(row, 0);
     disasm_ui.treeView->scrollTo(model_index);
     disasm_ui.treeView->selectionModel()->setCurrentIndex(model_index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
 }
@@ -140,5 +250,5 @@ int DisassemblerWidget::SelectedRow()
     if (!index.isValid())
         return -1;
 
-    return model->itemFromIndex(disasm_ui.treeView->selectionModel()->currentIndex())->row();
+    return index.row();
 }
\ No newline at end of file
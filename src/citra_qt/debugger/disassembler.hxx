@@ -1,12 +1,96 @@
+#include <QAbstractItemModel>
 #include <QDockWidget>
 #include "../ui_disassembler.h"
 
+#include <list>
+#include <set>
+#include <unordered_map>
+
 #include "common/common.h"
-#include "common/break_points.h"
+
+#include "../bootmanager.hxx"
 
 class QAction;
-class QStandardItemModel;
-class EmuThread;
+
+/**
+ * Disassembly of a range of guest code, one row per instruction. Rows are only disassembled as
+ * the view asks for them, which it does for the visible ones, and the last lines decoded are kept
+ * in a small LRU cache so that scrolling back and repainting don't decode them again.
+ */
+class DisassemblerModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    enum {
+        NUM_ROWS        = 0x40000,      ///< Instructions of the range shown, 1 MB of code
+        CACHE_CAPACITY  = 256,          ///< Lines kept decoded, a few screens worth
+    };
+
+    DisassemblerModel(QObject* parent);
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    /**
+     * Shows the range starting at an address, dropping the decoded lines
+     * @param address Address of the first row, word aligned
+     */
+    void SetBaseAddress(u32 address);
+
+    /**
+     * Highlights the row of the instruction about to run, moving the range to it if it's outside
+     * @param address Address of the instruction
+     * @return Row of the instruction
+     */
+    int SetCurrentAddress(u32 address);
+
+    /**
+     * Sets the CPU state the rows are decoded from, as published by the emu thread
+     * @param snapshot CPU state
+     */
+    void SetSnapshot(const CpuSnapshot& snapshot);
+
+    /**
+     * Shows whether a row has a breakpoint
+     * @param row Row of the instruction
+     * @param enabled Whether the breakpoint is set
+     */
+    void SetBreakpoint(int row, bool enabled);
+
+    /**
+     * Gets the address of the instruction of a row
+     * @param row Row of the instruction
+     */
+    u32 GetAddress(int row) const {
+        return base_address + row * 4;
+    }
+
+private:
+    /// Instruction decoded
+    struct Line {
+        u32 address;
+        u32 instruction;                ///< Word the line was decoded from, to catch code changes
+        QString text;
+    };
+
+    typedef std::list<Line> LineList;
+
+    const QString& GetLine(u32 address) const;
+    void RowChanged(int row);
+
+    u32 base_address;
+    u32 current_address;
+    CpuSnapshot snapshot;
+    std::set<u32> breakpoints;
+
+    // Most recently used first, the map finds the lines by address
+    mutable LineList lines;
+    mutable std::unordered_map<u32, LineList::iterator> line_map;
+};
 
 class DisassemblerWidget : public QDockWidget
 {
@@ -32,11 +116,7 @@ private:
     int SelectedRow();
 
     Ui::DockWidget disasm_ui;
-    QStandardItemModel* model;
-
-    u32 base_addr;
-
-	BreakPoints* breakpoints;
+    DisassemblerModel* model;
 
     EmuThread& emu_thread;
 };
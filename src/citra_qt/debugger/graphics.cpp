@@ -7,6 +7,8 @@
 #include <QVBoxLayout>
 #include <QDebug>
 
+#include <algorithm>
+
 extern GraphicsDebugger g_debugger;
 
 GPUCommandStreamItemModel::GPUCommandStreamItemModel(QObject* parent) : QAbstractListModel(parent), command_count(0)
@@ -16,7 +18,8 @@ GPUCommandStreamItemModel::GPUCommandStreamItemModel(QObject* parent) : QAbstrac
 
 int GPUCommandStreamItemModel::rowCount(const QModelIndex& parent) const
 {
-    return command_count;
+    // Only the latest commands are kept in the history
+    return std::min(command_count, (int)GraphicsDebugger::GX_HISTORY_CAPACITY);
 }
 
 QVariant GPUCommandStreamItemModel::data(const QModelIndex& index, int role) const
@@ -24,8 +27,10 @@ QVariant GPUCommandStreamItemModel::data(const QModelIndex& index, int role) con
     if (!index.isValid())
         return QVariant();
 
-    int command_index = index.row();
-    const GSP_GPU::GXCommand& command = GetDebugger()->ReadGXCommandHistory(command_index);
+    const u64 command_index = command_count - rowCount() + index.row();
+    GSP_GPU::GXCommand command;
+    if (!GetDebugger()->ReadGXCommandHistory(command_index, command))
+        return QVariant();
     if (role == Qt::DisplayRole)
     {
         std::map<GSP_GPU::GXCommandId, const char*> command_names;
@@ -64,7 +69,11 @@ void GPUCommandStreamItemModel::OnGXCommandFinishedInternal(int total_command_co
 
     int prev_command_count = command_count;
     command_count = total_command_count;
-    emit dataChanged(index(prev_command_count,0), index(total_command_count-1,0));
+
+    // All rows move up once the history wraps around
+    if (total_command_count > GraphicsDebugger::GX_HISTORY_CAPACITY)
+        prev_command_count = 0;
+    emit dataChanged(index(prev_command_count,0), index(rowCount()-1,0));
 }
 
 
@@ -97,9 +97,11 @@ QVariant GPUCommandListModel::data(const QModelIndex& index, int role) const
     return QVariant();
 }
 
-void GPUCommandListModel::OnCommandListCalled(const GraphicsDebugger::PicaCommandList& lst, bool is_new)
+void GPUCommandListModel::OnCommandListCalled(size_t index, bool is_new)
 {
-    emit CommandListCalled();
+    // Only new lists change the tree
+    if (is_new)
+        emit CommandListCalled();
 }
 
 
@@ -107,7 +109,13 @@ void GPUCommandListModel::OnCommandListCalledInternal()
 {
     beginResetModel();
 
-    command_lists = GetDebugger()->GetCommandLists();
+    // Lists don't change once captured, only the new ones are split into their commands
+    const size_t command_list_count = GetDebugger()->GetCommandListCount();
+    for (size_t i = command_lists.size(); i < command_list_count; ++i) {
+        u32 address;
+        GraphicsDebugger::PicaCommandList commands = GetDebugger()->GetCommandList(i, address);
+        command_lists.push_back(std::make_pair(address, std::move(commands)));
+    }
 
     // delete root item and rebuild tree
     delete root_item;
@@ -24,7 +24,7 @@ public:
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
 
 public:
-    void OnCommandListCalled(const GraphicsDebugger::PicaCommandList& lst, bool is_new) override;
+    void OnCommandListCalled(size_t index, bool is_new) override;
 
 public slots:
     void OnCommandListCalledInternal();
@@ -0,0 +1,141 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <map>
+
+#include <QCheckBox>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPushButton>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include "profiler.hxx"
+
+#include "common/profiler.h"
+
+enum {
+    COLUMN_NAME,
+    COLUMN_TOTAL,
+    COLUMN_SELF,
+    COLUMN_CALLS,
+    COLUMN_FRAME,
+    NUM_COLUMNS,
+};
+
+ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(tr("Profiler"), parent)
+{
+    enable_checkbox = new QCheckBox(tr("Enable"));
+    capture_button = new QPushButton(tr("Capture trace"));
+    capture_button->setEnabled(false);
+    frame_label = new QLabel;
+
+    tree = new QTreeWidget;
+    tree->setColumnCount(NUM_COLUMNS);
+    QStringList headers;
+    headers << tr("Category") << tr("ms/frame") << tr("Self ms") << tr("Calls") << tr("% of frame");
+    tree->setHeaderLabels(headers);
+    tree->header()->setStretchLastSection(false);
+    tree->setSortingEnabled(true);
+    tree->sortByColumn(COLUMN_TOTAL, Qt::DescendingOrder);
+
+    QHBoxLayout* controls = new QHBoxLayout;
+    controls->addWidget(enable_checkbox);
+    controls->addWidget(capture_button);
+    controls->addStretch();
+    controls->addWidget(frame_label);
+
+    QVBoxLayout* layout = new QVBoxLayout;
+    layout->addLayout(controls);
+    layout->addWidget(tree);
+    QWidget* main_widget = new QWidget;
+    main_widget->setLayout(layout);
+    setWidget(main_widget);
+
+    refresh_timer = new QTimer(this);
+    connect(enable_checkbox, SIGNAL(toggled(bool)), this, SLOT(OnEnableToggled(bool)));
+    connect(capture_button, SIGNAL(clicked()), this, SLOT(OnCaptureClicked()));
+    connect(refresh_timer, SIGNAL(timeout()), this, SLOT(Refresh()));
+}
+
+void ProfilerWidget::OnEnableToggled(bool enabled)
+{
+    Common::Profiler::g_enabled.store(enabled, std::memory_order_relaxed);
+    capture_button->setEnabled(enabled);
+    if (enabled) {
+        refresh_timer->start(500);
+    } else {
+        refresh_timer->stop();
+        if (Common::Profiler::IsCapturing())
+            OnCaptureClicked();
+    }
+}
+
+void ProfilerWidget::OnCaptureClicked()
+{
+    if (!Common::Profiler::IsCapturing()) {
+        Common::Profiler::StartCapture();
+        capture_button->setText(tr("Stop capture"));
+        return;
+    }
+
+    capture_button->setText(tr("Capture trace"));
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save trace"), QString(),
+                                                    tr("Chrome trace (*.json)"));
+    // The trace is dropped when no file is picked
+    Common::Profiler::StopCapture(filename.toStdString());
+}
+
+void ProfilerWidget::Refresh()
+{
+    Common::Profiler::FrameReport report;
+    Common::Profiler::GetLastFrame(report);
+
+    const double frame_ms = report.frame_ns / 1000000.0;
+    frame_label->setText(tr("Frame: %1 ms, %2 scopes dropped").arg(frame_ms, 0, 'f', 2)
+                         .arg((qulonglong)report.dropped));
+
+    tree->setUpdatesEnabled(false);
+    tree->clear();
+    std::map<int, QTreeWidgetItem*> items;
+    for (const auto& category : report.categories) {
+        QTreeWidgetItem* item = new QTreeWidgetItem;
+        item->setText(COLUMN_NAME, QString::fromStdString(category.name));
+        item->setData(COLUMN_TOTAL, Qt::DisplayRole, category.total_ns / 1000000.0);
+        item->setData(COLUMN_SELF, Qt::DisplayRole, category.self_ns / 1000000.0);
+        item->setData(COLUMN_CALLS, Qt::DisplayRole, category.calls);
+        if (report.frame_ns != 0) {
+            item->setData(COLUMN_FRAME, Qt::DisplayRole,
+                          category.total_ns * 100.0 / report.frame_ns);
+        }
+        items[category.id] = item;
+    }
+    std::map<int, int> parents;
+    for (const auto& category : report.categories)
+        parents[category.id] = category.parent;
+
+    // Categories nest as their scopes did, the last time. Those whose enclosing category had no
+    // scope ending in the frame, or that would end up nested in themselves, go to the top.
+    for (const auto& category : report.categories) {
+        bool nested = items.count(category.parent) != 0;
+        int ancestor = category.parent;
+        for (size_t depth = 0; nested && ancestor >= 0; depth++) {
+            if (ancestor == category.id || depth == parents.size()) {
+                nested = false;
+                break;
+            }
+            auto it = parents.find(ancestor);
+            ancestor = it != parents.end() ? it->second : -1;
+        }
+        if (nested)
+            items[category.parent]->addChild(items[category.id]);
+        else
+            tree->addTopLevelItem(items[category.id]);
+    }
+    tree->expandAll();
+    tree->setUpdatesEnabled(true);
+}
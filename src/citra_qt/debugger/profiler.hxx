@@ -0,0 +1,34 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <QDockWidget>
+
+class QCheckBox;
+class QLabel;
+class QPushButton;
+class QTimer;
+class QTreeWidget;
+
+/// Shows where the time of the last frame went, per profiler category, and captures traces
+class ProfilerWidget : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    ProfilerWidget(QWidget* parent = 0);
+
+private slots:
+    void OnEnableToggled(bool enabled);
+    void OnCaptureClicked();
+    void Refresh();
+
+private:
+    QCheckBox* enable_checkbox;
+    QPushButton* capture_button;
+    QLabel* frame_label;
+    QTreeWidget* tree;
+    QTimer* refresh_timer;
+};
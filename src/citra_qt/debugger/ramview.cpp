@@ -1,13 +1,75 @@
+#include <algorithm>
+
+#include <QTimer>
+
 #include "ramview.hxx"
 
+#include "../bootmanager.hxx"
+
 #include "common/common.h"
 #include "core/mem_map.h"
-GRamView::GRamView(QWidget* parent) : QHexEdit(parent)
+
+/// Minimum interval between two refreshes in ms, however fast the CPU state changes
+static const int REFRESH_INTERVAL = 50;
+
+/// Size of the memory window shown in bytes, QHexEdit doesn't scroll through > 10MB data streams
+static const int WINDOW_SIZE = 0x1000;
+
+GRamView::GRamView(QWidget* parent, EmuThread& emu_thread) : QHexEdit(parent), emu_thread(emu_thread), generation(0), address(0)
+{
+    setReadOnly(true);
+
+    refresh_timer = new QTimer(this);
+    connect(refresh_timer, SIGNAL(timeout()), this, SLOT(OnRefreshTimer()));
+    refresh_timer->start(REFRESH_INTERVAL);
+}
+
+void GRamView::SetAddress(u32 address)
 {
+    this->address = address;
+    setAddressOffset(address);
+    Refresh(true);
 }
 
 void GRamView::OnCPUStepped()
 {
-    // TODO: QHexEdit doesn't show vertical scroll bars for > 10MB data streams...
-    //setData(QByteArray((const char*)Mem_RAM,sizeof(Mem_RAM)/8));
-}
\ No newline at end of file
+    Refresh(true);
+}
+
+void GRamView::OnRefreshTimer()
+{
+    // Hidden views are refreshed once shown
+    if (isVisible())
+        Refresh(false);
+}
+
+void GRamView::Refresh(bool force)
+{
+    const u32 current_generation = emu_thread.GetGeneration();
+    if (!force && current_generation == generation)
+        return;
+    generation = current_generation;
+
+    // Read through host pointers a page at a time, reading I/O registers could have side effects.
+    // Pages that aren't mapped show as zeroes.
+    QByteArray data(WINDOW_SIZE, 0);
+    u32 offset = 0;
+    while (offset < (u32)WINDOW_SIZE)
+    {
+        const u32 page_address = address + offset;
+        const u32 size = std::min<u32>(Memory::PAGE_SIZE - (page_address & Memory::PAGE_MASK), WINDOW_SIZE - offset);
+        // Straight from the page table, GetPointer complains of every page that isn't mapped
+        const u8* page = Memory::g_page_table[page_address >> Memory::PAGE_BITS];
+        if (page != NULL)
+            memcpy(data.data() + offset, page + (page_address & Memory::PAGE_MASK), size);
+        offset += size;
+    }
+
+    // Replacing the data resets the view, keep it when nothing changed
+    if (data == window)
+        return;
+    window = data;
+    const int cursor = cursorPosition();
+    setData(window);
+    setCursorPosition(cursor);
+}
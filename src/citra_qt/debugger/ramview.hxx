@@ -1,12 +1,42 @@
 #include "qhexedit.h"
 
+#include "common/common_types.h"
+
+class QTimer;
+class EmuThread;
+
 class GRamView : public QHexEdit
 {
     Q_OBJECT
 
 public:
-    GRamView(QWidget* parent = NULL);
+    GRamView(QWidget* parent, EmuThread& emu_thread);
+
+    /**
+     * Sets the guest memory shown
+     *
+     * @param address Guest address of the first byte shown
+     */
+    void SetAddress(u32 address);
 
 public slots:
     void OnCPUStepped();
+
+private slots:
+    /// Refreshes the memory if the CPU state changed since the last refresh, polled by a timer
+    void OnRefreshTimer();
+
+private:
+    /**
+     * Reads the memory window again, replacing the data shown only if it changed
+     *
+     * @param force Refresh even if the CPU state didn't change
+     */
+    void Refresh(bool force);
+
+    EmuThread& emu_thread;
+    QTimer* refresh_timer;
+    u32 generation;                 ///< Generation of the CPU state shown
+    u32 address;                    ///< Guest address of the window shown
+    QByteArray window;              ///< Memory shown, compared with on refresh
 };
@@ -1,9 +1,13 @@
+#include <QTimer>
+
 #include "registers.hxx"
 
-#include "core/core.h"
-#include "core/arm/arm_interface.h"
+#include "../bootmanager.hxx"
+
+/// Minimum interval between two refreshes in ms, however fast the CPU state changes
+static const int REFRESH_INTERVAL = 50;
 
-RegistersWidget::RegistersWidget(QWidget* parent) : QDockWidget(parent)
+RegistersWidget::RegistersWidget(QWidget* parent, EmuThread& emu_thread) : QDockWidget(parent), emu_thread(emu_thread), generation(0)
 {
     cpu_regs_ui.setupUi(this);
 
@@ -35,29 +39,61 @@ RegistersWidget::RegistersWidget(QWidget* parent) : QDockWidget(parent)
     CSPR->addChild(new QTreeWidgetItem(QStringList("C")));
     CSPR->addChild(new QTreeWidgetItem(QStringList("Z")));
     CSPR->addChild(new QTreeWidgetItem(QStringList("N")));
+
+    refresh_timer = new QTimer(this);
+    connect(refresh_timer, SIGNAL(timeout()), this, SLOT(OnRefreshTimer()));
+    refresh_timer->start(REFRESH_INTERVAL);
 }
 
 void RegistersWidget::OnCPUStepped()
 {
-    ARM_Interface* app_core = Core::g_app_core;
+    Refresh(true);
+}
+
+void RegistersWidget::OnRefreshTimer()
+{
+    // Hidden views are refreshed once shown
+    if (isVisible())
+        Refresh(false);
+}
+
+void RegistersWidget::SetValue(QTreeWidgetItem* item, const QString& text)
+{
+    const bool changed = item->text(1) != text;
+    if (changed)
+        item->setText(1, text);
+    item->setBackground(1, changed ? QBrush(QColor(0xFF, 0x99, 0x99)) : QBrush());
+}
+
+void RegistersWidget::Refresh(bool force)
+{
+    const u32 current_generation = emu_thread.GetGeneration();
+    if (!force && current_generation == generation)
+        return;
+    generation = current_generation;
+
+    CpuSnapshot snapshot;
+    emu_thread.GetSnapshot(snapshot);
+    const u32* regs = snapshot.regs;
+    const u32 cpsr = snapshot.cpsr;
 
     for (int i = 0; i < 16; ++i)
-        registers->child(i)->setText(1, QString("0x%1").arg(app_core->GetReg(i), 8, 16, QLatin1Char('0')));
-
-    CSPR->setText(1, QString("0x%1").arg(app_core->GetCPSR(), 8, 16, QLatin1Char('0')));
-    CSPR->child(0)->setText(1, QString("b%1").arg(app_core->GetCPSR() & 0x1F, 5, 2, QLatin1Char('0'))); // M - Mode
-    CSPR->child(1)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 5) & 0x1));	// T - State
-    CSPR->child(2)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 6) & 0x1));	// F - FIQ disable
-    CSPR->child(3)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 7) & 0x1));	// I - IRQ disable
-    CSPR->child(4)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 8) & 0x1));	// A - Imprecise abort
-    CSPR->child(5)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 9) & 0x1));	// E - Data endianess
-    CSPR->child(6)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 10) & 0x3F));	// IT - If-Then state (DNM)
-    CSPR->child(7)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 16) & 0xF));	// GE - Greater-than-or-Equal
-    CSPR->child(8)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 20) & 0xF));	// DNM - Do not modify
-    CSPR->child(9)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 24) & 0x1));	// J - Java state
-    CSPR->child(10)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 27) & 0x1));	// Q - Sticky overflow
-    CSPR->child(11)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 28) & 0x1));	// V - Overflow
-    CSPR->child(12)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 29) & 0x1));	// C - Carry/Borrow/Extend
-    CSPR->child(13)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 30) & 0x1));	// Z - Zero
-    CSPR->child(14)->setText(1, QString("%1").arg((app_core->GetCPSR() >> 31) & 0x1));	// N - Negative/Less than
+        SetValue(registers->child(i), QString("0x%1").arg(regs[i], 8, 16, QLatin1Char('0')));
+
+    SetValue(CSPR, QString("0x%1").arg(cpsr, 8, 16, QLatin1Char('0')));
+    SetValue(CSPR->child(0), QString("b%1").arg(cpsr & 0x1F, 5, 2, QLatin1Char('0'))); // M - Mode
+    SetValue(CSPR->child(1), QString("%1").arg((cpsr >> 5) & 0x1));	// T - State
+    SetValue(CSPR->child(2), QString("%1").arg((cpsr >> 6) & 0x1));	// F - FIQ disable
+    SetValue(CSPR->child(3), QString("%1").arg((cpsr >> 7) & 0x1));	// I - IRQ disable
+    SetValue(CSPR->child(4), QString("%1").arg((cpsr >> 8) & 0x1));	// A - Imprecise abort
+    SetValue(CSPR->child(5), QString("%1").arg((cpsr >> 9) & 0x1));	// E - Data endianess
+    SetValue(CSPR->child(6), QString("%1").arg((cpsr >> 10) & 0x3F));	// IT - If-Then state (DNM)
+    SetValue(CSPR->child(7), QString("%1").arg((cpsr >> 16) & 0xF));	// GE - Greater-than-or-Equal
+    SetValue(CSPR->child(8), QString("%1").arg((cpsr >> 20) & 0xF));	// DNM - Do not modify
+    SetValue(CSPR->child(9), QString("%1").arg((cpsr >> 24) & 0x1));	// J - Java state
+    SetValue(CSPR->child(10), QString("%1").arg((cpsr >> 27) & 0x1));	// Q - Sticky overflow
+    SetValue(CSPR->child(11), QString("%1").arg((cpsr >> 28) & 0x1));	// V - Overflow
+    SetValue(CSPR->child(12), QString("%1").arg((cpsr >> 29) & 0x1));	// C - Carry/Borrow/Extend
+    SetValue(CSPR->child(13), QString("%1").arg((cpsr >> 30) & 0x1));	// Z - Zero
+    SetValue(CSPR->child(14), QString("%1").arg((cpsr >> 31) & 0x1));	// N - Negative/Less than
 }
@@ -3,23 +3,50 @@
 #include <QDockWidget>
 #include <QTreeWidgetItem>
 
+#include "common/common_types.h"
+
+class QTimer;
 class QTreeWidget;
+class EmuThread;
 
 class RegistersWidget : public QDockWidget
 {
     Q_OBJECT
 
 public:
-    RegistersWidget(QWidget* parent = NULL);
+    RegistersWidget(QWidget* parent, EmuThread& emu_thread);
 
 public slots:
     void OnCPUStepped();
 
+private slots:
+    /// Refreshes the registers if the CPU state changed since the last refresh, polled by a timer
+    void OnRefreshTimer();
+
 private:
+    /**
+     * Shows the registers published by the emulation thread, highlighting the ones that changed
+     *
+     * @param force Refresh even if the CPU state didn't change
+     */
+    void Refresh(bool force);
+
+    /**
+     * Sets the value shown by an item, highlighted if it changed
+     *
+     * @param item Item of the register or flag
+     * @param text Value shown
+     */
+    void SetValue(QTreeWidgetItem* item, const QString& text);
+
 	Ui::ARMRegisters cpu_regs_ui;
 
 	QTreeWidget* tree;
     
 	QTreeWidgetItem* registers;
 	QTreeWidgetItem* CSPR;
+
+    EmuThread& emu_thread;
+    QTimer* refresh_timer;
+    u32 generation;                 ///< Generation of the CPU state shown
 };
@@ -1,12 +1,14 @@
 #include <QtGui>
 #include <QDesktopWidget>
 #include <QFileDialog>
+#include <QInputDialog>
 #include "qhexedit.h"
 #include "main.hxx"
 
 #include "common/common.h"
 #include "common/platform.h"
 #include "common/log_manager.h"
+#include "common/perf_counters.h"
 #if EMU_PLATFORM == PLATFORM_LINUX
 #include <unistd.h>
 #endif
@@ -21,10 +23,16 @@
 #include "debugger/ramview.hxx"
 #include "debugger/graphics.hxx"
 #include "debugger/graphics_cmdlists.hxx"
+#include "debugger/profiler.hxx"
 
 #include "core/system.h"
 #include "core/loader.h"
 #include "core/core.h"
+#include "core/movie.h"
+#include "core/rewind.h"
+#include "core/settings.h"
+#include "core/speed_limiter.h"
+#include "core/statistics.h"
 #include "core/arm/disassembler/load_symbol_map.h"
 #include "version.h"
 
@@ -32,7 +40,9 @@
 GMainWindow::GMainWindow()
 {
     ui.setupUi(this);
-    statusBar()->hide();
+
+    statistics_label = new QLabel;
+    statusBar()->addPermanentWidget(statistics_label, 1);
 
     render_window = new GRenderWindow;
     render_window->hide();
@@ -41,11 +51,11 @@ GMainWindow::GMainWindow()
     addDockWidget(Qt::BottomDockWidgetArea, disasmWidget);
     disasmWidget->hide();
 
-    registersWidget = new RegistersWidget(this);
+    registersWidget = new RegistersWidget(this, render_window->GetEmuThread());
     addDockWidget(Qt::RightDockWidgetArea, registersWidget);
     registersWidget->hide();
 
-    callstackWidget = new CallstackWidget(this);
+    callstackWidget = new CallstackWidget(this, render_window->GetEmuThread());
     addDockWidget(Qt::RightDockWidgetArea, callstackWidget);
     callstackWidget->hide();
 
@@ -57,12 +67,49 @@ GMainWindow::GMainWindow()
     addDockWidget(Qt::RightDockWidgetArea, graphicsCommandsWidget);
     callstackWidget->hide();
 
+    profilerWidget = new ProfilerWidget(this);
+    addDockWidget(Qt::BottomDockWidgetArea, profilerWidget);
+    profilerWidget->hide();
+
     QMenu* debug_menu = ui.menu_View->addMenu(tr("Debugging"));
     debug_menu->addAction(disasmWidget->toggleViewAction());
     debug_menu->addAction(registersWidget->toggleViewAction());
     debug_menu->addAction(callstackWidget->toggleViewAction());
     debug_menu->addAction(graphicsWidget->toggleViewAction());
     debug_menu->addAction(graphicsCommandsWidget->toggleViewAction());
+    debug_menu->addAction(profilerWidget->toggleViewAction());
+
+    // Runtime statistics, sampled by the core every second
+    statistics_overlay = new QLabel(render_window);
+    statistics_overlay->setStyleSheet("QLabel { background-color: rgba(0, 0, 0, 160); color: white; padding: 4px; }");
+    statistics_overlay->move(8, 8);
+    statistics_overlay->hide();
+    statistics_overlay_action = ui.menu_View->addAction(tr("Statistics Overlay"));
+    statistics_overlay_action->setCheckable(true);
+    perf_counters_action = ui.menu_View->addAction(tr("Host Performance Counters"));
+    perf_counters_action->setCheckable(true);
+    QTimer* statistics_timer = new QTimer(this);
+    connect(statistics_timer, SIGNAL(timeout()), this, SLOT(OnUpdateStatistics()));
+    statistics_timer->start(1000);
+
+    // Emulation speed, in percent of real time
+    QMenu* speed_menu = ui.menu_Emulation->addMenu(tr("Speed"));
+    QActionGroup* speed_group = new QActionGroup(this);
+    static const int speeds[] = { 50, 100, 200, 400, SpeedLimiter::UNLIMITED };
+    for (int speed : speeds) {
+        QAction* action = speed_menu->addAction(speed == SpeedLimiter::UNLIMITED ?
+            tr("Unlimited") : tr("%1%").arg(speed));
+        action->setCheckable(true);
+        action->setData(speed);
+        speed_group->addAction(action);
+    }
+
+    // Input movies, recorded from and played back to the current session
+    QMenu* movie_menu = ui.menu_Emulation->addMenu(tr("Movie"));
+    connect(movie_menu->addAction(tr("Record...")), SIGNAL(triggered()), this, SLOT(OnRecordMovie()));
+    connect(movie_menu->addAction(tr("Play...")), SIGNAL(triggered()), this, SLOT(OnPlayMovie()));
+    connect(movie_menu->addAction(tr("Seek to frame...")), SIGNAL(triggered()), this, SLOT(OnSeekMovie()));
+    connect(movie_menu->addAction(tr("Stop")), SIGNAL(triggered()), this, SLOT(OnStopMovie()));
 
     // Set default UI state
     // geometry: 55% of the window contents are in the upper screen half, 45% in the lower half
@@ -85,34 +132,58 @@ GMainWindow::GMainWindow()
     ui.action_Popout_Window_Mode->setChecked(settings.value("popoutWindowMode", true).toBool());
     ToggleWindowMode();
 
+    int speed = settings.value("speed", (int)SpeedLimiter::DEFAULT_SPEED).toInt();
+    for (QAction* action : speed_group->actions()) {
+        action->setChecked(action->data().toInt() == speed);
+    }
+    SpeedLimiter::SetSpeed(speed);
+
+    statistics_overlay_action->setChecked(settings.value("statisticsOverlay", false).toBool());
+    OnToggleStatisticsOverlay(statistics_overlay_action->isChecked());
+
     // Setup connections
     connect(ui.action_Load_File, SIGNAL(triggered()), this, SLOT(OnMenuLoadFile()));
     connect(ui.action_Load_Symbol_Map, SIGNAL(triggered()), this, SLOT(OnMenuLoadSymbolMap()));
+    connect(ui.action_Profiling, SIGNAL(triggered(bool)), this, SLOT(OnToggleProfiling(bool)));
+    connect(ui.action_Save_Profile, SIGNAL(triggered()), this, SLOT(OnSaveProfile()));
+    connect(&render_window->GetEmuThread(), SIGNAL(ProfileSaveFailed()), this, SLOT(OnProfileSaveFailed()), Qt::QueuedConnection);
+    connect(ui.action_Save_State, SIGNAL(triggered()), this, SLOT(OnSaveState()));
+    connect(ui.action_Load_State, SIGNAL(triggered()), this, SLOT(OnLoadState()));
+    connect(ui.action_Rewind_Buffer, SIGNAL(triggered(bool)), this, SLOT(OnToggleRewindBuffer(bool)));
+    connect(ui.action_Rewind, SIGNAL(triggered()), this, SLOT(OnRewind()));
     connect(ui.action_Start, SIGNAL(triggered()), this, SLOT(OnStartGame()));
     connect(ui.action_Pause, SIGNAL(triggered()), this, SLOT(OnPauseGame()));
     connect(ui.action_Stop, SIGNAL(triggered()), this, SLOT(OnStopGame()));
     connect(ui.action_Popout_Window_Mode, SIGNAL(triggered(bool)), this, SLOT(ToggleWindowMode()));
     connect(ui.action_Hotkeys, SIGNAL(triggered()), this, SLOT(OnOpenHotkeysDialog()));
+    connect(speed_group, SIGNAL(triggered(QAction*)), this, SLOT(OnSelectSpeed(QAction*)));
+    connect(statistics_overlay_action, SIGNAL(toggled(bool)), this, SLOT(OnToggleStatisticsOverlay(bool)));
+    connect(perf_counters_action, SIGNAL(toggled(bool)), this, SLOT(OnTogglePerfCounters(bool)));
 
     // BlockingQueuedConnection is important here, it makes sure we've finished refreshing our views before the CPU continues
     connect(&render_window->GetEmuThread(), SIGNAL(CPUStepped()), disasmWidget, SLOT(OnCPUStepped()), Qt::BlockingQueuedConnection);
-    connect(&render_window->GetEmuThread(), SIGNAL(CPUStepped()), registersWidget, SLOT(OnCPUStepped()), Qt::BlockingQueuedConnection);
     connect(&render_window->GetEmuThread(), SIGNAL(CPUStepped()), callstackWidget, SLOT(OnCPUStepped()), Qt::BlockingQueuedConnection);
+    // The registers poll the CPU state at their own rate instead, so a running CPU never waits for them
 
     // Setup hotkeys
     RegisterHotkey("Main Window", "Load File", QKeySequence::Open);
     RegisterHotkey("Main Window", "Start Emulation");
+    RegisterHotkey("Main Window", "Rewind", QKeySequence(Qt::Key_Backspace));
     LoadHotkeys(settings);
 
     connect(GetHotkey("Main Window", "Load File", this), SIGNAL(activated()), this, SLOT(OnMenuLoadFile()));
     connect(GetHotkey("Main Window", "Start Emulation", this), SIGNAL(activated()), this, SLOT(OnStartGame()));
+    connect(GetHotkey("Main Window", "Rewind", this), SIGNAL(activated()), this, SLOT(OnRewind()));
 
     setWindowTitle(render_window->GetWindowTitle().c_str());
 
     show();
 
     LogManager::Init();
-    System::Init(render_window);
+    Settings::Load();
+    system_initialized = System::Init(render_window);
+    if (!system_initialized)
+        QMessageBox::critical(this, tr("Citra"), tr("Couldn't initialize the emulated system, see the log for details."));
 }
 
 GMainWindow::~GMainWindow()
@@ -124,13 +195,22 @@ GMainWindow::~GMainWindow()
 
 void GMainWindow::BootGame(const char* filename)
 {
+    // The emu thread would run on subsystems that aren't there
+    if (!system_initialized) {
+        QMessageBox::critical(this, tr("Citra"), tr("The emulated system isn't initialized, no game can be started."));
+        return;
+    }
+
     NOTICE_LOG(MASTER_LOG, "citra starting...\n");
 
+    // The profile of the title picks the CPU backend too, the video core is up already
+    Settings::LoadTitleProfile(Loader::ReadTitleId(filename));
     if (Core::Init()) {
         ERROR_LOG(MASTER_LOG, "core initialization failed, exiting...");
         Core::Stop();
         exit(1);
     }
+    OnToggleProfiling(ui.action_Profiling->isChecked());
 
     // Load a game or die...
     std::string boot_filename = filename;
@@ -141,11 +221,14 @@ void GMainWindow::BootGame(const char* filename)
         ERROR_LOG(BOOT, "Failed to load ROM: %s", error_str.c_str());
     }
 
+    ui.action_Save_State->setEnabled(res);
+    ui.action_Load_State->setEnabled(res);
+
     disasmWidget->Init();
     registersWidget->OnCPUStepped();
     callstackWidget->OnCPUStepped();
 
-    render_window->DoneCurrent(); // make sure EmuThread can access GL context
+    render_window->DoneCurrent(); // make sure the presenter thread or EmuThread can access GL context
     render_window->GetEmuThread().SetFilename(filename);
     render_window->GetEmuThread().start();
 
@@ -165,6 +248,89 @@ void GMainWindow::OnMenuLoadSymbolMap() {
         LoadSymbolMap(filename.toLatin1().data());
 }
 
+void GMainWindow::OnToggleProfiling(bool enable)
+{
+    // Takes effect when the core is created if no game is running yet. The emu thread owns the
+    // profiler while it runs, it switches it between two slices.
+    if (Core::g_app_core != NULL)
+        render_window->GetEmuThread().SetProfiling(enable);
+    ui.action_Save_Profile->setEnabled(enable);
+}
+
+void GMainWindow::OnSaveProfile()
+{
+    if (Core::g_app_core == NULL)
+        return;
+
+    // The emu thread writes it between two slices, while the samples don't change
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save profile"), QString(), tr("Flat profile (*.txt)"));
+    if (filename.size())
+        render_window->GetEmuThread().SaveProfile(filename);
+}
+
+void GMainWindow::OnProfileSaveFailed()
+{
+    QMessageBox::warning(this, tr("Save profile"), tr("Couldn't write the profile."));
+}
+
+void GMainWindow::OnSaveState()
+{
+    // The emu thread saves in the background between two slices
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save state"), QString(), tr("Savestate (*.sav)"));
+    if (filename.size())
+        render_window->GetEmuThread().SaveState(filename);
+}
+
+void GMainWindow::OnLoadState()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Load state"), QString(), tr("Savestate (*.sav)"));
+    if (filename.size())
+        render_window->GetEmuThread().LoadState(filename);
+}
+
+void GMainWindow::OnToggleRewindBuffer(bool enable)
+{
+    Rewind::SetEnabled(enable);
+    ui.action_Rewind->setEnabled(enable);
+}
+
+void GMainWindow::OnRewind()
+{
+    if (ui.action_Rewind->isEnabled())
+        render_window->GetEmuThread().StepBack();
+}
+
+void GMainWindow::OnRecordMovie()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Record movie"), QString(), tr("Movie (*.ctm)"));
+    if (filename.size())
+        render_window->GetEmuThread().RecordMovie(filename);
+}
+
+void GMainWindow::OnPlayMovie()
+{
+    QString filename = QFileDialog::getOpenFileName(this, tr("Play movie"), QString(), tr("Movie (*.ctm)"));
+    if (filename.size())
+        render_window->GetEmuThread().PlayMovie(filename);
+}
+
+void GMainWindow::OnStopMovie()
+{
+    render_window->GetEmuThread().StopMovie();
+}
+
+void GMainWindow::OnSeekMovie()
+{
+    bool ok;
+    int frame = QInputDialog::getInt(this, tr("Seek movie"), tr("Frame:"), Movie::GetFrame(), 0, INT_MAX, 1, &ok);
+    if (!ok)
+        return;
+
+    // The emulation runs unthrottled to the frame, then the CPU stops there
+    render_window->GetEmuThread().SeekMovie(frame);
+    OnStartGame();
+}
+
 void GMainWindow::OnStartGame()
 {
     render_window->GetEmuThread().SetCpuRunning(true);
@@ -192,6 +358,56 @@ void GMainWindow::OnStopGame()
     ui.action_Stop->setEnabled(false);
 }
 
+void GMainWindow::OnSelectSpeed(QAction* action)
+{
+    SpeedLimiter::SetSpeed(action->data().toInt());
+}
+
+void GMainWindow::OnUpdateStatistics()
+{
+    Statistics::Sample sample;
+    if (!Statistics::GetLastSample(sample))
+        return;
+
+    QString summary = QString::fromStdString(Statistics::FormatSummary(sample));
+    statistics_label->setText(summary);
+    if (!statistics_overlay->isVisible())
+        return;
+
+    // The overlay lists the busiest calls too, a handful is enough to tell what the guest is up to
+    static const size_t kMaxCalls = 5;
+    QString text = QString(summary).replace(" | ", "\n");
+    text += "\n\n" + tr("SVCs:");
+    for (size_t i = 0; i < sample.svcs.size() && i < kMaxCalls; i++)
+        text += QString("\n  %1: %2/s").arg(QString::fromStdString(sample.svcs[i].name)).arg(sample.svcs[i].per_second, 0, 'f', 0);
+    text += "\n\n" + tr("IPC:");
+    for (size_t i = 0; i < sample.ipc.size() && i < kMaxCalls; i++)
+        text += QString("\n  %1: %2/s").arg(QString::fromStdString(sample.ipc[i].name)).arg(sample.ipc[i].per_second, 0, 'f', 0);
+    text += "\n\n" + tr("Host memory:") + "\n  " + QString::fromStdString(Statistics::FormatMemory(sample)).replace(" | ", "\n  ");
+    if (!sample.perf.empty())
+        text += "\n\n" + tr("Host counters:");
+    for (const Statistics::PerfRate& rate : sample.perf)
+        text += "\n  " + QString::fromStdString(Statistics::FormatPerfRate(rate));
+    statistics_overlay->setText(text);
+    statistics_overlay->adjustSize();
+    statistics_overlay->raise();
+}
+
+void GMainWindow::OnToggleStatisticsOverlay(bool enable)
+{
+    statistics_overlay->setVisible(enable);
+    if (enable)
+        OnUpdateStatistics();
+}
+
+void GMainWindow::OnTogglePerfCounters(bool enable)
+{
+    if (!enable)
+        Common::PerfCounters::Disable();
+    else if (!Common::PerfCounters::Enable())
+        perf_counters_action->setChecked(false);
+}
+
 void GMainWindow::OnOpenHotkeysDialog()
 {
     GHotkeysDialog dialog(this);
@@ -232,11 +448,17 @@ void GMainWindow::closeEvent(QCloseEvent* event)
     settings.setValue("state", saveState());
     settings.setValue("geometryRenderWindow", render_window->saveGeometry());
     settings.setValue("popoutWindowMode", ui.action_Popout_Window_Mode->isChecked());
+    settings.setValue("speed", SpeedLimiter::g_speed.load());
+    settings.setValue("statisticsOverlay", statistics_overlay_action->isChecked());
     settings.setValue("firstStart", false);
     SaveHotkeys(settings);
+    Settings::Save();
 
     render_window->close();
 
+    // The emu thread is stopped by now
+    Settings::SaveTitleSuggestions();
+
     QWidget::closeEvent(event);
 }
 
@@ -12,6 +12,8 @@ class RegistersWidget;
 class CallstackWidget;
 class GPUCommandStreamWidget;
 class GPUCommandListWidget;
+class ProfilerWidget;
+class QLabel;
 
 class GMainWindow : public QMainWindow
 {
@@ -40,6 +42,21 @@ private slots:
     void OnStopGame();
     void OnMenuLoadFile();
     void OnMenuLoadSymbolMap();
+    void OnToggleProfiling(bool enable);
+    void OnSaveProfile();
+    void OnProfileSaveFailed();
+    void OnSaveState();
+    void OnLoadState();
+    void OnToggleRewindBuffer(bool enable);
+    void OnRewind();
+    void OnRecordMovie();
+    void OnPlayMovie();
+    void OnStopMovie();
+    void OnSeekMovie();
+    void OnSelectSpeed(QAction* action);
+    void OnUpdateStatistics();
+    void OnToggleStatisticsOverlay(bool enable);
+    void OnTogglePerfCounters(bool enable);
     void OnOpenHotkeysDialog();
     void OnConfigure();
     void ToggleWindowMode();
@@ -48,12 +65,19 @@ private:
     Ui::MainWindow ui;
 
     GRenderWindow* render_window;
+    bool system_initialized;        ///< Whether System::Init succeeded, no game boots otherwise
 
     DisassemblerWidget* disasmWidget;
     RegistersWidget* registersWidget;
     CallstackWidget* callstackWidget;
     GPUCommandStreamWidget* graphicsWidget;
     GPUCommandListWidget* graphicsCommandsWidget;
+    ProfilerWidget* profilerWidget;
+
+    QAction* statistics_overlay_action;
+    QAction* perf_counters_action;
+    QLabel* statistics_label;       ///< Summary of the last statistics sample, in the status bar
+    QLabel* statistics_overlay;     ///< The sample with its busiest calls, over the render window
 };
 
 #endif // _CITRA_QT_MAIN_HXX_
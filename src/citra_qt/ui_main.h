@@ -35,6 +35,8 @@ public:
     QAction *action_About;
     QAction *action_Popout_Window_Mode;
     QAction *action_Hotkeys;
+    QAction *action_Profiling;
+    QAction *action_Save_Profile;
     QAction *action_Configure;
     QWidget *centralwidget;
     QHBoxLayout *horizontalLayout;
@@ -76,6 +78,12 @@ public:
         action_Popout_Window_Mode->setCheckable(true);
         action_Hotkeys = new QAction(MainWindow);
         action_Hotkeys->setObjectName(QString::fromUtf8("action_Hotkeys"));
+        action_Profiling = new QAction(MainWindow);
+        action_Profiling->setObjectName(QString::fromUtf8("action_Profiling"));
+        action_Profiling->setCheckable(true);
+        action_Save_Profile = new QAction(MainWindow);
+        action_Save_Profile->setObjectName(QString::fromUtf8("action_Save_Profile"));
+        action_Save_Profile->setEnabled(false);
         action_Configure = new QAction(MainWindow);
         action_Configure->setObjectName(QString::fromUtf8("action_Configure"));
         centralwidget = new QWidget(MainWindow);
@@ -111,6 +119,9 @@ public:
         menu_Emulation->addAction(action_Pause);
         menu_Emulation->addAction(action_Stop);
         menu_Emulation->addSeparator();
+        menu_Emulation->addAction(action_Profiling);
+        menu_Emulation->addAction(action_Save_Profile);
+        menu_Emulation->addSeparator();
         menu_Emulation->addAction(action_Configure);
         menu_View->addAction(action_Popout_Window_Mode);
         menu_View->addAction(action_Hotkeys);
@@ -135,6 +146,8 @@ public:
         action_About->setText(QApplication::translate("MainWindow", "About Citra", 0, QApplication::UnicodeUTF8));
         action_Popout_Window_Mode->setText(QApplication::translate("MainWindow", "Popout window", 0, QApplication::UnicodeUTF8));
         action_Hotkeys->setText(QApplication::translate("MainWindow", "Configure &Hotkeys ...", 0, QApplication::UnicodeUTF8));
+        action_Profiling->setText(QApplication::translate("MainWindow", "Profile guest code", 0, QApplication::UnicodeUTF8));
+        action_Save_Profile->setText(QApplication::translate("MainWindow", "Save profile...", 0, QApplication::UnicodeUTF8));
         action_Configure->setText(QApplication::translate("MainWindow", "Configure ...", 0, QApplication::UnicodeUTF8));
         menu_File->setTitle(QApplication::translate("MainWindow", "&File", 0, QApplication::UnicodeUTF8));
         menu_Emulation->setTitle(QApplication::translate("MainWindow", "&Emulation", 0, QApplication::UnicodeUTF8));
@@ -0,0 +1,88 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/log_manager.h"
+#include "common/profiler.h"
+#include "common/timer.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hw/hw.h"
+
+#include "video_core/pica_trace.h"
+#include "video_core/video_core.h"
+
+#include "citra/emu_window/emu_window_glfw.h"
+#include "citra/emu_window/emu_window_headless.h"
+
+/// Replays a trace of the GPU work of frames, recorded by citra --record-trace, without the CPU
+int __cdecl main(int argc, char **argv) {
+    LogManager::Init();
+
+    // Leading options: --headless runs without a window or graphics context, --resolution-scale
+    // <1-4> renders draws on the host GPU at a multiple of the resolution, --repeat <count>
+    // replays the trace a number of times, e.g. to benchmark past the warm-up of the caches
+    int repeat = 1;
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--headless") == 0) {
+            VideoCore::g_headless_enabled = true;
+        } else if (strcmp(argv[1], "--resolution-scale") == 0 && argc >= 3) {
+            VideoCore::g_renderer_backend = "opengl";
+            VideoCore::g_resolution_scale = atoi(argv[2]);
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--repeat") == 0 && argc >= 3) {
+            repeat = std::max(atoi(argv[2]), 1);
+            argv++;
+            argc--;
+        } else {
+            ERROR_LOG(BOOT, "Unknown option %s", argv[1]);
+        }
+        argv++;
+        argc--;
+    }
+    if (argc < 2) {
+        ERROR_LOG(BOOT, "No trace specified");
+        return 1;
+    }
+
+    EmuWindow_Headless headless_window;
+    EmuWindow_GLFW* emu_window = NULL;
+    if (!VideoCore::g_headless_enabled) {
+        emu_window = new EmuWindow_GLFW;
+    }
+
+    // Only the modules the GPU work runs through, there is no CPU core nor services
+    CoreTiming::Init();
+    Memory::Init();
+    HW::Init();
+    VideoCore::Init(emu_window != NULL ? (EmuWindow*)emu_window : &headless_window);
+
+    int frames = 0;
+    const u64 start = Common::Timer::GetTimeUs();
+    for (int i = 0; i < repeat; i++) {
+        const int replayed = PicaTrace::Replay(argv[1]);
+        if (replayed < 0) {
+            frames = -1;
+            break;
+        }
+        frames += replayed;
+    }
+    const u64 elapsed = Common::Timer::GetTimeUs() - start;
+    if (frames > 0) {
+        NOTICE_LOG(BOOT, "replayed %d frames in %.3f s, %.3f ms per frame", frames,
+            elapsed / 1e6, elapsed / 1e3 / frames);
+    }
+
+    VideoCore::Shutdown();
+    HW::Shutdown();
+    Memory::Shutdown();
+    CoreTiming::Shutdown();
+    delete emu_window;
+
+    return frames >= 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/log_manager.h"
+
+#include "core/arm/exec_trace.h"
+
+/**
+ * Prints an instruction and the registers it changed
+ * @param event Instruction event
+ * @param regs Registers after the instruction
+ */
+static void PrintInstruction(const ExecTrace::Event& event, const u32* regs) {
+    printf("%08X", event.address);
+    for (int i = 0; i < ExecTrace::NUM_REGS; i++) {
+        if (!(event.changed & (1 << i))) {
+            continue;
+        }
+        if (i == ExecTrace::NUM_REGS - 1) {
+            printf(" cpsr=%08X", regs[i]);
+        } else {
+            printf(" r%d=%08X", i, regs[i]);
+        }
+    }
+    printf("\n");
+}
+
+/// Prints an execution trace recorded by citra --exec-trace, one event per line
+int __cdecl main(int argc, char **argv) {
+    LogManager::Init();
+
+    // Leading options: --summary only counts the events, e.g. to check a trace quickly
+    bool summary = false;
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--summary") == 0) {
+            summary = true;
+        } else {
+            ERROR_LOG(BOOT, "Unknown option %s", argv[1]);
+        }
+        argv++;
+        argc--;
+    }
+    if (argc < 2) {
+        ERROR_LOG(BOOT, "No trace specified");
+        return 1;
+    }
+
+    ExecTrace::Reader reader;
+    if (!reader.Open(argv[1])) {
+        return 1;
+    }
+
+    // Data accesses are recorded before the instruction that made them, they're printed above it
+    u64 counts[4] = {};
+    ExecTrace::Event event;
+    while (reader.Next(event)) {
+        counts[event.type]++;
+        if (summary) {
+            continue;
+        }
+        switch (event.type) {
+        case ExecTrace::Event::INSTRUCTION:
+            PrintInstruction(event, reader.GetRegs());
+            break;
+
+        case ExecTrace::Event::READ:
+        case ExecTrace::Event::WRITE:
+            printf("    %s%d %08X %0*X\n", event.type == ExecTrace::Event::WRITE ? "write" : "read",
+                event.size * 8, event.address, event.size * 2, event.value);
+            break;
+
+        case ExecTrace::Event::THREAD:
+            printf("thread %08X\n", event.value);
+            break;
+        }
+    }
+
+    printf("%llu instructions, %llu reads, %llu writes, %llu thread switches\n",
+        (unsigned long long)counts[ExecTrace::Event::INSTRUCTION],
+        (unsigned long long)counts[ExecTrace::Event::READ],
+        (unsigned long long)counts[ExecTrace::Event::WRITE],
+        (unsigned long long)counts[ExecTrace::Event::THREAD]);
+    return 0;
+}
@@ -32,6 +32,10 @@ inline void AtomicAnd(volatile u32& target, u32 value) {
     __sync_and_and_fetch(&target, value);
 }
 
+inline void AtomicAnd(volatile u8& target, u8 value) {
+    __sync_and_and_fetch(&target, value);
+}
+
 inline void AtomicDecrement(volatile u32& target) {
     __sync_add_and_fetch(&target, -1);
 }
@@ -56,6 +60,10 @@ inline void AtomicOr(volatile u32& target, u32 value) {
     __sync_or_and_fetch(&target, value);
 }
 
+inline void AtomicOr(volatile u8& target, u8 value) {
+    __sync_or_and_fetch(&target, value);
+}
+
 inline void AtomicStore(volatile u32& dest, u32 value) {
     dest = value; // 32-bit writes are always atomic.
 }
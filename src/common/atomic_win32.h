@@ -38,6 +38,10 @@ inline void AtomicAnd(volatile u32& target, u32 value) {
     _InterlockedAnd((volatile LONG*)&target, (LONG)value);
 }
 
+inline void AtomicAnd(volatile u8& target, u8 value) {
+    _InterlockedAnd8((volatile char*)&target, (char)value);
+}
+
 inline void AtomicIncrement(volatile u32& target) {
     InterlockedIncrement((volatile LONG*)&target);
 }
@@ -59,6 +63,10 @@ inline void AtomicOr(volatile u32& target, u32 value) {
     _InterlockedOr((volatile LONG*)&target, (LONG)value);
 }
 
+inline void AtomicOr(volatile u8& target, u8 value) {
+    _InterlockedOr8((volatile char*)&target, (char)value);
+}
+
 inline void AtomicStore(volatile u32& dest, u32 value) {
     dest = value; // 32-bit writes are always atomic.
 }
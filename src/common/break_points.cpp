@@ -9,8 +9,22 @@
 #include <sstream>
 #include <algorithm>
 
+void PageBitmap::Set(u32 start_address, u32 end_address, bool set)
+{
+    for (u32 page = start_address >> PAGE_BITS; page <= (end_address >> PAGE_BITS); ++page)
+    {
+        if (set)
+            m_Bits[page >> 5] |= 1 << (page & 31);
+        else
+            m_Bits[page >> 5] &= ~(1 << (page & 31));
+    }
+}
+
 bool BreakPoints::IsAddressBreakPoint(u32 _iAddress)
 {
+    if (!HasBreakPointInPage(_iAddress))
+        return false;
+
     for (TBreakPoints::iterator i = m_BreakPoints.begin(); i != m_BreakPoints.end(); ++i)
         if (i->iAddress == _iAddress)
             return true;
@@ -61,6 +75,7 @@ void BreakPoints::Add(const TBreakPoint& bp)
     if (!IsAddressBreakPoint(bp.iAddress))
     {
         m_BreakPoints.push_back(bp);
+        m_Pages.Set(bp.iAddress, bp.iAddress, true);
         //if (jit)
         //    jit->GetBlockCache()->InvalidateICache(bp.iAddress, 4);
     }
@@ -76,6 +91,7 @@ void BreakPoints::Add(u32 em_address, bool temp)
         pt.iAddress = em_address;
 
         m_BreakPoints.push_back(pt);
+        m_Pages.Set(em_address, em_address, true);
 
         //if (jit)
         //    jit->GetBlockCache()->InvalidateICache(em_address, 4);
@@ -89,6 +105,7 @@ void BreakPoints::Remove(u32 em_address)
         if (i->iAddress == em_address)
         {
             m_BreakPoints.erase(i);
+            UpdatePage(em_address);
             //if (jit)
             //    jit->GetBlockCache()->InvalidateICache(em_address, 4);
             return;
@@ -109,6 +126,16 @@ void BreakPoints::Clear()
     //}
     
     m_BreakPoints.clear();
+    m_Pages.Clear();
+}
+
+void BreakPoints::UpdatePage(u32 _iAddress)
+{
+    const u32 page = _iAddress >> PageBitmap::PAGE_BITS;
+    for (TBreakPoints::iterator i = m_BreakPoints.begin(); i != m_BreakPoints.end(); ++i)
+        if ((i->iAddress >> PageBitmap::PAGE_BITS) == page)
+            return;
+    m_Pages.Set(_iAddress, _iAddress, false);
 }
 
 MemChecks::TMemChecksStr MemChecks::GetStrings() const
@@ -152,7 +179,11 @@ void MemChecks::AddFromStrings(const TMemChecksStr& mcs)
 void MemChecks::Add(const TMemCheck& _rMemoryCheck)
 {
     if (GetMemCheck(_rMemoryCheck.StartAddress) == 0)
+    {
         m_MemChecks.push_back(_rMemoryCheck);
+        m_Pages.Set(_rMemoryCheck.StartAddress,
+            _rMemoryCheck.bRange ? _rMemoryCheck.EndAddress : _rMemoryCheck.StartAddress, true);
+    }
 }
 
 void MemChecks::Remove(u32 _Address)
@@ -162,6 +193,11 @@ void MemChecks::Remove(u32 _Address)
         if (i->StartAddress == _Address)
         {
             m_MemChecks.erase(i);
+
+            // The pages of the other checks are set again, they may share some
+            m_Pages.Clear();
+            for (TMemChecks::iterator j = m_MemChecks.begin(); j != m_MemChecks.end(); ++j)
+                m_Pages.Set(j->StartAddress, j->bRange ? j->EndAddress : j->StartAddress, true);
             return;
         }
     }
@@ -169,6 +205,9 @@ void MemChecks::Remove(u32 _Address)
 
 TMemCheck *MemChecks::GetMemCheck(u32 address)
 {
+    if (!HasMemCheckInPage(address))
+        return 0;
+
     for (TMemChecks::iterator i = m_MemChecks.begin(); i != m_MemChecks.end(); ++i)
     {
         if (i->bRange)
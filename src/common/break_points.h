@@ -5,6 +5,7 @@
 #ifndef _DEBUGGER_BREAKPOINTS_H
 #define _DEBUGGER_BREAKPOINTS_H
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -12,6 +13,30 @@
 
 class DebugInterface;
 
+// Bitmap of the 4 KiB pages of the address space, for the checks the CPU makes on every
+// instruction or access to cost a single bit test where nothing is set
+class PageBitmap
+{
+public:
+    enum { PAGE_BITS = 12 };
+
+    PageBitmap() : m_Bits(1 << (32 - PAGE_BITS - 5), 0) {}
+
+    bool IsSet(u32 address) const
+    {
+        const u32 page = address >> PAGE_BITS;
+        return (m_Bits[page >> 5] >> (page & 31)) & 1;
+    }
+
+    // Sets or clears the bits of the pages a range of addresses touches
+    void Set(u32 start_address, u32 end_address, bool set);
+
+    void Clear() { std::fill(m_Bits.begin(), m_Bits.end(), 0); }
+
+private:
+    std::vector<u32> m_Bits;
+};
+
 struct TBreakPoint
 {
     u32        iAddress;
@@ -59,6 +84,10 @@ public:
     bool IsAddressBreakPoint(u32 _iAddress);
     bool IsTempBreakPoint(u32 _iAddress);
 
+    // whether there are breakpoints in the page of an address, cheap enough to be asked for
+    // every instruction fetched
+    bool HasBreakPointInPage(u32 _iAddress) const { return m_Pages.IsSet(_iAddress); }
+
     // Add BreakPoint
     void Add(u32 em_address, bool temp=false);
     void Add(const TBreakPoint& bp);
@@ -70,7 +99,11 @@ public:
     void DeleteByAddress(u32 _Address);
 
 private:
+    // Recomputes the page bit of an address after a breakpoint was removed from it
+    void UpdatePage(u32 _iAddress);
+
     TBreakPoints m_BreakPoints;
+    PageBitmap   m_Pages;
     u32    m_iBreakOnCount;
 };
 
@@ -95,7 +128,14 @@ public:
     TMemCheck *GetMemCheck(u32 address);
     void Remove(u32 _Address);
 
-    void Clear() { m_MemChecks.clear(); };
+    // whether any memory check covers the page of an address, cheap enough to be asked for every
+    // access
+    bool HasMemCheckInPage(u32 address) const { return m_Pages.IsSet(address); }
+
+    void Clear() { m_MemChecks.clear(); m_Pages.Clear(); };
+
+private:
+    PageBitmap m_Pages;
 };
 
 #endif
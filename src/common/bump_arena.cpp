@@ -0,0 +1,77 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <new>
+
+#include "common/bump_arena.h"
+
+namespace Common {
+
+/**
+ * Creates an arena without any block yet
+ * @param block_size Size of the first block in bytes
+ */
+BumpArena::BumpArena(size_t block_size) : m_block_size(block_size), m_begin(NULL), m_cur(NULL),
+    m_end(NULL), m_used_before(0) {
+}
+
+/// Frees the blocks
+BumpArena::~BumpArena() {
+    for (const Block& block : m_blocks) {
+        ::operator delete(block.data);
+    }
+}
+
+/**
+ * Allocates memory living until the next Reset
+ * @param size Size in bytes
+ * @param alignment Alignment in bytes, a power of two
+ * @return Pointer to the memory
+ */
+void* BumpArena::Allocate(size_t size, size_t alignment) {
+    u8* ptr = (u8*)(((uintptr_t)m_cur + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (m_cur == NULL || ptr > m_end || (size_t)(m_end - ptr) < size) {
+        AddBlock(size + alignment);
+        ptr = (u8*)(((uintptr_t)m_cur + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+    m_cur = ptr + size;
+    return ptr;
+}
+
+/// Takes back all of the memory allocated, which must no longer be used
+void BumpArena::Reset() {
+    if (m_blocks.size() > 1) {
+        size_t total = 0;
+        for (const Block& block : m_blocks) {
+            total += block.size;
+            ::operator delete(block.data);
+        }
+        m_blocks.clear();
+        m_begin = NULL;
+        m_block_size = total;
+        AddBlock(total);
+    }
+    m_cur = m_begin;
+    m_used_before = 0;
+}
+
+/**
+ * Makes a new current block
+ * @param min_size Size the block must have at least in bytes
+ */
+void BumpArena::AddBlock(size_t min_size) {
+    if (m_begin != NULL) {
+        m_used_before += m_cur - m_begin;
+    }
+    // Blocks double in size, so that a frame larger than usual runs out of them a few times only
+    const size_t size = std::max(m_block_size, min_size);
+    m_block_size = size * 2;
+    const Block block = { (u8*)::operator new(size), size };
+    m_blocks.push_back(block);
+    m_begin = m_cur = block.data;
+    m_end = block.data + size;
+}
+
+} // namespace
@@ -0,0 +1,74 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Arena handing out memory by bumping a pointer, for data that all dies at once, e.g. at the end
+ * of a frame. Nothing is freed individually and no destructor runs, Reset takes everything back.
+ * A Reset after the memory overflowed into more blocks replaces them with a single block as large
+ * as all of them, so that a steady workload ends up in one block without any heap traffic.
+ * Not thread-safe.
+ */
+class BumpArena : NonCopyable {
+public:
+    /**
+     * Creates an arena without any block yet
+     * @param block_size Size of the first block in bytes
+     */
+    explicit BumpArena(size_t block_size = 0x10000);
+
+    /// Frees the blocks
+    ~BumpArena();
+
+    /**
+     * Allocates memory living until the next Reset
+     * @param size Size in bytes
+     * @param alignment Alignment in bytes, a power of two
+     * @return Pointer to the memory
+     */
+    void* Allocate(size_t size, size_t alignment = 16);
+
+    /**
+     * Allocates an array of trivial elements living until the next Reset, left uninitialized
+     * @tparam T Element type, without a meaningful destructor
+     * @param count Number of elements
+     * @return Pointer to the first element
+     */
+    template <typename T>
+    T* AllocateArray(size_t count) {
+        return static_cast<T*>(Allocate(count * sizeof(T), __alignof(T)));
+    }
+
+    /// Takes back all of the memory allocated, which must no longer be used
+    void Reset();
+
+    /// Gets the number of bytes allocated since the last Reset, alignment padding included
+    size_t GetUsed() const {
+        return m_used_before + (m_cur - m_begin);
+    }
+
+private:
+    void AddBlock(size_t min_size);
+
+    struct Block {
+        u8*     data;
+        size_t  size;
+    };
+
+    std::vector<Block>  m_blocks;           ///< The current block last
+    size_t              m_block_size;       ///< Size of the next block made
+    u8*                 m_begin;            ///< Current block
+    u8*                 m_cur;              ///< Free space left in the current block
+    u8*                 m_end;
+    size_t              m_used_before;      ///< Bytes used in the blocks before the current one
+};
+
+} // namespace
@@ -0,0 +1,189 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/code_cache.h"
+#include "common/log.h"
+#include "common/memory_util.h"
+
+namespace Common {
+
+CodeCache::CodeCache() : m_base(NULL), m_size(0), m_tag(MemoryTracker::TAG_JIT_CODE),
+    m_write_xor_execute(false), m_write_depth(0), m_current(0), m_offset(0), m_used(0),
+    m_num_blocks(0), m_num_reclaimed(0), m_num_flushes(0) {
+}
+
+CodeCache::~CodeCache() {
+    Shutdown();
+}
+
+/**
+ * Reserves the code space
+ * @param size Size of the code space in bytes, rounded down to whole regions
+ * @param tag Tag the code is accounted to in Common::MemoryTracker
+ * @param write_xor_execute Whether the space is writable only between BeginWrite and EndWrite,
+ *      see HostRequiresWriteXorExecute
+ * @return False if the host has no executable memory to give
+ */
+bool CodeCache::Init(size_t size, MemoryTracker::Tag tag, bool write_xor_execute) {
+    Shutdown();
+    m_size = size / REGION_SIZE * REGION_SIZE;
+    m_tag = tag;
+    m_write_xor_execute = write_xor_execute;
+    if (write_xor_execute) {
+        m_base = (u8*)AllocateMemoryPages(m_size);
+        if (m_base != NULL) {
+            WriteProtectMemory(m_base, m_size, true);
+        }
+    } else {
+        m_base = (u8*)AllocateExecutableMemory(m_size, false);
+    }
+    if (m_base == NULL) {
+        m_size = 0;
+        return false;
+    }
+    m_regions.assign(m_size / REGION_SIZE, Region());
+    m_current = 0;
+    m_offset = 0;
+    m_num_reclaimed = 0;
+    m_num_flushes = 0;
+    return true;
+}
+
+/// Frees the code space, all of the code goes away
+void CodeCache::Shutdown() {
+    if (m_base == NULL) {
+        return;
+    }
+    Flush();
+    FreeMemoryPages(m_base, m_size);
+    m_base = NULL;
+    m_size = 0;
+    m_regions.clear();
+}
+
+/// Whether the host refuses memory that is both writable and executable
+bool CodeCache::HostRequiresWriteXorExecute() {
+#if defined(__OpenBSD__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Gets room for a block of code, in the current region or else in a free one
+ * @param max_size Upper bound of the size of the code in bytes, at most REGION_SIZE
+ * @return Where to write the code, NULL if no region has room and the cache has to be flushed
+ */
+u8* CodeCache::BeginBlock(size_t max_size) {
+    if (m_base == NULL || max_size > REGION_SIZE) {
+        return NULL;
+    }
+    if (m_offset + max_size > REGION_SIZE) {
+        // The lowest free region, so that the code stays together
+        size_t next = m_regions.size();
+        for (size_t i = 0; i < m_regions.size(); i++) {
+            if (i != m_current && m_regions[i].num_blocks == 0) {
+                next = i;
+                break;
+            }
+        }
+        if (next == m_regions.size()) {
+            return NULL;
+        }
+        m_current = next;
+        m_offset = 0;
+    }
+    return m_base + m_current * REGION_SIZE + m_offset;
+}
+
+/**
+ * Keeps a block of code written where BeginBlock said, nothing is kept until it's called
+ * @param code Code of the block
+ * @param size Size of the code in bytes
+ */
+void CodeCache::EndBlock(u8* code, size_t size) {
+    _dbg_assert_(COMMON, code == m_base + m_current * REGION_SIZE + m_offset &&
+        m_offset + size <= REGION_SIZE);
+    Region& region = m_regions[m_current];
+    region.used += (u32)size;
+    region.num_blocks++;
+    m_offset += size;
+    m_used += size;
+    m_num_blocks++;
+    MemoryTracker::Allocate(m_tag, size);
+}
+
+/**
+ * Frees the code of a block, which nothing may run or jump to anymore. Its region is reused once
+ * all of its blocks are freed.
+ * @param code Code of the block
+ * @param size Size of the code in bytes, as given to EndBlock
+ */
+void CodeCache::FreeBlock(u8* code, size_t size) {
+    const size_t index = GetRegion(code);
+    Region& region = m_regions[index];
+    _dbg_assert_(COMMON, region.num_blocks > 0 && region.used >= size);
+    region.used -= (u32)size;
+    region.num_blocks--;
+    m_used -= size;
+    m_num_blocks--;
+    MemoryTracker::Free(m_tag, size);
+
+    if (region.num_blocks == 0) {
+        m_num_reclaimed++;
+        if (index == m_current) {
+            m_offset = 0;
+        }
+    }
+}
+
+/// Frees all of the code
+void CodeCache::Flush() {
+    if (m_num_blocks != 0) {
+        m_num_flushes++;
+    }
+    MemoryTracker::Adjust(m_tag, -(s64)m_used, -(s64)m_num_blocks);
+    for (Region& region : m_regions) {
+        region.used = 0;
+        region.num_blocks = 0;
+    }
+    m_current = 0;
+    m_offset = 0;
+    m_used = 0;
+    m_num_blocks = 0;
+}
+
+/// Makes the code space writable until the matching EndWrite, calls nest
+void CodeCache::BeginWrite() {
+    if (m_write_xor_execute && m_base != NULL && m_write_depth++ == 0) {
+        UnWriteProtectMemory(m_base, m_size, false);
+    }
+}
+
+/// Makes the code space executable again once the outermost BeginWrite is ended
+void CodeCache::EndWrite() {
+    if (m_write_xor_execute && m_base != NULL && --m_write_depth == 0) {
+        WriteProtectMemory(m_base, m_size, true);
+    }
+}
+
+/// Gets the usage of the code space
+CodeCache::Stats CodeCache::GetStats() const {
+    Stats stats;
+    stats.size = m_size;
+    stats.used = m_used;
+    stats.num_blocks = m_num_blocks;
+    stats.num_free_regions = 0;
+    for (size_t i = 0; i < m_regions.size(); i++) {
+        if (i != m_current && m_regions[i].num_blocks == 0) {
+            stats.num_free_regions++;
+        }
+    }
+    stats.num_reclaimed = m_num_reclaimed;
+    stats.num_flushes = m_num_flushes;
+    return stats;
+}
+
+} // namespace
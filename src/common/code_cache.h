@@ -0,0 +1,141 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+#include "common/memory_tracker.h"
+
+namespace Common {
+
+/**
+ * Executable memory of a JIT, reserved once and split into regions that blocks of code are bump
+ * allocated from. Each region counts the blocks it holds, so that the code of blocks dropped
+ * after their guest code changed is reused once their whole region is free instead of leaking
+ * until the next full flush. A full flush is only needed when no region is left.
+ *
+ * On hosts that refuse memory that is both writable and executable, the space is executable and
+ * made writable, but not executable, between BeginWrite and EndWrite. No code may run meanwhile.
+ */
+class CodeCache : NonCopyable {
+public:
+    enum {
+        REGION_SIZE = 0x10000,  ///< Granularity code is reused at, a multiple of the host page
+    };
+
+    /// Usage of the code space
+    struct Stats {
+        size_t  size;               ///< Bytes of the code space
+        size_t  used;               ///< Bytes of the blocks alive
+        u32     num_blocks;         ///< Blocks alive
+        u32     num_free_regions;   ///< Regions without blocks, the current one excluded
+        u64     num_reclaimed;      ///< Regions freed by their last block since Init
+        u64     num_flushes;        ///< Full flushes of blocks alive since Init
+    };
+
+    CodeCache();
+    ~CodeCache();
+
+    /**
+     * Reserves the code space
+     * @param size Size of the code space in bytes, rounded down to whole regions
+     * @param tag Tag the code is accounted to in Common::MemoryTracker
+     * @param write_xor_execute Whether the space is writable only between BeginWrite and
+     *      EndWrite, see HostRequiresWriteXorExecute
+     * @return False if the host has no executable memory to give
+     */
+    bool Init(size_t size, MemoryTracker::Tag tag, bool write_xor_execute);
+
+    /// Frees the code space, all of the code goes away
+    void Shutdown();
+
+    /// Whether the host refuses memory that is both writable and executable
+    static bool HostRequiresWriteXorExecute();
+
+    bool IsValid() const {
+        return m_base != NULL;
+    }
+
+    /**
+     * Gets room for a block of code, in the current region or else in a free one
+     * @param max_size Upper bound of the size of the code in bytes, at most REGION_SIZE
+     * @return Where to write the code, NULL if no region has room and the cache has to be
+     *      flushed
+     */
+    u8* BeginBlock(size_t max_size);
+
+    /**
+     * Keeps a block of code written where BeginBlock said, nothing is kept until it's called
+     * @param code Code of the block
+     * @param size Size of the code in bytes
+     */
+    void EndBlock(u8* code, size_t size);
+
+    /**
+     * Frees the code of a block, which nothing may run or jump to anymore. Its region is reused
+     * once all of its blocks are freed.
+     * @param code Code of the block
+     * @param size Size of the code in bytes, as given to EndBlock
+     */
+    void FreeBlock(u8* code, size_t size);
+
+    /// Frees all of the code
+    void Flush();
+
+    /// Makes the code space writable until the matching EndWrite, calls nest
+    void BeginWrite();
+
+    /// Makes the code space executable again once the outermost BeginWrite is ended
+    void EndWrite();
+
+    /// Gets the usage of the code space
+    Stats GetStats() const;
+
+    /// Scope of BeginWrite and EndWrite
+    class WriteScope : NonCopyable {
+    public:
+        explicit WriteScope(CodeCache& cache) : m_cache(cache) {
+            m_cache.BeginWrite();
+        }
+        ~WriteScope() {
+            m_cache.EndWrite();
+        }
+
+    private:
+        CodeCache& m_cache;
+    };
+
+private:
+    /// Blocks alive of a region
+    struct Region {
+        u32 used;           ///< Bytes of their code
+        u32 num_blocks;
+    };
+
+    /**
+     * Gets the region of a byte of the code space
+     * @param code Byte of the code space
+     * @return Index of the region
+     */
+    size_t GetRegion(const u8* code) const {
+        return (code - m_base) / REGION_SIZE;
+    }
+
+    u8*                 m_base;
+    size_t              m_size;
+    MemoryTracker::Tag  m_tag;
+    bool                m_write_xor_execute;
+    int                 m_write_depth;      ///< BeginWrite calls not ended yet
+    std::vector<Region> m_regions;
+    size_t              m_current;          ///< Region blocks are allocated from
+    size_t              m_offset;           ///< Of the free space in the current region
+    size_t              m_used;
+    u32                 m_num_blocks;
+    u64                 m_num_reclaimed;
+    u64                 m_num_flushes;
+};
+
+} // namespace
@@ -75,5 +75,6 @@
 
 // Files in the directory returned by GetUserPath(D_SYSCONF_IDX)
 #define SYSCONF    "SYSCONF"
+#define AES_KEYS   "aes_keys.txt"
 
 #endif // _COMMON_PATHS_H_
@@ -0,0 +1,316 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/compressed_image.h"
+#include "common/log.h"
+#include "common/lz4.h"
+
+namespace Common {
+
+namespace {
+
+enum {
+    CREATE_BATCH_BLOCKS = 64,   ///< Blocks compressed at once by Create, in parallel
+};
+
+} // namespace
+
+CompressedImage::CompressedImage() : m_index(nullptr), m_size(0), m_block_size(0),
+    m_num_blocks(0), m_clock(0), m_last_block(0xFFFFFFFF) {
+}
+
+CompressedImage::~CompressedImage() {
+    Close();
+}
+
+/**
+ * Tells whether a file starts like a compressed image
+ * @param header First bytes of the file
+ * @param size Number of bytes
+ * @return True if it does
+ */
+bool CompressedImage::IsCompressedImage(const u8* header, size_t size) {
+    u32 magic;
+    if (size < sizeof(magic)) {
+        return false;
+    }
+    memcpy(&magic, header, sizeof(magic));
+    return magic == MAGIC;
+}
+
+/**
+ * Compresses an image file
+ * @param filename Path of the image
+ * @param compressed_filename Path of the compressed image written
+ * @param block_size Size of the blocks, a power of 2 from MIN_BLOCK_SIZE to MAX_BLOCK_SIZE
+ * @return True on success
+ */
+bool CompressedImage::Create(const std::string& filename, const std::string& compressed_filename,
+    u32 block_size) {
+
+    if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE ||
+        (block_size & (block_size - 1)) != 0) {
+        ERROR_LOG(COMMON, "CompressedImage: invalid block size 0x%X", block_size);
+        return false;
+    }
+    File::MappedFile image(filename);
+    if (!image.IsOpen()) {
+        return false;
+    }
+    const u64 num_blocks = (image.GetSize() + block_size - 1) / block_size;
+    if (num_blocks > 0xFFFFFFFF) {
+        ERROR_LOG(COMMON, "CompressedImage: %s is too large", filename.c_str());
+        return false;
+    }
+    File::IOFile out(compressed_filename, "wb");
+    if (!out.IsOpen()) {
+        ERROR_LOG(COMMON, "CompressedImage: couldn't create %s", compressed_filename.c_str());
+        return false;
+    }
+
+    Header header = {};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.block_size = block_size;
+    header.num_blocks = (u32)num_blocks;
+    header.size = image.GetSize();
+    std::vector<u64> index((size_t)num_blocks + 1);
+    u64 offset = sizeof(header) + index.size() * sizeof(u64);
+
+    // The index is written once the sizes of the blocks are known
+    bool ok = out.WriteBytes(&header, sizeof(header)) &&
+        out.WriteArray(index.data(), index.size());
+
+    std::vector<std::vector<u8>> batch(CREATE_BATCH_BLOCKS);
+    for (u64 first = 0; ok && first < num_blocks; first += CREATE_BATCH_BLOCKS) {
+        const int count = (int)std::min<u64>(CREATE_BATCH_BLOCKS, num_blocks - first);
+        ThreadPool::GetShared().ParallelFor(0, count, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const u64 start = (first + i) * block_size;
+                const size_t size = (size_t)std::min<u64>(block_size, image.GetSize() - start);
+                const u8* data = image.GetData() + start;
+                // Blocks that don't compress, stored as is, are told apart by their size
+                std::vector<u8>& compressed = batch[i];
+                compressed.resize(size - 1);
+                const size_t compressed_size = size > 1 ?
+                    LZ4Compress(data, size, compressed.data(), compressed.size()) : 0;
+                if (compressed_size == 0) {
+                    compressed.assign(data, data + size);
+                } else {
+                    compressed.resize(compressed_size);
+                }
+            }
+        });
+        for (int i = 0; ok && i < count; i++) {
+            index[(size_t)first + i] = offset;
+            offset += batch[i].size();
+            ok = out.WriteBytes(batch[i].data(), batch[i].size());
+        }
+    }
+    index[(size_t)num_blocks] = offset;
+
+    ok = ok && out.Seek(sizeof(header), SEEK_SET) && out.WriteArray(index.data(), index.size());
+    if (!ok) {
+        ERROR_LOG(COMMON, "CompressedImage: couldn't write %s", compressed_filename.c_str());
+        return false;
+    }
+    INFO_LOG(COMMON, "CompressedImage: compressed %s from %llu to %llu bytes", filename.c_str(),
+        (unsigned long long)image.GetSize(), (unsigned long long)offset);
+    return true;
+}
+
+/**
+ * Opens a compressed image, mapping it and checking its index
+ * @param filename Path of the compressed image
+ * @return True on success
+ */
+bool CompressedImage::Open(const std::string& filename) {
+    Close();
+    if (!m_file.Open(filename)) {
+        return false;
+    }
+    Header header;
+    const u64 file_size = m_file.GetSize();
+    if (file_size < sizeof(header)) {
+        ERROR_LOG(COMMON, "CompressedImage: %s is too small", filename.c_str());
+        m_file.Close();
+        return false;
+    }
+    memcpy(&header, m_file.GetData(), sizeof(header));
+
+    const u64 index_end = sizeof(header) + ((u64)header.num_blocks + 1) * sizeof(u64);
+    if (header.magic != MAGIC || header.version != VERSION ||
+        header.block_size < MIN_BLOCK_SIZE || header.block_size > MAX_BLOCK_SIZE ||
+        (header.block_size & (header.block_size - 1)) != 0 ||
+        (header.size + header.block_size - 1) / header.block_size != header.num_blocks ||
+        index_end > file_size) {
+
+        ERROR_LOG(COMMON, "CompressedImage: %s has a broken header", filename.c_str());
+        m_file.Close();
+        return false;
+    }
+    // The header is 8 byte aligned, as are the offsets in the mapping
+    const u64* index = (const u64*)(m_file.GetData() + sizeof(header));
+    for (u32 i = 0; i < header.num_blocks; i++) {
+        if (index[i] < index_end || index[i] > index[i + 1] || index[i + 1] > file_size ||
+            index[i + 1] - index[i] > header.block_size) {
+
+            ERROR_LOG(COMMON, "CompressedImage: %s has a broken index", filename.c_str());
+            m_file.Close();
+            return false;
+        }
+    }
+
+    m_index = index;
+    m_size = header.size;
+    m_block_size = header.block_size;
+    m_num_blocks = header.num_blocks;
+    return true;
+}
+
+/// Waits for the blocks being decompressed ahead, then closes the image
+void CompressedImage::Close() {
+    std::vector<Common::Task> prefetches;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        prefetches.swap(m_prefetches);
+    }
+    for (size_t i = 0; i < prefetches.size(); i++) {
+        prefetches[i].Wait();
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_blocks.clear();
+    m_clock = 0;
+    m_last_block = 0xFFFFFFFF;
+    m_file.Close();
+    m_index = nullptr;
+    m_size = 0;
+    m_block_size = 0;
+    m_num_blocks = 0;
+}
+
+/**
+ * Decompresses a block
+ * @param index Index of the block
+ * @param block Receives the data
+ * @return True on success, false if the block is broken
+ */
+bool CompressedImage::Decompress(u32 index, Block& block) const {
+    const u64 start = (u64)index * m_block_size;
+    const size_t size = (size_t)std::min<u64>(m_block_size, m_size - start);
+    const u8* compressed = m_file.GetData() + m_index[index];
+    const size_t compressed_size = (size_t)(m_index[index + 1] - m_index[index]);
+
+    block.data.resize(size);
+    if (compressed_size == size) {
+        memcpy(block.data.data(), compressed, size);
+        return true;
+    }
+    if (!LZ4Decompress(compressed, compressed_size, block.data.data(), size)) {
+        ERROR_LOG(COMMON, "CompressedImage: block %u is broken", index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Gets a block from the cache, adding it if it isn't, decompressed or not
+ * @param index Index of the block
+ * @return The block
+ */
+std::shared_ptr<CompressedImage::Block> CompressedImage::GetBlock(u32 index) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::shared_ptr<Block>& slot = m_blocks[index];
+    if (!slot) {
+        slot = std::make_shared<Block>();
+        slot->ready = false;
+        slot->valid = false;
+    }
+    slot->last_use = ++m_clock;
+    std::shared_ptr<Block> block = slot;
+
+    // Blocks still in use stay alive through their references once dropped
+    while (m_blocks.size() > CACHE_BLOCKS) {
+        auto oldest = m_blocks.end();
+        for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+            if (it->first != index && (oldest == m_blocks.end() ||
+                it->second->last_use < oldest->second->last_use)) {
+                oldest = it;
+            }
+        }
+        m_blocks.erase(oldest);
+    }
+
+    if (m_last_block + 1 == index) {
+        Prefetch(index + 1);
+    }
+    m_last_block = index;
+    return block;
+}
+
+/**
+ * Decompresses the blocks following a sequential read on the thread pool, if they aren't cached.
+ * The cache lock must be held.
+ * @param index Index of the first block to decompress
+ */
+void CompressedImage::Prefetch(u32 index) {
+    m_prefetches.erase(std::remove_if(m_prefetches.begin(), m_prefetches.end(),
+        [](const Common::Task& task) { return task.IsDone(); }), m_prefetches.end());
+
+    const u32 end = std::min<u32>(index + PREFETCH_BLOCKS, m_num_blocks);
+    for (u32 i = index; i < end; i++) {
+        if (m_blocks.count(i) != 0) {
+            continue;
+        }
+        std::shared_ptr<Block> block = std::make_shared<Block>();
+        block->ready = false;
+        block->valid = false;
+        block->last_use = m_clock;
+        m_blocks[i] = block;
+        m_prefetches.push_back(ThreadPool::GetShared().Submit([this, i, block] {
+            std::lock_guard<std::mutex> guard(block->lock);
+            if (!block->ready) {
+                block->valid = Decompress(i, *block);
+                block->ready = true;
+            }
+        }));
+    }
+}
+
+/**
+ * Reads part of the image, decompressing the blocks it lies in
+ * @param offset Offset in the decompressed image
+ * @param buffer Receives the data
+ * @param size Number of bytes to read
+ * @return Number of bytes read, fewer than asked past the end or from a broken block
+ */
+size_t CompressedImage::Read(u64 offset, u8* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size && offset < m_size) {
+        const u32 index = (u32)(offset / m_block_size);
+        const size_t in_block = (size_t)(offset % m_block_size);
+
+        std::shared_ptr<Block> block = GetBlock(index);
+        std::lock_guard<std::mutex> guard(block->lock);
+        if (!block->ready) {
+            block->valid = Decompress(index, *block);
+            block->ready = true;
+        }
+        if (!block->valid) {
+            break;
+        }
+        const size_t count = std::min(size - done, block->data.size() - in_block);
+        memcpy(buffer + done, block->data.data() + in_block, count);
+        done += count;
+        offset += count;
+    }
+    return done;
+}
+
+} // namespace
@@ -0,0 +1,123 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/thread.h"
+#include "common/thread_pool.h"
+
+namespace Common {
+
+/**
+ * Image file stored as fixed size blocks compressed with LZ4, read at random. The file starts with
+ * a header, followed by the offsets of the blocks in the file and then the blocks, each found
+ * through the index on its own and stored as is when it doesn't compress. Blocks are decompressed
+ * into a small cache as they are read; reads going through blocks in order have the following
+ * blocks decompressed ahead of them on the shared thread pool. Reads are thread-safe.
+ */
+class CompressedImage : NonCopyable {
+public:
+    enum {
+        MAGIC               = 0x4D494243,   ///< "CBIM"
+        VERSION             = 1,
+        DEFAULT_BLOCK_SIZE  = 0x10000,
+        MIN_BLOCK_SIZE      = 0x1000,
+        MAX_BLOCK_SIZE      = 0x100000,
+        CACHE_BLOCKS        = 32,           ///< Blocks kept decompressed
+        PREFETCH_BLOCKS     = 4,            ///< Blocks decompressed ahead of sequential reads
+    };
+
+    CompressedImage();
+    ~CompressedImage();
+
+    /**
+     * Tells whether a file starts like a compressed image
+     * @param header First bytes of the file
+     * @param size Number of bytes
+     * @return True if it does
+     */
+    static bool IsCompressedImage(const u8* header, size_t size);
+
+    /**
+     * Compresses an image file
+     * @param filename Path of the image
+     * @param compressed_filename Path of the compressed image written
+     * @param block_size Size of the blocks, a power of 2 from MIN_BLOCK_SIZE to MAX_BLOCK_SIZE
+     * @return True on success
+     */
+    static bool Create(const std::string& filename, const std::string& compressed_filename,
+        u32 block_size = DEFAULT_BLOCK_SIZE);
+
+    /**
+     * Opens a compressed image, mapping it and checking its index
+     * @param filename Path of the compressed image
+     * @return True on success
+     */
+    bool Open(const std::string& filename);
+
+    /// Waits for the blocks being decompressed ahead, then closes the image
+    void Close();
+
+    bool IsOpen() const {
+        return m_file.IsOpen();
+    }
+
+    /// Gets the size of the image once decompressed, in bytes
+    u64 GetSize() const {
+        return m_size;
+    }
+
+    /**
+     * Reads part of the image, decompressing the blocks it lies in
+     * @param offset Offset in the decompressed image
+     * @param buffer Receives the data
+     * @param size Number of bytes to read
+     * @return Number of bytes read, fewer than asked past the end or from a broken block
+     */
+    size_t Read(u64 offset, u8* buffer, size_t size);
+
+private:
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 block_size;
+        u32 num_blocks;
+        u64 size;                   ///< Of the decompressed image
+        u64 reserved;
+    };
+
+    /// Block of the cache, decompressed by whoever takes its lock first
+    struct Block {
+        std::mutex      lock;       ///< Guards everything below
+        bool            ready;      ///< Whether it was decompressed, or found broken
+        bool            valid;      ///< Whether it is intact, once ready
+        std::vector<u8> data;
+        u64             last_use;   ///< Of the cache clock, guarded by the cache lock
+    };
+
+    std::shared_ptr<Block> GetBlock(u32 index);
+    void Prefetch(u32 index);
+    bool Decompress(u32 index, Block& block) const;
+
+    File::MappedFile    m_file;
+    const u64*          m_index;        ///< Offsets of the blocks in the file, num_blocks + 1
+    u64                 m_size;
+    u32                 m_block_size;
+    u32                 m_num_blocks;
+
+    std::mutex                                          m_lock;     ///< Guards everything below
+    std::unordered_map<u32, std::shared_ptr<Block>>     m_blocks;   ///< The cache, by index
+    u64                                                 m_clock;    ///< Of the last use
+    u32                                                 m_last_block;   ///< Last block read
+    std::vector<Common::Task>                           m_prefetches;   ///< Tasks maybe running
+};
+
+} // namespace
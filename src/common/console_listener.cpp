@@ -19,6 +19,7 @@
 
 ConsoleListener::ConsoleListener()
 {
+    m_buffered = 0;
 #ifdef _WIN32
     hConsole = NULL;
     bUseColor = true;
@@ -29,6 +30,7 @@ ConsoleListener::ConsoleListener()
 
 ConsoleListener::~ConsoleListener()
 {
+    Flush();
     Close();
 }
 
@@ -309,9 +311,32 @@ void ConsoleListener::Log(LogTypes::LOG_LEVELS Level, const char *Text)
             break;
         }
     }
-    fprintf(stderr, "%s%s%s", ColorAttr, Text, ResetAttr);
+    const size_t ColorLength = strlen(ColorAttr);
+    const size_t TextLength = strlen(Text);
+    const size_t ResetLength = strlen(ResetAttr);
+    const size_t Length = ColorLength + TextLength + ResetLength;
+    if (m_buffered + Length > BUFFER_SIZE)
+        Flush();
+    if (Length > BUFFER_SIZE)
+    {
+        fprintf(stderr, "%s%s%s", ColorAttr, Text, ResetAttr);
+        return;
+    }
+    memcpy(m_buffer + m_buffered, ColorAttr, ColorLength);
+    memcpy(m_buffer + m_buffered + ColorLength, Text, TextLength);
+    memcpy(m_buffer + m_buffered + ColorLength + TextLength, ResetAttr, ResetLength);
+    m_buffered += Length;
 #endif
 }
+
+void ConsoleListener::Flush()
+{
+    if (m_buffered == 0)
+        return;
+    fwrite(m_buffer, 1, m_buffered, stderr);
+    fflush(stderr);
+    m_buffered = 0;
+}
 // Clear console screen
 void ConsoleListener::ClearScreen(bool Cursor)
 { 
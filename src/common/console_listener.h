@@ -28,9 +28,16 @@ public:
     COORD GetCoordinates(int BytesRead, int BufferWidth);
 #endif
     void Log(LogTypes::LOG_LEVELS, const char *Text);
+    void Flush();
     void ClearScreen(bool Cursor = true);
 
 private:
+    // Messages are written to stderr a buffer at a time, the terminal is slow with every write.
+    // The Windows console takes the colours as calls between the writes, it's written directly.
+    enum { BUFFER_SIZE = 0x10000 };
+    char m_buffer[BUFFER_SIZE];
+    size_t m_buffered;
+
 #ifdef _WIN32
     HWND GetHwnd(void);
     HANDLE hConsole;
@@ -0,0 +1,247 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/cpu_detect.h"
+#include "common/string_util.h"
+
+#if defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+CPUInfo cpu_info;
+
+#if defined(_M_X64) || defined(_M_IX86)
+
+/**
+ * Runs the CPUID instruction
+ * @param info Receives EAX, EBX, ECX and EDX
+ * @param function Leaf to query
+ * @param subfunction Subleaf to query, in ECX
+ */
+static void CPUID(u32 info[4], u32 function, u32 subfunction = 0) {
+#ifdef _MSC_VER
+    __cpuidex((int*)info, function, subfunction);
+#else
+    __cpuid_count(function, subfunction, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+/**
+ * Reads an extended control register, the OS saves the AVX state if bits 1 and 2 of XCR0 are set
+ * @return Low 32 bits of XCR0
+ */
+static u32 GetXCR0() {
+#ifdef _MSC_VER
+    return (u32)_xgetbv(0);
+#else
+    u32 eax, edx;
+    __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#endif
+}
+
+/**
+ * Reads the cache sizes from the deterministic cache parameters leaf, 4 on Intel and 0x8000001D
+ * on AMD, both laid out alike
+ * @param info CPU info to fill in
+ * @param function Leaf to query
+ */
+static void DetectCaches(CPUInfo& info, u32 function) {
+    u32 regs[4];
+    for (u32 index = 0; index < 16; index++) {
+        CPUID(regs, function, index);
+        const u32 type = regs[0] & 0x1F;
+        if (type == 0) {
+            break;
+        }
+        // Instruction caches aside
+        if (type == 2) {
+            continue;
+        }
+        const u32 level = (regs[0] >> 5) & 7;
+        const int line_size = (regs[1] & 0xFFF) + 1;
+        const int size = (((regs[1] >> 22) & 0x3FF) + 1) * (((regs[1] >> 12) & 0x3FF) + 1) *
+            line_size * (regs[2] + 1);
+        if (level == 1) {
+            info.l1d_cache_size = size;
+            info.cache_line_size = line_size;
+        } else if (level == 2) {
+            info.l2_cache_size = size;
+        } else if (level == 3) {
+            info.l3_cache_size = size;
+        }
+    }
+}
+
+#endif
+
+CPUInfo::CPUInfo() {
+    Detect();
+}
+
+// Detects the various cpu features
+void CPUInfo::Detect() {
+    memset(this, 0, sizeof(*this));
+    vendor = VENDOR_OTHER;
+    num_cores = 1;
+    logical_cpu_count = 1;
+
+#ifdef _M_X64
+    OS64bit = true;
+    CPU64bit = true;
+    Mode64bit = true;
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86)
+    u32 info[4];
+    CPUID(info, 0);
+    const u32 max_function = info[0];
+    memcpy(cpu_string, &info[1], 4);
+    memcpy(cpu_string + 4, &info[3], 4);
+    memcpy(cpu_string + 8, &info[2], 4);
+    if (strcmp(cpu_string, "GenuineIntel") == 0) {
+        vendor = VENDOR_INTEL;
+    } else if (strcmp(cpu_string, "AuthenticAMD") == 0) {
+        vendor = VENDOR_AMD;
+    }
+
+    u32 family = 0;
+    if (max_function >= 1) {
+        CPUID(info, 1);
+        family = (info[0] >> 8) & 0xF;
+        if (family == 0xF) {
+            family += (info[0] >> 20) & 0xFF;
+        }
+        logical_cpu_count = (info[1] >> 16) & 0xFF;
+        HTT = (info[3] >> 28) & 1;
+        bSSE = (info[3] >> 25) & 1;
+        bSSE2 = (info[3] >> 26) & 1;
+        bSSE3 = info[2] & 1;
+        bSSSE3 = (info[2] >> 9) & 1;
+        bSSE4_1 = (info[2] >> 19) & 1;
+        bSSE4_2 = (info[2] >> 20) & 1;
+        bPOPCNT = (info[2] >> 23) & 1;
+        bAES = (info[2] >> 25) & 1;
+
+        // AVX is only usable if the OS saves the YMM registers on context switches
+        const bool os_avx = ((info[2] >> 27) & 1) && (GetXCR0() & 6) == 6;
+        bAVX = os_avx && ((info[2] >> 28) & 1);
+        bFMA = os_avx && ((info[2] >> 12) & 1);
+        bF16C = os_avx && ((info[2] >> 29) & 1);
+        if (max_function >= 7) {
+            CPUID(info, 7);
+            bAVX2 = os_avx && ((info[1] >> 5) & 1);
+            bBMI1 = (info[1] >> 3) & 1;
+            bBMI2 = (info[1] >> 8) & 1;
+            bSHA = (info[1] >> 29) & 1;
+        }
+    }
+
+    CPUID(info, 0x80000000);
+    const u32 max_extended_function = info[0];
+    bool topology_extensions = false;
+    if (max_extended_function >= 0x80000001) {
+        CPUID(info, 0x80000001);
+        topology_extensions = (info[2] >> 22) & 1;
+        bLAHFSAHF64 = info[2] & 1;
+        bLZCNT = (info[2] >> 5) & 1;
+        bSSE4A = (info[2] >> 6) & 1;
+        bLongMode = (info[3] >> 29) & 1;
+        CPU64bit = CPU64bit || bLongMode;
+    }
+    if (max_extended_function >= 0x80000004) {
+        for (u32 n = 0; n < 3; n++) {
+            CPUID(info, 0x80000002 + n);
+            memcpy(brand_string + n * 16, info, sizeof(info));
+        }
+    } else {
+        strcpy(brand_string, cpu_string);
+    }
+
+    if (logical_cpu_count == 0 || !HTT) {
+        logical_cpu_count = 1;
+    }
+    num_cores = logical_cpu_count;
+    if (vendor == VENDOR_INTEL && max_function >= 0xB) {
+        // Extended topology: threads per core at the SMT level, per package at the core level
+        int threads_per_core = 1;
+        for (u32 level = 0; level < 8; level++) {
+            CPUID(info, 0xB, level);
+            const u32 type = (info[2] >> 8) & 0xFF;
+            const int count = info[1] & 0xFFFF;
+            if (type == 0) {
+                break;
+            } else if (type == 1 && count > 0) {
+                threads_per_core = count;
+            } else if (type == 2 && count > 0) {
+                logical_cpu_count = count;
+            }
+        }
+        num_cores = std::max(logical_cpu_count / threads_per_core, 1);
+    } else if (vendor == VENDOR_INTEL && max_function >= 4) {
+        CPUID(info, 4);
+        num_cores = ((info[0] >> 26) & 0x3F) + 1;
+    } else if (vendor == VENDOR_AMD && max_extended_function >= 0x80000008) {
+        // Counts hardware threads, Zen and later tell how many share a core
+        CPUID(info, 0x80000008);
+        logical_cpu_count = (info[2] & 0xFF) + 1;
+        int threads_per_core = 1;
+        if (family >= 0x17 && max_extended_function >= 0x8000001E) {
+            CPUID(info, 0x8000001E);
+            threads_per_core = ((info[1] >> 8) & 0xFF) + 1;
+        }
+        num_cores = std::max(logical_cpu_count / threads_per_core, 1);
+    }
+
+    if (vendor == VENDOR_INTEL && max_function >= 4) {
+        DetectCaches(*this, 4);
+    } else if (vendor == VENDOR_AMD && topology_extensions && max_extended_function >= 0x8000001D) {
+        DetectCaches(*this, 0x8000001D);
+    } else if (vendor == VENDOR_AMD && max_extended_function >= 0x80000006) {
+        // Older AMD parts only give the sizes in KB
+        CPUID(info, 0x80000005);
+        l1d_cache_size = (info[2] >> 24) * 1024;
+        cache_line_size = info[2] & 0xFF;
+        CPUID(info, 0x80000006);
+        l2_cache_size = (info[2] >> 16) * 1024;
+        l3_cache_size = (info[3] >> 18) * 512 * 1024;
+    }
+#endif
+}
+
+// Turn the cpu info into a string we can show
+std::string CPUInfo::Summarize() {
+    std::string sum(brand_string[0] != '\0' ? brand_string : cpu_string);
+    const struct {
+        bool        present;
+        const char* name;
+    } features[] = {
+        { bSSE, "SSE" }, { bSSE2, "SSE2" }, { bSSE3, "SSE3" }, { bSSSE3, "SSSE3" },
+        { bSSE4_1, "SSE4.1" }, { bSSE4_2, "SSE4.2" }, { bAVX, "AVX" }, { bAVX2, "AVX2" },
+        { bFMA, "FMA" }, { bF16C, "F16C" }, { bAES, "AES" }, { bSHA, "SHA" },
+        { bPOPCNT, "POPCNT" }, { bLZCNT, "LZCNT" }, { bBMI1, "BMI1" }, { bBMI2, "BMI2" },
+        { bLongMode, "64-bit" },
+    };
+    for (const auto& feature : features) {
+        if (feature.present) {
+            sum += ", ";
+            sum += feature.name;
+        }
+    }
+    sum += StringFromFormat(", %d cores, %d threads", num_cores, logical_cpu_count);
+    if (l2_cache_size != 0) {
+        sum += StringFromFormat(", L1d %d KB, L2 %d KB, L3 %d KB", l1d_cache_size / 1024,
+            l2_cache_size / 1024, l3_cache_size / 1024);
+    }
+    return sum;
+}
@@ -29,7 +29,13 @@ struct CPUInfo
 
     bool HTT;
     int num_cores;
-    int logical_cpu_count;
+    int logical_cpu_count;      // Hardware threads of the package, num_cores with SMT off
+
+    // Cache sizes in bytes, 0 when the CPU doesn't tell
+    int l1d_cache_size;
+    int l2_cache_size;
+    int l3_cache_size;
+    int cache_line_size;
 
     bool bSSE;
     bool bSSE2;
@@ -41,7 +47,13 @@ struct CPUInfo
     bool bLZCNT;
     bool bSSE4A;
     bool bAVX;
+    bool bAVX2;
+    bool bFMA;
+    bool bF16C;
+    bool bBMI1;
+    bool bBMI2;
     bool bAES;
+    bool bSHA;
     bool bLAHFSAHF64;
     bool bLongMode;
 
@@ -0,0 +1,689 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/cpu_detect.h"
+#include "common/crypto.h"
+
+#ifdef _M_X64
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit the instructions of an extension in functions targeting it
+#if defined(_M_X64) && defined(__GNUC__)
+#define TARGET_AES __attribute__((target("aes,sse2")))
+#define TARGET_SHA __attribute__((target("sha,sse4.1,ssse3")))
+#else
+#define TARGET_AES
+#define TARGET_SHA
+#endif
+
+namespace Common {
+
+namespace {
+
+enum {
+    MAX_BATCH_BLOCKS = 64,  ///< Counter blocks encrypted at once in CTR mode
+};
+
+const u32 kSHA256InitialState[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+const u32 kSHA256RoundConstants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+inline u32 LoadBE32(const u8* data) {
+    return ((u32)data[0] << 24) | ((u32)data[1] << 16) | ((u32)data[2] << 8) | data[3];
+}
+
+inline void StoreBE32(u8* data, u32 value) {
+    data[0] = (u8)(value >> 24);
+    data[1] = (u8)(value >> 16);
+    data[2] = (u8)(value >> 8);
+    data[3] = (u8)value;
+}
+
+inline u32 RotateRight(u32 value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+/// Hashes whole blocks into a SHA-256 state, portably
+void CompressSHA256Scalar(u32 state[8], const u8* data, size_t num_blocks) {
+    for (; num_blocks != 0; num_blocks--, data += SHA256::BLOCK_SIZE) {
+        u32 w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = LoadBE32(data + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            const u32 s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^
+                (w[i - 15] >> 3);
+            const u32 s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^
+                (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        u32 a = state[0], b = state[1], c = state[2], d = state[3];
+        u32 e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            const u32 s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            const u32 choice = (e & f) ^ (~e & g);
+            const u32 t1 = h + s1 + choice + kSHA256RoundConstants[i] + w[i];
+            const u32 s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            const u32 majority = (a & b) ^ (a & c) ^ (b & c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + s0 + majority;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef _M_X64
+
+/// Hashes whole blocks into a SHA-256 state with the SHA extensions, four rounds at a time
+TARGET_SHA void CompressSHA256SHANI(u32 state[8], const u8* data, size_t num_blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+    // The rounds take the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; num_blocks != 0; num_blocks--, data += SHA256::BLOCK_SIZE) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i w[4];
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)),
+                    byte_swap);
+            }
+            __m128i msg = _mm_add_epi32(w[i & 3],
+                _mm_loadu_si128((const __m128i*)&kSHA256RoundConstants[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i <= 14) {
+                // Words of the next four rounds, from those of the last sixteen
+                tmp = _mm_alignr_epi8(w[i & 3], w[(i + 3) & 3], 4);
+                w[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(i + 1) & 3], tmp),
+                    w[i & 3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (i >= 1 && i <= 12) {
+                w[(i + 3) & 3] = _mm_sha256msg1_epu32(w[(i + 3) & 3], w[i & 3]);
+            }
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#endif // _M_X64
+
+typedef void (*CompressFunction)(u32 state[8], const u8* data, size_t num_blocks);
+
+CompressFunction ChooseCompressSHA256() {
+#ifdef _M_X64
+    if (cpu_info.bSHA && cpu_info.bSSE4_1) {
+        return &CompressSHA256SHANI;
+    }
+#endif
+    return &CompressSHA256Scalar;
+}
+
+void CompressSHA256(u32 state[8], const u8* data, size_t num_blocks) {
+    static const CompressFunction compress = ChooseCompressSHA256();
+    compress(state, data, num_blocks);
+}
+
+/// Tables of the portable AES, computed at startup
+struct AESTables {
+    u8  sbox[256];
+    u8  inverse_sbox[256];
+    u32 encrypt[4][256];    ///< SubBytes and MixColumns of a byte of each row of a column
+
+    AESTables();
+};
+
+inline u8 MultiplyByX(u8 value) {
+    return (u8)((value << 1) ^ ((value & 0x80) ? 0x1B : 0));
+}
+
+/// Multiplies in the field of AES
+u8 Multiply(u8 a, u8 b) {
+    u8 product = 0;
+    for (; b != 0; b >>= 1, a = MultiplyByX(a)) {
+        if (b & 1) {
+            product ^= a;
+        }
+    }
+    return product;
+}
+
+inline u8 RotateLeft8(u8 value, int bits) {
+    return (u8)((value << bits) | (value >> (8 - bits)));
+}
+
+AESTables::AESTables() {
+    // p goes through the field by powers of 3, q through their inverses
+    u8 p = 1;
+    u8 q = 1;
+    do {
+        p = p ^ MultiplyByX(p);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        sbox[p] = q ^ RotateLeft8(q, 1) ^ RotateLeft8(q, 2) ^ RotateLeft8(q, 3) ^
+            RotateLeft8(q, 4) ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        const u8 s = sbox[i];
+        inverse_sbox[s] = (u8)i;
+        const u32 column = ((u32)MultiplyByX(s) << 24) | ((u32)s << 16) | ((u32)s << 8) |
+            (u8)(MultiplyByX(s) ^ s);
+        encrypt[0][i] = column;
+        encrypt[1][i] = RotateRight(column, 8);
+        encrypt[2][i] = RotateRight(column, 16);
+        encrypt[3][i] = RotateRight(column, 24);
+    }
+}
+
+const AESTables g_aes_tables;
+
+/// Encrypts blocks portably, with the tables
+void EncryptBlocksScalar(const u8 (*keys)[AES128::BLOCK_SIZE], const u8* in, u8* out,
+    size_t num_blocks) {
+
+    const AESTables& t = g_aes_tables;
+    for (; num_blocks != 0; num_blocks--, in += AES128::BLOCK_SIZE, out += AES128::BLOCK_SIZE) {
+        u32 s[4];
+        for (int i = 0; i < 4; i++) {
+            s[i] = LoadBE32(in + i * 4) ^ LoadBE32(keys[0] + i * 4);
+        }
+        for (int round = 1; round < 10; round++) {
+            u32 n[4];
+            for (int i = 0; i < 4; i++) {
+                n[i] = t.encrypt[0][s[i] >> 24] ^
+                    t.encrypt[1][(s[(i + 1) & 3] >> 16) & 0xFF] ^
+                    t.encrypt[2][(s[(i + 2) & 3] >> 8) & 0xFF] ^
+                    t.encrypt[3][s[(i + 3) & 3] & 0xFF] ^ LoadBE32(keys[round] + i * 4);
+            }
+            memcpy(s, n, sizeof(s));
+        }
+        for (int i = 0; i < 4; i++) {
+            const u32 column = ((u32)t.sbox[s[i] >> 24] << 24) |
+                ((u32)t.sbox[(s[(i + 1) & 3] >> 16) & 0xFF] << 16) |
+                ((u32)t.sbox[(s[(i + 2) & 3] >> 8) & 0xFF] << 8) | t.sbox[s[(i + 3) & 3] & 0xFF];
+            StoreBE32(out + i * 4, column ^ LoadBE32(keys[10] + i * 4));
+        }
+    }
+}
+
+/// Decrypts blocks portably, a byte at a time; only CBC decryption needs it
+void DecryptBlocksScalar(const u8 (*keys)[AES128::BLOCK_SIZE], const u8* in, u8* out,
+    size_t num_blocks) {
+
+    const AESTables& t = g_aes_tables;
+    for (; num_blocks != 0; num_blocks--, in += AES128::BLOCK_SIZE, out += AES128::BLOCK_SIZE) {
+        // Bytes column after column
+        u8 s[16];
+        for (int i = 0; i < 16; i++) {
+            s[i] = in[i] ^ keys[10][i];
+        }
+        for (int round = 9; round >= 0; round--) {
+            u8 n[16];
+            for (int column = 0; column < 4; column++) {
+                for (int row = 0; row < 4; row++) {
+                    const u8 shifted = s[((column - row + 4) & 3) * 4 + row];
+                    n[column * 4 + row] = t.inverse_sbox[shifted] ^ keys[round][column * 4 + row];
+                }
+            }
+            if (round != 0) {
+                for (int column = 0; column < 4; column++) {
+                    const u8* c = n + column * 4;
+                    u8* d = s + column * 4;
+                    d[0] = Multiply(c[0], 14) ^ Multiply(c[1], 11) ^ Multiply(c[2], 13) ^
+                        Multiply(c[3], 9);
+                    d[1] = Multiply(c[0], 9) ^ Multiply(c[1], 14) ^ Multiply(c[2], 11) ^
+                        Multiply(c[3], 13);
+                    d[2] = Multiply(c[0], 13) ^ Multiply(c[1], 9) ^ Multiply(c[2], 14) ^
+                        Multiply(c[3], 11);
+                    d[3] = Multiply(c[0], 11) ^ Multiply(c[1], 13) ^ Multiply(c[2], 9) ^
+                        Multiply(c[3], 14);
+                }
+            } else {
+                memcpy(s, n, sizeof(s));
+            }
+        }
+        memcpy(out, s, sizeof(s));
+    }
+}
+
+#ifdef _M_X64
+
+/// Encrypts blocks with the AES extensions, four at a time so that their rounds overlap
+TARGET_AES void EncryptBlocksAESNI(const u8 (*keys)[AES128::BLOCK_SIZE], const u8* in, u8* out,
+    size_t num_blocks) {
+
+    __m128i k[11];
+    for (int i = 0; i < 11; i++) {
+        k[i] = _mm_loadu_si128((const __m128i*)keys[i]);
+    }
+    for (; num_blocks >= 4; num_blocks -= 4, in += 64, out += 64) {
+        __m128i b[4];
+        for (int i = 0; i < 4; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in + i), k[0]);
+        }
+        for (int round = 1; round < 10; round++) {
+            for (int i = 0; i < 4; i++) {
+                b[i] = _mm_aesenc_si128(b[i], k[round]);
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            _mm_storeu_si128((__m128i*)out + i, _mm_aesenclast_si128(b[i], k[10]));
+        }
+    }
+    for (; num_blocks != 0; num_blocks--, in += 16, out += 16) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), k[0]);
+        for (int round = 1; round < 10; round++) {
+            b = _mm_aesenc_si128(b, k[round]);
+        }
+        _mm_storeu_si128((__m128i*)out, _mm_aesenclast_si128(b, k[10]));
+    }
+}
+
+/// Decrypts blocks with the AES extensions, with the keys of the equivalent inverse cipher
+TARGET_AES void DecryptBlocksAESNI(const u8 (*keys)[AES128::BLOCK_SIZE], const u8* in, u8* out,
+    size_t num_blocks) {
+
+    __m128i k[11];
+    for (int i = 0; i < 11; i++) {
+        k[i] = _mm_loadu_si128((const __m128i*)keys[i]);
+    }
+    for (; num_blocks != 0; num_blocks--, in += 16, out += 16) {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), k[0]);
+        for (int round = 1; round < 10; round++) {
+            b = _mm_aesdec_si128(b, k[round]);
+        }
+        _mm_storeu_si128((__m128i*)out, _mm_aesdeclast_si128(b, k[10]));
+    }
+}
+
+/// Derives the keys of the equivalent inverse cipher from the encryption keys
+TARGET_AES void ExpandDecryptKeysAESNI(const u8 (*encrypt_keys)[AES128::BLOCK_SIZE],
+    u8 (*decrypt_keys)[AES128::BLOCK_SIZE]) {
+
+    memcpy(decrypt_keys[0], encrypt_keys[10], AES128::BLOCK_SIZE);
+    for (int i = 1; i < 10; i++) {
+        const __m128i key = _mm_loadu_si128((const __m128i*)encrypt_keys[10 - i]);
+        _mm_storeu_si128((__m128i*)decrypt_keys[i], _mm_aesimc_si128(key));
+    }
+    memcpy(decrypt_keys[10], encrypt_keys[0], AES128::BLOCK_SIZE);
+}
+
+#endif // _M_X64
+
+inline bool HasAESNI() {
+#ifdef _M_X64
+    return cpu_info.bAES;
+#else
+    return false;
+#endif
+}
+
+typedef void (*BlocksFunction)(const u8 (*keys)[AES128::BLOCK_SIZE], const u8* in, u8* out,
+    size_t num_blocks);
+
+BlocksFunction ChooseEncryptBlocks() {
+#ifdef _M_X64
+    if (HasAESNI()) {
+        return &EncryptBlocksAESNI;
+    }
+#endif
+    return &EncryptBlocksScalar;
+}
+
+BlocksFunction ChooseDecryptBlocks() {
+#ifdef _M_X64
+    if (HasAESNI()) {
+        return &DecryptBlocksAESNI;
+    }
+#endif
+    return &DecryptBlocksScalar;
+}
+
+/**
+ * Adds to a 128-bit big endian counter
+ * @param ctr Counter to add to
+ * @param value Value to add
+ */
+void AddToCounter(u8 ctr[AES128::BLOCK_SIZE], u64 value) {
+    for (int i = AES128::BLOCK_SIZE - 1; i >= 0 && value != 0; i--) {
+        const u64 sum = ctr[i] + (value & 0xFF);
+        ctr[i] = (u8)sum;
+        value = (value >> 8) + (sum >> 8);
+    }
+}
+
+} // namespace
+
+SHA256::SHA256() {
+    Reset();
+}
+
+/// Starts over, forgetting the data given so far
+void SHA256::Reset() {
+    memcpy(m_state, kSHA256InitialState, sizeof(m_state));
+    m_size = 0;
+}
+
+/**
+ * Hashes data following the data given so far
+ * @param data Data to hash
+ * @param size Size of the data in bytes
+ */
+void SHA256::Update(const u8* data, size_t size) {
+    size_t buffered = (size_t)(m_size % BLOCK_SIZE);
+    m_size += size;
+    if (buffered != 0) {
+        const size_t count = std::min(size, BLOCK_SIZE - buffered);
+        memcpy(m_buffer + buffered, data, count);
+        data += count;
+        size -= count;
+        buffered += count;
+        if (buffered < BLOCK_SIZE) {
+            return;
+        }
+        CompressSHA256(m_state, m_buffer, 1);
+    }
+    // Whole blocks straight from the data
+    CompressSHA256(m_state, data, size / BLOCK_SIZE);
+    memcpy(m_buffer, data + size / BLOCK_SIZE * BLOCK_SIZE, size % BLOCK_SIZE);
+}
+
+/**
+ * Gets the digest of all of the data given since the last reset, and starts over
+ * @param digest Receives the digest
+ */
+void SHA256::Final(u8 digest[DIGEST_SIZE]) {
+    const u64 bits = m_size * 8;
+    const u8 padding = 0x80;
+    Update(&padding, 1);
+    const u8 zeros[BLOCK_SIZE] = {};
+    const size_t buffered = (size_t)(m_size % BLOCK_SIZE);
+    Update(zeros, (buffered <= BLOCK_SIZE - 8 ? BLOCK_SIZE - 8 : 2 * BLOCK_SIZE - 8) - buffered);
+    u8 length[8];
+    StoreBE32(length, (u32)(bits >> 32));
+    StoreBE32(length + 4, (u32)bits);
+    Update(length, sizeof(length));
+
+    for (int i = 0; i < 8; i++) {
+        StoreBE32(digest + i * 4, m_state[i]);
+    }
+    Reset();
+}
+
+/**
+ * Gets the digest of a buffer
+ * @param data Data to hash
+ * @param size Size of the data in bytes
+ * @param digest Receives the digest
+ */
+void SHA256::Hash(const u8* data, size_t size, u8 digest[DIGEST_SIZE]) {
+    SHA256 sha;
+    sha.Update(data, size);
+    sha.Final(digest);
+}
+
+/// Saves or loads the data given so far, for a hash in progress
+void SHA256::DoState(PointerWrap& p) {
+    p.DoArray(m_state, 8);
+    p.DoArray(m_buffer, BLOCK_SIZE);
+    p.Do(m_size);
+}
+
+/// Sets up a zero key
+AES128::AES128() {
+    const u8 zero_key[KEY_SIZE] = {};
+    SetKey(zero_key);
+}
+
+AES128::AES128(const u8 key[KEY_SIZE]) {
+    SetKey(key);
+}
+
+/// Sets the key, expanding it into the round keys
+void AES128::SetKey(const u8 key[KEY_SIZE]) {
+    const AESTables& t = g_aes_tables;
+    u32 words[4 * (NUM_ROUNDS + 1)];
+    for (int i = 0; i < 4; i++) {
+        words[i] = LoadBE32(key + i * 4);
+    }
+    u8 rcon = 1;
+    for (int i = 4; i < 4 * (NUM_ROUNDS + 1); i++) {
+        u32 word = words[i - 1];
+        if (i % 4 == 0) {
+            word = ((u32)t.sbox[(word >> 16) & 0xFF] << 24) |
+                ((u32)t.sbox[(word >> 8) & 0xFF] << 16) | ((u32)t.sbox[word & 0xFF] << 8) |
+                t.sbox[word >> 24];
+            word ^= (u32)rcon << 24;
+            rcon = MultiplyByX(rcon);
+        }
+        words[i] = words[i - 4] ^ word;
+    }
+    for (int i = 0; i < 4 * (NUM_ROUNDS + 1); i++) {
+        StoreBE32(&m_encrypt_keys[i / 4][(i % 4) * 4], words[i]);
+    }
+
+#ifdef _M_X64
+    if (HasAESNI()) {
+        ExpandDecryptKeysAESNI(m_encrypt_keys, m_decrypt_keys);
+        return;
+    }
+#endif
+    memset(m_decrypt_keys, 0, sizeof(m_decrypt_keys));
+}
+
+/**
+ * Encrypts blocks on their own (ECB)
+ * @param in Blocks to encrypt
+ * @param out Receives the encrypted blocks, may be in
+ * @param num_blocks Number of blocks
+ */
+void AES128::EncryptBlocks(const u8* in, u8* out, size_t num_blocks) const {
+    static const BlocksFunction encrypt = ChooseEncryptBlocks();
+    encrypt(m_encrypt_keys, in, out, num_blocks);
+}
+
+/**
+ * Decrypts blocks on their own (ECB)
+ * @param in Blocks to decrypt
+ * @param out Receives the decrypted blocks, may be in
+ * @param num_blocks Number of blocks
+ */
+void AES128::DecryptBlocks(const u8* in, u8* out, size_t num_blocks) const {
+    static const BlocksFunction decrypt = ChooseDecryptBlocks();
+    decrypt(HasAESNI() ? m_decrypt_keys : m_encrypt_keys, in, out, num_blocks);
+}
+
+/**
+ * Encrypts or decrypts data in counter mode, from any offset into the data the counter was
+ * set up for, so that parts of the data can be decrypted on their own
+ * @param data Data to transform in place
+ * @param size Size of the data in bytes
+ * @param ctr Counter of the first block of the data the counter was set up for, big endian
+ * @param offset Offset of data from the start of the data the counter was set up for
+ */
+void AES128::TransformCTR(u8* data, size_t size, const u8 ctr[BLOCK_SIZE], u64 offset) const {
+    u8 counter[BLOCK_SIZE];
+    memcpy(counter, ctr, BLOCK_SIZE);
+    AddToCounter(counter, offset / BLOCK_SIZE);
+    size_t skip = (size_t)(offset % BLOCK_SIZE);
+
+    // The key stream of a batch of counter blocks at a time
+    u8 stream[MAX_BATCH_BLOCKS * BLOCK_SIZE];
+    while (size != 0) {
+        const size_t num_blocks = std::min<size_t>(MAX_BATCH_BLOCKS,
+            (skip + size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        for (size_t i = 0; i < num_blocks; i++) {
+            memcpy(stream + i * BLOCK_SIZE, counter, BLOCK_SIZE);
+            AddToCounter(counter, 1);
+        }
+        EncryptBlocks(stream, stream, num_blocks);
+
+        const size_t count = std::min(size, num_blocks * BLOCK_SIZE - skip);
+        for (size_t i = 0; i < count; i++) {
+            data[i] ^= stream[skip + i];
+        }
+        data += count;
+        size -= count;
+        skip = 0;
+    }
+}
+
+/**
+ * Encrypts whole blocks in CBC mode
+ * @param data Data to encrypt in place
+ * @param size Size of the data in bytes, a multiple of BLOCK_SIZE
+ * @param iv Initialization vector, receives that of the data following
+ */
+void AES128::EncryptCBC(u8* data, size_t size, u8 iv[BLOCK_SIZE]) const {
+    for (size_t offset = 0; offset + BLOCK_SIZE <= size; offset += BLOCK_SIZE) {
+        for (int i = 0; i < BLOCK_SIZE; i++) {
+            data[offset + i] ^= iv[i];
+        }
+        EncryptBlocks(data + offset, data + offset, 1);
+        memcpy(iv, data + offset, BLOCK_SIZE);
+    }
+}
+
+/**
+ * Decrypts whole blocks in CBC mode
+ * @param data Data to decrypt in place
+ * @param size Size of the data in bytes, a multiple of BLOCK_SIZE
+ * @param iv Initialization vector, receives that of the data following
+ */
+void AES128::DecryptCBC(u8* data, size_t size, u8 iv[BLOCK_SIZE]) const {
+    // Unlike encryption the blocks decrypt independently, a batch at a time
+    u8 cipher[MAX_BATCH_BLOCKS * BLOCK_SIZE];
+    size = size / BLOCK_SIZE * BLOCK_SIZE;
+    while (size != 0) {
+        const size_t count = std::min<size_t>(size, sizeof(cipher));
+        memcpy(cipher, data, count);
+        DecryptBlocks(data, data, count / BLOCK_SIZE);
+        for (size_t i = 0; i < count; i++) {
+            data[i] ^= (i < BLOCK_SIZE) ? iv[i] : cipher[i - BLOCK_SIZE];
+        }
+        memcpy(iv, cipher + count - BLOCK_SIZE, BLOCK_SIZE);
+        data += count;
+        size -= count;
+    }
+}
+
+/**
+ * Computes the CBC-MAC of data in CCM mode, before it is encrypted with the first counter block
+ * @param data Plain data
+ * @param size Size of the data in bytes
+ * @param nonce Nonce of the data
+ * @param mac Receives the CBC-MAC
+ */
+void AES128::ComputeCCMMac(const u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+    u8 mac[BLOCK_SIZE]) const {
+
+    // Flags of a 16-byte MAC and a 3-byte length, then the nonce and the length
+    mac[0] = ((CCM_MAC_SIZE - 2) / 2) << 3 | (BLOCK_SIZE - 1 - CCM_NONCE_SIZE - 1);
+    memcpy(mac + 1, nonce, CCM_NONCE_SIZE);
+    mac[13] = (u8)(size >> 16);
+    mac[14] = (u8)(size >> 8);
+    mac[15] = (u8)size;
+    EncryptBlocks(mac, mac, 1);
+
+    for (size_t offset = 0; offset < size; offset += BLOCK_SIZE) {
+        const size_t count = std::min<size_t>(BLOCK_SIZE, size - offset);
+        for (size_t i = 0; i < count; i++) {
+            mac[i] ^= data[offset + i];
+        }
+        EncryptBlocks(mac, mac, 1);
+    }
+}
+
+/**
+ * Encrypts data in CCM mode, with no associated data
+ * @param data Data to encrypt in place
+ * @param size Size of the data in bytes, less than 16 MB
+ * @param nonce Nonce of the data
+ * @param mac Receives the MAC of the data
+ */
+void AES128::EncryptCCM(u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+    u8 mac[CCM_MAC_SIZE]) const {
+
+    u8 ctr[BLOCK_SIZE] = {};
+    ctr[0] = BLOCK_SIZE - 1 - CCM_NONCE_SIZE - 1;
+    memcpy(ctr + 1, nonce, CCM_NONCE_SIZE);
+
+    ComputeCCMMac(data, size, nonce, mac);
+    TransformCTR(mac, CCM_MAC_SIZE, ctr);
+    TransformCTR(data, size, ctr, BLOCK_SIZE);
+}
+
+/**
+ * Decrypts data in CCM mode, with no associated data
+ * @param data Data to decrypt in place
+ * @param size Size of the data in bytes, less than 16 MB
+ * @param nonce Nonce of the data
+ * @param mac MAC of the data
+ * @return True if the MAC matches the data decrypted
+ */
+bool AES128::DecryptCCM(u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+    const u8 mac[CCM_MAC_SIZE]) const {
+
+    u8 ctr[BLOCK_SIZE] = {};
+    ctr[0] = BLOCK_SIZE - 1 - CCM_NONCE_SIZE - 1;
+    memcpy(ctr + 1, nonce, CCM_NONCE_SIZE);
+
+    TransformCTR(data, size, ctr, BLOCK_SIZE);
+    u8 computed[BLOCK_SIZE];
+    ComputeCCMMac(data, size, nonce, computed);
+    TransformCTR(computed, CCM_MAC_SIZE, ctr);
+    return memcmp(computed, mac, CCM_MAC_SIZE) == 0;
+}
+
+} // namespace
@@ -0,0 +1,153 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+// SHA-256 and AES-128, as the hardware of the 3DS has them for the system and the images it
+// reads. Both use the SHA and AES extensions of x86 CPUs that have them, picked at runtime, and
+// portable code on the others.
+
+namespace Common {
+
+/// SHA-256 of data given in any number of pieces
+class SHA256 {
+public:
+    enum {
+        DIGEST_SIZE = 32,
+        BLOCK_SIZE  = 64,
+    };
+
+    SHA256();
+
+    /// Starts over, forgetting the data given so far
+    void Reset();
+
+    /**
+     * Hashes data following the data given so far
+     * @param data Data to hash
+     * @param size Size of the data in bytes
+     */
+    void Update(const u8* data, size_t size);
+
+    /**
+     * Gets the digest of all of the data given since the last reset, and starts over
+     * @param digest Receives the digest
+     */
+    void Final(u8 digest[DIGEST_SIZE]);
+
+    /**
+     * Gets the digest of a buffer
+     * @param data Data to hash
+     * @param size Size of the data in bytes
+     * @param digest Receives the digest
+     */
+    static void Hash(const u8* data, size_t size, u8 digest[DIGEST_SIZE]);
+
+    /// Saves or loads the data given so far, for a hash in progress
+    void DoState(PointerWrap& p);
+
+private:
+    u32 m_state[8];
+    u8  m_buffer[BLOCK_SIZE];   ///< Data of the block not hashed yet
+    u64 m_size;                 ///< Bytes given since the last reset
+};
+
+/// AES with a 128-bit key, in the modes the 3DS uses
+class AES128 {
+public:
+    enum {
+        BLOCK_SIZE      = 16,
+        KEY_SIZE        = 16,
+        CCM_NONCE_SIZE  = 12,
+        CCM_MAC_SIZE    = 16,
+    };
+
+    /// Sets up a zero key
+    AES128();
+
+    explicit AES128(const u8 key[KEY_SIZE]);
+
+    /// Sets the key, expanding it into the round keys
+    void SetKey(const u8 key[KEY_SIZE]);
+
+    /**
+     * Encrypts blocks on their own (ECB)
+     * @param in Blocks to encrypt
+     * @param out Receives the encrypted blocks, may be in
+     * @param num_blocks Number of blocks
+     */
+    void EncryptBlocks(const u8* in, u8* out, size_t num_blocks) const;
+
+    /**
+     * Decrypts blocks on their own (ECB)
+     * @param in Blocks to decrypt
+     * @param out Receives the decrypted blocks, may be in
+     * @param num_blocks Number of blocks
+     */
+    void DecryptBlocks(const u8* in, u8* out, size_t num_blocks) const;
+
+    /**
+     * Encrypts or decrypts data in counter mode, from any offset into the data the counter was
+     * set up for, so that parts of the data can be decrypted on their own
+     * @param data Data to transform in place
+     * @param size Size of the data in bytes
+     * @param ctr Counter of the first block of the data the counter was set up for, big endian
+     * @param offset Offset of data from the start of the data the counter was set up for
+     */
+    void TransformCTR(u8* data, size_t size, const u8 ctr[BLOCK_SIZE], u64 offset = 0) const;
+
+    /**
+     * Encrypts whole blocks in CBC mode
+     * @param data Data to encrypt in place
+     * @param size Size of the data in bytes, a multiple of BLOCK_SIZE
+     * @param iv Initialization vector, receives that of the data following
+     */
+    void EncryptCBC(u8* data, size_t size, u8 iv[BLOCK_SIZE]) const;
+
+    /**
+     * Decrypts whole blocks in CBC mode
+     * @param data Data to decrypt in place
+     * @param size Size of the data in bytes, a multiple of BLOCK_SIZE
+     * @param iv Initialization vector, receives that of the data following
+     */
+    void DecryptCBC(u8* data, size_t size, u8 iv[BLOCK_SIZE]) const;
+
+    /**
+     * Encrypts data in CCM mode, with no associated data
+     * @param data Data to encrypt in place
+     * @param size Size of the data in bytes, less than 16 MB
+     * @param nonce Nonce of the data
+     * @param mac Receives the MAC of the data
+     */
+    void EncryptCCM(u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+        u8 mac[CCM_MAC_SIZE]) const;
+
+    /**
+     * Decrypts data in CCM mode, with no associated data
+     * @param data Data to decrypt in place
+     * @param size Size of the data in bytes, less than 16 MB
+     * @param nonce Nonce of the data
+     * @param mac MAC of the data
+     * @return True if the MAC matches the data decrypted
+     */
+    bool DecryptCCM(u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+        const u8 mac[CCM_MAC_SIZE]) const;
+
+private:
+    enum {
+        NUM_ROUNDS = 10,
+    };
+
+    void ComputeCCMMac(const u8* data, size_t size, const u8 nonce[CCM_NONCE_SIZE],
+        u8 mac[BLOCK_SIZE]) const;
+
+    u8 m_encrypt_keys[NUM_ROUNDS + 1][BLOCK_SIZE];
+    u8 m_decrypt_keys[NUM_ROUNDS + 1][BLOCK_SIZE];  ///< For the AES extensions, last round first
+};
+
+} // namespace
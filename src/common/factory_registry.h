@@ -0,0 +1,80 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Backends of a kind, found by name when the settings pick one at startup. Each registers a
+ * factory and the capabilities it reports, flags whose meaning is up to the kind of backend.
+ * @tparam T Interface of the backends
+ */
+template <typename T>
+class FactoryRegistry : NonCopyable {
+public:
+    typedef T* (*Factory)();
+
+    struct Backend {
+        const char* name;           ///< Name the settings select it by, as "jit"
+        const char* description;    ///< Shown by the frontends listing the backends
+        u32         capabilities;
+        Factory     create;         ///< Creates an instance, not initialized yet
+    };
+
+    /**
+     * Adds a backend, replacing the one of the same name
+     * @param backend Backend to add, whose strings outlive the registry
+     */
+    void Register(const Backend& backend) {
+        for (size_t i = 0; i < m_backends.size(); i++) {
+            if (m_backends[i].name == std::string(backend.name)) {
+                m_backends[i] = backend;
+                return;
+            }
+        }
+        m_backends.push_back(backend);
+    }
+
+    /**
+     * Finds a backend by name
+     * @param name Name of the backend
+     * @return The backend, NULL if none has the name
+     */
+    const Backend* Find(const std::string& name) const {
+        for (size_t i = 0; i < m_backends.size(); i++) {
+            if (m_backends[i].name == name) {
+                return &m_backends[i];
+            }
+        }
+        return NULL;
+    }
+
+    /// Gets the backends, in the order they were registered
+    const std::vector<Backend>& GetBackends() const {
+        return m_backends;
+    }
+
+    /**
+     * Gets the names of the backends, for logs and usage
+     * @return Names separated by commas
+     */
+    std::string GetNames() const {
+        std::string names;
+        for (size_t i = 0; i < m_backends.size(); i++) {
+            names += (i == 0 ? "" : ", ") + std::string(m_backends[i].name);
+        }
+        return names;
+    }
+
+private:
+    std::vector<Backend> m_backends;
+};
+
+} // namespace
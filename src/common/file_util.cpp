@@ -20,7 +20,10 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__)
@@ -907,4 +910,89 @@ bool IOFile::Resize(u64 size)
     return m_good;
 }
 
+MappedFile::MappedFile()
+    : m_data(NULL), m_size(0)
+{}
+
+MappedFile::MappedFile(const std::string& filename)
+    : m_data(NULL), m_size(0)
+{
+    Open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFile(UTF8ToTStr(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        // The view keeps the mapping and the file open once their handles are closed
+        HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+            m_data = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (m_data != NULL)
+                m_size = size.QuadPart;
+            CloseHandle(mapping);
+        }
+    }
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat64 file_info;
+    if (fd >= 0 && fstat64(fd, &file_info) == 0 && file_info.st_size > 0)
+    {
+        // The mapping keeps the file open once the descriptor is closed
+        void* data = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            m_data = (const u8*)data;
+            m_size = file_info.st_size;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+#endif
+    if (m_data == NULL)
+    {
+        ERROR_LOG(COMMON, "MappedFile: couldn't map %s: %s", filename.c_str(), GetLastErrorMsg());
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data == NULL)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap((void*)m_data, m_size);
+#endif
+    m_data = NULL;
+    m_size = 0;
+}
+
+void MappedFile::Prefetch() const
+{
+    if (m_data == NULL)
+        return;
+#ifdef _WIN32
+    // PrefetchVirtualMemory needs Windows 8, pages are read in as they are touched
+#else
+    if (madvise((void*)m_data, m_size, MADV_WILLNEED) != 0)
+        WARN_LOG(COMMON, "MappedFile: couldn't prefetch: %s", GetLastErrorMsg());
+#endif
+}
+
 } // namespace
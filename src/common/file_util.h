@@ -208,6 +208,33 @@ private:
 	IOFile& operator=(IOFile& other);
 };
 
+// A whole file mapped read-only into memory, to parse in place rather than read into a buffer.
+// Empty files can't be mapped and fail to open.
+class MappedFile : public NonCopyable
+{
+public:
+	MappedFile();
+	MappedFile(const std::string& filename);
+
+	~MappedFile();
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen() const { return NULL != m_data; }
+
+	const u8* GetData() const { return m_data; }
+	u64 GetSize() const { return m_size; }
+
+	// Has the OS start reading the whole file in the background, so that pages are resident by
+	// the time they are touched. Only a hint, and a no-op where the OS takes none.
+	void Prefetch() const;
+
+private:
+	const u8* m_data;
+	u64 m_size;
+};
+
 }  // namespace
 
 // To deal with Windows being dumb at unicode:
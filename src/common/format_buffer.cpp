@@ -0,0 +1,91 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/format_buffer.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace Common {
+
+namespace {
+
+enum {
+    TEMP_CAPACITY = 1024,
+};
+
+THREAD_LOCAL char g_temp[TEMP_CAPACITY];   ///< Text of FormatTemp, per thread
+
+} // namespace
+
+/**
+ * Appends formatted text
+ * @param format printf format, checked against the arguments by GCC
+ * @return The buffer, for chaining
+ */
+FormatBuffer& FormatBuffer::Append(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    AppendV(format, args);
+    va_end(args);
+    return *this;
+}
+
+FormatBuffer& FormatBuffer::AppendV(const char* format, va_list args) {
+    const size_t left = m_capacity - m_size;
+    if (left <= 1) {
+        m_truncated = m_truncated || format[0] != '\0';
+        return *this;
+    }
+    // Truncated output, _vsnprintf gives -1 for it
+    const int written = vsnprintf(m_buffer + m_size, left, format, args);
+    if (written < 0 || (size_t)written >= left) {
+        m_size = m_capacity - 1;
+        m_buffer[m_size] = '\0';
+        m_truncated = true;
+    } else {
+        m_size += written;
+    }
+    return *this;
+}
+
+/**
+ * Appends text as is
+ * @param text Text to append
+ * @param length Length of the text in bytes
+ * @return The buffer, for chaining
+ */
+FormatBuffer& FormatBuffer::AppendText(const char* text, size_t length) {
+    const size_t left = m_capacity - m_size - 1;
+    if (length > left) {
+        length = left;
+        m_truncated = true;
+    }
+    memcpy(m_buffer + m_size, text, length);
+    m_size += length;
+    m_buffer[m_size] = '\0';
+    return *this;
+}
+
+/**
+ * Formats text into a buffer of the calling thread, for the arguments of a call taking a string
+ * @param format printf format, checked against the arguments by GCC
+ * @return The text, valid until the next call on the same thread. Truncated to 1023 bytes.
+ */
+const char* FormatTemp(const char* format, ...) {
+    FormatBuffer buffer(g_temp, TEMP_CAPACITY);
+    va_list args;
+    va_start(args, format);
+    buffer.AppendV(format, args);
+    va_end(args);
+    return g_temp;
+}
+
+} // namespace
@@ -0,0 +1,104 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include "common/common.h"
+
+/// Has the compiler check the arguments of a printf-style function against its format
+#ifdef __GNUC__
+#define PRINTF_FORMAT(format_index, first_arg) \
+    __attribute__((format(printf, format_index, first_arg)))
+#else
+#define PRINTF_FORMAT(format_index, first_arg)
+#endif
+
+namespace Common {
+
+/**
+ * Text formatted printf-style into a buffer the caller owns, so that formatting never allocates.
+ * Appends past the end of the buffer are truncated, the text stays terminated.
+ */
+class FormatBuffer : NonCopyable {
+public:
+    /**
+     * Starts empty text in a buffer
+     * @param buffer Buffer the text is written to
+     * @param capacity Size of the buffer in bytes, with the terminator, at least 1
+     */
+    FormatBuffer(char* buffer, size_t capacity) : m_buffer(buffer), m_capacity(capacity) {
+        Clear();
+    }
+
+    /// Empties the text
+    void Clear() {
+        m_size = 0;
+        m_truncated = false;
+        m_buffer[0] = '\0';
+    }
+
+    /**
+     * Appends formatted text
+     * @param format printf format, checked against the arguments by GCC
+     * @return The buffer, for chaining
+     */
+    FormatBuffer& Append(const char* format, ...) PRINTF_FORMAT(2, 3);
+
+    /// @see Append
+    FormatBuffer& AppendV(const char* format, va_list args);
+
+    /**
+     * Appends text as is
+     * @param text Text to append
+     * @param length Length of the text in bytes
+     * @return The buffer, for chaining
+     */
+    FormatBuffer& AppendText(const char* text, size_t length);
+
+    /// Gets the text, terminated
+    const char* c_str() const {
+        return m_buffer;
+    }
+
+    /// Gets the length of the text in bytes
+    size_t size() const {
+        return m_size;
+    }
+
+    /// Tells whether an append didn't fit
+    bool IsTruncated() const {
+        return m_truncated;
+    }
+
+private:
+    char*   m_buffer;
+    size_t  m_capacity;
+    size_t  m_size;
+    bool    m_truncated;
+};
+
+/**
+ * Formatted text in a buffer of its own, for text on the stack or in a record
+ * @tparam Capacity Size of the buffer in bytes, with the terminator
+ */
+template <size_t Capacity>
+class FixedFormatBuffer : public FormatBuffer {
+public:
+    FixedFormatBuffer() : FormatBuffer(m_storage, Capacity) {}
+
+private:
+    char m_storage[Capacity];
+};
+
+/**
+ * Formats text into a buffer of the calling thread, for the arguments of a call taking a string
+ * @param format printf format, checked against the arguments by GCC
+ * @return The text, valid until the next call on the same thread. Truncated to 1023 bytes.
+ */
+const char* FormatTemp(const char* format, ...) PRINTF_FORMAT(1, 2);
+
+} // namespace
@@ -3,13 +3,33 @@
 // Refer to the license.txt file included.
 
 
+#include <algorithm>
+
 #include "common/hash.h"
 #if _M_SSE >= 0x402
 #include "common/cpu_detect.h"
 #include <nmmintrin.h>
 #endif
 
-static u64 (*ptrHashFunction)(const u8 *src, int len, u32 samples) = &GetMurmurHash3;
+// SIMD paths of the fast hash, picked at runtime
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define FAST_HASH_SSE2
+#include "common/cpu_detect.h"
+#include <emmintrin.h>
+#if defined(_MSC_VER) || defined(__clang__) || (__GNUC__ * 100 + __GNUC_MINOR__ >= 409)
+#define FAST_HASH_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+static u64 GetFastHash64Sampled(const u8 *src, int len, u32 samples);
+
+static u64 (*ptrHashFunction)(const u8 *src, int len, u32 samples) = &GetFastHash64Sampled;
 
 // uint32_t
 // WARNING - may read one more byte!
@@ -83,6 +103,20 @@ u32 HashAdler32(const u8* data, size_t len)
     return((b << 16) | a);
 }
 
+// 32-bit FNV-1, a byte at a time. Stable across hosts and versions, unlike the fast hashes.
+u32 HashFNV(const u8* ptr, int length)
+{
+    u32 hash = 0x811C9DC5;
+
+    for (int i = 0; i < length; i++)
+    {
+        hash *= 0x01000193;
+        hash ^= ptr[i];
+    }
+
+    return hash;
+}
+
 // Stupid hash - but can't go back now :)
 // Don't use for new things. At least it's reasonably fast.
 u32 HashEctor(const u8* ptr, int length)
@@ -504,15 +538,493 @@ void SetHash64Function(bool useHiresTextures)
     {
         ptrHashFunction = &GetHashHiresTexture;
     }
-#if _M_SSE >= 0x402
-    else if (cpu_info.bSSE4_2 && !useHiresTextures) // sse crc32 version
+    else
     {
-        ptrHashFunction = &GetCRC32;
+        // Outruns the SSE4.2 CRC32 version as well
+        ptrHashFunction = &GetFastHash64Sampled;
     }
+}
+
+// Fast hash: a 64-byte stripe at a time goes into eight 64-bit accumulators, lane by lane, each
+// lane adding its data to the neighbouring accumulator and the product of the low and high halves
+// of the data XORed with a key taken from a secret. The keys slide along the secret a word per
+// stripe, and the accumulators are scrambled at the end of each block of stripes using up the
+// secret. Short inputs are mixed 16 bytes at a time with 128-bit multiplies instead.
+
+namespace {
+
+enum
+{
+    STRIPE_SIZE = 64,
+    SECRET_SIZE = FastHashState::SECRET_SIZE,
+    STRIPES_PER_BLOCK = (SECRET_SIZE - STRIPE_SIZE) / 8,
+    MAX_SHORT_SIZE = 240,               // Longer inputs go through the accumulators
+    LAST_STRIPE_KEY = SECRET_SIZE - STRIPE_SIZE - 7,
+};
+
+const u32 PRIME32_1 = 0x9E3779B1U;
+const u32 PRIME32_2 = 0x85EBCA77U;
+const u32 PRIME32_3 = 0xC2B2AE3DU;
+const u64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const u64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const u64 PRIME64_3 = 0x165667B19E3779F9ULL;
+const u64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const u64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+const u64 PRIME_MX = 0x165667919E3779F9ULL;
+
+// Random bytes, keyed further with the seed for seeded hashes of long inputs
+const u8 DEFAULT_SECRET[SECRET_SIZE] = {
+    0xaf, 0xcd, 0x1d, 0x7b, 0x39, 0xa8, 0x20, 0xe2, 0xf4, 0x65, 0xb9, 0xa1,
+    0x6a, 0x9e, 0x78, 0x6e, 0x4f, 0x45, 0x09, 0x80, 0x18, 0x5d, 0xc4, 0x06,
+    0xec, 0x81, 0x4c, 0x72, 0xa8, 0xb8, 0x8b, 0xf8, 0x9b, 0x74, 0xa8, 0x51,
+    0x6a, 0x89, 0x39, 0x1b, 0xea, 0xa2, 0x7e, 0x74, 0x0c, 0x9f, 0xcb, 0x53,
+    0xe1, 0x32, 0x45, 0x1f, 0xbe, 0x9a, 0x82, 0x2c, 0x3c, 0xab, 0x16, 0xc9,
+    0x3a, 0x13, 0x84, 0xc5, 0xc3, 0x8a, 0xc9, 0x41, 0x90, 0x78, 0xe5, 0x3e,
+    0xa6, 0xb0, 0x8c, 0x36, 0x8c, 0x48, 0xb8, 0xf3, 0x09, 0x3d, 0xb1, 0x3c,
+    0xdd, 0xec, 0x7e, 0x65, 0xf6, 0xde, 0x5b, 0x05, 0xe0, 0x26, 0xd3, 0xc2,
+    0x7b, 0xdb, 0xbb, 0xe0, 0x3f, 0xa0, 0x21, 0x86, 0x2f, 0xa9, 0x3a, 0x98,
+    0x55, 0x75, 0x1f, 0x8e, 0x19, 0x4d, 0xcc, 0x00, 0x16, 0x0f, 0x4e, 0xb5,
+    0xab, 0x80, 0x1d, 0x97, 0x97, 0x3f, 0xbb, 0x84, 0x55, 0x12, 0x52, 0x75,
+    0x5c, 0x82, 0x29, 0x7d, 0x86, 0x7f, 0x7f, 0x2b, 0x10, 0x17, 0xcf, 0xc3,
+    0x64, 0x4f, 0x91, 0x83, 0xa0, 0xe9, 0x66, 0x34, 0xac, 0x85, 0x44, 0x5a,
+    0x2b, 0x8d, 0x1a, 0xd8, 0xd7, 0x9e, 0x0b, 0x10, 0x2b, 0x60, 0x01, 0xdb,
+    0x0d, 0xf1, 0x25, 0x18, 0x92, 0x8a, 0x03, 0xa9, 0x6a, 0x2f, 0xca, 0x0d,
+    0xd9, 0xf1, 0xf5, 0xed, 0x4c, 0x63, 0xd2, 0x7b, 0xd6, 0x6a, 0x49, 0x54,
+};
+
+inline u32 Read32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline u64 Read64(const u8* p)
+{
+    u64 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void Write64(u8* p, u64 value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+// Multiplies to 128 bits and folds the high half into the low one
+inline u64 Fold64(u64 a, u64 b)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    return (u64)product ^ (u64)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    u64 high;
+    const u64 low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    const u64 lo_lo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+    const u64 hi_lo = (a >> 32) * (b & 0xFFFFFFFF);
+    const u64 lo_hi = (a & 0xFFFFFFFF) * (b >> 32);
+    const u64 hi_hi = (a >> 32) * (b >> 32);
+    const u64 cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    const u64 high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    const u64 low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    return low ^ high;
 #endif
+}
+
+inline u64 Avalanche(u64 h)
+{
+    h ^= h >> 37;
+    h *= PRIME_MX;
+    h ^= h >> 32;
+    return h;
+}
+
+inline u64 Mix16(const u8* p, const u8* secret, u64 seed)
+{
+    return Fold64(Read64(p) ^ (Read64(secret) + seed), Read64(p + 8) ^ (Read64(secret + 8) - seed));
+}
+
+u64 HashUpTo16(const u8* p, size_t len, const u8* secret, u64 seed)
+{
+    if (len > 8)
+    {
+        const u64 low = Read64(p) ^ ((Read64(secret + 24) ^ Read64(secret + 32)) + seed);
+        const u64 high = Read64(p + len - 8) ^ ((Read64(secret + 40) ^ Read64(secret + 48)) - seed);
+        return Avalanche(len + bswap64(low) + high + Fold64(low, high));
+    }
+    if (len >= 4)
+    {
+        const u64 input = Read32(p + len - 4) + ((u64)Read32(p) << 32);
+        const u64 keyed = input ^ ((Read64(secret + 8) ^ Read64(secret + 16)) - seed);
+        return Avalanche(len + Fold64(keyed, PRIME64_1 + (len << 2)));
+    }
+    if (len > 0)
+    {
+        const u32 combined = ((u32)p[0] << 16) | ((u32)p[len >> 1] << 24) | p[len - 1] |
+            ((u32)len << 8);
+        const u64 keyed = combined ^ ((u64)(Read32(secret) ^ Read32(secret + 4)) + seed);
+        return Avalanche(Fold64(keyed, PRIME64_1));
+    }
+    return Avalanche(seed ^ Read64(secret + 56) ^ Read64(secret + 64));
+}
+
+u64 HashUpTo128(const u8* p, size_t len, const u8* secret, u64 seed)
+{
+    u64 acc = len * PRIME64_1;
+    if (len > 32)
+    {
+        if (len > 64)
+        {
+            if (len > 96)
+            {
+                acc += Mix16(p + 48, secret + 96, seed);
+                acc += Mix16(p + len - 64, secret + 112, seed);
+            }
+            acc += Mix16(p + 32, secret + 64, seed);
+            acc += Mix16(p + len - 48, secret + 80, seed);
+        }
+        acc += Mix16(p + 16, secret + 32, seed);
+        acc += Mix16(p + len - 32, secret + 48, seed);
+    }
+    acc += Mix16(p, secret, seed);
+    acc += Mix16(p + len - 16, secret + 16, seed);
+    return Avalanche(acc);
+}
+
+u64 HashUpTo240(const u8* p, size_t len, const u8* secret, u64 seed)
+{
+    u64 acc = len * PRIME64_1;
+    for (int i = 0; i < 8; i++)
+        acc += Mix16(p + 16 * i, secret + 16 * i, seed);
+    acc = Avalanche(acc);
+    // The rounds past the eighth reuse the secret, shifted
+    const int rounds = (int)(len / 16);
+    for (int i = 8; i < rounds; i++)
+        acc += Mix16(p + 16 * i, secret + 16 * (i - 8) + 3, seed);
+    acc += Mix16(p + len - 16, secret + SECRET_SIZE - 17, seed);
+    return Avalanche(acc);
+}
+
+u64 HashShort(const u8* p, size_t len, u64 seed)
+{
+    if (len <= 16)
+        return HashUpTo16(p, len, DEFAULT_SECRET, seed);
+    if (len <= 128)
+        return HashUpTo128(p, len, DEFAULT_SECRET, seed);
+    return HashUpTo240(p, len, DEFAULT_SECRET, seed);
+}
+
+Hash128 HashShort128(const u8* p, size_t len, u64 seed)
+{
+    const Hash128 hash = { HashShort(p, len, seed), HashShort(p, len, seed ^ PRIME64_4) };
+    return hash;
+}
+
+void InitSecret(u8* secret, u64 seed)
+{
+    for (int i = 0; i < SECRET_SIZE; i += 16)
+    {
+        Write64(secret + i, Read64(DEFAULT_SECRET + i) + seed);
+        Write64(secret + i + 8, Read64(DEFAULT_SECRET + i + 8) - seed);
+    }
+}
+
+void InitAccumulators(u64* acc)
+{
+    const u64 init[8] = {
+        PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1,
+    };
+    memcpy(acc, init, sizeof(init));
+}
+
+/**
+ * Accumulates consecutive stripes, the key of each stripe one word further along the secret
+ * @param acc Accumulators
+ * @param data Stripes
+ * @param secret Key of the first stripe
+ * @param stripes Number of stripes
+ */
+void AccumulateScalar(u64* acc, const u8* data, const u8* secret, size_t stripes)
+{
+    for (size_t n = 0; n < stripes; n++)
+    {
+        const u8* stripe = data + n * STRIPE_SIZE;
+        const u8* key = secret + n * 8;
+        for (int i = 0; i < 8; i++)
+        {
+            const u64 value = Read64(stripe + 8 * i);
+            const u64 keyed = value ^ Read64(key + 8 * i);
+            acc[i ^ 1] += value;
+            acc[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+        }
+    }
+}
+
+#ifdef FAST_HASH_SSE2
+void AccumulateSSE2(u64* acc, const u8* data, const u8* secret, size_t stripes)
+{
+    __m128i a[4];
+    for (int j = 0; j < 4; j++)
+        a[j] = _mm_loadu_si128((const __m128i*)acc + j);
+
+    for (size_t n = 0; n < stripes; n++)
+    {
+        const __m128i* stripe = (const __m128i*)(data + n * STRIPE_SIZE);
+        const __m128i* key = (const __m128i*)(secret + n * 8);
+        for (int j = 0; j < 4; j++)
+        {
+            const __m128i value = _mm_loadu_si128(stripe + j);
+            const __m128i keyed = _mm_xor_si128(value, _mm_loadu_si128(key + j));
+            // Low halves times high halves, and the data added to the other lane of the pair
+            const __m128i keyed_high = _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+            const __m128i product = _mm_mul_epu32(keyed, keyed_high);
+            const __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm_add_epi64(a[j], _mm_add_epi64(product, swapped));
+        }
+    }
+
+    for (int j = 0; j < 4; j++)
+        _mm_storeu_si128((__m128i*)acc + j, a[j]);
+}
+#endif
+
+#ifdef FAST_HASH_AVX2
+TARGET_AVX2 void AccumulateAVX2(u64* acc, const u8* data, const u8* secret, size_t stripes)
+{
+    __m256i a[2];
+    for (int j = 0; j < 2; j++)
+        a[j] = _mm256_loadu_si256((const __m256i*)acc + j);
+
+    for (size_t n = 0; n < stripes; n++)
+    {
+        const __m256i* stripe = (const __m256i*)(data + n * STRIPE_SIZE);
+        const __m256i* key = (const __m256i*)(secret + n * 8);
+        for (int j = 0; j < 2; j++)
+        {
+            const __m256i value = _mm256_loadu_si256(stripe + j);
+            const __m256i keyed = _mm256_xor_si256(value, _mm256_loadu_si256(key + j));
+            const __m256i keyed_high = _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1));
+            const __m256i product = _mm256_mul_epu32(keyed, keyed_high);
+            const __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm256_add_epi64(a[j], _mm256_add_epi64(product, swapped));
+        }
+    }
+
+    for (int j = 0; j < 2; j++)
+        _mm256_storeu_si256((__m256i*)acc + j, a[j]);
+}
+#endif
+
+typedef void (*AccumulateFunction)(u64* acc, const u8* data, const u8* secret, size_t stripes);
+
+AccumulateFunction ChooseAccumulate()
+{
+#ifdef FAST_HASH_AVX2
+    if (cpu_info.bAVX2)
+        return &AccumulateAVX2;
+#endif
+#ifdef FAST_HASH_SSE2
+    if (cpu_info.bSSE2)
+        return &AccumulateSSE2;
+#endif
+    return &AccumulateScalar;
+}
+
+void Accumulate(u64* acc, const u8* data, const u8* secret, size_t stripes)
+{
+    static const AccumulateFunction accumulate = ChooseAccumulate();
+    accumulate(acc, data, secret, stripes);
+}
+
+void Scramble(u64* acc, const u8* secret)
+{
+    const u8* key = secret + SECRET_SIZE - STRIPE_SIZE;
+    for (int i = 0; i < 8; i++)
+    {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= Read64(key + 8 * i);
+        acc[i] *= PRIME32_1;
+    }
+}
+
+/**
+ * Accumulates whole stripes, scrambling the accumulators at the end of each block
+ * @param acc Accumulators
+ * @param block_stripes Stripes already accumulated into the current block, updated
+ * @param secret Secret of the hash
+ * @param data Stripes
+ * @param stripes Number of stripes
+ */
+void ConsumeStripes(u64* acc, size_t* block_stripes, const u8* secret, const u8* data,
+    size_t stripes)
+{
+    while (stripes > 0)
+    {
+        const size_t count = std::min<size_t>(stripes, STRIPES_PER_BLOCK - *block_stripes);
+        Accumulate(acc, data, secret + *block_stripes * 8, count);
+        data += count * STRIPE_SIZE;
+        stripes -= count;
+        *block_stripes += count;
+        if (*block_stripes == STRIPES_PER_BLOCK)
+        {
+            Scramble(acc, secret);
+            *block_stripes = 0;
+        }
+    }
+}
+
+u64 Merge(const u64* acc, const u8* secret, u64 start)
+{
+    u64 result = start;
+    for (int i = 0; i < 4; i++)
+        result += Fold64(acc[2 * i] ^ Read64(secret + 16 * i),
+            acc[2 * i + 1] ^ Read64(secret + 16 * i + 8));
+    return Avalanche(result);
+}
+
+u64 Merge64(const u64* acc, const u8* secret, u64 len)
+{
+    return Merge(acc, secret + 11, len * PRIME64_1);
+}
+
+Hash128 Merge128(const u64* acc, const u8* secret, u64 len)
+{
+    const Hash128 hash = {
+        Merge(acc, secret + 11, len * PRIME64_1),
+        Merge(acc, secret + SECRET_SIZE - STRIPE_SIZE - 11, ~(len * PRIME64_2)),
+    };
+    return hash;
+}
+
+/// Accumulates an input longer than MAX_SHORT_SIZE, the last stripe ending at its end
+void AccumulateLong(u64* acc, const u8* p, size_t len, const u8* secret)
+{
+    InitAccumulators(acc);
+    size_t block_stripes = 0;
+    ConsumeStripes(acc, &block_stripes, secret, p, (len - 1) / STRIPE_SIZE);
+    Accumulate(acc, p + len - STRIPE_SIZE, secret + LAST_STRIPE_KEY, 1);
+}
+
+} // namespace
+
+u64 GetFastHash64(const u8* src, size_t len, u64 seed)
+{
+    if (len <= MAX_SHORT_SIZE)
+        return HashShort(src, len, seed);
+
+    u8 secret[SECRET_SIZE];
+    InitSecret(secret, seed);
+    u64 acc[8];
+    AccumulateLong(acc, src, len, secret);
+    return Merge64(acc, secret, len);
+}
+
+Hash128 GetFastHash128(const u8* src, size_t len, u64 seed)
+{
+    if (len <= MAX_SHORT_SIZE)
+        return HashShort128(src, len, seed);
+
+    u8 secret[SECRET_SIZE];
+    InitSecret(secret, seed);
+    u64 acc[8];
+    AccumulateLong(acc, src, len, secret);
+    return Merge128(acc, secret, len);
+}
+
+// Hashes everything with the fast hash, sampled hashes go through MurmurHash3
+static u64 GetFastHash64Sampled(const u8 *src, int len, u32 samples)
+{
+    if (samples == 0)
+        return GetFastHash64(src, len);
+    return GetMurmurHash3(src, len, samples);
+}
+
+FastHashState::FastHashState(u64 seed)
+{
+    Reset(seed);
+}
+
+void FastHashState::Reset(u64 seed)
+{
+    InitAccumulators(m_acc);
+    InitSecret(m_secret, seed);
+    m_buffered = 0;
+    m_stripes = 0;
+    m_total = 0;
+    m_seed = seed;
+}
+
+void FastHashState::Update(const u8* src, size_t len)
+{
+    m_total += len;
+    if (len <= BUFFER_SIZE - m_buffered)
+    {
+        memcpy(m_buffer + m_buffered, src, len);
+        m_buffered += len;
+        return;
+    }
+
+    // Stripes are only consumed with more data after them, the last one being hashed apart
+    if (m_buffered > 0)
+    {
+        const size_t fill = BUFFER_SIZE - m_buffered;
+        memcpy(m_buffer + m_buffered, src, fill);
+        src += fill;
+        len -= fill;
+        ConsumeStripes(m_acc, &m_stripes, m_secret, m_buffer, BUFFER_SIZE / STRIPE_SIZE);
+        m_buffered = 0;
+    }
+    if (len > BUFFER_SIZE)
+    {
+        const size_t stripes = (len - 1) / STRIPE_SIZE;
+        ConsumeStripes(m_acc, &m_stripes, m_secret, src, stripes);
+        src += stripes * STRIPE_SIZE;
+        len -= stripes * STRIPE_SIZE;
+        // The end of the buffer keeps the stripe before, for a last stripe spanning both
+        memcpy(m_buffer + BUFFER_SIZE - STRIPE_SIZE, src - STRIPE_SIZE, STRIPE_SIZE);
+    }
+    memcpy(m_buffer, src, len);
+    m_buffered = len;
+}
+
+u64 FastHashState::Digest64() const
+{
+    if (m_total <= MAX_SHORT_SIZE)
+        return HashShort(m_buffer, (size_t)m_total, m_seed);
+
+    u64 acc[8];
+    FinishLong(acc);
+    return Merge64(acc, m_secret, m_total);
+}
+
+Hash128 FastHashState::Digest128() const
+{
+    if (m_total <= MAX_SHORT_SIZE)
+        return HashShort128(m_buffer, (size_t)m_total, m_seed);
+
+    u64 acc[8];
+    FinishLong(acc);
+    return Merge128(acc, m_secret, m_total);
+}
+
+void FastHashState::FinishLong(u64* acc) const
+{
+    memcpy(acc, m_acc, sizeof(m_acc));
+    size_t block_stripes = m_stripes;
+    if (m_buffered >= STRIPE_SIZE)
+    {
+        ConsumeStripes(acc, &block_stripes, m_secret, m_buffer, (m_buffered - 1) / STRIPE_SIZE);
+        Accumulate(acc, m_buffer + m_buffered - STRIPE_SIZE, m_secret + LAST_STRIPE_KEY, 1);
+    }
     else
     {
-        ptrHashFunction = &GetMurmurHash3;
+        u8 last[STRIPE_SIZE];
+        const size_t before = STRIPE_SIZE - m_buffered;
+        memcpy(last, m_buffer + BUFFER_SIZE - before, before);
+        memcpy(last + before, m_buffer, m_buffered);
+        Accumulate(acc, last, m_secret + LAST_STRIPE_KEY, 1);
     }
 }
 
@@ -17,4 +17,50 @@ u64 GetHashHiresTexture(const u8 *src, int len, u32 samples);
 u64 GetMurmurHash3(const u8 *src, int len, u32 samples);
 u64 GetHash64(const u8 *src, int len, u32 samples);
 void SetHash64Function(bool useHiresTextures);
+
+struct Hash128
+{
+    u64 low;
+    u64 high;
+
+    bool operator==(const Hash128& other) const { return low == other.low && high == other.high; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+};
+
+// Fast 64 and 128-bit hashes of whole buffers, vectorised with SSE2 or AVX2 where the CPU has it.
+// Not cryptographic, and not stable across versions: don't store them.
+u64 GetFastHash64(const u8* src, size_t len, u64 seed = 0);
+Hash128 GetFastHash128(const u8* src, size_t len, u64 seed = 0);
+
+// Streaming form of the fast hashes: the digests equal the hash of all the data updated with
+// since the last reset, however it was split
+class FastHashState
+{
+public:
+    FastHashState(u64 seed = 0);
+
+    void Reset(u64 seed = 0);
+    void Update(const u8* src, size_t len);
+
+    u64 Digest64() const;
+    Hash128 Digest128() const;
+
+    enum
+    {
+        SECRET_SIZE = 192,
+        BUFFER_SIZE = 256,
+    };
+
+private:
+    void FinishLong(u64* acc) const;
+
+    u64 m_acc[8];
+    u8 m_secret[SECRET_SIZE];
+    u8 m_buffer[BUFFER_SIZE];
+    size_t m_buffered;
+    size_t m_stripes;           // Stripes accumulated into the current block
+    u64 m_total;
+    u64 m_seed;
+};
+
 #endif // _HASH_H_
@@ -0,0 +1,192 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <fstream>
+
+#include "common/file_util.h"
+#include "common/ini_file.h"
+#include "common/string_util.h"
+
+/**
+ * Reads a file, replacing what was read before
+ * @param filename Path of the file
+ * @return False if the file couldn't be read, the contents are empty then
+ */
+bool IniFile::Load(const std::string& filename) {
+    m_sections.clear();
+    m_sections.push_back(Section());
+
+    std::ifstream file;
+    OpenFStream(file, filename, std::ios::in);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        // Windows line ends stay out of the values
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        const std::string stripped = StripSpaces(line);
+        if (stripped.size() >= 2 && stripped[0] == '[' && stripped[stripped.size() - 1] == ']') {
+            Section section;
+            section.name = stripped.substr(1, stripped.size() - 2);
+            m_sections.push_back(section);
+        } else {
+            m_sections.back().lines.push_back(line);
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes the file
+ * @param filename Path of the file
+ * @return False if the file couldn't be written
+ */
+bool IniFile::Save(const std::string& filename) const {
+    std::ofstream file;
+    OpenFStream(file, filename, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < m_sections.size(); i++) {
+        const Section& section = m_sections[i];
+        if (i != 0) {
+            file << "[" << section.name << "]\n";
+        }
+        for (size_t j = 0; j < section.lines.size(); j++) {
+            file << section.lines[j] << "\n";
+        }
+    }
+    return !file.fail();
+}
+
+/**
+ * Gets the value of a key
+ * @param section Section of the key
+ * @param key Name of the key
+ * @param value Filled with the value, or the default when the key is missing
+ * @param default_value Value of a missing key
+ * @return False if the key is missing
+ */
+bool IniFile::Get(const std::string& section, const std::string& key, std::string* value,
+    const std::string& default_value) const {
+
+    const Section* found = FindSection(section);
+    if (found != NULL) {
+        for (size_t i = 0; i < found->lines.size(); i++) {
+            std::string line_key, line_value;
+            if (ParseLine(found->lines[i], &line_key, &line_value) && line_key == key) {
+                *value = line_value;
+                return true;
+            }
+        }
+    }
+    *value = default_value;
+    return false;
+}
+
+bool IniFile::Get(const std::string& section, const std::string& key, int* value,
+    int default_value) const {
+
+    std::string text;
+    *value = default_value;
+    return Get(section, key, &text) && TryParse(text, value);
+}
+
+bool IniFile::Get(const std::string& section, const std::string& key, bool* value,
+    bool default_value) const {
+
+    std::string text;
+    *value = default_value;
+    return Get(section, key, &text) && TryParse(text, value);
+}
+
+/**
+ * Sets the value of a key, adding the key and its section if they're missing
+ * @param section Section of the key
+ * @param key Name of the key
+ * @param value Value of the key
+ */
+void IniFile::Set(const std::string& section, const std::string& key, const std::string& value) {
+    const std::string line = key + " = " + value;
+
+    Section* found = const_cast<Section*>(FindSection(section));
+    if (found == NULL) {
+        if (m_sections.empty()) {
+            m_sections.push_back(Section());
+        }
+        // A blank line between the sections, unless the file was empty
+        std::vector<std::string>& previous = m_sections.back().lines;
+        if (m_sections.size() > 1 || !previous.empty()) {
+            if (previous.empty() || !StripSpaces(previous.back()).empty()) {
+                previous.push_back("");
+            }
+        }
+        Section added;
+        added.name = section;
+        m_sections.push_back(added);
+        found = &m_sections.back();
+    }
+    for (size_t i = 0; i < found->lines.size(); i++) {
+        std::string line_key, line_value;
+        if (ParseLine(found->lines[i], &line_key, &line_value) && line_key == key) {
+            found->lines[i] = line;
+            return;
+        }
+    }
+
+    // After the last key, blank lines and comments below it belong to the next section
+    size_t position = found->lines.size();
+    while (position > 0 && !ParseLine(found->lines[position - 1], NULL, NULL)) {
+        position--;
+    }
+    found->lines.insert(found->lines.begin() + position, line);
+}
+
+void IniFile::Set(const std::string& section, const std::string& key, int value) {
+    Set(section, key, StringFromInt(value));
+}
+
+void IniFile::Set(const std::string& section, const std::string& key, bool value) {
+    Set(section, key, StringFromBool(value));
+}
+
+const IniFile::Section* IniFile::FindSection(const std::string& name) const {
+    // The first section has no header, no name finds it
+    for (size_t i = 1; i < m_sections.size(); i++) {
+        if (m_sections[i].name == name) {
+            return &m_sections[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Splits a line in its key and its value
+ * @param line Line of a section
+ * @param key Filled with the key, if not NULL
+ * @param value Filled with the value without its quotes, if not NULL
+ * @return False if the line is blank or a comment
+ */
+bool IniFile::ParseLine(const std::string& line, std::string* key, std::string* value) {
+    const std::string stripped = StripSpaces(line);
+    if (stripped.empty() || stripped[0] == '#' || stripped[0] == ';') {
+        return false;
+    }
+    const size_t equals = stripped.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    if (key != NULL) {
+        *key = StripSpaces(stripped.substr(0, equals));
+    }
+    if (value != NULL) {
+        *value = StripQuotes(StripSpaces(stripped.substr(equals + 1)));
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+/**
+ * Settings file of "[Section]" headers and "key = value" lines. Lines are kept as read, so that
+ * saving a file that was loaded keeps its comments and order, with the values set replaced.
+ */
+class IniFile {
+public:
+    /**
+     * Reads a file, replacing what was read before
+     * @param filename Path of the file
+     * @return False if the file couldn't be read, the contents are empty then
+     */
+    bool Load(const std::string& filename);
+
+    /**
+     * Writes the file
+     * @param filename Path of the file
+     * @return False if the file couldn't be written
+     */
+    bool Save(const std::string& filename) const;
+
+    /**
+     * Gets the value of a key
+     * @param section Section of the key
+     * @param key Name of the key
+     * @param value Filled with the value, or the default when the key is missing
+     * @param default_value Value of a missing key
+     * @return False if the key is missing
+     */
+    bool Get(const std::string& section, const std::string& key, std::string* value,
+        const std::string& default_value = "") const;
+    bool Get(const std::string& section, const std::string& key, int* value,
+        int default_value = 0) const;
+    bool Get(const std::string& section, const std::string& key, bool* value,
+        bool default_value = false) const;
+
+    /**
+     * Sets the value of a key, adding the key and its section if they're missing
+     * @param section Section of the key
+     * @param key Name of the key
+     * @param value Value of the key
+     */
+    void Set(const std::string& section, const std::string& key, const std::string& value);
+    void Set(const std::string& section, const std::string& key, int value);
+    void Set(const std::string& section, const std::string& key, bool value);
+
+private:
+    struct Section {
+        std::string name;
+        std::vector<std::string> lines; ///< Lines after the header, keys and comments
+    };
+
+    const Section* FindSection(const std::string& name) const;
+    static bool ParseLine(const std::string& line, std::string* key, std::string* value);
+
+    std::vector<Section> m_sections;    ///< The first has no header, lines before any section
+};
@@ -7,23 +7,24 @@
 #define _LINEAR_DISKCACHE
 
 #include "common/common.h"
+#include "common/file_util.h"
+#include "common/scm_rev.h"
 #include <fstream>
-
-// defined in Version.cpp
-extern const char *scm_rev_git_str;
+#include <string.h>
 
 // On disk format:
 //header{
 // u32 'DCAC';
-// u32 version;  // svn_rev
 // u16 sizeof(key_type);
 // u16 sizeof(value_type);
+// char version[40];  // git revision, files of other builds are discarded
 //}
 
 //key_value_pair{
 // u32 value_size;
 // key_type   key;
 // value_type[value_size]   value;
+// u32 entry_number;  // one based, entries after a mismatch are discarded
 //}
 
 template <typename K, typename V>
@@ -175,7 +176,8 @@ private:
             , key_t_size(sizeof(K))
             , value_t_size(sizeof(V))
         {
-            memcpy(ver, scm_rev_git_str, 40);
+            memset(ver, 0, sizeof(ver));
+            strncpy(ver, Common::g_scm_rev, sizeof(ver));
         }
 
         const u32 id;
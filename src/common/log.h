@@ -5,6 +5,8 @@
 #ifndef _LOG_H_
 #define _LOG_H_
 
+#include <atomic>
+
 #define LOGGING
 
 #define    NOTICE_LEVEL  1  // VERY important information that is NOT errors. Like startup and OSReports.
@@ -82,6 +84,10 @@ enum LOG_LEVELS {
 
 }  // namespace
 
+// Most verbose level each log type lets through, 0 when disabled or without listeners. Kept up to
+// date by the LogManager so that the log macros filter without calling into it.
+extern std::atomic<int> g_log_levels[LogTypes::NUMBER_OF_LOGS];
+
 void GenericLog(LOGTYPES_LEVELS level, LOGTYPES_TYPE type,
         const char *file, int line, const char *fmt, ...)
 #ifdef __GNUC__
@@ -89,30 +95,49 @@ void GenericLog(LOGTYPES_LEVELS level, LOGTYPES_TYPE type,
 #endif
         ;
 
+// Levels more verbose than MAX_LOGLEVEL compile to nothing, the build may set it lower
+#ifndef MAX_LOGLEVEL
 #if defined LOGGING || defined _DEBUG || defined DEBUGFAST
 #define MAX_LOGLEVEL DEBUG_LEVEL
 #else
-#ifndef MAX_LOGLEVEL
 #define MAX_LOGLEVEL WARNING_LEVEL
-#endif // loglevel
 #endif // logging
+#endif // loglevel
 
 #ifdef GEKKO
 #define GENERIC_LOG(t, v, ...)
 #else
 // Let the compiler optimize this out
 #define GENERIC_LOG(t, v, ...) { \
-    if (v <= MAX_LOGLEVEL) \
+    if (v <= MAX_LOGLEVEL && v <= g_log_levels[t].load(std::memory_order_relaxed)) \
         GenericLog(v, t, __FILE__, __LINE__, __VA_ARGS__); \
     }
 #endif
 
+// Whether a message of the level would be logged by the type, for the rate-limited macros
+#define LOG_PASSES(t, v) (v <= MAX_LOGLEVEL && v <= g_log_levels[t].load(std::memory_order_relaxed))
+
 #define ERROR_LOG(t,...) do { GENERIC_LOG(LogTypes::t, LogTypes::LERROR, __VA_ARGS__) } while (0)
 #define WARN_LOG(t,...) do { GENERIC_LOG(LogTypes::t, LogTypes::LWARNING, __VA_ARGS__) } while (0)
 #define NOTICE_LOG(t,...) do { GENERIC_LOG(LogTypes::t, LogTypes::LNOTICE, __VA_ARGS__) } while (0)
 #define INFO_LOG(t,...) do { GENERIC_LOG(LogTypes::t, LogTypes::LINFO, __VA_ARGS__) } while (0)
 #define DEBUG_LOG(t,...) do { GENERIC_LOG(LogTypes::t, LogTypes::LDEBUG, __VA_ARGS__) } while (0)
 
+// Rate-limited logging for spammy call sites: LOG_ONCE(ERROR, GPU, "...") logs the first message
+// that passes the filter and drops the ones after, LOG_EVERY_N(WARNING, KERNEL, 100, "...") logs
+// the first one and then one in n.
+#define LOG_ONCE(v, t, ...) do { \
+    static std::atomic<bool> logged_(false); \
+    if (LOG_PASSES(LogTypes::t, LogTypes::L##v) && !logged_.exchange(true)) \
+        GenericLog(LogTypes::L##v, LogTypes::t, __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+#define LOG_EVERY_N(v, t, n, ...) do { \
+    static std::atomic<unsigned> count_(0); \
+    if (LOG_PASSES(LogTypes::t, LogTypes::L##v) && \
+        count_.fetch_add(1, std::memory_order_relaxed) % (n) == 0) \
+        GenericLog(LogTypes::L##v, LogTypes::t, __FILE__, __LINE__, __VA_ARGS__); \
+    } while (0)
+
 #if MAX_LOGLEVEL >= DEBUG_LEVEL
 #define _dbg_assert_(_t_, _a_) \
     if (!(_a_)) {\
@@ -3,9 +3,14 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <chrono>
+#include <stdarg.h>
+#include <time.h>
 
 #include "common/log_manager.h"
 #include "common/console_listener.h"
+#include "common/format_buffer.h"
+#include "common/memory_tracker.h"
 #include "common/timer.h"
 #include "common/thread.h"
 #include "common/file_util.h"
@@ -21,9 +26,310 @@ void GenericLog(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type,
     va_end(args);
 }
 
+std::atomic<int> g_log_levels[LogTypes::NUMBER_OF_LOGS];
+
 LogManager *LogManager::m_logManager = NULL;
 
+enum
+{
+    MAX_LOG_ARGS = 16,
+    MAX_FREE_RECORDS = 256,     // Records kept for reuse, more are freed
+};
+
+union LogArg
+{
+    s64 i;
+    double d;
+    const void* p;
+};
+
+// A log call as queued for the logger thread: the format and its arguments, unformatted
+struct LogRecord : Common::MPSCQueueNode
+{
+    LogTypes::LOG_LEVELS level;
+    LogTypes::LOG_TYPE type;
+    const char* file;
+    int line;
+    const char* format;         // NULL when text is the message, formatted by the caller
+    int num_args;
+    LogArg args[MAX_LOG_ARGS];  // Strings are offsets of their copies in text
+    int text_size;              // Bytes of text used, with the terminators
+    char text[MAX_MSGLEN];
+};
+
+// Records come from the heap while the free list has none, accounted as log buffers
+static LogRecord* NewRecord()
+{
+    Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_LOG_BUFFERS, sizeof(LogRecord));
+    return new LogRecord;
+}
+
+static void DeleteRecord(LogRecord* record)
+{
+    Common::MemoryTracker::Free(Common::MemoryTracker::TAG_LOG_BUFFERS, sizeof(LogRecord));
+    delete record;
+}
+
+// Argument types of printf conversions
+enum LogArgType
+{
+    ARG_NONE,                   // %%
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_SIZE,
+    ARG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING,
+};
+
+struct LogSpec
+{
+    const char* end;            // Past the conversion character
+    int num_stars;              // Width and precision given as int arguments before the value
+    LogArgType type;
+};
+
+// Parses a printf conversion specification, false for those the logger thread can't format
+static bool ParseSpec(const char* p, LogSpec* spec)
+{
+    spec->num_stars = 0;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+        p++;
+    if (*p == '*')
+    {
+        spec->num_stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            spec->num_stars++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+
+    int longs = 0;
+    bool size = false;
+    for (;; p++)
+    {
+        if (*p == 'l')
+            longs++;
+        else if (*p == 'z' || *p == 'j' || *p == 't')
+            size = true;
+        else if (*p != 'h')
+            break;
+    }
+
+    switch (*p)
+    {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        spec->type = (longs >= 2) ? ARG_LONG_LONG : (longs == 1) ? ARG_LONG :
+            size ? ARG_SIZE : ARG_INT;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        spec->type = ARG_DOUBLE;
+        break;
+    case 'p':
+        spec->type = ARG_POINTER;
+        break;
+    case 's':
+        if (longs != 0)
+            return false;
+        spec->type = ARG_STRING;
+        break;
+    case '%':
+        spec->type = ARG_NONE;
+        break;
+    default:
+        // %n, long doubles and broken formats
+        return false;
+    }
+    spec->end = p + 1;
+    return true;
+}
+
+// Takes the arguments of a log call into its record, false if they don't fit
+static bool CaptureArgs(LogRecord* record, va_list args)
+{
+    size_t text_size = 0;
+    record->num_args = 0;
+    for (const char* p = record->format; *p != '\0';)
+    {
+        if (*p++ != '%')
+            continue;
+
+        LogSpec spec;
+        if (!ParseSpec(p, &spec))
+            return false;
+        p = spec.end;
+        if (spec.type == ARG_NONE)
+            continue;
+        if (record->num_args + spec.num_stars + 1 > MAX_LOG_ARGS)
+            return false;
+
+        for (int i = 0; i < spec.num_stars; i++)
+            record->args[record->num_args++].i = va_arg(args, int);
+        LogArg& arg = record->args[record->num_args++];
+        switch (spec.type)
+        {
+        case ARG_INT:
+            arg.i = va_arg(args, int);
+            break;
+        case ARG_LONG:
+            arg.i = va_arg(args, long);
+            break;
+        case ARG_LONG_LONG:
+            arg.i = va_arg(args, long long);
+            break;
+        case ARG_SIZE:
+            arg.i = (s64)va_arg(args, size_t);
+            break;
+        case ARG_DOUBLE:
+            arg.d = va_arg(args, double);
+            break;
+        case ARG_POINTER:
+            arg.p = va_arg(args, void*);
+            break;
+        case ARG_STRING:
+        default:
+            {
+                const char* str = va_arg(args, const char*);
+                if (str == NULL)
+                    str = "(null)";
+                const size_t length = strlen(str);
+                if (text_size + length + 1 > sizeof(record->text))
+                    return false;
+                memcpy(record->text + text_size, str, length + 1);
+                arg.i = (s64)text_size;
+                text_size += length + 1;
+            }
+            break;
+        }
+    }
+    record->text_size = (int)text_size;
+    return true;
+}
+
+// Formats one conversion with its value
+template <typename T>
+static void FormatArg(Common::FormatBuffer& out, const char* conversion, const LogArg* stars,
+    int num_stars, T value)
+{
+    switch (num_stars)
+    {
+    case 0:
+        out.Append(conversion, value);
+        break;
+    case 1:
+        out.Append(conversion, (int)stars[0].i, value);
+        break;
+    default:
+        out.Append(conversion, (int)stars[0].i, (int)stars[1].i, value);
+        break;
+    }
+}
+
+// Appends the message of a record, on the logger thread
+static void FormatRecord(const LogRecord* record, Common::FormatBuffer& out)
+{
+    if (record->format == NULL)
+    {
+        out.AppendText(record->text, strlen(record->text));
+        return;
+    }
+
+    int arg = 0;
+    const char* p = record->format;
+    while (*p != '\0' && !out.IsTruncated())
+    {
+        if (*p != '%')
+        {
+            const char* start = p;
+            while (*p != '\0' && *p != '%')
+                p++;
+            out.AppendText(start, p - start);
+            continue;
+        }
+
+        // Parsed already when the arguments were captured
+        const char* start = p++;
+        LogSpec spec;
+        ParseSpec(p, &spec);
+        p = spec.end;
+        if (spec.type == ARG_NONE)
+        {
+            out.AppendText("%", 1);
+            continue;
+        }
+
+        char conversion[32];
+        const size_t conversion_length = std::min<size_t>(p - start, sizeof(conversion) - 1);
+        memcpy(conversion, start, conversion_length);
+        conversion[conversion_length] = '\0';
+
+        const LogArg* stars = &record->args[arg];
+        const LogArg& value = record->args[arg + spec.num_stars];
+        arg += spec.num_stars + 1;
+
+        switch (spec.type)
+        {
+        case ARG_INT:
+            FormatArg(out, conversion, stars, spec.num_stars, (int)value.i);
+            break;
+        case ARG_LONG:
+            FormatArg(out, conversion, stars, spec.num_stars, (long)value.i);
+            break;
+        case ARG_LONG_LONG:
+            FormatArg(out, conversion, stars, spec.num_stars, (long long)value.i);
+            break;
+        case ARG_SIZE:
+            FormatArg(out, conversion, stars, spec.num_stars, (size_t)value.i);
+            break;
+        case ARG_DOUBLE:
+            FormatArg(out, conversion, stars, spec.num_stars, value.d);
+            break;
+        case ARG_POINTER:
+            FormatArg(out, conversion, stars, spec.num_stars, value.p);
+            break;
+        case ARG_STRING:
+        default:
+            FormatArg(out, conversion, stars, spec.num_stars, record->text + value.i);
+            break;
+        }
+    }
+}
+
+// Gets the wall clock time in ms since 1970, the time of the records
+static u64 GetRecordTime()
+{
+    using namespace std::chrono;
+    return (u64)duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// Formats a line of the log the way the listeners and the text log file get it
+static void FormatLine(const LogRecord* record, u64 time_ms, const char* short_name,
+    Common::FormatBuffer& out)
+{
+    // Minutes:seconds:milliseconds of the local time, as Timer::GetTimeFormatted
+    const time_t seconds = (time_t)(time_ms / 1000);
+    char minutes_seconds[8];
+    strftime(minutes_seconds, sizeof(minutes_seconds), "%M:%S", localtime(&seconds));
+
+    static const char level_to_char[7] = "-NEWID";
+    out.Append("%s:%03d %s:%d %c[%s]: ", minutes_seconds, (int)(time_ms % 1000), record->file,
+        record->line, level_to_char[(int)record->level], short_name);
+    FormatRecord(record, out);
+}
+
 LogManager::LogManager()
+    : m_free_records(MAX_FREE_RECORDS)
 {
     // create log files
     m_Log[LogTypes::MASTER_LOG]         = new LogContainer("*",                 "Master Log");
@@ -87,11 +393,29 @@ LogManager::LogManager()
         if (IsDebuggerPresent())
             m_Log[i]->AddListener(m_debuggerLog);
 #endif
+        UpdateLevel((LogTypes::LOG_TYPE)i);
     }
+
+    m_running = true;
+    m_sleeping = false;
+    m_last_flush = Common::Timer::GetTimeMs();
+    m_thread = std::thread(&LogManager::LoggerThread, this);
 }
 
 LogManager::~LogManager()
 {
+    // The logger thread writes what is queued before it exits
+    m_running = false;
+    {
+        std::lock_guard<std::mutex> lk(m_wake_lock);
+        m_sleeping = false;
+        m_wake.notify_one();
+    }
+    m_thread.join();
+    LogRecord* record;
+    while (m_free_records.Pop(record))
+        DeleteRecord(record);
+
     for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
     {
         m_logManager->RemoveListener((LogTypes::LOG_TYPE)i, m_fileLog);
@@ -110,25 +434,313 @@ LogManager::~LogManager()
 void LogManager::Log(LogTypes::LOG_LEVELS level, LogTypes::LOG_TYPE type, 
     const char *file, int line, const char *format, va_list args)
 {
-    char temp[MAX_MSGLEN];
-    char msg[MAX_MSGLEN * 2];
     LogContainer *log = m_Log[type];
 
     if (!log->IsEnabled() || level > log->GetLevel() || ! log->HasListeners())
         return;
 
-    CharArrayFromFormatV(temp, MAX_MSGLEN, format, args);
+    // Records are recycled by the logger thread, the heap only sees bursts
+    LogRecord* record;
+    if (!m_free_records.Pop(record))
+        record = NewRecord();
+    record->level = level;
+    record->type = type;
+    record->file = file;
+    record->line = line;
+    record->format = format;
 
-    static const char level_to_char[7] = "-NEWID";
-    sprintf(msg, "%s %s:%u %c[%s]: %s\n",
-        Common::Timer::GetTimeFormatted().c_str(),
-        file, line, level_to_char[(int)level],
-        log->GetShortName(), temp);
+    // Calls the logger thread can't format later are formatted right away
+    va_list args_copy;
+    va_copy(args_copy, args);
+    if (!CaptureArgs(record, args_copy))
+    {
+        record->format = NULL;
+        CharArrayFromFormatV(record->text, MAX_MSGLEN, format, args);
+        record->text_size = (int)strlen(record->text) + 1;
+    }
+    va_end(args_copy);
+
+    m_queue.Push(record);
+
+    // Pairs with the fence of the logger thread going to sleep, one of the two sees the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lk(m_wake_lock);
+        m_sleeping = false;
+        m_wake.notify_one();
+    }
+}
+
+// Publishes the level a log type lets through to the log macros
+void LogManager::UpdateLevel(LogTypes::LOG_TYPE type)
+{
+    const LogContainer *log = m_Log[type];
+    const bool passes = log->IsEnabled() && log->HasListeners();
+    g_log_levels[type].store(passes ? (int)log->GetLevel() : 0, std::memory_order_relaxed);
+}
+
+void LogManager::LoggerThread()
+{
+    Common::SetCurrentThreadName("Logger");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_LOW);
+
+    for (;;)
+    {
+        while (LogRecord* record = m_queue.Pop())
+        {
+            Write(record);
+            if (!m_free_records.Push(record))
+                DeleteRecord(record);
+            // The listeners buffer while records keep coming, but not for long
+            if (Common::Timer::GetTimeMs() - m_last_flush >= LOG_FLUSH_INTERVAL_MS)
+                FlushListeners();
+        }
+        // Pop sees nothing while a record is half pushed, Empty doesn't miss it
+        if (!m_queue.Empty())
+        {
+            Common::YieldCPU();
+            continue;
+        }
+        FlushListeners();
+        if (!m_running)
+            break;
+
+        std::unique_lock<std::mutex> lk(m_wake_lock);
+        m_sleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_queue.Empty() && m_running)
+        {
+            while (m_sleeping)
+                m_wake.wait(lk);
+        }
+        m_sleeping = false;
+    }
+}
+
+void LogManager::Write(const LogRecord* record)
+{
+    LogContainer *log = m_Log[record->type];
+    const u64 time_ms = GetRecordTime();
+    {
+        std::lock_guard<std::mutex> lk(m_binary_lock);
+        if (m_binary_log.IsOpen())
+            WriteBinary(record, time_ms);
+    }
+
+    // The message is formatted after its header, one byte is kept for the line end
+    char msg[MAX_MSGLEN * 2];
+    Common::FormatBuffer out(msg, sizeof(msg) - 1);
+    FormatLine(record, time_ms, log->GetShortName(), out);
+    msg[out.size()] = '\n';
+    msg[out.size() + 1] = '\0';
 #ifdef ANDROID
     Host_SysMessage(msg);    
 #endif
-    printf(msg); // TODO(ShizZy): RemoveMe when I no longer need this
-    log->Trigger(level, msg);
+    log->Trigger(record->level, msg);
+}
+
+// Flushes every listener once, on the logger thread
+void LogManager::FlushListeners()
+{
+    std::set<LogListener*> flushed;
+    for (int i = 0; i < LogTypes::NUMBER_OF_LOGS; ++i)
+        m_Log[i]->FlushListeners(flushed);
+    {
+        std::lock_guard<std::mutex> lk(m_binary_lock);
+        if (m_binary_log.IsOpen())
+            m_binary_log.Flush();
+    }
+    m_last_flush = Common::Timer::GetTimeMs();
+}
+
+// Layout of binary logs: a header, then entries, each a byte of BinaryLogEntry and its data
+enum
+{
+    BINARY_LOG_MAGIC = 0x424C5443,  // "CTLB"
+    BINARY_LOG_VERSION = 1,
+};
+
+enum BinaryLogEntry
+{
+    ENTRY_STRING = 1,           // BinaryLogString and its bytes, without terminator
+    ENTRY_RECORD = 2,           // BinaryLogRecord, its arguments, then its text
+};
+
+struct BinaryLogHeader
+{
+    u32 magic;
+    u32 version;
+};
+
+struct BinaryLogString
+{
+    u32 id;                     // From 1, in the order of the strings
+    u32 length;
+};
+
+struct BinaryLogRecord
+{
+    u64 time_ms;                // Wall clock time, since 1970
+    u32 file;                   // Ids of strings
+    u32 type;                   // Short name of the log type
+    u32 format;                 // 0 when the text is the message
+    u32 line;
+    u8 level;
+    u8 num_args;
+    u16 text_size;
+};
+
+bool LogManager::OpenBinaryLog(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lk(m_binary_lock);
+    m_binary_log.Close();
+    m_binary_ids.clear();
+    m_binary_strings.clear();
+
+    BinaryLogHeader header = { BINARY_LOG_MAGIC, BINARY_LOG_VERSION };
+    if (!m_binary_log.Open(filename, "wb") || !m_binary_log.WriteArray(&header, 1))
+    {
+        m_binary_log.Close();
+        return false;
+    }
+    // Stays a listener, the log types keep letting messages through
+    m_fileLog->SetEnable(false);
+    return true;
+}
+
+// Gets the id of a string of the binary log, writing the string the first time
+u32 LogManager::GetBinaryId(const char* str)
+{
+    auto it = m_binary_ids.find(str);
+    if (it != m_binary_ids.end() && m_binary_strings[it->second - 1] == str)
+        return it->second;
+
+    const u32 id = (u32)m_binary_strings.size() + 1;
+    m_binary_ids[str] = id;
+    m_binary_strings.push_back(str);
+
+    const u8 entry = ENTRY_STRING;
+    const BinaryLogString header = { id, (u32)strlen(str) };
+    m_binary_log.WriteArray(&entry, 1);
+    m_binary_log.WriteArray(&header, 1);
+    m_binary_log.WriteBytes(str, header.length);
+    return id;
+}
+
+// Writes a record to the binary log, with the binary lock held
+void LogManager::WriteBinary(const LogRecord* record, u64 time_ms)
+{
+    BinaryLogRecord binary;
+    memset(&binary, 0, sizeof(binary));
+    binary.time_ms = time_ms;
+    binary.file = GetBinaryId(record->file);
+    binary.type = GetBinaryId(m_Log[record->type]->GetShortName());
+    binary.format = (record->format != NULL) ? GetBinaryId(record->format) : 0;
+    binary.line = (u32)record->line;
+    binary.level = (u8)record->level;
+    binary.num_args = (record->format != NULL) ? (u8)record->num_args : 0;
+    binary.text_size = (u16)record->text_size;
+
+    const u8 entry = ENTRY_RECORD;
+    m_binary_log.WriteArray(&entry, 1);
+    m_binary_log.WriteArray(&binary, 1);
+    m_binary_log.WriteArray(record->args, binary.num_args);
+    m_binary_log.WriteBytes(record->text, binary.text_size);
+}
+
+// Checks that formatting a record read from a binary log stays within its arguments and text
+static bool CheckRecord(const LogRecord* record)
+{
+    if (record->format == NULL)
+        return true;
+
+    int arg = 0;
+    for (const char* p = record->format; *p != '\0';)
+    {
+        if (*p++ != '%')
+            continue;
+
+        LogSpec spec;
+        if (!ParseSpec(p, &spec))
+            return false;
+        p = spec.end;
+        if (spec.type == ARG_NONE)
+            continue;
+        arg += spec.num_stars + 1;
+        if (arg > record->num_args)
+            return false;
+        if (spec.type == ARG_STRING)
+        {
+            const s64 offset = record->args[arg - 1].i;
+            if (offset < 0 || offset >= record->text_size)
+                return false;
+        }
+    }
+    return true;
+}
+
+bool LogManager::DecodeBinaryLog(const std::string& filename, FILE* out)
+{
+    File::IOFile file(filename, "rb");
+    BinaryLogHeader header;
+    if (!file.ReadArray(&header, 1) || header.magic != BINARY_LOG_MAGIC ||
+        header.version != BINARY_LOG_VERSION)
+    {
+        ERROR_LOG(COMMON, "%s is not a binary log", filename.c_str());
+        return false;
+    }
+
+    std::vector<std::string> strings;
+    LogRecord record;
+    u8 entry;
+    while (file.ReadArray(&entry, 1))
+    {
+        if (entry == ENTRY_STRING)
+        {
+            BinaryLogString string;
+            if (!file.ReadArray(&string, 1) || string.id != strings.size() + 1 ||
+                string.length > MAX_MSGLEN)
+                break;
+            std::string text(string.length, '\0');
+            if (string.length != 0 && !file.ReadBytes(&text[0], string.length))
+                break;
+            strings.push_back(text);
+            continue;
+        }
+
+        BinaryLogRecord binary;
+        if (entry != ENTRY_RECORD || !file.ReadArray(&binary, 1) ||
+            binary.num_args > MAX_LOG_ARGS || binary.text_size > MAX_MSGLEN ||
+            binary.file == 0 || binary.file > strings.size() ||
+            binary.type == 0 || binary.type > strings.size() || binary.format > strings.size() ||
+            binary.level >= 7 || !file.ReadArray(record.args, binary.num_args) ||
+            !file.ReadBytes(record.text, binary.text_size))
+            break;
+
+        record.level = (LogTypes::LOG_LEVELS)binary.level;
+        record.file = strings[binary.file - 1].c_str();
+        record.line = (int)binary.line;
+        record.format = (binary.format != 0) ? strings[binary.format - 1].c_str() : NULL;
+        record.num_args = binary.num_args;
+        record.text_size = binary.text_size;
+        record.text[std::max<int>(binary.text_size, 1) - 1] = '\0';
+        if (!CheckRecord(&record))
+            break;
+
+        char msg[MAX_MSGLEN * 2];
+        Common::FormatBuffer line(msg, sizeof(msg));
+        FormatLine(&record, binary.time_ms, strings[binary.type - 1].c_str(), line);
+        fprintf(out, "%s\n", line.c_str());
+    }
+    // A record cut short is the end of the log of a crashed run
+    if (!feof(file.GetHandle()))
+    {
+        ERROR_LOG(COMMON, "%s is broken past offset %llu", filename.c_str(),
+            (unsigned long long)file.Tell());
+        return false;
+    }
+    return true;
 }
 
 void LogManager::Init()
@@ -163,6 +775,19 @@ void LogContainer::RemoveListener(LogListener *listener)
     m_listeners.erase(listener);
 }
 
+// Flushes the listeners that aren't in a set yet, adding them to it
+void LogContainer::FlushListeners(std::set<LogListener*>& flushed)
+{
+    std::lock_guard<std::mutex> lk(m_listeners_lock);
+
+    std::set<LogListener*>::const_iterator i;
+    for (i = m_listeners.begin(); i != m_listeners.end(); ++i)
+    {
+        if (flushed.insert(*i).second)
+            (*i)->Flush();
+    }
+}
+
 void LogContainer::Trigger(LogTypes::LOG_LEVELS level, const char *msg)
 {
     std::lock_guard<std::mutex> lk(m_listeners_lock);
@@ -176,8 +801,16 @@ void LogContainer::Trigger(LogTypes::LOG_LEVELS level, const char *msg)
 
 FileLogListener::FileLogListener(const char *filename)
 {
+    // Buffers set once the file is open are ignored by some standard libraries
+    m_logfile.rdbuf()->pubsetbuf(m_buffer, sizeof(m_buffer));
     OpenFStream(m_logfile, filename, std::ios::app);
     SetEnable(true);
+    Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_LOG_BUFFERS, sizeof(m_buffer));
+}
+
+FileLogListener::~FileLogListener()
+{
+    Common::MemoryTracker::Free(Common::MemoryTracker::TAG_LOG_BUFFERS, sizeof(m_buffer));
 }
 
 void FileLogListener::Log(LogTypes::LOG_LEVELS, const char *msg)
@@ -186,7 +819,16 @@ void FileLogListener::Log(LogTypes::LOG_LEVELS, const char *msg)
         return;
 
     std::lock_guard<std::mutex> lk(m_log_lock);
-    m_logfile << msg << std::flush;
+    m_logfile << msg;
+}
+
+void FileLogListener::Flush()
+{
+    if (!IsValid())
+        return;
+
+    std::lock_guard<std::mutex> lk(m_log_lock);
+    m_logfile.flush();
 }
 
 void DebuggerLogListener::Log(LogTypes::LOG_LEVELS, const char *msg)
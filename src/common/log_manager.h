@@ -6,15 +6,21 @@
 #define _LOGMANAGER_H_
 
 #include "common/log.h"
+#include "common/mpmc_queue.h"
+#include "common/mpsc_queue.h"
 #include "common/string_util.h"
 #include "common/thread.h"
 #include "common/file_util.h"
 
+#include <atomic>
 #include <set>
+#include <stdio.h>
+#include <unordered_map>
 #include <string.h>
 
 #define MAX_MESSAGES 8000
 #define MAX_MSGLEN  1024
+#define LOG_FLUSH_INTERVAL_MS 100
 
 
 // pure virtual interface
@@ -24,14 +30,20 @@ public:
     virtual ~LogListener() {}
 
     virtual void Log(LogTypes::LOG_LEVELS, const char *msg) = 0;
+
+    // Writes out what the listener buffered. Called by the logger thread once it has no records
+    // left and at least every LOG_FLUSH_INTERVAL_MS while it has.
+    virtual void Flush() {}
 };
 
 class FileLogListener : public LogListener
 {
 public:
     FileLogListener(const char *filename);
+    ~FileLogListener();
 
     void Log(LogTypes::LOG_LEVELS, const char *msg);
+    void Flush();
 
     bool IsValid() { return !m_logfile.fail(); }
     bool IsEnabled() const { return m_enable; }
@@ -41,6 +53,7 @@ public:
 
 private:
     std::mutex m_log_lock;
+    char m_buffer[0x10000];     // Of the stream, which writes to the file once it's full
     std::ofstream m_logfile;
     bool m_enable;
 };
@@ -63,6 +76,7 @@ public:
     void RemoveListener(LogListener* listener);
 
     void Trigger(LogTypes::LOG_LEVELS, const char *msg);
+    void FlushListeners(std::set<LogListener*>& flushed);
 
     bool IsEnabled() const { return m_enable; }
     void SetEnable(bool enable) { m_enable = enable; }
@@ -83,6 +97,7 @@ private:
 };
 
 class ConsoleListener;
+struct LogRecord;
 
 class LogManager : NonCopyable
 {
@@ -93,8 +108,33 @@ private:
     DebuggerLogListener *m_debuggerLog;
     static LogManager *m_logManager;  // Singleton. Ugh.
 
+    // The logging threads only queue a record of the call, the logger thread formats the messages
+    // and hands them to the listeners
+    Common::MPSCQueue<LogRecord> m_queue;
+    Common::MPMCQueue<LogRecord*> m_free_records;   // Written records, for the next calls
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_sleeping;       // Whether the logger thread waits for records
+    std::mutex m_wake_lock;
+    std::condition_variable m_wake;
+    u32 m_last_flush;                   // Time the listeners were last flushed, in ms
+
+    // The binary log has the records as queued, for citra_logdump to format offline. Strings are
+    // written once, records refer to them by id.
+    std::mutex m_binary_lock;
+    File::IOFile m_binary_log;
+    std::unordered_map<const char*, u32> m_binary_ids;
+    std::vector<std::string> m_binary_strings;  // Indexed by id - 1, to catch reused buffers
+
     LogManager();
     ~LogManager();
+
+    void LoggerThread();
+    void Write(const LogRecord* record);
+    void WriteBinary(const LogRecord* record, u64 time_ms);
+    u32 GetBinaryId(const char* str);
+    void FlushListeners();
+    void UpdateLevel(LogTypes::LOG_TYPE type);
 public:
 
     static u32 GetMaxLevel() { return MAX_LOGLEVEL;    }
@@ -105,11 +145,13 @@ public:
     void SetLogLevel(LogTypes::LOG_TYPE type, LogTypes::LOG_LEVELS level)
     {
         m_Log[type]->SetLevel(level);
+        UpdateLevel(type);
     }
 
     void SetEnable(LogTypes::LOG_TYPE type, bool enable)
     {
         m_Log[type]->SetEnable(enable);
+        UpdateLevel(type);
     }
 
     bool IsEnabled(LogTypes::LOG_TYPE type) const
@@ -130,11 +172,13 @@ public:
     void AddListener(LogTypes::LOG_TYPE type, LogListener *listener)
     {
         m_Log[type]->AddListener(listener);
+        UpdateLevel(type);
     }
 
     void RemoveListener(LogTypes::LOG_TYPE type, LogListener *listener)
     {
         m_Log[type]->RemoveListener(listener);
+        UpdateLevel(type);
     }
 
     FileLogListener *GetFileListener() const
@@ -162,6 +206,13 @@ public:
         m_logManager = logManager;
     }
 
+    // Writes the records to a binary log instead of the text log file, false if it can't be
+    // created
+    bool OpenBinaryLog(const std::string& filename);
+
+    // Prints the messages of a binary log as the text log has them, false if it's broken
+    static bool DecodeBinaryLog(const std::string& filename, FILE* out);
+
     static void Init();
     static void Shutdown();
 };
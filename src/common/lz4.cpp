@@ -0,0 +1,222 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/lz4.h"
+
+namespace Common {
+
+namespace {
+
+enum {
+    MIN_MATCH       = 4,
+    LAST_LITERALS   = 5,        ///< The last bytes of a block are always literals
+    MATCH_LIMIT     = 12,       ///< No match starts in the last bytes of a block
+    MAX_OFFSET      = 0xFFFF,
+    HASH_BITS       = 12,
+};
+
+u32 Read32(const u8* p) {
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+u32 Hash(u32 sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * Writes the part of a length that doesn't fit its 4 bits of the token
+ * @param length Length minus what the token holds
+ * @param op Output position, advanced
+ * @param oend End of the output
+ * @return False if the output is full
+ */
+bool WriteLength(size_t length, u8*& op, u8* oend) {
+    for (; length >= 255; length -= 255) {
+        if (op == oend) {
+            return false;
+        }
+        *op++ = 255;
+    }
+    if (op == oend) {
+        return false;
+    }
+    *op++ = (u8)length;
+    return true;
+}
+
+/**
+ * Writes a sequence: literals, then a match unless it is the last sequence
+ * @param literals Literals
+ * @param num_literals Number of literals
+ * @param offset Distance of the match back from the end of the literals, 0 for the last sequence
+ * @param match_length Length of the match
+ * @param op Output position, advanced
+ * @param oend End of the output
+ * @return False if the output is full
+ */
+bool WriteSequence(const u8* literals, size_t num_literals, size_t offset, size_t match_length,
+    u8*& op, u8* oend) {
+
+    if (op == oend) {
+        return false;
+    }
+    u8* token = op++;
+    *token = (u8)(std::min<size_t>(num_literals, 15) << 4);
+    if (num_literals >= 15 && !WriteLength(num_literals - 15, op, oend)) {
+        return false;
+    }
+    if ((size_t)(oend - op) < num_literals) {
+        return false;
+    }
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+    if (offset == 0) {
+        return true;
+    }
+
+    if (oend - op < 2) {
+        return false;
+    }
+    *op++ = (u8)offset;
+    *op++ = (u8)(offset >> 8);
+    const size_t length = match_length - MIN_MATCH;
+    *token |= (u8)std::min<size_t>(length, 15);
+    return length < 15 || WriteLength(length - 15, op, oend);
+}
+
+} // namespace
+
+/**
+ * Compresses data to an LZ4 block, the raw format without frame. Compression is greedy with a
+ * single hash probe per position, trading ratio for speed like LZ4's fast mode.
+ * @param src Data to compress
+ * @param src_size Size of the data in bytes
+ * @param dst Receives the block
+ * @param dst_capacity Size of the buffer the block is written to in bytes
+ * @return Size of the block in bytes, 0 if it doesn't fit the buffer
+ */
+size_t LZ4Compress(const u8* src, size_t src_size, u8* dst, size_t dst_capacity) {
+    u8* op = dst;
+    u8* const oend = dst + dst_capacity;
+    size_t anchor = 0;
+
+    if (src_size > MATCH_LIMIT) {
+        // Positions plus one of the last sequence of each hash, 0 for none
+        std::vector<u32> table(1 << HASH_BITS, 0);
+        const size_t match_limit = src_size - MATCH_LIMIT;
+        const size_t match_end = src_size - LAST_LITERALS;
+
+        for (size_t ip = 0; ip <= match_limit;) {
+            const u32 sequence = Read32(src + ip);
+            u32& slot = table[Hash(sequence)];
+            const size_t candidate = slot;
+            slot = (u32)ip + 1;
+            if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET ||
+                Read32(src + candidate - 1) != sequence) {
+                ip++;
+                continue;
+            }
+
+            const size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (ip + length < match_end && src[match + length] == src[ip + length]) {
+                length++;
+            }
+            if (!WriteSequence(src + anchor, ip - anchor, ip - match, length, op, oend)) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    if (!WriteSequence(src + anchor, src_size - anchor, 0, 0, op, oend)) {
+        return 0;
+    }
+    return op - dst;
+}
+
+/**
+ * Decompresses an LZ4 block, checking that it neither reads nor writes out of bounds
+ * @param src Block
+ * @param src_size Size of the block in bytes
+ * @param dst Receives the data
+ * @param dst_size Size of the data in bytes, which the block must decompress to exactly
+ * @return True on success, false if the block is broken
+ */
+bool LZ4Decompress(const u8* src, size_t src_size, u8* dst, size_t dst_size) {
+    const u8* ip = src;
+    const u8* const iend = src + src_size;
+    u8* op = dst;
+    u8* const oend = dst + dst_size;
+
+    while (ip < iend) {
+        const u8 token = *ip++;
+
+        size_t num_literals = token >> 4;
+        if (num_literals == 15) {
+            u8 byte;
+            do {
+                if (ip == iend) {
+                    return false;
+                }
+                byte = *ip++;
+                num_literals += byte;
+            } while (byte == 255);
+        }
+        if (num_literals > (size_t)(iend - ip) || num_literals > (size_t)(oend - op)) {
+            return false;
+        }
+        memcpy(op, ip, num_literals);
+        ip += num_literals;
+        op += num_literals;
+        if (ip == iend) {
+            // The last sequence has no match
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        const size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return false;
+        }
+        size_t length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15) {
+            u8 byte;
+            do {
+                if (ip == iend) {
+                    return false;
+                }
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+        }
+        if (length > (size_t)(oend - op)) {
+            return false;
+        }
+        const u8* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // Overlaps the bytes it writes, meant to repeat them
+            for (size_t i = 0; i < length; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == oend;
+}
+
+} // namespace
@@ -0,0 +1,32 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Compresses data to an LZ4 block, the raw format without frame. Compression is greedy with a
+ * single hash probe per position, trading ratio for speed like LZ4's fast mode.
+ * @param src Data to compress
+ * @param src_size Size of the data in bytes
+ * @param dst Receives the block
+ * @param dst_capacity Size of the buffer the block is written to in bytes
+ * @return Size of the block in bytes, 0 if it doesn't fit the buffer
+ */
+size_t LZ4Compress(const u8* src, size_t src_size, u8* dst, size_t dst_capacity);
+
+/**
+ * Decompresses an LZ4 block, checking that it neither reads nor writes out of bounds
+ * @param src Block
+ * @param src_size Size of the block in bytes
+ * @param dst Receives the data
+ * @param dst_size Size of the data in bytes, which the block must decompress to exactly
+ * @return True on success, false if the block is broken
+ */
+bool LZ4Decompress(const u8* src, size_t src_size, u8* dst, size_t dst_size);
+
+} // namespace
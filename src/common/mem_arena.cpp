@@ -20,10 +20,15 @@
 #include "common/memory_util.h"
 #include "common/mem_arena.h"
 
+#include <algorithm>
+
 #ifndef _WIN32
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include <cerrno>
 #include <cstring>
 #ifdef ANDROID
@@ -130,6 +135,7 @@ size_t roundup(size_t x) {
 
 void MemArena::GrabLowMemSpace(size_t size)
 {
+    m_size = size;
 #ifdef _WIN32
 #ifndef _XBOX
     hMemoryMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)(size), NULL);
@@ -145,15 +151,24 @@ void MemArena::GrabLowMemSpace(size_t size)
         return;
     }
 #else
-    mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-    fd = open(ram_temp_file.c_str(), O_RDWR | O_CREAT, mode);
+#ifdef SYS_memfd_create
+    // Anonymous shared memory, which no other instance can open and which is never written back
+    // to a disk
+    fd = (int)syscall(SYS_memfd_create, "citra_ram", 0);
     if (fd < 0)
+#endif
     {
-        ERROR_LOG(MEMMAP, "Failed to grab memory space as a file: %s of size: %08x  errno: %d", ram_temp_file.c_str(), (int)size, (int)(errno));
-        return;
+        mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+        fd = open(ram_temp_file.c_str(), O_RDWR | O_CREAT, mode);
+        if (fd < 0)
+        {
+            ERROR_LOG(MEMMAP, "Failed to grab memory space as a file: %s of size: %08x  errno: %d", ram_temp_file.c_str(), (int)size, (int)(errno));
+            return;
+        }
+        // delete immediately, we keep the fd so it still lives
+        unlink(ram_temp_file.c_str());
     }
-    // delete immediately, we keep the fd so it still lives
-    unlink(ram_temp_file.c_str());
+    // The space is sparse, pages are only backed once touched
     if (ftruncate(fd, size) != 0)
     {
         ERROR_LOG(MEMMAP, "Failed to ftruncate %d to size %08x", (int)fd, (int)size);
@@ -223,6 +238,54 @@ void MemArena::ReleaseView(void* view, size_t size)
 #endif
 }
 
+bool MemArena::Decommit(void* view, size_t size)
+{
+#if defined(MADV_REMOVE) && !defined(ANDROID)
+    // Punches a hole in the space, every view of the range reads back zero
+    return madvise(view, size, MADV_REMOVE) == 0;
+#else
+    return false;
+#endif
+}
+
+
+bool MemArena::UseHugePages(void* view, size_t size)
+{
+#if defined(MADV_HUGEPAGE) && !defined(ANDROID)
+    // The arena is shared memory, which only gets transparent huge pages where the host allows
+    // them for shmem, otherwise the advice is taken and ignored
+    std::string setting;
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+    if (file == NULL)
+        return false;
+    char buffer[128];
+    if (fgets(buffer, sizeof(buffer), file) != NULL)
+        setting = buffer;
+    fclose(file);
+    if (setting.empty() || setting.find("[never]") != std::string::npos ||
+        setting.find("[deny]") != std::string::npos)
+        return false;
+    return madvise(view, size, MADV_HUGEPAGE) == 0;
+#else
+    // Large pages on Windows need SEC_LARGE_PAGES for the whole mapping and the lock memory
+    // privilege, views of the arena can't ask for them one by one
+    return false;
+#endif
+}
+
+
+size_t MemArena::GetCommittedSize() const
+{
+#if defined(_WIN32) || defined(__SYMBIAN32__) || defined(ANDROID)
+    return m_size;
+#else
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return m_size;
+    return std::min((size_t)st.st_blocks * 512, m_size);
+#endif
+}
+
 #ifndef __SYMBIAN32__
 u8* MemArena::Find4GBBase()
 {
@@ -233,9 +296,23 @@ u8* MemArena::Find4GBBase()
     VirtualFree(base, 0, MEM_RELEASE);
     return base;
 #else
-    // Very precarious - mmap cannot return an error when trying to map already used pages.
-    // This makes the Windows approach above unusable on Linux, so we will simply pray...
-    return reinterpret_cast<u8*>(0x2300000000ULL);
+    // Reserve the whole range up front so nothing else can end up in it. The views are later
+    // mapped over the reservation with MAP_FIXED, everything in between stays inaccessible so
+    // that stray accesses fault instead of touching random host memory.
+    void* base = mmap(0, 0x100000000ULL + HUGE_PAGE_SIZE, PROT_NONE,
+        MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        PanicAlert("Failed to reserve 4 GB of memory space: %s", strerror(errno));
+        return 0;
+    }
+    // Aligned to a huge page, so that views at huge page boundaries of the guest space can have
+    // them. The slack on either side goes back.
+    u8* aligned = (u8*)(((uintptr_t)base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned != base)
+        munmap(base, aligned - (u8*)base);
+    if (aligned - (u8*)base != HUGE_PAGE_SIZE)
+        munmap(aligned + 0x100000000ULL, HUGE_PAGE_SIZE - (aligned - (u8*)base));
+    return aligned;
 #endif
 
 #else // 32 bit
@@ -273,8 +350,15 @@ u8* MemArena::Find4GBBase()
 #endif
 #endif
 }
-#endif
 
+void MemArena::Release4GBBase(u8* base)
+{
+#if defined(_M_X64) && !defined(_WIN32)
+    if (base)
+        munmap(base, 0x100000000ULL);
+#endif
+}
+#endif
 
 // yeah, this could also be done in like two bitwise ops...
 #define SKIP(a_flags, b_flags) 
@@ -283,6 +367,11 @@ u8* MemArena::Find4GBBase()
 //	if (!(a_flags & MV_FAKE_VMEM) && (b_flags & MV_FAKE_VMEM)) 
 //		continue; 
 
+// Offset of the arena a view with MV_HUGE_PAGES is placed at
+static size_t AlignToHugePage(size_t position) {
+    return (position + MemArena::HUGE_PAGE_SIZE - 1) & ~(MemArena::HUGE_PAGE_SIZE - 1);
+}
+
 static bool Memory_TryBase(u8 *base, const MemoryView *views, int num_views, u32 flags, MemArena *arena) {
     // OK, we know where to find free space. Now grab it!
     // We just mimic the popular BAT setup.
@@ -313,6 +402,8 @@ static bool Memory_TryBase(u8 *base, const MemoryView *views, int num_views, u32
             position = last_position;
         }
         else {
+            if (view.flags & MV_HUGE_PAGES)
+                position = AlignToHugePage(position);
 #ifdef __SYMBIAN32__
             *(view.out_ptr_low) = (u8*)((int)arena->memmap->Base() + view.virtual_address);
             arena->memmap->Commit(view.virtual_address & 0x3FFFFFFF, view.size);
@@ -390,8 +481,12 @@ u8 *MemoryMap_Setup(const MemoryView *views, int num_views, u32 flags, MemArena
         if (views[i].size == 0)
             continue;
         SKIP(flags, views[i].flags);
-        if ((views[i].flags & MV_MIRROR_PREVIOUS) == 0)
+        if ((views[i].flags & MV_MIRROR_PREVIOUS) == 0) {
+            // Padded as Memory_TryBase places the views
+            if (views[i].flags & MV_HUGE_PAGES)
+                total_mem = AlignToHugePage(total_mem);
             total_mem += roundup(views[i].size);
+        }
     }
     // Grab some pagefile backed memory out of the void ...
 #ifndef __SYMBIAN32__
@@ -457,6 +552,34 @@ u8 *MemoryMap_Setup(const MemoryView *views, int num_views, u32 flags, MemArena
     return base;
 }
 
+s64 MemoryMap_GetOffset(const MemoryView *views, int num_views, u32 flags, const u8 *pointer)
+{
+    // Walks the views as Memory_TryBase places them
+    size_t position = 0;
+    size_t last_position = 0;
+    for (int i = 0; i < num_views; i++)
+    {
+        const MemoryView &view = views[i];
+        if (view.size == 0)
+            continue;
+        SKIP(flags, view.flags);
+        if (view.flags & MV_MIRROR_PREVIOUS)
+            position = last_position;
+        else if (view.flags & MV_HUGE_PAGES)
+            position = AlignToHugePage(position);
+
+        const u8 *views_of_it[2] = { view.out_ptr_low ? *view.out_ptr_low : NULL, *view.out_ptr };
+        for (int j = 0; j < 2; j++)
+        {
+            if (views_of_it[j] && pointer >= views_of_it[j] && pointer < views_of_it[j] + view.size)
+                return (s64)(position + (pointer - views_of_it[j]));
+        }
+        last_position = position;
+        position += roundup(view.size);
+    }
+    return -1;
+}
+
 void MemoryMap_Shutdown(const MemoryView *views, int num_views, u32 flags, MemArena *arena)
 {
     for (int i = 0; i < num_views; i++)
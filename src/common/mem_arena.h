@@ -39,14 +39,29 @@ public:
     void ReleaseSpace();
     void *CreateView(s64 offset, size_t size, void *base = 0);
     void ReleaseView(void *view, size_t size);
+    // Hands the pages of a range of a view back to the host, they read back as zero. Returns
+    // false if the host can't, the range is then left as it was.
+    bool Decommit(void *view, size_t size);
+    // Bytes of the space backed by host memory. The host backs pages as they're first touched,
+    // except on Windows, where the page file is charged for the whole space up front.
+    size_t GetCommittedSize() const;
+    size_t GetReservedSize() const { return m_size; }
+    // Asks the host to back a view with huge pages. Returns false if it can't, the view then
+    // keeps the normal pages.
+    static bool UseHugePages(void *view, size_t size);
+
+    static const size_t HUGE_PAGE_SIZE = 0x200000;
 
 #ifdef __SYMBIAN32__
     RChunk* memmap;
 #else
     // This only finds 1 GB in 32-bit
     static u8 *Find4GBBase();
+    // Gives back the address space reserved by Find4GBBase (64-bit POSIX only)
+    static void Release4GBBase(u8 *base);
 #endif
 private:
+    size_t m_size;
 
 #ifdef _WIN32
     HANDLE hMemoryMapping;
@@ -62,6 +77,8 @@ enum {
     MV_IS_PRIMARY_RAM = 0x100,
     MV_IS_EXTRA1_RAM = 0x200,
     MV_IS_EXTRA2_RAM = 0x400,
+    // Placed at a huge page boundary of the arena, for MemArena::UseHugePages
+    MV_HUGE_PAGES = 0x800,
 };
 
 struct MemoryView
@@ -76,6 +93,9 @@ struct MemoryView
 // Uses a memory arena to set up an emulator-friendly memory map according to
 // a passed-in list of MemoryView structures.
 u8 *MemoryMap_Setup(const MemoryView *views, int num_views, u32 flags, MemArena *arena);
+// Gets the offset in the arena of host memory in one of the views MemoryMap_Setup created, for
+// MemArena::CreateView to map it again elsewhere. Returns -1 if the pointer is in none of them.
+s64 MemoryMap_GetOffset(const MemoryView *views, int num_views, u32 flags, const u8 *pointer);
 void MemoryMap_Shutdown(const MemoryView *views, int num_views, u32 flags, MemArena *arena);
 
 #endif // _MEMARENA_H_
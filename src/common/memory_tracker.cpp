@@ -0,0 +1,151 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <atomic>
+
+#include "common/common.h"
+#include "common/memory_tracker.h"
+
+namespace Common {
+namespace MemoryTracker {
+
+namespace {
+
+/// Usage of a tag as it's counted, zero before any static constructor reports to it
+struct Counters {
+    std::atomic<s64> bytes;
+    std::atomic<u64> peak;
+    std::atomic<s64> count;
+};
+
+const char* const kTagNames[NUM_TAGS] = {
+    "guest_memory",
+    "kernel_objects",
+    "jit_code",
+    "texture_cache",
+    "surface_cache",
+    "shader_cache",
+    "debugger_history",
+    "log_buffers",
+};
+
+Counters g_counters[NUM_TAGS];
+
+/// Budgets until the settings set them, 0 for tags without one or only bound by their owner
+std::atomic<u64> g_budgets[NUM_TAGS] = {
+    {0},
+    {0},
+    {0},                    // The code space of the JIT
+    {64 * 1024 * 1024},
+    {256 * 1024 * 1024},
+    {0},                    // The code space of the shader JIT
+    {0},
+    {0},
+};
+
+/**
+ * Raises the high-water mark of a tag
+ * @param counters Counters of the tag
+ * @param bytes Bytes the tag uses now
+ */
+void RaisePeak(Counters& counters, s64 bytes) {
+    u64 peak = counters.peak.load(std::memory_order_relaxed);
+    while (bytes > 0 && (u64)bytes > peak &&
+        !counters.peak.compare_exchange_weak(peak, (u64)bytes, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+/**
+ * Gets the name of a tag
+ * @param tag Tag to get the name of
+ * @return Name of the tag, e.g. "texture_cache"
+ */
+const char* GetTagName(Tag tag) {
+    return kTagNames[tag];
+}
+
+/**
+ * Adds to the usage of a tag, raising its high-water mark
+ * @param tag Tag of the memory
+ * @param bytes Bytes allocated, negative for bytes freed
+ * @param count Allocations made, negative for allocations freed
+ */
+void Adjust(Tag tag, s64 bytes, s64 count) {
+    Counters& counters = g_counters[tag];
+    const s64 now = counters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    counters.count.fetch_add(count, std::memory_order_relaxed);
+    RaisePeak(counters, now);
+}
+
+/**
+ * Sets the usage of a sampled tag, one whose memory the host backs without telling
+ * @param tag Tag of the memory
+ * @param bytes Bytes used now
+ */
+void SetUsage(Tag tag, u64 bytes) {
+    Counters& counters = g_counters[tag];
+    counters.bytes.store((s64)bytes, std::memory_order_relaxed);
+    RaisePeak(counters, (s64)bytes);
+}
+
+/**
+ * Gets the usage of a tag
+ * @param tag Tag to get the usage of
+ * @return Usage of the tag, with its budget
+ */
+Usage GetUsage(Tag tag) {
+    const Counters& counters = g_counters[tag];
+    const s64 bytes = counters.bytes.load(std::memory_order_relaxed);
+    Usage usage;
+    usage.bytes = bytes > 0 ? (u64)bytes : 0;
+    usage.peak = counters.peak.load(std::memory_order_relaxed);
+    usage.count = counters.count.load(std::memory_order_relaxed);
+    usage.budget = g_budgets[tag].load(std::memory_order_relaxed);
+    return usage;
+}
+
+/**
+ * Whether a tag has a budget its owner evicts to, the others are only accounted
+ * @param tag Tag
+ */
+bool HasBudget(Tag tag) {
+    return tag == TAG_JIT_CODE || tag == TAG_TEXTURE_CACHE || tag == TAG_SURFACE_CACHE ||
+        tag == TAG_SHADER_CACHE;
+}
+
+/**
+ * Gets the budget of a tag
+ * @param tag Tag
+ * @return Bytes the owner of the tag evicts beyond, 0 for no budget
+ */
+u64 GetBudget(Tag tag) {
+    return g_budgets[tag].load(std::memory_order_relaxed);
+}
+
+/**
+ * Sets the budget of a tag, which takes effect the next time its owner allocates
+ * @param tag Tag, one HasBudget is true of
+ * @param bytes Bytes the owner evicts beyond, 0 for no budget
+ */
+void SetBudget(Tag tag, u64 bytes) {
+    _dbg_assert_(COMMON, HasBudget(tag));
+    g_budgets[tag].store(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * Whether a tag uses more than its budget
+ * @param tag Tag
+ * @param extra Bytes about to be allocated, counted as used
+ */
+bool IsOverBudget(Tag tag, size_t extra) {
+    const Counters& counters = g_counters[tag];
+    const u64 budget = g_budgets[tag].load(std::memory_order_relaxed);
+    const s64 bytes = counters.bytes.load(std::memory_order_relaxed) + (s64)extra;
+    return budget != 0 && bytes > 0 && (u64)bytes > budget;
+}
+
+} // namespace
+} // namespace
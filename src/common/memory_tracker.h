@@ -0,0 +1,105 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Host memory used by the subsystems of the emulator, by tag. Owners report what they allocate
+ * and free, or the size they're at for memory the host backs on its own, and the tracker keeps
+ * the bytes, the number of allocations and the high-water mark of every tag. Caches also read
+ * their budget here, and evict once they're over it. Counts are atomic, any thread may report.
+ */
+namespace Common {
+namespace MemoryTracker {
+
+enum Tag {
+    TAG_GUEST_MEMORY,       ///< Guest memory backed by host memory, sampled
+    TAG_KERNEL_OBJECTS,     ///< HLE kernel objects
+    TAG_JIT_CODE,           ///< Translated ARM code
+    TAG_TEXTURE_CACHE,      ///< Decoded texels of the texture cache
+    TAG_SURFACE_CACHE,      ///< Host GPU framebuffers of the hardware rasterizer
+    TAG_SHADER_CACHE,       ///< Compiled vertex shaders and host GPU programs
+    TAG_DEBUGGER_HISTORY,   ///< GX command history of the GPU debugger
+    TAG_LOG_BUFFERS,        ///< Queued log records and listener buffers
+    NUM_TAGS,
+};
+
+/// Usage of a tag
+struct Usage {
+    u64 bytes;
+    u64 peak;       ///< Most bytes ever used at once
+    s64 count;      ///< Allocations alive, 0 for sampled tags
+    u64 budget;     ///< Bytes the tag evicts beyond, 0 for no budget
+};
+
+/**
+ * Gets the name of a tag
+ * @param tag Tag to get the name of
+ * @return Name of the tag, e.g. "texture_cache"
+ */
+const char* GetTagName(Tag tag);
+
+/**
+ * Adds to the usage of a tag, raising its high-water mark
+ * @param tag Tag of the memory
+ * @param bytes Bytes allocated, negative for bytes freed
+ * @param count Allocations made, negative for allocations freed
+ */
+void Adjust(Tag tag, s64 bytes, s64 count);
+
+/// Reports an allocation of a tag
+inline void Allocate(Tag tag, size_t size) {
+    Adjust(tag, (s64)size, 1);
+}
+
+/// Reports the free of an allocation of a tag
+inline void Free(Tag tag, size_t size) {
+    Adjust(tag, -(s64)size, -1);
+}
+
+/**
+ * Sets the usage of a sampled tag, one whose memory the host backs without telling
+ * @param tag Tag of the memory
+ * @param bytes Bytes used now
+ */
+void SetUsage(Tag tag, u64 bytes);
+
+/**
+ * Gets the usage of a tag
+ * @param tag Tag to get the usage of
+ * @return Usage of the tag, with its budget
+ */
+Usage GetUsage(Tag tag);
+
+/**
+ * Whether a tag has a budget its owner evicts to, the others are only accounted
+ * @param tag Tag
+ */
+bool HasBudget(Tag tag);
+
+/**
+ * Gets the budget of a tag
+ * @param tag Tag
+ * @return Bytes the owner of the tag evicts beyond, 0 for no budget
+ */
+u64 GetBudget(Tag tag);
+
+/**
+ * Sets the budget of a tag, which takes effect the next time its owner allocates
+ * @param tag Tag, one HasBudget is true of
+ * @param bytes Bytes the owner evicts beyond, 0 for no budget
+ */
+void SetBudget(Tag tag, u64 bytes);
+
+/**
+ * Whether a tag uses more than its budget
+ * @param tag Tag
+ * @param extra Bytes about to be allocated, counted as used
+ */
+bool IsOverBudget(Tag tag, size_t extra = 0);
+
+} // namespace
+} // namespace
@@ -0,0 +1,187 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Bounded lock-free queue with any number of producers and consumers (D. Vyukov's design). The
+ * cells are allocated once, by the constructor. Each cell has a sequence number telling which lap
+ * of the ring may use it next and whether it holds an element: producers and consumers claim an
+ * index with a compare-and-swap, then hand the cell over by bumping its sequence number. The
+ * batched calls claim a run of consecutive indices with a single compare-and-swap.
+ * @tparam T Element type, default constructible and movable
+ */
+template <typename T>
+class MPMCQueue : NonCopyable {
+public:
+    /**
+     * Allocates the cells
+     * @param capacity Number of elements the queue holds, rounded up to a power of two
+     */
+    explicit MPMCQueue(size_t capacity) : m_enqueue_pos(0), m_dequeue_pos(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// Gets the number of elements the queue holds
+    size_t Capacity() const {
+        return m_mask + 1;
+    }
+
+    /**
+     * Appends an element, from any thread
+     * @param element Element to append, moved from on success
+     * @return False if the queue is full
+     */
+    bool Push(T&& element) {
+        size_t pos;
+        if (Claim(m_enqueue_pos, 0, 1, pos) == 0) {
+            return false;
+        }
+        Cell& cell = m_cells[pos & m_mask];
+        cell.data = std::move(element);
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @see Push
+    bool Push(const T& element) {
+        T copy(element);
+        return Push(std::move(copy));
+    }
+
+    /**
+     * Appends as many elements of an array as there are free cells for, from any thread. The
+     * elements are consecutive in the queue.
+     * @param elements Elements to append, copied
+     * @param count Number of elements
+     * @return Number of elements appended, from the start of the array
+     */
+    size_t PushBatch(const T* elements, size_t count) {
+        size_t pos;
+        count = Claim(m_enqueue_pos, 0, count, pos);
+        for (size_t i = 0; i < count; i++) {
+            Cell& cell = m_cells[(pos + i) & m_mask];
+            cell.data = elements[i];
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /**
+     * Takes the oldest element, from any thread
+     * @param element Receives the element
+     * @return False if the queue is empty
+     */
+    bool Pop(T& element) {
+        size_t pos;
+        if (Claim(m_dequeue_pos, 1, 1, pos) == 0) {
+            return false;
+        }
+        Cell& cell = m_cells[pos & m_mask];
+        element = std::move(cell.data);
+        cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes up to a number of consecutive elements, from any thread
+     * @param elements Receives the elements, oldest first
+     * @param max_count Number of elements the array holds
+     * @return Number of elements taken
+     */
+    size_t PopBatch(T* elements, size_t max_count) {
+        size_t pos;
+        const size_t count = Claim(m_dequeue_pos, 1, max_count, pos);
+        for (size_t i = 0; i < count; i++) {
+            Cell& cell = m_cells[(pos + i) & m_mask];
+            elements[i] = std::move(cell.data);
+            cell.sequence.store(pos + i + m_mask + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// Whether the queue looks empty, only a hint while other threads push or pop
+    bool Empty() const {
+        const size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        return m_cells[pos & m_mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+private:
+    enum {
+        CACHE_LINE  = 64,
+    };
+
+    struct Cell {
+        std::atomic<size_t> sequence;   ///< Index the cell is ready for, plus one once written
+        T                   data;
+    };
+
+    /**
+     * Claims a run of consecutive indices whose cells are ready, the cell of index i being ready
+     * when its sequence number is i plus an offset
+     * @param position Next index to claim, of the producers or of the consumers
+     * @param offset 0 to claim cells to write, 1 to claim cells to read
+     * @param max_count Largest number of indices to claim
+     * @param first Receives the first index claimed
+     * @return Number of indices claimed, 0 if the first cell isn't ready
+     */
+    size_t Claim(std::atomic<size_t>& position, size_t offset, size_t max_count, size_t& first) {
+        if (max_count == 0) {
+            return 0;
+        }
+        size_t pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t count = 0;
+            while (count < max_count) {
+                const size_t index = pos + count;
+                const size_t sequence = m_cells[index & m_mask].sequence.load(
+                    std::memory_order_acquire);
+                if (sequence != index + offset) {
+                    break;
+                }
+                count++;
+            }
+            if (count == 0) {
+                // A cell from a lap behind: full or empty. Otherwise the index is gone already.
+                const size_t index = pos;
+                const size_t sequence = m_cells[index & m_mask].sequence.load(
+                    std::memory_order_acquire);
+                if ((ptrdiff_t)(sequence - (index + offset)) < 0) {
+                    return 0;
+                }
+                pos = position.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (position.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                first = pos;
+                return count;
+            }
+        }
+    }
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t                  m_mask;
+    u8                      m_pad0[CACHE_LINE];
+    std::atomic<size_t>     m_enqueue_pos;  ///< Next index pushed, shared by the producers
+    u8                      m_pad1[CACHE_LINE];
+    std::atomic<size_t>     m_dequeue_pos;  ///< Next index popped, shared by the consumers
+    u8                      m_pad2[CACHE_LINE];
+};
+
+} // namespace
@@ -0,0 +1,87 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+
+#include "common/common.h"
+
+namespace Common {
+
+/// Link of an element of an MPSCQueue, elements derive from it
+struct MPSCQueueNode {
+    std::atomic<MPSCQueueNode*> mpsc_next;
+};
+
+/**
+ * Intrusive lock-free queue with any number of producers and a single consumer (D. Vyukov's
+ * design). Push is wait-free, a single atomic exchange. Pop may see the queue empty while a push is
+ * in progress, Empty tells the consumer whether something is still on its way.
+ * @tparam T Element type, derived from MPSCQueueNode
+ */
+template <typename T>
+class MPSCQueue : NonCopyable {
+public:
+    MPSCQueue() : m_head(&m_stub), m_tail(&m_stub) {
+        m_stub.mpsc_next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    /**
+     * Appends an element, from any thread. The queue links it until it is popped.
+     * @param element Element to append
+     */
+    void Push(T* element) {
+        PushNode(element);
+    }
+
+    /**
+     * Takes the oldest element, from the consumer thread only
+     * @return Element, nullptr if there is none or the next one is still being pushed
+     */
+    T* Pop() {
+        MPSCQueueNode* tail = m_tail;
+        MPSCQueueNode* next = tail->mpsc_next.load(std::memory_order_acquire);
+        if (tail == &m_stub) {
+            if (next == nullptr) {
+                return nullptr;
+            }
+            m_tail = tail = next;
+            next = next->mpsc_next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            m_tail = next;
+            return static_cast<T*>(tail);
+        }
+        if (tail != m_head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        // Last element, the stub takes its place before it can be handed out
+        PushNode(&m_stub);
+        next = tail->mpsc_next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            m_tail = next;
+            return static_cast<T*>(tail);
+        }
+        return nullptr;
+    }
+
+    /// Whether nothing was pushed that wasn't popped yet, from the consumer thread only
+    bool Empty() const {
+        return m_tail == &m_stub && m_head.load(std::memory_order_acquire) == &m_stub;
+    }
+
+private:
+    void PushNode(MPSCQueueNode* node) {
+        node->mpsc_next.store(nullptr, std::memory_order_relaxed);
+        MPSCQueueNode* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->mpsc_next.store(node, std::memory_order_release);
+    }
+
+    std::atomic<MPSCQueueNode*> m_head;     ///< Last element pushed, producers swap it
+    MPSCQueueNode*              m_tail;     ///< Oldest element, owned by the consumer
+    MPSCQueueNode               m_stub;     ///< Placeholder keeping the list non-empty
+};
+
+} // namespace
@@ -0,0 +1,218 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <mutex>
+
+#include "common/log.h"
+#include "common/perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace Common {
+namespace PerfCounters {
+
+std::atomic<bool> g_enabled(false);
+
+namespace {
+
+/// Regions by registration order
+struct Registry {
+    std::mutex              lock;
+    std::vector<Region*>    regions;
+};
+
+/// Registry made on first use, regions being registered by static constructors
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+#ifdef __linux__
+
+enum {
+    GROUP_UNOPENED  = -2,   ///< The thread didn't open its group yet
+    GROUP_FAILED    = -1,   ///< The host refused the group of the thread
+};
+
+/// Perf event of every Event
+const u64 kPerfEvents[NUM_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+/// Group of the counters of the thread, its file descriptors live as long as the thread
+THREAD_LOCAL int t_group = GROUP_UNOPENED;
+/// Position of every event in the values read from the group, -1 if the host lacks the event
+THREAD_LOCAL int t_positions[NUM_EVENTS];
+THREAD_LOCAL int t_num_opened = 0;
+
+/**
+ * Opens a counter of the calling thread, counting user mode only
+ * @param event Perf event to count
+ * @param group File descriptor of the group leader, -1 to open the leader
+ * @return File descriptor of the counter, -1 on failure
+ */
+int OpenCounter(u64 event, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = event;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * Opens the group of the calling thread. Cycles lead it, events the host lacks are left out.
+ * @return True on success
+ */
+bool OpenGroup() {
+    t_group = OpenCounter(kPerfEvents[CYCLES], -1);
+    if (t_group < 0) {
+        t_group = GROUP_FAILED;
+        return false;
+    }
+    t_positions[CYCLES] = 0;
+    t_num_opened = 1;
+    for (int i = CYCLES + 1; i < NUM_EVENTS; i++) {
+        t_positions[i] = OpenCounter(kPerfEvents[i], t_group) >= 0 ? t_num_opened++ : -1;
+    }
+    return true;
+}
+
+#endif
+
+} // namespace
+
+/**
+ * Gets the name of an event
+ * @param event Event to get the name of
+ * @return Name of the event, e.g. "cycles"
+ */
+const char* GetEventName(Event event) {
+    switch (event) {
+    case CYCLES:        return "cycles";
+    case INSTRUCTIONS:  return "instructions";
+    case CACHE_MISSES:  return "cache_misses";
+    case BRANCH_MISSES: return "branch_misses";
+    default:            return "unknown";
+    }
+}
+
+/**
+ * Starts counting, if the host lets the calling thread open the counters
+ * @return True on success, false if the host has no counters or doesn't grant them
+ */
+bool Enable() {
+#ifdef __linux__
+    u64 counts[NUM_EVENTS];
+    if (!ReadCounters(counts)) {
+        ERROR_LOG(COMMON, "Couldn't open the performance counters, check "
+            "/proc/sys/kernel/perf_event_paranoid");
+        return false;
+    }
+    g_enabled = true;
+    return true;
+#else
+    // Windows only hands PMU counters to ETW kernel sessions, which need an elevated process
+    ERROR_LOG(COMMON, "Performance counters aren't supported on this host");
+    return false;
+#endif
+}
+
+/// Stops counting, the totals are kept
+void Disable() {
+    g_enabled = false;
+}
+
+Region::Region(const char* name) : m_name(name), m_scopes(0) {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        m_totals[i] = 0;
+    }
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    registry.regions.push_back(this);
+}
+
+/// Adds the counts of a scope to the totals of the region
+void Region::Add(const u64 counts[NUM_EVENTS]) {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        m_totals[i].fetch_add(counts[i], std::memory_order_relaxed);
+    }
+    m_scopes.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Gets the totals of the region
+ * @param counts Receives the totals of every event
+ * @return Number of scopes counted
+ */
+u64 Region::GetTotals(u64 counts[NUM_EVENTS]) const {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        counts[i] = m_totals[i].load(std::memory_order_relaxed);
+    }
+    return m_scopes.load(std::memory_order_relaxed);
+}
+
+/**
+ * Reads the counters of the calling thread, use Scope instead
+ * @param counts Receives the count of every event, those the host lacks read 0
+ * @return True on success, false if the thread has no counters
+ */
+bool ReadCounters(u64 counts[NUM_EVENTS]) {
+#ifdef __linux__
+    if (t_group == GROUP_UNOPENED && !OpenGroup()) {
+        return false;
+    }
+    if (t_group == GROUP_FAILED) {
+        return false;
+    }
+    // Read as the number of counters followed by their values
+    u64 values[1 + NUM_EVENTS];
+    const ssize_t size = (1 + t_num_opened) * sizeof(u64);
+    if (read(t_group, values, size) != size) {
+        return false;
+    }
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        counts[i] = t_positions[i] >= 0 ? values[1 + t_positions[i]] : 0;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Gets the totals of all regions
+ * @param regions Receives the totals, in the order the regions were registered
+ * @note This function is thread-safe
+ */
+void GetRegions(std::vector<RegionStats>& regions) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    regions.resize(registry.regions.size());
+    for (size_t i = 0; i < registry.regions.size(); i++) {
+        regions[i].name = registry.regions[i]->GetName();
+        regions[i].scopes = registry.regions[i]->GetTotals(regions[i].counts);
+    }
+}
+
+} // namespace
+} // namespace
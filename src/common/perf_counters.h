@@ -0,0 +1,121 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+/**
+ * Host performance counters around named regions of the emulator. While enabled, each scope reads
+ * the cycles, instructions, cache misses and branch mispredicts the calling thread has run up at
+ * its start and end, and adds the difference to the totals of its region. A region that misses a
+ * lot per instruction is bound by its data layout, one that doesn't by its computation.
+ *
+ * Counters are read through perf_event_open on Linux, a group per thread opened by its first
+ * scope. Reading them costs two system calls per scope, regions go around work of a few
+ * microseconds at least. Scopes nested in another region are counted in both.
+ */
+namespace Common {
+namespace PerfCounters {
+
+enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_MISSES,
+    BRANCH_MISSES,
+    NUM_EVENTS,
+};
+
+extern std::atomic<bool> g_enabled;     ///< Whether scopes read the counters, off by default
+
+/**
+ * Gets the name of an event
+ * @param event Event to get the name of
+ * @return Name of the event, e.g. "cycles"
+ */
+const char* GetEventName(Event event);
+
+/**
+ * Starts counting, if the host lets the calling thread open the counters
+ * @return True on success, false if the host has no counters or doesn't grant them
+ */
+bool Enable();
+
+/// Stops counting, the totals are kept
+void Disable();
+
+/// Region registered at startup, at namespace scope next to the code it counts
+class Region : NonCopyable {
+public:
+    explicit Region(const char* name);
+
+    const std::string& GetName() const {
+        return m_name;
+    }
+
+    /// Adds the counts of a scope to the totals of the region
+    void Add(const u64 counts[NUM_EVENTS]);
+
+    /**
+     * Gets the totals of the region
+     * @param counts Receives the totals of every event
+     * @return Number of scopes counted
+     */
+    u64 GetTotals(u64 counts[NUM_EVENTS]) const;
+
+private:
+    std::string             m_name;
+    std::atomic<u64>        m_totals[NUM_EVENTS];
+    std::atomic<u64>        m_scopes;
+};
+
+/**
+ * Reads the counters of the calling thread, use Scope instead
+ * @param counts Receives the count of every event, those the host lacks read 0
+ * @return True on success, false if the thread has no counters
+ */
+bool ReadCounters(u64 counts[NUM_EVENTS]);
+
+/// Counts its lifetime under a region, costing a relaxed load while counting is disabled
+class Scope : NonCopyable {
+public:
+    explicit Scope(Region& region) : m_region(region),
+        m_active(g_enabled.load(std::memory_order_relaxed) && ReadCounters(m_start)) {}
+
+    ~Scope() {
+        u64 end[NUM_EVENTS];
+        if (m_active && ReadCounters(end)) {
+            for (int i = 0; i < NUM_EVENTS; i++) {
+                end[i] -= m_start[i];
+            }
+            m_region.Add(end);
+        }
+    }
+
+private:
+    Region& m_region;
+    u64     m_start[NUM_EVENTS];
+    bool    m_active;   ///< Whether the scope read the counters at its start
+};
+
+/// Totals of a region
+struct RegionStats {
+    std::string name;
+    u64         counts[NUM_EVENTS];
+    u64         scopes;
+};
+
+/**
+ * Gets the totals of all regions
+ * @param regions Receives the totals, in the order the regions were registered
+ * @note This function is thread-safe
+ */
+void GetRegions(std::vector<RegionStats>& regions);
+
+} // namespace
+} // namespace
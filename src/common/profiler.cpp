@@ -0,0 +1,339 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "common/file_util.h"
+#include "common/log.h"
+#include "common/profiler.h"
+#include "common/spsc_queue.h"
+#include "common/thread.h"
+#include "common/timer.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace Common {
+namespace Profiler {
+
+namespace {
+
+enum {
+    RING_SIZE           = 0x4000,       ///< Scopes a thread can record between two frames
+    MAX_DEPTH           = 32,           ///< Deeper scopes aren't recorded
+    MAX_CAPTURED        = 0x200000,     ///< Scopes a trace holds, later ones are dropped
+    DRAIN_BATCH         = 0x100,
+};
+
+/// Scope recorded by a thread
+struct Event {
+    u64 begin_ns;
+    u64 end_ns;
+    u16 category;
+    s16 parent;                         ///< Category of the enclosing scope, -1 if none
+};
+
+/// Scope of a trace
+struct CapturedEvent {
+    u64 begin_ns;
+    u64 end_ns;
+    u16 category;
+    u16 thread;
+};
+
+/// Recording state of a thread, created the first time it opens a scope
+struct ThreadBuffer {
+    explicit ThreadBuffer(int index) : events(RING_SIZE), index(index), depth(0) {}
+
+    SPSCQueue<Event>    events;         ///< The thread pushes, EndFrame pops
+    int                 index;          ///< Thread number in traces
+    int                 depth;          ///< Scopes open, including those too deep to record
+    int                 categories[MAX_DEPTH];
+    u64                 begin_ns[MAX_DEPTH];
+};
+
+/// Names of the categories by ID
+struct Registry {
+    Registry() {
+        names.push_back("Other");
+    }
+
+    std::mutex                  lock;
+    std::vector<std::string>    names;
+};
+
+/// Registry made on first use, categories being registered by static constructors
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+THREAD_LOCAL ThreadBuffer* t_buffer = nullptr;
+
+std::mutex                                  g_buffers_lock;
+std::vector<std::unique_ptr<ThreadBuffer>>  g_buffers;          ///< Never freed, by g_buffers_lock
+std::atomic<u64>                            g_dropped(0);
+
+u64                                         g_frame_end_ns = 0; ///< Of the emulation thread
+
+std::mutex                                  g_report_lock;
+FrameReport                                 g_report;           ///< Guarded by g_report_lock
+
+std::mutex                                  g_capture_lock;     ///< Guards the trace state
+std::atomic<bool>                           g_capturing(false);
+u64                                         g_capture_start_ns = 0;
+std::vector<CapturedEvent>                  g_captured;
+
+/// Creates the buffer of the calling thread
+ThreadBuffer* CreateThreadBuffer() {
+    std::lock_guard<std::mutex> lock(g_buffers_lock);
+    g_buffers.emplace_back(new ThreadBuffer((int)g_buffers.size()));
+    t_buffer = g_buffers.back().get();
+    return t_buffer;
+}
+
+/**
+ * Appends a string to a JSON document as a string literal
+ * @param out Document
+ * @param str String
+ */
+void AppendJSONString(std::string& out, const std::string& str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((u8)c < 0x20) {
+            char escaped[8];
+            sprintf(escaped, "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+std::atomic<bool> g_enabled(false);
+
+/**
+ * Registers a category, or gets the one already registered under the name
+ * @param name Name shown in the reports
+ * @return ID of the category
+ * @note This function is thread-safe
+ */
+int RegisterCategory(const std::string& name) {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.lock);
+    auto it = std::find(registry.names.begin(), registry.names.end(), name);
+    if (it != registry.names.end()) {
+        return (int)(it - registry.names.begin());
+    }
+    if (registry.names.size() == MAX_CATEGORIES) {
+        return OTHER_CATEGORY;
+    }
+    registry.names.push_back(name);
+    return (int)registry.names.size() - 1;
+}
+
+/**
+ * Opens a scope on the calling thread, use Scope instead
+ * @param category ID of the category of the scope
+ */
+void BeginScope(int category) {
+    ThreadBuffer* buffer = t_buffer;
+    if (buffer == nullptr) {
+        buffer = CreateThreadBuffer();
+    }
+    const int depth = buffer->depth++;
+    if (depth < MAX_DEPTH) {
+        buffer->categories[depth] = category;
+        buffer->begin_ns[depth] = Timer::GetTimeNs();
+    }
+}
+
+/// Closes the innermost scope of the calling thread, use Scope instead
+void EndScope() {
+    ThreadBuffer* buffer = t_buffer;
+    const int depth = --buffer->depth;
+    if (depth >= MAX_DEPTH) {
+        return;
+    }
+    Event event;
+    event.begin_ns = buffer->begin_ns[depth];
+    event.end_ns = Timer::GetTimeNs();
+    event.category = (u16)buffer->categories[depth];
+    event.parent = depth > 0 ? (s16)buffer->categories[depth - 1] : -1;
+    if (!buffer->events.Push(event)) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/// Drains the rings into the report of the frame and the trace, called once per frame
+void EndFrame() {
+    struct Totals {
+        u64 total_ns;
+        s64 self_ns;        ///< Scopes nested in others can be drained a frame before them
+        u32 calls;
+        int parent;
+    };
+    Totals totals[MAX_CATEGORIES];
+    memset(totals, 0, sizeof(totals));
+
+    std::vector<ThreadBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_buffers_lock);
+        for (const auto& buffer : g_buffers) {
+            buffers.push_back(buffer.get());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_capture_lock);
+        const bool capturing = g_capturing.load(std::memory_order_relaxed);
+        Event events[DRAIN_BATCH];
+        for (ThreadBuffer* buffer : buffers) {
+            size_t count;
+            while ((count = buffer->events.PopBatch(events, DRAIN_BATCH)) != 0) {
+                for (size_t i = 0; i < count; i++) {
+                    const Event& event = events[i];
+                    const u64 duration = event.end_ns - event.begin_ns;
+                    Totals& category = totals[event.category];
+                    category.total_ns += duration;
+                    category.self_ns += duration;
+                    category.calls++;
+                    category.parent = event.parent;
+                    if (event.parent >= 0) {
+                        totals[event.parent].self_ns -= duration;
+                    }
+                    if (capturing && event.begin_ns >= g_capture_start_ns) {
+                        if (g_captured.size() < MAX_CAPTURED) {
+                            const CapturedEvent captured = { event.begin_ns, event.end_ns,
+                                event.category, (u16)buffer->index };
+                            g_captured.push_back(captured);
+                        } else {
+                            g_dropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    FrameReport report;
+    const u64 now = Timer::GetTimeNs();
+    report.frame_ns = g_frame_end_ns != 0 ? now - g_frame_end_ns : 0;
+    report.dropped = g_dropped.load(std::memory_order_relaxed);
+    g_frame_end_ns = now;
+    {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.lock);
+        for (int i = 0; i < (int)registry.names.size(); i++) {
+            const Totals& category = totals[i];
+            if (category.calls == 0) {
+                continue;
+            }
+            CategoryStats stats;
+            stats.id = i;
+            stats.parent = category.parent;
+            stats.name = registry.names[i];
+            stats.total_ns = category.total_ns;
+            stats.self_ns = (u64)std::max<s64>(category.self_ns, 0);
+            stats.calls = category.calls;
+            report.categories.push_back(std::move(stats));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(g_report_lock);
+    std::swap(g_report, report);
+}
+
+/**
+ * Gets the report of the last frame
+ * @param report Receives the report
+ * @note This function is thread-safe
+ */
+void GetLastFrame(FrameReport& report) {
+    std::lock_guard<std::mutex> lock(g_report_lock);
+    report = g_report;
+}
+
+/**
+ * Starts capturing a trace of the scopes, dropping any trace captured but not written
+ * @note This function is thread-safe
+ */
+void StartCapture() {
+    std::lock_guard<std::mutex> lock(g_capture_lock);
+    g_captured.clear();
+    g_capture_start_ns = Timer::GetTimeNs();
+    g_capturing.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * Stops capturing the trace and writes it out
+ * @param filename Path of the trace file, empty to drop the trace
+ * @return True on success
+ * @note This function is thread-safe
+ */
+bool StopCapture(const std::string& filename) {
+    std::vector<CapturedEvent> captured;
+    u64 start_ns;
+    {
+        std::lock_guard<std::mutex> lock(g_capture_lock);
+        g_capturing.store(false, std::memory_order_relaxed);
+        captured.swap(g_captured);
+        start_ns = g_capture_start_ns;
+    }
+    std::vector<std::string> names;
+    {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.lock);
+        names = registry.names;
+    }
+    if (filename.empty()) {
+        return true;
+    }
+
+    File::IOFile file(filename, "w");
+    std::string json = "{\"traceEvents\":[\n";
+    bool ok = file.IsOpen();
+    char buffer[128];
+    for (size_t i = 0; ok && i < captured.size(); i++) {
+        const CapturedEvent& event = captured[i];
+        json += "{\"name\":";
+        AppendJSONString(json, names[event.category]);
+        sprintf(buffer, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+            (u32)event.thread, (event.begin_ns - start_ns) / 1000.0,
+            (event.end_ns - event.begin_ns) / 1000.0, i + 1 < captured.size() ? "," : "");
+        json += buffer;
+        // Written out in pieces, a trace can run into hundreds of megabytes
+        if (json.size() >= 0x10000) {
+            ok = file.WriteBytes(json.data(), json.size());
+            json.clear();
+        }
+    }
+    json += "]}\n";
+    if (!ok || !file.WriteBytes(json.data(), json.size())) {
+        ERROR_LOG(COMMON, "couldn't write the profiler trace %s", filename.c_str());
+        return false;
+    }
+    NOTICE_LOG(COMMON, "wrote %u profiled scopes to %s", (u32)captured.size(), filename.c_str());
+    return true;
+}
+
+/// Whether a trace is being captured
+bool IsCapturing() {
+    return g_capturing.load(std::memory_order_relaxed);
+}
+
+} // namespace
+} // namespace
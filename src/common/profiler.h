@@ -0,0 +1,130 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+
+/**
+ * Instrumenting profiler. Code marks its sections with scopes of named categories. While profiling
+ * is enabled, each scope records its start and end into a lock-free ring of the thread it runs on.
+ * Once per frame the emulation thread drains the rings into per-category totals, kept as the
+ * report of the last frame. It also drains them into the trace being captured if any, which is
+ * written out in the Chrome trace event format (chrome://tracing).
+ */
+namespace Common {
+namespace Profiler {
+
+enum {
+    MAX_CATEGORIES  = 256,
+    OTHER_CATEGORY  = 0,        ///< Catches scopes of categories past MAX_CATEGORIES
+};
+
+extern std::atomic<bool> g_enabled;     ///< Whether scopes record, off by default
+
+/**
+ * Registers a category, or gets the one already registered under the name
+ * @param name Name shown in the reports
+ * @return ID of the category
+ * @note This function is thread-safe
+ */
+int RegisterCategory(const std::string& name);
+
+/// Category registered at startup, at namespace scope next to the code it times
+class Category : NonCopyable {
+public:
+    explicit Category(const char* name) : m_id(RegisterCategory(name)) {}
+
+    int GetId() const {
+        return m_id;
+    }
+
+private:
+    int m_id;
+};
+
+/**
+ * Opens a scope on the calling thread, use Scope instead
+ * @param category ID of the category of the scope
+ */
+void BeginScope(int category);
+
+/// Closes the innermost scope of the calling thread, use Scope instead
+void EndScope();
+
+/// Times its lifetime under a category, costing a relaxed load while profiling is disabled
+class Scope : NonCopyable {
+public:
+    explicit Scope(const Category& category) : m_active(g_enabled.load(std::memory_order_relaxed)) {
+        if (m_active) {
+            BeginScope(category.GetId());
+        }
+    }
+
+    explicit Scope(int category) : m_active(g_enabled.load(std::memory_order_relaxed)) {
+        if (m_active) {
+            BeginScope(category);
+        }
+    }
+
+    ~Scope() {
+        if (m_active) {
+            EndScope();
+        }
+    }
+
+private:
+    bool m_active;  ///< Whether the scope was opened, profiling can be disabled meanwhile
+};
+
+/// Totals of a category over a frame
+struct CategoryStats {
+    int         id;
+    int         parent;     ///< Category the scopes were nested in, -1 for top level scopes
+    std::string name;
+    u64         total_ns;   ///< Time spent in the scopes
+    u64         self_ns;    ///< Time spent in the scopes outside of the scopes nested in them
+    u32         calls;      ///< Number of scopes
+};
+
+/// Where the time of a frame went
+struct FrameReport {
+    u64                         frame_ns;       ///< Time since the end of the frame before
+    u64                         dropped;        ///< Scopes lost to full rings since startup
+    std::vector<CategoryStats>  categories;     ///< Categories with scopes in the frame, by ID
+};
+
+/// Drains the rings into the report of the frame and the trace, called once per frame
+void EndFrame();
+
+/**
+ * Gets the report of the last frame
+ * @param report Receives the report
+ * @note This function is thread-safe
+ */
+void GetLastFrame(FrameReport& report);
+
+/**
+ * Starts capturing a trace of the scopes, dropping any trace captured but not written
+ * @note This function is thread-safe
+ */
+void StartCapture();
+
+/**
+ * Stops capturing the trace and writes it out
+ * @param filename Path of the trace file, empty to drop the trace
+ * @return True on success
+ * @note This function is thread-safe
+ */
+bool StopCapture(const std::string& filename);
+
+/// Whether a trace is being captured
+bool IsCapturing();
+
+} // namespace
+} // namespace
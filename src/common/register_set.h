@@ -129,7 +129,7 @@ struct RegisterSet {
      */
     template<Id id>
     Struct<id>& Get(const Id& index) {
-        return const_cast<Struct<id>&>(GetThis().Get<id>(index));
+        return const_cast<Struct<id>&>(GetThis().template Get<id>(index));
     }
 
     /*
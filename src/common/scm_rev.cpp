@@ -0,0 +1,18 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/scm_rev.h"
+
+#define GIT_REV      "43021056d9859e289e9ba1c103dc6ba43d3af288"
+#define GIT_BRANCH   "master"
+#define GIT_DESC     "4302105-dirty"
+
+namespace Common {
+
+const char g_scm_rev[]      = GIT_REV;
+const char g_scm_branch[]   = GIT_BRANCH;
+const char g_scm_desc[]     = GIT_DESC;
+
+} // namespace
+
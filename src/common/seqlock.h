@@ -0,0 +1,76 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Value published by a single writer to any number of readers, none of which ever blocks. The
+ * writer fills the buffer the readers didn't see last, under a sequence number that is odd while
+ * it's being written; a reader copies the latest buffer and retries when its sequence number
+ * changed meanwhile. With two buffers a reader only retries when the writer went through two
+ * publishes during its copy.
+ * @tparam T Value type, trivially copyable
+ */
+template <typename T>
+class SeqLock : NonCopyable {
+public:
+    /// Publishes a value initialized by its default constructor
+    SeqLock() : m_latest(0) {
+        for (int i = 0; i < 2; i++) {
+            m_buffers[i].sequence.store(0, std::memory_order_relaxed);
+            m_buffers[i].value = T();
+        }
+    }
+
+    /**
+     * Publishes a value, from the writer thread only
+     * @param value Value to publish
+     */
+    void Write(const T& value) {
+        Buffer& buffer = m_buffers[m_latest.load(std::memory_order_relaxed) ^ 1];
+        const u32 sequence = buffer.sequence.load(std::memory_order_relaxed);
+        buffer.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&buffer.value, &value, sizeof(T));
+        buffer.sequence.store(sequence + 2, std::memory_order_release);
+        m_latest.store(m_latest.load(std::memory_order_relaxed) ^ 1, std::memory_order_release);
+    }
+
+    /**
+     * Gets the value published last, from any thread
+     * @param value Filled with the value
+     */
+    void Read(T& value) const {
+        while (true) {
+            const Buffer& buffer = m_buffers[m_latest.load(std::memory_order_acquire)];
+            const u32 sequence = buffer.sequence.load(std::memory_order_acquire);
+            if (sequence & 1) {
+                continue;
+            }
+            memcpy(&value, &buffer.value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (buffer.sequence.load(std::memory_order_relaxed) == sequence) {
+                return;
+            }
+        }
+    }
+
+private:
+    struct Buffer {
+        std::atomic<u32> sequence;      ///< Odd while the writer is on the value
+        T value;
+    };
+
+    Buffer m_buffers[2];
+    std::atomic<u32> m_latest;          ///< Buffer published last
+};
+
+} // namespace
@@ -0,0 +1,72 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <new>
+
+#include "common/slab_allocator.h"
+
+namespace Common {
+
+/**
+ * Creates an allocator without any slab yet
+ * @param slab_size Size of the slabs carved into blocks in bytes, at least MAX_SIZE
+ */
+SlabAllocator::SlabAllocator(size_t slab_size) : m_slab_size(slab_size), m_slab_cur(NULL),
+    m_slab_end(NULL) {
+    memset(m_free_lists, 0, sizeof(m_free_lists));
+}
+
+/// Frees the slabs, all of the blocks have to be freed already
+SlabAllocator::~SlabAllocator() {
+    for (u8* slab : m_slabs) {
+        ::operator delete(slab);
+    }
+}
+
+/**
+ * Allocates a block, aligned to GRANULARITY
+ * @param size Size of the block in bytes
+ * @return Pointer to the block
+ */
+void* SlabAllocator::Allocate(size_t size) {
+    if (size > MAX_SIZE) {
+        return ::operator new(size);
+    }
+    const size_t size_class = GetSizeClass(size);
+    FreeBlock* block = m_free_lists[size_class];
+    if (block != NULL) {
+        m_free_lists[size_class] = block->next;
+        return block;
+    }
+    const size_t block_size = (size_class + 1) * GRANULARITY;
+    if (m_slab_cur == NULL || (size_t)(m_slab_end - m_slab_cur) < block_size) {
+        // The heap aligns for any type, and block sizes keep the alignment along the slab
+        m_slab_cur = (u8*)::operator new(m_slab_size);
+        m_slab_end = m_slab_cur + m_slab_size;
+        m_slabs.push_back(m_slab_cur);
+    }
+    void* ptr = m_slab_cur;
+    m_slab_cur += block_size;
+    return ptr;
+}
+
+/**
+ * Frees a block
+ * @param ptr Pointer to the block
+ * @param size Size the block was allocated with
+ */
+void SlabAllocator::Free(void* ptr, size_t size) {
+    if (size > MAX_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+    const size_t size_class = GetSizeClass(size);
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = m_free_lists[size_class];
+    m_free_lists[size_class] = block;
+}
+
+} // namespace
@@ -0,0 +1,64 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Allocator of small fixed-size blocks. Memory comes from large slabs and freed blocks go to one
+ * free list per size class, so allocating and freeing doesn't hit the heap once the slabs are
+ * warm. Blocks go back to the heap only when the allocator is destroyed. Not thread-safe.
+ */
+class SlabAllocator : NonCopyable {
+public:
+    enum {
+        GRANULARITY = 16,       ///< Size classes are multiples of this
+        MAX_SIZE    = 0x400,    ///< Larger blocks come from the heap
+    };
+
+    /**
+     * Creates an allocator without any slab yet
+     * @param slab_size Size of the slabs carved into blocks in bytes, at least MAX_SIZE
+     */
+    explicit SlabAllocator(size_t slab_size = 0x10000);
+
+    /// Frees the slabs, all of the blocks have to be freed already
+    ~SlabAllocator();
+
+    /**
+     * Allocates a block, aligned to GRANULARITY
+     * @param size Size of the block in bytes
+     * @return Pointer to the block
+     */
+    void* Allocate(size_t size);
+
+    /**
+     * Frees a block
+     * @param ptr Pointer to the block
+     * @param size Size the block was allocated with
+     */
+    void Free(void* ptr, size_t size);
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static size_t GetSizeClass(size_t size) {
+        return size == 0 ? 0 : (size - 1) / GRANULARITY;
+    }
+
+    FreeBlock*          m_free_lists[MAX_SIZE / GRANULARITY];
+    size_t              m_slab_size;
+    u8*                 m_slab_cur;     ///< Free space left in the current slab
+    u8*                 m_slab_end;
+    std::vector<u8*>    m_slabs;
+};
+
+} // namespace
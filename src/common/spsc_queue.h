@@ -0,0 +1,153 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "common/common.h"
+
+namespace Common {
+
+/**
+ * Bounded lock-free ring with a single producer and a single consumer. The slots are allocated
+ * once, by the constructor. The producer and the consumer each keep their index and a copy of the
+ * other's on a cache line of their own, so that they only touch the other's line when the copy
+ * says the ring is full or empty.
+ * @tparam T Element type, default constructible and movable
+ */
+template <typename T>
+class SPSCQueue : NonCopyable {
+public:
+    /**
+     * Allocates the slots
+     * @param capacity Number of elements the ring holds, rounded up to a power of two
+     */
+    explicit SPSCQueue(size_t capacity) : m_tail(0), m_cached_head(0), m_head(0), m_cached_tail(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_slots.reset(new T[size]);
+    }
+
+    /// Gets the number of elements the ring holds
+    size_t Capacity() const {
+        return m_mask + 1;
+    }
+
+    /**
+     * Appends an element, from the producer thread only
+     * @param element Element to append, moved from on success
+     * @return False if the ring is full
+     */
+    bool Push(T&& element) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cached_head > m_mask) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail - m_cached_head > m_mask) {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::move(element);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// @see Push
+    bool Push(const T& element) {
+        T copy(element);
+        return Push(std::move(copy));
+    }
+
+    /**
+     * Appends as many elements of an array as there is room for, from the producer thread only.
+     * The consumer sees them all at once.
+     * @param elements Elements to append, copied
+     * @param count Number of elements
+     * @return Number of elements appended, from the start of the array
+     */
+    size_t PushBatch(const T* elements, size_t count) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_cached_head + m_mask + 1 - tail < count) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+        }
+        count = std::min(count, m_cached_head + m_mask + 1 - tail);
+        for (size_t i = 0; i < count; i++) {
+            m_slots[(tail + i) & m_mask] = elements[i];
+        }
+        if (count != 0) {
+            m_tail.store(tail + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /**
+     * Takes the oldest element, from the consumer thread only
+     * @param element Receives the element
+     * @return False if the ring is empty
+     */
+    bool Pop(T& element) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cached_tail) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cached_tail) {
+                return false;
+            }
+        }
+        element = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes up to a number of the oldest elements, from the consumer thread only. Their slots are
+     * handed back to the producer all at once.
+     * @param elements Receives the elements, oldest first
+     * @param max_count Number of elements the array holds
+     * @return Number of elements taken
+     */
+    size_t PopBatch(T* elements, size_t max_count) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (m_cached_tail - head < max_count) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+        }
+        const size_t count = std::min(max_count, m_cached_tail - head);
+        for (size_t i = 0; i < count; i++) {
+            elements[i] = std::move(m_slots[(head + i) & m_mask]);
+        }
+        if (count != 0) {
+            m_head.store(head + count, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /// Whether the ring is empty, exact from the consumer thread only
+    bool Empty() const {
+        return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    enum {
+        CACHE_LINE  = 64,
+    };
+
+    // Indices run freely and wrap around, the slot of an index is index & m_mask
+    std::unique_ptr<T[]>    m_slots;
+    size_t                  m_mask;
+    u8                      m_pad0[CACHE_LINE];
+
+    std::atomic<size_t>     m_tail;         ///< Next index pushed, written by the producer
+    size_t                  m_cached_head;  ///< Consumer's index as last seen by the producer
+    u8                      m_pad1[CACHE_LINE];
+
+    std::atomic<size_t>     m_head;         ///< Next index popped, written by the consumer
+    size_t                  m_cached_tail;  ///< Producer's index as last seen by the consumer
+    u8                      m_pad2[CACHE_LINE];
+};
+
+} // namespace
@@ -17,6 +17,11 @@
     #include <errno.h>
 #endif
 
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define UTF_SSE2
+#include <emmintrin.h>
+#endif
+
 /// Make a string lowercase
 void LowerStr(char* str) {
     for (int i = 0; str[i]; i++) {
@@ -97,11 +102,24 @@ bool CharArrayFromFormatV(char* out, int outsize, const char* format, va_list ar
 std::string StringFromFormat(const char* format, ...)
 {
     va_list args;
+    va_start(args, format);
+
+    // Most strings fit on the stack, which saves formatting them into a temporary on the heap
+    char stack_buf[256];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const bool fits = CharArrayFromFormatV(stack_buf, sizeof(stack_buf), format, args_copy);
+    va_end(args_copy);
+    if (fits)
+    {
+        va_end(args);
+        return std::string(stack_buf);
+    }
+
     char *buf = NULL;
 #ifdef _WIN32
     int required = 0;
 
-    va_start(args, format);
     required = _vscprintf(format, args);
     buf = new char[required + 1];
     CharArrayFromFormatV(buf, required + 1, format, args);
@@ -110,7 +128,6 @@ std::string StringFromFormat(const char* format, ...)
     std::string temp = buf;
     delete[] buf;
 #else
-    va_start(args, format);
     if (vasprintf(&buf, format, args) < 0)
         ERROR_LOG(COMMON, "Unable to allocate memory for string");
     va_end(args);
@@ -417,6 +434,145 @@ std::string UriEncode(const std::string & sSrc)
     return sResult;
 }
 
+/**
+ * Converts UTF-16 to UTF-8 in a buffer of the caller, without allocating. Runs of ASCII convert
+ * 8 characters at a time, unpaired surrogates become U+FFFD.
+ * @param src UTF-16 code units, in host order (the guest's)
+ * @param length Number of code units
+ * @param dest Buffer for the UTF-8, 3 bytes per code unit always suffice
+ * @param dest_size Size of the buffer in bytes
+ * @return Bytes written, the conversion stops before the first character that doesn't fit
+ */
+size_t UTF16ToUTF8(const u16* src, size_t length, char* dest, size_t dest_size)
+{
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length)
+    {
+#ifdef UTF_SSE2
+        if (length - in >= 8 && dest_size - out >= 8)
+        {
+            const __m128i units = _mm_loadu_si128((const __m128i*)(src + in));
+            const __m128i high = _mm_and_si128(units, _mm_set1_epi16((short)0xFF80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF)
+            {
+                _mm_storel_epi64((__m128i*)(dest + out), _mm_packus_epi16(units, units));
+                in += 8;
+                out += 8;
+                continue;
+            }
+        }
+#endif
+        u32 c = src[in++];
+        if (c >= 0xD800 && c < 0xE000)
+        {
+            if (c < 0xDC00 && in < length && src[in] >= 0xDC00 && src[in] < 0xE000)
+                c = 0x10000 + ((c - 0xD800) << 10) + (src[in++] - 0xDC00);
+            else
+                c = 0xFFFD;
+        }
+
+        const size_t size = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+        if (dest_size - out < size)
+            break;
+        switch (size)
+        {
+        case 1:
+            dest[out] = (char)c;
+            break;
+        case 2:
+            dest[out + 0] = (char)(0xC0 | (c >> 6));
+            dest[out + 1] = (char)(0x80 | (c & 0x3F));
+            break;
+        case 3:
+            dest[out + 0] = (char)(0xE0 | (c >> 12));
+            dest[out + 1] = (char)(0x80 | ((c >> 6) & 0x3F));
+            dest[out + 2] = (char)(0x80 | (c & 0x3F));
+            break;
+        default:
+            dest[out + 0] = (char)(0xF0 | (c >> 18));
+            dest[out + 1] = (char)(0x80 | ((c >> 12) & 0x3F));
+            dest[out + 2] = (char)(0x80 | ((c >> 6) & 0x3F));
+            dest[out + 3] = (char)(0x80 | (c & 0x3F));
+            break;
+        }
+        out += size;
+    }
+    return out;
+}
+
+/**
+ * Converts UTF-8 to UTF-16 in a buffer of the caller, without allocating. Runs of ASCII convert
+ * 16 characters at a time, malformed sequences become U+FFFD.
+ * @param src UTF-8 bytes
+ * @param length Number of bytes
+ * @param dest Buffer for the UTF-16, a code unit per byte always suffices
+ * @param dest_size Size of the buffer in code units
+ * @return Code units written, the conversion stops before the first character that doesn't fit
+ */
+size_t UTF8ToUTF16(const char* src, size_t length, u16* dest, size_t dest_size)
+{
+    static const u32 min_values[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    const u8* bytes = (const u8*)src;
+    size_t in = 0;
+    size_t out = 0;
+    while (in < length)
+    {
+#ifdef UTF_SSE2
+        if (length - in >= 16 && dest_size - out >= 16)
+        {
+            const __m128i chars = _mm_loadu_si128((const __m128i*)(bytes + in));
+            if (_mm_movemask_epi8(chars) == 0)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128((__m128i*)(dest + out), _mm_unpacklo_epi8(chars, zero));
+                _mm_storeu_si128((__m128i*)(dest + out + 8), _mm_unpackhi_epi8(chars, zero));
+                in += 16;
+                out += 16;
+                continue;
+            }
+        }
+#endif
+        const u8 lead = bytes[in];
+        size_t size = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 :
+            (lead >> 3) == 0x1E ? 4 : 0;
+        u32 c = size == 1 ? lead : lead & (0x7F >> size);
+        for (size_t i = 1; i < size; i++)
+        {
+            if (in + i >= length || (bytes[in + i] & 0xC0) != 0x80)
+            {
+                size = 0;
+                break;
+            }
+            c = (c << 6) | (bytes[in + i] & 0x3F);
+        }
+
+        // Overlong forms and encoded surrogates are malformed too, stray bytes go one by one
+        if (size == 0 || c < min_values[size] || c > 0x10FFFF || (c >= 0xD800 && c < 0xE000))
+        {
+            c = 0xFFFD;
+            size = std::max<size_t>(size, 1);
+        }
+
+        if (c >= 0x10000)
+        {
+            if (dest_size - out < 2)
+                break;
+            dest[out++] = (u16)(0xD800 + ((c - 0x10000) >> 10));
+            dest[out++] = (u16)(0xDC00 + ((c - 0x10000) & 0x3FF));
+        }
+        else
+        {
+            if (dest_size - out < 1)
+                break;
+            dest[out++] = (u16)c;
+        }
+        in += size;
+    }
+    return out;
+}
+
 #ifdef _WIN32
 
 std::string UTF16ToUTF8(const std::wstring& input)
@@ -13,6 +13,7 @@
 #include <iomanip>
 
 #include "common/common.h"
+#include "common/format_buffer.h"
 
 /// Make a string lowercase
 void LowerStr(char* str);
@@ -20,8 +21,8 @@ void LowerStr(char* str);
 /// Make a string uppercase
 void UpperStr(char* str);
 
-std::string StringFromFormat(const char* format, ...);
-// Cheap!
+std::string StringFromFormat(const char* format, ...) PRINTF_FORMAT(1, 2);
+// Cheap! Common::FormatBuffer appends without allocating at all.
 bool CharArrayFromFormatV(char* out, int outsize, const char* format, va_list args);
 
 template<size_t Count>
@@ -90,6 +91,28 @@ std::string ReplaceAll(std::string result, const std::string& src, const std::st
 std::string UriDecode(const std::string & sSrc);
 std::string UriEncode(const std::string & sSrc);
 
+/**
+ * Converts UTF-16 to UTF-8 in a buffer of the caller, without allocating. Runs of ASCII convert
+ * 8 characters at a time, unpaired surrogates become U+FFFD.
+ * @param src UTF-16 code units, in host order (the guest's)
+ * @param length Number of code units
+ * @param dest Buffer for the UTF-8, 3 bytes per code unit always suffice
+ * @param dest_size Size of the buffer in bytes
+ * @return Bytes written, the conversion stops before the first character that doesn't fit
+ */
+size_t UTF16ToUTF8(const u16* src, size_t length, char* dest, size_t dest_size);
+
+/**
+ * Converts UTF-8 to UTF-16 in a buffer of the caller, without allocating. Runs of ASCII convert
+ * 16 characters at a time, malformed sequences become U+FFFD.
+ * @param src UTF-8 bytes
+ * @param length Number of bytes
+ * @param dest Buffer for the UTF-16, a code unit per byte always suffices
+ * @param dest_size Size of the buffer in code units
+ * @return Code units written, the conversion stops before the first character that doesn't fit
+ */
+size_t UTF8ToUTF16(const char* src, size_t length, u16* dest, size_t dest_size);
+
 std::string CP1252ToUTF8(const std::string& str);
 std::string SHIFTJISToUTF8(const std::string& str);
 std::string UTF16ToUTF8(const std::wstring& str);
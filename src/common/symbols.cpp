@@ -2,56 +2,171 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "common/symbols.h"
 
-TSymbolsMap g_symbols;
+namespace
+{
+    // Symbol of the index, names are interned so that entries stay small and flat
+    struct SymbolEntry
+    {
+        u32 address;
+        u32 size;
+        u32 type;
+        u32 name;   // Index in g_names
+    };
+
+    bool CompareAddress(const SymbolEntry& a, const SymbolEntry& b)
+    {
+        return a.address < b.address;
+    }
+
+    bool SameAddress(const SymbolEntry& a, const SymbolEntry& b)
+    {
+        return a.address == b.address;
+    }
+
+    std::vector<SymbolEntry>                g_index;        // Sorted by address, unique
+    std::vector<SymbolEntry>                g_added;        // Added since the index was sorted
+    std::vector<std::string>                g_names;        // Interned names
+    std::unordered_map<std::string, u32>    g_name_ids;     // Index of interned names
+    std::function<void()>                   g_symbols_loader;
+    const std::string                       g_no_name;
+}
 
 namespace Symbols
 {
-    bool HasSymbol(u32 _address)
+    // Runs the loader set, once, the symbols it adds don't replace those added before
+    static void LoadPending()
+    {
+        if (g_symbols_loader)
+        {
+            std::function<void()> loader;
+            loader.swap(g_symbols_loader);
+            loader();
+        }
+    }
+
+    // Brings the index up to date: symbols added since are sorted once and merged in, a symbol
+    // keeping its address against those added after it
+    static void Update()
     {
-        return g_symbols.find(_address) != g_symbols.end();
+        LoadPending();
+        if (g_added.empty())
+            return;
+
+        std::stable_sort(g_added.begin(), g_added.end(), CompareAddress);
+        const size_t old_size = g_index.size();
+        g_index.insert(g_index.end(), g_added.begin(), g_added.end());
+        std::inplace_merge(g_index.begin(), g_index.begin() + old_size, g_index.end(),
+            CompareAddress);
+        g_index.erase(std::unique(g_index.begin(), g_index.end(), SameAddress), g_index.end());
+        g_added.clear();
     }
 
-    void Add(u32 _address, const std::string& _name, u32 _size, u32 _type)
+    // Finds the symbol at an address, nullptr if there is none
+    static const SymbolEntry* Find(u32 _address)
     {
-        if (!HasSymbol(_address))
-        {
-            TSymbol symbol;
-            symbol.address = _address;
-            symbol.name = _name;
-            symbol.size = _size;
-            symbol.type = _type;
+        Update();
+        const SymbolEntry key = { _address, 0, 0, 0 };
+        auto it = std::lower_bound(g_index.begin(), g_index.end(), key, CompareAddress);
+        if (it == g_index.end() || it->address != _address)
+            return nullptr;
+        return &*it;
+    }
 
-            g_symbols.insert(TSymbolsPair(_address, symbol));
-        }
+    // Finds the symbol whose range covers an address, symbols without a size only cover their
+    // start address. nullptr if there is none.
+    static const SymbolEntry* FindContaining(u32 _address)
+    {
+        Update();
+        const SymbolEntry key = { _address, 0, 0, 0 };
+        auto it = std::upper_bound(g_index.begin(), g_index.end(), key, CompareAddress);
+        if (it == g_index.begin())
+            return nullptr;
+        --it;
+        if (it->address == _address || _address - it->address < it->size)
+            return &*it;
+        return nullptr;
     }
 
-    TSymbol GetSymbol(u32 _address)
+    static TSymbol MakeSymbol(const SymbolEntry* entry)
     {
-        TSymbolsMap::iterator foundSymbolItr;
         TSymbol symbol;
-        
-        foundSymbolItr = g_symbols.find(_address);
-        if (foundSymbolItr != g_symbols.end())
+        if (entry != nullptr)
         {
-            symbol = (*foundSymbolItr).second;
+            symbol.address = entry->address;
+            symbol.name = g_names[entry->name];
+            symbol.size = entry->size;
+            symbol.type = entry->type;
         }
-
         return symbol;
     }
+
+    bool HasSymbol(u32 _address)
+    {
+        return Find(_address) != nullptr;
+    }
+
+    void Add(u32 _address, const std::string& _name, u32 _size, u32 _type)
+    {
+        // Sorted in on the next lookup, so that loading a symbol table sorts once
+        auto name = g_name_ids.insert(std::make_pair(_name, (u32)g_names.size()));
+        if (name.second)
+            g_names.push_back(_name);
+
+        const SymbolEntry entry = { _address, _size, _type, name.first->second };
+        g_added.push_back(entry);
+    }
+
+    TSymbol GetSymbol(u32 _address)
+    {
+        return MakeSymbol(Find(_address));
+    }
+
+    TSymbol GetSymbolContaining(u32 _address)
+    {
+        return MakeSymbol(FindContaining(_address));
+    }
+
+    const std::string& GetNameContaining(u32 _address, u32& _start)
+    {
+        const SymbolEntry* entry = FindContaining(_address);
+        if (entry == nullptr)
+            return g_no_name;
+        _start = entry->address;
+        return g_names[entry->name];
+    }
+
     const std::string& GetName(u32 _address)
     {
-        return GetSymbol(_address).name;
+        const SymbolEntry* entry = Find(_address);
+        return entry != nullptr ? g_names[entry->name] : g_no_name;
     }
     
     void Remove(u32 _address)
     {
-        g_symbols.erase(_address);
+        Update();
+        const SymbolEntry key = { _address, 0, 0, 0 };
+        auto it = std::lower_bound(g_index.begin(), g_index.end(), key, CompareAddress);
+        if (it != g_index.end() && it->address == _address)
+            g_index.erase(it);
     }
 
     void Clear()
     {
-        g_symbols.clear();
+        g_index.clear();
+        g_added.clear();
+        g_names.clear();
+        g_name_ids.clear();
+        g_symbols_loader = nullptr;
+    }
+
+    void SetLoader(std::function<void()> _loader)
+    {
+        g_symbols_loader = _loader;
     }
-}
\ No newline at end of file
+}
@@ -4,7 +4,8 @@
 
 #pragma once
 
-#include <map>
+#include <functional>
+#include <string>
 
 #include "common/common.h"
 
@@ -23,17 +24,21 @@ struct TSymbol
     u32     type;
 };
 
-typedef std::map<u32, TSymbol> TSymbolsMap;
-typedef std::pair<u32, TSymbol> TSymbolsPair;
-
 namespace Symbols
 {
     bool HasSymbol(u32 _address);
 
     void Add(u32 _address, const std::string& _name, u32 _size, u32 _type);
     TSymbol GetSymbol(u32 _address);
+    TSymbol GetSymbolContaining(u32 _address);
+    // Name of the symbol covering an address without copying it, empty if none does
+    const std::string& GetNameContaining(u32 _address, u32& _start);
     const std::string& GetName(u32 _address);
     void Remove(u32 _address);
     void Clear();
+
+    // Sets a function adding symbols, called on the first lookup rather than at load time so
+    // that symbol tables nobody looks at aren't parsed. Replaces the one set before, if any.
+    void SetLoader(std::function<void()> _loader);
 };
 
@@ -5,12 +5,21 @@
 #include "common/thread.h"
 #include "common/common.h"
 
+#include <algorithm>
+#include <atomic>
+
 #ifdef __APPLE__
 #include <mach/mach.h>
 #elif defined BSD4_4
 #include <pthread_np.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef USE_BEGINTHREADEX
 #include <process.h>
 #endif
@@ -28,6 +37,25 @@ int CurrentThreadId()
     return 0;
 #endif
 }
+
+/**
+ * Puts the order of GetCpuOrder together
+ * @param physical First logical CPU of every physical core, every CPU if the host didn't tell
+ * @param siblings Other logical CPUs of the cores
+ * @param num_physical_cores Filled with the number of physical cores
+ */
+static std::vector<int> MakeCpuOrder(std::vector<int> physical, const std::vector<int>& siblings,
+    int* num_physical_cores)
+{
+    if (physical.empty())
+    {
+        for (int cpu = 0; cpu < std::max((int)std::thread::hardware_concurrency(), 1); cpu++)
+            physical.push_back(cpu);
+    }
+    *num_physical_cores = (int)physical.size();
+    physical.insert(physical.end(), siblings.begin(), siblings.end());
+    return physical;
+}
     
 #ifdef _WIN32
 
@@ -41,6 +69,59 @@ void SetCurrentThreadAffinity(u32 mask)
     SetThreadAffinityMask(GetCurrentThread(), mask);
 }
 
+bool PinCurrentThreadToCpu(int cpu)
+{
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8))
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+void UnpinCurrentThread()
+{
+    DWORD_PTR process_mask, system_mask;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        SetThreadAffinityMask(GetCurrentThread(), process_mask);
+}
+
+std::vector<int> GetCpuOrder(int* num_physical_cores)
+{
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        process_mask = ~(DWORD_PTR)0;
+
+    std::vector<int> physical, siblings;
+    DWORD size = 0;
+    GetLogicalProcessorInformation(NULL, &size);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(size / sizeof(info[0]));
+    if (!info.empty() && GetLogicalProcessorInformation(info.data(), &size))
+    {
+        for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : info)
+        {
+            if (entry.Relationship != RelationProcessorCore)
+                continue;
+            const DWORD_PTR mask = entry.ProcessorMask & process_mask;
+            bool first = true;
+            for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++)
+            {
+                if (!((mask >> cpu) & 1))
+                    continue;
+                (first ? physical : siblings).push_back(cpu);
+                first = false;
+            }
+        }
+    }
+    return MakeCpuOrder(physical, siblings, num_physical_cores);
+}
+
+bool SetCurrentThreadPriority(ThreadPriority priority)
+{
+    static const int priorities[] = {
+        THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL,
+        THREAD_PRIORITY_TIME_CRITICAL,
+    };
+    return SetThreadPriority(GetCurrentThread(), priorities[priority]) != 0;
+}
+
 // Supporting functions
 void SleepCurrentThread(int ms)
 {
@@ -109,6 +190,120 @@ void SetCurrentThreadAffinity(u32 mask)
     SetThreadAffinity(pthread_self(), mask);
 }
 
+#if defined __linux__ && !defined ANDROID
+
+static cpu_set_t s_process_cpus;                    ///< CPUs of the process before the first pin
+static std::atomic<bool> s_process_cpus_kept(false);
+
+/// Reads a number of the CPU topology in sysfs, -1 if the file isn't there
+static int ReadTopologyId(int cpu, const char* name)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE* file = fopen(path, "r");
+    int id = -1;
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &id) != 1)
+            id = -1;
+        fclose(file);
+    }
+    return id;
+}
+
+bool PinCurrentThreadToCpu(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+
+    // Threads keep the mask of the thread that starts them, UnpinCurrentThread puts this one back
+    if (!s_process_cpus_kept.load())
+    {
+        if (sched_getaffinity(0, sizeof(s_process_cpus), &s_process_cpus) != 0)
+            return false;
+        s_process_cpus_kept.store(true);
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+void UnpinCurrentThread()
+{
+    if (s_process_cpus_kept.load())
+        pthread_setaffinity_np(pthread_self(), sizeof(s_process_cpus), &s_process_cpus);
+}
+
+std::vector<int> GetCpuOrder(int* num_physical_cores)
+{
+    cpu_set_t allowed;
+    if (s_process_cpus_kept.load())
+        allowed = s_process_cpus;
+    else if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return MakeCpuOrder(std::vector<int>(), std::vector<int>(), num_physical_cores);
+
+    // Logical CPUs of the same package and core ID are the threads of one physical core
+    std::vector<std::pair<int, int>> cores;
+    std::vector<int> physical, siblings;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        const std::pair<int, int> core(ReadTopologyId(cpu, "physical_package_id"),
+            ReadTopologyId(cpu, "core_id"));
+        if (core.second != -1 && std::find(cores.begin(), cores.end(), core) != cores.end())
+        {
+            siblings.push_back(cpu);
+        }
+        else
+        {
+            cores.push_back(core);
+            physical.push_back(cpu);
+        }
+    }
+    return MakeCpuOrder(physical, siblings, num_physical_cores);
+}
+
+#else
+
+bool PinCurrentThreadToCpu(int cpu)
+{
+    // OS X only has affinity tags, which group threads rather than pin them
+    return false;
+}
+
+void UnpinCurrentThread()
+{
+}
+
+std::vector<int> GetCpuOrder(int* num_physical_cores)
+{
+    return MakeCpuOrder(std::vector<int>(), std::vector<int>(), num_physical_cores);
+}
+
+#endif
+
+bool SetCurrentThreadPriority(ThreadPriority priority)
+{
+    if (priority == PRIORITY_REALTIME)
+    {
+        sched_param param;
+        param.sched_priority = (sched_get_priority_min(SCHED_FIFO) +
+            sched_get_priority_max(SCHED_FIFO)) / 2;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+            return true;
+        priority = PRIORITY_HIGH;
+    }
+#ifdef __linux__
+    // Linux has a nice value per thread, lowering it takes CAP_SYS_NICE or RLIMIT_NICE
+    static const int nice_values[] = { 10, 0, -10 };
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice_values[priority]) == 0;
+#else
+    return priority == PRIORITY_NORMAL;
+#endif
+}
+
 void SleepCurrentThread(int ms)
 {
     usleep(1000 * ms);
@@ -124,7 +319,11 @@ void SetCurrentThreadName(const char* szThreadName)
 #ifdef __APPLE__
     pthread_setname_np(szThreadName);
 #else
-    pthread_setname_np(pthread_self(), szThreadName);
+    // Linux refuses names of more than 15 characters rather than cutting them
+    char name[16];
+    strncpy(name, szThreadName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    pthread_setname_np(pthread_self(), name);
 #endif
 }
 
@@ -13,6 +13,7 @@
 #include "common/common_types.h"
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 
 // This may not be defined outside _WIN32
 #ifndef _WIN32
@@ -32,6 +33,42 @@ int CurrentThreadId();
 
 void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask);
 void SetCurrentThreadAffinity(u32 mask);
+
+/**
+ * Pins the current thread to a logical CPU, one of GetCpuOrder. Threads the current one starts
+ * from then on inherit the pin, unless they call UnpinCurrentThread.
+ * @param cpu Index of the logical CPU
+ * @return False if the host doesn't pin threads, or the CPU isn't there
+ */
+bool PinCurrentThreadToCpu(int cpu);
+
+/// Lets the current thread run on every CPU the process may run on again
+void UnpinCurrentThread();
+
+/**
+ * Gets the logical CPUs the process may run on, in the order threads should be spread on them:
+ * the first of every physical core, then the siblings sharing the cores
+ * @param num_physical_cores Filled with the number of physical cores, the first entries
+ * @return Indices of the logical CPUs, at least one
+ */
+std::vector<int> GetCpuOrder(int* num_physical_cores);
+
+/// Scheduling priorities of host threads
+enum ThreadPriority
+{
+    PRIORITY_LOW,           ///< Background work, as compression and the disk caches
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH,          ///< The emulation and the GPU threads
+    PRIORITY_REALTIME,      ///< Audio and presentation, which mustn't miss their deadlines
+};
+
+/**
+ * Sets the scheduling priority of the current thread. Realtime falls back to high where the
+ * process may not schedule realtime threads.
+ * @param priority Priority
+ * @return False if the host refused the priority, raising it needs privileges on some hosts
+ */
+bool SetCurrentThreadPriority(ThreadPriority priority);
     
 class Event
 {
@@ -149,6 +186,7 @@ inline void YieldCPU()
     std::this_thread::yield();
 }
     
+// Names longer than the host keeps (15 characters on Linux) are cut
 void SetCurrentThreadName(const char *name);
     
 } // namespace Common
@@ -0,0 +1,234 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/cpu_detect.h"
+#include "common/thread_pool.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+namespace Common {
+
+namespace {
+
+THREAD_LOCAL ThreadPool*    t_pool = nullptr;   ///< Pool of the current worker thread
+THREAD_LOCAL int            t_index = -1;       ///< Index of the current worker in its pool
+
+} // namespace
+
+/// Whether the task ran, false for an empty handle
+bool Task::IsDone() const {
+    return m_state != nullptr && m_state->done.load(std::memory_order_acquire);
+}
+
+/// Waits for the task to run, running other tasks of the pool meanwhile
+void Task::Wait() const {
+    if (m_state == nullptr) {
+        return;
+    }
+    ThreadPool& pool = *m_state->pool;
+    while (!IsDone()) {
+        if (pool.RunPendingTask()) {
+            continue;
+        }
+        // Nothing to help with: the task runs elsewhere, or was queued after the look
+        std::unique_lock<std::mutex> lk(pool.m_lock);
+        pool.m_num_waiting++;
+        while (!IsDone() && pool.m_pending.load(std::memory_order_relaxed) == 0) {
+            pool.m_task_done.wait(lk);
+        }
+        pool.m_num_waiting--;
+    }
+}
+
+/**
+ * Submits a function to run once the task has run, right away if it has already
+ * @param func Function to run
+ * @return Handle of the continuation
+ */
+Task Task::Then(std::function<void()> func) const {
+    std::shared_ptr<detail::TaskState> state = std::make_shared<detail::TaskState>();
+    state->func = std::move(func);
+    state->pool = m_state->pool;
+    state->done.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(m_state->lock);
+        if (!m_state->done.load(std::memory_order_relaxed)) {
+            m_state->continuations.push_back(state);
+            return Task(state);
+        }
+    }
+    m_state->pool->Enqueue(state);
+    return Task(state);
+}
+
+/**
+ * Starts the workers
+ * @param num_workers Number of worker threads, with none tasks run as they are submitted
+ */
+ThreadPool::ThreadPool(int num_workers)
+    : m_pending(0), m_next_queue(0), m_quit(false), m_num_waiting(0) {
+    for (int i = 0; i < num_workers; i++) {
+        m_queues.emplace_back(new Queue);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        m_workers.emplace_back(&ThreadPool::WorkerThread, this, i);
+    }
+}
+
+/// Runs the tasks still queued and stops the workers
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_quit = true;
+        m_wake.notify_all();
+    }
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Gets the pool shared by the whole emulator, started on first use with a worker per core
+ * besides the one running the emulation
+ * @return The shared pool
+ */
+ThreadPool& ThreadPool::GetShared() {
+    static ThreadPool pool(std::max(cpu_info.num_cores - 1, 1));
+    return pool;
+}
+
+/**
+ * Submits a function to run on a worker
+ * @param func Function to run
+ * @return Handle of the task
+ */
+Task ThreadPool::Submit(std::function<void()> func) {
+    std::shared_ptr<detail::TaskState> state = std::make_shared<detail::TaskState>();
+    state->func = std::move(func);
+    state->pool = this;
+    state->done.store(false, std::memory_order_relaxed);
+    Enqueue(state);
+    return Task(state);
+}
+
+/// Queues a task on the queue of the current worker, or on the next queue in turn
+void ThreadPool::Enqueue(TaskPtr task) {
+    if (m_workers.empty()) {
+        Run(task);
+        return;
+    }
+
+    const int index = t_pool == this ? t_index :
+        (int)(m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size());
+    {
+        std::lock_guard<std::mutex> lk(m_queues[index]->lock);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_wake.notify_one();
+    // Waiting threads help with the queued tasks too
+    if (m_num_waiting > 0) {
+        m_task_done.notify_all();
+    }
+}
+
+/**
+ * Takes a task to run, the newest of the worker's own queue or else the oldest of another queue
+ * @param index Index of the worker, -1 for other threads
+ * @return Task, nullptr if every queue is empty
+ */
+ThreadPool::TaskPtr ThreadPool::TakeTask(int index) {
+    TaskPtr task;
+    if (index >= 0) {
+        std::lock_guard<std::mutex> lk(m_queues[index]->lock);
+        if (!m_queues[index]->tasks.empty()) {
+            task = std::move(m_queues[index]->tasks.back());
+            m_queues[index]->tasks.pop_back();
+        }
+    }
+    const int num_queues = (int)m_queues.size();
+    for (int i = 1; task == nullptr && i <= num_queues; i++) {
+        Queue& victim = *m_queues[(index + i + num_queues) % num_queues];
+        std::lock_guard<std::mutex> lk(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (task != nullptr) {
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ * Runs a queued task on the calling thread
+ * @return True if there was one
+ */
+bool ThreadPool::RunPendingTask() {
+    if (m_pending.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    TaskPtr task = TakeTask(t_pool == this ? t_index : -1);
+    if (task == nullptr) {
+        return false;
+    }
+    Run(task);
+    return true;
+}
+
+/// Runs a task, then submits its continuations and wakes the threads waiting for it
+void ThreadPool::Run(const TaskPtr& task) {
+    task->func();
+    // Lets go of what the function holds, handles may keep the state alive for long
+    task->func = nullptr;
+
+    std::vector<TaskPtr> continuations;
+    {
+        std::lock_guard<std::mutex> lk(task->lock);
+        task->done.store(true, std::memory_order_release);
+        continuations.swap(task->continuations);
+    }
+    for (TaskPtr& continuation : continuations) {
+        Enqueue(std::move(continuation));
+    }
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (m_num_waiting > 0) {
+        m_task_done.notify_all();
+    }
+}
+
+/// Worker thread body: runs tasks until the pool quits with none left
+void ThreadPool::WorkerThread(int index) {
+    SetCurrentThreadName("Thread pool");
+    SetCurrentThreadPriority(PRIORITY_LOW);
+    // The pool may start after the emulation thread pinned itself, off its core
+    UnpinCurrentThread();
+    t_pool = this;
+    t_index = index;
+
+    for (;;) {
+        TaskPtr task = TakeTask(index);
+        if (task != nullptr) {
+            Run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(m_lock);
+        while (!m_quit && m_pending.load(std::memory_order_relaxed) == 0) {
+            m_wake.wait(lk);
+        }
+        if (m_quit && m_pending.load(std::memory_order_relaxed) == 0) {
+            break;
+        }
+    }
+}
+
+} // namespace
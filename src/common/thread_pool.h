@@ -0,0 +1,167 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "common/common.h"
+#include "common/thread.h"
+
+namespace Common {
+
+class ThreadPool;
+
+namespace detail {
+
+/// Shared state of a task: its function, whether it ran, and what to run once it has
+struct TaskState {
+    std::function<void()>                   func;
+    ThreadPool*                             pool;
+    std::atomic<bool>                       done;
+    std::mutex                              lock;           ///< Guards continuations
+    std::vector<std::shared_ptr<TaskState>> continuations;  ///< Submitted when the task is done
+};
+
+} // namespace detail
+
+/// Handle of a task submitted to a ThreadPool, copies refer to the same task
+class Task {
+public:
+    Task() {}
+
+    /// Whether the task ran, false for an empty handle
+    bool IsDone() const;
+
+    /// Waits for the task to run, running other tasks of the pool meanwhile
+    void Wait() const;
+
+    /**
+     * Submits a function to run once the task has run, right away if it has already
+     * @param func Function to run
+     * @return Handle of the continuation
+     */
+    Task Then(std::function<void()> func) const;
+
+private:
+    friend class ThreadPool;
+    explicit Task(std::shared_ptr<detail::TaskState> state) : m_state(std::move(state)) {}
+
+    std::shared_ptr<detail::TaskState> m_state;
+};
+
+/**
+ * Pool of worker threads running tasks. Each worker has its own queue: tasks submitted from a
+ * worker go to its queue, which it runs newest first, and idle workers steal the oldest tasks of
+ * the others. Tasks submitted from other threads are dealt out to the queues in turn. Waiting for a
+ * task runs other tasks instead of blocking, so tasks can wait for the tasks they submit.
+ */
+class ThreadPool : NonCopyable {
+public:
+    /**
+     * Starts the workers
+     * @param num_workers Number of worker threads, with none tasks run as they are submitted
+     */
+    explicit ThreadPool(int num_workers);
+
+    /// Runs the tasks still queued and stops the workers
+    ~ThreadPool();
+
+    /**
+     * Gets the pool shared by the whole emulator, started on first use with a worker per core
+     * besides the one running the emulation
+     * @return The shared pool
+     */
+    static ThreadPool& GetShared();
+
+    /// Gets the number of worker threads
+    int GetNumWorkers() const {
+        return (int)m_workers.size();
+    }
+
+    /**
+     * Submits a function to run on a worker
+     * @param func Function to run
+     * @return Handle of the task
+     */
+    Task Submit(std::function<void()> func);
+
+    /**
+     * Runs a function over a range split in chunks, on the workers and the calling thread, and
+     * waits for all of the chunks to be done
+     * @param begin First index of the range
+     * @param end Index past the range
+     * @param grain Number of indices of a chunk
+     * @param func Function called with the first index of a chunk and the index past it
+     */
+    template <typename Func>
+    void ParallelFor(int begin, int end, int grain, const Func& func) {
+        if (end <= begin) {
+            return;
+        }
+        grain = std::max(grain, 1);
+        const int num_chunks = (end - begin + grain - 1) / grain;
+        const int num_helpers = std::min(num_chunks, GetNumWorkers() + 1) - 1;
+        if (num_helpers <= 0) {
+            func(begin, end);
+            return;
+        }
+
+        // Every participant takes the next chunk until there is none left
+        std::atomic<int> next_chunk(0);
+        auto run_chunks = [&] {
+            for (;;) {
+                const int chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                if (chunk >= num_chunks) {
+                    break;
+                }
+                const int chunk_begin = begin + chunk * grain;
+                func(chunk_begin, std::min(chunk_begin + grain, end));
+            }
+        };
+        std::vector<Task> helpers;
+        helpers.reserve(num_helpers);
+        for (int i = 0; i < num_helpers; i++) {
+            helpers.push_back(Submit(run_chunks));
+        }
+        run_chunks();
+        for (const Task& helper : helpers) {
+            helper.Wait();
+        }
+    }
+
+private:
+    typedef std::shared_ptr<detail::TaskState> TaskPtr;
+
+    /// Queue of the tasks of a worker, the worker at the back and thieves at the front
+    struct Queue {
+        std::mutex          lock;
+        std::deque<TaskPtr> tasks;
+    };
+
+    friend class Task;
+
+    void Enqueue(TaskPtr task);
+    TaskPtr TakeTask(int index);
+    bool RunPendingTask();
+    void Run(const TaskPtr& task);
+    void WorkerThread(int index);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread>            m_workers;
+    std::atomic<int>                    m_pending;      ///< Tasks queued and not taken yet
+    std::atomic<unsigned>               m_next_queue;   ///< Queue of the next outside submission
+    bool                                m_quit;         ///< Guarded by m_lock
+    int                                 m_num_waiting;  ///< Threads in Task::Wait, by m_lock
+    std::mutex                          m_lock;
+    std::condition_variable             m_wake;         ///< Tasks to take, or quitting
+    std::condition_variable             m_task_done;    ///< Some task ran, for waits
+};
+
+} // namespace
@@ -8,11 +8,15 @@
 #include <Windows.h>
 #include <mmsystem.h>
 #include <sys/timeb.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#include <sys/time.h>
 #else
 #include <sys/time.h>
 #endif
 
 #include "common/common.h"
+#include "common/format_buffer.h"
 #include "common/timer.h"
 #include "common/string_util.h"
 
@@ -30,6 +34,80 @@ u32 Timer::GetTimeMs()
 #endif
 }
 
+// Nanoseconds of the monotonic clock
+u64 Timer::GetTimeNs()
+{
+#ifdef _WIN32
+    static const u64 frequency = []
+    {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        return (u64)f.QuadPart;
+    }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // Split so that the multiplication doesn't overflow after a few days of uptime
+    const u64 ticks = (u64)counter.QuadPart;
+    return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+#elif defined(__APPLE__)
+    static const mach_timebase_info_data_t timebase = []
+    {
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        return info;
+    }();
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+// -------------------------------------
+// Accumulators of durations
+// -------------------------------------
+
+TimeAccumulator::TimeAccumulator()
+{
+    for (Slot& slot : m_slots)
+    {
+        slot.time_ns.store(0, std::memory_order_relaxed);
+        slot.count.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Total of the durations added on all threads
+u64 TimeAccumulator::GetTotalNs() const
+{
+    u64 total = 0;
+    for (const Slot& slot : m_slots)
+        total += slot.time_ns.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Number of durations added on all threads
+u64 TimeAccumulator::GetCount() const
+{
+    u64 count = 0;
+    for (const Slot& slot : m_slots)
+        count += slot.count.load(std::memory_order_relaxed);
+    return count;
+}
+
+int TimeAccumulator::GetThreadSlot()
+{
+    static std::atomic<int> next_slot(0);
+#ifdef _MSC_VER
+    static __declspec(thread) int slot = -1;
+#else
+    static __thread int slot = -1;
+#endif
+    if (slot < 0)
+        slot = next_slot.fetch_add(1, std::memory_order_relaxed) % NUM_SLOTS;
+    return slot;
+}
+
 // --------------------------------------------
 // Initiate, Start, Stop, and Update the time
 // --------------------------------------------
@@ -115,7 +193,7 @@ std::string Timer::GetTimeElapsedFormatted() const
     u32 Hours = Minutes / 60;
 
     std::string TmpStr = StringFromFormat("%02i:%02i:%02i:%03i",
-        Hours, Minutes % 60, Seconds % 60, Milliseconds % 1000);
+        Hours, Minutes % 60, Seconds % 60, (u32)(Milliseconds % 1000));
     return TmpStr;
 }
 
@@ -166,10 +244,17 @@ u64 Timer::GetLocalTimeSinceJan1970()
 // Return the current time formatted as Minutes:Seconds:Milliseconds
 // in the form 00:00:000.
 std::string Timer::GetTimeFormatted()
+{
+    FixedFormatBuffer<13> formattedTime;
+    AppendTimeFormatted(formattedTime);
+    return std::string(formattedTime.c_str());
+}
+
+// Appends the time as GetTimeFormatted does, without allocating
+void Timer::AppendTimeFormatted(FormatBuffer& out)
 {
     time_t sysTime;
     struct tm * gmTime;
-    char formattedTime[13];
     char tmp[13];
 
     time(&sysTime);
@@ -181,14 +266,12 @@ std::string Timer::GetTimeFormatted()
 #ifdef _WIN32
     struct timeb tp;
     (void)::ftime(&tp);
-    sprintf(formattedTime, "%s:%03i", tmp, tp.millitm);
+    out.Append("%s:%03i", tmp, tp.millitm);
 #else
     struct timeval t;
     (void)gettimeofday(&t, NULL);
-    sprintf(formattedTime, "%s:%03d", tmp, (int)(t.tv_usec / 1000));
+    out.Append("%s:%03d", tmp, (int)(t.tv_usec / 1000));
 #endif
-
-    return std::string(formattedTime);
 }
 
 // Returns a timestamp with decimals for precise time comparisons
@@ -6,10 +6,13 @@
 #define _TIMER_H_
 
 #include "common/common.h"
+#include <atomic>
 #include <string>
 
 namespace Common
 {
+class FormatBuffer;
+
 class Timer
 {
 public:
@@ -30,17 +33,74 @@ public:
     static double GetDoubleTime();
 
     static std::string GetTimeFormatted();
+    static void AppendTimeFormatted(FormatBuffer& out);
     std::string GetTimeElapsedFormatted() const;
     u64 GetTimeElapsed();
 
     static u32 GetTimeMs();
 
+    // Monotonic clock with an arbitrary origin, unaffected by changes of the wall clock
+    static u64 GetTimeNs();
+    static u64 GetTimeUs() { return GetTimeNs() / 1000; }
+
 private:
     u64 m_LastTime;
     u64 m_StartTime;
     bool m_Running;
 };
 
+// Sum and count of durations measured on any number of threads. Each thread adds to a slot of its
+// own cache line, so timing a hot path on several threads doesn't bounce a shared counter around.
+// Totals are read from any thread, callers keep the previous totals to get the time of a period.
+class TimeAccumulator : NonCopyable
+{
+public:
+    TimeAccumulator();
+
+    void Add(u64 ns)
+    {
+        Slot& slot = m_slots[GetThreadSlot()];
+        slot.time_ns.fetch_add(ns, std::memory_order_relaxed);
+        slot.count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    u64 GetTotalNs() const;
+    u64 GetCount() const;
+
+private:
+    enum { NUM_SLOTS = 16 };
+
+    struct MEMORY_ALIGNED64_DECL(Slot)
+    {
+        std::atomic<u64> time_ns;
+        std::atomic<u64> count;
+    };
+
+    // Slot of the calling thread, threads past NUM_SLOTS share slots
+    static int GetThreadSlot();
+
+    Slot m_slots[NUM_SLOTS];
+};
+
+// Adds the time from its construction to its destruction to an accumulator
+class ScopedTimer : NonCopyable
+{
+public:
+    explicit ScopedTimer(TimeAccumulator& accumulator)
+        : m_accumulator(accumulator), m_start(Timer::GetTimeNs())
+    {
+    }
+
+    ~ScopedTimer()
+    {
+        m_accumulator.Add(Timer::GetTimeNs() - m_start);
+    }
+
+private:
+    TimeAccumulator& m_accumulator;
+    u64 m_start;
+};
+
 } // Namespace Common
 
 #endif // _TIMER_H_
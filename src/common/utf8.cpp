@@ -27,6 +27,7 @@
 #include <string>
 
 #include "common/common_types.h"
+#include "common/string_util.h"
 #include "common/utf8.h"
 
 // is start of UTF sequence
@@ -421,42 +422,33 @@ bool UTF8StringHasNonASCII(const char *utf8string) {
 
 #ifdef _WIN32
 
+// wchar_t is UTF-16 on Windows, the converters of string_util take it as it is
+
 std::string ConvertWStringToUTF8(const wchar_t *wstr) {
-    int len = (int)wcslen(wstr);
-    int size = (int)WideCharToMultiByte(CP_UTF8, 0, wstr, len, 0, 0, NULL, NULL);
-    std::string s;
-    s.resize(size);
-    if (size > 0) {
-        WideCharToMultiByte(CP_UTF8, 0, wstr, len, &s[0], size, NULL, NULL);
-    }
+    const size_t len = wcslen(wstr);
+    std::string s(len * 3, '\0');
+    s.resize(UTF16ToUTF8((const u16 *)wstr, len, &s[0], s.size()));
     return s;
 }
 
 std::string ConvertWStringToUTF8(const std::wstring &wstr) {
-    int len = (int)wstr.size();
-    int size = (int)WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), len, 0, 0, NULL, NULL);
-    std::string s;
-    s.resize(size);
-    if (size > 0) {
-        WideCharToMultiByte(CP_UTF8, 0, wstr.c_str(), len, &s[0], size, NULL, NULL);
-    }
+    std::string s(wstr.size() * 3, '\0');
+    s.resize(UTF16ToUTF8((const u16 *)wstr.data(), wstr.size(), &s[0], s.size()));
     return s;
 }
 
 void ConvertUTF8ToWString(wchar_t *dest, size_t destSize, const std::string &source) {
-    int len = (int)source.size();
-    int size = (int)MultiByteToWideChar(CP_UTF8, 0, source.c_str(), len, NULL, 0);
-    MultiByteToWideChar(CP_UTF8, 0, source.c_str(), len, dest, std::min((int)destSize, size));
+    if (destSize == 0) {
+        return;
+    }
+    // Terminated, the paths it converts go straight to the Win32 calls
+    const size_t size = UTF8ToUTF16(source.data(), source.size(), (u16 *)dest, destSize - 1);
+    dest[size] = 0;
 }
 
 std::wstring ConvertUTF8ToWString(const std::string &source) {
-    int len = (int)source.size();
-    int size = (int)MultiByteToWideChar(CP_UTF8, 0, source.c_str(), len, NULL, 0);
-    std::wstring str;
-    str.resize(size);
-    if (size > 0) {
-        MultiByteToWideChar(CP_UTF8, 0, source.c_str(), len, &str[0], size);
-    }
+    std::wstring str(source.size(), L'\0');
+    str.resize(UTF8ToUTF16(source.data(), source.size(), (u16 *)&str[0], str.size()));
     return str;
 }
 
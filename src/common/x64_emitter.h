@@ -0,0 +1,403 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace JIT {
+
+/// x86-64 general purpose registers used by the translator
+enum X64Reg {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSP = 4,
+    RBP = 5,
+    RSI = 6,
+    RDI = 7,
+};
+
+/// SSE registers. Only the ones that are caller-saved in both host ABIs are listed.
+enum X64XmmReg {
+    XMM0 = 0,
+    XMM1 = 1,
+    XMM2 = 2,
+    XMM3 = 3,
+    XMM4 = 4,
+    XMM5 = 5,
+};
+
+/// First integer argument of a function: the ARMul_State pointer of a translated block
+#ifdef _WIN32
+const X64Reg ABI_PARAM1 = RCX;
+#else
+const X64Reg ABI_PARAM1 = RDI;
+#endif
+
+/// Two-operand integer ALU operations, encoded by their /r opcode
+enum X64AluOp {
+    ALU_ADD = 0x01,
+    ALU_OR  = 0x09,
+    ALU_AND = 0x21,
+    ALU_SUB = 0x29,
+    ALU_XOR = 0x31,
+    ALU_CMP = 0x39,
+};
+
+/// Conditions of Jcc, encoded by their 0F 8x opcode
+enum X64CondCode {
+    CC_Z    = 0x4,
+    CC_NZ   = 0x5,
+    CC_L    = 0xC,
+};
+
+/// Shift/rotate operations, encoded by their C1 /digit extension
+enum X64ShiftOp {
+    SHIFT_ROR = 1,
+    SHIFT_SHL = 4,
+    SHIFT_SHR = 5,
+    SHIFT_SAR = 7,
+};
+
+/// Packed single precision SSE operations, encoded by their 0F xx opcode
+enum X64SSEOp {
+    SSE_SQRTPS  = 0x51,
+    SSE_ANDPS   = 0x54,
+    SSE_ANDNPS  = 0x55,
+    SSE_ORPS    = 0x56,
+    SSE_XORPS   = 0x57,
+    SSE_ADDPS   = 0x58,
+    SSE_MULPS   = 0x59,
+    SSE_CVTDQ2PS = 0x5B,
+    SSE_SUBPS   = 0x5C,
+    SSE_MINPS   = 0x5D,
+    SSE_DIVPS   = 0x5E,
+    SSE_MAXPS   = 0x5F,
+};
+
+/// Predicates of CMPPS
+enum X64CmpPredicate {
+    CMP_EQ      = 0,
+    CMP_LT      = 1,
+    CMP_LE      = 2,
+    CMP_NEQ     = 4,
+    CMP_NLT     = 5,
+    CMP_NLE     = 6,
+};
+
+/**
+ * Minimal x86-64 code emitter. Only the handful of 32-bit register/memory and packed single
+ * SSE forms needed by the ARM translator and the shader JIT are supported; memory operands are
+ * always [base + disp32], [base + index + disp32] or RIP-relative.
+ */
+class X64Emitter {
+public:
+    X64Emitter() : code(nullptr), end(nullptr) {
+    }
+
+    /**
+     * Sets the buffer that subsequent instructions are written to
+     * @param ptr Start of the buffer
+     * @param size Size of the buffer in bytes
+     */
+    void SetCodePtr(u8* ptr, size_t size) {
+        code = ptr;
+        end = ptr + size;
+    }
+
+    /// Returns the address the next instruction will be written to
+    u8* GetCodePtr() const {
+        return code;
+    }
+
+    /**
+     * Checks whether the buffer still has room for a given amount of code
+     * @param size Number of bytes required
+     * @return True if at least size bytes are left
+     */
+    bool HasSpace(size_t size) const {
+        return code + size <= end;
+    }
+
+    /// mov dst, dword [base + disp]
+    void MOV_Load(X64Reg dst, X64Reg base, s32 disp) {
+        Write8(0x8B);
+        WriteModRMDisp32(dst, base, disp);
+    }
+
+    /// mov dword [base + disp], src
+    void MOV_Store(X64Reg base, s32 disp, X64Reg src) {
+        Write8(0x89);
+        WriteModRMDisp32(src, base, disp);
+    }
+
+    /// mov dst, imm32
+    void MOV_Imm(X64Reg dst, u32 imm) {
+        Write8(0xB8 + dst);
+        Write32(imm);
+    }
+
+    /// mov dst, qword [base + disp]
+    void MOV_Load64(X64Reg dst, X64Reg base, s32 disp) {
+        Write8(0x48);
+        Write8(0x8B);
+        WriteModRMDisp32(dst, base, disp);
+    }
+
+    /// mov dst, imm64 (the immediate is the last 8 bytes of the instruction)
+    void MOV_Imm64(X64Reg dst, u64 imm) {
+        Write8(0x48);
+        Write8(0xB8 + dst);
+        Write32((u32)imm);
+        Write32((u32)(imm >> 32));
+    }
+
+    /// mov dst, dword/qword [base + index + disp]
+    void MOV_LoadIndexed(X64Reg dst, X64Reg base, X64Reg index, s32 disp, bool wide) {
+        if (wide) {
+            Write8(0x48);
+        }
+        Write8(0x8B);
+        WriteModRMIndexed(dst, base, index, disp);
+    }
+
+    /// mov dword/qword [base + index + disp], src
+    void MOV_StoreIndexed(X64Reg base, X64Reg index, s32 disp, X64Reg src, bool wide) {
+        if (wide) {
+            Write8(0x48);
+        }
+        Write8(0x89);
+        WriteModRMIndexed(src, base, index, disp);
+    }
+
+    /// cmp reg, dword [base + index + disp]
+    void CMP_LoadIndexed(X64Reg reg, X64Reg base, X64Reg index, s32 disp) {
+        Write8(0x3B);
+        WriteModRMIndexed(reg, base, index, disp);
+    }
+
+    /// op dst, imm32 (32-bit)
+    void ALU_Imm(X64AluOp op, X64Reg dst, u32 imm) {
+        Write8(0x81);
+        Write8(0xC0 | (op & 0x38) | dst);
+        Write32(imm);
+    }
+
+    /// op dword/qword [base + disp], imm32 (sign extended when wide)
+    void ALU_MemImm(X64AluOp op, X64Reg base, s32 disp, u32 imm, bool wide = false) {
+        if (wide) {
+            Write8(0x48);
+        }
+        Write8(0x81);
+        WriteModRMDisp32((op & 0x38) >> 3, base, disp);
+        Write32(imm);
+    }
+
+    /// test dst, imm32 (32-bit)
+    void TEST_Imm(X64Reg dst, u32 imm) {
+        Write8(0xF7);
+        Write8(0xC0 | dst);
+        Write32(imm);
+    }
+
+    /// test dst, dst (64-bit)
+    void TEST_Self64(X64Reg dst) {
+        Write8(0x48);
+        Write8(0x85);
+        Write8(0xC0 | (dst << 3) | dst);
+    }
+
+    /// test byte [base + disp], imm8
+    void TEST_MemImm8(X64Reg base, s32 disp, u8 imm) {
+        Write8(0xF6);
+        WriteModRMDisp32(0, base, disp);
+        Write8(imm);
+    }
+
+    /**
+     * Emits a conditional jump whose target is set later with SetJumpTarget
+     * @param cond Condition of the jump
+     * @return Address of the rel32 displacement of the jump
+     */
+    u8* J_CC(X64CondCode cond) {
+        Write8(0x0F);
+        Write8(0x80 | cond);
+        u8* rel = code;
+        Write32(0);
+        return rel;
+    }
+
+    /**
+     * Points a jump emitted by J_CC at its target
+     * @param rel Address returned by J_CC
+     * @param target Code the jump goes to
+     */
+    static void SetJumpTarget(u8* rel, const u8* target) {
+        const u32 disp = (u32)(target - (rel + 4));
+        rel[0] = disp & 0xFF;
+        rel[1] = (disp >> 8) & 0xFF;
+        rel[2] = (disp >> 16) & 0xFF;
+        rel[3] = (disp >> 24) & 0xFF;
+    }
+
+    /// jmp target (5 bytes, rel32 within 2GB of the code)
+    void JMP(const u8* target) {
+        Write8(0xE9);
+        Write32((u32)(target - (code + 4)));
+    }
+
+    /// jmp dst (64-bit)
+    void JMP_Reg(X64Reg dst) {
+        Write8(0xFF);
+        Write8(0xC0 | (4 << 3) | dst);
+    }
+
+    /// op dst, src (32-bit)
+    void ALU_Reg(X64AluOp op, X64Reg dst, X64Reg src) {
+        Write8(op);
+        Write8(0xC0 | (src << 3) | dst);
+    }
+
+    /// shl/shr/sar/ror dst, imm8 (32-bit)
+    void SHIFT_Imm(X64ShiftOp op, X64Reg dst, u8 amount) {
+        Write8(0xC1);
+        Write8(0xC0 | (op << 3) | dst);
+        Write8(amount);
+    }
+
+    /// not dst (32-bit)
+    void NOT(X64Reg dst) {
+        Write8(0xF7);
+        Write8(0xC0 | (2 << 3) | dst);
+    }
+
+    /// ret
+    void RET() {
+        Write8(0xC3);
+    }
+
+    /// movups dst, [base + disp]
+    void MOVUPS_Load(X64XmmReg dst, X64Reg base, s32 disp) {
+        Write8(0x0F);
+        Write8(0x10);
+        WriteModRMDisp32(dst, base, disp);
+    }
+
+    /// movups [base + disp], src
+    void MOVUPS_Store(X64Reg base, s32 disp, X64XmmReg src) {
+        Write8(0x0F);
+        Write8(0x11);
+        WriteModRMDisp32(src, base, disp);
+    }
+
+    /// movaps dst, src
+    void MOVAPS_Reg(X64XmmReg dst, X64XmmReg src) {
+        Write8(0x0F);
+        Write8(0x28);
+        Write8(0xC0 | (dst << 3) | src);
+    }
+
+    /// op dst, src (packed single)
+    void SSE_Reg(X64SSEOp op, X64XmmReg dst, X64XmmReg src) {
+        Write8(0x0F);
+        Write8(op);
+        Write8(0xC0 | (dst << 3) | src);
+    }
+
+    /// op dst, [rip + target] (packed single, target must be 16 byte aligned)
+    void SSE_Rip(X64SSEOp op, X64XmmReg dst, const void* target) {
+        Write8(0x0F);
+        Write8(op);
+        WriteModRMRip(dst, target, 0);
+    }
+
+    /// cmpps dst, src, predicate
+    void CMPPS_Reg(X64XmmReg dst, X64XmmReg src, X64CmpPredicate predicate) {
+        Write8(0x0F);
+        Write8(0xC2);
+        Write8(0xC0 | (dst << 3) | src);
+        Write8(predicate);
+    }
+
+    /// cmpps dst, [rip + target], predicate (target must be 16 byte aligned)
+    void CMPPS_Rip(X64XmmReg dst, const void* target, X64CmpPredicate predicate) {
+        Write8(0x0F);
+        Write8(0xC2);
+        WriteModRMRip(dst, target, 1);
+        Write8(predicate);
+    }
+
+    /// cvttps2dq dst, src
+    void CVTTPS2DQ(X64XmmReg dst, X64XmmReg src) {
+        Write8(0xF3);
+        Write8(0x0F);
+        Write8(0x5B);
+        Write8(0xC0 | (dst << 3) | src);
+    }
+
+    /**
+     * Copies raw data (e.g. constants addressed RIP-relative) to the code buffer
+     * @param data Data to copy
+     * @param size Size of the data in bytes
+     */
+    void WriteData(const void* data, size_t size) {
+        const u8* bytes = (const u8*)data;
+        for (size_t i = 0; i < size; i++) {
+            Write8(bytes[i]);
+        }
+    }
+
+    /**
+     * Pads the code buffer with int3 up to a power of two boundary
+     * @param alignment Alignment in bytes
+     */
+    void AlignCode(size_t alignment) {
+        while (((size_t)code & (alignment - 1)) != 0) {
+            Write8(0xCC);
+        }
+    }
+
+private:
+    void Write8(u8 value) {
+        *code++ = value;
+    }
+
+    void Write32(u32 value) {
+        Write8(value & 0xFF);
+        Write8((value >> 8) & 0xFF);
+        Write8((value >> 16) & 0xFF);
+        Write8((value >> 24) & 0xFF);
+    }
+
+    /// Writes a mod=10 ModRM byte for [base + disp32] (base must not be RSP/RBP)
+    void WriteModRMDisp32(int reg, X64Reg base, s32 disp) {
+        Write8(0x80 | (reg << 3) | base);
+        Write32((u32)disp);
+    }
+
+    /// Writes a mod=10 ModRM and SIB byte for [base + index + disp32] (index must not be RSP)
+    void WriteModRMIndexed(int reg, X64Reg base, X64Reg index, s32 disp) {
+        Write8(0x84 | (reg << 3));
+        Write8((index << 3) | base);
+        Write32((u32)disp);
+    }
+
+    /**
+     * Writes a RIP-relative ModRM byte and displacement
+     * @param reg Register field
+     * @param target Address referenced by the instruction (within 2GB of the code)
+     * @param trailing_bytes Bytes of the instruction after the displacement (immediates)
+     */
+    void WriteModRMRip(int reg, const void* target, int trailing_bytes) {
+        Write8(0x05 | (reg << 3));
+        Write32((u32)((const u8*)target - (code + 4 + trailing_bytes)));
+    }
+
+    u8* code;   ///< Current write position
+    u8* end;    ///< End of the code buffer
+};
+
+} // namespace
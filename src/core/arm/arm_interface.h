@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "common/common.h"
 #include "common/common_types.h"
 
+#include "core/arm/arm_profiler.h"
 #include "core/hle/svc.h"
 
 /// Generic ARM11 CPU interface
@@ -14,9 +17,11 @@ class ARM_Interface : NonCopyable {
 public:
     ARM_Interface() {
         num_instructions = 0;
+        profiler = nullptr;
     }
 
-    ~ARM_Interface() {
+    virtual ~ARM_Interface() {
+        delete profiler;
     }
 
     /**
@@ -24,8 +29,20 @@ public:
      * @param num_instructions Number of instructions to run
      */
     void Run(int num_instructions) {
-        ExecuteInstructions(num_instructions);
-        this->num_instructions += num_instructions;
+        // With the profiler on, stop at each sampling point on the way
+        while (profiler != nullptr && num_instructions > 0) {
+            int chunk = std::min(num_instructions, profiler->GetCountdown());
+            int executed = ExecuteInstructions(chunk);
+            this->num_instructions += executed;
+            profiler->Advance(executed, GetPC(), GetReg(14));
+            if (executed < chunk) {
+                return;
+            }
+            num_instructions -= executed;
+        }
+        if (num_instructions > 0) {
+            this->num_instructions += ExecuteInstructions(num_instructions);
+        }
     }
 
     /// Step CPU by one instruction
@@ -72,7 +89,7 @@ public:
     virtual void SetCPSR(u32 cpsr) = 0;
 
     /**
-     * Returns the number of clock ticks since the last rese
+     * Returns the number of clock ticks since the last reset. CoreTiming is ticked by them.
      * @return Returns number of clock ticks
      */
     virtual u64 GetTicks() const = 0;
@@ -84,26 +101,88 @@ public:
     virtual void SaveContext(ThreadContext& ctx) = 0;
 
     /**
-     * Loads a CPU context
+     * Loads a CPU context. The VFP registers may be loaded lazily, so the context has to stay
+     * alive and unchanged while it's the current one.
      * @param ctx Thread context to load
      */
     virtual void LoadContext(const ThreadContext& ctx) = 0;
 
+    /**
+     * Loads a CPU context that needn't outlive the call, such as one read from a savestate. The
+     * VFP registers are loaded right away, and the contexts of threads are read again the next
+     * time they're loaded.
+     * @param ctx Thread context to load
+     */
+    virtual void LoadTransientContext(const ThreadContext& ctx) = 0;
+
+    /// Stops the current Run() at the end of the instruction being executed (e.g. from an SVC)
+    virtual void PrepareReschedule() = 0;
+
+    /**
+     * Tells whether the last Run() stopped early at a breakpoint or watchpoint of Core
+     * @return True if it did, the instruction at the breakpoint is run first by the next Run()
+     */
+    virtual bool IsStoppedForDebugger() const {
+        return false;
+    }
+
+    /**
+     * Keeps translated code of a title on disk, reusing what earlier runs translated from code
+     * that didn't change since. Cores that don't translate code ignore it.
+     * @param filename Path of the translation cache file
+     * @param title_id Identity of the title loaded, entries of other titles are ignored
+     */
+    virtual void OpenTranslationCache(const std::string& filename, u64 title_id) {
+    }
+
+    /**
+     * Translates up front all of the code the translation cache has valid blocks for, so that
+     * execution starts without going through the cache block by block. Cores that don't translate
+     * code ignore it.
+     */
+    virtual void WarmUp() {
+    }
+
     /// Getter for num_instructions
     u64 GetNumInstructions() {
         return num_instructions;
     }
 
+    /**
+     * Starts sampling the guest PC, discarding the samples of an earlier profiling run
+     * @param interval Number of instructions between samples
+     */
+    void EnableProfiling(int interval = ARM_Profiler::DEFAULT_INTERVAL) {
+        delete profiler;
+        profiler = new ARM_Profiler(interval);
+    }
+
+    /// Stops sampling the guest PC and discards the samples
+    void DisableProfiling() {
+        delete profiler;
+        profiler = nullptr;
+    }
+
+    /**
+     * Gets the sampling profiler of this core
+     * @return The profiler, nullptr if profiling is disabled
+     */
+    const ARM_Profiler* GetProfiler() const {
+        return profiler;
+    }
+
 protected:
     
     /**
      * Executes the given number of instructions
      * @param num_instructions Number of instructions to executes
+     * @return Number of instructions executed, fewer than requested after PrepareReschedule
      */
-    virtual void ExecuteInstructions(int num_instructions) = 0;
+    virtual int ExecuteInstructions(int num_instructions) = 0;
 
 private:
 
     u64 num_instructions; ///< Number of instructions executed
+    ARM_Profiler* profiler; ///< Guest PC sampling profiler, nullptr when profiling is disabled
 
 };
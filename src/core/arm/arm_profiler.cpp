@@ -0,0 +1,176 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <map>
+
+#include "common/file_util.h"
+#include "common/log.h"
+#include "common/string_util.h"
+#include "common/symbols.h"
+
+#include "core/arm/arm_profiler.h"
+
+/**
+ * Constructor
+ * @param interval Number of instructions between samples
+ */
+ARM_Profiler::ARM_Profiler(int interval) : next_sample(0), interval(std::max(interval, 1)) {
+    countdown = this->interval;
+}
+
+/**
+ * Accounts instructions executed by the core, takes a sample if they reach the sampling point
+ * @param num_instructions Number of instructions executed, at most GetCountdown()
+ * @param pc Current guest PC
+ * @param lr Current guest LR
+ */
+void ARM_Profiler::Advance(int num_instructions, u32 pc, u32 lr) {
+    countdown -= num_instructions;
+    if (countdown > 0) {
+        return;
+    }
+    countdown = interval;
+
+    Sample sample = { pc, lr };
+    if (samples.size() < RING_SIZE) {
+        samples.push_back(sample);
+    } else {
+        samples[next_sample] = sample;
+    }
+    next_sample = (next_sample + 1) % RING_SIZE;
+}
+
+/// Discards all samples taken so far
+void ARM_Profiler::Clear() {
+    samples.clear();
+    next_sample = 0;
+    countdown = interval;
+}
+
+/**
+ * Gets the samples in the ring buffer
+ * @return Samples, oldest first
+ */
+std::vector<ARM_Profiler::Sample> ARM_Profiler::GetSamples() const {
+    if (samples.size() < RING_SIZE) {
+        return samples;
+    }
+    std::vector<Sample> ordered(samples.begin() + next_sample, samples.end());
+    ordered.insert(ordered.end(), samples.begin(), samples.begin() + next_sample);
+    return ordered;
+}
+
+namespace {
+
+/// Samples aggregated for one function
+struct FunctionProfile {
+    FunctionProfile() : self(0), total(0) {
+    }
+    std::string name;
+    u32 self;   ///< Samples with the PC in the function
+    u32 total;  ///< Samples with the PC or the LR in the function
+};
+
+/**
+ * Finds the function an address belongs to
+ * @param address Guest address
+ * @param name Set to the name of the function
+ * @return Start address of the function, the address itself if no symbol covers it
+ */
+u32 GetFunction(u32 address, std::string& name) {
+    u32 start = address;
+    const std::string& symbol_name = Symbols::GetNameContaining(address, start);
+    if (symbol_name.empty()) {
+        name = StringFromFormat("0x%08X", address);
+        return address;
+    }
+    name = symbol_name;
+    return start;
+}
+
+} // namespace
+
+/**
+ * Writes a flat profile: samples per function, sorted by self time
+ * @param filename Path of the text file to write
+ * @return True on success
+ */
+bool ARM_Profiler::WriteFlatProfile(const std::string& filename) const {
+    std::map<u32, FunctionProfile> functions;
+    std::string name;
+
+    for (const Sample& sample : samples) {
+        u32 pc_function = GetFunction(sample.pc, name);
+        FunctionProfile& callee = functions[pc_function];
+        callee.name = name;
+        callee.self++;
+        callee.total++;
+
+        u32 lr_function = GetFunction(sample.lr, name);
+        if (lr_function != pc_function) {
+            FunctionProfile& caller = functions[lr_function];
+            caller.name = name;
+            caller.total++;
+        }
+    }
+
+    std::vector<const FunctionProfile*> sorted;
+    for (const auto& function : functions) {
+        sorted.push_back(&function.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const FunctionProfile* a, const FunctionProfile* b) {
+        return a->self != b->self ? a->self > b->self : a->total > b->total;
+    });
+
+    File::IOFile file(filename, "w");
+    if (!file.IsOpen()) {
+        ERROR_LOG(ARM11, "couldn't open %s for writing", filename.c_str());
+        return false;
+    }
+
+    const double percent = samples.empty() ? 0.0 : 100.0 / samples.size();
+    std::string text = StringFromFormat("# %u samples, one every %d instructions\n"
+        "#     self  self%%    total total%%  function\n", (u32)samples.size(), interval);
+    for (const FunctionProfile* function : sorted) {
+        text += StringFromFormat("%10u %6.2f %8u %6.2f  %s\n", function->self,
+            function->self * percent, function->total, function->total * percent,
+            function->name.c_str());
+    }
+    return file.WriteBytes(text.data(), text.size());
+}
+
+/**
+ * Writes the samples in the legacy binary CPU profile format read by pprof, with a two entry
+ * call stack (PC, LR) per sample. The sampling period is given in instructions.
+ * @param filename Path of the file to write
+ * @return True on success
+ */
+bool ARM_Profiler::WritePprofProfile(const std::string& filename) const {
+    // Identical stacks are merged into a single record with a sample count
+    std::map<std::pair<u32, u32>, u64> stacks;
+    for (const Sample& sample : samples) {
+        stacks[std::make_pair(sample.pc, sample.lr)]++;
+    }
+
+    // Header words: header count, header size, format version, sampling period, padding
+    std::vector<u64> words = { 0, 3, 0, (u64)interval, 0 };
+    for (const auto& stack : stacks) {
+        words.push_back(stack.second);
+        words.push_back(2);
+        words.push_back(stack.first.first);
+        words.push_back(stack.first.second);
+    }
+    // Trailer: a record of count 0 and depth 1
+    words.push_back(0);
+    words.push_back(1);
+    words.push_back(0);
+
+    File::IOFile file(filename, "wb");
+    if (!file.IsOpen()) {
+        ERROR_LOG(ARM11, "couldn't open %s for writing", filename.c_str());
+        return false;
+    }
+    return file.WriteArray(words.data(), words.size());
+}
@@ -0,0 +1,85 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common.h"
+#include "common/common_types.h"
+
+/**
+ * Sampling profiler for an ARM core. The core stops every few instructions to have its guest PC
+ * and LR recorded into a fixed-size ring buffer, which keeps the most recent samples once it's
+ * full. Samples are aggregated per function of the loaded symbol map when the profile is written.
+ */
+class ARM_Profiler : NonCopyable {
+public:
+    /// Guest state recorded at a sampling point
+    struct Sample {
+        u32 pc; ///< Address of the next instruction
+        u32 lr; ///< Link register, the return address into the caller unless it was reused
+    };
+
+    enum {
+        DEFAULT_INTERVAL    = 10000,    ///< Default number of instructions between samples
+        RING_SIZE           = 0x40000,  ///< Number of samples kept
+    };
+
+    /**
+     * Constructor
+     * @param interval Number of instructions between samples
+     */
+    ARM_Profiler(int interval = DEFAULT_INTERVAL);
+
+    /// Number of instructions left until the next sample
+    int GetCountdown() const {
+        return countdown;
+    }
+
+    /// Number of instructions between samples
+    int GetInterval() const {
+        return interval;
+    }
+
+    /**
+     * Accounts instructions executed by the core, takes a sample if they reach the sampling point
+     * @param num_instructions Number of instructions executed, at most GetCountdown()
+     * @param pc Current guest PC
+     * @param lr Current guest LR
+     */
+    void Advance(int num_instructions, u32 pc, u32 lr);
+
+    /// Discards all samples taken so far
+    void Clear();
+
+    /**
+     * Gets the samples in the ring buffer
+     * @return Samples, oldest first
+     */
+    std::vector<Sample> GetSamples() const;
+
+    /**
+     * Writes a flat profile: samples per function, sorted by self time
+     * @param filename Path of the text file to write
+     * @return True on success
+     */
+    bool WriteFlatProfile(const std::string& filename) const;
+
+    /**
+     * Writes the samples in the legacy binary CPU profile format read by pprof, with a two entry
+     * call stack (PC, LR) per sample. The sampling period is given in instructions.
+     * @param filename Path of the file to write
+     * @return True on success
+     */
+    bool WritePprofProfile(const std::string& filename) const;
+
+private:
+
+    std::vector<Sample> samples;    ///< Ring buffer, RING_SIZE entries once it's full
+    u32 next_sample;                ///< Ring buffer slot the next sample goes to
+    int interval;                   ///< Number of instructions between samples
+    int countdown;                  ///< Number of instructions left until the next sample
+};
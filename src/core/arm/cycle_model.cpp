@@ -0,0 +1,282 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "core/mem_map.h"
+#include "core/arm/cycle_model.h"
+
+namespace CycleModel {
+
+u8 g_wait_states[NUM_REGIONS];
+
+namespace {
+
+/// Classes of instructions of the same base cost
+enum InstructionClass {
+    CLASS_DATA_PROCESSING,
+    CLASS_SHIFT_BY_REGISTER,        ///< Data processing with a register-specified shift
+    CLASS_MULTIPLY,
+    CLASS_MULTIPLY_LONG,            ///< 64-bit results and accumulators
+    CLASS_LOAD_STORE,
+    CLASS_LOAD_STORE_MULTIPLE,      ///< Plus a cycle per two further registers transferred
+    CLASS_BRANCH,
+    CLASS_COPROCESSOR,              ///< CP15 and VFP data processing and transfers
+    CLASS_VFP_DIVIDE,               ///< VFP divide and square root
+    CLASS_SOFTWARE_INTERRUPT,
+    NUM_CLASSES
+};
+
+/// Base cost of each instruction class, in cycles
+const u8 g_class_cycles[NUM_CLASSES] = {
+    1,  // CLASS_DATA_PROCESSING
+    2,  // CLASS_SHIFT_BY_REGISTER
+    2,  // CLASS_MULTIPLY
+    3,  // CLASS_MULTIPLY_LONG
+    1,  // CLASS_LOAD_STORE
+    1,  // CLASS_LOAD_STORE_MULTIPLE
+    3,  // CLASS_BRANCH, averaged over predicted and mispredicted branches
+    1,  // CLASS_COPROCESSOR
+    15, // CLASS_VFP_DIVIDE
+    8,  // CLASS_SOFTWARE_INTERRUPT
+};
+
+enum {
+    PC_WRITE_CYCLES     = 4,    ///< Pipeline refill when something other than a branch sets PC
+
+    FCRAM_WAIT_STATES   = 1,    ///< Main memory, mostly served by the data cache
+    VRAM_WAIT_STATES    = 2,
+    IO_WAIT_STATES      = 10,   ///< Uncached hardware registers
+};
+
+/**
+ * Gets the base cost of a load/store multiple
+ * @param count Number of registers transferred
+ * @return Number of cycles
+ */
+u32 GetMultipleCycles(u32 count) {
+    return g_class_cycles[CLASS_LOAD_STORE_MULTIPLE] + (count > 1 ? (count - 1) / 2 : 0);
+}
+
+/**
+ * Counts the registers of a register list
+ * @param list Register list, a bit per register
+ * @return Number of registers in the list
+ */
+u32 CountRegisters(u32 list) {
+    u32 count = 0;
+    for (; list != 0; list &= list - 1) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Sets the wait states of the regions covering an address range
+ * @param start First address of the range
+ * @param end Address after the last one of the range
+ * @param wait_states Wait states of a data access to the range
+ */
+void SetWaitStates(u32 start, u32 end, u8 wait_states) {
+    for (u32 region = start >> REGION_BITS; region <= (end - 1) >> REGION_BITS; region++) {
+        g_wait_states[region] = wait_states;
+    }
+}
+
+} // namespace
+
+/// Fills the wait state table from the memory map
+void Init() {
+    memset(g_wait_states, 0, sizeof(g_wait_states));
+
+    SetWaitStates(Memory::EXEFS_CODE_VADDR, Memory::EXEFS_CODE_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::SYSTEM_MEMORY_VADDR, Memory::SYSTEM_MEMORY_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::HEAP_VADDR, Memory::HEAP_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::SHARED_MEMORY_VADDR, Memory::SHARED_MEMORY_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::HEAP_GSP_VADDR, Memory::HEAP_GSP_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::CONFIG_MEMORY_VADDR, Memory::SHARED_PAGE_VADDR_END, FCRAM_WAIT_STATES);
+    SetWaitStates(Memory::KERNEL_MEMORY_VADDR, Memory::KERNEL_MEMORY_VADDR_END, FCRAM_WAIT_STATES);
+    // The IO range as mapped runs into VRAM, which takes precedence
+    SetWaitStates(Memory::HARDWARE_IO_VADDR, Memory::HARDWARE_IO_VADDR_END, IO_WAIT_STATES);
+    SetWaitStates(Memory::VRAM_VADDR, Memory::VRAM_VADDR_END, VRAM_WAIT_STATES);
+}
+
+/**
+ * Gets the base cost of an ARM instruction, without the wait states of the memory it accesses
+ * @param instr Instruction word
+ * @return Number of cycles
+ */
+u32 GetInstructionCycles(u32 instr) {
+    const bool load = (instr & (1 << 20)) != 0;
+    const u32 rd = (instr >> 12) & 0xF;
+
+    if ((instr >> 28) == 0xF) {
+        // Unconditional space: BLX <imm>, PLD and the system instructions
+        if (((instr >> 25) & 7) == 5) {
+            return g_class_cycles[CLASS_BRANCH];
+        }
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+    }
+
+    switch ((instr >> 25) & 7) {
+    case 0:
+        if ((instr & 0x90) == 0x90) {
+            // Multiplies and the extra load/store space
+            if ((instr & 0x60) != 0) {
+                return g_class_cycles[CLASS_LOAD_STORE];
+            }
+            if ((instr & 0x0FC000F0) == 0x00000090) {
+                return g_class_cycles[CLASS_MULTIPLY];
+            }
+            if ((instr & 0x0F8000F0) == 0x00800090 || (instr & 0x0FF000F0) == 0x00400090) {
+                return g_class_cycles[CLASS_MULTIPLY_LONG];
+            }
+            // SWP and the exclusive accesses
+            return g_class_cycles[CLASS_LOAD_STORE];
+        }
+        if ((instr & 0x0F900000) == 0x01000000) {
+            // Comparison encodings without S bit: MRS, MSR, BX, BLX, CLZ, halfword multiplies
+            if ((instr & 0x0FFFFFD0) == 0x012FFF10) {
+                return g_class_cycles[CLASS_BRANCH];
+            }
+            if ((instr & 0x0F900090) == 0x01000080) {
+                return g_class_cycles[CLASS_MULTIPLY];
+            }
+            return g_class_cycles[CLASS_DATA_PROCESSING];
+        }
+        {
+            u32 cycles = g_class_cycles[(instr & 0x10) ? CLASS_SHIFT_BY_REGISTER :
+                CLASS_DATA_PROCESSING];
+            // Comparisons don't write Rd
+            if (rd == 15 && (instr & 0x01800000) != 0x01000000) {
+                cycles += PC_WRITE_CYCLES;
+            }
+            return cycles;
+        }
+
+    case 1:
+        // MOVW, MOVT and MSR take the comparison encodings without S bit
+        if (rd == 15 && (instr & 0x01800000) != 0x01000000) {
+            return g_class_cycles[CLASS_DATA_PROCESSING] + PC_WRITE_CYCLES;
+        }
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+
+    case 3:
+        if (instr & 0x10) {
+            // Media instructions, the multiplies among them are those of the 0x07 opcode space
+            if ((instr & 0x0F000010) == 0x07000010) {
+                return g_class_cycles[CLASS_MULTIPLY];
+            }
+            return g_class_cycles[CLASS_DATA_PROCESSING];
+        }
+        // Fall through, register offset LDR/STR
+    case 2:
+        if (load && rd == 15) {
+            return g_class_cycles[CLASS_LOAD_STORE] + PC_WRITE_CYCLES;
+        }
+        return g_class_cycles[CLASS_LOAD_STORE];
+
+    case 4:
+        if (load && (instr & (1 << 15))) {
+            return GetMultipleCycles(CountRegisters(instr & 0xFFFF)) + PC_WRITE_CYCLES;
+        }
+        return GetMultipleCycles(CountRegisters(instr & 0xFFFF));
+
+    case 5:
+        return g_class_cycles[CLASS_BRANCH];
+
+    case 6:
+        // Coprocessor loads and stores (VLDR, VSTM...), the offset is the number of words
+        return GetMultipleCycles(instr & 0xFF);
+
+    case 7:
+    default:
+        if (instr & (1 << 24)) {
+            return g_class_cycles[CLASS_SOFTWARE_INTERRUPT];
+        }
+        if ((instr & 0x0FB00E50) == 0x0E800A00 || (instr & 0x0FBF0ED0) == 0x0EB10AC0) {
+            return g_class_cycles[CLASS_VFP_DIVIDE];
+        }
+        return g_class_cycles[CLASS_COPROCESSOR];
+    }
+}
+
+/**
+ * Gets the base cost of a Thumb instruction, without the wait states of the memory it accesses
+ * @param instr Instruction halfword
+ * @return Number of cycles
+ */
+u32 GetThumbInstructionCycles(u16 instr) {
+    switch (instr >> 12) {
+    case 0x0: case 0x1: case 0x2: case 0x3:
+        // Shifts by immediate, add/subtract, move/compare/add/subtract immediate
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+
+    case 0x4:
+        if ((instr & 0x0800) != 0) {
+            // PC-relative load
+            return g_class_cycles[CLASS_LOAD_STORE];
+        }
+        if ((instr & 0x0400) == 0) {
+            const u32 op = (instr >> 6) & 0xF;
+            if (op == 0xD) {
+                return g_class_cycles[CLASS_MULTIPLY];
+            }
+            // LSL, LSR, ASR and ROR by register
+            if (op == 0x2 || op == 0x3 || op == 0x4 || op == 0x7) {
+                return g_class_cycles[CLASS_SHIFT_BY_REGISTER];
+            }
+            return g_class_cycles[CLASS_DATA_PROCESSING];
+        }
+        // High register operations, BX and BLX
+        if ((instr & 0x0300) == 0x0300) {
+            return g_class_cycles[CLASS_BRANCH];
+        }
+        if ((instr & 0x0300) != 0x0100 && ((instr & 7) | ((instr >> 4) & 8)) == 15) {
+            return g_class_cycles[CLASS_DATA_PROCESSING] + PC_WRITE_CYCLES;
+        }
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+
+    case 0x5: case 0x6: case 0x7: case 0x8: case 0x9:
+        return g_class_cycles[CLASS_LOAD_STORE];
+
+    case 0xA:
+        // ADD to PC or SP
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+
+    case 0xB:
+        if ((instr & 0x0600) == 0x0400) {
+            // PUSH and POP, bit 8 adds LR or PC to the list
+            const u32 count = CountRegisters(instr & 0x1FF);
+            if ((instr & 0x0900) == 0x0900) {
+                return GetMultipleCycles(count) + PC_WRITE_CYCLES;
+            }
+            return GetMultipleCycles(count);
+        }
+        return g_class_cycles[CLASS_DATA_PROCESSING];
+
+    case 0xC:
+        return GetMultipleCycles(CountRegisters(instr & 0xFF));
+
+    case 0xD:
+        if ((instr & 0x0F00) == 0x0F00) {
+            return g_class_cycles[CLASS_SOFTWARE_INTERRUPT];
+        }
+        return g_class_cycles[CLASS_BRANCH];
+
+    case 0xE:
+        // B, and the second half of BLX <imm>
+        return g_class_cycles[CLASS_BRANCH];
+
+    case 0xF:
+    default:
+        // First half of BL/BLX sets up LR, the second half branches
+        if ((instr & 0x0800) == 0) {
+            return g_class_cycles[CLASS_DATA_PROCESSING];
+        }
+        return g_class_cycles[CLASS_BRANCH];
+    }
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Approximate ARM11 MPCore timing, used by both CPU backends to tick CoreTiming in cycles rather
+ * than in instructions. Each instruction is charged a base cost by class (data processing,
+ * multiply, load/store, load/store multiple, branch, coprocessor...) plus a pipeline refill when
+ * it writes the PC, and every data access is charged the wait states of the memory region it
+ * hits. The figures are averages over typical cache behavior, not a model of the caches.
+ */
+namespace CycleModel {
+
+enum {
+    REGION_BITS = 20,                       ///< Wait states are looked up per 1 MiB of memory
+    NUM_REGIONS = (1 << (32 - REGION_BITS)),
+};
+
+extern u8 g_wait_states[NUM_REGIONS];       ///< Wait states of a data access, by address region
+
+/// Fills the wait state table from the memory map
+void Init();
+
+/**
+ * Gets the base cost of an ARM instruction, without the wait states of the memory it accesses
+ * @param instr Instruction word
+ * @return Number of cycles
+ */
+u32 GetInstructionCycles(u32 instr);
+
+/**
+ * Gets the base cost of a Thumb instruction, without the wait states of the memory it accesses
+ * @param instr Instruction halfword
+ * @return Number of cycles
+ */
+u32 GetThumbInstructionCycles(u16 instr);
+
+/**
+ * Gets the wait states of a data access
+ * @param addr Guest virtual address accessed
+ * @return Number of cycles the access adds to the instruction
+ */
+inline u32 GetWaitStates(u32 addr) {
+    return g_wait_states[addr >> REGION_BITS];
+}
+
+} // namespace
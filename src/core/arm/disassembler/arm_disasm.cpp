@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <vector>
+
 #include "core/arm/disassembler/arm_disasm.h"
 
 static const char *cond_names[] = {
@@ -135,13 +137,28 @@ static const char* cond_to_str(int cond) {
     return cond_names[cond];
 }
 
-char *ARM_Disasm::disasm(uint32_t addr, uint32_t insn, char *result)
+char *ARM_Disasm::disasm(uint32_t addr, uint32_t insn, char *buffer)
 {
-    static char   buf[80];
-    char          *ptr;
+    ARM_Instruction instr;
+    decode_insn(addr, insn, &instr);
+    return format(instr, buffer);
+}
+
+char *ARM_Disasm::disasm_thumb(uint32_t addr, uint32_t insn1, uint32_t insn2, char *buffer)
+{
+    ARM_Instruction instr;
+    decode_insn_thumb(addr, insn1, insn2, &instr);
+    return format(instr, buffer);
+}
 
-    ptr = result ? result : buf;
-    Opcode opcode = decode(insn);
+char *ARM_Disasm::format(const ARM_Instruction &instr, char *ptr)
+{
+    if (instr.flags & ARM_Instruction::kThumb)
+        return disasm_thumb_insn(instr, ptr);
+
+    uint32_t addr = instr.address;
+    uint32_t insn = instr.insn;
+    Opcode opcode = instr.opcode;
     switch (opcode) {
         case OP_INVALID:
             sprintf(ptr, "Invalid");
@@ -172,8 +189,7 @@ char *ARM_Disasm::disasm(uint32_t addr, uint32_t insn, char *result)
         case OP_BKPT:
             return disasm_bkpt(insn, ptr);
         case OP_BLX:
-            // not supported yet
-            break;
+            return disasm_blx(instr, ptr);
         case OP_BX:
             return disasm_bx(insn, ptr);
         case OP_CDP:
@@ -343,6 +359,17 @@ char *ARM_Disasm::disasm_branch(uint32_t addr, Opcode opcode, uint32_t insn, cha
     return ptr;
 }
 
+char *ARM_Disasm::disasm_blx(const ARM_Instruction &instr, char *ptr)
+{
+    if (instr.flags & ARM_Instruction::kBranch) {
+        sprintf(ptr, "blx\t0x%x", instr.target);
+        return ptr;
+    }
+    uint8_t rm = instr.insn & 0xf;
+    sprintf(ptr, "blx%s\tr%d", cond_to_str(instr.cond), rm);
+    return ptr;
+}
+
 char *ARM_Disasm::disasm_bx(uint32_t insn, char *ptr)
 {
     uint8_t cond = (insn >> 28) & 0xf;
@@ -726,279 +753,512 @@ char *ARM_Disasm::disasm_swp(Opcode opcode, uint32_t insn, char *ptr)
     return ptr;
 }
 
-Opcode ARM_Disasm::decode(uint32_t insn) {
-    uint32_t bits27_26 = (insn >> 26) & 0x3;
-    switch (bits27_26) {
-        case 0x0:
-            return decode00(insn);
-        case 0x1:
-            return decode01(insn);
-        case 0x2:
-            return decode10(insn);
-        case 0x3:
-            return decode11(insn);
-    }
-    return OP_INVALID;
+// Decoding is table-driven: an instruction is looked up by some of its bits in a table of
+// buckets, each holding the few encoding patterns that can match those bits, tried in order.
+// Most buckets have a single pattern, whose mask is covered by the index bits.
+struct DecodePattern {
+    uint32_t mask;
+    uint32_t value;
+    Opcode opcode;
+};
+
+// Patterns of the ARM instructions, the first matching one wins
+static const DecodePattern arm_patterns[] = {
+    // Unconditional space
+    { 0xfd70f000, 0xf550f000, OP_PLD },
+    { 0xfe000000, 0xfa000000, OP_BLX },
+
+    // Miscellaneous instructions in the data processing space
+    { 0x0ffffff0, 0x012fff10, OP_BX },
+    { 0x0ffffff0, 0x012fff30, OP_BLX },
+    { 0x0ff000f0, 0x01600010, OP_CLZ },
+    { 0xfff000f0, 0xe1200070, OP_BKPT },
+
+    // Swaps and multiplies
+    { 0x0ff00ff0, 0x01000090, OP_SWP },
+    { 0x0ff00ff0, 0x01400090, OP_SWPB },
+    { 0x0fe000f0, 0x00000090, OP_MUL },
+    { 0x0fe000f0, 0x00200090, OP_MLA },
+    { 0x0fe000f0, 0x00800090, OP_UMULL },
+    { 0x0fe000f0, 0x00a00090, OP_UMLAL },
+    { 0x0fe000f0, 0x00c00090, OP_SMULL },
+    { 0x0fe000f0, 0x00e00090, OP_SMLAL },
+    { 0x0e0000f0, 0x00000090, OP_UNDEFINED },
+
+    // Load/store halfword and signed byte
+    { 0x0e1000f0, 0x001000b0, OP_LDRH },
+    { 0x0e1000f0, 0x001000d0, OP_LDRSB },
+    { 0x0e1000f0, 0x001000f0, OP_LDRSH },
+    { 0x0e1000f0, 0x000000b0, OP_STRH },
+    { 0x0e000090, 0x00000090, OP_UNDEFINED },
+
+    // Data processing, the comparisons without S bit are the status register transfers
+    { 0x0df00000, 0x01100000, OP_TST },
+    { 0x0df00000, 0x01300000, OP_TEQ },
+    { 0x0df00000, 0x01500000, OP_CMP },
+    { 0x0df00000, 0x01700000, OP_CMN },
+    { 0x0df00000, 0x01000000, OP_MRS },
+    { 0x0df00000, 0x01200000, OP_MSR },
+    { 0x0df00000, 0x01400000, OP_MRS },
+    { 0x0df00000, 0x01600000, OP_MSR },
+    { 0x0de00000, 0x00000000, OP_AND },
+    { 0x0de00000, 0x00200000, OP_EOR },
+    { 0x0de00000, 0x00400000, OP_SUB },
+    { 0x0de00000, 0x00600000, OP_RSB },
+    { 0x0de00000, 0x00800000, OP_ADD },
+    { 0x0de00000, 0x00a00000, OP_ADC },
+    { 0x0de00000, 0x00c00000, OP_SBC },
+    { 0x0de00000, 0x00e00000, OP_RSC },
+    { 0x0de00000, 0x01800000, OP_ORR },
+    { 0x0de00000, 0x01a00000, OP_MOV },
+    { 0x0de00000, 0x01c00000, OP_BIC },
+    { 0x0de00000, 0x01e00000, OP_MVN },
+
+    // Load/store word and unsigned byte
+    { 0x0e000010, 0x06000010, OP_UNDEFINED },
+    { 0x0c500000, 0x04500000, OP_LDRB },
+    { 0x0c500000, 0x04100000, OP_LDR },
+    { 0x0c500000, 0x04400000, OP_STRB },
+    { 0x0c500000, 0x04000000, OP_STR },
+
+    // Load/store multiple and branches
+    { 0x0e100000, 0x08100000, OP_LDM },
+    { 0x0e100000, 0x08000000, OP_STM },
+    { 0x0f000000, 0x0a000000, OP_B },
+    { 0x0f000000, 0x0b000000, OP_BL },
+
+    // Coprocessors and software interrupt, CP15 only has register transfers of opcode 0
+    { 0x0e100000, 0x0c100000, OP_LDC },
+    { 0x0e100000, 0x0c000000, OP_STC },
+    { 0x0f000000, 0x0f000000, OP_SWI },
+    { 0x0ff00f10, 0x0e100f10, OP_MRC },
+    { 0x0ff00f10, 0x0e000f10, OP_MCR },
+    { 0x0f000f00, 0x0e000f00, OP_UNDEFINED },
+    { 0x0f000010, 0x0e000000, OP_CDP },
+    { 0x0f100010, 0x0e100010, OP_MRC },
+    { 0x0f100010, 0x0e000010, OP_MCR },
+};
+
+// Patterns of the Thumb instructions, the first matching one wins
+static const DecodePattern thumb_patterns[] = {
+    // Shift by immediate, add/subtract
+    { 0xf800, 0x0000, OP_THUMB_LSL },
+    { 0xf800, 0x0800, OP_THUMB_LSR },
+    { 0xf800, 0x1000, OP_THUMB_ASR },
+    { 0xfa00, 0x1800, OP_THUMB_ADD },
+    { 0xfa00, 0x1a00, OP_THUMB_SUB },
+
+    // Move/compare/add/subtract immediate
+    { 0xf800, 0x2000, OP_THUMB_MOV },
+    { 0xf800, 0x2800, OP_THUMB_CMP },
+    { 0xf800, 0x3000, OP_THUMB_ADD },
+    { 0xf800, 0x3800, OP_THUMB_SUB },
+
+    // Data processing on low registers
+    { 0xffc0, 0x4000, OP_THUMB_AND },
+    { 0xffc0, 0x4040, OP_THUMB_EOR },
+    { 0xffc0, 0x4080, OP_THUMB_LSL },
+    { 0xffc0, 0x40c0, OP_THUMB_LSR },
+    { 0xffc0, 0x4100, OP_THUMB_ASR },
+    { 0xffc0, 0x4140, OP_THUMB_ADC },
+    { 0xffc0, 0x4180, OP_THUMB_SBC },
+    { 0xffc0, 0x41c0, OP_THUMB_ROR },
+    { 0xffc0, 0x4200, OP_THUMB_TST },
+    { 0xffc0, 0x4240, OP_THUMB_NEG },
+    { 0xffc0, 0x4280, OP_THUMB_CMP },
+    { 0xffc0, 0x42c0, OP_THUMB_CMN },
+    { 0xffc0, 0x4300, OP_THUMB_ORR },
+    { 0xffc0, 0x4340, OP_THUMB_MUL },
+    { 0xffc0, 0x4380, OP_THUMB_BIC },
+    { 0xffc0, 0x43c0, OP_THUMB_MVN },
+
+    // High register operations and branch exchange
+    { 0xff00, 0x4400, OP_THUMB_ADD },
+    { 0xff00, 0x4500, OP_THUMB_CMP },
+    { 0xff00, 0x4600, OP_THUMB_MOV },
+    { 0xff80, 0x4700, OP_THUMB_BX },
+    { 0xff80, 0x4780, OP_THUMB_BLX },
+
+    // Loads and stores
+    { 0xf800, 0x4800, OP_THUMB_LDR },
+    { 0xfe00, 0x5000, OP_THUMB_STR },
+    { 0xfe00, 0x5200, OP_THUMB_STRH },
+    { 0xfe00, 0x5400, OP_THUMB_STRB },
+    { 0xfe00, 0x5600, OP_THUMB_LDRSB },
+    { 0xfe00, 0x5800, OP_THUMB_LDR },
+    { 0xfe00, 0x5a00, OP_THUMB_LDRH },
+    { 0xfe00, 0x5c00, OP_THUMB_LDRB },
+    { 0xfe00, 0x5e00, OP_THUMB_LDRSH },
+    { 0xf800, 0x6000, OP_THUMB_STR },
+    { 0xf800, 0x6800, OP_THUMB_LDR },
+    { 0xf800, 0x7000, OP_THUMB_STRB },
+    { 0xf800, 0x7800, OP_THUMB_LDRB },
+    { 0xf800, 0x8000, OP_THUMB_STRH },
+    { 0xf800, 0x8800, OP_THUMB_LDRH },
+    { 0xf800, 0x9000, OP_THUMB_STR },
+    { 0xf800, 0x9800, OP_THUMB_LDR },
+
+    // Address generation and miscellaneous
+    { 0xf000, 0xa000, OP_THUMB_ADD },
+    { 0xff80, 0xb000, OP_THUMB_ADD },
+    { 0xff80, 0xb080, OP_THUMB_SUB },
+    { 0xfe00, 0xb400, OP_THUMB_PUSH },
+    { 0xfe00, 0xbc00, OP_THUMB_POP },
+    { 0xff00, 0xbe00, OP_THUMB_BKPT },
+
+    // Load/store multiple, branches and software interrupt
+    { 0xf800, 0xc000, OP_THUMB_STMIA },
+    { 0xf800, 0xc800, OP_THUMB_LDMIA },
+    { 0xff00, 0xde00, OP_THUMB_UNDEFINED },
+    { 0xff00, 0xdf00, OP_THUMB_SWI },
+    { 0xf000, 0xd000, OP_THUMB_B },
+    { 0xf800, 0xe000, OP_THUMB_B },
+    { 0xf800, 0xe800, OP_THUMB_BLX },
+    { 0xf000, 0xf000, OP_THUMB_BL },
+};
+
+// Buckets of patterns, indexed by some bits of the instruction
+class DecodeTable {
+ public:
+  // index_mask holds the bits of the instructions the buckets are indexed by, expand_index
+  // spreads the index of a bucket back to them
+  DecodeTable(const DecodePattern *patterns, int num_patterns, int num_buckets,
+              uint32_t (*expand_index)(uint32_t), uint32_t index_mask)
+      : patterns_(patterns), first_(num_buckets + 1)
+  {
+      for (int bucket = 0; bucket < num_buckets; ++bucket) {
+          first_[bucket] = (uint16_t)candidates_.size();
+          uint32_t bits = expand_index(bucket);
+          for (int ii = 0; ii < num_patterns; ++ii) {
+              uint32_t mask = patterns[ii].mask & index_mask;
+              if ((bits & mask) == (patterns[ii].value & mask))
+                  candidates_.push_back((uint8_t)ii);
+          }
+      }
+      first_[num_buckets] = (uint16_t)candidates_.size();
+  }
+
+  Opcode lookup(uint32_t bucket, uint32_t insn, Opcode fallback) const
+  {
+      for (int ii = first_[bucket]; ii < first_[bucket + 1]; ++ii) {
+          const DecodePattern &pattern = patterns_[candidates_[ii]];
+          if ((insn & pattern.mask) == pattern.value)
+              return pattern.opcode;
+      }
+      return fallback;
+  }
+
+ private:
+  const DecodePattern *patterns_;
+  std::vector<uint16_t> first_;     // First candidate of each bucket, and the end of the last
+  std::vector<uint8_t> candidates_; // Indices of the patterns of the buckets, bucket after bucket
+};
+
+// ARM instructions are looked up by bits 27-20 and 7-4
+static uint32_t arm_bucket(uint32_t insn)
+{
+    return ((insn >> 16) & 0xff0) | ((insn >> 4) & 0xf);
 }
 
-Opcode ARM_Disasm::decode00(uint32_t insn) {
-    uint8_t bit25 = (insn >> 25) & 0x1;
-    uint8_t bit4 = (insn >> 4) & 0x1;
-    if (bit25 == 0 && bit4 == 1) {
-        if ((insn & 0x0ffffff0) == 0x012fff10) {
-            // Bx instruction
-            return OP_BX;
-        }
-        if ((insn & 0x0ff000f0) == 0x01600010) {
-            // Clz instruction
-            return OP_CLZ;
-        }
-        if ((insn & 0xfff000f0) == 0xe1200070) {
-            // Bkpt instruction
-            return OP_BKPT;
-        }
-        uint32_t bits7_4 = (insn >> 4) & 0xf;
-        if (bits7_4 == 0x9) {
-            if ((insn & 0x0ff00ff0) == 0x01000090) {
-                // Swp instruction
-                uint8_t bit22 = (insn >> 22) & 0x1;
-                if (bit22)
-                    return OP_SWPB;
-                return OP_SWP;
-            }
-            // One of the multiply instructions
-            return decode_mul(insn);
-        }
+static uint32_t arm_expand_bucket(uint32_t bucket)
+{
+    return ((bucket & 0xff0) << 16) | ((bucket & 0xf) << 4);
+}
 
-        uint8_t bit7 = (insn >> 7) & 0x1;
-        if (bit7 == 1) {
-            // One of the load/store halfword/byte instructions
-            return decode_ldrh(insn);
-        }
-    }
+// Thumb instructions are looked up by bits 15-6
+static uint32_t thumb_bucket(uint32_t insn)
+{
+    return (insn >> 6) & 0x3ff;
+}
 
-    // One of the data processing instructions
-    return decode_alu(insn);
+static uint32_t thumb_expand_bucket(uint32_t bucket)
+{
+    return bucket << 6;
 }
 
-Opcode ARM_Disasm::decode01(uint32_t insn) {
-    uint8_t is_reg = (insn >> 25) & 0x1;
-    uint8_t bit4 = (insn >> 4) & 0x1;
-    if (is_reg == 1 && bit4 == 1)
-        return OP_UNDEFINED;
-    uint8_t is_load = (insn >> 20) & 0x1;
-    uint8_t is_byte = (insn >> 22) & 0x1;
-    if ((insn & 0xfd70f000) == 0xf550f000) {
-        // Pre-load
-        return OP_PLD;
-    }
-    if (is_load) {
-        if (is_byte) {
-            // Load byte
-            return OP_LDRB;
-        }
-        // Load word
-        return OP_LDR;
-    }
-    if (is_byte) {
-        // Store byte
-        return OP_STRB;
-    }
-    // Store word
-    return OP_STR;
-}
-
-Opcode ARM_Disasm::decode10(uint32_t insn) {
-    uint8_t bit25 = (insn >> 25) & 0x1;
-    if (bit25 == 0) {
-        // LDM/STM
-        uint8_t is_load = (insn >> 20) & 0x1;
-        if (is_load)
-            return OP_LDM;
-        return OP_STM;
-    }
-    // Branch or Branch with link
-    uint8_t is_link = (insn >> 24) & 1;
-    uint32_t offset = insn & 0xffffff;
+static const DecodeTable arm_table(arm_patterns, sizeof(arm_patterns) / sizeof(arm_patterns[0]),
+                                   0x1000, arm_expand_bucket, 0x0ff000f0);
+static const DecodeTable thumb_table(thumb_patterns,
+                                     sizeof(thumb_patterns) / sizeof(thumb_patterns[0]),
+                                     0x400, thumb_expand_bucket, 0xffc0);
 
-    // Sign-extend the 24-bit offset
-    if ((offset >> 23) & 1)
-        offset |= 0xff000000;
+Opcode ARM_Disasm::decode(uint32_t insn) {
+    return arm_table.lookup(arm_bucket(insn), insn, OP_UNDEFINED);
+}
 
-    // Pre-compute the left-shift and the prefetch offset
-    offset <<= 2;
-    offset += 8;
-    if (is_link == 0)
-        return OP_B;
-    return OP_BL;
-}
-
-Opcode ARM_Disasm::decode11(uint32_t insn) {
-    uint8_t bit25 = (insn >> 25) & 0x1;
-    if (bit25 == 0) {
-        // LDC, SDC
-        uint8_t is_load = (insn >> 20) & 0x1;
-        if (is_load) {
-            // LDC
-            return OP_LDC;
-        }
-        // STC
-        return OP_STC;
-    }
+Opcode ARM_Disasm::decode_thumb(uint32_t insn) {
+    insn &= 0xffff;
+    return thumb_table.lookup(thumb_bucket(insn), insn, OP_THUMB_UNDEFINED);
+}
 
-    uint8_t bit24 = (insn >> 24) & 0x1;
-    if (bit24 == 0x1) {
-        // SWI
-        return OP_SWI;
-    }
-  
-    uint8_t bit4 = (insn >> 4) & 0x1;
-    uint8_t cpnum = (insn >> 8) & 0xf;
+void ARM_Disasm::decode_insn(uint32_t addr, uint32_t insn, ARM_Instruction *instr) {
+    instr->address = addr;
+    instr->insn = insn;
+    instr->target = 0;
+    instr->opcode = decode(insn);
+    instr->cond = (insn >> 28) & 0xf;
+    instr->size = 4;
+    instr->flags = 0;
 
-    if (cpnum == 15) {
-        // Special case for coprocessor 15
-        uint8_t opcode = (insn >> 21) & 0x7;
-        if (bit4 == 0 || opcode != 0) {
-            // This is an unexpected bit pattern.  Create an undefined
-            // instruction in case this is ever executed.
-            return OP_UNDEFINED;
-        }
+    switch (instr->opcode) {
+        case OP_B:
+        case OP_BL:
+        case OP_BLX: {
+            if (instr->opcode == OP_BLX) {
+                // BLX <reg> is a call the target of which isn't known
+                instr->flags |= ARM_Instruction::kLink;
+                if (instr->cond != 0xf)
+                    break;
+                // BLX <imm> is unconditional, bit 24 selects the halfword of the Thumb target
+                instr->cond = 0xe;
+                addr += ((insn >> 24) & 1) << 1;
+            } else if (instr->opcode == OP_BL) {
+                instr->flags |= ARM_Instruction::kLink;
+            }
 
-        // MRC, MCR
-        uint8_t is_mrc = (insn >> 20) & 0x1;
-        if (is_mrc)
-            return OP_MRC;
-        return OP_MCR;
+            // Sign-extend the 24-bit offset
+            uint32_t offset = insn & 0xffffff;
+            if ((offset >> 23) & 1)
+                offset |= 0xff000000;
+            instr->target = addr + (offset << 2) + 8;
+            instr->flags |= ARM_Instruction::kBranch;
+            break;
+        }
+        default:
+            break;
     }
+}
 
-    if (bit4 == 0) {
-        // CDP
-        return OP_CDP;
-    }
-    // MRC, MCR
-    uint8_t is_mrc = (insn >> 20) & 0x1;
-    if (is_mrc)
-        return OP_MRC;
-    return OP_MCR;
-}
-
-Opcode ARM_Disasm::decode_mul(uint32_t insn) {
-    uint8_t bit24 = (insn >> 24) & 0x1;
-    if (bit24 != 0) {
-        // This is an unexpected bit pattern.  Create an undefined
-        // instruction in case this is ever executed.
-        return OP_UNDEFINED;
-    }
-    uint8_t bit23 = (insn >> 23) & 0x1;
-    uint8_t bit22_U = (insn >> 22) & 0x1;
-    uint8_t bit21_A = (insn >> 21) & 0x1;
-    if (bit23 == 0) {
-        // 32-bit multiply
-        if (bit22_U != 0) {
-            // This is an unexpected bit pattern.  Create an undefined
-            // instruction in case this is ever executed.
-            return OP_UNDEFINED;
+void ARM_Disasm::decode_insn_thumb(uint32_t addr, uint32_t insn1, uint32_t insn2,
+                                   ARM_Instruction *instr) {
+    insn1 &= 0xffff;
+    insn2 &= 0xffff;
+    instr->address = addr;
+    instr->insn = insn1;
+    instr->target = 0;
+    instr->opcode = decode_thumb(insn1);
+    instr->cond = 0xe;
+    instr->size = 2;
+    instr->flags = ARM_Instruction::kThumb;
+
+    switch (instr->opcode) {
+        case OP_THUMB_B: {
+            uint32_t offset;
+            if ((insn1 & 0xf000) == 0xd000) {
+                instr->cond = (insn1 >> 8) & 0xf;
+                offset = insn1 & 0xff;
+                if (offset & 0x80)
+                    offset |= 0xffffff00;
+            } else {
+                offset = insn1 & 0x7ff;
+                if (offset & 0x400)
+                    offset |= 0xfffff800;
+            }
+            instr->target = addr + (offset << 1) + 4;
+            instr->flags |= ARM_Instruction::kBranch;
+            break;
         }
-        if (bit21_A == 0)
-            return OP_MUL;
-        return OP_MLA;
-    }
-    // 64-bit multiply
-    if (bit22_U == 0) {
-        // Unsigned multiply long
-        if (bit21_A == 0)
-            return OP_UMULL;
-        return OP_UMLAL;
+        case OP_THUMB_BL:
+            // The first half of BL/BLX <imm> sets LR up, the second one branches from it
+            if ((insn1 & 0xf800) == 0xf000 && ((insn2 & 0xf800) == 0xf800 ||
+                                               (insn2 & 0xf800) == 0xe800)) {
+                uint32_t offset = insn1 & 0x7ff;
+                if (offset & 0x400)
+                    offset |= 0xfffff800;
+                instr->insn = insn1 | (insn2 << 16);
+                instr->size = 4;
+                instr->target = addr + 4 + (offset << 12) + ((insn2 & 0x7ff) << 1);
+                if ((insn2 & 0xf800) == 0xe800) {
+                    instr->opcode = OP_THUMB_BLX;
+                    instr->target &= ~3;
+                }
+                instr->flags |= ARM_Instruction::kBranch | ARM_Instruction::kLink;
+            }
+            break;
+        case OP_THUMB_BLX:
+            instr->flags |= ARM_Instruction::kLink;
+            break;
+        default:
+            break;
     }
-    // Signed multiply long
-    if (bit21_A == 0)
-        return OP_SMULL;
-    return OP_SMLAL;
 }
 
-Opcode ARM_Disasm::decode_ldrh(uint32_t insn) {
-    uint8_t is_load = (insn >> 20) & 0x1;
-    uint8_t bits_65 = (insn >> 5) & 0x3;
-    if (is_load) {
-        if (bits_65 == 0x1) {
-            // Load unsigned halfword
-            return OP_LDRH;
-        } else if (bits_65 == 0x2) {
-            // Load signed byte
-            return OP_LDRSB;
-        }
-        // Signed halfword
-        if (bits_65 != 0x3) {
-            // This is an unexpected bit pattern.  Create an undefined
-            // instruction in case this is ever executed.
-            return OP_UNDEFINED;
+// Formats a Thumb register list, with LR or PC if extra is set
+static void format_reg_list(uint32_t list, const char *extra, char *ptr)
+{
+    const char *comma = "";
+    *ptr = 0;
+    for (int ii = 0; ii < 8; ++ii) {
+        if (list & (1 << ii)) {
+            ptr += sprintf(ptr, "%sr%d", comma, ii);
+            comma = ",";
         }
-        // Load signed halfword
-        return OP_LDRSH;
     }
-    // Store halfword
-    if (bits_65 != 0x1) {
-        // This is an unexpected bit pattern.  Create an undefined
-        // instruction in case this is ever executed.
-        return OP_UNDEFINED;
-    }
-    // Store halfword
-    return OP_STRH;
+    if (extra != NULL)
+        sprintf(ptr, "%s%s", comma, extra);
 }
 
-Opcode ARM_Disasm::decode_alu(uint32_t insn) {
-    uint8_t is_immed = (insn >> 25) & 0x1;
-    uint8_t opcode = (insn >> 21) & 0xf;
-    uint8_t bit_s = (insn >> 20) & 1;
-    uint8_t shift_is_reg = (insn >> 4) & 1;
-    uint8_t bit7 = (insn >> 7) & 1;
-    if (!is_immed && shift_is_reg && (bit7 != 0)) {
-        // This is an unexpected bit pattern.  Create an undefined
-        // instruction in case this is ever executed.
-        return OP_UNDEFINED;
-    }
-    switch (opcode) {
-        case 0x0:
-            return OP_AND;
-        case 0x1:
-            return OP_EOR;
-        case 0x2:
-            return OP_SUB;
-        case 0x3:
-            return OP_RSB;
-        case 0x4:
-            return OP_ADD;
-        case 0x5:
-            return OP_ADC;
-        case 0x6:
-            return OP_SBC;
-        case 0x7:
-            return OP_RSC;
-        case 0x8:
-            if (bit_s)
-                return OP_TST;
-            return OP_MRS;
-        case 0x9:
-            if (bit_s)
-                return OP_TEQ;
-            return OP_MSR;
-        case 0xa:
-            if (bit_s)
-                return OP_CMP;
-            return OP_MRS;
-        case 0xb:
-            if (bit_s)
-                return OP_CMN;
-            return OP_MSR;
-        case 0xc:
-            return OP_ORR;
-        case 0xd:
-            return OP_MOV;
-        case 0xe:
-            return OP_BIC;
-        case 0xf:
-            return OP_MVN;
+char *ARM_Disasm::disasm_thumb_insn(const ARM_Instruction &instr, char *ptr)
+{
+    char tmp_list[64];
+
+    uint32_t insn = instr.insn & 0xffff;
+    uint8_t rd = insn & 0x7;
+    uint8_t rs = (insn >> 3) & 0x7;
+    uint8_t rn = (insn >> 6) & 0x7;
+    uint8_t rd_hi = (insn & 0x7) | ((insn >> 4) & 0x8);
+    uint8_t rm_hi = (insn >> 3) & 0xf;
+    uint8_t rd8 = (insn >> 8) & 0x7;
+    uint8_t immed8 = insn & 0xff;
+    uint8_t immed5 = (insn >> 6) & 0x1f;
+
+    const char *opname = opcode_names[instr.opcode];
+    switch (instr.opcode) {
+        case OP_THUMB_UNDEFINED:
+            sprintf(ptr, "Undefined");
+            return ptr;
+
+        case OP_THUMB_LSL:
+        case OP_THUMB_LSR:
+        case OP_THUMB_ASR:
+            if ((insn >> 13) == 0) {
+                // Shift by immediate, LSR and ASR by 0 are by 32
+                uint32_t shift = immed5;
+                if (shift == 0 && instr.opcode != OP_THUMB_LSL)
+                    shift = 32;
+                sprintf(ptr, "%s\tr%d, r%d, #%u", opname, rd, rs, shift);
+                return ptr;
+            }
+            sprintf(ptr, "%s\tr%d, r%d", opname, rd, rs);
+            return ptr;
+
+        case OP_THUMB_ADD:
+        case OP_THUMB_SUB:
+            switch (insn >> 11) {
+                case 0x03:
+                    if (insn & 0x0400)
+                        sprintf(ptr, "%s\tr%d, r%d, #%d", opname, rd, rs, rn);
+                    else
+                        sprintf(ptr, "%s\tr%d, r%d, r%d", opname, rd, rs, rn);
+                    return ptr;
+                case 0x06:
+                case 0x07:
+                    sprintf(ptr, "%s\tr%d, #%d", opname, rd8, immed8);
+                    return ptr;
+                case 0x08:
+                    sprintf(ptr, "%s\tr%d, r%d", opname, rd_hi, rm_hi);
+                    return ptr;
+                case 0x14:
+                case 0x15:
+                    sprintf(ptr, "%s\tr%d, %s, #%d", opname, rd8, (insn & 0x0800) ? "sp" : "pc",
+                            immed8 << 2);
+                    return ptr;
+                default:
+                    sprintf(ptr, "%s\tsp, #%d", opname, (insn & 0x7f) << 2);
+                    return ptr;
+            }
+
+        case OP_THUMB_MOV:
+        case OP_THUMB_CMP:
+            if ((insn >> 13) == 1) {
+                sprintf(ptr, "%s\tr%d, #%d", opname, rd8, immed8);
+            } else if (insn & 0x0400) {
+                sprintf(ptr, "%s\tr%d, r%d", opname, rd_hi, rm_hi);
+            } else {
+                sprintf(ptr, "%s\tr%d, r%d", opname, rd, rs);
+            }
+            return ptr;
+
+        case OP_THUMB_AND:
+        case OP_THUMB_EOR:
+        case OP_THUMB_ADC:
+        case OP_THUMB_SBC:
+        case OP_THUMB_ROR:
+        case OP_THUMB_TST:
+        case OP_THUMB_NEG:
+        case OP_THUMB_CMN:
+        case OP_THUMB_ORR:
+        case OP_THUMB_MUL:
+        case OP_THUMB_BIC:
+        case OP_THUMB_MVN:
+            sprintf(ptr, "%s\tr%d, r%d", opname, rd, rs);
+            return ptr;
+
+        case OP_THUMB_BX:
+            sprintf(ptr, "%s\tr%d", opname, rm_hi);
+            return ptr;
+
+        case OP_THUMB_BLX:
+        case OP_THUMB_BL:
+            if (instr.flags & ARM_Instruction::kBranch) {
+                sprintf(ptr, "%s\t0x%x", opname, instr.target);
+            } else if ((insn & 0xff80) == 0x4780) {
+                sprintf(ptr, "%s\tr%d", opname, rm_hi);
+            } else if ((insn & 0xf800) == 0xf000) {
+                sprintf(ptr, "%s\t(first half)", opname);
+            } else {
+                sprintf(ptr, "%s\t(second half) lr + #0x%x", opname, (insn & 0x7ff) << 1);
+            }
+            return ptr;
+
+        case OP_THUMB_LDR:
+        case OP_THUMB_LDRB:
+        case OP_THUMB_LDRH:
+        case OP_THUMB_LDRSB:
+        case OP_THUMB_LDRSH:
+        case OP_THUMB_STR:
+        case OP_THUMB_STRB:
+        case OP_THUMB_STRH:
+            switch (insn >> 12) {
+                case 0x4: {
+                    uint32_t addr = ((instr.address + 4) & ~3) + (immed8 << 2);
+                    sprintf(ptr, "%s\tr%d, [pc, #%d]  ; 0x%x", opname, rd8, immed8 << 2, addr);
+                    return ptr;
+                }
+                case 0x5:
+                    sprintf(ptr, "%s\tr%d, [r%d, r%d]", opname, rd, rs, rn);
+                    return ptr;
+                case 0x9:
+                    sprintf(ptr, "%s\tr%d, [sp, #%d]", opname, rd8, immed8 << 2);
+                    return ptr;
+                default: {
+                    // Offsets are scaled by the size of the access
+                    int shift = (insn >> 12) == 0x6 ? 2 : (insn >> 12) == 0x8 ? 1 : 0;
+                    if (immed5 == 0)
+                        sprintf(ptr, "%s\tr%d, [r%d]", opname, rd, rs);
+                    else
+                        sprintf(ptr, "%s\tr%d, [r%d, #%d]", opname, rd, rs, immed5 << shift);
+                    return ptr;
+                }
+            }
+
+        case OP_THUMB_PUSH:
+        case OP_THUMB_POP:
+            format_reg_list(insn & 0xff, (insn & 0x100) ?
+                            (instr.opcode == OP_THUMB_PUSH ? "lr" : "pc") : NULL, tmp_list);
+            sprintf(ptr, "%s\t{%s}", opname, tmp_list);
+            return ptr;
+
+        case OP_THUMB_LDMIA:
+        case OP_THUMB_STMIA:
+            format_reg_list(insn & 0xff, NULL, tmp_list);
+            sprintf(ptr, "%s\tr%d!, {%s}", opname, rd8, tmp_list);
+            return ptr;
+
+        case OP_THUMB_B:
+            sprintf(ptr, "%s%s\t0x%x", opname, cond_to_str(instr.cond), instr.target);
+            return ptr;
+
+        case OP_THUMB_SWI:
+            sprintf(ptr, "%s\t0x%x", opname, immed8);
+            return ptr;
+
+        case OP_THUMB_BKPT:
+            sprintf(ptr, "%s\t#%d", opname, immed8);
+            return ptr;
+
+        default:
+            sprintf(ptr, "Error");
+            return ptr;
     }
-    // Unreachable
-    return OP_INVALID;
-}
\ No newline at end of file
+}
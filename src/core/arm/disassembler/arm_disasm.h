@@ -107,22 +107,42 @@ enum Opcode {
     OP_END                // must be last
 };
 
+// Decoded instruction, formatted into text only when asked for
+struct ARM_Instruction {
+    // Flags
+    enum {
+        kThumb = 1,         // Thumb instruction
+        kBranch = 2,        // Branch to an immediate target, in target
+        kLink = 4,          // Branch that sets LR, a call
+    };
+
+    uint32_t address;       // Guest address of the instruction
+    uint32_t insn;          // Instruction word, the first halfword in the low bits for Thumb
+    uint32_t target;        // Branch target if kBranch
+    Opcode opcode;
+    uint8_t cond;           // Condition code, 14 (always) for unconditional instructions
+    uint8_t size;           // Size in bytes, 2 or 4 (ARM and Thumb BL/BLX pairs)
+    uint8_t flags;
+};
+
 class ARM_Disasm {
  public:
+  // Buffers given to format() and disasm() must hold at least this many characters
+  static const int kBufferSize = 128;
+
   static char *disasm(uint32_t addr, uint32_t insn, char *buffer);
+  static char *disasm_thumb(uint32_t addr, uint32_t insn1, uint32_t insn2, char *buffer);
   static Opcode decode(uint32_t insn);
+  static Opcode decode_thumb(uint32_t insn);
+  static void decode_insn(uint32_t addr, uint32_t insn, ARM_Instruction *instr);
+  static void decode_insn_thumb(uint32_t addr, uint32_t insn1, uint32_t insn2,
+                                ARM_Instruction *instr);
+  static char *format(const ARM_Instruction &instr, char *buffer);
 
  private:
-  static Opcode decode00(uint32_t insn);
-  static Opcode decode01(uint32_t insn);
-  static Opcode decode10(uint32_t insn);
-  static Opcode decode11(uint32_t insn);
-  static Opcode decode_mul(uint32_t insn);
-  static Opcode decode_ldrh(uint32_t insn);
-  static Opcode decode_alu(uint32_t insn);
-
   static char *disasm_alu(Opcode opcode, uint32_t insn, char *ptr);
   static char *disasm_branch(uint32_t addr, Opcode opcode, uint32_t insn, char *ptr);
+  static char *disasm_blx(const ARM_Instruction &instr, char *ptr);
   static char *disasm_bx(uint32_t insn, char *ptr);
   static char *disasm_bkpt(uint32_t insn, char *ptr);
   static char *disasm_clz(uint32_t insn, char *ptr);
@@ -138,9 +158,7 @@ class ARM_Disasm {
   static char *disasm_pld(uint32_t insn, char *ptr);
   static char *disasm_swi(uint32_t insn, char *ptr);
   static char *disasm_swp(Opcode opcode, uint32_t insn, char *ptr);
+  static char *disasm_thumb_insn(const ARM_Instruction &instr, char *ptr);
 };
 
-extern char *disasm_insn_thumb(uint32_t pc, uint32_t insn1, uint32_t insn2, char *result);
-extern Opcode decode_insn_thumb(uint32_t given);
-
 #endif /* ARMDIS_H */
@@ -0,0 +1,144 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <mutex>
+
+#include "core/arm/exclusive_monitor.h"
+#include "core/arm/interpreter/armdefs.h"
+
+namespace ExclusiveMonitor {
+
+bool g_shared = false;
+
+namespace {
+
+enum {
+    MAX_HOLDERS = 4,    ///< Cores that may hold a reservation at once
+};
+
+/// Taken by the STREX of a core and by the stores of the others, the STREX stores while holding it
+std::recursive_mutex    g_lock;
+ARMul_State*            g_holders[MAX_HOLDERS];     ///< Cores that reserved a granule
+std::atomic<int>        g_num_holders(0);           ///< Number of entries in g_holders
+
+/**
+ * Gets whether a core is among the holders, with the lock held
+ * @param state ARM core state of the core
+ * @return True if the core reserved a granule since the monitor was shared
+ */
+bool IsHolder(ARMul_State* state) {
+    for (int i = 0; i < g_num_holders; i++) {
+        if (g_holders[i] == state) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Clears the reservations of a granule, with the lock held
+ * @param granule Address of the granule
+ */
+void ClearGranuleLocked(u32 granule) {
+    for (int i = 0; i < g_num_holders; ) {
+        if (g_holders[i]->exclusive_tag == granule) {
+            g_holders[i]->exclusive_tag = NO_RESERVATION;
+            g_holders[i] = g_holders[g_num_holders - 1];
+            g_num_holders--;
+        } else {
+            i++;
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * Switches between the single core and the shared monitor. Called between slices, when no core
+ * is running, reservations made before the switch fail their STREX once.
+ * @param shared Whether more than one core runs code
+ */
+void SetShared(bool shared) {
+    if (shared == g_shared) {
+        return;
+    }
+    // Holders are only tracked while shared, those of an earlier time have gone stale
+    std::lock_guard<std::recursive_mutex> lock(g_lock);
+    g_num_holders = 0;
+    g_shared = shared;
+}
+
+/**
+ * Reserves the granule of an address, as LDREX does
+ * @param state ARM core state of the core
+ * @param addr Guest address loaded
+ */
+void Reserve(ARMul_State* state, u32 addr) {
+    if (!g_shared) {
+        state->exclusive_tag = GetGranule(addr);
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(g_lock);
+    state->exclusive_tag = GetGranule(addr);
+    if (!IsHolder(state) && g_num_holders < MAX_HOLDERS) {
+        g_holders[g_num_holders] = state;
+        g_num_holders++;
+    }
+}
+
+/**
+ * Drops the reservation of a core, as CLREX and context switches do
+ * @param state ARM core state of the core
+ */
+void Clear(ARMul_State* state) {
+    state->exclusive_tag = NO_RESERVATION;
+}
+
+/**
+ * Starts a store exclusive, dropping the reservation of the core. If the granule was still
+ * reserved the caller stores and calls EndStore, the shared monitor is locked until then.
+ * @param state ARM core state of the core
+ * @param addr Guest address stored
+ * @return True if the store goes ahead, false if it fails
+ */
+bool BeginStore(ARMul_State* state, u32 addr) {
+    const u32 granule = GetGranule(addr);
+    if (!g_shared) {
+        const bool reserved = state->exclusive_tag == granule;
+        state->exclusive_tag = NO_RESERVATION;
+        return reserved;
+    }
+
+    g_lock.lock();
+    if (state->exclusive_tag != granule || !IsHolder(state)) {
+        state->exclusive_tag = NO_RESERVATION;
+        g_lock.unlock();
+        return false;
+    }
+    // The other cores lose the granule as well, their STREX would overwrite this store
+    ClearGranuleLocked(granule);
+    return true;
+}
+
+/// Ends a store exclusive that BeginStore let go ahead
+void EndStore() {
+    if (g_shared) {
+        g_lock.unlock();
+    }
+}
+
+/**
+ * Clears the reservations of the granule of a store, use OnStore instead
+ * @param addr Guest address stored
+ */
+void ClearGranule(u32 addr) {
+    if (g_num_holders.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(g_lock);
+    ClearGranuleLocked(GetGranule(addr));
+}
+
+} // namespace
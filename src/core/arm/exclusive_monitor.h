@@ -0,0 +1,86 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+struct ARMul_State;
+
+/**
+ * Exclusive monitor of LDREX/STREX. Every core keeps the granule it reserved in its ARMul_State,
+ * and loses it to CLREX, a context switch or a store exclusive. While only the app core runs code,
+ * nothing can store to the granule between the LDREX and the STREX of a lock but the core itself,
+ * so a STREX only compares its granule with the reserved one. Once the sys core runs on its own
+ * thread the reservations are shared: a STREX checks and stores under a lock, and every store of
+ * either core to a reserved granule clears the reservation.
+ */
+namespace ExclusiveMonitor {
+
+enum {
+    GRANULE_SIZE    = 8,            ///< Bytes a reservation covers, those of LDREXD
+    NO_RESERVATION  = 0xFFFFFFFF,   ///< Reserved granule of a core without a reservation
+};
+
+extern bool g_shared;   ///< Whether more than one core runs code, see SetShared
+
+/**
+ * Gets the granule of an address
+ * @param addr Guest address
+ * @return Address of the granule
+ */
+inline u32 GetGranule(u32 addr) {
+    return addr & ~(GRANULE_SIZE - 1);
+}
+
+/**
+ * Switches between the single core and the shared monitor. Called between slices, when no core
+ * is running, reservations made before the switch fail their STREX once.
+ * @param shared Whether more than one core runs code
+ */
+void SetShared(bool shared);
+
+/**
+ * Reserves the granule of an address, as LDREX does
+ * @param state ARM core state of the core
+ * @param addr Guest address loaded
+ */
+void Reserve(ARMul_State* state, u32 addr);
+
+/**
+ * Drops the reservation of a core, as CLREX and context switches do
+ * @param state ARM core state of the core
+ */
+void Clear(ARMul_State* state);
+
+/**
+ * Starts a store exclusive, dropping the reservation of the core. If the granule was still
+ * reserved the caller stores and calls EndStore, the shared monitor is locked until then.
+ * @param state ARM core state of the core
+ * @param addr Guest address stored
+ * @return True if the store goes ahead, false if it fails
+ */
+bool BeginStore(ARMul_State* state, u32 addr);
+
+/// Ends a store exclusive that BeginStore let go ahead
+void EndStore();
+
+/**
+ * Clears the reservations of the granule of a store, use OnStore instead
+ * @param addr Guest address stored
+ */
+void ClearGranule(u32 addr);
+
+/**
+ * Clears the reservations a store breaks, none unless the monitor is shared. Called by Memory
+ * for every store.
+ * @param addr Guest address stored
+ */
+inline void OnStore(u32 addr) {
+    if (g_shared) {
+        ClearGranule(addr);
+    }
+}
+
+} // namespace
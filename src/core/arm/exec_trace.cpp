@@ -0,0 +1,438 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/log.h"
+#include "common/spsc_queue.h"
+#include "common/thread.h"
+
+#include "core/arm/exec_trace.h"
+
+namespace ExecTrace {
+
+std::atomic<bool> g_enabled(false);
+
+namespace {
+
+enum {
+    MAGIC               = 0x54584543,   ///< "CEXT"
+    VERSION             = 1,
+
+    CPSR_INDEX          = 15,           ///< Index of the CPSR in the registers of a thread
+    CPSR_TBIT           = 1 << 5,
+
+    CHUNK_SIZE          = 0x100000,     ///< Size of a buffer handed to the writer, in bytes
+    NUM_CHUNKS          = 32,           ///< Buffers the emulation thread may be ahead by
+    MAX_RECORD_SIZE     = 0x80,         ///< Tag, PC, mask and all the registers, as varints
+    READ_BUFFER_SIZE    = 0x100000,
+};
+
+/**
+ * Records start with a tag byte, its low bits the type. Instructions have flags for the fields
+ * that follow: the PC as a delta from the one after the last instruction of the thread, then the
+ * mask of the registers changed, the CPSR at bit 0 and Rn at bit n + 1, then the delta of each.
+ * Data accesses have the log2 of their size, then the address as a delta from the last access
+ * and the value. Thread switches are followed by the handle.
+ */
+enum {
+    TAG_INSTRUCTION     = 0,
+    TAG_READ            = 1,
+    TAG_WRITE           = 2,
+    TAG_THREAD          = 3,
+    TAG_TYPE_MASK       = 3,
+
+    TAG_JUMP            = 1 << 2,       ///< Instruction isn't the one after the last
+    TAG_CHANGED         = 1 << 3,       ///< Instruction changed registers
+
+    TAG_SIZE_SHIFT      = 2,
+};
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+};
+
+/// Buffer of records, filled by the emulation thread then written by the writer thread
+struct Chunk {
+    std::unique_ptr<u8[]>   data;
+    size_t                  size;
+};
+
+Chunk                       g_chunks[NUM_CHUNKS];
+Common::SPSCQueue<Chunk*>   g_full_chunks(NUM_CHUNKS);  ///< Pushed by the emulation thread
+Common::SPSCQueue<Chunk*>   g_free_chunks(NUM_CHUNKS);  ///< Pushed by the writer thread
+
+std::thread*                g_thread = nullptr;     ///< Writer thread
+Common::Event               g_work_event;           ///< Signalled as a chunk is full
+Common::Event               g_free_event;           ///< Signalled as a chunk is written
+std::atomic<bool>           g_quit(false);          ///< Writer exits once every chunk is written
+std::atomic<bool>           g_failed(false);        ///< A write failed, the rest is dropped
+File::IOFile                g_file;
+
+// Only touched by the emulation thread
+Chunk*                      g_chunk = nullptr;      ///< Chunk being filled
+u8*                         g_cursor = nullptr;     ///< Next record in the chunk
+u8*                         g_limit = nullptr;      ///< Past it, the chunk goes to the writer
+u64                         g_size = 0;             ///< Bytes handed to the writer
+std::unordered_map<Handle, ThreadState> g_threads;
+ThreadState*                g_current = nullptr;
+Handle                      g_current_thread = 0;
+u32                         g_mem_address = 0;
+
+inline u32 ZigZag(u32 value) {
+    return (value << 1) ^ (u32)((s32)value >> 31);
+}
+
+inline u32 UnZigZag(u32 value) {
+    return (value >> 1) ^ (u32)-(s32)(value & 1);
+}
+
+inline void WriteVarint(u8*& p, u32 value) {
+    while (value >= 0x80) {
+        *p++ = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (u8)value;
+}
+
+inline u32 ReadVarint(const u8*& p) {
+    u32 value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const u8 byte = *p++;
+        value |= (u32)(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            break;
+        }
+    }
+    return value;
+}
+
+/**
+ * Gets the address an instruction sequential to the last one of a thread is at
+ * @param thread Registers of the thread
+ */
+inline u32 GetNextPC(const ThreadState& thread) {
+    return thread.pc + ((thread.regs[CPSR_INDEX] & CPSR_TBIT) ? 2 : 4);
+}
+
+/// Writer thread: writes the full chunks in the order they were filled
+void WriterFunc() {
+    Common::SetCurrentThreadName("ExecTrace");
+
+    for (;;) {
+        Chunk* chunk;
+        if (g_full_chunks.Pop(chunk)) {
+            if (!g_failed && !g_file.WriteBytes(chunk->data.get(), chunk->size)) {
+                g_failed = true;
+            }
+            g_free_chunks.Push(chunk);
+            g_free_event.Set();
+            continue;
+        }
+        if (g_quit.load(std::memory_order_acquire)) {
+            if (g_full_chunks.Empty()) {
+                break;
+            }
+            continue;
+        }
+        g_work_event.Wait();
+    }
+}
+
+/// Takes a written chunk to fill, waiting for the writer if it's a full set of chunks behind
+void TakeChunk() {
+    while (!g_free_chunks.Pop(g_chunk)) {
+        g_free_event.Wait();
+    }
+    g_cursor = g_chunk->data.get();
+    g_limit = g_cursor + CHUNK_SIZE - MAX_RECORD_SIZE;
+}
+
+/// Hands the chunk being filled to the writer
+void SubmitChunk() {
+    g_chunk->size = g_cursor - g_chunk->data.get();
+    g_size += g_chunk->size;
+    g_full_chunks.Push(g_chunk);
+    g_work_event.Set();
+    g_chunk = nullptr;
+}
+
+/// Makes room for the next record
+inline void CheckLimit() {
+    if (g_cursor >= g_limit) {
+        SubmitChunk();
+        TakeChunk();
+    }
+}
+
+/**
+ * Writes a thread switch
+ * @param thread Handle of the thread switched to
+ */
+void WriteThread(Handle thread) {
+    *g_cursor++ = TAG_THREAD;
+    WriteVarint(g_cursor, thread);
+    g_current = &g_threads[thread];
+    g_current_thread = thread;
+    CheckLimit();
+}
+
+} // namespace
+
+/**
+ * Starts recording a trace, stopping any trace recorded. Must be called between two CPU slices.
+ * The JIT hands the instructions over to the interpreter while a trace is recorded.
+ * @param filename Path of the trace
+ * @param thread Handle of the guest thread the CPU runs
+ * @return True on success
+ */
+bool Start(const std::string& filename, Handle thread) {
+    Stop();
+
+    const FileHeader header = { MAGIC, VERSION };
+    if (!g_file.Open(filename, "wb") || !g_file.WriteArray(&header, 1)) {
+        ERROR_LOG(ARM11, "couldn't create execution trace %s", filename.c_str());
+        g_file.Close();
+        return false;
+    }
+
+    // The writer isn't running, every chunk is free
+    Chunk* stale;
+    while (g_free_chunks.Pop(stale)) {
+    }
+    for (Chunk& chunk : g_chunks) {
+        if (chunk.data == nullptr) {
+            chunk.data.reset(new u8[CHUNK_SIZE]);
+        }
+        g_free_chunks.Push(&chunk);
+    }
+    TakeChunk();
+
+    g_size = 0;
+    g_threads.clear();
+    g_mem_address = 0;
+    WriteThread(thread);
+
+    g_failed = false;
+    g_quit = false;
+    g_thread = new std::thread(WriterFunc);
+    g_enabled = true;
+
+    NOTICE_LOG(ARM11, "recording execution trace %s", filename.c_str());
+    return true;
+}
+
+/// Stops recording the trace, writing what the buffers hold
+void Stop() {
+    if (!g_enabled) {
+        return;
+    }
+    g_enabled = false;
+
+    SubmitChunk();
+    g_quit.store(true, std::memory_order_release);
+    g_work_event.Set();
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+    g_file.Close();
+
+    g_threads.clear();
+    g_current = nullptr;
+
+    if (g_failed) {
+        ERROR_LOG(ARM11, "couldn't write the execution trace, it's cut short");
+    } else {
+        NOTICE_LOG(ARM11, "execution trace stopped after %llu bytes", (unsigned long long)g_size);
+    }
+}
+
+/**
+ * Records an instruction run, after the data accesses it made. Called by the interpreter.
+ * @param pc Address of the instruction
+ * @param regs R0-R14 after the instruction
+ * @param cpsr CPSR after the instruction
+ */
+void OnInstruction(u32 pc, const u32* regs, u32 cpsr) {
+    ThreadState& thread = *g_current;
+    u8* const tag = g_cursor++;
+    u8 flags = TAG_INSTRUCTION;
+
+    const u32 next_pc = GetNextPC(thread);
+    if (pc != next_pc) {
+        flags |= TAG_JUMP;
+        WriteVarint(g_cursor, ZigZag(pc - next_pc));
+    }
+    thread.pc = pc;
+
+    u32 changed = (cpsr != thread.regs[CPSR_INDEX]) ? 1 : 0;
+    for (int i = 0; i < CPSR_INDEX; i++) {
+        if (regs[i] != thread.regs[i]) {
+            changed |= 2 << i;
+        }
+    }
+    if (changed != 0) {
+        flags |= TAG_CHANGED;
+        WriteVarint(g_cursor, changed);
+        if (changed & 1) {
+            WriteVarint(g_cursor, ZigZag(cpsr - thread.regs[CPSR_INDEX]));
+            thread.regs[CPSR_INDEX] = cpsr;
+        }
+        for (int i = 0; i < CPSR_INDEX; i++) {
+            if (changed & (2 << i)) {
+                WriteVarint(g_cursor, ZigZag(regs[i] - thread.regs[i]));
+                thread.regs[i] = regs[i];
+            }
+        }
+    }
+    *tag = flags;
+    CheckLimit();
+}
+
+/**
+ * Records a data access of the instruction being run. Called by the interpreter.
+ * @param address Guest address accessed
+ * @param value Value read or written
+ * @param size Size of the access in bytes
+ * @param write Whether the access is a write
+ */
+void OnMemAccess(u32 address, u32 value, int size, bool write) {
+    const u8 log2_size = size == 4 ? 2 : (size == 2 ? 1 : 0);
+    *g_cursor++ = (write ? TAG_WRITE : TAG_READ) | (log2_size << TAG_SIZE_SHIFT);
+    WriteVarint(g_cursor, ZigZag(address - g_mem_address));
+    WriteVarint(g_cursor, value);
+    g_mem_address = address;
+    CheckLimit();
+}
+
+/**
+ * Records a switch of the guest thread the CPU runs
+ * @param thread Handle of the thread switched to
+ */
+void SwitchThread(Handle thread) {
+    if (!IsEnabled() || thread == g_current_thread) {
+        return;
+    }
+    WriteThread(thread);
+}
+
+Reader::Reader() : buffer(new u8[READ_BUFFER_SIZE + MAX_RECORD_SIZE]), pos(0), end(0),
+    current(&threads[0]), current_thread(0), mem_address(0) {
+}
+
+/**
+ * Opens a trace
+ * @param filename Path of the trace
+ * @return True on success, false if the file isn't a trace of this version
+ */
+bool Reader::Open(const std::string& filename) {
+    FileHeader header;
+    if (!file.Open(filename, "rb") || !file.ReadArray(&header, 1) || header.magic != MAGIC ||
+        header.version != VERSION) {
+        ERROR_LOG(ARM11, "%s isn't an execution trace of version %u", filename.c_str(),
+            (u32)VERSION);
+        file.Close();
+        return false;
+    }
+    pos = end = 0;
+    threads.clear();
+    current = &threads[0];
+    current_thread = 0;
+    mem_address = 0;
+    return true;
+}
+
+/**
+ * Makes sure the buffer holds a full record, reading more of the file
+ * @return False if the file has no more records
+ */
+bool Reader::Fill() {
+    if (end - pos >= MAX_RECORD_SIZE) {
+        return true;
+    }
+    memmove(buffer.get(), buffer.get() + pos, end - pos);
+    end -= pos;
+    pos = 0;
+    if (file.IsOpen()) {
+        end += fread(buffer.get() + end, 1, READ_BUFFER_SIZE - end, file.GetHandle());
+    }
+    // A record cut short by the end of the file reads zeroes past it, then is dropped
+    memset(buffer.get() + end, 0, MAX_RECORD_SIZE);
+    return end != 0;
+}
+
+/**
+ * Decodes the next event
+ * @param event Receives the event
+ * @return False at the end of the trace, which may be in the middle of a record if the
+ *      recording was cut short
+ */
+bool Reader::Next(Event& event) {
+    if (!Fill()) {
+        return false;
+    }
+    const u8* const start = buffer.get() + pos;
+    const u8* p = start;
+    const u8 tag = *p++;
+
+    switch (tag & TAG_TYPE_MASK) {
+    case TAG_INSTRUCTION:
+    {
+        ThreadState& thread = *current;
+        const int size = (thread.regs[CPSR_INDEX] & CPSR_TBIT) ? 2 : 4;
+        u32 pc = GetNextPC(thread);
+        if (tag & TAG_JUMP) {
+            pc += UnZigZag(ReadVarint(p));
+        }
+        thread.pc = pc;
+
+        u32 changed = 0;
+        if (tag & TAG_CHANGED) {
+            const u32 mask = ReadVarint(p);
+            if (mask & 1) {
+                thread.regs[CPSR_INDEX] += UnZigZag(ReadVarint(p));
+            }
+            for (int i = 0; i < CPSR_INDEX; i++) {
+                if (mask & (2 << i)) {
+                    thread.regs[i] += UnZigZag(ReadVarint(p));
+                }
+            }
+            changed = (mask >> 1) | ((mask & 1) << CPSR_INDEX);
+        }
+        event.type = Event::INSTRUCTION;
+        event.address = pc;
+        event.value = 0;
+        event.size = size;
+        event.changed = changed;
+        break;
+    }
+
+    case TAG_READ:
+    case TAG_WRITE:
+        mem_address += UnZigZag(ReadVarint(p));
+        event.type = (tag & TAG_TYPE_MASK) == TAG_WRITE ? Event::WRITE : Event::READ;
+        event.address = mem_address;
+        event.value = ReadVarint(p);
+        event.size = 1 << ((tag >> TAG_SIZE_SHIFT) & 3);
+        event.changed = 0;
+        break;
+
+    case TAG_THREAD:
+        current_thread = ReadVarint(p);
+        current = &threads[current_thread];
+        event.type = Event::THREAD;
+        event.address = 0;
+        event.value = current_thread;
+        event.size = 0;
+        event.changed = 0;
+        break;
+    }
+
+    pos += p - start;
+    return pos <= end;
+}
+
+} // namespace
@@ -0,0 +1,149 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "common/common.h"
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+#include "core/hle/kernel/kernel.h"
+
+/**
+ * Execution traces of the application core, for bugs that only show after millions of
+ * instructions: every instruction run with the registers it changed, the data accesses it made
+ * and the guest thread switches. Records are delta encoded as varints against the registers the
+ * thread had after its previous instruction, a sequential instruction that changes one register
+ * takes about three bytes. The emulation thread fills buffers that a writer thread streams to
+ * disk, the emulation only waits for it when it falls the whole set of buffers behind.
+ */
+namespace ExecTrace {
+
+enum {
+    NUM_REGS    = 16,       ///< R0-R14 and the CPSR, the PC is the address of the records
+};
+
+extern std::atomic<bool> g_enabled;
+
+/**
+ * Tells whether a trace is recorded, a relaxed load for the hooks of the interpreter
+ * @return True if it is
+ */
+inline bool IsEnabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Starts recording a trace, stopping any trace recorded. Must be called between two CPU slices.
+ * The JIT hands the instructions over to the interpreter while a trace is recorded.
+ * @param filename Path of the trace
+ * @param thread Handle of the guest thread the CPU runs
+ * @return True on success
+ */
+bool Start(const std::string& filename, Handle thread);
+
+/// Stops recording the trace, writing what the buffers hold
+void Stop();
+
+/**
+ * Records an instruction run, after the data accesses it made. Called by the interpreter.
+ * @param pc Address of the instruction
+ * @param regs R0-R14 after the instruction
+ * @param cpsr CPSR after the instruction
+ */
+void OnInstruction(u32 pc, const u32* regs, u32 cpsr);
+
+/**
+ * Records a data access of the instruction being run. Called by the interpreter.
+ * @param address Guest address accessed
+ * @param value Value read or written
+ * @param size Size of the access in bytes
+ * @param write Whether the access is a write
+ */
+void OnMemAccess(u32 address, u32 value, int size, bool write);
+
+/**
+ * Records a switch of the guest thread the CPU runs
+ * @param thread Handle of the thread switched to
+ */
+void SwitchThread(Handle thread);
+
+/// Registers of a guest thread, as the deltas of its instructions leave them
+struct ThreadState {
+    u32 regs[NUM_REGS];
+    u32 pc;                 ///< Address of the last instruction of the thread
+};
+
+/// Event of a trace, as decoded by a Reader
+struct Event {
+    enum Type {
+        INSTRUCTION,        ///< Instruction run at address, changing the registers of the mask
+        READ,               ///< Data read of size bytes at address, which read value
+        WRITE,              ///< Data write of size bytes at address, which wrote value
+        THREAD,             ///< Switch to the guest thread of handle value
+    };
+
+    Type    type;
+    u32     address;
+    u32     value;
+    int     size;
+    u32     changed;        ///< Registers the instruction changed, bit n for register n
+};
+
+/// Decodes a trace, one event after the other
+class Reader : NonCopyable {
+public:
+    Reader();
+
+    /**
+     * Opens a trace
+     * @param filename Path of the trace
+     * @return True on success, false if the file isn't a trace of this version
+     */
+    bool Open(const std::string& filename);
+
+    /**
+     * Decodes the next event
+     * @param event Receives the event
+     * @return False at the end of the trace, which may be in the middle of a record if the
+     *      recording was cut short
+     */
+    bool Next(Event& event);
+
+    /**
+     * Gets the registers of the current thread, as of the last instruction decoded
+     * @return R0-R14 and the CPSR
+     */
+    const u32* GetRegs() const {
+        return current->regs;
+    }
+
+    /// Gets the handle of the current thread
+    Handle GetThread() const {
+        return current_thread;
+    }
+
+private:
+    /**
+     * Makes sure the buffer holds a full record, reading more of the file
+     * @return False if the file has no more records
+     */
+    bool Fill();
+
+    File::IOFile                            file;
+    std::unique_ptr<u8[]>                   buffer;
+    size_t                                  pos;        ///< Offset of the next record in buffer
+    size_t                                  end;        ///< Number of bytes in buffer
+    std::unordered_map<Handle, ThreadState> threads;
+    ThreadState*                            current;
+    Handle                                  current_thread;
+    u32                                     mem_address; ///< Address of the last data access
+};
+
+} // namespace
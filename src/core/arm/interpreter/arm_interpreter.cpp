@@ -2,14 +2,19 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.  
 
+#include "common/memory_util.h"
+
 #include "core/arm/interpreter/arm_interpreter.h"
 
+#include "core/arm/exclusive_monitor.h"
+
 const static cpu_config_t s_arm11_cpu_info = {
     "armv6", "arm11", 0x0007b000, 0x0007f000, NONCACHE
 };
 
-ARM_Interpreter::ARM_Interpreter()  {
-    state = new ARMul_State;
+ARM_Interpreter::ARM_Interpreter() : skipped_instructions(0) {
+    // The hot state of ARMul_State starts on a cache line, which new doesn't align to
+    state = (ARMul_State*)AllocateAlignedMemory(sizeof(ARMul_State), 64);
 
     ARMul_EmulateInit();
     ARMul_NewState(state);
@@ -32,7 +37,9 @@ ARM_Interpreter::ARM_Interpreter()  {
 }
 
 ARM_Interpreter::~ARM_Interpreter() {
-    delete state;
+    free(state->cold);
+    free(state->ThumbTranslations);
+    FreeAlignedMemory(state);
 }
 
 /**
@@ -86,20 +93,26 @@ void ARM_Interpreter::SetCPSR(u32 cpsr) {
 }
 
 /**
- * Returns the number of clock ticks since the last reset
+ * Returns the number of clock ticks since the last reset, as charged by the CycleModel
  * @return Returns number of clock ticks
  */
 u64 ARM_Interpreter::GetTicks() const {
-    return ARMul_Time(state);
+    return state->NumCycles;
 }
 
 /**
  * Executes the given number of instructions
  * @param num_instructions Number of instructions to executes
+ * @return Number of instructions executed, fewer than requested after PrepareReschedule
  */
-void ARM_Interpreter::ExecuteInstructions(int num_instructions) {
-    state->NumInstrsToExecute = num_instructions;
+int ARM_Interpreter::ExecuteInstructions(int num_instructions) {
+    // ARMul_Emulate32 runs one instruction more than NumInstrsToExecute
+    skipped_instructions = 0;
+    state->DebugStop = 0;
+    state->DebugSkipped = 0;
+    state->NumInstrsToExecute = num_instructions - 1;
     ARMul_Emulate32(state);
+    return num_instructions - skipped_instructions - state->DebugSkipped;
 }
 
 /**
@@ -109,15 +122,31 @@ void ARM_Interpreter::ExecuteInstructions(int num_instructions) {
  */
 void ARM_Interpreter::SaveContext(ThreadContext& ctx) {
     memcpy(ctx.cpu_registers, state->Reg, sizeof(ctx.cpu_registers));
-    memcpy(ctx.fpu_registers, state->ExtReg, sizeof(ctx.fpu_registers));
 
     ctx.sp = state->Reg[13];
     ctx.lr = state->Reg[14];
     ctx.pc = state->pc;
     ctx.cpsr = state->Cpsr;
-
-    ctx.fpscr = state->VFP[1];
-    ctx.fpexc = state->VFP[2];
+    ctx.tls_address = state->TPIDRURO;
+    ctx.tls_user = state->TPIDRURW;
+
+    // The VFP registers of the thread are still in the unit if it used VFP since its context was
+    // loaded, and in its context otherwise. Either way there's nothing to do if they're already
+    // where they have to go.
+    if (state->VFPOwner == state->VFPContext) {
+        if (&ctx != state->VFPOwner || state->VFPDirty) {
+            memcpy(ctx.fpu_registers, state->ExtReg, sizeof(ctx.fpu_registers));
+            ctx.fpscr = state->VFP[1];
+            ctx.fpexc = state->VFP[2];
+            if (&ctx == state->VFPOwner) {
+                state->VFPDirty = 0;
+            }
+        }
+    } else if (&ctx != state->VFPContext) {
+        memcpy(ctx.fpu_registers, state->VFPContext->fpu_registers, sizeof(ctx.fpu_registers));
+        ctx.fpscr = state->VFPContext->fpscr;
+        ctx.fpexc = state->VFPContext->fpexc;
+    }
 }
 
 /**
@@ -127,16 +156,57 @@ void ARM_Interpreter::SaveContext(ThreadContext& ctx) {
  */
 void ARM_Interpreter::LoadContext(const ThreadContext& ctx) {
     memcpy(state->Reg, ctx.cpu_registers, sizeof(ctx.cpu_registers));
-    memcpy(state->ExtReg, ctx.fpu_registers, sizeof(ctx.fpu_registers));
 
     state->Reg[13] = ctx.sp;
     state->Reg[14] = ctx.lr;
     state->pc = ctx.pc;
     state->Cpsr = ctx.cpsr;
+    state->TPIDRURO = ctx.tls_address;
+    state->TPIDRURW = ctx.tls_user;
 
-    state->VFP[1] = ctx.fpscr;
-    state->VFP[2] = ctx.fpexc;
+    // The thread switched to can't complete a store exclusive the previous one began
+    ExclusiveMonitor::Clear(state);
+
+    // The VFP registers are only loaded by the first VFP instruction the thread runs. Until then
+    // the unit keeps those of the context they came from, which makes switching back to that
+    // context free, unless they were changed and never saved.
+    if (state->VFPDirty) {
+        state->VFPOwner = NULL;
+        state->VFPDirty = 0;
+    }
+    state->VFPContext = &ctx;
 
     state->Reg[15] = ctx.pc;
     state->NextInstr = RESUME;
 }
+
+/**
+ * Loads a CPU context that needn't outlive the call, such as one read from a savestate
+ * @param ctx Thread context to load
+ */
+void ARM_Interpreter::LoadTransientContext(const ThreadContext& ctx) {
+    LoadContext(ctx);
+
+    // The unit holds the registers of no context, so the next SaveContext stores them and the
+    // next thread loaded reloads its own, even if the unit had them before the savestate
+    memcpy(state->ExtReg, ctx.fpu_registers, sizeof(ctx.fpu_registers));
+    state->VFP[1] = ctx.fpscr;
+    state->VFP[2] = ctx.fpexc;
+    state->VFPContext = NULL;
+    state->VFPOwner = NULL;
+    state->VFPDirty = 1;
+}
+
+/// Stops the current Run() at the end of the instruction being executed (e.g. from an SVC)
+void ARM_Interpreter::PrepareReschedule() {
+    skipped_instructions = state->NumInstrsToExecute;
+    state->NumInstrsToExecute = 0;
+}
+
+/**
+ * Tells whether the last Run() stopped early at a breakpoint or watchpoint of Core
+ * @return True if it did, the instruction at the breakpoint is run first by the next Run()
+ */
+bool ARM_Interpreter::IsStoppedForDebugger() const {
+    return state->DebugStop != 0;
+}
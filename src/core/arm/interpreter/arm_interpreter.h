@@ -55,7 +55,7 @@ public:
     void SetCPSR(u32 cpsr);
 
     /**
-     * Returns the number of clock ticks since the last reset
+     * Returns the number of clock ticks since the last reset, as charged by the CycleModel
      * @return Returns number of clock ticks
      */
     u64 GetTicks() const;
@@ -72,16 +72,31 @@ public:
      */
     void LoadContext(const ThreadContext& ctx);
 
+    /**
+     * Loads a CPU context that needn't outlive the call, such as one read from a savestate
+     * @param ctx Thread context to load
+     */
+    void LoadTransientContext(const ThreadContext& ctx);
+
+    /// Stops the current Run() at the end of the instruction being executed (e.g. from an SVC)
+    void PrepareReschedule();
+
+    /// Tells whether the last Run() stopped early at a breakpoint or watchpoint of Core
+    bool IsStoppedForDebugger() const;
+
 protected:
 
     /**
      * Executes the given number of instructions
      * @param num_instructions Number of instructions to executes
+     * @return Number of instructions executed, fewer than requested after PrepareReschedule
      */
-    void ExecuteInstructions(int num_instructions);
+    int ExecuteInstructions(int num_instructions);
+
+    ARMul_State* state;
 
 private:
 
-    ARMul_State* state;
+    u32 skipped_instructions;   ///< Instructions of the current slice dropped by PrepareReschedule
 
 };
@@ -21,7 +21,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stddef.h>
 
+#include "common/common.h"
 #include "common/platform.h"
 
 //teawater add for arm2x86 2005.02.14-------------------------------------------
@@ -115,6 +117,9 @@ typedef unsigned int ARMword;    /* must be 32 bits wide */
 typedef unsigned char ARMbyte;    /* must be 8 bits wide */
 typedef unsigned short ARMhword;    /* must be 16 bits wide */
 typedef struct ARMul_State ARMul_State;
+typedef struct ARMul_ColdState ARMul_ColdState;
+struct ThreadContext;
+namespace DecodeCache { struct Page; }
 typedef struct ARMul_io ARMul_io;
 typedef struct ARMul_Energy ARMul_Energy;
 
@@ -229,15 +234,87 @@ typedef struct
 } mem_config_t;
 #endif
 #define VFP_REG_NUM 64
+#define JIT_RETURN_STACK_SIZE 8    /* entries of the return stack of translated BLs, a power of 2 */
+#define ARMUL_HOT_STATE_SIZE 256    /* bytes at the start of ARMul_State the hot state fits in */
+
+/* Simulation state of the skyeye MMU, cache and device models. The 3DS cores don't go through
+   them when they run code, so it lives out of ARMul_State behind ARMul_State::cold. */
+struct ARMul_ColdState
+{
+    mmu_state_t mmu;
+    int mmu_inited;
+
+//added by ksh:for handle different machs io 2004-3-5
+    ARMul_io mach_io;
+
+/*added by ksh,2004-11-26,some energy profiling*/
+    ARMul_Energy energy;
+
+    /* monitored memory for exclusice access */
+    ARMword exclusive_tag_array[128];
+    /* 1 means exclusive access and 0 means open access */
+    ARMword exclusive_access_state;
+
+//teawater add for record reg value to ./reg.txt 2005.07.10---------------------
+    FILE *tea_reg_fd;
+//AJ2D--------------------------------------------------------------------------
+//diff log
+    FILE * state_log;
+
+    u32 WriteAddr[17];
+    u32 WriteData[17];
+    u32 WritePc[17];
+    u32 CurrWrite;
+};
+
 struct ARMul_State
 {
+    /* ---- Hot state, what the interpreter and the translated blocks touch on every instruction.
+       It starts on a cache line and fits in the first ARMUL_HOT_STATE_SIZE bytes. ---- */
+    MEMORY_ALIGNED64(ARMword Reg[16]);    /* the current register file */
+    unsigned long long NumCycles;    /* CycleModel cycles, what the core reports as its ticks */
+    unsigned long long NumInstrs;    /* the number of instructions executed */
+    unsigned NumInstrsToExecute;
+    /* Run time state of the blocks ARM_JIT translates, which address it relative to the state */
+    int JITDowncount;    /* instructions the blocks may still run before returning */
+    const u8 *JITDirtyPages;    /* Memory::g_dirty_pages, checked by a block before it runs */
+
+    ARMword NFlag, ZFlag, CFlag, VFlag, IFFlags;    /* dummy flags for speed */
+#ifdef MODET
+    ARMword TFlag;        /* Thumb state */
+#endif
+    ARMword Cpsr;        /* the current psr */
+    ARMword Mode;        /* the current mode */
+    ARMword Bank;        /* the current register bank */
+    /* C and V of the last add/subtract, evaluated on first use (see ARMul_ResolveFlags) */
+    ARMword LazyFlagsOp, LazyFlagsA, LazyFlagsB, LazyFlagsResult;
+    unsigned int shifter_carry_out;
+
     ARMword Emulate;    /* to start and stop emulation */
+    unsigned NextInstr;
+    ARMword instr, pc, temp;    /* saved register state */
+    ARMword loaded, decoded;    /* saved pipeline state */
+    //chy 2006-04-12 for ICE breakpoint
+    ARMword loaded_addr, decoded_addr;    /* saved pipeline state addr*/
+    u32 CurrInstr;
+    unsigned int NumScycles, NumNcycles, NumIcycles, NumCcycles, NumFcycles;    /* emulated cycles used */
+
+    ARMword Aborted;    /* sticky flag for aborts */
+    unsigned abortSig;
+    unsigned NtransSig;
+    unsigned NresetSig;    /* reset the processor */
+    unsigned NfiqSig;
+    unsigned NirqSig;
+    ARMword exclusive_tag;    /* granule reserved by LDREX, see ExclusiveMonitor */
+    unsigned DebugStop;    /* stop before the next instruction, for a breakpoint or watchpoint */
+    /* Page of the decode cache looked up last, most fetches hit it (see DecodeCache::Fetch) */
+    ARMword DecodeLastPageIndex;
+    DecodeCache::Page *DecodeLastPage;
+    /* ---- End of the hot state ---- */
+
     unsigned EndCondition;    /* reason for stopping */
     unsigned ErrorCode;    /* type of illegal instruction */
 
-    /* Order of the following register should not be modified */
-    ARMword Reg[16];    /* the current register file */
-    ARMword Cpsr;        /* the current psr */
     ARMword Spsr_copy;
     ARMword phys_pc;
     ARMword Reg_usr[2];
@@ -247,9 +324,6 @@ struct ARMul_State
     ARMword Reg_irq[2];   /* R13_IRQ R14_IRQ */
     ARMword Reg_firq[7];  /* R8---R14 FIRQ */
     ARMword Spsr[7];    /* the exception psr's */
-    ARMword Mode;        /* the current mode */
-    ARMword Bank;        /* the current register bank */
-    ARMword exclusive_tag;
     ARMword exclusive_state;
     ARMword exclusive_result;
     ARMword CP15[VFP_BASE - CP15_BASE];
@@ -258,34 +332,29 @@ struct ARMul_State
        VFPv3-D32/ASIMD may have up to 32 doubleword registers (D0-D31),
         and only 32 singleword registers are accessible (S0-S31). */
     ARMword ExtReg[VFP_REG_NUM];
-    /* ---- End of the ordered registers ---- */
-    
+
     ARMword RegBank[7][16];    /* all the registers */
     //chy:2003-08-19, used in arm xscale
     /* 40 bit accumulator.  We always keep this 64 bits wide,
        and move only 40 bits out of it in an MRA insn.  */
     ARMdword Accumulator;
 
-    ARMword NFlag, ZFlag, CFlag, VFlag, IFFlags;    /* dummy flags for speed */
+    /* Lazy VFP context switching: ExtReg, FPSCR and FPEXC are only swapped on the first VFP
+       instruction after a context load (see vfp_switch_context) */
+    const struct ThreadContext* VFPContext;  /* context of the running thread */
+    const struct ThreadContext* VFPOwner;    /* context the VFP registers were loaded from */
+    int VFPDirty;                            /* VFP used since the registers were last saved */
+    /* CP15 c13 thread IDs of the running thread, loaded with its context. MRC and MCR reach them
+       without going through the coprocessor dispatch. */
+    ARMword TPIDRURO;                        /* user read-only, the TLS of the thread */
+    ARMword TPIDRURW;                        /* user read/write */
         unsigned long long int icounter, debug_icounter, kernel_icounter;
-        unsigned int shifter_carry_out;
         //ARMword translate_pc;
 
     /* add armv6 flags dyf:2010-08-09 */
     ARMword GEFlag, EFlag, AFlag, QFlags;
     //chy:2003-08-19, used in arm v5e|xscale
     ARMword SFlag;
-#ifdef MODET
-    ARMword TFlag;        /* Thumb state */
-#endif
-    ARMword instr, pc, temp;    /* saved register state */
-    ARMword loaded, decoded;    /* saved pipeline state */
-    //chy 2006-04-12 for ICE breakpoint
-    ARMword loaded_addr, decoded_addr;    /* saved pipeline state addr*/
-    unsigned int NumScycles, NumNcycles, NumIcycles, NumCcycles, NumFcycles;    /* emulated cycles used */
-    unsigned long long NumInstrs;    /* the number of instructions executed */
-    unsigned NumInstrsToExecute;
-    unsigned NextInstr;
     unsigned VectorCatch;    /* caught exception mask */
     unsigned CallDebug;    /* set to call the debugger */
     unsigned CanWatch;    /* set by memory interface if its willing to suffer the
@@ -314,12 +383,6 @@ struct ARMul_State
     struct EventNode **EventPtr;    /* the event list */
 
     unsigned Debug;        /* show instructions as they are executed */
-    unsigned NresetSig;    /* reset the processor */
-    unsigned NfiqSig;
-    unsigned NirqSig;
-
-    unsigned abortSig;
-    unsigned NtransSig;
     unsigned bigendSig;
     unsigned prog32Sig;
     unsigned data32Sig;
@@ -359,7 +422,6 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
     unsigned lateabtSig;
 
     ARMword Vector;        /* synthesize aborts in cycle modes */
-    ARMword Aborted;    /* sticky flag for aborts */
     ARMword Reseted;    /* sticky flag for Reset */
     ARMword Inted, LastInted;    /* sticky flags for interrupts */
     ARMword Base;        /* extra hand for base writeback */
@@ -369,8 +431,10 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
 
     int verbose;        /* non-zero means print various messages like the banner */
 
-    mmu_state_t mmu;
-    int mmu_inited;
+    ARMul_ColdState *cold;    /* MMU, cache and device models, see ARMul_ColdState */
+    /* ARM equivalents of the Thumb opcodes decoded so far, see ARMul_ThumbDecode. Per core, the
+       cores may run on two host threads. */
+    ARMword *ThumbTranslations;
     //mem_state_t mem;
     /*remove io_state to skyeye_mach_*.c files */
     //io_state_t io;
@@ -394,12 +458,6 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
     ARMword CP14R0_CCD;    /* used to count 64 clock cycles with CP14 R0 bit 3 set */
 
 
-//added by ksh:for handle different machs io 2004-3-5
-    ARMul_io mach_io;
-
-/*added by ksh,2004-11-26,some energy profiling*/
-    ARMul_Energy energy;
-
 //teawater add for next_dis 2004.10.27-----------------------
     int disassemble;
 //AJ2D------------------------------------------
@@ -426,10 +484,6 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
     void *tb_now;
 //AJ2D--------------------------------------------------------------------------
 
-//teawater add for record reg value to ./reg.txt 2005.07.10---------------------
-    FILE *tea_reg_fd;
-//AJ2D--------------------------------------------------------------------------
-
 /*added by ksh in 2005-10-1*/
     cpu_config_t *cpu;
     //mem_config_t *mem_bank;
@@ -447,25 +501,25 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
 #ifdef DBCT_TEST_SPEED
     uint64_t    instr_count;
 #endif    //DBCT_TEST_SPEED
-//    FILE * state_log;
-//diff log
-//#if DIFF_STATE
-    FILE * state_log;
-//#endif
-    /* monitored memory for exclusice access */
-    ARMword exclusive_tag_array[128];
-    /* 1 means exclusive access and 0 means open access */
-    ARMword exclusive_access_state;
 
     memory_space_intf space;    
-    u32 CurrInstr;
     u32 last_pc; /* the last pc executed */
     u32 last_instr; /* the last inst executed */
-    u32 WriteAddr[17];
-    u32 WriteData[17];
-    u32 WritePc[17];
-    u32 CurrWrite;
+
+    unsigned DebugSkipped;    /* instructions of the run left over when it stopped */
+    ARMword BreakPointPassed;    /* breakpoint stopped at, the next fetch runs past it */
+
+    /* Return stack of the translated BLs, see ARM_JIT */
+    unsigned JITReturnTop;    /* index of the top of JITReturnStack */
+    struct {
+        ARMword pc;    /* guest address a BL returns to */
+        ARMword reserved;
+        void *code;    /* host code of the block at pc, NULL while it isn't known */
+    } JITReturnStack[JIT_RETURN_STACK_SIZE];
 };
+
+static_assert(offsetof(ARMul_State, EndCondition) <= ARMUL_HOT_STATE_SIZE,
+    "the hot state of ARMul_State outgrew its cache lines");
 #define DIFF_WRITE 0
 
 typedef ARMul_State arm_core_t;
@@ -819,6 +873,50 @@ pascal void SpinCursor (short increment);    /* copied from CursorCtl.h */
 #define AL 14
 #define NV 15
 
+/* Pending lazy C/V flag computations */
+#define LAZY_FLAGS_NONE 0
+#define LAZY_FLAGS_ADD  1
+#define LAZY_FLAGS_SUB  2
+
+/* Flag-setting adds and subtracts only record their operands and result, most of the time the
+   C and V flags they would produce are overwritten before anything looks at them.  The flags
+   are computed here when they are actually read or when another write to them needs the
+   pending result out of the way first. */
+static inline void
+ARMul_ResolveFlags (ARMul_State * state)
+{
+	if (state->LazyFlagsOp != LAZY_FLAGS_NONE) {
+		ARMword a = state->LazyFlagsA >> 31;
+		ARMword b = state->LazyFlagsB >> 31;
+		ARMword r = state->LazyFlagsResult >> 31;
+
+		if (state->LazyFlagsOp == LAZY_FLAGS_ADD) {
+			state->CFlag = (a & b) | (a & !r) | (b & !r);
+			state->VFlag = (a == b) && (a != r);
+		}
+		else {
+			state->CFlag = (a & !b) | (a & !r) | (!b & !r);
+			state->VFlag = (a != b) && (a != r);
+		}
+		state->LazyFlagsOp = LAZY_FLAGS_NONE;
+	}
+}
+
+/* Condition codes as masks of the NZCV values that pass them, bit (N << 3 | Z << 2 | C << 1 | V)
+   of the entry of a condition being set when it passes.  NV has no bits, the instructions of
+   that space are decoded apart from the conditional ones. */
+extern const u16 ARMul_ConditionTable[16];
+
+/* Whether the flags pass a condition code, one look-up in place of evaluating the flags */
+static inline int
+ARMul_ConditionPassed (ARMul_State * state, ARMword cond)
+{
+	ARMul_ResolveFlags (state);
+	ARMword nzcv = (state->NFlag << 3) | (state->ZFlag << 2) | (state->CFlag << 1)
+		| state->VFlag;
+	return (ARMul_ConditionTable[cond] >> nzcv) & 1;
+}
+
 #ifndef NFLAG
 #define NFLAG    state->NFlag
 #endif //NFLAG
@@ -828,11 +926,11 @@ pascal void SpinCursor (short increment);    /* copied from CursorCtl.h */
 #endif //ZFLAG
 
 #ifndef CFLAG
-#define CFLAG    state->CFlag
+#define CFLAG    (ARMul_ResolveFlags (state), state->CFlag)
 #endif //CFLAG
 
 #ifndef VFLAG
-#define VFLAG    state->VFlag
+#define VFLAG    (ARMul_ResolveFlags (state), state->VFlag)
 #endif //VFLAG
 
 #ifndef IFLAG
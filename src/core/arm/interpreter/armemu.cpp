@@ -16,12 +16,23 @@
     along with this program; if not, write to the Free Software
     Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.  */
 
+#include "core/core.h"
+#include "core/mem_map.h"
+#include "core/arm/cycle_model.h"
+#include "core/arm/exclusive_monitor.h"
+#include "core/arm/exec_trace.h"
+#include "core/arm/shadow_stack.h"
 #include "core/hle/hle.h"
 
 #include "arm_regformat.h"
 #include "armdefs.h"
 #include "armemu.h"
 #include "armos.h"
+#include "decode_cache.h"
+#include "dp_handlers.h"
+#include "idle_loop.h"
+#include "media_handlers.h"
+#include "thumb_handlers.h"
 
 #define ARMul_Debug(x,y,z) 0 // Disabling this /bunnei
 
@@ -308,7 +319,7 @@ unsigned int mirror_register_file[39];
 
 /* The PC pipeline value depends on whether ARM
    or Thumb instructions are being executed.  */
-ARMword isize;
+THREAD_LOCAL ARMword isize;
 
 extern int debugmode;
 int ARMul_ICE_debug(ARMul_State *state,ARMword instr,ARMword addr);
@@ -549,7 +560,18 @@ ARMul_Emulate26 (ARMul_State * state)
         }
         printf("\n");
 #endif
-    instr = ARMul_LoadInstrN (state, pc, isize);
+    /* Thumb halfwords come out of the cached word they are part of.  */
+    instr = DecodeCache::Fetch (state, pc, TFLAG != 0);
+    if (state->DebugStop) {
+        /* A breakpoint or watchpoint of Core: stop before this instruction, RESUME fetches it
+           again when the core runs on.  */
+        state->Reg[15] = pc;
+        state->NextInstr = RESUME;
+        state->DebugSkipped = state->NumInstrsToExecute + 1;
+        break;
+    }
+    if (pc & 2)
+        instr >>= 16;
     state->last_instr = state->CurrInstr;
     state->CurrInstr = instr;
 #if 0
@@ -567,7 +589,7 @@ ARMul_Emulate26 (ARMul_State * state)
                 for (;idx < 17; idx ++) {
                         printf("R%d:%x\t", idx, state->Reg[idx]);
                 }
-            printf("\nN:%d\t Z:%d\t C:%d\t V:%d\n", state->NFlag,  state->ZFlag, state->CFlag, state->VFlag);
+            printf("\nN:%d\t Z:%d\t C:%d\t V:%d\n", state->NFlag,  state->ZFlag, CFLAG, VFLAG);
                 printf("\n");
             printf("------------------------------------\n");
             flag--;
@@ -575,7 +597,7 @@ ARMul_Emulate26 (ARMul_State * state)
     }
 #endif    
 #if DIFF_STATE
-      fprintf(state->state_log, "PC:0x%x\n", pc);
+      fprintf(state->cold->state_log, "PC:0x%x\n", pc);
       if (pc && (pc + 8) != state->Reg[15]) {
               printf("lucky dog\n");
               printf("pc is %x, R15 is %x\n", pc, state->Reg[15]);
@@ -583,92 +605,92 @@ ARMul_Emulate26 (ARMul_State * state)
       }
       for (reg_index = 0; reg_index < 16; reg_index ++) {
               if (state->Reg[reg_index] != mirror_register_file[reg_index]) {
-                      fprintf(state->state_log, "R%d:0x%x\n", reg_index, state->Reg[reg_index]);
+                      fprintf(state->cold->state_log, "R%d:0x%x\n", reg_index, state->Reg[reg_index]);
                       mirror_register_file[reg_index] = state->Reg[reg_index];
               }
       }
       if (state->Cpsr != mirror_register_file[CPSR_REG]) {
-              fprintf(state->state_log, "Cpsr:0x%x\n", state->Cpsr);
+              fprintf(state->cold->state_log, "Cpsr:0x%x\n", state->Cpsr);
               mirror_register_file[CPSR_REG] = state->Cpsr;
       }
       if (state->RegBank[SVCBANK][13] != mirror_register_file[R13_SVC]) {
-              fprintf(state->state_log, "R13_SVC:0x%x\n", state->RegBank[SVCBANK][13]);
+              fprintf(state->cold->state_log, "R13_SVC:0x%x\n", state->RegBank[SVCBANK][13]);
               mirror_register_file[R13_SVC] = state->RegBank[SVCBANK][13];
       }
       if (state->RegBank[SVCBANK][14] != mirror_register_file[R14_SVC]) {
-              fprintf(state->state_log, "R14_SVC:0x%x\n", state->RegBank[SVCBANK][14]);
+              fprintf(state->cold->state_log, "R14_SVC:0x%x\n", state->RegBank[SVCBANK][14]);
               mirror_register_file[R14_SVC] = state->RegBank[SVCBANK][14];
       }
       if (state->RegBank[ABORTBANK][13] != mirror_register_file[R13_ABORT]) {
-              fprintf(state->state_log, "R13_ABORT:0x%x\n", state->RegBank[ABORTBANK][13]);
+              fprintf(state->cold->state_log, "R13_ABORT:0x%x\n", state->RegBank[ABORTBANK][13]);
               mirror_register_file[R13_ABORT] = state->RegBank[ABORTBANK][13];
       }
       if (state->RegBank[ABORTBANK][14] != mirror_register_file[R14_ABORT]) {
-              fprintf(state->state_log, "R14_ABORT:0x%x\n", state->RegBank[ABORTBANK][14]);
+              fprintf(state->cold->state_log, "R14_ABORT:0x%x\n", state->RegBank[ABORTBANK][14]);
               mirror_register_file[R14_ABORT] = state->RegBank[ABORTBANK][14];
       }
       if (state->RegBank[UNDEFBANK][13] != mirror_register_file[R13_UNDEF]) {
-              fprintf(state->state_log, "R13_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][13]);
+              fprintf(state->cold->state_log, "R13_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][13]);
               mirror_register_file[R13_UNDEF] = state->RegBank[UNDEFBANK][13];
       }
       if (state->RegBank[UNDEFBANK][14] != mirror_register_file[R14_UNDEF]) {
-              fprintf(state->state_log, "R14_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][14]);
+              fprintf(state->cold->state_log, "R14_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][14]);
               mirror_register_file[R14_UNDEF] = state->RegBank[UNDEFBANK][14];
       }
       if (state->RegBank[IRQBANK][13] != mirror_register_file[R13_IRQ]) {
-              fprintf(state->state_log, "R13_IRQ:0x%x\n", state->RegBank[IRQBANK][13]);
+              fprintf(state->cold->state_log, "R13_IRQ:0x%x\n", state->RegBank[IRQBANK][13]);
               mirror_register_file[R13_IRQ] = state->RegBank[IRQBANK][13];
       }
       if (state->RegBank[IRQBANK][14] != mirror_register_file[R14_IRQ]) {
-              fprintf(state->state_log, "R14_IRQ:0x%x\n", state->RegBank[IRQBANK][14]);
+              fprintf(state->cold->state_log, "R14_IRQ:0x%x\n", state->RegBank[IRQBANK][14]);
               mirror_register_file[R14_IRQ] = state->RegBank[IRQBANK][14];
       }
       if (state->RegBank[FIQBANK][8] != mirror_register_file[R8_FIRQ]) {
-              fprintf(state->state_log, "R8_FIRQ:0x%x\n", state->RegBank[FIQBANK][8]);
+              fprintf(state->cold->state_log, "R8_FIRQ:0x%x\n", state->RegBank[FIQBANK][8]);
               mirror_register_file[R8_FIRQ] = state->RegBank[FIQBANK][8];
       }
       if (state->RegBank[FIQBANK][9] != mirror_register_file[R9_FIRQ]) {
-              fprintf(state->state_log, "R9_FIRQ:0x%x\n", state->RegBank[FIQBANK][9]);
+              fprintf(state->cold->state_log, "R9_FIRQ:0x%x\n", state->RegBank[FIQBANK][9]);
               mirror_register_file[R9_FIRQ] = state->RegBank[FIQBANK][9];
       }
       if (state->RegBank[FIQBANK][10] != mirror_register_file[R10_FIRQ]) {
-              fprintf(state->state_log, "R10_FIRQ:0x%x\n", state->RegBank[FIQBANK][10]);
+              fprintf(state->cold->state_log, "R10_FIRQ:0x%x\n", state->RegBank[FIQBANK][10]);
               mirror_register_file[R10_FIRQ] = state->RegBank[FIQBANK][10];
       }
       if (state->RegBank[FIQBANK][11] != mirror_register_file[R11_FIRQ]) {
-              fprintf(state->state_log, "R11_FIRQ:0x%x\n", state->RegBank[FIQBANK][11]);
+              fprintf(state->cold->state_log, "R11_FIRQ:0x%x\n", state->RegBank[FIQBANK][11]);
               mirror_register_file[R11_FIRQ] = state->RegBank[FIQBANK][11];
       }
       if (state->RegBank[FIQBANK][12] != mirror_register_file[R12_FIRQ]) {
-              fprintf(state->state_log, "R12_FIRQ:0x%x\n", state->RegBank[FIQBANK][12]);
+              fprintf(state->cold->state_log, "R12_FIRQ:0x%x\n", state->RegBank[FIQBANK][12]);
               mirror_register_file[R12_FIRQ] = state->RegBank[FIQBANK][12];
       }
       if (state->RegBank[FIQBANK][13] != mirror_register_file[R13_FIRQ]) {
-              fprintf(state->state_log, "R13_FIRQ:0x%x\n", state->RegBank[FIQBANK][13]);
+              fprintf(state->cold->state_log, "R13_FIRQ:0x%x\n", state->RegBank[FIQBANK][13]);
               mirror_register_file[R13_FIRQ] = state->RegBank[FIQBANK][13];
       }
       if (state->RegBank[FIQBANK][14] != mirror_register_file[R14_FIRQ]) {
-              fprintf(state->state_log, "R14_FIRQ:0x%x\n", state->RegBank[FIQBANK][14]);
+              fprintf(state->cold->state_log, "R14_FIRQ:0x%x\n", state->RegBank[FIQBANK][14]);
               mirror_register_file[R14_FIRQ] = state->RegBank[FIQBANK][14];
       }
       if (state->Spsr[SVCBANK] != mirror_register_file[SPSR_SVC]) {
-              fprintf(state->state_log, "SPSR_SVC:0x%x\n", state->Spsr[SVCBANK]);
+              fprintf(state->cold->state_log, "SPSR_SVC:0x%x\n", state->Spsr[SVCBANK]);
               mirror_register_file[SPSR_SVC] = state->RegBank[SVCBANK];
       }
       if (state->Spsr[ABORTBANK] != mirror_register_file[SPSR_ABORT]) {
-              fprintf(state->state_log, "SPSR_ABORT:0x%x\n", state->Spsr[ABORTBANK]);
+              fprintf(state->cold->state_log, "SPSR_ABORT:0x%x\n", state->Spsr[ABORTBANK]);
               mirror_register_file[SPSR_ABORT] = state->RegBank[ABORTBANK];
       }
       if (state->Spsr[UNDEFBANK] != mirror_register_file[SPSR_UNDEF]) {
-              fprintf(state->state_log, "SPSR_UNDEF:0x%x\n", state->Spsr[UNDEFBANK]);
+              fprintf(state->cold->state_log, "SPSR_UNDEF:0x%x\n", state->Spsr[UNDEFBANK]);
               mirror_register_file[SPSR_UNDEF] = state->RegBank[UNDEFBANK];
       }
       if (state->Spsr[IRQBANK] != mirror_register_file[SPSR_IRQ]) {
-              fprintf(state->state_log, "SPSR_IRQ:0x%x\n", state->Spsr[IRQBANK]);
+              fprintf(state->cold->state_log, "SPSR_IRQ:0x%x\n", state->Spsr[IRQBANK]);
               mirror_register_file[SPSR_IRQ] = state->RegBank[IRQBANK];
       }
       if (state->Spsr[FIQBANK] != mirror_register_file[SPSR_FIRQ]) {
-              fprintf(state->state_log, "SPSR_FIRQ:0x%x\n", state->Spsr[FIQBANK]);
+              fprintf(state->cold->state_log, "SPSR_FIRQ:0x%x\n", state->Spsr[FIQBANK]);
               mirror_register_file[SPSR_FIRQ] = state->RegBank[FIQBANK];
       }
 #endif
@@ -691,7 +713,7 @@ ARMul_Emulate26 (ARMul_State * state)
                 printf("R%02d % 8x\n", alex, state->Reg[alex]);
             }
             printf("R%02d % 8x\n", alex, state->Reg[alex] - 8);
-            printf("CPS %x%07x\n", (state->NFlag<<3 | state->ZFlag<<2 | state->CFlag<<1 | state->VFlag), state->Cpsr & 0xfffffff);
+            printf("CPS %x%07x\n", (state->NFlag<<3 | state->ZFlag<<2 | CFLAG<<1 | VFLAG), state->Cpsr & 0xfffffff);
         } else {
             if (state->NumInstrs < 0x400000)
             {
@@ -870,15 +892,15 @@ ARMul_Emulate26 (ARMul_State * state)
         if (state->tea_pc) {
             int i;
 
-            if (state->tea_reg_fd) {
-                fprintf (state->tea_reg_fd, "\n");
+            if (state->cold->tea_reg_fd) {
+                fprintf (state->cold->tea_reg_fd, "\n");
                 for (i = 0; i < 15; i++) {
-                    fprintf (state->tea_reg_fd, "%x,",
+                    fprintf (state->cold->tea_reg_fd, "%x,",
                          state->Reg[i]);
                 }
-                fprintf (state->tea_reg_fd, "%x,", pc);
+                fprintf (state->cold->tea_reg_fd, "%x,", pc);
                 state->Cpsr = ARMul_GetCPSR (state);
-                fprintf (state->tea_reg_fd, "%x\n",
+                fprintf (state->cold->tea_reg_fd, "%x\n",
                      state->Cpsr);
             }
             else {
@@ -929,6 +951,11 @@ ARMul_Emulate26 (ARMul_State * state)
         if (TFLAG) {
             ARMword new_instr;
 
+            /* The common Thumb instructions run through their native
+               handlers, the others are translated.  */
+            if (ThumbHandlers::Execute (state, pc, instr))
+                goto donext;
+
             /* Check if in Thumb mode.  */
             switch (ARMul_ThumbDecode(state, pc, instr, &new_instr)) {
             case t_undefined:
@@ -979,20 +1006,11 @@ ARMul_Emulate26 (ARMul_State * state)
             }
             /* dyf add for armv6 instruct CPS 2010.9.17 */
             if (state->is_v6) {
-                /* clrex do nothing here temporary */
+                /* clrex */
                 if (instr == 0xf57ff01f) {
-                    //printf("clrex \n");
-                    ERROR_LOG(ARM11, "Instr = 0x%x, pc = 0x%x, clrex instr!!\n", instr, pc);
-#if 0
-                    int i;
-                    for(i = 0; i < 128; i++){
-                        state->exclusive_tag_array[i] = 0xffffffff;
-                    }
-#endif
-                    /* shenoubang 2012-3-14 refer the dyncom_interpreter */
-                    state->exclusive_tag_array[0] = 0xFFFFFFFF;
-                    state->exclusive_access_state = 0;
-                    _assert_msg_(ARM11, false, "disabled skyeye code 'goto donext'"); //goto donext;
+                    ExclusiveMonitor::Clear(state);
+                    temp = FALSE;
+                    break;
                 }
 
                 if (BITS(20, 27) == 0x10) {
@@ -1067,49 +1085,8 @@ ARMul_Emulate26 (ARMul_State * state)
             }
             temp = FALSE;
             break;
-        case EQ:
-            temp = ZFLAG;
-            break;
-        case NE:
-            temp = !ZFLAG;
-            break;
-        case VS:
-            temp = VFLAG;
-            break;
-        case VC:
-            temp = !VFLAG;
-            break;
-        case MI:
-            temp = NFLAG;
-            break;
-        case PL:
-            temp = !NFLAG;
-            break;
-        case CS:
-            temp = CFLAG;
-            break;
-        case CC:
-            temp = !CFLAG;
-            break;
-        case HI:
-            temp = (CFLAG && !ZFLAG);
-            break;
-        case LS:
-            temp = (!CFLAG || ZFLAG);
-            break;
-        case GE:
-            temp = ((!NFLAG && !VFLAG) || (NFLAG && VFLAG));
-            break;
-        case LT:
-            temp = ((NFLAG && !VFLAG) || (!NFLAG && VFLAG));
-            break;
-        case GT:
-            temp = ((!NFLAG && !VFLAG && !ZFLAG)
-                || (NFLAG && VFLAG && !ZFLAG));
-            break;
-        case LE:
-            temp = ((NFLAG && !VFLAG) || (!NFLAG && VFLAG))
-                || ZFLAG;
+        default:
+            temp = ARMul_ConditionPassed (state, temp);
             break;
         }        /* cc check */
 
@@ -1213,6 +1190,11 @@ ARMul_Emulate26 (ARMul_State * state)
         if (temp) {
               mainswitch:
 
+            /* Data processing instructions not involving the PC run
+               through their specialised handlers.  */
+            if (DPHandlers::Execute (state, instr))
+                goto donext;
+
             if (state->is_XScale) {
                 if (BIT (20) == 0 && BITS (25, 27) == 0) {
                     if (BITS (4, 7) == 0xD) {
@@ -2590,6 +2572,12 @@ ARMul_Emulate26 (ARMul_State * state)
 
             case 0x1a:    /* MOV reg */
 #ifdef MODET
+                /* strexd */
+                if (state->is_v6) {
+                    if (BITS (4, 7) == 0x9)
+                        if (handle_v6_insn (state, instr))
+                            break;
+                }
                 if (BITS (4, 11) == 0xB) {
                     /* STRH register offset, write-back, up, pre indexed.  */
                     SHPREUPWB ();
@@ -2610,6 +2598,12 @@ ARMul_Emulate26 (ARMul_State * state)
 
             case 0x1b:    /* MOVS reg */
 #ifdef MODET
+                /* ldrexd */
+                if (state->is_v6) {
+                    if (BITS (4, 7) == 0x9)
+                        if (handle_v6_insn (state, instr))
+                            break;
+                }
                 if ((BITS (4, 11) & 0xF9) == 0x9)
                     /* LDR register offset, write-back, up, pre indexed.  */
                     LHPREUPWB ();
@@ -2690,6 +2684,12 @@ ARMul_Emulate26 (ARMul_State * state)
 
             case 0x1e:    /* MVN reg */
 #ifdef MODET
+                /* strexh */
+                if (state->is_v6) {
+                    if (BITS (4, 7) == 0x9)
+                        if (handle_v6_insn (state, instr))
+                            break;
+                }
                 if (BITS (4, 7) == 0xB) {
                     /* STRH immediate offset, write-back, up, pre indexed.  */
                     SHPREUPWB ();
@@ -2710,6 +2710,12 @@ ARMul_Emulate26 (ARMul_State * state)
 
             case 0x1f:    /* MVNS reg */
 #ifdef MODET
+                /* ldrexh */
+                if (state->is_v6) {
+                    if (BITS (4, 7) == 0x9)
+                        if (handle_v6_insn (state, instr))
+                            break;
+                }
                 if ((BITS (4, 7) & 0x9) == 0x9)
                     /* LDR immediate offset, write-back, up, pre indexed.  */
                     LHPREUPWB ();
@@ -4070,6 +4076,7 @@ ARMul_Emulate26 (ARMul_State * state)
             case 0xae:
             case 0xaf:
                 state->Reg[15] = pc + 8 + NEGBRANCH;
+                IdleLoop::OnBackwardBranch (pc, state->Reg[15]);
                 FLUSHPIPE;
                 break;
 
@@ -4500,6 +4507,18 @@ ARMul_Emulate26 (ARMul_State * state)
             case 0xef:
                 if (BIT (4)) {
                     /* MRC */
+                    // mrc p15, 0, rd, c13, c0, 3 starts every IPC request, the thread IDs are
+                    // read and written straight in the state. MCRs with opcode 0 land here too.
+                    if ((instr & 0x0FFF0FFF) == 0x0E1D0F70 && DESTReg != 15) {
+                        DEST = state->TPIDRURO;
+                        break;
+                    } else if ((instr & 0x0FFF0FFF) == 0x0E1D0F50 && DESTReg != 15) {
+                        DEST = state->TPIDRURW;
+                        break;
+                    } else if ((instr & 0x0FFF0FFF) == 0x0E0D0F50 && DESTReg != 15) {
+                        state->TPIDRURW = DEST;
+                        break;
+                    }
                     temp = ARMul_MRC (state, instr);
                     if (DESTReg == 15) {
                         ASSIGNN ((temp & NBIT) != 0);
@@ -4548,7 +4567,7 @@ ARMul_Emulate26 (ARMul_State * state)
                 //    ARMul_OSHandleSWI (state, BITS (0, 23));
                 //    break;
                 //}
-                HLE::CallSVC(instr);
+                HLE::CallSVC(instr, state->Reg);
                 ARMul_Abort (state, ARMul_SWIV);
                 break;
             }
@@ -4557,6 +4576,11 @@ ARMul_Emulate26 (ARMul_State * state)
 #ifdef MODET
           donext:
 #endif
+              /* Calls and returns, for the debugger.  */
+              if ((state->NextInstr & PRIMEPIPE) && ShadowStack::IsEnabled())
+                  ShadowStack::OnBranch (pc, state->Reg[15], state->Reg[14], state->Reg[13]);
+              if (ExecTrace::IsEnabled ())
+                  ExecTrace::OnInstruction (pc, state->Reg, ARMul_GetCPSR (state));
               state->pc = pc;
 #if 0
             /* shenoubang */
@@ -4587,95 +4611,95 @@ ARMul_Emulate26 (ARMul_State * state)
 #endif
 
 #if 0
-          fprintf(state->state_log, "PC:0x%x\n", pc);
+          fprintf(state->cold->state_log, "PC:0x%x\n", pc);
           for (reg_index = 0; reg_index < 16; reg_index ++) {
                   if (state->Reg[reg_index] != mirror_register_file[reg_index]) {
-                          fprintf(state->state_log, "R%d:0x%x\n", reg_index, state->Reg[reg_index]);
+                          fprintf(state->cold->state_log, "R%d:0x%x\n", reg_index, state->Reg[reg_index]);
                           mirror_register_file[reg_index] = state->Reg[reg_index];
                   }
           }
           if (state->Cpsr != mirror_register_file[CPSR_REG]) {
-                  fprintf(state->state_log, "Cpsr:0x%x\n", state->Cpsr);
+                  fprintf(state->cold->state_log, "Cpsr:0x%x\n", state->Cpsr);
                   mirror_register_file[CPSR_REG] = state->Cpsr;
           }
           if (state->RegBank[SVCBANK][13] != mirror_register_file[R13_SVC]) {
-                  fprintf(state->state_log, "R13_SVC:0x%x\n", state->RegBank[SVCBANK][13]);
+                  fprintf(state->cold->state_log, "R13_SVC:0x%x\n", state->RegBank[SVCBANK][13]);
                   mirror_register_file[R13_SVC] = state->RegBank[SVCBANK][13];
           }
           if (state->RegBank[SVCBANK][14] != mirror_register_file[R14_SVC]) {
-                  fprintf(state->state_log, "R14_SVC:0x%x\n", state->RegBank[SVCBANK][14]);
+                  fprintf(state->cold->state_log, "R14_SVC:0x%x\n", state->RegBank[SVCBANK][14]);
                   mirror_register_file[R14_SVC] = state->RegBank[SVCBANK][14];
           }
           if (state->RegBank[ABORTBANK][13] != mirror_register_file[R13_ABORT]) {
-                  fprintf(state->state_log, "R13_ABORT:0x%x\n", state->RegBank[ABORTBANK][13]);
+                  fprintf(state->cold->state_log, "R13_ABORT:0x%x\n", state->RegBank[ABORTBANK][13]);
                   mirror_register_file[R13_ABORT] = state->RegBank[ABORTBANK][13];
           }
           if (state->RegBank[ABORTBANK][14] != mirror_register_file[R14_ABORT]) {
-                  fprintf(state->state_log, "R14_ABORT:0x%x\n", state->RegBank[ABORTBANK][14]);
+                  fprintf(state->cold->state_log, "R14_ABORT:0x%x\n", state->RegBank[ABORTBANK][14]);
                   mirror_register_file[R14_ABORT] = state->RegBank[ABORTBANK][14];
           }
           if (state->RegBank[UNDEFBANK][13] != mirror_register_file[R13_UNDEF]) {
-                  fprintf(state->state_log, "R13_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][13]);
+                  fprintf(state->cold->state_log, "R13_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][13]);
                   mirror_register_file[R13_UNDEF] = state->RegBank[UNDEFBANK][13];
           }
           if (state->RegBank[UNDEFBANK][14] != mirror_register_file[R14_UNDEF]) {
-                  fprintf(state->state_log, "R14_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][14]);
+                  fprintf(state->cold->state_log, "R14_UNDEF:0x%x\n", state->RegBank[UNDEFBANK][14]);
                   mirror_register_file[R14_UNDEF] = state->RegBank[UNDEFBANK][14];
           }
           if (state->RegBank[IRQBANK][13] != mirror_register_file[R13_IRQ]) {
-                  fprintf(state->state_log, "R13_IRQ:0x%x\n", state->RegBank[IRQBANK][13]);
+                  fprintf(state->cold->state_log, "R13_IRQ:0x%x\n", state->RegBank[IRQBANK][13]);
                   mirror_register_file[R13_IRQ] = state->RegBank[IRQBANK][13];
           }
           if (state->RegBank[IRQBANK][14] != mirror_register_file[R14_IRQ]) {
-                  fprintf(state->state_log, "R14_IRQ:0x%x\n", state->RegBank[IRQBANK][14]);
+                  fprintf(state->cold->state_log, "R14_IRQ:0x%x\n", state->RegBank[IRQBANK][14]);
                   mirror_register_file[R14_IRQ] = state->RegBank[IRQBANK][14];
           }
           if (state->RegBank[FIQBANK][8] != mirror_register_file[R8_FIRQ]) {
-                  fprintf(state->state_log, "R8_FIRQ:0x%x\n", state->RegBank[FIQBANK][8]);
+                  fprintf(state->cold->state_log, "R8_FIRQ:0x%x\n", state->RegBank[FIQBANK][8]);
                   mirror_register_file[R8_FIRQ] = state->RegBank[FIQBANK][8];
           }
           if (state->RegBank[FIQBANK][9] != mirror_register_file[R9_FIRQ]) {
-                  fprintf(state->state_log, "R9_FIRQ:0x%x\n", state->RegBank[FIQBANK][9]);
+                  fprintf(state->cold->state_log, "R9_FIRQ:0x%x\n", state->RegBank[FIQBANK][9]);
                   mirror_register_file[R9_FIRQ] = state->RegBank[FIQBANK][9];
           }
           if (state->RegBank[FIQBANK][10] != mirror_register_file[R10_FIRQ]) {
-                  fprintf(state->state_log, "R10_FIRQ:0x%x\n", state->RegBank[FIQBANK][10]);
+                  fprintf(state->cold->state_log, "R10_FIRQ:0x%x\n", state->RegBank[FIQBANK][10]);
                   mirror_register_file[R10_FIRQ] = state->RegBank[FIQBANK][10];
           }
           if (state->RegBank[FIQBANK][11] != mirror_register_file[R11_FIRQ]) {
-                  fprintf(state->state_log, "R11_FIRQ:0x%x\n", state->RegBank[FIQBANK][11]);
+                  fprintf(state->cold->state_log, "R11_FIRQ:0x%x\n", state->RegBank[FIQBANK][11]);
                   mirror_register_file[R11_FIRQ] = state->RegBank[FIQBANK][11];
           }
           if (state->RegBank[FIQBANK][12] != mirror_register_file[R12_FIRQ]) {
-                  fprintf(state->state_log, "R12_FIRQ:0x%x\n", state->RegBank[FIQBANK][12]);
+                  fprintf(state->cold->state_log, "R12_FIRQ:0x%x\n", state->RegBank[FIQBANK][12]);
                   mirror_register_file[R12_FIRQ] = state->RegBank[FIQBANK][12];
           }
           if (state->RegBank[FIQBANK][13] != mirror_register_file[R13_FIRQ]) {
-                  fprintf(state->state_log, "R13_FIRQ:0x%x\n", state->RegBank[FIQBANK][13]);
+                  fprintf(state->cold->state_log, "R13_FIRQ:0x%x\n", state->RegBank[FIQBANK][13]);
                   mirror_register_file[R13_FIRQ] = state->RegBank[FIQBANK][13];
           }
           if (state->RegBank[FIQBANK][14] != mirror_register_file[R14_FIRQ]) {
-                  fprintf(state->state_log, "R14_FIRQ:0x%x\n", state->RegBank[FIQBANK][14]);
+                  fprintf(state->cold->state_log, "R14_FIRQ:0x%x\n", state->RegBank[FIQBANK][14]);
                   mirror_register_file[R14_FIRQ] = state->RegBank[FIQBANK][14];
           }
           if (state->Spsr[SVCBANK] != mirror_register_file[SPSR_SVC]) {
-                  fprintf(state->state_log, "SPSR_SVC:0x%x\n", state->Spsr[SVCBANK]);
+                  fprintf(state->cold->state_log, "SPSR_SVC:0x%x\n", state->Spsr[SVCBANK]);
                   mirror_register_file[SPSR_SVC] = state->RegBank[SVCBANK];
           }
           if (state->Spsr[ABORTBANK] != mirror_register_file[SPSR_ABORT]) {
-                  fprintf(state->state_log, "SPSR_ABORT:0x%x\n", state->Spsr[ABORTBANK]);
+                  fprintf(state->cold->state_log, "SPSR_ABORT:0x%x\n", state->Spsr[ABORTBANK]);
                   mirror_register_file[SPSR_ABORT] = state->RegBank[ABORTBANK];
           }
           if (state->Spsr[UNDEFBANK] != mirror_register_file[SPSR_UNDEF]) {
-                  fprintf(state->state_log, "SPSR_UNDEF:0x%x\n", state->Spsr[UNDEFBANK]);
+                  fprintf(state->cold->state_log, "SPSR_UNDEF:0x%x\n", state->Spsr[UNDEFBANK]);
                   mirror_register_file[SPSR_UNDEF] = state->RegBank[UNDEFBANK];
           }
           if (state->Spsr[IRQBANK] != mirror_register_file[SPSR_IRQ]) {
-                  fprintf(state->state_log, "SPSR_IRQ:0x%x\n", state->Spsr[IRQBANK]);
+                  fprintf(state->cold->state_log, "SPSR_IRQ:0x%x\n", state->Spsr[IRQBANK]);
                   mirror_register_file[SPSR_IRQ] = state->RegBank[IRQBANK];
           }
           if (state->Spsr[FIQBANK] != mirror_register_file[SPSR_FIRQ]) {
-                  fprintf(state->state_log, "SPSR_FIRQ:0x%x\n", state->Spsr[FIQBANK]);
+                  fprintf(state->cold->state_log, "SPSR_FIRQ:0x%x\n", state->Spsr[FIQBANK]);
                   mirror_register_file[SPSR_FIRQ] = state->RegBank[FIQBANK];
           }
 
@@ -5760,6 +5784,41 @@ StoreByte (ARMul_State * state, ARMword instr, ARMword address)
     return TRUE;
 }
 
+/* Gets the host pointer of the words an LDM or STM transfers, when they
+   all lie in one page of plain memory and nothing watches the accesses,
+   NULL otherwise.  The cycles of the accesses are charged as the word by
+   word path charges them, and the page is marked dirty for a store.  */
+
+static u32_le *
+BlockTransferPointer (ARMul_State * state, ARMword instr, ARMword address,
+              bool write)
+{
+    ARMword count = 0, temp;
+    u8 *block;
+
+    if ((address & 3) || ExecTrace::IsEnabled () || Memory::g_access_stats_enabled)
+        return NULL;
+    /* Stores of a shared monitor clear the reservations word by word.  */
+    if (write && ExclusiveMonitor::g_shared)
+        return NULL;
+    if (Core::g_memchecks != NULL && Core::g_memchecks->HasMemCheckInPage (address))
+        return NULL;
+
+    for (temp = 0; temp < 16; temp++)
+        count += BIT (temp);
+    block = Memory::GetBlockPointer (address, count * 4);
+    if (block == NULL)
+        return NULL;
+
+    if (write)
+        Memory::MarkPageDirty (address);
+    state->NumNcycles++;
+    state->NumScycles += count - 1;
+    state->NumCycles += CycleModel::GetWaitStates (address) * count;
+    ARMul_CLEARABORT;
+    return (u32_le *) block;
+}
+
 /* This function does the work of loading the registers listed in an LDM
    instruction, when the S bit is clear.  The code here is always increment
    after, it's up to the caller to get the input address correct and to
@@ -5769,6 +5828,7 @@ static void
 LoadMult (ARMul_State * state, ARMword instr, ARMword address, ARMword WBBase)
 {
     ARMword dest, temp;
+    u32_le *words;
 
     //UNDEF_LSMNoRegs;
     //UNDEF_LSMPCBase;
@@ -5778,6 +5838,20 @@ LoadMult (ARMul_State * state, ARMword instr, ARMword address, ARMword WBBase)
     if (ADDREXCEPT (address))
         INTERNALABORT (address);
 #endif
+
+    /* Transfers within a page of plain memory load the registers in one go.  */
+    words = BlockTransferPointer (state, instr, address, false);
+    if (words != NULL) {
+        for (temp = 0; temp < 16; temp++)
+            if (BIT (temp))
+                state->Reg[temp] = *words++;
+        if (BIT (15))
+            WriteR15Branch(state, (state->Reg[15] & PCMASK));
+        ARMul_Icycles (state, 1, 0L);
+        if (BIT (21) && LHSReg != 15)
+            LSBase = WBBase;
+        return;
+    }
 /*chy 2004-05-23 may write twice
   if (BIT (21) && LHSReg != 15)
     LSBase = WBBase;
@@ -5998,6 +6072,7 @@ StoreMult (ARMul_State * state,
        ARMword instr, ARMword address, ARMword WBBase)
 {
     ARMword temp;
+    u32_le *words;
 
     UNDEF_LSMNoRegs;
     UNDEF_LSMPCBase;
@@ -6015,6 +6090,19 @@ StoreMult (ARMul_State * state,
         PATCHR15;
 #endif
 
+#ifdef MODE32
+    /* Transfers within a page of plain memory store the registers in one go.  */
+    words = BlockTransferPointer (state, instr, address, true);
+    if (words != NULL) {
+        for (temp = 0; temp < 16; temp++)
+            if (BIT (temp))
+                *words++ = state->Reg[temp];
+        if (BIT (21) && LHSReg != 15)
+            LSBase = WBBase;
+        return;
+    }
+#endif
+
     /* N cycle first.  */
     for (temp = 0; !BIT (temp); temp++);
 
@@ -6339,12 +6427,96 @@ MultiplyAdd64 (ARMul_State * state, ARMword instr, int msigned, int scc)
     return scount + 1;
 }
 
+/* Load exclusive, LDREX/LDREXB/LDREXH/LDREXD: loads Rd (and Rd+1) from [Rn] and reserves
+   the granule of the address in the exclusive monitor.  */
+
+static int
+ExclusiveLoad (ARMul_State * state, ARMword instr)
+{
+  ARMword address = LHS;
+  ARMword dest;
+
+  BUSUSEDINCPCS;
+  switch (BITS (21, 22))
+    {
+    case 0:
+      dest = ARMul_LoadWordN (state, address);
+      break;
+    case 1:
+      dest = ARMul_LoadWordN (state, address);
+      if (!state->Aborted)
+        state->Reg[(DESTReg + 1) & 15] = ARMul_LoadWordS (state, address + 4);
+      break;
+    case 2:
+      dest = ARMul_LoadByte (state, address);
+      break;
+    default:
+      dest = ARMul_LoadHalfWord (state, address);
+      break;
+    }
+  if (state->Aborted)
+    {
+      TAKEABORT;
+      return 1;
+    }
+  state->Reg[DESTReg] = dest;
+  ExclusiveMonitor::Reserve (state, address);
+  ARMul_Icycles (state, 1, 0L);
+  return 1;
+}
+
+/* Store exclusive, STREX/STREXB/STREXH/STREXD: stores Rm (and Rm+1) to [Rn] if the granule
+   is still reserved, and sets Rd to 0 if it stored, 1 if it didn't.  */
+
+static int
+ExclusiveStore (ARMul_State * state, ARMword instr)
+{
+  ARMword address = LHS;
+  ARMword value = state->Reg[RHSReg];
+
+  BUSUSEDINCPCN;
+  if (!ExclusiveMonitor::BeginStore (state, address))
+    {
+      state->Reg[DESTReg] = 1;
+      return 1;
+    }
+  switch (BITS (21, 22))
+    {
+    case 0:
+      ARMul_StoreWordN (state, address, value);
+      break;
+    case 1:
+      ARMul_StoreWordN (state, address, value);
+      if (!state->Aborted)
+        ARMul_StoreWordS (state, address + 4, state->Reg[(RHSReg + 1) & 15]);
+      break;
+    case 2:
+      ARMul_StoreByte (state, address, value);
+      break;
+    default:
+      ARMul_StoreHalfWord (state, address, value);
+      break;
+    }
+  ExclusiveMonitor::EndStore ();
+  if (state->Aborted)
+    {
+      TAKEABORT;
+      return 1;
+    }
+  state->Reg[DESTReg] = 0;
+  return 1;
+}
+
 /* Attempt to emulate an ARMv6 instruction.
    Returns non-zero upon success.  */
 
 static int
 handle_v6_insn (ARMul_State * state, ARMword instr)
 {
+  /* Media instructions run through their own handlers.  */
+  if (MediaHandlers::Execute (state, instr))
+    return 1;
+
   switch (BITS (20, 27))
     {
 #if 0
@@ -6384,72 +6556,21 @@ handle_v6_insn (ARMul_State * state, ARMword instr)
 
 
 /* add new instr for arm v6. */
-    ARMword lhs, temp;
-    case 0x18:    /* ORR reg */
-      {
-    /* dyf add armv6 instr strex  2010.9.17 */
-     if (BITS (4, 7) == 0x9) {
-        lhs = LHS;
-        ARMul_StoreWordS(state, lhs, RHS);
-        //StoreWord(state, lhs, RHS)
-        if (state->Aborted) {
-            TAKEABORT;
-        }
-        // FIX(Normmatt): Handle RD in STREX/STREXB
-        state->Reg[DESTReg] = 0; //Always succeed
-
-        return 1;
-     }
-     break;
-      }
-
-    case 0x19:    /* orrs reg */
-      {
-    /* dyf add armv6 instr ldrex  */
-    if (BITS (4, 7) == 0x9) {
-        lhs = LHS;
-        LoadWord (state, instr, lhs);
-        return 1;
-    }
-    break;
-      }
-
-    case 0x1c:    /* BIC reg */
-      {
-    /* dyf add for STREXB */
-    if (BITS (4, 7) == 0x9) {
-        lhs = LHS;
-        ARMul_StoreByte (state, lhs, RHS);
-        BUSUSEDINCPCN;
-        if (state->Aborted) {
-            TAKEABORT;
-        }
-        // FIX(Normmatt): Handle RD in STREX/STREXB
-        state->Reg[DESTReg] = 0; //Always succeed
-        //printf("In %s, strexb not implemented\n", __FUNCTION__);
-        UNDEF_LSRBPC;
-        /* WRITESDEST (dest); */
-        return 1;
-    }
-    break;
-      }
+    case 0x18:    /* strex */
+    case 0x1c:    /* strexb */
+    case 0x1e:    /* strexh */
+    case 0x1a:    /* strexd */
+      if (BITS (4, 7) == 0x9)
+        return ExclusiveStore (state, instr);
+      break;
 
-    case 0x1d:    /* BICS reg */
-      {
-    if ((BITS (4, 7)) == 0x9) {
-        /* ldrexb */
-        temp = LHS;
-        LoadByte (state, instr, temp, LUNSIGNED);
-        //state->Reg[BITS(12, 15)] = ARMul_LoadByte(state, state->Reg[BITS(16, 19)]);
-        //printf("ldrexb\n");
-        //printf("instr is %x rm is %d\n", instr, BITS(16, 19));
-        //exit(-1);
-        
-        //printf("In %s, ldrexb not implemented\n", __FUNCTION__);
-        return 1;
-    }
-    break;
-      }
+    case 0x19:    /* ldrex */
+    case 0x1d:    /* ldrexb */
+    case 0x1f:    /* ldrexh */
+    case 0x1b:    /* ldrexd */
+      if (BITS (4, 7) == 0x9)
+        return ExclusiveLoad (state, instr);
+      break;
 /* add end */
 
     case 0x6a:
@@ -21,7 +21,15 @@
 #include "core/arm/interpreter/skyeye_defs.h"
 #include "core/arm/interpreter/armdefs.h"
 
-extern ARMword isize;
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/* Size of the instruction being executed. Per host thread, the system core runs on one of its
+   own and may be in the other instruction set than the application core.  */
+extern THREAD_LOCAL ARMword isize;
 
 /* Condition code values.  */
 #define EQ 0
@@ -104,15 +112,15 @@ extern ARMword isize;
 #define CLEARZ state->ZFlag = 0
 #define ASSIGNZ(res) state->ZFlag = res
 
-#define CFLAG state->CFlag
-#define SETC state->CFlag = 1
-#define CLEARC state->CFlag = 0
-#define ASSIGNC(res) state->CFlag = res
+#define CFLAG (ARMul_ResolveFlags (state), state->CFlag)
+#define SETC (ARMul_ResolveFlags (state), state->CFlag = 1)
+#define CLEARC (ARMul_ResolveFlags (state), state->CFlag = 0)
+#define ASSIGNC(res) (ARMul_ResolveFlags (state), state->CFlag = (res))
 
-#define VFLAG state->VFlag
-#define SETV state->VFlag = 1
-#define CLEARV state->VFlag = 0
-#define ASSIGNV(res) state->VFlag = res
+#define VFLAG (ARMul_ResolveFlags (state), state->VFlag)
+#define SETV (ARMul_ResolveFlags (state), state->VFlag = 1)
+#define CLEARV (ARMul_ResolveFlags (state), state->VFlag = 0)
+#define ASSIGNV(res) (ARMul_ResolveFlags (state), state->VFlag = (res))
 
 #define SFLAG state->SFlag
 #define SETS state->SFlag = 1
@@ -136,6 +144,7 @@ extern ARMword isize;
 #define CCBITS (0xf0000000L)
 #endif
 
+#define GEBITS (0x000f0000L)
 #define INTBITS (0xc0L)
 
 #if defined MODET && defined MODE32
@@ -179,10 +188,11 @@ extern ARMword isize;
 #define ER15INT (IFFLAGS << 26)
 #define EMODE (state->Mode)
 
+/* The GE flags of the media instructions only live in Cpsr.  */
 #ifdef MODET
-#define CPSR (ECC | EINT | EMODE | (TFLAG << 5))
+#define CPSR (ECC | (state->Cpsr & GEBITS) | EINT | EMODE | (TFLAG << 5))
 #else
-#define CPSR (ECC | EINT | EMODE)
+#define CPSR (ECC | (state->Cpsr & GEBITS) | EINT | EMODE)
 #endif
 
 #ifdef MODE32
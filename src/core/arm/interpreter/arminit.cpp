@@ -26,8 +26,11 @@
 
 #include <math.h>
 
+#include "core/arm/exclusive_monitor.h"
 #include "core/arm/interpreter/armdefs.h"
 #include "core/arm/interpreter/armemu.h"
+#include "core/arm/interpreter/dp_handlers.h"
+#include "core/arm/interpreter/thumb_handlers.h"
 
 /***************************************************************************\
 *                 Definitions for the emulator architecture                 *
@@ -150,6 +153,8 @@ ARMul_EmulateInit (void)
 	for (i = 0; i < 256; i++)
 		ARMul_BitList[i] *= 4;	/* you always need 4 times these values */
 
+	DPHandlers::Init ();
+	ThumbHandlers::Init ();
 }
 
 /***************************************************************************\
@@ -162,6 +167,16 @@ ARMul_NewState (ARMul_State *state)
 	unsigned i, j;
 
 	memset (state, 0, sizeof (ARMul_State));
+	state->cold = (ARMul_ColdState *) calloc (1, sizeof (ARMul_ColdState));
+	if (state->cold == NULL) {
+		printf ("SKYEYE: ARMul_NewState malloc state->cold error\n");
+		exit(-1);
+	}
+	state->ThumbTranslations = (ARMword *) calloc (0x10000, sizeof (ARMword));
+	if (state->ThumbTranslations == NULL) {
+		printf ("SKYEYE: ARMul_NewState malloc state->ThumbTranslations error\n");
+		exit(-1);
+	}
 
 	state->Emulate = RUN;
 	for (i = 0; i < 16; i++) {
@@ -189,7 +204,7 @@ ARMul_NewState (ARMul_State *state)
 		(struct EventNode **) malloc ((unsigned) EVENTLISTSIZE *
 					      sizeof (struct EventNode *));
 #if DIFF_STATE
-	state->state_log = fopen("/data/state.log", "w");
+	state->cold->state_log = fopen("/data/state.log", "w");
 	printf("create pc log file.\n");
 #endif
 	if (state->EventPtr == NULL) {
@@ -199,11 +214,11 @@ ARMul_NewState (ARMul_State *state)
 	for (i = 0; i < EVENTLISTSIZE; i++)
 		*(state->EventPtr + i) = NULL;
 #if SAVE_LOG
-	state->state_log = fopen("/tmp/state.log", "w");
+	state->cold->state_log = fopen("/tmp/state.log", "w");
 	printf("create pc log file.\n");
 #else
 #if DIFF_LOG
-	state->state_log = fopen("/tmp/state.log", "r");
+	state->cold->state_log = fopen("/tmp/state.log", "r");
 	printf("loaded pc log file.\n");
 #endif
 #endif
@@ -228,8 +243,11 @@ ARMul_NewState (ARMul_State *state)
 	//if (pref->user_mode_sim)
 	//	register_callback(arm_user_mode_init, Bootmach_callback);
 
-	memset(&state->exclusive_tag_array[0], 0xFF, sizeof(state->exclusive_tag_array[0]) * 128);
-	state->exclusive_access_state = 0;
+	memset(&state->cold->exclusive_tag_array[0], 0xFF, sizeof(state->cold->exclusive_tag_array[0]) * 128);
+	state->cold->exclusive_access_state = 0;
+	state->exclusive_tag = ExclusiveMonitor::NO_RESERVATION;
+	state->DecodeLastPageIndex = 0xFFFFFFFF;
+	state->DecodeLastPage = NULL;
 	//state->cpu = (cpu_config_t *) malloc (sizeof (cpu_config_t));
 	//state->mem_bank = (mem_config_t *) malloc (sizeof (mem_config_t));
 	return (state);
@@ -316,10 +334,15 @@ ARMul_Reset (ARMul_State * state)
 	state->NumInstrs = 0;
 	state->NumNcycles = 0;
 	state->NumScycles = 0;
+	state->NumCycles = 0;
 	state->NumIcycles = 0;
 	state->NumCcycles = 0;
 	state->NumFcycles = 0;
 
+	state->DebugStop = 0;
+	state->DebugSkipped = 0;
+	state->BreakPointPassed = 0xFFFFFFFF;
+
 	//fprintf(stderr,"armul_reset 3: state->  Cpsr 0x%x, Mode %d\n",state->Cpsr,state->Mode);  
 	mmu_reset (state);
 	//fprintf(stderr,"armul_reset 4: state->  Cpsr 0x%x, Mode %d\n",state->Cpsr,state->Mode);  
@@ -575,7 +598,7 @@ ARMul_Abort (ARMul_State * state, ARMword vector)
 	}
 
 	if (ARMul_MODE32BIT) {
-		if (state->mmu.control & CONTROL_VECTOR)
+		if (state->cold->mmu.control & CONTROL_VECTOR)
 			vector += 0xffff0000;	//for v4 high exception  address
 		if (state->vector_remap_flag)
 			vector += state->vector_remap_addr; /* support some remap function in LPC processor */
@@ -29,7 +29,7 @@
 extern mmu_ops_t xscale_mmu_ops;
 exception_t arm_mmu_write(short size, u32 addr, uint32_t *value);
 exception_t arm_mmu_read(short size, u32 addr, uint32_t *value);
-#define MMU_OPS (state->mmu.ops)
+#define MMU_OPS (state->cold->mmu.ops)
 ARMword skyeye_cachetype = -1;
 
 int
@@ -37,42 +37,42 @@ mmu_init (ARMul_State * state)
 {
 	int ret;
 
-	state->mmu.control = 0x70;
-	state->mmu.translation_table_base = 0xDEADC0DE;
-	state->mmu.domain_access_control = 0xDEADC0DE;
-	state->mmu.fault_status = 0;
-	state->mmu.fault_address = 0;
-	state->mmu.process_id = 0;
+	state->cold->mmu.control = 0x70;
+	state->cold->mmu.translation_table_base = 0xDEADC0DE;
+	state->cold->mmu.domain_access_control = 0xDEADC0DE;
+	state->cold->mmu.fault_status = 0;
+	state->cold->mmu.fault_address = 0;
+	state->cold->mmu.process_id = 0;
 
 	switch (state->cpu->cpu_val & state->cpu->cpu_mask) {
 	//case SA1100:
 	//case SA1110:
 	//	NOTICE_LOG(ARM11, "SKYEYE: use sa11xx mmu ops\n");
-	//	state->mmu.ops = sa_mmu_ops;
+	//	state->cold->mmu.ops = sa_mmu_ops;
 	//	break;
 	//case PXA250:
 	//case PXA270:		//xscale
 	//	NOTICE_LOG(ARM11, "SKYEYE: use xscale mmu ops\n");
-	//	state->mmu.ops = xscale_mmu_ops;
+	//	state->cold->mmu.ops = xscale_mmu_ops;
 	//	break;
 	//case 0x41807200:	//arm720t
 	//case 0x41007700:	//arm7tdmi
 	//case 0x41007100:	//arm7100
 	//	NOTICE_LOG(ARM11,  "SKYEYE: use arm7100 mmu ops\n");
-	//	state->mmu.ops = arm7100_mmu_ops;
+	//	state->cold->mmu.ops = arm7100_mmu_ops;
 	//	break;
 	//case 0x41009200:
 	//	NOTICE_LOG(ARM11, "SKYEYE: use arm920t mmu ops\n");
-	//	state->mmu.ops = arm920t_mmu_ops;
+	//	state->cold->mmu.ops = arm920t_mmu_ops;
 	//	break;
 	//case 0x41069260:
 	//	NOTICE_LOG(ARM11, "SKYEYE: use arm926ejs mmu ops\n");
-	//	state->mmu.ops = arm926ejs_mmu_ops;
+	//	state->cold->mmu.ops = arm926ejs_mmu_ops;
 	//	break;
 	/* case 0x560f5810: */
 	case 0x0007b000:
 		NOTICE_LOG(ARM11, "SKYEYE: use arm11jzf-s mmu ops\n");
-		state->mmu.ops = arm1176jzf_s_mmu_ops;
+		state->cold->mmu.ops = arm1176jzf_s_mmu_ops;
 		break;
 
 	default:
@@ -82,8 +82,8 @@ mmu_init (ARMul_State * state)
 		break;
 
 	};
-	ret = state->mmu.ops.init (state);
-	state->mmu_inited = (ret == 0);
+	ret = state->cold->mmu.ops.init (state);
+	state->cold->mmu_inited = (ret == 0);
 	/* initialize mmu_read and mmu_write for disassemble */
 	//skyeye_config_t *config  = get_current_config();
 	//generic_arch_t *arch_instance = get_arch_instance(config->arch->arch_name);
@@ -96,7 +96,7 @@ mmu_init (ARMul_State * state)
 int
 mmu_reset (ARMul_State * state)
 {
-	if (state->mmu_inited)
+	if (state->cold->mmu_inited)
 		mmu_exit (state);
 	return mmu_init (state);
 }
@@ -105,7 +105,7 @@ void
 mmu_exit (ARMul_State * state)
 {
 	MMU_OPS.exit (state);
-	state->mmu_inited = 0;
+	state->cold->mmu_inited = 0;
 }
 
 fault_t
@@ -85,10 +85,10 @@ typedef enum mmu_regnum_t
 #define CONTROL_EE                      (1<<25)
 
 /*Macro defines for MMU state*/
-#define MMU_CTL (state->mmu.control)
-#define MMU_Enabled (state->mmu.control & CONTROL_MMU)
+#define MMU_CTL (state->cold->mmu.control)
+#define MMU_Enabled (state->cold->mmu.control & CONTROL_MMU)
 #define MMU_Disabled (!(MMU_Enabled))
-#define MMU_Aligned (state->mmu.control & CONTROL_ALIGN_FAULT)
+#define MMU_Aligned (state->cold->mmu.control & CONTROL_ALIGN_FAULT)
 
 #define MMU_ICacheEnabled (MMU_CTL & CONTROL_INSTRUCTION_CACHE)
 #define MMU_ICacheDisabled (!(MMU_ICacheDisabled))
@@ -109,10 +109,10 @@ typedef enum mmu_regnum_t
 //	if ((va) & PID_VA_MAP_MASK)\
 //		ret = (va); \
 //	else \
-//		ret = ((va) | (state->mmu.process_id & PID_VA_MAP_MASK));\
+//		ret = ((va) | (state->cold->mmu.process_id & PID_VA_MAP_MASK));\
 //	ret;\
 //})
-#define mmu_pid_va_map(va) ((va) & PID_VA_MAP_MASK) ? (va) : ((va) | (state->mmu.process_id & PID_VA_MAP_MASK))
+#define mmu_pid_va_map(va) ((va) & PID_VA_MAP_MASK) ? (va) : ((va) | (state->cold->mmu.process_id & PID_VA_MAP_MASK))
 
 /* FS[3:0] in the fault status register: */
 
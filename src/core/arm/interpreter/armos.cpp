@@ -560,7 +560,7 @@ ARMul_OSHandleSWI (ARMul_State * state, ARMword number)
 //	case SWI_Set_tls:
 //		{
 //			//printf("syscall set_tls unimplemented\n");
-//			state->mmu.thread_uro_id = state->Reg[0];
+//			state->cold->mmu.thread_uro_id = state->Reg[0];
 //			state->CP15[CP15_THREAD_URO - CP15_BASE] = state->Reg[0];
 //			state->Reg[0] = 0;
 //			return FALSE;
@@ -153,6 +153,9 @@ ARMul_FixCPSR (ARMul_State * state, ARMword instr, ARMword rhs)
 			SETPSR_X (state->Cpsr, rhs);
 		if (BIT (18))
 			SETPSR_S (state->Cpsr, rhs);
+	} else if (BIT (18)) {
+		/* The GE flags are writable from user mode.  */
+		state->Cpsr = (state->Cpsr & ~GEBITS) | (rhs & GEBITS);
 	}
 	if (BIT (19))
 		SETPSR_F (state->Cpsr, rhs);
@@ -398,6 +401,14 @@ ARMul_NthReg (ARMword instr, unsigned number)
 	return (bit - 1);
 }
 
+/* Masks of the NZCV values passing each condition code, in the order of the codes: EQ, NE, CS,
+   CC, MI, PL, VS, VC, HI, LS, GE, LT, GT, LE, AL and NV.  */
+
+const u16 ARMul_ConditionTable[16] = {
+	0xF0F0, 0x0F0F, 0xCCCC, 0x3333, 0xFF00, 0x00FF, 0xAAAA, 0x5555,
+	0x0C0C, 0xF3F3, 0xAA55, 0x55AA, 0x0A05, 0xF5FA, 0xFFFF, 0x0000,
+};
+
 /* Assigns the N and Z flags depending on the value of result.  */
 
 void
@@ -435,13 +446,17 @@ SubOverflow (ARMword a, ARMword b, ARMword result)
 		|| (POS (a) && NEG (b) && NEG (result)));
 }
 
-/* Assigns the C flag after an addition of a and b to give result.  */
+/* Assigns the C flag after an addition of a and b to give result.  The flags are only
+   computed when read (see ARMul_ResolveFlags), so this also takes care of V and callers
+   always pair it with ARMul_AddOverflow on the same operands.  */
 
 void
 ARMul_AddCarry (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 {
-	ASSIGNC ((NEG (a) && NEG (b)) ||
-		 (NEG (a) && POS (result)) || (NEG (b) && POS (result)));
+	state->LazyFlagsOp = LAZY_FLAGS_ADD;
+	state->LazyFlagsA = a;
+	state->LazyFlagsB = b;
+	state->LazyFlagsResult = result;
 }
 
 /* Assigns the V flag after an addition of a and b to give result.  */
@@ -449,16 +464,21 @@ ARMul_AddCarry (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 void
 ARMul_AddOverflow (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 {
-	ASSIGNV (AddOverflow (a, b, result));
+	if (state->LazyFlagsOp != LAZY_FLAGS_ADD || state->LazyFlagsA != a
+	    || state->LazyFlagsB != b || state->LazyFlagsResult != result)
+		ASSIGNV (AddOverflow (a, b, result));
 }
 
-/* Assigns the C flag after an subtraction of a and b to give result.  */
+/* Assigns the C flag after an subtraction of a and b to give result.  Like ARMul_AddCarry
+   the flags are evaluated lazily, together with V.  */
 
 void
 ARMul_SubCarry (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 {
-	ASSIGNC ((NEG (a) && POS (b)) ||
-		 (NEG (a) && POS (result)) || (POS (b) && POS (result)));
+	state->LazyFlagsOp = LAZY_FLAGS_SUB;
+	state->LazyFlagsA = a;
+	state->LazyFlagsB = b;
+	state->LazyFlagsResult = result;
 }
 
 /* Assigns the V flag after an subtraction of a and b to give result.  */
@@ -466,7 +486,9 @@ ARMul_SubCarry (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 void
 ARMul_SubOverflow (ARMul_State * state, ARMword a, ARMword b, ARMword result)
 {
-	ASSIGNV (SubOverflow (a, b, result));
+	if (state->LazyFlagsOp != LAZY_FLAGS_SUB || state->LazyFlagsA != a
+	    || state->LazyFlagsB != b || state->LazyFlagsResult != result)
+		ASSIGNV (SubOverflow (a, b, result));
 }
 
 /* This function does the work of generating the addresses used in an
@@ -25,6 +25,10 @@ defined to generate aborts. */
 
 #include "armdefs.h"
 #include "skyeye_defs.h"
+#include "core/core.h"
+#include "core/mem_map.h"
+#include "core/arm/cycle_model.h"
+#include "core/arm/exec_trace.h"
 //#include "code_cov.h"
 
 #ifdef VALIDATE			/* for running the validate suite */
@@ -34,6 +38,11 @@ defined to generate aborts. */
 
 /* #define ABORTS */
 
+/* Citra only runs user-mode code on top of HLE memory, so by default all loads and stores go
+   straight to Memory:: and skip the MMU/TLB/cache models (mmu_pid_va_map, MMU_OPS dispatch,
+   translation).  Build with ARMUL_MMU_SIMULATION (CMake option ENABLE_ARM_MMU_SIMULATION) to
+   route them through the simulated MMU again.  CP15 accesses always use the MMU model. */
+
 #ifdef ABORTS			/* the memory system will abort */
 /* For the old test suite Abort between 32 Kbytes and 32 Mbytes
    For the new test suite Abort between 8 Mbytes and 26 Mbytes */
@@ -60,7 +69,19 @@ GetByte (ARMul_State * state, ARMword address, ARMword * data)
 {
 	fault_t fault;
 
+	/* Wait states of the memory accessed, on top of the cost of the instruction */
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_read_byte (state, address, data);
+#else
+	*data = Memory::Read8 (address);
+	fault = NO_FAULT;
+#endif
+	/* Watchpoints, a bit test unless the page has some */
+	Core::CheckMemAccess (state, address, *data, 1, false);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, *data, 1, false);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 //              printf("SKYEYE: GetByte fault %d \n", fault);
@@ -76,7 +97,17 @@ GetHalfWord (ARMul_State * state, ARMword address, ARMword * data)
 {
 	fault_t fault;
 
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_read_halfword (state, address, data);
+#else
+	*data = Memory::Read16 (address);
+	fault = NO_FAULT;
+#endif
+	Core::CheckMemAccess (state, address, *data, 2, false);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, *data, 2, false);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 //              printf("SKYEYE: GetHalfWord fault %d \n", fault);
@@ -93,7 +124,17 @@ GetWord (ARMul_State * state, ARMword address, ARMword * data)
 {
 	fault_t fault;
 
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_read_word (state, address, data);
+#else
+	*data = Memory::Read32 (address);
+	fault = NO_FAULT;
+#endif
+	Core::CheckMemAccess (state, address, *data, 4, false);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, *data, 4, false);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 #if 0
@@ -138,7 +179,12 @@ static fault_t
 LoadInstr (ARMul_State * state, ARMword address, ARMword * instr)
 {
 	fault_t fault;
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_load_instr (state, address, instr);
+#else
+	*instr = Memory::Read32 (address);
+	fault = NO_FAULT;
+#endif
 	return fault;
 	//if (fault)
 	//      log_msg("load_instr fault = %d, address = %x\n", fault, address);
@@ -152,7 +198,17 @@ PutByte (ARMul_State * state, ARMword address, ARMword data)
 {
 	fault_t fault;
 
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_write_byte (state, address, data);
+#else
+	Memory::Write8 (address, data);
+	fault = NO_FAULT;
+#endif
+	Core::CheckMemAccess (state, address, data, 1, true);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, data, 1, true);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 //              printf("SKYEYE: PutByte fault %d \n", fault);
@@ -168,7 +224,17 @@ PutHalfWord (ARMul_State * state, ARMword address, ARMword data)
 {
 	fault_t fault;
 
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_write_halfword (state, address, data);
+#else
+	Memory::Write16 (address, data);
+	fault = NO_FAULT;
+#endif
+	Core::CheckMemAccess (state, address, data, 2, true);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, data, 2, true);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 //              printf("SKYEYE: PutHalfWord fault %d \n", fault);
@@ -185,7 +251,17 @@ PutWord (ARMul_State * state, ARMword address, ARMword data)
 {
 	fault_t fault;
 
+	state->NumCycles += CycleModel::GetWaitStates (address);
+
+#ifdef ARMUL_MMU_SIMULATION
 	fault = mmu_write_word (state, address, data);
+#else
+	Memory::Write32 (address, data);
+	fault = NO_FAULT;
+#endif
+	Core::CheckMemAccess (state, address, data, 4, true);
+	if (ExecTrace::IsEnabled ())
+		ExecTrace::OnMemAccess (address, data, 4, true);
 	if (fault) {
 //chy 2003-07-11: sometime has fault, but linux can continue running  !!!!????
 #if 0
@@ -307,8 +383,8 @@ ARMul_ReLoadInstr (ARMul_State * state, ARMword address, ARMword isize)
 		/* dyf add for s3c6410 no instcache temporary 2010.9.17 */
 		if (!(skyeye_cachetype == INSTCACHE)) {
 			/* set translation fault  on prefetch abort */
-			state->mmu.fault_statusi = fault  & 0xFF;
-			state->mmu.fault_address = address;
+			state->cold->mmu.fault_statusi = fault  & 0xFF;
+			state->cold->mmu.fault_address = address;
 		}
 		/* add end */
 
@@ -374,9 +450,9 @@ ARMul_ReadWord (ARMul_State * state, ARMword address)
 
 	fault = GetWord (state, address, &data);
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return ARMul_ABORTWORD;
 	}
@@ -424,9 +500,9 @@ ARMul_LoadHalfWord (ARMul_State * state, ARMword address)
 	fault = GetHalfWord (state, address, &data);
 
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return ARMul_ABORTWORD;
 	}
@@ -463,9 +539,9 @@ ARMul_ReadByte (ARMul_State * state, ARMword address)
 	fault = GetByte (state, address, &data);
 
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return ARMul_ABORTWORD;
 	}
@@ -510,9 +586,9 @@ ARMul_WriteWord (ARMul_State * state, ARMword address, ARMword data)
 
 	fault = PutWord (state, address, data);
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return;
 	}
@@ -556,9 +632,9 @@ ARMul_StoreHalfWord (ARMul_State * state, ARMword address, ARMword data)
 	state->NumNcycles++;
 	fault = PutHalfWord (state, address, data);
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return;
 	}
@@ -587,9 +663,9 @@ ARMul_WriteByte (ARMul_State * state, ARMword address, ARMword data)
 	fault_t fault;
 	fault = PutByte (state, address, data);
 	if (fault) {
-		state->mmu.fault_status =
-			(fault | (state->mmu.last_domain << 4)) & 0xFF;
-		state->mmu.fault_address = address;
+		state->cold->mmu.fault_status =
+			(fault | (state->cold->mmu.last_domain << 4)) & 0xFF;
+		state->cold->mmu.fault_address = address;
 		ARMul_DATAABORT (address);
 		return;
 	}
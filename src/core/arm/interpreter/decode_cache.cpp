@@ -0,0 +1,142 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "common/atomic.h"
+
+#include "core/core.h"
+#include "core/arm/interpreter/armemu.h"
+#include "core/arm/interpreter/decode_cache.h"
+
+namespace DecodeCache {
+
+static std::unordered_map<u32, Page*> g_pages; ///< Cached pages, keyed by page index
+static std::mutex g_lock;   ///< Taken by the slow path, which the cores may take at once
+
+/**
+ * Empties a page, which stays allocated for the cores that remember it
+ * @param page Page to empty
+ */
+static void EmptyPage(Page* page) {
+    memset(page->valid, 0, sizeof(page->valid));
+}
+
+/**
+ * Stops the core at a breakpoint on an instruction, once until it moves on
+ * @param state ARM core state
+ * @param addr Guest address of the instruction
+ */
+static void CheckBreakPoint(ARMul_State* state, u32 addr) {
+    // Pages with breakpoints are never left as the last page, so that Fetch sends every
+    // instruction of them here to be checked
+    BreakPoints* breakpoints = Core::g_breakpoints;
+    if (breakpoints != nullptr && breakpoints->HasBreakPointInPage(addr)) {
+        state->DecodeLastPageIndex = 0xFFFFFFFF;
+        state->DecodeLastPage = nullptr;
+        if (addr != state->BreakPointPassed && breakpoints->IsAddressBreakPoint(addr)) {
+            state->DebugStop = 1;
+            state->BreakPointPassed = addr;
+        } else {
+            state->BreakPointPassed = 0xFFFFFFFF;
+        }
+    }
+}
+
+/**
+ * Fetches an instruction through the SkyEye memory interface and caches it
+ * @param state ARM core state
+ * @param addr Guest address of the instruction
+ * @param thumb Whether the instruction is a Thumb one
+ * @return The instruction word
+ */
+ARMword FetchSlow(ARMul_State* state, u32 addr, bool thumb) {
+    const u32 page_index = addr >> PAGE_BITS;
+
+    // Pages are keyed and invalidated by the address they run at, a write through another mapping
+    // of the same memory would leave the cached words stale, so such pages are never cached
+    if (Memory::IsPageShared(addr)) {
+        state->DecodeLastPageIndex = 0xFFFFFFFF;
+        state->DecodeLastPage = nullptr;
+        CheckBreakPoint(state, addr);
+
+        ARMword instr = ARMul_LoadInstrN(state, addr & ~3, 4);
+        if (instr == ARMul_ABORTWORD) {
+            state->NumCycles++;
+        } else if (thumb) {
+            const u16 half = (addr & 2) ? (u16)(instr >> 16) : (u16)instr;
+            state->NumCycles += CycleModel::GetThumbInstructionCycles(half);
+        } else {
+            state->NumCycles += CycleModel::GetInstructionCycles(instr);
+        }
+        return instr;
+    }
+
+    std::lock_guard<std::mutex> lock(g_lock);
+
+    Page*& page = g_pages[page_index];
+    if (page == nullptr) {
+        page = new Page;
+        EmptyPage(page);
+    }
+    // Guest code was written since the page was cached, by a store or by a host writer through
+    // Memory::MarkRangeDirty. The bit is cleared first, a write the other core makes meanwhile
+    // sets it again and empties the page at the next lookup.
+    if (Memory::g_dirty_pages[page_index] & Memory::DIRTY_CODE) {
+        Common::AtomicAnd(Memory::g_dirty_pages[page_index], (u8)~Memory::DIRTY_CODE);
+        EmptyPage(page);
+    }
+    state->DecodeLastPageIndex = page_index;
+    state->DecodeLastPage = page;
+
+    CheckBreakPoint(state, addr);
+
+    const u32 index = (addr & PAGE_MASK) >> 2;
+    if (page->valid[index >> 5] & (1 << (index & 31))) {
+        state->NumNcycles++;
+        ChargeCycles(state, page, addr, thumb);
+        return page->instructions[index];
+    }
+
+    ARMword instr = ARMul_LoadInstrN(state, addr & ~3, 4);
+
+    // Don't remember prefetch aborts, the next attempt has to fault again
+    if (instr == ARMul_ABORTWORD) {
+        state->NumCycles++;
+        return instr;
+    }
+    page->instructions[index] = instr;
+    page->valid[index >> 5] |= (1 << (index & 31));
+    page->arm_cycles[index] = CycleModel::GetInstructionCycles(instr);
+    page->thumb_cycles[index * 2] = CycleModel::GetThumbInstructionCycles(instr & 0xFFFF);
+    page->thumb_cycles[index * 2 + 1] = CycleModel::GetThumbInstructionCycles(instr >> 16);
+
+    ChargeCycles(state, page, addr, thumb);
+    return instr;
+}
+
+/**
+ * Throws away all cached instructions of the page containing an address
+ * @param addr Guest address inside the page
+ */
+void InvalidatePage(u32 addr) {
+    std::lock_guard<std::mutex> lock(g_lock);
+    auto it = g_pages.find(addr >> PAGE_BITS);
+    if (it != g_pages.end()) {
+        EmptyPage(it->second);
+    }
+}
+
+/// Throws away all cached instructions, with no core running
+void Clear() {
+    // The cores remembering a page are gone by now, see Core::Shutdown
+    for (auto it = g_pages.begin(); it != g_pages.end(); ++it) {
+        delete it->second;
+    }
+    g_pages.clear();
+}
+
+} // namespace
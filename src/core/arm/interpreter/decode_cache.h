@@ -0,0 +1,103 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/mem_map.h"
+#include "core/arm/cycle_model.h"
+#include "core/arm/interpreter/armdefs.h"
+
+/**
+ * Cache of already fetched ARM instruction words, kept per 4 KiB guest page. The interpreter
+ * normally goes through the whole SkyEye fetch path (ARMul_LoadInstrN -> MMU -> Memory::Read32)
+ * for every executed instruction; with the cache that only happens the first time an address
+ * runs. Pages are thrown away once Memory marks them DIRTY_CODE. The CycleModel cost of each
+ * instruction is cached along with it, and charged to the core every time it's fetched.
+ *
+ * The cache holds the fetched words and their costs, not decoded handlers: SkyEye decodes in the
+ * one big switch of ARMul_Emulate32, with no per-instruction handler to remember, and the JIT is
+ * the pre-decoded path. Pages are keyed by the address they run at, like every other consumer of
+ * Memory::g_dirty_pages, so pages mapped at more than one address (see Memory::IsPageShared) are
+ * never cached.
+ *
+ * The cores share the cache but each remembers the page it looked up last. Pages stay allocated
+ * until Clear, a dirty page is emptied in place, so the page a core remembers never goes away
+ * under it while the other core refills it.
+ */
+namespace DecodeCache {
+
+enum {
+    PAGE_BITS   = 12,
+    PAGE_SIZE   = (1 << PAGE_BITS),
+    PAGE_MASK   = (PAGE_SIZE - 1),
+    NUM_PAGES   = (1 << (32 - PAGE_BITS)),
+};
+
+/// Decoded instructions of a single guest page
+struct Page {
+    ARMword instructions[PAGE_SIZE / 4];    ///< Instruction words, indexed by (addr & PAGE_MASK) >> 2
+    u32     valid[PAGE_SIZE / 4 / 32];      ///< Bitmap of filled entries in instructions[]
+    u8      arm_cycles[PAGE_SIZE / 4];      ///< Cost of the words as ARM instructions
+    u8      thumb_cycles[PAGE_SIZE / 2];    ///< Cost of the halfwords as Thumb instructions
+};
+
+/**
+ * Fetches an instruction through the SkyEye memory interface and caches it
+ * @param state ARM core state
+ * @param addr Guest address of the instruction
+ * @param thumb Whether the instruction is a Thumb one
+ * @return The instruction word
+ */
+ARMword FetchSlow(ARMul_State* state, u32 addr, bool thumb);
+
+/**
+ * Throws away all cached instructions of the page containing an address
+ * @param addr Guest address inside the page
+ */
+void InvalidatePage(u32 addr);
+
+/// Throws away all cached instructions, with no core running
+void Clear();
+
+/**
+ * Charges the cost of a cached instruction to the core
+ * @param state ARM core state
+ * @param page Page holding the instruction
+ * @param addr Guest address of the instruction
+ * @param thumb Whether the instruction is a Thumb one
+ */
+inline void ChargeCycles(ARMul_State* state, const Page* page, u32 addr, bool thumb) {
+    if (thumb) {
+        state->NumCycles += page->thumb_cycles[(addr & PAGE_MASK) >> 1];
+    } else {
+        state->NumCycles += page->arm_cycles[(addr & PAGE_MASK) >> 2];
+    }
+}
+
+/**
+ * Fetches the instruction word (one ARM or two Thumb instructions) holding an instruction, from
+ * the cache if possible, and charges the cost of the instruction
+ * @param state ARM core state
+ * @param addr Guest address of the instruction
+ * @param thumb Whether the instruction is a Thumb one
+ * @return The instruction word
+ */
+inline ARMword Fetch(ARMul_State* state, u32 addr, bool thumb) {
+    const u32 page_index = addr >> PAGE_BITS;
+    if (page_index == state->DecodeLastPageIndex &&
+        !(Memory::g_dirty_pages[page_index] & Memory::DIRTY_CODE)) {
+        const Page* page = state->DecodeLastPage;
+        const u32 index = (addr & PAGE_MASK) >> 2;
+        if (page->valid[index >> 5] & (1 << (index & 31))) {
+            state->NumNcycles++;
+            ChargeCycles(state, page, addr, thumb);
+            return page->instructions[index];
+        }
+    }
+    return FetchSlow(state, addr, thumb);
+}
+
+} // namespace
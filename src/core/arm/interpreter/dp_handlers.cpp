@@ -0,0 +1,298 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "core/arm/interpreter/armemu.h"
+#include "core/arm/interpreter/dp_handlers.h"
+
+namespace DPHandlers {
+
+Handler g_handlers[NUM_HANDLERS];
+
+namespace {
+
+/// Data processing opcodes (instruction bits 21-24)
+enum Opcode {
+    OP_AND, OP_EOR, OP_SUB, OP_RSB, OP_ADD, OP_ADC, OP_SBC, OP_RSC,
+    OP_TST, OP_TEQ, OP_CMP, OP_CMN, OP_ORR, OP_MOV, OP_BIC, OP_MVN,
+    NUM_OPCODES,
+};
+
+/// Forms of the shifter operand
+enum Operand {
+    OPERAND_IMM,            ///< Rotated 8-bit immediate
+    OPERAND_IMM_SHIFT,      ///< Rm shifted by an immediate, OPERAND_IMM_SHIFT + shift type
+    OPERAND_REG_SHIFT = 5,  ///< Rm shifted by Rs, OPERAND_REG_SHIFT + shift type
+    NUM_OPERANDS = 9,
+};
+
+/// Whether an opcode sets C from the shifter (AND/EOR/TST/TEQ/ORR/MOV/BIC/MVN) rather than the ALU
+template <u32 opcode>
+struct IsLogical {
+    enum {
+        value = opcode <= OP_EOR || (opcode >= OP_TST && opcode <= OP_TEQ) || opcode >= OP_ORR,
+    };
+};
+
+/**
+ * Evaluates the shifter operand of an instruction
+ * @param state ARM core state
+ * @param instr ARM instruction word
+ * @tparam operand Form of the operand
+ * @tparam set_carry Whether the shifter carry-out goes to the C flag
+ * @return The operand value
+ */
+template <int operand, bool set_carry>
+inline ARMword ShifterOperand(ARMul_State* state, ARMword instr) {
+    if (operand == OPERAND_IMM) {
+        const u32 imm = instr & 0xFFF;
+        const ARMword value = ARMul_ImmedTable[imm];
+        if (set_carry && imm > 0xFF) {
+            ASSIGNC(value >> 31);
+        }
+        return value;
+    }
+
+    const ARMword base = state->Reg[instr & 0xF];
+    if (operand < OPERAND_REG_SHIFT) {
+        // An amount of 0 encodes LSR #32, ASR #32 and RRX
+        const u32 amount = (instr >> 7) & 0x1F;
+        switch (operand - OPERAND_IMM_SHIFT) {
+        case LSL:
+            if (set_carry && amount != 0) {
+                ASSIGNC((base >> (32 - amount)) & 1);
+            }
+            return base << amount;
+        case LSR:
+            if (amount == 0) {
+                if (set_carry) {
+                    ASSIGNC(base >> 31);
+                }
+                return 0;
+            }
+            if (set_carry) {
+                ASSIGNC((base >> (amount - 1)) & 1);
+            }
+            return base >> amount;
+        case ASR:
+            if (amount == 0) {
+                if (set_carry) {
+                    ASSIGNC(base >> 31);
+                }
+                return (ARMword)((s32)base >> 31);
+            }
+            if (set_carry) {
+                ASSIGNC(((s32)base >> (amount - 1)) & 1);
+            }
+            return (ARMword)((s32)base >> amount);
+        default: // ROR
+            if (amount == 0) {
+                ARMword carry_in = CFLAG;
+                if (set_carry) {
+                    ASSIGNC(base & 1);
+                }
+                return (base >> 1) | (carry_in << 31);
+            }
+            if (set_carry) {
+                ASSIGNC((base >> (amount - 1)) & 1);
+            }
+            return (base << (32 - amount)) | (base >> amount);
+        }
+    }
+
+    // Register shifts take an extra cycle, during which the PC moves on
+    INCPC;
+    ARMul_Icycles(state, 1, 0L);
+
+    const u32 amount = state->Reg[(instr >> 8) & 0xF] & 0xFF;
+    if (amount == 0) {
+        return base;
+    }
+    switch (operand - OPERAND_REG_SHIFT) {
+    case LSL:
+        if (amount >= 32) {
+            if (set_carry) {
+                ASSIGNC(amount == 32 ? base & 1 : 0);
+            }
+            return 0;
+        }
+        if (set_carry) {
+            ASSIGNC((base >> (32 - amount)) & 1);
+        }
+        return base << amount;
+    case LSR:
+        if (amount >= 32) {
+            if (set_carry) {
+                ASSIGNC(amount == 32 ? base >> 31 : 0);
+            }
+            return 0;
+        }
+        if (set_carry) {
+            ASSIGNC((base >> (amount - 1)) & 1);
+        }
+        return base >> amount;
+    case ASR:
+        if (amount >= 32) {
+            if (set_carry) {
+                ASSIGNC(base >> 31);
+            }
+            return (ARMword)((s32)base >> 31);
+        }
+        if (set_carry) {
+            ASSIGNC(((s32)base >> (amount - 1)) & 1);
+        }
+        return (ARMword)((s32)base >> amount);
+    default: // ROR
+        {
+            const u32 rotate = amount & 0x1F;
+            if (rotate == 0) {
+                if (set_carry) {
+                    ASSIGNC(base >> 31);
+                }
+                return base;
+            }
+            if (set_carry) {
+                ASSIGNC((base >> (rotate - 1)) & 1);
+            }
+            return (base << (32 - rotate)) | (base >> rotate);
+        }
+    }
+}
+
+/**
+ * Executes one data processing instruction. Everything but the register numbers is known at
+ * compile time, so the shifter and the flag updates reduce to straight-line code.
+ * @param state ARM core state
+ * @param instr ARM instruction word
+ * @tparam opcode Data processing opcode
+ * @tparam set_flags Whether the S bit is set
+ * @tparam operand Form of the shifter operand
+ * @return False if the instruction involves the PC and has to go through the generic path
+ */
+template <u32 opcode, bool set_flags, int operand>
+bool DataProcessing(ARMul_State* state, ARMword instr) {
+    const u32 rd = (instr >> 12) & 0xF;
+    const u32 rn = (instr >> 16) & 0xF;
+
+    if (rd == 15 || (opcode != OP_MOV && opcode != OP_MVN && rn == 15)) {
+        return false;
+    }
+    if (operand != OPERAND_IMM && (instr & 0xF) == 15) {
+        return false;
+    }
+    if (operand >= OPERAND_REG_SHIFT && ((instr & (1 << 7)) || ((instr >> 8) & 0xF) == 15)) {
+        return false;   // Bit 7 set means multiply or extra load/store, not data processing
+    }
+
+    const ARMword rhs = ShifterOperand<operand, set_flags && IsLogical<opcode>::value>(state, instr);
+    const ARMword lhs = state->Reg[rn];
+    ARMword dest;
+
+    switch (opcode) {
+    case OP_AND: case OP_TST:   dest = lhs & rhs;               break;
+    case OP_EOR: case OP_TEQ:   dest = lhs ^ rhs;               break;
+    case OP_SUB: case OP_CMP:   dest = lhs - rhs;               break;
+    case OP_RSB:                dest = rhs - lhs;               break;
+    case OP_ADD: case OP_CMN:   dest = lhs + rhs;               break;
+    case OP_ADC:                dest = lhs + rhs + CFLAG;       break;
+    case OP_SBC:                dest = lhs - rhs - !CFLAG;      break;
+    case OP_RSC:                dest = rhs - lhs - !CFLAG;      break;
+    case OP_ORR:                dest = lhs | rhs;               break;
+    case OP_MOV:                dest = rhs;                     break;
+    case OP_BIC:                dest = lhs & ~rhs;              break;
+    default:                    dest = ~rhs;                    break;
+    }
+
+    if (set_flags) {
+        ARMul_NegZero(state, dest);
+        switch (opcode) {
+        case OP_SUB: case OP_SBC: case OP_CMP:
+            ARMul_SubCarry(state, lhs, rhs, dest);
+            ARMul_SubOverflow(state, lhs, rhs, dest);
+            break;
+        case OP_RSB: case OP_RSC:
+            ARMul_SubCarry(state, rhs, lhs, dest);
+            ARMul_SubOverflow(state, rhs, lhs, dest);
+            break;
+        case OP_ADD: case OP_ADC: case OP_CMN:
+            ARMul_AddCarry(state, lhs, rhs, dest);
+            ARMul_AddOverflow(state, lhs, rhs, dest);
+            break;
+        }
+    }
+    if (opcode < OP_TST || opcode > OP_CMN) {
+        state->Reg[rd] = dest;
+    }
+    return true;
+}
+
+/**
+ * Registers the handlers of one opcode and S bit for every operand form
+ * @tparam opcode Data processing opcode
+ * @tparam set_flags Whether the S bit is set
+ */
+template <u32 opcode, bool set_flags>
+void RegisterOpcode() {
+    static const Handler handlers[NUM_OPERANDS] = {
+        &DataProcessing<opcode, set_flags, OPERAND_IMM>,
+        &DataProcessing<opcode, set_flags, OPERAND_IMM_SHIFT + LSL>,
+        &DataProcessing<opcode, set_flags, OPERAND_IMM_SHIFT + LSR>,
+        &DataProcessing<opcode, set_flags, OPERAND_IMM_SHIFT + ASR>,
+        &DataProcessing<opcode, set_flags, OPERAND_IMM_SHIFT + ROR>,
+        &DataProcessing<opcode, set_flags, OPERAND_REG_SHIFT + LSL>,
+        &DataProcessing<opcode, set_flags, OPERAND_REG_SHIFT + LSR>,
+        &DataProcessing<opcode, set_flags, OPERAND_REG_SHIFT + ASR>,
+        &DataProcessing<opcode, set_flags, OPERAND_REG_SHIFT + ROR>,
+    };
+
+    // Index bits 3-10 are instruction bits 20-27 (S, opcode, I), bits 0-2 are bits 4-6 (register
+    // shift flag and shift type)
+    for (u32 imm = 0; imm < 2; imm++) {
+        const u32 byte = (imm << 5) | (opcode << 1) | (set_flags ? 1 : 0);
+        for (u32 low = 0; low < 8; low++) {
+            int operand;
+            if (imm) {
+                operand = OPERAND_IMM;
+            } else if (low & 1) {
+                operand = OPERAND_REG_SHIFT + (low >> 1);
+            } else {
+                operand = OPERAND_IMM_SHIFT + (low >> 1);
+            }
+            g_handlers[(byte << 3) | low] = handlers[operand];
+        }
+    }
+}
+
+/// Registers both S bit variants of an opcode
+template <u32 opcode>
+void RegisterOpcodeFlags() {
+    RegisterOpcode<opcode, true>();
+    // TST/TEQ/CMP/CMN without the S bit encode MRS, MSR, BX and other miscellaneous instructions
+    if (opcode < OP_TST || opcode > OP_CMN) {
+        RegisterOpcode<opcode, false>();
+    }
+}
+
+} // namespace
+
+/// Fills the handler table, called from ARMul_EmulateInit
+void Init() {
+    RegisterOpcodeFlags<OP_AND>();
+    RegisterOpcodeFlags<OP_EOR>();
+    RegisterOpcodeFlags<OP_SUB>();
+    RegisterOpcodeFlags<OP_RSB>();
+    RegisterOpcodeFlags<OP_ADD>();
+    RegisterOpcodeFlags<OP_ADC>();
+    RegisterOpcodeFlags<OP_SBC>();
+    RegisterOpcodeFlags<OP_RSC>();
+    RegisterOpcodeFlags<OP_TST>();
+    RegisterOpcodeFlags<OP_TEQ>();
+    RegisterOpcodeFlags<OP_CMP>();
+    RegisterOpcodeFlags<OP_CMN>();
+    RegisterOpcodeFlags<OP_ORR>();
+    RegisterOpcodeFlags<OP_MOV>();
+    RegisterOpcodeFlags<OP_BIC>();
+    RegisterOpcodeFlags<OP_MVN>();
+}
+
+} // namespace
@@ -0,0 +1,46 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "core/arm/interpreter/armdefs.h"
+
+/**
+ * Specialised handlers for ARM data processing instructions. The generic path in ARMul_Emulate32
+ * decodes the shifter operand and the flag updates of every instruction at runtime; here there is
+ * one handler per (opcode, S bit, shifter operand form) combination, instantiated from a template
+ * at compile time, so each one is straight-line code. Instructions that read or write the PC are
+ * left to the generic path.
+ */
+namespace DPHandlers {
+
+/**
+ * Executes a data processing instruction
+ * @param state ARM core state
+ * @param instr ARM instruction word, with the condition already checked
+ * @return False if the instruction has to go through the generic path
+ */
+typedef bool (*Handler)(ARMul_State* state, ARMword instr);
+
+enum {
+    NUM_HANDLERS = (1 << 11),   ///< Table index: instruction bits 20-27 and 4-6
+};
+
+extern Handler g_handlers[NUM_HANDLERS];    ///< Handler for each index, nullptr if there is none
+
+/// Fills the handler table, called from ARMul_EmulateInit
+void Init();
+
+/**
+ * Executes an instruction through its specialised handler if it has one
+ * @param state ARM core state
+ * @param instr ARM instruction word, with the condition already checked
+ * @return True if the instruction was executed
+ */
+inline bool Execute(ARMul_State* state, ARMword instr) {
+    Handler handler = g_handlers[((instr >> 17) & 0x7F8) | ((instr >> 4) & 7)];
+    return handler != nullptr && handler(state, instr);
+}
+
+} // namespace
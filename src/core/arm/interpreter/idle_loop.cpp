@@ -0,0 +1,281 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common/log.h"
+
+#include "core/core.h"
+#include "core/mem_map.h"
+#include "core/sys_core.h"
+#include "core/arm/interpreter/idle_loop.h"
+
+namespace IdleLoop {
+
+bool g_skip_pending = false;
+bool g_detection_enabled = true;
+
+namespace {
+
+/// Result of analysing the loop closed by a branch
+struct LoopInfo {
+    u32     branch_instr;   ///< Branch instruction the result was computed for
+    bool    idle;           ///< Whether the loop is idle
+};
+
+typedef std::unordered_map<u32, LoopInfo> LoopMap;
+
+/// Analysed loops keyed by branch address, of the app core and of the sys core thread
+LoopMap g_loops[2];
+
+/// Branches of the loops skipped without analysis, set once before the cores run
+std::unordered_set<u32> g_known_loops;
+
+/// Bits used for the individual NZCV flags in the register masks
+enum {
+    FLAG_N  = (1 << 16),
+    FLAG_Z  = (1 << 17),
+    FLAG_C  = (1 << 18),
+    FLAG_V  = (1 << 19),
+};
+
+/// Flags read by each condition code
+const u32 COND_FLAGS[16] = {
+    FLAG_Z, FLAG_Z,                         // EQ, NE
+    FLAG_C, FLAG_C,                         // CS, CC
+    FLAG_N, FLAG_N,                         // MI, PL
+    FLAG_V, FLAG_V,                         // VS, VC
+    FLAG_C | FLAG_Z, FLAG_C | FLAG_Z,       // HI, LS
+    FLAG_N | FLAG_V, FLAG_N | FLAG_V,       // GE, LT
+    FLAG_N | FLAG_Z | FLAG_V,               // GT
+    FLAG_N | FLAG_Z | FLAG_V,               // LE
+    0, 0,                                   // AL, NV
+};
+
+/// Register usage of a single instruction
+struct Usage {
+    u32 reads;      ///< Registers (and FLAG_*) read
+    u32 writes;     ///< Registers (and FLAG_*) written
+};
+
+/**
+ * Works out which registers an instruction reads and writes
+ * @param instr ARM instruction word
+ * @param usage Register usage of the instruction
+ * @return False if the instruction is not allowed in an idle loop (stores, writeback, branches,
+ *         PC writes, coprocessor and system instructions)
+ */
+bool GetUsage(u32 instr, Usage& usage) {
+    const u32 cond = instr >> 28;
+    const u32 rn = (instr >> 16) & 0xF;
+    const u32 rd = (instr >> 12) & 0xF;
+    const u32 rm = instr & 0xF;
+
+    if (cond == 0xF || rd == 15) {
+        return false;
+    }
+    usage.reads = COND_FLAGS[cond];
+    usage.writes = 0;
+
+    switch ((instr >> 25) & 7) {
+    case 0: // Data processing (register), multiplies and extra loads/stores
+        if ((instr & 0x90) == 0x90) {
+            // LDRH/LDRSB/LDRSH with immediate or register offset, no writeback
+            bool load = (instr & (1 << 20)) != 0;
+            bool pre_indexed = (instr & (1 << 24)) != 0;
+            bool writeback = (instr & (1 << 21)) != 0;
+            if (!load || !pre_indexed || writeback || ((instr >> 5) & 3) == 0) {
+                return false;
+            }
+            usage.reads |= (1 << rn);
+            if (!(instr & (1 << 22))) {
+                usage.reads |= (1 << rm);
+            }
+            usage.writes |= (1 << rd);
+            return true;
+        }
+        // Register operand, optionally shifted by a register
+        usage.reads |= (1 << rm);
+        if (instr & (1 << 4)) {
+            usage.reads |= (1 << ((instr >> 8) & 0xF));
+        }
+        // RRX reads the carry flag
+        if ((instr & 0xFF0) == 0x060) {
+            usage.reads |= FLAG_C;
+        }
+        break;
+
+    case 1: // Data processing (immediate)
+        break;
+
+    case 2: // LDR/LDRB (immediate offset)
+    case 3: // LDR/LDRB (register offset)
+        {
+            bool load = (instr & (1 << 20)) != 0;
+            bool pre_indexed = (instr & (1 << 24)) != 0;
+            bool writeback = (instr & (1 << 21)) != 0;
+            if (!load || !pre_indexed || writeback) {
+                return false;
+            }
+            // Media instructions share the register offset space
+            if (((instr >> 25) & 7) == 3 && (instr & (1 << 4))) {
+                return false;
+            }
+            usage.reads |= (1 << rn);
+            if (((instr >> 25) & 7) == 3) {
+                usage.reads |= (1 << rm);
+            }
+            usage.writes |= (1 << rd);
+        }
+        return true;
+
+    default:
+        return false;
+    }
+
+    // Everything left is data processing
+    const u32 opcode = (instr >> 21) & 0xF;
+    const bool set_flags = (instr & (1 << 20)) != 0;
+
+    // MRS/MSR/BX and friends live in the compare encodings without S bit
+    if (opcode >= 0x8 && opcode <= 0xB && !set_flags) {
+        return false;
+    }
+    if (opcode != 0xD && opcode != 0xF) {   // MOV and MVN have no first operand
+        usage.reads |= (1 << rn);
+    }
+    if (opcode < 0x8 || opcode > 0xB) {     // TST/TEQ/CMP/CMN only set flags
+        usage.writes |= (1 << rd);
+    }
+    if (opcode == 0x5 || opcode == 0x6 || opcode == 0x7) {  // ADC/SBC/RSC
+        usage.reads |= FLAG_C;
+    }
+    if (set_flags) {
+        bool arithmetic = (opcode >= 0x2 && opcode <= 0x7) || (opcode >= 0xA && opcode <= 0xB);
+        if (arithmetic) {
+            usage.writes |= FLAG_N | FLAG_Z | FLAG_C | FLAG_V;
+        } else {
+            // Logical ops leave V alone and only change C if the shifter produces a carry. A
+            // flag that is left alone is neither read nor written.
+            usage.writes |= FLAG_N | FLAG_Z;
+            bool imm = (instr & (1 << 25)) != 0;
+            if (imm ? ((instr >> 8) & 0xF) != 0 : (instr & 0xFF0) != 0) {
+                usage.writes |= FLAG_C;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Analyses the loop between target and a backward branch
+ * @param branch_addr Guest address of the branch instruction
+ * @param target Guest address the branch jumps to
+ * @return True if the loop is idle
+ */
+bool Analyse(u32 branch_addr, u32 target) {
+    u32 written = 0;        // Registers written so far by unconditional instructions
+    u32 carried = 0;        // Registers read before the loop body wrote them
+    u32 ever_written = 0;   // Registers written anywhere in the loop
+
+    for (u32 addr = target; addr < branch_addr; addr += 4) {
+        Usage usage;
+        u32 instr = Memory::Read32(addr);
+        if (!GetUsage(instr, usage)) {
+            return false;
+        }
+        carried |= usage.reads & ~written;
+        ever_written |= usage.writes;
+        if ((instr >> 28) == 0xE) {
+            written |= usage.writes;
+        }
+    }
+    // The branch itself reads the flags it is conditional on
+    carried |= COND_FLAGS[Memory::Read32(branch_addr) >> 28] & ~written;
+
+    // A value that survives from one iteration into the next (a counter, say) makes every
+    // iteration different, that's a delay loop and not an idle one
+    return (carried & ever_written) == 0;
+}
+
+} // namespace
+
+/**
+ * Checks whether a taken backward branch closes an idle loop
+ * @param branch_addr Guest address of the branch instruction
+ * @param target Guest address the branch jumps to
+ * @return True if the loop was found to be idle
+ */
+bool Check(u32 branch_addr, u32 target) {
+    u32 branch_instr = Memory::Read32(branch_addr);
+
+    // The cores may check at once, each has the loops it ran into to itself
+    LoopMap& loops = g_loops[SysCore::IsSysCoreThread() ? 1 : 0];
+    auto it = loops.find(branch_addr);
+    if (it != loops.end() && it->second.branch_instr == branch_instr) {
+        return it->second.idle;
+    }
+
+    LoopInfo& info = loops[branch_addr];
+    info.branch_instr = branch_instr;
+    if (g_known_loops.count(branch_addr)) {
+        info.idle = true;
+        return true;
+    }
+    info.idle = g_detection_enabled && Analyse(branch_addr, target);
+    if (info.idle) {
+        DEBUG_LOG(ARM11, "idle loop at 0x%08X-0x%08X", target, branch_addr);
+    }
+    return info.idle;
+}
+
+/// Ends the current CPU slice and has the core loop idle to the next event
+void RequestSkip() {
+    // Time is the app core's to skip, the sys core only gives up the rest of its slice
+    if (SysCore::IsSysCoreThread()) {
+        Core::g_sys_core->PrepareReschedule();
+        return;
+    }
+    g_skip_pending = true;
+    Core::g_app_core->PrepareReschedule();
+}
+
+/// Forgets all analysed loops
+void Clear() {
+    g_loops[0].clear();
+    g_loops[1].clear();
+    g_skip_pending = false;
+}
+
+/**
+ * Sets the loops skipped without being analysed, from the profile of the title. They still have
+ * to be short backward branches, the analysis being what tells idle ones from the others.
+ * @param branch_addrs Guest addresses of the branch instructions closing the loops
+ */
+void SetKnownLoops(const std::vector<u32>& branch_addrs) {
+    g_known_loops.clear();
+    g_known_loops.insert(branch_addrs.begin(), branch_addrs.end());
+    g_loops[0].clear();
+    g_loops[1].clear();
+}
+
+/**
+ * Gets the loops of the app core the analysis found idle since the last Clear, for the profile of
+ * the title to suggest
+ * @return Guest addresses of the branch instructions closing the loops, ascending
+ */
+std::vector<u32> GetDetectedLoops() {
+    std::vector<u32> detected;
+    for (auto& loop : g_loops[0]) {
+        if (loop.second.idle && !g_known_loops.count(loop.first)) {
+            detected.push_back(loop.first);
+        }
+    }
+    std::sort(detected.begin(), detected.end());
+    return detected;
+}
+
+} // namespace
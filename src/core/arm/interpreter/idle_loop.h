@@ -0,0 +1,66 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+
+/**
+ * Detection of guest idle loops. A short backward branch whose loop body only loads from memory
+ * and computes on what it loaded (no stores, no state carried from one iteration to the next)
+ * does exactly the same thing every iteration until something outside the CPU changes memory,
+ * which only happens at CoreTiming events. Such loops are skipped by idling to the next event.
+ */
+namespace IdleLoop {
+
+enum {
+    MAX_LOOP_INSTRUCTIONS = 8,  ///< Longest loop body (including the branch) that is analysed
+};
+
+extern bool g_skip_pending; ///< Set when an idle loop was hit, the core loop then calls Idle
+extern bool g_detection_enabled;    ///< Whether loops are analysed, else only known ones skip
+
+/**
+ * Checks whether a taken backward branch closes an idle loop
+ * @param branch_addr Guest address of the branch instruction
+ * @param target Guest address the branch jumps to
+ * @return True if the loop was found to be idle
+ */
+bool Check(u32 branch_addr, u32 target);
+
+/// Ends the current CPU slice and has the core loop idle to the next event, on the app core
+void RequestSkip();
+
+/**
+ * Called by the interpreter for every taken backward branch. If the branch closes an idle loop,
+ * ends the current CPU slice and requests an idle skip.
+ * @param branch_addr Guest address of the branch instruction
+ * @param target Guest address the branch jumps to
+ */
+inline void OnBackwardBranch(u32 branch_addr, u32 target) {
+    if (branch_addr - target < MAX_LOOP_INSTRUCTIONS * 4 && Check(branch_addr, target)) {
+        RequestSkip();
+    }
+}
+
+/// Forgets all analysed loops
+void Clear();
+
+/**
+ * Sets the loops skipped without being analysed, from the profile of the title. They still have
+ * to be short backward branches, the analysis being what tells idle ones from the others.
+ * @param branch_addrs Guest addresses of the branch instructions closing the loops
+ */
+void SetKnownLoops(const std::vector<u32>& branch_addrs);
+
+/**
+ * Gets the loops of the app core the analysis found idle since the last Clear, for the profile of
+ * the title to suggest
+ * @return Guest addresses of the branch instructions closing the loops, ascending
+ */
+std::vector<u32> GetDetectedLoops();
+
+} // namespace
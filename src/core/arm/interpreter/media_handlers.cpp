@@ -0,0 +1,463 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/common.h"
+
+#include "core/arm/interpreter/armemu.h"
+#include "core/arm/interpreter/media_handlers.h"
+
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || _M_IX86_FP >= 2))
+#define MEDIA_HANDLERS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace MediaHandlers {
+
+namespace {
+
+/// How the lanes of a flavour of parallel add and subtract are brought back to their width
+enum ParallelMode {
+    MODE_MODULAR = 1,   ///< Truncated, GE set from the carries or signs
+    MODE_SATURATING,    ///< Clamped to the range of the lane
+    MODE_HALVING,       ///< Halved, which always fits
+};
+
+/**
+ * Whether a halfword lane of an operation subtracts
+ * @param op Operation, a ParallelOp
+ * @param lane Lane, 0 for the low halfword
+ * @return True if Rd gets the lane of Rn minus that of Rm
+ */
+inline bool IsSubtractLane(u32 op, u32 lane) {
+    switch (op) {
+    case OP_ASX:    return lane == 0;
+    case OP_SAX:    return lane == 1;
+    case OP_SUB16:
+    case OP_SUB8:   return true;
+    default:        return false;
+    }
+}
+
+/**
+ * Kernel of a parallel add or subtract instruction. The lanes are widened so the sums and
+ * differences are exact, which gives the GE flags, the saturation and the halving at once.
+ * @tparam flavour Flavour of the instruction, a ParallelFlavour
+ * @tparam op Operation of the instruction, a ParallelOp
+ */
+template <u32 flavour, u32 op>
+u32 Parallel(u32 n, u32 m, u32& ge) {
+    const bool is_signed = flavour < FLAVOUR_UNSIGNED;
+    const u32 mode = flavour & 3;
+    const bool bytes = op >= OP_ADD8;
+
+    // ASX and SAX pair each halfword of Rn with the other halfword of Rm
+    if (op == OP_ASX || op == OP_SAX) {
+        m = (m << 16) | (m >> 16);
+    }
+
+#ifdef MEDIA_HANDLERS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i packed_n = _mm_cvtsi32_si128((int)n);
+    const __m128i packed_m = _mm_cvtsi32_si128((int)m);
+    __m128i result;
+    if (bytes) {
+        const __m128i wide_n = is_signed ? _mm_srai_epi16(_mm_unpacklo_epi8(packed_n, packed_n), 8)
+            : _mm_unpacklo_epi8(packed_n, zero);
+        const __m128i wide_m = is_signed ? _mm_srai_epi16(_mm_unpacklo_epi8(packed_m, packed_m), 8)
+            : _mm_unpacklo_epi8(packed_m, zero);
+        // Subtracting lanes add the negated lane of Rm
+        const __m128i sub_mask = _mm_set1_epi16(op == OP_SUB8 ? -1 : 0);
+        __m128i wide = _mm_add_epi16(wide_n,
+            _mm_sub_epi16(_mm_xor_si128(wide_m, sub_mask), sub_mask));
+        if (mode == MODE_HALVING) {
+            wide = _mm_srai_epi16(wide, 1);
+        }
+        if (mode == MODE_SATURATING) {
+            result = is_signed ? _mm_packs_epi16(wide, wide) : _mm_packus_epi16(wide, wide);
+        } else {
+            result = _mm_packus_epi16(_mm_and_si128(wide, _mm_set1_epi16(0xFF)), zero);
+        }
+        if (mode == MODE_MODULAR) {
+            // Signed and subtracting lanes set GE when they aren't negative, unsigned adding ones
+            // when they carry out
+            const __m128i threshold = is_signed ? _mm_set1_epi16(-1) :
+                _mm_or_si128(sub_mask, _mm_andnot_si128(sub_mask, _mm_set1_epi16(0xFF)));
+            const __m128i ge_lanes = _mm_cmpgt_epi16(wide, threshold);
+            ge = _mm_movemask_epi8(_mm_packs_epi16(ge_lanes, ge_lanes)) & 0xF;
+        }
+    } else {
+        const __m128i wide_n = is_signed ?
+            _mm_srai_epi32(_mm_unpacklo_epi16(packed_n, packed_n), 16) :
+            _mm_unpacklo_epi16(packed_n, zero);
+        const __m128i wide_m = is_signed ?
+            _mm_srai_epi32(_mm_unpacklo_epi16(packed_m, packed_m), 16) :
+            _mm_unpacklo_epi16(packed_m, zero);
+        const __m128i sub_mask = _mm_set_epi32(0, 0, IsSubtractLane(op, 1) ? -1 : 0,
+            IsSubtractLane(op, 0) ? -1 : 0);
+        __m128i wide = _mm_add_epi32(wide_n,
+            _mm_sub_epi32(_mm_xor_si128(wide_m, sub_mask), sub_mask));
+        if (mode == MODE_HALVING) {
+            wide = _mm_srai_epi32(wide, 1);
+        }
+        if (mode == MODE_SATURATING && is_signed) {
+            result = _mm_packs_epi32(wide, zero);
+        } else if (mode == MODE_SATURATING) {
+            // SSE2 can only pack to signed halfwords, biasing the lanes makes that unsigned
+            const __m128i biased = _mm_packs_epi32(_mm_sub_epi32(wide, _mm_set1_epi32(0x8000)),
+                zero);
+            result = _mm_xor_si128(biased, _mm_set1_epi16((s16)0x8000));
+        } else {
+            result = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(wide, 16), 16), zero);
+        }
+        if (mode == MODE_MODULAR) {
+            const __m128i threshold = is_signed ? _mm_set1_epi32(-1) :
+                _mm_or_si128(sub_mask, _mm_andnot_si128(sub_mask, _mm_set1_epi32(0xFFFF)));
+            const __m128i ge_lanes = _mm_cmpgt_epi32(wide, threshold);
+            ge = _mm_movemask_epi8(_mm_packs_epi32(ge_lanes, ge_lanes)) & 0xF;
+        }
+    }
+    return (u32)_mm_cvtsi128_si32(result);
+#else
+    const u32 lane_bits = bytes ? 8 : 16;
+    const u32 lane_mask = (1u << lane_bits) - 1;
+    const s32 lane_max = is_signed ? (s32)(lane_mask >> 1) : (s32)lane_mask;
+    const s32 lane_min = is_signed ? -lane_max - 1 : 0;
+    u32 result = 0;
+    u32 ge_bits = 0;
+    for (u32 lane = 0; lane < 32 / lane_bits; lane++) {
+        const u32 shift = lane * lane_bits;
+        s32 a = (n >> shift) & lane_mask;
+        s32 b = (m >> shift) & lane_mask;
+        if (is_signed) {
+            a = (s32)((u32)a << (32 - lane_bits)) >> (32 - lane_bits);
+            b = (s32)((u32)b << (32 - lane_bits)) >> (32 - lane_bits);
+        }
+        const bool subtract = bytes ? op == OP_SUB8 : IsSubtractLane(op, lane);
+        s32 wide = subtract ? a - b : a + b;
+        if (mode == MODE_HALVING) {
+            wide >>= 1;
+        }
+        if (mode == MODE_SATURATING) {
+            wide = CLAMP(wide, lane_min, lane_max);
+        }
+        result |= ((u32)wide & lane_mask) << shift;
+        if ((is_signed || subtract) ? wide >= 0 : wide > (s32)lane_mask) {
+            ge_bits |= bytes ? 1 << lane : 3 << (lane * 2);
+        }
+    }
+    if (mode == MODE_MODULAR) {
+        ge = ge_bits;
+    }
+    return result;
+#endif
+}
+
+#define PARALLEL_KERNELS(flavour) { \
+    &Parallel<flavour, OP_ADD16>, &Parallel<flavour, OP_ASX>, &Parallel<flavour, OP_SAX>, \
+    &Parallel<flavour, OP_SUB16>, &Parallel<flavour, OP_ADD8>, nullptr, nullptr, \
+    &Parallel<flavour, OP_SUB8> }
+
+/// Kernel of every flavour and operation, nullptr for the undefined encodings
+const ParallelKernel kParallelKernels[NUM_PARALLEL_FLAVOURS][NUM_PARALLEL_OPS] = {
+    {},
+    PARALLEL_KERNELS(FLAVOUR_SIGNED),
+    PARALLEL_KERNELS(FLAVOUR_SIGNED_SATURATING),
+    PARALLEL_KERNELS(FLAVOUR_SIGNED_HALVING),
+    {},
+    PARALLEL_KERNELS(FLAVOUR_UNSIGNED),
+    PARALLEL_KERNELS(FLAVOUR_UNSIGNED_SATURATING),
+    PARALLEL_KERNELS(FLAVOUR_UNSIGNED_HALVING),
+};
+
+#undef PARALLEL_KERNELS
+
+/**
+ * Clamps both signed halfwords of a value
+ * @param value Halfwords to clamp
+ * @param low Lowest value of the range
+ * @param high Highest value of the range
+ * @param saturated Set if a halfword was out of the range
+ * @return The clamped halfwords
+ */
+u32 Saturate16(u32 value, s32 low, s32 high, bool& saturated) {
+#ifdef MEDIA_HANDLERS_SSE2
+    const __m128i packed = _mm_cvtsi32_si128((int)value);
+    const __m128i clamped = _mm_max_epi16(_mm_min_epi16(packed, _mm_set1_epi16((s16)high)),
+        _mm_set1_epi16((s16)low));
+    if ((_mm_movemask_epi8(_mm_cmpeq_epi16(packed, clamped)) & 0xF) != 0xF) {
+        saturated = true;
+    }
+    return (u32)_mm_cvtsi128_si32(clamped);
+#else
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 16) {
+        const s32 half = (s16)(value >> shift);
+        const s32 clamped = CLAMP(half, low, high);
+        if (clamped != half) {
+            saturated = true;
+        }
+        result |= ((u32)clamped & 0xFFFF) << shift;
+    }
+    return result;
+#endif
+}
+
+/**
+ * Sets the GE flags
+ * @param state ARM core state
+ * @param ge GE flags in bits 0-3
+ */
+inline void SetGE(ARMul_State* state, u32 ge) {
+    state->Cpsr = (state->Cpsr & ~GEBITS) | (ge << 16);
+}
+
+/**
+ * Executes SXTB16, SXTAB16, UXTB16 or UXTAB16
+ * @param state ARM core state
+ * @param instr ARM instruction word
+ * @param is_signed Whether the bytes are sign extended
+ */
+void ExtendBytes16(ARMul_State* state, ARMword instr, bool is_signed) {
+    const u32 rotate = BITS(10, 11) * 8;
+    const u32 m = state->Reg[BITS(0, 3)];
+    const u32 rotated = rotate != 0 ? (m >> rotate) | (m << (32 - rotate)) : m;
+    u32 low = rotated & 0xFF;
+    u32 high = (rotated >> 16) & 0xFF;
+    if (is_signed) {
+        low = (u32)(s32)(s8)low;
+        high = (u32)(s32)(s8)high;
+    }
+    // Rn of 15 encodes the forms without the add
+    if (BITS(16, 19) != 15) {
+        const u32 n = state->Reg[BITS(16, 19)];
+        low += n;
+        high += n >> 16;
+    }
+    state->Reg[BITS(12, 15)] = (low & 0xFFFF) | (high << 16);
+}
+
+} // namespace
+
+/**
+ * Gets the kernel of a parallel add or subtract instruction
+ * @param flavour Flavour of the instruction, a ParallelFlavour
+ * @param op Operation of the instruction, a ParallelOp
+ * @return The kernel, nullptr if the encoding is undefined
+ */
+ParallelKernel GetParallelKernel(u32 flavour, u32 op) {
+    if (flavour >= NUM_PARALLEL_FLAVOURS || op >= NUM_PARALLEL_OPS) {
+        return nullptr;
+    }
+    return kParallelKernels[flavour][op];
+}
+
+/**
+ * Picks every byte from Rn or Rm by its GE flag, as SEL does
+ * @param n Value of Rn, the bytes whose GE flag is set
+ * @param m Value of Rm, the bytes whose GE flag is clear
+ * @param ge GE flags in bits 0-3
+ * @return Value of Rd
+ */
+u32 Select(u32 n, u32 m, u32 ge) {
+    // Spreads GE bit i to bit 8 * i, the shifted copies of the flags don't overlap
+    const u32 mask = (((ge & 0xF) * 0x00204081) & 0x01010101) * 0xFF;
+    return (n & mask) | (m & ~mask);
+}
+
+/**
+ * Sums the absolute differences of the bytes, as USAD8 does
+ * @param n Value of Rn
+ * @param m Value of Rm
+ * @return Sum of the four differences
+ */
+u32 SumOfAbsoluteDifferences(u32 n, u32 m) {
+#ifdef MEDIA_HANDLERS_SSE2
+    return (u32)_mm_cvtsi128_si32(_mm_sad_epu8(_mm_cvtsi32_si128((int)n),
+        _mm_cvtsi32_si128((int)m)));
+#else
+    u32 sum = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        const s32 difference = (s32)((n >> shift) & 0xFF) - (s32)((m >> shift) & 0xFF);
+        sum += difference < 0 ? -difference : difference;
+    }
+    return sum;
+#endif
+}
+
+/**
+ * Saturates a value to a signed range, as SSAT does
+ * @param value Value to saturate
+ * @param bits Width of the range, 1 to 32
+ * @param saturated Set if the value was out of the range, left alone otherwise
+ * @return The value clamped to [-2^(bits-1), 2^(bits-1)-1]
+ */
+u32 SignedSaturate(s32 value, u32 bits, bool& saturated) {
+    if (bits >= 32) {
+        return (u32)value;
+    }
+    const s32 high = (s32)((1u << (bits - 1)) - 1);
+    const s32 low = -high - 1;
+    if (value < low || value > high) {
+        saturated = true;
+        return (u32)(value < low ? low : high);
+    }
+    return (u32)value;
+}
+
+/**
+ * Saturates a value to an unsigned range, as USAT does
+ * @param value Value to saturate
+ * @param bits Width of the range, 0 to 31
+ * @param saturated Set if the value was out of the range, left alone otherwise
+ * @return The value clamped to [0, 2^bits-1]
+ */
+u32 UnsignedSaturate(s32 value, u32 bits, bool& saturated) {
+    const s32 high = (s32)((1u << bits) - 1);
+    if (value < 0 || value > high) {
+        saturated = true;
+        return (u32)(value < 0 ? 0 : high);
+    }
+    return (u32)value;
+}
+
+/**
+ * Saturates both halfwords to a signed range, as SSAT16 does
+ * @param value Halfwords to saturate
+ * @param bits Width of the range, 1 to 16
+ * @param saturated Set if a halfword was out of the range, left alone otherwise
+ * @return The halfwords clamped to [-2^(bits-1), 2^(bits-1)-1]
+ */
+u32 SignedSaturate16(u32 value, u32 bits, bool& saturated) {
+    const s32 high = (1 << (bits - 1)) - 1;
+    return Saturate16(value, -high - 1, high, saturated);
+}
+
+/**
+ * Saturates both signed halfwords to an unsigned range, as USAT16 does
+ * @param value Halfwords to saturate
+ * @param bits Width of the range, 0 to 15
+ * @param saturated Set if a halfword was out of the range, left alone otherwise
+ * @return The halfwords clamped to [0, 2^bits-1]
+ */
+u32 UnsignedSaturate16(u32 value, u32 bits, bool& saturated) {
+    return Saturate16(value, 0, (1 << bits) - 1, saturated);
+}
+
+/**
+ * Executes a media instruction, called by the interpreter for the ARMv6 encodings
+ * @param state ARM core state
+ * @param instr ARM instruction word, with the condition already checked
+ * @return False if the instruction isn't a media one or writes the PC
+ */
+bool Execute(ARMul_State* state, ARMword instr) {
+    // Every media encoding has bit 4 set, and Rd of USAD8 is where the others have Rn
+    const u32 rd = BITS(20, 27) == 0x78 ? BITS(16, 19) : BITS(12, 15);
+    if (!BIT(4) || rd == 15) {
+        return false;
+    }
+    const u32 n = state->Reg[BITS(16, 19)];
+    const u32 m = state->Reg[BITS(0, 3)];
+    bool saturated = false;
+
+    switch (BITS(20, 27)) {
+    case 0x61: case 0x62: case 0x63:
+    case 0x65: case 0x66: case 0x67:
+    {
+        ParallelKernel kernel = GetParallelKernel(BITS(20, 22), BITS(5, 7));
+        if (kernel == nullptr || BITS(8, 11) != 0xF) {
+            return false;
+        }
+        u32 ge;
+        state->Reg[rd] = kernel(n, m, ge);
+        if (BITS(20, 21) == MODE_MODULAR) {
+            SetGE(state, ge);
+        }
+        return true;
+    }
+
+    case 0x68:
+        if (BITS(4, 11) == 0xFB) {
+            state->Reg[rd] = Select(n, m, (state->Cpsr & GEBITS) >> 16);
+            return true;
+        }
+        if (BITS(4, 5) == 1) {
+            // PKHBT, or PKHTB where a shift of 0 encodes ASR #32
+            const u32 amount = BITS(7, 11);
+            if (BIT(6)) {
+                const u32 shifted = (u32)((s32)m >> (amount == 0 ? 31 : amount));
+                state->Reg[rd] = (n & 0xFFFF0000) | (shifted & 0xFFFF);
+            } else {
+                state->Reg[rd] = (n & 0xFFFF) | ((m << amount) & 0xFFFF0000);
+            }
+            return true;
+        }
+        if (BITS(4, 9) == 0x7) {
+            ExtendBytes16(state, instr, true);
+            return true;
+        }
+        return false;
+
+    case 0x6c:
+        if (BITS(4, 9) == 0x7) {
+            ExtendBytes16(state, instr, false);
+            return true;
+        }
+        return false;
+
+    case 0x6a:
+        if (BITS(4, 11) == 0xF3) {
+            state->Reg[rd] = SignedSaturate16(m, BITS(16, 19) + 1, saturated);
+            break;
+        }
+        // Fall through to SSAT, whose saturation width takes bit 20
+    case 0x6b:
+        if (BITS(4, 5) == 1) {
+            const u32 amount = BITS(7, 11);
+            const s32 operand = BIT(6) ? (s32)m >> (amount == 0 ? 31 : amount) :
+                (s32)(m << amount);
+            state->Reg[rd] = SignedSaturate(operand, BITS(16, 20) + 1, saturated);
+            break;
+        }
+        return false;
+
+    case 0x6e:
+        if (BITS(4, 11) == 0xF3) {
+            state->Reg[rd] = UnsignedSaturate16(m, BITS(16, 19), saturated);
+            break;
+        }
+        // Fall through to USAT
+    case 0x6f:
+        if (BITS(4, 5) == 1) {
+            const u32 amount = BITS(7, 11);
+            const s32 operand = BIT(6) ? (s32)m >> (amount == 0 ? 31 : amount) :
+                (s32)(m << amount);
+            state->Reg[rd] = UnsignedSaturate(operand, BITS(16, 20), saturated);
+            break;
+        }
+        return false;
+
+    case 0x78:
+        // USAD8, or USADA8 accumulating Ra unless it's 15
+        if (BITS(4, 7) == 1) {
+            u32 sum = SumOfAbsoluteDifferences(m, state->Reg[BITS(8, 11)]);
+            if (BITS(12, 15) != 15) {
+                sum += state->Reg[BITS(12, 15)];
+            }
+            state->Reg[rd] = sum;
+            return true;
+        }
+        return false;
+
+    default:
+        return false;
+    }
+
+    // The saturating instructions set Q, and never clear it
+    if (saturated) {
+        SETS;
+    }
+    return true;
+}
+
+} // namespace
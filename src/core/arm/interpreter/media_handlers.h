@@ -0,0 +1,120 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/arm/interpreter/armdefs.h"
+
+/**
+ * ARMv6 media instructions: the parallel add and subtract family (SADD16, UQSUB8, UHASX...), SEL,
+ * USAD8/USADA8, PKHBT/PKHTB, SXTB16/UXTB16 and SSAT/USAT with their 16-bit forms. The kernels work
+ * on register values and return the GE flags of all lanes at once, so they don't depend on the
+ * interpreter and the JIT can call them as they are. On SSE2 hosts the lanes are computed with
+ * packed integer instructions, elsewhere one at a time.
+ */
+namespace MediaHandlers {
+
+/// Parallel add and subtract operations (instruction bits 5-7)
+enum ParallelOp {
+    OP_ADD16,
+    OP_ASX,         ///< Adds the high halfwords, subtracts the low ones, the halves of Rm swapped
+    OP_SAX,         ///< Subtracts the high halfwords, adds the low ones, the halves of Rm swapped
+    OP_SUB16,
+    OP_ADD8,
+    OP_SUB8 = 7,
+    NUM_PARALLEL_OPS,
+};
+
+/// Flavours of the parallel add and subtract operations (instruction bits 20-22)
+enum ParallelFlavour {
+    FLAVOUR_SIGNED = 1,             ///< Modular, sets GE, e.g. SADD16
+    FLAVOUR_SIGNED_SATURATING,      ///< e.g. QADD16
+    FLAVOUR_SIGNED_HALVING,         ///< e.g. SHADD16
+    FLAVOUR_UNSIGNED = 5,           ///< Modular, sets GE, e.g. UADD16
+    FLAVOUR_UNSIGNED_SATURATING,    ///< e.g. UQADD16
+    FLAVOUR_UNSIGNED_HALVING,       ///< e.g. UHADD16
+    NUM_PARALLEL_FLAVOURS,
+};
+
+/**
+ * Kernel of a parallel add or subtract instruction
+ * @param n Value of Rn
+ * @param m Value of Rm
+ * @param ge Receives the GE flags in bits 0-3, only set by the modular flavours
+ * @return Value of Rd
+ */
+typedef u32 (*ParallelKernel)(u32 n, u32 m, u32& ge);
+
+/**
+ * Gets the kernel of a parallel add or subtract instruction
+ * @param flavour Flavour of the instruction, a ParallelFlavour
+ * @param op Operation of the instruction, a ParallelOp
+ * @return The kernel, nullptr if the encoding is undefined
+ */
+ParallelKernel GetParallelKernel(u32 flavour, u32 op);
+
+/**
+ * Picks every byte from Rn or Rm by its GE flag, as SEL does
+ * @param n Value of Rn, the bytes whose GE flag is set
+ * @param m Value of Rm, the bytes whose GE flag is clear
+ * @param ge GE flags in bits 0-3
+ * @return Value of Rd
+ */
+u32 Select(u32 n, u32 m, u32 ge);
+
+/**
+ * Sums the absolute differences of the bytes, as USAD8 does
+ * @param n Value of Rn
+ * @param m Value of Rm
+ * @return Sum of the four differences
+ */
+u32 SumOfAbsoluteDifferences(u32 n, u32 m);
+
+/**
+ * Saturates a value to a signed range, as SSAT does
+ * @param value Value to saturate
+ * @param bits Width of the range, 1 to 32
+ * @param saturated Set if the value was out of the range, left alone otherwise
+ * @return The value clamped to [-2^(bits-1), 2^(bits-1)-1]
+ */
+u32 SignedSaturate(s32 value, u32 bits, bool& saturated);
+
+/**
+ * Saturates a value to an unsigned range, as USAT does
+ * @param value Value to saturate
+ * @param bits Width of the range, 0 to 31
+ * @param saturated Set if the value was out of the range, left alone otherwise
+ * @return The value clamped to [0, 2^bits-1]
+ */
+u32 UnsignedSaturate(s32 value, u32 bits, bool& saturated);
+
+/**
+ * Saturates both halfwords to a signed range, as SSAT16 does
+ * @param value Halfwords to saturate
+ * @param bits Width of the range, 1 to 16
+ * @param saturated Set if a halfword was out of the range, left alone otherwise
+ * @return The halfwords clamped to [-2^(bits-1), 2^(bits-1)-1]
+ */
+u32 SignedSaturate16(u32 value, u32 bits, bool& saturated);
+
+/**
+ * Saturates both signed halfwords to an unsigned range, as USAT16 does
+ * @param value Halfwords to saturate
+ * @param bits Width of the range, 0 to 15
+ * @param saturated Set if a halfword was out of the range, left alone otherwise
+ * @return The halfwords clamped to [0, 2^bits-1]
+ */
+u32 UnsignedSaturate16(u32 value, u32 bits, bool& saturated);
+
+/**
+ * Executes a media instruction, called by the interpreter for the ARMv6 encodings
+ * @param state ARM core state
+ * @param instr ARM instruction word, with the condition already checked
+ * @return False if the instruction isn't a media one or writes the PC
+ */
+bool Execute(ARMul_State* state, ARMword instr);
+
+} // namespace
@@ -47,7 +47,7 @@ static inline void invalidate_by_asid(ARMul_State *state, ARMword asid){
 }
 
 static uint32_t get_phys_page(ARMul_State* state, ARMword va){
-    uint32_t phys_page = tlb_entry_array[va >> 12][state->mmu.context_id & 0xFF];
+    uint32_t phys_page = tlb_entry_array[va >> 12][state->cold->mmu.context_id & 0xFF];
     //printf("In %s, for va=0x%x, page=0x%x\n", __func__, va, phys_page);
     return phys_page;
 }
@@ -55,7 +55,7 @@ static uint32_t get_phys_page(ARMul_State* state, ARMword va){
 static inline void insert_tlb(ARMul_State* state, ARMword va, ARMword pa){
     //printf("In %s, insert va=0x%x, pa=0x%x\n", __FUNCTION__, va, pa);
     //printf("In %s, insert va=0x%x, va>>12=0x%x, pa=0x%x, pa>>12=0x%x\n", __FUNCTION__, va, va >> 12, pa, pa >> 12);
-    tlb_entry_array[va >> 12][state->mmu.context_id & 0xFF] = pa >> 12;
+    tlb_entry_array[va >> 12][state->cold->mmu.context_id & 0xFF] = pa >> 12;
 
     return;
 }
@@ -66,11 +66,11 @@ static void* mem_ptr = NULL;
 static int exclusive_detect(ARMul_State* state, ARMword addr){
     #if 0
     for(int i = 0; i < 128; i++){
-        if(state->exclusive_tag_array[i] == addr)
+        if(state->cold->exclusive_tag_array[i] == addr)
             return 0;
     }
     #endif
-    if(state->exclusive_tag_array[0] == addr)
+    if(state->cold->exclusive_tag_array[0] == addr)
         return 0;
     else
         return -1;
@@ -79,15 +79,15 @@ static int exclusive_detect(ARMul_State* state, ARMword addr){
 static void add_exclusive_addr(ARMul_State* state, ARMword addr){
     #if 0
     for(int i = 0; i < 128; i++){
-        if(state->exclusive_tag_array[i] == 0xffffffff){
-            state->exclusive_tag_array[i] = addr;
+        if(state->cold->exclusive_tag_array[i] == 0xffffffff){
+            state->cold->exclusive_tag_array[i] = addr;
             //printf("In %s, add  addr 0x%x\n", __func__, addr);
             return;
         }
     }
     printf("In %s ,can not monitor the addr, out of array\n", __FUNCTION__);
     #endif
-    state->exclusive_tag_array[0] = addr;
+    state->cold->exclusive_tag_array[0] = addr;
     return;
 }
 
@@ -95,14 +95,14 @@ static void remove_exclusive(ARMul_State* state, ARMword addr){
     #if 0
     int i;
     for(i = 0; i < 128; i++){
-        if(state->exclusive_tag_array[i] == addr){
-            state->exclusive_tag_array[i] = 0xffffffff;
+        if(state->cold->exclusive_tag_array[i] == addr){
+            state->cold->exclusive_tag_array[i] = 0xffffffff;
             //printf("In %s, remove  addr 0x%x\n", __func__, addr);
             return;
         }
     }
     #endif
-    state->exclusive_tag_array[0] = 0xFFFFFFFF;
+    state->cold->exclusive_tag_array[0] = 0xFFFFFFFF;
 }
 
 /* This function encodes table 8-2 Interpreting AP bits,
@@ -112,8 +112,8 @@ check_perms (ARMul_State *state, int ap, int read)
 {
     int s, r, user;
 
-    s = state->mmu.control & CONTROL_SYSTEM;
-    r = state->mmu.control & CONTROL_ROM;
+    s = state->cold->mmu.control & CONTROL_SYSTEM;
+    r = state->cold->mmu.control & CONTROL_ROM;
     /* chy 2006-02-15 , should consider system mode, don't conside 26bit mode */
 //    printf("ap is %x, user is %x, s is %x, read is %x\n", ap, user, s, read);
 //    printf("mode is %x\n", state->Mode);
@@ -139,8 +139,8 @@ check_access (ARMul_State *state, ARMword virt_addr, tlb_entry_t *tlb,
 {
     int access;
 
-    state->mmu.last_domain = tlb->domain;
-    access = (state->mmu.domain_access_control >> (tlb->domain * 2)) & 3;
+    state->cold->mmu.last_domain = tlb->domain;
+    access = (state->cold->mmu.domain_access_control >> (tlb->domain * 2)) & 3;
     if ((access == 0) || (access == 2)) {
         /* It's unclear from the documentation whether this
            should always raise a section domain fault, or if
@@ -221,12 +221,12 @@ mmu_translate (ARMul_State *state, ARMword virt_addr, ARMword *phys_addr, int *a
     {
         /* walk the translation tables */
         ARMword l1addr, l1desc;
-        if (state->mmu.translation_table_ctrl && virt_addr << state->mmu.translation_table_ctrl >> (32 - state->mmu.translation_table_ctrl - 1)) {
-            l1addr = state->mmu.translation_table_base1;
+        if (state->cold->mmu.translation_table_ctrl && virt_addr << state->cold->mmu.translation_table_ctrl >> (32 - state->cold->mmu.translation_table_ctrl - 1)) {
+            l1addr = state->cold->mmu.translation_table_base1;
             l1addr = (((l1addr >> 14) << 14) | (virt_addr >> 18)) & ~3;
         } else {
-            l1addr = state->mmu.translation_table_base0;
-            l1addr = (((l1addr >> (14 - state->mmu.translation_table_ctrl)) << (14 - state->mmu.translation_table_ctrl)) | (virt_addr << state->mmu.translation_table_ctrl) >> (18 + state->mmu.translation_table_ctrl)) & ~3;
+            l1addr = state->cold->mmu.translation_table_base0;
+            l1addr = (((l1addr >> (14 - state->cold->mmu.translation_table_ctrl)) << (14 - state->cold->mmu.translation_table_ctrl)) | (virt_addr << state->cold->mmu.translation_table_ctrl) >> (18 + state->cold->mmu.translation_table_ctrl)) & ~3;
         }
 
         /* l1desc = mem_read_word (state, l1addr); */
@@ -237,9 +237,9 @@ mmu_translate (ARMul_State *state, ARMword virt_addr, ARMword *phys_addr, int *a
 
         #if 0
         if (virt_addr == 0xc000d2bc) {
-                printf("mmu_control is %x\n", state->mmu.translation_table_ctrl);
-                printf("mmu_table_0 is %x\n", state->mmu.translation_table_base0);
-                printf("mmu_table_1 is %x\n", state->mmu.translation_table_base1);
+                printf("mmu_control is %x\n", state->cold->mmu.translation_table_ctrl);
+                printf("mmu_table_0 is %x\n", state->cold->mmu.translation_table_base0);
+                printf("mmu_table_1 is %x\n", state->cold->mmu.translation_table_base1);
                 printf("l1addr is %x l1desc is %x\n", l1addr, l1desc);
  //               exit(-1);
         }
@@ -295,9 +295,9 @@ mmu_translate (ARMul_State *state, ARMword virt_addr, ARMword *phys_addr, int *a
             *sop = 0;     /* section */
             #if 0
             if (virt_addr == 0xc000d2bc) {
-                    printf("mmu_control is %x\n", state->mmu.translation_table_ctrl);
-                    printf("mmu_table_0 is %x\n", state->mmu.translation_table_base0);
-                    printf("mmu_table_1 is %x\n", state->mmu.translation_table_base1);
+                    printf("mmu_control is %x\n", state->cold->mmu.translation_table_ctrl);
+                    printf("mmu_table_0 is %x\n", state->cold->mmu.translation_table_base0);
+                    printf("mmu_table_1 is %x\n", state->cold->mmu.translation_table_base1);
                     printf("l1addr is %x l1desc is %x\n", l1addr, l1desc);
 //                    printf("l2addr is %x l2desc is %x\n", l2addr, l2desc);
                     printf("ap is %x, sop is %x\n", *ap, *sop);
@@ -325,14 +325,14 @@ static fault_t arm1176jzf_s_mmu_read (ARMul_State *state, ARMword va,
 int
 arm1176jzf_s_mmu_init (ARMul_State *state)
 {
-    state->mmu.control = 0x50078;
-    state->mmu.translation_table_base = 0xDEADC0DE;
-    state->mmu.domain_access_control = 0xDEADC0DE;
-    state->mmu.fault_status = 0;
-    state->mmu.fault_address = 0;
-    state->mmu.process_id = 0;
-    state->mmu.context_id = 0;
-    state->mmu.thread_uro_id = 0;
+    state->cold->mmu.control = 0x50078;
+    state->cold->mmu.translation_table_base = 0xDEADC0DE;
+    state->cold->mmu.domain_access_control = 0xDEADC0DE;
+    state->cold->mmu.fault_status = 0;
+    state->cold->mmu.fault_address = 0;
+    state->cold->mmu.process_id = 0;
+    state->cold->mmu.context_id = 0;
+    state->cold->mmu.thread_uro_id = 0;
     //invalidate_all_tlb(state);
 
     return No_exp;
@@ -450,7 +450,7 @@ arm1176jzf_s_mmu_read (ARMul_State *state, ARMword va, ARMword *data,
     real_va = va;
     /* if MMU disabled, memory_read */
     if (MMU_Disabled) {
-//            printf("MMU disabled cpu_id:%x addr:%x.\n", state->mmu.process_id, va);
+//            printf("MMU disabled cpu_id:%x addr:%x.\n", state->cold->mmu.process_id, va);
 //            sleep(1);
 
         /* *data = mem_read_word(state, va); */
@@ -571,7 +571,7 @@ skip_translation:
         int rn = (state->CurrInstr & 0xF0000) >> 16;
         if(state->Reg[rn] == va){
             add_exclusive_addr(state, pa | (real_va & 3));
-            state->exclusive_access_state = 1;
+            state->cold->exclusive_access_state = 1;
         }
     }
 #if 0
@@ -730,10 +730,10 @@ skip_translation:
         ((state->CurrInstr & 0x0FF000F0) == 0x01c00090)){
         /* failed , the address is monitord now. */
         int dest_reg = (state->CurrInstr & 0xF000) >> 12;
-        if((exclusive_detect(state, pa | (real_va & 3)) == 0) && (state->exclusive_access_state == 1)){
+        if((exclusive_detect(state, pa | (real_va & 3)) == 0) && (state->cold->exclusive_access_state == 1)){
             remove_exclusive(state, pa | (real_va & 3));
             state->Reg[dest_reg] = 0;
-            state->exclusive_access_state = 0;
+            state->cold->exclusive_access_state = 0;
         }
         else{
             state->Reg[dest_reg] = 1;
@@ -778,8 +778,8 @@ skip_translation:
 finished_write:
 #if DIFF_WRITE
     if(state->icounter > state->debug_icounter){
-        if(state->CurrWrite >= 17 ){
-            printf("Wrong write array, 0x%x",  state->CurrWrite);
+        if(state->cold->CurrWrite >= 17 ){
+            printf("Wrong write array, 0x%x",  state->cold->CurrWrite);
             exit(-1);
         }
         uint32 record_data = data;
@@ -788,10 +788,10 @@ finished_write:
         if(datatype == ARM_HALFWORD_TYPE)
             record_data &= 0xFFFF;
 
-        state->WriteAddr[state->CurrWrite] = pa | (real_va & 3);
-        state->WriteData[state->CurrWrite] = record_data;
-        state->WritePc[state->CurrWrite] = state->Reg[15];
-        state->CurrWrite++;
+        state->cold->WriteAddr[state->cold->CurrWrite] = pa | (real_va & 3);
+        state->cold->WriteData[state->cold->CurrWrite] = record_data;
+        state->cold->WritePc[state->cold->CurrWrite] = state->Reg[15];
+        state->cold->CurrWrite++;
         //printf("In %s, pc=0x%x, addr=0x%x, data=0x%x, CFlag=%d\n", __FUNCTION__, state->Reg[15],  pa | (real_va & 3), record_data, state->CFlag);
     }
 #endif
@@ -824,21 +824,21 @@ arm1176jzf_s_mmu_mrc (ARMul_State *state, ARMword instr, ARMword *value)
          * 10           read as 0
          * 18,16    read as 1
          * */
-        data = (state->mmu.control | 0x50078) & 0xFFFFFBFF;
+        data = (state->cold->mmu.control | 0x50078) & 0xFFFFFBFF;
         break;
     case MMU_TRANSLATION_TABLE_BASE:
 #if 0
-        data = state->mmu.translation_table_base;
+        data = state->cold->mmu.translation_table_base;
 #endif
         switch (OPC_2) {
         case 0:
-            data = state->mmu.translation_table_base0;
+            data = state->cold->mmu.translation_table_base0;
             break;
         case 1:
-            data = state->mmu.translation_table_base1;
+            data = state->cold->mmu.translation_table_base1;
             break;
         case 2:
-            data = state->mmu.translation_table_ctrl;
+            data = state->cold->mmu.translation_table_ctrl;
             break;
         default:
             printf ("mmu_mrc read UNKNOWN - p15 c2 opcode2 %d\n", OPC_2);
@@ -846,27 +846,27 @@ arm1176jzf_s_mmu_mrc (ARMul_State *state, ARMword instr, ARMword *value)
         }
         break;
     case MMU_DOMAIN_ACCESS_CONTROL:
-        data = state->mmu.domain_access_control;
+        data = state->cold->mmu.domain_access_control;
         break;
     case MMU_FAULT_STATUS:
         /* OPC_2 = 0: data FSR value
          * */
         if (OPC_2 == 0)
-            data = state->mmu.fault_status;
+            data = state->cold->mmu.fault_status;
         if (OPC_2 == 1)
-            data = state->mmu.fault_statusi;
+            data = state->cold->mmu.fault_statusi;
         break;
     case MMU_FAULT_ADDRESS:
-        data = state->mmu.fault_address;
+        data = state->cold->mmu.fault_address;
         break;
     case MMU_PID:
-        //data = state->mmu.process_id;
+        //data = state->cold->mmu.process_id;
         if(OPC_2 == 0)
-            data = state->mmu.process_id;
+            data = state->cold->mmu.process_id;
         else if(OPC_2 == 1)
-            data = state->mmu.context_id;
+            data = state->cold->mmu.context_id;
         else if(OPC_2 == 3){
-            data = state->mmu.thread_uro_id;
+            data = state->cold->mmu.thread_uro_id;
         }
         else{
             printf ("mmu_mcr read UNKNOWN - reg %d\n", creg);
@@ -901,11 +901,11 @@ arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value)
          * 18,16    read as 1
          * */
             if(OPC_2 == 0)
-                state->mmu.control = (value | 0x50078) & 0xFFFFFBFF;
+                state->cold->mmu.control = (value | 0x50078) & 0xFFFFFBFF;
             else if(OPC_2 == 1)
-                state->mmu.auxiliary_control = value;
+                state->cold->mmu.auxiliary_control = value;
             else if(OPC_2 == 2)
-                state->mmu.coprocessor_access_control = value;
+                state->cold->mmu.coprocessor_access_control = value;
             else
                 fprintf(stderr, "In %s, wrong OPC_2 %d\n", __FUNCTION__, OPC_2);
             break;
@@ -915,26 +915,26 @@ arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value)
                 case 0:
 #if 0
                 /* TTBR0 */
-                    if (state->mmu.translation_table_ctrl & 0x7) {
-                        for (i = 0; i <= state->mmu.translation_table_ctrl; i++)
-                            state->mmu.translation_table_base0 &= ~(1 << (5 + i));
+                    if (state->cold->mmu.translation_table_ctrl & 0x7) {
+                        for (i = 0; i <= state->cold->mmu.translation_table_ctrl; i++)
+                            state->cold->mmu.translation_table_base0 &= ~(1 << (5 + i));
                     }
 #endif
-                    state->mmu.translation_table_base0 = (value);
+                    state->cold->mmu.translation_table_base0 = (value);
                     break;
                 case 1:
 #if 0
                 /* TTBR1 */
-                    if (state->mmu.translation_table_ctrl & 0x7) {
-                        for (i = 0; i <= state->mmu.translation_table_ctrl; i++)
-                            state->mmu.translation_table_base1 &= 1 << (5 + i);
+                    if (state->cold->mmu.translation_table_ctrl & 0x7) {
+                        for (i = 0; i <= state->cold->mmu.translation_table_ctrl; i++)
+                            state->cold->mmu.translation_table_base1 &= 1 << (5 + i);
                     }
 #endif
-                    state->mmu.translation_table_base1 = (value);
+                    state->cold->mmu.translation_table_base1 = (value);
                     break;
                 case 2:
                 /* TTBC */
-                    state->mmu.translation_table_ctrl = value & 0x7;
+                    state->cold->mmu.translation_table_ctrl = value & 0x7;
                     break;
                 default:
                     printf ("mmu_mcr wrote UNKNOWN - cp15 c2 opcode2 %d\n", OPC_2);
@@ -945,18 +945,18 @@ arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value)
             break;
         case MMU_DOMAIN_ACCESS_CONTROL:
         /* printf("mmu_mcr wrote DACR         "); */
-            state->mmu.domain_access_control = value;
+            state->cold->mmu.domain_access_control = value;
             break;
 
         case MMU_FAULT_STATUS:
             if (OPC_2 == 0)
-                state->mmu.fault_status = value & 0xFF;
+                state->cold->mmu.fault_status = value & 0xFF;
             if (OPC_2 == 1) {
                 printf("set fault status instr\n");
             }
             break;
         case MMU_FAULT_ADDRESS:
-            state->mmu.fault_address = value;
+            state->cold->mmu.fault_address = value;
             break;
 
         case MMU_CACHE_OPS:
@@ -1036,15 +1036,15 @@ arm1176jzf_s_mmu_mcr (ARMul_State *state, ARMword instr, ARMword value)
             break;
         case MMU_PID:
             //printf("SKYEYE In %s, write pid 0x%x OPC_2=%d instr=0x%x\n", __FUNCTION__, value, OPC_2, instr);
-            //state->mmu.process_id = value;
+            //state->cold->mmu.process_id = value;
             /*0:24 should be zero. */
-            //state->mmu.process_id = value & 0xfe000000;
+            //state->cold->mmu.process_id = value & 0xfe000000;
             if(OPC_2 == 0)
-                state->mmu.process_id = value;
+                state->cold->mmu.process_id = value;
             else if(OPC_2 == 1)
-                state->mmu.context_id = value;
+                state->cold->mmu.context_id = value;
             else if(OPC_2 == 3){
-                state->mmu.thread_uro_id = value;
+                state->cold->mmu.thread_uro_id = value;
             }
             else{
                 printf ("mmu_mcr wrote UNKNOWN - reg %d\n", creg);
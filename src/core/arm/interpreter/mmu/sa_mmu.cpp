@@ -81,12 +81,12 @@ sa_mmu_init (ARMul_State * state)
 	sa_mmu_desc_t *desc;
 	cache_desc_t *c_desc;
 
-	state->mmu.control = 0x70;
-	state->mmu.translation_table_base = 0xDEADC0DE;
-	state->mmu.domain_access_control = 0xDEADC0DE;
-	state->mmu.fault_status = 0;
-	state->mmu.fault_address = 0;
-	state->mmu.process_id = 0;
+	state->cold->mmu.control = 0x70;
+	state->cold->mmu.translation_table_base = 0xDEADC0DE;
+	state->cold->mmu.domain_access_control = 0xDEADC0DE;
+	state->cold->mmu.fault_status = 0;
+	state->cold->mmu.fault_address = 0;
+	state->cold->mmu.process_id = 0;
 
 	desc = &sa11xx_mmu_desc;
 	if (mmu_tlb_init (I_TLB (), desc->i_tlb)) {
@@ -609,26 +609,26 @@ sa_mmu_mrc (ARMul_State * state, ARMword instr, ARMword * value)
 		break;
 	case MMU_CONTROL:
 //              printf("mmu_mrc read CONTROL");
-		data = state->mmu.control;
+		data = state->cold->mmu.control;
 		break;
 	case MMU_TRANSLATION_TABLE_BASE:
 //              printf("mmu_mrc read TTB    ");
-		data = state->mmu.translation_table_base;
+		data = state->cold->mmu.translation_table_base;
 		break;
 	case MMU_DOMAIN_ACCESS_CONTROL:
 //              printf("mmu_mrc read DACR   ");
-		data = state->mmu.domain_access_control;
+		data = state->cold->mmu.domain_access_control;
 		break;
 	case MMU_FAULT_STATUS:
 //              printf("mmu_mrc read FSR    ");
-		data = state->mmu.fault_status;
+		data = state->cold->mmu.fault_status;
 		break;
 	case MMU_FAULT_ADDRESS:
 //              printf("mmu_mrc read FAR    ");
-		data = state->mmu.fault_address;
+		data = state->cold->mmu.fault_address;
 		break;
 	case MMU_PID:
-		data = state->mmu.process_id;
+		data = state->cold->mmu.process_id;
 	default:
 		printf ("mmu_mrc read UNKNOWN - reg %d\n", creg);
 		data = 0;
@@ -755,23 +755,23 @@ sa_mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 		switch (creg) {
 		case MMU_CONTROL:
 //              printf("mmu_mcr wrote CONTROL      ");
-			state->mmu.control = (value | 0x70) & 0xFFFD;
+			state->cold->mmu.control = (value | 0x70) & 0xFFFD;
 			break;
 		case MMU_TRANSLATION_TABLE_BASE:
 //              printf("mmu_mcr wrote TTB          ");
-			state->mmu.translation_table_base =
+			state->cold->mmu.translation_table_base =
 				value & 0xFFFFC000;
 			break;
 		case MMU_DOMAIN_ACCESS_CONTROL:
 //              printf("mmu_mcr wrote DACR         ");
-			state->mmu.domain_access_control = value;
+			state->cold->mmu.domain_access_control = value;
 			break;
 
 		case MMU_FAULT_STATUS:
-			state->mmu.fault_status = value & 0xFF;
+			state->cold->mmu.fault_status = value & 0xFF;
 			break;
 		case MMU_FAULT_ADDRESS:
-			state->mmu.fault_address = value;
+			state->cold->mmu.fault_address = value;
 			break;
 
 		case MMU_CACHE_OPS:
@@ -789,7 +789,7 @@ sa_mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 			break;
 		case MMU_PID:
 			//2004-06-06 lyh, bug provided by wen ye wenye@cs.ucsb.edu
-			state->mmu.process_id = value & 0x7e000000;
+			state->cold->mmu.process_id = value & 0x7e000000;
 			break;
 
 		default:
@@ -45,14 +45,14 @@ typedef struct sa_mmu_s
 	wb_s wb_t;
 } sa_mmu_t;
 
-#define I_TLB() (&state->mmu.u.sa_mmu.i_tlb)
-#define I_CACHE() (&state->mmu.u.sa_mmu.i_cache)
-
-#define D_TLB() (&state->mmu.u.sa_mmu.d_tlb)
-#define MAIN_D_CACHE() (&state->mmu.u.sa_mmu.main_d_cache)
-#define MINI_D_CACHE() (&state->mmu.u.sa_mmu.mini_d_cache)
-#define WB() (&state->mmu.u.sa_mmu.wb_t)
-#define RB() (&state->mmu.u.sa_mmu.rb_t)
+#define I_TLB() (&state->cold->mmu.u.sa_mmu.i_tlb)
+#define I_CACHE() (&state->cold->mmu.u.sa_mmu.i_cache)
+
+#define D_TLB() (&state->cold->mmu.u.sa_mmu.d_tlb)
+#define MAIN_D_CACHE() (&state->cold->mmu.u.sa_mmu.main_d_cache)
+#define MINI_D_CACHE() (&state->cold->mmu.u.sa_mmu.mini_d_cache)
+#define WB() (&state->cold->mmu.u.sa_mmu.wb_t)
+#define RB() (&state->cold->mmu.u.sa_mmu.rb_t)
 
 extern mmu_ops_t sa_mmu_ops;
 #endif /*_SA_MMU_H_*/
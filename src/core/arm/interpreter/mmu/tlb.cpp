@@ -18,8 +18,8 @@ check_perms (ARMul_State * state, int ap, int read)
 {
 	int s, r, user;
 
-	s = state->mmu.control & CONTROL_SYSTEM;
-	r = state->mmu.control & CONTROL_ROM;
+	s = state->cold->mmu.control & CONTROL_SYSTEM;
+	r = state->cold->mmu.control & CONTROL_ROM;
 	//chy 2006-02-15 , should consider system mode, don't conside 26bit mode
 	user = (state->Mode == USER32MODE) || (state->Mode == USER26MODE) || (state->Mode == SYSTEM32MODE);
 
@@ -42,8 +42,8 @@ check_access (ARMul_State * state, ARMword virt_addr, tlb_entry_t * tlb,
 {
 	int access;
 
-	state->mmu.last_domain = tlb->domain;
-	access = (state->mmu.domain_access_control >> (tlb->domain * 2)) & 3;
+	state->cold->mmu.last_domain = tlb->domain;
+	access = (state->cold->mmu.domain_access_control >> (tlb->domain * 2)) & 3;
 	if ((access == 0) || (access == 2)) {
 		/* It's unclear from the documentation whether this
 		   should always raise a section domain fault, or if
@@ -120,7 +120,7 @@ translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 		ARMword l1addr, l1desc;
 		tlb_entry_t entry;
 
-		l1addr = state->mmu.translation_table_base & 0xFFFFC000;
+		l1addr = state->cold->mmu.translation_table_base & 0xFFFFC000;
 		l1addr = (l1addr | (virt_addr >> 18)) & ~3;
 		//l1desc = mem_read_word (state, l1addr);
 		bus_read(32, l1addr, &l1desc);
@@ -152,7 +152,7 @@ translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 				entry.domain = (l1desc >> 5) & 0x0000000F;
 				switch (l2desc & 3) {
 				case 0:
-					state->mmu.last_domain = entry.domain;
+					state->cold->mmu.last_domain = entry.domain;
 					return PAGE_TRANSLATION_FAULT;
 				case 3:
 					entry.mapping = TLB_TINYPAGE;
@@ -188,11 +188,11 @@ translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 				//chy 2003-09-02 for xscale
 				switch (l2desc & 3) {
 				case 0:
-					state->mmu.last_domain = entry.domain;
+					state->cold->mmu.last_domain = entry.domain;
 					return PAGE_TRANSLATION_FAULT;
 				case 3:
 					if (!state->is_XScale) {
-						state->mmu.last_domain =
+						state->cold->mmu.last_domain =
 							entry.domain;
 						return PAGE_TRANSLATION_FAULT;
 					};
@@ -231,7 +231,7 @@ translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 		tlb_t->cycle = (tlb_t->cycle + 1) % tlb_t->num;
 		**tlb = entry;
 	}
-	state->mmu.last_domain = (*tlb)->domain;
+	state->cold->mmu.last_domain = (*tlb)->domain;
 	return NO_FAULT;
 }
 
@@ -367,7 +367,7 @@ unsigned xscale_cp15_read_reg (ARMul_State * state, unsigned reg,
 {
 //chy 2003-09-03: for xsacle_cp15_cp_access_allowed
 	if (reg == 15) {
-		*data = state->mmu.copro_access;
+		*data = state->cold->mmu.copro_access;
 		//printf("SKYEYE: xscale_cp15_read_reg: reg 0x%x,data %x\n",reg,*data);
 		return 0;
 	}
@@ -398,11 +398,11 @@ unsigned xscale_cp15_write_reg (ARMul_State * state, unsigned reg,
 	switch (reg) {
 	case MMU_FAULT_STATUS:
 		//printf("SKYEYE:cp15_write_reg  wrote FS        val 0x%x \n",value);
-		state->mmu.fault_status = value & 0x6FF;
+		state->cold->mmu.fault_status = value & 0x6FF;
 		break;
 	case MMU_FAULT_ADDRESS:
 		//printf("SKYEYE:cp15_write_reg wrote FA         val 0x%x \n",value);
-		state->mmu.fault_address = value;
+		state->cold->mmu.fault_address = value;
 		break;
 	default:
 		printf ("SKYEYE: xscale_cp15_write_reg: reg 0x%x R15 %x ERROR isn't existed\n", reg, state->Reg[15]);
@@ -418,14 +418,14 @@ xscale_cp15_init (ARMul_State * state)
 	xscale_mmu_desc_t *desc;
 	cache_desc_t *c_desc;
 
-	state->mmu.control = 0;
-	state->mmu.translation_table_base = 0xDEADC0DE;
-	state->mmu.domain_access_control = 0xDEADC0DE;
-	state->mmu.fault_status = 0;
-	state->mmu.fault_address = 0;
-	state->mmu.process_id = 0;
-	state->mmu.cache_type = 0xB1AA1AA;	//0000 1011 0001 1010 1010 0001 1010 1010
-	state->mmu.aux_control = 0;
+	state->cold->mmu.control = 0;
+	state->cold->mmu.translation_table_base = 0xDEADC0DE;
+	state->cold->mmu.domain_access_control = 0xDEADC0DE;
+	state->cold->mmu.fault_status = 0;
+	state->cold->mmu.fault_address = 0;
+	state->cold->mmu.process_id = 0;
+	state->cold->mmu.cache_type = 0xB1AA1AA;	//0000 1011 0001 1010 1010 0001 1010 1010
+	state->cold->mmu.aux_control = 0;
 
 	desc = &pxa_mmu_desc;
 
@@ -1115,36 +1115,36 @@ ARMword xscale_mmu_mrc (ARMul_State * state, ARMword instr, ARMword * value)
 	switch (creg) {
 	case MMU_ID:		//XSCALE_CP15
 		//printf("mmu_mrc read ID       \n");
-		data = (opcode_2 ? state->mmu.cache_type : state->cpu->
+		data = (opcode_2 ? state->cold->mmu.cache_type : state->cpu->
 			cpu_val);
 		break;
 	case MMU_CONTROL:	//XSCALE_CP15_AUX_CONTROL
 		//printf("mmu_mrc read CONTROL  \n");
-		data = (opcode_2 ? state->mmu.aux_control : state->mmu.
+		data = (opcode_2 ? state->cold->mmu.aux_control : state->cold->mmu.
 			control);
 		break;
 	case MMU_TRANSLATION_TABLE_BASE:
 		//printf("mmu_mrc read TTB      \n");
-		data = state->mmu.translation_table_base;
+		data = state->cold->mmu.translation_table_base;
 		break;
 	case MMU_DOMAIN_ACCESS_CONTROL:
 		//printf("mmu_mrc read DACR     \n");
-		data = state->mmu.domain_access_control;
+		data = state->cold->mmu.domain_access_control;
 		break;
 	case MMU_FAULT_STATUS:
 		//printf("mmu_mrc read FSR      \n");
-		data = state->mmu.fault_status;
+		data = state->cold->mmu.fault_status;
 		break;
 	case MMU_FAULT_ADDRESS:
 		//printf("mmu_mrc read FAR      \n");
-		data = state->mmu.fault_address;
+		data = state->cold->mmu.fault_address;
 		break;
 	case MMU_PID:
 		//printf("mmu_mrc read PID      \n");
-		data = state->mmu.process_id;
+		data = state->cold->mmu.process_id;
 	case XSCALE_CP15_COPRO_ACCESS:
 		//printf("xscale cp15 read coprocessor access\n");
-		data = state->mmu.copro_access;
+		data = state->cold->mmu.copro_access;
 		break;
 	default:
 		data = 0;
@@ -1283,25 +1283,25 @@ ARMword xscale_mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 	switch (creg) {
 	case MMU_CONTROL:
 		//printf("mmu_mcr wrote CONTROL  val 0x%x       \n",value);
-		state->mmu.control =
+		state->cold->mmu.control =
 			(opcode_2 ? (value & 0x33) : (value & 0x3FFF));
 		break;
 	case MMU_TRANSLATION_TABLE_BASE:
 		//printf("mmu_mcr wrote TTB      val 0x%x       \n",value);
-		state->mmu.translation_table_base = value & 0xFFFFC000;
+		state->cold->mmu.translation_table_base = value & 0xFFFFC000;
 		break;
 	case MMU_DOMAIN_ACCESS_CONTROL:
 		//printf("mmu_mcr wrote DACR    val 0x%x \n",value);
-		state->mmu.domain_access_control = value;
+		state->cold->mmu.domain_access_control = value;
 		break;
 
 	case MMU_FAULT_STATUS:
 		//printf("mmu_mcr wrote FS        val 0x%x \n",value);
-		state->mmu.fault_status = value & 0x6FF;
+		state->cold->mmu.fault_status = value & 0x6FF;
 		break;
 	case MMU_FAULT_ADDRESS:
 		//printf("mmu_mcr wrote FA         val 0x%x \n",value);
-		state->mmu.fault_address = value;
+		state->cold->mmu.fault_address = value;
 		break;
 
 	case MMU_CACHE_OPS:
@@ -1314,11 +1314,11 @@ ARMword xscale_mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 		break;
 	case MMU_PID:
 		//printf("mmu_mcr wrote PID          val 0x%x \n",value);
-		state->mmu.process_id = value & 0xfe000000;
+		state->cold->mmu.process_id = value & 0xfe000000;
 		break;
 	case XSCALE_CP15_COPRO_ACCESS:
 		//printf("xscale cp15 write coprocessor access  val 0x %x\n",value);
-		state->mmu.copro_access = value & 0x3ff;
+		state->cold->mmu.copro_access = value & 0x3ff;
 		break;
 
 	default:
@@ -0,0 +1,535 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "core/arm/interpreter/armemu.h"
+#include "core/arm/interpreter/thumb_handlers.h"
+
+namespace ThumbHandlers {
+
+Handler g_handlers[NUM_HANDLERS];
+
+namespace {
+
+/// Format 3 opcodes (instruction bits 11-12)
+enum ImmediateOpcode {
+    IMM_MOV, IMM_CMP, IMM_ADD, IMM_SUB,
+};
+
+/// Format 4 opcodes (instruction bits 6-9)
+enum ALUOpcode {
+    ALU_AND, ALU_EOR, ALU_LSL, ALU_LSR, ALU_ASR, ALU_ADC, ALU_SBC, ALU_ROR,
+    ALU_TST, ALU_NEG, ALU_CMP, ALU_CMN, ALU_ORR, ALU_MUL, ALU_BIC, ALU_MVN,
+};
+
+/// Format 5 opcodes (instruction bits 8-9) that don't branch
+enum HighOpcode {
+    HIGH_ADD, HIGH_CMP, HIGH_MOV,
+};
+
+/**
+ * Sets the flags of an addition
+ * @param state ARM core state
+ * @param a First operand
+ * @param b Second operand
+ * @param result Result of the addition
+ */
+inline void SetAddFlags(ARMul_State* state, ARMword a, ARMword b, ARMword result) {
+    ARMul_NegZero(state, result);
+    ARMul_AddCarry(state, a, b, result);
+    ARMul_AddOverflow(state, a, b, result);
+}
+
+/**
+ * Sets the flags of a subtraction
+ * @param state ARM core state
+ * @param a Operand subtracted from
+ * @param b Operand subtracted
+ * @param result Result of the subtraction
+ */
+inline void SetSubFlags(ARMul_State* state, ARMword a, ARMword b, ARMword result) {
+    ARMul_NegZero(state, result);
+    ARMul_SubCarry(state, a, b, result);
+    ARMul_SubOverflow(state, a, b, result);
+}
+
+/**
+ * Format 1: LSL/LSR/ASR Rd, Rs, #imm5
+ * @tparam type Shift type
+ */
+template <u32 type>
+bool ShiftImmediate(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword base = state->Reg[(tinstr >> 3) & 7];
+    // An amount of 0 encodes LSR #32 and ASR #32
+    const u32 amount = (tinstr >> 6) & 0x1F;
+    ARMword result;
+
+    switch (type) {
+    case LSL:
+        if (amount != 0) {
+            ASSIGNC((base >> (32 - amount)) & 1);
+        }
+        result = base << amount;
+        break;
+    case LSR:
+        if (amount == 0) {
+            ASSIGNC(base >> 31);
+            result = 0;
+        } else {
+            ASSIGNC((base >> (amount - 1)) & 1);
+            result = base >> amount;
+        }
+        break;
+    default: // ASR
+        if (amount == 0) {
+            ASSIGNC(base >> 31);
+            result = (ARMword)((s32)base >> 31);
+        } else {
+            ASSIGNC(((s32)base >> (amount - 1)) & 1);
+            result = (ARMword)((s32)base >> amount);
+        }
+        break;
+    }
+    ARMul_NegZero(state, result);
+    state->Reg[tinstr & 7] = result;
+    return true;
+}
+
+/**
+ * Format 2: ADD/SUB Rd, Rs, Rn and ADD/SUB Rd, Rs, #imm3
+ * @tparam immediate Whether the second operand is an immediate
+ * @tparam subtract Whether it's a subtraction
+ */
+template <bool immediate, bool subtract>
+bool AddSubtract(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword lhs = state->Reg[(tinstr >> 3) & 7];
+    const ARMword rhs = immediate ? (tinstr >> 6) & 7 : state->Reg[(tinstr >> 6) & 7];
+    const ARMword result = subtract ? lhs - rhs : lhs + rhs;
+
+    if (subtract) {
+        SetSubFlags(state, lhs, rhs, result);
+    } else {
+        SetAddFlags(state, lhs, rhs, result);
+    }
+    state->Reg[tinstr & 7] = result;
+    return true;
+}
+
+/**
+ * Format 3: MOV/CMP/ADD/SUB Rd, #imm8
+ * @tparam opcode Operation
+ */
+template <u32 opcode>
+bool Immediate(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const u32 rd = (tinstr >> 8) & 7;
+    const ARMword lhs = state->Reg[rd];
+    const ARMword rhs = tinstr & 0xFF;
+
+    switch (opcode) {
+    case IMM_MOV:
+        ARMul_NegZero(state, rhs);
+        state->Reg[rd] = rhs;
+        break;
+    case IMM_CMP:
+        SetSubFlags(state, lhs, rhs, lhs - rhs);
+        break;
+    case IMM_ADD:
+        SetAddFlags(state, lhs, rhs, lhs + rhs);
+        state->Reg[rd] = lhs + rhs;
+        break;
+    default: // IMM_SUB
+        SetSubFlags(state, lhs, rhs, lhs - rhs);
+        state->Reg[rd] = lhs - rhs;
+        break;
+    }
+    return true;
+}
+
+/**
+ * Shifts a register by the bottom byte of another, as the register shifts of format 4 do
+ * @param state ARM core state
+ * @param base Value to shift
+ * @param amount Shift amount, 0 to 255
+ * @tparam type Shift type
+ * @return The shifted value, the C flag is set from the last bit shifted out
+ */
+template <u32 type>
+inline ARMword ShiftRegister(ARMul_State* state, ARMword base, u32 amount) {
+    if (amount == 0) {
+        return base;
+    }
+    switch (type) {
+    case LSL:
+        if (amount >= 32) {
+            ASSIGNC(amount == 32 ? base & 1 : 0);
+            return 0;
+        }
+        ASSIGNC((base >> (32 - amount)) & 1);
+        return base << amount;
+    case LSR:
+        if (amount >= 32) {
+            ASSIGNC(amount == 32 ? base >> 31 : 0);
+            return 0;
+        }
+        ASSIGNC((base >> (amount - 1)) & 1);
+        return base >> amount;
+    case ASR:
+        if (amount >= 32) {
+            ASSIGNC(base >> 31);
+            return (ARMword)((s32)base >> 31);
+        }
+        ASSIGNC(((s32)base >> (amount - 1)) & 1);
+        return (ARMword)((s32)base >> amount);
+    default: // ROR
+        {
+            const u32 rotate = amount & 0x1F;
+            if (rotate == 0) {
+                ASSIGNC(base >> 31);
+                return base;
+            }
+            ASSIGNC((base >> (rotate - 1)) & 1);
+            return (base << (32 - rotate)) | (base >> rotate);
+        }
+    }
+}
+
+/**
+ * Format 4: ALU operations on two low registers, which all set the flags
+ * @tparam opcode Operation, anything but MUL
+ */
+template <u32 opcode>
+bool ALU(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const u32 rd = tinstr & 7;
+    const ARMword lhs = state->Reg[rd];
+    const ARMword rhs = state->Reg[(tinstr >> 3) & 7];
+    ARMword result;
+
+    switch (opcode) {
+    case ALU_LSL: case ALU_LSR: case ALU_ASR: case ALU_ROR:
+        // Register shifts take an extra cycle, during which the PC moves on
+        INCPC;
+        ARMul_Icycles(state, 1, 0L);
+        break;
+    }
+
+    switch (opcode) {
+    case ALU_AND: case ALU_TST: result = lhs & rhs;                                 break;
+    case ALU_EOR:               result = lhs ^ rhs;                                 break;
+    case ALU_LSL:               result = ShiftRegister<LSL>(state, lhs, rhs & 0xFF); break;
+    case ALU_LSR:               result = ShiftRegister<LSR>(state, lhs, rhs & 0xFF); break;
+    case ALU_ASR:               result = ShiftRegister<ASR>(state, lhs, rhs & 0xFF); break;
+    case ALU_ROR:               result = ShiftRegister<ROR>(state, lhs, rhs & 0xFF); break;
+    case ALU_ADC:               result = lhs + rhs + CFLAG;                         break;
+    case ALU_SBC:               result = lhs - rhs - !CFLAG;                        break;
+    case ALU_NEG:               result = 0 - rhs;                                   break;
+    case ALU_CMP:               result = lhs - rhs;                                 break;
+    case ALU_CMN:               result = lhs + rhs;                                 break;
+    case ALU_ORR:               result = lhs | rhs;                                 break;
+    case ALU_BIC:               result = lhs & ~rhs;                                break;
+    default:                    result = ~rhs;                                      break;
+    }
+
+    switch (opcode) {
+    case ALU_ADC: case ALU_CMN:
+        SetAddFlags(state, lhs, rhs, result);
+        break;
+    case ALU_SBC: case ALU_CMP:
+        SetSubFlags(state, lhs, rhs, result);
+        break;
+    case ALU_NEG:
+        SetSubFlags(state, 0, rhs, result);
+        break;
+    default:
+        ARMul_NegZero(state, result);
+        break;
+    }
+    if (opcode != ALU_TST && opcode != ALU_CMP && opcode != ALU_CMN) {
+        state->Reg[rd] = result;
+    }
+    return true;
+}
+
+/**
+ * Format 5: ADD/CMP/MOV with a high register, unless it's the PC
+ * @tparam opcode Operation
+ */
+template <u32 opcode>
+bool HighRegister(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const u32 rd = (tinstr & 7) | ((tinstr >> 4) & 8);
+    const u32 rs = (tinstr >> 3) & 0xF;
+    if (rd == 15 || rs == 15) {
+        return false;
+    }
+
+    const ARMword lhs = state->Reg[rd];
+    const ARMword rhs = state->Reg[rs];
+    switch (opcode) {
+    case HIGH_ADD:
+        state->Reg[rd] = lhs + rhs;
+        break;
+    case HIGH_CMP:
+        SetSubFlags(state, lhs, rhs, lhs - rhs);
+        break;
+    default: // HIGH_MOV
+        state->Reg[rd] = rhs;
+        break;
+    }
+    return true;
+}
+
+/**
+ * Transfers a register to or from memory, as the generic LDR and STR paths do
+ * @param state ARM core state
+ * @param rd Register transferred
+ * @param address Guest address of the transfer
+ * @tparam size Size of the transfer in bytes
+ * @tparam load Whether it's a load
+ * @tparam sign_extend Whether a load of a byte or halfword is sign extended
+ */
+template <u32 size, bool load, bool sign_extend>
+inline void Transfer(ARMul_State* state, u32 rd, ARMword address) {
+    if (!load) {
+        BUSUSEDINCPCN;
+        switch (size) {
+        case 4: ARMul_StoreWordN(state, address, state->Reg[rd]);   break;
+        case 2: ARMul_StoreHalfWord(state, address, state->Reg[rd]); break;
+        default: ARMul_StoreByte(state, address, state->Reg[rd]);   break;
+        }
+        if (state->Aborted) {
+            TAKEABORT;
+        }
+        return;
+    }
+
+    BUSUSEDINCPCS;
+    ARMword value;
+    switch (size) {
+    case 4: value = ARMul_LoadWordN(state, address);    break;
+    case 2: value = ARMul_LoadHalfWord(state, address); break;
+    default: value = ARMul_LoadByte(state, address);    break;
+    }
+    if (state->Aborted) {
+        TAKEABORT;
+        return;
+    }
+    if (size == 4 && (address & 3)) {
+        value = ARMul_Align(state, address, value);
+    }
+    if (sign_extend && size == 2) {
+        value = (ARMword)(s32)(s16)value;
+    } else if (sign_extend && size == 1) {
+        value = (ARMword)(s32)(s8)value;
+    }
+    state->Reg[rd] = value;
+    ARMul_Icycles(state, 1, 0L);
+}
+
+/// Format 6: LDR Rd, [PC, #imm8], relative to the word aligned PC
+bool LoadPCRelative(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword base = state->Reg[15] & 0xFFFFFFFC;
+    Transfer<4, true, false>(state, (tinstr >> 8) & 7, base + ((tinstr & 0xFF) << 2));
+    return true;
+}
+
+/**
+ * Formats 7 and 8: loads and stores at [Rb, Ro]
+ * @tparam size Size of the transfer in bytes
+ * @tparam load Whether it's a load
+ * @tparam sign_extend Whether a load is sign extended
+ */
+template <u32 size, bool load, bool sign_extend>
+bool RegisterOffset(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword address = state->Reg[(tinstr >> 3) & 7] + state->Reg[(tinstr >> 6) & 7];
+    Transfer<size, load, sign_extend>(state, tinstr & 7, address);
+    return true;
+}
+
+/**
+ * Formats 9 and 10: loads and stores at [Rb, #imm5], the offset scaled by the size
+ * @tparam size Size of the transfer in bytes
+ * @tparam load Whether it's a load
+ */
+template <u32 size, bool load>
+bool ImmediateOffset(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword address = state->Reg[(tinstr >> 3) & 7] + ((tinstr >> 6) & 0x1F) * size;
+    Transfer<size, load, false>(state, tinstr & 7, address);
+    return true;
+}
+
+/**
+ * Format 11: LDR/STR Rd, [SP, #imm8]
+ * @tparam load Whether it's a load
+ */
+template <bool load>
+bool SPRelative(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    Transfer<4, load, false>(state, (tinstr >> 8) & 7, state->Reg[13] + ((tinstr & 0xFF) << 2));
+    return true;
+}
+
+/**
+ * Format 12: ADD Rd, PC/SP, #imm8, relative to the word aligned PC
+ * @tparam sp Whether the base is SP
+ */
+template <bool sp>
+bool LoadAddress(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword base = sp ? state->Reg[13] : state->Reg[15] & 0xFFFFFFFC;
+    state->Reg[(tinstr >> 8) & 7] = base + ((tinstr & 0xFF) << 2);
+    return true;
+}
+
+/**
+ * Format 13: ADD/SUB SP, #imm7
+ * @tparam subtract Whether it's a subtraction
+ */
+template <bool subtract>
+bool AdjustSP(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword offset = (tinstr & 0x7F) << 2;
+    state->Reg[13] = subtract ? state->Reg[13] - offset : state->Reg[13] + offset;
+    return true;
+}
+
+/// Format 16: conditional branch
+bool ConditionalBranch(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    if (ARMul_ConditionPassed(state, (tinstr >> 8) & 0xF)) {
+        state->Reg[15] = pc + 4 + ((ARMword)(s32)(s8)(tinstr & 0xFF) << 1);
+        FLUSHPIPE;
+    }
+    return true;
+}
+
+/// Format 18: unconditional branch
+bool Branch(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    state->Reg[15] = pc + 4 + ((ARMword)((s32)(tinstr << 21) >> 21) << 1);
+    FLUSHPIPE;
+    return true;
+}
+
+/// Format 19, first half: LR = PC + the high part of the offset
+bool BranchLinkHigh(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    state->Reg[14] = state->Reg[15] + ((ARMword)((s32)(tinstr << 21) >> 21) << 12);
+    // Runs on with the second half, as ARMul_ThumbDecode does
+    state->Reg[15] = pc + 2;
+    FLUSHPIPE;
+    return true;
+}
+
+/// Format 19, second half: branches to LR + the low part of the offset and links
+bool BranchLinkLow(ARMul_State* state, ARMword pc, ARMword tinstr) {
+    const ARMword next = pc + 2;
+    state->Reg[15] = state->Reg[14] + ((tinstr & 0x07FF) << 1);
+    state->Reg[14] = next | 1;
+    FLUSHPIPE;
+    return true;
+}
+
+/**
+ * Sets the handler of every instruction that matches a pattern
+ * @param pattern Bits 6-15 the instructions have, as an instruction halfword
+ * @param mask Bits 6-15 the pattern covers, as an instruction halfword
+ * @param handler Handler of the instructions
+ */
+void Register(u32 pattern, u32 mask, Handler handler) {
+    for (u32 index = 0; index < NUM_HANDLERS; index++) {
+        if ((index & (mask >> 6)) == (pattern >> 6)) {
+            g_handlers[index] = handler;
+        }
+    }
+}
+
+/**
+ * Registers the handler of a format 4 operation
+ * @tparam opcode Operation
+ */
+template <u32 opcode>
+void RegisterALU() {
+    Register(0x4000 | (opcode << 6), 0xFFC0, &ALU<opcode>);
+}
+
+/**
+ * Registers the handler of a format 5 operation, for the forms that involve a high register
+ * @tparam opcode Operation
+ */
+template <u32 opcode>
+void RegisterHighRegister() {
+    // Without a high register (H1 = H2 = 0) the encodings are undefined before ARMv6
+    for (u32 high = 1; high < 4; high++) {
+        Register(0x4400 | (opcode << 8) | (high << 6), 0xFFC0, &HighRegister<opcode>);
+    }
+}
+
+} // namespace
+
+/// Fills the handler table, called from ARMul_EmulateInit
+void Init() {
+    Register(0x0000, 0xF800, &ShiftImmediate<LSL>);
+    Register(0x0800, 0xF800, &ShiftImmediate<LSR>);
+    Register(0x1000, 0xF800, &ShiftImmediate<ASR>);
+
+    Register(0x1800, 0xFE00, &AddSubtract<false, false>);
+    Register(0x1A00, 0xFE00, &AddSubtract<false, true>);
+    Register(0x1C00, 0xFE00, &AddSubtract<true, false>);
+    Register(0x1E00, 0xFE00, &AddSubtract<true, true>);
+
+    Register(0x2000, 0xF800, &Immediate<IMM_MOV>);
+    Register(0x2800, 0xF800, &Immediate<IMM_CMP>);
+    Register(0x3000, 0xF800, &Immediate<IMM_ADD>);
+    Register(0x3800, 0xF800, &Immediate<IMM_SUB>);
+
+    // MUL is left to the translation, which models its early termination cycles
+    RegisterALU<ALU_AND>();
+    RegisterALU<ALU_EOR>();
+    RegisterALU<ALU_LSL>();
+    RegisterALU<ALU_LSR>();
+    RegisterALU<ALU_ASR>();
+    RegisterALU<ALU_ADC>();
+    RegisterALU<ALU_SBC>();
+    RegisterALU<ALU_ROR>();
+    RegisterALU<ALU_TST>();
+    RegisterALU<ALU_NEG>();
+    RegisterALU<ALU_CMP>();
+    RegisterALU<ALU_CMN>();
+    RegisterALU<ALU_ORR>();
+    RegisterALU<ALU_BIC>();
+    RegisterALU<ALU_MVN>();
+
+    RegisterHighRegister<HIGH_ADD>();
+    RegisterHighRegister<HIGH_CMP>();
+    RegisterHighRegister<HIGH_MOV>();
+
+    Register(0x4800, 0xF800, &LoadPCRelative);
+
+    Register(0x5000, 0xFE00, &RegisterOffset<4, false, false>);  // STR
+    Register(0x5200, 0xFE00, &RegisterOffset<2, false, false>);  // STRH
+    Register(0x5400, 0xFE00, &RegisterOffset<1, false, false>);  // STRB
+    Register(0x5600, 0xFE00, &RegisterOffset<1, true, true>);    // LDRSB
+    Register(0x5800, 0xFE00, &RegisterOffset<4, true, false>);   // LDR
+    Register(0x5A00, 0xFE00, &RegisterOffset<2, true, false>);   // LDRH
+    Register(0x5C00, 0xFE00, &RegisterOffset<1, true, false>);   // LDRB
+    Register(0x5E00, 0xFE00, &RegisterOffset<2, true, true>);    // LDRSH
+
+    Register(0x6000, 0xF800, &ImmediateOffset<4, false>);   // STR
+    Register(0x6800, 0xF800, &ImmediateOffset<4, true>);    // LDR
+    Register(0x7000, 0xF800, &ImmediateOffset<1, false>);   // STRB
+    Register(0x7800, 0xF800, &ImmediateOffset<1, true>);    // LDRB
+    Register(0x8000, 0xF800, &ImmediateOffset<2, false>);   // STRH
+    Register(0x8800, 0xF800, &ImmediateOffset<2, true>);    // LDRH
+
+    Register(0x9000, 0xF800, &SPRelative<false>);
+    Register(0x9800, 0xF800, &SPRelative<true>);
+
+    Register(0xA000, 0xF800, &LoadAddress<false>);
+    Register(0xA800, 0xF800, &LoadAddress<true>);
+
+    Register(0xB000, 0xFF80, &AdjustSP<false>);
+    Register(0xB080, 0xFF80, &AdjustSP<true>);
+
+    // Condition 1110 is undefined and 1111 is SWI, which stay with the translation
+    for (u32 cond = 0; cond < AL; cond++) {
+        Register(0xD000 | (cond << 8), 0xFF00, &ConditionalBranch);
+    }
+    Register(0xE000, 0xF800, &Branch);
+    Register(0xF000, 0xF800, &BranchLinkHigh);
+    Register(0xF800, 0xF800, &BranchLinkLow);
+}
+
+} // namespace
@@ -0,0 +1,50 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "core/arm/interpreter/armdefs.h"
+
+/**
+ * Native handlers for Thumb instructions. ARMul_ThumbDecode re-encodes a Thumb instruction as its
+ * ARM equivalent, which then goes through the ARM decoder; here the common formats (shifts and ALU
+ * operations, loads and stores of single registers, SP adjustments and branches) are executed
+ * straight from the Thumb encoding, through a table indexed by the top opcode bits. Push, pop,
+ * load/store multiple, multiplies, BX/BLX, SWI and anything involving the PC as a general register
+ * are left to the translation.
+ */
+namespace ThumbHandlers {
+
+/**
+ * Executes a Thumb instruction
+ * @param state ARM core state
+ * @param pc Address of the instruction
+ * @param tinstr Thumb instruction halfword
+ * @return False if the instruction has to go through the ARM translation
+ */
+typedef bool (*Handler)(ARMul_State* state, ARMword pc, ARMword tinstr);
+
+enum {
+    NUM_HANDLERS = (1 << 10),   ///< Table index: instruction bits 6-15
+};
+
+extern Handler g_handlers[NUM_HANDLERS];    ///< Handler for each index, nullptr if there is none
+
+/// Fills the handler table, called from ARMul_EmulateInit
+void Init();
+
+/**
+ * Executes a Thumb instruction through its native handler if it has one
+ * @param state ARM core state
+ * @param pc Address of the instruction
+ * @param instr Fetched instruction, the halfword at pc and the next one as ARMul_ThumbDecode takes
+ * @return True if the instruction was executed
+ */
+inline bool Execute(ARMul_State* state, ARMword pc, ARMword instr) {
+    const ARMword tinstr = state->bigendSig ? (instr >> 16) : (instr & 0xFFFF);
+    Handler handler = g_handlers[tinstr >> 6];
+    return handler != nullptr && handler(state, pc, tinstr);
+}
+
+} // namespace
@@ -33,7 +33,6 @@ existing ARM simulator.  */
 #include "armemu.h"
 #include "armos.h"
 
-
 /* Decode a 16bit Thumb instruction.  The instruction is in the low
    16-bits of the tinstr field, with the following Thumb instruction
    held in the high 16-bits.  Passing in two Thumb instructions allows
@@ -58,6 +57,17 @@ ARMul_ThumbDecode (
 		tinstr &= 0xFFFF;
 	}
 
+	/* ThumbTranslations holds the ARM equivalents of already decoded Thumb
+	   instructions, indexed by the 16-bit opcode. Everything below the
+	   conditional branches (formats 1-17) is a pure re-encoding of the opcode
+	   bits, so each opcode only has to go through the decoder once. Zero means
+	   "not translated yet"; every ARM equivalent has the AL condition so can
+	   never be zero.  */
+	if (state->ThumbTranslations[tinstr] != 0) {
+		*ainstr = state->ThumbTranslations[tinstr];
+		return t_decoded;
+	}
+
 #if 1				/* debugging to catch non updates */
 	*ainstr = 0xDEADC0DE;
 #endif
@@ -385,58 +395,7 @@ ARMul_ThumbDecode (
 		}
 		else if ((tinstr & 0x0F00) != 0x0E00) {
 			/* Format 16 */
-			int doit = FALSE;
-			/* TODO: Since we are doing a switch here, we could just add
-			   the SWI and undefined instruction checks into this
-			   switch to same on a couple of conditionals: */
-			switch ((tinstr & 0x0F00) >> 8) {
-			case EQ:
-				doit = ZFLAG;
-				break;
-			case NE:
-				doit = !ZFLAG;
-				break;
-			case VS:
-				doit = VFLAG;
-				break;
-			case VC:
-				doit = !VFLAG;
-				break;
-			case MI:
-				doit = NFLAG;
-				break;
-			case PL:
-				doit = !NFLAG;
-				break;
-			case CS:
-				doit = CFLAG;
-				break;
-			case CC:
-				doit = !CFLAG;
-				break;
-			case HI:
-				doit = (CFLAG && !ZFLAG);
-				break;
-			case LS:
-				doit = (!CFLAG || ZFLAG);
-				break;
-			case GE:
-				doit = ((!NFLAG && !VFLAG)
-					|| (NFLAG && VFLAG));
-				break;
-			case LT:
-				doit = ((NFLAG && !VFLAG)
-					|| (!NFLAG && VFLAG));
-				break;
-			case GT:
-				doit = ((!NFLAG && !VFLAG && !ZFLAG)
-					|| (NFLAG && VFLAG && !ZFLAG));
-				break;
-			case LE:
-				doit = ((NFLAG && !VFLAG)
-					|| (!NFLAG && VFLAG)) || ZFLAG;
-				break;
-			}
+			int doit = ARMul_ConditionPassed (state, (tinstr & 0x0F00) >> 8);
 			if (doit) {
 				state->Reg[15] = (pc + 4
 						  + (((tinstr & 0x7F) << 1)
@@ -509,5 +468,9 @@ ARMul_ThumbDecode (
 		break;
 	}
 
+	/* Formats 1-17 don't touch the state, remember their translation.  */
+	if (valid == t_decoded && ((tinstr & 0xF800) >> 11) < 26)
+		state->ThumbTranslations[tinstr] = *ainstr;
+
 	return valid;
 }
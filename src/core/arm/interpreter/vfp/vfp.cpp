@@ -27,6 +27,7 @@
 
 #include "core/arm/interpreter/armdefs.h"
 #include "core/arm/interpreter/vfp/vfp.h"
+#include "core/hle/svc.h"
 
 //ARMul_State* persistent_state; /* function calls from SoftFloat lib don't have an access to ARMul_state. */
 
@@ -44,6 +45,25 @@ VFPInit (ARMul_State *state)
 	return No_exp;
 }
 
+/*
+ * Loads the VFP registers of the running thread if they aren't the ones in
+ * the unit, and marks them as used so that the next context save stores them.
+ */
+void
+vfp_switch_context (ARMul_State * state)
+{
+	const ThreadContext* ctx = state->VFPContext;
+
+	if (ctx != NULL && state->VFPOwner != ctx)
+	{
+		memcpy (state->ExtReg, ctx->fpu_registers, sizeof (ctx->fpu_registers));
+		state->VFP[VFP_OFFSET(VFP_FPSCR)] = ctx->fpscr;
+		state->VFP[VFP_OFFSET(VFP_FPEXC)] = ctx->fpexc;
+	}
+	state->VFPOwner = ctx;
+	state->VFPDirty = 1;
+}
+
 unsigned
 VFPMRC (ARMul_State * state, unsigned type, ARMword instr, ARMword * value)
 {
@@ -55,6 +75,8 @@ VFPMRC (ARMul_State * state, unsigned type, ARMword instr, ARMword * value)
 	int CRm = BITS (0, 3);
 	int OPC_2 = BITS (5, 7);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	/* CRn/opc1 CRm/opc2 */
@@ -82,6 +104,8 @@ VFPMCR (ARMul_State * state, unsigned type, ARMword instr, ARMword value)
 	int CRm = BITS (0, 3);
 	int OPC_2 = BITS (5, 7);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	/* CRn/opc1 CRm/opc2 */
@@ -107,6 +131,8 @@ VFPMRRC (ARMul_State * state, unsigned type, ARMword instr, ARMword * value1, AR
 	int Rt2 = BITS (16, 19);
 	int CRm = BITS (0, 3);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	if (CoProc == 10 || CoProc == 11)
 	{
 		#define VFP_MRRC_TRANS
@@ -129,6 +155,8 @@ VFPMCRR (ARMul_State * state, unsigned type, ARMword instr, ARMword value1, ARMw
 	int Rt2 = BITS (16, 19);
 	int CRm = BITS (0, 3);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	/* CRn/opc1 CRm/opc2 */
@@ -158,6 +186,8 @@ VFPSTC (ARMul_State * state, unsigned type, ARMword instr, ARMword * value)
 	int D = BIT(22);
 	int W = BIT(21);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	/* VSTM */
@@ -201,6 +231,8 @@ VFPLDC (ARMul_State * state, unsigned type, ARMword instr, ARMword value)
 	int D = BIT(22);
 	int W = BIT(21);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	if ( (P|U|D|W) == 0 )
@@ -230,6 +262,8 @@ VFPCDP (ARMul_State * state, unsigned type, ARMword instr)
 	int CRm = BITS (0, 3);
 	int OPC_2 = BITS (5, 7);
 	
+	VFP_CHECK_CONTEXT (state);
+	
 	/* TODO check access permission */
 	
 	/* CRn/opc1 CRm/opc2 */
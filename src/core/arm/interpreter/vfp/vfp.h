@@ -36,6 +36,12 @@ unsigned VFPSTC (ARMul_State * state, unsigned type, ARMword instr, ARMword * va
 unsigned VFPLDC (ARMul_State * state, unsigned type, ARMword instr, ARMword value);
 unsigned VFPCDP (ARMul_State * state, unsigned type, ARMword instr);
 
+void vfp_switch_context (ARMul_State * state);
+
+/* Called by every VFP instruction, brings the VFP registers of the running thread in on the first */
+#define VFP_CHECK_CONTEXT(state) \
+	do { if (!(state)->VFPDirty) vfp_switch_context (state); } while (0)
+
 /* FPSID Information */
 #define VFP_FPSID_IMPLMEN 0 	/* should be the same as cp15 0 c0 0*/
 #define VFP_FPSID_SW 0
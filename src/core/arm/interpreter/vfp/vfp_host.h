@@ -0,0 +1,229 @@
+/*
+    vfp/vfp_host.h - ARM VFPv3 emulation unit - host FPU fast path
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * VFP add/sub/mul/div/sqrt are IEEE 754 basic operations, so in round to
+ * nearest mode the host SSE2 unit gives the very result the soft-float code
+ * computes, in a fraction of the time.
+ *
+ * Switching MXCSR to the guest rounding mode and reading back its flags
+ * costs more than the soft-float code itself, so the host runs in its own
+ * round to nearest mode and the inexact flag is worked out from the
+ * operands: single precision is computed in double precision, where the
+ * product of two floats is exact and rounding twice is known to be harmless,
+ * double precision uses error-free transformations (Knuth's TwoSum,
+ * Dekker's TwoProduct) to get the rounding error.
+ *
+ * The host result is only taken when nothing else can differ. Directed
+ * rounding, flush-to-zero, NaNs, infinities, invalid operations, division by
+ * zero, overflow and inexact results near the denormal range all go to the
+ * soft-float code, which knows the exact VFP semantics for those cases.
+ */
+
+#ifndef __VFP_HOST_H__
+#define __VFP_HOST_H__
+
+#include <math.h>
+#include <string.h>
+
+#include "core/arm/interpreter/vfp/vfp_helper.h"
+
+/*
+ * x86-64 always does scalar floating point in SSE2, without the excess
+ * precision of x87 that would make the results below wrong.
+ */
+#if defined(__x86_64__) || defined(_M_X64)
+
+#define VFP_HOST_FPU 1
+
+enum vfp_host_op {
+	VFP_HOST_ADD,
+	VFP_HOST_MUL,
+	VFP_HOST_DIV,
+	VFP_HOST_SQRT,
+};
+
+/*
+ * Biased exponent range of double operands that can't overflow or underflow
+ * in TwoProduct, from 2^-400 to 2^400.
+ */
+#define VFP_HOST_DOUBLE_MIN_EXP	(1023 - 400)
+#define VFP_HOST_DOUBLE_MAX_EXP	(1023 + 400)
+
+/*
+ * Whether a double operand is zero or well inside the exponent range.
+ */
+static inline int vfp_host_double_in_range(u64 v)
+{
+	int exponent = vfp_double_packed_exponent(v);
+	return (exponent >= VFP_HOST_DOUBLE_MIN_EXP && exponent <= VFP_HOST_DOUBLE_MAX_EXP) ||
+	       vfp_double_packed_abs(v) == 0;
+}
+
+/*
+ * s + e == a + b exactly.
+ */
+static inline void vfp_host_two_sum(double a, double b, double *s, double *e)
+{
+	double bv;
+
+	*s = a + b;
+	bv = *s - a;
+	*e = (a - (*s - bv)) + (b - bv);
+}
+
+/*
+ * p + e == a * b exactly, as long as nothing over- or underflows.
+ */
+static inline void vfp_host_two_product(double a, double b, double *p, double *e)
+{
+	double c, ah, al, bh, bl;
+
+	*p = a * b;
+	c = 134217729.0 * a;	/* 2^27 + 1 */
+	ah = c - (c - a);
+	al = a - ah;
+	c = 134217729.0 * b;
+	bh = c - (c - b);
+	bl = b - bh;
+	*e = ((ah * bh - *p) + ah * bl + al * bh) + al * bl;
+}
+
+/*
+ * Checks a rounded result. Tiny inexact results are left out since VFP
+ * detects underflow before rounding and IEEE hosts after it.
+ * Returns 0 if the soft-float code has to do the operation.
+ */
+static inline int vfp_host_accept(int inexact, int exponent, int max_exponent, u32 *exceptions)
+{
+	if (exponent == max_exponent)
+		return 0;	/* NaN or infinity */
+	if (inexact && exponent <= 1)
+		return 0;
+	*exceptions = inexact ? FPSCR_IXC : 0;
+	return 1;
+}
+
+/*
+ * Computes sd = n op m (sd = sqrt(m) for VFP_HOST_SQRT) in single precision.
+ * Returns 0 without touching sd if the soft-float code has to do it instead.
+ */
+static inline int vfp_single_host(ARMul_State* state, int sd, enum vfp_host_op op, s32 n, s32 m, u32 fpscr, u32 *exceptions)
+{
+	float fn, fm, fd;
+	double a, b, r, e = 0.0;
+	int inexact;
+	s32 d;
+
+	if (fpscr & (FPSCR_FLUSHTOZERO | FPSCR_RMODE_MASK))
+		return 0;
+
+	memcpy(&fn, &n, sizeof(fn));
+	memcpy(&fm, &m, sizeof(fm));
+	a = fn;
+	b = fm;
+
+	switch (op) {
+	case VFP_HOST_ADD:
+		vfp_host_two_sum(a, b, &r, &e);
+		fd = (float)r;
+		inexact = e != 0.0 || (double)fd != r;
+		break;
+	case VFP_HOST_MUL:
+		r = a * b;	/* exact */
+		fd = (float)r;
+		inexact = (double)fd != r;
+		break;
+	case VFP_HOST_DIV:
+		r = a / b;
+		fd = (float)r;
+		inexact = (double)fd * b != a;
+		break;
+	case VFP_HOST_SQRT:
+	default:
+		r = sqrt(b);
+		fd = (float)r;
+		inexact = (double)fd * fd != b;
+		break;
+	}
+
+	memcpy(&d, &fd, sizeof(d));
+	if (!vfp_host_accept(inexact, vfp_single_packed_exponent(d), 255, exceptions))
+		return 0;
+	vfp_put_float(state, d, sd);
+	return 1;
+}
+
+/*
+ * Computes dd = n op m (dd = sqrt(m) for VFP_HOST_SQRT) in double precision.
+ * Returns 0 without touching dd if the soft-float code has to do it instead.
+ */
+static inline int vfp_double_host(ARMul_State* state, int dd, enum vfp_host_op op, u64 n, u64 m, u32 fpscr, u32 *exceptions)
+{
+	double a, b, r, p, e;
+	int inexact;
+	u64 d;
+
+	if (fpscr & (FPSCR_FLUSHTOZERO | FPSCR_RMODE_MASK))
+		return 0;
+
+	/*
+	 * TwoProduct needs the operands well inside the exponent range.
+	 */
+	if (op != VFP_HOST_ADD) {
+		if ((op != VFP_HOST_SQRT && !vfp_host_double_in_range(n)) || !vfp_host_double_in_range(m))
+			return 0;
+	}
+
+	memcpy(&a, &n, sizeof(a));
+	memcpy(&b, &m, sizeof(b));
+
+	switch (op) {
+	case VFP_HOST_ADD:
+		vfp_host_two_sum(a, b, &r, &e);
+		inexact = e != 0.0;
+		break;
+	case VFP_HOST_MUL:
+		vfp_host_two_product(a, b, &r, &e);
+		inexact = e != 0.0;
+		break;
+	case VFP_HOST_DIV:
+		r = a / b;
+		vfp_host_two_product(r, b, &p, &e);
+		inexact = p != a || e != 0.0;
+		break;
+	case VFP_HOST_SQRT:
+	default:
+		if (b < 0.0)
+			return 0;
+		r = sqrt(b);
+		vfp_host_two_product(r, r, &p, &e);
+		inexact = p != b || e != 0.0;
+		break;
+	}
+
+	memcpy(&d, &r, sizeof(d));
+	if (!vfp_host_accept(inexact, (int)vfp_double_packed_exponent(d), 2047, exceptions))
+		return 0;
+	vfp_put_double(state, d, dd);
+	return 1;
+}
+
+#endif
+
+#endif
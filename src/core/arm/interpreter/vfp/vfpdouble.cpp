@@ -52,6 +52,7 @@
  */
  
 #include "core/arm/interpreter/vfp/vfp.h"
+#include "core/arm/interpreter/vfp/vfp_host.h"
 #include "core/arm/interpreter/vfp/vfp_helper.h"
 #include "core/arm/interpreter/vfp/asm_vfp.h"
 
@@ -290,6 +291,12 @@ static u32 vfp_double_fsqrt(ARMul_State* state, int dd, int unused, int dm, u32
 	struct vfp_double vdm, vdd, *vdp;
 	int ret, tm;
 
+#ifdef VFP_HOST_FPU
+	u32 exceptions;
+	if (vfp_double_host(state, dd, VFP_HOST_SQRT, 0, vfp_get_double(state, dm), fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	vfp_double_unpack(&vdm, vfp_get_double(state, dm));
 	tm = vfp_double_type(&vdm);
 	if (tm & (VFP_NAN|VFP_INFINITY)) {
@@ -970,6 +977,10 @@ static u32 vfp_double_fmul(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
 	u32 exceptions;
 
 	pr_debug("In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+	if (vfp_double_host(state, dd, VFP_HOST_MUL, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, &exceptions))
+		return exceptions;
+#endif
 	vfp_double_unpack(&vdn, vfp_get_double(state, dn));
 	if (vdn.exponent == 0 && vdn.significand)
 		vfp_double_normalise_denormal(&vdn);
@@ -991,6 +1002,13 @@ static u32 vfp_double_fnmul(ARMul_State* state, int dd, int dn, int dm, u32 fpsc
 	u32 exceptions;
 
 	pr_debug("In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+	/*
+	 * Negate an operand rather than the result, the rounding has to see the sign.
+	 */
+	if (vfp_double_host(state, dd, VFP_HOST_MUL, vfp_double_packed_negate(vfp_get_double(state, dn)), vfp_get_double(state, dm), fpscr, &exceptions))
+		return exceptions;
+#endif
 	vfp_double_unpack(&vdn, vfp_get_double(state, dn));
 	if (vdn.exponent == 0 && vdn.significand)
 		vfp_double_normalise_denormal(&vdn);
@@ -1014,6 +1032,10 @@ static u32 vfp_double_fadd(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
 	u32 exceptions;
 
 	pr_debug("In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+	if (vfp_double_host(state, dd, VFP_HOST_ADD, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, &exceptions))
+		return exceptions;
+#endif
 	vfp_double_unpack(&vdn, vfp_get_double(state, dn));
 	if (vdn.exponent == 0 && vdn.significand)
 		vfp_double_normalise_denormal(&vdn);
@@ -1036,6 +1058,10 @@ static u32 vfp_double_fsub(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
 	u32 exceptions;
 
 	pr_debug("In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+	if (vfp_double_host(state, dd, VFP_HOST_ADD, vfp_get_double(state, dn), vfp_double_packed_negate(vfp_get_double(state, dm)), fpscr, &exceptions))
+		return exceptions;
+#endif
 	vfp_double_unpack(&vdn, vfp_get_double(state, dn));
 	if (vdn.exponent == 0 && vdn.significand)
 		vfp_double_normalise_denormal(&vdn);
@@ -1064,6 +1090,10 @@ static u32 vfp_double_fdiv(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
 	int tm, tn;
 
 	pr_debug("In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+	if (vfp_double_host(state, dd, VFP_HOST_DIV, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, &exceptions))
+		return exceptions;
+#endif
 	vfp_double_unpack(&vdn, vfp_get_double(state, dn));
 	vfp_double_unpack(&vdm, vfp_get_double(state, dm));
 
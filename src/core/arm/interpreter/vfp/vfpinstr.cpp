@@ -3136,6 +3136,7 @@ VFPLABEL_INST:
 			}
 			else
 			{	
+				cpu->LazyFlagsOp = LAZY_FLAGS_NONE;
 				cpu->NFlag = (cpu->VFP[VFP_OFFSET(VFP_FPSCR)] >> 31) & 1;
 				cpu->ZFlag = (cpu->VFP[VFP_OFFSET(VFP_FPSCR)] >> 30) & 1;
 				cpu->CFlag = (cpu->VFP[VFP_OFFSET(VFP_FPSCR)] >> 29) & 1;
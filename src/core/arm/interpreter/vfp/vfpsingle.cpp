@@ -54,6 +54,7 @@
 #include "core/arm/interpreter/vfp/vfp_helper.h"
 #include "core/arm/interpreter/vfp/asm_vfp.h"
 #include "core/arm/interpreter/vfp/vfp.h"
+#include "core/arm/interpreter/vfp/vfp_host.h"
 
 static struct vfp_single vfp_single_default_qnan = {
 	//.exponent	= 255,
@@ -330,6 +331,12 @@ static u32 vfp_single_fsqrt(ARMul_State* state, int sd, int unused, s32 m, u32 f
 	struct vfp_single vsm, vsd, *vsp;
 	int ret, tm;
 
+#ifdef VFP_HOST_FPU
+	u32 exceptions;
+	if (vfp_single_host(state, sd, VFP_HOST_SQRT, 0, m, fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	vfp_single_unpack(&vsm, m);
 	tm = vfp_single_type(&vsm);
 	if (tm & (VFP_NAN|VFP_INFINITY)) {
@@ -999,6 +1006,11 @@ static u32 vfp_single_fmul(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
 	pr_debug("In %sVFP: s%u = %08x\n", __FUNCTION__, sn, n);
 
+#ifdef VFP_HOST_FPU
+	if (vfp_single_host(state, sd, VFP_HOST_MUL, n, m, fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	vfp_single_unpack(&vsn, n);
 	if (vsn.exponent == 0 && vsn.significand)
 		vfp_single_normalise_denormal(&vsn);
@@ -1022,6 +1034,14 @@ static u32 vfp_single_fnmul(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr
 
 	pr_debug("VFP: s%u = %08x\n", sn, n);
 
+#ifdef VFP_HOST_FPU
+	/*
+	 * Negate an operand rather than the result, the rounding has to see the sign.
+	 */
+	if (vfp_single_host(state, sd, VFP_HOST_MUL, vfp_single_packed_negate(n), m, fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	vfp_single_unpack(&vsn, n);
 	if (vsn.exponent == 0 && vsn.significand)
 		vfp_single_normalise_denormal(&vsn);
@@ -1046,6 +1066,11 @@ static u32 vfp_single_fadd(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
 	pr_debug("VFP: s%u = %08x\n", sn, n);
 
+#ifdef VFP_HOST_FPU
+	if (vfp_single_host(state, sd, VFP_HOST_ADD, n, m, fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	/*
 	 * Unpack and normalise denormals.
 	 */
@@ -1086,6 +1111,11 @@ static u32 vfp_single_fdiv(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
 	pr_debug("VFP: s%u = %08x\n", sn, n);
 
+#ifdef VFP_HOST_FPU
+	if (vfp_single_host(state, sd, VFP_HOST_DIV, n, m, fpscr, &exceptions))
+		return exceptions;
+#endif
+
 	vfp_single_unpack(&vsn, n);
 	vfp_single_unpack(&vsm, m);
 
@@ -0,0 +1,968 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include "common/atomic.h"
+#include "common/hash.h"
+#include "common/log.h"
+#include "common/memory_tracker.h"
+
+#include "core/core.h"
+#include "core/mem_map.h"
+#include "core/arm/cycle_model.h"
+#include "core/arm/exec_trace.h"
+#include "core/arm/interpreter/idle_loop.h"
+#include "core/arm/jit/arm_jit.h"
+
+#if defined(__x86_64__) || (defined(_MSC_VER) && defined(_M_X64))
+#define ARM_JIT_X64 1
+#endif
+
+using namespace JIT;
+
+namespace {
+
+const size_t CODE_SPACE_SIZE        = 16 * 1024 * 1024; ///< Size of the translated code buffer
+const u32 MAX_BLOCK_INSTRUCTIONS    = 64;               ///< Longest run translated as one block
+const size_t MAX_INSTRUCTION_SIZE   = 32;               ///< Upper bound of host bytes per instruction
+const size_t MAX_BLOCK_OVERHEAD     = 256;              ///< Host bytes of the prologue and exits
+const u32 MAX_BLOCK_EXITS           = 2;                ///< A BL has two, every other block one
+const u32 TRANSLATION_VERSION       = 1;                ///< Layout of the translated code
+const int MIN_RUN_INSTRUCTIONS      = 4;                ///< Shortest block left the interpreter for
+const int MAX_INTERPRETER_RUNS      = 8;                ///< Misses before interpreting the slice
+
+/// Upper bound of the host code of a block
+const size_t MAX_BLOCK_CODE_SIZE = (MAX_BLOCK_INSTRUCTIONS + 1) * MAX_INSTRUCTION_SIZE +
+    MAX_BLOCK_OVERHEAD;
+
+/// Offsets within ARMul_State of the run time state of translated code
+const s32 DOWNCOUNT_OFFSET          = (s32)offsetof(ARMul_State, JITDowncount);
+const s32 DIRTY_PAGES_OFFSET        = (s32)offsetof(ARMul_State, JITDirtyPages);
+const s32 RETURN_TOP_OFFSET         = (s32)offsetof(ARMul_State, JITReturnTop);
+const s32 RETURN_PC_OFFSET          = (s32)offsetof(ARMul_State, JITReturnStack[0].pc);
+const s32 RETURN_CODE_OFFSET        = (s32)offsetof(ARMul_State, JITReturnStack[0].code);
+const s32 NUM_S_CYCLES_OFFSET       = (s32)offsetof(ARMul_State, NumScycles);
+const s32 NUM_CYCLES_OFFSET         = (s32)offsetof(ARMul_State, NumCycles);
+
+const u32 INSTR_BX_LR               = 0xE12FFF1E;
+
+/// ARM data-processing opcodes (bits 21-24)
+enum {
+    OP_AND = 0x0, OP_EOR = 0x1, OP_SUB = 0x2, OP_RSB = 0x3,
+    OP_ADD = 0x4, OP_ADC = 0x5, OP_SBC = 0x6, OP_RSC = 0x7,
+    OP_TST = 0x8, OP_TEQ = 0x9, OP_CMP = 0xA, OP_CMN = 0xB,
+    OP_ORR = 0xC, OP_MOV = 0xD, OP_BIC = 0xE, OP_MVN = 0xF,
+};
+
+/// Byte offset of a guest register within ARMul_State
+inline s32 RegOffset(int index) {
+    return (s32)(offsetof(ARMul_State, Reg) + index * sizeof(ARMword));
+}
+
+/**
+ * Tells whether CompileInstruction translates an instruction: unconditional data-processing
+ * ones without S bit, that neither need the carry nor write the PC
+ * @param instr ARM instruction word
+ */
+bool IsTranslatable(u32 instr) {
+    if ((instr >> 28) != 0xE || ((instr >> 26) & 3) != 0 || (instr & (1 << 20))) {
+        return false;
+    }
+    switch ((instr >> 21) & 0xF) {
+    case OP_AND: case OP_EOR: case OP_SUB: case OP_RSB:
+    case OP_ADD: case OP_ORR: case OP_MOV: case OP_BIC: case OP_MVN:
+        break;
+    default:
+        // Carry-dependent ops and the comparison encodings (MRS/MSR/BX when S=0)
+        return false;
+    }
+    if (((instr >> 12) & 0xF) == 15) {
+        return false;
+    }
+    if (!(instr & (1 << 25))) {
+        // Register operands shifted by a register (and the multiply/extra load space) use bit 4
+        if (instr & (1 << 4)) {
+            return false;
+        }
+        // ROR #0 encodes RRX, which needs the carry flag
+        if (((instr >> 5) & 3) == 3 && ((instr >> 7) & 0x1F) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Tells whether an ARM instruction may change the flow of control: a branch, an SVC, or a write
+ * to the PC. Errs on the side of yes, which only shortens the interpreter runs.
+ * @param instr ARM instruction word
+ */
+bool MayBranch(u32 instr) {
+    const u32 op = (instr >> 25) & 7;
+    if ((instr >> 28) == 0xF || op == 5 || ((instr >> 24) & 0xF) == 0xF) {
+        return true;
+    }
+    if ((instr & 0x0FFFFFD0) == 0x012FFF10) {
+        return true;
+    }
+    if (op == 4) {
+        return (instr & (1 << 20)) && (instr & (1 << 15));
+    }
+    return op <= 3 && ((instr >> 12) & 0xF) == 15;
+}
+
+/**
+ * Tells whether a block starting at a guest address would be worth leaving the interpreter for:
+ * MIN_RUN_INSTRUCTIONS translatable instructions, or fewer ended by an unconditional B or BL that
+ * links it to the next block. Shorter blocks cost more to enter than they save.
+ * @param addr Guest address of the first instruction
+ * @param page_end Guest address of the end of its page, the block isn't read past it
+ */
+bool StartsLongBlock(u32 addr, u32 page_end) {
+    for (int i = 0; i < MIN_RUN_INSTRUCTIONS; i++, addr += 4) {
+        if (addr >= page_end) {
+            return false;
+        }
+        const u32 instr = Memory::Read32(addr);
+        if (i > 0 && (instr >> 28) == 0xE && ((instr >> 25) & 7) == 5) {
+            return true;
+        }
+        if (!IsTranslatable(instr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Counts the ARM instructions from a guest address the interpreter runs in one call, up to the
+ * next one a block worth translating starts with or through the first one that may branch,
+ * within the page
+ * @param addr Guest address of the first instruction, which the JIT left to the interpreter
+ * @param max Most instructions to run
+ * @return Number of instructions, at least 1
+ */
+int GetInterpreterRun(u32 addr, int max) {
+    const u32 page_end = (addr | ((1 << Memory::PAGE_BITS) - 1)) + 1;
+    int count = 1;
+    for (u32 pc = addr; count < max && pc + 4 < page_end; pc += 4, count++) {
+        if (MayBranch(Memory::Read32(pc)) || StartsLongBlock(pc + 4, page_end)) {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Hashes the ExeFS code pages a guest range lies in
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param hash Receives the hash
+ * @return False if the range isn't within ExeFS code
+ */
+bool HashCodePages(u32 addr, u32 size, u64* hash) {
+    const u32 start = addr & ~((1 << Memory::PAGE_BITS) - 1);
+    const u32 end = ((addr + size - 1) | ((1 << Memory::PAGE_BITS) - 1)) + 1;
+    if (start < Memory::EXEFS_CODE_VADDR || end > Memory::EXEFS_CODE_VADDR_END) {
+        return false;
+    }
+    *hash = GetFastHash64(Memory::g_exefs_code + (start - Memory::EXEFS_CODE_VADDR), end - start);
+    return true;
+}
+
+/**
+ * Tells whether Core has code breakpoints in the pages a guest range lies in. Code of those pages
+ * is left to the interpreter, which checks the breakpoints.
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @return True if any of the pages has a breakpoint
+ */
+bool HasBreakPoints(u32 addr, u32 size) {
+    if (Core::g_breakpoints == nullptr) {
+        return false;
+    }
+    for (u32 page = addr >> Memory::PAGE_BITS; page <= (addr + size - 1) >> Memory::PAGE_BITS;
+        page++) {
+        if (Core::g_breakpoints->HasBreakPointInPage(page << Memory::PAGE_BITS)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Points an exit of kind EXIT_JUMP at a block, or back at the dispatcher
+ * @param exit Host address of the exit
+ * @param target Guest address the exit goes to
+ * @param entry Host code of the block at target, nullptr to return to the dispatcher
+ */
+void PatchJumpExit(u8* exit, u32 target, const u8* entry) {
+    X64Emitter patcher;
+    patcher.SetCodePtr(exit, 5);
+    if (entry != nullptr) {
+        patcher.JMP(entry);
+    } else {
+        patcher.MOV_Imm(RAX, target);
+    }
+}
+
+/**
+ * Sets the host code an exit of kind EXIT_RETURN_CODE pushes on the return stack
+ * @param exit Host address of the exit
+ * @param entry Host code of the block returned to, nullptr if there's none
+ */
+void PatchReturnCodeExit(u8* exit, const u8* entry) {
+    const u64 code = (u64)(size_t)entry;
+    memcpy(exit, &code, sizeof(code));
+}
+
+} // namespace
+
+/// Returns the number of guest bytes a block depends on (at least its first instruction)
+u32 ARM_JIT::GetBlockSize(const Block& block) {
+    return (block.num_instructions > 0 ? block.num_instructions : 1) * 4;
+}
+
+ARM_JIT::ARM_JIT() : block_entry(nullptr), translation_cache_open(false), title_id(0),
+    reschedule_pending(false) {
+#ifdef ARM_JIT_X64
+    static_assert(sizeof(state->JITReturnStack[0]) == 16, "return stack entries are indexed * 16");
+    static_assert(MAX_BLOCK_CODE_SIZE <= Common::CodeCache::REGION_SIZE,
+        "blocks are allocated within a region");
+    if (!code_cache.Init(CODE_SPACE_SIZE, Common::MemoryTracker::TAG_JIT_CODE,
+        Common::CodeCache::HostRequiresWriteXorExecute())) {
+
+        ERROR_LOG(DYNA_REC, "no executable memory, every instruction is interpreted");
+    }
+#endif
+    state->JITDirtyPages = Memory::g_dirty_pages;
+    ClearCache();
+}
+
+ARM_JIT::~ARM_JIT() {
+    if (code_cache.IsValid()) {
+        const Common::CodeCache::Stats stats = code_cache.GetStats();
+        INFO_LOG(DYNA_REC, "code cache: %u KB of %u KB used by %u blocks, %llu regions reclaimed, "
+            "%llu flushes", (u32)(stats.used / 1024), (u32)(stats.size / 1024), stats.num_blocks,
+            (unsigned long long)stats.num_reclaimed, (unsigned long long)stats.num_flushes);
+    }
+    translation_cache.Close();
+}
+
+/// Throws away all translated code (e.g. after guest code has been modified)
+void ARM_JIT::ClearCache() {
+    block_cache.clear();
+    page_blocks.clear();
+    jump_exits.clear();
+    return_exits.clear();
+    memset(lookup_table, 0, sizeof(lookup_table));
+    memset(state->JITReturnStack, 0, sizeof(state->JITReturnStack));
+    const Common::CodeCache::Stats stats = code_cache.GetStats();
+    if (stats.num_blocks != 0) {
+        INFO_LOG(DYNA_REC, "flushing %u blocks, %u KB of code", stats.num_blocks,
+            (u32)(stats.used / 1024));
+    }
+    code_cache.Flush();
+}
+
+/// Stops the current Run() at the end of the instruction being executed (e.g. from an SVC)
+void ARM_JIT::PrepareReschedule() {
+    reschedule_pending = true;
+    ARM_Interpreter::PrepareReschedule();
+}
+
+/**
+ * Keeps the blocks translated from ExeFS code on disk, reusing those of earlier runs whose
+ * code pages are unchanged in g_exefs_code
+ * @param filename Path of the translation cache file
+ * @param title_id Identity of the title loaded, entries of other titles are ignored
+ */
+void ARM_JIT::OpenTranslationCache(const std::string& filename, u64 title_id) {
+    ClearCache();
+    cached_blocks.clear();
+    cached_page_blocks.clear();
+    this->title_id = title_id;
+
+    // Entries are a TranslationHeader followed by the exits and the host code of the block
+    struct Reader : LinearDiskCacheReader<TranslationKey, u8> {
+        ARM_JIT* jit;
+        u32 num_valid;
+
+        void Read(const TranslationKey& key, const u8* value, u32 value_size) override {
+            TranslationHeader header;
+            if (key.title_id != jit->title_id || key.version != TRANSLATION_VERSION ||
+                value_size < sizeof(header)) {
+                return;
+            }
+            memcpy(&header, value, sizeof(header));
+            if (header.num_instructions == 0 || header.num_instructions > MAX_BLOCK_INSTRUCTIONS ||
+                header.num_exits > MAX_BLOCK_EXITS ||
+                value_size - sizeof(header) < header.num_exits * sizeof(Exit)) {
+                return;
+            }
+            const u8* code = value + sizeof(header) + header.num_exits * sizeof(Exit);
+            const u32 code_size = (u32)(value + value_size - code);
+            if (code_size > MAX_BLOCK_CODE_SIZE || header.bail_offset >= code_size) {
+                return;
+            }
+            std::vector<Exit> exits(header.num_exits);
+            for (u32 i = 0; i < header.num_exits; i++) {
+                memcpy(&exits[i], value + sizeof(header) + i * sizeof(Exit), sizeof(Exit));
+                if (exits[i].offset + (exits[i].kind == EXIT_JUMP ? 5 : 8) > code_size) {
+                    return;
+                }
+            }
+            // Code the title modified since, or of another version of it, is translated again
+            u64 page_hash;
+            if (!HashCodePages(key.pc, header.num_instructions * 4, &page_hash) ||
+                page_hash != key.page_hash) {
+                return;
+            }
+            CachedBlock& block = jit->cached_blocks[key.pc];
+            block.num_instructions = header.num_instructions;
+            block.bail_offset = header.bail_offset;
+            block.exits.swap(exits);
+            block.code.assign(code, value + value_size);
+            num_valid++;
+        }
+    } reader;
+    reader.jit = this;
+    reader.num_valid = 0;
+
+    translation_cache.Close();
+    const u32 count = translation_cache.OpenAndRead(filename.c_str(), reader);
+    translation_cache_open = true;
+    INFO_LOG(DYNA_REC, "%u of %u translated blocks in %s are valid", reader.num_valid, count,
+        filename.c_str());
+
+    // The pages were written by the loader, cached blocks stay valid until they are written again
+    for (auto& it : cached_blocks) {
+        const u32 last_page = (it.first + it.second.num_instructions * 4 - 1) >> Memory::PAGE_BITS;
+        for (u32 page = it.first >> Memory::PAGE_BITS; page <= last_page; page++) {
+            Common::AtomicAnd(Memory::g_dirty_pages[page], (u8)~Memory::DIRTY_JIT);
+            cached_page_blocks[page].push_back(it.first);
+        }
+    }
+}
+
+/// Translates up front all of the code the translation cache has valid blocks for
+void ARM_JIT::WarmUp() {
+    // Compiling can drop cached blocks of pages written since, so go through a copy of the keys
+    std::vector<u32> addresses;
+    addresses.reserve(cached_blocks.size());
+    for (const auto& it : cached_blocks) {
+        addresses.push_back(it.first);
+    }
+    std::sort(addresses.begin(), addresses.end());
+
+    u32 num_loaded = 0;
+    for (u32 addr : addresses) {
+        if (block_cache.find(addr) == block_cache.end() &&
+            cached_blocks.find(addr) != cached_blocks.end()) {
+            Compile(addr);
+            num_loaded++;
+        }
+    }
+    INFO_LOG(DYNA_REC, "warmed up %u translated blocks", num_loaded);
+}
+
+/// Returns the guest address of the next instruction the core will execute
+u32 ARM_JIT::GetNextPC() const {
+    // After a branch or context load the pipeline is refilled from R15, otherwise execution
+    // simply continues after the last instruction
+    if (state->NextInstr >= PRIMEPIPE) {
+        return state->Reg[15];
+    }
+    return state->pc + 4;
+}
+
+/**
+ * Points the interpreter pipeline at a new guest address
+ * @param addr Guest address to continue execution from
+ */
+void ARM_JIT::ResumeAt(u32 addr) {
+    state->pc = state->Reg[15] = addr;
+    state->NextInstr = RESUME;
+}
+
+/**
+ * Drops the blocks of every page in a guest range that was written since it was translated
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ */
+void ARM_JIT::InvalidateDirtyPages(u32 addr, u32 size) {
+    const u32 last_page = (addr + size - 1) >> Memory::PAGE_BITS;
+    for (u32 page = addr >> Memory::PAGE_BITS; page <= last_page; page++) {
+        if (!(Memory::g_dirty_pages[page] & Memory::DIRTY_JIT)) {
+            continue;
+        }
+        Common::AtomicAnd(Memory::g_dirty_pages[page], (u8)~Memory::DIRTY_JIT);
+
+        auto cached = cached_page_blocks.find(page);
+        if (cached != cached_page_blocks.end()) {
+            for (size_t i = 0; i < cached->second.size(); i++) {
+                cached_blocks.erase(cached->second[i]);
+            }
+            cached_page_blocks.erase(cached);
+        }
+
+        auto it = page_blocks.find(page);
+        if (it == page_blocks.end()) {
+            continue;
+        }
+        // Unlinking the exits to the blocks patches code
+        Common::CodeCache::WriteScope write_scope(code_cache);
+        for (size_t i = 0; i < it->second.size(); i++) {
+            DropBlock(it->second[i]);
+        }
+        page_blocks.erase(it);
+    }
+}
+
+/**
+ * Finds the block starting at a guest address, if it was translated
+ * @param addr Guest address of the first instruction
+ * @return The block, nullptr if it isn't in the cache
+ */
+const ARM_JIT::Block* ARM_JIT::LookupBlock(u32 addr) {
+    LookupEntry& entry = lookup_table[(addr >> 2) & (LOOKUP_TABLE_SIZE - 1)];
+    if (entry.block != nullptr && entry.pc == addr) {
+        return entry.block;
+    }
+    auto it = block_cache.find(addr);
+    if (it == block_cache.end()) {
+        return nullptr;
+    }
+    // Elements of the map stay where they are when it grows
+    entry.pc = addr;
+    entry.block = &it->second;
+    return entry.block;
+}
+
+/**
+ * Removes a block from block_cache and the lookup table, unlinking the exits to it
+ * @param addr Guest address of the block
+ */
+void ARM_JIT::DropBlock(u32 addr) {
+    LookupEntry& entry = lookup_table[(addr >> 2) & (LOOKUP_TABLE_SIZE - 1)];
+    if (entry.block != nullptr && entry.pc == addr) {
+        entry.block = nullptr;
+    }
+    auto it = block_cache.find(addr);
+    if (it == block_cache.end()) {
+        return;
+    }
+    if (it->second.entry != nullptr) {
+        PatchExits(addr, nullptr);
+        // BLs may have pushed the code of the block already
+        memset(state->JITReturnStack, 0, sizeof(state->JITReturnStack));
+        // Nothing jumps to the code anymore, and nothing will patch it once its region is reused
+        UnlinkExitsOf(it->second);
+        code_cache.FreeBlock((u8*)it->second.entry, it->second.code_size);
+    }
+    block_cache.erase(it);
+}
+
+/**
+ * Removes the exits of a block from jump_exits and return_exits, before its code is freed
+ * @param block Block
+ */
+void ARM_JIT::UnlinkExitsOf(const Block& block) {
+    for (const Exit& exit : block.exits) {
+        auto& exits = (exit.kind == EXIT_JUMP) ? jump_exits : return_exits;
+        auto it = exits.find(exit.target);
+        if (it == exits.end()) {
+            continue;
+        }
+        std::vector<u8*>& codes = it->second;
+        auto found = std::find(codes.begin(), codes.end(), (u8*)block.entry + exit.offset);
+        if (found != codes.end()) {
+            *found = codes.back();
+            codes.pop_back();
+        }
+        if (codes.empty()) {
+            exits.erase(it);
+        }
+    }
+}
+
+/**
+ * Patches the exits to a guest address, pointing them at the block translated there or
+ * back at the dispatcher
+ * @param addr Guest address of the block
+ * @param entry Host code of the block, nullptr to unlink the exits
+ */
+void ARM_JIT::PatchExits(u32 addr, const u8* entry) {
+    auto jumps = jump_exits.find(addr);
+    if (jumps != jump_exits.end()) {
+        for (u8* exit : jumps->second) {
+            PatchJumpExit(exit, addr, entry);
+        }
+    }
+    auto returns = return_exits.find(addr);
+    if (returns != return_exits.end()) {
+        for (u8* exit : returns->second) {
+            PatchReturnCodeExit(exit, entry);
+        }
+    }
+}
+
+/**
+ * Registers the exits of a block just placed in the code space, linking those to translated
+ * blocks
+ * @param entry Host code of the block
+ * @param exits Exits of the block
+ */
+void ARM_JIT::LinkExits(u8* entry, const std::vector<Exit>& exits) {
+    for (const Exit& exit : exits) {
+        u8* code = entry + exit.offset;
+        const Block* target = LookupBlock(exit.target);
+        const u8* target_entry = (target != nullptr) ? (const u8*)target->entry : nullptr;
+        if (exit.kind == EXIT_JUMP) {
+            jump_exits[exit.target].push_back(code);
+            PatchJumpExit(code, exit.target, target_entry);
+        } else {
+            return_exits[exit.target].push_back(code);
+            PatchReturnCodeExit(code, target_entry);
+        }
+    }
+}
+
+/**
+ * Emits the checks and cycle accounting a block starts with, always of the same size
+ * @param addr Guest address of the first instruction
+ * @param num_instructions Number of guest instructions of the block
+ * @param num_cycles CycleModel cost of the instructions
+ * @param bail Code returning to the dispatcher when the block can't run
+ */
+void ARM_JIT::EmitPrologue(u32 addr, u32 num_instructions, u32 num_cycles, const u8* bail) {
+    const X64Reg base = ABI_PARAM1;
+
+    // Blocks linked to aren't looked at by the dispatcher, so they check for writes to their code
+    // themselves. The dispatcher drops them when they return.
+    const u32 last_byte = addr + (num_instructions > 0 ? num_instructions : 1) * 4 - 1;
+    emitter.MOV_Load64(RDX, base, DIRTY_PAGES_OFFSET);
+    emitter.TEST_MemImm8(RDX, addr >> Memory::PAGE_BITS, Memory::DIRTY_JIT);
+    X64Emitter::SetJumpTarget(emitter.J_CC(CC_NZ), bail);
+    emitter.TEST_MemImm8(RDX, last_byte >> Memory::PAGE_BITS, Memory::DIRTY_JIT);
+    X64Emitter::SetJumpTarget(emitter.J_CC(CC_NZ), bail);
+
+    // A block that doesn't fit in what's left of the slice is left to the interpreter
+    emitter.ALU_MemImm(ALU_CMP, base, DOWNCOUNT_OFFSET, num_instructions);
+    X64Emitter::SetJumpTarget(emitter.J_CC(CC_L), bail);
+    emitter.ALU_MemImm(ALU_SUB, base, DOWNCOUNT_OFFSET, num_instructions);
+    emitter.ALU_MemImm(ALU_ADD, base, NUM_S_CYCLES_OFFSET, num_instructions);
+    emitter.ALU_MemImm(ALU_ADD, base, NUM_CYCLES_OFFSET, num_cycles, true);
+}
+
+/**
+ * Emits a patchable exit to a guest address
+ * @param target Guest address of the next instruction
+ */
+void ARM_JIT::EmitExit(u32 target) {
+    Exit exit;
+    exit.offset = (u32)(emitter.GetCodePtr() - block_entry);
+    exit.target = target;
+    exit.kind = EXIT_JUMP;
+    block_exits.push_back(exit);
+
+    emitter.MOV_Imm(RAX, target);
+    emitter.RET();
+}
+
+/**
+ * Emits a B, BL or BX LR as the end of a block
+ * @param instr ARM instruction word
+ * @param pc Guest address of the instruction
+ * @return True if the instruction was translated, false if it isn't one of those
+ */
+bool ARM_JIT::CompileBranch(u32 instr, u32 pc) {
+    const X64Reg base = ABI_PARAM1;
+
+    if (instr == INSTR_BX_LR) {
+        emitter.MOV_Load(RAX, base, RegOffset(14));
+        emitter.TEST_Imm(RAX, 1);
+        u8* to_thumb = emitter.J_CC(CC_NZ);
+
+        // Returns to the block after the BL on top of the return stack go straight to its code
+        emitter.MOV_Load(RDX, base, RETURN_TOP_OFFSET);
+        emitter.SHIFT_Imm(SHIFT_SHL, RDX, 4);
+        emitter.CMP_LoadIndexed(RAX, base, RDX, RETURN_PC_OFFSET);
+        u8* mispredicted = emitter.J_CC(CC_NZ);
+        emitter.ALU_MemImm(ALU_SUB, base, RETURN_TOP_OFFSET, 1);
+        emitter.ALU_MemImm(ALU_AND, base, RETURN_TOP_OFFSET, JIT_RETURN_STACK_SIZE - 1);
+        emitter.MOV_LoadIndexed(RDX, base, RDX, RETURN_CODE_OFFSET, true);
+        emitter.TEST_Self64(RDX);
+        u8* not_translated = emitter.J_CC(CC_Z);
+        emitter.JMP_Reg(RDX);
+        X64Emitter::SetJumpTarget(mispredicted, emitter.GetCodePtr());
+        X64Emitter::SetJumpTarget(not_translated, emitter.GetCodePtr());
+        emitter.RET();
+
+        // Switches to Thumb are left to the interpreter, which runs the BX again
+        X64Emitter::SetJumpTarget(to_thumb, emitter.GetCodePtr());
+        emitter.ALU_MemImm(ALU_ADD, base, DOWNCOUNT_OFFSET, 1);
+        emitter.ALU_MemImm(ALU_SUB, base, NUM_S_CYCLES_OFFSET, 1);
+        emitter.ALU_MemImm(ALU_SUB, base, NUM_CYCLES_OFFSET,
+            CycleModel::GetInstructionCycles(instr), true);
+        emitter.MOV_Imm(RAX, pc);
+        emitter.RET();
+        return true;
+    }
+
+    // Unconditional B and BL
+    if ((instr >> 28) != 0xE || ((instr >> 25) & 7) != 5) {
+        return false;
+    }
+    const u32 target = pc + 8 + ((s32)(instr << 8) >> 6);
+    // Idle loops are left to the interpreter, which skips them to the next event
+    if (!(instr & (1 << 24)) && pc - target < IdleLoop::MAX_LOOP_INSTRUCTIONS * 4 &&
+        IdleLoop::Check(pc, target)) {
+        return false;
+    }
+    if (instr & (1 << 24)) {
+        emitter.MOV_Imm(RAX, pc + 4);
+        emitter.MOV_Store(base, RegOffset(14), RAX);
+
+        emitter.MOV_Load(RDX, base, RETURN_TOP_OFFSET);
+        emitter.ALU_Imm(ALU_ADD, RDX, 1);
+        emitter.ALU_Imm(ALU_AND, RDX, JIT_RETURN_STACK_SIZE - 1);
+        emitter.MOV_Store(base, RETURN_TOP_OFFSET, RDX);
+        emitter.SHIFT_Imm(SHIFT_SHL, RDX, 4);
+        emitter.MOV_StoreIndexed(base, RDX, RETURN_PC_OFFSET, RAX, false);
+        emitter.MOV_Imm64(RAX, 0);
+
+        Exit exit;
+        exit.offset = (u32)(emitter.GetCodePtr() - sizeof(u64) - block_entry);
+        exit.target = pc + 4;
+        exit.kind = EXIT_RETURN_CODE;
+        block_exits.push_back(exit);
+
+        emitter.MOV_StoreIndexed(base, RDX, RETURN_CODE_OFFSET, RAX, true);
+    }
+    EmitExit(target);
+    return true;
+}
+
+/**
+ * Translates the guest block starting at the given address
+ * @param addr Guest address of the first instruction
+ * @return Reference to the (possibly empty) block stored in the cache
+ */
+const ARM_JIT::Block& ARM_JIT::Compile(u32 addr) {
+    // The budget bounds the code of all the cores, each throws its own away once it's over
+    if (Common::MemoryTracker::IsOverBudget(Common::MemoryTracker::TAG_JIT_CODE,
+        MAX_BLOCK_CODE_SIZE)) {
+
+        ClearCache();
+    }
+    Common::CodeCache::WriteScope write_scope(code_cache);
+
+    // Anything stale translated from these pages has to go before their dirty bit is consumed,
+    // which may free the region the block goes to
+    InvalidateDirtyPages(addr, MAX_BLOCK_INSTRUCTIONS * 4);
+
+    u8* entry = code_cache.BeginBlock(MAX_BLOCK_CODE_SIZE);
+    if (entry == nullptr && code_cache.IsValid()) {
+        // Every region holds live blocks, those still run are relinked as they're translated
+        ClearCache();
+        entry = code_cache.BeginBlock(MAX_BLOCK_CODE_SIZE);
+    }
+
+    Block& block = block_cache[addr];
+    block.entry = nullptr;
+    block.num_instructions = 0;
+    block.num_cycles = 0;
+    block.code_size = 0;
+    block.exits.clear();
+    block.num_interpreted = GetInterpreterRun(addr, MAX_BLOCK_INSTRUCTIONS);
+
+    if (entry == nullptr) {
+        return block;
+    }
+
+    emitter.SetCodePtr(entry, MAX_BLOCK_CODE_SIZE);
+    block_entry = entry;
+    block_exits.clear();
+    u32 bail_offset = 0;
+    bool loaded = false;
+
+    auto cached = cached_blocks.find(addr);
+    if (cached != cached_blocks.end() &&
+        !HasBreakPoints(addr, cached->second.num_instructions * 4)) {
+        // Translated by an earlier run, from the same code
+        emitter.WriteData(cached->second.code.data(), cached->second.code.size());
+        block.num_instructions = cached->second.num_instructions;
+        bail_offset = cached->second.bail_offset;
+        block_exits = cached->second.exits;
+        loaded = true;
+    } else {
+        // Emitted again below, once the size and cost of the block are known
+        EmitPrologue(addr, 0, 0, entry);
+
+        bool ended = false;
+        while (block.num_instructions < MAX_BLOCK_INSTRUCTIONS) {
+            u32 pc = addr + block.num_instructions * 4;
+            if (HasBreakPoints(pc, 4)) {
+                break;
+            }
+            const u32 instr = Memory::Read32(pc);
+            if (CompileBranch(instr, pc)) {
+                block.num_instructions++;
+                ended = true;
+                break;
+            }
+            if (!CompileInstruction(instr, pc)) {
+                break;
+            }
+            block.num_instructions++;
+        }
+
+        if (block.num_instructions > 0) {
+            if (!ended) {
+                EmitExit(addr + block.num_instructions * 4);
+            }
+            bail_offset = (u32)(emitter.GetCodePtr() - entry);
+            emitter.MOV_Imm(RAX, addr);
+            emitter.RET();
+        }
+    }
+
+    // Translated instructions don't access memory, there are no wait states to add
+    for (u32 i = 0; i < block.num_instructions; i++) {
+        block.num_cycles += CycleModel::GetInstructionCycles(Memory::Read32(addr + i * 4));
+    }
+
+    if (block.num_instructions > 0) {
+        u8* end = emitter.GetCodePtr();
+        emitter.SetCodePtr(entry, end - entry);
+        EmitPrologue(addr, block.num_instructions, block.num_cycles, entry + bail_offset);
+        block.entry = (BlockFunc)entry;
+        block.code_size = (u32)(end - entry);
+        block.exits = block_exits;
+        code_cache.EndBlock(entry, block.code_size);
+
+        if (loaded) {
+            DEBUG_LOG(DYNA_REC, "loaded block at 0x%08X (%d instructions)", addr,
+                block.num_instructions);
+        } else {
+            StoreTranslation(addr, block, end - entry, bail_offset, block_exits);
+            DEBUG_LOG(DYNA_REC, "compiled block at 0x%08X (%d instructions)", addr,
+                block.num_instructions);
+        }
+        LinkExits(entry, block_exits);
+        PatchExits(addr, entry);
+    }
+
+    // Empty blocks are tracked as well, the code might become translatable once it's rewritten
+    const u32 last_page = (addr + GetBlockSize(block) - 1) >> Memory::PAGE_BITS;
+    for (u32 page = addr >> Memory::PAGE_BITS; page <= last_page; page++) {
+        page_blocks[page].push_back(addr);
+    }
+    return block;
+}
+
+/**
+ * Appends a block just translated to the translation cache, if it is of ExeFS code
+ * @param addr Guest address of the first instruction
+ * @param block Block
+ * @param size Size of the host code in bytes
+ * @param bail_offset Offset of the code returning to the dispatcher
+ * @param exits Exits of the block, still unlinked in its code
+ */
+void ARM_JIT::StoreTranslation(u32 addr, const Block& block, size_t size, u32 bail_offset,
+    const std::vector<Exit>& exits) {
+    TranslationKey key;
+    if (!translation_cache_open ||
+        !HashCodePages(addr, block.num_instructions * 4, &key.page_hash)) {
+        return;
+    }
+    key.title_id = title_id;
+    key.pc = addr;
+    key.version = TRANSLATION_VERSION;
+
+    // The translated code only addresses guest state relative to its argument, and its exits
+    // are patched once it's placed, so it can run from anywhere in the code space
+    TranslationHeader header;
+    header.num_instructions = block.num_instructions;
+    header.bail_offset = bail_offset;
+    header.num_exits = (u32)exits.size();
+    const size_t code_offset = sizeof(header) + exits.size() * sizeof(Exit);
+    std::vector<u8> value(code_offset + size);
+    memcpy(value.data(), &header, sizeof(header));
+    if (!exits.empty()) {
+        memcpy(value.data() + sizeof(header), exits.data(), exits.size() * sizeof(Exit));
+    }
+    memcpy(value.data() + code_offset, (const void*)block.entry, size);
+    translation_cache.Append(key, value.data(), (u32)value.size());
+
+    // Stays valid until its pages are written over, which drops the block below in Compile
+    CachedBlock& cached = cached_blocks[addr];
+    cached.num_instructions = block.num_instructions;
+    cached.bail_offset = bail_offset;
+    cached.exits = exits;
+    cached.code.assign(value.begin() + code_offset, value.end());
+    const u32 last_page = (addr + block.num_instructions * 4 - 1) >> Memory::PAGE_BITS;
+    for (u32 page = addr >> Memory::PAGE_BITS; page <= last_page; page++) {
+        cached_page_blocks[page].push_back(addr);
+    }
+}
+
+/**
+ * Emits host code for a single ARM instruction
+ * @param instr ARM instruction word
+ * @param pc Guest address of the instruction
+ * @return True if the instruction was translated, false if it must be interpreted
+ */
+bool ARM_JIT::CompileInstruction(u32 instr, u32 pc) {
+    if (!IsTranslatable(instr)) {
+        return false;
+    }
+    bool imm = (instr & (1 << 25)) != 0;
+    int opcode = (instr >> 21) & 0xF;
+    int rn = (instr >> 16) & 0xF;
+    int rd = (instr >> 12) & 0xF;
+
+    const X64Reg base = ABI_PARAM1;
+
+    // Operand 2 -> EDX
+    if (imm) {
+        u32 value = instr & 0xFF;
+        u32 rotate = ((instr >> 8) & 0xF) * 2;
+        if (rotate != 0) {
+            value = (value >> rotate) | (value << (32 - rotate));
+        }
+        emitter.MOV_Imm(RDX, value);
+    } else {
+        int rm = instr & 0xF;
+        int shift_type = (instr >> 5) & 3;
+        u8 amount = (instr >> 7) & 0x1F;
+
+        if (rm == 15) {
+            emitter.MOV_Imm(RDX, pc + 8);
+        } else {
+            emitter.MOV_Load(RDX, base, RegOffset(rm));
+        }
+        switch (shift_type) {
+        case 0: // LSL
+            if (amount != 0) {
+                emitter.SHIFT_Imm(SHIFT_SHL, RDX, amount);
+            }
+            break;
+        case 1: // LSR, #0 encodes #32
+            if (amount == 0) {
+                emitter.MOV_Imm(RDX, 0);
+            } else {
+                emitter.SHIFT_Imm(SHIFT_SHR, RDX, amount);
+            }
+            break;
+        case 2: // ASR, #0 encodes #32
+            emitter.SHIFT_Imm(SHIFT_SAR, RDX, amount == 0 ? 31 : amount);
+            break;
+        case 3: // ROR
+            emitter.SHIFT_Imm(SHIFT_ROR, RDX, amount);
+            break;
+        }
+    }
+
+    if (opcode == OP_MOV || opcode == OP_MVN) {
+        if (opcode == OP_MVN) {
+            emitter.NOT(RDX);
+        }
+        emitter.MOV_Store(base, RegOffset(rd), RDX);
+        return true;
+    }
+
+    // Operand 1 -> EAX
+    if (rn == 15) {
+        emitter.MOV_Imm(RAX, pc + 8);
+    } else {
+        emitter.MOV_Load(RAX, base, RegOffset(rn));
+    }
+
+    switch (opcode) {
+    case OP_AND: emitter.ALU_Reg(ALU_AND, RAX, RDX); break;
+    case OP_EOR: emitter.ALU_Reg(ALU_XOR, RAX, RDX); break;
+    case OP_SUB: emitter.ALU_Reg(ALU_SUB, RAX, RDX); break;
+    case OP_ADD: emitter.ALU_Reg(ALU_ADD, RAX, RDX); break;
+    case OP_ORR: emitter.ALU_Reg(ALU_OR,  RAX, RDX); break;
+    case OP_BIC:
+        emitter.NOT(RDX);
+        emitter.ALU_Reg(ALU_AND, RAX, RDX);
+        break;
+    case OP_RSB:
+        emitter.ALU_Reg(ALU_SUB, RDX, RAX);
+        emitter.MOV_Store(base, RegOffset(rd), RDX);
+        return true;
+    }
+    emitter.MOV_Store(base, RegOffset(rd), RAX);
+    return true;
+}
+
+/**
+ * Executes the given number of instructions
+ * @param num_instructions Number of instructions to executes
+ * @return Number of instructions executed, fewer than requested after PrepareReschedule
+ */
+int ARM_JIT::ExecuteInstructions(int num_instructions) {
+    // Translated blocks don't report their instructions to the execution trace
+    if (ExecTrace::IsEnabled()) {
+        return ARM_Interpreter::ExecuteInstructions(num_instructions);
+    }
+
+    int executed = 0;
+    int interpreter_runs = 0; // Interpreter runs since the last translated block
+
+    reschedule_pending = false;
+    state->DebugStop = 0;
+    while (executed < num_instructions && !reschedule_pending && !state->DebugStop) {
+        // Code that keeps missing blocks, such as a loop of loads and stores, is better off in
+        // the interpreter for the rest of the slice. Thumb code is never translated, it runs until
+        // it may have switched back to ARM.
+        if (++interpreter_runs > MAX_INTERPRETER_RUNS) {
+            executed += ARM_Interpreter::ExecuteInstructions(num_instructions - executed);
+            break;
+        }
+        int run = std::min(num_instructions - executed, (int)MAX_BLOCK_INSTRUCTIONS);
+        if (!state->TFlag) {
+            u32 pc = GetNextPC();
+            const Block* block = LookupBlock(pc);
+            if (block != nullptr) {
+                // Guest code may have been overwritten since the block was translated
+                InvalidateDirtyPages(pc, GetBlockSize(*block));
+                block = LookupBlock(pc);
+            }
+            if (block == nullptr) {
+                block = &Compile(pc);
+            }
+
+            if (block->entry != nullptr) {
+                const int remaining = num_instructions - executed;
+                if ((int)block->num_instructions > remaining) {
+                    // Block doesn't fit in what's left of the slice, let the interpreter finish
+                    // it rather than translating a second block from the middle of this one
+                    return executed + ARM_Interpreter::ExecuteInstructions(remaining);
+                }
+                // Blocks account for their instructions and cycles themselves, and run on into
+                // the blocks they're linked to while those fit in what's left
+                state->JITDowncount = remaining;
+                const u32 next_pc = block->entry(state);
+                ResumeAt(next_pc);
+                if (state->JITDowncount != remaining) {
+                    executed += remaining - state->JITDowncount;
+                    interpreter_runs = 0;
+                    continue;
+                }
+                // The block left its first instruction to the interpreter, e.g. a BX to Thumb
+            }
+            run = std::min(run, (int)block->num_interpreted);
+        }
+        // Every call to the interpreter has a setup cost, it runs what can't be translated at once
+        executed += ARM_Interpreter::ExecuteInstructions(run);
+    }
+    return executed;
+}
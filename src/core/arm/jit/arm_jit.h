@@ -0,0 +1,259 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "common/code_cache.h"
+#include "common/common.h"
+#include "common/linear_disk_cache.h"
+
+#include "core/arm/interpreter/arm_interpreter.h"
+#include "common/x64_emitter.h"
+
+/**
+ * ARM11 CPU core that translates guest basic blocks into host x86-64 code. Instructions the
+ * translator does not understand are handed to the underlying interpreter one at a time, so the
+ * JIT can grow coverage incrementally without ever losing accuracy.
+ *
+ * A block ends in an exit to the guest address that follows it, or to the target of the B, BL or
+ * BX LR it ends with. Exits to a translated block jump straight to it, they are patched when that
+ * block is translated and dropped. BL pushes its return address on a small return stack, so BX LR
+ * returns to the block after it without the dispatcher. Everything else goes back to the
+ * dispatcher, which finds the next block through a direct mapped table before the block cache.
+ *
+ * Code lives in a Common::CodeCache. Blocks dropped after their guest code changed free their
+ * code, which is reused once the rest of its region is dropped too, so the code space is only
+ * flushed as a whole when it runs out of regions or over the TAG_JIT_CODE budget.
+ */
+class ARM_JIT : public ARM_Interpreter {
+public:
+
+    ARM_JIT();
+    ~ARM_JIT();
+
+    /// Throws away all translated code (e.g. after guest code has been modified)
+    void ClearCache();
+
+    /// Stops the current Run() at the end of the instruction being executed (e.g. from an SVC)
+    void PrepareReschedule();
+
+    /**
+     * Keeps the blocks translated from ExeFS code on disk, reusing those of earlier runs whose
+     * code pages are unchanged in g_exefs_code
+     * @param filename Path of the translation cache file
+     * @param title_id Identity of the title loaded, entries of other titles are ignored
+     */
+    void OpenTranslationCache(const std::string& filename, u64 title_id);
+
+    /// Translates up front all of the code the translation cache has valid blocks for
+    void WarmUp();
+
+protected:
+
+    /**
+     * Executes the given number of instructions
+     * @param num_instructions Number of instructions to executes
+     * @return Number of instructions executed, fewer than requested after PrepareReschedule
+     */
+    int ExecuteInstructions(int num_instructions);
+
+private:
+
+    /**
+     * Host code of a block, which runs it and the blocks it's linked to
+     * @param state ARM core state, its JITDowncount the number of instructions left to run
+     * @return Guest address of the next instruction to execute
+     */
+    typedef u32 (*BlockFunc)(ARMul_State* state);
+
+    enum {
+        LOOKUP_TABLE_SIZE = 4096,   ///< Entries of the table in front of block_cache
+    };
+
+    /// Kinds of the patchable exits of a block
+    enum ExitKind {
+        EXIT_JUMP,          ///< 5 bytes, mov eax, target; ret or jmp to the block at target
+        EXIT_RETURN_CODE,   ///< 8 bytes, immediate of the host code a BL pushes, 0 if unknown
+    };
+
+    /// Patchable exit of a block
+    struct Exit {
+        u32         offset;             ///< Offset of the exit from the block entry
+        u32         target;             ///< Guest address the exit goes to
+        u32         kind;               ///< ExitKind
+    };
+
+    /// A translated run of guest instructions
+    struct Block {
+        BlockFunc   entry;              ///< Host code, or nullptr if nothing could be translated
+        u32         num_instructions;   ///< Number of guest instructions covered by the block
+        u32         num_cycles;         ///< CycleModel cost of the instructions
+        u32         code_size;          ///< Bytes of the host code in code_cache
+        u32         num_interpreted;    ///< Instructions the interpreter runs at once from here
+        std::vector<Exit> exits;        ///< Exits of the host code, registered by LinkExits
+    };
+
+    /// Key of a block in the translation cache
+    struct TranslationKey {
+        u64         title_id;
+        u64         page_hash;          ///< Hash of the guest code pages the block covers
+        u32         pc;                 ///< Guest address of the first instruction
+        u32         version;            ///< Layout of the translated code, TRANSLATION_VERSION
+    };
+
+    /// Start of a translation cache entry, followed by the exits and the host code
+    struct TranslationHeader {
+        u32         num_instructions;
+        u32         bail_offset;        ///< Offset of the code returning to the dispatcher
+        u32         num_exits;
+    };
+
+    /// Block of the translation cache, valid for the current contents of its code pages
+    struct CachedBlock {
+        u32                 num_instructions;
+        u32                 bail_offset;    ///< Offset of the code returning to the dispatcher
+        std::vector<Exit>   exits;
+        std::vector<u8>     code;           ///< Host code with unlinked exits, position independent
+    };
+
+    /// Entry of the direct mapped table in front of block_cache
+    struct LookupEntry {
+        u32             pc;
+        const Block*    block;              ///< Block at pc, nullptr if the entry is empty
+    };
+
+    /**
+     * Translates the guest block starting at the given address
+     * @param addr Guest address of the first instruction
+     * @return Reference to the (possibly empty) block stored in the cache
+     */
+    const Block& Compile(u32 addr);
+
+    /// Returns the number of guest bytes a block depends on (at least its first instruction)
+    static u32 GetBlockSize(const Block& block);
+
+    /**
+     * Finds the block starting at a guest address, if it was translated
+     * @param addr Guest address of the first instruction
+     * @return The block, nullptr if it isn't in the cache
+     */
+    const Block* LookupBlock(u32 addr);
+
+    /**
+     * Emits the checks and cycle accounting a block starts with, always of the same size
+     * @param addr Guest address of the first instruction
+     * @param num_instructions Number of guest instructions of the block
+     * @param num_cycles CycleModel cost of the instructions
+     * @param bail Code returning to the dispatcher when the block can't run
+     */
+    void EmitPrologue(u32 addr, u32 num_instructions, u32 num_cycles, const u8* bail);
+
+    /**
+     * Emits a patchable exit to a guest address
+     * @param target Guest address of the next instruction
+     */
+    void EmitExit(u32 target);
+
+    /**
+     * Emits a B, BL or BX LR as the end of a block
+     * @param instr ARM instruction word
+     * @param pc Guest address of the instruction
+     * @return True if the instruction was translated, false if it isn't one of those
+     */
+    bool CompileBranch(u32 instr, u32 pc);
+
+    /**
+     * Registers the exits of a block just placed in the code space, linking those to translated
+     * blocks
+     * @param entry Host code of the block
+     * @param exits Exits of the block
+     */
+    void LinkExits(u8* entry, const std::vector<Exit>& exits);
+
+    /**
+     * Patches the exits to a guest address, pointing them at the block translated there or
+     * back at the dispatcher
+     * @param addr Guest address of the block
+     * @param entry Host code of the block, nullptr to unlink the exits
+     */
+    void PatchExits(u32 addr, const u8* entry);
+
+    /**
+     * Removes the exits of a block from jump_exits and return_exits, before its code is freed
+     * @param block Block
+     */
+    void UnlinkExitsOf(const Block& block);
+
+    /**
+     * Removes a block from block_cache and the lookup table, unlinking the exits to it and
+     * freeing its code
+     * @param addr Guest address of the block
+     */
+    void DropBlock(u32 addr);
+
+    /**
+     * Drops the blocks of every page in a guest range that was written since it was translated
+     * @param addr Guest address of the range
+     * @param size Size of the range in bytes
+     */
+    void InvalidateDirtyPages(u32 addr, u32 size);
+
+    /**
+     * Emits host code for a single ARM instruction
+     * @param instr ARM instruction word
+     * @param pc Guest address of the instruction
+     * @return True if the instruction was translated, false if it must be interpreted
+     */
+    bool CompileInstruction(u32 instr, u32 pc);
+
+    /**
+     * Appends a block just translated to the translation cache, if it is of ExeFS code
+     * @param addr Guest address of the first instruction
+     * @param block Block
+     * @param size Size of the host code in bytes
+     * @param bail_offset Offset of the code returning to the dispatcher
+     * @param exits Exits of the block, still unlinked in its code
+     */
+    void StoreTranslation(u32 addr, const Block& block, size_t size, u32 bail_offset,
+        const std::vector<Exit>& exits);
+
+    /// Returns the guest address of the next instruction the core will execute
+    u32 GetNextPC() const;
+
+    /**
+     * Points the interpreter pipeline at a new guest address
+     * @param addr Guest address to continue execution from
+     */
+    void ResumeAt(u32 addr);
+
+    std::unordered_map<u32, Block> block_cache;   ///< Translated blocks keyed by guest address
+    LookupEntry lookup_table[LOOKUP_TABLE_SIZE];    ///< Blocks by guest address, see LookupBlock
+
+    /// Host addresses of the exits of the blocks keyed by the guest address they go to, split by
+    /// ExitKind
+    std::unordered_map<u32, std::vector<u8*>> jump_exits;
+    std::unordered_map<u32, std::vector<u8*>> return_exits;
+    u8* block_entry;                ///< Host code of the block being translated
+    std::vector<Exit> block_exits;  ///< Exits of the block being translated
+
+    /// Start addresses of the blocks overlapping each guest page, keyed by page index
+    std::unordered_map<u32, std::vector<u32>> page_blocks;
+
+    /// Blocks of the translation cache keyed by guest address, and their pages as above
+    std::unordered_map<u32, CachedBlock> cached_blocks;
+    std::unordered_map<u32, std::vector<u32>> cached_page_blocks;
+
+    LinearDiskCache<TranslationKey, u8> translation_cache;
+    bool translation_cache_open;
+    u64 title_id;       ///< Title the translation cache is open for
+
+    JIT::X64Emitter emitter;
+
+    Common::CodeCache code_cache;   ///< Executable memory holding translated code
+
+    bool reschedule_pending;    ///< Set by PrepareReschedule to end ExecuteInstructions early
+};
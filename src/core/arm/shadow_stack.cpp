@@ -0,0 +1,114 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "core/arm/shadow_stack.h"
+
+namespace ShadowStack {
+
+std::atomic<bool> g_enabled(false);
+
+namespace {
+
+std::atomic<bool>                               g_clear_pending(false); ///< Set when turned on
+std::unordered_map<Handle, std::vector<Frame>>  g_stacks;               ///< By thread
+std::vector<Frame>*                             g_current = nullptr;    ///< Of the current thread
+Handle                                          g_current_thread = 0;
+
+/// Gets the stack of the current thread, creating it if need be
+std::vector<Frame>& GetCurrent() {
+    if (g_clear_pending.exchange(false)) {
+        g_stacks.clear();
+        g_current = nullptr;
+    }
+    if (g_current == nullptr) {
+        g_current = &g_stacks[g_current_thread];
+        g_current->reserve(MAX_DEPTH);
+    }
+    return *g_current;
+}
+
+} // namespace
+
+/**
+ * Accounts an instruction that wrote the PC, called from the CPU core when enabled
+ * @param address Address of the instruction
+ * @param target New PC
+ * @param lr LR after the instruction
+ * @param sp SP after the instruction
+ */
+void OnBranch(u32 address, u32 target, u32 lr, u32 sp) {
+    std::vector<Frame>& stack = GetCurrent();
+
+    // Calls leave LR right after themselves, with bit 0 set in Thumb code. With MOV LR, PC
+    // before a load of the PC, that's after the load as well.
+    if (lr == address + 4 || lr == ((address + 2) | 1)) {
+        if (stack.size() >= MAX_DEPTH) {
+            stack.erase(stack.begin(), stack.begin() + MAX_DEPTH / 2);
+        }
+        const Frame frame = { address, target, lr, sp };
+        stack.push_back(frame);
+        return;
+    }
+
+    // Returns go back to one of the last callers, exception handlers and longjmp skipping the
+    // frames in between
+    const size_t end = stack.size() > MAX_RETURN_SCAN ? stack.size() - MAX_RETURN_SCAN : 0;
+    for (size_t i = stack.size(); i > end; i--) {
+        if ((stack[i - 1].return_address & ~1) == (target & ~1)) {
+            stack.resize(i - 1);
+            return;
+        }
+    }
+}
+
+/**
+ * Turns the shadow stacks on or off, thread-safe. Frames are only recorded while on, the stacks
+ * start out empty each time they are turned on.
+ * @param enabled Whether the CPU core keeps the stacks
+ */
+void SetEnabled(bool enabled) {
+    if (enabled && !g_enabled.load()) {
+        // Cleared by the emulation thread, the first time it touches the stacks
+        g_clear_pending.store(true);
+    }
+    g_enabled.store(enabled);
+}
+
+/**
+ * Makes the stack of a thread the current one, as it's switched to
+ * @param thread Handle of the thread
+ */
+void SwitchThread(Handle thread) {
+    g_current_thread = thread;
+    g_current = nullptr;
+}
+
+/**
+ * Throws away the stack of a thread that exited or restarted
+ * @param thread Handle of the thread
+ */
+void ResetThread(Handle thread) {
+    g_stacks.erase(thread);
+    g_current = nullptr;
+}
+
+/**
+ * Gets the call stack of the current thread. Must not be called while the CPU runs.
+ * @return Frames, outermost first
+ */
+const std::vector<Frame>& GetFrames() {
+    return GetCurrent();
+}
+
+/// Throws away all stacks
+void Clear() {
+    g_stacks.clear();
+    g_current = nullptr;
+}
+
+} // namespace
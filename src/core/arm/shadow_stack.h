@@ -0,0 +1,80 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+/**
+ * Shadow call stacks of the guest threads, kept by the CPU core as a debug feature so that their
+ * call stacks can be shown without scanning the guest stacks. Every instruction that writes the
+ * PC is looked at: it is a call if it left LR pointing right after itself, and a return if it
+ * branched to the return address of one of the last frames. Both CPU backends go through the
+ * interpreter for PC writes, so this catches them all.
+ */
+namespace ShadowStack {
+
+/// Call of a function
+struct Frame {
+    u32 call_address;       ///< Address of the calling instruction
+    u32 function;           ///< Address called, bit 0 set for Thumb code
+    u32 return_address;     ///< Value of LR after the call, bit 0 set for Thumb code
+    u32 sp;                 ///< Stack pointer at the call
+};
+
+enum {
+    MAX_DEPTH           = 1024,     ///< Deeper stacks lose their outermost frames
+    MAX_RETURN_SCAN     = 16,       ///< Frames a return can pop at once, for longjmp and such
+};
+
+extern std::atomic<bool> g_enabled;
+
+/**
+ * Accounts an instruction that wrote the PC, called from the CPU core when enabled
+ * @param address Address of the instruction
+ * @param target New PC
+ * @param lr LR after the instruction
+ * @param sp SP after the instruction
+ */
+void OnBranch(u32 address, u32 target, u32 lr, u32 sp);
+
+/**
+ * Turns the shadow stacks on or off, thread-safe. Frames are only recorded while on, the stacks
+ * start out empty each time they are turned on.
+ * @param enabled Whether the CPU core keeps the stacks
+ */
+void SetEnabled(bool enabled);
+
+/// Tells whether the CPU core keeps the stacks
+inline bool IsEnabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * Makes the stack of a thread the current one, as it's switched to
+ * @param thread Handle of the thread
+ */
+void SwitchThread(Handle thread);
+
+/**
+ * Throws away the stack of a thread that exited or restarted
+ * @param thread Handle of the thread
+ */
+void ResetThread(Handle thread);
+
+/**
+ * Gets the call stack of the current thread. Must not be called while the CPU runs.
+ * @return Frames, outermost first
+ */
+const std::vector<Frame>& GetFrames();
+
+/// Throws away all stacks
+void Clear();
+
+} // namespace
@@ -0,0 +1,175 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "common/common.h"
+#include "common/log.h"
+#include "common/thread.h"
+#include "common/timer.h"
+
+#include "core/audio_output.h"
+#include "core/time_stretcher.h"
+#include "core/hle/dsp/dsp.h"
+
+namespace AudioOutput {
+
+namespace {
+
+/// Samples kept buffered ahead of the device at full speed, a few audio frames
+const u32 kTargetLatencyMs = 50;
+
+/// Time the tempo takes to follow a change of the emulation speed, in device time
+const float kTempoResponseSeconds = 0.25f;
+
+/// Sink without a device, which takes the samples at real time and discards them
+class NullSink : public Sink {
+public:
+    NullSink() : m_thread(nullptr), m_quit(false) {}
+
+    const char* GetName() const {
+        return "null";
+    }
+
+    void Start() {
+        m_quit = false;
+        m_thread = new std::thread(&NullSink::ThreadFunc, this);
+    }
+
+    void Stop() {
+        m_quit = true;
+        m_thread->join();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+private:
+    void ThreadFunc() {
+        Common::SetCurrentThreadName("Null audio sink");
+        Common::SetCurrentThreadPriority(Common::PRIORITY_REALTIME);
+
+        static const size_t kChunk = DSP::SAMPLES_PER_FRAME;
+        s16 samples[kChunk * 2];
+        const u64 start = Common::Timer::GetTimeUs();
+        u64 played = 0;
+        while (!m_quit) {
+            Common::SleepCurrentThread(10);
+            const u64 due = (Common::Timer::GetTimeUs() - start) * DSP::SAMPLE_RATE / 1000000;
+            while (played < due) {
+                const size_t count = (size_t)std::min<u64>(due - played, kChunk);
+                Fill(samples, count);
+                played += count;
+            }
+        }
+    }
+
+    std::thread*    m_thread;
+    volatile bool   m_quit;
+};
+
+Sink* CreateNullSink() {
+    return new NullSink;
+}
+
+Sink*               g_sink = nullptr;
+bool                g_started = false;
+TimeStretcher       g_stretcher(DSP::SAMPLE_RATE);  ///< Only used by the thread of the sink
+float               g_tempo = 1.0f;
+std::atomic<float>  g_reported_tempo(1.0f);
+
+} // namespace
+
+std::string g_sink_backend = "null";
+
+/**
+ * Gets the sink backends Init creates the sink from, "null" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+SinkBackendRegistry& GetSinkBackends() {
+    static SinkBackendRegistry registry;
+    if (registry.GetBackends().empty()) {
+        const SinkBackendRegistry::Backend null = {
+            "null", "Takes the samples at real time and discards them", 0, CreateNullSink
+        };
+        registry.Register(null);
+    }
+    return registry;
+}
+
+/**
+ * Sets the sink Init starts, before Init, instead of creating one of g_sink_backend
+ * @param sink Sink, owned by the module from now on
+ */
+void SetSink(Sink* sink) {
+    delete g_sink;
+    g_sink = sink;
+}
+
+/// Starts the sink
+void Init() {
+    if (g_sink == nullptr) {
+        const SinkBackendRegistry& registry = GetSinkBackends();
+        const SinkBackendRegistry::Backend* backend = registry.Find(g_sink_backend);
+        if (backend == nullptr) {
+            ERROR_LOG(AUDIO, "unknown audio backend %s, one of %s, using null",
+                g_sink_backend.c_str(), registry.GetNames().c_str());
+            backend = registry.Find("null");
+        }
+        g_sink = backend->create();
+    }
+    g_stretcher.Clear();
+    g_tempo = 1.0f;
+    g_reported_tempo = 1.0f;
+    g_sink->Start();
+    g_started = true;
+
+    NOTICE_LOG(AUDIO, "%s audio sink started", g_sink->GetName());
+}
+
+/// Stops the sink
+void Shutdown() {
+    if (!g_started) {
+        return;
+    }
+    g_sink->Stop();
+    g_started = false;
+}
+
+/**
+ * Gives the device the next samples, from the thread of the sink only. Never blocks.
+ * @param samples Receives the samples, left and right interleaved, 2 * count values
+ * @param count Number of samples the device needs, silence for the ones that aren't mixed yet
+ */
+void Fill(s16* samples, size_t count) {
+    s16 mixed[DSP::SAMPLES_PER_FRAME * 2];
+    size_t taken;
+    while ((taken = DSP::ReadSamples(mixed, DSP::SAMPLES_PER_FRAME)) != 0) {
+        g_stretcher.PushSamples(mixed, taken);
+    }
+
+    // The backlog settles where the tempo matches the speed samples come in at: above the target
+    // while the emulation runs fast, below while it runs slow
+    const float target = DSP::SAMPLE_RATE * kTargetLatencyMs / 1000.0f;
+    const float wanted = g_stretcher.GetBacklog() / target;
+    const float response = std::min(1.0f, count / (DSP::SAMPLE_RATE * kTempoResponseSeconds));
+    g_tempo += (wanted - g_tempo) * response;
+    g_stretcher.SetTempo(g_tempo);
+    g_tempo = g_stretcher.GetTempo();
+    g_reported_tempo.store(g_tempo, std::memory_order_relaxed);
+
+    const size_t played = g_stretcher.PopSamples(samples, count);
+    memset(&samples[played * 2], 0, (count - played) * 2 * sizeof(s16));
+}
+
+/**
+ * Gets the tempo the samples play at, from any thread
+ * @return Emulated samples played per device sample, about the emulation speed
+ */
+float GetTempo() {
+    return g_reported_tempo.load(std::memory_order_relaxed);
+}
+
+} // namespace
@@ -0,0 +1,79 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "common/common_types.h"
+#include "common/factory_registry.h"
+
+/**
+ * Plays the samples the DSP mixes on a host audio device. The device takes samples from its own
+ * thread, out of the lock-free ring the audio thread fills, so the emulation never waits on it.
+ * When the emulation runs slower or faster than real time the samples are time-stretched to
+ * the speed the device takes them at, keeping their pitch, rather than running dry or piling up.
+ */
+namespace AudioOutput {
+
+/// Host audio device, which calls Fill from a thread of its own as it needs samples
+class Sink {
+public:
+    virtual ~Sink() {}
+
+    /**
+     * Gets the name of the sink, for logs
+     * @return Name, as "null"
+     */
+    virtual const char* GetName() const = 0;
+
+    /// Starts calling Fill, the device plays stereo samples at DSP::SAMPLE_RATE
+    virtual void Start() = 0;
+
+    /// Stops calling Fill, returns once the last call returned
+    virtual void Stop() = 0;
+};
+
+/// Capabilities a sink backend reports
+enum SinkCapability {
+    SINK_CAP_DEVICE     = 1 << 0,   ///< Plays on a host device rather than discarding the samples
+};
+
+typedef Common::FactoryRegistry<Sink> SinkBackendRegistry;
+
+/**
+ * Gets the sink backends Init creates the sink from, "null" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+SinkBackendRegistry& GetSinkBackends();
+
+extern std::string g_sink_backend;  ///< Name of the sink backend used by Init, "null" by default
+
+/**
+ * Sets the sink Init starts, before Init, instead of creating one of g_sink_backend
+ * @param sink Sink, owned by the module from now on
+ */
+void SetSink(Sink* sink);
+
+/// Starts the sink
+void Init();
+
+/// Stops the sink
+void Shutdown();
+
+/**
+ * Gives the device the next samples, from the thread of the sink only. Never blocks.
+ * @param samples Receives the samples, left and right interleaved, 2 * count values
+ * @param count Number of samples the device needs, silence for the ones that aren't mixed yet
+ */
+void Fill(s16* samples, size_t count);
+
+/**
+ * Gets the tempo the samples play at, from any thread
+ * @return Emulated samples played per device sample, about the emulation speed
+ */
+float GetTempo();
+
+} // namespace
@@ -0,0 +1,96 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <string>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/scm_rev.h"
+#include "common/string_util.h"
+#include "common/timer.h"
+
+#include "core/boot_snapshot.h"
+#include "core/savestate.h"
+#include "core/hle/service/hid.h"
+#include "core/hw/gpu.h"
+
+namespace BootSnapshot {
+
+namespace {
+
+std::string g_filename;     ///< Snapshot Update writes, empty if none is due
+u64         g_frame = 0;    ///< Frame count the snapshot is written at
+
+/**
+ * Gets the path of the boot snapshot of a title
+ * @param title_id Title ID of the title
+ * @param frames Number of frames into the boot the snapshot is taken at
+ */
+std::string GetPath(u64 title_id, u32 frames) {
+    const u32 build = HashFNV((const u8*)Common::g_scm_rev, (int)strlen(Common::g_scm_rev));
+    return File::GetUserPath(D_CACHE_IDX) + "boot" DIR_SEP +
+        StringFromFormat("%016llX-%u-%08X.state", (unsigned long long)title_id, frames, build);
+}
+
+} // namespace
+
+/**
+ * Loads the boot snapshot of the title just loaded, or has Update write it. Must be called
+ * between two CPU slices, before any other state is loaded.
+ * @param title_id Title ID of the title, from Loader::ReadTitleId; titles without one aren't
+ * cached
+ * @param frames Number of frames into the boot the snapshot is taken at
+ * @return True if the snapshot was loaded
+ */
+bool Start(u64 title_id, u32 frames) {
+    g_filename.clear();
+    if (frames == 0) {
+        return false;
+    }
+    if (title_id == 0) {
+        WARN_LOG(COMMON, "the title has no title ID, its boot isn't cached");
+        return false;
+    }
+
+    const std::string path = GetPath(title_id, frames);
+    if (File::Exists(path) && SaveState::Load(path)) {
+        HID_User::SetPadState(0);
+        NOTICE_LOG(COMMON, "booted from the snapshot at frame %u", frames);
+        return true;
+    }
+    g_filename = path;
+    g_frame = GPU::GetFrameCount() + frames;
+    return false;
+}
+
+/// Writes the boot snapshot once its frame is reached, called between two CPU slices
+void Update() {
+    if (g_filename.empty() || GPU::GetFrameCount() < g_frame) {
+        return;
+    }
+
+    // Written under a name of its own first, so that runs of the title starting meanwhile never
+    // load a snapshot half written
+    const std::string temp_filename = g_filename +
+        StringFromFormat(".%llu.tmp", (unsigned long long)Common::Timer::GetTimeUs());
+    File::CreateFullPath(g_filename);
+    if (SaveState::Save(temp_filename) && File::Rename(temp_filename, g_filename)) {
+        NOTICE_LOG(COMMON, "boot snapshot written to %s", g_filename.c_str());
+    } else {
+        // Another run of the title may have written it first
+        File::Delete(temp_filename);
+        WARN_LOG(COMMON, "couldn't write the boot snapshot %s", g_filename.c_str());
+    }
+    g_filename.clear();
+}
+
+/// Drops a boot snapshot that wasn't written yet
+void Shutdown() {
+    g_filename.clear();
+}
+
+} // namespace
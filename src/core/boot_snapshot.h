@@ -0,0 +1,35 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Cache of savestates taken a number of frames into the boot of titles, so that runs of a title
+ * that don't care about its startup, e.g. batch benchmarks, skip its logos and loading. The first
+ * run of a title writes the savestate once the frames have run, later runs of the title load it
+ * right after the title is loaded. Savestates are keyed by title ID, number of frames and build,
+ * so that a new build boots the title again rather than load a state it may not read properly.
+ * Runs from a snapshot start with no button held, whatever the run that wrote it held.
+ */
+namespace BootSnapshot {
+
+/**
+ * Loads the boot snapshot of the title just loaded, or has Update write it. Must be called
+ * between two CPU slices, before any other state is loaded.
+ * @param title_id Title ID of the title, from Loader::ReadTitleId; titles without one aren't
+ * cached
+ * @param frames Number of frames into the boot the snapshot is taken at
+ * @return True if the snapshot was loaded
+ */
+bool Start(u64 title_id, u32 frames);
+
+/// Writes the boot snapshot once its frame is reached, called between two CPU slices
+void Update();
+
+/// Drops a boot snapshot that wasn't written yet
+void Shutdown();
+
+} // namespace
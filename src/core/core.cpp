@@ -2,38 +2,213 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
 #include "common/common_types.h"
+#include "common/chunk_file.h"
 #include "common/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
 #include "common/symbols.h"
 
+#include "core/boot_snapshot.h"
 #include "core/core.h"
+#include "core/core_timing.h"
+#include "core/gdb_stub.h"
 #include "core/mem_map.h"
-#include "core/hw/hw.h"
+#include "core/movie.h"
+#include "core/rewind.h"
+#include "core/run_ahead.h"
+#include "core/savestate.h"
+#include "core/sys_core.h"
+#include "core/arm/cycle_model.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/interpreter/arm_interpreter.h"
+#include "core/arm/interpreter/decode_cache.h"
+#include "core/arm/interpreter/idle_loop.h"
+#include "core/arm/jit/arm_jit.h"
 
+#include "core/hle/hle.h"
 #include "core/hle/kernel/thread.h"
 
 namespace Core {
 
+std::string     g_cpu_backend = "interpreter"; ///< Name of the CPU backend used by Init
+bool            g_translation_cache_enabled = false; ///< Keep translated code on disk
+bool            g_warm_up_enabled = false;  ///< Prefetch the image, translate cached code at load
+
 ARM_Disasm*     g_disasm    = NULL; ///< ARM disassembler
 ARM_Interface*  g_app_core  = NULL; ///< ARM11 application core
 ARM_Interface*  g_sys_core  = NULL; ///< ARM11 system (OS) core
 
+BreakPoints*    g_breakpoints = NULL;   ///< Code breakpoints the CPU stops at, NULL if none
+MemChecks*      g_memchecks   = NULL;   ///< Memory watchpoints, NULL if none
+
+/// Average cost of an app core instruction over the last slice, in 1/16 cycles
+static u32 g_instruction_cost = 16;
+
+/// Set by Stop, from any thread, for RunLoop to return
+static std::atomic<bool> g_stop_requested(false);
+
+static Common::Profiler::Category g_profile_cpu("CPU");
+static Common::Profiler::Category g_profile_core_timing("CoreTiming");
+static Common::PerfCounters::Region g_perf_cpu("CPU");
+
+/**
+ * Accounts the cycles the CPU ran since start, skips idle time, dispatches any CoreTiming events
+ * that are due and switches threads if HLE asked for a reschedule
+ * @param start_ticks Ticks of the app core before the slice ran
+ * @param start_instructions Number of instructions executed before the slice ran
+ * @param sys_start_ticks Ticks of the sys core before the slice ran
+ */
+static void EndSlice(u64 start_ticks, u64 start_instructions, u64 sys_start_ticks) {
+    // Sync point with the sys core, nothing it does may cross an event boundary
+    SysCore::EndSlice();
+    const u64 sys_cycles = g_sys_core->GetTicks() - sys_start_ticks;
+
+    const u64 cycles = g_app_core->GetTicks() - start_ticks;
+    const u64 instructions = g_app_core->GetNumInstructions() - start_instructions;
+    if (instructions > 0) {
+        g_instruction_cost = (u32)std::max<u64>(cycles * 16 / instructions, 16);
+    }
+    CoreTiming::downcount -= (int)cycles;
+
+    // The guest is spinning in a loop that can't end before something external happens,
+    // fast-forward to the next event instead of running it
+    if (IdleLoop::g_skip_pending) {
+        IdleLoop::g_skip_pending = false;
+        // The sys core may be what the app core waits for, time skips only as far as it ran
+        CoreTiming::Idle((int)std::min<u64>(sys_cycles, INT_MAX));
+    }
+    if (CoreTiming::downcount <= 0) {
+        CoreTiming::Advance();
+    }
+    if (HLE::g_reschedule) {
+        HLE::g_reschedule = false;
+        Kernel::Reschedule();
+    }
+}
+
 /// Run the core CPU loop
 void RunLoop() {
-    for (;;){
-        g_app_core->Run(100);
-        HW::Update();
-        Kernel::Reschedule();
+    while (!g_stop_requested.load(std::memory_order_relaxed)) {
+        const bool hit = RunSlice();
+        if (GDBStub::IsAttached()) {
+            GDBStub::Update(hit);
+        }
+    }
+}
+
+/// Runs the CPU up to the next scheduled event or thread switch, without the work done between two
+/// slices
+static void RunCpuSlice() {
+    // Run about as many instructions as fit before the next scheduled event at the cost of the
+    // last slice, HLE may end the slice early to switch threads. The cores check breakpoints on
+    // their own and end the slice early at one as well.
+    u64 start_ticks = g_app_core->GetTicks();
+    u64 start_instructions = g_app_core->GetNumInstructions();
+    u64 sys_start_ticks = g_sys_core->GetTicks();
+    int instructions = std::max((int)((s64)CoreTiming::downcount * 16 / g_instruction_cost), 1);
+    SysCore::BeginSlice(instructions);
+    if (Kernel::IsIdle()) {
+        // Every thread of the app core waits, time skips to the next event, which may wake one of
+        // them up
+        IdleLoop::g_skip_pending = true;
+    } else {
+        Common::Profiler::Scope scope(g_profile_cpu);
+        Common::PerfCounters::Scope perf_scope(g_perf_cpu);
+        g_app_core->Run(instructions);
+    }
+    Common::Profiler::Scope scope(g_profile_core_timing);
+    EndSlice(start_ticks, start_instructions, sys_start_ticks);
+}
+
+/**
+ * Runs the CPU up to the next scheduled event or thread switch, one iteration of RunLoop
+ * @return True if the CPU stopped at a breakpoint or watchpoint, or a movie seek reached its frame
+ */
+bool RunSlice() {
+    RunCpuSlice();
+    bool hit = g_app_core->IsStoppedForDebugger();
+    SaveState::Update();
+    BootSnapshot::Update();
+    Rewind::Update();
+    RunAhead::Update(RunCpuSlice);
+    if (Movie::Update()) {
+        hit = true;
+    }
+    return hit;
+}
+
+/**
+ * Drops the code cached from the page of a breakpoint that was added or removed, so the CPU
+ * checks the breakpoints while it runs code of the page or stops doing so
+ * @param address Address of the breakpoint
+ */
+void InvalidateBreakPoint(u32 address) {
+    // The decode cache and the JIT lose the page as if the guest had written to it
+    Memory::MarkRangeDirty(address, 4, Memory::DIRTY_CODE | Memory::DIRTY_JIT);
+}
+
+/**
+ * Runs the watchpoints set on a data access
+ * @param state ARM core state of the core making the access
+ * @param address Guest address accessed
+ * @param value Value read or written
+ * @param size Size of the access in bytes
+ * @param write Whether the access is a write
+ */
+void HitMemCheck(ARMul_State* state, u32 address, u32 value, int size, bool write) {
+    TMemCheck* check = g_memchecks->GetMemCheck(address);
+    if (check == NULL || !(write ? check->OnWrite : check->OnRead)) {
+        return;
+    }
+    check->numHits++;
+    if (check->Log) {
+        INFO_LOG(MEMMAP, "CHK %08X %s%d %0*X at %08X", state->pc, write ? "Write" : "Read",
+            size * 8, size * 2, value, address);
+    }
+    if (check->Break) {
+        // The access completes, the core stops before the next instruction
+        state->DebugStop = 1;
     }
 }
 
 /// Step the CPU one instruction
 void SingleStep() {
-    g_app_core->Step();
-    HW::Update();
-    Kernel::Reschedule();
+    u64 start_ticks = g_app_core->GetTicks();
+    u64 start_instructions = g_app_core->GetNumInstructions();
+    if (Kernel::IsIdle()) {
+        IdleLoop::g_skip_pending = true;
+    } else {
+        g_app_core->Step();
+    }
+    EndSlice(start_ticks, start_instructions, g_sys_core->GetTicks());
+}
+
+/**
+ * Saves or loads the state of the cores, the registers of the threads they run
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("Core", 2);
+    if (!s) {
+        return;
+    }
+    ThreadContext context;
+    ThreadContext sys_context;
+    g_app_core->SaveContext(context);
+    g_sys_core->SaveContext(sys_context);
+    p.Do(context);
+    p.Do(sys_context);
+    p.Do(g_instruction_cost);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // The contexts go away on return, the cores can't load their VFP registers lazily
+        g_app_core->LoadTransientContext(context);
+        g_sys_core->LoadTransientContext(sys_context);
+    }
 }
 
 /// Halt the core
@@ -41,26 +216,81 @@ void Halt(const char *msg) {
     // TODO(ShizZy): ImplementMe
 }
 
-/// Kill the core
+/// Makes RunLoop return after the slice being run, callable from any thread
 void Stop() {
-    // TODO(ShizZy): ImplementMe
+    g_stop_requested.store(true, std::memory_order_relaxed);
+}
+
+static ARM_Interface* CreateInterpreter() {
+    return new ARM_Interpreter();
+}
+
+static ARM_Interface* CreateJIT() {
+    return new ARM_JIT();
+}
+
+/**
+ * Gets the CPU backends Init picks the app core from, "interpreter" and "jit" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+CPUBackendRegistry& GetCPUBackends() {
+    static CPUBackendRegistry registry;
+    if (registry.GetBackends().empty()) {
+        const CPUBackendRegistry::Backend interpreter = {
+            "interpreter", "SkyEye-based ARM interpreter", 0, CreateInterpreter
+        };
+        const CPUBackendRegistry::Backend jit = {
+            "jit", "x86-64 dynamic recompiler, falls back to the interpreter",
+            CPU_CAP_TRANSLATES | CPU_CAP_HOST_X64, CreateJIT
+        };
+        registry.Register(interpreter);
+        registry.Register(jit);
+    }
+    return registry;
+}
+
+/// Creates a CPU core of the configured backend, the default one if there's no such backend
+static ARM_Interface* CreateCPUCore() {
+    const CPUBackendRegistry& registry = GetCPUBackends();
+    const CPUBackendRegistry::Backend* backend = registry.Find(g_cpu_backend);
+    if (backend == NULL) {
+        ERROR_LOG(MASTER_LOG, "unknown CPU backend %s, one of %s, using interpreter",
+            g_cpu_backend.c_str(), registry.GetNames().c_str());
+        backend = registry.Find("interpreter");
+    }
+    NOTICE_LOG(MASTER_LOG, "CPU backend %s: %s", backend->name, backend->description);
+    return backend->create();
 }
 
 /// Initialize the core
 int Init() {
     NOTICE_LOG(MASTER_LOG, "initialized OK");
 
+    g_stop_requested.store(false, std::memory_order_relaxed);
+    CycleModel::Init();
+
     g_disasm = new ARM_Disasm();
-    g_app_core = new ARM_Interpreter();
+    g_app_core = CreateCPUCore();
+    // The JIT consumes the DIRTY_JIT bits of the pages it translated, a second one would miss the
+    // writes the first one saw. The sys core interprets, sharing the decode cache.
     g_sys_core = new ARM_Interpreter();
+    SysCore::Init();
 
     return 0;
 }
 
 void Shutdown() {
+    SysCore::Shutdown();
+
     delete g_disasm;
     delete g_app_core;
     delete g_sys_core;
+    g_disasm = NULL;
+    g_app_core = NULL;
+    g_sys_core = NULL;
+
+    DecodeCache::Clear();
+    IdleLoop::Clear();
 
     NOTICE_LOG(MASTER_LOG, "shutdown OK");
 }
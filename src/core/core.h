@@ -4,31 +4,102 @@
 
 #pragma once
 
+#include <string>
+
+#include "common/break_points.h"
+#include "common/factory_registry.h"
+
 #include "core/arm/arm_interface.h"
 #include "core/arm/interpreter/armdefs.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace Core {
 
+/// Capabilities a CPU backend reports
+enum CPUCapability {
+    CPU_CAP_TRANSLATES  = 1 << 0,   ///< Runs translated host code, the translation cache applies
+    CPU_CAP_HOST_X64    = 1 << 1,   ///< Only translates on x86-64 hosts, interprets elsewhere
+};
+
+typedef Common::FactoryRegistry<ARM_Interface> CPUBackendRegistry;
+
+/**
+ * Gets the CPU backends Init picks the app core from, "interpreter" and "jit" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+CPUBackendRegistry& GetCPUBackends();
+
+extern std::string      g_cpu_backend;  ///< CPU backend Init uses, "interpreter" by default
+extern bool             g_translation_cache_enabled; ///< Keep translated code on disk, see Loader
+extern bool             g_warm_up_enabled;  ///< Prefetch the image, translate cached code at load
+
 extern ARM_Interface*   g_app_core;     ///< ARM11 application core
 extern ARM_Interface*   g_sys_core;     ///< ARM11 system (OS) core
 
+extern BreakPoints*     g_breakpoints;  ///< Code breakpoints the CPU stops at, NULL if none
+extern MemChecks*       g_memchecks;    ///< Memory watchpoints, NULL if none
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /// Start the core
 void Start();
 
-/// Run the core CPU loop
+/// Run the core CPU loop, until Stop
 void RunLoop();
 
+/**
+ * Runs the CPU up to the next scheduled event or thread switch, one iteration of RunLoop
+ * @return True if the CPU stopped at a breakpoint or watchpoint, or a movie seek reached its frame
+ */
+bool RunSlice();
+
+/**
+ * Drops the code cached from the page of a breakpoint that was added or removed, so the CPU
+ * checks the breakpoints while it runs code of the page or stops doing so
+ * @param address Address of the breakpoint
+ */
+void InvalidateBreakPoint(u32 address);
+
+/**
+ * Runs the watchpoints set on a data access
+ * @param state ARM core state of the core making the access
+ * @param address Guest address accessed
+ * @param value Value read or written
+ * @param size Size of the access in bytes
+ * @param write Whether the access is a write
+ */
+void HitMemCheck(ARMul_State* state, u32 address, u32 value, int size, bool write);
+
+/**
+ * Runs the watchpoints set on a data access, a single bit test when its page has none
+ * @param state ARM core state of the core making the access
+ * @param address Guest address accessed
+ * @param value Value read or written
+ * @param size Size of the access in bytes
+ * @param write Whether the access is a write
+ */
+inline void CheckMemAccess(ARMul_State* state, u32 address, u32 value, int size, bool write) {
+    if (g_memchecks != NULL && g_memchecks->HasMemCheckInPage(address)) {
+        HitMemCheck(state, address, value, size, write);
+    }
+}
+
 /// Step the CPU one instruction
 void SingleStep();
 
+/**
+ * Saves or loads the state of the application core, the registers of the thread it runs
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
 /// Halt the core
 void Halt(const char *msg);
 
-/// Kill the core
+/// Makes RunLoop return after the slice being run, callable from any thread
 void Stop();
 
 /// Initialize the core
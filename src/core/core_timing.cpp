@@ -2,13 +2,15 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <cstdio>
 
 #include "common/msg_handler.h"
 #include "common/std_mutex.h"
-#include "common/atomic.h"
 #include "common/chunk_file.h"
+#include "common/mpsc_queue.h"
 
 #include "core/core_timing.h"
 #include "core/core.h"
@@ -35,33 +37,52 @@ struct EventType
 
 std::vector<EventType> event_types;
 
-struct BaseEvent
+// Scheduled events are kept in a 4-ary min-heap, ordered by time and then by the order they were
+// scheduled in, so that events due at the same cycle run first come first served. Every event has
+// a slot tracking where it sits in the heap, which lets a handle unschedule it in O(log n).
+struct Event
 {
     s64 time;
+    u64 order;
     u64 userdata;
     int type;
-    //	Event *next;
+    u32 slot;
 };
 
-typedef LinkedListItem<BaseEvent> Event;
+struct EventSlot
+{
+    u32 heap_index;
+    u32 generation;  // Bumped when the slot is freed, so stale handles don't match
+};
+
+const u32 HEAP_ARITY = 4;
 
-Event *first;
-Event *tsFirst;
-Event *tsLast;
+std::vector<Event> event_queue;
+std::vector<EventSlot> event_slots;
+std::vector<u32> free_event_slots;
+u64 event_order;
 
-// event pools
-Event *eventPool = 0;
-Event *eventTsPool = 0;
-int allocatedTsEvents = 0;
+// Events scheduled from other threads wait in a lock-free queue until the CPU thread moves them
+// to the heap. Posting one never blocks, and the CPU thread only has to check a flag.
+struct TsEvent : Common::MPSCQueueNode
+{
+    s64 time;
+    u64 userdata;
+    int type;
+};
+
+Common::MPSCQueue<TsEvent> tsQueue;
 // Optimization to skip MoveEvents when possible.
-volatile u32 hasTsEvents = false;
+std::atomic<u32> hasTsEvents;
 
-// Downcount has been moved to currentMIPS, to save a couple of clocks in every ARM JIT block
-// as we can already reach that structure through a register.
+// Length of the current slice and the cycles left in it. The CPU loop runs the core for
+// downcount cycles, subtracts what it actually used and calls Advance to dispatch due events.
 int slicelength;
+int downcount;
 
 MEMORY_ALIGNED16(s64) globalTimer;
 s64 idledCycles;
+u64 eventsDispatched;   // Callbacks run since Init, for the statistics
 
 static std::recursive_mutex externalEventSection;
 
@@ -80,39 +101,86 @@ int GetClockFrequencyMHz()
 }
 
 
-Event* GetNewEvent()
+inline bool EventBefore(const Event& a, const Event& b)
 {
-    if (!eventPool)
-        return new Event;
-
-    Event* ev = eventPool;
-    eventPool = ev->next;
-    return ev;
+    return a.time < b.time || (a.time == b.time && a.order < b.order);
 }
 
-Event* GetNewTsEvent()
+inline void PlaceEvent(u32 index, const Event& ev)
 {
-    allocatedTsEvents++;
+    event_queue[index] = ev;
+    event_slots[ev.slot].heap_index = index;
+}
 
-    if (!eventTsPool)
-        return new Event;
+void SiftUp(u32 index)
+{
+    const Event ev = event_queue[index];
+    while (index > 0)
+    {
+        u32 parent = (index - 1) / HEAP_ARITY;
+        if (!EventBefore(ev, event_queue[parent]))
+            break;
+        PlaceEvent(index, event_queue[parent]);
+        index = parent;
+    }
+    PlaceEvent(index, ev);
+}
 
-    Event* ev = eventTsPool;
-    eventTsPool = ev->next;
-    return ev;
+void SiftDown(u32 index)
+{
+    const Event ev = event_queue[index];
+    const u32 size = (u32)event_queue.size();
+    for (;;)
+    {
+        u32 child = index * HEAP_ARITY + 1;
+        if (child >= size)
+            break;
+        u32 best = child;
+        u32 end = std::min(child + HEAP_ARITY, size);
+        for (u32 i = child + 1; i < end; i++)
+        {
+            if (EventBefore(event_queue[i], event_queue[best]))
+                best = i;
+        }
+        if (!EventBefore(event_queue[best], ev))
+            break;
+        PlaceEvent(index, event_queue[best]);
+        index = best;
+    }
+    PlaceEvent(index, ev);
 }
 
-void FreeEvent(Event* ev)
+// Removes the event at a position of the heap and frees its slot
+Event RemoveEventAt(u32 index)
 {
-    ev->next = eventPool;
-    eventPool = ev;
+    const Event ev = event_queue[index];
+    event_slots[ev.slot].generation++;
+    free_event_slots.push_back(ev.slot);
+
+    const Event last = event_queue.back();
+    event_queue.pop_back();
+    if (index < event_queue.size())
+    {
+        PlaceEvent(index, last);
+        if (index > 0 && EventBefore(last, event_queue[(index - 1) / HEAP_ARITY]))
+            SiftUp(index);
+        else
+            SiftDown(index);
+    }
+    return ev;
 }
 
-void FreeTsEvent(Event* ev)
+// Slots of the scheduled events matching a predicate, which stay valid while removing them
+template <typename Pred>
+std::vector<u32> FindEventSlots(Pred pred)
 {
-    ev->next = eventTsPool;
-    eventTsPool = ev;
-    allocatedTsEvents--;
+    std::vector<u32> slots;
+    for (size_t i = 0; i < event_queue.size(); i++)
+    {
+        if (pred(event_queue[i]))
+            slots.push_back(event_queue[i].slot);
+    }
+    return slots;
 }
 
 int RegisterEvent(const char *name, TimedCallback callback)
@@ -137,18 +205,19 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-    if (first)
+    if (!event_queue.empty())
         PanicAlert("Cannot unregister events with events pending");
     event_types.clear();
 }
 
 void Init()
 {
-    //currentMIPS->downcount = INITIAL_SLICE_LENGTH;
-    //slicelength = INITIAL_SLICE_LENGTH;
+    downcount = INITIAL_SLICE_LENGTH;
+    slicelength = INITIAL_SLICE_LENGTH;
     globalTimer = 0;
     idledCycles = 0;
-    hasTsEvents = 0;
+    eventsDispatched = 0;
+    hasTsEvents.store(0, std::memory_order_relaxed);
 }
 
 void Shutdown()
@@ -156,28 +225,13 @@ void Shutdown()
     MoveEvents();
     ClearPendingEvents();
     UnregisterAllEvents();
-
-    while (eventPool)
-    {
-        Event *ev = eventPool;
-        eventPool = ev->next;
-        delete ev;
-    }
-
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    while (eventTsPool)
-    {
-        Event *ev = eventTsPool;
-        eventTsPool = ev->next;
-        delete ev;
-    }
+    event_slots.clear();
+    free_event_slots.clear();
 }
 
 u64 GetTicks()
 {
-    ERROR_LOG(TIME, "Unimplemented function!");
-    return 0;
-    //return (u64)globalTimer + slicelength - currentMIPS->downcount;
+    return (u64)globalTimer + slicelength - downcount;
 }
 
 u64 GetIdleTicks()
@@ -185,24 +239,23 @@ u64 GetIdleTicks()
     return (u64)idledCycles;
 }
 
+u64 GetEventsDispatched()
+{
+    return eventsDispatched;
+}
+
 
 // This is to be called when outside threads, such as the graphics thread, wants to
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    Event *ne = GetNewTsEvent();
+    TsEvent *ne = new TsEvent;
     ne->time = GetTicks() + cyclesIntoFuture;
     ne->type = event_type;
-    ne->next = 0;
     ne->userdata = userdata;
-    if (!tsFirst)
-        tsFirst = ne;
-    if (tsLast)
-        tsLast->next = ne;
-    tsLast = ne;
+    tsQueue.Push(ne);
 
-    Common::AtomicStoreRelease(hasTsEvents, 1);
+    hasTsEvents.store(1, std::memory_order_release);
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
@@ -220,138 +273,76 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-    while (first)
-    {
-        Event *e = first->next;
-        FreeEvent(first);
-        first = e;
-    }
+    while (!event_queue.empty())
+        RemoveEventAt((u32)event_queue.size() - 1);
 }
 
-void AddEventToQueue(Event* ne)
+EventHandle AddEventToQueue(s64 time, int event_type, u64 userdata)
 {
-    Event* prev = NULL;
-    Event** pNext = &first;
-    for (;;)
+    u32 slot;
+    if (free_event_slots.empty())
     {
-        Event*& next = *pNext;
-        if (!next || ne->time < next->time)
-        {
-            ne->next = next;
-            next = ne;
-            break;
-        }
-        prev = next;
-        pNext = &prev->next;
+        slot = (u32)event_slots.size();
+        EventSlot new_slot = { 0, 0 };
+        event_slots.push_back(new_slot);
     }
+    else
+    {
+        slot = free_event_slots.back();
+        free_event_slots.pop_back();
+    }
+
+    Event ne = { time, event_order++, userdata, event_type, slot };
+    event_queue.push_back(ne);
+    SiftUp((u32)event_queue.size() - 1);
+    return ((EventHandle)event_slots[slot].generation << 32) | slot;
 }
 
 // This must be run ONLY from within the cpu thread
 // cyclesIntoFuture may be VERY inaccurate if called from anything else
 // than Advance 
-void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
+EventHandle ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-    Event *ne = GetNewEvent();
-    ne->userdata = userdata;
-    ne->type = event_type;
-    ne->time = GetTicks() + cyclesIntoFuture;
-    AddEventToQueue(ne);
+    s64 time = GetTicks() + cyclesIntoFuture;
+    EventHandle handle = AddEventToQueue(time, event_type, userdata);
+
+    // Cut the current slice short if the new event is due before it ends
+    s64 sliceEnd = globalTimer + slicelength;
+    if (time < sliceEnd)
+    {
+        int cut = (int)(sliceEnd - std::max(time, (s64)GetTicks()));
+        slicelength -= cut;
+        downcount -= cut;
+    }
+    return handle;
+}
+
+// Returns cycles left in timer, 0 if the event already ran or was removed.
+s64 UnscheduleEvent(EventHandle handle)
+{
+    u32 slot = (u32)handle;
+    if (slot >= event_slots.size() || event_slots[slot].generation != (u32)(handle >> 32))
+        return 0;
+    return RemoveEventAt(event_slots[slot].heap_index).time - globalTimer;
 }
 
 // Returns cycles left in timer.
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
     s64 result = 0;
-    if (!first)
-        return result;
-    while (first)
-    {
-        if (first->type == event_type && first->userdata == userdata)
-        {
-            result = first->time - globalTimer;
-
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!first)
-        return result;
-    Event *prev = first;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type && ptr->userdata == userdata)
-        {
-            result = ptr->time - globalTimer;
-
-            prev->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
-
+    std::vector<u32> slots = FindEventSlots([&](const Event& ev) {
+        return ev.type == event_type && ev.userdata == userdata;
+    });
+    for (size_t i = 0; i < slots.size(); i++)
+        result = RemoveEventAt(event_slots[slots[i]].heap_index).time - globalTimer;
     return result;
 }
 
+// The queue can only be drained by the CPU thread, so events are removed once moved to the heap.
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
 {
-    s64 result = 0;
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    if (!tsFirst)
-        return result;
-    while (tsFirst)
-    {
-        if (tsFirst->type == event_type && tsFirst->userdata == userdata)
-        {
-            result = tsFirst->time - globalTimer;
-
-            Event *next = tsFirst->next;
-            FreeTsEvent(tsFirst);
-            tsFirst = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!tsFirst)
-    {
-        tsLast = NULL;
-        return result;
-    }
-
-    Event *prev = tsFirst;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type && ptr->userdata == userdata)
-        {
-            result = ptr->time - globalTimer;
-
-            prev->next = ptr->next;
-            if (ptr == tsLast)
-                tsLast = prev;
-            FreeTsEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
-
-    return result;
+    MoveEvents();
+    return UnscheduleEvent(event_type, userdata);
 }
 
 // Warning: not included in save state.
@@ -362,97 +353,27 @@ void RegisterAdvanceCallback(void(*callback)(int cyclesExecuted))
 
 bool IsScheduled(int event_type)
 {
-    if (!first)
-        return false;
-    Event *e = first;
-    while (e) {
-        if (e->type == event_type)
+    for (size_t i = 0; i < event_queue.size(); i++)
+    {
+        if (event_queue[i].type == event_type)
             return true;
-        e = e->next;
     }
     return false;
 }
 
 void RemoveEvent(int event_type)
 {
-    if (!first)
-        return;
-    while (first)
-    {
-        if (first->type == event_type)
-        {
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!first)
-        return;
-    Event *prev = first;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type)
-        {
-            prev->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
+    std::vector<u32> slots = FindEventSlots([&](const Event& ev) {
+        return ev.type == event_type;
+    });
+    for (size_t i = 0; i < slots.size(); i++)
+        RemoveEventAt(event_slots[slots[i]].heap_index);
 }
 
 void RemoveThreadsafeEvent(int event_type)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-    if (!tsFirst)
-    {
-        return;
-    }
-    while (tsFirst)
-    {
-        if (tsFirst->type == event_type)
-        {
-            Event *next = tsFirst->next;
-            FreeTsEvent(tsFirst);
-            tsFirst = next;
-        }
-        else
-        {
-            break;
-        }
-    }
-    if (!tsFirst)
-    {
-        tsLast = NULL;
-        return;
-    }
-    Event *prev = tsFirst;
-    Event *ptr = prev->next;
-    while (ptr)
-    {
-        if (ptr->type == event_type)
-        {
-            prev->next = ptr->next;
-            if (ptr == tsLast)
-                tsLast = prev;
-            FreeTsEvent(ptr);
-            ptr = prev->next;
-        }
-        else
-        {
-            prev = ptr;
-            ptr = ptr->next;
-        }
-    }
+    MoveEvents();
+    RemoveEvent(event_type);
 }
 
 void RemoveAllEvents(int event_type)
@@ -464,122 +385,103 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
-    while (first)
+    while (!event_queue.empty() && event_queue[0].time <= globalTimer)
     {
-        if (first->time <= globalTimer)
-        {
-            //			LOG(TIMER, "[Scheduler] %s		 (%lld, %lld) ", 
-            //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
-            Event* evt = first;
-            first = first->next;
-            event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
-            FreeEvent(evt);
-        }
-        else
-        {
-            break;
-        }
+        //			LOG(TIMER, "[Scheduler] %s		 (%lld, %lld) ", 
+        //				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
+        // Removed first, the callback may schedule events of its own
+        Event evt = RemoveEventAt(0);
+        eventsDispatched++;
+        event_types[evt.type].callback(evt.userdata, (int)(globalTimer - evt.time));
     }
 }
 
 void MoveEvents()
 {
-    Common::AtomicStoreRelease(hasTsEvents, 0);
+    hasTsEvents.store(0, std::memory_order_relaxed);
 
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
     // Move events from async queue into main queue
-    while (tsFirst)
-    {
-        Event *next = tsFirst->next;
-        AddEventToQueue(tsFirst);
-        tsFirst = next;
-    }
-    tsLast = NULL;
-
-    // Move free events to threadsafe pool
-    while (allocatedTsEvents > 0 && eventPool)
+    while (TsEvent *ev = tsQueue.Pop())
     {
-        Event *ev = eventPool;
-        eventPool = ev->next;
-        ev->next = eventTsPool;
-        eventTsPool = ev;
-        allocatedTsEvents--;
+        AddEventToQueue(ev->time, ev->type, ev->userdata);
+        delete ev;
     }
+    // A push still in progress is picked up by the next Advance
+    if (!tsQueue.Empty())
+        hasTsEvents.store(1, std::memory_order_relaxed);
 }
 
 void Advance()
 {
-    ERROR_LOG(TIME, "Unimplemented function!");
-    //int cyclesExecuted = slicelength - currentMIPS->downcount;
-    //globalTimer += cyclesExecuted;
-    //currentMIPS->downcount = slicelength;
-
-    //if (Common::AtomicLoadAcquire(hasTsEvents))
-    //	MoveEvents();
-    //ProcessFifoWaitEvents();
-
-    //if (!first)
-    //{
-    //	// WARN_LOG(TIMER, "WARNING - no events in queue. Setting currentMIPS->downcount to 10000");
-    //	currentMIPS->downcount += 10000;
-    //}
-    //else
-    //{
-    //	slicelength = (int)(first->time - globalTimer);
-    //	if (slicelength > MAX_SLICE_LENGTH)
-    //		slicelength = MAX_SLICE_LENGTH;
-    //	currentMIPS->downcount = slicelength;
-    //}
-    //if (advanceCallback)
-    //	advanceCallback(cyclesExecuted);
+    int cyclesExecuted = slicelength - downcount;
+    globalTimer += cyclesExecuted;
+    downcount = slicelength;
+
+    if (hasTsEvents.load(std::memory_order_relaxed))
+        MoveEvents();
+    ProcessFifoWaitEvents();
+
+    if (event_queue.empty())
+    {
+        // WARN_LOG(TIMER, "WARNING - no events in queue. Setting downcount to 10000");
+        slicelength = INITIAL_SLICE_LENGTH;
+    }
+    else
+    {
+        slicelength = (int)(event_queue[0].time - globalTimer);
+        if (slicelength > MAX_SLICE_LENGTH)
+            slicelength = MAX_SLICE_LENGTH;
+    }
+    downcount = slicelength;
+    if (advanceCallback)
+        advanceCallback(cyclesExecuted);
 }
 
 void LogPendingEvents()
 {
-    Event *ptr = first;
-    while (ptr)
+    for (size_t i = 0; i < event_queue.size(); i++)
     {
-        //INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-        ptr = ptr->next;
+        //INFO_LOG(TIMER, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, event_queue[i].time, event_queue[i].type);
     }
 }
 
 void Idle(int maxIdle)
 {
-    ERROR_LOG(TIME, "Unimplemented function!");
-    //int cyclesDown = currentMIPS->downcount;
-    //if (maxIdle != 0 && cyclesDown > maxIdle)
-    //	cyclesDown = maxIdle;
+    int cyclesDown = downcount;
+    if (maxIdle != 0 && cyclesDown > maxIdle)
+        cyclesDown = maxIdle;
 
-    //if (first && cyclesDown > 0)
-    //{
-    //	int cyclesExecuted = slicelength - currentMIPS->downcount;
-    //	int cyclesNextEvent = (int) (first->time - globalTimer);
+    if (!event_queue.empty() && cyclesDown > 0)
+    {
+        int cyclesExecuted = slicelength - downcount;
+        int cyclesNextEvent = (int) (event_queue[0].time - globalTimer);
 
-    //	if (cyclesNextEvent < cyclesExecuted + cyclesDown)
-    //	{
-    //		cyclesDown = cyclesNextEvent - cyclesExecuted;
-    //		// Now, now... no time machines, please.
-    //		if (cyclesDown < 0)
-    //			cyclesDown = 0;
-    //	}
-    //}
+        if (cyclesNextEvent < cyclesExecuted + cyclesDown)
+        {
+            cyclesDown = cyclesNextEvent - cyclesExecuted;
+            // Now, now... no time machines, please.
+            if (cyclesDown < 0)
+                cyclesDown = 0;
+        }
+    }
 
-    //INFO_LOG(TIME, "Idle for %i cycles! (%f ms)", cyclesDown, cyclesDown / (float)(g_clock_rate_arm11 * 0.001f));
+    DEBUG_LOG(TIME, "Idle for %i cycles! (%f ms)", cyclesDown, cyclesDown / (float)(g_clock_rate_arm11 * 0.001f));
 
-    //idledCycles += cyclesDown;
-    //currentMIPS->downcount -= cyclesDown;
-    //if (currentMIPS->downcount == 0)
-    //	currentMIPS->downcount = -1;
+    idledCycles += cyclesDown;
+    downcount -= cyclesDown;
 }
 
 std::string GetScheduledEventsSummary()
 {
-    Event *ptr = first;
+    // Listed in the order they will run
+    std::vector<Event> events(event_queue);
+    std::sort(events.begin(), events.end(), EventBefore);
+
     std::string text = "Scheduled events\n";
     text.reserve(1000);
-    while (ptr)
+    for (size_t i = 0; i < events.size(); i++)
     {
+        const Event *ptr = &events[i];
         unsigned int t = ptr->type;
         if (t >= event_types.size())
             PanicAlert("Invalid event type"); // %i", t);
@@ -589,21 +491,16 @@ std::string GetScheduledEventsSummary()
         char temp[512];
         sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
         text += temp;
-        ptr = ptr->next;
     }
     return text;
 }
 
-void Event_DoState(PointerWrap &p, BaseEvent *ev)
-{
-    p.Do(*ev);
-}
-
 void DoState(PointerWrap &p)
 {
-    std::lock_guard<std::recursive_mutex> lk(externalEventSection);
+    // Events posted from other threads are saved with the others
+    MoveEvents();
 
-    auto s = p.Section("CoreTiming", 1);
+    auto s = p.Section("CoreTiming", 3, 4);
     if (!s)
         return;
 
@@ -612,13 +509,18 @@ void DoState(PointerWrap &p)
     // These (should) be filled in later by the modules.
     event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
-    p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **)NULL);
-    p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
+    p.Do(event_queue);
+    p.Do(event_slots);
+    p.Do(free_event_slots);
+    p.Do(event_order);
 
     p.Do(g_clock_rate_arm11);
     p.Do(slicelength);
     p.Do(globalTimer);
     p.Do(idledCycles);
+    // GetTicks counts from it, the slice the state was saved in goes on from where it was
+    if (s >= 4)
+        p.Do(downcount);
 }
 
 }	// namespace
@@ -55,6 +55,11 @@ inline s64 cyclesToUs(s64 cycles) {
     return cycles / (g_clock_rate_arm11 / 1000000);
 }
 
+inline s64 nsToCycles(s64 ns) {
+    // Whole seconds apart, so that long timeouts don't overflow
+    return ns / 1000000000 * g_clock_rate_arm11 + ns % 1000000000 * g_clock_rate_arm11 / 1000000000;
+}
+
 namespace CoreTiming {
 
 void Init();
@@ -64,6 +69,8 @@ typedef void(*TimedCallback)(u64 userdata, int cyclesLate);
 
 u64 GetTicks();
 u64 GetIdleTicks();
+// Number of event callbacks run since Init.
+u64 GetEventsDispatched();
 
 // Returns the event_type identifier.
 int RegisterEvent(const char *name, TimedCallback callback);
@@ -71,12 +78,18 @@ int RegisterEvent(const char *name, TimedCallback callback);
 void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callback);
 void UnregisterAllEvents();
 
+// Identifies a scheduled event until it runs or is removed, it can then no longer match any.
+typedef u64 EventHandle;
+
 // userdata MAY NOT CONTAIN POINTERS. userdata might get written and reloaded from disk,
 // when we implement state saves.
-void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
+EventHandle ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata = 0);
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
+// Unscheduling by handle takes O(log n), by type and userdata it scans the whole queue.
+s64 UnscheduleEvent(EventHandle handle);
 s64 UnscheduleEvent(int event_type, u64 userdata);
+// Called on the CPU thread, these move the thread-safe events to the main queue first.
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata);
 
 void RemoveEvent(int event_type);
@@ -105,5 +118,6 @@ void DoState(PointerWrap &p);
 void SetClockFrequencyMHz(int cpuMhz);
 int GetClockFrequencyMHz();
 extern int slicelength;
+extern int downcount;
 
 }; // namespace
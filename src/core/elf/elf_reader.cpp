@@ -58,19 +58,16 @@ static void byteswapSection(Elf32_Shdr &sec)
 	bswap(sec.sh_type);
 }
 
-ElfReader::ElfReader(void *ptr)
+ElfReader::ElfReader(const void *ptr)
 {
-	base = (char*)ptr;
-	base32 = (u32 *)ptr;
-	header = (Elf32_Ehdr*)ptr;
-	byteswapHeader(*header);
+	base = (const char*)ptr;
+	base32 = (const u32 *)ptr;
+	header = (const Elf32_Ehdr*)ptr;
 
-	segments = (Elf32_Phdr *)(base + header->e_phoff);
-	sections = (Elf32_Shdr *)(base + header->e_shoff);
+	segments = (const Elf32_Phdr *)(base + header->e_phoff);
+	sections = (const Elf32_Shdr *)(base + header->e_shoff);
 
 	entryPoint = header->e_entry;
-
-    LoadSymbols();
 }
 
 const char *ElfReader::GetSectionName(int section) const
@@ -113,7 +110,7 @@ bool ElfReader::LoadInto(u32 vaddr)
 
 	for (int i = 0; i < header->e_phnum; i++)
 	{
-		Elf32_Phdr *p = segments + i;
+		const Elf32_Phdr *p = segments + i;
 
 		INFO_LOG(MASTER_LOG, "Type: %i Vaddr: %08x Filesz: %i Memsz: %i ", p->p_type, p->p_vaddr, p->p_filesz, p->p_memsz);
 
@@ -123,18 +120,12 @@ bool ElfReader::LoadInto(u32 vaddr)
 			u32 writeAddr = segmentVAddr[i];
 
 			const u8 *src = GetSegmentPtr(i);
-			u8 *dst = Memory::GetPointer(writeAddr);
 			u32 srcSize = p->p_filesz;
 			u32 dstSize = p->p_memsz;
-			u32 *s = (u32*)src;
-			u32 *d = (u32*)dst;
-			for (int j = 0; j < (int)(srcSize + 3) / 4; j++)
-			{
-				*d++ = /*_byteswap_ulong*/(*s++);
-			}
+			Memory::WriteBlock(writeAddr, src, srcSize);
 			if (srcSize < dstSize)
 			{
-				//memset(dst + srcSize, 0, dstSize-srcSize); //zero out bss
+				Memory::ZeroBlock(writeAddr + srcSize, dstSize - srcSize); //zero out bss
 			}
 			INFO_LOG(MASTER_LOG,"Loadable Segment Copied to %08x, size %08x", writeAddr, p->p_memsz);
 		}
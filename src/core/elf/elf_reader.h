@@ -19,19 +19,20 @@ typedef int SectionID;
 class ElfReader
 {
 private:
-	char *base;
-	u32 *base32;
+	const char *base;
+	const u32 *base32;
 
-	Elf32_Ehdr *header;
-	Elf32_Phdr *segments;
-	Elf32_Shdr *sections;
+	const Elf32_Ehdr *header;
+	const Elf32_Phdr *segments;
+	const Elf32_Shdr *sections;
 
 	u32 *sectionAddrs;
 	bool bRelocate;
 	u32 entryPoint;
 
 public:
-	ElfReader(void *ptr);
+	// The image is parsed in place and must outlive the reader
+	ElfReader(const void *ptr);
 	~ElfReader() { }
 
 	u32 Read32(int off) const { return base32[off>>2]; }
@@ -42,6 +43,7 @@ public:
 	u32 GetEntryPoint() const { return entryPoint; }
 	u32 GetFlags() const { return (u32)(header->e_flags); }
 	bool LoadInto(u32 vaddr);
+	// Adds the symbols of .symtab to the symbol map, not done when the reader is created
 	bool LoadSymbols();
 
 	int GetNumSegments() const { return (int)(header->e_phnum); }
@@ -80,7 +80,126 @@ static bool FixFilenameCase(const std::string &path, std::string &filename)
 	return retValue;
 }
 
-bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior)
+static bool GetModificationTime(const std::string &path, s64 &sec, s64 &nsec)
+{
+	struct stat s;
+	if (stat(path.c_str(), &s) != 0)
+		return false;
+
+	sec = s.st_mtime;
+#ifdef __APPLE__
+	nsec = s.st_mtimespec.tv_nsec;
+#else
+	nsec = s.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+bool CaseFoldingIndex::List(const std::string &path, Directory &directory)
+{
+	directory.names.clear();
+	directory.folded.clear();
+	if (!GetModificationTime(path, directory.mtime_sec, directory.mtime_nsec))
+		return false;
+
+	DIR *dirp = opendir(path.c_str());
+	if (!dirp)
+		return false;
+
+	while (struct dirent *result = readdir(dirp))
+	{
+		std::string name = result->d_name;
+		std::string folded = name;
+		for (size_t i = 0; i < folded.size(); i++)
+		{
+			folded[i] = tolower(folded[i]);
+		}
+		// The first of names differing only by case wins, as with a case insensitive host
+		directory.folded.insert(std::make_pair(folded, name));
+		directory.names.insert(name);
+	}
+
+	closedir(dirp);
+	return true;
+}
+
+bool CaseFoldingIndex::Find(const Directory &directory, std::string &filename)
+{
+	if (directory.names.count(filename))
+		return true;
+
+	std::string folded = filename;
+	for (size_t i = 0; i < folded.size(); i++)
+	{
+		folded[i] = tolower(folded[i]);
+	}
+
+	auto it = directory.folded.find(folded);
+	if (it == directory.folded.end())
+		return false;
+
+	filename = it->second;
+	return true;
+}
+
+bool CaseFoldingIndex::FixFilenameCase(const std::string &path, std::string &filename)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = directories.find(path);
+	if (it == directories.end())
+	{
+		Directory directory;
+		if (!List(path, directory))
+			return false;
+
+		it = directories.insert(std::make_pair(path, std::move(directory))).first;
+		return Find(it->second, filename);
+	}
+
+	if (Find(it->second, filename))
+		return true;
+
+	// Missing from the listing, which is stale if something else modified the directory since
+	Directory &directory = it->second;
+	s64 sec, nsec;
+	if (!GetModificationTime(path, sec, nsec))
+	{
+		directories.erase(it);
+		return false;
+	}
+
+	if (sec == directory.mtime_sec && nsec == directory.mtime_nsec)
+		return false;
+
+	if (!List(path, directory))
+	{
+		directories.erase(it);
+		return false;
+	}
+
+	return Find(directory, filename);
+}
+
+void CaseFoldingIndex::Invalidate(const std::string &path)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::string entry = path;
+	while (!entry.empty() && entry[entry.size() - 1] == '/')
+		entry.erase(entry.size() - 1);
+
+	const std::string parent = entry.substr(0, entry.find_last_of('/') + 1);
+	const std::string under = entry + "/";
+	for (auto it = directories.begin(); it != directories.end();)
+	{
+		if (it->first == parent || it->first.compare(0, under.size(), under) == 0)
+			it = directories.erase(it);
+		else
+			++it;
+	}
+}
+
+bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior,
+	CaseFoldingIndex *index)
 {
 	size_t len = path.size();
 
@@ -111,7 +230,9 @@ bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior b
 			std::string component = path.substr(start, i - start);
 
 			// Fix case and stop on nonexistant path component
-			if (FixFilenameCase(fullPath, component) == false) {
+			bool found = index ? index->FixFilenameCase(fullPath, component) :
+				FixFilenameCase(fullPath, component);
+			if (found == false) {
 				// Still counts as success if partial matches allowed or if this
 				// is the last component and only the ones before it are required
 				return (behavior == FPC_PARTIAL_ALLOWED || (behavior == FPC_PATH_MUST_EXIST && i >= len));
@@ -148,13 +269,14 @@ std::string DirectoryFileHandle::GetLocalPath(std::string& basePath, std::string
 	return basePath + localpath;
 }
 
-bool DirectoryFileHandle::Open(std::string& basePath, std::string& fileName, FileAccess access)
+bool DirectoryFileHandle::Open(std::string& basePath, std::string& fileName, FileAccess access,
+	CaseFoldingIndex *index)
 {
 #if HOST_IS_CASE_SENSITIVE
 	if (access & (FILEACCESS_APPEND|FILEACCESS_CREATE|FILEACCESS_WRITE))
 	{
 		DEBUG_LOG(FILESYS, "Checking case for path %s", fileName.c_str());
-		if ( ! FixPathCase(basePath, fileName, FPC_PATH_MUST_EXIST) )
+		if ( ! FixPathCase(basePath, fileName, FPC_PATH_MUST_EXIST, index) )
 			return false;  // or go on and attempt (for a better error code than just 0?)
 	}
 	// else we try fopen first (in case we're lucky) before simulating case insensitivity
@@ -182,8 +304,10 @@ bool DirectoryFileHandle::Open(std::string& basePath, std::string& fileName, Fil
 	} else {
 		openmode = OPEN_EXISTING;
 	}
-	//Let's do it!
-	hFile = CreateFile(ConvertUTF8ToWString(fullName).c_str(), desired, sharemode, 0, openmode, 0, 0);
+	//Let's do it! Files open all the time, their paths convert on the stack
+	wchar_t wide_name[MAX_PATH];
+	ConvertUTF8ToWString(wide_name, MAX_PATH, fullName);
+	hFile = CreateFile(wide_name, desired, sharemode, 0, openmode, 0, 0);
 	bool success = hFile != INVALID_HANDLE_VALUE;
 #else
 	// Convert flags in access parameter to fopen access mode
@@ -219,7 +343,7 @@ bool DirectoryFileHandle::Open(std::string& basePath, std::string& fileName, Fil
 	    !(access & FILEACCESS_CREATE) &&
 	    !(access & FILEACCESS_WRITE))
 	{
-		if ( ! FixPathCase(basePath,fileName, FPC_PATH_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fileName, FPC_PATH_MUST_EXIST, index) )
 			return 0;  // or go on and attempt (for a better error code than just 0?)
 		fullName = GetLocalPath(basePath,fileName); 
 		const char* fullNameC = fullName.c_str();
@@ -329,10 +453,15 @@ bool DirectoryFileSystem::MkDir(const std::string &dirname) {
 	// duplicate (different case) directories
 
 	std::string fixedCase = dirname;
-	if ( ! FixPathCase(basePath,fixedCase, FPC_PARTIAL_ALLOWED) )
+	if ( ! FixPathCase(basePath,fixedCase, FPC_PARTIAL_ALLOWED, &caseIndex) )
 		return false;
 
-	return File::CreateFullPath(GetLocalPath(fixedCase));
+	std::string fullName = GetLocalPath(fixedCase);
+	if (! File::CreateFullPath(fullName))
+		return false;
+
+	caseIndex.Invalidate(fullName);
+	return true;
 #else
 	return File::CreateFullPath(GetLocalPath(dirname));
 #endif
@@ -344,11 +473,14 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 #if HOST_IS_CASE_SENSITIVE
 	// Maybe we're lucky?
 	if (File::DeleteDirRecursively(fullName))
+	{
+		caseIndex.Invalidate(fullName);
 		return true;
+	}
 
 	// Nope, fix case and try again
 	fullName = dirname;
-	if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST) )
+	if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST, &caseIndex) )
 		return false;  // or go on and attempt (for a better error code than just false?)
 
 	fullName = GetLocalPath(fullName);
@@ -359,7 +491,14 @@ bool DirectoryFileSystem::RmDir(const std::string &dirname) {
 #else
 	return 0 == rmdir(fullName.c_str());
 #endif*/
-	return File::DeleteDirRecursively(fullName);
+	bool retValue = File::DeleteDirRecursively(fullName);
+
+#if HOST_IS_CASE_SENSITIVE
+	if (retValue)
+		caseIndex.Invalidate(fullName);
+#endif
+
+	return retValue;
 }
 
 int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &to) {
@@ -383,7 +522,7 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 
 #if HOST_IS_CASE_SENSITIVE
 	// In case TO should overwrite a file with different case
-	if ( ! FixPathCase(basePath,fullTo, FPC_PATH_MUST_EXIST) )
+	if ( ! FixPathCase(basePath,fullTo, FPC_PATH_MUST_EXIST, &caseIndex) )
 		return -1;  // or go on and attempt (for a better error code than just false?)
 #endif
 
@@ -401,7 +540,7 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 	{
 		// May have failed due to case sensitivity on FROM, so try again
 		fullFrom = from;
-		if ( ! FixPathCase(basePath,fullFrom, FPC_FILE_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fullFrom, FPC_FILE_MUST_EXIST, &caseIndex) )
 			return -1;  // or go on and attempt (for a better error code than just false?)
 		fullFrom = GetLocalPath(fullFrom);
 
@@ -413,6 +552,14 @@ int DirectoryFileSystem::RenameFile(const std::string &from, const std::string &
 	}
 #endif
 
+#if HOST_IS_CASE_SENSITIVE
+	if (retValue)
+	{
+		caseIndex.Invalidate(fullFrom);
+		caseIndex.Invalidate(fullTo);
+	}
+#endif
+
 	// TODO: Better error codes.
 	return retValue ? 0 : -1;//SCE_KERNEL_ERROR_ERRNO_FILE_ALREADY_EXISTS;
 }
@@ -430,7 +577,7 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 	{
 		// May have failed due to case sensitivity, so try again
 		fullName = filename;
-		if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST) )
+		if ( ! FixPathCase(basePath,fullName, FPC_FILE_MUST_EXIST, &caseIndex) )
 			return false;  // or go on and attempt (for a better error code than just false?)
 		fullName = GetLocalPath(fullName);
 
@@ -440,6 +587,9 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 		retValue = (0 == unlink(fullName.c_str()));
 #endif
 	}
+
+	if (retValue)
+		caseIndex.Invalidate(fullName);
 #endif
 
 	return retValue;
@@ -447,7 +597,15 @@ bool DirectoryFileSystem::RemoveFile(const std::string &filename) {
 
 u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename) {
 	OpenFileEntry entry;
+#if HOST_IS_CASE_SENSITIVE
+	bool success = entry.hFile.Open(basePath,filename,access,&caseIndex);
+
+	// The file may have just been created
+	if (success && (access & (FILEACCESS_APPEND|FILEACCESS_CREATE|FILEACCESS_WRITE)))
+		caseIndex.Invalidate(GetLocalPath(filename));
+#else
 	bool success = entry.hFile.Open(basePath,filename,access);
+#endif
 
 	if (!success) {
 #ifdef _WIN32
@@ -464,6 +622,7 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access, const
 #endif
 
 		u32 newHandle = hAlloc->GetNewHandle();
+		std::lock_guard<std::mutex> guard(entriesLock);
 		entries[newHandle] = entry;
 
 		return newHandle;
@@ -471,6 +630,7 @@ u32 DirectoryFileSystem::OpenFile(std::string filename, FileAccess access, const
 }
 
 void DirectoryFileSystem::CloseFile(u32 handle) {
+	std::lock_guard<std::mutex> guard(entriesLock);
 	EntryMap::iterator iter = entries.find(handle);
 	if (iter != entries.end()) {
 		hAlloc->FreeHandle(handle);
@@ -482,16 +642,22 @@ void DirectoryFileSystem::CloseFile(u32 handle) {
 	}
 }
 
-bool DirectoryFileSystem::OwnsHandle(u32 handle) {
+// Entries stay in place until closed, so the lock is only held for the lookup.
+DirectoryFileSystem::OpenFileEntry *DirectoryFileSystem::GetOpenFile(u32 handle) {
+	std::lock_guard<std::mutex> guard(entriesLock);
 	EntryMap::iterator iter = entries.find(handle);
-	return (iter != entries.end());
+	return iter != entries.end() ? &iter->second : NULL;
+}
+
+bool DirectoryFileSystem::OwnsHandle(u32 handle) {
+	return GetOpenFile(handle) != NULL;
 }
 
 size_t DirectoryFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size) {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *entry = GetOpenFile(handle);
+	if (entry)
 	{
-		size_t bytesRead = iter->second.hFile.Read(pointer,size);
+		size_t bytesRead = entry->hFile.Read(pointer,size);
 		return bytesRead;
 	} else {
 		//This shouldn't happen...
@@ -501,10 +667,10 @@ size_t DirectoryFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size) {
 }
 
 size_t DirectoryFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size) {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end())
+	OpenFileEntry *entry = GetOpenFile(handle);
+	if (entry)
 	{
-		size_t bytesWritten = iter->second.hFile.Write(pointer,size);
+		size_t bytesWritten = entry->hFile.Write(pointer,size);
 		return bytesWritten;
 	} else {
 		//This shouldn't happen...
@@ -514,9 +680,9 @@ size_t DirectoryFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size) {
 }
 
 size_t DirectoryFileSystem::SeekFile(u32 handle, s32 position, FileMove type) {
-	EntryMap::iterator iter = entries.find(handle);
-	if (iter != entries.end()) {
-		return iter->second.hFile.Seek(position,type);
+	OpenFileEntry *entry = GetOpenFile(handle);
+	if (entry) {
+		return entry->hFile.Seek(position,type);
 	} else {
 		//This shouldn't happen...
 		ERROR_LOG(FILESYS,"Cannot seek in file that hasn't been opened: %08x", handle);
@@ -531,7 +697,7 @@ FileInfo DirectoryFileSystem::GetFileInfo(std::string filename) {
 	std::string fullName = GetLocalPath(filename);
 	if (! File::Exists(fullName)) {
 #if HOST_IS_CASE_SENSITIVE
-		if (! FixPathCase(basePath,filename, FPC_FILE_MUST_EXIST))
+		if (! FixPathCase(basePath,filename, FPC_FILE_MUST_EXIST, &caseIndex))
 			return x;
 		fullName = GetLocalPath(filename);
 
@@ -548,7 +714,9 @@ FileInfo DirectoryFileSystem::GetFileInfo(std::string filename) {
 	{
 #ifdef _WIN32
 		struct _stat64i32 s;
-		_wstat64i32(ConvertUTF8ToWString(fullName).c_str(), &s);
+		wchar_t wide_name[MAX_PATH];
+		ConvertUTF8ToWString(wide_name, MAX_PATH, fullName);
+		_wstat64i32(wide_name, &s);
 #else
 		struct stat s;
 		stat(fullName.c_str(), &s);
@@ -627,7 +795,7 @@ std::vector<FileInfo> DirectoryFileSystem::GetDirListing(std::string path) {
 	DIR *dp = opendir(localPath.c_str());
 
 #if HOST_IS_CASE_SENSITIVE
-	if(dp == NULL && FixPathCase(basePath,path, FPC_FILE_MUST_EXIST)) {
+	if(dp == NULL && FixPathCase(basePath,path, FPC_FILE_MUST_EXIST, &caseIndex)) {
 		// May have failed due to case sensitivity, try again
 		localPath = GetLocalPath(path);
 		dp = opendir(localPath.c_str());
@@ -662,6 +830,7 @@ std::vector<FileInfo> DirectoryFileSystem::GetDirListing(std::string path) {
 }
 
 void DirectoryFileSystem::DoState(PointerWrap &p) {
+	std::lock_guard<std::mutex> guard(entriesLock);
 	if (!entries.empty()) {
 		p.SetError(p.ERROR_WARNING);
 		ERROR_LOG(FILESYS, "FIXME: Open files during savestate, could go badly.");
@@ -20,6 +20,10 @@
 // TODO: Remove the Windows-specific code, FILE is fine there too.
 
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common/std_mutex.h"
 
 #include "core/file_sys/file_sys.h"
 
@@ -54,9 +58,40 @@ enum FixPathCaseBehavior {
 	FPC_PARTIAL_ALLOWED,  // don't care how many exist (mkdir recursive)
 };
 
-bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior);
+// Real names of the entries of the host directories of a mount, by lower-cased name. Directories
+// are listed on their first lookup and listed again when a lookup misses and they were modified
+// since, so that opens with the wrong case don't list every directory of their path.
+class CaseFoldingIndex
+{
+public:
+	// Fixes the case of a name in a directory, false if the directory has no such entry
+	bool FixFilenameCase(const std::string &path, std::string &filename);
+
+	// Drops the listings of the directory of a host path, and those under the path
+	void Invalidate(const std::string &path);
+
+private:
+	struct Directory
+	{
+		s64 mtime_sec;
+		s64 mtime_nsec;
+		std::unordered_set<std::string> names;  // Real names, for exact matches
+		std::unordered_map<std::string, std::string> folded;  // Real names by lower case name
+	};
+
+	static bool List(const std::string &path, Directory &directory);
+	static bool Find(const Directory &directory, std::string &filename);
+
+	std::unordered_map<std::string, Directory> directories;  // By path, with a trailing slash
+	std::mutex lock;
+};
+
+bool FixPathCase(std::string& basePath, std::string &path, FixPathCaseBehavior behavior,
+	CaseFoldingIndex *index = NULL);
 #endif
 
+class CaseFoldingIndex;
+
 struct DirectoryFileHandle
 {
 #ifdef _WIN32
@@ -74,7 +109,9 @@ struct DirectoryFileHandle
 	}
 
 	std::string GetLocalPath(std::string& basePath, std::string localpath);
-	bool Open(std::string& basePath, std::string& fileName, FileAccess access);
+	// The index, if any, fixes the case of the path on case sensitive hosts
+	bool Open(std::string& basePath, std::string& fileName, FileAccess access,
+		CaseFoldingIndex *index = NULL);
 	size_t Read(u8* pointer, s64 size);
 	size_t Write(const u8* pointer, s64 size);
 	size_t Seek(s32 position, FileMove type);
@@ -109,11 +146,19 @@ private:
 
 	typedef std::map<u32, OpenFileEntry> EntryMap;
 	EntryMap entries;
+	// Only guards the map, files are read and written without it
+	std::mutex entriesLock;
 	std::string basePath;
 	IHandleAllocator *hAlloc;
 
+	OpenFileEntry *GetOpenFile(u32 handle);
+
 	// In case of Windows: Translate slashes, etc.
 	std::string GetLocalPath(std::string localpath);
+
+#if HOST_IS_CASE_SENSITIVE
+	CaseFoldingIndex caseIndex;
+#endif
 };
 
 // VFSFileSystem: Ability to map in Android APK paths as well! Does not support all features, only meant for fonts.
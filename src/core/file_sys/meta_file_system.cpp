@@ -159,21 +159,66 @@ static bool RealPath(const std::string &currentDirectory, const std::string &inP
 	return true;
 }
 
+MetaFileSystem::MetaFileSystem() : current(6), mounts(std::make_shared<MountTable>())
+{
+	for (int i = 0; i < HANDLE_SLOTS; i++)
+		handleSlots[i].store(0);
+	for (int i = 0; i < MAX_FILE_SYSTEMS; i++)
+		handleOwners[i].store(NULL);
+}
+
 IFileSystem *MetaFileSystem::GetHandleOwner(u32 handle)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
-	for (size_t i = 0; i < fileSystems.size(); i++)
+	const u64 slot = handleSlots[handle & (HANDLE_SLOTS - 1)].load(std::memory_order_acquire);
+	if ((u32)(slot >> 32) == handle && (u32)slot != 0)
+		return handleOwners[(u32)slot - 1].load(std::memory_order_acquire);
+
+	// Left out of the slots, or restored by a savestate
+	MountTablePtr table = GetMounts();
+	for (size_t i = 0; i < table->fileSystems.size(); i++)
 	{
-		if (fileSystems[i].system->OwnsHandle(handle))
-			return fileSystems[i].system; //got it!
+		if (table->fileSystems[i].system->OwnsHandle(handle))
+			return table->fileSystems[i].system; //got it!
 	}
 	//none found?
 	return 0;
 }
 
-bool MetaFileSystem::MapFilePath(const std::string &_inpath, std::string &outpath, MountPoint **system)
+void MetaFileSystem::RegisterHandle(u32 handle, IFileSystem *system)
+{
+	if (handle == 0)
+		return;
+
+	for (u32 i = 0; i < MAX_FILE_SYSTEMS; i++)
+	{
+		IFileSystem *owner = handleOwners[i].load(std::memory_order_acquire);
+		if (owner == NULL)
+			return;
+		if (owner != system)
+			continue;
+
+		u64 empty = 0;
+		handleSlots[handle & (HANDLE_SLOTS - 1)].compare_exchange_strong(empty, ((u64)handle << 32) | (i + 1), std::memory_order_release);
+		return;
+	}
+}
+
+void MetaFileSystem::UnregisterHandle(u32 handle)
+{
+	std::atomic<u64> &slot = handleSlots[handle & (HANDLE_SLOTS - 1)];
+	u64 value = slot.load(std::memory_order_relaxed);
+	if ((u32)(value >> 32) == handle)
+		slot.compare_exchange_strong(value, 0, std::memory_order_release);
+}
+
+bool MetaFileSystem::MapFilePath(const std::string &_inpath, std::string &outpath, MountPoint *system)
+{
+	MountTablePtr table = GetMounts();
+	return MapFilePath(*table, _inpath, outpath, system);
+}
+
+bool MetaFileSystem::MapFilePath(const MountTable &table, const std::string &_inpath, std::string &outpath, MountPoint *system, int *error)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string realpath;
 
 	// Special handling: host0:command.txt (as seen in Super Monkey Ball Adventures, for example)
@@ -184,18 +229,19 @@ bool MetaFileSystem::MapFilePath(const std::string &_inpath, std::string &outpat
 		inpath = inpath.substr(strlen("host0:"));
 	}
 
-	const std::string *currentDirectory = &startingDirectory;
+	const std::string *currentDirectory = &table.startingDirectory;
 
 	_assert_msg_(FILESYS, false, "must implement equiv of __KernelGetCurThread");
 
 	int currentThread = 0;//__KernelGetCurThread();
-	currentDir_t::iterator it = currentDir.find(currentThread);
-	if (it == currentDir.end()) 
+	currentDir_t::const_iterator it = table.currentDir.find(currentThread);
+	if (it == table.currentDir.end()) 
 	{
 		//Attempt to emulate SCE_KERNEL_ERROR_NOCWD / 8002032C: may break things requiring fixes elsewhere
 		if (inpath.find(':') == std::string::npos /* means path is relative */) 
 		{
-			lastOpenError = -1;//SCE_KERNEL_ERROR_NOCWD;
+			if (error != NULL)
+				*error = -1;//SCE_KERNEL_ERROR_NOCWD;
 			WARN_LOG(FILESYS, "Path is relative, but current directory not set for thread %i. returning 8002032C(SCE_KERNEL_ERROR_NOCWD) instead.", currentThread);
 		}
 	}
@@ -206,15 +252,16 @@ bool MetaFileSystem::MapFilePath(const std::string &_inpath, std::string &outpat
 
 	if ( RealPath(*currentDirectory, inpath, realpath) )
 	{
-		for (size_t i = 0; i < fileSystems.size(); i++)
+		for (size_t i = 0; i < table.fileSystems.size(); i++)
 		{
-			size_t prefLen = fileSystems[i].prefix.size();
-			if (strncasecmp(fileSystems[i].prefix.c_str(), realpath.c_str(), prefLen) == 0)
+			const MountPoint &mountPoint = table.fileSystems[i];
+			size_t prefLen = mountPoint.prefix.size();
+			if (strncasecmp(mountPoint.prefix.c_str(), realpath.c_str(), prefLen) == 0)
 			{
 				outpath = realpath.substr(prefLen);
-				*system = &(fileSystems[i]);
+				*system = mountPoint;
 
-				INFO_LOG(FILESYS, "MapFilePath: mapped \"%s\" to prefix: \"%s\", path: \"%s\"", inpath.c_str(), fileSystems[i].prefix.c_str(), outpath.c_str());
+				INFO_LOG(FILESYS, "MapFilePath: mapped \"%s\" to prefix: \"%s\", path: \"%s\"", inpath.c_str(), mountPoint.prefix.c_str(), outpath.c_str());
 
 				return true;
 			}
@@ -231,7 +278,21 @@ void MetaFileSystem::Mount(std::string prefix, IFileSystem *system)
 	MountPoint x;
 	x.prefix = prefix;
 	x.system = system;
-	fileSystems.push_back(x);
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
+	table->fileSystems.push_back(x);
+	SetMounts(table);
+
+	for (u32 i = 0; i < MAX_FILE_SYSTEMS; i++)
+	{
+		IFileSystem *owner = handleOwners[i].load(std::memory_order_relaxed);
+		if (owner == system)
+			break;
+		if (owner == NULL)
+		{
+			handleOwners[i].store(system, std::memory_order_release);
+			break;
+		}
+	}
 }
 
 void MetaFileSystem::Unmount(std::string prefix, IFileSystem *system)
@@ -240,7 +301,10 @@ void MetaFileSystem::Unmount(std::string prefix, IFileSystem *system)
 	MountPoint x;
 	x.prefix = prefix;
 	x.system = system;
-	fileSystems.erase(std::remove(fileSystems.begin(), fileSystems.end(), x), fileSystems.end());
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
+	table->fileSystems.erase(std::remove(table->fileSystems.begin(), table->fileSystems.end(), x), table->fileSystems.end());
+	SetMounts(table);
+	// The system keeps its place in handleOwners, its open handles stay valid.
 }
 
 void MetaFileSystem::Shutdown()
@@ -250,9 +314,10 @@ void MetaFileSystem::Shutdown()
 
 	// Ownership is a bit convoluted. Let's just delete everything once.
 
+	MountTablePtr table = GetMounts();
 	std::set<IFileSystem *> toDelete;
-	for (size_t i = 0; i < fileSystems.size(); i++) {
-		toDelete.insert(fileSystems[i].system);
+	for (size_t i = 0; i < table->fileSystems.size(); i++) {
+		toDelete.insert(table->fileSystems[i].system);
 	}
 
 	for (auto iter = toDelete.begin(); iter != toDelete.end(); ++iter)
@@ -260,28 +325,24 @@ void MetaFileSystem::Shutdown()
 		delete *iter;
 	}
 
-	fileSystems.clear();
-	currentDir.clear();
-	startingDirectory = "";
+	SetMounts(std::make_shared<MountTable>());
+	for (int i = 0; i < HANDLE_SLOTS; i++)
+		handleSlots[i].store(0);
+	for (int i = 0; i < MAX_FILE_SYSTEMS; i++)
+		handleOwners[i].store(NULL);
 }
 
 u32 MetaFileSystem::OpenWithError(int &error, std::string filename, FileAccess access, const char *devicename)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
-	u32 h = OpenFile(filename, access, devicename);
-	error = lastOpenError;
-	return h;
-}
-
-u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename)
-{
-	std::lock_guard<std::recursive_mutex> guard(lock);
-	lastOpenError = 0;
+	error = 0;
 	std::string of;
-	MountPoint *mount;
-	if (MapFilePath(filename, of, &mount))
+	MountPoint mount;
+	MountTablePtr table = GetMounts();
+	if (MapFilePath(*table, filename, of, &mount, &error))
 	{
-		return mount->system->OpenFile(of, access, mount->prefix.c_str());
+		u32 h = mount.system->OpenFile(of, access, mount.prefix.c_str());
+		RegisterHandle(h, mount.system);
+		return h;
 	}
 	else
 	{
@@ -289,9 +350,14 @@ u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access, const char
 	}
 }
 
+u32 MetaFileSystem::OpenFile(std::string filename, FileAccess access, const char *devicename)
+{
+	int error;
+	return OpenWithError(error, filename, access, devicename);
+}
+
 FileInfo MetaFileSystem::GetFileInfo(std::string filename)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(filename, of, &system))
@@ -307,7 +373,6 @@ FileInfo MetaFileSystem::GetFileInfo(std::string filename)
 
 bool MetaFileSystem::GetHostPath(const std::string &inpath, std::string &outpath)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(inpath, of, &system)) {
@@ -319,7 +384,6 @@ bool MetaFileSystem::GetHostPath(const std::string &inpath, std::string &outpath
 
 std::vector<FileInfo> MetaFileSystem::GetDirListing(std::string path)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(path, of, &system))
@@ -336,7 +400,9 @@ std::vector<FileInfo> MetaFileSystem::GetDirListing(std::string path)
 void MetaFileSystem::ThreadEnded(int threadID)
 {
 	std::lock_guard<std::recursive_mutex> guard(lock);
-	currentDir.erase(threadID);
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
+	table->currentDir.erase(threadID);
+	SetMounts(table);
 }
 
 int MetaFileSystem::ChDir(const std::string &dir)
@@ -350,23 +416,26 @@ int MetaFileSystem::ChDir(const std::string &dir)
 
 	int curThread = 0; //__KernelGetCurThread();
 	
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
 	std::string of;
-	MountPoint *mountPoint;
-	if (MapFilePath(dir, of, &mountPoint))
+	MountPoint mountPoint;
+	if (MapFilePath(*table, dir, of, &mountPoint))
 	{
-		currentDir[curThread] = mountPoint->prefix + of;
+		table->currentDir[curThread] = mountPoint.prefix + of;
+		SetMounts(table);
 		return 0;
 	}
 	else
 	{
-		for (size_t i = 0; i < fileSystems.size(); i++)
+		for (size_t i = 0; i < table->fileSystems.size(); i++)
 		{
-			const std::string &prefix = fileSystems[i].prefix;
+			const std::string &prefix = table->fileSystems[i].prefix;
 			if (strncasecmp(prefix.c_str(), dir.c_str(), prefix.size()) == 0)
 			{
 				// The PSP is completely happy with invalid current dirs as long as they have a valid device.
 				WARN_LOG(FILESYS, "ChDir failed to map path \"%s\", saving as current directory anyway", dir.c_str());
-				currentDir[curThread] = dir;
+				table->currentDir[curThread] = dir;
+				SetMounts(table);
 				return 0;
 			}
 		}
@@ -376,9 +445,16 @@ int MetaFileSystem::ChDir(const std::string &dir)
 	}
 }
 
-bool MetaFileSystem::MkDir(const std::string &dirname)
+void MetaFileSystem::SetStartingDirectory(const std::string &dir)
 {
 	std::lock_guard<std::recursive_mutex> guard(lock);
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
+	table->startingDirectory = dir;
+	SetMounts(table);
+}
+
+bool MetaFileSystem::MkDir(const std::string &dirname)
+{
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
@@ -393,7 +469,6 @@ bool MetaFileSystem::MkDir(const std::string &dirname)
 
 bool MetaFileSystem::RmDir(const std::string &dirname)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(dirname, of, &system))
@@ -408,7 +483,6 @@ bool MetaFileSystem::RmDir(const std::string &dirname)
 
 int MetaFileSystem::RenameFile(const std::string &from, const std::string &to)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	std::string rf;
 	IFileSystem *osystem;
@@ -440,7 +514,6 @@ int MetaFileSystem::RenameFile(const std::string &from, const std::string &to)
 
 bool MetaFileSystem::RemoveFile(const std::string &filename)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	std::string of;
 	IFileSystem *system;
 	if (MapFilePath(filename, of, &system))
@@ -455,15 +528,14 @@ bool MetaFileSystem::RemoveFile(const std::string &filename)
 
 void MetaFileSystem::CloseFile(u32 handle)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
+	UnregisterHandle(handle);
 	if (sys)
 		sys->CloseFile(handle);
 }
 
 size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
 		return sys->ReadFile(handle,pointer,size);
@@ -473,7 +545,6 @@ size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 
 size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
 		return sys->WriteFile(handle,pointer,size);
@@ -483,7 +554,6 @@ size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
 
 size_t MetaFileSystem::SeekFile(u32 handle, s32 position, FileMove type)
 {
-	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
 	if (sys)
 		return sys->SeekFile(handle,position,type);
@@ -499,14 +569,25 @@ void MetaFileSystem::DoState(PointerWrap &p)
 	if (!s)
 		return;
 
-	p.Do(current);
+	u32 currentHandle = current;
+	p.Do(currentHandle);
+	current = currentHandle;
+
+	// The handles loaded are found by asking the systems until they are closed
+	if (p.mode == p.MODE_READ)
+	{
+		for (int i = 0; i < HANDLE_SLOTS; i++)
+			handleSlots[i].store(0);
+	}
 
 	// Save/load per-thread current directory map
-	p.Do(currentDir);
+	std::shared_ptr<MountTable> table = std::make_shared<MountTable>(*GetMounts());
+	p.Do(table->currentDir);
+	SetMounts(table);
 
-	u32 n = (u32) fileSystems.size();
+	u32 n = (u32) table->fileSystems.size();
 	p.Do(n);
-	if (n != (u32) fileSystems.size())
+	if (n != (u32) table->fileSystems.size())
 	{
 		p.SetError(p.ERROR_FAILURE);
 		ERROR_LOG(FILESYS, "Savestate failure: number of filesystems doesn't match.");
@@ -514,6 +595,5 @@ void MetaFileSystem::DoState(PointerWrap &p)
 	}
 
 	for (u32 i = 0; i < n; ++i)
-		fileSystems[i].system->DoState(p);
+		table->fileSystems[i].system->DoState(p);
 }
-
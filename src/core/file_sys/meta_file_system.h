@@ -17,14 +17,21 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include "common/std_mutex.h"
 
 #include "core/file_sys/file_sys.h"
 
+// Mounts and current directories are read far more often than they change, from the emulation
+// thread and from the I/O workers alike. They live in an immutable table, replaced as a whole by
+// the rare calls that change them, so that resolving a path takes no lock. Open handles are
+// resolved to their file system through a lock free slot table rather than by asking every
+// mounted system in turn. The file systems lock their own state.
 class MetaFileSystem : public IHandleAllocator, public IFileSystem
 {
 private:
-	u32 current;
 	struct MountPoint
 	{
 		std::string prefix;
@@ -35,21 +42,55 @@ private:
 			return prefix == other.prefix && system == other.system;
 		}
 	};
-	std::vector<MountPoint> fileSystems;
 
 	typedef std::map<int, std::string> currentDir_t;
-	currentDir_t currentDir;
 
-	std::string startingDirectory;
-	int lastOpenError;
+	// Published with an atomic pointer swap, never modified once it is.
+	struct MountTable
+	{
+		std::vector<MountPoint> fileSystems;
+		currentDir_t currentDir;
+		std::string startingDirectory;
+	};
+	typedef std::shared_ptr<const MountTable> MountTablePtr;
+
+	enum
+	{
+		MAX_FILE_SYSTEMS = 64,
+		HANDLE_SLOTS = 4096,	// Power of 2
+	};
+
+	std::atomic<u32> current;
+	MountTablePtr mounts;
+
+	// Slot handle % HANDLE_SLOTS holds the handle in its high word and the index of its owner in
+	// handleOwners plus one in its low word, 0 when empty. A handle whose slot is taken by an older
+	// one still open is left out, and found by asking every mounted system.
+	std::atomic<u64> handleSlots[HANDLE_SLOTS];
+	std::atomic<IFileSystem *> handleOwners[MAX_FILE_SYSTEMS];
+	u32 numHandleOwners;
+
+	// Taken by the calls that replace the mount table, readers go without it.
 	std::recursive_mutex lock;
 
-public:
-	MetaFileSystem()
+	MountTablePtr GetMounts() const
+	{
+		return std::atomic_load(&mounts);
+	}
+	void SetMounts(const MountTablePtr &table)
 	{
-		current = 6;  // what?
+		std::atomic_store(&mounts, table);
 	}
 
+	void RegisterHandle(u32 handle, IFileSystem *system);
+	void UnregisterHandle(u32 handle);
+	// The error of a failed open is returned through error rather than kept in a member, so that
+	// concurrent opens don't see each other's.
+	bool MapFilePath(const MountTable &table, const std::string &inpath, std::string &outpath, MountPoint *system, int *error = NULL);
+
+public:
+	MetaFileSystem();
+
 	void Mount(std::string prefix, IFileSystem *system);
 	void Unmount(std::string prefix, IFileSystem *system);
 
@@ -57,20 +98,20 @@ public:
 
 	void Shutdown();
 
-	u32 GetNewHandle() {return current++;}
+	u32 GetNewHandle() {return current.fetch_add(1);}
 	void FreeHandle(u32 handle) {}
 
 	virtual void DoState(PointerWrap &p);
 
 	IFileSystem *GetHandleOwner(u32 handle);
-	bool MapFilePath(const std::string &inpath, std::string &outpath, MountPoint **system);
+	bool MapFilePath(const std::string &inpath, std::string &outpath, MountPoint *system);
 
 	inline bool MapFilePath(const std::string &_inpath, std::string &outpath, IFileSystem **system)
 	{
-		MountPoint *mountPoint;
+		MountPoint mountPoint;
 		if (MapFilePath(_inpath, outpath, &mountPoint))
 		{
-			*system = mountPoint->system;
+			*system = mountPoint.system;
 			return true;
 		}
 
@@ -103,8 +144,5 @@ public:
 
 	// TODO: void IoCtl(...)
 
-	void SetStartingDirectory(const std::string &dir) {
-		std::lock_guard<std::recursive_mutex> guard(lock);
-		startingDirectory = dir;
-	}
+	void SetStartingDirectory(const std::string &dir);
 };
@@ -0,0 +1,553 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/hash.h"
+#include "common/log.h"
+#include "common/string_util.h"
+
+#include "core/file_sys/romfs_file_system.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+enum {
+    IVFC_MAGIC              = 0x43465649,   ///< "IVFC"
+    IVFC_MASTER_HASH_SIZE   = 0x08,         ///< Offsets in the IVFC header
+    IVFC_LEVEL3_BLOCK_SIZE  = 0x4C,         ///< Log2 of the block size of level 3
+    IVFC_HEADER_SIZE        = 0x60,         ///< Master hash follows, then level 3 at a block
+
+    LEVEL3_HEADER_SIZE      = 0x28,         ///< Level 3 holds the file system proper
+    LEVEL3_DIRECTORY_META   = 0x0C,         ///< Offsets in the level 3 header
+    LEVEL3_FILE_META        = 0x1C,
+    LEVEL3_FILE_DATA        = 0x24,
+
+    DIRECTORY_SIBLING       = 0x04,         ///< Offsets in directory metadata
+    DIRECTORY_FIRST_CHILD   = 0x08,
+    DIRECTORY_FIRST_FILE    = 0x0C,
+    DIRECTORY_NAME          = 0x18,
+
+    FILE_SIBLING            = 0x04,         ///< Offsets in file metadata
+    FILE_DATA_OFFSET        = 0x08,
+    FILE_DATA_SIZE          = 0x10,
+    FILE_NAME               = 0x20,
+
+    NO_META                 = 0xFFFFFFFF,   ///< Offset of missing siblings and children
+};
+
+u32 Read32(const u8* data, u64 offset) {
+    u32 value;
+    memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+u64 Read64(const u8* data, u64 offset) {
+    u64 value;
+    memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+/**
+ * Reads the name of a metadata entry, stored in UTF-16 after its length in bytes
+ * @param meta Metadata entry
+ * @param name_offset Offset of the name in the entry
+ * @return Name in UTF-8
+ */
+std::string ReadName(const u8* meta, u32 name_offset) {
+    // Entries are 4-byte aligned, so are the names after their lengths
+    const u32 length = Read32(meta, name_offset - 4) / 2;
+    std::string result(length * 3, '\0');
+    result.resize(UTF16ToUTF8((const u16*)(meta + name_offset), length, &result[0],
+        result.size()));
+    return result;
+}
+
+/**
+ * Gets a path in the form of the index, without leading or trailing slashes
+ * @param path Path in the file system
+ * @return Path as indexed
+ */
+std::string NormalizePath(const std::string& path) {
+    const size_t begin = path.find_first_not_of('/');
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    return path.substr(begin, path.find_last_not_of('/') + 1 - begin);
+}
+
+u32 HashPath(const std::string& path) {
+    return (u32)GetFastHash64((const u8*)path.data(), path.size());
+}
+
+/**
+ * Makes the info of an entry
+ * @param name Name to give the entry
+ * @param is_directory Whether the entry is a directory
+ * @param size Size of the entry in bytes
+ * @return Info of the entry
+ */
+FileInfo MakeFileInfo(const std::string& name, bool is_directory, u64 size) {
+    FileInfo info;
+    info.name = name;
+    info.exists = true;
+    info.type = is_directory ? FILETYPE_DIRECTORY : FILETYPE_NORMAL;
+    info.access = is_directory ? 0555 : 0444;
+    info.size = (s64)size;
+    info.sectorSize = 0;
+    memset(&info.atime, 0, sizeof(info.atime));
+    memset(&info.ctime, 0, sizeof(info.ctime));
+    memset(&info.mtime, 0, sizeof(info.mtime));
+    return info;
+}
+
+} // namespace
+
+/**
+ * Indexes the entries of a RomFS
+ * @param handle_allocator Allocator of the handles of opened files
+ * @param romfs RomFS image, starting with its IVFC header, must outlive the file system
+ * @param size Size of the image in bytes
+ * @param aes Key the RomFS is encrypted with, nullptr if it isn't
+ * @param ctr Counter of the start of the RomFS if it is encrypted
+ */
+RomFSFileSystem::RomFSFileSystem(IHandleAllocator* handle_allocator, const u8* romfs, u64 size,
+    const Common::AES128* aes, const u8* ctr) :
+    m_handle_allocator(handle_allocator), m_romfs(romfs), m_size(size), m_mapped(romfs),
+    m_image(nullptr), m_image_offset(0), m_directory_meta(nullptr), m_directory_meta_size(0),
+    m_file_meta(nullptr), m_file_meta_size(0), m_file_data_offset(0) {
+
+    SetCipher(aes, ctr);
+    // The metadata of an encrypted RomFS is decrypted to a copy, the image stays as it is
+    if (m_encrypted && !ReadMetadata()) {
+        ERROR_LOG(FILESYS, "RomFS is broken or its key wrong, no file of it can be opened");
+        return;
+    }
+    Index();
+}
+
+/**
+ * Indexes the entries of a RomFS in a compressed image
+ * @param handle_allocator Allocator of the handles of opened files
+ * @param image Compressed image, must outlive the file system
+ * @param offset Offset of the RomFS in the image, at its IVFC header
+ * @param size Size of the RomFS in bytes
+ * @param aes Key the RomFS is encrypted with, nullptr if it isn't
+ * @param ctr Counter of the start of the RomFS if it is encrypted
+ */
+RomFSFileSystem::RomFSFileSystem(IHandleAllocator* handle_allocator,
+    Common::CompressedImage* image, u64 offset, u64 size, const Common::AES128* aes,
+    const u8* ctr) :
+    m_handle_allocator(handle_allocator), m_romfs(nullptr), m_size(size), m_mapped(nullptr),
+    m_image(image), m_image_offset(offset), m_directory_meta(nullptr), m_directory_meta_size(0),
+    m_file_meta(nullptr), m_file_meta_size(0), m_file_data_offset(0) {
+
+    SetCipher(aes, ctr);
+    if (!ReadMetadata()) {
+        ERROR_LOG(FILESYS, "RomFS is broken, no file of it can be opened");
+        return;
+    }
+    Index();
+}
+
+/**
+ * Sets up the key and counter of an encrypted RomFS
+ * @param aes Key the RomFS is encrypted with, nullptr if it isn't
+ * @param ctr Counter of the start of the RomFS if it is encrypted
+ */
+void RomFSFileSystem::SetCipher(const Common::AES128* aes, const u8* ctr) {
+    m_encrypted = (aes != nullptr);
+    memset(m_ctr, 0, sizeof(m_ctr));
+    if (m_encrypted) {
+        m_aes = *aes;
+        memcpy(m_ctr, ctr, sizeof(m_ctr));
+    }
+}
+
+/// Indexes the entries, leaving none if the RomFS is broken
+void RomFSFileSystem::Index() {
+    if (!IndexEntries()) {
+        ERROR_LOG(FILESYS, "RomFS is broken, no file of it can be opened");
+        m_entries.clear();
+        m_index.clear();
+        return;
+    }
+    INFO_LOG(FILESYS, "indexed %u RomFS entries", (u32)m_entries.size());
+}
+
+RomFSFileSystem::~RomFSFileSystem() {
+}
+
+/**
+ * Reads bytes of the RomFS from the image, decrypting them if the RomFS is encrypted
+ * @param offset Offset of the bytes in the RomFS
+ * @param data Receives the bytes
+ * @param size Number of bytes to read
+ * @return Number of bytes read
+ */
+size_t RomFSFileSystem::ReadImage(u64 offset, u8* data, size_t size) const {
+    if (m_image != nullptr) {
+        size = m_image->Read(m_image_offset + offset, data, size);
+    } else {
+        memcpy(data, m_mapped + offset, size);
+    }
+    if (m_encrypted) {
+        m_aes.TransformCTR(data, size, m_ctr, offset);
+    }
+    return size;
+}
+
+/**
+ * Reads the start of a RomFS that isn't mapped as is, from its IVFC header to the end of its
+ * metadata tables or the start of its file data, whichever is last
+ * @return True on success, false if the RomFS is broken
+ */
+bool RomFSFileSystem::ReadMetadata() {
+    u8 header[IVFC_HEADER_SIZE];
+    if (m_size < IVFC_HEADER_SIZE || ReadImage(0, header, sizeof(header)) != sizeof(header) ||
+        Read32(header, 0) != IVFC_MAGIC || Read32(header, IVFC_LEVEL3_BLOCK_SIZE) >= 32) {
+        return false;
+    }
+    const u64 block_size = 1ULL << Read32(header, IVFC_LEVEL3_BLOCK_SIZE);
+    const u64 level3 = (IVFC_HEADER_SIZE + Read32(header, IVFC_MASTER_HASH_SIZE) + block_size - 1)
+        & ~(block_size - 1);
+    u8 level3_header[LEVEL3_HEADER_SIZE];
+    if (level3 + LEVEL3_HEADER_SIZE > m_size ||
+        ReadImage(level3, level3_header, sizeof(level3_header)) != sizeof(level3_header)) {
+        return false;
+    }
+
+    // Bounds are checked again when the metadata is indexed
+    const u64 directory_meta_end = (u64)Read32(level3_header, LEVEL3_DIRECTORY_META) +
+        Read32(level3_header, LEVEL3_DIRECTORY_META + 4);
+    const u64 file_meta_end = (u64)Read32(level3_header, LEVEL3_FILE_META) +
+        Read32(level3_header, LEVEL3_FILE_META + 4);
+    const u64 file_data = Read32(level3_header, LEVEL3_FILE_DATA);
+    const u64 metadata_size = std::min(m_size, level3 + std::max<u64>(LEVEL3_HEADER_SIZE,
+        std::max(std::max(directory_meta_end, file_meta_end), file_data)));
+    m_metadata.resize((size_t)metadata_size);
+    if (ReadImage(0, m_metadata.data(), m_metadata.size()) != m_metadata.size()) {
+        return false;
+    }
+    m_romfs = m_metadata.data();
+    return true;
+}
+
+/**
+ * Locates the metadata tables, and walks the directory tree into the entries and their index
+ * @return True on success, false if the RomFS is broken
+ */
+bool RomFSFileSystem::IndexEntries() {
+    if (m_size < IVFC_HEADER_SIZE || Read32(m_romfs, 0) != IVFC_MAGIC) {
+        return false;
+    }
+    const u32 block_size_log2 = Read32(m_romfs, IVFC_LEVEL3_BLOCK_SIZE);
+    if (block_size_log2 >= 32) {
+        return false;
+    }
+    const u64 block_size = 1ULL << block_size_log2;
+    const u64 level3 = (IVFC_HEADER_SIZE + Read32(m_romfs, IVFC_MASTER_HASH_SIZE) + block_size - 1)
+        & ~(block_size - 1);
+    if (level3 + LEVEL3_HEADER_SIZE > m_size) {
+        return false;
+    }
+
+    const u64 directory_meta = level3 + Read32(m_romfs, level3 + LEVEL3_DIRECTORY_META);
+    m_directory_meta_size = Read32(m_romfs, level3 + LEVEL3_DIRECTORY_META + 4);
+    const u64 file_meta = level3 + Read32(m_romfs, level3 + LEVEL3_FILE_META);
+    m_file_meta_size = Read32(m_romfs, level3 + LEVEL3_FILE_META + 4);
+    m_file_data_offset = level3 + Read32(m_romfs, level3 + LEVEL3_FILE_DATA);
+    if (directory_meta + m_directory_meta_size > m_size || file_meta + m_file_meta_size > m_size ||
+        m_file_data_offset > m_size) {
+        return false;
+    }
+    m_directory_meta = m_romfs + directory_meta;
+    m_file_meta = m_romfs + file_meta;
+
+    // Breadth first from the root, entries being added behind the directory walked
+    const Entry root = { std::string(), 0, true, 0, 0 };
+    if (GetDirectoryMeta(0) == nullptr) {
+        return false;
+    }
+    m_entries.push_back(root);
+    for (u32 i = 0; i < (u32)m_entries.size(); i++) {
+        if (m_entries[i].is_directory && !AddChildren(i)) {
+            return false;
+        }
+    }
+
+    size_t index_size = 16;
+    while (index_size < m_entries.size() * 2) {
+        index_size *= 2;
+    }
+    const IndexSlot empty = { 0, INVALID_ENTRY };
+    m_index.assign(index_size, empty);
+    const size_t mask = index_size - 1;
+    for (u32 i = 0; i < (u32)m_entries.size(); i++) {
+        const u32 hash = HashPath(m_entries[i].path);
+        size_t slot = hash & mask;
+        while (m_index[slot].entry != INVALID_ENTRY) {
+            slot = (slot + 1) & mask;
+        }
+        m_index[slot].hash = hash;
+        m_index[slot].entry = i;
+    }
+    return true;
+}
+
+/**
+ * Adds the subdirectories and files of a directory to the entries
+ * @param directory Index of the entry of the directory
+ * @return True on success, false if the metadata is broken
+ */
+bool RomFSFileSystem::AddChildren(u32 directory) {
+    const std::string parent = m_entries[directory].path;
+    const std::string prefix = parent.empty() ? parent : parent + "/";
+    const u8* meta = GetDirectoryMeta(m_entries[directory].meta_offset);
+    // Each metadata entry takes at least its fixed part, more entries means a cycle
+    const size_t max_entries = m_directory_meta_size / DIRECTORY_NAME +
+        m_file_meta_size / FILE_NAME;
+
+    for (u32 offset = Read32(meta, DIRECTORY_FIRST_CHILD); offset != NO_META;) {
+        const u8* child = GetDirectoryMeta(offset);
+        if (child == nullptr || m_entries.size() > max_entries) {
+            return false;
+        }
+        const Entry entry = { prefix + ReadName(child, DIRECTORY_NAME), offset, true, 0, 0 };
+        m_entries.push_back(entry);
+        offset = Read32(child, DIRECTORY_SIBLING);
+    }
+    for (u32 offset = Read32(meta, DIRECTORY_FIRST_FILE); offset != NO_META;) {
+        const u8* file = GetFileMeta(offset);
+        if (file == nullptr || m_entries.size() > max_entries) {
+            return false;
+        }
+        const u64 data_offset = m_file_data_offset + Read64(file, FILE_DATA_OFFSET);
+        const u64 size = Read64(file, FILE_DATA_SIZE);
+        if (data_offset > m_size || size > m_size - data_offset) {
+            return false;
+        }
+        const Entry entry = { prefix + ReadName(file, FILE_NAME), offset, false, data_offset,
+            size };
+        m_entries.push_back(entry);
+        offset = Read32(file, FILE_SIBLING);
+    }
+    return true;
+}
+
+/**
+ * Looks an entry up in the index
+ * @param path Path of the entry
+ * @return The entry, nullptr if there is none at the path
+ */
+const RomFSFileSystem::Entry* RomFSFileSystem::FindEntry(const std::string& path) const {
+    if (m_index.empty()) {
+        return nullptr;
+    }
+    const std::string normalized = NormalizePath(path);
+    const u32 hash = HashPath(normalized);
+    const size_t mask = m_index.size() - 1;
+    for (size_t slot = hash & mask; m_index[slot].entry != INVALID_ENTRY;
+        slot = (slot + 1) & mask) {
+
+        const IndexSlot& it = m_index[slot];
+        if (it.hash == hash && m_entries[it.entry].path == normalized) {
+            return &m_entries[it.entry];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Finds a file opened. The entries of the map stay where they are until closed, so the file can
+ * be read or seeked without the lock, which is only needed while the map is looked up or changed.
+ * @param handle Handle of the file
+ * @return The file, nullptr if the handle isn't one of an opened file
+ */
+RomFSFileSystem::OpenFileEntry* RomFSFileSystem::FindOpenFile(u32 handle) {
+    std::lock_guard<std::mutex> guard(m_open_files_lock);
+    EntryMap::iterator it = m_open_files.find(handle);
+    return it != m_open_files.end() ? &it->second : nullptr;
+}
+
+/**
+ * Gets directory metadata, checking that it lies in its table
+ * @param offset Offset of the metadata in the table
+ * @return The metadata, nullptr if it lies out of the table
+ */
+const u8* RomFSFileSystem::GetDirectoryMeta(u32 offset) const {
+    if ((u64)offset + DIRECTORY_NAME > m_directory_meta_size ||
+        Read32(m_directory_meta, offset + DIRECTORY_NAME - 4) >
+        m_directory_meta_size - offset - DIRECTORY_NAME) {
+        return nullptr;
+    }
+    return m_directory_meta + offset;
+}
+
+/**
+ * Gets file metadata, checking that it lies in its table
+ * @param offset Offset of the metadata in the table
+ * @return The metadata, nullptr if it lies out of the table
+ */
+const u8* RomFSFileSystem::GetFileMeta(u32 offset) const {
+    if ((u64)offset + FILE_NAME > m_file_meta_size ||
+        Read32(m_file_meta, offset + FILE_NAME - 4) > m_file_meta_size - offset - FILE_NAME) {
+        return nullptr;
+    }
+    return m_file_meta + offset;
+}
+
+void RomFSFileSystem::DoState(PointerWrap& p) {
+    auto s = p.Section("RomFSFileSystem", 1);
+    if (!s) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(m_open_files_lock);
+    p.Do(m_open_files);
+    // The state can come from another RomFS
+    for (auto it = m_open_files.begin(); it != m_open_files.end();) {
+        if (it->second.entry >= m_entries.size() || m_entries[it->second.entry].is_directory) {
+            p.SetError(p.ERROR_FAILURE);
+            ERROR_LOG(FILESYS, "Savestate failure: file opened isn't in the RomFS.");
+            it = m_open_files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<FileInfo> RomFSFileSystem::GetDirListing(std::string path) {
+    std::vector<FileInfo> listing;
+    const Entry* directory = FindEntry(path);
+    if (directory == nullptr || !directory->is_directory) {
+        ERROR_LOG(FILESYS, "RomFS has no directory %s", path.c_str());
+        return listing;
+    }
+    const std::string prefix = directory->path.empty() ? directory->path : directory->path + "/";
+    const u8* meta = GetDirectoryMeta(directory->meta_offset);
+
+    // Entries were checked when indexed, their names lead back to them
+    for (u32 offset = Read32(meta, DIRECTORY_FIRST_CHILD); offset != NO_META;) {
+        const u8* child = GetDirectoryMeta(offset);
+        listing.push_back(MakeFileInfo(ReadName(child, DIRECTORY_NAME), true, 0));
+        offset = Read32(child, DIRECTORY_SIBLING);
+    }
+    for (u32 offset = Read32(meta, DIRECTORY_FIRST_FILE); offset != NO_META;) {
+        const u8* file = GetFileMeta(offset);
+        listing.push_back(MakeFileInfo(ReadName(file, FILE_NAME), false,
+            Read64(file, FILE_DATA_SIZE)));
+        offset = Read32(file, FILE_SIBLING);
+    }
+    return listing;
+}
+
+u32 RomFSFileSystem::OpenFile(std::string filename, FileAccess access, const char* devicename) {
+    if (access & (FILEACCESS_WRITE | FILEACCESS_APPEND | FILEACCESS_CREATE)) {
+        ERROR_LOG(FILESYS, "RomFS is read-only, can't open %s with access %i", filename.c_str(),
+            (int)access);
+        return 0;
+    }
+    const Entry* entry = FindEntry(filename);
+    if (entry == nullptr || entry->is_directory) {
+        ERROR_LOG(FILESYS, "RomFS has no file %s", filename.c_str());
+        return 0;
+    }
+    const OpenFileEntry open_file = { (u32)(entry - &m_entries[0]), 0 };
+    const u32 handle = m_handle_allocator->GetNewHandle();
+    std::lock_guard<std::mutex> guard(m_open_files_lock);
+    m_open_files[handle] = open_file;
+    return handle;
+}
+
+void RomFSFileSystem::CloseFile(u32 handle) {
+    std::lock_guard<std::mutex> guard(m_open_files_lock);
+    EntryMap::iterator it = m_open_files.find(handle);
+    if (it == m_open_files.end()) {
+        ERROR_LOG(FILESYS, "Cannot close file that hasn't been opened: %08x", handle);
+        return;
+    }
+    m_handle_allocator->FreeHandle(handle);
+    m_open_files.erase(it);
+}
+
+size_t RomFSFileSystem::ReadFile(u32 handle, u8* pointer, s64 size) {
+    OpenFileEntry* const found = FindOpenFile(handle);
+    if (found == nullptr) {
+        ERROR_LOG(FILESYS, "Cannot read file that hasn't been opened: %08x", handle);
+        return 0;
+    }
+    OpenFileEntry& open_file = *found;
+    const Entry& entry = m_entries[open_file.entry];
+    if (size <= 0 || open_file.position >= entry.size) {
+        return 0;
+    }
+    // Straight from the image, pages of it are only read in as they are copied
+    u64 count = std::min<u64>((u64)size, entry.size - open_file.position);
+    if (m_image != nullptr || m_encrypted) {
+        count = ReadImage(entry.data_offset + open_file.position, pointer, (size_t)count);
+    } else {
+        memcpy(pointer, m_romfs + entry.data_offset + open_file.position, (size_t)count);
+    }
+    open_file.position += count;
+    return (size_t)count;
+}
+
+size_t RomFSFileSystem::WriteFile(u32 handle, const u8* pointer, s64 size) {
+    ERROR_LOG(FILESYS, "Cannot write to the RomFS: %08x", handle);
+    return 0;
+}
+
+size_t RomFSFileSystem::SeekFile(u32 handle, s32 position, FileMove type) {
+    OpenFileEntry* const found = FindOpenFile(handle);
+    if (found == nullptr) {
+        ERROR_LOG(FILESYS, "Cannot seek in file that hasn't been opened: %08x", handle);
+        return 0;
+    }
+    OpenFileEntry& open_file = *found;
+    s64 base = 0;
+    switch (type) {
+    case FILEMOVE_BEGIN:    base = 0;                                       break;
+    case FILEMOVE_CURRENT:  base = (s64)open_file.position;                 break;
+    case FILEMOVE_END:      base = (s64)m_entries[open_file.entry].size;    break;
+    }
+    open_file.position = (u64)std::max<s64>(base + position, 0);
+    return (size_t)open_file.position;
+}
+
+FileInfo RomFSFileSystem::GetFileInfo(std::string filename) {
+    const Entry* entry = FindEntry(filename);
+    if (entry == nullptr) {
+        FileInfo info;
+        info.name = filename;
+        return info;
+    }
+    return MakeFileInfo(filename, entry->is_directory, entry->size);
+}
+
+bool RomFSFileSystem::OwnsHandle(u32 handle) {
+    return FindOpenFile(handle) != nullptr;
+}
+
+bool RomFSFileSystem::MkDir(const std::string& dirname) {
+    return false;
+}
+
+bool RomFSFileSystem::RmDir(const std::string& dirname) {
+    return false;
+}
+
+int RomFSFileSystem::RenameFile(const std::string& from, const std::string& to) {
+    return -1;
+}
+
+bool RomFSFileSystem::RemoveFile(const std::string& filename) {
+    return false;
+}
+
+bool RomFSFileSystem::GetHostPath(const std::string& inpath, std::string& outpath) {
+    return false;
+}
@@ -0,0 +1,131 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/compressed_image.h"
+#include "common/crypto.h"
+#include "common/std_mutex.h"
+
+#include "core/file_sys/file_sys.h"
+
+/**
+ * Read-only file system over a RomFS image held in memory, typically mapped from the application
+ * image. The directory tree is walked once when the file system is created, into a table of the
+ * paths of all of the entries indexed by hash, and reads copy from the image straight into the
+ * buffer they are given. A RomFS in a compressed image has its metadata read up front, and its
+ * files read from the image as they are. An encrypted RomFS is decrypted as it is read, the
+ * metadata once up front and the file data as the files are read.
+ */
+class RomFSFileSystem : public IFileSystem {
+public:
+    /**
+     * Indexes the entries of a RomFS
+     * @param handle_allocator Allocator of the handles of opened files
+     * @param romfs RomFS image, starting with its IVFC header, must outlive the file system
+     * @param size Size of the image in bytes
+     * @param aes Key the RomFS is encrypted with, nullptr if it isn't
+     * @param ctr Counter of the start of the RomFS if it is encrypted
+     */
+    RomFSFileSystem(IHandleAllocator* handle_allocator, const u8* romfs, u64 size,
+        const Common::AES128* aes = nullptr, const u8* ctr = nullptr);
+
+    /**
+     * Indexes the entries of a RomFS in a compressed image
+     * @param handle_allocator Allocator of the handles of opened files
+     * @param image Compressed image, must outlive the file system
+     * @param offset Offset of the RomFS in the image, at its IVFC header
+     * @param size Size of the RomFS in bytes
+     * @param aes Key the RomFS is encrypted with, nullptr if it isn't
+     * @param ctr Counter of the start of the RomFS if it is encrypted
+     */
+    RomFSFileSystem(IHandleAllocator* handle_allocator, Common::CompressedImage* image,
+        u64 offset, u64 size, const Common::AES128* aes = nullptr, const u8* ctr = nullptr);
+    ~RomFSFileSystem();
+
+    /// Whether the image is a RomFS the file system could index
+    bool IsValid() const {
+        return !m_entries.empty();
+    }
+
+    void DoState(PointerWrap& p);
+    std::vector<FileInfo> GetDirListing(std::string path);
+    u32      OpenFile(std::string filename, FileAccess access, const char* devicename = NULL);
+    void     CloseFile(u32 handle);
+    size_t   ReadFile(u32 handle, u8* pointer, s64 size);
+    size_t   WriteFile(u32 handle, const u8* pointer, s64 size);
+    size_t   SeekFile(u32 handle, s32 position, FileMove type);
+    FileInfo GetFileInfo(std::string filename);
+    bool     OwnsHandle(u32 handle);
+
+    bool MkDir(const std::string& dirname);
+    bool RmDir(const std::string& dirname);
+    int  RenameFile(const std::string& from, const std::string& to);
+    bool RemoveFile(const std::string& filename);
+    bool GetHostPath(const std::string& inpath, std::string& outpath);
+
+private:
+    /// File or directory of the RomFS
+    struct Entry {
+        std::string path;           ///< Full path, without leading or trailing slashes
+        u32         meta_offset;    ///< Of the entry in the directory or file metadata table
+        bool        is_directory;
+        u64         data_offset;    ///< Of the data of a file in the image
+        u64         size;           ///< Of the data of a file in bytes
+    };
+
+    /// Slot of the path index
+    struct IndexSlot {
+        u32 hash;
+        u32 entry;                  ///< Index of the entry, INVALID_ENTRY for empty slots
+    };
+
+    /// File opened, plain data to be savestated as is
+    struct OpenFileEntry {
+        u32 entry;
+        u64 position;
+    };
+
+    enum {
+        INVALID_ENTRY = 0xFFFFFFFF,
+    };
+
+    void SetCipher(const Common::AES128* aes, const u8* ctr);
+    void Index();
+    bool IndexEntries();
+    bool ReadMetadata();
+    size_t ReadImage(u64 offset, u8* data, size_t size) const;
+    bool AddChildren(u32 directory);
+    const Entry* FindEntry(const std::string& path) const;
+    OpenFileEntry* FindOpenFile(u32 handle);
+
+    const u8*   GetDirectoryMeta(u32 offset) const;
+    const u8*   GetFileMeta(u32 offset) const;
+
+    typedef std::map<u32, OpenFileEntry> EntryMap;
+
+    IHandleAllocator*       m_handle_allocator;
+    const u8*               m_romfs;            ///< Only up to the file data if read
+    u64                     m_size;
+    const u8*               m_mapped;           ///< Mapped image, nullptr if from m_image
+    Common::CompressedImage* m_image;           ///< To read file data from, nullptr if mapped
+    u64                     m_image_offset;     ///< Of the RomFS in m_image
+    bool                    m_encrypted;
+    Common::AES128          m_aes;              ///< Key of an encrypted RomFS
+    u8                      m_ctr[Common::AES128::BLOCK_SIZE];
+    std::vector<u8>         m_metadata;         ///< Start of the RomFS if read, not mapped
+    const u8*               m_directory_meta;   ///< Table of the directory metadata
+    u32                     m_directory_meta_size;
+    const u8*               m_file_meta;        ///< Table of the file metadata
+    u32                     m_file_meta_size;
+    u64                     m_file_data_offset; ///< Offset of the file data in the image
+    std::vector<Entry>      m_entries;          ///< Root directory first
+    std::vector<IndexSlot>  m_index;            ///< Open addressed by path hash, power of 2 sized
+    EntryMap                m_open_files;
+    std::mutex              m_open_files_lock;  ///< Only guards the map, not the files in it
+};
@@ -0,0 +1,647 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/file_util.h"
+#include "common/log.h"
+#include "common/thread.h"
+#include "common/utf8.h"
+
+#include "core/file_sys/save_data_file_system.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+/// Suffix of the files a commit writes before renaming them over the originals
+const char kTempSuffix[] = ".citra-commit";
+
+/// Journal of the commit being renamed into place, at the root of the save data
+const char kJournalName[] = ".citra-journal";
+
+/**
+ * Gets the key of a path in the overlay
+ * @param path Path in the save data
+ * @return Path without leading, trailing or doubled slashes
+ */
+std::string NormalizePath(const std::string& path) {
+    std::string normalized;
+    for (size_t i = 0; i < path.size(); i++) {
+        const char c = path[i] == '\\' ? '/' : path[i];
+        if (c != '/' || (!normalized.empty() && normalized[normalized.size() - 1] != '/')) {
+            normalized += c;
+        }
+    }
+    if (!normalized.empty() && normalized[normalized.size() - 1] == '/') {
+        normalized.erase(normalized.size() - 1);
+    }
+    return normalized;
+}
+
+/// Gets the directory of a normalized path, empty at the root
+std::string GetParent(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+/// Gets the name of a normalized path in its directory
+std::string GetName(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/// Whether a host file is one of the commits, which the guest doesn't see
+bool IsCommitFile(const std::string& name) {
+    const size_t suffix = sizeof(kTempSuffix) - 1;
+    return name == kJournalName || (name.size() > suffix &&
+        name.compare(name.size() - suffix, suffix, kTempSuffix) == 0);
+}
+
+/**
+ * Writes a host file and waits for it to reach the disk
+ * @param path Host path of the file
+ * @param data Contents of the file
+ * @param size Size of the contents in bytes
+ * @return True on success
+ */
+bool WriteDurably(const std::string& path, const void* data, size_t size) {
+    File::IOFile file(path, "wb");
+    if (!file.IsOpen() || !file.WriteBytes(data, size) || !file.Flush()) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file.GetHandle())) == 0;
+#else
+    return fsync(fileno(file.GetHandle())) == 0;
+#endif
+}
+
+/**
+ * Renames a host file over another in one step, as seen by a process killed meanwhile
+ * @param from Host path of the file renamed
+ * @param to Host path replaced
+ * @return True on success
+ */
+bool ReplaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExW(ConvertUTF8ToWString(from).c_str(), ConvertUTF8ToWString(to).c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+/**
+ * Mounts a host directory, finishing the commit a killed process left half done
+ * @param handle_allocator Allocator of the handles of opened files
+ * @param base_path Host directory of the save data, created if missing
+ */
+SaveDataFileSystem::SaveDataFileSystem(IHandleAllocator* handle_allocator,
+    const std::string& base_path) : m_handle_allocator(handle_allocator),
+    m_base_path(base_path.empty() || base_path[base_path.size() - 1] == '/' ? base_path :
+        base_path + "/"),
+    m_host(handle_allocator, m_base_path), m_writing(false), m_quit(false) {
+    RecoverJournal();
+    m_writer = new std::thread(&SaveDataFileSystem::WriterThreadFunc, this);
+}
+
+/// Commits the files written and waits for them to be on disk
+SaveDataFileSystem::~SaveDataFileSystem() {
+    Commit();
+    {
+        std::lock_guard<std::mutex> guard(m_commits_lock);
+        m_quit = true;
+    }
+    m_commits_changed.notify_all();
+    m_writer->join();
+    delete m_writer;
+}
+
+/// Commits the files written since their last commit, returning before they're on disk
+void SaveDataFileSystem::Commit() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    CommitFiles(m_files.begin(), m_files.end());
+}
+
+/// Waits for the commits to be on disk
+void SaveDataFileSystem::WaitForWrites() {
+    std::unique_lock<std::mutex> lock(m_commits_lock);
+    while (!m_commits.empty() || m_writing) {
+        m_commits_changed.wait(lock);
+    }
+}
+
+/**
+ * Gets a file of the overlay, reading it from the host the first time
+ * @param path Normalized path of the file
+ * @return The file, not existing if the host has no such file
+ */
+SaveDataFileSystem::CachedFile& SaveDataFileSystem::LoadFile(const std::string& path) {
+    FileMap::iterator it = m_files.find(path);
+    if (it != m_files.end()) {
+        return it->second;
+    }
+
+    CachedFile file;
+    file.data = std::make_shared<std::vector<u8>>();
+    file.exists = false;
+    file.dirty = false;
+    const u32 handle = m_host.OpenFile(path, FILEACCESS_READ);
+    if (handle != 0) {
+        file.exists = true;
+        file.data->resize(m_host.SeekFile(handle, 0, FILEMOVE_END));
+        m_host.SeekFile(handle, 0, FILEMOVE_BEGIN);
+        if (!file.data->empty()) {
+            file.data->resize(m_host.ReadFile(handle, file.data->data(), file.data->size()));
+        }
+        m_host.CloseFile(handle);
+    }
+    return m_files.insert(std::make_pair(path, file)).first->second;
+}
+
+SaveDataFileSystem::OpenFileEntry* SaveDataFileSystem::FindOpenFile(u32 handle) {
+    EntryMap::iterator it = m_open_files.find(handle);
+    return it != m_open_files.end() ? &it->second : nullptr;
+}
+
+/**
+ * Hands the files of a range of the overlay changed since their last commit to the writer, as a
+ * single commit
+ * @param begin First file of the range
+ * @param end End of the range
+ */
+void SaveDataFileSystem::CommitFiles(FileMap::iterator begin, FileMap::iterator end) {
+    PendingCommit commit;
+    for (FileMap::iterator it = begin; it != end; ++it) {
+        CachedFile& file = it->second;
+        if (!file.dirty) {
+            continue;
+        }
+        // Shared rather than copied, a write to the file afterwards copies it first
+        PendingWrite write = { it->first, nullptr };
+        if (file.exists) {
+            write.data = file.data;
+        }
+        commit.push_back(write);
+        file.dirty = false;
+    }
+    if (commit.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(m_commits_lock);
+        m_commits.push_back(std::move(commit));
+    }
+    m_commits_changed.notify_all();
+}
+
+/// Commits a file of the overlay if it changed since its last commit
+void SaveDataFileSystem::CommitFile(FileMap::iterator it) {
+    FileMap::iterator end = it;
+    CommitFiles(it, ++end);
+}
+
+/**
+ * Writes a commit to the host directory, from the writer thread
+ * @param commit Files of the commit
+ */
+void SaveDataFileSystem::WriteCommit(const PendingCommit& commit) {
+    std::string journal;
+    for (const PendingWrite& write : commit) {
+        const std::string host_path = m_base_path + write.path;
+        if (write.data != nullptr) {
+            File::CreateFullPath(m_base_path + GetParent(write.path) + "/");
+            const std::vector<u8>& data = *write.data;
+            if (!WriteDurably(host_path + kTempSuffix, data.empty() ? nullptr : &data[0],
+                data.size())) {
+                ERROR_LOG(FILESYS, "Can't write save data %s, commit dropped", host_path.c_str());
+                for (const PendingWrite& written : commit) {
+                    File::Delete(m_base_path + written.path + kTempSuffix);
+                }
+                return;
+            }
+        }
+        journal += (write.data != nullptr ? "w " : "d ") + write.path + "\n";
+    }
+
+    // The commit takes place with the journal renamed into place, before the files are
+    const std::string journal_path = m_base_path + kJournalName;
+    const std::string journal_temp = journal_path + kTempSuffix;
+    if (!WriteDurably(journal_temp, journal.data(), journal.size()) ||
+        !ReplaceFile(journal_temp, journal_path)) {
+        ERROR_LOG(FILESYS, "Can't write the journal of %s, commit dropped", m_base_path.c_str());
+        return;
+    }
+    ApplyJournal(journal);
+    File::Delete(journal_path);
+}
+
+/**
+ * Renames the files of a journal over their originals and removes those it removes. Files
+ * renamed already are skipped, so a journal can be applied again.
+ * @param journal Journal, a line per file: "w <path>" for a file written, "d <path>" removed
+ */
+void SaveDataFileSystem::ApplyJournal(const std::string& journal) {
+    size_t begin = 0;
+    while (begin < journal.size()) {
+        size_t end = journal.find('\n', begin);
+        if (end == std::string::npos) {
+            end = journal.size();
+        }
+        const std::string line = journal.substr(begin, end - begin);
+        begin = end + 1;
+        if (line.size() < 3) {
+            continue;
+        }
+
+        const std::string host_path = m_base_path + line.substr(2);
+        if (line[0] == 'w') {
+            if (File::Exists(host_path + kTempSuffix) &&
+                !ReplaceFile(host_path + kTempSuffix, host_path)) {
+                ERROR_LOG(FILESYS, "Can't commit save data %s", host_path.c_str());
+            }
+        } else if (File::Exists(host_path)) {
+            File::Delete(host_path);
+        }
+    }
+}
+
+/// Finishes the commit of a killed process if its journal made it to disk, else drops it
+void SaveDataFileSystem::RecoverJournal() {
+    const std::string journal_path = m_base_path + kJournalName;
+    std::string journal;
+    if (File::Exists(journal_path) && File::ReadFileToString(false, journal_path.c_str(),
+        journal)) {
+        WARN_LOG(FILESYS, "Finishing the save data commit interrupted in %s", m_base_path.c_str());
+        ApplyJournal(journal);
+        File::Delete(journal_path);
+    }
+
+    const std::string journal_temp = journal_path + kTempSuffix;
+    if (File::Exists(journal_temp) && File::ReadFileToString(false, journal_temp.c_str(),
+        journal)) {
+        // Files of a commit that never took place, the originals are still whole
+        size_t begin = 0;
+        while (begin < journal.size()) {
+            size_t end = journal.find('\n', begin);
+            if (end == std::string::npos) {
+                end = journal.size();
+            }
+            if (end - begin > 2) {
+                File::Delete(m_base_path + journal.substr(begin + 2, end - begin - 2) +
+                    kTempSuffix);
+            }
+            begin = end + 1;
+        }
+        File::Delete(journal_temp);
+    }
+}
+
+/// Writer thread: writes the commits queued, in order
+void SaveDataFileSystem::WriterThreadFunc() {
+    Common::SetCurrentThreadName("Save data writer");
+
+    std::unique_lock<std::mutex> lock(m_commits_lock);
+    for (;;) {
+        while (m_commits.empty() && !m_quit) {
+            m_commits_changed.wait(lock);
+        }
+        if (m_commits.empty()) {
+            break;
+        }
+        PendingCommit commit = std::move(m_commits.front());
+        m_commits.pop_front();
+        m_writing = true;
+        lock.unlock();
+
+        WriteCommit(commit);
+        commit.clear();
+
+        lock.lock();
+        m_writing = false;
+        m_commits_changed.notify_all();
+    }
+}
+
+void SaveDataFileSystem::DoState(PointerWrap& p) {
+    auto s = p.Section("SaveDataFileSystem", 1);
+    if (!s) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // Open files, and the files written but not committed: the rest is on disk
+    u32 count = (u32)m_open_files.size();
+    p.Do(count);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        m_open_files.clear();
+    }
+    EntryMap::iterator open_file = m_open_files.begin();
+    for (u32 i = 0; i < count; i++) {
+        u32 handle = 0;
+        OpenFileEntry entry;
+        if (p.GetMode() != PointerWrap::MODE_READ) {
+            handle = open_file->first;
+            entry = open_file->second;
+            ++open_file;
+        }
+        int access = (int)entry.access;
+        p.Do(handle);
+        p.Do(entry.path);
+        p.Do(entry.position);
+        p.Do(access);
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            entry.access = (FileAccess)access;
+            m_open_files[handle] = entry;
+        }
+    }
+
+    count = 0;
+    for (FileMap::const_iterator it = m_files.begin(); it != m_files.end(); ++it) {
+        count += it->second.dirty ? 1 : 0;
+    }
+    p.Do(count);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // Whatever the state didn't write is read again from the commits on disk
+        WaitForWrites();
+        m_files.clear();
+    }
+    FileMap::iterator file = m_files.begin();
+    for (u32 i = 0; i < count; i++) {
+        std::string path;
+        std::vector<u8> data;
+        bool exists = false;
+        if (p.GetMode() != PointerWrap::MODE_READ) {
+            while (!file->second.dirty) {
+                ++file;
+            }
+            path = file->first;
+            data = *file->second.data;
+            exists = file->second.exists;
+            ++file;
+        }
+        p.Do(path);
+        p.Do(data);
+        p.Do(exists);
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            CachedFile cached = {
+                std::make_shared<std::vector<u8>>(std::move(data)), exists, true
+            };
+            m_files[path] = cached;
+        }
+    }
+}
+
+std::vector<FileInfo> SaveDataFileSystem::GetDirListing(std::string path) {
+    std::vector<FileInfo> listing = m_host.GetDirListing(path);
+    listing.erase(std::remove_if(listing.begin(), listing.end(),
+        [](const FileInfo& info) { return IsCommitFile(info.name); }), listing.end());
+
+    // Files of the overlay replace those of the host, or hide them once removed
+    const std::string directory = NormalizePath(path);
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (FileMap::const_iterator it = m_files.begin(); it != m_files.end(); ++it) {
+        if (GetParent(it->first) != directory) {
+            continue;
+        }
+        const std::string name = GetName(it->first);
+        std::vector<FileInfo>::iterator entry = std::find_if(listing.begin(), listing.end(),
+            [&](const FileInfo& info) { return info.name == name; });
+        if (!it->second.exists) {
+            if (entry != listing.end()) {
+                listing.erase(entry);
+            }
+            continue;
+        }
+        if (entry == listing.end()) {
+            FileInfo info;
+            info.name = name;
+            info.exists = true;
+            info.type = FILETYPE_NORMAL;
+            info.access = 0666;
+            memset(&info.atime, 0, sizeof(info.atime));
+            memset(&info.ctime, 0, sizeof(info.ctime));
+            memset(&info.mtime, 0, sizeof(info.mtime));
+            entry = listing.insert(listing.end(), info);
+        }
+        entry->size = (s64)it->second.data->size();
+    }
+    return listing;
+}
+
+u32 SaveDataFileSystem::OpenFile(std::string filename, FileAccess access, const char* devicename) {
+    const std::string path = NormalizePath(filename);
+    std::lock_guard<std::mutex> guard(m_lock);
+    CachedFile& file = LoadFile(path);
+
+    // As fopen: files opened to write or append are created, those to read and write only with
+    // FILEACCESS_CREATE
+    const bool write = (access & FILEACCESS_WRITE) != 0;
+    const bool append = (access & FILEACCESS_APPEND) != 0;
+    const bool read = (access & FILEACCESS_READ) != 0;
+    if (!file.exists) {
+        if (!append && !(write && (!read || (access & FILEACCESS_CREATE)))) {
+            ERROR_LOG(FILESYS, "Save data has no file %s", filename.c_str());
+            return 0;
+        }
+        file.exists = true;
+        file.data = std::make_shared<std::vector<u8>>();
+        file.dirty = true;
+    } else if (write && !read && !append) {
+        file.data = std::make_shared<std::vector<u8>>();
+        file.dirty = true;
+    }
+
+    const OpenFileEntry entry = { path, 0, access };
+    const u32 handle = m_handle_allocator->GetNewHandle();
+    m_open_files[handle] = entry;
+    return handle;
+}
+
+void SaveDataFileSystem::CloseFile(u32 handle) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    EntryMap::iterator it = m_open_files.find(handle);
+    if (it == m_open_files.end()) {
+        ERROR_LOG(FILESYS, "Cannot close file that hasn't been opened: %08x", handle);
+        return;
+    }
+    m_handle_allocator->FreeHandle(handle);
+    FileMap::iterator file = m_files.find(it->second.path);
+    m_open_files.erase(it);
+    if (file != m_files.end()) {
+        CommitFile(file);
+    }
+}
+
+size_t SaveDataFileSystem::ReadFile(u32 handle, u8* pointer, s64 size) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    OpenFileEntry* entry = FindOpenFile(handle);
+    if (entry == nullptr) {
+        ERROR_LOG(FILESYS, "Cannot read file that hasn't been opened: %08x", handle);
+        return 0;
+    }
+    const std::vector<u8>& data = *LoadFile(entry->path).data;
+    if (entry->position >= data.size() || size <= 0) {
+        return 0;
+    }
+    const size_t count = (size_t)std::min<u64>(size, data.size() - entry->position);
+    memcpy(pointer, &data[(size_t)entry->position], count);
+    entry->position += count;
+    return count;
+}
+
+size_t SaveDataFileSystem::WriteFile(u32 handle, const u8* pointer, s64 size) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    OpenFileEntry* entry = FindOpenFile(handle);
+    if (entry == nullptr) {
+        ERROR_LOG(FILESYS, "Cannot write to file that hasn't been opened: %08x", handle);
+        return 0;
+    }
+    if (size <= 0) {
+        return 0;
+    }
+    CachedFile& file = LoadFile(entry->path);
+    if (!file.exists) {
+        ERROR_LOG(FILESYS, "Cannot write to file removed: %s", entry->path.c_str());
+        return 0;
+    }
+    if (file.data.use_count() > 1) {
+        // The writer still has the data of the last commit
+        file.data = std::make_shared<std::vector<u8>>(*file.data);
+    }
+    std::vector<u8>& data = *file.data;
+    if (entry->access & FILEACCESS_APPEND) {
+        entry->position = data.size();
+    }
+    if (entry->position + size > data.size()) {
+        data.resize((size_t)(entry->position + size));
+    }
+    memcpy(&data[(size_t)entry->position], pointer, (size_t)size);
+    entry->position += size;
+    file.dirty = true;
+    return (size_t)size;
+}
+
+size_t SaveDataFileSystem::SeekFile(u32 handle, s32 position, FileMove type) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    OpenFileEntry* entry = FindOpenFile(handle);
+    if (entry == nullptr) {
+        ERROR_LOG(FILESYS, "Cannot seek in file that hasn't been opened: %08x", handle);
+        return 0;
+    }
+    s64 base = 0;
+    if (type == FILEMOVE_CURRENT) {
+        base = (s64)entry->position;
+    } else if (type == FILEMOVE_END) {
+        base = (s64)LoadFile(entry->path).data->size();
+    }
+    // Seeks before the start fail and leave the position, as fseek
+    if (base + position >= 0) {
+        entry->position = (u64)(base + position);
+    }
+    return (size_t)entry->position;
+}
+
+FileInfo SaveDataFileSystem::GetFileInfo(std::string filename) {
+    const std::string path = NormalizePath(filename);
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        FileMap::const_iterator it = m_files.find(path);
+        if (it != m_files.end()) {
+            FileInfo info = m_host.GetFileInfo(filename);
+            info.name = filename;
+            info.exists = it->second.exists;
+            info.type = FILETYPE_NORMAL;
+            info.size = it->second.exists ? (s64)it->second.data->size() : 0;
+            return info;
+        }
+    }
+    return m_host.GetFileInfo(filename);
+}
+
+bool SaveDataFileSystem::OwnsHandle(u32 handle) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return FindOpenFile(handle) != nullptr;
+}
+
+bool SaveDataFileSystem::MkDir(const std::string& dirname) {
+    return m_host.MkDir(dirname);
+}
+
+bool SaveDataFileSystem::RmDir(const std::string& dirname) {
+    // The files of the directory go from the overlay with it, committed first so that the writer
+    // doesn't bring them back
+    const std::string directory = NormalizePath(dirname) + "/";
+    std::lock_guard<std::mutex> guard(m_lock);
+    CommitFiles(m_files.begin(), m_files.end());
+    WaitForWrites();
+    for (FileMap::iterator it = m_files.begin(); it != m_files.end();) {
+        if (it->first.compare(0, directory.size(), directory) == 0) {
+            it = m_files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return m_host.RmDir(dirname);
+}
+
+int SaveDataFileSystem::RenameFile(const std::string& from, const std::string& to) {
+    // Renamed on the host once both files are there, the overlay follows
+    std::lock_guard<std::mutex> guard(m_lock);
+    CommitFiles(m_files.begin(), m_files.end());
+    WaitForWrites();
+    const int result = m_host.RenameFile(from, to);
+    if (result != 0) {
+        return result;
+    }
+
+    // As on the host, the file stays in its directory
+    const std::string from_path = NormalizePath(from);
+    const std::string parent = GetParent(from_path);
+    const std::string to_path = (parent.empty() ? "" : parent + "/") + GetName(NormalizePath(to));
+    m_files.erase(to_path);
+    FileMap::iterator it = m_files.find(from_path);
+    if (it != m_files.end()) {
+        m_files[to_path] = it->second;
+        m_files.erase(from_path);
+    }
+    for (EntryMap::iterator open_file = m_open_files.begin(); open_file != m_open_files.end();
+        ++open_file) {
+        if (open_file->second.path == from_path) {
+            open_file->second.path = to_path;
+        }
+    }
+    return 0;
+}
+
+bool SaveDataFileSystem::RemoveFile(const std::string& filename) {
+    const std::string path = NormalizePath(filename);
+    std::lock_guard<std::mutex> guard(m_lock);
+    CachedFile& file = LoadFile(path);
+    if (!file.exists) {
+        return false;
+    }
+    file.exists = false;
+    file.data = std::make_shared<std::vector<u8>>();
+    file.dirty = true;
+    CommitFile(m_files.find(path));
+    return true;
+}
+
+bool SaveDataFileSystem::GetHostPath(const std::string& inpath, std::string& outpath) {
+    return m_host.GetHostPath(inpath, outpath);
+}
@@ -0,0 +1,109 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/std_condition_variable.h"
+#include "common/std_mutex.h"
+#include "common/std_thread.h"
+
+#include "core/file_sys/directory_file_system.h"
+#include "core/file_sys/file_sys.h"
+
+/**
+ * Save data in a host directory, written behind the guest's back. Files opened are read whole into
+ * an overlay in memory, which the reads and writes go to without touching the disk. Closing a file
+ * written, or Commit for all of them as on a guest flush, hands a snapshot of the files to a
+ * writer thread. The writer puts every file of a commit next to its original, then a journal
+ * naming them, then renames them over the originals: a process killed at any point leaves either
+ * the files before the commit or, once the journal is replayed on the next mount, those after it.
+ */
+class SaveDataFileSystem : public IFileSystem {
+public:
+    /**
+     * Mounts a host directory, finishing the commit a killed process left half done
+     * @param handle_allocator Allocator of the handles of opened files
+     * @param base_path Host directory of the save data, created if missing
+     */
+    SaveDataFileSystem(IHandleAllocator* handle_allocator, const std::string& base_path);
+
+    /// Commits the files written and waits for them to be on disk
+    ~SaveDataFileSystem();
+
+    /// Commits the files written since their last commit, returning before they're on disk
+    void Commit();
+
+    /// Waits for the commits to be on disk
+    void WaitForWrites();
+
+    void DoState(PointerWrap& p);
+    std::vector<FileInfo> GetDirListing(std::string path);
+    u32      OpenFile(std::string filename, FileAccess access, const char* devicename = NULL);
+    void     CloseFile(u32 handle);
+    size_t   ReadFile(u32 handle, u8* pointer, s64 size);
+    size_t   WriteFile(u32 handle, const u8* pointer, s64 size);
+    size_t   SeekFile(u32 handle, s32 position, FileMove type);
+    FileInfo GetFileInfo(std::string filename);
+    bool     OwnsHandle(u32 handle);
+
+    bool MkDir(const std::string& dirname);
+    bool RmDir(const std::string& dirname);
+    int  RenameFile(const std::string& from, const std::string& to);
+    bool RemoveFile(const std::string& filename);
+    bool GetHostPath(const std::string& inpath, std::string& outpath);
+
+private:
+    /// File in the overlay
+    struct CachedFile {
+        std::shared_ptr<std::vector<u8>> data; ///< Shared with the writer while committed
+        bool exists;                        ///< False once removed
+        bool dirty;                         ///< Changed since its last commit
+    };
+
+    struct OpenFileEntry {
+        std::string path;                   ///< Key of the file in the overlay
+        u64         position;
+        FileAccess  access;
+    };
+
+    /// File of a commit, with no data to remove it
+    struct PendingWrite {
+        std::string path;
+        std::shared_ptr<const std::vector<u8>> data;
+    };
+
+    typedef std::vector<PendingWrite> PendingCommit;
+    typedef std::map<std::string, CachedFile> FileMap;
+    typedef std::map<u32, OpenFileEntry> EntryMap;
+
+    CachedFile& LoadFile(const std::string& path);
+    OpenFileEntry* FindOpenFile(u32 handle);
+    void CommitFiles(FileMap::iterator begin, FileMap::iterator end);
+    void CommitFile(FileMap::iterator it);
+    void WriteCommit(const PendingCommit& commit);
+    void ApplyJournal(const std::string& journal);
+    void RecoverJournal();
+    void WriterThreadFunc();
+
+    IHandleAllocator*       m_handle_allocator;
+    std::string             m_base_path;        ///< With a trailing slash
+    DirectoryFileSystem     m_host;             ///< Listings, info and directories
+
+    FileMap                 m_files;            ///< Overlay, by path without a leading slash
+    EntryMap                m_open_files;
+    std::mutex              m_lock;             ///< Guards the overlay and the open files
+
+    std::deque<PendingCommit> m_commits;        ///< Commits the writer didn't start yet
+    bool                    m_writing;          ///< Whether the writer is on a commit
+    bool                    m_quit;
+    std::mutex              m_commits_lock;     ///< Guards the commits and the flags
+    std::condition_variable m_commits_changed;  ///< Commit queued or written, or quitting
+    std::thread*            m_writer;
+};
@@ -0,0 +1,714 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "common/break_points.h"
+#include "common/log.h"
+#include "common/thread.h"
+
+#include "core/core.h"
+#include "core/gdb_stub.h"
+#include "core/mem_map.h"
+
+namespace GDBStub {
+
+std::atomic<bool> g_attached(false);
+
+namespace {
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+const Socket INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+
+void CloseSocket(Socket socket) {
+    closesocket(socket);
+}
+#else
+typedef int Socket;
+const Socket INVALID_SOCKET_HANDLE = -1;
+
+void CloseSocket(Socket socket) {
+    close(socket);
+}
+#endif
+
+enum {
+    MAX_PACKET_SIZE     = 0x1000,   ///< Largest packet GDB is told to send, see qSupported
+    POLL_INTERVAL       = 10,       ///< Milliseconds between two looks at the CPU while it runs
+
+    // Registers of the GDB ARM target without a description: R0-R15, the FPA registers F0-F7
+    // and FPS, which the 3DS doesn't have, then the CPSR
+    NUM_CORE_REGS       = 16,
+    FPA_REG_SIZE        = 12,
+    FPS_REG             = 24,
+    CPSR_REG            = 25,
+    REGS_SIZE           = NUM_CORE_REGS * 4 + 8 * FPA_REG_SIZE + 4 + 4,
+
+    SIGINT_SIGNAL       = 2,
+    SIGTRAP_SIGNAL      = 5,
+};
+
+/// What the emulation thread does once the debugger lets it go
+enum Resume {
+    RESUME_NONE,        ///< Keep waiting
+    RESUME_CONTINUE,    ///< Run until a breakpoint or the debugger stops it
+    RESUME_STEP,        ///< Run one instruction, then stop again
+};
+
+/// What ReadPacket got
+enum ReadResult {
+    READ_PACKET,
+    READ_INTERRUPT,     ///< Ctrl-C, a 0x03 byte outside of a packet
+    READ_TIMEOUT,
+    READ_CLOSED,
+};
+
+std::thread*            g_thread = nullptr;     ///< Stub thread, handles the packets
+std::atomic<bool>       g_quit(false);
+Socket                  g_listen_socket = INVALID_SOCKET_HANDLE;
+Socket                  g_client_socket = INVALID_SOCKET_HANDLE;
+std::string             g_received;             ///< Bytes received that are no packet yet
+
+std::atomic<bool>       g_halt_requested(false);
+std::mutex              g_mutex;                ///< Guards what follows
+std::condition_variable g_condition;
+bool                    g_halted = false;       ///< Emulation thread waits in Update
+u32                     g_stop_count = 0;       ///< Times the emulation thread stopped
+Resume                  g_resume = RESUME_NONE;
+
+// Only touched by the stub thread, while the emulation thread is halted
+BreakPoints             g_own_breakpoints;      ///< Core::g_breakpoints if the frontend has none
+std::vector<u32>        g_breakpoint_addresses; ///< Breakpoints the debugger set
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Appends a word as GDB wants registers, the bytes in guest (little-endian) order
+ * @param out String appended to
+ * @param value Word to append
+ */
+void AppendWord(std::string& out, u32 value) {
+    for (int i = 0; i < 4; i++) {
+        const u8 byte = (u8)(value >> (i * 8));
+        out += HEX_DIGITS[byte >> 4];
+        out += HEX_DIGITS[byte & 0xF];
+    }
+}
+
+/**
+ * Parses a word of bytes in guest order
+ * @param hex Hex digits, 8 of them are read
+ * @param value Receives the word
+ * @return False if the digits run short or aren't hex
+ */
+bool ParseWord(const char* hex, u32& value) {
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        const int high = HexValue(hex[i * 2]);
+        const int low = high >= 0 ? HexValue(hex[i * 2 + 1]) : -1;
+        if (low < 0) {
+            return false;
+        }
+        value |= (u32)(high << 4 | low) << (i * 8);
+    }
+    return true;
+}
+
+/**
+ * Parses a number written with the most significant digit first, as addresses and lengths are
+ * @param p Parsed from, left past the digits
+ * @return The number
+ */
+u32 ParseNumber(const char*& p) {
+    u32 value = 0;
+    int digit;
+    while ((digit = HexValue(*p)) >= 0) {
+        value = value << 4 | digit;
+        p++;
+    }
+    return value;
+}
+
+/**
+ * Sends a packet, framing it with its checksum
+ * @param data Payload of the packet
+ */
+void SendPacket(const std::string& data) {
+    u8 checksum = 0;
+    for (char c : data) {
+        checksum += (u8)c;
+    }
+    std::string packet = "$" + data + "#";
+    packet += HEX_DIGITS[checksum >> 4];
+    packet += HEX_DIGITS[checksum & 0xF];
+    send(g_client_socket, packet.data(), (int)packet.size(), 0);
+}
+
+/**
+ * Waits for the next packet of the debugger, acknowledging it
+ * @param packet Receives the payload of the packet
+ * @param timeout_ms Milliseconds to wait for it, -1 for as long as it takes
+ * @return What was read
+ */
+ReadResult ReadPacket(std::string& packet, int timeout_ms) {
+    for (;;) {
+        // Acknowledgements of our packets aren't looked at, TCP doesn't lose them
+        size_t start = g_received.find_first_not_of("+-");
+        if (start != std::string::npos && g_received[start] == 0x03) {
+            g_received.erase(0, start + 1);
+            return READ_INTERRUPT;
+        }
+        if (start != std::string::npos && g_received[start] != '$') {
+            g_received.erase(0, start + 1);
+            continue;
+        }
+        const size_t end = start != std::string::npos ? g_received.find('#', start) : start;
+        if (end != std::string::npos && end + 2 < g_received.size()) {
+            packet = g_received.substr(start + 1, end - start - 1);
+            const int checksum = HexValue(g_received[end + 1]) << 4 |
+                HexValue(g_received[end + 2]);
+            g_received.erase(0, end + 3);
+
+            u8 sum = 0;
+            for (char c : packet) {
+                sum += (u8)c;
+            }
+            send(g_client_socket, sum == checksum ? "+" : "-", 1, 0);
+            if (sum == checksum) {
+                return READ_PACKET;
+            }
+            continue;
+        }
+
+        // Periodically wakes up to see whether the stub should quit
+        const int wait_ms = timeout_ms < 0 ? 100 : std::min(timeout_ms, 100);
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(g_client_socket, &fds);
+        timeval timeout = { 0, wait_ms * 1000 };
+        const int ready = select((int)g_client_socket + 1, &fds, NULL, NULL, &timeout);
+        if (g_quit || ready < 0) {
+            return READ_CLOSED;
+        }
+        if (ready == 0) {
+            if (timeout_ms >= 0 && (timeout_ms -= wait_ms) <= 0) {
+                return READ_TIMEOUT;
+            }
+            continue;
+        }
+        char buffer[MAX_PACKET_SIZE];
+        const int received = recv(g_client_socket, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            return READ_CLOSED;
+        }
+        g_received.append(buffer, received);
+    }
+}
+
+/**
+ * Has the emulation thread stop at the end of its slice and waits for it to do so
+ * @return False if the stub quits meanwhile, the emulation thread being the one shutting it down
+ */
+bool Halt() {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    g_halt_requested = true;
+    while (!g_halted || g_resume != RESUME_NONE) {
+        if (g_quit) {
+            return false;
+        }
+        g_condition.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    return true;
+}
+
+/**
+ * Lets the halted emulation thread go
+ * @param resume What it does
+ */
+void ResumeCPU(Resume resume) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_resume = resume;
+    g_condition.notify_all();
+}
+
+/**
+ * Waits for the emulation thread to stop after it was resumed, or for Ctrl-C
+ * @param stop_count Times the emulation thread had stopped before it was resumed
+ * @return Signal of the stop, 0 if the debugger went away
+ */
+int WaitForStop(u32 stop_count) {
+    int signal = SIGTRAP_SIGNAL;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            if (g_halted && g_stop_count != stop_count) {
+                return signal;
+            }
+        }
+        std::string packet;
+        switch (ReadPacket(packet, POLL_INTERVAL)) {
+        case READ_INTERRUPT:
+            signal = SIGINT_SIGNAL;
+            g_halt_requested = true;
+            break;
+        case READ_CLOSED:
+            return 0;
+        default:
+            // Only Ctrl-C is expected while the target runs
+            break;
+        }
+    }
+}
+
+/// Replies to 'g' with all the registers
+std::string ReadRegisters() {
+    ARM_Interface* core = Core::g_app_core;
+    std::string reply;
+    for (int i = 0; i < NUM_CORE_REGS; i++) {
+        AppendWord(reply, i == 15 ? core->GetPC() : core->GetReg(i));
+    }
+    reply.append((8 * FPA_REG_SIZE + 4) * 2, '0');
+    AppendWord(reply, core->GetCPSR());
+    return reply;
+}
+
+/**
+ * Writes a register
+ * @param id GDB number of the register
+ * @param value Value written, registers the 3DS doesn't have ignore it
+ */
+void WriteRegister(u32 id, u32 value) {
+    ARM_Interface* core = Core::g_app_core;
+    if (id == 15) {
+        core->SetPC(value);
+    } else if (id < NUM_CORE_REGS) {
+        core->SetReg(id, value);
+    } else if (id == CPSR_REG) {
+        core->SetCPSR(value);
+    }
+}
+
+/**
+ * Replies to 'p' with a register
+ * @param id GDB number of the register
+ */
+std::string ReadRegister(u32 id) {
+    ARM_Interface* core = Core::g_app_core;
+    std::string reply;
+    if (id < NUM_CORE_REGS) {
+        AppendWord(reply, id == 15 ? core->GetPC() : core->GetReg(id));
+    } else if (id == CPSR_REG) {
+        AppendWord(reply, core->GetCPSR());
+    } else if (id < FPS_REG) {
+        reply.append(FPA_REG_SIZE * 2, '0');
+    } else if (id == FPS_REG) {
+        reply.append(8, '0');
+    } else {
+        reply = "E01";
+    }
+    return reply;
+}
+
+/**
+ * Replies to 'm' with guest memory, straight from the page table so that unmapped addresses
+ * don't get logged
+ * @param address Guest address of the memory
+ * @param size Number of bytes
+ */
+std::string ReadMemory(u32 address, u32 size) {
+    std::string reply;
+    size = std::min<u32>(size, MAX_PACKET_SIZE / 2);
+    for (u32 i = 0; i < size; i++) {
+        const u8* page = Memory::g_page_table[(address + i) >> Memory::PAGE_BITS];
+        if (page == NULL) {
+            break;
+        }
+        const u8 byte = page[(address + i) & Memory::PAGE_MASK];
+        reply += HEX_DIGITS[byte >> 4];
+        reply += HEX_DIGITS[byte & 0xF];
+    }
+    return reply.empty() && size != 0 ? "E01" : reply;
+}
+
+/**
+ * Writes guest memory for 'M', invalidating the code decoded and translated from it
+ * @param address Guest address of the memory
+ * @param size Number of bytes
+ * @param hex Bytes, as hex digits
+ * @return True on success
+ */
+bool WriteMemory(u32 address, u32 size, const char* hex) {
+    for (u32 i = 0; i < size; i++) {
+        u8* page = Memory::g_page_table[(address + i) >> Memory::PAGE_BITS];
+        const int high = HexValue(hex[i * 2]);
+        const int low = high >= 0 ? HexValue(hex[i * 2 + 1]) : -1;
+        if (page == NULL || low < 0) {
+            Memory::MarkRangeDirty(address, i);
+            return false;
+        }
+        page[(address + i) & Memory::PAGE_MASK] = (u8)(high << 4 | low);
+    }
+    Memory::MarkRangeDirty(address, size);
+    return true;
+}
+
+/**
+ * Adds or removes a software breakpoint for 'Z0' and 'z0'
+ * @param address Address of the breakpoint
+ * @param add Whether it's added
+ */
+void SetBreakPoint(u32 address, bool add) {
+    auto it = std::find(g_breakpoint_addresses.begin(), g_breakpoint_addresses.end(), address);
+    if (add == (it != g_breakpoint_addresses.end())) {
+        return;
+    }
+    if (add) {
+        Core::g_breakpoints->Add(address);
+        g_breakpoint_addresses.push_back(address);
+    } else {
+        Core::g_breakpoints->Remove(address);
+        g_breakpoint_addresses.erase(it);
+    }
+    Core::InvalidateBreakPoint(address);
+}
+
+/**
+ * Handles a packet of the debugger while the target is stopped
+ * @param packet Payload of the packet
+ * @param resume Receives what the emulation thread does next, RESUME_NONE to keep it stopped
+ * @param detach Set if the debugger detaches
+ * @return Reply to send, none if resumed
+ */
+std::string HandlePacket(const std::string& packet, Resume& resume, bool& detach) {
+    const char* p = packet.c_str() + 1;
+    switch (packet[0]) {
+    case '?':
+        return "S05";
+
+    case 'g':
+        return ReadRegisters();
+
+    case 'G':
+        for (u32 id = 0; id < NUM_CORE_REGS; id++) {
+            u32 value;
+            if (!ParseWord(p + id * 8, value)) {
+                return "E01";
+            }
+            WriteRegister(id, value);
+        }
+        if (packet.size() >= 1 + REGS_SIZE * 2) {
+            u32 cpsr;
+            if (ParseWord(p + (REGS_SIZE - 4) * 2, cpsr)) {
+                WriteRegister(CPSR_REG, cpsr);
+            }
+        }
+        return "OK";
+
+    case 'p':
+        return ReadRegister(ParseNumber(p));
+
+    case 'P':
+    {
+        const u32 id = ParseNumber(p);
+        u32 value;
+        if (*p != '=' || !ParseWord(p + 1, value)) {
+            return "E01";
+        }
+        WriteRegister(id, value);
+        return "OK";
+    }
+
+    case 'm':
+    {
+        const u32 address = ParseNumber(p);
+        if (*p++ != ',') {
+            return "E01";
+        }
+        return ReadMemory(address, ParseNumber(p));
+    }
+
+    case 'M':
+    {
+        const u32 address = ParseNumber(p);
+        if (*p++ != ',') {
+            return "E01";
+        }
+        const u32 size = ParseNumber(p);
+        if (*p++ != ':' || strlen(p) < size * 2) {
+            return "E01";
+        }
+        return WriteMemory(address, size, p) ? "OK" : "E01";
+    }
+
+    case 'c':
+        resume = RESUME_CONTINUE;
+        return "";
+
+    case 's':
+        resume = RESUME_STEP;
+        return "";
+
+    case 'Z':
+    case 'z':
+    {
+        // Software breakpoints only, GDB writes the others in memory or steps through them
+        if (packet.size() < 3 || packet[1] != '0' || packet[2] != ',') {
+            return "";
+        }
+        p = packet.c_str() + 3;
+        SetBreakPoint(ParseNumber(p), packet[0] == 'Z');
+        return "OK";
+    }
+
+    case 'H':
+    case 'T':
+        return "OK";
+
+    case 'q':
+        if (packet.compare(0, 11, "qSupported:") == 0 || packet == "qSupported") {
+            char reply[32];
+            sprintf(reply, "PacketSize=%x", (u32)MAX_PACKET_SIZE);
+            return reply;
+        }
+        if (packet.compare(0, 9, "qAttached") == 0) {
+            return "1";
+        }
+        return "";
+
+    case 'D':
+        detach = true;
+        return "OK";
+
+    case 'k':
+        detach = true;
+        return "";
+
+    default:
+        return "";
+    }
+}
+
+/// Talks to the debugger that connected until it goes away, the emulation thread halted
+void Serve() {
+    for (;;) {
+        std::string packet;
+        const ReadResult result = ReadPacket(packet, -1);
+        if (result == READ_CLOSED) {
+            return;
+        }
+        if (result != READ_PACKET || packet.empty()) {
+            continue;
+        }
+
+        Resume resume = RESUME_NONE;
+        bool detach = false;
+        const std::string reply = HandlePacket(packet, resume, detach);
+        if (resume == RESUME_NONE && packet[0] != 'k') {
+            SendPacket(reply);
+        }
+        if (detach) {
+            return;
+        }
+        if (resume != RESUME_NONE) {
+            u32 stop_count;
+            {
+                std::lock_guard<std::mutex> lock(g_mutex);
+                stop_count = g_stop_count;
+            }
+            ResumeCPU(resume);
+            const int signal = WaitForStop(stop_count);
+            if (signal == 0) {
+                Halt();
+                return;
+            }
+            char stop_reply[4];
+            sprintf(stop_reply, "S%02x", signal);
+            SendPacket(stop_reply);
+        }
+    }
+}
+
+/// Stub thread: waits for a debugger, then serves it with the CPU halted
+void ThreadFunc() {
+    Common::SetCurrentThreadName("GDBStub");
+
+    while (!g_quit) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(g_listen_socket, &fds);
+        timeval timeout = { 0, 100 * 1000 };
+        if (select((int)g_listen_socket + 1, &fds, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        g_client_socket = accept(g_listen_socket, NULL, NULL);
+        if (g_client_socket == INVALID_SOCKET_HANDLE) {
+            continue;
+        }
+        NOTICE_LOG(GDB_STUB, "debugger attached");
+
+        g_received.clear();
+        g_attached = true;
+        if (Halt()) {
+            Serve();
+        }
+
+        // Serve leaves the CPU halted unless the stub quits, the breakpoints of the debugger go
+        // with it
+        if (!g_quit) {
+            for (u32 address : g_breakpoint_addresses) {
+                Core::g_breakpoints->Remove(address);
+                Core::InvalidateBreakPoint(address);
+            }
+        }
+        g_breakpoint_addresses.clear();
+        g_attached = false;
+        ResumeCPU(RESUME_CONTINUE);
+
+        CloseSocket(g_client_socket);
+        g_client_socket = INVALID_SOCKET_HANDLE;
+        NOTICE_LOG(GDB_STUB, "debugger detached");
+    }
+}
+
+} // namespace
+
+/**
+ * Stops the CPU for the debugger if it hit a breakpoint or the debugger asked for it, and waits
+ * for the debugger to resume it. Must be called by the emulation thread between two slices while
+ * a debugger is attached.
+ * @param hit Whether the last slice stopped at a breakpoint or watchpoint
+ */
+void Update(bool hit) {
+    if (!hit && !g_halt_requested.load(std::memory_order_relaxed)) {
+        return;
+    }
+    g_halt_requested = false;
+
+    for (;;) {
+        Resume resume;
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            g_halted = true;
+            g_stop_count++;
+            g_resume = RESUME_NONE;
+            g_condition.notify_all();
+            g_condition.wait(lock, [] { return g_resume != RESUME_NONE; });
+            resume = g_resume;
+            g_halted = false;
+        }
+        if (resume != RESUME_STEP) {
+            return;
+        }
+
+        // A breakpoint at the PC would stop the step before its instruction, lift it meanwhile
+        const u32 pc = Core::g_app_core->GetPC();
+        const bool on_breakpoint = Core::g_breakpoints->IsAddressBreakPoint(pc);
+        if (on_breakpoint) {
+            Core::g_breakpoints->Remove(pc);
+            Core::InvalidateBreakPoint(pc);
+        }
+        Core::SingleStep();
+        if (on_breakpoint) {
+            Core::g_breakpoints->Add(pc);
+            Core::InvalidateBreakPoint(pc);
+        }
+    }
+}
+
+/**
+ * Starts listening for a debugger, on a thread of the stub
+ * @param port TCP port to listen on
+ * @return True on success
+ */
+bool Init(u16 port) {
+    Shutdown();
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+    g_listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (g_listen_socket == INVALID_SOCKET_HANDLE) {
+        ERROR_LOG(GDB_STUB, "couldn't create a socket");
+        return false;
+    }
+    const int reuse = 1;
+    setsockopt(g_listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(g_listen_socket, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(g_listen_socket, 1) != 0) {
+        ERROR_LOG(GDB_STUB, "couldn't listen on port %u", port);
+        CloseSocket(g_listen_socket);
+        g_listen_socket = INVALID_SOCKET_HANDLE;
+        return false;
+    }
+
+    if (Core::g_breakpoints == nullptr) {
+        Core::g_breakpoints = &g_own_breakpoints;
+    }
+    g_quit = false;
+    g_thread = new std::thread(ThreadFunc);
+
+    NOTICE_LOG(GDB_STUB, "waiting for a debugger on port %u", port);
+    return true;
+}
+
+/// Stops listening, detaching any debugger attached
+void Shutdown() {
+    if (g_thread == nullptr) {
+        return;
+    }
+    g_quit = true;
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+
+    CloseSocket(g_listen_socket);
+    g_listen_socket = INVALID_SOCKET_HANDLE;
+    if (Core::g_breakpoints == &g_own_breakpoints) {
+        Core::g_breakpoints = nullptr;
+    }
+}
+
+} // namespace
@@ -0,0 +1,48 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+
+#include "common/common_types.h"
+
+/**
+ * Server of the GDB remote serial protocol, to debug guest code of the application core with GDB
+ * ("target remote :port"). Packets are handled by a thread of the stub, the emulation thread only
+ * looks at a flag between slices. While GDB has the target stopped the emulation thread waits in
+ * Update, and the stub reads and writes the registers and memory. Software breakpoints are those
+ * of Core::g_breakpoints, checked through their page bitmap.
+ */
+namespace GDBStub {
+
+extern std::atomic<bool> g_attached;
+
+/**
+ * Tells whether a debugger is attached, a relaxed load for the loop of the emulation thread
+ * @return True if one is
+ */
+inline bool IsAttached() {
+    return g_attached.load(std::memory_order_relaxed);
+}
+
+/**
+ * Stops the CPU for the debugger if it hit a breakpoint or the debugger asked for it, and waits
+ * for the debugger to resume it. Must be called by the emulation thread between two slices while
+ * a debugger is attached.
+ * @param hit Whether the last slice stopped at a breakpoint or watchpoint
+ */
+void Update(bool hit);
+
+/**
+ * Starts listening for a debugger, on a thread of the stub
+ * @param port TCP port to listen on
+ * @return True on success
+ */
+bool Init(u16 port);
+
+/// Stops listening, detaching any debugger attached
+void Shutdown();
+
+} // namespace
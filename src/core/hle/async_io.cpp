@@ -0,0 +1,180 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "common/log.h"
+#include "common/thread_pool.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/system.h"
+#include "core/hle/async_io.h"
+#include "core/hle/kernel/thread.h"
+
+namespace AsyncIO {
+
+namespace {
+
+/// Request in flight
+struct Job {
+    Handle                  thread;     ///< Guest thread waiting for the request
+    std::function<void()>   complete;   ///< Run on the emulation thread as the request is done
+    Common::Task            task;
+};
+
+int                                     g_complete_event = -1;
+u64                                     g_next_id = 0;
+std::map<u64, std::unique_ptr<Job>>     g_jobs;     ///< By ID, only touched by the emulation thread
+
+/**
+ * Completes a request: tells its service and resumes its thread
+ * @param id ID of the request
+ */
+void Complete(u64 id) {
+    auto it = g_jobs.find(id);
+    if (it == g_jobs.end()) {
+        return;
+    }
+    std::unique_ptr<Job> job = std::move(it->second);
+    g_jobs.erase(it);
+
+    if (job->complete != nullptr) {
+        job->complete();
+    }
+    Kernel::ResumeThreadFromWait(job->thread);
+}
+
+void CompleteCallback(u64 userdata, int cycles_late) {
+    Complete(userdata);
+}
+
+/**
+ * Runs a file request on the thread pool, the current guest thread waiting for it
+ * @param handle Handle of the file in System::g_ctr_file_system
+ * @param address Guest address of the buffer
+ * @param size Number of bytes to transfer
+ * @param write Whether the request writes the file, else it reads it
+ * @param callback Function told of the result, nullptr for none
+ * @param userdata Value passed to the callback
+ */
+void SubmitFile(u32 handle, u32 address, u32 size, bool write, CompletionCallback callback,
+    u64 userdata) {
+
+    // Guest regions are contiguous in host memory, a buffer is if both of its ends are mapped
+    u8* pointer = size != 0 ? Memory::GetPointer(address) : nullptr;
+    if (size != 0 && (pointer == nullptr ||
+        Memory::GetPointer(address + size - 1) != pointer + size - 1)) {
+
+        ERROR_LOG(HLE, "I/O buffer 0x%08X of 0x%X bytes isn't mapped", address, size);
+        if (callback != nullptr) {
+            callback(-1, userdata);
+        }
+        return;
+    }
+
+    // Written by the worker before it schedules completion
+    std::shared_ptr<s64> result = std::make_shared<s64>(-1);
+    Run([=] {
+        // The meta file system serializes this with the requests of the emulation thread
+        if (write) {
+            *result = (s64)System::g_ctr_file_system.WriteFile(handle, pointer, size);
+        } else {
+            *result = (s64)System::g_ctr_file_system.ReadFile(handle, pointer, size);
+        }
+    }, [=] {
+        // Written from the worker through the host pointer, behind the back of the dirty tracking
+        if (!write && *result > 0) {
+            Memory::MarkRangeDirty(address, (size_t)*result);
+        }
+        if (callback != nullptr) {
+            callback(*result, userdata);
+        }
+    });
+}
+
+} // namespace
+
+/**
+ * Runs a function on the shared thread pool, the current guest thread waiting meanwhile. Must be
+ * called from an HLE call of that thread.
+ * @param work Run on a worker, must leave alone whatever the emulation thread may touch
+ *      meanwhile, guest memory aside from the buffers of the request
+ * @param complete Run on the emulation thread once the work is done, before the guest thread
+ *      resumes, nullptr for nothing
+ */
+void Run(std::function<void()> work, std::function<void()> complete) {
+    const u64 id = g_next_id++;
+    std::unique_ptr<Job> job(new Job);
+    job->thread = Kernel::GetCurrentThreadHandle();
+    job->complete = std::move(complete);
+    Job* const raw_job = job.get();
+    g_jobs[id] = std::move(job);
+
+    Kernel::WaitCurrentThread(WAITTYPE_IO);
+    raw_job->task = Common::ThreadPool::GetShared().Submit([work, id] {
+        work();
+        CoreTiming::ScheduleEvent_Threadsafe(0, g_complete_event, id);
+    });
+}
+
+/**
+ * Reads a file of the emulated file system into guest memory, the current guest thread waiting
+ * meanwhile. Must be called from an HLE call of that thread.
+ * @param handle Handle of the file in System::g_ctr_file_system
+ * @param address Guest address of the buffer read to
+ * @param size Number of bytes to read
+ * @param callback Function told of the result, nullptr for none
+ * @param userdata Value passed to the callback
+ */
+void ReadFile(u32 handle, u32 address, u32 size, CompletionCallback callback, u64 userdata) {
+    SubmitFile(handle, address, size, false, callback, userdata);
+}
+
+/**
+ * Writes guest memory to a file of the emulated file system, the current guest thread waiting
+ * meanwhile. Must be called from an HLE call of that thread.
+ * @param handle Handle of the file in System::g_ctr_file_system
+ * @param address Guest address of the buffer written from
+ * @param size Number of bytes to write
+ * @param callback Function told of the result, nullptr for none
+ * @param userdata Value passed to the callback
+ */
+void WriteFile(u32 handle, u32 address, u32 size, CompletionCallback callback, u64 userdata) {
+    SubmitFile(handle, address, size, true, callback, userdata);
+}
+
+/**
+ * Waits for the requests in flight and completes them, resuming their threads, so that no I/O
+ * touches guest memory or is left out of a savestate
+ */
+void Flush() {
+    std::vector<u64> ids;
+    for (const auto& it : g_jobs) {
+        it.second->task.Wait();
+        ids.push_back(it.first);
+    }
+    for (u64 id : ids) {
+        CoreTiming::UnscheduleThreadsafeEvent(g_complete_event, id);
+        Complete(id);
+    }
+}
+
+/// Initialize the asynchronous I/O
+void Init() {
+    g_complete_event = CoreTiming::RegisterEvent("AsyncIO::Complete", CompleteCallback);
+}
+
+/// Shutdown the asynchronous I/O, waiting for the requests in flight
+void Shutdown() {
+    for (const auto& it : g_jobs) {
+        it.second->task.Wait();
+    }
+    g_jobs.clear();
+}
+
+} // namespace
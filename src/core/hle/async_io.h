@@ -0,0 +1,70 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+
+#include "common/common_types.h"
+
+/**
+ * Asynchronous requests of the HLE services, such as file I/O. A request runs on the shared thread
+ * pool while the guest thread that made it waits, and other guest threads keep running. Once it
+ * is done, a CoreTiming event has the emulation thread call back the service with its result and
+ * resume the waiting thread, as when hardware completes a request.
+ */
+namespace AsyncIO {
+
+/**
+ * Called on the emulation thread when a request is done, before its thread resumes
+ * @param result Number of bytes transferred, -1 on error
+ * @param userdata Value given with the request
+ */
+typedef void (*CompletionCallback)(s64 result, u64 userdata);
+
+/**
+ * Runs a function on the shared thread pool, the current guest thread waiting meanwhile. Must be
+ * called from an HLE call of that thread.
+ * @param work Run on a worker, must leave alone whatever the emulation thread may touch
+ *      meanwhile, guest memory aside from the buffers of the request
+ * @param complete Run on the emulation thread once the work is done, before the guest thread
+ *      resumes, nullptr for nothing
+ */
+void Run(std::function<void()> work, std::function<void()> complete);
+
+/**
+ * Reads a file of the emulated file system into guest memory, the current guest thread waiting
+ * meanwhile. Must be called from an HLE call of that thread.
+ * @param handle Handle of the file in System::g_ctr_file_system
+ * @param address Guest address of the buffer read to
+ * @param size Number of bytes to read
+ * @param callback Function told of the result, nullptr for none
+ * @param userdata Value passed to the callback
+ */
+void ReadFile(u32 handle, u32 address, u32 size, CompletionCallback callback, u64 userdata);
+
+/**
+ * Writes guest memory to a file of the emulated file system, the current guest thread waiting
+ * meanwhile. Must be called from an HLE call of that thread.
+ * @param handle Handle of the file in System::g_ctr_file_system
+ * @param address Guest address of the buffer written from
+ * @param size Number of bytes to write
+ * @param callback Function told of the result, nullptr for none
+ * @param userdata Value passed to the callback
+ */
+void WriteFile(u32 handle, u32 address, u32 size, CompletionCallback callback, u64 userdata);
+
+/**
+ * Waits for the requests in flight and completes them, resuming their threads, so that no I/O
+ * touches guest memory or is left out of a savestate
+ */
+void Flush();
+
+/// Initialize the asynchronous I/O
+void Init();
+
+/// Shutdown the asynchronous I/O, waiting for the requests in flight
+void Shutdown();
+
+} // namespace
@@ -2,69 +2,152 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.  
 
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
 #include "common/common_types.h"
 #include "common/log.h"
 
+#include "core/core_timing.h"
+#include "core/mem_map.h"
 #include "core/hle/config_mem.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace ConfigMem {
 
-enum {
-    KERNEL_VERSIONREVISION  = 0x1FF80001,
-    KERNEL_VERSIONMINOR     = 0x1FF80002,
-    KERNEL_VERSIONMAJOR     = 0x1FF80003,
-    UPDATEFLAG              = 0x1FF80004,
-    NSTID                   = 0x1FF80008,
-    SYSCOREVER              = 0x1FF80010,
-    UNITINFO                = 0x1FF80014,
-    KERNEL_CTRSDKVERSION    = 0x1FF80018,
-    APPMEMTYPE              = 0x1FF80030,
-    APPMEMALLOC             = 0x1FF80040,
-    FIRM_VERSIONREVISION    = 0x1FF80061,
-    FIRM_VERSIONMINOR       = 0x1FF80062,
-    FIRM_VERSIONMAJOR       = 0x1FF80063,
-    FIRM_SYSCOREVER         = 0x1FF80064,
-    FIRM_CTRSDKVERSION      = 0x1FF80068,
+/// Config memory at Memory::CONFIG_MEMORY_VADDR, the versions and the memory layout
+struct ConfigMemDef {
+    u8  kernel_unk;                 ///< 0x00
+    u8  kernel_version_revision;    ///< 0x01
+    u8  kernel_version_minor;       ///< 0x02
+    u8  kernel_version_major;       ///< 0x03
+    u32 update_flag;                ///< 0x04
+    u64 ns_tid;                     ///< 0x08
+    u32 sys_core_ver;               ///< 0x10
+    u8  unit_info;                  ///< 0x14, bit 0 set for retail
+    u8  boot_firm;                  ///< 0x15
+    u8  prev_firm;                  ///< 0x16
+    u8  padding0;
+    u32 kernel_ctr_sdk_version;     ///< 0x18
+    u32 padding1[5];
+    u32 app_mem_type;               ///< 0x30
+    u32 padding2[3];
+    u32 app_mem_alloc;              ///< 0x40, bytes of FCRAM for the application
+    u32 sys_mem_alloc;              ///< 0x44, bytes of FCRAM for the system applets
+    u32 base_mem_alloc;             ///< 0x48, bytes of FCRAM for the base processes
+    u32 padding3[5];
+    u8  firm_unk;                   ///< 0x60
+    u8  firm_version_revision;      ///< 0x61
+    u8  firm_version_minor;         ///< 0x62
+    u8  firm_version_major;         ///< 0x63
+    u32 firm_sys_core_ver;          ///< 0x64
+    u32 firm_ctr_sdk_version;       ///< 0x68
+    u8  padding4[0xF94];
 };
+static_assert(offsetof(ConfigMemDef, app_mem_alloc) == 0x40, "Config memory has the wrong layout");
+static_assert(offsetof(ConfigMemDef, firm_ctr_sdk_version) == 0x68,
+    "Config memory has the wrong layout");
+static_assert(sizeof(ConfigMemDef) == Memory::CONFIG_MEMORY_SIZE,
+    "ConfigMemDef has the wrong size");
 
-template <typename T>
-inline void Read(T &var, const u32 addr) {
-    switch (addr) {
-
-    // Bit 0 set for Retail
-    case UNITINFO:
-        var = 0x00000001;
-        break;
-
-    // Set app memory size to 64MB?
-    case APPMEMALLOC:
-        var = 0x04000000;
-        break;
-
-    // Unknown - normally set to: 0x08000000 - (APPMEMALLOC + *0x1FF80048)
-    // (Total FCRAM size - APPMEMALLOC - *0x1FF80048)
-    case 0x1FF80044:
-        var = 0x08000000 - (0x04000000 + 0x1400000);
-        break;
-
-    // Unknown - normally set to: 0x1400000 (20MB)
-    case 0x1FF80048:
-        var = 0x1400000;
-        break;
-
-    default:
-        ERROR_LOG(HLE, "unknown ConfigMem::Read%d @ 0x%08X", sizeof(var) * 8, addr);
-    }
+/// Time of the shared page, the title adds the ticks since the update to it
+struct DateTime {
+    u64 date_time;                  ///< Milliseconds since 1900-01-01 as of update_tick
+    u64 update_tick;                ///< ARM11 tick count of the update
+    u64 unk[2];
+};
+
+/// Shared page at Memory::SHARED_PAGE_VADDR, the time and the state of the hardware
+struct SharedPageDef {
+    u32 date_time_selector;         ///< 0x00, entry of date_time the latest update wrote
+    u8  running_hw;                 ///< 0x04, 1 for a retail unit
+    u8  mcu_hw_info;                ///< 0x05
+    u8  padding0[0x1A];
+    DateTime date_time[2];          ///< 0x20, written in turns, so that readers see a whole one
+    u8  wifi_mac[6];                ///< 0x60
+    u8  wifi_link_level;            ///< 0x66
+    u8  network_state;              ///< 0x67
+    u8  padding1[0x18];
+    float slider_state_3d;          ///< 0x80, 0.0 for the 3D slider all the way down
+    u8  led_state_3d;               ///< 0x84
+    u8  battery_state;              ///< 0x85, bit 0 adapter, bit 1 charging, bits 2-4 level
+    u8  padding2[0x3A];
+    u64 home_menu_tid;              ///< 0xC0
+    u8  padding3[0xF38];
+};
+static_assert(offsetof(SharedPageDef, slider_state_3d) == 0x80,
+    "Shared page has the wrong layout");
+static_assert(offsetof(SharedPageDef, home_menu_tid) == 0xC0, "Shared page has the wrong layout");
+static_assert(sizeof(SharedPageDef) == Memory::SHARED_PAGE_SIZE,
+    "SharedPageDef has the wrong size");
+
+/// Seconds from 1900-01-01, where the time of the shared page starts, to the Unix epoch
+static const u64 kSecondsFrom1900To1970 = 2208988800ULL;
+
+/// The kernel refreshes the time of the shared page once a second
+static const int kTimeUpdateMs = 1000;
+
+static int g_time_update_event = -1;
+
+/// Gets the shared page in host memory
+static SharedPageDef* GetSharedPage() {
+    return (SharedPageDef*)(Memory::g_config_mem + Memory::CONFIG_MEMORY_SIZE);
 }
 
-// Explicitly instantiate template functions because we aren't defining this in the header:
+/**
+ * Writes the time as of now to the entry of the shared page the title doesn't read, then selects
+ * it. The time follows the ticks from the previous entry on, savestates keep it going.
+ */
+static void UpdateTime() {
+    SharedPageDef* page = GetSharedPage();
+    const DateTime& previous = page->date_time[page->date_time_selector & 1];
+    DateTime& next = page->date_time[(page->date_time_selector + 1) & 1];
 
-template void Read<u64>(u64 &var, const u32 addr);
-template void Read<u32>(u32 &var, const u32 addr);
-template void Read<u16>(u16 &var, const u32 addr);
-template void Read<u8>(u8 &var, const u32 addr);
+    // Whole milliseconds only, the ticks left over count towards the next update
+    const u64 ticks_per_ms = g_clock_rate_arm11 / 1000;
+    const u64 elapsed_ms = (CoreTiming::GetTicks() - previous.update_tick) / ticks_per_ms;
+    next.date_time = previous.date_time + elapsed_ms;
+    next.update_tick = previous.update_tick + elapsed_ms * ticks_per_ms;
+    page->date_time_selector = (page->date_time_selector + 1) & 1;
+    Memory::MarkRangeDirty(Memory::SHARED_PAGE_VADDR, Memory::SHARED_PAGE_SIZE);
+}
+
+static void TimeUpdateCallback(u64 userdata, int cycles_late) {
+    UpdateTime();
+    CoreTiming::ScheduleEvent(msToCycles(kTimeUpdateMs) - cycles_late, g_time_update_event);
+}
+
+/// Fills config memory and the shared page, and schedules the updates of the shared page
+void Init() {
+    ConfigMemDef* config = (ConfigMemDef*)Memory::g_config_mem;
+    memset(config, 0, sizeof(ConfigMemDef));
+    config->unit_info = 1;
+    config->app_mem_alloc = 0x04000000;     // 64MB for the application
+    config->base_mem_alloc = 0x01400000;    // 20MB, normally
+    // The FCRAM left over for the applets
+    config->sys_mem_alloc = Memory::FCRAM_SIZE - config->app_mem_alloc - config->base_mem_alloc;
+
+    SharedPageDef* page = GetSharedPage();
+    memset(page, 0, sizeof(SharedPageDef));
+    page->running_hw = 1;
+    page->battery_state = 0x1 | (5 << 2);   // Full, on the adapter
+    page->date_time[0].date_time = ((u64)time(NULL) + kSecondsFrom1900To1970) * 1000;
+    page->date_time[0].update_tick = CoreTiming::GetTicks();
+    Memory::MarkRangeDirty(Memory::CONFIG_MEMORY_VADDR,
+        Memory::CONFIG_MEMORY_SIZE + Memory::SHARED_PAGE_SIZE);
 
+    g_time_update_event = CoreTiming::RegisterEvent("ConfigMem::TimeUpdate", TimeUpdateCallback);
+    CoreTiming::ScheduleEvent(msToCycles(kTimeUpdateMs), g_time_update_event);
+}
+
+/// Stops the updates of the shared page
+void Shutdown() {
+    if (g_time_update_event != -1) {
+        CoreTiming::RemoveEvent(g_time_update_event);
+        g_time_update_event = -1;
+    }
+}
 
 } // namespace
@@ -8,6 +8,10 @@
 // read-only for ARM11 processes. I'm guessing this would normally be written to by the firmware/
 // bootrom. Because we're not emulating this, and essentially just "stubbing" the functionality, I'm
 // putting this as a subset of HLE for now.
+//
+// Config memory and the shared page after it are host pages mapped as any other memory, titles
+// poll them in loops. HLE fills them at Init and keeps the time of the shared page up to date on
+// an event of its own, reads never go through a handler.
 
 #include "common/common_types.h"
 
@@ -15,7 +19,10 @@
 
 namespace ConfigMem {
 
-template <typename T>
-inline void Read(T &var, const u32 addr);
+/// Fills config memory and the shared page, and schedules the updates of the shared page
+void Init();
+
+/// Stops the updates of the shared page
+void Shutdown();
 
 } // namespace
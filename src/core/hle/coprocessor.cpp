@@ -4,6 +4,7 @@
 
 #include "core/hle/coprocessor.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/thread.h"
 #include "core/mem_map.h"
 #include "core/core.h"
 
@@ -12,7 +13,7 @@ namespace HLE {
 /// Returns the coprocessor (in this case, syscore) command buffer pointer
 Addr GetThreadCommandBuffer() {
     // Called on insruction: mrc p15, 0, r0, c13, c0, 3
-    return Memory::KERNEL_MEMORY_VADDR;
+    return Kernel::GetCurrentThreadTLSAddress();
 }
 
 /// Call an MRC (move to ARM register from coprocessor) instruction in HLE
@@ -0,0 +1,368 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/atomic.h"
+#include "common/chunk_file.h"
+#include "common/common.h"
+#include "common/spsc_queue.h"
+#include "common/thread.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hle/dsp/source.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+namespace {
+
+/// Stereo sample of the output ring
+struct StereoSample {
+    s16 left;
+    s16 right;
+};
+
+/// What the audio thread renders a frame from, taken from DSP memory at the start of the frame
+struct FrameInput {
+    SourceConfiguration     sources[NUM_SOURCES];
+    AdpcmCoefficients       adpcm_coefficients[NUM_SOURCES];
+    DspConfiguration        dsp_configuration;
+    bool                    muted;      ///< Whether the samples stay out of the output ring
+};
+
+/// What the audio thread rendered, written to DSP memory at the start of the next frame
+struct FrameOutput {
+    SourceStatus            statuses[NUM_SOURCES];
+    FinalMixSamples         final_samples;
+};
+
+enum {
+    OUTPUT_RING_SIZE = 8192,                ///< Samples of the output ring, a quarter second
+};
+
+// State of the mixer, only used by the audio thread while a frame is in flight
+Source          g_sources[NUM_SOURCES];
+float           g_master_volume = 1.0f;
+float           g_aux_return_volume[2] = { 1.0f, 1.0f };
+u16             g_output_format = OUTPUT_STEREO;
+
+FrameInput      g_input;
+FrameOutput     g_output;
+int             g_region = 0;           ///< Region of DSP memory of the frame in flight
+bool            g_frame_pending = false;///< Whether g_output is still to be written to DSP memory
+bool            g_output_muted = false; ///< Whether the frames run from now on are muted
+
+std::thread*    g_thread = nullptr;     ///< Host thread rendering frames
+Common::Event   g_work_event;           ///< Signalled by the emulation thread for each frame
+Common::Event   g_done_event;           ///< Signalled by the audio thread once it rendered one
+volatile u32    g_submitted = 0;        ///< Frames submitted, only written by the emulation thread
+volatile u32    g_completed = 0;        ///< Frames rendered, only written by the audio thread
+volatile bool   g_quit = false;         ///< Tells the audio thread to exit
+
+Common::SPSCQueue<StereoSample> g_output_ring(OUTPUT_RING_SIZE);
+
+/**
+ * Gets the region of DSP memory the application last filled in
+ * @param index Receives the number of the region
+ * @return Host pointer of the region, NULL if DSP memory isn't mapped
+ */
+SharedMemory* GetCurrentRegion(int& index) {
+    SharedMemory* region0 = (SharedMemory*)Memory::GetPointer(REGION_0_VADDR);
+    SharedMemory* region1 = (SharedMemory*)Memory::GetPointer(REGION_1_VADDR);
+    if (region0 == NULL || region1 == NULL) {
+        return NULL;
+    }
+    // The counters wrap around, the newer one is ahead by less than half their range
+    index = ((s16)(region1->frame_counter - region0->frame_counter) > 0) ? 1 : 0;
+    return (index == 0) ? region0 : region1;
+}
+
+/**
+ * Applies the changes the application made to the configuration of the final mix
+ * @param config Configuration of the final mix, as of the start of the frame
+ */
+void ApplyDspConfiguration(const DspConfiguration& config) {
+    const u32 dirty = config.dirty;
+    if (dirty & DSP_MASTER_VOLUME_DIRTY) {
+        g_master_volume = config.master_volume;
+    }
+    if (dirty & DSP_AUX_RETURN_VOLUME_DIRTY) {
+        g_aux_return_volume[0] = config.aux_return_volume[0];
+        g_aux_return_volume[1] = config.aux_return_volume[1];
+    }
+    if (dirty & DSP_OUTPUT_FORMAT_DIRTY) {
+        g_output_format = config.output_format;
+    }
+}
+
+/**
+ * Mixes the buses down to the final samples of a frame
+ * @param buses Bus samples, left and right interleaved, SAMPLES_PER_FRAME * 2 floats per bus
+ * @param out Receives the final samples, saturated
+ */
+void MixFinal(float* const buses[NUM_BUSES], s16* out) {
+    // The auxiliary buses are returned straight away, effects of the application aren't applied
+    const float aux0 = g_aux_return_volume[0] * g_master_volume;
+    const float aux1 = g_aux_return_volume[1] * g_master_volume;
+    const float main = g_master_volume;
+    const bool mono = (g_output_format == OUTPUT_MONO);
+
+#ifdef _M_X64
+    const __m128 main_gain = _mm_set1_ps(main);
+    const __m128 aux0_gain = _mm_set1_ps(aux0);
+    const __m128 aux1_gain = _mm_set1_ps(aux1);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (int i = 0; i < SAMPLES_PER_FRAME * 2; i += 8) {
+        __m128 mix[2];
+        for (int j = 0; j < 2; j++) {
+            const int n = i + j * 4;
+            mix[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&buses[0][n]), main_gain),
+                _mm_mul_ps(_mm_loadu_ps(&buses[1][n]), aux0_gain)),
+                _mm_mul_ps(_mm_loadu_ps(&buses[2][n]), aux1_gain));
+            if (mono) {
+                // Both channels of each sample get the average of the two
+                const __m128 swapped = _mm_shuffle_ps(mix[j], mix[j], _MM_SHUFFLE(2, 3, 0, 1));
+                mix[j] = _mm_mul_ps(_mm_add_ps(mix[j], swapped), half);
+            }
+        }
+        const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(mix[0]), _mm_cvtps_epi32(mix[1]));
+        _mm_storeu_si128((__m128i*)&out[i], packed);
+    }
+#else
+    for (int i = 0; i < SAMPLES_PER_FRAME * 2; i += 2) {
+        float mix[2];
+        for (int c = 0; c < 2; c++) {
+            mix[c] = buses[0][i + c] * main + buses[1][i + c] * aux0 + buses[2][i + c] * aux1;
+        }
+        if (mono) {
+            mix[0] = mix[1] = (mix[0] + mix[1]) * 0.5f;
+        }
+        for (int c = 0; c < 2; c++) {
+            const float value = std::max(-32768.0f, std::min(32767.0f, mix[c]));
+            out[i + c] = (s16)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+        }
+    }
+#endif
+}
+
+/// Renders the frame of g_input into g_output and the output ring
+void RenderFrame() {
+    ApplyDspConfiguration(g_input.dsp_configuration);
+
+    MEMORY_ALIGNED16(float buses[NUM_BUSES][SAMPLES_PER_FRAME * 2]);
+    memset(buses, 0, sizeof(buses));
+    float* const bus_pointers[NUM_BUSES] = { buses[0], buses[1], buses[2] };
+
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        g_sources[i].ApplyConfiguration(g_input.sources[i], g_input.adpcm_coefficients[i]);
+        g_sources[i].MixFrame(bus_pointers);
+        g_sources[i].GetStatus(g_output.statuses[i]);
+    }
+
+    s16* const out = g_output.final_samples.pcm16;
+    MixFinal(bus_pointers, out);
+
+    StereoSample samples[SAMPLES_PER_FRAME];
+    for (int i = 0; i < SAMPLES_PER_FRAME; i++) {
+        samples[i].left = out[i * 2 + 0];
+        samples[i].right = out[i * 2 + 1];
+    }
+    // Without a sink taking them the ring fills up, the newest samples are dropped
+    if (!g_input.muted) {
+        g_output_ring.PushBatch(samples, SAMPLES_PER_FRAME);
+    }
+}
+
+/// Audio thread: renders the frames in the order they were submitted
+void ThreadFunc() {
+    Common::SetCurrentThreadName("Audio");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_REALTIME);
+
+    u32 completed = g_completed;
+    for (;;) {
+        if (completed == Common::AtomicLoadAcquire(g_submitted)) {
+            if (g_quit) {
+                break;
+            }
+            g_work_event.Wait();
+            continue;
+        }
+        RenderFrame();
+        completed++;
+        Common::AtomicStoreRelease(g_completed, completed);
+        g_done_event.Set();
+    }
+}
+
+/// Waits until the audio thread rendered the frame in flight
+void WaitForFrame() {
+    while (Common::AtomicLoadAcquire(g_completed) != g_submitted) {
+        g_done_event.Wait();
+    }
+}
+
+/// Writes the output of the frame last rendered to the region it was rendered from
+void PublishFrame() {
+    const u32 address = (g_region == 0) ? REGION_0_VADDR : REGION_1_VADDR;
+    SharedMemory* region = (SharedMemory*)Memory::GetPointer(address);
+    if (region == NULL) {
+        return;
+    }
+    memcpy(region->source_statuses, g_output.statuses, sizeof(g_output.statuses));
+    region->final_samples = g_output.final_samples;
+    memset(&region->dsp_status, 0, sizeof(region->dsp_status));
+    Memory::MarkRangeDirty(address, sizeof(SharedMemory));
+}
+
+} // namespace
+
+/// Starts the audio thread
+void Init() {
+    g_submitted = g_completed = 0;
+    g_frame_pending = false;
+    g_output_muted = false;
+    g_quit = false;
+    g_thread = new std::thread(ThreadFunc);
+
+    NOTICE_LOG(DSPHLE, "audio thread started");
+}
+
+/// Joins the audio thread
+void Shutdown() {
+    if (g_thread == nullptr) {
+        return;
+    }
+    g_quit = true;
+    g_work_event.Set();
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+    ResetFrames();
+}
+
+/**
+ * Gets the number of emulated CPU cycles of an audio frame
+ * @return Cycles between two frames
+ */
+s64 GetFrameCycles() {
+    return (s64)g_clock_rate_arm11 * SAMPLES_PER_FRAME / SAMPLE_RATE;
+}
+
+/// Runs an audio frame, called by the DSP service at each frame while the firmware runs: writes
+/// the output of the last frame to DSP memory and starts rendering the next one
+void RunFrame() {
+    WaitForFrame();
+    if (g_frame_pending) {
+        PublishFrame();
+        g_frame_pending = false;
+    }
+
+    SharedMemory* region = GetCurrentRegion(g_region);
+    if (region == NULL) {
+        return;
+    }
+    memcpy(g_input.sources, region->source_configurations, sizeof(g_input.sources));
+    memcpy(g_input.adpcm_coefficients, region->adpcm_coefficients,
+        sizeof(g_input.adpcm_coefficients));
+    g_input.dsp_configuration = region->dsp_configuration;
+    g_input.muted = g_output_muted;
+
+    // The changes are taken, the application sees the dirty bits it set cleared
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        region->source_configurations[i].dirty = 0;
+    }
+    region->dsp_configuration.dirty = 0;
+    Memory::MarkRangeDirty((g_region == 0) ? REGION_0_VADDR : REGION_1_VADDR,
+        sizeof(SharedMemory));
+
+    g_frame_pending = true;
+    if (g_thread == nullptr) {
+        RenderFrame();
+        g_submitted = g_completed = g_submitted + 1;
+        return;
+    }
+    Common::AtomicStoreRelease(g_submitted, g_submitted + 1);
+    g_work_event.Set();
+}
+
+/// Drops the voices and the frame being rendered, as the firmware starts or stops
+void ResetFrames() {
+    WaitForFrame();
+    g_frame_pending = false;
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        g_sources[i] = Source();
+    }
+    g_master_volume = 1.0f;
+    g_aux_return_volume[0] = g_aux_return_volume[1] = 1.0f;
+    g_output_format = OUTPUT_STEREO;
+}
+
+/**
+ * Takes mixed samples from the output ring, from the thread of the audio sink. The audio thread
+ * drops the samples of the frames that don't fit in the ring.
+ * @param samples Receives the samples, left and right interleaved, 2 * max_count values
+ * @param max_count Most samples to take
+ * @return Number of samples taken
+ */
+size_t ReadSamples(s16* samples, size_t max_count) {
+    StereoSample chunk[SAMPLES_PER_FRAME];
+    size_t count = 0;
+    while (count < max_count) {
+        const size_t taken = g_output_ring.PopBatch(chunk,
+            std::min(max_count - count, (size_t)SAMPLES_PER_FRAME));
+        if (taken == 0) {
+            break;
+        }
+        for (size_t i = 0; i < taken; i++) {
+            samples[(count + i) * 2 + 0] = chunk[i].left;
+            samples[(count + i) * 2 + 1] = chunk[i].right;
+        }
+        count += taken;
+    }
+    return count;
+}
+
+/**
+ * Keeps the samples of the frames run from now on out of the output ring or lets them in again,
+ * for frames emulated ahead and thrown away
+ * @param muted Whether the samples are dropped
+ */
+void SetOutputMuted(bool muted) {
+    g_output_muted = muted;
+}
+
+/**
+ * Saves or loads the voices and the output of the frame last rendered. Waits for the audio
+ * thread to finish the frame.
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    WaitForFrame();
+
+    auto s = p.Section("DSP", 1);
+    if (!s) {
+        return;
+    }
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        g_sources[i].DoState(p);
+    }
+    p.Do(g_master_volume);
+    p.DoArray(g_aux_return_volume, 2);
+    p.Do(g_output_format);
+    p.Do(g_output);
+    p.Do(g_region);
+    p.Do(g_frame_pending);
+}
+
+} // namespace
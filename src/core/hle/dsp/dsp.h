@@ -0,0 +1,68 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+#include "core/hle/dsp/shared_memory.h"
+
+class PointerWrap;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+// High-level emulation of the audio firmware of the DSP. The voices are decoded, resampled and
+// mixed on an audio thread of their own, a frame at a time: at each audio frame the emulation
+// thread takes the output of the frame the audio thread rendered into DSP memory, and hands it
+// the configuration of the next one. What the application sees only changes at frame boundaries,
+// at the same emulated time whatever the host thread timing.
+
+namespace DSP {
+
+/// Starts the audio thread
+void Init();
+
+/// Joins the audio thread
+void Shutdown();
+
+/**
+ * Gets the number of emulated CPU cycles of an audio frame
+ * @return Cycles between two frames
+ */
+s64 GetFrameCycles();
+
+/// Runs an audio frame, called by the DSP service at each frame while the firmware runs: writes
+/// the output of the last frame to DSP memory and starts rendering the next one
+void RunFrame();
+
+/// Drops the voices and the frame being rendered, as the firmware starts or stops
+void ResetFrames();
+
+/**
+ * Takes mixed samples from the output ring, from the thread of the audio sink. The audio thread
+ * drops the samples of the frames that don't fit in the ring.
+ * @param samples Receives the samples, left and right interleaved, 2 * max_count values
+ * @param max_count Most samples to take
+ * @return Number of samples taken
+ */
+size_t ReadSamples(s16* samples, size_t max_count);
+
+/**
+ * Keeps the samples of the frames run from now on out of the output ring or lets them in again,
+ * for frames emulated ahead and thrown away
+ * @param muted Whether the samples are dropped
+ */
+void SetOutputMuted(bool muted);
+
+/**
+ * Saves or loads the voices and the output of the frame last rendered. Waits for the audio
+ * thread to finish the frame.
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
+} // namespace
@@ -0,0 +1,229 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+// Layout of the regions of DSP memory the application and the audio firmware exchange the voice
+// configuration and the mixed samples through. The DSP is a 16-bit machine: the structures are
+// made of 16-bit words, and 32-bit integers are stored as two words with the high one first.
+//
+// There are two regions, the application fills in the one with the older frame counter and bumps
+// the counter, and the DSP processes the one with the newer counter for the next audio frame.
+
+namespace DSP {
+
+enum {
+    NUM_SOURCES         = 24,               ///< Voices the firmware mixes
+    SAMPLES_PER_FRAME   = 160,              ///< Stereo samples output per audio frame
+    SAMPLE_RATE         = 32728,            ///< Output sample rate, in Hz
+    NUM_BUSES           = 3,                ///< Main mix and the two auxiliary buses
+
+    REGION_0_VADDR      = 0x1FF50000,       ///< First region, in DSP memory
+    REGION_1_VADDR      = 0x1FF70000,       ///< Second region
+    DATA_VADDR          = 0x1FF40000,       ///< Word 0 of the DSP data memory
+    REGION_0_DSP_ADDR   = 0x8000,           ///< First region, as a DSP data memory word address
+};
+
+/// 32-bit integer as the DSP stores it, as two 16-bit words with the high one first
+struct DspU32 {
+    u16 high;
+    u16 low;
+
+    operator u32() const {
+        return ((u32)high << 16) | low;
+    }
+
+    DspU32& operator=(u32 value) {
+        high = (u16)(value >> 16);
+        low = (u16)(value & 0xFFFF);
+        return *this;
+    }
+};
+static_assert(sizeof(DspU32) == 4, "DspU32 has the wrong size");
+
+/// Bits of SourceConfiguration::dirty, the fields the application changed since the last frame
+enum {
+    SOURCE_FORMAT_DIRTY             = (1 << 0),
+    SOURCE_MONO_OR_STEREO_DIRTY     = (1 << 1),
+    SOURCE_ADPCM_COEFFS_DIRTY       = (1 << 2),
+    SOURCE_PARTIAL_EMBEDDED_DIRTY   = (1 << 3),     ///< Only the embedded buffer's ADPCM state
+    SOURCE_PARTIAL_RESET            = (1 << 4),
+    SOURCE_ENABLE_DIRTY             = (1 << 16),
+    SOURCE_INTERPOLATION_DIRTY      = (1 << 17),
+    SOURCE_RATE_MULTIPLIER_DIRTY    = (1 << 18),
+    SOURCE_BUFFER_QUEUE_DIRTY       = (1 << 19),    ///< Buffers of buffers_dirty were added
+    SOURCE_LOOP_RELATED_DIRTY       = (1 << 20),
+    SOURCE_PLAY_POSITION_DIRTY      = (1 << 21),
+    SOURCE_FILTERS_ENABLED_DIRTY    = (1 << 22),
+    SOURCE_SIMPLE_FILTER_DIRTY      = (1 << 23),
+    SOURCE_BIQUAD_FILTER_DIRTY      = (1 << 24),
+    SOURCE_GAIN_0_DIRTY             = (1 << 25),
+    SOURCE_GAIN_1_DIRTY             = (1 << 26),
+    SOURCE_GAIN_2_DIRTY             = (1 << 27),
+    SOURCE_SYNC_DIRTY               = (1 << 28),
+    SOURCE_RESET                    = (1 << 29),    ///< Stops the voice and drops its buffers
+    SOURCE_EMBEDDED_BUFFER_DIRTY    = (1 << 30),    ///< The embedded buffer was added
+};
+
+/// Sample formats of SourceConfiguration::format
+enum SourceFormat : u16 {
+    FORMAT_PCM8     = 0,
+    FORMAT_PCM16    = 1,
+    FORMAT_ADPCM    = 2,                    ///< 4-bit DSP ADPCM, 14 samples per 8-byte frame
+};
+
+/// Channel counts of SourceConfiguration::mono_or_stereo
+enum SourceChannels : u16 {
+    CHANNELS_MONO   = 1,
+    CHANNELS_STEREO = 2,
+};
+
+/// Interpolation modes of SourceConfiguration::interpolation_mode
+enum SourceInterpolation : u8 {
+    INTERPOLATION_POLYPHASE = 0,
+    INTERPOLATION_LINEAR    = 1,
+    INTERPOLATION_NONE      = 2,
+};
+
+/// Buffer of the queue of a voice
+struct SourceBuffer {
+    DspU32  physical_address;
+    DspU32  length;                         ///< In samples
+    u8      adpcm_ps;                       ///< ADPCM predictor and scale of the first frame
+    u8      padding0;
+    s16     adpcm_yn[2];                    ///< ADPCM history of the first sample
+    u8      adpcm_dirty;                    ///< Whether adpcm_ps and adpcm_yn are set
+    u8      is_looping;
+    u16     buffer_id;
+    u16     padding1;
+};
+static_assert(sizeof(SourceBuffer) == 20, "SourceBuffer has the wrong size");
+
+/// Configuration of a voice, written by the application
+struct SourceConfiguration {
+    DspU32  dirty;                          ///< SOURCE_* bits, cleared by the DSP
+
+    float   gain[NUM_BUSES][4];             ///< Front left, front right, back left, back right
+    float   rate_multiplier;                ///< Source samples per output sample
+    u8      interpolation_mode;             ///< SourceInterpolation
+    u8      padding0;
+
+    u16     filters_enabled;
+    s16     simple_filter[2];
+    s16     biquad_filter[5];
+
+    u16     buffers_dirty;                  ///< Bits of the buffers added to the queue
+    SourceBuffer buffers[4];
+
+    DspU32  loop_related;
+    u8      enable;
+    u8      padding1;
+    u16     sync;                           ///< Echoed in the status once applied
+    DspU32  play_position;                  ///< Sample the embedded buffer starts playing at
+
+    // Embedded buffer, the first one of the queue
+    DspU32  physical_address;
+    DspU32  length;                         ///< In samples
+    u16     mono_or_stereo;                 ///< SourceChannels
+    u16     format;                         ///< SourceFormat
+    u8      adpcm_ps;
+    u8      padding2;
+    s16     adpcm_yn[2];
+    u16     adpcm_dirty;
+    u16     is_looping;
+    u16     buffer_id;
+};
+static_assert(sizeof(SourceConfiguration) == 192, "SourceConfiguration has the wrong size");
+static_assert(offsetof(SourceConfiguration, buffers) == 76, "Buffers have the wrong offset");
+
+/// Status of a voice, written by the DSP at the end of each frame
+struct SourceStatus {
+    u8      is_enabled;
+    u8      current_buffer_id_dirty;        ///< Set for the frame a buffer starts playing in
+    u16     sync;                           ///< SourceConfiguration::sync last applied
+    DspU32  buffer_position;                ///< Sample of the current buffer playing
+    u16     current_buffer_id;
+    u16     padding0;
+};
+static_assert(sizeof(SourceStatus) == 12, "SourceStatus has the wrong size");
+
+/// ADPCM coefficients of a voice, 8 pairs picked by the predictor of each frame
+struct AdpcmCoefficients {
+    s16     coeffs[16];
+};
+static_assert(sizeof(AdpcmCoefficients) == 32, "AdpcmCoefficients has the wrong size");
+
+/// Bits of DspConfiguration::dirty
+enum {
+    DSP_MASTER_VOLUME_DIRTY         = (1 << 0),
+    DSP_AUX_RETURN_VOLUME_DIRTY     = (1 << 1) | (1 << 2),
+    DSP_OUTPUT_FORMAT_DIRTY         = (1 << 4),
+};
+
+/// Output formats of DspConfiguration::output_format
+enum {
+    OUTPUT_MONO     = 0,
+    OUTPUT_STEREO   = 1,
+    OUTPUT_SURROUND = 2,
+};
+
+/// Configuration of the final mix, written by the application
+struct DspConfiguration {
+    DspU32  dirty;                          ///< DSP_* bits, cleared by the DSP
+    float   master_volume;
+    float   aux_return_volume[2];           ///< Gain the auxiliary buses are mixed back with
+    u16     output_buffer_count;
+    u16     padding0[2];
+    u16     output_format;                  ///< OUTPUT_*
+    u16     limiter_enabled;
+    u16     headphones_connected;
+    u16     aux_bus_enable[2];              ///< Whether the application processes the bus
+    u16     unknown[82];                    ///< Effects the firmware has, not emulated
+};
+static_assert(sizeof(DspConfiguration) == 196, "DspConfiguration has the wrong size");
+
+/// Status of the DSP, written at the end of each frame
+struct DspStatus {
+    u16     unknown;
+    u16     dropped_frames;
+    u16     padding0[14];
+};
+static_assert(sizeof(DspStatus) == 32, "DspStatus has the wrong size");
+
+/// Output of the final mix of a frame
+struct FinalMixSamples {
+    s16     pcm16[SAMPLES_PER_FRAME * 2];   ///< Left and right samples interleaved
+};
+
+/// Auxiliary bus samples of a frame, for applications that process them
+struct IntermediateMixSamples {
+    s32     pcm32[2][4][SAMPLES_PER_FRAME]; ///< Bus, channel, sample
+};
+
+/// Region of DSP memory, as the words the DSP reports the addresses of through the audio pipe
+struct SharedMemory {
+    u16                     frame_counter;
+    u16                     padding0;
+    SourceConfiguration     source_configurations[NUM_SOURCES];
+    SourceStatus            source_statuses[NUM_SOURCES];
+    AdpcmCoefficients       adpcm_coefficients[NUM_SOURCES];
+    DspConfiguration        dsp_configuration;
+    DspStatus               dsp_status;
+    FinalMixSamples         final_samples;
+    IntermediateMixSamples  intermediate_mix_samples;
+    u16                     compressor[24];
+    u16                     dsp_debug[320];
+    u16                     unknown[5][16]; ///< Structures the firmware reports unused
+};
+static_assert(sizeof(SharedMemory) <= REGION_1_VADDR - REGION_0_VADDR,
+    "SharedMemory doesn't fit in a region");
+
+} // namespace
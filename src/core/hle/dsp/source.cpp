@@ -0,0 +1,458 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/chunk_file.h"
+#include "common/common.h"
+
+#include "core/mem_map.h"
+#include "core/hle/dsp/source.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+namespace {
+
+enum {
+    ADPCM_FRAME_SAMPLES = 14,               ///< Samples of an ADPCM frame, after its header byte
+    ADPCM_FRAME_SIZE    = 8,                ///< Bytes of an ADPCM frame
+    MAX_STEP            = (16 << 16),       ///< Fastest resampling, 16 source samples per output
+    /// Most source samples a frame decodes, at MAX_STEP
+    MAX_DECODED         = ((0xFFFF + SAMPLES_PER_FRAME * MAX_STEP) >> 16),
+};
+
+/// Last two samples of the previous frame and the samples decoded for the current one, left and
+/// right interleaved. Only the audio thread renders frames, one voice at a time.
+float g_decoded[(2 + MAX_DECODED) * 2];
+
+/**
+ * Gets the size of the samples of a buffer
+ * @param format SourceFormat of the buffer
+ * @param channels SourceChannels of the buffer
+ * @param length Number of samples of the buffer
+ * @return Size in bytes
+ */
+u32 GetBufferSize(u16 format, u16 channels, u32 length) {
+    switch (format) {
+    case FORMAT_PCM8:
+        return length * channels;
+    case FORMAT_PCM16:
+        return length * channels * 2;
+    default:
+        return (length + ADPCM_FRAME_SAMPLES - 1) / ADPCM_FRAME_SAMPLES * ADPCM_FRAME_SIZE;
+    }
+}
+
+/**
+ * Resamples a frame of a voice, interpolating linearly between the decoded samples
+ * @param decoded Decoded samples, left and right interleaved
+ * @param fraction Position of the first output sample in the decoded ones, 16.16
+ * @param step Decoded samples per output sample, 16.16
+ * @param out Receives SAMPLES_PER_FRAME output samples, left and right interleaved
+ */
+void ResampleLinear(const float* decoded, u32 fraction, u32 step, float* out) {
+#ifdef _M_X64
+    // Two output samples at a time, each from the pair of decoded samples it falls between
+    const __m128 scale = _mm_set1_ps(1.0f / 65536.0f);
+    for (int i = 0; i < SAMPLES_PER_FRAME; i += 2) {
+        const u32 pos0 = fraction + i * step;
+        const u32 pos1 = pos0 + step;
+        const float* s0 = &decoded[(pos0 >> 16) * 2];
+        const float* s1 = &decoded[(pos1 >> 16) * 2];
+        const __m128 a = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)s0),
+            (const __m64*)s1);
+        const __m128 b = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(s0 + 2)),
+            (const __m64*)(s1 + 2));
+        const __m128 t = _mm_mul_ps(_mm_set_ps((float)(pos1 & 0xFFFF), (float)(pos1 & 0xFFFF),
+            (float)(pos0 & 0xFFFF), (float)(pos0 & 0xFFFF)), scale);
+        _mm_storeu_ps(&out[i * 2], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+    }
+#else
+    for (int i = 0; i < SAMPLES_PER_FRAME; i++) {
+        const u32 pos = fraction + i * step;
+        const float* s = &decoded[(pos >> 16) * 2];
+        const float t = (pos & 0xFFFF) * (1.0f / 65536.0f);
+        out[i * 2 + 0] = s[0] + (s[2] - s[0]) * t;
+        out[i * 2 + 1] = s[1] + (s[3] - s[1]) * t;
+    }
+#endif
+}
+
+/**
+ * Resamples a frame of a voice, taking the decoded sample each output sample falls after
+ * @param decoded Decoded samples, left and right interleaved
+ * @param fraction Position of the first output sample in the decoded ones, 16.16
+ * @param step Decoded samples per output sample, 16.16
+ * @param out Receives SAMPLES_PER_FRAME output samples, left and right interleaved
+ */
+void ResampleNearest(const float* decoded, u32 fraction, u32 step, float* out) {
+    for (int i = 0; i < SAMPLES_PER_FRAME; i++) {
+        const float* s = &decoded[((fraction + i * step) >> 16) * 2];
+        out[i * 2 + 0] = s[0];
+        out[i * 2 + 1] = s[1];
+    }
+}
+
+/**
+ * Mixes a frame of a voice into a bus
+ * @param bus Bus samples, left and right interleaved, SAMPLES_PER_FRAME * 2 floats
+ * @param samples Samples of the voice, left and right interleaved
+ * @param left Gain of the left channel
+ * @param right Gain of the right channel
+ */
+void MixIntoBus(float* bus, const float* samples, float left, float right) {
+#ifdef _M_X64
+    const __m128 gain = _mm_set_ps(right, left, right, left);
+    for (int i = 0; i < SAMPLES_PER_FRAME * 2; i += 8) {
+        const __m128 a = _mm_mul_ps(_mm_loadu_ps(&samples[i + 0]), gain);
+        const __m128 b = _mm_mul_ps(_mm_loadu_ps(&samples[i + 4]), gain);
+        _mm_storeu_ps(&bus[i + 0], _mm_add_ps(_mm_loadu_ps(&bus[i + 0]), a));
+        _mm_storeu_ps(&bus[i + 4], _mm_add_ps(_mm_loadu_ps(&bus[i + 4]), b));
+    }
+#else
+    for (int i = 0; i < SAMPLES_PER_FRAME * 2; i += 2) {
+        bus[i + 0] += samples[i + 0] * left;
+        bus[i + 1] += samples[i + 1] * right;
+    }
+#endif
+}
+
+} // namespace
+
+Source::Source() {
+    m_format = FORMAT_PCM16;
+    m_channels = CHANNELS_MONO;
+    m_interpolation = INTERPOLATION_POLYPHASE;
+    m_rate_multiplier = 1.0f;
+    memset(m_gain, 0, sizeof(m_gain));
+    memset(m_adpcm_coeffs, 0, sizeof(m_adpcm_coeffs));
+    m_sync = 0;
+    Reset();
+}
+
+/// Stops the voice and drops its buffers
+void Source::Reset() {
+    m_enabled = false;
+    m_queue.clear();
+    memset(&m_current, 0, sizeof(m_current));
+    m_current_dirty = false;
+    m_position = 0;
+    m_adpcm_yn[0] = m_adpcm_yn[1] = 0;
+    m_fraction = 0;
+    memset(m_history, 0, sizeof(m_history));
+}
+
+/**
+ * Applies the changes the application made to the configuration of the voice
+ * @param config Configuration of the voice, as of the start of the frame
+ * @param coeffs ADPCM coefficients of the voice
+ */
+void Source::ApplyConfiguration(const SourceConfiguration& config,
+    const AdpcmCoefficients& coeffs) {
+    const u32 dirty = config.dirty;
+    if (dirty == 0) {
+        return;
+    }
+
+    if (dirty & SOURCE_RESET) {
+        Reset();
+    }
+    if (dirty & SOURCE_PARTIAL_RESET) {
+        m_position = 0;
+        m_fraction = 0;
+        memset(m_history, 0, sizeof(m_history));
+    }
+    if (dirty & SOURCE_ENABLE_DIRTY) {
+        m_enabled = (config.enable != 0);
+    }
+    if (dirty & SOURCE_SYNC_DIRTY) {
+        m_sync = config.sync;
+    }
+    if (dirty & SOURCE_RATE_MULTIPLIER_DIRTY) {
+        m_rate_multiplier = config.rate_multiplier;
+    }
+    if (dirty & SOURCE_INTERPOLATION_DIRTY) {
+        m_interpolation = config.interpolation_mode;
+    }
+    const int gain_dirty[NUM_BUSES] = {
+        SOURCE_GAIN_0_DIRTY, SOURCE_GAIN_1_DIRTY, SOURCE_GAIN_2_DIRTY,
+    };
+    for (int bus = 0; bus < NUM_BUSES; bus++) {
+        if (dirty & gain_dirty[bus]) {
+            memcpy(m_gain[bus], config.gain[bus], sizeof(m_gain[bus]));
+        }
+    }
+    if (dirty & SOURCE_ADPCM_COEFFS_DIRTY) {
+        memcpy(m_adpcm_coeffs, coeffs.coeffs, sizeof(m_adpcm_coeffs));
+    }
+    if (dirty & SOURCE_FORMAT_DIRTY) {
+        m_format = config.format;
+    }
+    if (dirty & SOURCE_MONO_OR_STEREO_DIRTY) {
+        m_channels = config.mono_or_stereo;
+    }
+    // Filters aren't emulated, voices play unfiltered
+
+    if (dirty & SOURCE_EMBEDDED_BUFFER_DIRTY) {
+        Buffer buffer;
+        buffer.address = config.physical_address;
+        buffer.length = config.length;
+        buffer.play_position = (dirty & SOURCE_PLAY_POSITION_DIRTY) ? (u32)config.play_position
+            : 0;
+        buffer.format = m_format;
+        buffer.channels = m_channels;
+        buffer.buffer_id = config.buffer_id;
+        buffer.adpcm_dirty = (config.adpcm_dirty != 0);
+        buffer.is_looping = (config.is_looping != 0);
+        buffer.adpcm_yn[0] = config.adpcm_yn[0];
+        buffer.adpcm_yn[1] = config.adpcm_yn[1];
+        Enqueue(buffer);
+    }
+    if (dirty & SOURCE_BUFFER_QUEUE_DIRTY) {
+        for (int i = 0; i < 4; i++) {
+            if (!(config.buffers_dirty & (1 << i))) {
+                continue;
+            }
+            const SourceBuffer& in = config.buffers[i];
+            Buffer buffer;
+            buffer.address = in.physical_address;
+            buffer.length = in.length;
+            buffer.play_position = 0;
+            buffer.format = m_format;
+            buffer.channels = m_channels;
+            buffer.buffer_id = in.buffer_id;
+            buffer.adpcm_dirty = in.adpcm_dirty;
+            buffer.is_looping = in.is_looping;
+            buffer.adpcm_yn[0] = in.adpcm_yn[0];
+            buffer.adpcm_yn[1] = in.adpcm_yn[1];
+            Enqueue(buffer);
+        }
+    }
+}
+
+/**
+ * Adds a buffer to the queue, which plays in buffer_id order
+ * @param buffer Buffer to add
+ */
+void Source::Enqueue(const Buffer& buffer) {
+    if (buffer.length == 0) {
+        return;
+    }
+    auto it = m_queue.begin();
+    while (it != m_queue.end() && it->buffer_id <= buffer.buffer_id) {
+        ++it;
+    }
+    m_queue.insert(it, buffer);
+}
+
+/**
+ * Starts playing the next buffer of the queue
+ * @return False if the queue is empty
+ */
+bool Source::Dequeue() {
+    if (m_queue.empty()) {
+        m_current.length = 0;
+        return false;
+    }
+    m_current = m_queue.front();
+    m_queue.erase(m_queue.begin());
+    m_current_dirty = true;
+    m_position = std::min(m_current.play_position, m_current.length);
+    if (m_current.adpcm_dirty) {
+        m_adpcm_yn[0] = m_current.adpcm_yn[0];
+        m_adpcm_yn[1] = m_current.adpcm_yn[1];
+    }
+    return true;
+}
+
+/**
+ * Gets the samples of the current buffer
+ * @return Host pointer of the samples, NULL if they aren't all in plain guest memory
+ */
+const u8* Source::GetCurrentData() const {
+    const u32 size = GetBufferSize(m_current.format, m_current.channels, m_current.length);
+    const u32 first = Memory::VirtualAddressFromPhysical(m_current.address);
+    const u32 last = Memory::VirtualAddressFromPhysical(m_current.address + size - 1);
+    if (first == 0 || last - first != size - 1) {
+        return NULL;
+    }
+    return Memory::GetPointer(first);
+}
+
+/**
+ * Decodes a sample of the current buffer
+ * @param data Samples of the current buffer
+ * @param out Receives the left and right values of the sample
+ */
+void Source::DecodeSample(const u8* data, float out[2]) {
+    const bool stereo = (m_current.channels == CHANNELS_STEREO);
+    const u32 n = m_position;
+
+    switch (m_current.format) {
+    case FORMAT_PCM8:
+        if (stereo) {
+            out[0] = (float)((s8)data[n * 2 + 0] * 256);
+            out[1] = (float)((s8)data[n * 2 + 1] * 256);
+        } else {
+            out[0] = out[1] = (float)((s8)data[n] * 256);
+        }
+        break;
+
+    case FORMAT_PCM16:
+        {
+            const s16* samples = (const s16*)data;
+            if (stereo) {
+                out[0] = samples[n * 2 + 0];
+                out[1] = samples[n * 2 + 1];
+            } else {
+                out[0] = out[1] = samples[n];
+            }
+        }
+        break;
+
+    default:
+        {
+            // Every frame starts with its scale and the pair of coefficients it predicts with
+            const u8* frame = &data[n / ADPCM_FRAME_SAMPLES * ADPCM_FRAME_SIZE];
+            const u32 index = n % ADPCM_FRAME_SAMPLES;
+            const u8 ps = frame[0];
+            const u8 byte = frame[1 + index / 2];
+            const int nibble = (index & 1) ? (byte & 0xF) : (byte >> 4);
+            const int delta = ((nibble ^ 8) - 8) * (1 << (ps & 0xF));
+            const int coeff1 = m_adpcm_coeffs[((ps >> 4) & 7) * 2 + 0];
+            const int coeff2 = m_adpcm_coeffs[((ps >> 4) & 7) * 2 + 1];
+            int value = ((delta << 11) + 1024 + coeff1 * m_adpcm_yn[0] + coeff2 * m_adpcm_yn[1])
+                >> 11;
+            value = std::max(-32768, std::min(32767, value));
+            m_adpcm_yn[1] = m_adpcm_yn[0];
+            m_adpcm_yn[0] = (s16)value;
+            out[0] = out[1] = (float)value;
+        }
+        break;
+    }
+}
+
+/**
+ * Decodes samples of the buffers, going on with the next buffer as one ends
+ * @param out Receives the samples, left and right interleaved, 2 * count floats
+ * @param count Number of samples to decode, silence after the last buffer
+ */
+void Source::Decode(float* out, u32 count) {
+    u32 n = 0;
+    while (n < count) {
+        if (m_position >= m_current.length) {
+            if (m_current.length != 0 && m_current.is_looping) {
+                m_position = 0;
+                if (m_current.adpcm_dirty) {
+                    m_adpcm_yn[0] = m_current.adpcm_yn[0];
+                    m_adpcm_yn[1] = m_current.adpcm_yn[1];
+                }
+            } else if (!Dequeue()) {
+                break;
+            }
+            continue;
+        }
+
+        const u8* data = GetCurrentData();
+        if (data == NULL) {
+            ERROR_LOG(DSPHLE, "buffer %u at invalid address 0x%08X", m_current.buffer_id,
+                m_current.address);
+            m_position = m_current.length;
+            continue;
+        }
+        const u32 end = std::min(m_current.length, m_position + count - n);
+        for (; m_position < end; m_position++, n++) {
+            DecodeSample(data, &out[n * 2]);
+        }
+    }
+    memset(&out[n * 2], 0, (count - n) * 2 * sizeof(float));
+}
+
+/**
+ * Renders a frame of the voice and mixes it into the buses
+ * @param buses Receives the samples of the voice scaled by its gains, left and right
+ *     interleaved, SAMPLES_PER_FRAME * 2 floats per bus
+ */
+void Source::MixFrame(float* const buses[NUM_BUSES]) {
+    m_current_dirty = false;
+    if (!m_enabled) {
+        return;
+    }
+
+    // Output samples at fraction + i * step in the decoded ones, the first two decoded samples are
+    // the last two of the previous frame
+    float rate = m_rate_multiplier;
+    if (!(rate > 0.0f)) {
+        rate = 0.0f;
+    }
+    const u32 step = std::min((u32)(rate * 65536.0f), (u32)MAX_STEP);
+    const u32 end = m_fraction + SAMPLES_PER_FRAME * step;
+    const u32 count = end >> 16;
+
+    memcpy(g_decoded, m_history, sizeof(m_history));
+    Decode(&g_decoded[4], count);
+    memcpy(m_history, &g_decoded[count * 2], sizeof(m_history));
+
+    MEMORY_ALIGNED16(float samples[SAMPLES_PER_FRAME * 2]);
+    if (m_interpolation == INTERPOLATION_NONE) {
+        ResampleNearest(g_decoded, m_fraction, step, samples);
+    } else {
+        ResampleLinear(g_decoded, m_fraction, step, samples);
+    }
+    m_fraction = end & 0xFFFF;
+
+    // Back channels are folded into the front ones, the output is stereo
+    for (int bus = 0; bus < NUM_BUSES; bus++) {
+        const float left = m_gain[bus][0] + m_gain[bus][2];
+        const float right = m_gain[bus][1] + m_gain[bus][3];
+        if (left != 0.0f || right != 0.0f) {
+            MixIntoBus(buses[bus], samples, left, right);
+        }
+    }
+}
+
+/**
+ * Gets the status of the voice at the end of the last frame rendered
+ * @param status Receives the status
+ */
+void Source::GetStatus(SourceStatus& status) const {
+    status.is_enabled = m_enabled;
+    status.current_buffer_id_dirty = m_current_dirty;
+    status.sync = m_sync;
+    status.buffer_position = m_position;
+    status.current_buffer_id = m_current.buffer_id;
+    status.padding0 = 0;
+}
+
+/**
+ * Saves or loads the state of the voice
+ * @param p Savestate the state is written to or read from
+ */
+void Source::DoState(PointerWrap& p) {
+    p.Do(m_enabled);
+    p.Do(m_sync);
+    p.Do(m_format);
+    p.Do(m_channels);
+    p.Do(m_interpolation);
+    p.Do(m_rate_multiplier);
+    p.DoArray(&m_gain[0][0], NUM_BUSES * 4);
+    p.DoArray(m_adpcm_coeffs, 16);
+    p.DoPOD(m_queue);
+    p.Do(m_current);
+    p.Do(m_current_dirty);
+    p.Do(m_position);
+    p.DoArray(m_adpcm_yn, 2);
+    p.Do(m_fraction);
+    p.DoArray(m_history, 4);
+}
+
+} // namespace
@@ -0,0 +1,123 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/hle/dsp/shared_memory.h"
+
+class PointerWrap;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+/**
+ * Voice of the DSP mixer: queues the buffers the application adds to it, decodes them to floats
+ * and resamples them to the output rate, a frame at a time. Only the audio thread uses voices
+ * while it renders a frame.
+ */
+class Source {
+public:
+    Source();
+
+    /// Stops the voice and drops its buffers
+    void Reset();
+
+    /**
+     * Applies the changes the application made to the configuration of the voice
+     * @param config Configuration of the voice, as of the start of the frame
+     * @param coeffs ADPCM coefficients of the voice
+     */
+    void ApplyConfiguration(const SourceConfiguration& config, const AdpcmCoefficients& coeffs);
+
+    /**
+     * Renders a frame of the voice and mixes it into the buses
+     * @param buses Receives the samples of the voice scaled by its gains, left and right
+     *     interleaved, SAMPLES_PER_FRAME * 2 floats per bus
+     */
+    void MixFrame(float* const buses[NUM_BUSES]);
+
+    /**
+     * Gets the status of the voice at the end of the last frame rendered
+     * @param status Receives the status
+     */
+    void GetStatus(SourceStatus& status) const;
+
+    /**
+     * Saves or loads the state of the voice
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
+private:
+    /// Buffer of the queue, as it was when it was added
+    struct Buffer {
+        u32     address;                    ///< Physical address of the samples
+        u32     length;                     ///< In samples
+        u32     play_position;              ///< Sample it starts playing at
+        u16     format;                     ///< SourceFormat
+        u16     channels;                   ///< SourceChannels
+        u16     buffer_id;
+        u8      adpcm_dirty;                ///< Whether adpcm_yn is set, else the history goes on
+        u8      is_looping;
+        s16     adpcm_yn[2];
+    };
+
+    /**
+     * Adds a buffer to the queue, which plays in buffer_id order
+     * @param buffer Buffer to add
+     */
+    void Enqueue(const Buffer& buffer);
+
+    /**
+     * Starts playing the next buffer of the queue
+     * @return False if the queue is empty
+     */
+    bool Dequeue();
+
+    /**
+     * Decodes samples of the buffers, going on with the next buffer as one ends
+     * @param out Receives the samples, left and right interleaved, 2 * count floats
+     * @param count Number of samples to decode, silence after the last buffer
+     */
+    void Decode(float* out, u32 count);
+
+    /**
+     * Decodes a sample of the current buffer
+     * @param data Samples of the current buffer
+     * @param out Receives the left and right values of the sample
+     */
+    void DecodeSample(const u8* data, float out[2]);
+
+    /**
+     * Gets the samples of the current buffer
+     * @return Host pointer of the samples, NULL if they aren't all in plain guest memory
+     */
+    const u8* GetCurrentData() const;
+
+    bool    m_enabled;
+    u16     m_sync;
+    u16     m_format;                       ///< SourceFormat of the buffers added from now on
+    u16     m_channels;                     ///< SourceChannels of the buffers added from now on
+    u8      m_interpolation;                ///< SourceInterpolation
+    float   m_rate_multiplier;
+    float   m_gain[NUM_BUSES][4];
+    s16     m_adpcm_coeffs[16];
+
+    std::vector<Buffer> m_queue;            ///< Buffers to play after the current one
+    Buffer  m_current;                      ///< Buffer playing, length 0 for none
+    bool    m_current_dirty;                ///< Whether a buffer started playing this frame
+    u32     m_position;                     ///< Next sample of the current buffer to decode
+    s16     m_adpcm_yn[2];                  ///< ADPCM history, of the last samples decoded
+
+    u32     m_fraction;                     ///< Position between the last two samples, 16.16
+    float   m_history[4];                   ///< Last two samples decoded, left and right
+};
+
+} // namespace
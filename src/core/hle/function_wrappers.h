@@ -734,12 +734,40 @@ template<int func(void*, u32, u32, u32, u32, u32)> void WrapI_VUUUUU(){
     RETURN(retval);
 }
 
+template<int func(void*, s32, s32)> void WrapI_VII(){
+    u32 retval = func(Memory::GetPointer(PARAM(0)), PARAM(1), PARAM(2));
+    RETURN(retval);
+}
+
+template<int func(void*, u32, s32)> void WrapI_VUI(){
+    u32 retval = func(Memory::GetPointer(PARAM(0)), PARAM(1), PARAM(2));
+    RETURN(retval);
+}
+
+// A 64-bit argument after a 32-bit one is passed in the next even register pair, r2 and r3
 template<int func(u32, s64)> void WrapI_US64() {
-    int retval = func(PARAM(0), PARAM64(1));
+    int retval = func(PARAM(0), PARAM64(2));
+    RETURN(retval);
+}
+
+template<void func(s64)> void WrapV_S64() {
+    func(PARAM64(0));
+}
+
+template<int func(u32, u32, u32, u32, s64)> void WrapI_UUUUS64() {
+    int retval = func(PARAM(0), PARAM(1), PARAM(2), PARAM(3), PARAM(4) | ((u64)PARAM(5) << 32));
+    RETURN(retval);
+}
+
+// WaitSynchronizationN gets its timeout in r0 and r4
+template<int func(void*, u32, u32, s64)> void WrapI_VUUS64() {
+    int retval = func(Memory::GetPointer(PARAM(1)), PARAM(2), PARAM(3),
+        PARAM(0) | ((u64)PARAM(4) << 32));
     RETURN(retval);
 }
 
-template<int func(void*, void*, u32, u32, s64)> void WrapI_VVUUS64() {
-    int retval = func(Memory::GetPointer(PARAM(0)), Memory::GetPointer(PARAM(1)), PARAM(2), PARAM(3), PARAM(4));
+// SetTimer gets its initial delay in r2 and r3, its interval in r1 and r4
+template<int func(u32, s64, s64)> void WrapI_US64S64() {
+    int retval = func(PARAM(0), PARAM64(2), PARAM(1) | ((u64)PARAM(4) << 32));
     RETURN(retval);
 }
@@ -3,8 +3,13 @@
 // Refer to the license.txt file included.  
 
 #include <vector>
+#include "common/profiler.h"
 
 #include "core/mem_map.h"
+#include "core/core_timing.h"
+#include "core/sys_core.h"
+#include "core/hle/async_io.h"
+#include "core/hle/config_mem.h"
 #include "core/hle/hle.h"
 #include "core/hle/svc.h"
 #include "core/hle/service/service.h"
@@ -15,6 +20,17 @@ namespace HLE {
 
 static std::vector<ModuleDef> g_module_db;
 
+bool g_reschedule = false;  ///< If true, immediately reschedules the CPU to a new thread
+u32* g_svc_regs = NULL;     ///< Register file of the core executing the current SVC
+
+/// SVC handlers indexed by SVC number, NULL for unimplemented ones. Flat so that dispatching an
+/// SVC is a single load, aligned so that the hot entries share as few cache lines as possible.
+static MEMORY_ALIGNED64(Func) g_svc_table[0x100];
+
+static Common::Profiler::Category g_profile_svc("SVC");
+
+u64 g_svc_call_counts[0x100];   ///< Calls of every SVC since Init, implemented or not
+
 const FunctionDef* GetSVCInfo(u32 opcode) {
     u32 func_num = opcode & 0xFFFFFF; // 8 bits
     if (func_num > 0xFF) {
@@ -24,28 +40,64 @@ const FunctionDef* GetSVCInfo(u32 opcode) {
     return &g_module_db[0].func_table[func_num];
 }
 
-void CallSVC(u32 opcode) {
-    const FunctionDef *info = GetSVCInfo(opcode);
+/**
+ * Gets the name of an SVC
+ * @param func_num Id of the SVC
+ * @return Name of the SVC, empty if it has no entry in the SVC table
+ */
+const char* GetSVCName(u32 func_num) {
+    if (g_module_db.empty()) {
+        return "";
+    }
+    const ModuleDef& module = g_module_db[0];
+    for (int i = 0; i < module.num_funcs; i++) {
+        if (module.func_table[i].id == func_num) {
+            return module.func_table[i].name;
+        }
+    }
+    return "";
+}
 
-    if (!info) {
+/**
+ * Executes an SVC
+ * @param opcode SVC instruction word
+ * @param regs Register file of the calling core, read and written by the handler
+ */
+void CallSVC(u32 opcode, u32* regs) {
+    // The kernel state belongs to the app core thread, which serves the SVC at the sync point
+    if (SysCore::IsSysCoreThread()) {
+        SysCore::DeferSVC(opcode, regs);
         return;
     }
-    if (info->func) {
-        info->func();
-    } else {
-        ERROR_LOG(HLE, "Unimplemented SVC function %s(..)", info->name.c_str());
+    u32 func_num = opcode & 0xFFFFFF;
+    if (func_num <= 0xFF) {
+        g_svc_call_counts[func_num]++;
+    }
+    if (func_num <= 0xFF && g_svc_table[func_num] != NULL) {
+        Common::Profiler::Scope scope(g_profile_svc);
+        g_svc_regs = regs;
+        g_svc_table[func_num]();
+        return;
+    }
+
+    // Slow path, only taken to report what's missing
+    const FunctionDef *info = GetSVCInfo(opcode);
+    if (info) {
+        ERROR_LOG(HLE, "Unimplemented SVC function %s(..)", info->name);
     }
 }
 
 void EatCycles(u32 cycles) {
-    // TODO: ImplementMe
+    CoreTiming::downcount -= cycles;
 }
 
 void ReSchedule(const char *reason) {
 #ifdef _DEBUG
     _dbg_assert_msg_(HLE, reason != 0 && strlen(reason) < 256, "ReSchedule: Invalid or too long reason.");
 #endif
-    // TODO: ImplementMe
+    // End the current CPU slice so the core loop reschedules right after this instruction
+    Core::g_app_core->PrepareReschedule();
+    g_reschedule = true;
 }
 
 void RegisterModule(std::string name, int num_functions, const FunctionDef* func_table) {
@@ -53,22 +105,42 @@ void RegisterModule(std::string name, int num_functions, const FunctionDef* func
     g_module_db.push_back(module);
 }
 
+/**
+ * Binds the SVC handlers into the dispatch table used by CallSVC
+ * @param num_functions Number of entries in func_table
+ * @param func_table SVC handlers, indexed by their id
+ */
+void RegisterSVCTable(int num_functions, const FunctionDef* func_table) {
+    memset(g_svc_table, 0, sizeof(g_svc_table));
+    for (int i = 0; i < num_functions; i++) {
+        if (func_table[i].id < ARRAY_SIZE(g_svc_table)) {
+            g_svc_table[func_table[i].id] = func_table[i].func;
+        }
+    }
+}
+
 void RegisterAllModules() {
     SVC::Register();
 }
 
 void Init() {
     Service::Init();
+    AsyncIO::Init();
+    ConfigMem::Init();
     
     RegisterAllModules();
+    memset(g_svc_call_counts, 0, sizeof(g_svc_call_counts));
 
     NOTICE_LOG(HLE, "initialized OK");
 }
 
 void Shutdown() {
+    ConfigMem::Shutdown();
+    AsyncIO::Shutdown();
     Service::Shutdown();
 
     g_module_db.clear();
+    memset(g_svc_table, 0, sizeof(g_svc_table));
 
     NOTICE_LOG(HLE, "shutdown OK");
 }
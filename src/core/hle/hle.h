@@ -9,21 +9,25 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#define PARAM(n)        Core::g_app_core->GetReg(n)
-#define PARAM64(n)      (Core::g_app_core->GetReg(n) | ((u64)Core::g_app_core->GetReg(n + 1) << 32))
-#define RETURN(n)       Core::g_app_core->SetReg(0, n)
+#define PARAM(n)        HLE::g_svc_regs[n]
+#define PARAM64(n)      (HLE::g_svc_regs[n] | ((u64)HLE::g_svc_regs[n + 1] << 32))
+#define RETURN(n)       HLE::g_svc_regs[0] = n
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace HLE {
 
+extern bool g_reschedule;    ///< If true, immediately reschedules the CPU to a new thread
+extern u32* g_svc_regs;      ///< Register file of the core executing the current SVC
+extern u64 g_svc_call_counts[0x100];   ///< Calls of every SVC since Init, implemented or not
+
 typedef u32 Addr;
 typedef void (*Func)();
 
 struct FunctionDef {
     u32                 id;
     Func                func;
-    std::string         name;
+    const char*         name;
 };
 
 struct ModuleDef {
@@ -34,7 +38,26 @@ struct ModuleDef {
 
 void RegisterModule(std::string name, int num_functions, const FunctionDef *func_table);
 
-void CallSVC(u32 opcode);
+/**
+ * Binds the SVC handlers into the dispatch table used by CallSVC
+ * @param num_functions Number of entries in func_table
+ * @param func_table SVC handlers, indexed by their id
+ */
+void RegisterSVCTable(int num_functions, const FunctionDef* func_table);
+
+/**
+ * Executes an SVC
+ * @param opcode SVC instruction word
+ * @param regs Register file of the calling core, read and written by the handler
+ */
+void CallSVC(u32 opcode, u32* regs);
+
+/**
+ * Gets the name of an SVC
+ * @param func_num Id of the SVC
+ * @return Name of the SVC, empty if it has no entry in the SVC table
+ */
+const char* GetSVCName(u32 func_num);
 
 void EatCycles(u32 cycles);
 
@@ -0,0 +1,120 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#include <unordered_map>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/mem_map.h"
+#include "core/hle/kernel/address_arbiter.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/thread.h"
+
+namespace Kernel {
+
+/**
+ * Address arbiter. The threads waiting on each address are in an intrusive list, found through a
+ * hash table by address, so signalling an address only touches the threads waiting on it.
+ */
+class AddressArbiter : public Object {
+public:
+    const char* GetTypeName() { return "Arbiter"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Arbiter; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Arbiter; }
+
+    /// The queues are rebuilt from the threads once all objects are loaded, see ThreadingDoState
+    void DoState(PointerWrap& p) {
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            queues.clear();
+        }
+    }
+
+    /// Queues by guest address, the nodes stay put as the table grows so threads can link in
+    std::unordered_map<u32, WaitQueue> queues;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Creates an address arbiter, which guest locks and condition variables are built on
+ * @return Handle of the arbiter
+ */
+Handle CreateAddressArbiter() {
+    return Kernel::g_object_pool.Create(new AddressArbiter);
+}
+
+/**
+ * Signals or waits on a guest address
+ * @param handle Handle of the address arbiter
+ * @param address Guest address of the word arbitrated
+ * @param type What to do with the address
+ * @param value Number of threads to resume for a signal, negative for all of them, else the
+ *      value the word is compared to
+ * @param nano_seconds Timeout of the variants that have one
+ */
+Result ArbitrateAddress(Handle handle, u32 address, ArbitrationType type, s32 value,
+    s64 nano_seconds) {
+
+    u32 error;
+    AddressArbiter* arbiter = Kernel::g_object_pool.Get<AddressArbiter>(handle, error);
+    if (arbiter == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+
+    switch (type) {
+    case ArbitrationType::Signal:
+    {
+        auto it = arbiter->queues.find(address);
+        if (it != arbiter->queues.end()) {
+            ResumeAddressWaiters(&it->second, value);
+            if (it->second.empty()) {
+                arbiter->queues.erase(it);
+            }
+        }
+        return 0;
+    }
+
+    case ArbitrationType::WaitIfLessThan:
+    case ArbitrationType::DecrementAndWaitIfLessThan:
+    case ArbitrationType::WaitIfLessThanWithTimeout:
+    case ArbitrationType::DecrementAndWaitIfLessThanWithTimeout:
+    {
+        const s32 word = (s32)Memory::Read32(address);
+        if (word >= value) {
+            return 0;
+        }
+        if (type == ArbitrationType::DecrementAndWaitIfLessThan ||
+            type == ArbitrationType::DecrementAndWaitIfLessThanWithTimeout) {
+            Memory::Write32(address, (u32)(word - 1));
+        }
+        const bool has_timeout = (type == ArbitrationType::WaitIfLessThanWithTimeout ||
+            type == ArbitrationType::DecrementAndWaitIfLessThanWithTimeout);
+        WaitCurrentThreadOnAddress(handle, address, &arbiter->queues[address],
+            has_timeout ? nano_seconds : -1);
+        return 0;
+    }
+
+    default:
+        ERROR_LOG(KERNEL, "ArbitrateAddress unknown type=%d", (u32)type);
+        return ERROR_INVALID_ENUM_VALUE;
+    }
+}
+
+/**
+ * Gets the queue of the threads waiting on an address, to load them back into it
+ * @param handle Handle of the address arbiter
+ * @param address Guest address waited on
+ */
+WaitQueue* GetAddressQueue(Handle handle, u32 address) {
+    return &Kernel::g_object_pool.GetFast<AddressArbiter>(handle)->queues[address];
+}
+
+/// Creates an empty address arbiter to load a state into
+Object* NewAddressArbiterObject() {
+    return new AddressArbiter;
+}
+
+} // namespace
@@ -0,0 +1,50 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace Kernel {
+
+/// What ArbitrateAddress does with the address
+enum class ArbitrationType : u32 {
+    Signal                                  = 0,    ///< Resumes up to value waiting threads
+    WaitIfLessThan                          = 1,    ///< Waits while the word is below value
+    DecrementAndWaitIfLessThan              = 2,    ///< Same, decrementing the word first
+    WaitIfLessThanWithTimeout               = 3,
+    DecrementAndWaitIfLessThanWithTimeout   = 4,
+};
+
+/**
+ * Creates an address arbiter, which guest locks and condition variables are built on
+ * @return Handle of the arbiter
+ */
+Handle CreateAddressArbiter();
+
+/**
+ * Signals or waits on a guest address
+ * @param handle Handle of the address arbiter
+ * @param address Guest address of the word arbitrated
+ * @param type What to do with the address
+ * @param value Number of threads to resume for a signal, negative for all of them, else the
+ *      value the word is compared to
+ * @param nano_seconds Timeout of the variants that have one
+ */
+Result ArbitrateAddress(Handle handle, u32 address, ArbitrationType type, s32 value,
+    s64 nano_seconds);
+
+/**
+ * Gets the queue of the threads waiting on an address, to load them back into it
+ * @param handle Handle of the address arbiter
+ * @param address Guest address waited on
+ */
+WaitQueue* GetAddressQueue(Handle handle, u32 address);
+
+/// Creates an empty address arbiter to load a state into
+Object* NewAddressArbiterObject();
+
+} // namespace
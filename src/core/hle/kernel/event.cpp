@@ -0,0 +1,95 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/event.h"
+#include "core/hle/kernel/thread.h"
+
+namespace Kernel {
+
+class Event : public WaitObject {
+public:
+    const char* GetTypeName() { return "Event"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Event; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Event; }
+
+    bool ShouldWait(Handle thread) {
+        return !signaled;
+    }
+
+    void Acquire(Handle thread) {
+        if (reset_type == RESETTYPE_ONESHOT) {
+            signaled = false;
+        }
+    }
+
+    void DoState(PointerWrap& p) {
+        p.Do(reset_type);
+        p.Do(signaled);
+        DoWaiters(p);
+    }
+
+    ResetType reset_type;                       ///< What clears the event
+    bool signaled;                              ///< Whether waiting on the event completes
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Creates an event, initially cleared
+ * @param reset_type Whether the event clears as it wakes a thread, stays signalled, or only wakes
+ *      the threads already waiting
+ * @return Handle of the event
+ */
+Handle CreateEvent(ResetType reset_type) {
+    Event* event = new Event;
+    event->reset_type = reset_type;
+    event->signaled = false;
+    return Kernel::g_object_pool.Create(event);
+}
+
+/**
+ * Signals an event, waking up the threads waiting on it
+ * @param handle Handle of the event
+ */
+Result SignalEvent(Handle handle) {
+    u32 error;
+    Event* event = Kernel::g_object_pool.Get<Event>(handle, error);
+    if (event == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    event->signaled = true;
+    event->WakeupWaitingThreads();
+
+    // A pulse only wakes up the threads that were waiting at the time
+    if (event->reset_type == RESETTYPE_PULSE) {
+        event->signaled = false;
+    }
+    return 0;
+}
+
+/**
+ * Clears an event
+ * @param handle Handle of the event
+ */
+Result ClearEvent(Handle handle) {
+    u32 error;
+    Event* event = Kernel::g_object_pool.Get<Event>(handle, error);
+    if (event == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    event->signaled = false;
+    return 0;
+}
+
+/// Creates an empty event to load a state into
+Object* NewEventObject() {
+    return new Event;
+}
+
+} // namespace
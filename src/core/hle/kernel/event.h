@@ -0,0 +1,37 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/svc.h"
+
+namespace Kernel {
+
+/**
+ * Creates an event, initially cleared
+ * @param reset_type Whether the event clears as it wakes a thread, stays signalled, or only wakes
+ *      the threads already waiting
+ * @return Handle of the event
+ */
+Handle CreateEvent(ResetType reset_type);
+
+/**
+ * Signals an event, waking up the threads waiting on it
+ * @param handle Handle of the event
+ */
+Result SignalEvent(Handle handle);
+
+/**
+ * Clears an event
+ * @param handle Handle of the event
+ */
+Result ClearEvent(Handle handle);
+
+/// Creates an empty event to load a state into
+Object* NewEventObject();
+
+} // namespace
@@ -5,134 +5,413 @@
 #pragma once
 
 #include <string.h>
+#include <vector>
 
 #include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/memory_tracker.h"
+#include "common/slab_allocator.h"
 
 #include "core/core.h"
+#include "core/hle/kernel/address_arbiter.h"
+#include "core/hle/kernel/event.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/mutex.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/semaphore.h"
+#include "core/hle/kernel/shared_memory.h"
 #include "core/hle/kernel/thread.h"
+#include "core/hle/kernel/timer.h"
 
 namespace Kernel {
 
+namespace {
+
+/// Kernel objects come from slabs, so that creating and destroying them doesn't hit the heap
+Common::SlabAllocator g_object_allocator;
+
+} // namespace
+
+void* Object::operator new(size_t size) {
+    Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_KERNEL_OBJECTS, size);
+    return g_object_allocator.Allocate(size);
+}
+
+void Object::operator delete(void* ptr, size_t size) {
+    if (ptr != NULL) {
+        Common::MemoryTracker::Free(Common::MemoryTracker::TAG_KERNEL_OBJECTS, size);
+        g_object_allocator.Free(ptr, size);
+    }
+}
+
+/// Drops a reference, queueing the object for destruction if it was the last one
+void Object::DecRef() {
+    _dbg_assert_(KERNEL, ref_count > 0);
+    if (--ref_count == 0) {
+        g_object_pool.QueueDestroy(this);
+    }
+}
+
+/**
+ * Saves or loads the waiters and the owner of the object. Nothing is stored, both are rebuilt
+ * from the threads once all objects are loaded, see ThreadingDoState.
+ * @param p Savestate the object is written to or read from
+ */
+void WaitObject::DoWaiters(PointerWrap& p) {
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        waiters = WaitQueue();
+        owner = 0;
+    }
+}
+
 ObjectPool g_object_pool;
 
 ObjectPool::ObjectPool() {
-    memset(occupied, 0, sizeof(bool) * MAX_COUNT);
-    next_id = INITIAL_NEXT_ID;
+    memset(slots, 0, sizeof(slots));
+    for (int i = 0; i < MAX_COUNT; i++) {
+        slots[i].generation = 1;
+        slots[i].target = INVALID_INDEX;
+    }
+    free_head = free_tail = INVALID_INDEX;
+    for (int i = INITIAL_NEXT_ID; i < MAX_COUNT; i++) {
+        PushFree(i);
+    }
+    for (int i = 0; i < NUM_HANDLE_TYPES; i++) {
+        type_heads[i] = INVALID_INDEX;
+    }
+    count = 0;
 }
 
-Handle ObjectPool::Create(Object* obj, int range_bottom, int range_top) {
-    if (range_top > MAX_COUNT) {
-        range_top = MAX_COUNT;
+/**
+ * Inserts an object into the table
+ * @param obj Object to insert, the table takes ownership of it
+ * @return Handle of the object, 0 if the table is full
+ */
+Handle ObjectPool::Create(Object* obj) {
+    const u16 index = PopFree();
+    if (index == INVALID_INDEX) {
+        ERROR_LOG(HLE, "Unable to allocate kernel object, too many objects slots in use.");
+        return 0;
     }
-    if (next_id >= range_bottom && next_id < range_top) {
-        range_bottom = next_id++;
+    Slot& slot = slots[index];
+
+    const u32 type = (u32)obj->GetHandleType();
+    _dbg_assert_(KERNEL, type < NUM_HANDLE_TYPES);
+    slot.object = obj;
+    slot.prev = INVALID_INDEX;
+    slot.next = type_heads[type];
+    if (slot.next != INVALID_INDEX) {
+        slots[slot.next].prev = index;
     }
-    for (int i = range_bottom; i < range_top; i++) {
-        if (!occupied[i]) {
-            occupied[i] = true;
-            pool[i] = obj;
-            pool[i]->handle = i + HANDLE_OFFSET;
-            return i + HANDLE_OFFSET;
-        }
+    type_heads[type] = index;
+    count++;
+
+    obj->handle = (slot.generation << GENERATION_SHIFT) | (index + HANDLE_OFFSET);
+    obj->ref_count = 1;
+    return obj->handle;
+}
+
+/**
+ * Creates another handle to the object of a handle, as DuplicateHandle, which holds a
+ * reference of its own until it is closed
+ * @param handle Open handle of the object
+ * @return The new handle, 0 if the handle isn't open or the table is full
+ */
+Handle ObjectPool::Duplicate(Handle handle) {
+    if (!IsOpen(handle)) {
+        return 0;
+    }
+    const u16 index = PopFree();
+    if (index == INVALID_INDEX) {
+        ERROR_LOG(HLE, "Unable to duplicate handle %08x, too many objects slots in use.", handle);
+        return 0;
+    }
+    // Duplicates aren't in the lists of their type, Iterate visits each object once
+    Object* obj = slots[GetIndex(handle)].object;
+    Slot& slot = slots[index];
+    slot.object = obj;
+    slot.target = GetIndex(obj->handle);
+    slot.closed = false;
+    slot.prev = slot.next = INVALID_INDEX;
+    obj->IncRef();
+    return (slot.generation << GENERATION_SHIFT) | (index + HANDLE_OFFSET);
+}
+
+/**
+ * Revokes a handle and drops its reference, as CloseHandle. The handle stops resolving for the
+ * application right away. The object stays valid for the kernel while it holds references to
+ * it, and goes away at the next DestroyPending after the last one. Services and ports stay,
+ * Service::Manager owns them.
+ * @param handle Handle to close
+ * @return ERROR_INVALID_HANDLE if the handle isn't open, else 0
+ */
+Result ObjectPool::Close(Handle handle) {
+    if (!IsOpen(handle)) {
+        return ERROR_INVALID_HANDLE;
+    }
+    Slot& slot = slots[GetIndex(handle)];
+    Object* obj = slot.object;
+    if (obj->GetHandleType() == HandleType::Service || obj->GetHandleType() == HandleType::Port) {
+        return 0;
     }
-    ERROR_LOG(HLE, "Unable to allocate kernel object, too many objects slots in use.");
+    // The kernel goes on finding the object by its own handle, a duplicate's slot is only a handle
+    if (slot.target != INVALID_INDEX) {
+        Release(handle);
+    } else {
+        slot.closed = true;
+    }
+    obj->DecRef();
     return 0;
 }
 
-bool ObjectPool::IsValid(Handle handle) {
-    int index = handle - HANDLE_OFFSET;
-    if (index < 0)
-        return false;
-    if (index >= MAX_COUNT)
-        return false;
+/**
+ * Queues an object that lost its last reference for destruction
+ * @param obj Object, still in its slot
+ */
+void ObjectPool::QueueDestroy(Object* obj) {
+    pending.push_back(obj->handle);
+}
+
+/// Destroys the objects left without references, at a point where nothing points to them
+void ObjectPool::DestroyPending() {
+    // Destructors may drop the references of other objects, which queue them in turn
+    while (!pending.empty()) {
+        const Handle handle = pending.back();
+        pending.pop_back();
+        if (IsValid(handle) && slots[GetIndex(handle)].object->ref_count == 0) {
+            delete Release(handle);
+        }
+    }
+}
+
+/**
+ * Takes a slot off the free list
+ * @return Index of the slot, INVALID_INDEX if the table is full
+ */
+u16 ObjectPool::PopFree() {
+    const u16 index = free_head;
+    if (index != INVALID_INDEX) {
+        free_head = slots[index].next;
+        if (free_head == INVALID_INDEX) {
+            free_tail = INVALID_INDEX;
+        }
+    }
+    return index;
+}
+
+/**
+ * Frees the slot of a valid handle
+ * @param handle Handle to free
+ * @return Object that was in the slot
+ */
+Object* ObjectPool::Release(Handle handle) {
+    const u16 index = GetIndex(handle);
+    Slot& slot = slots[index];
+    Object* obj = slot.object;
+
+    if (slot.target == INVALID_INDEX) {
+        if (slot.prev != INVALID_INDEX) {
+            slots[slot.prev].next = slot.next;
+        } else {
+            type_heads[(u32)obj->GetHandleType()] = slot.next;
+        }
+        if (slot.next != INVALID_INDEX) {
+            slots[slot.next].prev = slot.prev;
+        }
+        count--;
+    }
+    slot.object = NULL;
+    slot.target = INVALID_INDEX;
+    slot.closed = false;
+    slot.generation = slot.generation % MAX_GENERATION + 1;
+    PushFree(index);
+    return obj;
+}
 
-    return occupied[index];
+/// Puts a slot at the end of the free list
+void ObjectPool::PushFree(u16 index) {
+    slots[index].next = INVALID_INDEX;
+    if (free_tail == INVALID_INDEX) {
+        free_head = index;
+    } else {
+        slots[free_tail].next = index;
+    }
+    free_tail = index;
 }
 
 void ObjectPool::Clear() {
+    pending.clear();
+    for (int i = 0; i < MAX_COUNT; i++) {
+        if (slots[i].object != NULL && slots[i].target != INVALID_INDEX) {
+            Release((slots[i].generation << GENERATION_SHIFT) | (i + HANDLE_OFFSET));
+        }
+    }
     for (int i = 0; i < MAX_COUNT; i++) {
         //brutally clear everything, no validation
-        if (occupied[i])
-            delete pool[i];
-        occupied[i] = false;
+        if (slots[i].object != NULL) {
+            delete Release(slots[i].object->handle);
+        }
     }
-    memset(pool, 0, sizeof(Object*)*MAX_COUNT);
-    next_id = INITIAL_NEXT_ID;
 }
 
 Object* &ObjectPool::operator [](Handle handle)
 {
     _dbg_assert_msg_(KERNEL, IsValid(handle), "GRABBING UNALLOCED KERNEL OBJ");
-    return pool[handle - HANDLE_OFFSET];
+    return slots[GetIndex(handle)].object;
 }
 
 void ObjectPool::List() {
     for (int i = 0; i < MAX_COUNT; i++) {
-        if (occupied[i]) {
-            if (pool[i]) {
-                INFO_LOG(KERNEL, "KO %i: %s \"%s\"", i + HANDLE_OFFSET, pool[i]->GetTypeName(), 
-                    pool[i]->GetName());
-            }
+        if (slots[i].object != NULL && slots[i].target == INVALID_INDEX) {
+            INFO_LOG(KERNEL, "KO %08x: %s \"%s\"", slots[i].object->handle,
+                slots[i].object->GetTypeName(), slots[i].object->GetName());
         }
     }
 }
 
 int ObjectPool::GetCount() {
-    int count = 0;
+    return count;
+}
+
+/**
+ * Saves or loads the handle table with the objects in it. Loading keeps the objects already
+ * in the slot they had in the state, such as services, and replaces the others.
+ * @param p Savestate the table is written to or read from
+ */
+void ObjectPool::DoState(PointerWrap& p) {
+    auto s = p.Section("ObjectPool", 10);
+    if (!s) {
+        return;
+    }
+
+    // The duplicates of the running session go first, the objects they point to may be replaced
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        for (int i = 0; i < MAX_COUNT; i++) {
+            if (slots[i].target != INVALID_INDEX) {
+                slots[i].object = NULL;
+            }
+        }
+    }
+
+    // Types first, so that all objects of the state exist before any of them is loaded. The
+    // slots of duplicates are stored as free ones, with the slot they point to.
+    for (int i = 0; i < MAX_COUNT; i++) {
+        u32 type = (slots[i].object != NULL && slots[i].target == INVALID_INDEX) ?
+            (u32)slots[i].object->GetHandleType() : 0;
+        p.Do(type);
+        if (p.GetMode() != PointerWrap::MODE_READ) {
+            continue;
+        }
+        if (slots[i].object != NULL && (u32)slots[i].object->GetHandleType() != type) {
+            delete slots[i].object;
+            slots[i].object = NULL;
+        }
+        if (slots[i].object == NULL && type != (u32)HandleType::Unknown) {
+            slots[i].object = CreateByIDType(type);
+            if (slots[i].object == NULL) {
+                p.SetError(PointerWrap::ERROR_FAILURE);
+                return;
+            }
+        }
+    }
+
     for (int i = 0; i < MAX_COUNT; i++) {
-        if (occupied[i])
-            count++;
+        p.Do(slots[i].generation);
+        p.Do(slots[i].next);
+        p.Do(slots[i].prev);
+        p.Do(slots[i].target);
+        p.Do(slots[i].closed);
+    }
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        for (int i = 0; i < MAX_COUNT; i++) {
+            if (slots[i].target != INVALID_INDEX) {
+                slots[i].object = slots[slots[i].target].object;
+            }
+        }
+    }
+    p.Do(free_head);
+    p.Do(free_tail);
+    p.DoArray(type_heads, NUM_HANDLE_TYPES);
+    p.Do(count);
+
+    // Objects left without references are destroyed after the load, as they would have been
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        pending.clear();
+    }
+    for (int i = 0; i < MAX_COUNT; i++) {
+        if (slots[i].object != NULL && slots[i].target == INVALID_INDEX) {
+            slots[i].object->handle = (slots[i].generation << GENERATION_SHIFT) |
+                (i + HANDLE_OFFSET);
+            p.Do(slots[i].object->ref_count);
+            if (p.GetMode() == PointerWrap::MODE_READ && slots[i].object->ref_count == 0) {
+                pending.push_back(slots[i].object->handle);
+            }
+        }
+    }
+    for (int i = 0; i < MAX_COUNT; i++) {
+        if (slots[i].object != NULL && slots[i].target == INVALID_INDEX) {
+            slots[i].object->DoState(p);
+        }
     }
-    return count;
 }
 
+/**
+ * Creates an empty object to load a state into
+ * @param type Handle type of the object
+ * @return Object, NULL if objects of the type can't be created this way
+ */
 Object* ObjectPool::CreateByIDType(int type) {
-    // Used for save states.  This is ugly, but what other way is there?
-    switch (type) {
-    //case SCE_KERNEL_TMID_Alarm:
-    //    return __KernelAlarmObject();
-    //case SCE_KERNEL_TMID_EventFlag:
-    //    return __KernelEventFlagObject();
-    //case SCE_KERNEL_TMID_Mbox:
-    //    return __KernelMbxObject();
-    //case SCE_KERNEL_TMID_Fpl:
-    //    return __KernelMemoryFPLObject();
-    //case SCE_KERNEL_TMID_Vpl:
-    //    return __KernelMemoryVPLObject();
-    //case PPSSPP_KERNEL_TMID_PMB:
-    //    return __KernelMemoryPMBObject();
-    //case PPSSPP_KERNEL_TMID_Module:
-    //    return __KernelModuleObject();
-    //case SCE_KERNEL_TMID_Mpipe:
-    //    return __KernelMsgPipeObject();
-    //case SCE_KERNEL_TMID_Mutex:
-    //    return __KernelMutexObject();
-    //case SCE_KERNEL_TMID_LwMutex:
-    //    return __KernelLwMutexObject();
-    //case SCE_KERNEL_TMID_Semaphore:
-    //    return __KernelSemaphoreObject();
-    //case SCE_KERNEL_TMID_Callback:
-    //    return __KernelCallbackObject();
-    //case SCE_KERNEL_TMID_Thread:
-    //    return __KernelThreadObject();
-    //case SCE_KERNEL_TMID_VTimer:
-    //    return __KernelVTimerObject();
-    //case SCE_KERNEL_TMID_Tlspl:
-    //    return __KernelTlsplObject();
-    //case PPSSPP_KERNEL_TMID_File:
-    //    return __KernelFileNodeObject();
-    //case PPSSPP_KERNEL_TMID_DirList:
-    //    return __KernelDirListingObject();
+    switch ((HandleType)type) {
+    case HandleType::Arbiter:
+        return NewAddressArbiterObject();
+    case HandleType::Event:
+        return NewEventObject();
+    case HandleType::Mutex:
+        return NewMutexObject();
+    case HandleType::Process:
+        return NewProcessObject();
+    case HandleType::Semaphore:
+        return NewSemaphoreObject();
+    case HandleType::SharedMemory:
+        return NewSharedMemoryObject();
+    case HandleType::Thread:
+        return NewThreadObject();
+    case HandleType::Timer:
+        return NewTimerObject();
 
+    // Services are only created by Service::Init, a state can't bring in a service that the
+    // running session doesn't have
+    default:
+        ERROR_LOG(KERNEL, "Unable to load state: could not create object of type %d.", type);
+        return NULL;
+    }
+}
+
+/**
+ * Gets an object threads can wait on
+ * @param handle Handle of the object
+ * @return The object, NULL if the handle isn't that of an event, mutex, semaphore, thread or timer
+ */
+WaitObject* GetWaitObject(Handle handle) {
+    if (!g_object_pool.IsValid(handle)) {
+        return NULL;
+    }
+    Object* obj = g_object_pool[handle];
+    switch (obj->GetHandleType()) {
+    case HandleType::Event:
+    case HandleType::Mutex:
+    case HandleType::Semaphore:
+    case HandleType::Thread:
+    case HandleType::Timer:
+        return static_cast<WaitObject*>(obj);
     default:
-        ERROR_LOG(COMMON, "Unable to load state: could not find object type %d.", type);
         return NULL;
     }
 }
 
 void Init() {
     Kernel::ThreadingInit();
+    Kernel::TimersInit();
 }
 
 void Shutdown() {
@@ -149,10 +428,22 @@ bool LoadExec(u32 entry_point) {
     
     Core::g_app_core->SetPC(entry_point);
 
+    // The application is the first process, its threads run in the memory the loader mapped
+    SetCurrentProcess(CreateProcess("application"));
+
     // 0x30 is the typical main thread priority I've seen used so far
     Handle thread = Kernel::SetupMainThread(0x30);
 
     return true;
 }
 
+/**
+ * Saves or loads the state of the kernel: the objects and the scheduler
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    g_object_pool.DoState(p);
+    ThreadingDoState(p);
+}
+
 } // namespace
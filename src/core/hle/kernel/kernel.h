@@ -4,11 +4,15 @@
 
 #pragma once
 
+#include <vector>
+
 #include "common/common.h"
 
 typedef u32 Handle;
 typedef s32 Result;
 
+class PointerWrap;
+
 namespace Kernel {
 
 enum class HandleType : u32 {
@@ -24,6 +28,7 @@ enum class HandleType : u32 {
     Arbiter         = 9,
     File            = 10,
     Semaphore       = 11,
+    Timer           = 12,
 };
     
 enum {
@@ -31,47 +36,272 @@ enum {
     DEFAULT_STACK_SIZE  = 0x4000,
 };
 
+/// Results of the kernel calls, as the 3DS returns them
+enum {
+    RESULT_WAIT_TIMEOUT         = 0x09401BFE,   ///< WaitSynchronization timed out
+    ERROR_INVALID_HANDLE        = 0xD8E007F7,   ///< Not the handle of an object of the type
+    ERROR_OUT_OF_RANGE          = 0xD8E007FD,   ///< Count beyond what the object allows
+    ERROR_INVALID_ENUM_VALUE    = 0xD8E093ED,   ///< Unknown operation
+    ERROR_OUT_OF_MEMORY         = 0xD86007F3,   ///< No room left for an allocation
+    ERROR_INVALID_ADDRESS       = 0xE0E01BF5,   ///< Range that isn't mapped or that is taken
+};
+
 class ObjectPool;
 
+/**
+ * Kernel object. Objects are reference counted: the handle the object is created with is one
+ * reference, which CloseHandle drops, and the kernel takes more while it uses the object, as
+ * threads waiting on it or holding it. The last reference going away doesn't destroy the object
+ * right away, ObjectPool::DestroyPending does at the next reschedule, when no SVC or callback
+ * can be running with a pointer to it.
+ */
 class Object : NonCopyable {
     friend class ObjectPool;
     u32 handle;
+    u32 ref_count;  ///< References to the object, the object is queued for destruction at 0
 public:
     virtual ~Object() {}
     Handle GetHandle() const { return handle; }
     virtual const char *GetTypeName() { return "[BAD KERNEL OBJECT TYPE]"; }
     virtual const char *GetName() { return "[UNKNOWN KERNEL OBJECT]"; }
     virtual Kernel::HandleType GetHandleType() const = 0;
+
+    /// Takes a reference to the object, for as long as the kernel uses it beyond the current call
+    void IncRef() {
+        ref_count++;
+    }
+
+    /// Drops a reference, queueing the object for destruction if it was the last one
+    void DecRef();
+
+    /**
+     * Saves or loads the state of the object. Objects refer to each other by handle in states,
+     * all objects of a state exist by the time any of them is loaded.
+     * @param p Savestate the state is written to or read from
+     */
+    virtual void DoState(PointerWrap& p) = 0;
+
+    /// Kernel objects are carved out of slabs, see Common::SlabAllocator, and accounted to
+    /// Common::MemoryTracker::TAG_KERNEL_OBJECTS
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
+};
+
+class Thread;
+class WaitObject;
+struct WaitQueue;
+
+/// Link of a thread into the wait queue of one of the objects it waits on
+struct WaitLink {
+    Thread*     thread;
+    WaitObject* object;     ///< NULL for a queue of an address arbiter
+    WaitQueue*  queue;      ///< Queue the link is in
+    WaitLink*   prev;
+    WaitLink*   next;
+};
+
+/**
+ * Intrusive list of the threads waiting on a kernel object, by priority and then in the order
+ * they started waiting, so the thread to resume first is always at the front
+ */
+struct WaitQueue {
+    WaitQueue() : first(NULL), last(NULL) {
+    }
+    bool empty() const {
+        return first == NULL;
+    }
+
+    /**
+     * Adds a link to the queue
+     * @param after Link to insert after, NULL to insert at the front
+     * @param link Link to insert
+     */
+    void InsertAfter(WaitLink* after, WaitLink* link) {
+        link->prev = after;
+        link->next = (after != NULL) ? after->next : first;
+        if (link->next != NULL) {
+            link->next->prev = link;
+        } else {
+            last = link;
+        }
+        if (after != NULL) {
+            after->next = link;
+        } else {
+            first = link;
+        }
+    }
+
+    /// Removes a link that is in the queue
+    void Remove(WaitLink* link) {
+        if (link->prev != NULL) {
+            link->prev->next = link->next;
+        } else {
+            first = link->next;
+        }
+        if (link->next != NULL) {
+            link->next->prev = link->prev;
+        } else {
+            last = link->prev;
+        }
+        link->prev = link->next = NULL;
+    }
+
+    WaitLink* first;    ///< Best priority thread that has waited the longest, checked first
+    WaitLink* last;     ///< Worst priority thread that started waiting last
+};
+
+/**
+ * Kernel object that threads can wait on with WaitSynchronization. A thread waits as long as
+ * ShouldWait says so, and acquires the object when its wait completes, which locks a mutex or
+ * takes a count of a semaphore. Objects call WakeupWaitingThreads whenever they may have become
+ * available, so waiting threads resume exactly then and never poll. An object a thread holds,
+ * a locked mutex, has the thread as its owner, which inherits the priority of its best waiter.
+ */
+class WaitObject : public Object {
+public:
+    WaitObject() : owner(0) {
+    }
+
+    /**
+     * Whether a thread has to wait for the object
+     * @param thread Handle of the thread that would acquire the object, 0 for one that holds
+     *      nothing, which tells whether the object is available at all
+     */
+    virtual bool ShouldWait(Handle thread) = 0;
+
+    /**
+     * Acquires the object for a thread, which ShouldWait allowed
+     * @param thread Handle of the thread acquiring the object
+     */
+    virtual void Acquire(Handle thread) = 0;
+
+    /// Resumes the waiting threads whose wait the object completes, best priority first
+    void WakeupWaitingThreads();
+
+    /**
+     * Saves or loads the waiters and the owner of the object. Nothing is stored, both are rebuilt
+     * from the threads once all objects are loaded, see ThreadingDoState.
+     * @param p Savestate the object is written to or read from
+     */
+    void DoWaiters(PointerWrap& p);
+
+    WaitQueue waiters;  ///< Threads waiting on the object
+    Handle owner;       ///< Thread holding the object, 0 if none, see SetObjectOwner
 };
 
+/**
+ * Gets an object threads can wait on
+ * @param handle Handle of the object
+ * @return The object, NULL if the handle isn't that of an event, mutex, semaphore, thread or timer
+ */
+WaitObject* GetWaitObject(Handle handle);
+
+/**
+ * Handle table of the kernel objects. A handle holds the index of its slot in the table plus the
+ * generation of the slot, which is bumped every time the slot is freed, so a handle that outlives
+ * its object is caught by a single compare instead of silently resolving to whatever object
+ * reused the slot. Free slots form a FIFO list, which makes Create and Destroy O(1) and delays
+ * reuse of a slot for as long as possible. Live objects are also linked into one list per handle
+ * type, so Iterate only visits objects of the requested type.
+ *
+ * The slot an object is created in is its own, the kernel refers to the object by that handle for
+ * as long as the object lives. DuplicateHandle gives the object more slots, each one a handle and
+ * a reference of its own. Closing a handle revokes it for the application: a duplicate's slot is
+ * freed, while the object's own slot is marked closed and only resolves for the kernel, through
+ * its references, until the object goes away. Handles that come from the application are checked
+ * with IsOpen.
+ */
 class ObjectPool : NonCopyable {
+    friend class Object;
 public:
     ObjectPool();
     ~ObjectPool() {}
 
-    // Allocates a handle within the range and inserts the object into the map.
-    Handle Create(Object* obj, int range_bottom=INITIAL_NEXT_ID, int range_top=0x7FFFFFFF);
+    /**
+     * Inserts an object into the table
+     * @param obj Object to insert, the table takes ownership of it
+     * @return Handle of the object, 0 if the table is full
+     */
+    Handle Create(Object* obj);
 
+    /**
+     * Creates an empty object to load a state into
+     * @param type Handle type of the object
+     * @return Object, NULL if objects of the type can't be created this way
+     */
     static Object* CreateByIDType(int type);
 
+    /**
+     * Drops the reference of a handle to an object of a type, see Close
+     * @param handle Handle of the object
+     * @return 0
+     */
     template <class T>
     u32 Destroy(Handle handle) {
         u32 error;
         if (Get<T>(handle, error)) {
-            occupied[handle - HANDLE_OFFSET] = false;
-            delete pool[handle - HANDLE_OFFSET];
+            Close(handle);
         }
         return error;
     };
 
-    bool IsValid(Handle handle);
+    /**
+     * Creates another handle to the object of a handle, as DuplicateHandle, which holds a
+     * reference of its own until it is closed
+     * @param handle Open handle of the object
+     * @return The new handle, 0 if the handle isn't open or the table is full
+     */
+    Handle Duplicate(Handle handle);
+
+    /**
+     * Revokes a handle and drops its reference, as CloseHandle. The handle stops resolving for the
+     * application right away. The object stays valid for the kernel while it holds references to
+     * it, and goes away at the next DestroyPending after the last one. Services and ports stay,
+     * Service::Manager owns them.
+     * @param handle Handle to close
+     * @return ERROR_INVALID_HANDLE if the handle isn't open, else 0
+     */
+    Result Close(Handle handle);
+
+    /// Destroys the objects left without references, at a point where nothing points to them
+    void DestroyPending();
+
+    bool IsValid(Handle handle) const {
+        const u32 index = GetIndex(handle);
+        return index < MAX_COUNT && slots[index].object != NULL &&
+            slots[index].generation == GetGeneration(handle);
+    }
+
+    /**
+     * Whether a handle the application passes is one it may use, valid and not closed
+     * @param handle Handle to check
+     */
+    bool IsOpen(Handle handle) const {
+        return IsValid(handle) && !slots[GetIndex(handle)].closed;
+    }
+
+    /**
+     * Gets the handle the kernel keeps for the object of a handle the application passes, which
+     * stays valid as long as the object however the application closes its handles
+     * @param handle Handle to resolve
+     * @return The object's own handle, 0 if the handle isn't open
+     */
+    Handle Resolve(Handle handle) const {
+        return IsOpen(handle) ? slots[GetIndex(handle)].object->GetHandle() : 0;
+    }
 
     template <class T>
     T* Get(Handle handle, u32& outError) {
-        if (handle < HANDLE_OFFSET || handle >= HANDLE_OFFSET + MAX_COUNT || !occupied[handle - HANDLE_OFFSET]) {
+        if (!IsValid(handle)) {
             // Tekken 6 spams 0x80020001 gets wrong with no ill effects, also on the real PSP
             if (handle != 0 && (u32)handle != 0x80020001) {
-                WARN_LOG(KERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
+                if (GetIndex(handle) < MAX_COUNT && slots[GetIndex(handle)].object != NULL) {
+                    LOG_EVERY_N(WARNING, KERNEL, 100, "Kernel: Stale object handle %i (%08x)", handle,
+                        handle);
+                } else {
+                    LOG_EVERY_N(WARNING, KERNEL, 100, "Kernel: Bad object handle %i (%08x)", handle,
+                        handle);
+                }
             }
             outError = 0;//T::GetMissingErrorCode();
             return 0;
@@ -79,8 +309,8 @@ public:
             // Previously we had a dynamic_cast here, but since RTTI was disabled traditionally,
             // it just acted as a static case and everything worked. This means that we will never
             // see the Wrong type object error below, but we'll just have to live with that danger.
-            T* t = static_cast<T*>(pool[handle - HANDLE_OFFSET]);
-            if (t == 0 || t->GetHandleType() != T::GetStaticHandleType()) {
+            T* t = static_cast<T*>(slots[GetIndex(handle)].object);
+            if (t->GetHandleType() != T::GetStaticHandleType()) {
                 WARN_LOG(KERNEL, "Kernel: Wrong object type for %i (%08x)", handle, handle);
                 outError = 0;//T::GetMissingErrorCode();
                 return 0;
@@ -93,38 +323,43 @@ public:
     // ONLY use this when you know the handle is valid.
     template <class T>
     T *GetFast(Handle handle) {
-        const Handle realHandle = handle - HANDLE_OFFSET;
-        _dbg_assert_(KERNEL, realHandle >= 0 && realHandle < MAX_COUNT && occupied[realHandle]);
-        return static_cast<T*>(pool[realHandle]);
+        _dbg_assert_(KERNEL, IsValid(handle));
+        return static_cast<T*>(slots[GetIndex(handle)].object);
     }
 
+    /**
+     * Calls a function for every live object of a type, until it returns false. The function may
+     * destroy the object it is given, but no other object of the type.
+     */
     template <class T, typename ArgT>
     void Iterate(bool func(T*, ArgT), ArgT arg) {
-        int type = T::GetStaticIDType();
-        for (int i = 0; i < MAX_COUNT; i++)
-        {
-            if (!occupied[i])
-                continue;
-            T* t = static_cast<T*>(pool[i]);
-            if (t->GetIDType() == type) {
-                if (!func(t, arg))
-                    break;
-            }
+        u16 i = type_heads[(u32)T::GetStaticHandleType()];
+        while (i != INVALID_INDEX) {
+            const u16 next = slots[i].next;
+            if (!func(static_cast<T*>(slots[i].object), arg))
+                break;
+            i = next;
         }
     }
 
     bool GetIDType(Handle handle, HandleType* type) const {
-        if ((handle < HANDLE_OFFSET) || (handle >= HANDLE_OFFSET + MAX_COUNT) || 
-            !occupied[handle - HANDLE_OFFSET]) {
+        if (!IsValid(handle)) {
             ERROR_LOG(KERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
             return false;
         }
-        Object* t = pool[handle - HANDLE_OFFSET];
-        *type = t->GetHandleType();
+        *type = slots[GetIndex(handle)].object->GetHandleType();
         return true;
     }
 
     Object* &operator [](Handle handle);
+
+    /**
+     * Saves or loads the handle table with the objects in it. Loading keeps the objects already
+     * in the slot they had in the state, such as services, and replaces the others.
+     * @param p Savestate the table is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
     void List();
     void Clear();
     int GetCount();
@@ -132,14 +367,60 @@ public:
 private:
     
     enum {
-        MAX_COUNT       = 0x1000,
-        HANDLE_OFFSET   = 0x100,
-        INITIAL_NEXT_ID = 0x10,
+        MAX_COUNT           = 0x1000,
+        HANDLE_OFFSET       = 0x100,
+        INITIAL_NEXT_ID     = 0x10,     ///< Slots below this one are never handed out
+        GENERATION_SHIFT    = 16,
+        MAX_GENERATION      = 0x7FFF,   ///< Keeps bit 31 of handles clear
+        NUM_HANDLE_TYPES    = 13,
+        INVALID_INDEX       = 0xFFFF,
     };
 
-    Object* pool[MAX_COUNT];
-    bool    occupied[MAX_COUNT];
-    int     next_id;
+    struct Slot {
+        Object* object;     ///< Object in the slot, NULL if the slot is free
+        u16     generation; ///< Generation of the handle of the current or next object
+        u16     next;       ///< Next free slot, or next object of the same type
+        u16     prev;       ///< Previous object of the same type
+        u16     target;     ///< Own slot of the object of a duplicate, INVALID_INDEX otherwise
+        bool    closed;     ///< Whether the application closed the object's own handle
+    };
+
+    static u32 GetIndex(Handle handle) {
+        return (handle & ((1 << GENERATION_SHIFT) - 1)) - HANDLE_OFFSET;
+    }
+
+    static u32 GetGeneration(Handle handle) {
+        return handle >> GENERATION_SHIFT;
+    }
+
+    /**
+     * Takes a slot off the free list
+     * @return Index of the slot, INVALID_INDEX if the table is full
+     */
+    u16 PopFree();
+
+    /**
+     * Frees the slot of a valid handle
+     * @param handle Handle to free
+     * @return Object that was in the slot
+     */
+    Object* Release(Handle handle);
+
+    /// Puts a slot at the end of the free list
+    void PushFree(u16 index);
+
+    /**
+     * Queues an object that lost its last reference for destruction
+     * @param obj Object, still in its slot
+     */
+    void QueueDestroy(Object* obj);
+
+    Slot    slots[MAX_COUNT];
+    u16     free_head;                      ///< Slot handed out next
+    u16     free_tail;                      ///< Slot freed last
+    u16     type_heads[NUM_HANDLE_TYPES];   ///< First live object of each handle type
+    int     count;                          ///< Number of live objects
+    std::vector<Handle> pending;            ///< Objects without references, see DestroyPending
 };
 
 extern ObjectPool g_object_pool;
@@ -151,4 +432,10 @@ extern ObjectPool g_object_pool;
  */
 bool LoadExec(u32 entry_point);
 
+/**
+ * Saves or loads the state of the kernel: the objects and the scheduler
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -2,87 +2,55 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.  
 
-#include <map>
-#include <vector>
-
 #include "common/common.h"
+#include "common/chunk_file.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/mutex.h"
 #include "core/hle/kernel/thread.h"
 
 namespace Kernel {
 
-class Mutex : public Object {
+class Mutex : public WaitObject {
 public:
     const char* GetTypeName() { return "Mutex"; }
 
     static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Mutex; }
     Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Mutex; }
 
-    bool initial_locked;                        ///< Initial lock state when mutex was created
-    bool locked;                                ///< Current locked state
-    Handle lock_thread;                         ///< Handle to thread that currently has mutex
-    std::vector<Handle> waiting_threads;        ///< Threads that are waiting for the mutex
-};
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-typedef std::multimap<Handle, Handle> MutexMap;
-static MutexMap g_mutex_held_locks;
-
-void MutexAcquireLock(Mutex* mutex, Handle thread) {
-    g_mutex_held_locks.insert(std::make_pair(thread, mutex->GetHandle()));
-    mutex->lock_thread = thread;
-}
-
-void MutexAcquireLock(Mutex* mutex) {
-    Handle thread = GetCurrentThreadHandle();
-    MutexAcquireLock(mutex, thread);
-}
+    bool ShouldWait(Handle thread) {
+        return locked && owner != thread;
+    }
 
-void MutexEraseLock(Mutex* mutex) {
-    Handle handle = mutex->GetHandle();
-    auto locked = g_mutex_held_locks.equal_range(mutex->lock_thread);
-    for (MutexMap::iterator iter = locked.first; iter != locked.second; ++iter) {
-        if ((*iter).second == handle) {
-            g_mutex_held_locks.erase(iter);
-            break;
+    void Acquire(Handle thread) {
+        if (!locked) {
+            locked = true;
+            SetObjectOwner(this, thread);
         }
     }
-    mutex->lock_thread = -1;
-}
 
-bool LockMutex(Mutex* mutex) {
-    // Mutex alread locked?
-    if (mutex->locked) {
-        return false;
+    void DoState(PointerWrap& p) {
+        p.Do(initial_locked);
+        p.Do(locked);
+        DoWaiters(p);
     }
-    MutexAcquireLock(mutex);
-    return true;
-}
 
-bool ReleaseMutexForThread(Mutex* mutex, Handle thread) {
-    MutexAcquireLock(mutex, thread);
-    Kernel::ResumeThreadFromWait(thread);
-    return true;
-}
+    bool initial_locked;                        ///< Initial lock state when mutex was created
+    bool locked;                                ///< Current locked state, owner holds it
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Releases a mutex, handing it straight to its best waiter if any
+ * @param mutex Mutex to release
+ * @return Whether the mutex is locked again by a waiter
+ */
 bool ReleaseMutex(Mutex* mutex) {
-    MutexEraseLock(mutex);
-    bool woke_threads = false;
-    auto iter = mutex->waiting_threads.begin();
-
-    // Find the next waiting thread for the mutex...
-    while (!woke_threads && !mutex->waiting_threads.empty()) {
-        woke_threads |= ReleaseMutexForThread(mutex, *iter);
-        mutex->waiting_threads.erase(iter);
-    }
-    // Reset mutex lock thread handle, nothing is waiting
-    if (!woke_threads) {
-        mutex->locked = false;
-        mutex->lock_thread = -1;
-    }
-    return woke_threads;
+    mutex->locked = false;
+    SetObjectOwner(mutex, 0);
+    mutex->WakeupWaitingThreads();
+    return mutex->locked;
 }
 
 /**
@@ -110,11 +78,7 @@ Mutex* CreateMutex(Handle& handle, bool initial_locked) {
 
     // Acquire mutex with current thread if initialized as locked...
     if (mutex->locked) {
-        MutexAcquireLock(mutex);
-
-    // Otherwise, reset lock thread handle
-    } else {
-        mutex->lock_thread = -1;
+        SetObjectOwner(mutex, GetCurrentThreadHandle());
     }
     return mutex;
 }
@@ -129,4 +93,20 @@ Handle CreateMutex(bool initial_locked) {
     return handle;
 }
 
+/// Creates an empty mutex to load a state into
+Object* NewMutexObject() {
+    return new Mutex;
+}
+
+/**
+ * Releases the mutexes a thread holds, as it exits
+ * @param thread Handle of the thread
+ */
+void ReleaseThreadMutexes(Handle thread) {
+    // Only mutexes are ever held
+    while (WaitObject* object = GetFirstHeldObject(thread)) {
+        ReleaseMutex(static_cast<Mutex*>(object));
+    }
+}
+
 } // namespace
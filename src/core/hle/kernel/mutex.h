@@ -23,4 +23,13 @@ Result ReleaseMutex(Handle handle);
  */
 Handle CreateMutex(bool initial_locked);
 
+/// Creates an empty mutex to load a state into
+Object* NewMutexObject();
+
+/**
+ * Releases the mutexes a thread holds, as it exits
+ * @param thread Handle of the thread
+ */
+void ReleaseThreadMutexes(Handle thread);
+
 } // namespace
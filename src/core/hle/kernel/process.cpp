@@ -0,0 +1,139 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/mem_map.h"
+#include "core/sys_core.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/process.h"
+
+namespace Kernel {
+
+class Process : public Object {
+public:
+    Process() : address_space(NULL), owns_address_space(false) {
+    }
+    ~Process();
+
+    const char* GetName() { return name; }
+    const char* GetTypeName() { return "Process"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Process; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Process; }
+
+    void DoState(PointerWrap& p);
+
+    char name[Kernel::MAX_NAME_LENGTH + 1];
+    Memory::AddressSpace* address_space;    ///< Page table and memory areas of the process
+    bool owns_address_space;                ///< False for the boot one, which Memory keeps
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static Handle g_current_process = 0;    ///< Process whose address space is current
+static bool g_switch_pending = false;   ///< The switch to it waits for the sync point
+
+Process::~Process() {
+    if (g_current_process == GetHandle()) {
+        SetCurrentProcess(0);
+    }
+    if (owns_address_space) {
+        Memory::DestroyAddressSpace(address_space);
+    }
+}
+
+void Process::DoState(PointerWrap& p) {
+    p.DoArray(name, Kernel::MAX_NAME_LENGTH + 1);
+
+    // The pages are mapped as the process was created, only the areas change afterwards
+    const bool owned = owns_address_space;
+    p.Do(owns_address_space);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        if (owns_address_space && !owned) {
+            address_space = Memory::CreateAddressSpace();
+        } else if (!owns_address_space) {
+            if (owned) {
+                Memory::DestroyAddressSpace(address_space);
+            }
+            address_space = Memory::GetBootAddressSpace();
+        }
+    }
+    if (owns_address_space) {
+        Memory::DoAreas(p, address_space);
+    }
+}
+
+/// Whether a process has the boot address space, for Iterate
+static bool HasBootAddressSpace(Process* process, bool* found) {
+    *found = !process->owns_address_space;
+    return !*found;
+}
+
+/**
+ * Creates a process, whose threads run in an address space of its own. The first process takes
+ * the boot address space, which the loader mapped the application into, the others get one
+ * mapped as a fresh process is.
+ * @param name Name of the process, for logs
+ * @return Handle of the process, 0 if the handle table is full
+ */
+Handle CreateProcess(const char* name) {
+    bool boot_space_taken = false;
+    Kernel::g_object_pool.Iterate<Process, bool*>(HasBootAddressSpace, &boot_space_taken);
+
+    Process* process = new Process;
+    strncpy(process->name, name, Kernel::MAX_NAME_LENGTH);
+    process->name[Kernel::MAX_NAME_LENGTH] = '\0';
+    process->owns_address_space = boot_space_taken;
+    process->address_space = boot_space_taken ? Memory::CreateAddressSpace() :
+        Memory::GetBootAddressSpace();
+
+    const Handle handle = Kernel::g_object_pool.Create(process);
+    if (handle == 0) {
+        delete process;
+    }
+    return handle;
+}
+
+/// Gets the handle of the process whose address space is current, 0 before the first process
+Handle GetCurrentProcessHandle() {
+    return g_current_process;
+}
+
+/**
+ * Makes a process the current one, switching to its address space. Only the page table pointer
+ * changes, no memory is copied. While a slice runs the sys core thread goes through the page
+ * table, so the switch waits for the sync point then, see SyncCurrentProcess. The app core only
+ * switches threads between slices, it doesn't run code of the new process before.
+ * @param handle Handle of the process, 0 for the boot address space
+ */
+void SetCurrentProcess(Handle handle) {
+    u32 error;
+    Process* process = (handle != 0) ? Kernel::g_object_pool.Get<Process>(handle, error) : NULL;
+    g_current_process = (process != NULL) ? handle : 0;
+    if (SysCore::IsSliceRunning()) {
+        g_switch_pending = true;
+        return;
+    }
+    g_switch_pending = false;
+    Memory::SetAddressSpace((process != NULL) ? process->address_space : NULL);
+}
+
+/// Switches to the address space of the current process if SetCurrentProcess left it to the sync
+/// point. Called by the app core thread once the sys core finished its slice.
+void SyncCurrentProcess() {
+    if (g_switch_pending) {
+        SetCurrentProcess(g_current_process);
+    }
+}
+
+/// Creates an empty process to load a state into
+Object* NewProcessObject() {
+    return new Process;
+}
+
+} // namespace
@@ -0,0 +1,41 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace Kernel {
+
+/**
+ * Creates a process, whose threads run in an address space of its own. The first process takes
+ * the boot address space, which the loader mapped the application into, the others get one
+ * mapped as a fresh process is.
+ * @param name Name of the process, for logs
+ * @return Handle of the process, 0 if the handle table is full
+ */
+Handle CreateProcess(const char* name);
+
+/// Gets the handle of the process whose address space is current, 0 before the first process
+Handle GetCurrentProcessHandle();
+
+/**
+ * Makes a process the current one, switching to its address space. Only the page table pointer
+ * changes, no memory is copied. While a slice runs the sys core thread goes through the page
+ * table, so the switch waits for the sync point then, see SyncCurrentProcess. The app core only
+ * switches threads between slices, it doesn't run code of the new process before.
+ * @param handle Handle of the process, 0 for the boot address space
+ */
+void SetCurrentProcess(Handle handle);
+
+/// Switches to the address space of the current process if SetCurrentProcess left it to the sync
+/// point. Called by the app core thread once the sys core finished its slice.
+void SyncCurrentProcess();
+
+/// Creates an empty process to load a state into
+Object* NewProcessObject();
+
+} // namespace
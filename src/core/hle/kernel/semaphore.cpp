@@ -0,0 +1,87 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/semaphore.h"
+#include "core/hle/kernel/thread.h"
+
+namespace Kernel {
+
+class Semaphore : public WaitObject {
+public:
+    const char* GetTypeName() { return "Semaphore"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Semaphore; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Semaphore; }
+
+    bool ShouldWait(Handle thread) {
+        return available_count <= 0;
+    }
+
+    void Acquire(Handle thread) {
+        // A wait on all of several handles may name the semaphore twice
+        if (available_count > 0) {
+            available_count--;
+        }
+    }
+
+    void DoState(PointerWrap& p) {
+        p.Do(max_count);
+        p.Do(available_count);
+        DoWaiters(p);
+    }
+
+    s32 max_count;                              ///< Count the semaphore can't be released beyond
+    s32 available_count;                        ///< Times it can be acquired without waiting
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Creates a semaphore
+ * @param handle Set to the handle of the semaphore
+ * @param initial_count Number of times the semaphore can be acquired before waits block
+ * @param max_count Count the semaphore can't be released beyond
+ */
+Result CreateSemaphore(Handle* handle, s32 initial_count, s32 max_count) {
+    if (initial_count < 0 || max_count < 0 || initial_count > max_count) {
+        return ERROR_OUT_OF_RANGE;
+    }
+    Semaphore* semaphore = new Semaphore;
+    semaphore->max_count = max_count;
+    semaphore->available_count = initial_count;
+    *handle = Kernel::g_object_pool.Create(semaphore);
+    return 0;
+}
+
+/**
+ * Releases a semaphore, waking up as many waiting threads as the count allows
+ * @param count Set to the count of the semaphore before the release
+ * @param handle Handle of the semaphore
+ * @param release_count Number added to the count
+ */
+Result ReleaseSemaphore(s32* count, Handle handle, s32 release_count) {
+    u32 error;
+    Semaphore* semaphore = Kernel::g_object_pool.Get<Semaphore>(handle, error);
+    if (semaphore == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    if (release_count < 0 || release_count > semaphore->max_count - semaphore->available_count) {
+        return ERROR_OUT_OF_RANGE;
+    }
+    *count = semaphore->available_count;
+    semaphore->available_count += release_count;
+    semaphore->WakeupWaitingThreads();
+    return 0;
+}
+
+/// Creates an empty semaphore to load a state into
+Object* NewSemaphoreObject() {
+    return new Semaphore;
+}
+
+} // namespace
@@ -0,0 +1,32 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace Kernel {
+
+/**
+ * Creates a semaphore
+ * @param handle Set to the handle of the semaphore
+ * @param initial_count Number of times the semaphore can be acquired before waits block
+ * @param max_count Count the semaphore can't be released beyond
+ */
+Result CreateSemaphore(Handle* handle, s32 initial_count, s32 max_count);
+
+/**
+ * Releases a semaphore, waking up as many waiting threads as the count allows
+ * @param count Set to the count of the semaphore before the release
+ * @param handle Handle of the semaphore
+ * @param release_count Number added to the count
+ */
+Result ReleaseSemaphore(s32* count, Handle handle, s32 release_count);
+
+/// Creates an empty semaphore to load a state into
+Object* NewSemaphoreObject();
+
+} // namespace
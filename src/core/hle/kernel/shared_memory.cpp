@@ -0,0 +1,92 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/mem_map.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/shared_memory.h"
+
+namespace Kernel {
+
+class SharedMemory : public Object {
+public:
+    const char* GetTypeName() { return "SharedMemory"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::SharedMemory; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::SharedMemory; }
+
+    void DoState(PointerWrap& p) {
+        p.Do(size);
+        p.Do(base_address);
+        p.Do(permissions);
+    }
+
+    u32 size;                                   ///< Size of the block in bytes, page aligned
+    u32 base_address;                           ///< Where the block was first mapped, 0 if it
+                                                ///< wasn't; its pages back the block
+    u32 permissions;                            ///< Of the application on the block
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Creates a block of shared memory, which a service hands to the application to map with
+ * MapMemoryBlock
+ * @param size Size of the block in bytes
+ * @return Handle of the shared memory
+ */
+Handle CreateSharedMemory(u32 size) {
+    SharedMemory* shared_memory = new SharedMemory;
+    shared_memory->size = (size + Memory::PAGE_MASK) & ~Memory::PAGE_MASK;
+    shared_memory->base_address = 0;
+    shared_memory->permissions = 0;
+    return Kernel::g_object_pool.Create(shared_memory);
+}
+
+/**
+ * Maps a block of shared memory, as MapMemoryBlock. The pages it's first mapped at back the
+ * block, mapping it at another address maps those pages there as well, so that every mapping
+ * reads and writes the same memory.
+ * @param handle Handle of the shared memory
+ * @param address Guest address the application maps the block at
+ * @param permissions Permissions of the application on the block
+ * @return 0 on success, ERROR_INVALID_HANDLE if the handle isn't that of shared memory
+ */
+Result MapSharedMemory(Handle handle, u32 address, u32 permissions) {
+    u32 error;
+    SharedMemory* shared_memory = Kernel::g_object_pool.Get<SharedMemory>(handle, error);
+    if (shared_memory == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    if (shared_memory->base_address == 0) {
+        shared_memory->base_address = address;
+    } else if (address != shared_memory->base_address &&
+        !Memory::MapAlias(address, shared_memory->size, shared_memory->base_address)) {
+
+        ERROR_LOG(KERNEL, "can't map shared memory 0x%08X at 0x%08X, it's mapped at 0x%08X",
+            handle, address, shared_memory->base_address);
+    }
+    shared_memory->permissions = permissions;
+    return 0;
+}
+
+/**
+ * Gets the guest address a block of shared memory was first mapped at, where services access it
+ * @param handle Handle of the shared memory
+ * @return The address, 0 if the application hasn't mapped the block
+ */
+u32 GetSharedMemoryAddress(Handle handle) {
+    u32 error;
+    SharedMemory* shared_memory = Kernel::g_object_pool.Get<SharedMemory>(handle, error);
+    return (shared_memory != NULL) ? shared_memory->base_address : 0;
+}
+
+/// Creates an empty shared memory block to load a state into
+Object* NewSharedMemoryObject() {
+    return new SharedMemory;
+}
+
+} // namespace
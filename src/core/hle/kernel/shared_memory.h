@@ -0,0 +1,42 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace Kernel {
+
+/**
+ * Creates a block of shared memory, which a service hands to the application to map with
+ * MapMemoryBlock
+ * @param size Size of the block in bytes
+ * @return Handle of the shared memory
+ */
+Handle CreateSharedMemory(u32 size);
+
+/**
+ * Maps a block of shared memory, as MapMemoryBlock. The pages it's first mapped at back the
+ * block, mapping it at another address maps those pages there as well, so that every mapping
+ * reads and writes the same memory.
+ * @param handle Handle of the shared memory
+ * @param address Guest address the application maps the block at
+ * @param permissions Permissions of the application on the block
+ * @return 0 on success, ERROR_INVALID_HANDLE if the handle isn't that of shared memory
+ */
+Result MapSharedMemory(Handle handle, u32 address, u32 permissions);
+
+/**
+ * Gets the guest address a block of shared memory was first mapped at, where services access it
+ * @param handle Handle of the shared memory
+ * @return The address, 0 if the application hasn't mapped the block
+ */
+u32 GetSharedMemoryAddress(Handle handle);
+
+/// Creates an empty shared memory block to load a state into
+Object* NewSharedMemoryObject();
+
+} // namespace
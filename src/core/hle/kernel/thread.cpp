@@ -4,25 +4,47 @@
 
 #include <stdio.h>
 
+#include <algorithm>
 #include <list>
 #include <vector>
 #include <map>
 #include <string>
 
 #include "common/common.h"
-#include "common/thread_queue_list.h"
+#include "common/chunk_file.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
+#include "core/sys_core.h"
+#include "core/arm/exec_trace.h"
+#include "core/arm/shadow_stack.h"
 #include "core/hle/hle.h"
 #include "core/hle/svc.h"
+#include "core/hle/kernel/address_arbiter.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/mutex.h"
+#include "core/hle/kernel/process.h"
 #include "core/hle/kernel/thread.h"
 
 namespace Kernel {
 
-class Thread : public Kernel::Object {
+/**
+ * Gets the core a thread runs on. Threads stay on their core, one that may run on either core is
+ * put on the app core, the ideal processor of applications.
+ * @param processor_id Processor id the thread was created with
+ * @return Core of the thread
+ */
+static ThreadCore GetThreadCore(s32 processor_id) {
+    if (processor_id == 1 || (u32)processor_id == THREADPROCESSORID_1) {
+        return THREADCORE_SYS;
+    }
+    return THREADCORE_APP;
+}
+
+class Thread : public Kernel::WaitObject {
 public:
+    ~Thread();
 
     const char* GetName() { return name; }
     const char* GetTypeName() { return "Thread"; }
@@ -36,6 +58,16 @@ public:
     inline bool IsWaiting() const { return (status & THREADSTATUS_WAIT) != 0; }
     inline bool IsSuspended() const { return (status & THREADSTATUS_SUSPEND) != 0; }
 
+    /// Waiting on a thread completes once it exits
+    bool ShouldWait(Handle thread) {
+        return status != THREADSTATUS_DEAD;
+    }
+
+    void Acquire(Handle thread) {
+    }
+
+    void DoState(PointerWrap& p);
+
     ThreadContext context;
 
     u32 status;
@@ -47,25 +79,313 @@ public:
     s32 current_priority;
 
     s32 processor_id;
+    ThreadCore core;        ///< Core the thread runs on, see GetThreadCore
+    Handle process;         ///< Process the thread runs in, 0 for the boot address space
 
     WaitType wait_type;
 
     char name[Kernel::MAX_NAME_LENGTH + 1];
+
+    Thread* ready_prev;     ///< Previous thread of the same priority in the ready queue
+    Thread* ready_next;     ///< Next thread of the same priority in the ready queue
+
+    std::vector<WaitObject*> held_objects;  ///< Objects the thread owns, see SetObjectOwner
+
+    std::vector<WaitLink> wait_links;       ///< One per object of the WaitSynchronization
+    bool wait_all;                          ///< Whether the wait is on all of the objects
+    u64 wait_serial;                        ///< Orders the waits in the queues of the objects
+    Handle wait_arbiter;                    ///< Address arbiter waited on, 0 for objects
+    u32 wait_address;                       ///< Address waited on in wait_arbiter
+    bool has_wakeup;                        ///< Whether the wait has a timeout scheduled
+    CoreTiming::EventHandle wakeup_event;   ///< Timeout of the wait
+};
+
+/**
+ * Saves or loads a pointer to a thread, as the handle of the thread
+ * @param p Savestate the pointer is written to or read from
+ * @param t Pointer to the thread, NULL is saved as handle 0
+ */
+static void DoThreadPointer(PointerWrap& p, Thread*& t) {
+    Handle handle = (t != NULL) ? t->GetHandle() : 0;
+    p.Do(handle);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        t = (handle != 0) ? Kernel::g_object_pool.GetFast<Thread>(handle) : NULL;
+    }
+}
+
+void Thread::DoState(PointerWrap& p) {
+    p.Do(context);
+    p.Do(status);
+    p.Do(entry_point);
+    p.Do(stack_top);
+    p.Do(stack_size);
+    p.Do(initial_priority);
+    p.Do(current_priority);
+    p.Do(processor_id);
+    core = GetThreadCore(processor_id);
+    p.Do(process);
+    p.Do(wait_type);
+    p.DoArray(name, Kernel::MAX_NAME_LENGTH + 1);
+    DoThreadPointer(p, ready_prev);
+    DoThreadPointer(p, ready_next);
+
+    // The objects held, as handles, ThreadingDoState makes the thread their owner again
+    u32 num_held = (u32)held_objects.size();
+    p.Do(num_held);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        held_objects.assign(num_held, NULL);
+    }
+    for (WaitObject*& object : held_objects) {
+        Handle handle = (object != NULL) ? object->GetHandle() : 0;
+        p.Do(handle);
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            object = GetWaitObject(handle);
+        }
+    }
+
+    // The objects waited on, as handles, ThreadingDoState links them back into their queues
+    u32 num_links = (u32)wait_links.size();
+    p.Do(num_links);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        wait_links.assign(num_links, WaitLink());
+    }
+    for (WaitLink& link : wait_links) {
+        Handle handle = (link.object != NULL) ? link.object->GetHandle() : 0;
+        p.Do(handle);
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            link.thread = this;
+            link.object = GetWaitObject(handle);
+            link.queue = NULL;
+            link.prev = link.next = NULL;
+        }
+    }
+    p.Do(wait_all);
+    p.Do(wait_arbiter);
+    p.Do(wait_address);
+    p.Do(wait_serial);
+    p.Do(has_wakeup);
+    p.Do(wakeup_event);
+    DoWaiters(p);
+}
+
+/**
+ * Ready threads, one intrusive FIFO list per priority. A bitmap of the non-empty lists makes
+ * finding the highest priority ready thread a find-first-set instead of a walk over the levels.
+ */
+class ReadyQueue {
+public:
+    ReadyQueue() {
+        Clear();
+    }
+
+    /// Empties the queue
+    void Clear() {
+        memset(first, 0, sizeof(first));
+        memset(last, 0, sizeof(last));
+        bitmap = 0;
+    }
+
+    /**
+     * Adds a thread at the front of the list of its priority, so it runs before threads that were
+     * already there
+     * @param t Thread to add, must not be in the queue
+     */
+    void PushFront(Thread* t) {
+        const s32 priority = t->current_priority;
+        t->ready_prev = NULL;
+        t->ready_next = first[priority];
+        if (first[priority] != NULL) {
+            first[priority]->ready_prev = t;
+        } else {
+            last[priority] = t;
+        }
+        first[priority] = t;
+        bitmap |= 1ULL << priority;
+    }
+
+    /**
+     * Adds a thread at the back of the list of its priority
+     * @param t Thread to add, must not be in the queue
+     */
+    void PushBack(Thread* t) {
+        const s32 priority = t->current_priority;
+        t->ready_next = NULL;
+        t->ready_prev = last[priority];
+        if (last[priority] != NULL) {
+            last[priority]->ready_next = t;
+        } else {
+            first[priority] = t;
+        }
+        last[priority] = t;
+        bitmap |= 1ULL << priority;
+    }
+
+    /**
+     * Removes a thread from the queue, if it's in there
+     * @param t Thread to remove
+     */
+    void Remove(Thread* t) {
+        const s32 priority = t->current_priority;
+        // A thread marked as ready may already have been popped by NextThread
+        if (t->ready_prev == NULL && first[priority] != t) {
+            return;
+        }
+        if (t->ready_prev != NULL) {
+            t->ready_prev->ready_next = t->ready_next;
+        } else {
+            first[priority] = t->ready_next;
+        }
+        if (t->ready_next != NULL) {
+            t->ready_next->ready_prev = t->ready_prev;
+        } else {
+            last[priority] = t->ready_prev;
+        }
+        if (first[priority] == NULL) {
+            bitmap &= ~(1ULL << priority);
+        }
+        t->ready_prev = t->ready_next = NULL;
+    }
+
+    /**
+     * Removes the first thread of the highest priority that is better than the given one
+     * @param priority Priority the thread has to beat
+     * @return The thread, NULL if there is none
+     */
+    Thread* PopFirstBetter(s32 priority) {
+        const u64 candidates = bitmap & ((1ULL << priority) - 1);
+        if (candidates == 0) {
+            return NULL;
+        }
+        Thread* t = first[LowestSetBit(candidates)];
+        Remove(t);
+        return t;
+    }
+
+    /**
+     * Removes the first thread of the highest priority
+     * @return The thread, NULL if the queue is empty
+     */
+    Thread* PopFirst() {
+        if (bitmap == 0) {
+            return NULL;
+        }
+        Thread* t = first[LowestSetBit(bitmap)];
+        Remove(t);
+        return t;
+    }
+
+    /// Saves or loads the queue, the links between its threads are saved with the threads
+    void DoState(PointerWrap& p) {
+        for (int i = 0; i < NUM_PRIORITIES; i++) {
+            DoThreadPointer(p, first[i]);
+            DoThreadPointer(p, last[i]);
+        }
+        p.Do(bitmap);
+    }
+
+private:
+
+    enum {
+        NUM_PRIORITIES = THREADPRIO_LOWEST + 1, ///< One list per priority, all fit in the bitmap
+    };
+
+    /// Index of the lowest set bit of a non-zero value
+    static int LowestSetBit(u64 value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (int)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (u32)value)) {
+            return (int)index;
+        }
+        _BitScanForward(&index, (u32)(value >> 32));
+        return (int)index + 32;
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    Thread* first[NUM_PRIORITIES];  ///< First ready thread of each priority
+    Thread* last[NUM_PRIORITIES];   ///< Last ready thread of each priority
+    u64 bitmap;                     ///< Bit n is set if there is a ready thread of priority n
 };
 
 // Lists all thread ids that aren't deleted/etc.
 std::vector<Handle> g_thread_queue;
 
-// Lists only ready thread ids.
-Common::ThreadQueueList<Handle> g_thread_ready_queue;
+// Lists only ready threads, per core.
+ReadyQueue g_thread_ready_queue[NUM_THREADCORES];
+
+Thread* g_current_thread[NUM_THREADCORES];  ///< Thread each core runs, NULL before the first one
+ThreadCore g_calling_core = THREADCORE_APP; ///< Core whose current thread makes the SVCs
+
+int g_wakeup_event = -1;    ///< Timeout of a wait, userdata is the handle of the thread
+u64 g_next_wait_serial = 0; ///< Of the next thread to wait on objects
+
+/// Threads are destroyed once they exited and lost their handle, the list forgets them then
+Thread::~Thread() {
+    g_thread_queue.erase(std::remove(g_thread_queue.begin(), g_thread_queue.end(), GetHandle()),
+        g_thread_queue.end());
+}
+
+enum {
+    TLS_SIZE        = 0x200,    ///< Thread local storage of a thread, its IPC command buffer in it
+    NUM_TLS_SLOTS   = Memory::KERNEL_MEMORY_SIZE / TLS_SIZE,
+};
+static_assert(NUM_TLS_SLOTS <= 64, "The TLS slots don't fit in the mask");
+
+u64 g_used_tls_slots = 0;   ///< Bit per TLS slot of kernel memory, set while a thread has it
+
+/**
+ * Gets the bit of the TLS slot at an address
+ * @param address Address of the TLS
+ * @return Bit of the slot in g_used_tls_slots
+ */
+static u64 GetTLSSlotBit(u32 address) {
+    return 1ULL << ((address - Memory::KERNEL_MEMORY_VADDR) / TLS_SIZE);
+}
 
-Handle g_current_thread_handle;
-Thread* g_current_thread;
+/**
+ * Gives a thread a TLS of its own, zeroed. Kernel memory starts with the TLS of the main thread.
+ * @return Address of the TLS
+ */
+static u32 AllocateTLS() {
+    for (u32 slot = 0; slot < NUM_TLS_SLOTS; slot++) {
+        const u32 address = Memory::KERNEL_MEMORY_VADDR + slot * TLS_SIZE;
+        if (!(g_used_tls_slots & GetTLSSlotBit(address))) {
+            g_used_tls_slots |= GetTLSSlotBit(address);
+            Memory::ZeroBlock(address, TLS_SIZE);
+            return address;
+        }
+    }
+    ERROR_LOG(KERNEL, "Out of TLS slots, the thread shares the TLS of the first one");
+    return Memory::KERNEL_MEMORY_VADDR;
+}
 
 
-/// Gets the current thread
+/// Gets the current thread of the calling core
 inline Thread* GetCurrentThread() {
-    return g_current_thread;
+    return g_current_thread[g_calling_core];
+}
+
+/**
+ * Gets the emulated CPU of a core
+ * @param core Core
+ * @return The CPU running the threads of the core
+ */
+static ARM_Interface* GetCPU(ThreadCore core) {
+    return (core == THREADCORE_SYS) ? Core::g_sys_core : Core::g_app_core;
+}
+
+/**
+ * Sets the core whose current thread makes the SVCs served, the app core unless SysCore serves
+ * one of the sys core
+ * @param core Core of the calling thread
+ */
+void SetCallingCore(ThreadCore core) {
+    g_calling_core = core;
 }
 
 /// Gets the current thread handle
@@ -73,30 +393,56 @@ Handle GetCurrentThreadHandle() {
     return GetCurrentThread()->GetHandle();
 }
 
-/// Sets the current thread
-inline void SetCurrentThread(Thread* t) {
-    g_current_thread = t;
-    g_current_thread_handle = t->GetHandle();
+/// Gets the TLS of the current thread, where its IPC command buffer is
+u32 GetCurrentThreadTLSAddress() {
+    Thread* t = GetCurrentThread();
+    return (t != NULL) ? t->context.tls_address : Memory::KERNEL_MEMORY_VADDR;
 }
 
-/// Saves the current CPU context
-void SaveContext(ThreadContext& ctx) {
-    Core::g_app_core->SaveContext(ctx);
+/**
+ * Sets the current thread of a core
+ * @param core Core
+ * @param t Thread the core runs, NULL for none
+ */
+inline void SetCurrentThread(ThreadCore core, Thread* t) {
+    // A core holds a reference to its thread, a thread that exited stays until it's switched out
+    if (t != NULL) {
+        t->IncRef();
+    }
+    if (g_current_thread[core] != NULL) {
+        g_current_thread[core]->DecRef();
+    }
+    g_current_thread[core] = t;
+    // The shadow stack and the trace follow the app core
+    if (core == THREADCORE_APP) {
+        // Switching to a thread of another process swaps the page table under the CPU
+        if (t != NULL) {
+            SetCurrentProcess(t->process);
+        }
+        const Handle handle = (t != NULL) ? t->GetHandle() : 0;
+        ShadowStack::SwitchThread(handle);
+        ExecTrace::SwitchThread(handle);
+    }
 }
 
-/// Loads a CPU context
-void LoadContext(ThreadContext& ctx) {
-    Core::g_app_core->LoadContext(ctx);
+/// Lets the sys core run while it has a thread to run, see SysCore::g_enabled
+static void UpdateSysCoreEnabled() {
+    const Thread* t = g_current_thread[THREADCORE_SYS];
+    SysCore::g_enabled = t != NULL && t->IsRunning();
 }
 
 /// Resets a thread
 void ResetThread(Thread* t, u32 arg, s32 lowest_priority) {
+    // The TLS stays the thread's for its whole life
+    const u32 tls_address = t->context.tls_address;
     memset(&t->context, 0, sizeof(ThreadContext));
+    t->context.tls_address = tls_address;
 
     t->context.cpu_registers[0] = arg;
     t->context.pc = t->entry_point;
     t->context.sp = t->stack_top;
     t->context.cpsr = 0x1F; // Usermode
+    ShadowStack::ResetThread(t->GetHandle());
     
     if (t->current_priority < lowest_priority) {
         t->current_priority = t->initial_priority;
@@ -107,16 +453,16 @@ void ResetThread(Thread* t, u32 arg, s32 lowest_priority) {
 
 /// Change a thread to "ready" state
 void ChangeReadyState(Thread* t, bool ready) {
-    Handle handle = t->GetHandle();
+    ReadyQueue& queue = g_thread_ready_queue[t->core];
     if (t->IsReady()) {
         if (!ready) {
-            g_thread_ready_queue.remove(t->current_priority, handle);
+            queue.Remove(t);
         }
     }  else if (ready) {
         if (t->IsRunning()) {
-            g_thread_ready_queue.push_front(t->current_priority, handle);
+            queue.PushFront(t);
         } else {
-            g_thread_ready_queue.push_back(t->current_priority, handle);
+            queue.PushBack(t);
         }
         t->status = THREADSTATUS_READY;
     }
@@ -146,13 +492,26 @@ void CallThread(Thread* t) {
     ChangeThreadState(t, THREADSTATUS_READY);
 }
 
-/// Switches CPU context to that of the specified thread
-void SwitchContext(Thread* t) {
-    Thread* cur = GetCurrentThread();
+/**
+ * Switches the CPU context of a core to that of a thread
+ * @param core Core
+ * @param t Thread of the core, NULL for none
+ */
+void SwitchContext(ThreadCore core, Thread* t) {
+    Thread* cur = g_current_thread[core];
+
+    // Switching to the running thread only has to update its state, the CPU already holds its
+    // context
+    if (t != NULL && t == cur) {
+        ChangeReadyState(t, false);
+        t->status = (t->status | THREADSTATUS_RUNNING) & ~THREADSTATUS_READY;
+        t->wait_type = WAITTYPE_NONE;
+        return;
+    }
     
     // Save context for current thread
     if (cur) {
-        SaveContext(cur->context);
+        GetCPU(core)->SaveContext(cur->context);
         
         if (cur->IsRunning()) {
             ChangeReadyState(cur, true);
@@ -160,30 +519,28 @@ void SwitchContext(Thread* t) {
     }
     // Load context of new thread
     if (t) {
-        SetCurrentThread(t);
+        SetCurrentThread(core, t);
         ChangeReadyState(t, false);
         t->status = (t->status | THREADSTATUS_RUNNING) & ~THREADSTATUS_READY;
         t->wait_type = WAITTYPE_NONE;
-        LoadContext(t->context);
+        GetCPU(core)->LoadContext(t->context);
     } else {
-        SetCurrentThread(NULL);
+        SetCurrentThread(core, NULL);
     }
 }
 
-/// Gets the next thread that is ready to be run by priority
-Thread* NextThread() {
-    Handle next;
-    Thread* cur = GetCurrentThread();
+/**
+ * Gets the next thread of a core that is ready to be run by priority
+ * @param core Core
+ * @return The thread, NULL if the current one keeps running or there is none
+ */
+Thread* NextThread(ThreadCore core) {
+    Thread* cur = g_current_thread[core];
     
     if (cur && cur->IsRunning()) {
-        next = g_thread_ready_queue.pop_first_better(cur->current_priority);
-    } else  {
-        next = g_thread_ready_queue.pop_first();
-    }
-    if (next == 0) {
-        return NULL;
+        return g_thread_ready_queue[core].PopFirstBetter(cur->current_priority);
     }
-    return Kernel::g_object_pool.GetFast<Thread>(next);
+    return g_thread_ready_queue[core].PopFirst();
 }
 
 /// Puts the current thread in the wait state for the given type
@@ -191,6 +548,16 @@ void WaitCurrentThread(WaitType wait_type) {
     Thread* t = GetCurrentThread();
     t->wait_type = wait_type;
     ChangeThreadState(t, ThreadStatus(THREADSTATUS_WAIT | (t->status & THREADSTATUS_SUSPEND)));
+    HLE::ReSchedule("thread waiting");
+}
+
+/// Resumes a thread from waiting by marking it as "ready"
+static void ResumeThreadFromWait(Thread* t) {
+    t->status &= ~THREADSTATUS_WAIT;
+    if (!(t->status & (THREADSTATUS_WAITSUSPEND | THREADSTATUS_DORMANT | THREADSTATUS_DEAD))) {
+        ChangeReadyState(t, true);
+        HLE::ReSchedule("thread resumed");
+    }
 }
 
 /// Resumes a thread from waiting by marking it as "ready"
@@ -198,11 +565,393 @@ void ResumeThreadFromWait(Handle handle) {
     u32 error;
     Thread* t = Kernel::g_object_pool.Get<Thread>(handle, error);
     if (t) {
-        t->status &= ~THREADSTATUS_WAIT;
-        if (!(t->status & (THREADSTATUS_WAITSUSPEND | THREADSTATUS_DORMANT | THREADSTATUS_DEAD))) {
-            ChangeReadyState(t, true);
+        ResumeThreadFromWait(t);
+    }
+}
+
+/**
+ * Whether a waiting thread is resumed before another: the one of better priority, or the one
+ * that started waiting first among equals
+ */
+static bool WaitsBefore(const Thread* a, const Thread* b) {
+    if (a->current_priority != b->current_priority) {
+        return a->current_priority < b->current_priority;
+    }
+    return a->wait_serial < b->wait_serial;
+}
+
+/**
+ * Adds a link of a waiting thread to a queue, at its place by priority. Threads mostly wait
+ * behind the others, so the walk starts from the back.
+ * @param queue Queue of the object or the address waited on
+ * @param link Link to add, of a thread whose wait_serial is set
+ */
+static void InsertWaiter(WaitQueue* queue, WaitLink* link) {
+    WaitLink* after = queue->last;
+    while (after != NULL && WaitsBefore(link->thread, after->thread)) {
+        after = after->prev;
+    }
+    queue->InsertAfter(after, link);
+}
+
+static void UpdatePriority(Thread* t);
+
+/**
+ * Updates the priorities of the owners of the objects of a wait, as it begins or ends
+ * @param links Links of the wait
+ */
+static void UpdateOwnerPriorities(const std::vector<WaitLink>& links) {
+    for (const WaitLink& link : links) {
+        if (link.object != NULL && link.object->owner != 0) {
+            UpdatePriority(Kernel::g_object_pool.GetFast<Thread>(link.object->owner));
+        }
+    }
+}
+
+/**
+ * Changes the current priority of a thread, moving it to its new place in the ready queue or in
+ * the queues it waits in
+ * @param t Thread
+ * @param priority New current priority
+ */
+static void SetCurrentPriority(Thread* t, s32 priority) {
+    if (t->IsReady()) {
+        g_thread_ready_queue[t->core].Remove(t);
+        t->current_priority = priority;
+        g_thread_ready_queue[t->core].PushBack(t);
+    } else {
+        t->current_priority = priority;
+    }
+    if (t->IsWaiting()) {
+        for (WaitLink& link : t->wait_links) {
+            link.queue->Remove(&link);
+            InsertWaiter(link.queue, &link);
+        }
+    }
+    HLE::ReSchedule("thread priority changed");
+}
+
+/**
+ * Updates the current priority of a thread to the best of its own and those of the threads
+ * waiting on the objects it holds, which the threads they wait on inherit in turn
+ * @param t Thread
+ */
+static void UpdatePriority(Thread* t) {
+    s32 priority = t->initial_priority;
+    for (const WaitObject* object : t->held_objects) {
+        if (!object->waiters.empty()) {
+            priority = std::min(priority, object->waiters.first->thread->current_priority);
         }
     }
+    if (priority == t->current_priority) {
+        return;
+    }
+    SetCurrentPriority(t, priority);
+    if (t->IsWaiting()) {
+        UpdateOwnerPriorities(t->wait_links);
+    }
+}
+
+/**
+ * Sets the thread holding an object, which inherits the priority of the threads waiting on it
+ * @param object Object, as a locked mutex
+ * @param thread Handle of the thread, 0 as the object is released
+ */
+void SetObjectOwner(WaitObject* object, Handle thread) {
+    if (object->owner == thread) {
+        return;
+    }
+    if (object->owner != 0) {
+        Thread* old_owner = Kernel::g_object_pool.GetFast<Thread>(object->owner);
+        std::vector<WaitObject*>& held = old_owner->held_objects;
+        held.erase(std::find(held.begin(), held.end(), object));
+        object->owner = 0;
+        UpdatePriority(old_owner);
+        object->DecRef();
+    }
+    if (thread != 0) {
+        Thread* new_owner = Kernel::g_object_pool.GetFast<Thread>(thread);
+        new_owner->held_objects.push_back(object);
+        object->IncRef();
+        object->owner = thread;
+        UpdatePriority(new_owner);
+    }
+}
+
+/**
+ * Gets an object a thread holds
+ * @param thread Handle of the thread
+ * @return The object held the longest, NULL if none
+ */
+WaitObject* GetFirstHeldObject(Handle thread) {
+    Thread* t = Kernel::g_object_pool.GetFast<Thread>(thread);
+    return t->held_objects.empty() ? NULL : t->held_objects.front();
+}
+
+/**
+ * Writes the result of a WaitSynchronization to the registers of its thread
+ * @param t Thread that waited
+ * @param result Result of the call, in r0
+ * @param index Index of the object acquired, in r1
+ */
+static void SetWaitResult(Thread* t, Result result, s32 index) {
+    // The context of the current thread is in its CPU, even as it waits with no thread to run.
+    // The sys core doesn't run meanwhile, a thread it runs doesn't wait.
+    if (t == g_current_thread[t->core]) {
+        GetCPU(t->core)->SetReg(0, result);
+        GetCPU(t->core)->SetReg(1, index);
+    } else {
+        t->context.cpu_registers[0] = result;
+        t->context.cpu_registers[1] = index;
+    }
+}
+
+/**
+ * Acquires the objects of a WaitSynchronization if its wait can complete
+ * @param t Thread that waits
+ * @param index Set to the index of the object acquired by a wait on any, else to -1
+ * @return Whether the wait completed
+ */
+static bool TryCompleteWait(Thread* t, s32* index) {
+    const Handle handle = t->GetHandle();
+    if (t->wait_all) {
+        for (const WaitLink& link : t->wait_links) {
+            if (link.object->ShouldWait(handle)) {
+                return false;
+            }
+        }
+        for (const WaitLink& link : t->wait_links) {
+            link.object->Acquire(handle);
+        }
+        *index = -1;
+        return true;
+    }
+    for (size_t i = 0; i < t->wait_links.size(); i++) {
+        if (!t->wait_links[i].object->ShouldWait(handle)) {
+            t->wait_links[i].object->Acquire(handle);
+            *index = (s32)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Ends the WaitSynchronization of a thread, taking it out of the queues and resuming it
+ * @param t Thread that waits
+ * @param result Result of the call
+ * @param index Index of the object acquired
+ */
+static void EndWait(Thread* t, Result result, s32 index) {
+    for (WaitLink& link : t->wait_links) {
+        link.queue->Remove(&link);
+    }
+    std::vector<WaitLink> links;
+    links.swap(t->wait_links);
+    if (t->wait_arbiter != 0) {
+        Kernel::g_object_pool[t->wait_arbiter]->DecRef();
+    }
+    t->wait_arbiter = 0;
+    if (t->has_wakeup) {
+        CoreTiming::UnscheduleEvent(t->wakeup_event);
+        t->has_wakeup = false;
+    }
+    SetWaitResult(t, result, index);
+    ResumeThreadFromWait(t);
+
+    // The owners of the objects no longer inherit the priority of the thread
+    UpdateOwnerPriorities(links);
+    for (WaitLink& link : links) {
+        if (link.object != NULL) {
+            link.object->DecRef();
+        }
+    }
+}
+
+/// Resumes a thread whose wait timed out, or that slept for its time
+static void WakeupCallback(u64 userdata, int cycles_late) {
+    u32 error;
+    Thread* t = Kernel::g_object_pool.Get<Thread>((Handle)userdata, error);
+    if (t == NULL || !t->has_wakeup) {
+        return;
+    }
+    t->has_wakeup = false;
+    if (t->wait_type == WAITTYPE_SLEEP) {
+        EndWait(t, 0, 0);
+    } else {
+        EndWait(t, RESULT_WAIT_TIMEOUT, -1);
+    }
+}
+
+/// Resumes the waiting threads whose wait the object completes, best priority first
+void WaitObject::WakeupWaitingThreads() {
+    // Ending a wait updates the priorities of the owners, which moves their links in the queues,
+    // this one included, so the waiters are taken in their order beforehand. The handles may
+    // repeat, a thread is taken once.
+    std::vector<Thread*> threads;
+    for (WaitLink* link = waiters.first; link != NULL; link = link->next) {
+        if (std::find(threads.begin(), threads.end(), link->thread) == threads.end()) {
+            threads.push_back(link->thread);
+        }
+    }
+
+    // Once the object is taken, as a mutex handed to its best waiter, no other wait completes
+    for (Thread* t : threads) {
+        if (ShouldWait(0)) {
+            break;
+        }
+        s32 index;
+        if (!t->wait_links.empty() && TryCompleteWait(t, &index)) {
+            EndWait(t, 0, index);
+        }
+    }
+}
+
+/**
+ * Puts the current thread in the wait state, adding its links to their queues
+ * @param t Current thread
+ * @param wait_type Type of wait
+ * @param nano_seconds Timeout, negative to wait forever
+ */
+static void BeginWait(Thread* t, WaitType wait_type, s64 nano_seconds) {
+    // The thread holds a reference to each object it waits on, closing them doesn't end the wait
+    t->wait_serial = g_next_wait_serial++;
+    for (WaitLink& link : t->wait_links) {
+        InsertWaiter(link.queue, &link);
+        if (link.object != NULL) {
+            link.object->IncRef();
+        }
+    }
+    if (nano_seconds >= 0) {
+        t->wakeup_event = CoreTiming::ScheduleEvent(nsToCycles(nano_seconds), g_wakeup_event,
+            t->GetHandle());
+        t->has_wakeup = true;
+    }
+    WaitCurrentThread(wait_type);
+
+    // The owners of the objects inherit the priority of the thread
+    UpdateOwnerPriorities(t->wait_links);
+}
+
+/**
+ * Waits on kernel objects with the current thread, as WaitSynchronization. The objects are
+ * acquired as the wait completes. If that can't happen right away the thread waits until the
+ * objects signal or the timeout expires, and gets the result of the wait in its r0 and r1 as it
+ * resumes.
+ * @param objects Objects to wait on, in the order of the handles
+ * @param count Number of objects, a wait on none of them only ends with its timeout
+ * @param wait_all Whether all of the objects have to be acquired at once, or any of them
+ * @param nano_seconds Timeout, 0 to only check the objects, negative to wait forever
+ * @param out_index Set to the index of the object acquired by a wait on any, else to -1
+ * @return RESULT_WAIT_TIMEOUT if the objects can't be acquired and the timeout is 0, else 0
+ */
+Result WaitSynchronization(WaitObject** objects, u32 count, bool wait_all, s64 nano_seconds,
+    s32* out_index) {
+
+    Thread* t = GetCurrentThread();
+    t->wait_all = wait_all;
+    t->wait_links.resize(count);
+    for (u32 i = 0; i < count; i++) {
+        t->wait_links[i].thread = t;
+        t->wait_links[i].object = objects[i];
+        t->wait_links[i].queue = &objects[i]->waiters;
+        t->wait_links[i].prev = t->wait_links[i].next = NULL;
+    }
+    if (TryCompleteWait(t, out_index)) {
+        t->wait_links.clear();
+        return 0;
+    }
+    *out_index = -1;
+    if (nano_seconds == 0) {
+        t->wait_links.clear();
+        return RESULT_WAIT_TIMEOUT;
+    }
+
+    // The links stay put until the wait ends, nothing resizes the vector meanwhile
+    BeginWait(t, WAITTYPE_SYNCH, nano_seconds);
+    return 0;
+}
+
+/**
+ * Waits with the current thread in a queue of an address arbiter, until the address
+ * is signalled or the timeout expires. The thread gets 0 or RESULT_WAIT_TIMEOUT in its r0 as it
+ * resumes.
+ * @param arbiter Handle of the address arbiter
+ * @param address Guest address waited on
+ * @param queue Queue of the address in the arbiter
+ * @param nano_seconds Timeout, negative to wait forever
+ */
+void WaitCurrentThreadOnAddress(Handle arbiter, u32 address, WaitQueue* queue,
+    s64 nano_seconds) {
+
+    Thread* t = GetCurrentThread();
+    t->wait_all = false;
+    t->wait_arbiter = arbiter;
+    t->wait_address = address;
+    Kernel::g_object_pool[arbiter]->IncRef();
+    t->wait_links.resize(1);
+    t->wait_links[0].thread = t;
+    t->wait_links[0].object = NULL;
+    t->wait_links[0].queue = queue;
+    BeginWait(t, WAITTYPE_ARB, nano_seconds);
+}
+
+/**
+ * Resumes the threads waiting in a queue of an address arbiter, best priority first
+ * @param queue Queue of the address in the arbiter
+ * @param count Number of threads to resume, negative for all of them
+ */
+void ResumeAddressWaiters(WaitQueue* queue, s32 count) {
+    while (!queue->empty() && count != 0) {
+        EndWait(queue->first->thread, 0, 0);
+        if (count > 0) {
+            count--;
+        }
+    }
+}
+
+/**
+ * Puts the current thread to sleep, as SleepThread
+ * @param nano_seconds Time to sleep, 0 or less to only let the other ready threads of the same
+ *      priority run first
+ */
+void SleepCurrentThread(s64 nano_seconds) {
+    Thread* t = GetCurrentThread();
+    if (nano_seconds > 0) {
+        // A wait on nothing, only its timeout ends it
+        t->wait_all = false;
+        t->wait_links.clear();
+        BeginWait(t, WAITTYPE_SLEEP, nano_seconds);
+        return;
+    }
+
+    // Behind the threads of its priority that are ready already
+    t->status = (t->status & ~THREADSTATUS_RUNNING) | THREADSTATUS_READY;
+    g_thread_ready_queue[t->core].PushBack(t);
+    HLE::ReSchedule("thread yielded");
+}
+
+/// Exits the current thread, waking up the threads waiting on it
+void ExitCurrentThread() {
+    Thread* t = GetCurrentThread();
+    ReleaseThreadMutexes(t->GetHandle());
+    ShadowStack::ResetThread(t->GetHandle());
+    g_used_tls_slots &= ~GetTLSSlotBit(t->context.tls_address);
+    ChangeThreadState(t, THREADSTATUS_DEAD);
+    t->WakeupWaitingThreads();
+    HLE::ReSchedule("thread exited");
+
+    // What's left of the thread goes with its handle, and once its core switches away from it
+    if (t->process != 0) {
+        Kernel::g_object_pool[t->process]->DecRef();
+    }
+    t->DecRef();
+}
+
+/// Whether no thread of the app core can run, the current one waiting or gone as well
+bool IsIdle() {
+    Thread* t = g_current_thread[THREADCORE_APP];
+    return t != NULL && !t->IsRunning() && !t->IsReady();
 }
 
 /// Creates a new thread
@@ -215,9 +964,16 @@ Thread* CreateThread(Handle& handle, const char* name, u32 entry_point, s32 prio
     Thread* t = new Thread;
     
     handle = Kernel::g_object_pool.Create(t);
+
+    // The thread holds a reference to itself and to its process until it exits, its handle
+    // may be closed before
+    t->IncRef();
+    t->process = GetCurrentProcessHandle();
+    if (t->process != 0) {
+        Kernel::g_object_pool[t->process]->IncRef();
+    }
     
     g_thread_queue.push_back(handle);
-    g_thread_ready_queue.prepare(priority);
     
     t->status = THREADSTATUS_DORMANT;
     t->entry_point = entry_point;
@@ -225,7 +981,16 @@ Thread* CreateThread(Handle& handle, const char* name, u32 entry_point, s32 prio
     t->stack_size = stack_size;
     t->initial_priority = t->current_priority = priority;
     t->processor_id = processor_id;
+    t->core = GetThreadCore(processor_id);
     t->wait_type = WAITTYPE_NONE;
+    t->ready_prev = t->ready_next = NULL;
+    t->wait_all = false;
+    t->wait_serial = 0;
+    t->wait_arbiter = 0;
+    t->wait_address = 0;
+    t->has_wakeup = false;
+    t->wakeup_event = 0;
+    t->context.tls_address = AllocateTLS();
     
     strncpy(t->name, name, Kernel::MAX_NAME_LENGTH);
     t->name[Kernel::MAX_NAME_LENGTH] = '\0';
@@ -285,39 +1050,98 @@ Handle SetupMainThread(s32 priority, int stack_size) {
     ResetThread(t, 0, 0);
     
     // If running another thread already, set it to "ready" state
-    Thread* cur = GetCurrentThread();
+    Thread* cur = g_current_thread[THREADCORE_APP];
     if (cur && cur->IsRunning()) {
         ChangeReadyState(cur, true);
     }
     
     // Run new "main" thread
-    SetCurrentThread(t);
+    SetCurrentThread(THREADCORE_APP, t);
     t->status = THREADSTATUS_RUNNING;
-    LoadContext(t->context);
+    Core::g_app_core->LoadContext(t->context);
 
     return handle;
 }
 
-/// Reschedules to the next available thread (call after current thread is suspended)
+/// Reschedules every core to its next available thread (call after current thread is suspended)
 void Reschedule() {
-    Thread* prev = GetCurrentThread();
-    Thread* next = NextThread();
-    if (next > 0) {
-        SwitchContext(next);
-
-        // Hack - automatically change previous thread (which would have been in "wait" state) to
-        // "ready" state, so that we can immediately resume to it when new thread yields. FixMe to
-        // actually wait for whatever event it is supposed to be waiting on.
-        ChangeReadyState(prev, true);
+    // With no thread to switch to, a waiting current thread stays put and the CPU idles, see
+    // IsIdle. Called between slices, when the sys core doesn't run.
+    for (int core = 0; core < NUM_THREADCORES; core++) {
+        Thread* next = NextThread((ThreadCore)core);
+        if (next != NULL) {
+            SwitchContext((ThreadCore)core, next);
+        }
     }
+    UpdateSysCoreEnabled();
+
+    // No SVC runs meanwhile, the objects closed since the last slice can go
+    Kernel::g_object_pool.DestroyPending();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void ThreadingInit() {
+    g_wakeup_event = CoreTiming::RegisterEvent("Kernel::WakeupThread", WakeupCallback);
+    g_used_tls_slots = 0;
+    g_calling_core = THREADCORE_APP;
 }
 
 void ThreadingShutdown() {
+    ShadowStack::Clear();
+    for (int core = 0; core < NUM_THREADCORES; core++) {
+        g_thread_ready_queue[core].Clear();
+        g_current_thread[core] = NULL;
+    }
+    SysCore::g_enabled = false;
+}
+
+/// Creates an empty thread to load a state into
+Object* NewThreadObject() {
+    return new Thread;
+}
+
+/**
+ * Saves or loads the thread list, the ready queues and the current threads
+ * @param p Savestate the state is written to or read from
+ */
+void ThreadingDoState(PointerWrap& p) {
+    auto s = p.Section("Threading", 4);
+    if (!s) {
+        return;
+    }
+    p.Do(g_thread_queue);
+    for (int core = 0; core < NUM_THREADCORES; core++) {
+        g_thread_ready_queue[core].DoState(p);
+        DoThreadPointer(p, g_current_thread[core]);
+    }
+    p.Do(g_next_wait_serial);
+
+    // Every object is loaded by now, the threads own the objects they hold again and go back
+    // into the queues of the objects they wait on, where their priorities and serials order them
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // Shadow stacks aren't saved, the loaded threads start them over
+        const Thread* app_thread = g_current_thread[THREADCORE_APP];
+        ShadowStack::Clear();
+        ShadowStack::SwitchThread((app_thread != NULL) ? app_thread->GetHandle() : 0);
+        SetCurrentProcess((app_thread != NULL) ? app_thread->process : 0);
+        UpdateSysCoreEnabled();
+        g_used_tls_slots = 0;
+        for (Handle handle : g_thread_queue) {
+            Thread* t = Kernel::g_object_pool.GetFast<Thread>(handle);
+            if (t->status != THREADSTATUS_DEAD) {
+                g_used_tls_slots |= GetTLSSlotBit(t->context.tls_address);
+            }
+            for (WaitObject* object : t->held_objects) {
+                object->owner = handle;
+            }
+            for (WaitLink& link : t->wait_links) {
+                link.queue = (link.object != NULL) ? &link.object->waiters :
+                    GetAddressQueue(t->wait_arbiter, t->wait_address);
+                InsertWaiter(link.queue, &link);
+            }
+        }
+    }
 }
 
 } // namespace
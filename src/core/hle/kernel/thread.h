@@ -20,6 +20,13 @@ enum ThreadProcessorId {
     THREADPROCESSORID_ALL   = 0xFFFFFFFC,   ///< Enables both cores
 };
 
+/// Emulated cores that run threads, picked by the processor id of the thread
+enum ThreadCore {
+    THREADCORE_APP          = 0,    ///< Application core, Core::g_app_core
+    THREADCORE_SYS          = 1,    ///< System core, Core::g_sys_core
+    NUM_THREADCORES,
+};
+
 enum ThreadStatus {
     THREADSTATUS_RUNNING        = 1,
     THREADSTATUS_READY          = 2,
@@ -39,6 +46,8 @@ enum WaitType {
     WAITTYPE_VBLANK,
     WAITTYPE_MUTEX,
     WAITTYPE_SYNCH,
+    WAITTYPE_IO,
+    WAITTYPE_ARB,
 };
 
 namespace Kernel {
@@ -50,20 +59,88 @@ Handle CreateThread(const char* name, u32 entry_point, s32 priority, u32 arg, s3
 /// Sets up the primary application thread
 Handle SetupMainThread(s32 priority, int stack_size=Kernel::DEFAULT_STACK_SIZE);
 
-/// Reschedules to the next available thread (call after current thread is suspended)
+/// Reschedules every core to its next available thread (call after current thread is suspended)
 void Reschedule();
 
+/**
+ * Sets the core whose current thread makes the SVCs served, the app core unless SysCore serves
+ * one of the sys core
+ * @param core Core of the calling thread
+ */
+void SetCallingCore(ThreadCore core);
+
 /// Puts the current thread in the wait state for the given type
 void WaitCurrentThread(WaitType wait_type);
 
+/**
+ * Waits on kernel objects with the current thread, as WaitSynchronization. The objects are
+ * acquired as the wait completes. If that can't happen right away the thread waits until the
+ * objects signal or the timeout expires, and gets the result of the wait in its r0 and r1 as it
+ * resumes.
+ * @param objects Objects to wait on, in the order of the handles
+ * @param count Number of objects, a wait on none of them only ends with its timeout
+ * @param wait_all Whether all of the objects have to be acquired at once, or any of them
+ * @param nano_seconds Timeout, 0 to only check the objects, negative to wait forever
+ * @param out_index Set to the index of the object acquired by a wait on any, else to -1
+ * @return RESULT_WAIT_TIMEOUT if the objects can't be acquired and the timeout is 0, else 0
+ */
+Result WaitSynchronization(WaitObject** objects, u32 count, bool wait_all, s64 nano_seconds,
+    s32* out_index);
+
+/**
+ * Waits with the current thread in a queue of an address arbiter, until the address
+ * is signalled or the timeout expires. The thread gets 0 or RESULT_WAIT_TIMEOUT in its r0 as it
+ * resumes.
+ * @param arbiter Handle of the address arbiter
+ * @param address Guest address waited on
+ * @param queue Queue of the address in the arbiter
+ * @param nano_seconds Timeout, negative to wait forever
+ */
+void WaitCurrentThreadOnAddress(Handle arbiter, u32 address, WaitQueue* queue,
+    s64 nano_seconds);
+
+/**
+ * Resumes the threads waiting in a queue of an address arbiter, best priority first
+ * @param queue Queue of the address in the arbiter
+ * @param count Number of threads to resume, negative for all of them
+ */
+void ResumeAddressWaiters(WaitQueue* queue, s32 count);
+
+/**
+ * Puts the current thread to sleep, as SleepThread
+ * @param nano_seconds Time to sleep, 0 or less to only let the other ready threads of the same
+ *      priority run first
+ */
+void SleepCurrentThread(s64 nano_seconds);
+
+/**
+ * Sets the thread holding an object, which inherits the priority of the threads waiting on it
+ * @param object Object, as a locked mutex
+ * @param thread Handle of the thread, 0 as the object is released
+ */
+void SetObjectOwner(WaitObject* object, Handle thread);
+
+/**
+ * Gets an object a thread holds
+ * @param thread Handle of the thread
+ * @return The object held the longest, NULL if none
+ */
+WaitObject* GetFirstHeldObject(Handle thread);
+
+/// Exits the current thread, waking up the threads waiting on it
+void ExitCurrentThread();
+
 /// Resumes a thread from waiting by marking it as "ready"
 void ResumeThreadFromWait(Handle handle);
 
 /// Gets the current thread handle
 Handle GetCurrentThreadHandle();
 
-/// Put current thread in a wait state - on WaitSynchronization
-void WaitThread_Synchronization();
+/// Gets the TLS of the current thread, where its IPC command buffer is
+u32 GetCurrentThreadTLSAddress();
+
+/// Whether no thread of the app core can run, the current one waiting or gone as well
+bool IsIdle();
 
 /// Initialize threading
 void ThreadingInit();
@@ -71,4 +148,13 @@ void ThreadingInit();
 /// Shutdown threading
 void ThreadingShutdown();
 
+/// Creates an empty thread to load a state into
+Object* NewThreadObject();
+
+/**
+ * Saves or loads the thread list, the ready queues and the current threads
+ * @param p Savestate the state is written to or read from
+ */
+void ThreadingDoState(PointerWrap& p);
+
 } // namespace
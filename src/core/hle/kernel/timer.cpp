@@ -0,0 +1,162 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/core_timing.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/kernel/timer.h"
+
+namespace Kernel {
+
+class Timer : public WaitObject {
+public:
+    const char* GetTypeName() { return "Timer"; }
+
+    static Kernel::HandleType GetStaticHandleType() {  return Kernel::HandleType::Timer; }
+    Kernel::HandleType GetHandleType() const { return Kernel::HandleType::Timer; }
+
+    bool ShouldWait(Handle thread) {
+        return !signaled;
+    }
+
+    void Acquire(Handle thread) {
+        if (reset_type == RESETTYPE_ONESHOT) {
+            signaled = false;
+        }
+    }
+
+    void DoState(PointerWrap& p) {
+        p.Do(reset_type);
+        p.Do(signaled);
+        p.Do(interval);
+        p.Do(scheduled);
+        p.Do(event);
+        DoWaiters(p);
+    }
+
+    ResetType reset_type;                       ///< What clears the timer
+    bool signaled;                              ///< Whether waiting on the timer completes
+    s64 interval;                               ///< Cycles between signals, 0 for one signal
+    bool scheduled;                             ///< Whether the timer is running
+    CoreTiming::EventHandle event;              ///< Next signal, while the timer runs
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int g_timer_event = -1;  ///< Signal of a timer, userdata is the handle of the timer
+
+/// Signals a timer as it expires, and starts its next period
+static void TimerCallback(u64 userdata, int cycles_late) {
+    u32 error;
+    Timer* timer = Kernel::g_object_pool.Get<Timer>((Handle)userdata, error);
+    if (timer == NULL) {
+        return;
+    }
+    timer->scheduled = false;
+    timer->signaled = true;
+    timer->WakeupWaitingThreads();
+
+    // A pulse only wakes up the threads that were waiting at the time
+    if (timer->reset_type == RESETTYPE_PULSE) {
+        timer->signaled = false;
+    }
+    if (timer->interval != 0) {
+        timer->event = CoreTiming::ScheduleEvent(timer->interval - cycles_late, g_timer_event,
+            userdata);
+        timer->scheduled = true;
+    }
+}
+
+/// Stops a timer if it is running
+static void Unschedule(Timer* timer) {
+    if (timer->scheduled) {
+        CoreTiming::UnscheduleEvent(timer->event);
+        timer->scheduled = false;
+    }
+}
+
+/**
+ * Creates a timer, initially stopped and cleared
+ * @param reset_type Whether the timer clears as it wakes a thread, stays signalled, or only wakes
+ *      the threads already waiting
+ * @return Handle of the timer
+ */
+Handle CreateTimer(ResetType reset_type) {
+    Timer* timer = new Timer;
+    timer->reset_type = reset_type;
+    timer->signaled = false;
+    timer->interval = 0;
+    timer->scheduled = false;
+    timer->event = 0;
+    return Kernel::g_object_pool.Create(timer);
+}
+
+/**
+ * Starts a timer, replacing the periods it had
+ * @param handle Handle of the timer
+ * @param initial Nanoseconds until the timer first signals
+ * @param interval Nanoseconds between the signals after the first, 0 to only signal once
+ */
+Result SetTimer(Handle handle, s64 initial, s64 interval) {
+    u32 error;
+    Timer* timer = Kernel::g_object_pool.Get<Timer>(handle, error);
+    if (timer == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    if (initial < 0 || interval < 0) {
+        return ERROR_OUT_OF_RANGE;
+    }
+    Unschedule(timer);
+
+    // A period shorter than a cycle would signal forever without the guest getting to run
+    timer->interval = (interval != 0) ? std::max<s64>(nsToCycles(interval), 1) : 0;
+    timer->event = CoreTiming::ScheduleEvent(nsToCycles(initial), g_timer_event, handle);
+    timer->scheduled = true;
+    return 0;
+}
+
+/**
+ * Stops a timer, leaving it signalled if it was
+ * @param handle Handle of the timer
+ */
+Result CancelTimer(Handle handle) {
+    u32 error;
+    Timer* timer = Kernel::g_object_pool.Get<Timer>(handle, error);
+    if (timer == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    Unschedule(timer);
+    return 0;
+}
+
+/**
+ * Clears a timer, leaving it running if it was
+ * @param handle Handle of the timer
+ */
+Result ClearTimer(Handle handle) {
+    u32 error;
+    Timer* timer = Kernel::g_object_pool.Get<Timer>(handle, error);
+    if (timer == NULL) {
+        return ERROR_INVALID_HANDLE;
+    }
+    timer->signaled = false;
+    return 0;
+}
+
+/// Creates an empty timer to load a state into
+Object* NewTimerObject() {
+    return new Timer;
+}
+
+/// Initialize the timers
+void TimersInit() {
+    g_timer_event = CoreTiming::RegisterEvent("Kernel::Timer", TimerCallback);
+}
+
+} // namespace
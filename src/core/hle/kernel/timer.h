@@ -0,0 +1,48 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.  
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/svc.h"
+
+namespace Kernel {
+
+/**
+ * Creates a timer, initially stopped and cleared
+ * @param reset_type Whether the timer clears as it wakes a thread, stays signalled, or only wakes
+ *      the threads already waiting
+ * @return Handle of the timer
+ */
+Handle CreateTimer(ResetType reset_type);
+
+/**
+ * Starts a timer, replacing the periods it had
+ * @param handle Handle of the timer
+ * @param initial Nanoseconds until the timer first signals
+ * @param interval Nanoseconds between the signals after the first, 0 to only signal once
+ */
+Result SetTimer(Handle handle, s64 initial, s64 interval);
+
+/**
+ * Stops a timer, leaving it signalled if it was
+ * @param handle Handle of the timer
+ */
+Result CancelTimer(Handle handle);
+
+/**
+ * Clears a timer, leaving it running if it was
+ * @param handle Handle of the timer
+ */
+Result ClearTimer(Handle handle);
+
+/// Creates an empty timer to load a state into
+Object* NewTimerObject();
+
+/// Initialize the timers
+void TimersInit();
+
+} // namespace
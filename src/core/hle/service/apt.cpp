@@ -2,11 +2,19 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
+#include "common/chunk_file.h"
 #include "common/common.h"
 
+#include "core/mem_map.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/event.h"
 #include "core/hle/kernel/mutex.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/thread.h"
 #include "core/hle/service/apt.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -14,8 +22,154 @@
 
 namespace APT_U {
 
+/// Commands sent from a program to another along with a parameter
+enum Signal {
+    SIGNAL_NONE             = 0,
+    SIGNAL_WAKEUP           = 1,    ///< Starts the receiver, the application once it initialized
+    SIGNAL_REQUEST          = 2,
+    SIGNAL_RESPONSE         = 3,
+    SIGNAL_EXIT             = 4,
+    SIGNAL_WAKEUP_EXIT      = 10,   ///< Wakes up the caller of an applet that closed
+    SIGNAL_WAKEUP_PAUSE     = 11,
+    SIGNAL_WAKEUP_CANCEL    = 12,   ///< Wakes up the caller of an applet that was cancelled
+};
+
+/// Result of ReceiveParameter and GlanceParameter with no parameter for the program
+static const u32 ERROR_NO_PARAMETER = 0xC8A0CFEF;
+
+/// Program APT manages, the application or a library applet
+struct Applet {
+    u32 id;                     ///< AppletId
+    Handle process;             ///< Process the program runs in, 0 for an applet that isn't loaded
+    Handle notification_event;  ///< Signalled for a pending notification, 0 until Initialize
+    Handle parameter_event;     ///< Signalled as a parameter is sent to the program
+    u32 caller_id;              ///< AppletId of the program that started the applet
+};
+
+/// Parameter sent from a program to another, until the receiver takes it
+struct Parameter {
+    u32 sender_id;
+    u32 destination_id;
+    u32 signal;             ///< Signal
+    Handle handle;          ///< Object handed along, as the shared memory of a keyboard, or 0
+    std::vector<u8> buffer;
+};
+
+static std::vector<Applet> g_applets;
+static Parameter g_parameter;
+static bool g_parameter_pending = false;
+
+/**
+ * Gets a program APT manages
+ * @param id AppletId of the program
+ * @return The program, NULL if APT doesn't know it
+ */
+static Applet* FindApplet(u32 id) {
+    for (size_t i = 0; i < g_applets.size(); i++) {
+        if (g_applets[i].id == id) {
+            return &g_applets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets the program a process runs, the caller of a command
+ * @param process Handle of the process
+ * @return The program, NULL if the process isn't one APT manages
+ */
+static Applet* FindAppletByProcess(Handle process) {
+    for (size_t i = 0; i < g_applets.size(); i++) {
+        if (g_applets[i].process == process) {
+            return &g_applets[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets a program APT manages, adding it if APT doesn't know it yet. Adding invalidates the
+ * pointers to the other programs.
+ * @param id AppletId of the program
+ */
+static Applet* AddApplet(u32 id) {
+    Applet* applet = FindApplet(id);
+    if (applet == NULL) {
+        Applet added = {};
+        added.id = id;
+        g_applets.push_back(added);
+        applet = &g_applets.back();
+    }
+    return applet;
+}
+
+/**
+ * Sends a parameter to a program, replacing the one pending, and signals the program
+ * @param parameter Parameter to send, its handle is a reference the parameter takes over
+ */
+static void PostParameter(const Parameter& parameter) {
+    if (g_parameter_pending && g_parameter.handle != 0) {
+        Kernel::g_object_pool.Close(g_parameter.handle);
+    }
+    g_parameter = parameter;
+    g_parameter_pending = true;
+
+    Applet* destination = FindApplet(parameter.destination_id);
+    if (destination != NULL && destination->parameter_event != 0) {
+        Kernel::SignalEvent(destination->parameter_event);
+    }
+    DEBUG_LOG(OSHLE, "APT_U parameter 0x%03X -> 0x%03X, signal %d", parameter.sender_id,
+        parameter.destination_id, parameter.signal);
+}
+
+/**
+ * Copies a buffer the caller passes in a static buffer
+ * @param address Address of the buffer
+ * @param size Size of the buffer in bytes
+ */
+static std::vector<u8> ReadBuffer(u32 address, u32 size) {
+    std::vector<u8> buffer(size);
+    const u8* source = (size != 0) ? Memory::GetPointer(address) : NULL;
+    if (source != NULL) {
+        memcpy(buffer.data(), source, size);
+    } else {
+        buffer.clear();
+    }
+    return buffer;
+}
+
+/**
+ * Registers the calling program with APT
+ *  Inputs:
+ *      1 : AppletId of the program
+ *      2 : Attributes of the program
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Handle translation descriptor
+ *      3 : Handle of the notification event
+ *      4 : Handle of the parameter event
+ */
 void Initialize(Service::Interface* self) {
-    NOTICE_LOG(OSHLE, "APT_U::Sync - Initialize");
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 app_id = cmd_buff[1];
+
+    Applet* applet = AddApplet(app_id);
+    applet->process = Kernel::GetCurrentProcessHandle();
+    if (applet->notification_event == 0) {
+        applet->notification_event = Kernel::CreateEvent(RESETTYPE_ONESHOT);
+        applet->parameter_event = Kernel::CreateEvent(RESETTYPE_ONESHOT);
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0x04000000;
+    cmd_buff[3] = Kernel::g_object_pool.Duplicate(applet->notification_event);
+    cmd_buff[4] = Kernel::g_object_pool.Duplicate(applet->parameter_event);
+
+    // There's no home menu, which wakes the application up once it's registered
+    if (app_id == APPLET_ID_APPLICATION) {
+        Parameter wakeup = { APPLET_ID_HOME_MENU, app_id, SIGNAL_WAKEUP, 0 };
+        PostParameter(wakeup);
+    }
+    NOTICE_LOG(OSHLE, "APT_U::Initialize applet 0x%03X", app_id);
 }
 
 void GetLockHandle(Service::Interface* self) {
@@ -26,47 +180,295 @@ void GetLockHandle(Service::Interface* self) {
     DEBUG_LOG(KERNEL, "APT_U::GetLockHandle called : created handle 0x%08X", cmd_buff[5]);
 }
 
+/**
+ * Lets the calling program receive notifications and parameters
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void Enable(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets whether a program is registered with APT
+ *  Inputs:
+ *      1 : AppletId of the program
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : 1 if the program is registered, else 0
+ */
+void IsRegistered(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const Applet* applet = FindApplet(cmd_buff[1]);
+    cmd_buff[1] = 0;
+    cmd_buff[2] = (applet != NULL && applet->notification_event != 0) ? 1 : 0;
+}
+
+/**
+ * Gets the notification pending for a program, as its notification event is signalled
+ *  Inputs:
+ *      1 : AppletId of the program
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Notification, 0 for none
+ */
+void InquireNotification(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0; // No home or power button presses yet
+}
+
+/**
+ * Sends a parameter to a program
+ *  Inputs:
+ *      1 : AppletId of the sender
+ *      2 : AppletId of the destination
+ *      3 : Signal
+ *      4 : Size of the buffer
+ *      6 : Handle handed along, or 0
+ *      8 : Address of the buffer
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SendParameter(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    Parameter parameter;
+    parameter.sender_id = cmd_buff[1];
+    parameter.destination_id = cmd_buff[2];
+    parameter.signal = cmd_buff[3];
+    parameter.handle = Kernel::g_object_pool.Duplicate(cmd_buff[6]);
+    parameter.buffer = ReadBuffer(cmd_buff[8], cmd_buff[4]);
+    PostParameter(parameter);
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Writes the parameter pending for a program to its command buffer
+ * @param app_id AppletId of the program
+ * @param take Whether the program takes the parameter, else it only looks at it
+ */
+static void ReplyParameter(u32 app_id, bool take) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 size = cmd_buff[2];
+    if (!g_parameter_pending || g_parameter.destination_id != app_id) {
+        cmd_buff[1] = ERROR_NO_PARAMETER;
+        return;
+    }
+
+    // The static buffer the program set up for the reply
+    const u32 address = cmd_buff[0x41];
+    const u32 copied = std::min(size, (u32)g_parameter.buffer.size());
+    u8* destination = (copied != 0) ? Memory::GetPointer(address) : NULL;
+    if (destination != NULL) {
+        memcpy(destination, g_parameter.buffer.data(), copied);
+        Memory::MarkRangeDirty(address, copied);
+    }
+
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_parameter.sender_id;
+    cmd_buff[3] = g_parameter.signal;
+    cmd_buff[4] = copied;
+    cmd_buff[5] = 0x10;
+    // Taking the parameter hands its reference over, looking at it gives the program another
+    cmd_buff[6] = take ? g_parameter.handle : Kernel::g_object_pool.Duplicate(g_parameter.handle);
+    cmd_buff[7] = (copied << 14) | 2;
+    cmd_buff[8] = address;
+    if (take) {
+        g_parameter_pending = false;
+        g_parameter.handle = 0;
+        g_parameter.buffer.clear();
+    }
+}
+
+/**
+ * Takes the parameter pending for a program
+ *  Inputs:
+ *      1 : AppletId of the program
+ *      2 : Size of the buffer of the program
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : AppletId of the sender
+ *      3 : Signal
+ *      4 : Size of the buffer written
+ *      6 : Handle handed along, or 0
+ *      8 : Address of the buffer written
+ */
+void ReceiveParameter(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    ReplyParameter(cmd_buff[1], true);
+}
+
+/**
+ * Gets the parameter pending for a program, leaving it pending
+ *  Inputs:
+ *      1 : AppletId of the program
+ *      2 : Size of the buffer of the program
+ *  Outputs:
+ *      Same as ReceiveParameter
+ */
+void GlanceParameter(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    ReplyParameter(cmd_buff[1], false);
+}
+
+/**
+ * Drops the parameter pending, if it was sent between the programs given
+ *  Inputs:
+ *      1 : Whether to check the sender
+ *      2 : AppletId of the sender
+ *      3 : Whether to check the destination
+ *      4 : AppletId of the destination
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : 1 if a parameter was dropped, else 0
+ */
+void CancelParameter(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const bool matches = g_parameter_pending &&
+        (cmd_buff[1] == 0 || g_parameter.sender_id == cmd_buff[2]) &&
+        (cmd_buff[3] == 0 || g_parameter.destination_id == cmd_buff[4]);
+
+    if (matches) {
+        Kernel::g_object_pool.Close(g_parameter.handle);
+        g_parameter_pending = false;
+        g_parameter.handle = 0;
+        g_parameter.buffer.clear();
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = matches ? 1 : 0;
+}
+
+/**
+ * Loads a library applet ahead of its start. There's no applet loader, so this only warns that
+ * the applet will close as it starts.
+ *  Inputs:
+ *      1 : AppletId of the applet
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void PreloadLibraryApplet(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    WARN_LOG(OSHLE, "APT_U applet 0x%03X isn't loaded, it closes as it starts", cmd_buff[1]);
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Finishes loading a library applet, or prepares to start one. Nothing to wait for, no applet is
+ * loaded.
+ *  Inputs:
+ *      1 : AppletId of the applet
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void PrepareLibraryApplet(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Starts a library applet. No applet is loaded, so the applet is cancelled right away and the
+ * calling program stays in the foreground.
+ *  Inputs:
+ *      1 : AppletId of the applet
+ *      2 : Size of the buffer passed to the applet
+ *      4 : Handle passed to the applet, or 0
+ *      6 : Address of the buffer
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void StartLibraryApplet(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 app_id = cmd_buff[1];
+    Applet* applet = AddApplet(app_id);
+    Applet* caller = FindAppletByProcess(Kernel::GetCurrentProcessHandle());
+    applet->caller_id = (caller != NULL) ? caller->id : (u32)APPLET_ID_APPLICATION;
+    cmd_buff[1] = 0;
+
+    // Nothing to run, the caller sees the applet cancelled right away
+    Parameter cancel = { app_id, applet->caller_id, SIGNAL_WAKEUP_CANCEL, 0 };
+    PostParameter(cancel);
+}
+
+/**
+ * Prepares to close the calling library applet
+ *  Inputs:
+ *      1 : Whether the caller isn't paused
+ *      2 : Whether the applet exits
+ *      3 : Whether to jump to the home menu
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void PrepareToCloseLibraryApplet(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Closes the calling library applet, waking up the program that started it
+ *  Inputs:
+ *      1 : Size of the buffer passed to the caller
+ *      3 : Handle passed to the caller, or 0
+ *      5 : Address of the buffer
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void CloseLibraryApplet(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 size = cmd_buff[1];
+    Applet* applet = FindAppletByProcess(Kernel::GetCurrentProcessHandle());
+    cmd_buff[1] = 0;
+    if (applet == NULL) {
+        ERROR_LOG(OSHLE, "APT_U::CloseLibraryApplet called outside of an applet");
+        return;
+    }
+
+    Parameter exit = { applet->id, applet->caller_id, SIGNAL_WAKEUP_EXIT,
+        Kernel::g_object_pool.Duplicate(cmd_buff[3]), ReadBuffer(cmd_buff[5], size) };
+    PostParameter(exit);
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x00010040, GetLockHandle, "GetLockHandle"},
     {0x00020080, Initialize,    "Initialize"},
-    {0x00030040, NULL,          "Enable"},
+    {0x00030040, Enable,        "Enable"},
     {0x00040040, NULL,          "Finalize"},
     {0x00050040, NULL,          "GetAppletManInfo"},
     {0x00060040, NULL,          "GetAppletInfo"},
     {0x00070000, NULL,          "GetLastSignaledAppletId"},
     {0x00080000, NULL,          "CountRegisteredApplet"},
-    {0x00090040, NULL,          "IsRegistered"},
+    {0x00090040, IsRegistered,  "IsRegistered"},
     {0x000A0040, NULL,          "GetAttribute"},
-    {0x000B0040, NULL,          "InquireNotification"},
-    {0x000C0104, NULL,          "SendParameter"},
-    {0x000D0080, NULL,          "ReceiveParameter"},
-    {0x000E0080, NULL,          "GlanceParameter"},
-    {0x000F0100, NULL,          "CancelParameter"},
+    {0x000B0040, InquireNotification, "InquireNotification"},
+    {0x000C0104, SendParameter, "SendParameter"},
+    {0x000D0080, ReceiveParameter, "ReceiveParameter"},
+    {0x000E0080, GlanceParameter, "GlanceParameter"},
+    {0x000F0100, CancelParameter, "CancelParameter"},
     {0x001000C2, NULL,          "DebugFunc"},
     {0x001100C0, NULL,          "MapProgramIdForDebug"},
     {0x00120040, NULL,          "SetHomeMenuAppletIdForDebug"},
     {0x00130000, NULL,          "GetPreparationState"},
     {0x00140040, NULL,          "SetPreparationState"},
     {0x00150140, NULL,          "PrepareToStartApplication"},
-    {0x00160040, NULL,          "PreloadLibraryApplet"},
-    {0x00170040, NULL,          "FinishPreloadingLibraryApplet"},
-    {0x00180040, NULL,          "PrepareToStartLibraryApplet"},
+    {0x00160040, PreloadLibraryApplet, "PreloadLibraryApplet"},
+    {0x00170040, PrepareLibraryApplet, "FinishPreloadingLibraryApplet"},
+    {0x00180040, PrepareLibraryApplet, "PrepareToStartLibraryApplet"},
     {0x00190040, NULL,          "PrepareToStartSystemApplet"},
     {0x001A0000, NULL,          "PrepareToStartNewestHomeMenu"},
     {0x001B00C4, NULL,          "StartApplication"},
     {0x001C0000, NULL,          "WakeupApplication"},
     {0x001D0000, NULL,          "CancelApplication"},
-    {0x001E0084, NULL,          "StartLibraryApplet"},
+    {0x001E0084, StartLibraryApplet, "StartLibraryApplet"},
     {0x001F0084, NULL,          "StartSystemApplet"},
     {0x00200044, NULL,          "StartNewestHomeMenu"},
     {0x00210000, NULL,          "OrderToCloseApplication"},
     {0x00220040, NULL,          "PrepareToCloseApplication"},
     {0x00230040, NULL,          "PrepareToJumpToApplication"},
     {0x00240044, NULL,          "JumpToApplication"},
-    {0x002500C0, NULL,          "PrepareToCloseLibraryApplet"},
+    {0x002500C0, PrepareToCloseLibraryApplet, "PrepareToCloseLibraryApplet"},
     {0x00260000, NULL,          "PrepareToCloseSystemApplet"},
     {0x00270044, NULL,          "CloseApplication"},
-    {0x00280044, NULL,          "CloseLibraryApplet"},
+    {0x00280044, CloseLibraryApplet, "CloseLibraryApplet"},
     {0x00290044, NULL,          "CloseSystemApplet"},
     {0x002A0000, NULL,          "OrderToCloseSystemApplet"},
     {0x002B0000, NULL,          "PrepareToJumpToHomeMenu"},
@@ -115,6 +517,24 @@ Interface::Interface() {
 }
 
 Interface::~Interface() {
+    g_applets.clear();
+    g_parameter = Parameter();
+    g_parameter_pending = false;
+}
+
+/**
+ * Saves or loads the state of the service, the applets and the parameter in flight
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.DoPOD(g_applets);
+    p.Do(g_parameter.sender_id);
+    p.Do(g_parameter.destination_id);
+    p.Do(g_parameter.signal);
+    p.Do(g_parameter.handle);
+    p.Do(g_parameter.buffer);
+    p.Do(g_parameter_pending);
 }
 
 } // namespace
@@ -11,6 +11,14 @@
 
 namespace APT_U {
 
+/// Ids of the programs APT manages, as they identify themselves to it
+enum AppletId {
+    APPLET_ID_HOME_MENU             = 0x101,
+    APPLET_ID_APPLICATION           = 0x300,
+    APPLET_ID_SOFTWARE_KEYBOARD     = 0x401,
+    APPLET_ID_ERROR_DISPLAY         = 0x406,
+};
+
 // Application and title launching service. These services handle signaling for home/power button as
 // well. Only one session for either APT service can be open at a time, normally processes close the
 // service handle immediately once finished using the service. The commands for APT:U and APT:S are 
@@ -32,6 +40,12 @@ public:
     const char *GetPortName() const {
         return "APT:U";
     }
+
+    /**
+     * Saves or loads the state of the service, the applets and the parameter in flight
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
 };
 
 } // namespace
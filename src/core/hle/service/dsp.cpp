@@ -0,0 +1,390 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "common/chunk_file.h"
+#include "common/log.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/hle.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hle/kernel/event.h"
+#include "core/hle/service/dsp.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP_DSP
+
+namespace DSP_DSP {
+
+enum {
+    NUM_INTERRUPTS  = 3,
+    NUM_PIPES       = 8,
+    PIPE_AUDIO      = 2,                        ///< Pipe the audio firmware is driven through
+    INTERRUPT_PIPE  = 2,                        ///< Interrupt of the pipes, by pipe
+};
+
+/// States the application puts the audio firmware in, written to the audio pipe
+enum {
+    AUDIO_STATE_INITIALIZE  = 0,
+    AUDIO_STATE_SHUTDOWN    = 1,
+    AUDIO_STATE_WAKEUP      = 2,
+    AUDIO_STATE_SLEEP       = 3,
+};
+
+static Handle g_semaphore_event = 0;            ///< 0 until the application asks for it
+static Handle g_interrupt_events[NUM_INTERRUPTS][NUM_PIPES] = {};
+static std::vector<u8> g_pipe_data[NUM_PIPES];  ///< Bytes the application is still to read
+static bool g_running = false;                  ///< Whether the firmware runs audio frames
+static bool g_frame_scheduled = false;
+static int g_frame_event = -1;
+
+/// Runs an audio frame and signals the application, every 160 samples while the firmware runs
+static void FrameCallback(u64 userdata, int cycles_late) {
+    if (!g_running) {
+        g_frame_scheduled = false;
+        return;
+    }
+    CoreTiming::ScheduleEvent(DSP::GetFrameCycles() - cycles_late, g_frame_event);
+
+    DSP::RunFrame();
+    if (g_interrupt_events[INTERRUPT_PIPE][PIPE_AUDIO] != 0) {
+        Kernel::SignalEvent(g_interrupt_events[INTERRUPT_PIPE][PIPE_AUDIO]);
+    }
+}
+
+/// Starts running audio frames, from the next frame on
+static void StartFrames() {
+    g_running = true;
+    if (!g_frame_scheduled) {
+        CoreTiming::ScheduleEvent(DSP::GetFrameCycles(), g_frame_event);
+        g_frame_scheduled = true;
+    }
+}
+
+/// Answers the application starting the firmware with the DSP addresses of the structures of
+/// the first region of DSP memory, the second one is at the same offsets
+static void WriteStructAddresses() {
+    static const size_t offsets[] = {
+        offsetof(DSP::SharedMemory, frame_counter),
+        offsetof(DSP::SharedMemory, source_configurations),
+        offsetof(DSP::SharedMemory, source_statuses),
+        offsetof(DSP::SharedMemory, adpcm_coefficients),
+        offsetof(DSP::SharedMemory, dsp_configuration),
+        offsetof(DSP::SharedMemory, dsp_status),
+        offsetof(DSP::SharedMemory, final_samples),
+        offsetof(DSP::SharedMemory, intermediate_mix_samples),
+        offsetof(DSP::SharedMemory, compressor),
+        offsetof(DSP::SharedMemory, dsp_debug),
+        offsetof(DSP::SharedMemory, unknown[0]),
+        offsetof(DSP::SharedMemory, unknown[1]),
+        offsetof(DSP::SharedMemory, unknown[2]),
+        offsetof(DSP::SharedMemory, unknown[3]),
+        offsetof(DSP::SharedMemory, unknown[4]),
+    };
+    std::vector<u8>& pipe = g_pipe_data[PIPE_AUDIO];
+    const u16 count = ARRAY_SIZE(offsets);
+    pipe.insert(pipe.end(), (const u8*)&count, (const u8*)&count + 2);
+    for (size_t i = 0; i < ARRAY_SIZE(offsets); i++) {
+        const u16 address = (u16)(DSP::REGION_0_DSP_ADDR + offsets[i] / 2);
+        pipe.insert(pipe.end(), (const u8*)&address, (const u8*)&address + 2);
+    }
+}
+
+/**
+ * Sets the state of the audio firmware, as the application writes it to the audio pipe
+ * @param state AUDIO_STATE_*
+ */
+static void SetAudioState(u32 state) {
+    switch (state) {
+    case AUDIO_STATE_INITIALIZE:
+        DSP::ResetFrames();
+        WriteStructAddresses();
+        StartFrames();
+        break;
+
+    case AUDIO_STATE_WAKEUP:
+        WriteStructAddresses();
+        StartFrames();
+        break;
+
+    case AUDIO_STATE_SHUTDOWN:
+        g_running = false;
+        DSP::ResetFrames();
+        break;
+
+    case AUDIO_STATE_SLEEP:
+        g_running = false;
+        break;
+
+    default:
+        ERROR_LOG(DSPHLE, "unknown audio firmware state %u", state);
+        break;
+    }
+}
+
+/**
+ * Tells whether the DSP has replied to the application, it always has
+ *  Inputs:
+ *      1 : Register number
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether it has replied
+ */
+void RecvDataIsReady(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 1;
+}
+
+/**
+ * Gets the reply of the DSP to the application, the firmware being ready
+ *  Inputs:
+ *      1 : Register number
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Reply of the DSP
+ */
+void RecvData(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 1;
+}
+
+/**
+ * Gets the address the application accesses a DSP data memory address at
+ *  Inputs:
+ *      1 : DSP address, in 16-bit words
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Virtual address
+ */
+void ConvertProcessAddressFromDspDram(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 address = cmd_buff[1];
+    cmd_buff[1] = 0;
+    cmd_buff[2] = (address << 1) + DSP::DATA_VADDR;
+}
+
+/**
+ * Writes to a pipe of the DSP, the audio pipe sets the state of the audio firmware
+ *  Inputs:
+ *      1 : Pipe
+ *      2 : Size in bytes
+ *      3 : Static buffer descriptor
+ *      4 : Address of the data
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void WriteProcessPipe(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 pipe = cmd_buff[1];
+    const u32 size = cmd_buff[2];
+    const u32 address = cmd_buff[4];
+
+    if (pipe == PIPE_AUDIO && size >= 4) {
+        SetAudioState(Memory::Read32(address));
+    } else {
+        DEBUG_LOG(DSPHLE, "ignored write of %u bytes to pipe %u", size, pipe);
+    }
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Reads the bytes the DSP wrote to a pipe, as many as there are up to a size
+ *  Inputs:
+ *      1 : Pipe
+ *      2 : Peer
+ *      3 : Size in bytes
+ *      0x41 : Address of the static buffer receiving the data
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Number of bytes read
+ *      3 : Static buffer descriptor
+ *      4 : Address of the data
+ */
+void ReadPipeIfPossible(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 pipe = cmd_buff[1];
+    const u32 size = cmd_buff[3] & 0xFFFF;
+    const u32 address = cmd_buff[0x41];
+
+    u32 read = 0;
+    if (pipe < NUM_PIPES) {
+        std::vector<u8>& data = g_pipe_data[pipe];
+        read = std::min(size, (u32)data.size());
+        for (u32 i = 0; i < read; i++) {
+            Memory::Write8(address + i, data[i]);
+        }
+        data.erase(data.begin(), data.begin() + read);
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = read;
+    cmd_buff[3] = (read << 14) | 2;
+    cmd_buff[4] = address;
+}
+
+/**
+ * Loads the firmware of the DSP, which is emulated and always loads
+ *  Inputs:
+ *      1 : Size of the firmware
+ *      2 : Program memory mask
+ *      3 : Data memory mask
+ *      4 : Mapped buffer descriptor
+ *      5 : Address of the firmware
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether the firmware is loaded
+ *      3 : Mapped buffer descriptor
+ *      4 : Address of the firmware
+ */
+void LoadComponent(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 size = cmd_buff[1];
+    const u32 address = cmd_buff[5];
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 1;
+    cmd_buff[3] = (size << 4) | 0xA;
+    cmd_buff[4] = address;
+
+    NOTICE_LOG(DSPHLE, "firmware of %u bytes loaded, emulated at a high level", size);
+}
+
+/**
+ * Flushes or invalidates the data cache over a range, the DSP sees guest memory as it is
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void FlushDataCache(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Registers the event signalled on an interrupt of a pipe
+ *  Inputs:
+ *      1 : Interrupt
+ *      2 : Pipe
+ *      4 : Event handle, 0 to unregister the event
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void RegisterInterruptEvents(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 interrupt = cmd_buff[1];
+    const u32 pipe = cmd_buff[2];
+    if (interrupt < NUM_INTERRUPTS && pipe < NUM_PIPES) {
+        // The service keeps a reference, the application may close its handle
+        Kernel::g_object_pool.Close(g_interrupt_events[interrupt][pipe]);
+        g_interrupt_events[interrupt][pipe] = Kernel::g_object_pool.Duplicate(cmd_buff[4]);
+    } else {
+        ERROR_LOG(DSPHLE, "invalid interrupt %u of pipe %u", interrupt, pipe);
+    }
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the event signalled along with the semaphore of the DSP
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Handle translation descriptor
+ *      3 : Event handle
+ */
+void GetSemaphoreEventHandle(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    if (g_semaphore_event == 0) {
+        g_semaphore_event = Kernel::CreateEvent(RESETTYPE_ONESHOT);
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0;
+    cmd_buff[3] = Kernel::g_object_pool.Duplicate(g_semaphore_event);
+}
+
+/**
+ * Tells whether headphones are plugged in, they never are
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether headphones are plugged in
+ */
+void GetHeadphoneStatus(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0;
+}
+
+/**
+ * Accepts a command the emulated firmware has no use for
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void Ignore(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+}
+
+const Interface::FunctionInfo FunctionTable[] = {
+    {0x00010040, RecvData,                          "RecvData"},
+    {0x00020040, RecvDataIsReady,                   "RecvDataIsReady"},
+    {0x00030080, NULL,                              "SendData"},
+    {0x00040040, NULL,                              "SendDataIsEmpty"},
+    {0x00070040, Ignore,                            "WriteReg0x10"},
+    {0x00080000, NULL,                              "GetSemaphore"},
+    {0x00090040, Ignore,                            "ClearSemaphore"},
+    {0x000B0000, NULL,                              "CheckSemaphoreRequest"},
+    {0x000C0040, ConvertProcessAddressFromDspDram,  "ConvertProcessAddressFromDspDram"},
+    {0x000D0082, WriteProcessPipe,                  "WriteProcessPipe"},
+    {0x001000C0, ReadPipeIfPossible,                "ReadPipeIfPossible"},
+    {0x001100C2, LoadComponent,                     "LoadComponent"},
+    {0x00120000, Ignore,                            "UnloadComponent"},
+    {0x00130082, FlushDataCache,                    "FlushDataCache"},
+    {0x00140082, FlushDataCache,                    "InvalidateDCache"},
+    {0x00150082, RegisterInterruptEvents,           "RegisterInterruptEvents"},
+    {0x00160000, GetSemaphoreEventHandle,           "GetSemaphoreEventHandle"},
+    {0x00170040, Ignore,                            "SetSemaphoreMask"},
+    {0x001F0000, GetHeadphoneStatus,                "GetHeadphoneStatus"},
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interface class
+
+Interface::Interface() {
+    Register(FunctionTable, ARRAY_SIZE(FunctionTable));
+    g_frame_event = CoreTiming::RegisterEvent("DSP::AudioFrame", FrameCallback);
+    DSP::Init();
+}
+
+Interface::~Interface() {
+    DSP::Shutdown();
+    g_semaphore_event = 0;
+    memset(g_interrupt_events, 0, sizeof(g_interrupt_events));
+    for (int i = 0; i < NUM_PIPES; i++) {
+        g_pipe_data[i].clear();
+    }
+    g_running = false;
+    g_frame_scheduled = false;
+}
+
+/**
+ * Saves or loads the state of the service, with the events it was given, the pipes and the
+ * voices of the firmware. The audio frames are scheduled in CoreTiming, which has its own
+ * state.
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.Do(g_semaphore_event);
+    p.DoArray(&g_interrupt_events[0][0], NUM_INTERRUPTS * NUM_PIPES);
+    for (int i = 0; i < NUM_PIPES; i++) {
+        p.Do(g_pipe_data[i]);
+    }
+    p.Do(g_running);
+    p.Do(g_frame_scheduled);
+    DSP::DoState(p);
+}
+
+} // namespace
@@ -0,0 +1,44 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "core/hle/service/service.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP_DSP
+
+// This service loads the audio firmware into the DSP and talks to it through pipes and interrupts.
+// The firmware is emulated at a high level (see core/hle/dsp/dsp.h): once the application starts
+// it through the audio pipe, the service runs an audio frame on a CoreTiming event every 160
+// samples and signals the interrupt event the application registered for the pipe.
+
+namespace DSP_DSP {
+
+class Interface : public Service::Interface {
+public:
+
+    Interface();
+
+    ~Interface();
+
+    /**
+     * Gets the string port name used by CTROS for the service
+     * @return Port name of service
+     */
+    const char *GetPortName() const {
+        return "dsp::DSP";
+    }
+
+    /**
+     * Saves or loads the state of the service, with the events it was given, the pipes and the
+     * voices of the firmware. The audio frames are scheduled in CoreTiming, which has its own
+     * state.
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
+};
+
+} // namespace
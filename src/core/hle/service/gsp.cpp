@@ -2,17 +2,26 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <string.h>
+
+#include <algorithm>
 
 #include "common/log.h"
 #include "common/bit_field.h"
+#include "common/chunk_file.h"
 
 #include "core/mem_map.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/event.h"
 #include "core/hle/service/gsp.h"
 
 #include "core/hw/gpu.h"
+#include "core/hw/hw.h"
 
 #include "video_core/gpu_debugger.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/pica_trace.h"
+#include "video_core/rasterizer.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -45,14 +54,17 @@ static inline u8* GX_GetCmdBufferPointer(u32 thread_id, u32 offset=0) {
     return Memory::GetPointer(GX_GetCmdBufferAddress(thread_id) + offset);
 }
 
-/// Finishes execution of a GSP command
+/// Number of command slots of a GX command buffer, after its header
+static const u32 kGXCommandSlots = 15;
+
+/// Finishes execution of a GSP command, moving the buffer on to the next one
 void GX_FinishCommand(u32 thread_id) {
     GX_CmdBufferHeader* header = (GX_CmdBufferHeader*)GX_GetCmdBufferPointer(thread_id);
 
     g_debugger.GXCommandProcessed(GX_GetCmdBufferPointer(thread_id, 0x20 + (header->index * 0x20)));
 
+    header->index = (header->index + 1) % kGXCommandSlots;
     header->number_commands = header->number_commands - 1;
-    // TODO: Increment header->index?
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -61,6 +73,43 @@ void GX_FinishCommand(u32 thread_id) {
 namespace GSP_GPU {
 
 u32 g_thread_id = 0;
+bool g_interrupt_relay_registered = false;  ///< Whether the application takes interrupts
+Handle g_interrupt_event = 0;               ///< Event signalled as interrupts are queued
+
+/// Interrupt relay queue of a thread in GSP shared memory, a ring of interrupt ids
+struct InterruptRelayQueue {
+    u8 index;               ///< Slot of the oldest interrupt not taken by the application
+    u8 number_interrupts;
+    u8 error_code;          ///< Set when an interrupt was dropped, the ring being full
+    u8 padding;
+    u8 slot[0x34];
+    u8 reserved[8];
+};
+static_assert(sizeof(InterruptRelayQueue) == 0x40, "InterruptRelayQueue has the wrong size");
+
+/// Gets the interrupt relay queue of a thread in GSP shared memory
+static inline InterruptRelayQueue* GetInterruptRelayQueue(u32 thread_id) {
+    return (InterruptRelayQueue*)Memory::GetPointer(0x10002000 + thread_id * 0x40);
+}
+
+/**
+ * Signals a GSP interrupt to the application, if it registered an interrupt relay queue
+ * @param interrupt_id Interrupt to signal
+ */
+void SignalInterrupt(InterruptId interrupt_id) {
+    if (!g_interrupt_relay_registered) {
+        return;
+    }
+    InterruptRelayQueue* queue = GetInterruptRelayQueue(g_thread_id);
+    if (queue->number_interrupts >= ARRAY_SIZE(queue->slot)) {
+        queue->error_code = 1;
+        return;
+    }
+    queue->slot[(queue->index + queue->number_interrupts) % ARRAY_SIZE(queue->slot)] =
+        (u8)interrupt_id;
+    queue->number_interrupts++;
+    Kernel::SignalEvent(g_interrupt_event);
+}
 
 enum {
     REG_FRAMEBUFFER_1   = 0x00400468,
@@ -74,8 +123,11 @@ void ReadHWRegs(Service::Interface* self) {
 
     u32* cmd_buff = Service::GetCommandBuffer();
     u32 reg_addr = cmd_buff[1];
+
+    // The guest expects to see the state left by all the command lists it submitted
+    GPUThread::Sync();
     u32 size = cmd_buff[2];
-    u32* dst = (u32*)Memory::GetPointer(cmd_buff[0x41]);
+    u32 dst = cmd_buff[0x41];
 
     switch (reg_addr) {
 
@@ -86,13 +138,13 @@ void ReadHWRegs(Service::Interface* self) {
     // Top framebuffer 1 addresses
     case REG_FRAMEBUFFER_1:
         GPU::SetFramebufferLocation(GPU::FRAMEBUFFER_LOCATION_VRAM);
-        memcpy(dst, framebuffer_1, size);
+        Memory::WriteBlock(dst, framebuffer_1, std::min<u32>(size, sizeof(framebuffer_1)));
         break;
 
     // Top framebuffer 2 addresses
     case REG_FRAMEBUFFER_2:
         GPU::SetFramebufferLocation(GPU::FRAMEBUFFER_LOCATION_VRAM);
-        memcpy(dst, framebuffer_2, size);
+        Memory::WriteBlock(dst, framebuffer_2, std::min<u32>(size, sizeof(framebuffer_2)));
         break;
 
     default:
@@ -101,45 +153,124 @@ void ReadHWRegs(Service::Interface* self) {
 
 }
 
+/**
+ * GSP_GPU::RegisterInterruptRelayQueue service function
+ *  Inputs:
+ *      1 : Flags
+ *      3 : Event signalled as interrupts are queued
+ *  Outputs:
+ *      1 : 0x2A07 the first time the queue is registered, 0 after
+ *      2 : Thread index of the interrupt relay queue in GSP shared memory
+ */
 void RegisterInterruptRelayQueue(Service::Interface* self) {
     u32* cmd_buff = Service::GetCommandBuffer();
-    u32 flags = cmd_buff[1];
-    u32 event_handle = cmd_buff[3]; // TODO(bunnei): Implement event handling
+    const bool first_initialization = g_interrupt_event == 0;
+
+    // The service keeps a reference, the application may close its handle
+    Kernel::g_object_pool.Close(g_interrupt_event);
+    g_interrupt_event = Kernel::g_object_pool.Duplicate(cmd_buff[3]);
 
+    // Interrupts are how the guest learns that its command lists are done
+    GPUThread::Sync();
+    memset(GetInterruptRelayQueue(g_thread_id), 0, sizeof(InterruptRelayQueue));
+    g_interrupt_relay_registered = true;
+
+    // The application sets up the framebuffers on the first registration only
+    cmd_buff[1] = first_initialization ? 0x2A07 : 0;
     cmd_buff[2] = g_thread_id;          // ThreadID
 }
 
+/**
+ * GSP_GPU::UnregisterInterruptRelayQueue service function
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void UnregisterInterruptRelayQueue(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+
+    // Interrupts raised from here on are dropped, the event stays for another registration
+    g_interrupt_relay_registered = false;
 
-/// This triggers handling of the GX command written to the command buffer in shared memory.
-void TriggerCmdReqQueue(Service::Interface* self) {
-    GX_CmdBufferHeader* header = (GX_CmdBufferHeader*)GX_GetCmdBufferPointer(g_thread_id);
-    u32* cmd_buff = (u32*)GX_GetCmdBufferPointer(g_thread_id, 0x20 + (header->index * 0x20));
+    cmd_buff[1] = 0;
+}
 
+
+/**
+ * Executes a GX command of the command buffer in shared memory
+ * @param cmd_buff Command, its id first
+ * @return Whether the command was a DMA, which only interrupts once the batch is done
+ */
+bool ExecuteGXCommand(const u32* cmd_buff) {
     switch (static_cast<GXCommandId>(cmd_buff[0])) {
 
     // GX request DMA - typically used for copying memory from GSP heap to VRAM
     case GXCommandId::REQUEST_DMA:
-        memcpy(Memory::GetPointer(cmd_buff[2]), Memory::GetPointer(cmd_buff[1]), cmd_buff[3]);
-        break;
+    {
+        // Rendered surfaces may only be up to date on the host GPU
+        const u32 src = Memory::PhysicalAddressFromVirtual(cmd_buff[1]);
+        const u32 dst = Memory::PhysicalAddressFromVirtual(cmd_buff[2]);
+        Pica::Rasterizer::FlushRegion(src, cmd_buff[3]);
+        Pica::Rasterizer::FlushRegion(dst, cmd_buff[3]);
+        Memory::CopyBlock(cmd_buff[2], cmd_buff[1], cmd_buff[3]);
+        Pica::Rasterizer::InvalidateRegion(dst, cmd_buff[3]);
+        return true;
+    }
 
     case GXCommandId::SET_COMMAND_LIST_LAST:
-        GPU::Write<u32>(GPU::Registers::CommandListAddress, cmd_buff[1] >> 3);
-        GPU::Write<u32>(GPU::Registers::CommandListSize, cmd_buff[2] >> 3);
-        GPU::Write<u32>(GPU::Registers::ProcessCommandList, 1); // TODO: Not sure if we are supposed to always write this
+        HW::Write<u32>(GPU::Registers::CommandListAddress, cmd_buff[1] >> 3);
+        HW::Write<u32>(GPU::Registers::CommandListSize, cmd_buff[2] >> 3);
+        HW::Write<u32>(GPU::Registers::ProcessCommandList, 1); // TODO: Not sure if we are supposed to always write this
 
         // TODO: Move this to GPU
         // TODO: Not sure what units the size is measured in
         g_debugger.CommandListCalled(cmd_buff[1], (u32*)Memory::GetPointer(cmd_buff[1]), cmd_buff[2]);
         break;
 
+    // Fills up to two buffers, a buffer with a start address of 0 is unused
     case GXCommandId::SET_MEMORY_FILL:
+        for (int n = 0; n < 2; n++) {
+            const u32* buffer = cmd_buff + 1 + n * 3;
+            if (buffer[0] == 0) {
+                continue;
+            }
+            GPU::MemoryFillConfig config;
+            config.start_address = Memory::PhysicalAddressFromVirtual(buffer[0]);
+            config.value = buffer[1];
+            config.end_address = Memory::PhysicalAddressFromVirtual(buffer[2]);
+            config.width = (GPU::MemoryFillConfig::Width)((cmd_buff[7] >> (n * 16 + 8)) & 3);
+            config.engine = n;
+            GPU::MemoryFill(config);
+        }
         break;
 
     case GXCommandId::SET_DISPLAY_TRANSFER:
+    {
+        GPU::DisplayTransferConfig config;
+        config.input_address = Memory::PhysicalAddressFromVirtual(cmd_buff[1]);
+        config.output_address = Memory::PhysicalAddressFromVirtual(cmd_buff[2]);
+        config.input_width = cmd_buff[3] & 0xFFFF;
+        config.input_height = cmd_buff[3] >> 16;
+        config.output_width = cmd_buff[4] & 0xFFFF;
+        config.output_height = cmd_buff[4] >> 16;
+        config.flags.hex = cmd_buff[5];
+        GPU::DisplayTransfer(config);
         break;
+    }
 
+    // Line widths and gaps are given in units of 16 bytes
     case GXCommandId::SET_TEXTURE_COPY:
+    {
+        GPU::TextureCopyConfig config;
+        config.input_address = Memory::PhysicalAddressFromVirtual(cmd_buff[1]);
+        config.output_address = Memory::PhysicalAddressFromVirtual(cmd_buff[2]);
+        config.size = cmd_buff[3];
+        config.input_width = (cmd_buff[4] & 0xFFFF) * 16;
+        config.input_gap = (cmd_buff[4] >> 16) * 16;
+        config.output_width = (cmd_buff[5] & 0xFFFF) * 16;
+        config.output_gap = (cmd_buff[5] >> 16) * 16;
+        GPU::TextureCopy(config);
         break;
+    }
 
     case GXCommandId::SET_COMMAND_LIST_FIRST:
     {
@@ -152,8 +283,32 @@ void TriggerCmdReqQueue(Service::Interface* self) {
     default:
         ERROR_LOG(GSP, "TriggerCmdReqQueue unknown command 0x%08X", cmd_buff[0]);
     }
+    return false;
+}
+
+/**
+ * This triggers handling of the GX commands written to the command buffer in shared memory. All
+ * of the commands queued are handled at once, the application only triggers as the buffer
+ * goes from empty to one command and keeps queueing more meanwhile.
+ */
+void TriggerCmdReqQueue(Service::Interface* self) {
+    GX_CmdBufferHeader* header = (GX_CmdBufferHeader*)GX_GetCmdBufferPointer(g_thread_id);
 
-    GX_FinishCommand(g_thread_id);
+    // A corrupt count would otherwise have the loop run over the commands again and again
+    u32 count = std::min<u32>(header->number_commands, kGXCommandSlots);
+    bool dma_done = false;
+    for (; count > 0; count--) {
+        const u32* cmd_buff = (const u32*)GX_GetCmdBufferPointer(g_thread_id,
+            0x20 + (header->index * 0x20));
+        PicaTrace::OnGXCommand(cmd_buff);
+        if (ExecuteGXCommand(cmd_buff)) {
+            dma_done = true;
+        }
+        GX_FinishCommand(g_thread_id);
+    }
+    if (dma_done) {
+        SignalInterrupt(InterruptId::DMA);
+    }
 }
 
 const Interface::FunctionInfo FunctionTable[] = {
@@ -176,7 +331,7 @@ const Interface::FunctionInfo FunctionTable[] = {
     {0x00110040, NULL,                          "SetPerfLogMode"},
     {0x00120000, NULL,                          "GetPerfLog"},
     {0x00130042, RegisterInterruptRelayQueue,   "RegisterInterruptRelayQueue"},
-    {0x00140000, NULL,                          "UnregisterInterruptRelayQueue"},
+    {0x00140000, UnregisterInterruptRelayQueue, "UnregisterInterruptRelayQueue"},
     {0x00150002, NULL,                          "TryAcquireRight"},
     {0x00160042, NULL,                          "AcquireRight"},
     {0x00170000, NULL,                          "ReleaseRight"},
@@ -197,6 +352,20 @@ Interface::Interface() {
 }
 
 Interface::~Interface() {
+    // The kernel objects go with the object pool, the next boot registers again
+    g_interrupt_relay_registered = false;
+    g_interrupt_event = 0;
+}
+
+/**
+ * Saves or loads the state of the service, with the interrupt relay queue registration
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.Do(g_thread_id);
+    p.Do(g_interrupt_relay_registered);
+    p.Do(g_interrupt_event);
 }
 
 } // namespace
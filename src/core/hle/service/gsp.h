@@ -28,6 +28,30 @@ union GXCommand {
     u32 data[0x20];
 };
 
+/// GSP interrupts, as the application sees them in its interrupt relay queue
+enum class InterruptId : u8 {
+    PSC0    = 0x00,     ///< Memory fill 0 done
+    PSC1    = 0x01,     ///< Memory fill 1 done
+    PDC0    = 0x02,     ///< Vertical blank of the top screen
+    PDC1    = 0x03,     ///< Vertical blank of the bottom screen
+    PPF     = 0x04,     ///< Display transfer or texture copy done
+    P3D     = 0x05,     ///< Command list done
+    DMA     = 0x06,
+};
+
+/**
+ * Signals a GSP interrupt to the application, if it registered an interrupt relay queue
+ * @param interrupt_id Interrupt to signal
+ */
+void SignalInterrupt(InterruptId interrupt_id);
+
+/**
+ * Executes a GX command of the command buffer in shared memory
+ * @param cmd_buff Command, its id first
+ * @return Whether the command was a DMA, which only interrupts once the batch is done
+ */
+bool ExecuteGXCommand(const u32* cmd_buff);
+
 /// Interface to "srv:" service
 class Interface : public Service::Interface {
 public:
@@ -44,6 +68,12 @@ public:
         return "gsp::Gpu";
     }
 
+    /**
+     * Saves or loads the state of the service, with the interrupt relay queue registration
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
 };
 
 } // namespace
@@ -2,9 +2,18 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <atomic>
+#include <cstddef>
+
+#include "common/chunk_file.h"
 #include "common/log.h"
 
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/movie.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/event.h"
+#include "core/hle/kernel/shared_memory.h"
 #include "core/hle/service/hid.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -12,8 +21,174 @@
 
 namespace HID_User {
 
+/// Entry of the pad state ring in HID shared memory
+struct PadDataEntry {
+    u32 current_state;      ///< Buttons held down, PadButton bits
+    u32 delta_additions;    ///< Buttons pressed since the previous entry
+    u32 delta_removals;     ///< Buttons released since the previous entry
+    s16 circle_pad_x;
+    s16 circle_pad_y;
+};
+static_assert(sizeof(PadDataEntry) == 0x10, "PadDataEntry has the wrong size");
+
+/// Entry of the touch screen ring in HID shared memory
+struct TouchDataEntry {
+    u16 x;
+    u16 y;
+    u32 valid;              ///< Whether the screen is touched, else the position is stale
+};
+static_assert(sizeof(TouchDataEntry) == 0x8, "TouchDataEntry has the wrong size");
+
+/// Input rings at the start of HID shared memory, the application reads the latest entries
+struct SharedMem {
+    // Pad state
+    s64             pad_index_reset_ticks;          ///< CPU ticks as the index last wrapped to 0
+    s64             pad_index_reset_ticks_previous;
+    u32             pad_index;                      ///< Entry of the latest update
+    u32             pad_padding0[2];
+    u32             pad_current_state;              ///< Raw buttons, as the latest entry
+    s16             pad_circle_pad_x;
+    s16             pad_circle_pad_y;
+    u32             pad_padding1;
+    PadDataEntry    pad_entries[8];
+
+    // Touch screen
+    s64             touch_index_reset_ticks;
+    s64             touch_index_reset_ticks_previous;
+    u32             touch_index;
+    u32             touch_padding0;
+    TouchDataEntry  touch_raw;
+    TouchDataEntry  touch_entries[8];
+};
+static_assert(offsetof(SharedMem, pad_entries) == 0x28, "Pad entries have the wrong offset");
+static_assert(offsetof(SharedMem, touch_index_reset_ticks) == 0xA8,
+    "Touch data has the wrong offset");
+static_assert(sizeof(SharedMem) == 0x108, "SharedMem has the wrong size");
+
+/// Events of GetIPCHandles, in the order of the reply
+enum {
+    EVENT_PAD_0,
+    EVENT_PAD_1,
+    EVENT_ACCELEROMETER,
+    EVENT_GYROSCOPE,
+    EVENT_DEBUG_PAD,
+    NUM_EVENTS,
+};
+
+static std::atomic<u32> g_frontend_pad_state(0);    ///< Buttons the frontend holds down
+static u32 g_pad_state = 0;                         ///< Pad state of the current frame
+
+static Handle g_shared_mem = 0;                     ///< 0 until the application asks for it
+static Handle g_events[NUM_EVENTS] = {};
+static u32 g_last_pad_state = 0;                    ///< Of the latest entry of the pad ring
+static bool g_ring_update_scheduled = false;
+static int g_ring_update_event = -1;
+
+/// The hardware samples the pad and the touch screen every 4 ms
+static const int kRingUpdateMs = 4;
+
+/**
+ * Sets the buttons the frontend holds down, from any thread. The application sees them from the
+ * next vertical blank on.
+ * @param state Pad state, PadButton bits
+ */
+void SetPadState(u32 state) {
+    g_frontend_pad_state.store(state, std::memory_order_relaxed);
+}
+
+/**
+ * Gets the pad state the application sees, latched at the last vertical blank
+ * @return Pad state, PadButton bits
+ */
+u32 GetPadState() {
+    return g_pad_state;
+}
+
+/// Latches the pad state of the next frame, played back from a movie if one is, called once per
+/// vertical blank
+void Update() {
+    g_pad_state = Movie::OnFrame(g_frontend_pad_state.load(std::memory_order_relaxed));
+}
+
+/**
+ * Gets the next entry of an input ring, keeping the index and tick count of the ring
+ * @param index Index of the latest entry of the ring
+ * @param reset_ticks Tick count as the index last wrapped to 0
+ * @param reset_ticks_previous Tick count of the wrap before that
+ */
+static void AdvanceRing(u32& index, s64& reset_ticks, s64& reset_ticks_previous) {
+    index = (index + 1) % 8;
+    if (index == 0) {
+        reset_ticks_previous = reset_ticks;
+        reset_ticks = (s64)CoreTiming::GetTicks();
+    }
+}
+
+/// Writes the next entries of the input rings in shared memory and signals the application
+static void RingUpdateCallback(u64 userdata, int cycles_late) {
+    CoreTiming::ScheduleEvent(msToCycles(kRingUpdateMs) - cycles_late, g_ring_update_event);
+
+    const u32 address = Kernel::GetSharedMemoryAddress(g_shared_mem);
+    SharedMem* mem = (address != 0) ? (SharedMem*)Memory::GetPointer(address) : NULL;
+    if (mem == NULL) {
+        return;
+    }
+
+    // What the application sees only changes at vertical blanks, so that movies stay in sync
+    const u32 state = g_pad_state;
+    AdvanceRing(mem->pad_index, mem->pad_index_reset_ticks, mem->pad_index_reset_ticks_previous);
+    PadDataEntry& pad = mem->pad_entries[mem->pad_index];
+    pad.current_state = state;
+    pad.delta_additions = state & ~g_last_pad_state;
+    pad.delta_removals = g_last_pad_state & ~state;
+    pad.circle_pad_x = pad.circle_pad_y = 0;
+    mem->pad_current_state = state;
+    g_last_pad_state = state;
+
+    // No touch screen input yet, the application still sees its ring move on
+    AdvanceRing(mem->touch_index, mem->touch_index_reset_ticks,
+        mem->touch_index_reset_ticks_previous);
+    TouchDataEntry& touch = mem->touch_entries[mem->touch_index];
+    touch.x = touch.y = 0;
+    touch.valid = 0;
+    mem->touch_raw = touch;
+
+    Memory::MarkRangeDirty(address, sizeof(SharedMem));
+    Kernel::SignalEvent(g_events[EVENT_PAD_0]);
+}
+
+/**
+ * Gets the shared memory and the events of the service, and starts updating the rings in the
+ * shared memory
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Handle translation descriptor
+ *      3 : Shared memory handle
+ *      4-8 : Handles of the PAD0, PAD1, accelerometer, gyroscope and debug pad events
+ */
+void GetIPCHandles(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    if (g_shared_mem == 0) {
+        g_shared_mem = Kernel::CreateSharedMemory(sizeof(SharedMem));
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            g_events[i] = Kernel::CreateEvent(RESETTYPE_ONESHOT);
+        }
+    }
+    if (!g_ring_update_scheduled) {
+        CoreTiming::ScheduleEvent(msToCycles(kRingUpdateMs), g_ring_update_event);
+        g_ring_update_scheduled = true;
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0x14000000;
+    // The application gets handles of its own, closing them leaves those of the service
+    cmd_buff[3] = Kernel::g_object_pool.Duplicate(g_shared_mem);
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        cmd_buff[4 + i] = Kernel::g_object_pool.Duplicate(g_events[i]);
+    }
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
-    {0x000A0000, NULL, "GetIPCHandles"},
+    {0x000A0000, GetIPCHandles, "GetIPCHandles"},
     {0x00110000, NULL, "EnableAccelerometer"},
     {0x00130000, NULL, "EnableGyroscopeLow"},
     {0x00150000, NULL, "GetGyroscopeLowRawToDpsCoefficient"},
@@ -25,9 +200,28 @@ const Interface::FunctionInfo FunctionTable[] = {
 
 Interface::Interface() {
     Register(FunctionTable, ARRAY_SIZE(FunctionTable));
+    g_ring_update_event = CoreTiming::RegisterEvent("HID::RingUpdate", RingUpdateCallback);
 }
 
 Interface::~Interface() {
+    g_shared_mem = 0;
+    memset(g_events, 0, sizeof(g_events));
+    g_last_pad_state = 0;
+    g_ring_update_scheduled = false;
+}
+
+/**
+ * Saves or loads the state of the service, with the latched pad state and the handles it gave
+ * out. The update of the rings is scheduled in CoreTiming, which has its own state.
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.Do(g_pad_state);
+    p.Do(g_shared_mem);
+    p.DoArray(g_events, NUM_EVENTS);
+    p.Do(g_last_pad_state);
+    p.Do(g_ring_update_scheduled);
 }
 
 } // namespace
@@ -11,9 +11,46 @@
 
 // This service is used for interfacing to physical user controls... perhaps "Human Interface 
 // Devices"? Uses include game pad controls, accelerometers, gyroscopes, etc.
+//
+// The application reads the input from rings in shared memory that the service writes at the
+// sampling rate of the hardware, on a CoreTiming event. The frontend sets the input from its own
+// thread, the emulation thread only ever reads a snapshot of it.
 
 namespace HID_User {
 
+/// Pad buttons, as bits of a pad state
+enum PadButton : u32 {
+    PAD_A       = (1 << 0),
+    PAD_B       = (1 << 1),
+    PAD_SELECT  = (1 << 2),
+    PAD_START   = (1 << 3),
+    PAD_RIGHT   = (1 << 4),
+    PAD_LEFT    = (1 << 5),
+    PAD_UP      = (1 << 6),
+    PAD_DOWN    = (1 << 7),
+    PAD_R       = (1 << 8),
+    PAD_L       = (1 << 9),
+    PAD_X       = (1 << 10),
+    PAD_Y       = (1 << 11),
+};
+
+/**
+ * Sets the buttons the frontend holds down, from any thread. The application sees them from the
+ * next vertical blank on.
+ * @param state Pad state, PadButton bits
+ */
+void SetPadState(u32 state);
+
+/**
+ * Gets the pad state the application sees, latched at the last vertical blank
+ * @return Pad state, PadButton bits
+ */
+u32 GetPadState();
+
+/// Latches the pad state of the next frame, played back from a movie if one is, called once per
+/// vertical blank
+void Update();
+
 class Interface : public Service::Interface {
 public:
 
@@ -29,6 +66,13 @@ public:
         return "hid:USER";
     }
 
+    /**
+     * Saves or loads the state of the service, with the latched pad state and the handles it gave
+     * out. The update of the rings is scheduled in CoreTiming, which has its own state.
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
 };
 
 } // namespace
@@ -0,0 +1,299 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/chunk_file.h"
+#include "common/crypto.h"
+#include "common/log.h"
+
+#include "core/mem_map.h"
+#include "core/hle/hle.h"
+#include "core/hle/service/ps.h"
+#include "core/hw/aes_keys.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace PS_PS
+
+namespace PS_PS {
+
+/// Modes of the AES engine, as the commands take them
+enum {
+    ALGORITHM_CBC_ENCRYPT   = 0,
+    ALGORITHM_CBC_DECRYPT   = 1,
+    ALGORITHM_CTR_ENCRYPT   = 2,
+    ALGORITHM_CTR_DECRYPT   = 3,
+    ALGORITHM_CCM_ENCRYPT   = 4,
+    ALGORITHM_CCM_DECRYPT   = 5,
+};
+
+/// Key slots of the key types the commands take, -1 for the key type that uses the slot last set
+static const int kKeyTypeSlots[] = {
+    0x0D, 0x2D, 0x31, 0x38, 0x32, 0x39, 0x2E, -1, 0x36, 0x39,
+};
+
+/// Result of the commands given something they can't do. The codes of the system aren't known,
+/// any failure keeps the applications from using the data.
+static const u32 ERROR_INVALID = 0xE0E01BEE;
+/// Result of a CCM decryption whose MAC doesn't match the data
+static const u32 ERROR_MAC_MISMATCH = 0xC8A01BEF;
+
+/// Seed of the xorshift generator of the random bytes, the same every boot for the runs to be
+/// reproducible
+static const u64 kRandomSeed = 0x9E3779B97F4A7C15ULL;
+static u64 g_random_state = kRandomSeed;
+
+/// Seed of the friend codes and ID of the console, a made up console
+static const u64 kLocalFriendCodeSeed = 0x0000012345678ABCULL;
+static const u32 kDeviceId = 0x12345678;
+
+/**
+ * Gets the key of a key type the commands take
+ * @param key_type Key type
+ * @param aes Receives the key
+ * @return False if the key isn't known, logged
+ */
+static bool GetKey(u32 key_type, Common::AES128& aes) {
+    u8 key[AESKeys::KEY_SIZE];
+    if (key_type >= ARRAY_SIZE(kKeyTypeSlots) || kKeyTypeSlots[key_type] < 0) {
+        ERROR_LOG(HLE, "unsupported key type %u", key_type);
+        return false;
+    }
+    if (!AESKeys::GetNormalKey(kKeyTypeSlots[key_type], key)) {
+        ERROR_LOG(HLE, "no key for slot 0x%02X (key type %u) in the keys file",
+            kKeyTypeSlots[key_type], key_type);
+        return false;
+    }
+    aes.SetKey(key);
+    return true;
+}
+
+/**
+ * Adds a number of blocks to a big endian counter, as counter mode does over the data
+ * @param ctr Counter
+ * @param num_blocks Number of blocks
+ */
+static void AdvanceCounter(u8 ctr[Common::AES128::BLOCK_SIZE], u32 num_blocks) {
+    u32 carry = num_blocks;
+    for (int i = Common::AES128::BLOCK_SIZE - 1; i >= 0 && carry != 0; i--) {
+        carry += ctr[i];
+        ctr[i] = (u8)carry;
+        carry >>= 8;
+    }
+}
+
+/**
+ * PS_PS::EncryptDecryptAes service function
+ *  Inputs:
+ *      1 : Size of the source data
+ *      2 : Size of the destination buffer
+ *      3-6 : IV or counter
+ *      7 : Algorithm, CBC or CTR
+ *      8 : Key type
+ *      10 : Source data address
+ *      12 : Destination buffer address
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2-5 : IV or counter of the data following
+ */
+static void EncryptDecryptAes(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 size = std::min(cmd_buff[1], cmd_buff[2]);
+    const u32 algorithm = cmd_buff[7];
+    const u32 src_address = cmd_buff[10];
+    const u32 dst_address = cmd_buff[12];
+    u8 iv[Common::AES128::BLOCK_SIZE];
+    memcpy(iv, &cmd_buff[3], sizeof(iv));
+
+    Common::AES128 aes;
+    if (!GetKey(cmd_buff[8], aes)) {
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+    const bool cbc = (algorithm == ALGORITHM_CBC_ENCRYPT || algorithm == ALGORITHM_CBC_DECRYPT);
+    if (!cbc && algorithm != ALGORITHM_CTR_ENCRYPT && algorithm != ALGORITHM_CTR_DECRYPT) {
+        ERROR_LOG(HLE, "unsupported algorithm %u", algorithm);
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+    if (cbc && (size % Common::AES128::BLOCK_SIZE) != 0) {
+        ERROR_LOG(HLE, "CBC of 0x%X bytes, not whole blocks", size);
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+
+    std::vector<u8> data(size);
+    Memory::ReadBlock(src_address, data.data(), size);
+    if (algorithm == ALGORITHM_CBC_ENCRYPT) {
+        aes.EncryptCBC(data.data(), size, iv);
+    } else if (algorithm == ALGORITHM_CBC_DECRYPT) {
+        aes.DecryptCBC(data.data(), size, iv);
+    } else {
+        aes.TransformCTR(data.data(), size, iv);
+        AdvanceCounter(iv, (size + Common::AES128::BLOCK_SIZE - 1) / Common::AES128::BLOCK_SIZE);
+    }
+    Memory::WriteBlock(dst_address, data.data(), size);
+
+    cmd_buff[1] = 0;
+    memcpy(&cmd_buff[2], iv, sizeof(iv));
+}
+
+/**
+ * PS_PS::EncryptSignDecryptVerifyAesCcm service function. The MAC follows the data, in the
+ *  destination buffer when encrypting and in the source data when decrypting.
+ *  Inputs:
+ *      1 : Size of the source data
+ *      2 : Size of the associated data, which must be 0
+ *      3 : Size of the destination buffer
+ *      4 : Size of the data to encrypt or decrypt
+ *      5 : Size of the MAC, which must be 16
+ *      6-8 : Nonce
+ *      9 : Algorithm, CCM encrypt or decrypt
+ *      10 : Key type
+ *      12 : Source data address
+ *      14 : Destination buffer address
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+static void EncryptSignDecryptVerifyAesCcm(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 src_size = cmd_buff[1];
+    const u32 dst_size = cmd_buff[3];
+    const u32 size = cmd_buff[4];
+    const u32 algorithm = cmd_buff[9];
+    const u32 src_address = cmd_buff[12];
+    const u32 dst_address = cmd_buff[14];
+    const bool encrypt = (algorithm == ALGORITHM_CCM_ENCRYPT);
+    u8 nonce[Common::AES128::CCM_NONCE_SIZE];
+    memcpy(nonce, &cmd_buff[6], sizeof(nonce));
+
+    Common::AES128 aes;
+    if (!GetKey(cmd_buff[10], aes)) {
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+    if (!encrypt && algorithm != ALGORITHM_CCM_DECRYPT) {
+        ERROR_LOG(HLE, "unsupported algorithm %u", algorithm);
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+    if (cmd_buff[2] != 0 || cmd_buff[5] != Common::AES128::CCM_MAC_SIZE) {
+        ERROR_LOG(HLE, "unsupported CCM with 0x%X bytes of associated data and a %u byte MAC",
+            cmd_buff[2], cmd_buff[5]);
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+    const u32 sealed_size = size + Common::AES128::CCM_MAC_SIZE;
+    if ((encrypt && (src_size < size || dst_size < sealed_size)) ||
+        (!encrypt && (src_size < sealed_size || dst_size < size))) {
+
+        ERROR_LOG(HLE, "CCM of 0x%X bytes with a source of 0x%X and a destination of 0x%X",
+            size, src_size, dst_size);
+        cmd_buff[1] = ERROR_INVALID;
+        return;
+    }
+
+    std::vector<u8> data(sealed_size);
+    if (encrypt) {
+        Memory::ReadBlock(src_address, data.data(), size);
+        aes.EncryptCCM(data.data(), size, nonce, &data[size]);
+        Memory::WriteBlock(dst_address, data.data(), sealed_size);
+    } else {
+        Memory::ReadBlock(src_address, data.data(), sealed_size);
+        if (!aes.DecryptCCM(data.data(), size, nonce, &data[size])) {
+            WARN_LOG(HLE, "CCM MAC mismatch over 0x%X bytes", size);
+            cmd_buff[1] = ERROR_MAC_MISMATCH;
+            return;
+        }
+        Memory::WriteBlock(dst_address, data.data(), size);
+    }
+    cmd_buff[1] = 0;
+}
+
+/**
+ * PS_PS::GetLocalFriendCodeSeed service function
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2-3 : Seed of the friend codes of the console
+ */
+static void GetLocalFriendCodeSeed(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = (u32)kLocalFriendCodeSeed;
+    cmd_buff[3] = (u32)(kLocalFriendCodeSeed >> 32);
+}
+
+/**
+ * PS_PS::GetDeviceId service function
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : ID of the console
+ */
+static void GetDeviceId(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = kDeviceId;
+}
+
+/**
+ * PS_PS::GenerateRandomBytes service function
+ *  Inputs:
+ *      1 : Number of bytes
+ *      3 : Address of the buffer
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+static void GenerateRandomBytes(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 size = cmd_buff[1];
+    std::vector<u8> data(size);
+    for (u32 i = 0; i < size; i++) {
+        g_random_state ^= g_random_state << 13;
+        g_random_state ^= g_random_state >> 7;
+        g_random_state ^= g_random_state << 17;
+        data[i] = (u8)(g_random_state >> 32);
+    }
+    Memory::WriteBlock(cmd_buff[3], data.data(), size);
+    cmd_buff[1] = 0;
+}
+
+const Interface::FunctionInfo FunctionTable[] = {
+    {0x00010244, NULL,                              "SignRsaSha256"},
+    {0x00020244, NULL,                              "VerifyRsaSha256"},
+    {0x000401C4, EncryptDecryptAes,                 "EncryptDecryptAes"},
+    {0x00050284, EncryptSignDecryptVerifyAesCcm,    "EncryptSignDecryptVerifyAesCcm"},
+    {0x00060040, NULL,                              "GetRomId"},
+    {0x00070040, NULL,                              "GetRomId2"},
+    {0x00080040, NULL,                              "GetRomMakerCode"},
+    {0x00090000, GetLocalFriendCodeSeed,            "GetLocalFriendCodeSeed"},
+    {0x000A0000, GetDeviceId,                       "GetDeviceId"},
+    {0x000B0000, NULL,                              "SeedRNG"},
+    {0x000C0000, NULL,                              "GetCTRCardAutoStartupBit"},
+    {0x000D0042, GenerateRandomBytes,               "GenerateRandomBytes"},
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interface class
+
+Interface::Interface() {
+    Register(FunctionTable, ARRAY_SIZE(FunctionTable));
+    g_random_state = kRandomSeed;
+}
+
+Interface::~Interface() {
+}
+
+/**
+ * Saves or loads the state of the service, which is the state of the random number generator
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.Do(g_random_state);
+}
+
+} // namespace
@@ -0,0 +1,42 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "core/hle/service/service.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace PS_PS
+
+// This service runs the AES engine for the system, which encrypts and decrypts buffers with the
+// keys of its slots, as well as giving out the identity of the console and random bytes. The AES
+// is done at once on the host, with the AES extensions of the CPU when it has them, and the keys
+// are those of the keys file (see core/hw/aes_keys.h).
+
+namespace PS_PS {
+
+class Interface : public Service::Interface {
+public:
+
+    Interface();
+
+    ~Interface();
+
+    /**
+     * Gets the string port name used by CTROS for the service
+     * @return Port name of service
+     */
+    const char *GetPortName() const {
+        return "ps:ps";
+    }
+
+    /**
+     * Saves or loads the state of the service, which is the state of the random number generator
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
+};
+
+} // namespace
@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include "common/common.h"
+#include "common/chunk_file.h"
 #include "common/log.h"
 #include "common/string_util.h"
 
@@ -10,9 +11,12 @@
 
 #include "core/hle/service/service.h"
 #include "core/hle/service/apt.h"
+#include "core/hle/service/dsp.h"
 #include "core/hle/service/gsp.h"
 #include "core/hle/service/hid.h"
+#include "core/hle/service/ps.h"
 #include "core/hle/service/srv.h"
+#include "core/hle/service/y2r_u.h"
 
 #include "core/hle/kernel/kernel.h"
 
@@ -20,6 +24,84 @@ namespace Service {
 
 Manager* g_manager = NULL;  ///< Service manager
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Service Interface class
+
+/**
+ * Registers the functions in the service
+ */
+void Interface::Register(const FunctionInfo* functions, int len) {
+    m_profile_category = Common::Profiler::RegisterCategory(std::string("Service ") +
+        GetPortName());
+
+    for (int i = 0; i < len; i++) {
+        auto itr = std::find_if(m_functions.begin(), m_functions.end(),
+            [&](const FunctionInfo& info) { return info.id == functions[i].id; });
+        if (itr != m_functions.end()) {
+            *itr = functions[i];
+        } else {
+            m_functions.push_back(functions[i]);
+        }
+    }
+
+    // Rebuild the dispatch table, at most half full so that probe sequences stay short
+    u32 size = 8;
+    while (size < m_functions.size() * 2) {
+        size *= 2;
+    }
+    FunctionSlot empty = { 0, NULL, 0 };
+    m_function_table.assign(size, empty);
+    for (const FunctionInfo& info : m_functions) {
+        u32 i = HashCommand(info.id) & (size - 1);
+        while (m_function_table[i].info != NULL) {
+            i = (i + 1) & (size - 1);
+        }
+        m_function_table[i].id = info.id;
+        m_function_table[i].info = &info;
+    }
+}
+
+/// Logs how many times each command of the service was called
+void Interface::LogCallCounts() const {
+    std::vector<const FunctionSlot*> called;
+    for (const FunctionSlot& slot : m_function_table) {
+        if (slot.info != NULL && slot.call_count != 0) {
+            called.push_back(&slot);
+        }
+    }
+    std::sort(called.begin(), called.end(), [](const FunctionSlot* a, const FunctionSlot* b) {
+        return a->call_count > b->call_count;
+    });
+    for (const FunctionSlot* slot : called) {
+        NOTICE_LOG(OSHLE, "%s: command 0x%08X (%s) called %llu times", GetPortName(), slot->id,
+            slot->info->name, (unsigned long long)slot->call_count);
+    }
+}
+
+/**
+ * Gets how many times each command of the service was called
+ * @param counts Receives the commands called at least once, appended
+ */
+void Interface::GetCallCounts(std::vector<CallCount>& counts) const {
+    for (const FunctionSlot& slot : m_function_table) {
+        if (slot.info != NULL && slot.call_count != 0) {
+            CallCount count;
+            count.name = std::string(GetPortName()) + ":" + slot.info->name;
+            count.count = slot.call_count;
+            counts.push_back(count);
+        }
+    }
+}
+
+/**
+ * Saves or loads the state of the service, the handles it created. Services with state of
+ * their own save it on top.
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    p.Do(m_handles);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Service Manager class
 
@@ -27,37 +109,44 @@ Manager::Manager() {
 }
 
 Manager::~Manager() {
-    for(Interface* service : m_services) {
-        DeleteService(service->GetPortName());
+    while (!m_services.empty()) {
+        DeleteService(m_services.back()->GetPortName());
     }
 }
 
 /// Add a service to the manager (does not create it though)
 void Manager::AddService(Interface* service) {
-    m_port_map[service->GetPortName()] = Kernel::g_object_pool.Create(service);
+    Kernel::g_object_pool.Create(service);
+    Port port = { MakePortKey(service->GetPortName()), service };
+    m_ports.push_back(port);
     m_services.push_back(service);
 }
 
 /// Removes a service from the manager, also frees memory
-void Manager::DeleteService(std::string port_name) {
-    Interface* service = FetchFromPortName(port_name);
+void Manager::DeleteService(const char* port_name) {
+    const u64 key = MakePortKey(port_name);
+    Interface* service = FetchFromPortKey(key);
     m_services.erase(std::remove(m_services.begin(), m_services.end(), service), m_services.end());
-    m_port_map.erase(port_name);
+    m_ports.erase(std::remove_if(m_ports.begin(), m_ports.end(),
+        [key](const Port& port) { return port.key == key; }), m_ports.end());
     delete service;
 }
 
-/// Get a Service Interface from its Handle
-Interface* Manager::FetchFromHandle(Handle handle) {
-    return Kernel::g_object_pool.GetFast<Interface>(handle);
+/// Logs the command call counts of all services
+void Manager::LogCallCounts() const {
+    for (const Interface* service : m_services) {
+        service->LogCallCounts();
+    }
 }
 
-/// Get a Service Interface from its port
-Interface* Manager::FetchFromPortName(std::string port_name) {
-    auto itr = m_port_map.find(port_name);
-    if (itr == m_port_map.end()) {
-        return NULL;
+/**
+ * Gets the command call counts of all services
+ * @param counts Receives the commands called at least once, appended
+ */
+void Manager::GetCallCounts(std::vector<CallCount>& counts) const {
+    for (const Interface* service : m_services) {
+        service->GetCallCounts(counts);
     }
-    return FetchFromHandle(itr->second);
 }
 
 
@@ -70,14 +159,18 @@ void Init() {
     
     g_manager->AddService(new SRV::Interface);
     g_manager->AddService(new APT_U::Interface);
+    g_manager->AddService(new DSP_DSP::Interface);
     g_manager->AddService(new GSP_GPU::Interface);
     g_manager->AddService(new HID_User::Interface);
+    g_manager->AddService(new PS_PS::Interface);
+    g_manager->AddService(new Y2R_U::Interface);
 
     NOTICE_LOG(HLE, "Services initialized OK");
 }
 
 /// Shutdown ServiceManager
 void Shutdown() {
+    g_manager->LogCallCounts();
     delete g_manager;
     NOTICE_LOG(HLE, "Services shutdown OK");
 }
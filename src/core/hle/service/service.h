@@ -5,14 +5,17 @@
 #pragma once
 
 #include <algorithm>
+#include <cstring>
 #include <vector>
-#include <map>
 #include <string>
 
 #include "common/common.h"
+#include "common/profiler.h"
 #include "core/mem_map.h"
 
+#include "core/hle/async_io.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/thread.h"
 #include "core/hle/svc.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -24,21 +27,45 @@ static const int kMaxPortSize           = 0x08; ///< Maximum size of a port name
 static const int kCommandHeaderOffset   = 0x80; ///< Offset into command buffer of header
 
 /**
- * Returns a pointer to the command buffer in kernel memory
+ * Returns a pointer to the command buffer of the current thread, in its TLS
  * @param offset Optional offset into command buffer
  * @return Pointer to command buffer
  */
 inline static u32* GetCommandBuffer(const int offset=0) {
-    return (u32*)Memory::GetPointer(Memory::KERNEL_MEMORY_VADDR + kCommandHeaderOffset + offset);
+    return (u32*)Memory::GetPointer(Kernel::GetCurrentThreadTLSAddress() + kCommandHeaderOffset +
+        offset);
+}
+
+/**
+ * Packs a port name into the key services are looked up by, so that names compare as one
+ * integer
+ * @param name Port name, only read up to its first NUL or kMaxPortSize characters
+ * @return The characters of the name, zero padded
+ */
+inline u64 MakePortKey(const char* name) {
+    char key[kMaxPortSize] = {};
+    for (int i = 0; i < kMaxPortSize && name[i] != '\0'; i++) {
+        key[i] = name[i];
+    }
+    u64 result;
+    memcpy(&result, key, sizeof(result));
+    return result;
 }
 
 class Manager;
 
+/// Number of times a command of a service was called
+struct CallCount {
+    std::string name;   ///< "port:command", e.g. "gsp::Gpu:TriggerCmdReqQueue"
+    u64         count;
+};
+
 /// Interface to a CTROS service
 class Interface  : public Kernel::Object {
     friend class Manager;
 public:
-    
+    Interface() : m_profile_category(Common::Profiler::OTHER_CATEGORY) {}
+
     const char *GetName() { return GetPortName(); }
     const char *GetTypeName() { return GetPortName(); }
 
@@ -50,7 +77,7 @@ public:
     struct FunctionInfo {
         u32         id;
         Function    func;
-        std::string name;
+        const char* name;
     };
 
     /**
@@ -81,39 +108,102 @@ public:
      */
     Result Sync() {
         u32* cmd_buff = GetCommandBuffer();
-        auto itr = m_functions.find(cmd_buff[0]);
+        FunctionSlot* slot = FindFunction(cmd_buff[0]);
 
-        if (itr == m_functions.end()) {
+        if (slot == NULL) {
             ERROR_LOG(OSHLE, "Unknown/unimplemented function: port = %s, command = 0x%08X!", 
                 GetPortName(), cmd_buff[0]);
             return -1;
         }
-        if (itr->second.func == NULL) {
+        slot->call_count++;
+        if (slot->info->func == NULL) {
             ERROR_LOG(OSHLE, "Unimplemented function: port = %s, name = %s!", 
-                GetPortName(), itr->second.name.c_str());
+                GetPortName(), slot->info->name);
             return -1;
         } 
 
-        itr->second.func(this);
+        Common::Profiler::Scope scope(m_profile_category);
+        slot->info->func(this);
 
         return 0; // TODO: Implement return from actual function
     }
 
+    /// Logs how many times each command of the service was called
+    void LogCallCounts() const;
+
+    /**
+     * Gets how many times each command of the service was called
+     * @param counts Receives the commands called at least once, appended
+     */
+    void GetCallCounts(std::vector<CallCount>& counts) const;
+
+    /**
+     * Saves or loads the state of the service, the handles it created. Services with state of
+     * their own save it on top.
+     * @param p Savestate the state is written to or read from
+     */
+    virtual void DoState(PointerWrap& p);
+
 protected:
 
     /**
      * Registers the functions in the service
      */
-    void Register(const FunctionInfo* functions, int len) {
-        for (int i = 0; i < len; i++) {
-            m_functions[functions[i].id] = functions[i];
-        }
+    void Register(const FunctionInfo* functions, int len);
+
+    /**
+     * Defers the rest of the current command to the shared thread pool, for the expensive ones.
+     * The calling guest thread waits while other threads keep running, and gets its reply once
+     * the work is done. The command buffer is shared, so the work takes its parameters along
+     * and the reply is only written to it once the work is done.
+     * @param work Run on a worker, must leave the emulator state alone, guest memory aside from
+     *      the buffers of the command
+     * @param reply Run on the emulation thread once the work is done, writes the reply to the
+     *      command buffer
+     */
+    void Defer(std::function<void()> work, std::function<void()> reply) {
+        AsyncIO::Run(std::move(work), std::move(reply));
     }
 
 private:
 
+    /// Entry of the command dispatch table
+    struct FunctionSlot {
+        u32                 id;         ///< Command header
+        const FunctionInfo* info;       ///< Registered function, NULL if the slot is empty
+        u64                 call_count; ///< Number of times the command was called
+    };
+
+    /**
+     * Looks up a command in the dispatch table
+     * @param id Command header
+     * @return Slot of the command, NULL if it isn't registered
+     */
+    FunctionSlot* FindFunction(u32 id) {
+        if (m_function_table.empty()) {
+            return NULL;
+        }
+        const u32 mask = (u32)m_function_table.size() - 1;
+        for (u32 i = HashCommand(id) & mask;; i = (i + 1) & mask) {
+            FunctionSlot& slot = m_function_table[i];
+            if (slot.info == NULL) {
+                return NULL;
+            }
+            if (slot.id == id) {
+                return &slot;
+            }
+        }
+    }
+
+    /// Spreads the command id bits (command number and parameter counts) over the table index
+    static u32 HashCommand(u32 id) {
+        return (id * 0x9E3779B1) >> 16;
+    }
+
     std::vector<Handle>         m_handles;
-    std::map<u32, FunctionInfo> m_functions;
+    std::vector<FunctionInfo>   m_functions;        ///< Registered functions
+    std::vector<FunctionSlot>   m_function_table;   ///< Open-addressed, power of two sized table
+    int                         m_profile_category; ///< Commands are timed per service
 
 };
 
@@ -128,19 +218,52 @@ public:
     /// Add a service to the manager (does not create it though)
     void AddService(Interface* service);
 
-    /// Removes a service from the manager (does not delete it though)
-    void DeleteService(std::string port_name);
+    /// Removes a service from the manager, also frees memory
+    void DeleteService(const char* port_name);
 
-    /// Get a Service Interface from its UID
-    Interface* FetchFromHandle(u32 uid);
+    /// Get a Service Interface from its Handle, which has to be the handle of a service
+    Interface* FetchFromHandle(Handle handle) {
+        return Kernel::g_object_pool.GetFast<Interface>(handle);
+    }
+
+    /**
+     * Get a Service Interface from its port
+     * @param port_key Port name packed by MakePortKey
+     * @return The service, NULL if there is none on the port
+     */
+    Interface* FetchFromPortKey(u64 port_key) {
+        for (const Port& port : m_ports) {
+            if (port.key == port_key) {
+                return port.service;
+            }
+        }
+        return NULL;
+    }
 
     /// Get a Service Interface from its port
-    Interface* FetchFromPortName(std::string port_name);
+    Interface* FetchFromPortName(const char* port_name) {
+        return FetchFromPortKey(MakePortKey(port_name));
+    }
+
+    /// Logs the command call counts of all services
+    void LogCallCounts() const;
+
+    /**
+     * Gets the command call counts of all services
+     * @param counts Receives the commands called at least once, appended
+     */
+    void GetCallCounts(std::vector<CallCount>& counts) const;
 
 private:
 
+    /// Port a service is connected through
+    struct Port {
+        u64         key;            ///< Port name packed by MakePortKey
+        Interface*  service;
+    };
+
     std::vector<Interface*>     m_services;
-    std::map<std::string, u32>  m_port_map;
+    std::vector<Port>           m_ports;    ///< A handful, a scan beats any map
 
 };
 
@@ -26,16 +26,15 @@ void GetServiceHandle(Service::Interface* self) {
     Result res = 0;
     u32* cmd_buff = Service::GetCommandBuffer();
 
-    std::string port_name = std::string((const char*)&cmd_buff[1], 0, Service::kMaxPortSize);
+    const char* port_name = (const char*)&cmd_buff[1];
     Service::Interface* service = Service::g_manager->FetchFromPortName(port_name);
 
-    NOTICE_LOG(OSHLE, "SRV::Sync - GetHandle - port: %s, handle: 0x%08X", port_name.c_str(), 
-        service->GetHandle());
-
     if (NULL != service) {
         cmd_buff[3] = service->GetHandle();
+        NOTICE_LOG(OSHLE, "SRV::Sync - GetHandle - port: %.8s, handle: 0x%08X", port_name,
+            cmd_buff[3]);
     } else {
-        ERROR_LOG(OSHLE, "Service %s does not exist", port_name.c_str());
+        ERROR_LOG(OSHLE, "Service %.8s does not exist", port_name);
         res = -1;
     }
     cmd_buff[1] = res;
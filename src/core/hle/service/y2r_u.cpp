@@ -0,0 +1,1002 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/chunk_file.h"
+#include "common/log.h"
+#include "common/thread_pool.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hle/hle.h"
+#include "core/hle/kernel/event.h"
+#include "core/hle/service/y2r_u.h"
+
+#include "video_core/rasterizer.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Y2R_U
+
+namespace Y2R_U {
+
+/// Layouts of the YUV data the unit reads
+enum InputFormat {
+    INPUT_YUV422_INDIV_8    = 0,    ///< Y, U and V planes of bytes, U and V every other pixel
+    INPUT_YUV420_INDIV_8    = 1,    ///< Same as YUV422, U and V every other line as well
+    INPUT_YUV422_INDIV_16   = 2,    ///< Planes of 16-bit samples, the data in the low byte
+    INPUT_YUV420_INDIV_16   = 3,
+    INPUT_YUYV422_INTERLEAVED = 4,  ///< Y0 U Y1 V for every two pixels, in a single buffer
+};
+
+/// Formats of the RGB data the unit writes
+enum OutputFormat {
+    OUTPUT_RGBA8    = 0,
+    OUTPUT_RGB8     = 1,
+    OUTPUT_RGB5A1   = 2,
+    OUTPUT_RGB565   = 3,
+};
+
+/// Orders the unit writes the pixels in
+enum BlockAlignment {
+    BLOCK_LINEAR    = 0,    ///< Row after row
+    BLOCK_8_BY_8    = 1,    ///< 8x8 tiles in Morton order, as textures are, row of tiles first
+};
+
+enum {
+    ROTATION_NONE           = 0,
+    NUM_STANDARD_COEFFICIENTS = 4,
+    MAX_INPUT_LINE_WIDTH    = 1024,
+    MIN_PARALLEL_PIXELS     = 256 * 256,    ///< Smaller images are converted on the calling thread
+    PARALLEL_STRIPS         = 4,            ///< Strips of 8 lines of a chunk on the thread pool
+    CYCLES_PER_PIXEL        = 12,           ///< About 4 ms for a 400x240 video frame
+};
+
+/// Result of the setters given a parameter out of range
+static const u32 ERROR_OUT_OF_RANGE = 0xE0E053FD;
+
+/**
+ * Coefficients of the conversion, in fixed point with 8 fractional bits: Y, V to R, V to G, U to
+ * G and U to B factors, then the R, G and B offsets
+ */
+typedef s16 Coefficients[8];
+
+/// Coefficients of ITU-R BT.601 and BT.709, full range then with Y scaled from 16-235
+static const Coefficients kStandardCoefficients[NUM_STANDARD_COEFFICIENTS] = {
+    { 0x100, 0x166, 0xB6, 0x58, 0x1C5, -0x166F, 0x10EE, -0x1C5B },
+    { 0x100, 0x193, 0x77, 0x2F, 0x1DB, -0x1933, 0xA7C, -0x1D51 },
+    { 0x12A, 0x198, 0xD0, 0x64, 0x204, -0x1BDE, 0x10F2, -0x229B },
+    { 0x12A, 0x1CA, 0x88, 0x36, 0x21C, -0x1F04, 0x99C, -0x2421 },
+};
+
+/// Buffer the unit reads from or writes to, transfer_unit bytes at a time with gap bytes skipped
+/// after each of them
+struct BufferConfig {
+    u32 address;
+    u32 size;               ///< Number of bytes transferred, gaps excluded
+    u32 transfer_unit;
+    u32 gap;
+};
+
+/// Parameters of a conversion
+struct ConversionConfig {
+    u8              input_format;       ///< InputFormat
+    u8              output_format;      ///< OutputFormat
+    u8              rotation;
+    u8              block_alignment;    ///< BlockAlignment
+    u16             input_line_width;   ///< Width of the image in pixels, a multiple of 8
+    u16             input_lines;        ///< Height of the image in pixels
+    Coefficients    coefficients;
+    u16             alpha;              ///< Alpha of the pixels of the formats with alpha
+};
+
+/// Parameters as SetPackageParameter gets them
+struct PackageParameter {
+    u8  input_format;
+    u8  output_format;
+    u8  rotation;
+    u8  block_alignment;
+    u16 input_line_width;
+    u16 input_lines;
+    u8  standard_coefficient;
+    u8  padding;
+    u16 alpha;
+};
+
+static ConversionConfig g_config;
+static BufferConfig     g_sending_y;
+static BufferConfig     g_sending_u;
+static BufferConfig     g_sending_v;
+static BufferConfig     g_sending_yuyv;
+static BufferConfig     g_receiving;
+static bool             g_transfer_end_interrupt = false;
+static bool             g_busy = false;             ///< Whether a conversion is in progress
+static Handle           g_transfer_end_event = 0;   ///< 0 until the application asks for it
+static int              g_transfer_event = -1;
+
+/// Ends the conversion in progress, signalling the application if it asked to be
+static void TransferEndCallback(u64 userdata, int cycles_late) {
+    g_busy = false;
+    if (g_transfer_end_interrupt && g_transfer_end_event != 0) {
+        Kernel::SignalEvent(g_transfer_end_event);
+    }
+}
+
+/**
+ * Gets the range of guest memory a buffer spans, gaps included
+ * @param buffer Buffer to get the range of
+ * @return Number of bytes from the address of the buffer to the end of its last transfer unit
+ */
+static u32 GetBufferSpan(const BufferConfig& buffer) {
+    if (buffer.transfer_unit == 0 || buffer.size == 0) {
+        return buffer.size;
+    }
+    const u32 num_units = (buffer.size + buffer.transfer_unit - 1) / buffer.transfer_unit;
+    return buffer.size + (num_units - 1) * buffer.gap;
+}
+
+/**
+ * Reads the data of a sending buffer, the bytes past the end of the buffer being left as they are
+ * @param buffer Buffer to read
+ * @param data Receives the data
+ * @param size Number of bytes to read
+ */
+static void ReadBuffer(const BufferConfig& buffer, u8* data, u32 size) {
+    size = std::min(size, buffer.size);
+    Pica::Rasterizer::FlushRegion(Memory::PhysicalAddressFromVirtual(buffer.address),
+        GetBufferSpan(buffer));
+
+    const u32 unit = (buffer.transfer_unit != 0) ? buffer.transfer_unit : size;
+    u32 address = buffer.address;
+    for (u32 offset = 0; offset < size; offset += unit) {
+        const u32 span = std::min(unit, size - offset);
+        Memory::ReadBlock(address, data + offset, span);
+        address += span + buffer.gap;
+    }
+}
+
+/**
+ * Writes data to the receiving buffer, the data past the end of the buffer being dropped
+ * @param buffer Buffer to write
+ * @param data Data to write
+ * @param size Number of bytes to write
+ */
+static void WriteBuffer(const BufferConfig& buffer, const u8* data, u32 size) {
+    size = std::min(size, buffer.size);
+    const u32 physical_address = Memory::PhysicalAddressFromVirtual(buffer.address);
+    Pica::Rasterizer::FlushRegion(physical_address, GetBufferSpan(buffer));
+
+    const u32 unit = (buffer.transfer_unit != 0) ? buffer.transfer_unit : size;
+    u32 address = buffer.address;
+    for (u32 offset = 0; offset < size; offset += unit) {
+        const u32 span = std::min(unit, size - offset);
+        Memory::WriteBlock(address, data + offset, span);
+        address += span + buffer.gap;
+    }
+    Pica::Rasterizer::InvalidateRegion(physical_address, GetBufferSpan(buffer));
+}
+
+/**
+ * Reads a plane of 16-bit samples, keeping the low byte of each
+ * @param buffer Buffer to read
+ * @param plane Receives the samples
+ * @param count Number of samples to read
+ */
+static void ReadPlane16(const BufferConfig& buffer, u8* plane, u32 count) {
+    std::vector<u8> data(count * 2);
+    ReadBuffer(buffer, data.data(), count * 2);
+    for (u32 i = 0; i < count; i++) {
+        plane[i] = data[i * 2];
+    }
+}
+
+/// Clamps a channel computed by the conversion to 8 bits
+static inline u32 ClampChannel(s32 value) {
+    return (u32)std::max(0, std::min(value, 255));
+}
+
+#ifdef _M_X64
+
+/// Gets a pair of 16-bit factors of _mm_madd_epi16 in every 32-bit lane
+static inline __m128i FactorPair(s32 low, s32 high) {
+    return _mm_set1_epi32((s32)(((u32)(u16)low) | ((u32)(u16)high << 16)));
+}
+
+/**
+ * Computes a channel of four pixels from the Y term and the chroma term of each, both as that of
+ * the scalar conversion
+ * @return Channel of every pixel, a 32-bit lane each, not clamped yet
+ */
+static inline __m128i ComputeChannel(__m128i luma, __m128i chroma, __m128i offset) {
+    const __m128i sum = _mm_add_epi32(luma, chroma);
+    return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(sum, 3), offset), 5);
+}
+
+/**
+ * Converts the pixels of a line eight at a time with SSE2, the products being summed in 32 bits
+ * as they are by the scalar conversion
+ * @return Number of pixels converted, the rest are left to the scalar conversion
+ * @see ConvertLine
+ */
+static u32 ConvertLineSSE2(const u8* y, const u8* u, const u8* v, u32 width,
+    const Coefficients& c, u8 alpha, u32* pixels) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i alpha_words = _mm_set1_epi16(alpha);
+    const __m128i y_factor = FactorPair(c[0], 0);
+    const __m128i r_factors = FactorPair(c[1], 0);        // V and U pairs from here on
+    const __m128i g_factors = FactorPair(-c[2], -c[3]);
+    const __m128i b_factors = FactorPair(0, c[4]);
+    const __m128i r_offset = _mm_set1_epi32(c[5] + 0x18);
+    const __m128i g_offset = _mm_set1_epi32(c[6] + 0x18);
+    const __m128i b_offset = _mm_set1_epi32(c[7] + 0x18);
+
+    u32 x = 0;
+    for (; x + 8 <= width; x += 8) {
+        s32 u4, v4;
+        memcpy(&u4, u + x / 2, 4);
+        memcpy(&v4, v + x / 2, 4);
+        const __m128i y_bytes = _mm_loadl_epi64((const __m128i*)(y + x));
+        const __m128i u_bytes = _mm_cvtsi32_si128(u4);
+        const __m128i v_bytes = _mm_cvtsi32_si128(v4);
+
+        // Every chroma sample twice, for the two pixels it covers
+        const __m128i y_words = _mm_unpacklo_epi8(y_bytes, zero);
+        const __m128i u_words = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u_bytes, u_bytes), zero);
+        const __m128i v_words = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v_bytes, v_bytes), zero);
+
+        __m128i channels[3][2];
+        for (int half = 0; half < 2; half++) {
+            const __m128i y_dwords = half ? _mm_unpackhi_epi16(y_words, zero) :
+                _mm_unpacklo_epi16(y_words, zero);
+            const __m128i vu = half ? _mm_unpackhi_epi16(v_words, u_words) :
+                _mm_unpacklo_epi16(v_words, u_words);
+            const __m128i luma = _mm_madd_epi16(y_dwords, y_factor);
+            channels[0][half] = ComputeChannel(luma, _mm_madd_epi16(vu, r_factors), r_offset);
+            channels[1][half] = ComputeChannel(luma, _mm_madd_epi16(vu, g_factors), g_offset);
+            channels[2][half] = ComputeChannel(luma, _mm_madd_epi16(vu, b_factors), b_offset);
+        }
+        __m128i rgb[3];
+        for (int i = 0; i < 3; i++) {
+            const __m128i packed = _mm_packs_epi32(channels[i][0], channels[i][1]);
+            rgb[i] = _mm_min_epi16(_mm_max_epi16(packed, zero), max);
+        }
+
+        // R G B A from the most significant byte down
+        const __m128i ba = _mm_or_si128(alpha_words, _mm_slli_epi16(rgb[2], 8));
+        const __m128i rg = _mm_or_si128(rgb[1], _mm_slli_epi16(rgb[0], 8));
+        _mm_storeu_si128((__m128i*)(pixels + x), _mm_unpacklo_epi16(ba, rg));
+        _mm_storeu_si128((__m128i*)(pixels + x + 4), _mm_unpackhi_epi16(ba, rg));
+    }
+    return x;
+}
+
+#endif // _M_X64
+
+/**
+ * Converts a line of YUV pixels
+ * @param y Y of every pixel
+ * @param u U of every other pixel, from the first one
+ * @param v V of every other pixel, from the first one
+ * @param width Number of pixels
+ * @param c Coefficients of the conversion
+ * @param alpha Alpha of the pixels
+ * @param pixels Receives the pixels, R G B A from the most significant byte down
+ */
+static void ConvertLine(const u8* y, const u8* u, const u8* v, u32 width, const Coefficients& c,
+    u8 alpha, u32* pixels) {
+
+    u32 x = 0;
+#ifdef _M_X64
+    x = ConvertLineSSE2(y, u, v, width, c, alpha, pixels);
+#endif
+    for (; x < width; x++) {
+        const s32 luma = c[0] * y[x];
+        const s32 cu = u[x / 2];
+        const s32 cv = v[x / 2];
+        const u32 r = ClampChannel((((luma + c[1] * cv) >> 3) + c[5] + 0x18) >> 5);
+        const u32 g = ClampChannel((((luma - c[2] * cv - c[3] * cu) >> 3) + c[6] + 0x18) >> 5);
+        const u32 b = ClampChannel((((luma + c[4] * cu) >> 3) + c[7] + 0x18) >> 5);
+        pixels[x] = (r << 24) | (g << 16) | (b << 8) | alpha;
+    }
+}
+
+/// Gets the number of bytes of a pixel of an output format
+static u32 GetOutputBytes(u8 format) {
+    switch (format) {
+    case OUTPUT_RGBA8:
+        return 4;
+    case OUTPUT_RGB8:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+/// Gets the index of a pixel within an 8x8 tile, in Morton order
+static inline u32 GetMortonIndex(u32 x, u32 y) {
+    return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) |
+        ((y & 4) << 3);
+}
+
+/**
+ * Writes a converted line to the output in the output format and layout
+ * @param pixels Converted pixels, as ConvertLine writes them
+ * @param width Number of pixels
+ * @param line Line within its strip of 8 lines
+ * @param strip Output the strip of the line starts at
+ */
+static void StoreLine(const u32* pixels, u32 width, u32 line, u8* strip) {
+    const u32 bytes = GetOutputBytes(g_config.output_format);
+    const bool tiled = (g_config.block_alignment == BLOCK_8_BY_8);
+    if (!tiled && g_config.output_format == OUTPUT_RGBA8) {
+        memcpy(strip + line * width * 4, pixels, width * 4);
+        return;
+    }
+
+    for (u32 x = 0; x < width; x++) {
+        const u32 index = tiled ? (x & ~7) * 8 + GetMortonIndex(x & 7, line) : line * width + x;
+        u8* dst = strip + index * bytes;
+        const u32 pixel = pixels[x];
+        const u32 r = pixel >> 24;
+        const u32 g = (pixel >> 16) & 0xFF;
+        const u32 b = (pixel >> 8) & 0xFF;
+        u32 value;
+        switch (g_config.output_format) {
+        case OUTPUT_RGBA8:
+            memcpy(dst, &pixel, 4);
+            continue;
+        case OUTPUT_RGB8:
+            dst[0] = (u8)b;
+            dst[1] = (u8)g;
+            dst[2] = (u8)r;
+            continue;
+        case OUTPUT_RGB5A1:
+            value = ((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | ((pixel & 0xFF) >> 7);
+            break;
+        default:
+            value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+            break;
+        }
+        dst[0] = (u8)value;
+        dst[1] = (u8)(value >> 8);
+    }
+}
+
+/// Converts the image of the sending buffers into the receiving buffer
+static void Convert() {
+    const u32 width = std::min<u32>(g_config.input_line_width, MAX_INPUT_LINE_WIDTH) & ~7;
+    const u32 lines = g_config.input_lines;
+    if (width == 0 || lines == 0) {
+        return;
+    }
+    if (g_config.rotation != ROTATION_NONE) {
+        ERROR_LOG(HLE, "unimplemented rotation %u, converting without", g_config.rotation);
+    }
+
+    // The planes of the input, U and V at half the width and at half the lines for YUV420
+    const bool is420 = (g_config.input_format == INPUT_YUV420_INDIV_8 ||
+        g_config.input_format == INPUT_YUV420_INDIV_16);
+    const u32 chroma_width = width / 2;
+    const u32 chroma_lines = is420 ? (lines + 1) / 2 : lines;
+    std::vector<u8> y(width * lines);
+    std::vector<u8> u(chroma_width * chroma_lines);
+    std::vector<u8> v(chroma_width * chroma_lines);
+
+    switch (g_config.input_format) {
+    case INPUT_YUV422_INDIV_8:
+    case INPUT_YUV420_INDIV_8:
+        ReadBuffer(g_sending_y, y.data(), (u32)y.size());
+        ReadBuffer(g_sending_u, u.data(), (u32)u.size());
+        ReadBuffer(g_sending_v, v.data(), (u32)v.size());
+        break;
+
+    case INPUT_YUV422_INDIV_16:
+    case INPUT_YUV420_INDIV_16:
+        ReadPlane16(g_sending_y, y.data(), (u32)y.size());
+        ReadPlane16(g_sending_u, u.data(), (u32)u.size());
+        ReadPlane16(g_sending_v, v.data(), (u32)v.size());
+        break;
+
+    case INPUT_YUYV422_INTERLEAVED:
+    {
+        std::vector<u8> data(width * lines * 2);
+        ReadBuffer(g_sending_yuyv, data.data(), (u32)data.size());
+        for (u32 i = 0; i < width * lines / 2; i++) {
+            y[i * 2] = data[i * 4];
+            u[i] = data[i * 4 + 1];
+            y[i * 2 + 1] = data[i * 4 + 2];
+            v[i] = data[i * 4 + 3];
+        }
+        break;
+    }
+
+    default:
+        ERROR_LOG(HLE, "unknown input format %u", g_config.input_format);
+        return;
+    }
+
+    // Whole strips of 8 lines, the tiles of the last one being cut short if need be
+    const u32 strip_size = width * 8 * GetOutputBytes(g_config.output_format);
+    const int num_strips = (int)((lines + 7) / 8);
+    std::vector<u8> output(num_strips * strip_size);
+
+    auto convert_strips = [&](int begin, int end) {
+        std::vector<u32> pixels(width);
+        for (int strip = begin; strip < end; strip++) {
+            const u32 strip_lines = std::min<u32>(8, lines - strip * 8);
+            for (u32 line = 0; line < strip_lines; line++) {
+                const u32 y_line = strip * 8 + line;
+                const u32 chroma_line = is420 ? y_line / 2 : y_line;
+                ConvertLine(&y[y_line * width], &u[chroma_line * chroma_width],
+                    &v[chroma_line * chroma_width], width, g_config.coefficients,
+                    (u8)g_config.alpha, pixels.data());
+                StoreLine(pixels.data(), width, line, &output[strip * strip_size]);
+            }
+        }
+    };
+
+    if (width * lines >= MIN_PARALLEL_PIXELS) {
+        Common::ThreadPool::GetShared().ParallelFor(0, num_strips, PARALLEL_STRIPS,
+            convert_strips);
+    } else {
+        convert_strips(0, num_strips);
+    }
+
+    WriteBuffer(g_receiving, output.data(),
+        width * lines * GetOutputBytes(g_config.output_format));
+}
+
+/**
+ * Sets up a buffer from the parameters of the SetSending and SetReceiving commands
+ * @param buffer Buffer to set up
+ * @param cmd_buff Command buffer of the command
+ */
+static void SetBuffer(BufferConfig& buffer, const u32* cmd_buff) {
+    buffer.address = cmd_buff[1];
+    buffer.size = cmd_buff[2];
+    buffer.transfer_unit = cmd_buff[3];
+    buffer.gap = cmd_buff[4];
+}
+
+/**
+ * Sets the layout of the YUV data
+ *  Inputs:
+ *      1 : InputFormat
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetInputFormat(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_config.input_format = (u8)cmd_buff[1];
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the layout of the YUV data
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : InputFormat
+ */
+void GetInputFormat(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.input_format;
+}
+
+/**
+ * Sets the format of the RGB data
+ *  Inputs:
+ *      1 : OutputFormat
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetOutputFormat(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_config.output_format = (u8)cmd_buff[1];
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the format of the RGB data
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : OutputFormat
+ */
+void GetOutputFormat(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.output_format;
+}
+
+/**
+ * Sets the rotation of the image, only no rotation is emulated
+ *  Inputs:
+ *      1 : Rotation, 0 for none, then 90, 180 and 270 degrees clockwise
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetRotation(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_config.rotation = (u8)cmd_buff[1];
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the rotation of the image
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Rotation
+ */
+void GetRotation(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.rotation;
+}
+
+/**
+ * Sets the order the RGB pixels are written in
+ *  Inputs:
+ *      1 : BlockAlignment
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetBlockAlignment(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_config.block_alignment = (u8)cmd_buff[1];
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the order the RGB pixels are written in
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : BlockAlignment
+ */
+void GetBlockAlignment(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.block_alignment;
+}
+
+/**
+ * Sets whether the transfer end event is signalled at the end of conversions
+ *  Inputs:
+ *      1 : Whether it is
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetTransferEndInterrupt(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_transfer_end_interrupt = (cmd_buff[1] & 0xFF) != 0;
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets whether the transfer end event is signalled at the end of conversions
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether it is
+ */
+void GetTransferEndInterrupt(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_transfer_end_interrupt;
+}
+
+/**
+ * Gets the event signalled at the end of conversions
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Handle translation descriptor
+ *      3 : Event handle
+ */
+void GetTransferEndEvent(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    if (g_transfer_end_event == 0) {
+        g_transfer_end_event = Kernel::CreateEvent(RESETTYPE_ONESHOT);
+    }
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 0;
+    cmd_buff[3] = Kernel::g_object_pool.Duplicate(g_transfer_end_event);
+}
+
+/**
+ * Sets up a sending or the receiving buffer, the command tells which
+ *  Inputs:
+ *      1 : Address of the buffer
+ *      2 : Number of bytes transferred
+ *      3 : Transfer unit in bytes
+ *      4 : Number of bytes skipped after each transfer unit
+ *      5 : Handle translation descriptor
+ *      6 : Handle of the process of the buffer
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetSendingY(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    SetBuffer(g_sending_y, cmd_buff);
+    cmd_buff[1] = 0;
+}
+
+void SetSendingU(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    SetBuffer(g_sending_u, cmd_buff);
+    cmd_buff[1] = 0;
+}
+
+void SetSendingV(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    SetBuffer(g_sending_v, cmd_buff);
+    cmd_buff[1] = 0;
+}
+
+void SetSendingYUYV(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    SetBuffer(g_sending_yuyv, cmd_buff);
+    cmd_buff[1] = 0;
+}
+
+void SetReceiving(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    SetBuffer(g_receiving, cmd_buff);
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Tells whether a buffer was transferred in full, which it is once no conversion is in progress;
+ * all of the IsFinished commands answer alike
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether the buffer was transferred
+ */
+void IsFinished(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = !g_busy;
+}
+
+/**
+ * Sets the width of the image
+ *  Inputs:
+ *      1 : Width in pixels, a multiple of 8 up to 1024
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetInputLineWidth(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 width = cmd_buff[1];
+    if (width == 0 || width > MAX_INPUT_LINE_WIDTH || (width & 7) != 0) {
+        ERROR_LOG(HLE, "invalid line width %u", width);
+        cmd_buff[1] = ERROR_OUT_OF_RANGE;
+        return;
+    }
+    g_config.input_line_width = (u16)width;
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the width of the image
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Width in pixels
+ */
+void GetInputLineWidth(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.input_line_width;
+}
+
+/**
+ * Sets the height of the image
+ *  Inputs:
+ *      1 : Height in pixels, up to 1024
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetInputLines(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 lines = cmd_buff[1];
+    if (lines == 0 || lines > 1024) {
+        ERROR_LOG(HLE, "invalid number of lines %u", lines);
+        cmd_buff[1] = ERROR_OUT_OF_RANGE;
+        return;
+    }
+    g_config.input_lines = (u16)lines;
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the height of the image
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Height in pixels
+ */
+void GetInputLines(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.input_lines;
+}
+
+/**
+ * Sets the coefficients of the conversion
+ *  Inputs:
+ *      1-4 : Coefficients, two 16-bit ones per word
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetCoefficient(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    memcpy(g_config.coefficients, &cmd_buff[1], sizeof(Coefficients));
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the coefficients of the conversion
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2-5 : Coefficients, two 16-bit ones per word
+ */
+void GetCoefficient(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    memcpy(&cmd_buff[2], g_config.coefficients, sizeof(Coefficients));
+}
+
+/**
+ * Sets the coefficients of the conversion to standard ones
+ *  Inputs:
+ *      1 : Index of the coefficients, BT.601, BT.709, then both with Y scaled
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetStandardCoefficient(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 index = cmd_buff[1];
+    if (index >= NUM_STANDARD_COEFFICIENTS) {
+        ERROR_LOG(HLE, "invalid standard coefficients %u", index);
+        cmd_buff[1] = ERROR_OUT_OF_RANGE;
+        return;
+    }
+    memcpy(g_config.coefficients, kStandardCoefficients[index], sizeof(Coefficients));
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets standard coefficients
+ *  Inputs:
+ *      1 : Index of the coefficients
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2-5 : Coefficients, two 16-bit ones per word
+ */
+void GetStandardCoefficient(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    const u32 index = cmd_buff[1];
+    if (index >= NUM_STANDARD_COEFFICIENTS) {
+        cmd_buff[1] = ERROR_OUT_OF_RANGE;
+        return;
+    }
+    cmd_buff[1] = 0;
+    memcpy(&cmd_buff[2], kStandardCoefficients[index], sizeof(Coefficients));
+}
+
+/**
+ * Sets the alpha of the pixels of the output formats with alpha
+ *  Inputs:
+ *      1 : Alpha
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetAlpha(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    g_config.alpha = (u16)cmd_buff[1];
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Gets the alpha of the pixels of the output formats with alpha
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Alpha
+ */
+void GetAlpha(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_config.alpha;
+}
+
+/**
+ * Converts the image, the unit staying busy for as long as the hardware would take
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void StartConversion(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    Convert();
+
+    CoreTiming::RemoveEvent(g_transfer_event);
+    CoreTiming::ScheduleEvent((s64)g_config.input_line_width * g_config.input_lines *
+        CYCLES_PER_PIXEL, g_transfer_event);
+    g_busy = true;
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Stops the conversion in progress, the transfer end event isn't signalled
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void StopConversion(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    CoreTiming::RemoveEvent(g_transfer_event);
+    g_busy = false;
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Tells whether a conversion is in progress
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether one is
+ */
+void IsBusyConversion(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = g_busy;
+}
+
+/**
+ * Sets all of the parameters of a conversion at once
+ *  Inputs:
+ *      1-3 : PackageParameter
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void SetPackageParameter(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    PackageParameter params;
+    memcpy(&params, &cmd_buff[1], sizeof(params));
+
+    g_config.input_format = params.input_format;
+    g_config.output_format = params.output_format;
+    g_config.rotation = params.rotation;
+    g_config.block_alignment = params.block_alignment;
+    g_config.input_line_width = params.input_line_width;
+    g_config.input_lines = params.input_lines;
+    g_config.alpha = params.alpha;
+    if (params.standard_coefficient < NUM_STANDARD_COEFFICIENTS) {
+        memcpy(g_config.coefficients, kStandardCoefficients[params.standard_coefficient],
+            sizeof(Coefficients));
+    }
+    cmd_buff[1] = 0;
+}
+
+/**
+ * Tells whether the unit answers, it always does
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Whether it answers
+ */
+void PingProcess(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    cmd_buff[1] = 0;
+    cmd_buff[2] = 1;
+}
+
+/**
+ * Stops the conversion in progress and resets the parameters and buffers to their defaults, the
+ * command of DriverInitialize and DriverFinalize alike
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+void DriverInitialize(Service::Interface* self) {
+    u32* cmd_buff = Service::GetCommandBuffer();
+    CoreTiming::RemoveEvent(g_transfer_event);
+    g_busy = false;
+
+    memset(&g_config, 0, sizeof(g_config));
+    memcpy(g_config.coefficients, kStandardCoefficients[0], sizeof(Coefficients));
+    g_config.input_line_width = MAX_INPUT_LINE_WIDTH;
+    g_config.input_lines = MAX_INPUT_LINE_WIDTH;
+    memset(&g_sending_y, 0, sizeof(g_sending_y));
+    memset(&g_sending_u, 0, sizeof(g_sending_u));
+    memset(&g_sending_v, 0, sizeof(g_sending_v));
+    memset(&g_sending_yuyv, 0, sizeof(g_sending_yuyv));
+    memset(&g_receiving, 0, sizeof(g_receiving));
+    g_transfer_end_interrupt = false;
+    cmd_buff[1] = 0;
+}
+
+const Interface::FunctionInfo FunctionTable[] = {
+    {0x00010040, SetInputFormat,            "SetInputFormat"},
+    {0x00020000, GetInputFormat,            "GetInputFormat"},
+    {0x00030040, SetOutputFormat,           "SetOutputFormat"},
+    {0x00040000, GetOutputFormat,           "GetOutputFormat"},
+    {0x00050040, SetRotation,               "SetRotation"},
+    {0x00060000, GetRotation,               "GetRotation"},
+    {0x00070040, SetBlockAlignment,         "SetBlockAlignment"},
+    {0x00080000, GetBlockAlignment,         "GetBlockAlignment"},
+    {0x000D0040, SetTransferEndInterrupt,   "SetTransferEndInterrupt"},
+    {0x000E0000, GetTransferEndInterrupt,   "GetTransferEndInterrupt"},
+    {0x000F0000, GetTransferEndEvent,       "GetTransferEndEvent"},
+    {0x00100102, SetSendingY,               "SetSendingY"},
+    {0x00110102, SetSendingU,               "SetSendingU"},
+    {0x00120102, SetSendingV,               "SetSendingV"},
+    {0x00130102, SetSendingYUYV,            "SetSendingYUYV"},
+    {0x00140000, IsFinished,                "IsFinishedSendingYuv"},
+    {0x00150000, IsFinished,                "IsFinishedSendingY"},
+    {0x00160000, IsFinished,                "IsFinishedSendingU"},
+    {0x00170000, IsFinished,                "IsFinishedSendingV"},
+    {0x00180102, SetReceiving,              "SetReceiving"},
+    {0x00190000, IsFinished,                "IsFinishedReceiving"},
+    {0x001A0040, SetInputLineWidth,         "SetInputLineWidth"},
+    {0x001B0000, GetInputLineWidth,         "GetInputLineWidth"},
+    {0x001C0040, SetInputLines,             "SetInputLines"},
+    {0x001D0000, GetInputLines,             "GetInputLines"},
+    {0x001E0100, SetCoefficient,            "SetCoefficient"},
+    {0x001F0000, GetCoefficient,            "GetCoefficient"},
+    {0x00200040, SetStandardCoefficient,    "SetStandardCoefficient"},
+    {0x00210040, GetStandardCoefficient,    "GetStandardCoefficient"},
+    {0x00220040, SetAlpha,                  "SetAlpha"},
+    {0x00230000, GetAlpha,                  "GetAlpha"},
+    {0x00260000, StartConversion,           "StartConversion"},
+    {0x00270000, StopConversion,            "StopConversion"},
+    {0x00280000, IsBusyConversion,          "IsBusyConversion"},
+    {0x002901C0, SetPackageParameter,       "SetPackageParameter"},
+    {0x002A0000, PingProcess,               "PingProcess"},
+    {0x002B0000, DriverInitialize,          "DriverInitialize"},
+    {0x002C0000, DriverInitialize,          "DriverFinalize"},
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interface class
+
+Interface::Interface() {
+    Register(FunctionTable, ARRAY_SIZE(FunctionTable));
+    g_transfer_event = CoreTiming::RegisterEvent("Y2R::TransferEnd", TransferEndCallback);
+
+    memset(&g_config, 0, sizeof(g_config));
+    memcpy(g_config.coefficients, kStandardCoefficients[0], sizeof(Coefficients));
+}
+
+Interface::~Interface() {
+    memset(&g_sending_y, 0, sizeof(g_sending_y));
+    memset(&g_sending_u, 0, sizeof(g_sending_u));
+    memset(&g_sending_v, 0, sizeof(g_sending_v));
+    memset(&g_sending_yuyv, 0, sizeof(g_sending_yuyv));
+    memset(&g_receiving, 0, sizeof(g_receiving));
+    g_transfer_end_interrupt = false;
+    g_busy = false;
+    g_transfer_end_event = 0;
+}
+
+/**
+ * Saves or loads the state of the service, with the conversion parameters, the buffers and the
+ * transfer end event. The end of the conversion is scheduled in CoreTiming, which has its own
+ * state.
+ * @param p Savestate the state is written to or read from
+ */
+void Interface::DoState(PointerWrap& p) {
+    Service::Interface::DoState(p);
+    p.DoPOD(g_config);
+    p.DoPOD(g_sending_y);
+    p.DoPOD(g_sending_u);
+    p.DoPOD(g_sending_v);
+    p.DoPOD(g_sending_yuyv);
+    p.DoPOD(g_receiving);
+    p.Do(g_transfer_end_interrupt);
+    p.Do(g_busy);
+    p.Do(g_transfer_end_event);
+}
+
+} // namespace
@@ -0,0 +1,45 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "core/hle/service/service.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Y2R_U
+
+// This service drives the YUV-to-RGB conversion unit, which video players push every decoded frame
+// through. The application sets up the formats and the buffers the unit reads the Y, U and V data
+// from and writes the RGB data to, then starts the conversion and waits on the transfer end event.
+// The conversion runs at once on StartConversion, with SSE2 kernels on the thread pool; the unit
+// stays busy and the event is signalled a little later, on a CoreTiming event.
+
+namespace Y2R_U {
+
+class Interface : public Service::Interface {
+public:
+
+    Interface();
+
+    ~Interface();
+
+    /**
+     * Gets the string port name used by CTROS for the service
+     * @return Port name of service
+     */
+    const char *GetPortName() const {
+        return "y2r:u";
+    }
+
+    /**
+     * Saves or loads the state of the service, with the conversion parameters, the buffers and
+     * the transfer end event. The end of the conversion is scheduled in CoreTiming, which has its
+     * own state.
+     * @param p Savestate the state is written to or read from
+     */
+    void DoState(PointerWrap& p);
+
+};
+
+} // namespace
@@ -4,14 +4,20 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "common/symbols.h"
 
 #include "core/mem_map.h"
 
+#include "core/hle/kernel/address_arbiter.h"
+#include "core/hle/kernel/event.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/mutex.h"
+#include "core/hle/kernel/semaphore.h"
+#include "core/hle/kernel/shared_memory.h"
 #include "core/hle/kernel/thread.h"
+#include "core/hle/kernel/timer.h"
 
 #include "core/hle/function_wrappers.h"
 #include "core/hle/svc.h"
@@ -24,8 +30,10 @@
 namespace SVC {
 
 enum ControlMemoryOperation {
-    MEMORY_OPERATION_HEAP       = 0x00000003,
-    MEMORY_OPERATION_GSP_HEAP   = 0x00010003,
+    MEMORY_OPERATION_FREE       = 0x00000001,
+    MEMORY_OPERATION_COMMIT     = 0x00000003,
+    MEMORY_OPERATION_MASK       = 0x000000FF,
+    MEMORY_OPERATION_LINEAR     = 0x00010000,   ///< Flag, in the physically contiguous GSP heap
 };
 
 enum MapMemoryPermission {
@@ -33,42 +41,63 @@ enum MapMemoryPermission {
     MEMORY_PERMISSION_NORMAL    = 0x00000001,
 };
 
-/// Map application or GSP heap memory
+/// Map or free application or GSP heap memory
 Result ControlMemory(void* _outaddr, u32 operation, u32 addr0, u32 addr1, u32 size, u32 permissions) {
     u32* outaddr = (u32*)_outaddr;
     u32 virtual_address = 0x00000000;
+    Result result = 0;
 
     DEBUG_LOG(SVC, "ControlMemory called operation=0x%08X, addr0=0x%08X, addr1=0x%08X, size=%08X, permissions=0x%08X", 
         operation, addr0, addr1, size, permissions);
 
-    switch (operation) {
-
-    // Map normal heap memory
-    case MEMORY_OPERATION_HEAP:
-        virtual_address = Memory::MapBlock_Heap(size, operation, permissions);
+    switch (operation & MEMORY_OPERATION_MASK) {
+
+    // Map normal or GSP heap memory
+    case MEMORY_OPERATION_COMMIT:
+        if (operation & MEMORY_OPERATION_LINEAR) {
+            virtual_address = Memory::AllocateArea(Memory::HEAP_GSP_VADDR, Memory::HEAP_GSP_SIZE,
+                addr0, size, permissions, Memory::MEMORY_STATE_CONTINUOUS);
+        } else {
+            virtual_address = Memory::AllocateArea(Memory::HEAP_VADDR, Memory::HEAP_SIZE,
+                addr0, size, permissions, Memory::MEMORY_STATE_PRIVATE);
+        }
+        if (virtual_address == 0) {
+            ERROR_LOG(SVC, "ControlMemory can't commit 0x%08X bytes at 0x%08X", size, addr0);
+            result = (addr0 != 0) ? Kernel::ERROR_INVALID_ADDRESS : Kernel::ERROR_OUT_OF_MEMORY;
+        }
         break;
 
-    // Map GSP heap memory
-    case MEMORY_OPERATION_GSP_HEAP:
-        virtual_address = Memory::MapBlock_HeapGSP(size, operation, permissions);
+    case MEMORY_OPERATION_FREE:
+        if (!Memory::FreeArea(addr0, size)) {
+            ERROR_LOG(SVC, "ControlMemory can't free 0x%08X bytes at 0x%08X", size, addr0);
+            result = Kernel::ERROR_INVALID_ADDRESS;
+        }
         break;
 
     // Unknown ControlMemory operation
     default:
         ERROR_LOG(SVC, "ControlMemory unknown operation=0x%08X", operation);
+        result = Kernel::ERROR_INVALID_ENUM_VALUE;
     }
     if (NULL != outaddr) {
         *outaddr = virtual_address;
     }
-    Core::g_app_core->SetReg(1, virtual_address);
+    HLE::g_svc_regs[1] = virtual_address;
 
-    return 0;
+    return result;
 }
 
 /// Maps a memory block to specified address
 Result MapMemoryBlock(Handle memblock, u32 addr, u32 mypermissions, u32 otherpermission) {
     DEBUG_LOG(SVC, "MapMemoryBlock called memblock=0x08X, addr=0x%08X, mypermissions=0x%08X, otherpermission=%d", 
         memblock, addr, mypermissions, otherpermission);
+
+    // Only the blocks services create are kernel objects so far, the others are just mapped
+    const Handle object = Kernel::g_object_pool.Resolve(memblock);
+    if (object != 0 &&
+        Kernel::g_object_pool[object]->GetHandleType() == Kernel::HandleType::SharedMemory) {
+        Kernel::MapSharedMemory(object, addr, mypermissions);
+    }
     switch (mypermissions) {
     case MEMORY_PERMISSION_NORMAL:
     case MEMORY_PERMISSION_NORMAL + 1:
@@ -85,7 +114,7 @@ Result MapMemoryBlock(Handle memblock, u32 addr, u32 mypermissions, u32 otherper
 Result ConnectToPort(void* out, const char* port_name) {
     Service::Interface* service = Service::g_manager->FetchFromPortName(port_name);
     if (service) {
-        Core::g_app_core->SetReg(1, service->GetHandle());
+        HLE::g_svc_regs[1] = service->GetHandle();
     } else {
         PanicYesNo("ConnectToPort called port_name=%s, but it is not implemented!", port_name);
     }
@@ -95,50 +124,102 @@ Result ConnectToPort(void* out, const char* port_name) {
 
 /// Synchronize to an OS service
 Result SendSyncRequest(Handle handle) {
-    DEBUG_LOG(SVC, "SendSyncRequest called handle=0x%08X");
+    DEBUG_LOG(SVC, "SendSyncRequest called handle=0x%08X", handle);
     Service::Interface* service = Service::g_manager->FetchFromHandle(handle);
     service->Sync();
     return 0;
 }
 
-/// Close a handle
+/// Close a handle, the object goes once the kernel no longer uses it either
 Result CloseHandle(Handle handle) {
-    // ImplementMe
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) CloseHandle called handle=0x%08X", handle);
+    DEBUG_LOG(SVC, "CloseHandle called handle=0x%08X", handle);
+    return Kernel::g_object_pool.Close(handle);
+}
+
+/// Duplicate a handle, the duplicate has to be closed as well
+Result DuplicateHandle(void* out, Handle handle) {
+    DEBUG_LOG(SVC, "DuplicateHandle called handle=0x%08X", handle);
+    const Handle duplicate = Kernel::g_object_pool.Duplicate(handle);
+    if (duplicate == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    HLE::g_svc_regs[1] = duplicate;
     return 0;
 }
 
 /// Wait for a handle to synchronize, timeout after the specified nanoseconds
 Result WaitSynchronization1(Handle handle, s64 nano_seconds) {
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) WaitSynchronization1 called handle=0x%08X, nanoseconds=%d", 
-        handle, nano_seconds);
-    Kernel::WaitCurrentThread(WAITTYPE_SYNCH); // TODO(bunnei): Is this correct?
-    return 0;
+    DEBUG_LOG(SVC, "WaitSynchronization1 called handle=0x%08X, nanoseconds=%lld", handle,
+        nano_seconds);
+
+    // Services and the objects that are still stubs never signal, waiting on them would hang.
+    // Closed handles are as bad as any other.
+    Kernel::WaitObject* object = Kernel::g_object_pool.IsOpen(handle) ?
+        Kernel::GetWaitObject(handle) : NULL;
+    if (object == NULL) {
+        WARN_LOG(SVC, "WaitSynchronization1 on handle 0x%08X, which can't be waited on", handle);
+        return 0;
+    }
+    s32 index;
+    return Kernel::WaitSynchronization(&object, 1, false, nano_seconds, &index);
 }
 
 /// Wait for the given handles to synchronize, timeout after the specified nanoseconds
-Result WaitSynchronizationN(void* _out, void* _handles, u32 handle_count, u32 wait_all, s64 nano_seconds) {
-    s32* out = (s32*)_out;
+Result WaitSynchronizationN(void* _handles, u32 handle_count, u32 wait_all, s64 nano_seconds) {
     Handle* handles = (Handle*)_handles;
 
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) WaitSynchronizationN called handle_count=%d, wait_all=%s, nanoseconds=%d %s", 
+    DEBUG_LOG(SVC, "WaitSynchronizationN called handle_count=%d, wait_all=%s, nanoseconds=%lld",
         handle_count, (wait_all ? "true" : "false"), nano_seconds);
 
+    if (handles == NULL && handle_count != 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    std::vector<Kernel::WaitObject*> objects;
+    objects.reserve(handle_count);
     for (u32 i = 0; i < handle_count; i++) {
         DEBUG_LOG(SVC, "\thandle[%d]=0x%08X", i, handles[i]);
+        Kernel::WaitObject* object = Kernel::g_object_pool.IsOpen(handles[i]) ?
+            Kernel::GetWaitObject(handles[i]) : NULL;
+        if (object != NULL) {
+            objects.push_back(object);
+            continue;
+        }
+
+        // Handles that can't be waited on count as signalled, as WaitSynchronization1 has them
+        WARN_LOG(SVC, "WaitSynchronizationN on handle 0x%08X, which can't be waited on",
+            handles[i]);
+        if (!wait_all) {
+            HLE::g_svc_regs[1] = i;
+            return 0;
+        }
     }
-    Kernel::WaitCurrentThread(WAITTYPE_SYNCH); // TODO(bunnei): Is this correct?
-    return 0;
+    s32 index;
+    Result result = Kernel::WaitSynchronization(objects.data(), (u32)objects.size(),
+        wait_all != 0, nano_seconds, &index);
+    HLE::g_svc_regs[1] = index;
+    return result;
 }
 
 /// Create an address arbiter (to allocate access to shared resources)
 Result CreateAddressArbiter(void* arbiter) {
-    // ImplementMe
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) CreateAddressArbiter called");
-    Core::g_app_core->SetReg(1, 0xFABBDADD);
+    Handle handle = Kernel::CreateAddressArbiter();
+    HLE::g_svc_regs[1] = handle;
+    DEBUG_LOG(SVC, "CreateAddressArbiter called : created handle 0x%08X", handle);
     return 0;
 }
 
+/// Signal or wait on a guest address through an address arbiter
+Result ArbitrateAddress(Handle arbiter, u32 address, u32 type, u32 value, s64 nano_seconds) {
+    DEBUG_LOG(SVC, "ArbitrateAddress called arbiter=0x%08X, address=0x%08X, type=0x%08X, "
+        "value=0x%08X, nanoseconds=%lld", arbiter, address, type, value, nano_seconds);
+    arbiter = Kernel::g_object_pool.Resolve(arbiter);
+    if (arbiter == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::ArbitrateAddress(arbiter, address, (Kernel::ArbitrationType)type, (s32)value,
+        nano_seconds);
+}
+
 /// Used to output a message on a debug hardware unit - does nothing on a retail unit
 void OutputDebugString(const char* string) {
     NOTICE_LOG(SVC, "## OSDEBUG: %08X %s", Core::g_app_core->GetPC(), string);
@@ -150,7 +231,7 @@ Result GetResourceLimit(void* resource_limit, Handle process) {
     // 0xFFFF8001 is a handle alias for the current KProcess, and 0xFFFF8000 is a handle alias for 
     // the current KThread.
     DEBUG_LOG(SVC, "(UNIMPLEMENTED) GetResourceLimit called process=0x%08X", process);
-    Core::g_app_core->SetReg(1, 0xDEADBEEF);
+    HLE::g_svc_regs[1] = 0xDEADBEEF;
     return 0;
 }
 
@@ -159,7 +240,7 @@ Result GetResourceLimitCurrentValues(void* _values, Handle resource_limit, void*
     //s64* values = (s64*)_values;
     DEBUG_LOG(SVC, "(UNIMPLEMENTED) GetResourceLimitCurrentValues called resource_limit=%08X, names=%s, name_count=%d",
         resource_limit, names, name_count);
-    Memory::Write32(Core::g_app_core->GetReg(0), 0); // Normmatt: Set used memory to 0 for now
+    Memory::Write32(PARAM(0), 0); // Normmatt: Set used memory to 0 for now
     return 0;
 }
 
@@ -178,7 +259,7 @@ Result CreateThread(u32 priority, u32 entry_point, u32 arg, u32 stack_top, u32 p
     Handle thread = Kernel::CreateThread(name.c_str(), entry_point, priority, arg, processor_id,
         stack_top);
 
-    Core::g_app_core->SetReg(1, thread);
+    HLE::g_svc_regs[1] = thread;
 
     DEBUG_LOG(SVC, "CreateThread called entrypoint=0x%08X (%s), arg=0x%08X, stacktop=0x%08X, "
         "threadpriority=0x%08X, processorid=0x%08X : created handle 0x%08X", entry_point, 
@@ -191,7 +272,7 @@ Result CreateThread(u32 priority, u32 entry_point, u32 arg, u32 stack_top, u32 p
 Result CreateMutex(void* _mutex, u32 initial_locked) {
     Handle* mutex = (Handle*)_mutex;
     *mutex = Kernel::CreateMutex((initial_locked != 0));
-    Core::g_app_core->SetReg(1, *mutex);
+    HLE::g_svc_regs[1] = *mutex;
     DEBUG_LOG(SVC, "CreateMutex called initial_locked=%s : created handle 0x%08X", 
         initial_locked ? "true" : "false", *mutex);
     return 0;
@@ -200,6 +281,10 @@ Result CreateMutex(void* _mutex, u32 initial_locked) {
 /// Release a mutex
 Result ReleaseMutex(Handle handle) {
     DEBUG_LOG(SVC, "ReleaseMutex called handle=0x%08X", handle);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
     Kernel::ReleaseMutex(handle);
     return 0;
 }
@@ -210,22 +295,123 @@ Result GetThreadId(void* thread_id, u32 thread) {
     return 0;
 }
 
-/// Query memory
+/// Query memory, the kernel returns the area an address is in and its page flags in r1 to r5
 Result QueryMemory(void *_info, void *_out, u32 addr) {
-    MemoryInfo* info = (MemoryInfo*) _info;
-    PageInfo* out = (PageInfo*) _out;
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) QueryMemory called addr=0x%08X", addr);
+    DEBUG_LOG(SVC, "QueryMemory called addr=0x%08X", addr);
+    const Memory::MemoryArea area = Memory::QueryArea(addr);
+    HLE::g_svc_regs[1] = area.base_address;
+    HLE::g_svc_regs[2] = area.size;
+    HLE::g_svc_regs[3] = area.permissions;
+    HLE::g_svc_regs[4] = area.state;
+    HLE::g_svc_regs[5] = 0;
     return 0;
 }
 
+/// Exits the current thread
+void ExitThread() {
+    DEBUG_LOG(SVC, "ExitThread called thread=0x%08X", Kernel::GetCurrentThreadHandle());
+    Kernel::ExitCurrentThread();
+}
+
+/// Puts the current thread to sleep for the specified nanoseconds, 0 only yields
+void SleepThread(s64 nano_seconds) {
+    DEBUG_LOG(SVC, "SleepThread called nanoseconds=%lld", nano_seconds);
+    Kernel::SleepCurrentThread(nano_seconds);
+}
+
+/// Create a semaphore
+Result CreateSemaphore(void* _semaphore, s32 initial_count, s32 max_count) {
+    Handle semaphore = 0;
+    Result result = Kernel::CreateSemaphore(&semaphore, initial_count, max_count);
+    HLE::g_svc_regs[1] = semaphore;
+    DEBUG_LOG(SVC, "CreateSemaphore called initial_count=%d, max_count=%d : created handle 0x%08X",
+        initial_count, max_count, semaphore);
+    return result;
+}
+
+/// Release a semaphore
+Result ReleaseSemaphore(void* _count, Handle handle, s32 release_count) {
+    DEBUG_LOG(SVC, "ReleaseSemaphore called handle=0x%08X, release_count=%d", handle,
+        release_count);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    s32 count = 0;
+    Result result = Kernel::ReleaseSemaphore(&count, handle, release_count);
+    HLE::g_svc_regs[1] = count;
+    return result;
+}
+
 /// Create an event
 Result CreateEvent(void* _event, u32 reset_type) {
-    Handle* event = (Handle*)_event;
-    DEBUG_LOG(SVC, "(UNIMPLEMENTED) CreateEvent called reset_type=0x%08X", reset_type);
-    Core::g_app_core->SetReg(1, 0xBADC0DE0);
+    Handle event = Kernel::CreateEvent((ResetType)reset_type);
+    HLE::g_svc_regs[1] = event;
+    DEBUG_LOG(SVC, "CreateEvent called reset_type=0x%08X : created handle 0x%08X", reset_type,
+        event);
     return 0;
 }
 
+/// Signal an event
+Result SignalEvent(Handle handle) {
+    DEBUG_LOG(SVC, "SignalEvent called handle=0x%08X", handle);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::SignalEvent(handle);
+}
+
+/// Clear an event
+Result ClearEvent(Handle handle) {
+    DEBUG_LOG(SVC, "ClearEvent called handle=0x%08X", handle);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::ClearEvent(handle);
+}
+
+/// Create a timer
+Result CreateTimer(void* _timer, u32 reset_type) {
+    Handle timer = Kernel::CreateTimer((ResetType)reset_type);
+    HLE::g_svc_regs[1] = timer;
+    DEBUG_LOG(SVC, "CreateTimer called reset_type=0x%08X : created handle 0x%08X", reset_type,
+        timer);
+    return 0;
+}
+
+/// Start a timer, signalling after the initial nanoseconds and then every interval
+Result SetTimer(Handle handle, s64 initial, s64 interval) {
+    DEBUG_LOG(SVC, "SetTimer called handle=0x%08X, initial=%lld, interval=%lld", handle,
+        initial, interval);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::SetTimer(handle, initial, interval);
+}
+
+/// Stop a timer
+Result CancelTimer(Handle handle) {
+    DEBUG_LOG(SVC, "CancelTimer called handle=0x%08X", handle);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::CancelTimer(handle);
+}
+
+/// Clear a timer
+Result ClearTimer(Handle handle) {
+    DEBUG_LOG(SVC, "ClearTimer called handle=0x%08X", handle);
+    handle = Kernel::g_object_pool.Resolve(handle);
+    if (handle == 0) {
+        return Kernel::ERROR_INVALID_HANDLE;
+    }
+    return Kernel::ClearTimer(handle);
+}
+
 const HLE::FunctionDef SVC_Table[] = {
     {0x00,  NULL,                                       "Unknown"},
     {0x01,  WrapI_VUUUUU<ControlMemory>,                "ControlMemory"},
@@ -236,8 +422,8 @@ const HLE::FunctionDef SVC_Table[] = {
     {0x06,  NULL,                                       "GetProcessIdealProcessor"},
     {0x07,  NULL,                                       "SetProcessIdealProcessor"},
     {0x08,  WrapI_UUUUU<CreateThread>,                  "CreateThread"},
-    {0x09,  NULL,                                       "ExitThread"},
-    {0x0A,  NULL,                                       "SleepThread"},
+    {0x09,  WrapV_V<ExitThread>,                        "ExitThread"},
+    {0x0A,  WrapV_S64<SleepThread>,                     "SleepThread"},
     {0x0B,  NULL,                                       "GetThreadPriority"},
     {0x0C,  NULL,                                       "SetThreadPriority"},
     {0x0D,  NULL,                                       "GetThreadAffinityMask"},
@@ -248,25 +434,25 @@ const HLE::FunctionDef SVC_Table[] = {
     {0x12,  NULL,                                       "Run"},
     {0x13,  WrapI_VU<CreateMutex>,                      "CreateMutex"},
     {0x14,  WrapI_U<ReleaseMutex>,                      "ReleaseMutex"},
-    {0x15,  NULL,                                       "CreateSemaphore"},
-    {0x16,  NULL,                                       "ReleaseSemaphore"},
+    {0x15,  WrapI_VII<CreateSemaphore>,                 "CreateSemaphore"},
+    {0x16,  WrapI_VUI<ReleaseSemaphore>,                "ReleaseSemaphore"},
     {0x17,  WrapI_VU<CreateEvent>,                      "CreateEvent"},
-    {0x18,  NULL,                                       "SignalEvent"},
-    {0x19,  NULL,                                       "ClearEvent"},
-    {0x1A,  NULL,                                       "CreateTimer"},
-    {0x1B,  NULL,                                       "SetTimer"},
-    {0x1C,  NULL,                                       "CancelTimer"},
-    {0x1D,  NULL,                                       "ClearTimer"},
+    {0x18,  WrapI_U<SignalEvent>,                       "SignalEvent"},
+    {0x19,  WrapI_U<ClearEvent>,                        "ClearEvent"},
+    {0x1A,  WrapI_VU<CreateTimer>,                      "CreateTimer"},
+    {0x1B,  WrapI_US64S64<SetTimer>,                    "SetTimer"},
+    {0x1C,  WrapI_U<CancelTimer>,                       "CancelTimer"},
+    {0x1D,  WrapI_U<ClearTimer>,                        "ClearTimer"},
     {0x1E,  NULL,                                       "CreateMemoryBlock"},
     {0x1F,  WrapI_UUUU<MapMemoryBlock>,                 "MapMemoryBlock"},
     {0x20,  NULL,                                       "UnmapMemoryBlock"},
     {0x21,  WrapI_V<CreateAddressArbiter>,              "CreateAddressArbiter"},
-    {0x22,  NULL,                                       "ArbitrateAddress"},
+    {0x22,  WrapI_UUUUS64<ArbitrateAddress>,            "ArbitrateAddress"},
     {0x23,  WrapI_U<CloseHandle>,                       "CloseHandle"},
     {0x24,  WrapI_US64<WaitSynchronization1>,           "WaitSynchronization1"},
-    {0x25,  WrapI_VVUUS64<WaitSynchronizationN>,        "WaitSynchronizationN"},
+    {0x25,  WrapI_VUUS64<WaitSynchronizationN>,         "WaitSynchronizationN"},
     {0x26,  NULL,                                       "SignalAndWait"},
-    {0x27,  NULL,                                       "DuplicateHandle"},
+    {0x27,  WrapI_VU<DuplicateHandle>,                  "DuplicateHandle"},
     {0x28,  NULL,                                       "GetSystemTick"},
     {0x29,  NULL,                                       "GetHandleInfo"},
     {0x2A,  NULL,                                       "GetSystemInfo"},
@@ -357,6 +543,7 @@ const HLE::FunctionDef SVC_Table[] = {
 
 void Register() {
     HLE::RegisterModule("SVC_Table", ARRAY_SIZE(SVC_Table), SVC_Table);
+    HLE::RegisterSVCTable(ARRAY_SIZE(SVC_Table), SVC_Table);
 }
 
 } // namespace
@@ -29,6 +29,8 @@ struct ThreadContext {
     u32 fpu_registers[32];
     u32 fpscr;
     u32 fpexc;
+    u32 tls_address;    ///< CP15 c13 user read-only thread ID (TPIDRURO), the TLS of the thread
+    u32 tls_user;       ///< CP15 c13 user read/write thread ID (TPIDRURW), free for the thread
 };
 
 enum ResetType {
@@ -0,0 +1,205 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/string_util.h"
+
+#include "core/hw/aes_keys.h"
+
+namespace AESKeys {
+
+namespace {
+
+/// Keys of a slot, as 128-bit big endian numbers
+struct Slot {
+    bool    has_key_x;
+    bool    has_key_y;
+    bool    has_normal_key;
+    u8      key_x[KEY_SIZE];
+    u8      key_y[KEY_SIZE];
+    u8      normal_key[KEY_SIZE];
+};
+
+Slot g_slots[NUM_SLOTS];
+
+/// Constant the key scrambler adds, big endian
+const u8 kScramblerConstant[KEY_SIZE] = {
+    0x1F, 0xF9, 0xE9, 0xAA, 0xC5, 0xFE, 0x04, 0x08, 0x02, 0x45, 0x91, 0xDC, 0x5D, 0x52, 0x76, 0x8A,
+};
+
+/// 128-bit number, for the key scrambler
+struct U128 {
+    u64 high;
+    u64 low;
+};
+
+U128 Load128(const u8 key[KEY_SIZE]) {
+    U128 value = { 0, 0 };
+    for (int i = 0; i < 8; i++) {
+        value.high = (value.high << 8) | key[i];
+        value.low = (value.low << 8) | key[i + 8];
+    }
+    return value;
+}
+
+void Store128(U128 value, u8 key[KEY_SIZE]) {
+    for (int i = 7; i >= 0; i--) {
+        key[i] = (u8)value.high;
+        key[i + 8] = (u8)value.low;
+        value.high >>= 8;
+        value.low >>= 8;
+    }
+}
+
+/// Rotates a 128-bit number left by 1 to 63 bits
+U128 RotateLeft(U128 value, int bits) {
+    U128 result;
+    result.high = (value.high << bits) | (value.low >> (64 - bits));
+    result.low = (value.low << bits) | (value.high >> (64 - bits));
+    return result;
+}
+
+/**
+ * Parses 32 hex digits into a key
+ * @param text Digits
+ * @param key Receives the key
+ * @return False if the text isn't 32 hex digits
+ */
+bool ParseKey(const std::string& text, u8 key[KEY_SIZE]) {
+    if (text.size() != KEY_SIZE * 2) {
+        return false;
+    }
+    for (int i = 0; i < KEY_SIZE; i++) {
+        const std::string digits = text.substr(i * 2, 2);
+        char* end;
+        key[i] = (u8)strtoul(digits.c_str(), &end, 16);
+        if (*end != '\0' || !isxdigit((unsigned char)digits[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Parses a line of the keys file
+ * @param line Line, "slot0xNNKeyX=...", "slot0xNNKeyY=..." or "slot0xNNKey=..."
+ * @return False if the line is none of those
+ */
+bool ParseLine(const std::string& line) {
+    const size_t equals = line.find('=');
+    if (equals == std::string::npos || line.compare(0, 6, "slot0x") != 0 || equals < 11) {
+        return false;
+    }
+    char* end;
+    const std::string slot_digits = line.substr(6, 2);
+    const unsigned long index = strtoul(slot_digits.c_str(), &end, 16);
+    if (*end != '\0' || index >= NUM_SLOTS) {
+        return false;
+    }
+
+    Slot& slot = g_slots[index];
+    const std::string type = StripSpaces(line.substr(8, equals - 8));
+    const std::string value = StripSpaces(line.substr(equals + 1));
+    if (type == "KeyX") {
+        slot.has_key_x = ParseKey(value, slot.key_x);
+        return slot.has_key_x;
+    }
+    if (type == "KeyY") {
+        slot.has_key_y = ParseKey(value, slot.key_y);
+        return slot.has_key_y;
+    }
+    if (type == "Key") {
+        slot.has_normal_key = ParseKey(value, slot.normal_key);
+        return slot.has_normal_key;
+    }
+    return false;
+}
+
+} // namespace
+
+/// Loads the keys file, called when the hardware is initialized
+void Init() {
+    memset(g_slots, 0, sizeof(g_slots));
+
+    const std::string path = File::GetUserPath(D_SYSCONF_IDX) + AES_KEYS;
+    std::string text;
+    if (!File::Exists(path) || !File::ReadFileToString(true, path.c_str(), text)) {
+        INFO_LOG(HW, "no AES keys file at %s, encrypted content can't be read", path.c_str());
+        return;
+    }
+
+    std::istringstream lines(text);
+    std::string line;
+    int num_keys = 0;
+    for (int number = 1; std::getline(lines, line); number++) {
+        line = StripSpaces(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (ParseLine(line)) {
+            num_keys++;
+        } else {
+            WARN_LOG(HW, "%s:%d: not a key, ignored", path.c_str(), number);
+        }
+    }
+    NOTICE_LOG(HW, "loaded %d AES keys", num_keys);
+}
+
+/// Forgets the keys
+void Shutdown() {
+    memset(g_slots, 0, sizeof(g_slots));
+}
+
+/**
+ * Gets the normal key of a slot
+ * @param slot Key slot
+ * @param key Receives the key
+ * @return False if the slot has no normal key and no KeyX and KeyY to derive it from
+ */
+bool GetNormalKey(int slot, u8 key[KEY_SIZE]) {
+    if (slot < 0 || slot >= NUM_SLOTS) {
+        return false;
+    }
+    if (g_slots[slot].has_normal_key) {
+        memcpy(key, g_slots[slot].normal_key, KEY_SIZE);
+        return true;
+    }
+    return g_slots[slot].has_key_y && DeriveNormalKey(slot, g_slots[slot].key_y, key);
+}
+
+/**
+ * Derives a normal key from the KeyX of a slot and a KeyY, as the slot would with the KeyY set
+ * @param slot Key slot
+ * @param key_y KeyY
+ * @param key Receives the key
+ * @return False if the slot has no KeyX
+ */
+bool DeriveNormalKey(int slot, const u8 key_y[KEY_SIZE], u8 key[KEY_SIZE]) {
+    if (slot < 0 || slot >= NUM_SLOTS || !g_slots[slot].has_key_x) {
+        return false;
+    }
+    // ((KeyX <<< 2) ^ KeyY) + C, rotated left by 87
+    U128 value = RotateLeft(Load128(g_slots[slot].key_x), 2);
+    const U128 y = Load128(key_y);
+    const U128 c = Load128(kScramblerConstant);
+    value.high ^= y.high;
+    value.low ^= y.low;
+    const u64 low = value.low + c.low;
+    value.high += c.high + (low < value.low ? 1 : 0);
+    value.low = low;
+
+    const U128 swapped = { value.low, value.high };
+    Store128(RotateLeft(swapped, 87 - 64), key);
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Key slots of the AES engine. The keys of the console are secret and don't ship with the
+ * emulator: they are read at startup from aes_keys.txt in the sysconf directory, one per line as
+ * "slot0x2CKeyX=" followed by 32 hex digits, with KeyY and normal keys as "slot0x2CKeyY=" and
+ * "slot0x2CKey=". The normal key of a slot with both a KeyX and a KeyY is derived from them with
+ * the key scrambler of the hardware.
+ */
+namespace AESKeys {
+
+enum {
+    NUM_SLOTS   = 0x40,
+    KEY_SIZE    = 16,
+
+    SLOT_NCCH           = 0x2C,     ///< KeyX of the original NCCH crypto, KeyY from the NCCH
+    SLOT_NCCH_7X        = 0x25,     ///< Secondary NCCH keys of the later system versions
+    SLOT_NCCH_93        = 0x18,
+    SLOT_NCCH_96        = 0x1B,
+};
+
+/// Loads the keys file, called when the hardware is initialized
+void Init();
+
+/// Forgets the keys
+void Shutdown();
+
+/**
+ * Gets the normal key of a slot
+ * @param slot Key slot
+ * @param key Receives the key
+ * @return False if the slot has no normal key and no KeyX and KeyY to derive it from
+ */
+bool GetNormalKey(int slot, u8 key[KEY_SIZE]);
+
+/**
+ * Derives a normal key from the KeyX of a slot and a KeyY, as the slot would with the KeyY set
+ * @param slot Key slot
+ * @param key_y KeyY
+ * @param key Receives the key
+ * @return False if the slot has no KeyX
+ */
+bool DeriveNormalKey(int slot, const u8 key_y[KEY_SIZE], u8 key[KEY_SIZE]);
+
+} // namespace
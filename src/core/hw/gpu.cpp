@@ -2,16 +2,36 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
-#include "common/common_types.h"
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
 #include "common/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 #include "core/mem_map.h"
-#include "core/hle/kernel/thread.h"
+#include "core/speed_limiter.h"
+#include "core/statistics.h"
+#include "core/hle/service/gsp.h"
+#include "core/hle/service/hid.h"
 #include "core/hw/gpu.h"
+#include "core/hw/hw.h"
 
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/pica_trace.h"
+#include "video_core/rasterizer.h"
+#include "video_core/utils.h"
 #include "video_core/video_core.h"
 
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
 
 namespace GPU {
 
@@ -19,7 +39,398 @@ Registers g_regs;
 
 static const u32 kFrameTicks = 268123480 / 60;  ///< 268MHz / 60 frames per second
 
-u64 g_last_ticks = 0; ///< Last CPU ticks
+/// Cycles an engine takes at least for a job, the interrupts of tiny jobs don't come right away
+static const s64 kMinEngineTicks = 1000;
+
+// CoreTiming event types of the interrupts
+static int g_vblank_top_event = -1;         ///< Vertical blank of the top screen
+static int g_vblank_bottom_event = -1;      ///< Vertical blank of the bottom screen
+static int g_memory_fill_event = -1;        ///< Memory fill done, userdata is the fill unit
+static int g_transfer_event = -1;           ///< Display transfer or texture copy done
+static int g_command_list_event = -1;       ///< Command list done, userdata is its fence
+
+static u64 g_frame_count = 0;               ///< Frames presented since Init
+static bool g_present_frames = true;        ///< Whether the vertical blank presents the frame
+static bool g_count_frames = true;          ///< Whether the frame is emulated time
+static bool g_skip_frame = false;           ///< Whether frameskip skips the frame
+
+static Common::Profiler::Category g_profile_write("GPU::Write");
+static Common::PerfCounters::Region g_perf_transfers("GPU transfers");
+
+/**
+ * Gets the cycles an engine takes for a job. How fast the engines are isn't measured, the jobs
+ * are assumed to go through a word per cycle.
+ * @param size Number of bytes the job goes through
+ * @return Cycles from the start of the job to its completion interrupt
+ */
+static s64 GetEngineTicks(const u32 size) {
+    return std::max<s64>(size / 4, kMinEngineTicks);
+}
+
+/**
+ * Gets a host pointer to a physical memory range the engines access
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ * @return Host pointer, NULL if the range isn't contiguous memory in FCRAM or VRAM
+ */
+static u8* GetRangePointer(const u32 address, const u32 size) {
+    u8* pointer = VideoCore::GetPhysicalPointer(address);
+    if (pointer == NULL || size == 0 ||
+        VideoCore::GetPhysicalPointer(address + size - 1) != pointer + size - 1) {
+        return NULL;
+    }
+    return pointer;
+}
+
+/**
+ * Notifies the consumers of guest memory that an engine wrote to a range. The host copies of the
+ * range must have been flushed before the write.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+static void FinishWrite(const u32 address, const u32 size) {
+    // Replaying a trace writes the range again, it isn't traced
+    Memory::MarkRangeDirty(Memory::VirtualAddressFromPhysical(address), size,
+        Memory::DIRTY_ALL & ~Memory::DIRTY_TRACE);
+    Pica::Rasterizer::InvalidateRegion(address, size);
+}
+
+/**
+ * Fills memory with a repeating pattern
+ * @param dst Memory to fill
+ * @param size Size of the memory in bytes
+ * @param pattern 48 bytes to repeat, a multiple of every fill width
+ */
+static void FillPattern(u8* dst, const size_t size, const u8 pattern[48]) {
+    size_t i = 0;
+#ifdef _M_X64
+    // Non-temporal stores: fills clear whole render targets, which the CPU doesn't read back
+    const size_t head = std::min(size, (size_t)((16 - ((uintptr_t)dst & 15)) & 15));
+    for (; i < head; i++) {
+        dst[i] = pattern[i % 48];
+    }
+    u8 rotated[48];
+    for (int n = 0; n < 48; n++) {
+        rotated[n] = pattern[(head + n) % 48];
+    }
+    const __m128i a = _mm_loadu_si128((const __m128i*)rotated);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(rotated + 16));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(rotated + 32));
+    for (; i + 48 <= size; i += 48) {
+        _mm_stream_si128((__m128i*)(dst + i), a);
+        _mm_stream_si128((__m128i*)(dst + i + 16), b);
+        _mm_stream_si128((__m128i*)(dst + i + 32), c);
+    }
+    _mm_sfence();
+#endif
+    for (; i < size; i++) {
+        dst[i] = pattern[i % 48];
+    }
+}
+
+/**
+ * Runs a memory fill
+ * @param config Fill to run
+ */
+void MemoryFill(const MemoryFillConfig& config) {
+    // The command lists in flight may still render to the range
+    GPUThread::Sync();
+
+    const u32 size = config.end_address - config.start_address;
+    CoreTiming::ScheduleEvent(GetEngineTicks(size), g_memory_fill_event, config.engine);
+    u8* dst = config.end_address > config.start_address ?
+        GetRangePointer(config.start_address, size) : NULL;
+    if (dst == NULL) {
+        ERROR_LOG(GPU, "memory fill of invalid range 0x%08X-0x%08X", config.start_address,
+            config.end_address);
+        return;
+    }
+
+    // The value is stored little endian, like the pixels of the color buffers
+    const u32 value_size = config.width == MemoryFillConfig::Width16 ? 2 :
+        config.width == MemoryFillConfig::Width24 ? 3 : 4;
+    u8 pattern[48];
+    for (int n = 0; n < 48; n++) {
+        pattern[n] = (u8)(config.value >> ((n % value_size) * 8));
+    }
+
+    Pica::Rasterizer::FlushRegion(config.start_address, size);
+    Common::PerfCounters::Scope perf_scope(g_perf_transfers);
+    FillPattern(dst, size, pattern);
+    FinishWrite(config.start_address, size);
+}
+
+/**
+ * Runs a display transfer one pixel at a time, for any formats and either layout
+ * @param config Transfer to run
+ * @param input Input pixels
+ * @param output Receives the output pixels
+ */
+static void DisplayTransferGeneric(const DisplayTransferConfig& config, const u8* input,
+    u8* output) {
+    const VideoCore::ColorFormat input_format =
+        VideoCore::GetColorFormat(config.flags.input_format);
+    const VideoCore::ColorFormat output_format =
+        VideoCore::GetColorFormat(config.flags.output_format);
+    const u32 input_pixel_size = VideoCore::GetPixelSize(input_format);
+    const u32 output_pixel_size = VideoCore::GetPixelSize(output_format);
+    const u32 scale_x = config.flags.scaling != DisplayTransferFlags::NoScale ? 2 : 1;
+    const u32 scale_y = config.flags.scaling == DisplayTransferFlags::ScaleXY ? 2 : 1;
+    const bool output_tiled = config.flags.output_tiled != 0;
+
+    for (u32 y = 0; y < config.output_height; y++) {
+        for (u32 x = 0; x < config.output_width; x++) {
+            // Downscaling averages the input pixels covered by the output pixel
+            u32 sum[4] = { 0, 0, 0, 0 };
+            for (u32 sub_y = 0; sub_y < scale_y; sub_y++) {
+                for (u32 sub_x = 0; sub_x < scale_x; sub_x++) {
+                    const u32 input_x = std::min(x * scale_x + sub_x, config.input_width - 1);
+                    const u32 input_y = std::min(y * scale_y + sub_y, config.input_height - 1);
+                    const u32 offset = output_tiled ? input_y * config.input_width + input_x :
+                        VideoCore::GetTiledPixelOffset(input_x, input_y, config.input_width);
+                    u8 rgba[4];
+                    VideoCore::DecodeColor(input_format, input + offset * input_pixel_size, rgba);
+                    for (int c = 0; c < 4; c++) {
+                        sum[c] += rgba[c];
+                    }
+                }
+            }
+            const u32 count = scale_x * scale_y;
+            u8 rgba[4];
+            for (int c = 0; c < 4; c++) {
+                rgba[c] = (u8)((sum[c] + count / 2) / count);
+            }
+
+            const u32 output_y = config.flags.flip_vertically ? config.output_height - 1 - y : y;
+            const u32 offset = output_tiled ?
+                VideoCore::GetTiledPixelOffset(x, output_y, config.output_width) :
+                output_y * config.output_width + x;
+            VideoCore::EncodeColor(output_format, rgba, output + offset * output_pixel_size);
+        }
+    }
+}
+
+#ifdef _M_X64
+
+/**
+ * Stores 4 RGBA8 pixels as RGB8
+ * @param dst Receives the 12 bytes of the pixels
+ * @param pixels Pixels
+ */
+static inline void StoreRGB8(u8* dst, const __m128i pixels) {
+    // Alpha is the lowest byte of a pixel. Pack the remaining 3 bytes of both pixels of each
+    // quadword, then both quadwords.
+    const __m128i rgb = _mm_srli_epi32(pixels, 8);
+    const __m128i low_dwords = _mm_set_epi32(0, -1, 0, -1);
+    const __m128i pairs = _mm_or_si128(_mm_and_si128(rgb, low_dwords),
+        _mm_srli_epi64(_mm_andnot_si128(low_dwords, rgb), 8));
+    const __m128i packed = _mm_or_si128(_mm_move_epi64(pairs),
+        _mm_srli_si128(_mm_unpackhi_epi64(_mm_setzero_si128(), pairs), 2));
+    _mm_storel_epi64((__m128i*)dst, packed);
+    const u32 last = (u32)_mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+    memcpy(dst + 8, &last, sizeof(last));
+}
+
+/**
+ * Averages the 4 RGBA8 pixels of a 16 byte block
+ * @param block Pixels
+ * @return Average pixel
+ */
+static inline u32 AveragePixels(const __m128i block) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(block, zero), _mm_unpackhi_epi8(block, zero));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+    return (u32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+}
+
+/**
+ * Runs the display transfers of rendered frames to the LCD framebuffers: tiled RGBA8 to linear
+ * RGBA8 or RGB8, unscaled or downscaled 2x2. The tiles are converted a row or a 2x2 quad at a
+ * time, which Morton order keeps in 16 byte blocks.
+ * @param config Transfer to run
+ * @param input Input pixels
+ * @param output Receives the output pixels
+ * @return True if done, false if the transfer isn't of that kind
+ */
+static bool DisplayTransferSSE2(const DisplayTransferConfig& config, const u8* input, u8* output) {
+    const VideoCore::ColorFormat output_format =
+        VideoCore::GetColorFormat(config.flags.output_format);
+    const bool downscale = config.flags.scaling == DisplayTransferFlags::ScaleXY;
+    const u32 scale = downscale ? 2 : 1;
+    if (config.flags.output_tiled || config.flags.input_format != TransferFormat::RGBA8 ||
+        (output_format != VideoCore::ColorFormat::RGBA8 &&
+        output_format != VideoCore::ColorFormat::RGB8) ||
+        (config.flags.scaling != DisplayTransferFlags::NoScale && !downscale) ||
+        config.output_width * scale != config.input_width ||
+        config.output_height * scale != config.input_height ||
+        config.input_width % 8 != 0 || config.input_height % 8 != 0) {
+        return false;
+    }
+    const bool rgb8 = output_format == VideoCore::ColorFormat::RGB8;
+    const u32 pixel_size = rgb8 ? 3 : 4;
+    const u32 tile_size = 8 / scale;
+
+    const u8* tile = input;
+    for (u32 tile_y = 0; tile_y < config.output_height; tile_y += tile_size) {
+        for (u32 tile_x = 0; tile_x < config.output_width; tile_x += tile_size, tile += 256) {
+            // Block n holds the pixels 4n to 4n+3 in Morton order: a 2x2 quad
+            __m128i blocks[16];
+            for (int n = 0; n < 16; n++) {
+                blocks[n] = _mm_loadu_si128((const __m128i*)tile + n);
+            }
+
+            __m128i rows[8][2];
+            if (downscale) {
+                u32 pixels[4][4];
+                for (int n = 0; n < 16; n++) {
+                    pixels[((n >> 1) & 1) | ((n >> 2) & 2)][(n & 1) | ((n >> 1) & 2)] =
+                        AveragePixels(blocks[n]);
+                }
+                for (int y = 0; y < 4; y++) {
+                    rows[y][0] = _mm_loadu_si128((const __m128i*)pixels[y]);
+                }
+            } else {
+                // The low quadword of a block is in an even row, the high one in an odd row
+                for (int y = 0; y < 8; y++) {
+                    const int n = (y & 2) | ((y & 4) << 1);
+                    if (y & 1) {
+                        rows[y][0] = _mm_unpackhi_epi64(blocks[n], blocks[n | 1]);
+                        rows[y][1] = _mm_unpackhi_epi64(blocks[n | 4], blocks[n | 5]);
+                    } else {
+                        rows[y][0] = _mm_unpacklo_epi64(blocks[n], blocks[n | 1]);
+                        rows[y][1] = _mm_unpacklo_epi64(blocks[n | 4], blocks[n | 5]);
+                    }
+                }
+            }
+
+            for (u32 y = 0; y < tile_size; y++) {
+                const u32 output_y = config.flags.flip_vertically ?
+                    config.output_height - 1 - (tile_y + y) : tile_y + y;
+                u8* row = output + (output_y * config.output_width + tile_x) * pixel_size;
+                for (u32 half = 0; half < tile_size / 4; half++) {
+                    if (rgb8) {
+                        StoreRGB8(row + half * 12, rows[y][half]);
+                    } else {
+                        _mm_storeu_si128((__m128i*)(row + half * 16), rows[y][half]);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+#endif
+
+/**
+ * Runs a display transfer, on the host GPU if its input is only up to date there
+ * @param config Transfer to run
+ */
+void DisplayTransfer(const DisplayTransferConfig& config) {
+    // The command lists in flight may still render to the input
+    GPUThread::Sync();
+    CoreTiming::ScheduleEvent(GetEngineTicks(config.output_width * config.output_height * 4),
+        g_transfer_event);
+    Pica::CommandProcessor::OnDisplayTransfer(config.input_address, config.output_address);
+    if (VideoCore::g_mono_enabled && (config.output_address == g_regs.framebuffer_top_right_1 ||
+        config.output_address == g_regs.framebuffer_top_right_2)) {
+        // Its draws were skipped, and the right eye isn't presented
+        return;
+    }
+    if (Pica::Rasterizer::AccelerateDisplayTransfer(config)) {
+        return;
+    }
+    Common::PerfCounters::Scope perf_scope(g_perf_transfers);
+
+    const u32 input_size = config.input_width * config.input_height *
+        VideoCore::GetPixelSize(VideoCore::GetColorFormat(config.flags.input_format));
+    const u32 output_size = config.output_width * config.output_height *
+        VideoCore::GetPixelSize(VideoCore::GetColorFormat(config.flags.output_format));
+    const u8* input = GetRangePointer(config.input_address, input_size);
+    u8* output = GetRangePointer(config.output_address, output_size);
+    if (input == NULL || output == NULL) {
+        ERROR_LOG(GPU, "display transfer of invalid range 0x%08X -> 0x%08X",
+            config.input_address, config.output_address);
+        return;
+    }
+
+    Pica::Rasterizer::FlushRegion(config.input_address, input_size);
+    Pica::Rasterizer::FlushRegion(config.output_address, output_size);
+#ifdef _M_X64
+    if (!DisplayTransferSSE2(config, input, output))
+#endif
+    {
+        DisplayTransferGeneric(config, input, output);
+    }
+    FinishWrite(config.output_address, output_size);
+}
+
+/**
+ * Gets the size of the memory a texture copy accesses on one side
+ * @param size Number of bytes copied
+ * @param width Bytes in a line
+ * @param gap Bytes skipped after a line
+ * @return Size in bytes, from the first byte to the last one copied
+ */
+static u32 GetCopySpan(const u32 size, const u32 width, const u32 gap) {
+    const u32 span = size / width * (width + gap) + size % width;
+    return size % width == 0 ? span - gap : span;
+}
+
+/**
+ * Runs a texture copy, on the host GPU if its input is only up to date there
+ * @param config Copy to run
+ */
+void TextureCopy(const TextureCopyConfig& config) {
+    GPUThread::Sync();
+    CoreTiming::ScheduleEvent(GetEngineTicks(config.size), g_transfer_event);
+    if (Pica::Rasterizer::AccelerateTextureCopy(config) || config.size == 0) {
+        return;
+    }
+
+    // Gapless copies go in one block, whatever the line widths
+    const bool gapless = config.input_gap == 0 && config.output_gap == 0;
+    const u32 input_width = gapless || config.input_width == 0 ? config.size : config.input_width;
+    const u32 output_width = gapless || config.output_width == 0 ? config.size :
+        config.output_width;
+    const u32 input_size = GetCopySpan(config.size, input_width, config.input_gap);
+    const u32 output_size = GetCopySpan(config.size, output_width, config.output_gap);
+    const u8* src = GetRangePointer(config.input_address, input_size);
+    u8* dst = GetRangePointer(config.output_address, output_size);
+    if (src == NULL || dst == NULL) {
+        ERROR_LOG(GPU, "texture copy of invalid range 0x%08X -> 0x%08X", config.input_address,
+            config.output_address);
+        return;
+    }
+
+    Pica::Rasterizer::FlushRegion(config.input_address, input_size);
+    Pica::Rasterizer::FlushRegion(config.output_address, output_size);
+
+    // Copy the longest runs that are contiguous on both sides
+    u32 input_x = 0;
+    u32 output_x = 0;
+    for (u32 remaining = config.size; remaining > 0;) {
+        const u32 span = std::min(remaining, std::min(input_width - input_x,
+            output_width - output_x));
+        memmove(dst, src, span);
+        src += span;
+        dst += span;
+        remaining -= span;
+        input_x += span;
+        output_x += span;
+        if (input_x == input_width) {
+            src += config.input_gap;
+            input_x = 0;
+        }
+        if (output_x == output_width) {
+            dst += config.output_gap;
+            output_x = 0;
+        }
+    }
+
+    FinishWrite(config.output_address, output_size);
+}
 
 /**
  * Sets whether the framebuffers are in the GSP heap (FCRAM) or VRAM
@@ -67,121 +478,169 @@ const FramebufferLocation GetFramebufferLocation() {
 }
 
 /**
- * Gets a read-only pointer to a framebuffer in memory
+ * Gets the virtual address of a framebuffer, which its dirty page bits are tracked under
  * @param address Physical address of framebuffer
- * @return Returns const pointer to raw framebuffer
+ * @return Virtual address of the framebuffer, 0 if the framebuffer location is unknown
  */
-const u8* GetFramebufferPointer(const u32 address) {
+const u32 GetFramebufferVirtualAddress(const u32 address) {
     switch (GetFramebufferLocation()) {
     case FRAMEBUFFER_LOCATION_FCRAM:
-        return (const u8*)Memory::GetPointer(Memory::VirtualAddressFromPhysical_FCRAM(address));
+        return Memory::VirtualAddressFromPhysical_FCRAM(address);
     case FRAMEBUFFER_LOCATION_VRAM:
-        return (const u8*)Memory::GetPointer(Memory::VirtualAddressFromPhysical_VRAM(address));
+        return Memory::VirtualAddressFromPhysical_VRAM(address);
     default:
         ERROR_LOG(GPU, "unknown framebuffer location");
     }
-    return NULL;
+    return 0;
 }
 
-template <typename T>
-inline void Read(T &var, const u32 addr) {
-    switch (addr) {
-    case Registers::FramebufferTopLeft1:
-        var = g_regs.framebuffer_top_left_1;
-        break;
-
-    case Registers::FramebufferTopLeft2:
-        var = g_regs.framebuffer_top_left_2;
-        break;
-
-    case Registers::FramebufferTopRight1:
-        var = g_regs.framebuffer_top_right_1;
-        break;
-
-    case Registers::FramebufferTopRight2:
-        var = g_regs.framebuffer_top_right_2;
-        break;
-
-    case Registers::FramebufferSubLeft1:
-        var = g_regs.framebuffer_sub_left_1;
-        break;
-
-    case Registers::FramebufferSubRight1:
-        var = g_regs.framebuffer_sub_right_1;
-        break;
-
-    case Registers::CommandListSize:
-        var = g_regs.command_list_size;
-        break;
-
-    case Registers::CommandListAddress:
-        var = g_regs.command_list_address;
-        break;
-
-    case Registers::ProcessCommandList:
-        var = g_regs.command_processing_enabled;
-        break;
+/**
+ * Gets a read-only pointer to a framebuffer in memory
+ * @param address Physical address of framebuffer
+ * @return Returns const pointer to raw framebuffer
+ */
+const u8* GetFramebufferPointer(const u32 address) {
+    const u32 virtual_address = GetFramebufferVirtualAddress(address);
+    return virtual_address != 0 ? (const u8*)Memory::GetPointer(virtual_address) : NULL;
+}
 
-    default:
-        ERROR_LOG(GPU, "unknown Read%d @ 0x%08X", sizeof(var) * 8, addr);
-        break;
+/// Starts the command list set up in the registers when the guest sets bit 0
+static void WriteProcessCommandList(u32 addr, u32 data) {
+    Common::Profiler::Scope scope(g_profile_write);
+    g_regs.command_processing_enabled = data;
+    if (g_regs.command_processing_enabled & 1) {
+        const u32 address = g_regs.command_list_address << 3;
+        DEBUG_LOG(GPU, "Beginning %x bytes of commands from address %x",
+            g_regs.command_list_size << 3, address);
+        const u32 size = g_regs.command_list_size << 3;
+        const u32 fence = GPUThread::SubmitCommandList(address, size);
+        CoreTiming::ScheduleEvent(GetEngineTicks(size), g_command_list_event, fence);
     }
 }
 
-template <typename T>
-inline void Write(u32 addr, const T data) {
-    switch (static_cast<Registers::Id>(addr)) {
-    case Registers::CommandListSize:
-        g_regs.command_list_size = data;
-        break;
+/// Gives the GPU its pages of IO and sets the handlers of the registers it emulates
+static void MapRegisters() {
+    HW::MapDevicePage(0x1EF00000, "GPU");
+    HW::MapDevicePage(0x1EF01000, "GPU");
+
+    // The framebuffer registers are only read, the guest sets the framebuffers through GSP
+    HW::SetRegisterHandlers(Registers::FramebufferTopLeft1,
+        [](u32) -> u32 { return g_regs.framebuffer_top_left_1; }, NULL);
+    HW::SetRegisterHandlers(Registers::FramebufferTopLeft2,
+        [](u32) -> u32 { return g_regs.framebuffer_top_left_2; }, NULL);
+    HW::SetRegisterHandlers(Registers::FramebufferTopRight1,
+        [](u32) -> u32 { return g_regs.framebuffer_top_right_1; }, NULL);
+    HW::SetRegisterHandlers(Registers::FramebufferTopRight2,
+        [](u32) -> u32 { return g_regs.framebuffer_top_right_2; }, NULL);
+    HW::SetRegisterHandlers(Registers::FramebufferSubLeft1,
+        [](u32) -> u32 { return g_regs.framebuffer_sub_left_1; }, NULL);
+    HW::SetRegisterHandlers(Registers::FramebufferSubRight1,
+        [](u32) -> u32 { return g_regs.framebuffer_sub_right_1; }, NULL);
+
+    HW::SetRegisterHandlers(Registers::CommandListSize,
+        [](u32) -> u32 { return g_regs.command_list_size; },
+        [](u32, u32 data) { g_regs.command_list_size = data; });
+    HW::SetRegisterHandlers(Registers::CommandListAddress,
+        [](u32) -> u32 { return g_regs.command_list_address; },
+        [](u32, u32 data) { g_regs.command_list_address = data; });
+    HW::SetRegisterHandlers(Registers::ProcessCommandList,
+        [](u32) -> u32 { return g_regs.command_processing_enabled; }, WriteProcessCommandList);
+}
 
-    case Registers::CommandListAddress:
-        g_regs.command_list_address = data;
-        break;
+/// Fakes a vertical blank of the top screen once per frame, which presents the frame
+static void VBlankTopCallback(u64 userdata, int cycles_late) {
+    if (g_present_frames && !g_skip_frame) {
+        // The renderer reads the framebuffers, which the command lists in flight may still render
+        // to
+        GPUThread::Sync();
+        VideoCore::g_renderer->SwapBuffers();
+    }
+    VideoCore::g_frame_arena.Reset();
+    bool skip = false;
+    if (g_count_frames) {
+        PicaTrace::OnFrame();
+        Common::Profiler::EndFrame();
+        // Frames emulated ahead and the ones that count under them aren't skipped
+        skip = SpeedLimiter::Throttle() && g_present_frames;
+    }
+    if (SpeedLimiter::g_frameskip_enabled || g_skip_frame) {
+        // The command processor starts skipping between two command lists
+        GPUThread::Sync();
+        Pica::CommandProcessor::SetFrameSkipped(skip);
+        g_skip_frame = skip;
+    }
+    HID_User::Update();
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC0);
+    if (g_count_frames) {
+        g_frame_count++;
+        Statistics::Update();
+    }
 
-    case Registers::ProcessCommandList:
-        g_regs.command_processing_enabled = data;
-        if (g_regs.command_processing_enabled & 1)
-        {
-            // u32* buffer = (u32*)Memory::GetPointer(g_regs.command_list_address << 3);
-            ERROR_LOG(GPU, "Beginning %x bytes of commands from address %x", g_regs.command_list_size, g_regs.command_list_address << 3);
-            // TODO: Process command list!
-        }
-        break;
+    CoreTiming::ScheduleEvent(kFrameTicks - cycles_late, g_vblank_top_event);
+}
 
-    default:
-        ERROR_LOG(GPU, "unknown Write%d 0x%08X @ 0x%08X", sizeof(data) * 8, data, addr);
-        break;
-    }
+/// Fakes a vertical blank of the bottom screen once per frame
+static void VBlankBottomCallback(u64 userdata, int cycles_late) {
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC1);
+    CoreTiming::ScheduleEvent(kFrameTicks - cycles_late, g_vblank_bottom_event);
 }
 
-// Explicitly instantiate template functions because we aren't defining this in the header:
+/// Signals the end of a memory fill, userdata is the fill unit
+static void MemoryFillCallback(u64 userdata, int cycles_late) {
+    GSP_GPU::SignalInterrupt(userdata == 0 ? GSP_GPU::InterruptId::PSC0 :
+        GSP_GPU::InterruptId::PSC1);
+}
 
-template void Read<u64>(u64 &var, const u32 addr);
-template void Read<u32>(u32 &var, const u32 addr);
-template void Read<u16>(u16 &var, const u32 addr);
-template void Read<u8>(u8 &var, const u32 addr);
+/// Signals the end of a display transfer or texture copy
+static void TransferCallback(u64 userdata, int cycles_late) {
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
+}
 
-template void Write<u64>(u32 addr, const u64 data);
-template void Write<u32>(u32 addr, const u32 data);
-template void Write<u16>(u32 addr, const u16 data);
-template void Write<u8>(u32 addr, const u8 data);
+/// Signals the end of a command list, userdata is its fence
+static void CommandListCallback(u64 userdata, int cycles_late) {
+    // The guest reads what the list rendered once told it's done
+    GPUThread::WaitForFence((u32)userdata);
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
+}
 
-/// Update hardware
-void Update() {
-    u64 current_ticks = Core::g_app_core->GetTicks();
+/// Gets the number of frames presented since Init, counted at the vertical blank of the top screen
+u64 GetFrameCount() {
+    return g_frame_count;
+}
 
-    // Fake a vertical blank
-    if ((current_ticks - g_last_ticks) >= kFrameTicks) {
-        g_last_ticks = current_ticks;
-        VideoCore::g_renderer->SwapBuffers();
-        Kernel::WaitCurrentThread(WAITTYPE_VBLANK);
-    }
+/**
+ * Gets the number of emulated CPU cycles of a frame
+ * @return Cycles between two vertical blanks
+ */
+u32 GetFrameCycles() {
+    return kFrameTicks;
+}
+
+/**
+ * Sets what the vertical blank of the top screen does with the frame, for run-ahead, which shows
+ * frames emulated ahead in place of the ones that count. Both are on by default.
+ * @param present Whether the frame is presented
+ * @param count Whether the frame is emulated time: counted, throttled, traced and profiled
+ */
+void SetFrameOutput(bool present, bool count) {
+    g_present_frames = present;
+    g_count_frames = count;
 }
 
 /// Initialize hardware
 void Init() {
-    g_last_ticks = Core::g_app_core->GetTicks();
+    g_frame_count = 0;
+    g_present_frames = g_count_frames = true;
+    g_skip_frame = false;
+    MapRegisters();
+    g_vblank_top_event = CoreTiming::RegisterEvent("GPU::VBlankTop", VBlankTopCallback);
+    g_vblank_bottom_event = CoreTiming::RegisterEvent("GPU::VBlankBottom", VBlankBottomCallback);
+    g_memory_fill_event = CoreTiming::RegisterEvent("GPU::MemoryFill", MemoryFillCallback);
+    g_transfer_event = CoreTiming::RegisterEvent("GPU::Transfer", TransferCallback);
+    g_command_list_event = CoreTiming::RegisterEvent("GPU::CommandList", CommandListCallback);
+    CoreTiming::ScheduleEvent(kFrameTicks, g_vblank_top_event);
+    CoreTiming::ScheduleEvent(kFrameTicks, g_vblank_bottom_event);
+
     SetFramebufferLocation(FRAMEBUFFER_LOCATION_FCRAM);
     NOTICE_LOG(GPU, "initialized OK");
 }
@@ -191,4 +650,16 @@ void Shutdown() {
     NOTICE_LOG(GPU, "shutdown OK");
 }
 
+/**
+ * Saves or loads the GPU registers, jobs in flight finish through their CoreTiming events
+ * @param p Savestate the registers are written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("GPU", 1);
+    if (!s) {
+        return;
+    }
+    p.Do(g_regs);
+}
+
 } // namespace
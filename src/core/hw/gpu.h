@@ -5,6 +5,9 @@
 #pragma once
 
 #include "common/common_types.h"
+#include "common/bit_field.h"
+
+class PointerWrap;
 
 namespace GPU {
 
@@ -74,12 +77,100 @@ enum FramebufferLocation {
     FRAMEBUFFER_LOCATION_VRAM,      ///< Framebuffer is in VRAM
 };
 
+/// Memory fill: fills a memory range with a 16, 24 or 32-bit value
+struct MemoryFillConfig {
+    enum Width : u32 {
+        Width16     = 0,
+        Width24     = 1,
+        Width32     = 2,
+    };
+
+    u32     start_address;      ///< Physical address of the range
+    u32     end_address;        ///< Physical address past the end of the range
+    u32     value;
+    Width   width;
+    u32     engine;             ///< Fill unit, 0 or 1, the completion raises PSC0 or PSC1
+};
+
+/// Pixel formats of the display transfer engine, numbered differently from the PICA color buffers
+enum class TransferFormat : u32 {
+    RGBA8   = 0,
+    RGB8    = 1,
+    RGB565  = 2,
+    RGB5A1  = 3,
+    RGBA4   = 4,
+};
+
+/// Flags of a display transfer
+union DisplayTransferFlags {
+    enum Scaling : u32 {
+        NoScale     = 0,    ///< Output size equals the input size
+        ScaleX      = 1,    ///< Each output pixel averages 2x1 input pixels
+        ScaleXY     = 2,    ///< Each output pixel averages 2x2 input pixels
+    };
+
+    u32 hex;
+
+    BitField< 0, 1, u32>            flip_vertically;
+    BitField< 1, 1, u32>            output_tiled;   ///< Linear input to tiled output, else reverse
+    BitField< 8, 3, TransferFormat> input_format;
+    BitField<12, 3, TransferFormat> output_format;
+    BitField<24, 2, Scaling>        scaling;
+};
+
+/// Display transfer: converts a color buffer between the tiled and linear layouts
+struct DisplayTransferConfig {
+    u32                     input_address;      ///< Physical address of the input
+    u32                     output_address;     ///< Physical address of the output
+    u32                     input_width;
+    u32                     input_height;
+    u32                     output_width;
+    u32                     output_height;
+    DisplayTransferFlags    flags;
+};
+
+/// Texture copy: copies lines of bytes, skipping a gap in the input and output after each line
+struct TextureCopyConfig {
+    u32 input_address;      ///< Physical address of the input
+    u32 output_address;     ///< Physical address of the output
+    u32 size;               ///< Number of bytes copied, not counting the gaps
+    u32 input_width;        ///< Bytes in a line of the input
+    u32 input_gap;          ///< Bytes skipped after a line of the input
+    u32 output_width;       ///< Bytes in a line of the output
+    u32 output_gap;         ///< Bytes skipped after a line of the output
+};
+
+/**
+ * Runs a memory fill, its completion interrupt comes later on
+ * @param config Fill to run
+ */
+void MemoryFill(const MemoryFillConfig& config);
+
+/**
+ * Runs a display transfer, on the host GPU if its input is only up to date there
+ * @param config Transfer to run
+ */
+void DisplayTransfer(const DisplayTransferConfig& config);
+
+/**
+ * Runs a texture copy, on the host GPU if its input is only up to date there
+ * @param config Copy to run
+ */
+void TextureCopy(const TextureCopyConfig& config);
+
 /**
  * Sets whether the framebuffers are in the GSP heap (FCRAM) or VRAM
  * @param 
  */
 void SetFramebufferLocation(const FramebufferLocation mode);
 
+/**
+ * Gets the virtual address of a framebuffer, which its dirty page bits are tracked under
+ * @param address Physical address of framebuffer
+ * @return Virtual address of the framebuffer, 0 if the framebuffer location is unknown
+ */
+const u32 GetFramebufferVirtualAddress(const u32 address);
+
 /**
  * Gets a read-only pointer to a framebuffer in memory
  * @param address Physical address of framebuffer
@@ -92,14 +183,22 @@ const u8* GetFramebufferPointer(const u32 address);
  */
 const FramebufferLocation GetFramebufferLocation();
 
-template <typename T>
-inline void Read(T &var, const u32 addr);
+/// Gets the number of frames presented since Init, counted at the vertical blank of the top screen
+u64 GetFrameCount();
 
-template <typename T>
-inline void Write(u32 addr, const T data);
+/**
+ * Gets the number of emulated CPU cycles of a frame
+ * @return Cycles between two vertical blanks
+ */
+u32 GetFrameCycles();
 
-/// Update hardware
-void Update();
+/**
+ * Sets what the vertical blank of the top screen does with the frame, for run-ahead, which shows
+ * frames emulated ahead in place of the ones that count. Both are on by default.
+ * @param present Whether the frame is presented
+ * @param count Whether the frame is emulated time: counted, throttled, traced and profiled
+ */
+void SetFrameOutput(bool present, bool count);
 
 /// Initialize hardware
 void Init();
@@ -107,5 +206,11 @@ void Init();
 /// Shutdown hardware
 void Shutdown();
 
+/**
+ * Saves or loads the GPU registers, jobs in flight finish through their CoreTiming events
+ * @param p Savestate the registers are written to or read from
+ */
+void DoState(PointerWrap& p);
+
 
 } // namespace
@@ -0,0 +1,143 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/crypto.h"
+#include "common/log.h"
+
+#include "core/hw/hash.h"
+#include "core/hw/hw.h"
+
+namespace HASH {
+
+namespace {
+
+/// Virtual addresses of the registers and of the input FIFO
+const u32 kRegistersVAddr = 0x1EC01000;
+const u32 kFifoVAddr = 0x1EE01000;
+const u32 kFifoSize = 0x40;     ///< Words written anywhere in it go to the FIFO
+
+enum {
+    REG_CONTROL     = 0x00,
+    REG_SIZE        = 0x04,     ///< Bytes hashed since the hash started
+    REG_HASH        = 0x40,     ///< Digest, 8 words
+};
+
+enum {
+    CONTROL_START       = 1u << 0,  ///< Written to start a hash, reads set while one runs
+    CONTROL_FINAL       = 1u << 1,  ///< Written to end the hash, the digest is then readable
+    CONTROL_BIG_ENDIAN  = 1u << 3,  ///< Digest read as the bytes it is, not as words
+    CONTROL_MODE_SHIFT  = 4,        ///< 0 for SHA-256, 1 for SHA-224, 2 and 3 for SHA-1
+    CONTROL_MODE_MASK   = 3u << CONTROL_MODE_SHIFT,
+};
+
+u32 g_control;
+u32 g_size;
+u8 g_digest[Common::SHA256::DIGEST_SIZE];
+Common::SHA256 g_sha;
+
+u32 ReadRegister(u32 addr) {
+    const u32 offset = addr - kRegistersVAddr;
+    if (offset == REG_CONTROL) {
+        return g_control;
+    }
+    if (offset == REG_SIZE) {
+        return g_size;
+    }
+
+    u32 word;
+    memcpy(&word, &g_digest[offset - REG_HASH], sizeof(word));
+    if (!(g_control & CONTROL_BIG_ENDIAN)) {
+        word = Common::swap32(word);
+    }
+    return word;
+}
+
+void WriteRegister(u32 addr, u32 data) {
+    const u32 offset = addr - kRegistersVAddr;
+    if (offset == REG_SIZE) {
+        g_size = data;
+        return;
+    }
+    if (offset != REG_CONTROL) {
+        return;
+    }
+
+    if (((data & CONTROL_MODE_MASK) >> CONTROL_MODE_SHIFT) != 0 && (data & CONTROL_START)) {
+        ERROR_LOG(HW, "HASH: mode %u not emulated, hashing with SHA-256",
+            (data & CONTROL_MODE_MASK) >> CONTROL_MODE_SHIFT);
+    }
+    if (data & CONTROL_START) {
+        g_sha.Reset();
+        g_size = 0;
+    }
+    g_control = data & ~CONTROL_FINAL;
+    if (data & CONTROL_FINAL) {
+        g_sha.Final(g_digest);
+        g_control &= ~CONTROL_START;
+    }
+}
+
+/// Hashes a word written to the input FIFO, the hash runs as fast as the FIFO is written
+void WriteFifo(u32 addr, u32 data) {
+    if (!(g_control & CONTROL_START)) {
+        DEBUG_LOG(HW, "HASH: FIFO written with no hash started");
+        return;
+    }
+    const u32_le word = data;
+    g_sha.Update((const u8*)&word, sizeof(word));
+    g_size += sizeof(word);
+}
+
+/// Gives HASH its pages of IO and sets the handlers of its registers
+void MapRegisters() {
+    HW::MapDevicePage(kRegistersVAddr, "HASH");
+    HW::SetRegisterHandlers(kRegistersVAddr + REG_CONTROL, ReadRegister, WriteRegister);
+    HW::SetRegisterHandlers(kRegistersVAddr + REG_SIZE, ReadRegister, WriteRegister);
+    for (u32 offset = 0; offset < Common::SHA256::DIGEST_SIZE; offset += 4) {
+        HW::SetRegisterHandlers(kRegistersVAddr + REG_HASH + offset, ReadRegister, NULL);
+    }
+
+    HW::MapDevicePage(kFifoVAddr, "HASH");
+    for (u32 offset = 0; offset < kFifoSize; offset += 4) {
+        HW::SetRegisterHandlers(kFifoVAddr + offset, NULL, WriteFifo);
+    }
+}
+
+} // namespace
+
+/// Initialize hardware
+void Init() {
+    g_control = 0;
+    g_size = 0;
+    memset(g_digest, 0, sizeof(g_digest));
+    g_sha.Reset();
+    MapRegisters();
+    NOTICE_LOG(HW, "HASH initialized OK");
+}
+
+/// Shutdown hardware
+void Shutdown() {
+    NOTICE_LOG(HW, "HASH shutdown OK");
+}
+
+/**
+ * Saves or loads the registers and the hash in progress
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("HASH", 1);
+    if (!s) {
+        return;
+    }
+    p.Do(g_control);
+    p.Do(g_size);
+    p.DoArray(g_digest, Common::SHA256::DIGEST_SIZE);
+    g_sha.DoState(p);
+}
+
+} // namespace
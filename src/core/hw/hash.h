@@ -0,0 +1,30 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+// The HASH engine hashes the words written to its input FIFO with SHA-256, for the system to
+// check the content it reads. Its control register starts a hash and ends it, the digest is then
+// read from its hash registers. The hashing itself is instant, with the SHA extensions of the
+// host CPU when it has them.
+
+namespace HASH {
+
+/// Initialize hardware
+void Init();
+
+/// Shutdown hardware
+void Shutdown();
+
+/**
+ * Saves or loads the registers and the hash in progress
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
+} // namespace
@@ -5,8 +5,11 @@
 #include "common/common_types.h"
 #include "common/log.h"
 
+#include "core/mem_map.h"
 #include "core/hw/hw.h"
+#include "core/hw/aes_keys.h"
 #include "core/hw/gpu.h"
+#include "core/hw/hash.h"
 #include "core/hw/ndma.h"
 
 namespace HW {
@@ -37,39 +40,126 @@ enum {
     VADDR_GPU       = 0x1EF00000,
 };
 
+namespace {
+
+enum {
+    REGISTERS_PER_PAGE  = Memory::PAGE_SIZE / 4,
+    NUM_IO_PAGES        = Memory::HARDWARE_IO_SIZE >> Memory::PAGE_BITS,
+};
+
+/// Registers of a page of IO, every one of them has both handlers
+struct DevicePage {
+    const char*             device;
+    u32                     unknown_accesses;   ///< Only every 1000th is logged
+    RegisterReadHandler     reads[REGISTERS_PER_PAGE];
+    RegisterWriteHandler    writes[REGISTERS_PER_PAGE];
+};
+
+/// Pages no device was given, they log every access as unknown too
+DevicePage g_unmapped_page;
+
+/// Page of every IO page, g_unmapped_page for those of no device
+DevicePage* g_pages[NUM_IO_PAGES];
+
+/// Gets the page of an IO address
+DevicePage* GetPage(u32 addr) {
+    return g_pages[(addr - Memory::HARDWARE_IO_VADDR) >> Memory::PAGE_BITS];
+}
+
+/// Gets the index of the register of an IO address in its page
+u32 GetRegisterIndex(u32 addr) {
+    return (addr & Memory::PAGE_MASK) >> 2;
+}
+
+u32 ReadUnknown(u32 addr) {
+    DevicePage* page = GetPage(addr);
+    if (page->unknown_accesses++ % 1000 == 0) {
+        ERROR_LOG(HW, "unknown register read @ 0x%08X (%s)", addr, page->device);
+    }
+    return 0;
+}
+
+void WriteUnknown(u32 addr, u32 data) {
+    DevicePage* page = GetPage(addr);
+    if (page->unknown_accesses++ % 1000 == 0) {
+        ERROR_LOG(HW, "unknown register write 0x%08X @ 0x%08X (%s)", data, addr,
+            page->device);
+    }
+}
+
+/// Initializes a page with no register handled
+void ResetPage(DevicePage& page, const char* device) {
+    page.device = device;
+    page.unknown_accesses = 0;
+    for (int i = 0; i < REGISTERS_PER_PAGE; i++) {
+        page.reads[i] = ReadUnknown;
+        page.writes[i] = WriteUnknown;
+    }
+}
+
+/// Gives every page back to no device
+void UnmapPages() {
+    for (int i = 0; i < NUM_IO_PAGES; i++) {
+        if (g_pages[i] != &g_unmapped_page) {
+            delete g_pages[i];
+        }
+        g_pages[i] = &g_unmapped_page;
+    }
+}
+
+/// Reads a register, an access is two indexed loads and a call
+inline u32 ReadRegister(u32 addr) {
+    return GetPage(addr)->reads[GetRegisterIndex(addr)](addr);
+}
+
+inline void WriteRegister(u32 addr, u32 data) {
+    GetPage(addr)->writes[GetRegisterIndex(addr)](addr, data);
+}
+
+} // namespace
+
+/**
+ * Gives a page of IO to a device, whose registers aren't handled until set
+ * @param addr Virtual address of the page
+ * @param device Name of the device, for the logs of the registers it doesn't handle
+ */
+void MapDevicePage(u32 addr, const char* device) {
+    DevicePage*& page = g_pages[(addr - Memory::HARDWARE_IO_VADDR) >> Memory::PAGE_BITS];
+    if (page == &g_unmapped_page) {
+        page = new DevicePage;
+    }
+    ResetPage(*page, device);
+}
+
+/**
+ * Sets the functions called on accesses to a register, in a page mapped with MapDevicePage
+ * @param addr Virtual address of the register, word aligned
+ * @param read Function reading the register, NULL to log the reads as unknown
+ * @param write Function writing the register, NULL to log the writes as unknown
+ */
+void SetRegisterHandlers(u32 addr, RegisterReadHandler read, RegisterWriteHandler write) {
+    DevicePage* page = GetPage(addr);
+    _dbg_assert_msg_(HW, page != &g_unmapped_page, "register 0x%08X of no device", addr);
+    page->reads[GetRegisterIndex(addr)] = read != NULL ? read : ReadUnknown;
+    page->writes[GetRegisterIndex(addr)] = write != NULL ? write : WriteUnknown;
+}
+
 template <typename T>
-inline void Read(T &var, const u32 addr) {
-    switch (addr & 0xFFFFF000) {
-    
-    // TODO(bunnei): What is the virtual address of NDMA?
-    // case VADDR_NDMA:
-    //     NDMA::Read(var, addr);
-    //     break;
-
-    case VADDR_GPU:
-        GPU::Read(var, addr);
-        break;
-
-    default:
-        ERROR_LOG(HW, "unknown Read%d @ 0x%08X", sizeof(var) * 8, addr);
+void Read(T &var, const u32 addr) {
+    if (sizeof(T) == 8) {
+        var = (T)(ReadRegister(addr) | ((u64)ReadRegister(addr + 4) << 32));
+    } else {
+        var = (T)(ReadRegister(addr & ~3) >> ((addr & 3) * 8));
     }
 }
 
 template <typename T>
-inline void Write(u32 addr, const T data) {
-    switch (addr & 0xFFFFF000) {
-    
-    // TODO(bunnei): What is the virtual address of NDMA?
-    // case VADDR_NDMA 
-    //     NDMA::Write(addr, data);
-    //     break;
-
-    case VADDR_GPU:
-        GPU::Write(addr, data);
-        break;
-
-    default:
-        ERROR_LOG(HW, "unknown Write%d 0x%08X @ 0x%08X", sizeof(data) * 8, data, addr);
+void Write(u32 addr, const T data) {
+    if (sizeof(T) == 8) {
+        WriteRegister(addr, (u32)data);
+        WriteRegister(addr + 4, (u32)((u64)data >> 32));
+    } else {
+        WriteRegister(addr & ~3, (u32)data << ((addr & 3) * 8));
     }
 }
 
@@ -85,21 +175,50 @@ template void Write<u32>(u32 addr, const u32 data);
 template void Write<u16>(u32 addr, const u16 data);
 template void Write<u8>(u32 addr, const u8 data);
 
-/// Update hardware
-void Update() {
-    GPU::Update();
-    NDMA::Update();
-}
-
 /// Initialize hardware
 void Init() {
+    ResetPage(g_unmapped_page, "no device");
+    for (int i = 0; i < NUM_IO_PAGES; i++) {
+        g_pages[i] = &g_unmapped_page;
+    }
+
+    // Devices that aren't emulated get their pages only for the logs to name them
+    static const struct {
+        u32 addr;
+        const char* device;
+    } kUnemulatedDevices[] = {
+        { VADDR_CSND,       "CSND" },
+        { VADDR_DSP,        "DSP" },
+        { VADDR_PDN,        "PDN/CODEC" },
+        { VADDR_SPI,        "SPI" },
+        { VADDR_SPI_2,      "SPI" },
+        { VADDR_I2C,        "I2C" },
+        { VADDR_CODEC_2,    "CODEC" },
+        { VADDR_HID,        "HID/PAD/PTM" },
+        { VADDR_GPIO,       "GPIO" },
+        { VADDR_I2C_2,      "I2C" },
+        { VADDR_SPI_3,      "SPI" },
+        { VADDR_I2C_3,      "I2C" },
+        { VADDR_MIC,        "MIC" },
+        { VADDR_PXI,        "PXI" },
+        { VADDR_DSP_2,      "DSP" },
+    };
+    for (const auto& device : kUnemulatedDevices) {
+        MapDevicePage(device.addr, device.device);
+    }
+
+    AESKeys::Init();
     GPU::Init();
     NDMA::Init();
+    HASH::Init();
     NOTICE_LOG(HW, "initialized OK");
 }
 
 /// Shutdown hardware
 void Shutdown() {
+    HASH::Shutdown();
+    AESKeys::Shutdown();
+    UnmapPages();
     NOTICE_LOG(HW, "shutdown OK");
 }
 
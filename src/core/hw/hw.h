@@ -8,14 +8,41 @@
 
 namespace HW {
 
-template <typename T>
-inline void Read(T &var, const u32 addr);
+/**
+ * Reads a register of a device
+ * @param addr Virtual address of the register, word aligned
+ * @return Value of the register
+ */
+typedef u32 (*RegisterReadHandler)(u32 addr);
+
+/**
+ * Writes a register of a device. Writes narrower than a word come in their lanes of the word,
+ * the other lanes zero.
+ * @param addr Virtual address of the register, word aligned
+ * @param data Value written
+ */
+typedef void (*RegisterWriteHandler)(u32 addr, u32 data);
+
+/**
+ * Gives a page of IO to a device, whose registers aren't handled until set
+ * @param addr Virtual address of the page
+ * @param device Name of the device, for the logs of the registers it doesn't handle
+ */
+void MapDevicePage(u32 addr, const char* device);
+
+/**
+ * Sets the functions called on accesses to a register, in a page mapped with MapDevicePage
+ * @param addr Virtual address of the register, word aligned
+ * @param read Function reading the register, NULL to log the reads as unknown
+ * @param write Function writing the register, NULL to log the writes as unknown
+ */
+void SetRegisterHandlers(u32 addr, RegisterReadHandler read, RegisterWriteHandler write);
 
 template <typename T>
-inline void Write(u32 addr, const T data);
+void Read(T &var, const u32 addr);
 
-/// Update hardware
-void Update();
+template <typename T>
+void Write(u32 addr, const T data);
 
 /// Initialize hardware
 void Init();
@@ -2,47 +2,317 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
-#include "common/common_types.h"
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
 #include "common/log.h"
 
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/hw/hw.h"
 #include "core/hw/ndma.h"
 
 namespace NDMA {
 
-template <typename T>
-inline void Read(T &var, const u32 addr) {
-    ERROR_LOG(NDMA, "unknown Read%d @ 0x%08X", sizeof(var) * 8, addr);
+namespace {
+
+/// Virtual address the registers are mapped at. The ARM9 has them at physical 0x10002000, where
+/// the ARM11 sees them isn't known, so they're put in the free page after HASH.
+const u32 kRegistersVAddr = 0x1EC02000;
+
+const int kNumChannels = 8;
+
+enum {
+    REG_GLOBAL_CONTROL  = 0x00,
+    REG_CHANNELS        = 0x04,     ///< Registers of channel n start at REG_CHANNELS + n * 0x1C
+    CHANNEL_STRIDE      = 0x1C,
+};
+
+/// Registers of a channel, in the order they're mapped in
+enum ChannelRegister {
+    SOURCE_ADDRESS,
+    DEST_ADDRESS,
+    TRANSFER_COUNT,     ///< Words the transfer goes through in all
+    WRITE_COUNT,        ///< Words of a logical block, used when TRANSFER_COUNT is 0
+    BLOCK_INTERVAL,
+    FILL_DATA,          ///< Word written when the source is the fill data
+    CONTROL,
+    NUM_CHANNEL_REGISTERS,
+};
+
+enum AddressUpdate {
+    UPDATE_INCREMENT,
+    UPDATE_DECREMENT,
+    UPDATE_FIXED,
+    UPDATE_FILL,        ///< Source only, the fill data is written
+};
+
+enum {
+    CONTROL_IMMEDIATE   = 1u << 28,
+    CONTROL_REPEAT      = 1u << 29,
+    CONTROL_IRQ         = 1u << 30,
+    CONTROL_ENABLE      = 1u << 31,
+};
+
+/// Words a transfer goes through per CoreTiming event, big transfers never hold the CPU long
+const u32 kChunkWords = 0x4000;
+
+/// Cycles a channel takes to start a transfer
+const s64 kSetupTicks = 64;
+
+// The bus runs at a quarter of the ARM11 clock and carries a word per cycle: a copy reads and
+// writes each word, a fill only writes it
+const s64 kCopyTicksPerWord = 8;
+const s64 kFillTicksPerWord = 4;
+
+struct Channel {
+    u32 regs[NUM_CHANNEL_REGISTERS];
+
+    // State of the transfer in flight
+    u32 source;         ///< Physical address of the next word read
+    u32 dest;           ///< Physical address of the next word written
+    u32 words_left;
+
+    AddressUpdate GetDestUpdate() const {
+        return (AddressUpdate)((regs[CONTROL] >> 10) & 3);
+    }
+    AddressUpdate GetSourceUpdate() const {
+        return (AddressUpdate)((regs[CONTROL] >> 13) & 3);
+    }
+    u32 GetStartupMode() const {
+        return (regs[CONTROL] >> 24) & 0xF;
+    }
+};
+
+u32 g_global_control;
+Channel g_channels[kNumChannels];
+
+u32 g_pending_irqs;     ///< Channels done with CONTROL_IRQ set, the ARM11 has no line for them
+
+int g_chunk_event = -1; ///< Transfer of a chunk done, userdata is the channel
+
+/**
+ * Gets the virtual address a channel accesses memory through
+ * @param address Physical address in FCRAM, VRAM or IO
+ * @return Virtual address, 0 if the address is in none of them
+ */
+u32 GetVirtualAddress(u32 address) {
+    const u32 virtual_address = Memory::VirtualAddressFromPhysical(address);
+    if (virtual_address != 0) {
+        return virtual_address;
+    }
+    if (address < Memory::HARDWARE_IO_PADDR_END &&
+        Memory::VirtualAddressFromPhysical_IO(address) >= Memory::HARDWARE_IO_VADDR) {
+        return Memory::VirtualAddressFromPhysical_IO(address);
+    }
+    return 0;
 }
 
-template <typename T>
-inline void Write(u32 addr, const T data) {
-    ERROR_LOG(NDMA, "unknown Write%d 0x%08X @ 0x%08X", sizeof(data) * 8, data, addr);
+/**
+ * Gets the cycles a chunk of a transfer takes
+ * @param channel Channel doing the transfer
+ * @param words Number of words of the chunk
+ */
+s64 GetChunkTicks(const Channel& channel, u32 words) {
+    const bool fill = channel.GetSourceUpdate() == UPDATE_FILL;
+    return words * (fill ? kFillTicksPerWord : kCopyTicksPerWord);
 }
 
-// Explicitly instantiate template functions because we aren't defining this in the header:
+/**
+ * Moves an address on by a number of words
+ * @param address Address to move
+ * @param update How the address changes per word
+ * @param words Number of words
+ */
+void UpdateAddress(u32& address, AddressUpdate update, u32 words) {
+    if (update == UPDATE_INCREMENT) {
+        address += words * 4;
+    } else if (update == UPDATE_DECREMENT) {
+        address -= words * 4;
+    }
+}
 
-template void Read<u64>(u64 &var, const u32 addr);
-template void Read<u32>(u32 &var, const u32 addr);
-template void Read<u16>(u16 &var, const u32 addr);
-template void Read<u8>(u8 &var, const u32 addr);
+/**
+ * Transfers a chunk of words
+ * @param channel Channel doing the transfer
+ * @param words Number of words of the chunk
+ * @return False if the source or destination isn't memory the channel reaches
+ */
+bool TransferChunk(Channel& channel, u32 words) {
+    const AddressUpdate source_update = channel.GetSourceUpdate();
+    const AddressUpdate dest_update = channel.GetDestUpdate();
+    const u32 source = GetVirtualAddress(channel.source);
+    const u32 dest = GetVirtualAddress(channel.dest);
+    if ((source == 0 && source_update != UPDATE_FILL) || dest == 0) {
+        return false;
+    }
+
+    if (source_update == UPDATE_INCREMENT && dest_update == UPDATE_INCREMENT) {
+        Memory::CopyBlock(dest, source, words * 4);
+    } else if (source_update == UPDATE_FILL && dest_update == UPDATE_INCREMENT &&
+        channel.regs[FILL_DATA] == 0) {
+        Memory::ZeroBlock(dest, words * 4);
+    } else {
+        // FIFOs and descending copies go word by word
+        u32 read_address = source;
+        u32 write_address = dest;
+        for (u32 i = 0; i < words; i++) {
+            const u32 data = source_update == UPDATE_FILL ? channel.regs[FILL_DATA] :
+                Memory::Read32(read_address);
+            Memory::Write32(write_address, data);
+            UpdateAddress(read_address, source_update, 1);
+            UpdateAddress(write_address, dest_update, 1);
+        }
+    }
+    UpdateAddress(channel.source, source_update, words);
+    UpdateAddress(channel.dest, dest_update, words);
+    return true;
+}
 
-template void Write<u64>(u32 addr, const u64 data);
-template void Write<u32>(u32 addr, const u32 data);
-template void Write<u16>(u32 addr, const u16 data);
-template void Write<u8>(u32 addr, const u8 data);
+/// Transfers the chunk of a channel whose time is up and schedules the next one
+void ChunkCallback(u64 userdata, int cycles_late) {
+    const int index = (int)userdata;
+    Channel& channel = g_channels[index];
+    if (!(channel.regs[CONTROL] & CONTROL_ENABLE)) {
+        return;
+    }
 
-/// Update hardware
-void Update() {
+    const u32 words = std::min(channel.words_left, kChunkWords);
+    if (!TransferChunk(channel, words)) {
+        ERROR_LOG(NDMA, "channel %d: transfer 0x%08X -> 0x%08X out of memory, stopped", index,
+            channel.source, channel.dest);
+        channel.words_left = 0;
+    } else {
+        channel.words_left -= words;
+    }
+
+    if (channel.words_left != 0) {
+        const u32 next = std::min(channel.words_left, kChunkWords);
+        CoreTiming::ScheduleEvent(GetChunkTicks(channel, next) - cycles_late, g_chunk_event,
+            userdata);
+        return;
+    }
+
+    channel.regs[CONTROL] &= ~CONTROL_ENABLE;
+    if (channel.regs[CONTROL] & CONTROL_IRQ) {
+        g_pending_irqs |= 1u << index;
+        DEBUG_LOG(NDMA, "channel %d: transfer done, interrupt", index);
+    }
+}
+
+/**
+ * Starts the transfer of a channel whose control register was just enabled
+ * @param index Index of the channel
+ */
+void StartTransfer(int index) {
+    Channel& channel = g_channels[index];
+    if (!(channel.regs[CONTROL] & CONTROL_IMMEDIATE)) {
+        // The channel stays enabled and waits for a device that's not emulated
+        WARN_LOG(NDMA, "channel %d: startup mode %d not emulated", index,
+            channel.GetStartupMode());
+        return;
+    }
+    if (channel.regs[CONTROL] & CONTROL_REPEAT) {
+        WARN_LOG(NDMA, "channel %d: repeat mode not emulated, transferring once", index);
+    }
+
+    channel.source = channel.regs[SOURCE_ADDRESS];
+    channel.dest = channel.regs[DEST_ADDRESS];
+    channel.words_left = channel.regs[TRANSFER_COUNT] != 0 ? channel.regs[TRANSFER_COUNT] :
+        channel.regs[WRITE_COUNT];
+    DEBUG_LOG(NDMA, "channel %d: 0x%X words 0x%08X -> 0x%08X", index, channel.words_left,
+        channel.source, channel.dest);
+
+    const u32 words = std::min(channel.words_left, kChunkWords);
+    CoreTiming::ScheduleEvent(kSetupTicks + GetChunkTicks(channel, words), g_chunk_event, index);
+}
+
+/// Gets the channel and register of a channel register address, false for the global control
+bool DecodeRegister(u32 addr, int& index, int& reg) {
+    const u32 offset = addr - kRegistersVAddr;
+    if (offset < REG_CHANNELS) {
+        return false;
+    }
+    index = (offset - REG_CHANNELS) / CHANNEL_STRIDE;
+    reg = ((offset - REG_CHANNELS) % CHANNEL_STRIDE) / 4;
+    return true;
+}
+
+u32 ReadRegister(u32 addr) {
+    int index, reg;
+    if (!DecodeRegister(addr, index, reg)) {
+        return g_global_control;
+    }
+    return g_channels[index].regs[reg];
 }
 
+void WriteRegister(u32 addr, u32 data) {
+    int index, reg;
+    if (!DecodeRegister(addr, index, reg)) {
+        g_global_control = data;
+        return;
+    }
+
+    Channel& channel = g_channels[index];
+    if (reg != CONTROL) {
+        channel.regs[reg] = data;
+        return;
+    }
+
+    const bool was_enabled = (channel.regs[CONTROL] & CONTROL_ENABLE) != 0;
+    channel.regs[CONTROL] = data;
+    if (!was_enabled && (data & CONTROL_ENABLE)) {
+        StartTransfer(index);
+    } else if (was_enabled && !(data & CONTROL_ENABLE)) {
+        // Stopped by the guest, what got transferred so far stays
+        CoreTiming::UnscheduleEvent(g_chunk_event, index);
+        channel.words_left = 0;
+    }
+}
+
+/// Gives NDMA its page of IO and sets the handlers of its registers
+void MapRegisters() {
+    HW::MapDevicePage(kRegistersVAddr, "NDMA");
+    HW::SetRegisterHandlers(kRegistersVAddr + REG_GLOBAL_CONTROL, ReadRegister, WriteRegister);
+    for (u32 offset = REG_CHANNELS; offset < REG_CHANNELS + kNumChannels * CHANNEL_STRIDE;
+        offset += 4) {
+        HW::SetRegisterHandlers(kRegistersVAddr + offset, ReadRegister, WriteRegister);
+    }
+}
+
+} // namespace
+
 /// Initialize hardware
 void Init() {
-    NOTICE_LOG(GPU, "initialized OK");
+    g_global_control = 0;
+    memset(g_channels, 0, sizeof(g_channels));
+    g_pending_irqs = 0;
+    g_chunk_event = CoreTiming::RegisterEvent("NDMA::Chunk", ChunkCallback);
+    MapRegisters();
+    NOTICE_LOG(NDMA, "initialized OK");
 }
 
 /// Shutdown hardware
 void Shutdown() {
-    NOTICE_LOG(GPU, "shutdown OK");
+    NOTICE_LOG(NDMA, "shutdown OK");
+}
+
+/**
+ * Saves or loads the channel registers, the transfers in flight go on through their CoreTiming
+ * events
+ * @param p Savestate the registers are written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("NDMA", 1);
+    if (!s) {
+        return;
+    }
+    p.Do(g_global_control);
+    p.DoArray(g_channels, kNumChannels);
+    p.Do(g_pending_irqs);
 }
 
 } // namespace
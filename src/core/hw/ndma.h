@@ -6,16 +6,9 @@
 
 #include "common/common_types.h"
 
-namespace NDMA {
-
-template <typename T>
-inline void Read(T &var, const u32 addr);
-
-template <typename T>
-inline void Write(u32 addr, const T data);
+class PointerWrap;
 
-/// Update hardware
-void Update();
+namespace NDMA {
 
 /// Initialize hardware
 void Init();
@@ -23,4 +16,11 @@ void Init();
 /// Shutdown hardware
 void Shutdown();
 
+/**
+ * Saves or loads the channel registers, the transfers in flight go on through their CoreTiming
+ * events
+ * @param p Savestate the registers are written to or read from
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
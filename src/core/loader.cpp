@@ -2,14 +2,22 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <vector>
+
 #include "common/common_types.h"
+#include "common/compressed_image.h"
 #include "common/file_util.h"
+#include "common/hash.h"
+#include "common/symbols.h"
 
 #include "core/loader.h"
 #include "core/system.h"
 #include "core/core.h"
 #include "core/file_sys/directory_file_system.h"
+#include "core/file_sys/romfs_file_system.h"
 #include "core/elf/elf_reader.h"
+#include "core/ncch/ncch_reader.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/mem_map.h"
 
@@ -36,6 +44,150 @@ bool LoadDirectory_CXI(std::string &filename) {
     return true;
 }
 
+namespace {
+
+/// Image of the NCCH loaded, kept mapped for the RomFS to be paged in as it is read
+File::MappedFile    g_ncch_image;
+const u8*           g_romfs         = nullptr;
+u64                 g_romfs_size    = 0;
+
+/// Image of the ELF loaded, kept mapped for its symbols to be parsed when first looked up
+File::MappedFile    g_elf_image;
+
+/// Compressed image of the NCCH loaded, kept open for the RomFS to be read from
+Common::CompressedImage g_compressed_image;
+
+/// File mapped by MapFile and not loaded yet
+std::string         g_premapped_filename;
+
+/// Program ID of the NCCH loaded, 0 for the other formats
+u64                 g_title_id      = 0;
+
+/**
+ * Maps the image of a file to load, unless MapFile mapped it already
+ * @param image Mapping of the image
+ * @param filename File to map
+ * @return True on success
+ */
+bool MapImage(File::MappedFile& image, const std::string& filename) {
+    const bool premapped = image.IsOpen() && g_premapped_filename == filename;
+    g_premapped_filename.clear();
+    if (premapped) {
+        return true;
+    }
+    if (!image.Open(filename)) {
+        return false;
+    }
+    if (Core::g_warm_up_enabled) {
+        image.Prefetch();
+    }
+    return true;
+}
+
+/**
+ * Reads the start of an image until the NCCH reader has everything it needs but the RomFS
+ * @param size Size of the image in bytes
+ * @param read Reads bytes of the image, as bool read(u64 offset, u8* data, size_t size)
+ * @param head Receives the start of the image
+ * @return False if the image couldn't be read
+ */
+template <typename ReadFunc>
+bool ReadNCCHHead(u64 size, ReadFunc read, std::vector<u8>& head) {
+    u64 head_size = std::min<u64>(size, 0x10000);
+    for (;;) {
+        head.resize((size_t)head_size);
+        if (!read(0, head.data(), head.size())) {
+            return false;
+        }
+        const u64 needed = NCCHReader(head.data(), head_size, size).GetHeadSize();
+        if (needed <= head_size || needed > size) {
+            return true;
+        }
+        head_size = needed;
+    }
+}
+
+} // namespace
+
+/// Loads a CTR CXI or CCI image, only the code is read up front
+bool Load_NCCH(std::string &filename) {
+    g_romfs = nullptr;
+    g_romfs_size = 0;
+    if (!MapImage(g_ncch_image, filename)) {
+        return false;
+    }
+    NCCHReader ncch_reader(g_ncch_image.GetData(), g_ncch_image.GetSize());
+    if (!ncch_reader.IsValid() || !ncch_reader.LoadCode()) {
+        g_ncch_image.Close();
+        return false;
+    }
+    u64 romfs_size;
+    const u8* romfs_data = ncch_reader.GetRomFS(&romfs_size);
+    Common::AES128 aes;
+    u8 ctr[Common::AES128::BLOCK_SIZE];
+    const bool encrypted = ncch_reader.GetRomFSCipher(&aes, ctr);
+    if (romfs_data != nullptr) {
+        // An encrypted RomFS is only readable through its file system, which decrypts it
+        if (!encrypted) {
+            g_romfs = romfs_data;
+            g_romfs_size = romfs_size;
+        }
+        RomFSFileSystem* romfs = new RomFSFileSystem(&System::g_ctr_file_system, romfs_data,
+            romfs_size, encrypted ? &aes : nullptr, ctr);
+        if (romfs->IsValid()) {
+            System::g_ctr_file_system.Mount("romfs:", romfs);
+        } else {
+            delete romfs;
+        }
+    }
+
+    g_title_id = ncch_reader.GetProgramId();
+    Kernel::LoadExec(ncch_reader.GetEntryPoint());
+    return true;
+}
+
+/// Loads a CTR CXI or CCI image from a compressed image, only its RomFS is left to read later
+bool Load_CompressedNCCH(std::string &filename) {
+    g_romfs = nullptr;
+    g_romfs_size = 0;
+    if (!g_compressed_image.Open(filename)) {
+        return false;
+    }
+    const u64 size = g_compressed_image.GetSize();
+
+    std::vector<u8> head;
+    auto read = [](u64 offset, u8* data, size_t count) {
+        return g_compressed_image.Read(offset, data, count) == count;
+    };
+    if (!ReadNCCHHead(size, read, head)) {
+        g_compressed_image.Close();
+        return false;
+    }
+
+    NCCHReader ncch_reader(head.data(), head.size(), size);
+    if (!ncch_reader.IsValid() || !ncch_reader.LoadCode()) {
+        g_compressed_image.Close();
+        return false;
+    }
+    u64 romfs_offset, romfs_size;
+    Common::AES128 aes;
+    u8 ctr[Common::AES128::BLOCK_SIZE];
+    const bool encrypted = ncch_reader.GetRomFSCipher(&aes, ctr);
+    if (ncch_reader.GetRomFSRange(&romfs_offset, &romfs_size)) {
+        RomFSFileSystem* romfs = new RomFSFileSystem(&System::g_ctr_file_system,
+            &g_compressed_image, romfs_offset, romfs_size, encrypted ? &aes : nullptr, ctr);
+        if (romfs->IsValid()) {
+            System::g_ctr_file_system.Mount("romfs:", romfs);
+        } else {
+            delete romfs;
+        }
+    }
+
+    g_title_id = ncch_reader.GetProgramId();
+    Kernel::LoadExec(ncch_reader.GetEntryPoint());
+    return true;
+}
+
 /// Loads a CTR ELF file
 bool Load_ELF(std::string &filename) {
     std::string full_path = filename;
@@ -44,26 +196,20 @@ bool Load_ELF(std::string &filename) {
 #if EMU_PLATFORM == PLATFORM_WINDOWS
     path = ReplaceAll(path, "/", "\\");
 #endif
-    File::IOFile f(filename, "rb");
+    // Parsed straight from the mapping, only the segments are copied to guest memory
+    Symbols::SetLoader(nullptr);
 
-    if (f.IsOpen()) {
-        u64 size = f.GetSize();
-        u8* buffer = new u8[size];
-        ElfReader* elf_reader = NULL;
+    if (MapImage(g_elf_image, filename)) {
+        ElfReader elf_reader(g_elf_image.GetData());
+        elf_reader.LoadInto(0x00100000);
+        Symbols::SetLoader([] {
+            ElfReader(g_elf_image.GetData()).LoadSymbols();
+        });
 
-        f.ReadBytes(buffer, size);
-
-        elf_reader = new ElfReader(buffer);
-        elf_reader->LoadInto(0x00100000);
-
-        Kernel::LoadExec(elf_reader->GetEntryPoint());
-
-        delete[] buffer;
-        delete elf_reader;
+        Kernel::LoadExec(elf_reader.GetEntryPoint());
     } else {
         return false;
     }
-    f.Close();
 
     return true;
 }
@@ -76,14 +222,9 @@ bool Load_DAT(std::string &filename) {
 #if EMU_PLATFORM == PLATFORM_WINDOWS
     path = ReplaceAll(path, "/", "\\");
 #endif
-    File::IOFile f(filename, "rb");
+    File::MappedFile f(filename);
 
     if (f.IsOpen()) {
-        u64 size = f.GetSize();
-        u8* buffer = new u8[size];
-
-        f.ReadBytes(buffer, size);
-
         /**
         * (mattvail) We shouldn't really support this type of file
         * but for the sake of making it easier... we'll temporarily/hackishly
@@ -91,26 +232,19 @@ bool Load_DAT(std::string &filename) {
         */
         u32 entry_point = 0x00100000; // write to same entrypoint as elf
         u32 payload_offset = 0xA150;
-        
-        const u8 *src = &buffer[payload_offset];
-        u8 *dst = Memory::GetPointer(entry_point);
-        u32 srcSize = size - payload_offset; //just load everything...
-        u32 *s = (u32*)src;
-        u32 *d = (u32*)dst;
-        for (int j = 0; j < (int)(srcSize + 3) / 4; j++)
-        {
-            *d++ = (*s++);
+        if (f.GetSize() <= payload_offset) {
+            return false;
         }
         
+        const u8 *src = f.GetData() + payload_offset;
+        u32 srcSize = (u32)f.GetSize() - payload_offset; //just load everything...
+        Memory::WriteBlock(entry_point, src, srcSize);
+        
         Kernel::LoadExec(entry_point);
-
-
-        delete[] buffer;
     }
     else {
         return false;
     }
-    f.Close();
 
     return true;
 }
@@ -124,34 +258,18 @@ bool Load_BIN(std::string &filename) {
 #if EMU_PLATFORM == PLATFORM_WINDOWS
     path = ReplaceAll(path, "/", "\\");
 #endif
-    File::IOFile f(filename, "rb");
+    File::MappedFile f(filename);
 
     if (f.IsOpen()) {
-        u64 size = f.GetSize();
-        u8* buffer = new u8[size];
-
-        f.ReadBytes(buffer, size);
-
         u32 entry_point = 0x00100000; // Hardcoded, read from exheader
         
-        const u8 *src = buffer;
-        u8 *dst = Memory::GetPointer(entry_point);
-        u32 srcSize = size;
-        u32 *s = (u32*)src;
-        u32 *d = (u32*)dst;
-        for (int j = 0; j < (int)(srcSize + 3) / 4; j++)
-        {
-            *d++ = (*s++);
-        }
+        Memory::WriteBlock(entry_point, f.GetData(), (u32)f.GetSize());
         
         Kernel::LoadExec(entry_point);
-
-        delete[] buffer;
     }
     else {
         return false;
     }
-    f.Close();
 
     return true;
 }
@@ -164,9 +282,9 @@ bool IsBootableDirectory() {
 }
 
 /**
- * Identifies the type of a bootable file
+ * Identifies the type of a bootable file from its magic, or from its extension for the formats
+ * without one
  * @param filename String filename of bootable file
- * @todo (ShizZy) this function sucks... make it actually check file contents etc.
  * @return FileType of file
  */
 FileType IdentifyFile(std::string &filename) {
@@ -184,7 +302,27 @@ FileType IdentifyFile(std::string &filename) {
             return FILETYPE_NORMAL_DIRECTORY;
         }
     }
-    else if (!strcasecmp(extension.c_str(), ".elf")) {
+
+    u8 header[NCCHReader::MAGIC_OFFSET + 4];
+    File::IOFile f(filename, "rb");
+    if (f.ReadBytes(header, sizeof(header))) {
+        if (Common::CompressedImage::IsCompressedImage(header, sizeof(header))) {
+            return FILETYPE_CTR_COMPRESSED;
+        }
+        u32 magic;
+        memcpy(&magic, header + NCCHReader::MAGIC_OFFSET, sizeof(magic));
+        if (magic == NCCHReader::NCCH_MAGIC) {
+            return FILETYPE_CTR_CXI;
+        }
+        if (magic == NCCHReader::NCSD_MAGIC) {
+            return FILETYPE_CTR_CCI;
+        }
+        if (!memcmp(header, "\x7F" "ELF", 4)) {
+            return FILETYPE_CTR_ELF;
+        }
+    }
+
+    if (!strcasecmp(extension.c_str(), ".elf")) {
         return FILETYPE_CTR_ELF; // TODO(bunnei): Do some filetype checking :p
     }
     else if (!strcasecmp(extension.c_str(), ".axf")) {
@@ -211,6 +349,118 @@ FileType IdentifyFile(std::string &filename) {
     return FILETYPE_UNKNOWN;
 }
 
+/**
+ * Opens the translation cache of the application core for a file just loaded. Titles are told
+ * apart by the name of their bootable file, cached blocks are checked against its code anyway.
+ * @param filename String filename of the bootable file
+ */
+void OpenTranslationCache(const std::string& filename) {
+    const std::string directory = File::GetUserPath(D_CACHE_IDX);
+    if (!File::CreateFullPath(directory)) {
+        ERROR_LOG(LOADER, "Could not create translation cache directory %s", directory.c_str());
+        return;
+    }
+    std::string file, extension;
+    SplitPath(ReplaceAll(filename, "\\", "/"), NULL, &file, &extension);
+    const std::string name = file + extension;
+    const u64 title_id = GetMurmurHash3((const u8*)name.data(), (int)name.size(), 0);
+
+    Core::g_app_core->OpenTranslationCache(directory + "arm_translations.cache", title_id);
+}
+
+/**
+ * Reads the title ID of a bootable file without loading it, so that the profile of the title can
+ * be applied before the system initializes
+ * @param filename String filename of bootable file
+ * @return Program ID of the NCCH, 0 for the other formats or if the file couldn't be read
+ */
+u64 ReadTitleId(const std::string& filename) {
+    std::string identified = filename;
+    std::vector<u8> head;
+    u64 size;
+    switch (IdentifyFile(identified)) {
+    case FILETYPE_CTR_CXI:
+    case FILETYPE_CTR_CCI: {
+        File::IOFile file(identified, "rb");
+        size = file.GetSize();
+        auto read = [&file](u64 offset, u8* data, size_t count) {
+            return file.Seek(offset, SEEK_SET) && file.ReadBytes(data, count);
+        };
+        if (!ReadNCCHHead(size, read, head)) {
+            return 0;
+        }
+        break;
+    }
+
+    case FILETYPE_CTR_COMPRESSED: {
+        Common::CompressedImage image;
+        if (!image.Open(identified)) {
+            return 0;
+        }
+        size = image.GetSize();
+        auto read = [&image](u64 offset, u8* data, size_t count) {
+            return image.Read(offset, data, count) == count;
+        };
+        if (!ReadNCCHHead(size, read, head)) {
+            return 0;
+        }
+        break;
+    }
+
+    default:
+        return 0;
+    }
+
+    NCCHReader ncch_reader(head.data(), head.size(), size);
+    return ncch_reader.IsValid() ? ncch_reader.GetProgramId() : 0;
+}
+
+/**
+ * Gets the title ID of the application loaded
+ * @return Program ID of its NCCH, 0 if it isn't one
+ */
+u64 GetTitleId() {
+    return g_title_id;
+}
+
+/**
+ * Gets the RomFS of the application loaded, mapped from its image and paged in as it is read
+ * @param size Receives the size of the RomFS in bytes
+ * @return Pointer to the RomFS, nullptr if the application loaded has none, is compressed or is
+ *         encrypted
+ */
+const u8* GetRomFS(u64* size) {
+    *size = g_romfs_size;
+    return g_romfs;
+}
+
+/**
+ * Maps a bootable file ahead of LoadFile, which then only parses it. Only the image is touched,
+ * not the system, so this may run on another thread while the system initializes.
+ * @param filename String filename of bootable file
+ */
+void MapFile(const std::string& filename) {
+    std::string identified = filename;
+    switch (IdentifyFile(identified)) {
+    case FILETYPE_CTR_CXI:
+    case FILETYPE_CTR_CCI:
+        if (MapImage(g_ncch_image, identified)) {
+            g_premapped_filename = identified;
+        }
+        break;
+
+    case FILETYPE_CTR_ELF:
+        if (MapImage(g_elf_image, identified)) {
+            g_premapped_filename = identified;
+        }
+        break;
+
+    default:
+        // The other formats are read, not mapped
+        break;
+    }
+}
+
 /**
  * Identifies and loads a bootable file
  * @param filename String filename of bootable file
@@ -220,20 +470,36 @@ FileType IdentifyFile(std::string &filename) {
 bool LoadFile(std::string &filename, std::string *error_string) {
     INFO_LOG(LOADER, "Identifying file...");
 
+    bool loaded = false;
+    g_title_id = 0;
+
     // Note that this can modify filename!
     switch (IdentifyFile(filename)) {
 
+    case FILETYPE_CTR_CXI:
+    case FILETYPE_CTR_CCI:
+        loaded = Load_NCCH(filename);
+        break;
+
+    case FILETYPE_CTR_COMPRESSED:
+        loaded = Load_CompressedNCCH(filename);
+        break;
+
     case FILETYPE_CTR_ELF:
-        return Load_ELF(filename);
+        loaded = Load_ELF(filename);
+        break;
 
     case FILETYPE_CTR_BIN:
-        return Load_BIN(filename);
+        loaded = Load_BIN(filename);
+        break;
 
     case FILETYPE_LAUNCHER_DAT:
-        return Load_DAT(filename);
+        loaded = Load_DAT(filename);
+        break;
 
     case FILETYPE_DIRECTORY_CXI:
-        return LoadDirectory_CXI(filename);
+        loaded = LoadDirectory_CXI(filename);
+        break;
 
     case FILETYPE_ERROR:
         ERROR_LOG(LOADER, "Could not read file");
@@ -269,7 +535,14 @@ bool LoadFile(std::string &filename, std::string *error_string) {
         *error_string = " Failed to identify file";
         break;
     }
-    return false;
+
+    if (loaded && Core::g_translation_cache_enabled) {
+        OpenTranslationCache(filename);
+        if (Core::g_warm_up_enabled) {
+            Core::g_app_core->WarmUp();
+        }
+    }
+    return loaded;
 }
 
 } // namespace
\ No newline at end of file
@@ -18,6 +18,7 @@ enum FileType {
     FILETYPE_CTR_CXI,
     FILETYPE_CTR_ELF,
     FILETYPE_CTR_BIN,
+    FILETYPE_CTR_COMPRESSED,    ///< CXI or CCI in a Common::CompressedImage
 
     FILETYPE_LAUNCHER_DAT,
 
@@ -37,12 +38,42 @@ enum FileType {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- * Identifies the type of a bootable file
+ * Identifies the type of a bootable file from its magic, or from its extension for the formats
+ * without one
  * @param filename String filename of bootable file
  * @return FileType of file
  */
 FileType IdentifyFile(std::string &filename);
 
+/**
+ * Reads the title ID of a bootable file without loading it, so that the profile of the title can
+ * be applied before the system initializes
+ * @param filename String filename of bootable file
+ * @return Program ID of the NCCH, 0 for the other formats or if the file couldn't be read
+ */
+u64 ReadTitleId(const std::string& filename);
+
+/**
+ * Gets the title ID of the application loaded
+ * @return Program ID of its NCCH, 0 if it isn't one
+ */
+u64 GetTitleId();
+
+/**
+ * Gets the RomFS of the application loaded, mapped from its image and paged in as it is read
+ * @param size Receives the size of the RomFS in bytes
+ * @return Pointer to the RomFS, nullptr if the application loaded has none, is compressed or is
+ *         encrypted
+ */
+const u8* GetRomFS(u64* size);
+
+/**
+ * Maps a bootable file ahead of LoadFile, which then only parses it. Only the image is touched,
+ * not the system, so this may run on another thread while the system initializes.
+ * @param filename String filename of bootable file
+ */
+void MapFile(const std::string& filename);
+
 /**
  * Identifies and loads a bootable file
  * @param filename String filename of bootable file
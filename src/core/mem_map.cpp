@@ -2,7 +2,12 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <vector>
+
 #include "common/common.h"
+#include "common/atomic.h"
+#include "common/chunk_file.h"
 #include "common/mem_arena.h"
 
 #include "core/mem_map.h"
@@ -21,8 +26,10 @@ u8* g_system_mem                = NULL;         ///< System memory
 u8* g_heap                      = NULL;         ///< Application heap (main memory)
 u8* g_heap_gsp                  = NULL;         ///< GSP heap (main memory)
 u8* g_vram                      = NULL;         ///< Video memory (VRAM) pointer
+u8* g_dsp_mem                   = NULL;         ///< DSP memory
 u8* g_shared_mem                = NULL;         ///< Shared memory
 u8* g_kernel_mem;                               ///< Kernel memory
+u8* g_config_mem                = NULL;         ///< Config memory, the shared page after it
 
 u8* g_physical_bootrom          = NULL;         ///< Bootrom physical memory
 u8* g_uncached_bootrom          = NULL;
@@ -32,18 +39,41 @@ u8* g_physical_system_mem       = NULL;         ///< System physical memory
 u8* g_physical_fcram            = NULL;         ///< Main physical memory (FCRAM)
 u8* g_physical_heap_gsp         = NULL;         ///< GSP heap physical memory
 u8* g_physical_vram             = NULL;         ///< Video physical memory (VRAM)
+u8* g_physical_dsp_mem          = NULL;         ///< DSP physical memory
 u8* g_physical_shared_mem       = NULL;         ///< Physical shared memory
 u8* g_physical_kernel_mem;                      ///< Kernel memory
+u8* g_physical_config_mem       = NULL;         ///< Config memory and the shared page
+
+u8* g_fcram_paddr_mirror        = NULL;         ///< FCRAM mirrored at its physical address
+u8* g_fcram_fw0b_mirror         = NULL;         ///< FCRAM mirrored at the FW0B address
+u8* g_unused_mirror_low         = NULL;         ///< Low pointer of the mirrors (never set)
+
+bool g_fastmem_requested        = false;        ///< Try to use fastmem on the next Init
+bool g_huge_pages_requested     = false;        ///< Try to use huge pages on the next Init
+bool g_fastmem_enabled          = false;        ///< Guest memory is accessed as g_base + addr
+
+static u8* g_boot_page_table[PAGE_TABLE_NUM_ENTRIES];      ///< Of the boot address space
+static AddressSpace g_boot_space = { g_boot_page_table };   ///< Until a process switches it
+static AddressSpace* g_address_space = &g_boot_space;       ///< Current address space
+
+u8** g_page_table               = g_boot_page_table;    ///< Page table of g_address_space
+u8 g_dirty_pages[PAGE_TABLE_NUM_ENTRIES];       ///< Dirty bits of every guest page
 
 // We don't declare the IO region in here since its handled by other means.
 static MemoryView g_views[] = {
     {&g_exefs_code, &g_physical_exefs_code, EXEFS_CODE_VADDR,       EXEFS_CODE_SIZE,    0},
     {&g_vram,       &g_physical_vram,       VRAM_VADDR,             VRAM_SIZE,          0},
+    {&g_dsp_mem,    &g_physical_dsp_mem,    DSP_VADDR,              DSP_SIZE,           0},
     {&g_heap,       &g_physical_fcram,      HEAP_VADDR,             HEAP_SIZE,          MV_IS_PRIMARY_RAM},
+    {&g_unused_mirror_low, &g_fcram_paddr_mirror, FCRAM_PADDR,      FCRAM_SIZE,         MV_MIRROR_PREVIOUS},
+    {&g_unused_mirror_low, &g_fcram_fw0b_mirror,  FCRAM_VADDR_FW0B, FCRAM_SIZE,         MV_MIRROR_PREVIOUS},
     {&g_shared_mem, &g_physical_shared_mem, SHARED_MEMORY_VADDR,    SHARED_MEMORY_SIZE, 0},
     {&g_system_mem, &g_physical_system_mem, SYSTEM_MEMORY_VADDR,    SYSTEM_MEMORY_SIZE,    0},
     {&g_kernel_mem, &g_physical_kernel_mem, KERNEL_MEMORY_VADDR,    KERNEL_MEMORY_SIZE, 0},
     {&g_heap_gsp,   &g_physical_heap_gsp,   HEAP_GSP_VADDR,         HEAP_GSP_SIZE,      0},
+    // Last, the views before it keep the alignment of the host's allocation granularity
+    {&g_config_mem, &g_physical_config_mem, CONFIG_MEMORY_VADDR,
+        CONFIG_MEMORY_SIZE + SHARED_PAGE_SIZE, 0},
 };
 
 /*static MemoryView views[] =
@@ -62,27 +92,443 @@ static MemoryView g_views[] = {
 
 static const int kNumMemViews = sizeof(g_views) / sizeof(MemoryView);    ///< Number of mem views
 
+/**
+ * Points a range of guest pages at host memory
+ * @param vaddr Guest virtual address of the first page
+ * @param size Size of the range in bytes
+ * @param pointer Host memory backing the range
+ */
+static void MapPages(u8** page_table, u32 vaddr, u32 size, u8* pointer) {
+    for (u32 offset = 0; offset < size; offset += PAGE_SIZE) {
+        page_table[(vaddr + offset) >> PAGE_BITS] = pointer + offset;
+    }
+}
+
+/// Range of guest pages backed by one run of host memory
+struct PageRange {
+    u32 vaddr;
+    u32 size;
+    u8** pointer;
+};
+
+// Every page points at the same host memory the fastmem view at g_base + vaddr uses, IO is left
+// unmapped
+static const PageRange g_page_ranges[] = {
+    {EXEFS_CODE_VADDR,      EXEFS_CODE_SIZE,    &g_exefs_code},
+    {SYSTEM_MEMORY_VADDR,   SYSTEM_MEMORY_SIZE, &g_system_mem},
+    {HEAP_VADDR,            HEAP_SIZE,          &g_heap},
+    {SHARED_MEMORY_VADDR,   SHARED_MEMORY_SIZE, &g_shared_mem},
+    {HEAP_GSP_VADDR,        HEAP_GSP_SIZE,      &g_heap_gsp},
+    {VRAM_VADDR,            VRAM_SIZE,          &g_vram},
+    {DSP_VADDR,             DSP_SIZE,           &g_dsp_mem},
+    {KERNEL_MEMORY_VADDR,   KERNEL_MEMORY_SIZE, &g_kernel_mem},
+    // ConfigMem keeps both pages up to date, reads are plain memory reads
+    {CONFIG_MEMORY_VADDR,   CONFIG_MEMORY_SIZE + SHARED_PAGE_SIZE, &g_config_mem},
+    // Physical and firmware-specific FCRAM aliases (see _VirtualAddress)
+    {FCRAM_PADDR,           FCRAM_SIZE,         &g_heap},
+    {FCRAM_VADDR_FW0B,      FCRAM_SIZE,         &g_heap},
+};
+
+/// Range of guest pages mapped over other guest pages, see MapAlias
+struct Alias {
+    u32 address;
+    u32 size;
+    u32 target;
+};
+
+static std::vector<Alias> g_aliases;                ///< Mapped in every address space
+static std::vector<AddressSpace*> g_address_spaces; ///< The boot one and those of the processes
+
+/**
+ * Gets the host memory backing a guest page without the aliases
+ * @param vaddr Guest address of the page
+ * @return Host pointer, NULL for pages that need a handler (IO)
+ */
+static u8* GetHomePointer(u32 vaddr) {
+    // The FCRAM aliases come last, they override
+    for (int i = (int)ARRAY_SIZE(g_page_ranges) - 1; i >= 0; i--) {
+        const PageRange& range = g_page_ranges[i];
+        if (vaddr >= range.vaddr && vaddr - range.vaddr < range.size) {
+            return *range.pointer + (vaddr - range.vaddr);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Gets the host memory backing a guest range without the aliases, if it's one run of plain memory
+ * @param vaddr Guest address of the range, page aligned
+ * @param size Size of the range in bytes, page aligned
+ * @return Host pointer of the run, NULL if the range isn't one
+ */
+static u8* GetHomeRun(u32 vaddr, u32 size) {
+    u8* const pointer = GetHomePointer(vaddr);
+    for (u32 offset = PAGE_SIZE; pointer != NULL && offset < size; offset += PAGE_SIZE) {
+        if (GetHomePointer(vaddr + offset) != pointer + offset) {
+            return NULL;
+        }
+    }
+    return pointer;
+}
+
+/**
+ * Builds a page table from the memory views and the aliases, IO is left unmapped
+ * @param page_table Page table, of PAGE_TABLE_NUM_ENTRIES pointers
+ */
+static void SetupPageTable(u8** page_table) {
+    memset(page_table, 0, PAGE_TABLE_NUM_ENTRIES * sizeof(u8*));
+    for (const PageRange& range : g_page_ranges) {
+        MapPages(page_table, range.vaddr, range.size, *range.pointer);
+    }
+    for (const Alias& alias : g_aliases) {
+        MapPages(page_table, alias.address, alias.size, GetHomePointer(alias.target));
+    }
+}
+
+/**
+ * Points a guest range at a run of host memory in every page table, and in the fastmem view
+ * @param vaddr Guest address of the range, page aligned
+ * @param size Size of the range in bytes, page aligned
+ * @param pointer Host memory, in one of the views
+ * @return False if the host can't map the run in the fastmem view, nothing changed then
+ */
+static bool RemapRange(u32 vaddr, u32 size, u8* pointer) {
+    if (g_fastmem_enabled) {
+        // Windows can't map a view over another, fastmem then keeps the pages it has
+        const s64 offset = MemoryMap_GetOffset(g_views, kNumMemViews, 0, pointer);
+        if (offset < 0 || g_arena.CreateView(offset, size, g_base + vaddr) != g_base + vaddr) {
+            return false;
+        }
+    }
+    for (AddressSpace* space : g_address_spaces) {
+        MapPages(space->page_table, vaddr, size, pointer);
+    }
+    MarkRangeDirty(vaddr, size);
+    return true;
+}
+
+/// Tells whether two guest ranges overlap
+static bool Overlaps(u32 a, u32 a_size, u32 b, u32 b_size) {
+    return (u64)a < (u64)b + b_size && (u64)b < (u64)a + a_size;
+}
+
+/**
+ * Maps a range of guest pages over other guest pages, so that both read and write the same host
+ * memory, as a block of shared memory mapped at a second address
+ * @param addr Guest address of the range, page aligned
+ * @param size Size of the range in bytes, page aligned
+ * @param target Guest address of the pages the range aliases, page aligned
+ * @return True on success, false if either range isn't one run of plain memory, overlaps an alias,
+ *         or the host can't map the pages in the fastmem view
+ */
+bool MapAlias(u32 addr, u32 size, u32 target) {
+    if (((addr | size | target) & PAGE_MASK) != 0 || size == 0 ||
+        Overlaps(addr, size, target, size)) {
+
+        return false;
+    }
+    for (const Alias& alias : g_aliases) {
+        if (alias.address == addr && alias.size == size && alias.target == target) {
+            return true;
+        }
+        if (Overlaps(addr, size, alias.address, alias.size) ||
+            Overlaps(target, size, alias.address, alias.size)) {
+
+            return false;
+        }
+    }
+
+    u8* const pointer = GetHomeRun(target, size);
+    if (pointer == NULL || GetHomeRun(addr, size) == NULL || !RemapRange(addr, size, pointer)) {
+        return false;
+    }
+    const Alias alias = { addr, size, target };
+    g_aliases.push_back(alias);
+    // The interpreter stops caching the target pages once they're shared, see IsPageShared
+    MarkRangeDirty(target, size, DIRTY_CODE);
+    return true;
+}
+
+/// Unmaps every alias, the pages get the host memory they had before
+static void UnmapAliases() {
+    for (const Alias& alias : g_aliases) {
+        RemapRange(alias.address, alias.size, GetHomePointer(alias.address));
+    }
+    g_aliases.clear();
+}
+
+/**
+ * Tells whether a guest page shares its host memory with other guest pages through an alias, so
+ * that guest writes to it may go through another address. The FCRAM mirrors of the heap don't
+ * count, only host code writes them and it marks the heap pages.
+ * @param addr Guest address inside the page
+ * @return True if the page is mapped at more than one guest address
+ */
+bool IsPageShared(u32 addr) {
+    addr &= ~PAGE_MASK;
+    for (const Alias& alias : g_aliases) {
+        if (Overlaps(addr, PAGE_SIZE, alias.address, alias.size) ||
+            Overlaps(addr, PAGE_SIZE, alias.target, alias.size)) {
+
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Adds the dirty bits of the pages of every alias to the pages it aliases, so that consumers
+ * tracking guest memory by the addresses the host memory is first mapped at, such as savestates,
+ * see the writes through aliases
+ */
+void MergeAliasDirtyPages() {
+    for (const Alias& alias : g_aliases) {
+        for (u32 offset = 0; offset < alias.size; offset += PAGE_SIZE) {
+            Common::AtomicOr(g_dirty_pages[(alias.target + offset) >> PAGE_BITS],
+                g_dirty_pages[(alias.address + offset) >> PAGE_BITS]);
+        }
+    }
+}
+
+/**
+ * Saves or loads the aliases, mapping those of the state in place of the current ones
+ * @param p Savestate the aliases are written to or read from
+ */
+void DoAliases(PointerWrap& p) {
+    std::vector<Alias> aliases = g_aliases;
+    p.DoPOD(aliases);
+    if (p.GetMode() != PointerWrap::MODE_READ) {
+        return;
+    }
+    UnmapAliases();
+    for (const Alias& alias : aliases) {
+        if (!MapAlias(alias.address, alias.size, alias.target)) {
+            ERROR_LOG(MEMMAP, "can't map 0x%08X bytes at 0x%08X over 0x%08X", alias.size,
+                alias.address, alias.target);
+        }
+    }
+}
+
+/// Gets the current address space, the boot one Init creates until a process switches it
+AddressSpace* GetAddressSpace() {
+    return g_address_space;
+}
+
+/// Gets the boot address space, the one the loader maps the application into
+AddressSpace* GetBootAddressSpace() {
+    return &g_boot_space;
+}
+
+/**
+ * Makes an address space the current one, which the page table and the memory areas are of
+ * @param space Address space, NULL for the boot one
+ */
+void SetAddressSpace(AddressSpace* space) {
+    g_address_space = (space != NULL) ? space : &g_boot_space;
+    g_page_table = g_address_space->page_table;
+}
+
+/// Creates an address space mapped as that of a fresh process, heaps free
+AddressSpace* CreateAddressSpace() {
+    AddressSpace* space = new AddressSpace;
+    space->page_table = new u8*[PAGE_TABLE_NUM_ENTRIES];
+    SetupPageTable(space->page_table);
+    ResetAreas(space);
+    g_address_spaces.push_back(space);
+    return space;
+}
+
+/**
+ * Destroys an address space made by CreateAddressSpace, switching to the boot one if it's current
+ * @param space Address space
+ */
+void DestroyAddressSpace(AddressSpace* space) {
+    if (space == g_address_space) {
+        SetAddressSpace(NULL);
+    }
+    g_address_spaces.erase(std::find(g_address_spaces.begin(), g_address_spaces.end(), space));
+    delete[] space->page_table;
+    delete space;
+}
+
+/**
+ * Marks all pages of a guest range as written
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumers to notify (DIRTY_*), all of them by default
+ */
+void MarkRangeDirty(const u32 addr, const size_t size, const u8 flags) {
+    if (size == 0) {
+        return;
+    }
+    const u32 last_page = (u32)((addr + size - 1) >> PAGE_BITS);
+    for (u32 page = addr >> PAGE_BITS; page <= last_page; page++) {
+        Common::AtomicOr(g_dirty_pages[page], flags);
+    }
+}
+
+/**
+ * Checks whether any page of a guest range was written since a consumer last cleared it
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumer bits to check (DIRTY_*)
+ * @return True if any of the pages has one of the bits set
+ */
+bool IsRangeDirty(const u32 addr, const size_t size, const u8 flags) {
+    if (size == 0) {
+        return false;
+    }
+    const u32 last_page = (u32)((addr + size - 1) >> PAGE_BITS);
+    for (u32 page = addr >> PAGE_BITS; page <= last_page; page++) {
+        if (g_dirty_pages[page] & flags) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Clears consumer dirty bits for all pages of a guest range
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumer bits to clear (DIRTY_*)
+ */
+void ClearDirtyRange(const u32 addr, const size_t size, const u8 flags) {
+    if (size == 0) {
+        return;
+    }
+    const u32 last_page = (u32)((addr + size - 1) >> PAGE_BITS);
+    for (u32 page = addr >> PAGE_BITS; page <= last_page; page++) {
+        Common::AtomicAnd(g_dirty_pages[page], (u8)~flags);
+    }
+}
+
+/**
+ * Hands a run of contiguous host memory back to the host, zeroing it if the host can't take it
+ * @param pointer Start of the run, page aligned
+ * @param size Size of the run in bytes, 0 for none
+ */
+static void DecommitRun(u8* pointer, size_t size) {
+    if (size != 0 && !g_arena.Decommit(pointer, size)) {
+        memset(pointer, 0, size);
+    }
+}
+
+/**
+ * Zeroes a block of guest memory, handing its pages back to the host where it can, so that freed
+ * memory stops counting for the process until it's touched again
+ * @param addr Guest address of the block, page aligned
+ * @param size Size of the block in bytes, page aligned
+ */
+void DecommitBlock(const u32 addr, const size_t size) {
+    MarkRangeDirty(addr, size);
+
+    // The pages of a view are contiguous host memory, each run is handed back at once
+    const u64 end = (u64)addr + size;
+    u8* run_pointer = NULL;
+    size_t run_size = 0;
+    for (u64 page_addr = addr; page_addr < end; page_addr += PAGE_SIZE) {
+        u8* pointer = g_page_table[page_addr >> PAGE_BITS];
+        if (pointer != NULL && run_size != 0 && pointer == run_pointer + run_size) {
+            run_size += PAGE_SIZE;
+            continue;
+        }
+        DecommitRun(run_pointer, run_size);
+        if (pointer == NULL) {
+            // Pages without host memory go through their handlers
+            ZeroBlock((u32)page_addr, PAGE_SIZE);
+        }
+        run_pointer = pointer;
+        run_size = pointer != NULL ? PAGE_SIZE : 0;
+    }
+    DecommitRun(run_pointer, run_size);
+}
+
+/// Gets the bytes of guest memory backed by host memory, pages are backed once touched
+size_t GetCommittedSize() {
+    return g_arena.GetCommittedSize();
+}
+
+/// Gets the bytes of guest memory reserved, every region the guest maps
+size_t GetReservedSize() {
+    return g_arena.GetReservedSize();
+}
+
 void Init() {
     int flags = 0;
 
     for (size_t i = 0; i < ARRAY_SIZE(g_views); i++) {
         if (g_views[i].flags & MV_IS_PRIMARY_RAM)
             g_views[i].size = FCRAM_SIZE;
+
+        // FCRAM with its mirrors, VRAM and the GSP heap are the memory guest code and the GPU
+        // access all over, where TLB misses add up
+        g_views[i].flags &= ~MV_HUGE_PAGES;
+        if (g_huge_pages_requested && (g_views[i].out_ptr_low == &g_heap ||
+            g_views[i].out_ptr_low == &g_vram || g_views[i].out_ptr_low == &g_heap_gsp ||
+            (g_views[i].flags & MV_MIRROR_PREVIOUS))) {
+            g_views[i].flags |= MV_HUGE_PAGES;
+        }
     }
 
     g_base = MemoryMap_Setup(g_views, kNumMemViews, flags, &g_arena);
 
-    NOTICE_LOG(MEMMAP, "initialized OK, RAM at %p (mirror at 0 @ %p)", g_heap, 
-        g_physical_fcram);
+    if (g_huge_pages_requested && g_base != NULL) {
+        bool huge_pages = true;
+        for (size_t i = 0; i < ARRAY_SIZE(g_views); i++) {
+            if (!(g_views[i].flags & MV_HUGE_PAGES)) {
+                continue;
+            }
+            // Mirrors only have the view in the guest space
+            u8* const views[] = { *g_views[i].out_ptr_low, *g_views[i].out_ptr };
+            for (u8* view : views) {
+                if (view != NULL && !MemArena::UseHugePages(view, g_views[i].size)) {
+                    huge_pages = false;
+                }
+            }
+        }
+        if (huge_pages) {
+            NOTICE_LOG(MEMMAP, "FCRAM and VRAM are backed by huge pages where the host has them");
+        } else {
+            NOTICE_LOG(MEMMAP, "the host doesn't give huge pages to guest memory, using normal "
+                "pages");
+        }
+    }
+
+    g_aliases.clear();
+    g_address_spaces.assign(1, &g_boot_space);
+    SetupPageTable(g_boot_page_table);
+    ResetAreas(&g_boot_space);
+    SetAddressSpace(NULL);
+    memset(g_dirty_pages, 0, sizeof(g_dirty_pages));
+
+    g_fastmem_enabled = false;
+    if (g_fastmem_requested && g_base != NULL) {
+        g_fastmem_enabled = InstallFastmemHandler();
+    }
+
+    NOTICE_LOG(MEMMAP, "initialized OK, RAM at %p (mirror at 0 @ %p)%s", g_heap, 
+        g_physical_fcram, g_fastmem_enabled ? ", fastmem enabled" : "");
 }
 
 void Shutdown() {
+    if (g_fastmem_enabled) {
+        RemoveFastmemHandler();
+        g_fastmem_enabled = false;
+    }
+
     u32 flags = 0;
     MemoryMap_Shutdown(g_views, kNumMemViews, flags, &g_arena);
     
     g_arena.ReleaseSpace();
+    MemArena::Release4GBBase(g_base);
     g_base = NULL;
 
+    SetAddressSpace(NULL);
+    memset(g_boot_page_table, 0, sizeof(g_boot_page_table));
+    g_aliases.clear();
+    g_address_spaces.clear();
+
     NOTICE_LOG(MEMMAP, "shutdown OK");
 }
 
@@ -4,9 +4,15 @@
 
 #pragma once
 
+#include <vector>
+
 #include "common/common.h"
 #include "common/common_types.h"
 
+#include "core/arm/exclusive_monitor.h"
+
+class PointerWrap;
+
 namespace Memory {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,7 +43,11 @@ enum {
     CONFIG_MEMORY_VADDR_END = (CONFIG_MEMORY_VADDR + CONFIG_MEMORY_SIZE),
     CONFIG_MEMORY_MASK      = (CONFIG_MEMORY_SIZE - 1),
 
-    KERNEL_MEMORY_SIZE      = 0x00001000,   ///< Kernel memory size
+    SHARED_PAGE_SIZE        = 0x00001000,   ///< Shared page size
+    SHARED_PAGE_VADDR       = 0x1FF81000,   ///< Shared page, the time and the hardware state
+    SHARED_PAGE_VADDR_END   = (SHARED_PAGE_VADDR + SHARED_PAGE_SIZE),
+
+    KERNEL_MEMORY_SIZE      = 0x00008000,   ///< Kernel memory size, the TLS of every thread
     KERNEL_MEMORY_VADDR     = 0xFFFF0000,   ///< Kernel memory where the kthread objects etc are
     KERNEL_MEMORY_VADDR_END = (KERNEL_MEMORY_VADDR + KERNEL_MEMORY_SIZE),
     KERNEL_MEMORY_MASK      = (KERNEL_MEMORY_SIZE - 1),
@@ -79,10 +89,48 @@ enum {
     VRAM_VADDR_END          = (VRAM_VADDR + VRAM_SIZE),
     VRAM_MASK               = 0x007FFFFF,
 
+    DSP_VADDR               = 0x1FF00000,   ///< DSP memory, the audio firmware's code and data
+    DSP_VADDR_END           = (DSP_VADDR + DSP_SIZE),
+
     SCRATCHPAD_SIZE         = 0x00004000,   ///< Typical stack size - TODO: Read from exheader
     SCRATCHPAD_VADDR_END    = 0x10000000,
     SCRATCHPAD_VADDR        = (SCRATCHPAD_VADDR_END - SCRATCHPAD_SIZE), ///< Stack space
     SCRATCHPAD_MASK         = (SCRATCHPAD_SIZE - 1),            ///< Scratchpad memory mask
+
+    PAGE_BITS               = 12,                               ///< Page table granularity (4 KiB)
+    PAGE_SIZE               = (1 << PAGE_BITS),
+    PAGE_MASK               = (PAGE_SIZE - 1),
+    PAGE_TABLE_NUM_ENTRIES  = (1 << (32 - PAGE_BITS)),          ///< Pages in the 32-bit space
+};
+
+/// Per-consumer dirty bits kept for every guest page, set on any write to the page
+enum {
+    DIRTY_CODE              = (1 << 0),     ///< Interpreter decode cache
+    DIRTY_JIT               = (1 << 1),     ///< JIT block cache
+    DIRTY_TEXTURE           = (1 << 2),     ///< Texture cache
+    DIRTY_FRAMEBUFFER       = (1 << 3),     ///< Framebuffer upload in the renderer
+    DIRTY_SAVESTATE         = (1 << 4),     ///< Pages to write again at the end of a savestate
+    DIRTY_REWIND            = (1 << 5),     ///< Pages of the next rewind snapshot delta
+    DIRTY_TRACE             = (1 << 6),     ///< Pages to write before the next GX command traced
+    DIRTY_RUN_AHEAD         = (1 << 7),     ///< Pages to restore after the frames run ahead
+    DIRTY_ALL               = 0xFF,
+};
+
+/// Guest regions the access statistics are kept for, see GetRegion
+enum Region {
+    REGION_EXEFS_CODE,
+    REGION_SYSTEM_MEMORY,
+    REGION_HEAP,
+    REGION_SCRATCHPAD,
+    REGION_SHARED_MEMORY,
+    REGION_HEAP_GSP,
+    REGION_HARDWARE_IO,
+    REGION_VRAM,
+    REGION_DSP_MEMORY,
+    REGION_CONFIG_MEMORY,       ///< Config memory and the shared page after it
+    REGION_KERNEL_MEMORY,
+    REGION_OTHER,               ///< Anything else, e.g. physical addresses
+    NUM_REGIONS,
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -120,27 +168,234 @@ extern u8 *g_base;
 extern u8* g_heap_gsp;      ///< GSP heap (main memory)
 extern u8* g_heap;          ///< Application heap (main memory)
 extern u8* g_vram;          ///< Video memory (VRAM)
+extern u8* g_dsp_mem;       ///< DSP memory
 extern u8* g_shared_mem;    ///< Shared memory
 extern u8* g_kernel_mem;    ///< Kernel memory
+extern u8* g_config_mem;    ///< Config memory, the shared page after it
 extern u8* g_system_mem;    ///< System memory
 extern u8* g_exefs_code;    ///< ExeFS:/.code is loaded here
 
+/**
+ * Host pointer for every guest page of the current address space, or NULL for pages that need a
+ * handler (IO). Points at the table of the address space, see SetAddressSpace.
+ */
+extern u8** g_page_table;
+
+/**
+ * Dirty bits (DIRTY_*) of every guest page, see MarkPageDirty. Both cores write them at once, the
+ * consumers set and clear bits with the atomic Common::AtomicOr/AtomicAnd. A consumer clears its
+ * bit before it reads the page, so a write that marks the page meanwhile is seen the next time.
+ */
+extern u8 g_dirty_pages[PAGE_TABLE_NUM_ENTRIES];
+
+extern bool g_fastmem_requested;    ///< Set before Init to map guest memory for fastmem access
+extern bool g_huge_pages_requested; ///< Set before Init to back FCRAM and VRAM with huge pages
+extern bool g_fastmem_enabled;      ///< Guest memory is accessed as g_base + addr
+
+/**
+ * Installs the host fault handler that emulates fastmem accesses to IO/unmapped guest memory
+ * @return True if fastmem can be used on this host
+ */
+bool InstallFastmemHandler();
+
+/// Removes the fastmem fault handler
+void RemoveFastmemHandler();
+
+/// Counts the Read*/Write* calls of every region while on, off by default and about free then
+extern bool g_access_stats_enabled;
+
+/// Numbers of Read*/Write* calls of every region since the last ResetAccessStats
+struct AccessStats {
+    u64 reads[NUM_REGIONS];
+    u64 writes[NUM_REGIONS];
+};
+
+/**
+ * Gets the region of a guest address
+ * @param addr Guest virtual address
+ * @return Region, REGION_OTHER if the address is in none of them
+ */
+Region GetRegion(const u32 addr);
+
+/**
+ * Gets the name of a region, for logs
+ * @param region Region
+ * @return Name, as "heap"
+ */
+const char* GetRegionName(Region region);
+
+/// Gets the accesses counted since the last reset, only counted with g_access_stats_enabled
+const AccessStats& GetAccessStats();
+
+/// Zeroes the access counts
+void ResetAccessStats();
+
+/// Logs the access counts of the regions, most accessed first
+void LogAccessStats();
+
+/**
+ * Zeroes a block of guest memory, handing its pages back to the host where it can, so that freed
+ * memory stops counting for the process until it's touched again
+ * @param addr Guest address of the block, page aligned
+ * @param size Size of the block in bytes, page aligned
+ */
+void DecommitBlock(const u32 addr, const size_t size);
+
+/// Gets the bytes of guest memory backed by host memory, pages are backed once touched
+size_t GetCommittedSize();
+
+/// Gets the bytes of guest memory reserved, every region the guest maps
+size_t GetReservedSize();
+
+/**
+ * Address space of a process: the page table its accesses go through and its memory areas.
+ * Switching processes swaps the current address space, which only changes the page table
+ * pointer. Every address space maps the regions to the same host memory for now, the fastmem
+ * view at g_base is the one of all of them.
+ */
+struct AddressSpace {
+    /// Start of a memory area, the area ends where the next one starts
+    struct Area {
+        u32 base_address;
+        u32 permissions;
+        u32 state;
+    };
+
+    u8** page_table;            ///< Host pointer of every guest page, PAGE_TABLE_NUM_ENTRIES
+    std::vector<Area> areas;    ///< Sorted by address, every page is in exactly one of them
+};
+
+/// Gets the current address space, the boot one Init creates until a process switches it
+AddressSpace* GetAddressSpace();
+
+/// Gets the boot address space, the one the loader maps the application into
+AddressSpace* GetBootAddressSpace();
+
+/**
+ * Makes an address space the current one, which the page table and the memory areas are of
+ * @param space Address space, NULL for the boot one
+ */
+void SetAddressSpace(AddressSpace* space);
+
+/// Creates an address space mapped as that of a fresh process, heaps free
+AddressSpace* CreateAddressSpace();
+
+/**
+ * Destroys an address space made by CreateAddressSpace, switching to the boot one if it's current
+ * @param space Address space
+ */
+void DestroyAddressSpace(AddressSpace* space);
+
+/**
+ * Resets the memory areas of an address space to the mappings of a fresh process, heaps free
+ * @param space Address space
+ */
+void ResetAreas(AddressSpace* space);
+
+/**
+ * Maps a range of guest pages over other guest pages, so that both read and write the same host
+ * memory, as a block of shared memory mapped at a second address. Aliases are mapped in every
+ * address space, and in the fastmem view where the host can map a view over another.
+ * @param addr Guest address of the range, page aligned
+ * @param size Size of the range in bytes, page aligned
+ * @param target Guest address of the pages the range aliases, page aligned
+ * @return True on success, false if either range isn't one run of plain memory, overlaps an alias,
+ *         or the host can't map the pages in the fastmem view
+ */
+bool MapAlias(u32 addr, u32 size, u32 target);
+
+/**
+ * Tells whether a guest page shares its host memory with other guest pages through an alias, so
+ * that guest writes to it may go through another address. The FCRAM mirrors of the heap don't
+ * count, only host code writes them and it marks the heap pages.
+ * @param addr Guest address inside the page
+ * @return True if the page is mapped at more than one guest address
+ */
+bool IsPageShared(u32 addr);
+
+/**
+ * Adds the dirty bits of the pages of every alias to the pages it aliases, so that consumers
+ * tracking guest memory by the addresses the host memory is first mapped at, such as savestates,
+ * see the writes through aliases
+ */
+void MergeAliasDirtyPages();
+
+/**
+ * Saves or loads the aliases, mapping those of the state in place of the current ones
+ * @param p Savestate the aliases are written to or read from
+ */
+void DoAliases(PointerWrap& p);
+
+/**
+ * Performs a guest read through the handler path (IO, config memory), bypassing fastmem
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @return Value read, zero-extended
+ */
+u64 ReadSlow(const u32 addr, const int size);
+
+/**
+ * Performs a guest write through the handler path (IO, config memory), bypassing fastmem
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @param data Value to write
+ */
+void WriteSlow(const u32 addr, const int size, const u64 data);
+
 void Init();
 void Shutdown();
 
-u8 Read8(const u32 addr);
-u16 Read16(const u32 addr);
-u32 Read32(const u32 addr);
-
-u32 Read8_ZX(const u32 addr);
-u32 Read16_ZX(const u32 addr);
+/**
+ * Performs a guest read the inline Read* functions don't serve: counted ones (see
+ * g_access_stats_enabled) and ones of pages that aren't plain memory
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @return Value read, zero-extended
+ */
+u64 ReadFallback(const u32 addr, const int size);
 
-void Write8(const u32 addr, const u8 data);
-void Write16(const u32 addr, const u16 data);
-void Write32(const u32 addr, const u32 data);
+/**
+ * Performs a guest write the inline Write* functions don't serve, with the page already marked
+ * dirty: counted ones (see g_access_stats_enabled) and ones to pages that aren't plain memory
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @param data Value to write
+ */
+void WriteFallback(const u32 addr, const int size, const u64 data);
 
 u8* GetPointer(const u32 Address);
 
+/**
+ * Reads a block of guest memory into a host buffer
+ * @param src_addr Guest address to read from
+ * @param dest_buffer Host buffer to read into
+ * @param size Number of bytes to read
+ */
+void ReadBlock(const u32 src_addr, void* dest_buffer, const size_t size);
+
+/**
+ * Writes a host buffer into guest memory
+ * @param dest_addr Guest address to write to
+ * @param src_buffer Host buffer to write from
+ * @param size Number of bytes to write
+ */
+void WriteBlock(const u32 dest_addr, const void* src_buffer, const size_t size);
+
+/**
+ * Fills a block of guest memory with zeroes
+ * @param dest_addr Guest address to fill
+ * @param size Number of bytes to fill
+ */
+void ZeroBlock(const u32 dest_addr, const size_t size);
+
+/**
+ * Copies a block of guest memory to another guest address
+ * @param dest_addr Guest address to copy to
+ * @param src_addr Guest address to copy from
+ * @param size Number of bytes to copy
+ */
+void CopyBlock(const u32 dest_addr, const u32 src_addr, const size_t size);
+
 /**
  * Maps a block of memory in shared memory
  * @param handle Handle to map memory block for
@@ -149,21 +404,210 @@ u8* GetPointer(const u32 Address);
  */
 u32 MapBlock_Shared(u32 handle, u32 addr,u32 permissions) ;
 
+/// State of a virtual memory area, as QueryMemory reports it
+enum MemoryState {
+    MEMORY_STATE_FREE       = 0,    ///< Nothing is mapped
+    MEMORY_STATE_RESERVED   = 1,
+    MEMORY_STATE_IO         = 2,    ///< Hardware registers
+    MEMORY_STATE_STATIC     = 3,    ///< Mapped by the kernel, as VRAM and config memory
+    MEMORY_STATE_CODE       = 4,    ///< Code of the application
+    MEMORY_STATE_PRIVATE    = 5,    ///< Heap and stacks
+    MEMORY_STATE_SHARED     = 6,
+    MEMORY_STATE_CONTINUOUS = 7,    ///< Linear heap, physically contiguous
+};
+
+/// Permissions of a virtual memory area, bits
+enum MemoryAreaPermission {
+    MEMORY_AREA_READ        = (1 << 0),
+    MEMORY_AREA_WRITE       = (1 << 1),
+    MEMORY_AREA_EXECUTE     = (1 << 2),
+};
+
+/// Virtual memory area, a range of pages of the same state and permissions
+struct MemoryArea {
+    u32 base_address;
+    u32 size;
+    u32 permissions;        ///< MemoryAreaPermission bits
+    u32 state;              ///< MemoryState
+};
+
+/**
+ * Allocates a range of a region of the address space, as ControlMemory commits memory
+ * @param region_base Start of the region, as HEAP_VADDR
+ * @param region_size Size of the region in bytes
+ * @param addr Start of the range, 0 to take the lowest free one that fits
+ * @param size Size of the range in bytes, rounded up to whole pages
+ * @param permissions MemoryAreaPermission bits of the range
+ * @param state MemoryState of the range
+ * @return Start of the range, 0 if there is no room or the given range isn't all free
+ */
+u32 AllocateArea(u32 region_base, u32 region_size, u32 addr, u32 size, u32 permissions,
+    u32 state);
+
+/**
+ * Frees a range of the address space, as ControlMemory does. The memory reads back as zero once
+ * it is allocated again.
+ * @param addr Start of the range
+ * @param size Size of the range in bytes, rounded up to whole pages
+ * @return False if the range has free pages already
+ */
+bool FreeArea(u32 addr, u32 size);
+
+/**
+ * Gets the virtual memory area an address is in, as QueryMemory
+ * @param addr Guest address
+ * @return The area, neighbouring pages of the same state and permissions make up one area
+ */
+MemoryArea QueryArea(u32 addr);
+
+/**
+ * Saves or loads the memory areas of an address space
+ * @param p Savestate the areas are written to or read from
+ * @param space Address space
+ */
+void DoAreas(PointerWrap& p, AddressSpace* space);
+
 /**
- * Maps a block of memory on the heap
- * @param size Size of block in bytes
- * @param operation Memory map operation type
- * @param flags Memory allocation flags
+ * Saves or loads the state of the memory map, the areas of the boot address space and the aliases.
+ * Guest memory is saved on its own, the address spaces of the processes with them.
+ * @param p Savestate the state is written to or read from
  */
-u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions);
+void DoState(PointerWrap& p);
 
 /**
- * Maps a block of memory on the GSP heap
- * @param size Size of block in bytes
- * @param operation Memory map operation type
- * @param permissions Control memory permissions
+ * Marks the page containing a guest address as written for every consumer
+ * @param addr Guest address that was written
  */
-u32 MapBlock_HeapGSP(u32 size, u32 operation, u32 permissions);
+inline void MarkPageDirty(const u32 addr) {
+    // Sets every bit, a plain byte store is as good as an atomic or against the consumers
+    g_dirty_pages[addr >> PAGE_BITS] = DIRTY_ALL;
+}
+
+/**
+ * Gets the host pointer of a guest block for bulk accesses, which mark the pages they write dirty
+ * themselves
+ * @param addr Guest address of the block
+ * @param size Size of the block in bytes
+ * @return Host pointer, NULL if the block crosses a page or isn't plain memory
+ */
+inline u8* GetBlockPointer(const u32 addr, const u32 size) {
+    u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+    if (page_pointer == NULL || (addr & PAGE_MASK) + size > PAGE_SIZE) {
+        return NULL;
+    }
+    return g_fastmem_enabled ? &g_base[addr] : &page_pointer[addr & PAGE_MASK];
+}
+
+/**
+ * Reads guest memory, inlined into the callers for plain memory. Everything else goes through
+ * ReadFallback.
+ * @param addr Guest address
+ * @return Value read
+ */
+template <typename T>
+inline T _Read(const u32 addr) {
+    if (!g_access_stats_enabled) {
+        // With fastmem every access is a plain load, IO is caught by the fault handler
+        if (g_fastmem_enabled) {
+            return *(const T*)&g_base[addr];
+        }
+        const u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+        if (page_pointer != NULL) {
+            return *(const T*)&page_pointer[addr & PAGE_MASK];
+        }
+    }
+    return (T)ReadFallback(addr, sizeof(T));
+}
+
+/**
+ * Writes guest memory, inlined into the callers for plain memory. Everything else goes through
+ * WriteFallback.
+ * @param addr Guest address
+ * @param data Value to write
+ */
+template <typename T>
+inline void _Write(const u32 addr, const T data) {
+    MarkPageDirty(addr);
+    ExclusiveMonitor::OnStore(addr);
+
+    if (!g_access_stats_enabled) {
+        if (g_fastmem_enabled) {
+            *(T*)&g_base[addr] = data;
+            return;
+        }
+        u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+        if (page_pointer != NULL) {
+            *(T*)&page_pointer[addr & PAGE_MASK] = data;
+            return;
+        }
+    }
+    WriteFallback(addr, sizeof(T), data);
+}
+
+inline u8 Read8(const u32 addr) {
+    return _Read<u8>(addr);
+}
+
+inline u16 Read16(const u32 addr) {
+    return (u16)_Read<u16_le>(addr);
+}
+
+inline u32 Read32(const u32 addr) {
+    return (u32)_Read<u32_le>(addr);
+}
+
+inline u64 Read64(const u32 addr) {
+    return (u64)_Read<u64_le>(addr);
+}
+
+inline u32 Read8_ZX(const u32 addr) {
+    return (u32)Read8(addr);
+}
+
+inline u32 Read16_ZX(const u32 addr) {
+    return (u32)Read16(addr);
+}
+
+inline void Write8(const u32 addr, const u8 data) {
+    _Write<u8>(addr, data);
+}
+
+inline void Write16(const u32 addr, const u16 data) {
+    _Write<u16_le>(addr, data);
+}
+
+inline void Write32(const u32 addr, const u32 data) {
+    _Write<u32_le>(addr, data);
+}
+
+inline void Write64(const u32 addr, const u64 data) {
+    _Write<u64_le>(addr, data);
+}
+
+/**
+ * Marks all pages of a guest range as written
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumers to notify (DIRTY_*), all of them by default
+ */
+void MarkRangeDirty(const u32 addr, const size_t size, const u8 flags = DIRTY_ALL);
+
+/**
+ * Checks whether any page of a guest range was written since a consumer last cleared it
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumer bits to check (DIRTY_*)
+ * @return True if any of the pages has one of the bits set
+ */
+bool IsRangeDirty(const u32 addr, const size_t size, const u8 flags);
+
+/**
+ * Clears consumer dirty bits for all pages of a guest range
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param flags Consumer bits to clear (DIRTY_*)
+ */
+void ClearDirtyRange(const u32 addr, const size_t size, const u8 flags);
 
 inline const char* GetCharPointer(const u32 address) {
     return (const char *)GetPointer(address);
@@ -181,4 +625,35 @@ inline const u32 VirtualAddressFromPhysical_VRAM(const u32 address) {
     return (address + 0x07000000);
 }
 
+/**
+ * Gets the virtual address the CPU writes a physical address in FCRAM or VRAM through, which is
+ * the one its dirty page bits are tracked under
+ * @param address Physical address
+ * @return Virtual address, 0 if the address is in neither
+ */
+inline const u32 VirtualAddressFromPhysical(const u32 address) {
+    if (address >= FCRAM_PADDR && address < FCRAM_PADDR_END) {
+        return VirtualAddressFromPhysical_FCRAM(address);
+    }
+    if (address >= VRAM_PADDR && address < VRAM_PADDR_END) {
+        return VirtualAddressFromPhysical_VRAM(address);
+    }
+    return 0;
+}
+
+/**
+ * Gets the physical address the GPU sees for a virtual address in FCRAM or VRAM
+ * @param address Virtual address
+ * @return Physical address, 0 if the address is in neither
+ */
+inline const u32 PhysicalAddressFromVirtual(const u32 address) {
+    if (address >= FCRAM_VADDR && address < FCRAM_VADDR_END) {
+        return (address - FCRAM_VADDR) + FCRAM_PADDR;
+    }
+    if (address >= VRAM_VADDR && address < VRAM_VADDR_END) {
+        return (address - VRAM_VADDR) + VRAM_PADDR;
+    }
+    return 0;
+}
+
 } // namespace
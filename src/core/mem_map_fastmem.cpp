@@ -0,0 +1,298 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/common.h"
+
+#include "core/mem_map.h"
+
+#if defined(_M_X64) && (defined(__x86_64__) || defined(_MSC_VER))
+#if defined(_WIN32)
+#include <windows.h>
+#define FASTMEM_SUPPORTED 1
+#elif defined(__linux__)
+#include <signal.h>
+#include <ucontext.h>
+#define FASTMEM_SUPPORTED 1
+#endif
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Fastmem fault handling
+//
+// With fastmem enabled, guest memory is accessed as g_base + addr. Everything that isn't plain
+// memory (IO, config memory, unmapped space) is left inaccessible in the 4 GiB reservation, so
+// such an access faults. The handler decodes the faulting x86-64 load/store, performs it through
+// the regular handler path and resumes after the instruction.
+
+namespace Memory {
+
+#ifdef FASTMEM_SUPPORTED
+
+namespace {
+
+const u64 FASTMEM_SIZE = 0x100000000ULL;   ///< Size of the guest address space behind g_base
+
+/// Kind of memory access performed by a faulting host instruction
+enum AccessType {
+    ACCESS_LOAD,            ///< mov/movzx reg, [mem]
+    ACCESS_LOAD_SIGNED,     ///< movsx reg, [mem]
+    ACCESS_STORE,           ///< mov [mem], reg
+    ACCESS_STORE_IMM,       ///< mov [mem], imm
+};
+
+/// A decoded host memory access
+struct DecodedAccess {
+    AccessType  type;
+    int         size;       ///< Size of the memory operand in bytes
+    int         reg_size;   ///< Size of the register operand in bytes
+    int         reg;        ///< Register operand (0-15)
+    u64         imm;        ///< Immediate operand of ACCESS_STORE_IMM
+    int         length;     ///< Length of the instruction in bytes
+};
+
+/**
+ * Decodes the x86-64 instruction that caused a fastmem fault. Only the plain register/immediate
+ * moves compilers emit for Memory::Read/Write (and the JIT emits) are understood.
+ * @param code Pointer to the faulting instruction
+ * @param access Decoded access
+ * @return True if the instruction was understood
+ */
+bool DecodeAccess(const u8* code, DecodedAccess& access) {
+    int i = 0;
+    bool operand_size_16 = false;
+    u8 rex = 0;
+
+    if (code[i] == 0x66) {
+        operand_size_16 = true;
+        i++;
+    }
+    if ((code[i] & 0xF0) == 0x40) {
+        rex = code[i++];
+    }
+    const int operand_size = (rex & 8) ? 8 : (operand_size_16 ? 2 : 4);
+
+    u8 opcode = code[i++];
+    switch (opcode) {
+    case 0x8A: access.type = ACCESS_LOAD;       access.size = 1;            break;
+    case 0x8B: access.type = ACCESS_LOAD;       access.size = operand_size; break;
+    case 0x88: access.type = ACCESS_STORE;      access.size = 1;            break;
+    case 0x89: access.type = ACCESS_STORE;      access.size = operand_size; break;
+    case 0xC6: access.type = ACCESS_STORE_IMM;  access.size = 1;            break;
+    case 0xC7: access.type = ACCESS_STORE_IMM;  access.size = operand_size; break;
+    case 0x0F:
+        opcode = code[i++];
+        switch (opcode) {
+        case 0xB6: access.type = ACCESS_LOAD;           access.size = 1; break;
+        case 0xB7: access.type = ACCESS_LOAD;           access.size = 2; break;
+        case 0xBE: access.type = ACCESS_LOAD_SIGNED;    access.size = 1; break;
+        case 0xBF: access.type = ACCESS_LOAD_SIGNED;    access.size = 2; break;
+        default:
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+    access.reg_size = (opcode == 0x8A || opcode == 0x88) ? 1 : operand_size;
+
+    const u8 modrm = code[i++];
+    const int mod = modrm >> 6;
+    const int rm = modrm & 7;
+    access.reg = ((modrm >> 3) & 7) | ((rex & 4) ? 8 : 0);
+
+    if (mod == 3) {
+        return false;
+    }
+    if (rm == 4) {
+        const u8 sib = code[i++];
+        if (mod == 0 && (sib & 7) == 5) {
+            i += 4;
+        }
+    } else if (mod == 0 && rm == 5) {
+        // RIP-relative, never points into guest memory
+        return false;
+    }
+    if (mod == 1) {
+        i += 1;
+    } else if (mod == 2) {
+        i += 4;
+    }
+
+    // AH/CH/DH/BH can't be expressed as a plain register index
+    if (access.reg_size == 1 && rex == 0 && access.reg >= 4 && access.type != ACCESS_STORE_IMM) {
+        return false;
+    }
+
+    if (access.type == ACCESS_STORE_IMM) {
+        if (access.size == 1) {
+            access.imm = code[i];
+            i += 1;
+        } else if (access.size == 2) {
+            access.imm = code[i] | (code[i + 1] << 8);
+            i += 2;
+        } else {
+            u32 imm = code[i] | (code[i + 1] << 8) | (code[i + 2] << 16) |
+                ((u32)code[i + 3] << 24);
+            access.imm = (u64)(s64)(s32)imm;
+            i += 4;
+        }
+    }
+    access.length = i;
+    return true;
+}
+
+/**
+ * Emulates a faulting host instruction if it accessed the fastmem arena
+ * @param fault_addr Host address that faulted
+ * @param regs Host general purpose registers, indexed like the x86-64 encoding
+ * @param rip Host instruction pointer, advanced past the instruction on success
+ * @return True if the fault was handled
+ */
+bool HandleFault(uintptr_t fault_addr, u64* const regs[16], u64* rip) {
+    const uintptr_t base = (uintptr_t)g_base;
+    if (!g_fastmem_enabled || fault_addr < base || fault_addr >= base + FASTMEM_SIZE) {
+        return false;
+    }
+    const u32 guest_addr = (u32)(fault_addr - base);
+
+    DecodedAccess access;
+    if (!DecodeAccess((const u8*)*rip, access)) {
+        ERROR_LOG(MEMMAP, "fastmem: can't decode host instruction at %p for guest access @ 0x%08X",
+            (void*)*rip, guest_addr);
+        return false;
+    }
+
+    u64& reg = *regs[access.reg];
+    switch (access.type) {
+    case ACCESS_LOAD:
+    case ACCESS_LOAD_SIGNED:
+        {
+            u64 value = ReadSlow(guest_addr, access.size);
+            if (access.type == ACCESS_LOAD_SIGNED) {
+                value = (access.size == 1) ? (u64)(s64)(s8)value : (u64)(s64)(s16)value;
+            }
+            // Partial register writes keep the upper bits, 32-bit writes zero-extend
+            switch (access.reg_size) {
+            case 1: reg = (reg & ~0xFFULL) | (value & 0xFF);        break;
+            case 2: reg = (reg & ~0xFFFFULL) | (value & 0xFFFF);    break;
+            case 4: reg = value & 0xFFFFFFFF;                       break;
+            case 8: reg = value;                                    break;
+            }
+        }
+        break;
+
+    case ACCESS_STORE:
+        WriteSlow(guest_addr, access.size, reg);
+        break;
+
+    case ACCESS_STORE_IMM:
+        WriteSlow(guest_addr, access.size, access.imm);
+        break;
+    }
+
+    *rip += access.length;
+    return true;
+}
+
+#ifdef _WIN32
+
+PVOID g_handler = nullptr;
+
+LONG NTAPI FastmemExceptionHandler(PEXCEPTION_POINTERS info) {
+    if (info->ExceptionRecord->ExceptionCode != EXCEPTION_ACCESS_VIOLATION) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    CONTEXT* context = info->ContextRecord;
+
+    // Rax..R15 are laid out in encoding order in CONTEXT
+    u64* regs[16];
+    for (int i = 0; i < 16; i++) {
+        regs[i] = (u64*)&context->Rax + i;
+    }
+    if (HandleFault((uintptr_t)info->ExceptionRecord->ExceptionInformation[1], regs,
+        (u64*)&context->Rip)) {
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+#else
+
+struct sigaction g_old_segv_action;
+
+void FastmemSignalHandler(int sig, siginfo_t* info, void* raw_context) {
+    mcontext_t& mcontext = ((ucontext_t*)raw_context)->uc_mcontext;
+
+    static const int reg_index[16] = {
+        REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+        REG_R8,  REG_R9,  REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+    };
+    u64* regs[16];
+    for (int i = 0; i < 16; i++) {
+        regs[i] = (u64*)&mcontext.gregs[reg_index[i]];
+    }
+    if (HandleFault((uintptr_t)info->si_addr, regs, (u64*)&mcontext.gregs[REG_RIP])) {
+        return;
+    }
+
+    // Not a fastmem access: hand it to whoever was installed before us, or restore the default
+    // action and return so the instruction faults again and the process crashes normally
+    if (g_old_segv_action.sa_flags & SA_SIGINFO) {
+        g_old_segv_action.sa_sigaction(sig, info, raw_context);
+    } else if (g_old_segv_action.sa_handler != SIG_DFL && g_old_segv_action.sa_handler != SIG_IGN) {
+        g_old_segv_action.sa_handler(sig);
+    } else {
+        sigaction(SIGSEGV, &g_old_segv_action, nullptr);
+    }
+}
+
+#endif // _WIN32
+
+} // namespace
+
+/**
+ * Installs the host fault handler that emulates fastmem accesses to IO/unmapped guest memory
+ * @return True if fastmem can be used on this host
+ */
+bool InstallFastmemHandler() {
+#ifdef _WIN32
+    g_handler = AddVectoredExceptionHandler(1, FastmemExceptionHandler);
+    return g_handler != nullptr;
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = FastmemSignalHandler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGSEGV, &action, &g_old_segv_action) == 0;
+#endif
+}
+
+/// Removes the fastmem fault handler
+void RemoveFastmemHandler() {
+#ifdef _WIN32
+    if (g_handler != nullptr) {
+        RemoveVectoredExceptionHandler(g_handler);
+        g_handler = nullptr;
+    }
+#else
+    sigaction(SIGSEGV, &g_old_segv_action, nullptr);
+#endif
+}
+
+#else // FASTMEM_SUPPORTED
+
+bool InstallFastmemHandler() {
+    WARN_LOG(MEMMAP, "fastmem is not supported on this host");
+    return false;
+}
+
+void RemoveFastmemHandler() {
+}
+
+#endif // FASTMEM_SUPPORTED
+
+} // namespace
@@ -2,19 +2,19 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 
 #include "common/common.h"
+#include "common/perf_counters.h"
 
 #include "core/mem_map.h"
 #include "core/hw/hw.h"
 #include "hle/hle.h"
-#include "hle/config_mem.h"
 
 namespace Memory {
 
-std::map<u32, MemoryBlock> g_heap_map;
-std::map<u32, MemoryBlock> g_heap_gsp_map;
 std::map<u32, MemoryBlock> g_shared_map;
 
 /// Convert a physical address (or firmware-specific virtual address) to primary virtual address
@@ -40,95 +40,31 @@ u32 _VirtualAddress(const u32 addr) {
     return addr;
 }
 
+/// Handles reads of guest pages that aren't plain memory
 template <typename T>
-inline void _Read(T &var, const u32 addr) {
-    // TODO: Figure out the fastest order of tests for both read and write (they are probably different).
-    // TODO: Make sure this represents the mirrors in a correct way.
-    // Could just do a base-relative read, too.... TODO
-
+inline void _ReadSlow(T &var, const u32 addr) {
     const u32 vaddr = _VirtualAddress(addr);
 
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        var = *((const T*)&g_kernel_mem[vaddr & KERNEL_MEMORY_MASK]);
-
     // Hardware I/O register reads
     // 0x10XXXXXX- is physical address space, 0x1EXXXXXX is virtual address space
-    } else if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
+    if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
         HW::Read<T>(var, vaddr);
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        var = *((const T*)&g_exefs_code[vaddr & EXEFS_CODE_MASK]);
-
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR) && (vaddr < HEAP_GSP_VADDR_END)) {
-        var = *((const T*)&g_heap_gsp[vaddr & HEAP_GSP_MASK]);
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        var = *((const T*)&g_heap[vaddr & HEAP_MASK]);
-
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        var = *((const T*)&g_shared_mem[vaddr & SHARED_MEMORY_MASK]);
-
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-        var = *((const T*)&g_system_mem[vaddr & SYSTEM_MEMORY_MASK]);
-
-    // Config memory
-    } else if ((vaddr >= CONFIG_MEMORY_VADDR)  && (vaddr < CONFIG_MEMORY_VADDR_END)) {
-        ConfigMem::Read<T>(var, vaddr);
-
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        var = *((const T*)&g_vram[vaddr & VRAM_MASK]);
-
     } else {
         //_assert_msg_(MEMMAP, false, "unknown Read%d @ 0x%08X", sizeof(var) * 8, vaddr);
     }
 }
 
+/// Handles writes to guest pages that aren't plain memory
 template <typename T>
-inline void _Write(u32 addr, const T data) {
+inline void _WriteSlow(u32 addr, const T data) {
     u32 vaddr = _VirtualAddress(addr);
-    
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        *(T*)&g_kernel_mem[vaddr & KERNEL_MEMORY_MASK] = data;
 
     // Hardware I/O register writes
     // 0x10XXXXXX- is physical address space, 0x1EXXXXXX is virtual address space
-    } else if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
+    if ((vaddr >= HARDWARE_IO_VADDR) && (vaddr < HARDWARE_IO_VADDR_END)) {
         HW::Write<T>(vaddr, data);
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        *(T*)&g_exefs_code[vaddr & EXEFS_CODE_MASK] = data;
-
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR)  && (vaddr < HEAP_GSP_VADDR_END)) {
-        *(T*)&g_heap_gsp[vaddr & HEAP_GSP_MASK] = data;
-
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        *(T*)&g_heap[vaddr & HEAP_MASK] = data;
-
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        *(T*)&g_shared_mem[vaddr & SHARED_MEMORY_MASK] = data;
-
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-         *(T*)&g_system_mem[vaddr & SYSTEM_MEMORY_MASK] = data;
-
-    // VRAM
-    } else if ((vaddr >= VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        *(T*)&g_vram[vaddr & VRAM_MASK] = data;
-
-    //} else if ((vaddr & 0xFFF00000) == 0x1FF00000) {
-    //    _assert_msg_(MEMMAP, false, "umimplemented write to DSP memory");
     //} else if ((vaddr & 0xFFFF0000) == 0x1FF80000) {
     //    _assert_msg_(MEMMAP, false, "umimplemented write to Configuration Memory");
     //} else if ((vaddr & 0xFFFFF000) == 0x1FF81000) {
@@ -141,157 +77,347 @@ inline void _Write(u32 addr, const T data) {
     }
 }
 
-u8 *GetPointer(const u32 addr) {
-    const u32 vaddr = _VirtualAddress(addr);
-
-    // Kernel memory command buffer
-    if (vaddr >= KERNEL_MEMORY_VADDR && vaddr < KERNEL_MEMORY_VADDR_END) {
-        return g_kernel_mem + (vaddr & KERNEL_MEMORY_MASK);
+bool g_access_stats_enabled = false;
 
-    // ExeFS:/.code is loaded here
-    } else if ((vaddr >= EXEFS_CODE_VADDR)  && (vaddr < EXEFS_CODE_VADDR_END)) {
-        return g_exefs_code + (vaddr & EXEFS_CODE_MASK);
+static Common::PerfCounters::Region g_perf_blocks("Memory blocks");
 
-    // FCRAM - GSP heap
-    } else if ((vaddr >= HEAP_GSP_VADDR)  && (vaddr < HEAP_GSP_VADDR_END)) {
-        return g_heap_gsp + (vaddr & HEAP_GSP_MASK);
+static AccessStats g_access_stats;  ///< Counted by the emulation thread, approximate for others
 
-    // FCRAM - application heap
-    } else if ((vaddr >= HEAP_VADDR)  && (vaddr < HEAP_VADDR_END)) {
-        return g_heap + (vaddr & HEAP_MASK);
+/**
+ * Gets the region of a guest address
+ * @param addr Guest virtual address
+ * @return Region, REGION_OTHER if the address is in none of them
+ */
+Region GetRegion(const u32 addr) {
+    // Regions nested in others are checked before them: the scratchpad ends the heap range, VRAM
+    // and config memory are within the IO range
+    if (addr >= SCRATCHPAD_VADDR && addr < SCRATCHPAD_VADDR_END) {
+        return REGION_SCRATCHPAD;
+    } else if (addr >= HEAP_VADDR && addr < HEAP_VADDR_END) {
+        return REGION_HEAP;
+    } else if (addr >= EXEFS_CODE_VADDR && addr < EXEFS_CODE_VADDR_END) {
+        return REGION_EXEFS_CODE;
+    } else if (addr >= SYSTEM_MEMORY_VADDR && addr < SYSTEM_MEMORY_VADDR_END) {
+        return REGION_SYSTEM_MEMORY;
+    } else if (addr >= SHARED_MEMORY_VADDR && addr < SHARED_MEMORY_VADDR_END) {
+        return REGION_SHARED_MEMORY;
+    } else if (addr >= HEAP_GSP_VADDR && addr < HEAP_GSP_VADDR_END) {
+        return REGION_HEAP_GSP;
+    } else if (addr >= VRAM_VADDR && addr < VRAM_VADDR_END) {
+        return REGION_VRAM;
+    } else if (addr >= DSP_VADDR && addr < DSP_VADDR_END) {
+        return REGION_DSP_MEMORY;
+    } else if (addr >= CONFIG_MEMORY_VADDR && addr < SHARED_PAGE_VADDR_END) {
+        return REGION_CONFIG_MEMORY;
+    } else if (addr >= HARDWARE_IO_VADDR && addr < HARDWARE_IO_VADDR_END) {
+        return REGION_HARDWARE_IO;
+    } else if (addr >= KERNEL_MEMORY_VADDR && addr < KERNEL_MEMORY_VADDR_END) {
+        return REGION_KERNEL_MEMORY;
+    }
+    return REGION_OTHER;
+}
 
-    // Shared memory
-    } else if ((vaddr >= SHARED_MEMORY_VADDR)  && (vaddr < SHARED_MEMORY_VADDR_END)) {
-        return g_shared_mem + (vaddr & SHARED_MEMORY_MASK);
+/**
+ * Gets the name of a region, for logs
+ * @param region Region
+ * @return Name, as "heap"
+ */
+const char* GetRegionName(Region region) {
+    static const char* const names[NUM_REGIONS] = {
+        "exefs code", "system memory", "heap", "scratchpad", "shared memory", "gsp heap",
+        "hardware io", "vram", "dsp memory", "config memory", "kernel memory", "other",
+    };
+    return names[region];
+}
 
-    // System memory
-    } else if ((vaddr >= SYSTEM_MEMORY_VADDR)  && (vaddr < SYSTEM_MEMORY_VADDR_END)) {
-         return g_system_mem + (vaddr & SYSTEM_MEMORY_MASK);
+/// Gets the accesses counted since the last reset, only counted with g_access_stats_enabled
+const AccessStats& GetAccessStats() {
+    return g_access_stats;
+}
 
-    // VRAM
-    } else if ((vaddr > VRAM_VADDR)  && (vaddr < VRAM_VADDR_END)) {
-        return g_vram + (vaddr & VRAM_MASK);
+/// Zeroes the access counts
+void ResetAccessStats() {
+    memset(&g_access_stats, 0, sizeof(g_access_stats));
+}
 
-    } else {
-        ERROR_LOG(MEMMAP, "unknown GetPointer @ 0x%08x", vaddr);
-        return 0;
+/// Logs the access counts of the regions, most accessed first
+void LogAccessStats() {
+    int order[NUM_REGIONS];
+    u64 total = 0;
+    for (int i = 0; i < NUM_REGIONS; i++) {
+        order[i] = i;
+        total += g_access_stats.reads[i] + g_access_stats.writes[i];
+    }
+    std::sort(order, order + NUM_REGIONS, [](int a, int b) {
+        return g_access_stats.reads[a] + g_access_stats.writes[a] >
+            g_access_stats.reads[b] + g_access_stats.writes[b];
+    });
+
+    NOTICE_LOG(MEMMAP, "%llu guest accesses", (unsigned long long)total);
+    for (int i = 0; i < NUM_REGIONS; i++) {
+        const int region = order[i];
+        const u64 count = g_access_stats.reads[region] + g_access_stats.writes[region];
+        if (count == 0) {
+            break;
+        }
+        NOTICE_LOG(MEMMAP, "%-14s %5.1f%%  %llu reads, %llu writes",
+            GetRegionName((Region)region), count * 100.0 / total,
+            (unsigned long long)g_access_stats.reads[region],
+            (unsigned long long)g_access_stats.writes[region]);
     }
 }
 
 /**
- * Maps a block of memory in shared memory
- * @param handle Handle to map memory block for
- * @param addr Address to map memory block to
- * @param permissions Memory map permissions
+ * Counts an access for the statistics. Kept out of the inline Read* and Write*, which only test the
+ * flag.
+ * @param addr Guest address accessed
+ * @param write Whether the access is a write
  */
-u32 MapBlock_Shared(u32 handle, u32 addr,u32 permissions) {
-    MemoryBlock block;
-    
-    block.handle        = handle;
-    block.base_address  = addr;
-    block.permissions   = permissions;
-    
-    if (g_shared_map.size() > 0) {
-        const MemoryBlock last_block = g_shared_map.rbegin()->second;
-        block.address = last_block.address + last_block.size;
+static void CountAccess(const u32 addr, bool write) {
+    const Region region = GetRegion(addr);
+    if (write) {
+        g_access_stats.writes[region]++;
+    } else {
+        g_access_stats.reads[region]++;
     }
-    g_shared_map[block.GetVirtualAddress()] = block;
-
-    return block.GetVirtualAddress();
 }
 
 /**
- * Maps a block of memory on the heap
- * @param size Size of block in bytes
- * @param operation Memory map operation type
- * @param flags Memory allocation flags
+ * Performs a guest read the inline Read* functions don't serve: counted ones (see
+ * g_access_stats_enabled) and ones of pages that aren't plain memory
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @return Value read, zero-extended
  */
-u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions) {
-    MemoryBlock block;
-    
-    block.base_address  = HEAP_VADDR;
-    block.size          = size;
-    block.operation     = operation;
-    block.permissions   = permissions;
-    
-    if (g_heap_map.size() > 0) {
-        const MemoryBlock last_block = g_heap_map.rbegin()->second;
-        block.address = last_block.address + last_block.size;
+u64 ReadFallback(const u32 addr, const int size) {
+    if (g_access_stats_enabled) {
+        CountAccess(addr, false);
     }
-    g_heap_map[block.GetVirtualAddress()] = block;
 
-    return block.GetVirtualAddress();
+    // With fastmem IO is caught by the fault handler
+    const u8* pointer = &g_base[addr];
+    if (!g_fastmem_enabled) {
+        const u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+        if (page_pointer == NULL) {
+            return ReadSlow(addr, size);
+        }
+        pointer = &page_pointer[addr & PAGE_MASK];
+    }
+    switch (size) {
+    case 1: return *pointer;
+    case 2: return (u16)*(const u16_le*)pointer;
+    case 4: return (u32)*(const u32_le*)pointer;
+    case 8: return (u64)*(const u64_le*)pointer;
+    }
+    _assert_msg_(MEMMAP, false, "invalid ReadFallback size %d @ 0x%08X", size, addr);
+    return 0;
 }
 
 /**
- * Maps a block of memory on the GSP heap
- * @param size Size of block in bytes
- * @param operation Memory map operation type
- * @param flags Memory allocation flags
+ * Performs a guest write the inline Write* functions don't serve, with the page already marked
+ * dirty: counted ones (see g_access_stats_enabled) and ones to pages that aren't plain memory
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @param data Value to write
  */
-u32 MapBlock_HeapGSP(u32 size, u32 operation, u32 permissions) {
-    MemoryBlock block;
-    
-    block.base_address  = HEAP_GSP_VADDR;
-    block.size          = size;
-    block.operation     = operation;
-    block.permissions   = permissions;
-    
-    if (g_heap_gsp_map.size() > 0) {
-        const MemoryBlock last_block = g_heap_gsp_map.rbegin()->second;
-        block.address = last_block.address + last_block.size;
+void WriteFallback(const u32 addr, const int size, const u64 data) {
+    if (g_access_stats_enabled) {
+        CountAccess(addr, true);
     }
-    g_heap_gsp_map[block.GetVirtualAddress()] = block;
 
-    return block.GetVirtualAddress();
+    u8* pointer = &g_base[addr];
+    if (!g_fastmem_enabled) {
+        u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+        if (page_pointer == NULL) {
+            WriteSlow(addr, size, data);
+            return;
+        }
+        pointer = &page_pointer[addr & PAGE_MASK];
+    }
+    switch (size) {
+    case 1: *pointer = (u8)data;                    break;
+    case 2: *(u16_le*)pointer = (u16)data;          break;
+    case 4: *(u32_le*)pointer = (u32)data;          break;
+    case 8: *(u64_le*)pointer = data;               break;
+    default:
+        _assert_msg_(MEMMAP, false, "invalid WriteFallback size %d @ 0x%08X", size, addr);
+        break;
+    }
 }
 
-u8 Read8(const u32 addr) {
-    u8 _var = 0;
-    _Read<u8>(_var, addr);
-    return (u8)_var;
+/**
+ * Performs a guest read through the handler path (IO, config memory), bypassing fastmem
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @return Value read, zero-extended
+ */
+u64 ReadSlow(const u32 addr, const int size) {
+    switch (size) {
+    case 1: { u8 var = 0;      _ReadSlow<u8>(var, addr);       return var; }
+    case 2: { u16_le var = 0;  _ReadSlow<u16_le>(var, addr);   return (u16)var; }
+    case 4: { u32_le var = 0;  _ReadSlow<u32_le>(var, addr);   return (u32)var; }
+    case 8: { u64_le var = 0;  _ReadSlow<u64_le>(var, addr);   return (u64)var; }
+    }
+    _assert_msg_(MEMMAP, false, "invalid ReadSlow size %d @ 0x%08X", size, addr);
+    return 0;
 }
 
-u16 Read16(const u32 addr) {
-    u16_le _var = 0;
-    _Read<u16_le>(_var, addr);
-    return (u16)_var;
+/**
+ * Performs a guest write through the handler path (IO, config memory), bypassing fastmem
+ * @param addr Guest address
+ * @param size Access size in bytes (1, 2, 4 or 8)
+ * @param data Value to write
+ */
+void WriteSlow(const u32 addr, const int size, const u64 data) {
+    switch (size) {
+    case 1: _WriteSlow<u8>(addr, (u8)data);         break;
+    case 2: _WriteSlow<u16_le>(addr, (u16)data);    break;
+    case 4: _WriteSlow<u32_le>(addr, (u32)data);    break;
+    case 8: _WriteSlow<u64_le>(addr, data);         break;
+    default:
+        _assert_msg_(MEMMAP, false, "invalid WriteSlow size %d @ 0x%08X", size, addr);
+        break;
+    }
 }
 
-u32 Read32(const u32 addr) {
-    u32_le _var = 0;
-    _Read<u32_le>(_var, addr);
-    return _var;
+/**
+ * Splits a guest range into runs of pages that are contiguous in host memory
+ * @param addr Guest address of the range
+ * @param size Size of the range in bytes
+ * @param func Called as func(offset, host_pointer, span_size) for every run, with host_pointer
+ *             NULL for runs that aren't plain memory (IO, config memory, unmapped)
+ */
+template <typename Func>
+static void WalkBlock(const u32 addr, const size_t size, Func func) {
+    size_t offset = 0;
+    while (offset < size) {
+        const u32 span_addr = addr + (u32)offset;
+        u8* const span_pointer = g_page_table[span_addr >> PAGE_BITS];
+        size_t span_size = std::min<size_t>(PAGE_SIZE - (span_addr & PAGE_MASK), size - offset);
+
+        // Extend the span while the next page follows on directly in host memory
+        while (offset + span_size < size) {
+            const u32 next_addr = span_addr + (u32)span_size;
+            u8* const next_pointer = g_page_table[next_addr >> PAGE_BITS];
+            if (span_pointer == NULL ? next_pointer != NULL :
+                next_pointer != span_pointer + (next_addr - (span_addr & ~PAGE_MASK))) {
+                break;
+            }
+            span_size += std::min<size_t>(PAGE_SIZE, size - offset - span_size);
+        }
+
+        func(offset, span_pointer != NULL ? span_pointer + (span_addr & PAGE_MASK) : NULL,
+            span_size);
+        offset += span_size;
+    }
 }
 
-u64 Read64(const u32 addr) {
-    u64_le _var = 0;
-    _Read<u64_le>(_var, addr);
-    return _var;
+/**
+ * Reads a block of guest memory into a host buffer
+ * @param src_addr Guest address to read from
+ * @param dest_buffer Host buffer to read into
+ * @param size Number of bytes to read
+ */
+void ReadBlock(const u32 src_addr, void* dest_buffer, const size_t size) {
+    u8* dest = (u8*)dest_buffer;
+    WalkBlock(src_addr, size, [&](size_t offset, const u8* pointer, size_t span) {
+        if (pointer != NULL) {
+            memcpy(dest + offset, pointer, span);
+        } else {
+            for (size_t i = 0; i < span; i++) {
+                dest[offset + i] = (u8)ReadSlow(src_addr + (u32)(offset + i), 1);
+            }
+        }
+    });
 }
 
-u32 Read8_ZX(const u32 addr) {
-    return (u32)Read8(addr);
+/**
+ * Writes a host buffer into guest memory
+ * @param dest_addr Guest address to write to
+ * @param src_buffer Host buffer to write from
+ * @param size Number of bytes to write
+ */
+void WriteBlock(const u32 dest_addr, const void* src_buffer, const size_t size) {
+    const u8* src = (const u8*)src_buffer;
+    MarkRangeDirty(dest_addr, size);
+    WalkBlock(dest_addr, size, [&](size_t offset, u8* pointer, size_t span) {
+        if (pointer != NULL) {
+            memmove(pointer, src + offset, span);
+        } else {
+            for (size_t i = 0; i < span; i++) {
+                WriteSlow(dest_addr + (u32)(offset + i), 1, src[offset + i]);
+            }
+        }
+    });
 }
 
-u32 Read16_ZX(const u32 addr) {
-    return (u32)Read16(addr);
+/**
+ * Fills a block of guest memory with zeroes
+ * @param dest_addr Guest address to fill
+ * @param size Number of bytes to fill
+ */
+void ZeroBlock(const u32 dest_addr, const size_t size) {
+    MarkRangeDirty(dest_addr, size);
+    WalkBlock(dest_addr, size, [&](size_t offset, u8* pointer, size_t span) {
+        if (pointer != NULL) {
+            memset(pointer, 0, span);
+        } else {
+            for (size_t i = 0; i < span; i++) {
+                WriteSlow(dest_addr + (u32)(offset + i), 1, 0);
+            }
+        }
+    });
 }
 
-void Write8(const u32 addr, const u8 data) {
-    _Write<u8>(addr, data);
+/**
+ * Copies a block of guest memory to another guest address
+ * @param dest_addr Guest address to copy to
+ * @param src_addr Guest address to copy from
+ * @param size Number of bytes to copy
+ */
+void CopyBlock(const u32 dest_addr, const u32 src_addr, const size_t size) {
+    Common::PerfCounters::Scope perf_scope(g_perf_blocks);
+    WalkBlock(src_addr, size, [&](size_t offset, const u8* pointer, size_t span) {
+        if (pointer != NULL) {
+            WriteBlock(dest_addr + (u32)offset, pointer, span);
+        } else {
+            for (size_t i = 0; i < span; i++) {
+                const u8 value = (u8)ReadSlow(src_addr + (u32)(offset + i), 1);
+                WriteBlock(dest_addr + (u32)(offset + i), &value, 1);
+            }
+        }
+    });
 }
 
-void Write16(const u32 addr, const u16 data) {
-    _Write<u16_le>(addr, data);
+u8 *GetPointer(const u32 addr) {
+    u8* page_pointer = g_page_table[addr >> PAGE_BITS];
+    if (page_pointer != NULL) {
+        return page_pointer + (addr & PAGE_MASK);
+    }
+    ERROR_LOG(MEMMAP, "unknown GetPointer @ 0x%08x", _VirtualAddress(addr));
+    return 0;
 }
 
-void Write32(const u32 addr, const u32 data) {
-    _Write<u32_le>(addr, data);
-}
+/**
+ * Maps a block of memory in shared memory
+ * @param handle Handle to map memory block for
+ * @param addr Address to map memory block to
+ * @param permissions Memory map permissions
+ */
+u32 MapBlock_Shared(u32 handle, u32 addr,u32 permissions) {
+    MemoryBlock block;
+    
+    block.handle        = handle;
+    block.base_address  = addr;
+    block.permissions   = permissions;
+    
+    if (g_shared_map.size() > 0) {
+        const MemoryBlock last_block = g_shared_map.rbegin()->second;
+        block.address = last_block.address + last_block.size;
+    }
+    g_shared_map[block.GetVirtualAddress()] = block;
 
-void Write64(const u32 addr, const u64 data) {
-    _Write<u64_le>(addr, data);
+    return block.GetVirtualAddress();
 }
 
 } // namespace
@@ -0,0 +1,233 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/mem_map.h"
+
+namespace Memory {
+
+namespace {
+
+typedef AddressSpace::Area Area;
+
+const u64 kAddressSpaceEnd = 1ULL << 32;
+
+/// Gets the end of an area, its size added to its start
+u64 AreaEnd(const std::vector<Area>& areas, size_t index) {
+    return (index + 1 < areas.size()) ? areas[index + 1].base_address : kAddressSpaceEnd;
+}
+
+/// Gets the index of the area an address is in
+size_t FindArea(const std::vector<Area>& areas, u32 addr) {
+    auto it = std::upper_bound(areas.begin(), areas.end(), addr,
+        [](u32 addr, const Area& area) { return addr < area.base_address; });
+    return (size_t)(it - areas.begin()) - 1;
+}
+
+/**
+ * Splits the area an address is in, so that an area starts at the address
+ * @param areas Areas of an address space
+ * @param addr Address, the end of the address space for none
+ * @return Index of the area starting at the address, the number of areas for the end
+ */
+size_t SplitAt(std::vector<Area>& areas, u64 addr) {
+    if (addr >= kAddressSpaceEnd) {
+        return areas.size();
+    }
+    const size_t index = FindArea(areas, (u32)addr);
+    if (areas[index].base_address == addr) {
+        return index;
+    }
+    Area area = areas[index];
+    area.base_address = (u32)addr;
+    areas.insert(areas.begin() + index + 1, area);
+    return index + 1;
+}
+
+/// Merges an area into the one before it if they have the same state and permissions
+void MergeWithPrevious(std::vector<Area>& areas, size_t index) {
+    if (index == 0 || index >= areas.size()) {
+        return;
+    }
+    const Area& previous = areas[index - 1];
+    if (previous.state == areas[index].state &&
+        previous.permissions == areas[index].permissions) {
+
+        areas.erase(areas.begin() + index);
+    }
+}
+
+/**
+ * Sets the state and permissions of a range of pages, splitting and merging areas around it
+ * @param areas Areas of an address space
+ * @param addr Start of the range, page aligned
+ * @param size Size of the range in bytes, page aligned
+ * @param permissions MemoryAreaPermission bits
+ * @param state MemoryState
+ */
+void SetArea(std::vector<Area>& areas, u32 addr, u64 size, u32 permissions, u32 state) {
+    if (size == 0) {
+        return;
+    }
+    const size_t first = SplitAt(areas, addr);
+    const size_t end = SplitAt(areas, addr + size);
+    areas.erase(areas.begin() + first + 1, areas.begin() + end);
+    areas[first].permissions = permissions;
+    areas[first].state = state;
+    MergeWithPrevious(areas, first + 1);
+    MergeWithPrevious(areas, first);
+}
+
+/// Whether all of a range of pages is free
+bool IsFree(const std::vector<Area>& areas, u32 addr, u64 size) {
+    const size_t index = FindArea(areas, addr);
+    return areas[index].state == MEMORY_STATE_FREE && AreaEnd(areas, index) >= addr + size;
+}
+
+/// Rounds a size up to whole pages
+u64 PageAlign(u32 size) {
+    return ((u64)size + PAGE_MASK) & ~(u64)PAGE_MASK;
+}
+
+} // namespace
+
+/**
+ * Resets the memory areas of an address space to the mappings of a fresh process, heaps free
+ * @param space Address space
+ */
+void ResetAreas(AddressSpace* space) {
+    static const u32 kReadWrite = MEMORY_AREA_READ | MEMORY_AREA_WRITE;
+
+    std::vector<Area>& areas = space->areas;
+    const Area free_space = { 0, 0, MEMORY_STATE_FREE };
+    areas.assign(1, free_space);
+    SetArea(areas, EXEFS_CODE_VADDR, EXEFS_CODE_SIZE, kReadWrite | MEMORY_AREA_EXECUTE,
+        MEMORY_STATE_CODE);
+    SetArea(areas, SYSTEM_MEMORY_VADDR, SYSTEM_MEMORY_SIZE, kReadWrite, MEMORY_STATE_PRIVATE);
+    SetArea(areas, SCRATCHPAD_VADDR, SCRATCHPAD_SIZE, kReadWrite, MEMORY_STATE_PRIVATE);
+    SetArea(areas, CONFIG_MEMORY_VADDR, CONFIG_MEMORY_SIZE + SHARED_PAGE_SIZE, MEMORY_AREA_READ,
+        MEMORY_STATE_STATIC);
+    SetArea(areas, HARDWARE_IO_VADDR, HARDWARE_IO_SIZE, kReadWrite, MEMORY_STATE_IO);
+    SetArea(areas, VRAM_VADDR, VRAM_SIZE, kReadWrite, MEMORY_STATE_STATIC);
+    SetArea(areas, DSP_VADDR, DSP_SIZE, kReadWrite, MEMORY_STATE_STATIC);
+    SetArea(areas, KERNEL_MEMORY_VADDR, KERNEL_MEMORY_SIZE, kReadWrite, MEMORY_STATE_STATIC);
+}
+
+/**
+ * Allocates a range of a region of the address space, as ControlMemory commits memory
+ * @param region_base Start of the region, as HEAP_VADDR
+ * @param region_size Size of the region in bytes
+ * @param addr Start of the range, 0 to take the lowest free one that fits
+ * @param size Size of the range in bytes, rounded up to whole pages
+ * @param permissions MemoryAreaPermission bits of the range
+ * @param state MemoryState of the range
+ * @return Start of the range, 0 if there is no room or the given range isn't all free
+ */
+u32 AllocateArea(u32 region_base, u32 region_size, u32 addr, u32 size, u32 permissions,
+    u32 state) {
+
+    std::vector<Area>& areas = GetAddressSpace()->areas;
+    const u64 aligned_size = PageAlign(size);
+    const u64 region_end = (u64)region_base + region_size;
+    if (aligned_size == 0 || aligned_size > region_size) {
+        return 0;
+    }
+    if (addr != 0) {
+        if ((addr & PAGE_MASK) != 0 || addr < region_base || addr + aligned_size > region_end ||
+            !IsFree(areas, addr, aligned_size)) {
+            return 0;
+        }
+    } else {
+        // Allocations are rare next to lookups, a scan of the region is fine
+        for (size_t i = FindArea(areas, region_base); i < areas.size(); i++) {
+            const u64 start = std::max<u64>(areas[i].base_address, region_base);
+            if (start + aligned_size > region_end) {
+                return 0;
+            }
+            if (areas[i].state == MEMORY_STATE_FREE &&
+                AreaEnd(areas, i) >= start + aligned_size) {
+
+                addr = (u32)start;
+                break;
+            }
+        }
+        if (addr == 0) {
+            return 0;
+        }
+    }
+    SetArea(areas, addr, aligned_size, permissions, state);
+    return addr;
+}
+
+/**
+ * Frees a range of the address space, as ControlMemory does. The memory reads back as zero once
+ * it is allocated again.
+ * @param addr Start of the range
+ * @param size Size of the range in bytes, rounded up to whole pages
+ * @return False if the range has free pages already
+ */
+bool FreeArea(u32 addr, u32 size) {
+    std::vector<Area>& areas = GetAddressSpace()->areas;
+    const u64 aligned_size = PageAlign(size);
+    if ((addr & PAGE_MASK) != 0 || addr + aligned_size > kAddressSpaceEnd) {
+        return false;
+    }
+    const u64 end = addr + aligned_size;
+    for (size_t i = FindArea(areas, addr); i < areas.size() && areas[i].base_address < end; i++) {
+        if (areas[i].state == MEMORY_STATE_FREE) {
+            return false;
+        }
+    }
+
+    // The pages go back to the host, they read back as zero for the next allocation
+    DecommitBlock(addr, (size_t)aligned_size);
+    SetArea(areas, addr, aligned_size, 0, MEMORY_STATE_FREE);
+    return true;
+}
+
+/**
+ * Gets the virtual memory area an address is in, as QueryMemory
+ * @param addr Guest address
+ * @return The area, neighbouring pages of the same state and permissions make up one area
+ */
+MemoryArea QueryArea(u32 addr) {
+    const std::vector<Area>& areas = GetAddressSpace()->areas;
+    const size_t index = FindArea(areas, addr);
+    MemoryArea area;
+    area.base_address = areas[index].base_address;
+    area.size = (u32)std::min<u64>(AreaEnd(areas, index) - area.base_address, 0xFFFFFFFF);
+    area.permissions = areas[index].permissions;
+    area.state = areas[index].state;
+    return area;
+}
+
+/**
+ * Saves or loads the memory areas of an address space
+ * @param p Savestate the areas are written to or read from
+ * @param space Address space
+ */
+void DoAreas(PointerWrap& p, AddressSpace* space) {
+    p.DoPOD(space->areas);
+}
+
+/**
+ * Saves or loads the state of the memory map, the areas of the boot address space and the aliases.
+ * Guest memory is saved on its own, the address spaces of the processes with them.
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("MemoryAreas", 2);
+    if (!s) {
+        return;
+    }
+    DoAreas(p, GetBootAddressSpace());
+    DoAliases(p);
+}
+
+} // namespace
@@ -0,0 +1,323 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/log.h"
+
+#include "core/movie.h"
+#include "core/savestate.h"
+#include "core/speed_limiter.h"
+
+namespace Movie {
+
+namespace {
+
+enum {
+    MAGIC       = 0x564D5443,       ///< "CTMV"
+    VERSION     = 1,
+};
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+    u32 keyframe_interval;
+};
+
+/// Movies are a header followed by records, a state record first
+enum RecordType : u32 {
+    RECORD_STATE    = 1,            ///< Savestate taken before the frame of the record
+    RECORD_INPUT    = 2,            ///< Pad states of the frames from the frame of the record on
+};
+
+struct RecordHeader {
+    u32 type;
+    u32 frame;
+    u32 size;                       ///< Size of the data following the header in bytes
+};
+
+/// Savestate embedded in a movie played back
+struct Keyframe {
+    u32 frame;
+    u64 offset;                     ///< Offset of the savestate in the file
+};
+
+enum Mode {
+    MODE_NONE,
+    MODE_RECORDING,
+    MODE_PLAYBACK,
+};
+
+Mode                    g_mode = MODE_NONE;
+File::IOFile            g_file;
+u32                     g_frame = 0;            ///< Frames recorded or played back so far
+std::vector<u32>        g_inputs;               ///< Pad state of every frame
+u32                     g_inputs_written = 0;   ///< Frames of g_inputs already in the recording
+bool                    g_keyframe_due = false;
+std::vector<Keyframe>   g_keyframes;            ///< Keyframes of the playback, by frame
+u32                     g_seek_frame = 0;       ///< Frame the unthrottled seek runs to
+bool                    g_seeking = false;
+int                     g_seek_speed = 0;       ///< Speed setting to go back to after the seek
+
+/**
+ * Writes the pad states recorded since the last input record
+ * @return True on success
+ */
+bool WriteInputs() {
+    const u32 count = (u32)g_inputs.size() - g_inputs_written;
+    if (count == 0) {
+        return true;
+    }
+    const RecordHeader header = { RECORD_INPUT, g_inputs_written, count * 4 };
+    if (!g_file.WriteArray(&header, 1) || !g_file.WriteArray(&g_inputs[g_inputs_written], count)) {
+        return false;
+    }
+    g_inputs_written = (u32)g_inputs.size();
+    return true;
+}
+
+/**
+ * Writes the current state as a keyframe of the recording
+ * @return True on success
+ */
+bool WriteKeyframe() {
+    RecordHeader header = { RECORD_STATE, g_frame, 0 };
+    const u64 header_offset = g_file.Tell();
+    if (!g_file.WriteArray(&header, 1) || !SaveState::Save(g_file)) {
+        return false;
+    }
+    // The savestate writes itself out without telling its size beforehand
+    const u64 end = g_file.Tell();
+    header.size = (u32)(end - header_offset - sizeof(header));
+    return g_file.Seek(header_offset, SEEK_SET) && g_file.WriteArray(&header, 1) &&
+        g_file.Seek(end, SEEK_SET);
+}
+
+/**
+ * Loads a keyframe of the movie played back
+ * @param keyframe Keyframe to load
+ * @return True on success
+ */
+bool LoadKeyframe(const Keyframe& keyframe) {
+    if (!g_file.Seek(keyframe.offset, SEEK_SET) || !SaveState::Load(g_file)) {
+        return false;
+    }
+    g_frame = keyframe.frame;
+    return true;
+}
+
+/**
+ * Reads the records of a movie played back, the pad states and where the keyframes are
+ * @return True on success
+ */
+bool ReadRecords() {
+    RecordHeader header;
+    while (g_file.ReadArray(&header, 1)) {
+        const u64 offset = g_file.Tell();
+        if (header.type == RECORD_STATE) {
+            const Keyframe keyframe = { header.frame, offset };
+            g_keyframes.push_back(keyframe);
+        } else if (header.type == RECORD_INPUT) {
+            const u32 count = header.size / 4;
+            if (g_inputs.size() < header.frame + count) {
+                g_inputs.resize(header.frame + count);
+            }
+            if (!g_file.ReadArray(&g_inputs[header.frame], count)) {
+                g_inputs.resize(header.frame);
+                break;
+            }
+            continue;
+        } else {
+            ERROR_LOG(COMMON, "movie has a bad record of type %u", header.type);
+            return false;
+        }
+        if (!g_file.Seek(offset + header.size, SEEK_SET)) {
+            return false;
+        }
+    }
+    // A recording stopped by a crash can end in the middle of a record, what came before holds
+    g_file.Clear();
+    return !g_keyframes.empty() && g_keyframes[0].frame == 0;
+}
+
+/// Runs at the speed set before the seek again
+void EndSeek() {
+    g_seeking = false;
+    SpeedLimiter::SetSpeed(g_seek_speed);
+}
+
+} // namespace
+
+/**
+ * Starts recording a movie from the current state, stopping any movie recorded or played. Must be
+ * called between two CPU slices.
+ * @param filename Path of the movie
+ * @return True on success
+ */
+bool StartRecording(const std::string& filename) {
+    Stop();
+
+    const FileHeader header = { MAGIC, VERSION, KEYFRAME_INTERVAL };
+    if (!g_file.Open(filename, "wb") || !g_file.WriteArray(&header, 1) || !WriteKeyframe()) {
+        ERROR_LOG(COMMON, "couldn't create movie %s", filename.c_str());
+        g_file.Close();
+        return false;
+    }
+    g_mode = MODE_RECORDING;
+    NOTICE_LOG(COMMON, "recording movie %s", filename.c_str());
+    return true;
+}
+
+/**
+ * Starts playing a movie back, loading its first state. Must be called between two CPU slices.
+ * @param filename Path of the movie
+ * @return True on success
+ */
+bool StartPlayback(const std::string& filename) {
+    Stop();
+
+    FileHeader header;
+    if (!g_file.Open(filename, "rb") || !g_file.ReadArray(&header, 1) || header.magic != MAGIC ||
+        header.version != VERSION) {
+        ERROR_LOG(COMMON, "%s isn't a movie of version %u", filename.c_str(), (u32)VERSION);
+        g_file.Close();
+        return false;
+    }
+    if (!ReadRecords() || !LoadKeyframe(g_keyframes[0])) {
+        ERROR_LOG(COMMON, "couldn't play movie %s back", filename.c_str());
+        Stop();
+        return false;
+    }
+    g_mode = MODE_PLAYBACK;
+    NOTICE_LOG(COMMON, "playing movie %s back, %u frames", filename.c_str(),
+        (u32)g_inputs.size());
+    return true;
+}
+
+/**
+ * Seeks the movie played back to a frame, from the keyframe before it when the frame is behind
+ * the current one or past the next keyframe. Update tells when the frame is reached. Must be
+ * called between two CPU slices.
+ * @param frame Frame to seek to, clamped to the length of the movie
+ * @return True if a movie is played back
+ */
+bool Seek(u32 frame) {
+    if (g_mode != MODE_PLAYBACK) {
+        return false;
+    }
+    frame = std::min(frame, (u32)g_inputs.size());
+
+    const Keyframe* keyframe = &g_keyframes[0];
+    for (const Keyframe& it : g_keyframes) {
+        if (it.frame <= frame) {
+            keyframe = &it;
+        }
+    }
+    if (frame < g_frame || keyframe->frame > g_frame) {
+        if (!LoadKeyframe(*keyframe)) {
+            ERROR_LOG(COMMON, "couldn't load the keyframe at frame %u", keyframe->frame);
+            Stop();
+            return false;
+        }
+    }
+
+    if (!g_seeking) {
+        g_seek_speed = SpeedLimiter::g_speed;
+        SpeedLimiter::SetSpeed(SpeedLimiter::UNLIMITED);
+    }
+    g_seek_frame = frame;
+    g_seeking = true;
+    return true;
+}
+
+/**
+ * Gets the number of frames recorded or played back so far
+ * @return Frame number, 0 if no movie is recorded or played
+ */
+u32 GetFrame() {
+    return g_frame;
+}
+
+/// Tells whether a movie is recorded or played back
+bool IsActive() {
+    return g_mode != MODE_NONE;
+}
+
+/**
+ * Records or plays back the pad state of a frame, called once per vertical blank
+ * @param pad_state Pad state from the frontend
+ * @return Pad state the application is to see
+ */
+u32 OnFrame(u32 pad_state) {
+    switch (g_mode) {
+    case MODE_RECORDING:
+        g_inputs.push_back(pad_state);
+        g_frame++;
+        if (g_frame % KEYFRAME_INTERVAL == 0) {
+            g_keyframe_due = true;
+        }
+        return pad_state;
+
+    case MODE_PLAYBACK:
+        if (g_frame == g_inputs.size()) {
+            NOTICE_LOG(COMMON, "movie ended at frame %u", g_frame);
+            Stop();
+            return pad_state;
+        }
+        return g_inputs[g_frame++];
+
+    default:
+        return pad_state;
+    }
+}
+
+/**
+ * Writes the keyframe due while recording, and stops an unthrottled seek at its frame. Called
+ * between two CPU slices.
+ * @return True if a seek just reached its frame
+ */
+bool Update() {
+    if (g_keyframe_due) {
+        g_keyframe_due = false;
+        // Flushed so that the recording holds up to the keyframe if the emulator crashes
+        if (!WriteInputs() || !WriteKeyframe() || !g_file.Flush()) {
+            ERROR_LOG(COMMON, "couldn't write the keyframe at frame %u, recording stopped",
+                g_frame);
+            Stop();
+        }
+    }
+    if (g_seeking && (g_frame >= g_seek_frame || g_mode != MODE_PLAYBACK)) {
+        EndSeek();
+        NOTICE_LOG(COMMON, "movie seeked to frame %u", g_frame);
+        return true;
+    }
+    return false;
+}
+
+/// Stops recording or playing back the movie, writing the rest of a recording
+void Stop() {
+    if (g_mode == MODE_RECORDING && !WriteInputs()) {
+        ERROR_LOG(COMMON, "couldn't write the end of the movie recorded");
+    }
+    if (g_seeking) {
+        EndSeek();
+    }
+    g_mode = MODE_NONE;
+    g_file.Close();
+    g_frame = 0;
+    g_inputs.clear();
+    g_inputs_written = 0;
+    g_keyframe_due = false;
+    g_keyframes.clear();
+}
+
+/// Shutdown the movie module
+void Shutdown() {
+    Stop();
+}
+
+} // namespace
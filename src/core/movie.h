@@ -0,0 +1,77 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Input movies: the pad state of every frame, recorded from the frontend or played back in its
+ * place, from a savestate embedded at the start of the movie. The emulation being deterministic
+ * otherwise, playback runs as the recording did. Keyframe savestates are embedded every
+ * KEYFRAME_INTERVAL frames so that seeking loads the last keyframe before the frame sought and
+ * runs the rest unthrottled, rather than playing the movie from its start.
+ */
+namespace Movie {
+
+enum {
+    KEYFRAME_INTERVAL   = 60 * 60,  ///< Frames between two keyframes, a minute of emulated time
+};
+
+/**
+ * Starts recording a movie from the current state, stopping any movie recorded or played. Must be
+ * called between two CPU slices.
+ * @param filename Path of the movie
+ * @return True on success
+ */
+bool StartRecording(const std::string& filename);
+
+/**
+ * Starts playing a movie back, loading its first state. Must be called between two CPU slices.
+ * @param filename Path of the movie
+ * @return True on success
+ */
+bool StartPlayback(const std::string& filename);
+
+/**
+ * Seeks the movie played back to a frame, from the keyframe before it when the frame is behind
+ * the current one or past the next keyframe. Update tells when the frame is reached. Must be
+ * called between two CPU slices.
+ * @param frame Frame to seek to, clamped to the length of the movie
+ * @return True if a movie is played back
+ */
+bool Seek(u32 frame);
+
+/**
+ * Gets the number of frames recorded or played back so far
+ * @return Frame number, 0 if no movie is recorded or played
+ */
+u32 GetFrame();
+
+/// Tells whether a movie is recorded or played back
+bool IsActive();
+
+/**
+ * Records or plays back the pad state of a frame, called once per vertical blank
+ * @param pad_state Pad state from the frontend
+ * @return Pad state the application is to see
+ */
+u32 OnFrame(u32 pad_state);
+
+/**
+ * Writes the keyframe due while recording, and stops an unthrottled seek at its frame. Called
+ * between two CPU slices.
+ * @return True if a seek just reached its frame
+ */
+bool Update();
+
+/// Stops recording or playing back the movie, writing the rest of a recording
+void Stop();
+
+/// Shutdown the movie module
+void Shutdown();
+
+} // namespace
@@ -0,0 +1,512 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/log.h"
+
+#include "core/mem_map.h"
+#include "core/hw/aes_keys.h"
+#include "core/ncch/ncch_reader.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// NCCH header, at the start of the container
+struct NCCHReader::Header {
+    u8  signature[0x100];
+    u32 magic;
+    u32 content_size;
+    u8  partition_id[8];
+    u16 maker_code;
+    u16 version;
+    u8  reserved_0[4];
+    u8  program_id[8];
+    u8  reserved_1[0x10];
+    u8  logo_region_hash[0x20];
+    u8  product_code[0x10];
+    u8  extended_header_hash[0x20];
+    u32 extended_header_size;
+    u8  reserved_2[4];
+    u8  flags[8];                   ///< Media unit size shift at 6, crypto at 3 and 7
+    u32 plain_region_offset;        ///< Offsets and sizes from here on are in media units
+    u32 plain_region_size;
+    u32 logo_region_offset;
+    u32 logo_region_size;
+    u32 exefs_offset;
+    u32 exefs_size;
+    u32 exefs_hash_region_size;
+    u8  reserved_3[4];
+    u32 romfs_offset;
+    u32 romfs_size;
+    u32 romfs_hash_region_size;
+    u8  reserved_4[4];
+    u8  exefs_super_block_hash[0x20];
+    u8  romfs_super_block_hash[0x20];
+};
+
+/// Code set info, at the start of the exheader following the NCCH header
+struct NCCHReader::CodeSetInfo {
+    struct Segment {
+        u32 address;
+        u32 num_max_pages;
+        u32 code_size;
+    };
+
+    u8      name[8];
+    u8      reserved_0[5];
+    u8      flags;                  ///< Bit 0 set if ExeFS:/.code is compressed
+    u16     remaster_version;
+    Segment text;
+    u32     stack_size;
+    Segment ro;
+    u8      reserved_1[4];
+    Segment data;
+    u32     bss_size;
+};
+
+namespace {
+
+enum {
+    EXHEADER_SIZE       = 0x800,
+    NCSD_PARTITIONS     = 0x120,    ///< Offset of the partition table in NCSD headers
+    NCSD_FLAGS          = 0x188,    ///< Offset of the flags in NCSD headers
+    EXEFS_HEADER_SIZE   = 0x200,    ///< Sections follow the ExeFS header
+    EXEFS_MAX_SECTIONS  = 10,
+
+    FLAG_CRYPTO_METHOD  = 3,        ///< Index of the secondary key in the flags
+    FLAG_CRYPTO         = 7,        ///< Index of the crypto bits in the flags
+    CRYPTO_FIXED_KEY    = 1 << 0,
+    CRYPTO_NONE         = 1 << 2,
+    CRYPTO_SEED         = 1 << 5,
+
+    CTR_EXHEADER        = 1,        ///< Types of the regions, in their counters
+    CTR_EXEFS           = 2,
+    CTR_ROMFS           = 3,
+};
+
+/// Entry of the section table at the start of the ExeFS header
+struct ExeFSSection {
+    char    name[8];                ///< Not null terminated when 8 characters long
+    u32     offset;                 ///< From the end of the ExeFS header, in bytes
+    u32     size;
+};
+
+/**
+ * Reads a little endian word of an image
+ * @param data Image
+ * @param offset Offset of the word
+ * @return The word
+ */
+u32 Read32(const u8* data, u64 offset) {
+    u32 value;
+    memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+/**
+ * Gets the size ExeFS:/.code decompresses to from its footer
+ * @param src Compressed code
+ * @param src_size Size of the compressed code in bytes
+ * @return Size of the decompressed code in bytes, 0 if the footer is broken
+ */
+u32 GetDecompressedCodeSize(const u8* src, u32 src_size) {
+    if (src_size < 8) {
+        return 0;
+    }
+    return src_size + Read32(src, src_size - 4);
+}
+
+/**
+ * Decompresses ExeFS:/.code. It is compressed with LZSS backwards from its end, so that it can be
+ * decompressed in place: the footer tells where the compressed data starts and ends, and anything
+ * before the start is stored as is. The output is written backwards from its end too.
+ * @param src Compressed code
+ * @param src_size Size of the compressed code in bytes
+ * @param dst Receives the decompressed code
+ * @param dst_size Size of the decompressed code in bytes, from GetDecompressedCodeSize
+ * @return True on success, false if the code is broken
+ */
+bool DecompressCode(const u8* src, u32 src_size, u8* dst, u32 dst_size) {
+    const u32 bounds = Read32(src, src_size - 8);
+    const u32 footer_size = bounds >> 24;
+    const u32 compressed_size = bounds & 0xFFFFFF;
+    if (footer_size < 8 || footer_size > compressed_size || compressed_size > src_size) {
+        return false;
+    }
+    u32 in = src_size - footer_size;
+    const u32 in_end = src_size - compressed_size;
+    u32 out = dst_size;
+    memcpy(dst, src, in_end);
+
+    while (in > in_end) {
+        u8 control = src[--in];
+        for (int i = 0; i < 8 && in > in_end; i++, control <<= 1) {
+            if ((control & 0x80) == 0) {
+                if (out == in_end) {
+                    return false;
+                }
+                dst[--out] = src[--in];
+                continue;
+            }
+            // Back reference, 4 bits of length and 12 bits of distance from the output written
+            if (in - in_end < 2) {
+                return false;
+            }
+            in -= 2;
+            const u32 pair = src[in] | (src[in + 1] << 8);
+            const u32 length = (pair >> 12) + 3;
+            const u32 distance = (pair & 0xFFF) + 3;
+            if (length > out - in_end || out - 1 + distance >= dst_size) {
+                return false;
+            }
+            out -= length;
+            if (distance >= length) {
+                memcpy(dst + out, dst + out + distance, length);
+            } else {
+                // Overlaps the bytes it writes, meant to repeat them
+                for (u32 j = length; j-- > 0;) {
+                    dst[out + j] = dst[out + j + distance];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Parses an NCCH container, or the NCCH in the first partition of an NCSD image
+ * @param data Image, must outlive the reader
+ * @param size Size of the image in bytes
+ * @param image_size Size of the whole image when data only holds its start, 0 if it holds all
+ *                   of it. Everything but the RomFS must then be there, see GetHeadSize.
+ */
+NCCHReader::NCCHReader(const u8* data, u64 size, u64 image_size) : m_data(data), m_size(size),
+    m_container_size(image_size != 0 ? image_size : size), m_offset(0),
+    m_head_size(sizeof(Header) + EXHEADER_SIZE), m_header(nullptr), m_code_set_info(nullptr),
+    m_media_unit(0x200), m_encrypted(false) {
+
+    static_assert(sizeof(Header) == 0x200, "NCCH header has the wrong size");
+    static_assert(sizeof(CodeSetInfo) == 0x40, "code set info has the wrong size");
+
+    if (m_container_size < m_head_size) {
+        ERROR_LOG(LOADER, "image is too small to be an NCCH");
+        return;
+    }
+    if (m_size < m_head_size) {
+        return;
+    }
+    if (Read32(m_data, MAGIC_OFFSET) == NCSD_MAGIC) {
+        // The executable content is the first partition
+        const u32 unit = 0x200 << (m_data[NCSD_FLAGS + 6] & 0xF);
+        const u64 offset = (u64)Read32(m_data, NCSD_PARTITIONS) * unit;
+        const u64 partition_size = (u64)Read32(m_data, NCSD_PARTITIONS + 4) * unit;
+        if (offset + partition_size > m_container_size ||
+            partition_size < sizeof(Header) + EXHEADER_SIZE) {
+
+            ERROR_LOG(LOADER, "NCSD has no executable partition");
+            return;
+        }
+        m_offset = offset;
+        m_head_size = offset + sizeof(Header) + EXHEADER_SIZE;
+        if (m_size < m_head_size) {
+            return;
+        }
+        m_data += offset;
+        m_size = std::min(m_size - offset, partition_size);
+        m_container_size = partition_size;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(m_data);
+    if (header->magic != NCCH_MAGIC) {
+        ERROR_LOG(LOADER, "image isn't an NCCH");
+        return;
+    }
+    if (header->extended_header_size < sizeof(CodeSetInfo)) {
+        ERROR_LOG(LOADER, "NCCH has no exheader");
+        return;
+    }
+    m_media_unit = 0x200 << (header->flags[6] & 0xF);
+    m_head_size = std::max(m_head_size, m_offset +
+        ((u64)header->exefs_offset + header->exefs_size) * m_media_unit);
+    m_header = header;
+    m_code_set_info = reinterpret_cast<const CodeSetInfo*>(m_data + sizeof(Header));
+
+    m_encrypted = (header->flags[FLAG_CRYPTO] & CRYPTO_NONE) == 0;
+    if (m_encrypted) {
+        if (!SetUpKeys()) {
+            m_header = nullptr;
+            return;
+        }
+        // Only the code set info of the exheader is needed
+        static_assert(sizeof(m_code_set_info_data) == sizeof(CodeSetInfo),
+            "code set info doesn't fit its copy");
+        u8 ctr[Common::AES128::BLOCK_SIZE];
+        MakeCounter(CTR_EXHEADER, sizeof(Header), ctr);
+        memcpy(m_code_set_info_data, m_code_set_info, sizeof(CodeSetInfo));
+        m_primary_key.TransformCTR((u8*)m_code_set_info_data, sizeof(CodeSetInfo), ctr);
+        m_code_set_info = reinterpret_cast<const CodeSetInfo*>(m_code_set_info_data);
+    }
+}
+
+/**
+ * Sets up the keys of an encrypted container from its header
+ * @return True on success, false if they aren't in the keys file or the crypto is unsupported
+ */
+bool NCCHReader::SetUpKeys() {
+    const u8 crypto = m_header->flags[FLAG_CRYPTO];
+    if (crypto & CRYPTO_SEED) {
+        ERROR_LOG(LOADER, "NCCH is encrypted with a seed, the image must be decrypted first");
+        return false;
+    }
+    if (crypto & CRYPTO_FIXED_KEY) {
+        // Applications have a zero key, system titles a fixed key of the system
+        if (m_header->program_id[4] & 0x10) {
+            ERROR_LOG(LOADER, "NCCH is encrypted with the system fixed key, unsupported");
+            return false;
+        }
+        const u8 zero_key[AESKeys::KEY_SIZE] = {};
+        m_primary_key.SetKey(zero_key);
+        m_secondary_key.SetKey(zero_key);
+        return true;
+    }
+
+    int secondary_slot;
+    switch (m_header->flags[FLAG_CRYPTO_METHOD]) {
+    case 0x00:  secondary_slot = AESKeys::SLOT_NCCH;     break;
+    case 0x01:  secondary_slot = AESKeys::SLOT_NCCH_7X;  break;
+    case 0x0A:  secondary_slot = AESKeys::SLOT_NCCH_93;  break;
+    case 0x0B:  secondary_slot = AESKeys::SLOT_NCCH_96;  break;
+    default:
+        ERROR_LOG(LOADER, "NCCH is encrypted with unknown method 0x%02X",
+            m_header->flags[FLAG_CRYPTO_METHOD]);
+        return false;
+    }
+
+    // The KeyY of both keys is the start of the signature
+    u8 primary[AESKeys::KEY_SIZE], secondary[AESKeys::KEY_SIZE];
+    if (!AESKeys::DeriveNormalKey(AESKeys::SLOT_NCCH, m_header->signature, primary) ||
+        !AESKeys::DeriveNormalKey(secondary_slot, m_header->signature, secondary)) {
+
+        ERROR_LOG(LOADER, "NCCH is encrypted and the keys file has no KeyX of slots 0x%02X and "
+            "0x%02X, the image must be decrypted first", AESKeys::SLOT_NCCH, secondary_slot);
+        return false;
+    }
+    m_primary_key.SetKey(primary);
+    m_secondary_key.SetKey(secondary);
+    return true;
+}
+
+/**
+ * Makes the counter of a region of the container
+ * @param type 1 for the exheader, 2 for the ExeFS, 3 for the RomFS
+ * @param offset Offset of the region in the container in bytes
+ * @param ctr Receives the counter
+ */
+void NCCHReader::MakeCounter(u8 type, u64 offset, u8 ctr[Common::AES128::BLOCK_SIZE]) const {
+    memset(ctr, 0, Common::AES128::BLOCK_SIZE);
+    if (m_header->version == 1) {
+        // Partition ID as is, then the big endian offset of the region
+        memcpy(ctr, m_header->partition_id, 8);
+        for (int i = 0; i < 4; i++) {
+            ctr[12 + i] = (u8)(offset >> (24 - i * 8));
+        }
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        ctr[i] = m_header->partition_id[7 - i];
+    }
+    ctr[8] = type;
+}
+
+/**
+ * Gets a region of the container from its offset and size in media units
+ * @param offset Offset of the region in media units
+ * @param size Size of the region in media units
+ * @return Pointer to the region, nullptr if it lies out of the image
+ */
+const u8* NCCHReader::GetRegion(u32 offset, u32 size) const {
+    if (size == 0 || ((u64)offset + size) * m_media_unit > m_size) {
+        return nullptr;
+    }
+    return m_data + (u64)offset * m_media_unit;
+}
+
+/**
+ * Finds a section of the ExeFS
+ * @param name Name of the section
+ * @param offset Receives the offset of the section from the start of the ExeFS in bytes
+ * @param size Receives the size of the section in bytes
+ * @return True on success, false if the ExeFS has none of the name
+ */
+bool NCCHReader::FindExeFSSection(const char* name, u32* offset, u32* size) const {
+    const u8* exefs = GetRegion(m_header->exefs_offset, m_header->exefs_size);
+    if (exefs == nullptr) {
+        return false;
+    }
+    ExeFSSection sections[EXEFS_MAX_SECTIONS];
+    memcpy(sections, exefs, sizeof(sections));
+    if (m_encrypted) {
+        u8 ctr[Common::AES128::BLOCK_SIZE];
+        MakeCounter(CTR_EXEFS, (u64)m_header->exefs_offset * m_media_unit, ctr);
+        m_primary_key.TransformCTR((u8*)sections, sizeof(sections), ctr);
+    }
+
+    const u64 exefs_size = (u64)m_header->exefs_size * m_media_unit;
+    for (int i = 0; i < EXEFS_MAX_SECTIONS; i++) {
+        const ExeFSSection& section = sections[i];
+        if (strncmp(section.name, name, sizeof(section.name)) != 0) {
+            continue;
+        }
+        if (EXEFS_HEADER_SIZE + (u64)section.offset + section.size > exefs_size) {
+            ERROR_LOG(LOADER, "ExeFS:/%s lies out of the ExeFS", name);
+            return false;
+        }
+        *offset = EXEFS_HEADER_SIZE + section.offset;
+        *size = section.size;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Gets a section of the ExeFS, pointing into the image
+ * @param name Name of the section, e.g. ".code" or "icon"
+ * @param size Receives the size of the section in bytes
+ * @return Pointer to the section, nullptr if the ExeFS has none of the name or is encrypted
+ */
+const u8* NCCHReader::GetExeFSSection(const char* name, u32* size) const {
+    u32 offset;
+    if (m_encrypted || !FindExeFSSection(name, &offset, size)) {
+        return nullptr;
+    }
+    return m_data + (u64)m_header->exefs_offset * m_media_unit + offset;
+}
+
+/**
+ * Reads a section of the ExeFS, decrypting it if the container is encrypted
+ * @param name Name of the section, e.g. ".code" or "icon"
+ * @param data Receives the section
+ * @return True on success, false if the ExeFS has none of the name
+ */
+bool NCCHReader::ReadExeFSSection(const char* name, std::vector<u8>& data) const {
+    u32 offset, size;
+    if (!FindExeFSSection(name, &offset, &size)) {
+        return false;
+    }
+    const u64 exefs_offset = (u64)m_header->exefs_offset * m_media_unit;
+    data.assign(m_data + exefs_offset + offset, m_data + exefs_offset + offset + size);
+    if (m_encrypted) {
+        // The counter runs over the whole ExeFS, only the code has the secondary key
+        u8 ctr[Common::AES128::BLOCK_SIZE];
+        MakeCounter(CTR_EXEFS, exefs_offset, ctr);
+        const Common::AES128& key = (strcmp(name, ".code") == 0) ? m_secondary_key :
+            m_primary_key;
+        key.TransformCTR(data.data(), size, ctr, offset);
+    }
+    return true;
+}
+
+/**
+ * Gets the RomFS, pointing into the image
+ * @param size Receives the size of the RomFS in bytes
+ * @return Pointer to the RomFS, nullptr if the container has none
+ */
+const u8* NCCHReader::GetRomFS(u64* size) const {
+    *size = (u64)m_header->romfs_size * m_media_unit;
+    return GetRegion(m_header->romfs_offset, m_header->romfs_size);
+}
+
+/**
+ * Gets the key and counter the RomFS is encrypted with
+ * @param aes Receives the key
+ * @param ctr Receives the counter of the start of the RomFS
+ * @return False if the container isn't encrypted
+ */
+bool NCCHReader::GetRomFSCipher(Common::AES128* aes, u8 ctr[Common::AES128::BLOCK_SIZE]) const {
+    if (!m_encrypted) {
+        return false;
+    }
+    *aes = m_secondary_key;
+    MakeCounter(CTR_ROMFS, (u64)m_header->romfs_offset * m_media_unit, ctr);
+    return true;
+}
+
+/**
+ * Gets where the RomFS lies in the image, for images of which the reader only has the start
+ * @param offset Receives the offset of the RomFS from the start of the image in bytes
+ * @param size Receives the size of the RomFS in bytes
+ * @return True on success, false if the container has no RomFS
+ */
+bool NCCHReader::GetRomFSRange(u64* offset, u64* size) const {
+    const u64 start = (u64)m_header->romfs_offset * m_media_unit;
+    *size = (u64)m_header->romfs_size * m_media_unit;
+    if (*size == 0 || start + *size > m_container_size) {
+        return false;
+    }
+    *offset = m_offset + start;
+    return true;
+}
+
+/// Gets the address both the code and execution start at
+u32 NCCHReader::GetEntryPoint() const {
+    return m_code_set_info->text.address;
+}
+
+/// Gets the program ID of the header, which tells titles apart
+u64 NCCHReader::GetProgramId() const {
+    u64 program_id;
+    memcpy(&program_id, m_header->program_id, sizeof(program_id));
+    return program_id;
+}
+
+/**
+ * Loads ExeFS:/.code to the code region, decompressing it if the exheader says so
+ * @return True on success
+ */
+bool NCCHReader::LoadCode() const {
+    u32 size;
+    const u8* code = GetExeFSSection(".code", &size);
+    std::vector<u8> decrypted;
+    if (m_encrypted && ReadExeFSSection(".code", decrypted)) {
+        code = decrypted.data();
+        size = (u32)decrypted.size();
+    }
+    if (code == nullptr) {
+        ERROR_LOG(LOADER, "NCCH has no ExeFS:/.code");
+        return false;
+    }
+    const u32 address = GetEntryPoint();
+    if (address < Memory::EXEFS_CODE_VADDR || address >= Memory::EXEFS_CODE_VADDR_END) {
+        ERROR_LOG(LOADER, "NCCH code at 0x%08X is out of the code region", address);
+        return false;
+    }
+    // Decompressed straight to guest memory, the compressed code is only read from the image or
+    // its decrypted copy
+    u8* dst = Memory::g_exefs_code + (address - Memory::EXEFS_CODE_VADDR);
+    const u32 capacity = Memory::EXEFS_CODE_VADDR_END - address;
+
+    if ((m_code_set_info->flags & 1) == 0) {
+        if (size > capacity) {
+            ERROR_LOG(LOADER, "NCCH code of 0x%X bytes doesn't fit the code region", size);
+            return false;
+        }
+        memcpy(dst, code, size);
+        return true;
+    }
+    const u32 dst_size = GetDecompressedCodeSize(code, size);
+    if (dst_size == 0 || dst_size > capacity) {
+        ERROR_LOG(LOADER, "NCCH code of 0x%X bytes doesn't fit the code region", dst_size);
+        return false;
+    }
+    if (!DecompressCode(code, size, dst, dst_size)) {
+        ERROR_LOG(LOADER, "NCCH code is broken, couldn't decompress it");
+        return false;
+    }
+    INFO_LOG(LOADER, "decompressed NCCH code from 0x%X to 0x%X bytes", size, dst_size);
+    return true;
+}
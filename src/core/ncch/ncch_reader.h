@@ -0,0 +1,154 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common.h"
+#include "common/crypto.h"
+
+/**
+ * Reader of NCCH containers (CXI), on their own or as the first partition of an NCSD image (CCI,
+ * ".3ds"). The image is parsed in place, typically from a file mapping, so only the headers and
+ * the sections read are ever paged in: ExeFS:/.code when the application is loaded, and the RomFS
+ * as the application reads it. Encrypted containers are decrypted as they are read, with the keys
+ * of the keys file (see core/hw/aes_keys.h), so they load as decrypted ones do.
+ */
+class NCCHReader : NonCopyable {
+public:
+    enum {
+        NCCH_MAGIC          = 0x4843434E,   ///< "NCCH"
+        NCSD_MAGIC          = 0x4453434E,   ///< "NCSD"
+        MAGIC_OFFSET        = 0x100,        ///< Of the magic in both NCCH and NCSD headers
+    };
+
+    /**
+     * Parses an NCCH container, or the NCCH in the first partition of an NCSD image
+     * @param data Image, must outlive the reader
+     * @param size Size of the image in bytes
+     * @param image_size Size of the whole image when data only holds its start, 0 if it holds all
+     *                   of it. Everything but the RomFS must then be there, see GetHeadSize.
+     */
+    NCCHReader(const u8* data, u64 size, u64 image_size = 0);
+
+    /// Whether the image is an NCCH container the reader can load
+    bool IsValid() const {
+        return m_header != nullptr;
+    }
+
+    /**
+     * Gets how much of the start of the image the reader needs for everything but the RomFS. When
+     * given less it may only have got far enough to tell how much more it needs.
+     * @return Size in bytes
+     */
+    u64 GetHeadSize() const {
+        return m_head_size;
+    }
+
+    /// Whether the container is encrypted, its ExeFS and RomFS then have to be read decrypted
+    bool IsEncrypted() const {
+        return m_encrypted;
+    }
+
+    /**
+     * Gets a section of the ExeFS, pointing into the image
+     * @param name Name of the section, e.g. ".code" or "icon"
+     * @param size Receives the size of the section in bytes
+     * @return Pointer to the section, nullptr if the ExeFS has none of the name or is encrypted
+     */
+    const u8* GetExeFSSection(const char* name, u32* size) const;
+
+    /**
+     * Reads a section of the ExeFS, decrypting it if the container is encrypted
+     * @param name Name of the section, e.g. ".code" or "icon"
+     * @param data Receives the section
+     * @return True on success, false if the ExeFS has none of the name
+     */
+    bool ReadExeFSSection(const char* name, std::vector<u8>& data) const;
+
+    /**
+     * Gets the RomFS, pointing into the image
+     * @param size Receives the size of the RomFS in bytes
+     * @return Pointer to the RomFS, nullptr if the container has none. Still encrypted if the
+     *         container is, see GetRomFSCipher.
+     */
+    const u8* GetRomFS(u64* size) const;
+
+    /**
+     * Gets the key and counter the RomFS is encrypted with
+     * @param aes Receives the key
+     * @param ctr Receives the counter of the start of the RomFS
+     * @return False if the container isn't encrypted
+     */
+    bool GetRomFSCipher(Common::AES128* aes, u8 ctr[Common::AES128::BLOCK_SIZE]) const;
+
+    /**
+     * Gets where the RomFS lies in the image, for images of which the reader only has the start
+     * @param offset Receives the offset of the RomFS from the start of the image in bytes
+     * @param size Receives the size of the RomFS in bytes
+     * @return True on success, false if the container has no RomFS
+     */
+    bool GetRomFSRange(u64* offset, u64* size) const;
+
+    /// Gets the address both the code and execution start at
+    u32 GetEntryPoint() const;
+
+    /// Gets the program ID of the header, which tells titles apart
+    u64 GetProgramId() const;
+
+    /**
+     * Loads ExeFS:/.code to the code region, decompressing it if the exheader says so
+     * @return True on success
+     */
+    bool LoadCode() const;
+
+private:
+    struct Header;
+    struct CodeSetInfo;
+
+    /**
+     * Gets a region of the container from its offset and size in media units
+     * @param offset Offset of the region in media units
+     * @param size Size of the region in media units
+     * @return Pointer to the region, nullptr if it lies out of the image
+     */
+    const u8* GetRegion(u32 offset, u32 size) const;
+
+    /**
+     * Finds a section of the ExeFS
+     * @param name Name of the section
+     * @param offset Receives the offset of the section from the start of the ExeFS in bytes
+     * @param size Receives the size of the section in bytes
+     * @return True on success, false if the ExeFS has none of the name
+     */
+    bool FindExeFSSection(const char* name, u32* offset, u32* size) const;
+
+    /**
+     * Sets up the keys of an encrypted container from its header
+     * @return True on success, false if they aren't in the keys file or the crypto is unsupported
+     */
+    bool SetUpKeys();
+
+    /**
+     * Makes the counter of a region of the container
+     * @param type 1 for the exheader, 2 for the ExeFS, 3 for the RomFS
+     * @param offset Offset of the region in the container in bytes
+     * @param ctr Receives the counter
+     */
+    void MakeCounter(u8 type, u64 offset, u8 ctr[Common::AES128::BLOCK_SIZE]) const;
+
+    const u8*           m_data;             ///< Start of the NCCH container
+    u64                 m_size;             ///< Size of what the reader has of it in bytes
+    u64                 m_container_size;   ///< Size of the NCCH container in bytes
+    u64                 m_offset;           ///< Of the NCCH container in the image
+    u64                 m_head_size;        ///< See GetHeadSize
+    const Header*       m_header;           ///< nullptr if the image isn't a plain NCCH
+    const CodeSetInfo*  m_code_set_info;    ///< From the exheader
+    u32                 m_media_unit;       ///< Size of a media unit in bytes
+    bool                m_encrypted;
+    Common::AES128      m_primary_key;      ///< Of the exheader, ExeFS header and ExeFS data
+    Common::AES128      m_secondary_key;    ///< Of ExeFS:/.code and the RomFS
+    u32                 m_code_set_info_data[0x10]; ///< Code set info if decrypted
+};
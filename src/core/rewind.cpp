@@ -0,0 +1,332 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
+
+#include "video_core/rasterizer.h"
+
+namespace Rewind {
+
+namespace {
+
+enum {
+    INTERVAL_FRAMES     = 60,                   ///< Emulated frames between two snapshots
+    RECENT_FRAMES       = 20,                   ///< Younger snapshots are skipped by StepBack
+    MAX_BYTES           = 64 * 1024 * 1024,     ///< Budget of the ring, the shadow copy aside
+
+    MIN_ZERO_RUN        = 4,                    ///< Shorter runs of zeroes are kept in literals
+    MAX_RUN             = 0xFFFF,
+};
+
+struct Snapshot {
+    u64             ticks;          ///< CoreTiming ticks the snapshot was taken at
+    u32             state_size;     ///< Size of the module states before encoding
+    std::vector<u8> state;          ///< Module states, encoded
+    std::vector<u8> delta;          ///< Page indices, each followed by the encoded XOR of the
+                                    ///< page before and at the snapshot
+};
+
+std::atomic<bool>   g_enabled(false);
+std::deque<Snapshot> g_snapshots;               ///< Oldest first
+size_t              g_bytes = 0;                ///< Size of the data of all the snapshots
+std::vector<u8*>    g_shadow;                   ///< Pages as of the last snapshot by index,
+                                                ///< nullptr for all-zero pages
+u32                 g_first_page[SaveState::NUM_REGIONS];   ///< Index of each region's first page
+
+/**
+ * Appends data to a buffer as runs of zeroes, each followed by a run of literal bytes
+ * @param data Data to encode
+ * @param size Size of the data in bytes
+ * @param out Buffer to append to
+ */
+void EncodeZeroRuns(const u8* data, u32 size, std::vector<u8>& out) {
+    u32 i = 0;
+    while (i < size) {
+        u16 zeros = 0;
+        while (i < size && data[i] == 0 && zeros < MAX_RUN) {
+            zeros++;
+            i++;
+        }
+        const u32 start = i;
+        while (i < size && i - start < MAX_RUN) {
+            if (data[i] == 0 && (size - i < MIN_ZERO_RUN ||
+                (data[i + 1] | data[i + 2] | data[i + 3]) == 0)) {
+                break;
+            }
+            i++;
+        }
+        const u16 literals = (u16)(i - start);
+
+        const size_t pos = out.size();
+        out.resize(pos + 4 + literals);
+        memcpy(&out[pos], &zeros, 2);
+        memcpy(&out[pos + 2], &literals, 2);
+        memcpy(&out[pos + 4], data + start, literals);
+    }
+}
+
+/**
+ * Decodes runs of zeroes and literal bytes encoded by EncodeZeroRuns
+ * @param in Encoded data
+ * @param data Receives the data, or is XORed with it
+ * @param size Size of the data in bytes
+ * @param xor_data Whether to XOR the data in place rather than overwrite it
+ * @return Pointer past the encoded data
+ */
+const u8* DecodeZeroRuns(const u8* in, u8* data, u32 size, bool xor_data) {
+    u32 i = 0;
+    while (i < size) {
+        u16 zeros, literals;
+        memcpy(&zeros, in, 2);
+        memcpy(&literals, in + 2, 2);
+        in += 4;
+        if (!xor_data) {
+            memset(data + i, 0, zeros);
+        }
+        i += zeros;
+        if (xor_data) {
+            for (u32 j = 0; j < literals; j++) {
+                data[i + j] ^= in[j];
+            }
+        } else {
+            memcpy(data + i, in, literals);
+        }
+        i += literals;
+        in += literals;
+    }
+    return in;
+}
+
+/// Frees the pages of the shadow copy
+void FreeShadow() {
+    for (u8*& page : g_shadow) {
+        delete[] page;
+        page = nullptr;
+    }
+}
+
+/// Copies all of guest memory to the shadow copy, before the first snapshot of the ring
+void FillShadow() {
+    if (g_shadow.empty()) {
+        u32 num_pages = 0;
+        for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+            g_first_page[i] = num_pages;
+            num_pages += SaveState::g_regions[i].size / Memory::PAGE_SIZE;
+        }
+        g_shadow.resize(num_pages, nullptr);
+    }
+    FreeShadow();
+
+    for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+        const SaveState::Region& region = SaveState::g_regions[i];
+        for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+            const u8* memory = *region.pointer + offset;
+            if (!SaveState::IsZeroPage(memory)) {
+                u8* page = new u8[Memory::PAGE_SIZE];
+                memcpy(page, memory, Memory::PAGE_SIZE);
+                g_shadow[g_first_page[i] + offset / Memory::PAGE_SIZE] = page;
+            }
+        }
+    }
+}
+
+/// Drops the snapshots of the ring
+void DropSnapshots() {
+    g_snapshots.clear();
+    g_bytes = 0;
+}
+
+/// Takes a snapshot, encoding the pages written since the last one against the shadow copy
+void TakeSnapshot() {
+    SaveState::FlushMemory();
+
+    Snapshot snapshot;
+    snapshot.ticks = CoreTiming::GetTicks();
+
+    if (g_snapshots.empty()) {
+        FillShadow();
+    } else {
+        u64 words[Memory::PAGE_SIZE / 8];
+        u8* page = (u8*)words;
+        for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+            const SaveState::Region& region = SaveState::g_regions[i];
+            for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+                if (!SaveState::IsPageWritten(region, offset, Memory::DIRTY_REWIND)) {
+                    continue;
+                }
+                const u8* memory = *region.pointer + offset;
+                const u32 index = g_first_page[i] + offset / Memory::PAGE_SIZE;
+                u8*& shadow = g_shadow[index];
+                if (shadow == nullptr) {
+                    if (SaveState::IsZeroPage(memory)) {
+                        continue;
+                    }
+                    shadow = new u8[Memory::PAGE_SIZE]();
+                }
+                for (u32 j = 0; j < Memory::PAGE_SIZE; j++) {
+                    page[j] = shadow[j] ^ memory[j];
+                }
+                // Written back with the same contents
+                if (SaveState::IsZeroPage(page)) {
+                    continue;
+                }
+
+                const size_t pos = snapshot.delta.size();
+                snapshot.delta.resize(pos + 4);
+                memcpy(&snapshot.delta[pos], &index, 4);
+                EncodeZeroRuns(page, Memory::PAGE_SIZE, snapshot.delta);
+                memcpy(shadow, memory, Memory::PAGE_SIZE);
+            }
+        }
+    }
+    SaveState::ClearWritten(Memory::DIRTY_REWIND);
+
+    u8* ptr = NULL;
+    PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+    SaveState::DoState(p);
+    std::vector<u8> state((size_t)ptr);
+    ptr = state.data();
+    p.SetMode(PointerWrap::MODE_WRITE);
+    SaveState::DoState(p);
+    snapshot.state_size = (u32)state.size();
+    EncodeZeroRuns(state.data(), snapshot.state_size, snapshot.state);
+
+    g_bytes += snapshot.state.size() + snapshot.delta.size();
+    g_snapshots.push_back(std::move(snapshot));
+    while (g_bytes > MAX_BYTES && g_snapshots.size() > 1) {
+        g_bytes -= g_snapshots.front().state.size() + g_snapshots.front().delta.size();
+        g_snapshots.pop_front();
+    }
+}
+
+/**
+ * Converts a number of emulated frames to CoreTiming ticks
+ * @param frames Number of frames at 60 per second
+ * @return Number of ticks
+ */
+u64 FramesToTicks(int frames) {
+    return (u64)g_clock_rate_arm11 / 60 * frames;
+}
+
+} // namespace
+
+/**
+ * Turns the rewind ring on or off, off drops its snapshots. Takes effect at the next Update.
+ * @param enabled Whether to take snapshots
+ * @note This function is thread-safe
+ */
+void SetEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/// Takes a snapshot when one is due, called between two CPU slices
+void Update() {
+    if (!g_enabled.load(std::memory_order_relaxed)) {
+        if (!g_snapshots.empty()) {
+            Shutdown();
+        }
+        return;
+    }
+    if (g_snapshots.empty() || CoreTiming::GetTicks() - g_snapshots.back().ticks >=
+        FramesToTicks(INTERVAL_FRAMES)) {
+        TakeSnapshot();
+    }
+}
+
+/**
+ * Goes back to the last snapshot, or to the one before if the last one was taken moments ago so
+ * that stepping back repeatedly goes further back. Must be called between two CPU slices.
+ * @return True on success, false if there is no snapshot
+ */
+bool StepBack() {
+    if (g_snapshots.empty()) {
+        return false;
+    }
+
+    // Host framebuffers go to guest memory first, so that they aren't written back over it later
+    SaveState::FlushMemory();
+
+    // Back to the memory of the last snapshot
+    for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+        const SaveState::Region& region = SaveState::g_regions[i];
+        for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+            if (!SaveState::IsPageWritten(region, offset, Memory::DIRTY_REWIND)) {
+                continue;
+            }
+            const u8* shadow = g_shadow[g_first_page[i] + offset / Memory::PAGE_SIZE];
+            if (shadow != nullptr) {
+                memcpy(*region.pointer + offset, shadow, Memory::PAGE_SIZE);
+            } else {
+                memset(*region.pointer + offset, 0, Memory::PAGE_SIZE);
+            }
+            SaveState::MarkPageWritten(region, offset, Memory::DIRTY_ALL);
+        }
+    }
+
+    // Then undo the writes of the last snapshot to reach the one before
+    if (g_snapshots.size() > 1 && CoreTiming::GetTicks() - g_snapshots.back().ticks <
+        FramesToTicks(RECENT_FRAMES)) {
+        const Snapshot& last = g_snapshots.back();
+        const u8* in = last.delta.data();
+        const u8* end = in + last.delta.size();
+        while (in < end) {
+            u32 index;
+            memcpy(&index, in, 4);
+            in += 4;
+
+            int i = SaveState::NUM_REGIONS - 1;
+            while (index < g_first_page[i]) {
+                i--;
+            }
+            const SaveState::Region& region = SaveState::g_regions[i];
+            const u32 offset = (index - g_first_page[i]) * Memory::PAGE_SIZE;
+            u8*& shadow = g_shadow[index];
+            if (shadow == nullptr) {
+                shadow = new u8[Memory::PAGE_SIZE]();
+            }
+            in = DecodeZeroRuns(in, shadow, Memory::PAGE_SIZE, true);
+            memcpy(*region.pointer + offset, shadow, Memory::PAGE_SIZE);
+            SaveState::MarkPageWritten(region, offset, Memory::DIRTY_ALL);
+        }
+        g_bytes -= last.state.size() + last.delta.size();
+        g_snapshots.pop_back();
+    }
+
+    const Snapshot& snapshot = g_snapshots.back();
+    std::vector<u8> state(snapshot.state_size);
+    DecodeZeroRuns(snapshot.state.data(), state.data(), snapshot.state_size, false);
+    u8* ptr = state.data();
+    PointerWrap p(&ptr, PointerWrap::MODE_READ);
+    SaveState::DoState(p);
+
+    SaveState::ClearWritten(Memory::DIRTY_REWIND);
+    Pica::Rasterizer::InvalidateRegion(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    Pica::Rasterizer::InvalidateRegion(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+    return true;
+}
+
+/// Drops the snapshots, when the state is replaced as a whole e.g. by loading a savestate
+void Reset() {
+    DropSnapshots();
+}
+
+/// Drops the snapshots and frees the shadow copy of guest memory
+void Shutdown() {
+    DropSnapshots();
+    FreeShadow();
+}
+
+} // namespace
@@ -0,0 +1,42 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Ring of snapshots of the emulated system to step back in time. A snapshot is taken every second
+ * of emulated time between two CPU slices and holds the module states plus, for the guest pages
+ * written since the snapshot before it, how to undo those writes: the XOR of the page before and
+ * after, encoded as runs of zeroes and literal bytes. A shadow copy of guest memory as of the last
+ * snapshot, without its all-zero pages, gives the content before. The oldest snapshots are dropped
+ * to keep the ring within a fixed budget.
+ */
+namespace Rewind {
+
+/**
+ * Turns the rewind ring on or off, off drops its snapshots. Takes effect at the next Update.
+ * @param enabled Whether to take snapshots
+ * @note This function is thread-safe
+ */
+void SetEnabled(bool enabled);
+
+/// Takes a snapshot when one is due, called between two CPU slices
+void Update();
+
+/**
+ * Goes back to the last snapshot, or to the one before if the last one was taken moments ago so
+ * that stepping back repeatedly goes further back. Must be called between two CPU slices.
+ * @return True on success, false if there is no snapshot
+ */
+bool StepBack();
+
+/// Drops the snapshots, when the state is replaced as a whole e.g. by loading a savestate
+void Reset();
+
+/// Drops the snapshots and frees the shadow copy of guest memory
+void Shutdown();
+
+} // namespace
@@ -0,0 +1,228 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/gdb_stub.h"
+#include "core/mem_map.h"
+#include "core/movie.h"
+#include "core/run_ahead.h"
+#include "core/savestate.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hw/gpu.h"
+
+#include "video_core/rasterizer.h"
+
+namespace RunAhead {
+
+namespace {
+
+std::atomic<int>    g_frames(0);
+bool                g_running = false;          ///< Whether the shadow copy is of the snapshot
+u64                 g_frame = 0;                ///< Frame count as the frames last ran ahead
+std::vector<u8*>    g_shadow;                   ///< Pages as of the snapshot by index,
+                                                ///< nullptr for all-zero pages
+u32                 g_first_page[SaveState::NUM_REGIONS];   ///< Index of each region's first page
+std::vector<u8>     g_state;                    ///< Module states as of the snapshot
+
+/// Frees the pages of the shadow copy
+void FreeShadow() {
+    for (u8*& page : g_shadow) {
+        delete[] page;
+        page = nullptr;
+    }
+}
+
+/// Copies all of guest memory to the shadow copy, before the first snapshot
+void FillShadow() {
+    if (g_shadow.empty()) {
+        u32 num_pages = 0;
+        for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+            g_first_page[i] = num_pages;
+            num_pages += SaveState::g_regions[i].size / Memory::PAGE_SIZE;
+        }
+        g_shadow.resize(num_pages, nullptr);
+    }
+    FreeShadow();
+
+    for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+        const SaveState::Region& region = SaveState::g_regions[i];
+        for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+            const u8* memory = *region.pointer + offset;
+            if (!SaveState::IsZeroPage(memory)) {
+                u8* page = new u8[Memory::PAGE_SIZE];
+                memcpy(page, memory, Memory::PAGE_SIZE);
+                g_shadow[g_first_page[i] + offset / Memory::PAGE_SIZE] = page;
+            }
+        }
+    }
+}
+
+/// Copies the pages written since the last snapshot to the shadow copy
+void UpdateShadow() {
+    for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+        const SaveState::Region& region = SaveState::g_regions[i];
+        for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+            if (!SaveState::IsPageWritten(region, offset, Memory::DIRTY_RUN_AHEAD)) {
+                continue;
+            }
+            const u8* memory = *region.pointer + offset;
+            u8*& shadow = g_shadow[g_first_page[i] + offset / Memory::PAGE_SIZE];
+            if (SaveState::IsZeroPage(memory)) {
+                delete[] shadow;
+                shadow = nullptr;
+                continue;
+            }
+            if (shadow == nullptr) {
+                shadow = new u8[Memory::PAGE_SIZE];
+            }
+            memcpy(shadow, memory, Memory::PAGE_SIZE);
+        }
+    }
+}
+
+/// Takes the snapshot the frames ahead run from
+void TakeSnapshot() {
+    SaveState::FlushMemory();
+    if (g_running) {
+        UpdateShadow();
+    } else {
+        FillShadow();
+        g_running = true;
+    }
+    SaveState::ClearWritten(Memory::DIRTY_RUN_AHEAD);
+
+    u8* ptr = NULL;
+    PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+    SaveState::DoState(p);
+    g_state.resize((size_t)ptr);
+    ptr = g_state.data();
+    p.SetMode(PointerWrap::MODE_WRITE);
+    SaveState::DoState(p);
+}
+
+/// Goes back to the snapshot, over the pages the frames ahead wrote
+void RestoreSnapshot() {
+    // Host framebuffers go to guest memory first, so that they aren't written back over it later
+    SaveState::FlushMemory();
+
+    // The rasterizer drops what it holds of the pages restored, in runs of physical pages
+    u32 invalid_address = 0;
+    u32 invalid_size = 0;
+    for (int i = 0; i < SaveState::NUM_REGIONS; i++) {
+        const SaveState::Region& region = SaveState::g_regions[i];
+        for (u32 offset = 0; offset < region.size; offset += Memory::PAGE_SIZE) {
+            if (!SaveState::IsPageWritten(region, offset, Memory::DIRTY_RUN_AHEAD)) {
+                continue;
+            }
+            const u8* shadow = g_shadow[g_first_page[i] + offset / Memory::PAGE_SIZE];
+            if (shadow != nullptr) {
+                memcpy(*region.pointer + offset, shadow, Memory::PAGE_SIZE);
+            } else {
+                memset(*region.pointer + offset, 0, Memory::PAGE_SIZE);
+            }
+            // The shadow copy has the page already
+            SaveState::MarkPageWritten(region, offset,
+                Memory::DIRTY_ALL & ~Memory::DIRTY_RUN_AHEAD);
+
+            const u32 address = Memory::PhysicalAddressFromVirtual(region.address + offset);
+            if (address == 0) {
+                continue;
+            }
+            if (invalid_size != 0 && address == invalid_address + invalid_size) {
+                invalid_size += Memory::PAGE_SIZE;
+                continue;
+            }
+            if (invalid_size != 0) {
+                Pica::Rasterizer::InvalidateRegion(invalid_address, invalid_size);
+            }
+            invalid_address = address;
+            invalid_size = Memory::PAGE_SIZE;
+        }
+    }
+    if (invalid_size != 0) {
+        Pica::Rasterizer::InvalidateRegion(invalid_address, invalid_size);
+    }
+    SaveState::ClearWritten(Memory::DIRTY_RUN_AHEAD);
+
+    u8* ptr = g_state.data();
+    PointerWrap p(&ptr, PointerWrap::MODE_READ);
+    SaveState::DoState(p);
+}
+
+} // namespace
+
+/**
+ * Sets the number of frames run ahead, 0 turns run-ahead off and frees the snapshot. Takes effect
+ * at the next Update.
+ * @param frames Number of frames, clamped to MAX_FRAMES
+ * @note This function is thread-safe
+ */
+void SetFrames(int frames) {
+    g_frames.store(std::max(0, std::min(frames, (int)MAX_FRAMES)), std::memory_order_relaxed);
+}
+
+/**
+ * Gets the number of frames run ahead
+ * @return Number of frames, 0 if run-ahead is off
+ */
+int GetFrames() {
+    return g_frames.load(std::memory_order_relaxed);
+}
+
+/**
+ * Runs the frames ahead once per frame that counts, called between two CPU slices
+ * @param run_slice Runs a CPU slice, without the work done between two slices
+ */
+void Update(void (*run_slice)()) {
+    const int frames = g_frames.load(std::memory_order_relaxed);
+    if (frames == 0 || Movie::IsActive() || GDBStub::IsAttached() ||
+        Core::g_breakpoints != NULL) {
+
+        if (g_running) {
+            Shutdown();
+        }
+        return;
+    }
+    // Once per frame that counts, as the first slice after its vertical blank ends
+    if (g_running && GPU::GetFrameCount() == g_frame) {
+        return;
+    }
+    g_frame = GPU::GetFrameCount();
+
+    TakeSnapshot();
+    DSP::SetOutputMuted(true);
+    const u64 start = CoreTiming::GetTicks();
+    for (int i = 1; i <= frames; i++) {
+        GPU::SetFrameOutput(i == frames, false);
+        while (CoreTiming::GetTicks() < start + (u64)GPU::GetFrameCycles() * i) {
+            run_slice();
+        }
+    }
+    RestoreSnapshot();
+    DSP::SetOutputMuted(false);
+    GPU::SetFrameOutput(false, true);
+}
+
+/// Frees the snapshot and has the frames presented again
+void Shutdown() {
+    if (g_running) {
+        GPU::SetFrameOutput(true, true);
+        g_running = false;
+    }
+    FreeShadow();
+    g_shadow.clear();
+    g_state.clear();
+}
+
+} // namespace
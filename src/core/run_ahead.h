@@ -0,0 +1,48 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+/**
+ * Run-ahead, which hides the frames of input lag of the application: after every frame a snapshot
+ * of the emulated system is taken, a number of frames are run ahead with the current input, their
+ * samples muted and only the last one presented, then the snapshot is restored and the emulation
+ * goes on with the frame that counts, which isn't presented. The snapshot holds the module states
+ * and a shadow copy of guest memory, brought up to date with the pages the frame that counts wrote
+ * and restored over the pages the frames ahead wrote, so that it costs little more than the pages
+ * written. Off while a movie is recorded or played and while the application is debugged.
+ *
+ * The frames ahead run again for real, so writes of the application to host files happen more
+ * than once; they are the same writes, in the same order.
+ */
+namespace RunAhead {
+
+enum {
+    MAX_FRAMES = 6,     ///< Most frames run ahead
+};
+
+/**
+ * Sets the number of frames run ahead, 0 turns run-ahead off and frees the snapshot. Takes effect
+ * at the next Update.
+ * @param frames Number of frames, clamped to MAX_FRAMES
+ * @note This function is thread-safe
+ */
+void SetFrames(int frames);
+
+/**
+ * Gets the number of frames run ahead
+ * @return Number of frames, 0 if run-ahead is off
+ */
+int GetFrames();
+
+/**
+ * Runs the frames ahead once per frame that counts, called between two CPU slices
+ * @param run_slice Runs a CPU slice, without the work done between two slices
+ */
+void Update(void (*run_slice)());
+
+/// Frees the snapshot and has the frames presented again
+void Shutdown();
+
+} // namespace
@@ -0,0 +1,713 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/file_util.h"
+#include "common/log.h"
+#include "common/lz4.h"
+#include "common/scm_rev.h"
+#include "common/thread.h"
+#include "common/thread_pool.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
+#include "core/system.h"
+#include "core/hle/async_io.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hw/gpu.h"
+#include "core/hw/hash.h"
+#include "core/hw/ndma.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/rasterizer.h"
+
+namespace SaveState {
+
+const Region g_regions[NUM_REGIONS] = {
+    {Memory::EXEFS_CODE_VADDR,      Memory::EXEFS_CODE_SIZE,    &Memory::g_exefs_code,  {0, 0}},
+    {Memory::SYSTEM_MEMORY_VADDR,   Memory::SYSTEM_MEMORY_SIZE, &Memory::g_system_mem,  {0, 0}},
+    {Memory::HEAP_VADDR,            Memory::FCRAM_SIZE,         &Memory::g_heap,
+        {Memory::FCRAM_PADDR, Memory::FCRAM_VADDR_FW0B}},
+    {Memory::SHARED_MEMORY_VADDR,   Memory::SHARED_MEMORY_SIZE, &Memory::g_shared_mem,  {0, 0}},
+    {Memory::HEAP_GSP_VADDR,        Memory::HEAP_GSP_SIZE,      &Memory::g_heap_gsp,    {0, 0}},
+    {Memory::VRAM_VADDR,            Memory::VRAM_SIZE,          &Memory::g_vram,        {0, 0}},
+    {Memory::DSP_VADDR,             Memory::DSP_SIZE,           &Memory::g_dsp_mem,     {0, 0}},
+    {Memory::KERNEL_MEMORY_VADDR,   Memory::KERNEL_MEMORY_SIZE, &Memory::g_kernel_mem,  {0, 0}},
+    {Memory::CONFIG_MEMORY_VADDR,   Memory::CONFIG_MEMORY_SIZE + Memory::SHARED_PAGE_SIZE,
+        &Memory::g_config_mem,  {0, 0}},
+};
+
+namespace {
+
+/// Saves or loads the state of a module
+typedef void (*ModuleDoState)(PointerWrap& p);
+
+void FileSystemDoState(PointerWrap& p) {
+    System::g_ctr_file_system.DoState(p);
+}
+
+/// Modules in the order their states are saved and loaded, each state is a chunk of its own
+const ModuleDoState g_modules[] = {
+    Core::DoState,
+    CoreTiming::DoState,
+    Memory::DoState,
+    Kernel::DoState,
+    FileSystemDoState,
+    GPU::DoState,
+    NDMA::DoState,
+    HASH::DoState,
+    // Waits for the GPU thread, which owns the PICA state while it runs command lists
+    GPUThread::DoState,
+    Pica::CommandProcessor::DoState,
+};
+
+const int NUM_MODULES = ARRAY_SIZE(g_modules);
+
+} // namespace
+
+/// Saves or loads the states of the modules, everything but guest memory
+void DoState(PointerWrap& p) {
+    for (ModuleDoState do_state : g_modules) {
+        do_state(p);
+    }
+}
+
+/**
+ * Brings guest memory up to date: completes the I/O in flight, runs the pending command lists,
+ * writes back host framebuffers
+ */
+void FlushMemory() {
+    AsyncIO::Flush();
+    GPUThread::Sync();
+    Pica::Rasterizer::FlushRegion(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    Pica::Rasterizer::FlushRegion(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+    // The regions are tracked at the addresses they're saved from
+    Memory::MergeAliasDirtyPages();
+}
+
+/**
+ * Tells whether a page of guest memory is all zeroes
+ * @param page Host pointer to the page
+ */
+bool IsZeroPage(const u8* page) {
+    const u64* words = (const u64*)page;
+    for (u32 i = 0; i < Memory::PAGE_SIZE / 8; i++) {
+        if (words[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Tells whether a page of a region was written since its dirty bits were last cleared, through any
+ * of the addresses of the region
+ * @param region Memory region
+ * @param offset Offset of the page in the region
+ * @param flags Dirty bits to check
+ */
+bool IsPageWritten(const Region& region, u32 offset, u8 flags) {
+    if (Memory::g_dirty_pages[(region.address + offset) >> Memory::PAGE_BITS] & flags) {
+        return true;
+    }
+    for (u32 mirror : region.mirrors) {
+        if (mirror != 0 &&
+            (Memory::g_dirty_pages[(mirror + offset) >> Memory::PAGE_BITS] & flags)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Marks a page of a region written, through all of the addresses of the region
+ * @param region Memory region
+ * @param offset Offset of the page in the region
+ * @param flags Dirty bits to set
+ */
+void MarkPageWritten(const Region& region, u32 offset, u8 flags) {
+    Memory::MarkRangeDirty(region.address + offset, Memory::PAGE_SIZE, flags);
+    for (u32 mirror : region.mirrors) {
+        if (mirror != 0) {
+            Memory::MarkRangeDirty(mirror + offset, Memory::PAGE_SIZE, flags);
+        }
+    }
+}
+
+/**
+ * Clears dirty bits of all the regions, through all of their addresses
+ * @param flags Dirty bits to clear
+ */
+void ClearWritten(u8 flags) {
+    for (const Region& region : g_regions) {
+        Memory::ClearDirtyRange(region.address, region.size, flags);
+        for (u32 mirror : region.mirrors) {
+            if (mirror != 0) {
+                Memory::ClearDirtyRange(mirror, region.size, flags);
+            }
+        }
+    }
+}
+
+namespace {
+
+enum {
+    MAGIC       = 0x53535443,       ///< "CTSS"
+    VERSION     = 6,                ///< Layout of the file and of the module states
+
+    BLOCK_SIZE  = 0x100000,         ///< Size of the memory chunks, the last of a region may be less
+    BATCH_SIZE  = 32,               ///< Memory chunks compressed or decompressed at a time
+
+    MAX_CHUNKS  = 0x10000,          ///< Bound of the index, against broken headers
+};
+
+/**
+ * Files are a header, the chunks, then the index of the chunks. Chunks are compressed on their
+ * own, so that they can be compressed and decompressed in parallel and read on their own.
+ */
+struct FileHeader {
+    u32     magic;
+    u32     version;
+    char    scm_rev[48];            ///< Build that saved the state, loading warns about others
+    u32     num_chunks;             ///< Entries of the index
+    u32     reserved;
+    u64     index_offset;           ///< From the start of the state, 0 until the state is complete
+};
+
+enum ChunkType : u32 {
+    CHUNK_MEMORY    = 1,            ///< Block of guest memory, blocks of no chunk are all zeroes
+    CHUNK_STATE     = 2,            ///< State of a module, through PointerWrap
+};
+
+/// Entry of the index. Of two memory chunks of the same block, the later one is the newer.
+struct ChunkEntry {
+    u32 type;
+    u32 address;                    ///< Guest address of a memory chunk, module of a state chunk
+    u32 size;                       ///< Size of the data in bytes
+    u32 stored_size;                ///< Size in the file, the data is stored as is if it's equal
+    u64 offset;                     ///< From the start of the state
+};
+
+/// Chunk being compressed or decompressed
+struct Block {
+    const Region*       region;     ///< Region of a memory chunk
+    const ChunkEntry*   entry;      ///< Chunk of the block when loading, NULL if it's all zeroes
+    u32                 address;
+    u32                 size;
+    u8*                 memory;     ///< Host pointer to the data
+    bool                selected;   ///< Whether the chunk is written when saving
+    std::vector<u8>     stored;     ///< Data as in the file, empty when stored as is
+};
+
+/// Savestate being written, the index is written once all of the chunks are
+struct Output {
+    File::IOFile*           file;
+    u64                     start;  ///< Position of the header in the file
+    std::vector<ChunkEntry> index;
+};
+
+File::IOFile        g_file;                     ///< File of the background save
+Output              g_output;                   ///< Savestate of the background save
+std::thread*        g_thread = nullptr;         ///< Writes the memory of the background save
+std::atomic<bool>   g_memory_written(false);    ///< Set by the thread once it's done
+bool                g_memory_ok = false;        ///< Whether the thread wrote all of the memory
+
+/**
+ * Compresses the data of a block into its stored data, which is left empty if the data doesn't
+ * compress
+ * @param block Block to compress
+ */
+void Compress(Block& block) {
+    block.stored.resize(block.size - 1);
+    const size_t size = Common::LZ4Compress(block.memory, block.size, block.stored.data(),
+        block.stored.size());
+    block.stored.resize(size);
+}
+
+/// Splits all of the memory regions in blocks, a chunk each
+std::vector<Block> GetMemoryBlocks() {
+    std::vector<Block> blocks;
+    for (const Region& region : g_regions) {
+        for (u32 offset = 0; offset < region.size; offset += BLOCK_SIZE) {
+            Block block;
+            block.region = &region;
+            block.entry = NULL;
+            block.address = region.address + offset;
+            block.size = std::min<u32>(BLOCK_SIZE, region.size - offset);
+            block.memory = *region.pointer + offset;
+            block.selected = false;
+            blocks.push_back(block);
+        }
+    }
+    return blocks;
+}
+
+/**
+ * Writes the header of a savestate
+ * @param file File to write to, at the start of the savestate
+ * @param num_chunks Entries of the index
+ * @param index_offset Position of the index from the start of the savestate, 0 until it's written
+ * @return True on success
+ */
+bool WriteHeader(File::IOFile& file, u32 num_chunks, u64 index_offset) {
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    strncpy(header.scm_rev, Common::g_scm_rev, sizeof(header.scm_rev) - 1);
+    header.num_chunks = num_chunks;
+    header.index_offset = index_offset;
+    return file.WriteArray(&header, 1);
+}
+
+/**
+ * Starts writing a savestate, with a header that WriteState completes
+ * @param file File to write to, at its current position
+ * @param output Receives the savestate being written
+ * @return True on success
+ */
+bool BeginState(File::IOFile& file, Output& output) {
+    output.file = &file;
+    output.start = file.Tell();
+    output.index.clear();
+    return WriteHeader(file, 0, 0);
+}
+
+/**
+ * Writes a chunk and adds it to the index
+ * @param output Savestate to write to
+ * @param type Type of the chunk
+ * @param address Address of the chunk, as in the index
+ * @param data Data of the chunk
+ * @param size Size of the data in bytes
+ * @param stored Compressed data, empty if the data is stored as is
+ * @return True on success
+ */
+bool WriteChunk(Output& output, u32 type, u32 address, const u8* data, u32 size,
+    const std::vector<u8>& stored) {
+
+    ChunkEntry entry;
+    entry.type = type;
+    entry.address = address;
+    entry.size = size;
+    entry.stored_size = stored.empty() ? size : (u32)stored.size();
+    entry.offset = output.file->Tell() - output.start;
+    output.index.push_back(entry);
+    return stored.empty() ? output.file->WriteBytes(data, size) :
+        output.file->WriteBytes(stored.data(), stored.size());
+}
+
+/**
+ * Writes guest memory as chunks of a block each, compressed in parallel on the thread pool
+ * straight from the memory regions
+ * @param output Savestate to write to
+ * @param written_only Write the blocks with pages written since the background save started,
+ *                     zeroes or not, instead of the blocks that aren't all zeroes
+ * @return True on success
+ */
+bool WriteMemory(Output& output, bool written_only) {
+    std::vector<Block> blocks = GetMemoryBlocks();
+
+    for (size_t batch = 0; batch < blocks.size(); batch += BATCH_SIZE) {
+        const int end = (int)std::min<size_t>(blocks.size(), batch + BATCH_SIZE);
+        Common::ThreadPool::GetShared().ParallelFor((int)batch, end, 1, [&](int first, int last) {
+            for (int i = first; i < last; i++) {
+                Block& block = blocks[i];
+                for (u32 page = 0; page < block.size && !block.selected;
+                    page += Memory::PAGE_SIZE) {
+
+                    const u32 offset = block.address - block.region->address + page;
+                    block.selected = written_only ?
+                        IsPageWritten(*block.region, offset, Memory::DIRTY_SAVESTATE) :
+                        !IsZeroPage(block.memory + page);
+                }
+                if (block.selected) {
+                    Compress(block);
+                }
+            }
+        });
+
+        // Chunks are written in order, so that the index is the same from one save to the next
+        for (int i = (int)batch; i < end; i++) {
+            Block& block = blocks[i];
+            if (block.selected && !WriteChunk(output, CHUNK_MEMORY, block.address, block.memory,
+                block.size, block.stored)) {
+                return false;
+            }
+            std::vector<u8>().swap(block.stored);
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes the states of the modules as a chunk each, then the index and the complete header
+ * @param output Savestate to write to
+ * @return True on success
+ */
+bool WriteState(Output& output) {
+    // The modules save on this thread, the state of one may depend on the ones before it
+    std::vector<Block> blocks(NUM_MODULES);
+    std::vector<std::vector<u8>> states(NUM_MODULES);
+    for (int i = 0; i < NUM_MODULES; i++) {
+        u8* ptr = NULL;
+        PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+        g_modules[i](p);
+        states[i].resize((size_t)ptr);
+        ptr = states[i].data();
+        p.SetMode(PointerWrap::MODE_WRITE);
+        g_modules[i](p);
+        if (p.error == PointerWrap::ERROR_FAILURE) {
+            return false;
+        }
+        blocks[i].memory = states[i].data();
+        blocks[i].size = (u32)states[i].size();
+    }
+    Common::ThreadPool::GetShared().ParallelFor(0, NUM_MODULES, 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            if (blocks[i].size > 1) {
+                Compress(blocks[i]);
+            }
+        }
+    });
+    for (int i = 0; i < NUM_MODULES; i++) {
+        if (!WriteChunk(output, CHUNK_STATE, i, blocks[i].memory, blocks[i].size,
+            blocks[i].stored)) {
+            return false;
+        }
+    }
+
+    // The header goes last, a state cut short has no index
+    const u64 index_offset = output.file->Tell() - output.start;
+    if (!output.file->WriteArray(output.index.data(), output.index.size())) {
+        return false;
+    }
+    const u64 end = output.file->Tell();
+    return output.file->Seek(output.start, SEEK_SET) &&
+        WriteHeader(*output.file, (u32)output.index.size(), index_offset) &&
+        output.file->Seek(end, SEEK_SET);
+}
+
+/**
+ * Creates a savestate file and writes a header, which the complete one replaces
+ * @param file Receives the open file
+ * @param output Receives the savestate being written
+ * @param filename Path of the file
+ * @return True on success
+ */
+bool CreateStateFile(File::IOFile& file, Output& output, const std::string& filename) {
+    if (!file.Open(filename, "wb") || !BeginState(file, output)) {
+        ERROR_LOG(COMMON, "couldn't create savestate %s", filename.c_str());
+        file.Close();
+        return false;
+    }
+    return true;
+}
+
+/// Writes the memory of the background save, on its thread
+void ThreadFunc() {
+    Common::SetCurrentThreadName("SaveState");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_LOW);
+    // Started from the emulation thread, which may be pinned to its core
+    Common::UnpinCurrentThread();
+
+    g_memory_ok = WriteMemory(g_output, false);
+    g_memory_written.store(true, std::memory_order_release);
+}
+
+/// Waits for the thread of the background save and writes the rest of the file
+void FinishSave() {
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+
+    // What was written while the thread ran overrides what it wrote
+    FlushMemory();
+    if (g_memory_ok && WriteMemory(g_output, true) && WriteState(g_output)) {
+        NOTICE_LOG(COMMON, "saved state in the background");
+    } else {
+        ERROR_LOG(COMMON, "couldn't write the savestate saved in the background");
+    }
+    g_file.Close();
+    std::vector<ChunkEntry>().swap(g_output.index);
+}
+
+/**
+ * Reads a chunk, decompressing it
+ * @param file File of the savestate
+ * @param start Position of the header in the file
+ * @param entry Chunk to read
+ * @param data Receives the data, of the size of the chunk
+ * @return True on success
+ */
+bool ReadChunk(File::IOFile& file, u64 start, const ChunkEntry& entry, u8* data) {
+    if (!file.Seek(start + entry.offset, SEEK_SET)) {
+        return false;
+    }
+    if (entry.stored_size == entry.size) {
+        return file.ReadBytes(data, entry.size);
+    }
+    std::vector<u8> stored(entry.stored_size);
+    return file.ReadBytes(stored.data(), stored.size()) &&
+        Common::LZ4Decompress(stored.data(), stored.size(), data, entry.size);
+}
+
+/**
+ * Reads guest memory, the chunks of a batch are read in turn then decompressed in parallel on the
+ * thread pool. Blocks without a chunk are cleared.
+ * @param file File of the savestate
+ * @param start Position of the header in the file
+ * @param blocks Blocks of all of the regions, with their chunks
+ * @return True on success
+ */
+bool ReadMemory(File::IOFile& file, u64 start, std::vector<Block>& blocks) {
+    for (size_t batch = 0; batch < blocks.size(); batch += BATCH_SIZE) {
+        const int end = (int)std::min<size_t>(blocks.size(), batch + BATCH_SIZE);
+        for (int i = (int)batch; i < end; i++) {
+            Block& block = blocks[i];
+            if (block.entry == NULL) {
+                continue;
+            }
+            if (!file.Seek(start + block.entry->offset, SEEK_SET)) {
+                return false;
+            }
+            if (block.entry->stored_size == block.size) {
+                if (!file.ReadBytes(block.memory, block.size)) {
+                    return false;
+                }
+                continue;
+            }
+            block.stored.resize(block.entry->stored_size);
+            if (!file.ReadBytes(block.stored.data(), block.stored.size())) {
+                return false;
+            }
+        }
+
+        std::atomic<bool> ok(true);
+        Common::ThreadPool::GetShared().ParallelFor((int)batch, end, 1, [&](int first, int last) {
+            for (int i = first; i < last; i++) {
+                Block& block = blocks[i];
+                if (block.entry == NULL) {
+                    memset(block.memory, 0, block.size);
+                } else if (!block.stored.empty() && !Common::LZ4Decompress(block.stored.data(),
+                    block.stored.size(), block.memory, block.size)) {
+                    ok.store(false, std::memory_order_relaxed);
+                }
+                std::vector<u8>().swap(block.stored);
+            }
+        });
+        if (!ok.load()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Saves the state to a file, the emulation goes on once it's written. Must be called between two
+ * CPU slices.
+ * @param filename Path of the file
+ * @return True on success
+ */
+bool Save(const std::string& filename) {
+    File::IOFile file;
+    if (!file.Open(filename, "wb") || !Save(file)) {
+        ERROR_LOG(COMMON, "couldn't write savestate %s", filename.c_str());
+        return false;
+    }
+    NOTICE_LOG(COMMON, "saved state to %s", filename.c_str());
+    return true;
+}
+
+/**
+ * Saves the state into a file, e.g. to embed it in a file of another kind. Must be called between
+ * two CPU slices.
+ * @param file File to write to, at its current position
+ * @return True on success
+ */
+bool Save(File::IOFile& file) {
+    Shutdown();
+
+    FlushMemory();
+    Output output;
+    return BeginState(file, output) && WriteMemory(output, false) && WriteState(output);
+}
+
+/**
+ * Starts saving the state to a file in the background, Update finishes the save. Must be called
+ * between two CPU slices.
+ * @param filename Path of the file
+ * @return True if the save started, false if the file can't be created or a save is running
+ */
+bool BeginSave(const std::string& filename) {
+    if (g_thread != nullptr) {
+        WARN_LOG(COMMON, "a savestate is already being saved");
+        return false;
+    }
+    if (!CreateStateFile(g_file, g_output, filename)) {
+        return false;
+    }
+
+    // Pages written from now on are written again once the thread is done
+    FlushMemory();
+    ClearWritten(Memory::DIRTY_SAVESTATE);
+
+    g_memory_written.store(false, std::memory_order_relaxed);
+    g_thread = new std::thread(ThreadFunc);
+    NOTICE_LOG(COMMON, "saving state to %s in the background", filename.c_str());
+    return true;
+}
+
+/// Finishes the background save once its memory is written, called between two CPU slices
+void Update() {
+    if (g_thread != nullptr && g_memory_written.load(std::memory_order_acquire)) {
+        FinishSave();
+    }
+}
+
+/**
+ * Loads the state from a file. Must be called between two CPU slices, in a session running the
+ * application the state was saved from.
+ * @param filename Path of the file
+ * @return True on success. If the file is broken past its index the session is too.
+ */
+bool Load(const std::string& filename) {
+    File::IOFile file(filename, "rb");
+    if (!Load(file)) {
+        ERROR_LOG(COMMON, "couldn't load savestate %s", filename.c_str());
+        return false;
+    }
+    NOTICE_LOG(COMMON, "loaded state from %s", filename.c_str());
+    return true;
+}
+
+/**
+ * Loads the state from a file, e.g. from a state embedded in a file of another kind. Must be
+ * called between two CPU slices, in a session running the application the state was saved from.
+ * @param file File to read from, at its current position. Reading stops at the end of the state.
+ * @return True on success. If the state is broken past its index the session is too.
+ */
+bool Load(File::IOFile& file) {
+    Shutdown();
+
+    const u64 start = file.Tell();
+    FileHeader header;
+    if (!file.ReadArray(&header, 1) || header.magic != MAGIC) {
+        ERROR_LOG(COMMON, "not a savestate");
+        return false;
+    }
+    if (header.version != VERSION) {
+        ERROR_LOG(COMMON, "savestate of version %u, expected %u", header.version, (u32)VERSION);
+        return false;
+    }
+    header.scm_rev[sizeof(header.scm_rev) - 1] = '\0';
+    if (strncmp(header.scm_rev, Common::g_scm_rev, sizeof(header.scm_rev) - 1) != 0) {
+        WARN_LOG(COMMON, "savestate saved by build %s, it may not load properly", header.scm_rev);
+    }
+    if (header.index_offset == 0 || header.num_chunks > MAX_CHUNKS) {
+        ERROR_LOG(COMMON, "savestate is incomplete");
+        return false;
+    }
+
+    std::vector<ChunkEntry> index(header.num_chunks);
+    if (!file.Seek(start + header.index_offset, SEEK_SET) ||
+        !file.ReadArray(index.data(), index.size())) {
+        ERROR_LOG(COMMON, "savestate is truncated");
+        return false;
+    }
+    const u64 end = file.Tell();
+
+    // Every chunk is checked before the session is touched
+    std::vector<Block> blocks = GetMemoryBlocks();
+    std::vector<const ChunkEntry*> states(NUM_MODULES, (const ChunkEntry*)NULL);
+    for (const ChunkEntry& entry : index) {
+        Block* block = NULL;
+        if (entry.type == CHUNK_MEMORY) {
+            for (Block& it : blocks) {
+                if (it.address == entry.address && it.size == entry.size) {
+                    block = &it;
+                }
+            }
+        }
+        const bool is_state = entry.type == CHUNK_STATE && entry.address < (u32)NUM_MODULES;
+        if ((block == NULL && !is_state) || entry.stored_size > entry.size ||
+            entry.offset + entry.stored_size > header.index_offset) {
+            ERROR_LOG(COMMON, "savestate has a bad chunk of type %u at 0x%08X", entry.type,
+                entry.address);
+            return false;
+        }
+        if (block != NULL) {
+            block->entry = &entry;
+        } else {
+            states[entry.address] = &entry;
+        }
+    }
+
+    std::vector<std::vector<u8>> state_data(NUM_MODULES);
+    for (int i = 0; i < NUM_MODULES; i++) {
+        if (states[i] == NULL) {
+            ERROR_LOG(COMMON, "savestate has no state for module %d", i);
+            return false;
+        }
+        state_data[i].resize(states[i]->size);
+        if (!ReadChunk(file, start, *states[i], state_data[i].data())) {
+            ERROR_LOG(COMMON, "savestate has a broken state for module %d", i);
+            return false;
+        }
+    }
+
+    // Host framebuffers go to guest memory first, so that they aren't written back over it later
+    FlushMemory();
+    if (!ReadMemory(file, start, blocks)) {
+        ERROR_LOG(COMMON, "savestate has broken memory");
+        return false;
+    }
+
+    for (int i = 0; i < NUM_MODULES; i++) {
+        u8* ptr = state_data[i].data();
+        PointerWrap p(&ptr, PointerWrap::MODE_READ);
+        g_modules[i](p);
+        if (p.error == PointerWrap::ERROR_FAILURE) {
+            ERROR_LOG(COMMON, "savestate is broken");
+            return false;
+        }
+    }
+    file.Seek(end, SEEK_SET);
+
+    // Everything cached from guest memory is stale
+    for (const Region& region : g_regions) {
+        Memory::MarkRangeDirty(region.address, region.size);
+        for (u32 mirror : region.mirrors) {
+            if (mirror != 0) {
+                Memory::MarkRangeDirty(mirror, region.size);
+            }
+        }
+    }
+    Pica::Rasterizer::InvalidateRegion(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    Pica::Rasterizer::InvalidateRegion(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+    Rewind::Reset();
+    return true;
+}
+
+/// Finishes the background save, if there is one
+void Shutdown() {
+    if (g_thread != nullptr) {
+        FinishSave();
+    }
+}
+
+} // namespace
@@ -0,0 +1,126 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+namespace File {
+class IOFile;
+}
+
+/**
+ * State of the emulated system kept in a file, to be loaded back into a session running the same
+ * application. The file is made of chunks compressed on their own, found through an index at its
+ * end: one per module, saved through PointerWrap, and one per block of guest memory, compressed
+ * straight from the memory regions with the blocks that are all zeroes left out. Chunks are
+ * compressed and decompressed in parallel on the thread pool. A save can run in the background:
+ * the memory is written on a thread of its own while the emulation goes on, then the blocks
+ * written meanwhile and the module states are appended between two slices.
+ */
+namespace SaveState {
+
+/// Guest memory backed by host memory of its own
+struct Region {
+    u32     address;
+    u32     size;
+    u8**    pointer;
+    u32     mirrors[2];             ///< Other addresses the region is mapped at, 0 for none
+};
+
+enum {
+    NUM_REGIONS = 9,
+};
+
+extern const Region g_regions[NUM_REGIONS]; ///< All of the guest memory a state holds
+
+/// Saves or loads the states of the modules, everything but guest memory
+void DoState(PointerWrap& p);
+
+/**
+ * Brings guest memory up to date: completes the I/O in flight, runs the pending command lists,
+ * writes back host framebuffers
+ */
+void FlushMemory();
+
+/**
+ * Tells whether a page of guest memory is all zeroes
+ * @param page Host pointer to the page
+ */
+bool IsZeroPage(const u8* page);
+
+/**
+ * Tells whether a page of a region was written since its dirty bits were last cleared, through any
+ * of the addresses of the region
+ * @param region Memory region
+ * @param offset Offset of the page in the region
+ * @param flags Dirty bits to check
+ */
+bool IsPageWritten(const Region& region, u32 offset, u8 flags);
+
+/**
+ * Marks a page of a region written, through all of the addresses of the region
+ * @param region Memory region
+ * @param offset Offset of the page in the region
+ * @param flags Dirty bits to set
+ */
+void MarkPageWritten(const Region& region, u32 offset, u8 flags);
+
+/**
+ * Clears dirty bits of all the regions, through all of their addresses
+ * @param flags Dirty bits to clear
+ */
+void ClearWritten(u8 flags);
+
+/**
+ * Saves the state to a file, the emulation goes on once it's written. Must be called between two
+ * CPU slices.
+ * @param filename Path of the file
+ * @return True on success
+ */
+bool Save(const std::string& filename);
+
+/**
+ * Saves the state into a file, e.g. to embed it in a file of another kind. Must be called between
+ * two CPU slices.
+ * @param file File to write to, at its current position
+ * @return True on success
+ */
+bool Save(File::IOFile& file);
+
+/**
+ * Starts saving the state to a file in the background, Update finishes the save. Must be called
+ * between two CPU slices.
+ * @param filename Path of the file
+ * @return True if the save started, false if the file can't be created or a save is running
+ */
+bool BeginSave(const std::string& filename);
+
+/// Finishes the background save once its memory is written, called between two CPU slices
+void Update();
+
+/**
+ * Loads the state from a file. Must be called between two CPU slices, in a session running the
+ * application the state was saved from.
+ * @param filename Path of the file
+ * @return True on success. If the file is broken past its index the session is too.
+ */
+bool Load(const std::string& filename);
+
+/**
+ * Loads the state from a file, e.g. from a state embedded in a file of another kind. Must be
+ * called between two CPU slices, in a session running the application the state was saved from.
+ * @param file File to read from, at its current position. Reading stops at the end of the state.
+ * @return True on success. If the state is broken past its index the session is too.
+ */
+bool Load(File::IOFile& file);
+
+/// Finishes the background save, if there is one
+void Shutdown();
+
+} // namespace
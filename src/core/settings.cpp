@@ -0,0 +1,285 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/ini_file.h"
+#include "common/log.h"
+#include "common/memory_tracker.h"
+#include "common/string_util.h"
+
+#include "core/audio_output.h"
+#include "core/core.h"
+#include "core/run_ahead.h"
+#include "core/settings.h"
+#include "core/speed_limiter.h"
+#include "core/sys_core.h"
+#include "core/arm/interpreter/idle_loop.h"
+
+#include "video_core/gpu_thread.h"
+#include "video_core/video_core.h"
+
+namespace Settings {
+
+namespace {
+
+u64 g_title_id = 0;     ///< Title of the profile LoadTitleProfile read last
+
+/// Gets the path of a settings file, the default one if none is given
+std::string GetPath(const std::string& filename) {
+    return filename.empty() ? File::GetUserPath(F_EMUCONFIG_IDX) : filename;
+}
+
+/**
+ * Prints the backends of a registry
+ * @param kind Kind of the backends, as "cpu"
+ * @param registry Registry of the backends
+ * @param capability_names Names of the capability bits, from bit 0
+ * @param num_capabilities Number of names
+ */
+template <typename T>
+void PrintRegistry(const char* kind, const Common::FactoryRegistry<T>& registry,
+    const char* const* capability_names, int num_capabilities) {
+
+    for (auto& backend : registry.GetBackends()) {
+        std::string capabilities;
+        for (int i = 0; i < num_capabilities; i++) {
+            if (backend.capabilities & (1u << i)) {
+                capabilities += std::string(capabilities.empty() ? "" : ",") + capability_names[i];
+            }
+        }
+        printf("%-8s %-12s %-24s %s\n", kind, backend.name, capabilities.c_str(),
+            backend.description);
+    }
+}
+
+/**
+ * Gets the key of the budget of a memory tag, as "texture_cache_budget_mb"
+ * @param tag Tag, one with a budget
+ */
+std::string GetBudgetKey(Common::MemoryTracker::Tag tag) {
+    return std::string(Common::MemoryTracker::GetTagName(tag)) + "_budget_mb";
+}
+
+/// Reads the keys shared by the settings and the profiles into the globals of the modules
+void ReadValues(const IniFile& ini) {
+    ini.Get("Core", "cpu_backend", &Core::g_cpu_backend, Core::g_cpu_backend);
+    ini.Get("Core", "translation_cache", &Core::g_translation_cache_enabled,
+        Core::g_translation_cache_enabled);
+    ini.Get("Core", "warm_up", &Core::g_warm_up_enabled, Core::g_warm_up_enabled);
+    ini.Get("Core", "sys_core_thread", &SysCore::g_threaded, SysCore::g_threaded);
+    int run_ahead_frames;
+    ini.Get("Core", "run_ahead", &run_ahead_frames, RunAhead::GetFrames());
+    RunAhead::SetFrames(run_ahead_frames);
+
+    ini.Get("Video", "renderer_backend", &VideoCore::g_renderer_backend,
+        VideoCore::g_renderer_backend);
+    ini.Get("Video", "resolution_scale", &VideoCore::g_resolution_scale,
+        VideoCore::g_resolution_scale);
+    ini.Get("Video", "gpu_thread", &GPUThread::g_enabled, GPUThread::g_enabled);
+    ini.Get("Video", "shader_cache", &VideoCore::g_shader_cache_enabled,
+        VideoCore::g_shader_cache_enabled);
+    ini.Get("Video", "frame_latency", &VideoCore::g_frame_latency_enabled,
+        VideoCore::g_frame_latency_enabled);
+    ini.Get("Video", "presenter", &VideoCore::g_presenter_enabled,
+        VideoCore::g_presenter_enabled);
+    ini.Get("Video", "frameskip", &SpeedLimiter::g_frameskip_enabled,
+        SpeedLimiter::g_frameskip_enabled);
+
+    ini.Get("Audio", "sink_backend", &AudioOutput::g_sink_backend, AudioOutput::g_sink_backend);
+
+    // Budgets in MB, 0 for none
+    for (int i = 0; i < Common::MemoryTracker::NUM_TAGS; i++) {
+        const Common::MemoryTracker::Tag tag = (Common::MemoryTracker::Tag)i;
+        if (Common::MemoryTracker::HasBudget(tag)) {
+            int budget_mb;
+            ini.Get("Memory", GetBudgetKey(tag), &budget_mb,
+                (int)(Common::MemoryTracker::GetBudget(tag) >> 20));
+            Common::MemoryTracker::SetBudget(tag, (u64)std::max(budget_mb, 0) << 20);
+        }
+    }
+}
+
+/// Writes the globals of the modules ReadValues reads
+void WriteValues(IniFile& ini) {
+    ini.Set("Core", "cpu_backend", Core::g_cpu_backend);
+    ini.Set("Core", "translation_cache", Core::g_translation_cache_enabled);
+    ini.Set("Core", "warm_up", Core::g_warm_up_enabled);
+    ini.Set("Core", "sys_core_thread", SysCore::g_threaded);
+    ini.Set("Core", "run_ahead", RunAhead::GetFrames());
+
+    ini.Set("Video", "renderer_backend", VideoCore::g_renderer_backend);
+    ini.Set("Video", "resolution_scale", VideoCore::g_resolution_scale);
+    ini.Set("Video", "gpu_thread", GPUThread::g_enabled);
+    ini.Set("Video", "shader_cache", VideoCore::g_shader_cache_enabled);
+    ini.Set("Video", "frame_latency", VideoCore::g_frame_latency_enabled);
+    ini.Set("Video", "presenter", VideoCore::g_presenter_enabled);
+    ini.Set("Video", "frameskip", SpeedLimiter::g_frameskip_enabled);
+
+    ini.Set("Audio", "sink_backend", AudioOutput::g_sink_backend);
+
+    for (int i = 0; i < Common::MemoryTracker::NUM_TAGS; i++) {
+        const Common::MemoryTracker::Tag tag = (Common::MemoryTracker::Tag)i;
+        if (Common::MemoryTracker::HasBudget(tag)) {
+            ini.Set("Memory", GetBudgetKey(tag),
+                (int)(Common::MemoryTracker::GetBudget(tag) >> 20));
+        }
+    }
+}
+
+/**
+ * Gets the path of the profile of a title
+ * @param directory Directory of the profiles, with a trailing separator
+ * @param title_id Title ID of the title
+ */
+std::string GetProfilePath(const std::string& directory, u64 title_id) {
+    return directory + StringFromFormat("%016llX.ini", (unsigned long long)title_id);
+}
+
+/**
+ * Parses a list of addresses
+ * @param text Addresses separated by commas, in hexadecimal with or without 0x
+ * @return The addresses, without those that don't parse
+ */
+std::vector<u32> ParseAddresses(const std::string& text) {
+    std::vector<std::string> fields;
+    SplitString(text, ',', fields);
+    std::vector<u32> addresses;
+    for (size_t i = 0; i < fields.size(); i++) {
+        const std::string field = StripSpaces(fields[i]);
+        char* end;
+        const u32 address = (u32)strtoul(field.c_str(), &end, 16);
+        if (!field.empty() && *end == '\0') {
+            addresses.push_back(address);
+        }
+    }
+    return addresses;
+}
+
+} // namespace
+
+/**
+ * Reads the settings into the globals of the modules, before their Init
+ * @param filename Path of the ini file, emu.ini of the user config directory if empty
+ * @return False if the file couldn't be read, the globals are left as they were then
+ */
+bool Load(const std::string& filename) {
+    const std::string path = GetPath(filename);
+    IniFile ini;
+    if (!ini.Load(path)) {
+        INFO_LOG(MASTER_LOG, "no settings in %s, using the defaults", path.c_str());
+        return false;
+    }
+    ReadValues(ini);
+
+    NOTICE_LOG(MASTER_LOG, "settings read from %s: cpu %s, renderer %s, audio %s", path.c_str(),
+        Core::g_cpu_backend.c_str(), VideoCore::g_renderer_backend.c_str(),
+        AudioOutput::g_sink_backend.c_str());
+    return true;
+}
+
+/**
+ * Writes the globals of the modules, keeping the comments of the file
+ * @param filename Path of the ini file, emu.ini of the user config directory if empty
+ * @return False if the file couldn't be written
+ */
+bool Save(const std::string& filename) {
+    const std::string path = GetPath(filename);
+    IniFile ini;
+    ini.Load(path);
+    WriteValues(ini);
+
+    File::CreateFullPath(path);
+    if (!ini.Save(path)) {
+        ERROR_LOG(MASTER_LOG, "couldn't write the settings to %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads the profile of a title over the settings: the one shipped in the system directory with
+ * the tuned defaults of the title, then the user's. Profiles have the keys of the settings, and
+ * the idle loops to skip in [IdleLoop]. Keys read at Init only apply before it.
+ * @param title_id Title ID of the title, from Loader::ReadTitleId
+ * @return False if the title has no profile
+ */
+bool LoadTitleProfile(u64 title_id) {
+    g_title_id = title_id;
+    if (title_id == 0) {
+        return false;
+    }
+
+    bool found = false;
+    std::vector<u32> known_loops;
+    const std::string paths[] = {
+        GetProfilePath(File::GetSysDirectory() + GAMECONFIG_DIR DIR_SEP, title_id),
+        GetProfilePath(File::GetUserPath(D_GAMECONFIG_IDX), title_id),
+    };
+    for (int i = 0; i < (int)ARRAY_SIZE(paths); i++) {
+        IniFile ini;
+        if (!ini.Load(paths[i])) {
+            continue;
+        }
+        ReadValues(ini);
+        ini.Get("IdleLoop", "detection", &IdleLoop::g_detection_enabled,
+            IdleLoop::g_detection_enabled);
+        std::string skip;
+        if (ini.Get("IdleLoop", "skip", &skip)) {
+            known_loops = ParseAddresses(skip);
+        }
+        NOTICE_LOG(MASTER_LOG, "title profile read from %s", paths[i].c_str());
+        found = true;
+    }
+    IdleLoop::SetKnownLoops(known_loops);
+    return found;
+}
+
+/**
+ * Writes the idle loops detected since the profile of the title was loaded to the user profile,
+ * as suggestions for its skip list. From the CPU thread, before the core shuts down.
+ */
+void SaveTitleSuggestions() {
+    const std::vector<u32> detected = IdleLoop::GetDetectedLoops();
+    if (g_title_id == 0 || detected.empty()) {
+        return;
+    }
+
+    std::string suggested;
+    for (size_t i = 0; i < detected.size(); i++) {
+        suggested += StringFromFormat("%s0x%08X", i == 0 ? "" : ", ", detected[i]);
+    }
+    const std::string path = GetProfilePath(File::GetUserPath(D_GAMECONFIG_IDX), g_title_id);
+    IniFile ini;
+    ini.Load(path);
+    ini.Set("IdleLoop", "suggested", suggested);
+    File::CreateFullPath(path);
+    if (ini.Save(path)) {
+        NOTICE_LOG(MASTER_LOG, "%d idle loops suggested in %s", (int)detected.size(),
+            path.c_str());
+    }
+}
+
+/// Prints the backends of every kind with their capabilities, for the usage of the frontends
+void PrintBackends() {
+    static const char* const cpu_capabilities[] = { "translates", "x64-only" };
+    static const char* const renderer_capabilities[] = { "presents", "host-draws" };
+    static const char* const sink_capabilities[] = { "device" };
+
+    printf("%-8s %-12s %-24s %s\n", "kind", "name", "capabilities", "description");
+    PrintRegistry("cpu", Core::GetCPUBackends(), cpu_capabilities,
+        ARRAY_SIZE(cpu_capabilities));
+    PrintRegistry("renderer", VideoCore::GetRendererBackends(), renderer_capabilities,
+        ARRAY_SIZE(renderer_capabilities));
+    PrintRegistry("audio", AudioOutput::GetSinkBackends(), sink_capabilities,
+        ARRAY_SIZE(sink_capabilities));
+}
+
+} // namespace
@@ -0,0 +1,52 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Settings the frontends share, kept in an ini file: the backends of the CPU, the renderer and
+ * the audio output, picked by name from their registries at init, and the options of those
+ * backends. Loading sets the globals of the modules, which the options of the command line
+ * then override, so that runs can compare backends per title without a rebuild. Titles may have
+ * profiles of their own on top of the settings, with the hacks they need.
+ */
+namespace Settings {
+
+/**
+ * Reads the settings into the globals of the modules, before their Init
+ * @param filename Path of the ini file, emu.ini of the user config directory if empty
+ * @return False if the file couldn't be read, the globals are left as they were then
+ */
+bool Load(const std::string& filename = "");
+
+/**
+ * Writes the globals of the modules, keeping the comments of the file
+ * @param filename Path of the ini file, emu.ini of the user config directory if empty
+ * @return False if the file couldn't be written
+ */
+bool Save(const std::string& filename = "");
+
+/**
+ * Reads the profile of a title over the settings: the one shipped in the system directory with
+ * the tuned defaults of the title, then the user's. Profiles have the keys of the settings, and
+ * the idle loops to skip in [IdleLoop]. Keys read at Init only apply before it.
+ * @param title_id Title ID of the title, from Loader::ReadTitleId
+ * @return False if the title has no profile
+ */
+bool LoadTitleProfile(u64 title_id);
+
+/**
+ * Writes the idle loops detected since the profile of the title was loaded to the user profile,
+ * as suggestions for its skip list. From the CPU thread, before the core shuts down.
+ */
+void SaveTitleSuggestions();
+
+/// Prints the backends of every kind with their capabilities, for the usage of the frontends
+void PrintBackends();
+
+} // namespace
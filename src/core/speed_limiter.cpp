@@ -0,0 +1,104 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/profiler.h"
+#include "common/thread.h"
+#include "common/timer.h"
+
+#include "core/core_timing.h"
+#include "core/speed_limiter.h"
+
+namespace SpeedLimiter {
+
+std::atomic<int> g_speed(DEFAULT_SPEED);
+bool g_frameskip_enabled = false;
+
+static const s64 kMaxLagMs = 100;   ///< How far behind schedule the guest may fall before a restart
+static const s64 kSkipLagMs = 20;   ///< How far behind schedule the guest falls before frameskip
+static const int kMaxSkippedFrames = 3; ///< Most frames skipped in a row, so that the screens move
+
+static int  g_skipped_frames = 0;       ///< Frames skipped in a row
+
+static int  g_base_speed = UNLIMITED;   ///< Speed the schedule was started at, UNLIMITED if none
+static u64  g_base_ticks = 0;           ///< Emulated time the schedule was started at
+static u32  g_base_time_ms = 0;         ///< Real time the schedule was started at
+
+static Common::Profiler::Category g_profile_throttle("Speed limiter wait");
+
+/**
+ * Starts the schedule over at the current time
+ * @param speed Target speed of the schedule
+ */
+static void Restart(int speed) {
+    g_base_speed = speed;
+    g_base_ticks = CoreTiming::GetTicks();
+    g_base_time_ms = Common::Timer::GetTimeMs();
+}
+
+/// Initialize the limiter
+void Init() {
+    // Sleeps have to be precise to a millisecond for frames of 16 ms to be paced evenly
+    Common::Timer::IncreaseResolution();
+    g_base_speed = UNLIMITED;
+    g_skipped_frames = 0;
+}
+
+/// Shutdown the limiter
+void Shutdown() {
+    Common::Timer::RestoreResolution();
+}
+
+/**
+ * Sets the target speed, from any thread
+ * @param percent Speed in percent of real time, clamped to MIN_SPEED-MAX_SPEED. UNLIMITED to turn
+ *                the limiter off.
+ */
+void SetSpeed(int percent) {
+    if (percent != UNLIMITED) {
+        percent = std::min(std::max(percent, (int)MIN_SPEED), (int)MAX_SPEED);
+    }
+    g_speed.store(percent, std::memory_order_relaxed);
+}
+
+/**
+ * Waits until emulated time is due at the target speed, called once per emulated frame
+ * @return True if the next frame should be skipped, never with frameskip off
+ */
+bool Throttle() {
+    const int speed = g_speed.load(std::memory_order_relaxed);
+    if (speed == UNLIMITED) {
+        g_base_speed = UNLIMITED;
+        g_skipped_frames = 0;
+        return false;
+    }
+    if (speed != g_base_speed) {
+        Restart(speed);
+        g_skipped_frames = 0;
+        return false;
+    }
+
+    // Real time the emulated time since the start of the schedule takes at the target speed
+    const u64 ticks = CoreTiming::GetTicks() - g_base_ticks;
+    const s64 due_ms = (s64)(ticks * 100000 / ((u64)g_clock_rate_arm11 * speed));
+    const s64 elapsed_ms = (s64)(Common::Timer::GetTimeMs() - g_base_time_ms);
+
+    if (due_ms > elapsed_ms) {
+        Common::Profiler::Scope scope(g_profile_throttle);
+        Common::SleepCurrentThread((int)(due_ms - elapsed_ms));
+    } else if (elapsed_ms - due_ms > kMaxLagMs) {
+        // The host can't keep up (or emulation was paused), don't run fast to make up for it
+        Restart(speed);
+    } else if (g_frameskip_enabled && elapsed_ms - due_ms > kSkipLagMs &&
+        g_skipped_frames < kMaxSkippedFrames) {
+
+        g_skipped_frames++;
+        return true;
+    }
+    g_skipped_frames = 0;
+    return false;
+}
+
+} // namespace
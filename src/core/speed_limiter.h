@@ -0,0 +1,51 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+
+#include "common/common_types.h"
+
+/**
+ * Keeps emulated time at a set percentage of real time. The GPU throttles once per emulated frame:
+ * when the guest got ahead of its schedule the emulation thread sleeps until it's due, when it
+ * fell far behind the schedule starts over rather than racing to catch up. With frameskip on,
+ * frames are skipped while the guest is behind, a few in a row at most.
+ */
+namespace SpeedLimiter {
+
+enum {
+    UNLIMITED       = 0,    ///< Speed setting that turns the limiter off
+    MIN_SPEED       = 50,   ///< Slowest speed that can be set, in percent of real time
+    MAX_SPEED       = 400,  ///< Fastest speed that can be set, in percent of real time
+    DEFAULT_SPEED   = 100,
+};
+
+/// Target speed in percent of real time, UNLIMITED to run as fast as the host can
+extern std::atomic<int> g_speed;
+
+/// Whether frames are skipped while the guest is behind schedule, read every frame
+extern bool g_frameskip_enabled;
+
+/// Initialize the limiter
+void Init();
+
+/// Shutdown the limiter
+void Shutdown();
+
+/**
+ * Sets the target speed, from any thread
+ * @param percent Speed in percent of real time, clamped to MIN_SPEED-MAX_SPEED. UNLIMITED to turn
+ *                the limiter off.
+ */
+void SetSpeed(int percent);
+
+/**
+ * Waits until emulated time is due at the target speed, called once per emulated frame
+ * @return True if the next frame should be skipped, never with frameskip off
+ */
+bool Throttle();
+
+} // namespace
@@ -0,0 +1,363 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/string_util.h"
+#include "common/timer.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/statistics.h"
+#include "core/hle/hle.h"
+#include "core/hle/service/service.h"
+#include "core/hw/gpu.h"
+
+#include "video_core/video_core.h"
+
+namespace Statistics {
+
+bool g_log_enabled = false;
+
+static const u64 kIntervalUs = 1000000;     ///< Real time between two samples
+
+/// Counters at the start of the interval being sampled
+struct Baseline {
+    u64 time_us;
+    u64 instructions;
+    u64 emulated_frames;
+    u64 host_frames;
+    u64 ticks;
+    u64 idle_ticks;
+    u64 events;
+    u64 svc_calls[0x100];
+    std::map<std::string, u64> ipc_calls;
+    std::vector<Common::PerfCounters::RegionStats> perf;    ///< Regions only ever get added
+};
+
+static Baseline     g_baseline;         ///< Taken at the first frame, its time is 0 until then
+static File::IOFile g_json_file;
+
+static std::mutex   g_sample_lock;      ///< Guards the last sample, read by the frontends
+static Sample       g_last_sample;
+static bool         g_has_sample = false;
+
+/// Frames the renderer presented, zero while there's no renderer
+static u64 GetHostFrames() {
+    return VideoCore::g_renderer != NULL ? (u64)VideoCore::g_renderer->current_frame() : 0;
+}
+
+/**
+ * Gets the command call counts of all services, by "port:command"
+ * @param calls Receives the counts
+ */
+static void GetIPCCalls(std::map<std::string, u64>& calls) {
+    calls.clear();
+    if (Service::g_manager == NULL) {
+        return;
+    }
+    std::vector<Service::CallCount> counts;
+    Service::g_manager->GetCallCounts(counts);
+    for (const Service::CallCount& count : counts) {
+        calls[count.name] += count.count;
+    }
+}
+
+/**
+ * Reads the counters the next interval starts from
+ * @param baseline Receives the counters
+ */
+static void TakeBaseline(Baseline& baseline) {
+    baseline.time_us = Common::Timer::GetTimeUs();
+    baseline.instructions = Core::g_app_core != NULL ? Core::g_app_core->GetNumInstructions() : 0;
+    baseline.emulated_frames = GPU::GetFrameCount();
+    baseline.host_frames = GetHostFrames();
+    baseline.ticks = CoreTiming::GetTicks();
+    baseline.idle_ticks = CoreTiming::GetIdleTicks();
+    baseline.events = CoreTiming::GetEventsDispatched();
+    memcpy(baseline.svc_calls, HLE::g_svc_call_counts, sizeof(baseline.svc_calls));
+    GetIPCCalls(baseline.ipc_calls);
+    Common::PerfCounters::GetRegions(baseline.perf);
+}
+
+/// Sorts rates busiest first, ties by name so that samples list them in a stable order
+static void SortRates(std::vector<Rate>& rates) {
+    std::sort(rates.begin(), rates.end(), [](const Rate& a, const Rate& b) {
+        return a.per_second != b.per_second ? a.per_second > b.per_second : a.name < b.name;
+    });
+}
+
+/**
+ * Computes the rates between two baselines
+ * @param from Counters at the start of the interval
+ * @param to Counters at its end
+ * @param sample Receives the rates
+ */
+static void ComputeSample(const Baseline& from, const Baseline& to, Sample& sample) {
+    const double seconds = (to.time_us - from.time_us) / 1000000.0;
+    const double emulated_seconds = (double)(to.ticks - from.ticks) / g_clock_rate_arm11;
+
+    sample.host_seconds = seconds;
+    sample.mips = (to.instructions - from.instructions) / seconds / 1000000.0;
+    sample.emulated_fps = (to.emulated_frames - from.emulated_frames) / seconds;
+    sample.host_fps = (to.host_frames - from.host_frames) / seconds;
+    sample.speed = emulated_seconds / seconds * 100.0;
+    sample.idle = to.ticks != from.ticks ?
+        (double)(to.idle_ticks - from.idle_ticks) / (to.ticks - from.ticks) * 100.0 : 0.0;
+    sample.events_per_second = (to.events - from.events) / seconds;
+    sample.memory_committed = Memory::GetCommittedSize();
+    sample.memory_reserved = Memory::GetReservedSize();
+
+    // The host backs guest memory as it's touched, its high-water mark is that of the samples
+    Common::MemoryTracker::SetUsage(Common::MemoryTracker::TAG_GUEST_MEMORY,
+        sample.memory_committed);
+    for (int tag = 0; tag < Common::MemoryTracker::NUM_TAGS; tag++) {
+        sample.memory[tag] = Common::MemoryTracker::GetUsage((Common::MemoryTracker::Tag)tag);
+    }
+
+    sample.svcs.clear();
+    sample.svcs_per_second = 0.0;
+    for (u32 id = 0; id < ARRAY_SIZE(to.svc_calls); id++) {
+        const u64 calls = to.svc_calls[id] - from.svc_calls[id];
+        if (calls == 0) {
+            continue;
+        }
+        std::string name = HLE::GetSVCName(id);
+        if (name.empty()) {
+            name = StringFromFormat("0x%02X", id);
+        }
+        Rate rate = { name, calls / seconds };
+        sample.svcs.push_back(rate);
+        sample.svcs_per_second += rate.per_second;
+    }
+    SortRates(sample.svcs);
+
+    // Services are only added at Init, a command missing from the start of the interval is new
+    sample.ipc.clear();
+    sample.ipc_per_second = 0.0;
+    for (const auto& command : to.ipc_calls) {
+        auto previous = from.ipc_calls.find(command.first);
+        const u64 calls = command.second -
+            (previous != from.ipc_calls.end() ? previous->second : 0);
+        if (calls == 0) {
+            continue;
+        }
+        Rate rate = { command.first, calls / seconds };
+        sample.ipc.push_back(rate);
+        sample.ipc_per_second += rate.per_second;
+    }
+    SortRates(sample.ipc);
+
+    sample.perf.clear();
+    for (size_t i = 0; i < to.perf.size() && i < from.perf.size(); i++) {
+        if (to.perf[i].scopes == from.perf[i].scopes) {
+            continue;
+        }
+        PerfRate rate;
+        rate.name = to.perf[i].name;
+        for (int event = 0; event < Common::PerfCounters::NUM_EVENTS; event++) {
+            rate.per_second[event] = (to.perf[i].counts[event] - from.perf[i].counts[event]) /
+                seconds;
+        }
+        sample.perf.push_back(rate);
+    }
+}
+
+/**
+ * Appends rates to a JSON object, as an object of their own
+ * @param json JSON text to append to
+ * @param key Key of the object
+ * @param rates Rates, by name
+ */
+static void AppendJsonRates(std::string& json, const char* key, const std::vector<Rate>& rates) {
+    json += StringFromFormat(",\"%s\":{", key);
+    for (size_t i = 0; i < rates.size(); i++) {
+        // Names are those of the SVC and service tables, only quotes and backslashes need escaping
+        std::string name;
+        for (char c : rates[i].name) {
+            if (c == '"' || c == '\\') {
+                name += '\\';
+            }
+            name += c;
+        }
+        json += StringFromFormat("%s\"%s\":%.1f", i != 0 ? "," : "", name.c_str(),
+            rates[i].per_second);
+    }
+    json += "}";
+}
+
+/**
+ * Formats a sample as one line of JSON
+ * @param sample Sample to format
+ * @return The line, with its newline
+ */
+static std::string FormatJson(const Sample& sample) {
+    std::string json = StringFromFormat("{\"seconds\":%.3f,\"mips\":%.2f,\"emulated_fps\":%.2f,"
+        "\"host_fps\":%.2f,\"speed\":%.1f,\"idle\":%.1f,\"svcs_per_second\":%.1f,"
+        "\"ipc_per_second\":%.1f,\"events_per_second\":%.1f,\"memory_committed\":%llu,"
+        "\"memory_reserved\":%llu", sample.host_seconds, sample.mips, sample.emulated_fps,
+        sample.host_fps, sample.speed, sample.idle, sample.svcs_per_second, sample.ipc_per_second,
+        sample.events_per_second, (unsigned long long)sample.memory_committed,
+        (unsigned long long)sample.memory_reserved);
+    AppendJsonRates(json, "svcs", sample.svcs);
+    AppendJsonRates(json, "ipc", sample.ipc);
+    json += ",\"memory\":{";
+    for (int tag = 0; tag < Common::MemoryTracker::NUM_TAGS; tag++) {
+        const Common::MemoryTracker::Usage& usage = sample.memory[tag];
+        json += StringFromFormat("%s\"%s\":{\"bytes\":%llu,\"peak\":%llu,\"count\":%lld,"
+            "\"budget\":%llu}", tag != 0 ? "," : "",
+            Common::MemoryTracker::GetTagName((Common::MemoryTracker::Tag)tag),
+            (unsigned long long)usage.bytes, (unsigned long long)usage.peak,
+            (long long)usage.count, (unsigned long long)usage.budget);
+    }
+    json += "}";
+    json += ",\"perf\":{";
+    for (size_t i = 0; i < sample.perf.size(); i++) {
+        json += StringFromFormat("%s\"%s\":{", i != 0 ? "," : "", sample.perf[i].name.c_str());
+        for (int event = 0; event < Common::PerfCounters::NUM_EVENTS; event++) {
+            json += StringFromFormat("%s\"%s\":%.0f", event != 0 ? "," : "",
+                Common::PerfCounters::GetEventName((Common::PerfCounters::Event)event),
+                sample.perf[i].per_second[event]);
+        }
+        json += "}";
+    }
+    json += "}";
+    json += "}\n";
+    return json;
+}
+
+/// Initialize the statistics, the first sample covers the time from the first frame
+void Init() {
+    g_baseline.time_us = 0;
+    std::lock_guard<std::mutex> lock(g_sample_lock);
+    g_has_sample = false;
+}
+
+/// Shutdown the statistics, closing the JSON output
+void Shutdown() {
+    g_json_file.Close();
+    std::lock_guard<std::mutex> lock(g_sample_lock);
+    g_has_sample = false;
+}
+
+/**
+ * Writes every sample as a line of JSON to a file as it's taken, until Shutdown
+ * @param filename File to write to, truncated
+ * @return True on success
+ */
+bool SetJsonOutput(const std::string& filename) {
+    if (!g_json_file.Open(filename, "w")) {
+        ERROR_LOG(COMMON, "Couldn't open %s for the statistics", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Takes a sample if a second passed since the last one, called once per emulated frame
+void Update() {
+    // Frontends initialize the system long before they boot, the time in between isn't sampled
+    if (g_baseline.time_us == 0) {
+        TakeBaseline(g_baseline);
+        return;
+    }
+    if (Common::Timer::GetTimeUs() - g_baseline.time_us < kIntervalUs) {
+        return;
+    }
+
+    Baseline now;
+    TakeBaseline(now);
+    Sample sample;
+    ComputeSample(g_baseline, now, sample);
+    g_baseline = now;
+
+    if (g_log_enabled) {
+        NOTICE_LOG(COMMON, "stats: %s", FormatSummary(sample).c_str());
+        NOTICE_LOG(COMMON, "memory: %s", FormatMemory(sample).c_str());
+        for (const PerfRate& rate : sample.perf) {
+            NOTICE_LOG(COMMON, "perf: %s", FormatPerfRate(rate).c_str());
+        }
+    }
+    if (g_json_file.IsOpen()) {
+        // Flushed every line, a run that's killed still leaves its samples readable
+        const std::string json = FormatJson(sample);
+        g_json_file.WriteBytes(json.data(), json.size());
+        g_json_file.Flush();
+    }
+
+    std::lock_guard<std::mutex> lock(g_sample_lock);
+    g_last_sample = sample;
+    g_has_sample = true;
+}
+
+/**
+ * Gets the last sample taken, from any thread
+ * @param sample Receives the sample
+ * @return True if one was taken since Init
+ */
+bool GetLastSample(Sample& sample) {
+    std::lock_guard<std::mutex> lock(g_sample_lock);
+    if (!g_has_sample) {
+        return false;
+    }
+    sample = g_last_sample;
+    return true;
+}
+
+/**
+ * Formats the rates of a sample on one line, for a status bar or a log
+ * @param sample Sample to format
+ * @return The line, without the SVC and command breakdowns
+ */
+std::string FormatSummary(const Sample& sample) {
+    return StringFromFormat("%.1f MIPS | %.1f FPS (host %.1f) | speed %.0f%% | idle %.0f%% | "
+        "%.0f SVC/s | %.0f IPC/s | %.0f events/s | memory %.0f of %.0f MB", sample.mips,
+        sample.emulated_fps, sample.host_fps, sample.speed, sample.idle, sample.svcs_per_second,
+        sample.ipc_per_second, sample.events_per_second, sample.memory_committed / 1048576.0,
+        sample.memory_reserved / 1048576.0);
+}
+
+/**
+ * Formats the host memory of every tag of a sample on one line
+ * @param sample Sample to format
+ * @return The line, with the high-water marks and the budgets
+ */
+std::string FormatMemory(const Sample& sample) {
+    std::string line;
+    for (int tag = 0; tag < Common::MemoryTracker::NUM_TAGS; tag++) {
+        const Common::MemoryTracker::Usage& usage = sample.memory[tag];
+        line += StringFromFormat("%s%s %.1f MB (peak %.1f", tag != 0 ? " | " : "",
+            Common::MemoryTracker::GetTagName((Common::MemoryTracker::Tag)tag),
+            usage.bytes / 1048576.0, usage.peak / 1048576.0);
+        if (usage.budget != 0) {
+            line += StringFromFormat(", budget %.0f MB", usage.budget / 1048576.0);
+        }
+        if (usage.count != 0) {
+            line += StringFromFormat(", %lld allocations", (long long)usage.count);
+        }
+        line += ")";
+    }
+    return line;
+}
+
+/**
+ * Formats the performance counter rates of a region on one line
+ * @param rate Rates of the region
+ * @return The line, with the instructions per cycle and the misses per 1000 instructions
+ */
+std::string FormatPerfRate(const PerfRate& rate) {
+    using namespace Common::PerfCounters;
+    const double cycles = std::max(rate.per_second[CYCLES], 1.0);
+    const double kilo_instructions = std::max(rate.per_second[INSTRUCTIONS] / 1000.0, 1e-3);
+    return StringFromFormat("%s: %.0f Mcycles/s | %.2f IPC | %.2f cache misses/k | "
+        "%.2f branch misses/k", rate.name.c_str(), rate.per_second[CYCLES] / 1000000.0,
+        rate.per_second[INSTRUCTIONS] / cycles, rate.per_second[CACHE_MISSES] / kilo_instructions,
+        rate.per_second[BRANCH_MISSES] / kilo_instructions);
+}
+
+} // namespace
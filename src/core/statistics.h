@@ -0,0 +1,100 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/memory_tracker.h"
+#include "common/perf_counters.h"
+
+/**
+ * Runtime statistics of the emulation, sampled about once a second of real time. The GPU updates
+ * them once per emulated frame on the emulation thread, frontends read the last sample from any
+ * thread to show it, and the statistics can be logged or written as JSON lines as they're taken.
+ */
+namespace Statistics {
+
+/// Rate of one kind of call, an SVC or a service command
+struct Rate {
+    std::string name;
+    double      per_second;
+};
+
+/// Host performance counter rates of a region, see Common::PerfCounters
+struct PerfRate {
+    std::string name;
+    double      per_second[Common::PerfCounters::NUM_EVENTS];
+};
+
+/// Rates over the interval between two samples
+struct Sample {
+    double host_seconds;        ///< Length of the interval in real time
+    double mips;                ///< Millions of guest instructions per second
+    double emulated_fps;        ///< Frames the guest presented per second
+    double host_fps;            ///< Frames the renderer presented per second
+    double speed;               ///< Emulated time in percent of real time
+    double idle;                ///< Emulated time the CPU idled, in percent
+    double svcs_per_second;
+    double ipc_per_second;
+    double events_per_second;   ///< CoreTiming event callbacks run per second
+    u64 memory_committed;       ///< Bytes of guest memory backed by host memory at the end
+    u64 memory_reserved;        ///< Bytes of guest memory reserved
+    /// Host memory of every Common::MemoryTracker tag at the end, with the high-water marks
+    Common::MemoryTracker::Usage memory[Common::MemoryTracker::NUM_TAGS];
+    std::vector<Rate> svcs;     ///< SVCs called in the interval, busiest first
+    std::vector<Rate> ipc;      ///< Service commands called in the interval, busiest first
+    std::vector<PerfRate> perf; ///< Regions counted in the interval, empty unless counting
+};
+
+/// Whether every sample is logged as it's taken
+extern bool g_log_enabled;
+
+/// Initialize the statistics, the first sample covers the time from the first frame
+void Init();
+
+/// Shutdown the statistics, closing the JSON output
+void Shutdown();
+
+/**
+ * Writes every sample as a line of JSON to a file as it's taken, until Shutdown
+ * @param filename File to write to, truncated
+ * @return True on success
+ */
+bool SetJsonOutput(const std::string& filename);
+
+/// Takes a sample if a second passed since the last one, called once per emulated frame
+void Update();
+
+/**
+ * Gets the last sample taken, from any thread
+ * @param sample Receives the sample
+ * @return True if one was taken since Init
+ */
+bool GetLastSample(Sample& sample);
+
+/**
+ * Formats the rates of a sample on one line, for a status bar or a log
+ * @param sample Sample to format
+ * @return The line, without the SVC and command breakdowns
+ */
+std::string FormatSummary(const Sample& sample);
+
+/**
+ * Formats the host memory of every tag of a sample on one line
+ * @param sample Sample to format
+ * @return The line, with the high-water marks and the budgets
+ */
+std::string FormatMemory(const Sample& sample);
+
+/**
+ * Formats the performance counter rates of a region on one line
+ * @param rate Rates of the region
+ * @return The line, with the instructions per cycle and the misses per 1000 instructions
+ */
+std::string FormatPerfRate(const PerfRate& rate);
+
+} // namespace
@@ -0,0 +1,193 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/fifo_queue.h"
+#include "common/log.h"
+#include "common/thread.h"
+
+#include "core/core.h"
+#include "core/sys_core.h"
+#include "core/arm/exclusive_monitor.h"
+#include "core/hle/hle.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/thread.h"
+
+namespace SysCore {
+
+bool g_enabled = false;
+bool g_threaded = true;
+
+namespace {
+
+std::thread*                g_thread = nullptr; ///< Host thread running the sys core
+std::thread::id             g_thread_id;        ///< Id of g_thread
+Common::Event               g_start_event;      ///< Signalled by the app core to start a slice
+Common::Event               g_done_event;       ///< Signalled by the sys core when a slice is done
+bool                        g_quit = false;     ///< Tells the sys core thread to exit
+bool                        g_slice_running = false;    ///< Whether a slice was started
+int                         g_slice_cycles = 0; ///< Length of the slice to run
+bool                        g_svc_pending = false;  ///< Whether the slice ended at an SVC
+bool                        g_running_inline = false;   ///< App core thread runs the sys core
+u32                         g_svc_opcode = 0;   ///< SVC instruction word the slice ended at
+u32*                        g_svc_regs = nullptr;   ///< Register file of the sys core
+
+Common::FifoQueue<Request>  g_to_sys;           ///< Requests from the app core to the sys core
+Common::FifoQueue<Request>  g_to_app;           ///< Requests from the sys core to the app core
+
+/**
+ * Runs all queued requests
+ * @param queue Queue to drain
+ */
+void Drain(Common::FifoQueue<Request>& queue) {
+    Request request;
+    while (queue.Pop(request)) {
+        request();
+    }
+}
+
+/// Sys core thread: runs one slice each time the app core starts one
+void ThreadFunc() {
+    Common::SetCurrentThreadName("SysCore");
+
+    for (;;) {
+        g_start_event.Wait();
+        if (g_quit) {
+            break;
+        }
+        Drain(g_to_sys);
+        if (g_enabled) {
+            Core::g_sys_core->Run(g_slice_cycles);
+        }
+        g_done_event.Set();
+    }
+}
+
+} // namespace
+
+/// Starts the sys core thread if the threaded mode is enabled
+void Init() {
+    g_quit = false;
+    g_slice_running = false;
+    g_svc_pending = false;
+    if (!g_threaded) {
+        NOTICE_LOG(ARM11, "sys core runs on the app core thread");
+        return;
+    }
+    g_thread = new std::thread(ThreadFunc);
+    g_thread_id = g_thread->get_id();
+
+    NOTICE_LOG(ARM11, "sys core thread started");
+}
+
+/// Stops and joins the sys core thread
+void Shutdown() {
+    // The slice running ends, an SVC it ended at is dropped along with the kernel
+    g_quit = true;
+    if (g_thread != nullptr) {
+        EndSlice();
+
+        g_start_event.Set();
+        g_thread->join();
+        delete g_thread;
+        g_thread = nullptr;
+        g_thread_id = std::thread::id();
+    }
+    g_slice_running = false;
+    g_svc_pending = false;
+
+    g_to_sys.Clear();
+    g_to_app.Clear();
+}
+
+/**
+ * Lets the sys core run a slice concurrently with the app core. Called by the app core loop.
+ * @param cycles Length of the slice, in instructions
+ */
+void BeginSlice(int cycles) {
+    // No core runs between slices, the app core sees the switch before its next instruction
+    ExclusiveMonitor::SetShared(g_thread != nullptr && g_enabled);
+
+    // With nothing to run and nothing to deliver there's no point in waking the thread up
+    if (!g_enabled && g_to_sys.Empty()) {
+        return;
+    }
+    g_slice_cycles = cycles;
+    g_slice_running = true;
+    if (g_thread != nullptr) {
+        g_start_event.Set();
+    }
+}
+
+/// Waits for the sys core to finish its slice, serves its SVC and runs the requests it posted
+void EndSlice() {
+    if (g_slice_running && g_thread == nullptr) {
+        // The app core's slice is over, the sys core runs its own in its place
+        g_running_inline = true;
+        Drain(g_to_sys);
+        if (g_enabled) {
+            Core::g_sys_core->Run(g_slice_cycles);
+        }
+        g_running_inline = false;
+        g_slice_running = false;
+    } else if (g_slice_running) {
+        g_done_event.Wait();
+        g_slice_running = false;
+    }
+    // The sys core is done with the page table, a process switch made during the slice happens now
+    Kernel::SyncCurrentProcess();
+    Drain(g_to_app);
+
+    if (g_svc_pending && !g_quit) {
+        g_svc_pending = false;
+        Kernel::SetCallingCore(THREADCORE_SYS);
+        HLE::CallSVC(g_svc_opcode, g_svc_regs);
+        Kernel::SetCallingCore(THREADCORE_APP);
+    }
+}
+
+/// Whether the calling host thread is the sys core thread, or runs the sys core slice without it
+bool IsSysCoreThread() {
+    if (g_thread == nullptr) {
+        return g_running_inline;
+    }
+    return std::this_thread::get_id() == g_thread_id;
+}
+
+/// Whether a slice was started and not ended yet, during which the sys core may run
+bool IsSliceRunning() {
+    return g_slice_running;
+}
+
+/**
+ * Ends the slice of the sys core at an SVC, which is served at the sync point. Must only be called
+ * from the sys core thread.
+ * @param opcode SVC instruction word
+ * @param regs Register file of the sys core
+ */
+void DeferSVC(u32 opcode, u32* regs) {
+    g_svc_opcode = opcode;
+    g_svc_regs = regs;
+    g_svc_pending = true;
+    Core::g_sys_core->PrepareReschedule();
+}
+
+/**
+ * Queues a request to run on the sys core thread at the start of its next slice. Must only be
+ * called from the app core thread.
+ * @param request Function to run
+ */
+void PostToSys(Request request) {
+    g_to_sys.Push(std::move(request));
+}
+
+/**
+ * Queues a request to run on the app core thread at the end of the current slice. Must only be
+ * called from the sys core thread.
+ * @param request Function to run
+ */
+void PostToApp(Request request) {
+    g_to_app.Push(std::move(request));
+}
+
+} // namespace
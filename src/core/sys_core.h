@@ -0,0 +1,73 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+
+#include "common/common_types.h"
+
+/**
+ * Host thread running the ARM11 system core (Core::g_sys_core) next to the application core. The
+ * two cores only meet at slice boundaries: the app core loop starts a sys core slice of the same
+ * length before running its own and waits for it when the slice ends, right before CoreTiming
+ * events are dispatched. Work one core wants done in the other's context (shared memory and IPC
+ * traffic) is posted through a lock-free queue per direction and run at the next sync point.
+ * The kernel only runs on the app core thread: an SVC of the sys core ends its slice, and the app
+ * core thread serves it at the sync point before the sys core resumes.
+ * Without the thread (g_threaded off) the app core thread runs the sys core slice itself at the
+ * sync point, after its own, the same way otherwise.
+ */
+namespace SysCore {
+
+/// Function run in the context of the other core at the next sync point
+typedef std::function<void()> Request;
+
+extern bool g_enabled;  ///< Whether the sys core runs code, set by the kernel as it has a thread
+extern bool g_threaded; ///< Whether the sys core runs on a host thread of its own, read by Init
+
+/// Starts the sys core thread if the threaded mode is enabled
+void Init();
+
+/// Stops and joins the sys core thread
+void Shutdown();
+
+/**
+ * Lets the sys core run a slice concurrently with the app core. Called by the app core loop.
+ * @param cycles Length of the slice, in instructions
+ */
+void BeginSlice(int cycles);
+
+/// Waits for the sys core to finish its slice, serves its SVC and runs the requests it posted
+void EndSlice();
+
+/// Whether the calling host thread is the sys core thread, or runs the sys core slice without it
+bool IsSysCoreThread();
+
+/// Whether a slice was started and not ended yet, during which the sys core may run
+bool IsSliceRunning();
+
+/**
+ * Ends the slice of the sys core at an SVC, which is served at the sync point. Must only be called
+ * from the sys core thread.
+ * @param opcode SVC instruction word
+ * @param regs Register file of the sys core
+ */
+void DeferSVC(u32 opcode, u32* regs);
+
+/**
+ * Queues a request to run on the sys core thread at the start of its next slice. Must only be
+ * called from the app core thread.
+ * @param request Function to run
+ */
+void PostToSys(Request request);
+
+/**
+ * Queues a request to run on the app core thread at the end of the current slice. Must only be
+ * called from the sys core thread.
+ * @param request Function to run
+ */
+void PostToApp(Request request);
+
+} // namespace
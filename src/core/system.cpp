@@ -2,9 +2,23 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <thread>
+
+#include "common/cpu_detect.h"
+#include "common/string_util.h"
+#include "common/timer.h"
+
+#include "core/audio_output.h"
+#include "core/boot_snapshot.h"
 #include "core/core.h"
 #include "core/core_timing.h"
 #include "core/mem_map.h"
+#include "core/movie.h"
+#include "core/rewind.h"
+#include "core/run_ahead.h"
+#include "core/savestate.h"
+#include "core/speed_limiter.h"
+#include "core/statistics.h"
 #include "core/system.h"
 #include "core/hw/hw.h"
 #include "core/hle/hle.h"
@@ -13,19 +27,88 @@
 
 namespace System {
 
-volatile State g_state;
+volatile State g_state = STATE_NULL;
 MetaFileSystem g_ctr_file_system;
 
-void UpdateState(State state) {
-}
+namespace {
 
-void Init(EmuWindow* emu_window) {
-    Core::Init();
+/// Phases of Init, timed as they run
+enum Phase {
+    PHASE_CORE,         ///< Cores, CoreTiming and the speed limiter
+    PHASE_MEMORY,
+    PHASE_HW,
+    PHASE_HLE,          ///< Services and HLE modules
+    PHASE_VIDEO,        ///< Renderer, shader caches and rasterizer threads
+    NUM_PHASES,
+};
+
+const char* const kPhaseNames[NUM_PHASES] = { "core", "memory", "hw", "hle", "video" };
+
+u64 g_phase_times_us[NUM_PHASES];
+
+/// Initializes memory, the hardware and HLE, which no part of the video core depends on
+void InitEmulated() {
+    u64 start = Common::Timer::GetTimeUs();
     Memory::Init();
+    u64 end = Common::Timer::GetTimeUs();
+    g_phase_times_us[PHASE_MEMORY] = end - start;
+
+    start = end;
     HW::Init();
+    end = Common::Timer::GetTimeUs();
+    g_phase_times_us[PHASE_HW] = end - start;
+
+    start = end;
     HLE::Init();
+    g_phase_times_us[PHASE_HLE] = Common::Timer::GetTimeUs() - start;
+}
+
+} // namespace
+
+void UpdateState(State state) {
+}
+
+/**
+ * Initializes the subsystems, the system goes from STATE_NULL to STATE_IDLE
+ * @param emu_window Window the renderer presents to
+ * @return True on success, false if the system is initialized already
+ */
+bool Init(EmuWindow* emu_window) {
+    // The subsystems keep their state in globals, a second system would run on the same state
+    if (g_state != STATE_NULL) {
+        ERROR_LOG(COMMON, "The system is initialized already, one runs per process");
+        return false;
+    }
+
+    // The SIMD paths are picked from it, which one ran matters when comparing hosts
+    NOTICE_LOG(COMMON, "host CPU: %s", cpu_info.Summarize().c_str());
+
+    const u64 start = Common::Timer::GetTimeUs();
+    Core::Init();
     CoreTiming::Init();
+    SpeedLimiter::Init();
+    g_phase_times_us[PHASE_CORE] = Common::Timer::GetTimeUs() - start;
+
+    // The renderer stays on the calling thread, which the window's context is made current on,
+    // while the emulated side comes up on another: both mostly wait on the host, for the driver
+    // to create the context and the shader caches to open, and for the guest memory to be mapped
+    std::thread emulated_thread(InitEmulated);
+    const u64 video_start = Common::Timer::GetTimeUs();
     VideoCore::Init(emu_window);
+    g_phase_times_us[PHASE_VIDEO] = Common::Timer::GetTimeUs() - video_start;
+    emulated_thread.join();
+
+    Statistics::Init();
+    AudioOutput::Init();
+
+    std::string phases;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        phases += StringFromFormat(", %s %.1f ms", kPhaseNames[i], g_phase_times_us[i] / 1000.0);
+    }
+    NOTICE_LOG(COMMON, "initialized in %.1f ms%s", (Common::Timer::GetTimeUs() - start) / 1000.0,
+        phases.c_str());
+    g_state = STATE_IDLE;
+    return true;
 }
 
 void RunLoopFor(int cycles) {
@@ -35,14 +118,27 @@ void RunLoopFor(int cycles) {
 void RunLoopUntil(u64 global_cycles) {
 }
 
+/// Shuts the subsystems down, the system goes back to STATE_NULL and may be initialized again
 void Shutdown() {
+    if (g_state == STATE_NULL) {
+        return;
+    }
+    AudioOutput::Shutdown();
+    Statistics::Shutdown();
+    Movie::Shutdown();
+    SaveState::Shutdown();
+    BootSnapshot::Shutdown();
+    Rewind::Shutdown();
+    RunAhead::Shutdown();
     Core::Shutdown();
     Memory::Shutdown();
     HW::Shutdown();
     HLE::Shutdown();
     CoreTiming::Shutdown();
+    SpeedLimiter::Shutdown();
     VideoCore::Shutdown();
     g_ctr_file_system.Shutdown();
+    g_state = STATE_NULL;
 }
 
 } // namespace
@@ -9,6 +9,14 @@
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * The emulated system, which initializes the subsystems in dependency order and shuts them down.
+ * The subsystems keep their state in globals: the cores (Core::g_app_core), memory
+ * (Memory::g_heap...), the GPU registers (GPU::g_regs), the kernel objects
+ * (Kernel::g_object_pool), the services (Service::g_manager), the renderer (VideoCore::g_renderer)
+ * and the CoreTiming queues. There's thus one system per process, initialized at most once at a
+ * time; runs that have to happen side by side are separate processes, see citra --batch.
+ */
 namespace System {
 
 // State of the full emulator
@@ -27,9 +35,18 @@ extern volatile State g_state;
 extern MetaFileSystem g_ctr_file_system;
 
 void UpdateState(State state);
-void Init(EmuWindow* emu_window);
+
+/**
+ * Initializes the subsystems, the system goes from STATE_NULL to STATE_IDLE
+ * @param emu_window Window the renderer presents to
+ * @return True on success, false if the system is initialized already
+ */
+bool Init(EmuWindow* emu_window);
+
 void RunLoopFor(int cycles);
 void RunLoopUntil(u64 global_cycles);
+
+/// Shuts the subsystems down, the system goes back to STATE_NULL and may be initialized again
 void Shutdown();
 
 };
@@ -0,0 +1,200 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/common.h"
+
+#include "core/time_stretcher.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Sequences of 40 ms cross-faded over 8 ms and looked for within 15 ms, short enough not to echo
+// and long enough to hold a period of the lowest voices
+const u32 kSequenceMs   = 40;
+const u32 kOverlapMs    = 8;
+const u32 kSeekMs       = 15;
+
+const float kMinTempo   = 0.25f;
+const float kMaxTempo   = 4.0f;
+
+/**
+ * Gets the dot product of two runs of floats
+ * @param a First run
+ * @param b Second run
+ * @param count Number of floats, a multiple of 4
+ * @return Sum of a[i] * b[i]
+ */
+float DotProduct(const float* a, const float* b, u32 count) {
+#ifdef _M_X64
+    __m128 sum = _mm_setzero_ps();
+    for (u32 i = 0; i < count; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#else
+    float sum = 0.0f;
+    for (u32 i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+/**
+ * Converts a float sample to 16 bits, saturated
+ * @param value Sample, in the range of s16
+ * @return Saturated sample
+ */
+s16 ToPcm16(float value) {
+    value = std::max(-32768.0f, std::min(32767.0f, value));
+    return (s16)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+}
+
+} // namespace
+
+/**
+ * Sizes the sequences for a sample rate
+ * @param sample_rate Rate of the input and output samples, in Hz
+ */
+TimeStretcher::TimeStretcher(u32 sample_rate) {
+    // The overlap is a multiple of 2 samples, so that its interleaved floats are a multiple of 4
+    m_overlap = std::max((sample_rate * kOverlapMs / 1000) & ~1u, 16u);
+    m_sequence = std::max(sample_rate * kSequenceMs / 1000, 3 * m_overlap);
+    m_seek = std::max(sample_rate * kSeekMs / 1000, 1u);
+    m_tempo = 1.0f;
+    m_tail.resize(m_overlap * 2);
+    Clear();
+}
+
+/**
+ * Sets the tempo the samples pushed from now on play at
+ * @param tempo Input samples taken per output sample, 1 to play at the same speed
+ */
+void TimeStretcher::SetTempo(float tempo) {
+    m_tempo = std::max(kMinTempo, std::min(kMaxTempo, tempo));
+}
+
+/// Drops the buffered samples
+void TimeStretcher::Clear() {
+    m_skip_fraction = 0.0;
+    m_input.clear();
+    m_input_pos = 0;
+    std::fill(m_tail.begin(), m_tail.end(), 0.0f);
+    m_output.clear();
+    m_output_pos = 0;
+}
+
+/**
+ * Adds input samples
+ * @param samples Samples, left and right interleaved, 2 * count values
+ * @param count Number of samples
+ */
+void TimeStretcher::PushSamples(const s16* samples, size_t count) {
+    // The consumed samples are dropped once they're the bulk of the buffer
+    if (m_input_pos > 0 && m_input_pos * 2 >= m_input.size()) {
+        m_input.erase(m_input.begin(), m_input.begin() + m_input_pos);
+        m_input_pos = 0;
+    }
+    m_input.insert(m_input.end(), samples, samples + count * 2);
+    Process();
+}
+
+/**
+ * Takes output samples
+ * @param samples Receives the samples, left and right interleaved, 2 * max_count values
+ * @param max_count Most samples to take
+ * @return Number of samples taken
+ */
+size_t TimeStretcher::PopSamples(s16* samples, size_t max_count) {
+    const size_t count = std::min(max_count, (m_output.size() - m_output_pos) / 2);
+    std::copy(m_output.begin() + m_output_pos, m_output.begin() + m_output_pos + count * 2,
+        samples);
+    m_output_pos += count * 2;
+    if (m_output_pos * 2 >= m_output.size()) {
+        m_output.erase(m_output.begin(), m_output.begin() + m_output_pos);
+        m_output_pos = 0;
+    }
+    return count;
+}
+
+/**
+ * Gets the number of input samples buffered on top of the ones the next sequence is looked
+ * for in, and of output samples
+ * @return Samples that can play before the output runs dry, at a tempo of 1
+ */
+size_t TimeStretcher::GetBacklog() const {
+    const size_t input = (m_input.size() - m_input_pos) / 2;
+    const size_t window = m_seek + m_sequence;
+    return (input > window ? input - window : 0) + (m_output.size() - m_output_pos) / 2;
+}
+
+/**
+ * Looks for where a sequence lines up best with the end of the previous one
+ * @param input Input samples from the first offset looked at
+ * @return Offset of the sequence in samples, less than m_seek
+ */
+u32 TimeStretcher::SeekBestOverlap(const float* input) const {
+    const u32 values = m_overlap * 2;
+
+    // Correlation with the tail, normalized by the energy of the candidate
+    float energy = DotProduct(input, input, values);
+    float best_score = -1e30f;
+    u32 best_offset = 0;
+    for (u32 offset = 0; offset < m_seek; offset++) {
+        const float* candidate = &input[offset * 2];
+        const float score = DotProduct(m_tail.data(), candidate, values) /
+            std::sqrt(energy + 1.0f);
+        if (score > best_score) {
+            best_score = score;
+            best_offset = offset;
+        }
+        const float* first = &candidate[0];
+        const float* next = &candidate[values];
+        energy += next[0] * next[0] + next[1] * next[1] - first[0] * first[0] -
+            first[1] * first[1];
+        energy = std::max(energy, 0.0f);
+    }
+    return best_offset;
+}
+
+/// Makes output sequences of the input while there's enough of it
+void TimeStretcher::Process() {
+    const u32 window = m_seek + m_sequence;
+    const u32 overlap = m_overlap;
+    while ((m_input.size() - m_input_pos) / 2 >= window) {
+        const float* input = &m_input[m_input_pos];
+        const u32 offset = SeekBestOverlap(input);
+        const float* sequence = &input[offset * 2];
+
+        // Cross-fade from the tail of the previous sequence into this one
+        const float fade_step = 1.0f / overlap;
+        for (u32 i = 0; i < overlap; i++) {
+            const float fade = i * fade_step;
+            for (int c = 0; c < 2; c++) {
+                const float tail = m_tail[i * 2 + c];
+                m_output.push_back(ToPcm16(tail + (sequence[i * 2 + c] - tail) * fade));
+            }
+        }
+        for (u32 i = overlap * 2; i < (m_sequence - overlap) * 2; i++) {
+            m_output.push_back(ToPcm16(sequence[i]));
+        }
+        std::copy(&sequence[(m_sequence - overlap) * 2], &sequence[m_sequence * 2],
+            m_tail.begin());
+
+        // Each sequence plays m_sequence - overlap samples and moves the input on by tempo times
+        // as many
+        const double skip = m_tempo * (m_sequence - overlap) + m_skip_fraction;
+        const size_t whole = (size_t)skip;
+        m_skip_fraction = skip - whole;
+        m_input_pos += std::min(whole * 2, m_input.size() - m_input_pos);
+    }
+}
@@ -0,0 +1,84 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+
+/**
+ * Changes the tempo of stereo audio without changing its pitch, by WSOLA (waveform similarity
+ * overlap-add): the output is made of sequences of the input taken further apart or closer
+ * together than they are played, each one where it best lines up with the end of the previous one
+ * and cross-faded into it.
+ */
+class TimeStretcher {
+public:
+    /**
+     * Sizes the sequences for a sample rate
+     * @param sample_rate Rate of the input and output samples, in Hz
+     */
+    explicit TimeStretcher(u32 sample_rate);
+
+    /**
+     * Sets the tempo the samples pushed from now on play at
+     * @param tempo Input samples taken per output sample, 1 to play at the same speed
+     */
+    void SetTempo(float tempo);
+
+    /// Gets the current tempo
+    float GetTempo() const {
+        return m_tempo;
+    }
+
+    /**
+     * Adds input samples
+     * @param samples Samples, left and right interleaved, 2 * count values
+     * @param count Number of samples
+     */
+    void PushSamples(const s16* samples, size_t count);
+
+    /**
+     * Takes output samples
+     * @param samples Receives the samples, left and right interleaved, 2 * max_count values
+     * @param max_count Most samples to take
+     * @return Number of samples taken
+     */
+    size_t PopSamples(s16* samples, size_t max_count);
+
+    /**
+     * Gets the number of input samples buffered on top of the ones the next sequence is looked
+     * for in, and of output samples
+     * @return Samples that can play before the output runs dry, at a tempo of 1
+     */
+    size_t GetBacklog() const;
+
+    /// Drops the buffered samples
+    void Clear();
+
+private:
+    /// Makes output sequences of the input while there's enough of it
+    void Process();
+
+    /**
+     * Looks for where a sequence lines up best with the end of the previous one
+     * @param input Input samples from the first offset looked at
+     * @return Offset of the sequence in samples, less than m_seek
+     */
+    u32 SeekBestOverlap(const float* input) const;
+
+    u32                 m_sequence;     ///< Samples of a sequence, overlaps included
+    u32                 m_overlap;      ///< Samples cross-faded between two sequences
+    u32                 m_seek;         ///< Offsets a sequence is looked for at
+
+    float               m_tempo;
+    double              m_skip_fraction;///< Input samples to skip left over from the last sequence
+
+    std::vector<float>  m_input;        ///< Input samples from m_input_pos on, interleaved
+    size_t              m_input_pos;
+    std::vector<float>  m_tail;         ///< End of the previous sequence, to cross-fade with
+    std::vector<s16>    m_output;       ///< Output samples from m_output_pos on, interleaved
+    size_t              m_output_pos;
+};
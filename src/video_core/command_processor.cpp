@@ -0,0 +1,301 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <set>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
+
+#include "core/hw/gpu.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/rasterizer.h"
+#include "video_core/vertex_cache.h"
+#include "video_core/vertex_loader.h"
+#include "video_core/vertex_shader.h"
+#include "video_core/video_core.h"
+
+namespace Pica {
+
+RegisterSet<u32, Regs> g_regs;
+
+namespace CommandProcessor {
+
+static WriteHandler g_write_handlers[Regs::NumIds];  ///< Side effect of each register, or NULL
+static u8 g_register_groups[Regs::NumIds];  ///< Group (DIRTY_*) of each register, 0 for none
+static u32 g_dirty_groups;                  ///< Groups changed since their consumer took them
+
+/// Bit mask of the bytes enabled by each value of CommandHeader::parameter_mask
+static const u32 kParameterMasks[16] = {
+    0x00000000, 0x000000FF, 0x0000FF00, 0x0000FFFF,
+    0x00FF0000, 0x00FF00FF, 0x00FFFF00, 0x00FFFFFF,
+    0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFF00FFFF,
+    0xFFFF0000, 0xFFFF00FF, 0xFFFFFF00, 0xFFFFFFFF,
+};
+
+/**
+ * Writes the enabled bytes of a parameter to a register and runs the side effect of the write
+ * @param id Register to write
+ * @param value Parameter of the command
+ * @param mask Bit mask of the bytes to write
+ */
+static inline void WriteRegister(u32 id, u32 value, u32 mask) {
+    if (id >= Regs::NumIds) {
+        ERROR_LOG(GPU, "command list writes to invalid register 0x%03X", id);
+        return;
+    }
+    u32& reg = g_regs[static_cast<Regs::Id>(id)];
+    const u32 old_value = reg;
+    reg = (reg & ~mask) | (value & mask);
+
+    // Command lists rewrite most registers with the values they already have every frame
+    if (reg != old_value) {
+        g_dirty_groups |= g_register_groups[id];
+    }
+
+    if (g_write_handlers[id] != NULL) {
+        g_write_handlers[id](id);
+    }
+}
+
+// Vertices of the last draw, kept to reuse memory
+static std::vector<Float4> g_vertex_buffer;
+static std::vector<u32> g_indices;
+static std::vector<VertexShader::OutputVertex> g_shaded_vertices;
+
+static Common::Profiler::Category g_profile_command_list("GPU command list");
+static Common::PerfCounters::Region g_perf_command_list("GPU command list");
+
+// Color buffers the display transfers presented to each eye of the top screen
+static std::set<u32> g_left_eye_buffers;
+static std::set<u32> g_right_eye_buffers;
+
+// Color buffers the display transfers presented to either screen in this frame and the one before,
+// and copied elsewhere, which the guest may read
+static std::set<u32> g_frame_buffers;
+static std::set<u32> g_last_frame_buffers;
+static std::set<u32> g_copied_buffers;
+
+static bool g_frame_skipped = false;    ///< Whether frameskip skips the frame, see SetFrameSkipped
+static bool g_skip_draws = false;       ///< The current color buffer isn't rendered
+
+/// Decides whether the draws to the color buffer currently set in g_regs are skipped
+static void UpdateSkipDraws() {
+    const u32 address = g_regs.Get<Regs::ColorBufferAddress>().GetPhysicalAddress();
+    const bool right_eye_only = g_right_eye_buffers.count(address) != 0 &&
+        g_left_eye_buffers.count(address) == 0;
+    // Buffers presented once, e.g. a bottom screen drawn when it changes, are rendered whatever
+    // the frame
+    const bool skipped = g_frame_skipped && g_last_frame_buffers.count(address) != 0 &&
+        g_copied_buffers.count(address) == 0;
+    g_skip_draws = (VideoCore::g_mono_enabled && right_eye_only) || skipped;
+}
+
+/// Draw triggers: loads, shades and bins the vertices of the draw
+static void OnTriggerDraw(u32 id) {
+    if (g_skip_draws) {
+        return;
+    }
+    const VertexLoader& loader = VertexLoader::Get();
+    const u32 num_vertices = g_regs[Regs::NumVertices];
+
+    if (g_shaded_vertices.size() < num_vertices) {
+        g_shaded_vertices.resize(num_vertices);
+    }
+    if (id == Regs::TriggerDraw) {
+        const size_t size = num_vertices * loader.GetNumAttributes();
+        if (g_vertex_buffer.size() < size) {
+            g_vertex_buffer.resize(size);
+        }
+        loader.LoadVertices(g_regs[Regs::VertexOffset], num_vertices, g_vertex_buffer.data());
+        VertexShader::RunShader(g_vertex_buffer.data(), loader.GetNumAttributes(), num_vertices,
+            g_shaded_vertices.data());
+    } else {
+        // Indexed draws reference vertices repeatedly, each is shaded about once
+        if (g_indices.size() < num_vertices) {
+            g_indices.resize(num_vertices);
+        }
+        if (!VertexLoader::LoadIndices(num_vertices, g_indices.data())) {
+            return;
+        }
+        VertexCache::ShadeIndexedVertices(loader, g_indices.data(), num_vertices,
+            g_shaded_vertices.data());
+    }
+    Rasterizer::SubmitPrimitives(g_shaded_vertices.data(), num_vertices);
+}
+
+/// Color buffer changes: renders the triangles binned for the previous color buffer
+static void OnColorBufferChange(u32 id) {
+    Rasterizer::Flush();
+    UpdateSkipDraws();
+}
+
+/**
+ * Sets the function called on writes to a register
+ * @param id Register
+ * @param handler Function to call after each write, NULL for none
+ */
+void SetWriteHandler(Regs::Id id, WriteHandler handler) {
+    _dbg_assert_(GPU, id < Regs::NumIds);
+    g_write_handlers[id] = handler;
+}
+
+/**
+ * Executes a command list in place
+ * @param list Pointer to the first word of the list
+ * @param size Size of the list in bytes
+ */
+void ProcessCommandList(const u32* list, u32 size) {
+    Common::Profiler::Scope scope(g_profile_command_list);
+    Common::PerfCounters::Scope perf_scope(g_perf_command_list);
+    const u32* cur = list;
+    const u32* end = list + size / sizeof(u32);
+
+    // Each command is its first parameter followed by the header and the extra parameters, padded
+    // to a multiple of 8 bytes
+    while (end - cur >= 2) {
+        const CommandHeader header(cur[1]);
+        const u32 num_extra = header.extra_data_length;
+        if ((u32)(end - cur - 2) < num_extra) {
+            ERROR_LOG(GPU, "command list ends in the middle of a command at 0x%08X",
+                (u32)((cur - list) * sizeof(u32)));
+            break;
+        }
+
+        const u32 mask = kParameterMasks[header.parameter_mask];
+        u32 id = header.cmd_id;
+        WriteRegister(id, cur[0], mask);
+
+        // Grouped commands write consecutive registers, others write the same one repeatedly
+        const u32 id_step = header.group_commands;
+        for (u32 i = 0; i < num_extra; i++) {
+            id += id_step;
+            WriteRegister(id, cur[2 + i], mask);
+        }
+
+        cur += 2 + num_extra + (num_extra & 1);
+    }
+    Rasterizer::Flush();
+}
+
+/**
+ * Takes the dirty bits of register groups, clearing them. Each group has a single consumer: the
+ * vertex loader, or whichever rasterizer renders the draws.
+ * @param groups Groups to take (DIRTY_*)
+ * @return Those of the groups changed since they were last taken
+ */
+u32 TakeDirtyGroups(u32 groups) {
+    const u32 dirty = g_dirty_groups & groups;
+    g_dirty_groups &= ~groups;
+    return dirty;
+}
+
+/**
+ * Assigns a range of registers to a group
+ * @param first First register of the range
+ * @param last Last register of the range, inclusive
+ * @param group Group (DIRTY_*)
+ */
+static void SetRegisterGroup(u32 first, u32 last, u8 group) {
+    memset(&g_register_groups[first], group, last - first + 1);
+}
+
+/// Resets the register file and installs the default write handlers
+void Init() {
+    memset(&g_regs, 0, sizeof(g_regs));
+    VertexLoader::ClearCache();
+    memset(g_write_handlers, 0, sizeof(g_write_handlers));
+
+    memset(g_register_groups, 0, sizeof(g_register_groups));
+    SetRegisterGroup(Regs::CullMode, Regs::ViewportInvSizeY, DIRTY_VIEWPORT);
+    SetRegisterGroup(Regs::ViewportCorner, Regs::ViewportCorner, DIRTY_VIEWPORT);
+    SetRegisterGroup(Regs::TevStage0Source, 0xFF, DIRTY_COMBINERS);
+    SetRegisterGroup(Regs::ColorOperation, Regs::AlphaTest, DIRTY_BLENDING);
+    SetRegisterGroup(Regs::DepthBufferFormat, Regs::ColorBufferSize, DIRTY_FRAMEBUFFER);
+    SetRegisterGroup(Regs::VertexDescriptor, Regs::IndexArrayConfig - 1, DIRTY_VERTEX_ARRAYS);
+    g_dirty_groups = DIRTY_ALL;
+
+    SetWriteHandler(Regs::TriggerDraw, OnTriggerDraw);
+    SetWriteHandler(Regs::TriggerDrawIndexed, OnTriggerDraw);
+    SetWriteHandler(Regs::ColorBufferFormat, OnColorBufferChange);
+    SetWriteHandler(Regs::ColorBufferAddress, OnColorBufferChange);
+    SetWriteHandler(Regs::ColorBufferSize, OnColorBufferChange);
+    VertexShader::Init();
+    g_left_eye_buffers.clear();
+    g_right_eye_buffers.clear();
+    g_frame_buffers.clear();
+    g_last_frame_buffers.clear();
+    g_copied_buffers.clear();
+    g_frame_skipped = false;
+    g_skip_draws = false;
+}
+
+/**
+ * Notes the color buffer a display transfer presents, or copies for the guest to read. With
+ * VideoCore::g_mono_enabled set, the draws to color buffers only ever presented to the right eye
+ * of the top screen are skipped. Must not be called while a command list is being executed.
+ * @param input_address Physical address of the color buffer
+ * @param output_address Physical address of the framebuffer of the screen, or of the copy
+ */
+void OnDisplayTransfer(u32 input_address, u32 output_address) {
+    if (output_address == GPU::g_regs.framebuffer_top_left_1 ||
+        output_address == GPU::g_regs.framebuffer_top_left_2) {
+        g_left_eye_buffers.insert(input_address);
+        g_frame_buffers.insert(input_address);
+    } else if (output_address == GPU::g_regs.framebuffer_top_right_1 ||
+        output_address == GPU::g_regs.framebuffer_top_right_2) {
+        g_right_eye_buffers.insert(input_address);
+        g_frame_buffers.insert(input_address);
+    } else if (output_address == GPU::g_regs.framebuffer_sub_left_1 ||
+        output_address == GPU::g_regs.framebuffer_sub_left_2) {
+        g_frame_buffers.insert(input_address);
+    } else {
+        g_copied_buffers.insert(input_address);
+    }
+    UpdateSkipDraws();
+}
+
+/**
+ * Sets whether the next frame is skipped by frameskip, called at the vertical blank of every frame
+ * while frameskip is on. A skipped frame skips the draws to the color buffers that were presented
+ * in the frame before and never copied for the guest; registers are written and the other draws
+ * rendered as usual, so that everything the guest reads stays up to date. Must not be called
+ * while a command list is being executed.
+ * @param skipped Whether the draws of the next frame are skipped
+ */
+void SetFrameSkipped(bool skipped) {
+    g_last_frame_buffers.swap(g_frame_buffers);
+    g_frame_buffers.clear();
+    g_frame_skipped = skipped;
+    UpdateSkipDraws();
+}
+
+/**
+ * Saves or loads the register file and the shader memory. Must not be called while a command
+ * list is being executed.
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    auto s = p.Section("Pica", 1);
+    if (!s) {
+        return;
+    }
+    p.DoVoid(&g_regs, sizeof(g_regs));
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // Vertex layouts are cached by the register values they were built from
+        VertexLoader::ClearCache();
+        g_dirty_groups = DIRTY_ALL;
+    }
+    VertexShader::DoState(p);
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,89 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+#include "common/register_set.h"
+
+#include "video_core/pica.h"
+
+class PointerWrap;
+
+namespace Pica {
+
+extern RegisterSet<u32, Regs> g_regs;   ///< PICA register file, written by command lists
+
+namespace CommandProcessor {
+
+/// Groups of registers the draws derive state from, marked dirty by writes changing their value
+enum {
+    DIRTY_VIEWPORT          = (1 << 0),     ///< Culling and viewport
+    DIRTY_FRAMEBUFFER       = (1 << 1),     ///< Color and depth buffers
+    DIRTY_VERTEX_ARRAYS     = (1 << 2),     ///< Layout of the vertex arrays
+    DIRTY_COMBINERS         = (1 << 3),     ///< Texture combiner stages
+    DIRTY_BLENDING          = (1 << 4),     ///< Blending and alpha test
+    DIRTY_ALL               = 0x1F,
+};
+
+/**
+ * Takes the dirty bits of register groups, clearing them. Each group has a single consumer: the
+ * vertex loader, or whichever rasterizer renders the draws.
+ * @param groups Groups to take (DIRTY_*)
+ * @return Those of the groups changed since they were last taken
+ */
+u32 TakeDirtyGroups(u32 groups);
+
+/**
+ * Side effect of a register write, called after the new value has been stored
+ * @param id Register that was written
+ */
+typedef void (*WriteHandler)(u32 id);
+
+/**
+ * Sets the function called on writes to a register
+ * @param id Register
+ * @param handler Function to call after each write, NULL for none
+ */
+void SetWriteHandler(Regs::Id id, WriteHandler handler);
+
+/**
+ * Executes a command list in place
+ * @param list Pointer to the first word of the list
+ * @param size Size of the list in bytes
+ */
+void ProcessCommandList(const u32* list, u32 size);
+
+/// Resets the register file and installs the default write handlers
+void Init();
+
+/**
+ * Notes the color buffer a display transfer presents, or copies for the guest to read. With
+ * VideoCore::g_mono_enabled set, the draws to color buffers only ever presented to the right eye
+ * of the top screen are skipped. Must not be called while a command list is being executed.
+ * @param input_address Physical address of the color buffer
+ * @param output_address Physical address of the framebuffer of the screen, or of the copy
+ */
+void OnDisplayTransfer(u32 input_address, u32 output_address);
+
+/**
+ * Sets whether the next frame is skipped by frameskip, called at the vertical blank of every frame
+ * while frameskip is on. A skipped frame skips the draws to the color buffers that were presented
+ * in the frame before and never copied for the guest; registers are written and the other draws
+ * rendered as usual, so that everything the guest reads stays up to date. Must not be called
+ * while a command list is being executed.
+ * @param skipped Whether the draws of the next frame are skipped
+ */
+void SetFrameSkipped(bool skipped);
+
+/**
+ * Saves or loads the register file and the shader memory. Must not be called while a command
+ * list is being executed.
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,777 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+#include "common/common.h"
+#include "common/hash.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/fragment_pipeline.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+namespace Pica {
+
+namespace FragmentPipeline {
+
+namespace {
+
+typedef Regs::Struct<Regs::TevStage0Source>::Source Source;
+typedef Regs::Struct<Regs::TevStage0Operand>::ColorModifier ColorModifier;
+typedef Regs::Struct<Regs::TevStage0Operand>::AlphaModifier AlphaModifier;
+typedef Regs::Struct<Regs::TevStage0Op>::Operation Operation;
+typedef Regs::Struct<Regs::AlphaTest>::Function AlphaTestFunction;
+typedef Regs::Struct<Regs::BlendFunc>::Equation BlendEquation;
+typedef Regs::Struct<Regs::BlendFunc>::Factor BlendFactor;
+
+enum {
+    SOURCE_FIELDS_MASK  = 0x0FFF0FFF,   ///< Fields of TevStage0Source
+    OPERAND_FIELDS_MASK = 0x00777FFF,   ///< Fields of TevStage0Operand
+    OP_FIELDS_MASK      = 0x000F000F,   ///< Fields of TevStage0Op
+    SCALE_FIELDS_MASK   = 0x00030003,   ///< Fields of TevStage0Scale
+};
+
+/// Colors a stage can read, in the register file of a quad
+enum Register {
+    REG_ZERO,                           ///< Sources that aren't emulated read as zero
+    REG_PRIMARY,
+    REG_TEXTURE0,
+    REG_CONSTANT,                       ///< Constant color of the current stage
+    REG_PREVIOUS,
+    NUM_REGISTERS,
+};
+
+#ifdef _M_X64
+
+/// A value of the four pixels of a quad
+typedef __m128 Lanes;
+
+inline Lanes Splat(float value) { return _mm_set1_ps(value); }
+inline Lanes Load(const float* values) { return _mm_loadu_ps(values); }
+inline void Store(float* values, Lanes a) { _mm_storeu_ps(values, a); }
+inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+inline Lanes Round(Lanes a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+
+/// Compares the pixels of a quad, bit n of the result is set if pixel n passed
+template <AlphaTestFunction function>
+inline int Compare(Lanes a, Lanes b) {
+    switch (function) {
+    case AlphaTestFunction::Equal:              return _mm_movemask_ps(_mm_cmpeq_ps(a, b));
+    case AlphaTestFunction::NotEqual:           return _mm_movemask_ps(_mm_cmpneq_ps(a, b));
+    case AlphaTestFunction::LessThan:           return _mm_movemask_ps(_mm_cmplt_ps(a, b));
+    case AlphaTestFunction::LessThanOrEqual:    return _mm_movemask_ps(_mm_cmple_ps(a, b));
+    case AlphaTestFunction::GreaterThan:        return _mm_movemask_ps(_mm_cmpgt_ps(a, b));
+    case AlphaTestFunction::GreaterThanOrEqual: return _mm_movemask_ps(_mm_cmpge_ps(a, b));
+    case AlphaTestFunction::Never:              return 0;
+    default:                                    return 0xF;
+    }
+}
+
+#else
+
+/// A value of the four pixels of a quad
+struct Lanes {
+    float v[4];
+};
+
+#define LANEWISE(expression) \
+    Lanes result; \
+    for (int n = 0; n < 4; n++) { \
+        result.v[n] = expression; \
+    } \
+    return result
+
+inline Lanes Splat(float value) { LANEWISE(value); }
+inline Lanes Load(const float* values) { LANEWISE(values[n]); }
+inline void Store(float* values, Lanes a) { memcpy(values, a.v, sizeof(a.v)); }
+inline Lanes Add(Lanes a, Lanes b) { LANEWISE(a.v[n] + b.v[n]); }
+inline Lanes Sub(Lanes a, Lanes b) { LANEWISE(a.v[n] - b.v[n]); }
+inline Lanes Mul(Lanes a, Lanes b) { LANEWISE(a.v[n] * b.v[n]); }
+inline Lanes Min(Lanes a, Lanes b) { LANEWISE(std::min(a.v[n], b.v[n])); }
+inline Lanes Max(Lanes a, Lanes b) { LANEWISE(std::max(a.v[n], b.v[n])); }
+inline Lanes Round(Lanes a) { LANEWISE(floorf(a.v[n] + 0.5f)); }
+
+#undef LANEWISE
+
+/// Compares the pixels of a quad, bit n of the result is set if pixel n passed
+template <AlphaTestFunction function>
+inline int Compare(Lanes a, Lanes b) {
+    int mask = 0;
+    for (int n = 0; n < 4; n++) {
+        bool passed;
+        switch (function) {
+        case AlphaTestFunction::Equal:              passed = a.v[n] == b.v[n]; break;
+        case AlphaTestFunction::NotEqual:           passed = a.v[n] != b.v[n]; break;
+        case AlphaTestFunction::LessThan:           passed = a.v[n] < b.v[n]; break;
+        case AlphaTestFunction::LessThanOrEqual:    passed = a.v[n] <= b.v[n]; break;
+        case AlphaTestFunction::GreaterThan:        passed = a.v[n] > b.v[n]; break;
+        case AlphaTestFunction::GreaterThanOrEqual: passed = a.v[n] >= b.v[n]; break;
+        case AlphaTestFunction::Never:              passed = false; break;
+        default:                                    passed = true; break;
+        }
+        mask |= passed ? 1 << n : 0;
+    }
+    return mask;
+}
+
+#endif // _M_X64
+
+inline Lanes Clamp(Lanes a) {
+    return Min(Max(a, Splat(0.0f)), Splat(1.0f));
+}
+
+/// RGBA color of the four pixels of a quad
+struct Color {
+    Lanes   c[4];
+};
+
+/// Color combiner input of the four pixels of a quad
+struct Rgb {
+    Lanes   c[3];
+};
+
+typedef void (*ColorInputFunc)(const Color& source, Rgb& out);
+typedef Lanes (*AlphaInputFunc)(const Color& source);
+typedef void (*ColorOpFunc)(const Rgb* in, Rgb& out);
+typedef Lanes (*AlphaOpFunc)(const Lanes* in);
+typedef int (*AlphaTestFunc)(Lanes value, Lanes reference);
+typedef void (*BlendFactorFunc)(const Color& source, const Color& dest, const Color& constant,
+    Color& out);
+typedef Lanes (*BlendEquationFunc)(Lanes source, Lanes dest, Lanes source_factor,
+    Lanes dest_factor);
+
+/// Combiner stage of a routine
+struct Stage {
+    int                 index;                  ///< Index of the stage, of its constant color
+    int                 num_color_inputs;
+    u8                  color_sources[3];       ///< Registers the inputs read
+    ColorInputFunc      color_inputs[3];
+    int                 num_alpha_inputs;
+    u8                  alpha_sources[3];       ///< Registers the inputs read
+    AlphaInputFunc      alpha_inputs[3];
+    ColorOpFunc         color_op;
+    AlphaOpFunc         alpha_op;
+    float               color_scale;
+    float               alpha_scale;
+};
+
+} // namespace
+
+/// Routine of a configuration
+struct Program {
+    Config              config;                 ///< Told apart from hash collisions
+    int                 num_stages;             ///< Stages left, the passthrough ones dropped
+    Stage               stages[NUM_TEV_STAGES];
+    AlphaTestFunc       alpha_test;             ///< NULL if every pixel passes
+    BlendFactorFunc     blend_factors[4];       ///< Source, dest RGB, source, dest alpha. NULL
+                                                ///< if blending is disabled.
+    BlendEquationFunc   blend_equations[2];     ///< RGB, alpha
+};
+
+namespace {
+
+std::unordered_multimap<u64, Program>   g_programs; ///< Routines by hash of configuration
+
+template <ColorModifier modifier>
+void ColorInput(const Color& s, Rgb& out) {
+    for (int c = 0; c < 3; c++) {
+        switch (modifier) {
+        case ColorModifier::OneMinusSourceColor:    out.c[c] = Sub(Splat(1.0f), s.c[c]); break;
+        case ColorModifier::SourceAlpha:            out.c[c] = s.c[3]; break;
+        case ColorModifier::OneMinusSourceAlpha:    out.c[c] = Sub(Splat(1.0f), s.c[3]); break;
+        case ColorModifier::SourceRed:              out.c[c] = s.c[0]; break;
+        case ColorModifier::OneMinusSourceRed:      out.c[c] = Sub(Splat(1.0f), s.c[0]); break;
+        case ColorModifier::SourceGreen:            out.c[c] = s.c[1]; break;
+        case ColorModifier::OneMinusSourceGreen:    out.c[c] = Sub(Splat(1.0f), s.c[1]); break;
+        case ColorModifier::SourceBlue:             out.c[c] = s.c[2]; break;
+        case ColorModifier::OneMinusSourceBlue:     out.c[c] = Sub(Splat(1.0f), s.c[2]); break;
+        default:                                    out.c[c] = s.c[c]; break;
+        }
+    }
+}
+
+template <AlphaModifier modifier>
+Lanes AlphaInput(const Color& s) {
+    switch (modifier) {
+    case AlphaModifier::OneMinusSourceAlpha:    return Sub(Splat(1.0f), s.c[3]);
+    case AlphaModifier::SourceRed:              return s.c[0];
+    case AlphaModifier::OneMinusSourceRed:      return Sub(Splat(1.0f), s.c[0]);
+    case AlphaModifier::SourceGreen:            return s.c[1];
+    case AlphaModifier::OneMinusSourceGreen:    return Sub(Splat(1.0f), s.c[1]);
+    case AlphaModifier::SourceBlue:             return s.c[2];
+    case AlphaModifier::OneMinusSourceBlue:     return Sub(Splat(1.0f), s.c[2]);
+    default:                                    return s.c[3];
+    }
+}
+
+/**
+ * Runs a combiner operation on a channel
+ * @param in0 First input
+ * @param in1 Second input
+ * @param in2 Third input
+ * @return Output, Dot3RGB is done by ColorOp
+ */
+template <Operation op>
+inline Lanes Combine(Lanes in0, Lanes in1, Lanes in2) {
+    switch (op) {
+    case Operation::Modulate:
+        return Mul(in0, in1);
+
+    case Operation::Add:
+        return Min(Add(in0, in1), Splat(1.0f));
+
+    case Operation::AddSigned:
+        return Clamp(Sub(Add(in0, in1), Splat(0.5f)));
+
+    case Operation::Lerp:
+        return Add(Mul(in0, in2), Mul(in1, Sub(Splat(1.0f), in2)));
+
+    case Operation::Subtract:
+        return Max(Sub(in0, in1), Splat(0.0f));
+
+    case Operation::MultiplyThenAdd:
+        return Min(Add(Mul(in0, in1), in2), Splat(1.0f));
+
+    case Operation::AddThenMultiply:
+        return Mul(Min(Add(in0, in1), Splat(1.0f)), in2);
+
+    default:
+        return in0;
+    }
+}
+
+template <Operation op>
+void ColorOp(const Rgb* in, Rgb& out) {
+    if (op == Operation::Dot3RGB) {
+        const Lanes half = Splat(0.5f);
+        Lanes dot = Mul(Sub(in[0].c[0], half), Sub(in[1].c[0], half));
+        dot = Add(dot, Mul(Sub(in[0].c[1], half), Sub(in[1].c[1], half)));
+        dot = Add(dot, Mul(Sub(in[0].c[2], half), Sub(in[1].c[2], half)));
+        out.c[0] = out.c[1] = out.c[2] = Clamp(Mul(dot, Splat(4.0f)));
+        return;
+    }
+    for (int c = 0; c < 3; c++) {
+        out.c[c] = Combine<op>(in[0].c[c], in[1].c[c], in[2].c[c]);
+    }
+}
+
+template <Operation op>
+Lanes AlphaOp(const Lanes* in) {
+    return Combine<op>(in[0], in[1], in[2]);
+}
+
+template <AlphaTestFunction function>
+int AlphaTest(Lanes value, Lanes reference) {
+    return Compare<function>(value, reference);
+}
+
+template <BlendFactor factor>
+void BlendFactorOf(const Color& source, const Color& dest, const Color& constant, Color& out) {
+    const Lanes one = Splat(1.0f);
+    for (int c = 0; c < 4; c++) {
+        switch (factor) {
+        case BlendFactor::Zero:                  out.c[c] = Splat(0.0f); break;
+        case BlendFactor::SourceColor:           out.c[c] = source.c[c]; break;
+        case BlendFactor::OneMinusSourceColor:   out.c[c] = Sub(one, source.c[c]); break;
+        case BlendFactor::DestColor:             out.c[c] = dest.c[c]; break;
+        case BlendFactor::OneMinusDestColor:     out.c[c] = Sub(one, dest.c[c]); break;
+        case BlendFactor::SourceAlpha:           out.c[c] = source.c[3]; break;
+        case BlendFactor::OneMinusSourceAlpha:   out.c[c] = Sub(one, source.c[3]); break;
+        case BlendFactor::DestAlpha:             out.c[c] = dest.c[3]; break;
+        case BlendFactor::OneMinusDestAlpha:     out.c[c] = Sub(one, dest.c[3]); break;
+        case BlendFactor::ConstantColor:         out.c[c] = constant.c[c]; break;
+        case BlendFactor::OneMinusConstantColor: out.c[c] = Sub(one, constant.c[c]); break;
+        case BlendFactor::ConstantAlpha:         out.c[c] = constant.c[3]; break;
+        case BlendFactor::OneMinusConstantAlpha: out.c[c] = Sub(one, constant.c[3]); break;
+        case BlendFactor::SourceAlphaSaturate:
+            out.c[c] = c == 3 ? one : Min(source.c[3], Sub(one, dest.c[3]));
+            break;
+        default:                                 out.c[c] = one; break;
+        }
+    }
+}
+
+template <BlendEquation equation>
+Lanes BlendEquationOf(Lanes source, Lanes dest, Lanes source_factor, Lanes dest_factor) {
+    // Min and max leave the factors out, as in OpenGL
+    switch (equation) {
+    case BlendEquation::Subtract:
+        return Sub(Mul(source, source_factor), Mul(dest, dest_factor));
+
+    case BlendEquation::ReverseSubtract:
+        return Sub(Mul(dest, dest_factor), Mul(source, source_factor));
+
+    case BlendEquation::Min:
+        return Min(source, dest);
+
+    case BlendEquation::Max:
+        return Max(source, dest);
+
+    default:
+        return Add(Mul(source, source_factor), Mul(dest, dest_factor));
+    }
+}
+
+/// Case of a Get*Func switch, returning the instantiation for an enum value
+#define INSTANTIATION(func, type, value) case type::value: return func<type::value>
+
+/**
+ * Gets the kernel of a color combiner input
+ * @param modifier Modifier of the input
+ * @return Kernel
+ */
+ColorInputFunc GetColorInputFunc(ColorModifier modifier) {
+    switch (modifier) {
+    INSTANTIATION(ColorInput, ColorModifier, OneMinusSourceColor);
+    INSTANTIATION(ColorInput, ColorModifier, SourceAlpha);
+    INSTANTIATION(ColorInput, ColorModifier, OneMinusSourceAlpha);
+    INSTANTIATION(ColorInput, ColorModifier, SourceRed);
+    INSTANTIATION(ColorInput, ColorModifier, OneMinusSourceRed);
+    INSTANTIATION(ColorInput, ColorModifier, SourceGreen);
+    INSTANTIATION(ColorInput, ColorModifier, OneMinusSourceGreen);
+    INSTANTIATION(ColorInput, ColorModifier, SourceBlue);
+    INSTANTIATION(ColorInput, ColorModifier, OneMinusSourceBlue);
+    default: return ColorInput<ColorModifier::SourceColor>;
+    }
+}
+
+/**
+ * Gets the kernel of an alpha combiner input
+ * @param modifier Modifier of the input
+ * @return Kernel
+ */
+AlphaInputFunc GetAlphaInputFunc(AlphaModifier modifier) {
+    switch (modifier) {
+    INSTANTIATION(AlphaInput, AlphaModifier, OneMinusSourceAlpha);
+    INSTANTIATION(AlphaInput, AlphaModifier, SourceRed);
+    INSTANTIATION(AlphaInput, AlphaModifier, OneMinusSourceRed);
+    INSTANTIATION(AlphaInput, AlphaModifier, SourceGreen);
+    INSTANTIATION(AlphaInput, AlphaModifier, OneMinusSourceGreen);
+    INSTANTIATION(AlphaInput, AlphaModifier, SourceBlue);
+    INSTANTIATION(AlphaInput, AlphaModifier, OneMinusSourceBlue);
+    default: return AlphaInput<AlphaModifier::SourceAlpha>;
+    }
+}
+
+/**
+ * Gets the kernel of a color combiner operation
+ * @param op Operation
+ * @return Kernel
+ */
+ColorOpFunc GetColorOpFunc(Operation op) {
+    switch (op) {
+    INSTANTIATION(ColorOp, Operation, Modulate);
+    INSTANTIATION(ColorOp, Operation, Add);
+    INSTANTIATION(ColorOp, Operation, AddSigned);
+    INSTANTIATION(ColorOp, Operation, Lerp);
+    INSTANTIATION(ColorOp, Operation, Subtract);
+    INSTANTIATION(ColorOp, Operation, Dot3RGB);
+    INSTANTIATION(ColorOp, Operation, MultiplyThenAdd);
+    INSTANTIATION(ColorOp, Operation, AddThenMultiply);
+    default: return ColorOp<Operation::Replace>;
+    }
+}
+
+/**
+ * Gets the kernel of an alpha combiner operation
+ * @param op Operation, Dot3RGB is one of the color operation only
+ * @return Kernel
+ */
+AlphaOpFunc GetAlphaOpFunc(Operation op) {
+    switch (op) {
+    INSTANTIATION(AlphaOp, Operation, Modulate);
+    INSTANTIATION(AlphaOp, Operation, Add);
+    INSTANTIATION(AlphaOp, Operation, AddSigned);
+    INSTANTIATION(AlphaOp, Operation, Lerp);
+    INSTANTIATION(AlphaOp, Operation, Subtract);
+    INSTANTIATION(AlphaOp, Operation, MultiplyThenAdd);
+    INSTANTIATION(AlphaOp, Operation, AddThenMultiply);
+    default: return AlphaOp<Operation::Replace>;
+    }
+}
+
+/**
+ * Gets the kernel of an alpha test
+ * @param function Function of the test
+ * @return Kernel, NULL for Always
+ */
+AlphaTestFunc GetAlphaTestFunc(AlphaTestFunction function) {
+    switch (function) {
+    INSTANTIATION(AlphaTest, AlphaTestFunction, Never);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, Equal);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, NotEqual);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, LessThan);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, LessThanOrEqual);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, GreaterThan);
+    INSTANTIATION(AlphaTest, AlphaTestFunction, GreaterThanOrEqual);
+    default: return NULL;
+    }
+}
+
+/**
+ * Gets the kernel of a blend factor
+ * @param factor Factor
+ * @return Kernel
+ */
+BlendFactorFunc GetBlendFactorFunc(BlendFactor factor) {
+    switch (factor) {
+    INSTANTIATION(BlendFactorOf, BlendFactor, Zero);
+    INSTANTIATION(BlendFactorOf, BlendFactor, SourceColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusSourceColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, DestColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusDestColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, SourceAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusSourceAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, DestAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusDestAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, ConstantColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusConstantColor);
+    INSTANTIATION(BlendFactorOf, BlendFactor, ConstantAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, OneMinusConstantAlpha);
+    INSTANTIATION(BlendFactorOf, BlendFactor, SourceAlphaSaturate);
+    default: return BlendFactorOf<BlendFactor::One>;
+    }
+}
+
+/**
+ * Gets the kernel of a blend equation
+ * @param equation Equation
+ * @return Kernel
+ */
+BlendEquationFunc GetBlendEquationFunc(BlendEquation equation) {
+    switch (equation) {
+    INSTANTIATION(BlendEquationOf, BlendEquation, Subtract);
+    INSTANTIATION(BlendEquationOf, BlendEquation, ReverseSubtract);
+    INSTANTIATION(BlendEquationOf, BlendEquation, Min);
+    INSTANTIATION(BlendEquationOf, BlendEquation, Max);
+    default: return BlendEquationOf<BlendEquation::Add>;
+    }
+}
+
+#undef INSTANTIATION
+
+/**
+ * Gets the register a combiner source reads
+ * @param config Configuration
+ * @param source Source
+ * @return Register
+ */
+u8 GetSourceRegister(const Config& config, Source source) {
+    switch (source) {
+    case Source::PrimaryColor:
+        return REG_PRIMARY;
+
+    case Source::Texture0:
+        return config.texture0_enable ? REG_TEXTURE0 : REG_ZERO;
+
+    case Source::Constant:
+        return REG_CONSTANT;
+
+    case Source::Previous:
+        return REG_PREVIOUS;
+
+    default:
+        // Lighting, texture units 1-3 and the combiner buffer aren't emulated yet
+        return REG_ZERO;
+    }
+}
+
+/**
+ * Gets the number of inputs a combiner operation reads
+ * @param op Operation
+ * @return 1 to 3
+ */
+int GetNumInputs(Operation op) {
+    switch (op) {
+    case Operation::Lerp:
+    case Operation::MultiplyThenAdd:
+    case Operation::AddThenMultiply:
+        return 3;
+
+    case Operation::Replace:
+        return 1;
+
+    default:
+        return 2;
+    }
+}
+
+/**
+ * Gets whether a stage passes the output of the previous one through unchanged, as the stages
+ * games leave unused are set up
+ * @param config Configuration
+ * @param stage Stage
+ * @return True if the stage can be left out
+ */
+bool IsPassthroughStage(const Config& config, int stage) {
+    const u32 previous = (u32)Source::Previous;
+    return (config.tev_source[stage] & 0x000F000F) == (previous | previous << 16) &&
+        (config.tev_operand[stage] & 0x0000700F) == 0 && config.tev_op[stage] == 0 &&
+        config.tev_scale[stage] == 0;
+}
+
+/**
+ * Compiles a combiner stage
+ * @param config Configuration
+ * @param index Index of the stage
+ * @param stage Receives the stage of the routine
+ */
+void CompileStage(const Config& config, int index, Stage& stage) {
+    Regs::Struct<Regs::TevStage0Source> source;
+    Regs::Struct<Regs::TevStage0Operand> operand;
+    Regs::Struct<Regs::TevStage0Op> op;
+    Regs::Struct<Regs::TevStage0Scale> scale;
+    memcpy(&source, &config.tev_source[index], sizeof(u32));
+    memcpy(&operand, &config.tev_operand[index], sizeof(u32));
+    memcpy(&op, &config.tev_op[index], sizeof(u32));
+    memcpy(&scale, &config.tev_scale[index], sizeof(u32));
+
+    const Source color_sources[3] = { source.color_source1, source.color_source2,
+        source.color_source3 };
+    const Source alpha_sources[3] = { source.alpha_source1, source.alpha_source2,
+        source.alpha_source3 };
+    const ColorModifier color_modifiers[3] = { operand.color_modifier1, operand.color_modifier2,
+        operand.color_modifier3 };
+    const AlphaModifier alpha_modifiers[3] = { operand.alpha_modifier1, operand.alpha_modifier2,
+        operand.alpha_modifier3 };
+
+    stage.index = index;
+    stage.num_color_inputs = GetNumInputs(op.color_op);
+    stage.num_alpha_inputs = GetNumInputs(op.alpha_op);
+    for (int i = 0; i < 3; i++) {
+        stage.color_sources[i] = GetSourceRegister(config, color_sources[i]);
+        stage.color_inputs[i] = GetColorInputFunc(color_modifiers[i]);
+        stage.alpha_sources[i] = GetSourceRegister(config, alpha_sources[i]);
+        stage.alpha_inputs[i] = GetAlphaInputFunc(alpha_modifiers[i]);
+    }
+    stage.color_op = GetColorOpFunc(op.color_op);
+    stage.alpha_op = GetAlphaOpFunc(op.alpha_op);
+    stage.color_scale = (float)(1 << scale.color_scale);
+    stage.alpha_scale = (float)(1 << scale.alpha_scale);
+}
+
+/**
+ * Compiles the routine of a configuration
+ * @param config Configuration
+ * @param program Receives the routine
+ */
+void Compile(const Config& config, Program& program) {
+    program.config = config;
+    program.num_stages = 0;
+    for (int index = 0; index < NUM_TEV_STAGES; index++) {
+        if (!IsPassthroughStage(config, index)) {
+            CompileStage(config, index, program.stages[program.num_stages++]);
+        }
+    }
+    program.alpha_test = GetAlphaTestFunc((AlphaTestFunction)config.alpha_test_function);
+
+    Regs::Struct<Regs::BlendFunc> blend;
+    memcpy(&blend, &config.blend_func, sizeof(u32));
+    for (int i = 0; i < 4; i++) {
+        program.blend_factors[i] = NULL;
+    }
+    if (config.blend_enable) {
+        program.blend_factors[0] = GetBlendFactorFunc(blend.color_source_factor);
+        program.blend_factors[1] = GetBlendFactorFunc(blend.color_dest_factor);
+        program.blend_factors[2] = GetBlendFactorFunc(blend.alpha_source_factor);
+        program.blend_factors[3] = GetBlendFactorFunc(blend.alpha_dest_factor);
+        program.blend_equations[0] = GetBlendEquationFunc(blend.color_equation);
+        program.blend_equations[1] = GetBlendEquationFunc(blend.alpha_equation);
+    }
+}
+
+/**
+ * Unpacks a PICA RGBA8 register color
+ * @param color Color, red in the low byte
+ * @param out Receives the components, from 0 to 1
+ */
+void UnpackColor(u32 color, float* out) {
+    for (int c = 0; c < 4; c++) {
+        out[c] = ((color >> (8 * c)) & 0xFF) / 255.0f;
+    }
+}
+
+/**
+ * Loads RGBA8 colors of the pixels of a quad
+ * @param rgba Colors of the pixels
+ * @param out Receives the colors, from 0 to 1
+ */
+void LoadColors(const u8 (*rgba)[4], Color& out) {
+    for (int c = 0; c < 4; c++) {
+        float values[4];
+        for (int n = 0; n < 4; n++) {
+            values[n] = rgba[n][c];
+        }
+        out.c[c] = Mul(Load(values), Splat(1.0f / 255.0f));
+    }
+}
+
+} // namespace
+
+/**
+ * Decodes the fragment stage configuration currently set in Pica::g_regs
+ * @param config Receives the configuration
+ * @param texture0_enable Whether the draw samples texture 0
+ */
+void GetConfig(Config* config, bool texture0_enable) {
+    memset(config, 0, sizeof(*config));
+    for (int stage = 0; stage < NUM_TEV_STAGES; stage++) {
+        config->tev_source[stage] = g_regs[TevStageRegister(stage, Regs::TevStage0Source)] &
+            SOURCE_FIELDS_MASK;
+        config->tev_operand[stage] = g_regs[TevStageRegister(stage, Regs::TevStage0Operand)] &
+            OPERAND_FIELDS_MASK;
+        config->tev_op[stage] = g_regs[TevStageRegister(stage, Regs::TevStage0Op)] &
+            OP_FIELDS_MASK;
+        config->tev_scale[stage] = g_regs[TevStageRegister(stage, Regs::TevStage0Scale)] &
+            SCALE_FIELDS_MASK;
+    }
+    const auto& alpha_test = g_regs.Get<Regs::AlphaTest>();
+    const AlphaTestFunction function = alpha_test.function;
+    config->alpha_test_function = (u32)(alpha_test.enable ? function : AlphaTestFunction::Always);
+    config->texture0_enable = texture0_enable;
+    config->blend_enable = g_regs.Get<Regs::ColorOperation>().alpha_blending_enable;
+    config->blend_func = config->blend_enable ? g_regs[Regs::BlendFunc] : 0;
+}
+
+/**
+ * Decodes the uniforms currently set in Pica::g_regs
+ * @param uniforms Receives the uniforms
+ */
+void GetUniforms(Uniforms* uniforms) {
+    for (int stage = 0; stage < NUM_TEV_STAGES; stage++) {
+        UnpackColor(g_regs[TevStageRegister(stage, Regs::TevStage0Color)],
+            uniforms->tev_const_color[stage]);
+    }
+    uniforms->alpha_ref = (float)g_regs.Get<Regs::AlphaTest>().reference;
+    UnpackColor(g_regs[Regs::BlendColor], uniforms->blend_color);
+}
+
+/**
+ * Gets the routine of a configuration, compiling it on first use. Not thread safe, routines are
+ * only compiled on the GPU thread, they are shaded with on any.
+ * @param config Configuration
+ * @return Routine, valid until Clear
+ */
+const Program* GetProgram(const Config& config) {
+    // Triangles binned before hold on to their routines, so colliding ones are kept side by side
+    const u64 hash = GetFastHash64((const u8*)&config, sizeof(config));
+    const auto range = g_programs.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (memcmp(&it->second.config, &config, sizeof(config)) == 0) {
+            return &it->second;
+        }
+    }
+    Program& program = g_programs.insert(std::make_pair(hash, Program()))->second;
+    Compile(config, program);
+    return &program;
+}
+
+/**
+ * Shades a quad with a routine, writing the covered pixels that pass the alpha test
+ * @param program Routine
+ * @param uniforms Uniforms of the draw
+ * @param quad Quad
+ * @param format Format of the color buffer
+ */
+void ShadeQuad(const Program* program, const Uniforms& uniforms, const Quad& quad,
+    VideoCore::ColorFormat format) {
+    Color regs[NUM_REGISTERS];
+    for (int c = 0; c < 4; c++) {
+        regs[REG_ZERO].c[c] = Splat(0.0f);
+        regs[REG_PRIMARY].c[c] = Load(quad.color[c]);
+        regs[REG_PREVIOUS].c[c] = regs[REG_ZERO].c[c];
+    }
+    if (program->config.texture0_enable) {
+        LoadColors(quad.texel0, regs[REG_TEXTURE0]);
+    }
+
+    for (int i = 0; i < program->num_stages; i++) {
+        const Stage& stage = program->stages[i];
+        for (int c = 0; c < 4; c++) {
+            regs[REG_CONSTANT].c[c] = Splat(uniforms.tev_const_color[stage.index][c]);
+        }
+        // Both operations read the output of the stage before, which is only replaced once both
+        // ran
+        Rgb color_in[3];
+        Lanes alpha_in[3];
+        for (int n = 0; n < stage.num_color_inputs; n++) {
+            stage.color_inputs[n](regs[stage.color_sources[n]], color_in[n]);
+        }
+        for (int n = 0; n < stage.num_alpha_inputs; n++) {
+            alpha_in[n] = stage.alpha_inputs[n](regs[stage.alpha_sources[n]]);
+        }
+        Rgb rgb;
+        stage.color_op(color_in, rgb);
+        const Lanes alpha = stage.alpha_op(alpha_in);
+        for (int c = 0; c < 3; c++) {
+            regs[REG_PREVIOUS].c[c] = Clamp(Mul(rgb.c[c], Splat(stage.color_scale)));
+        }
+        regs[REG_PREVIOUS].c[3] = Clamp(Mul(alpha, Splat(stage.alpha_scale)));
+    }
+
+    int mask = quad.mask;
+    if (program->alpha_test != NULL) {
+        mask &= program->alpha_test(Round(Mul(regs[REG_PREVIOUS].c[3], Splat(255.0f))),
+            Splat(uniforms.alpha_ref));
+        if (mask == 0) {
+            return;
+        }
+    }
+
+    Color out = regs[REG_PREVIOUS];
+    if (program->blend_factors[0] != NULL) {
+        u8 dest_rgba[4][4] = {};
+        for (int n = 0; n < 4; n++) {
+            if (mask & (1 << n)) {
+                VideoCore::DecodeColor(format, quad.pixels[n], dest_rgba[n]);
+            }
+        }
+        Color dest, constant, factors[4];
+        LoadColors(dest_rgba, dest);
+        for (int c = 0; c < 4; c++) {
+            constant.c[c] = Splat(uniforms.blend_color[c]);
+        }
+        for (int i = 0; i < 4; i++) {
+            program->blend_factors[i](regs[REG_PREVIOUS], dest, constant, factors[i]);
+        }
+        for (int c = 0; c < 4; c++) {
+            const int factor = c == 3 ? 2 : 0;
+            out.c[c] = Clamp(program->blend_equations[c == 3](regs[REG_PREVIOUS].c[c],
+                dest.c[c], factors[factor].c[c], factors[factor + 1].c[c]));
+        }
+    }
+
+    float values[4][4];
+    for (int c = 0; c < 4; c++) {
+        Store(values[c], Add(Mul(out.c[c], Splat(255.0f)), Splat(0.5f)));
+    }
+    for (int n = 0; n < 4; n++) {
+        if (mask & (1 << n)) {
+            const u8 rgba[4] = { (u8)values[0][n], (u8)values[1][n], (u8)values[2][n],
+                (u8)values[3][n] };
+            VideoCore::EncodeColor(format, rgba, quad.pixels[n]);
+        }
+    }
+}
+
+/// Drops the compiled routines, none may be in use
+void Clear() {
+    g_programs.clear();
+}
+
+} // namespace
+
+} // namespace
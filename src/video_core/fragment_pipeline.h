@@ -0,0 +1,91 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+#include "video_core/utils.h"
+
+namespace Pica {
+
+/**
+ * Fragment stages of the software rasterizer: the texture combiners, the alpha test and blending.
+ * Every configuration of them is compiled once into a routine of its own, a chain of kernels
+ * instantiated from templates for each operation, modifier and function, so that shading a pixel
+ * doesn't go through a switch on the registers. The kernels work on a 2x2 quad of pixels at a
+ * time, on SSE2 hosts a channel of the four pixels per register.
+ */
+namespace FragmentPipeline {
+
+/**
+ * Register fields the routine of a configuration depends on. Zeroed first, so that it compares
+ * and hashes bytewise.
+ */
+struct Config {
+    u32     tev_source[NUM_TEV_STAGES];     ///< TevStage0Source of every stage
+    u32     tev_operand[NUM_TEV_STAGES];    ///< TevStage0Operand of every stage
+    u32     tev_op[NUM_TEV_STAGES];         ///< TevStage0Op of every stage
+    u32     tev_scale[NUM_TEV_STAGES];      ///< TevStage0Scale of every stage
+    u32     alpha_test_function;            ///< Always if the alpha test is disabled
+    u32     texture0_enable;                ///< Whether texture 0 is sampled
+    u32     blend_enable;
+    u32     blend_func;                     ///< BlendFunc, 0 if blending is disabled
+};
+
+/// Values of a draw the routines read, which don't take a routine of their own
+struct Uniforms {
+    float   tev_const_color[NUM_TEV_STAGES][4];
+    float   alpha_ref;                      ///< From 0 to 255
+    float   blend_color[4];
+};
+
+/// Quad of pixels covered by a triangle
+struct Quad {
+    float   color[4][4];                    ///< Primary color by channel then pixel, 0 to 1
+    u8      texel0[4][4];                   ///< RGBA8 texel of texture 0 of every pixel
+    u8*     pixels[4];                      ///< Pixels in the color buffer
+    int     mask;                           ///< Covered pixels, bit n for pixel n
+};
+
+struct Program;
+
+/**
+ * Decodes the fragment stage configuration currently set in Pica::g_regs
+ * @param config Receives the configuration
+ * @param texture0_enable Whether the draw samples texture 0
+ */
+void GetConfig(Config* config, bool texture0_enable);
+
+/**
+ * Decodes the uniforms currently set in Pica::g_regs
+ * @param uniforms Receives the uniforms
+ */
+void GetUniforms(Uniforms* uniforms);
+
+/**
+ * Gets the routine of a configuration, compiling it on first use. Not thread safe, routines are
+ * only compiled on the GPU thread, they are shaded with on any.
+ * @param config Configuration
+ * @return Routine, valid until Clear
+ */
+const Program* GetProgram(const Config& config);
+
+/**
+ * Shades a quad with a routine, writing the covered pixels that pass the alpha test
+ * @param program Routine
+ * @param uniforms Uniforms of the draw
+ * @param quad Quad
+ * @param format Format of the color buffer
+ */
+void ShadeQuad(const Program* program, const Uniforms& uniforms, const Quad& quad,
+    VideoCore::ColorFormat format);
+
+/// Drops the compiled routines, none may be in use
+void Clear();
+
+} // namespace
+
+} // namespace
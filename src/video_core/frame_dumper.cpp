@@ -0,0 +1,252 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "common/atomic.h"
+#include "common/log.h"
+#include "common/thread.h"
+
+#include "video_core/frame_dumper.h"
+#include "video_core/utils.h"
+#include "video_core/video_core.h"
+
+namespace FrameDumper {
+
+namespace {
+
+enum {
+    RING_SIZE       = 4,    ///< Number of frames queued, a power of two
+
+    TOP_SIZE        = VideoCore::kScreenTopWidth * VideoCore::kScreenTopHeight * 3,
+    BOTTOM_SIZE     = VideoCore::kScreenBottomWidth * VideoCore::kScreenBottomHeight * 3,
+
+    // Images show the screens as the window does, the bottom one centered under the top one
+    IMAGE_WIDTH     = VideoCore::kScreenTopWidth,
+    IMAGE_HEIGHT    = VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight,
+};
+
+/// Frame waiting in the ring
+struct Frame {
+    u32 number;
+    bool has_top;
+    bool has_bottom;
+    u8 top[TOP_SIZE];
+    u8 bottom[BOTTOM_SIZE];
+};
+
+std::vector<Frame>  g_ring;
+volatile u32        g_submitted = 0;        ///< Frames pushed so far, only written by the emulator
+volatile u32        g_completed = 0;        ///< Frames written so far, only written by the worker
+u32                 g_frame_number = 0;     ///< Number of the next frame, dropped ones included
+u32                 g_dropped = 0;          ///< Frames dropped because the ring was full
+bool                g_every_frame = true;   ///< Whether DumpFrame queues the frames shown
+
+std::string         g_directory;
+std::thread*        g_thread = nullptr;     ///< Worker thread encoding and writing frames
+Common::Event       g_work_event;           ///< Signalled when a frame is pushed or to quit
+volatile bool       g_quit = false;         ///< Tells the worker to exit once the ring is empty
+
+/**
+ * Run-length encodes a row of 24-bit pixels as TGA packets, which hold up to 128 pixels
+ * @param row Pixels
+ * @param width Width of the row in pixels
+ * @param out Receives the packets
+ */
+void EncodeRow(const u8* row, int width, std::vector<u8>& out) {
+    int x = 0;
+    while (x < width) {
+        // Length of the run of identical pixels starting at x
+        int run = 1;
+        while (x + run < width && run < 128 && memcmp(row + x * 3, row + (x + run) * 3, 3) == 0) {
+            run++;
+        }
+        if (run > 1) {
+            out.push_back((u8)(0x80 | (run - 1)));
+            out.insert(out.end(), row + x * 3, row + x * 3 + 3);
+            x += run;
+            continue;
+        }
+
+        // Raw packet up to the next run of at least two pixels
+        int count = 1;
+        while (x + count < width && count < 128 && (x + count + 1 >= width ||
+            memcmp(row + (x + count) * 3, row + (x + count + 1) * 3, 3) != 0)) {
+            count++;
+        }
+        out.push_back((u8)(count - 1));
+        out.insert(out.end(), row + x * 3, row + (x + count) * 3);
+        x += count;
+    }
+}
+
+/**
+ * Writes a frame as a run-length encoded TGA image
+ * @param frame Frame
+ * @param image Buffer to compose the image in
+ * @param encoded Buffer to encode the image in
+ */
+void WriteFrame(const Frame& frame, std::vector<u8>& image, std::vector<u8>& encoded) {
+    // Screens that can't be read stay black
+    memset(image.data(), 0, image.size());
+    if (frame.has_top) {
+        VideoCore::RotateFramebuffer(frame.top, image.data(), VideoCore::kScreenTopWidth,
+            VideoCore::kScreenTopHeight);
+    }
+    if (frame.has_bottom) {
+        u8 rotated[BOTTOM_SIZE];
+        VideoCore::RotateFramebuffer(frame.bottom, rotated, VideoCore::kScreenBottomWidth,
+            VideoCore::kScreenBottomHeight);
+        const int offset = (IMAGE_WIDTH - VideoCore::kScreenBottomWidth) / 2;
+        for (int y = 0; y < VideoCore::kScreenBottomHeight; y++) {
+            memcpy(&image[((VideoCore::kScreenTopHeight + y) * IMAGE_WIDTH + offset) * 3],
+                &rotated[y * VideoCore::kScreenBottomWidth * 3],
+                VideoCore::kScreenBottomWidth * 3);
+        }
+    }
+
+    VideoCore::TGAHeader header;
+    memset(&header, 0, sizeof(header));
+    header.datatypecode = 10; // run-length encoded RGB
+    header.bitsperpixel = 24;
+    header.width = IMAGE_WIDTH;
+    header.height = IMAGE_HEIGHT;
+    header.imagedescriptor = 0x20; // rows from the top down
+
+    encoded.assign((const u8*)&header, (const u8*)&header + sizeof(header));
+    for (int y = 0; y < IMAGE_HEIGHT; y++) {
+        EncodeRow(&image[y * IMAGE_WIDTH * 3], IMAGE_WIDTH, encoded);
+    }
+
+    char filename[32];
+    sprintf(filename, "/frame_%06u.tga", frame.number);
+    const std::string path = g_directory + filename;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        ERROR_LOG(RENDER, "can't write frame to %s", path.c_str());
+        return;
+    }
+    fwrite(encoded.data(), 1, encoded.size(), file);
+    fclose(file);
+}
+
+/**
+ * Queues a frame, unless the ring is full
+ * @param number Number the image is named after
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void QueueFrame(u32 number, const u8* top, const u8* bottom) {
+    const u32 submitted = g_submitted;
+    if (submitted - Common::AtomicLoadAcquire(g_completed) == RING_SIZE) {
+        g_dropped++;
+        return;
+    }
+
+    Frame& frame = g_ring[submitted & (RING_SIZE - 1)];
+    frame.number = number;
+    frame.has_top = top != NULL;
+    frame.has_bottom = bottom != NULL;
+    if (top != NULL) {
+        memcpy(frame.top, top, TOP_SIZE);
+    }
+    if (bottom != NULL) {
+        memcpy(frame.bottom, bottom, BOTTOM_SIZE);
+    }
+    Common::AtomicStoreRelease(g_submitted, submitted + 1);
+    g_work_event.Set();
+}
+
+/// Worker thread: writes the frames in the order they were pushed
+void ThreadFunc() {
+    Common::SetCurrentThreadName("FrameDumper");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_LOW);
+
+    std::vector<u8> image(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
+    std::vector<u8> encoded;
+    u32 completed = g_completed;
+    for (;;) {
+        if (completed == Common::AtomicLoadAcquire(g_submitted)) {
+            if (g_quit) {
+                break;
+            }
+            g_work_event.Wait();
+            continue;
+        }
+        WriteFrame(g_ring[completed & (RING_SIZE - 1)], image, encoded);
+        completed++;
+        Common::AtomicStoreRelease(g_completed, completed);
+    }
+}
+
+} // namespace
+
+/**
+ * Starts dumping frames, numbered from 0
+ * @param directory Directory the images are written to, which must exist
+ * @param every_frame Whether every frame shown is dumped, else only those queued by DumpFrameAs
+ */
+void Start(const std::string& directory, bool every_frame) {
+    Stop();
+
+    g_directory = directory;
+    g_ring.resize(RING_SIZE);
+    g_submitted = g_completed = 0;
+    g_frame_number = 0;
+    g_dropped = 0;
+    g_every_frame = every_frame;
+    g_quit = false;
+    g_thread = new std::thread(ThreadFunc);
+
+    NOTICE_LOG(RENDER, "dumping frames to %s", directory.c_str());
+}
+
+/// Writes the frames queued and stops dumping
+void Stop() {
+    if (g_thread == nullptr) {
+        return;
+    }
+    g_quit = true;
+    g_work_event.Set();
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+
+    NOTICE_LOG(RENDER, "dumped %u frames, %u dropped", g_submitted, g_dropped);
+}
+
+/// Whether frames are being dumped
+bool IsDumping() {
+    return g_thread != nullptr;
+}
+
+/**
+ * Queues a frame, if dumping. Never waits.
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void DumpFrame(const u8* top, const u8* bottom) {
+    if (g_thread == nullptr || !g_every_frame) {
+        return;
+    }
+    QueueFrame(g_frame_number++, top, bottom);
+}
+
+/**
+ * Queues a frame under a number of the caller's, if dumping. Never waits.
+ * @param number Number the image is named after
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void DumpFrameAs(u32 number, const u8* top, const u8* bottom) {
+    if (g_thread == nullptr) {
+        return;
+    }
+    QueueFrame(number, top, bottom);
+}
+
+} // namespace
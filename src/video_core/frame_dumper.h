@@ -0,0 +1,47 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Captures the frames the LCDs show to a numbered sequence of run-length encoded TGA images. The
+ * emulation thread only copies the framebuffers into a free slot of a ring, a worker thread
+ * rotates, encodes and writes them. Frames arriving while the ring is full are dropped, leaving a
+ * gap in the numbering, rather than waited for.
+ */
+namespace FrameDumper {
+
+/**
+ * Starts dumping frames, numbered from 0
+ * @param directory Directory the images are written to, which must exist
+ * @param every_frame Whether every frame shown is dumped, else only those queued by DumpFrameAs
+ */
+void Start(const std::string& directory, bool every_frame = true);
+
+/// Writes the frames queued and stops dumping
+void Stop();
+
+/// Whether frames are being dumped
+bool IsDumping();
+
+/**
+ * Queues a frame, if dumping. Never waits.
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void DumpFrame(const u8* top, const u8* bottom);
+
+/**
+ * Queues a frame under a number of the caller's, if dumping. Never waits.
+ * @param number Number the image is named after
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void DumpFrameAs(u32 number, const u8* top, const u8* bottom);
+
+} // namespace
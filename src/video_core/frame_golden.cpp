@@ -0,0 +1,249 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/string_util.h"
+
+#include "video_core/frame_dumper.h"
+#include "video_core/frame_golden.h"
+#include "video_core/video_core.h"
+
+namespace FrameGolden {
+
+namespace {
+
+enum Mode {
+    MODE_NONE,
+    MODE_RECORDING,
+    MODE_CHECKING,
+};
+
+enum {
+    TOP_SIZE        = VideoCore::kScreenTopWidth * VideoCore::kScreenTopHeight * 3,
+    BOTTOM_SIZE     = VideoCore::kScreenBottomWidth * VideoCore::kScreenBottomHeight * 3,
+    MAX_DUMPED      = 64,   ///< Frames that differ dumped at most, the first ones matter most
+};
+
+const char kHeader[] = "citra frame hashes 1";
+
+/// Hashes of a frame, 0 for a screen that can't be read
+struct FrameHash {
+    u64 top;
+    u64 bottom;
+};
+
+Mode                    g_mode = MODE_NONE;
+std::string             g_filename;
+std::vector<FrameHash>  g_hashes;           ///< Recorded so far, or the sequence checked against
+u32                     g_frame = 0;        ///< Number of the next frame shown
+CheckResult             g_result;
+bool                    g_dumping = false;  ///< Whether the frames that differ are dumped
+
+/**
+ * Hashes a fixed buffer, which tells apart versions of the hash
+ * @return Hash of the probe
+ */
+u64 GetProbeHash() {
+    u8 probe[256];
+    for (int i = 0; i < 256; i++) {
+        probe[i] = (u8)(i * 167 + 13);
+    }
+    return GetFastHash64(probe, sizeof(probe));
+}
+
+/**
+ * Reads a sequence of hashes
+ * @param filename File to read
+ * @param hashes Receives the hashes
+ * @return True on success
+ */
+bool ReadSequence(const std::string& filename, std::vector<FrameHash>& hashes) {
+    std::string text;
+    if (!File::ReadFileToString(true, filename.c_str(), text)) {
+        ERROR_LOG(RENDER, "can't read frame hashes from %s", filename.c_str());
+        return false;
+    }
+    std::vector<std::string> lines;
+    SplitString(text, '\n', lines);
+    unsigned long long probe;
+    const std::string header_format = std::string(kHeader) + " %llx";
+    if (lines.empty() || sscanf(lines[0].c_str(), header_format.c_str(), &probe) != 1) {
+        ERROR_LOG(RENDER, "%s isn't a sequence of frame hashes", filename.c_str());
+        return false;
+    }
+    if (probe != GetProbeHash()) {
+        ERROR_LOG(RENDER, "%s was recorded with another version of the frame hash, record it "
+            "again", filename.c_str());
+        return false;
+    }
+    hashes.clear();
+    for (size_t i = 1; i < lines.size(); i++) {
+        unsigned long long top, bottom;
+        if (sscanf(lines[i].c_str(), "%llx %llx", &top, &bottom) == 2) {
+            FrameHash hash = { top, bottom };
+            hashes.push_back(hash);
+        }
+    }
+    return true;
+}
+
+/**
+ * Writes a sequence of hashes, a line per frame after a header
+ * @param filename File to write
+ * @param hashes Hashes of the frames
+ * @return True on success
+ */
+bool WriteSequence(const std::string& filename, const std::vector<FrameHash>& hashes) {
+    std::string text = StringFromFormat("%s %016llx\n", kHeader,
+        (unsigned long long)GetProbeHash());
+    for (const FrameHash& hash : hashes) {
+        text += StringFromFormat("%016llx %016llx\n", (unsigned long long)hash.top,
+            (unsigned long long)hash.bottom);
+    }
+    if (!File::WriteStringToFile(true, text, filename.c_str())) {
+        ERROR_LOG(RENDER, "can't write frame hashes to %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+/**
+ * Starts recording the hashes of the frames shown
+ * @param filename File the sequence is written to when recording stops
+ */
+void StartRecording(const std::string& filename) {
+    Stop();
+    g_mode = MODE_RECORDING;
+    g_filename = filename;
+    g_hashes.clear();
+    g_frame = 0;
+}
+
+/**
+ * Starts checking the frames shown against a recorded sequence
+ * @param filename Sequence to check against
+ * @param diff_directory Directory the frames that differ are dumped to, which must exist. Empty
+ *                       to only report them.
+ * @return True on success, false if the sequence couldn't be read
+ */
+bool StartChecking(const std::string& filename, const std::string& diff_directory) {
+    Stop();
+    if (!ReadSequence(filename, g_hashes)) {
+        return false;
+    }
+    g_mode = MODE_CHECKING;
+    g_filename = filename;
+    g_frame = 0;
+    g_result.checked = 0;
+    g_result.divergent = 0;
+    g_result.first_divergent = -1;
+    g_result.golden_frames = (u32)g_hashes.size();
+
+    // Frames dumped with --dump-frames are all there already, the differing ones among them
+    g_dumping = !diff_directory.empty() && !FrameDumper::IsDumping();
+    if (g_dumping) {
+        FrameDumper::Start(diff_directory, false);
+    }
+    NOTICE_LOG(RENDER, "checking frames against the %u hashes of %s", g_result.golden_frames,
+        filename.c_str());
+    return true;
+}
+
+/// Stops recording or checking, writing the sequence recorded or logging what the check found
+void Stop() {
+    switch (g_mode) {
+    case MODE_RECORDING:
+        if (WriteSequence(g_filename, g_hashes)) {
+            NOTICE_LOG(RENDER, "wrote the hashes of %u frames to %s", (u32)g_hashes.size(),
+                g_filename.c_str());
+        }
+        break;
+
+    case MODE_CHECKING:
+        if (g_dumping) {
+            FrameDumper::Stop();
+            g_dumping = false;
+        }
+        if (g_result.divergent == 0) {
+            NOTICE_LOG(RENDER, "%u frames match %s", g_result.checked, g_filename.c_str());
+        } else {
+            ERROR_LOG(RENDER, "%u of %u frames differ from %s, the first is frame %lld",
+                g_result.divergent, g_result.checked, g_filename.c_str(),
+                (long long)g_result.first_divergent);
+        }
+        if (g_result.checked < g_result.golden_frames) {
+            NOTICE_LOG(RENDER, "%u frames of %s weren't shown", g_result.golden_frames -
+                g_result.checked, g_filename.c_str());
+        }
+        break;
+
+    default:
+        break;
+    }
+    g_mode = MODE_NONE;
+    g_hashes.clear();
+}
+
+/// Whether frames are being recorded or checked, the renderers then read back the framebuffers
+bool IsActive() {
+    return g_mode != MODE_NONE;
+}
+
+/**
+ * Hashes a frame shown, called by the renderers when it's presented
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void OnFrame(const u8* top, const u8* bottom) {
+    if (g_mode == MODE_NONE) {
+        return;
+    }
+    const u32 frame = g_frame++;
+    FrameHash hash;
+    hash.top = top != NULL ? GetFastHash64(top, TOP_SIZE) : 0;
+    hash.bottom = bottom != NULL ? GetFastHash64(bottom, BOTTOM_SIZE) : 0;
+
+    if (g_mode == MODE_RECORDING) {
+        g_hashes.push_back(hash);
+        return;
+    }
+    if (frame >= g_hashes.size()) {
+        return;
+    }
+    g_result.checked++;
+    if (hash.top == g_hashes[frame].top && hash.bottom == g_hashes[frame].bottom) {
+        return;
+    }
+    if (g_result.divergent == 0) {
+        g_result.first_divergent = frame;
+        ERROR_LOG(RENDER, "frame %u differs from %s", frame, g_filename.c_str());
+    }
+    g_result.divergent++;
+    if (g_dumping && g_result.divergent <= MAX_DUMPED) {
+        FrameDumper::DumpFrameAs(frame, top, bottom);
+    }
+}
+
+/**
+ * Gets what the check found so far
+ * @param result Receives the result
+ * @return True if frames are being checked
+ */
+bool GetCheckResult(CheckResult& result) {
+    if (g_mode != MODE_CHECKING) {
+        return false;
+    }
+    result = g_result;
+    return true;
+}
+
+} // namespace
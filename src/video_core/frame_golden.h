@@ -0,0 +1,66 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Golden frame hashes, to catch rendering regressions without diffing video dumps. Recording
+ * hashes every frame the LCDs show and writes the sequence to a file. Checking hashes them again
+ * against a sequence recorded before, reports the first frame that differs, and dumps the frames
+ * that differ, and only those, through the frame dumper.
+ *
+ * Frames are hashed with GetFastHash64, which isn't stable across versions of the hash.
+ * Sequences store the hash of a fixed probe buffer, a sequence recorded with another version is
+ * rejected as a whole instead of differing at every frame.
+ */
+namespace FrameGolden {
+
+/**
+ * Starts recording the hashes of the frames shown
+ * @param filename File the sequence is written to when recording stops
+ */
+void StartRecording(const std::string& filename);
+
+/**
+ * Starts checking the frames shown against a recorded sequence
+ * @param filename Sequence to check against
+ * @param diff_directory Directory the frames that differ are dumped to, which must exist. Empty
+ *                       to only report them.
+ * @return True on success, false if the sequence couldn't be read
+ */
+bool StartChecking(const std::string& filename, const std::string& diff_directory);
+
+/// Stops recording or checking, writing the sequence recorded or logging what the check found
+void Stop();
+
+/// Whether frames are being recorded or checked, the renderers then read back the framebuffers
+bool IsActive();
+
+/**
+ * Hashes a frame shown, called by the renderers when it's presented
+ * @param top Top screen framebuffer in V/RAM, NULL if it can't be read
+ * @param bottom Bottom screen framebuffer in V/RAM, NULL if it can't be read
+ */
+void OnFrame(const u8* top, const u8* bottom);
+
+/// What a check found so far
+struct CheckResult {
+    u32 checked;            ///< Frames compared to the sequence
+    u32 divergent;          ///< Frames that differ from it
+    s64 first_divergent;    ///< Number of the first frame that differs, -1 if none does
+    u32 golden_frames;      ///< Frames in the sequence
+};
+
+/**
+ * Gets what the check found so far
+ * @param result Receives the result
+ * @return True if frames are being checked
+ */
+bool GetCheckResult(CheckResult& result);
+
+} // namespace
@@ -0,0 +1,45 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/common.h"
+#include "common/log.h"
+
+#include "video_core/frame_output.h"
+
+namespace FrameOutput {
+
+namespace {
+
+Sink* g_sink = nullptr;
+
+} // namespace
+
+/**
+ * Sets the sink the frames go to, before the video core is initialized
+ * @param sink Sink, owned by the module from now on, NULL for none
+ */
+void SetSink(Sink* sink) {
+    delete g_sink;
+    g_sink = sink;
+    if (g_sink != nullptr) {
+        NOTICE_LOG(RENDER, "frames output to %s", g_sink->GetName());
+    }
+}
+
+/// Whether there's a sink to hand the frames to
+bool IsActive() {
+    return g_sink != nullptr;
+}
+
+/**
+ * Hands a frame to the sink, from the renderer
+ * @param frame Frame presented
+ */
+void OutputFrame(const Frame& frame) {
+    if (g_sink != nullptr) {
+        g_sink->OnFrame(frame);
+    }
+}
+
+} // namespace
@@ -0,0 +1,76 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Hands every frame the renderer presents to a consumer, as streaming to remote clients needs.
+ * The screens are handed over where they already are, with no copy and no read back from the
+ * host GPU: the framebuffers in memory and the OpenGL textures the window is drawn from. The
+ * consumer gets the frame before it's swapped to the window, so waiting for the host display
+ * adds no latency to it.
+ */
+namespace FrameOutput {
+
+/// A screen of a frame
+struct Screen {
+    int         width;              ///< Width of the screen in its pixels
+    int         height;             ///< Height of the screen in its pixels
+
+    /// Framebuffer as in V/RAM, NULL if memory doesn't hold the screen shown (rendered on the
+    /// host GPU). Pixels are 24-bit, in the byte order of the guest framebuffers, stored column by
+    /// column from the left, each from the bottom row up.
+    const u8*   pixels;
+
+    /// OpenGL texture the screen is shown from, 0 if none. Texture rows are the columns of the
+    /// screen like in the framebuffer, the first texture_extent of them hold it.
+    u32         texture;
+    float       texture_extent;
+    int         texture_scale;      ///< Texels of the texture per pixel of the screen
+};
+
+/// A frame presented, top and bottom screen
+struct Frame {
+    int         number;             ///< Index of the frame, counted from 0 by the renderer
+    Screen      screens[2];
+};
+
+/// Consumer of the frames, as an encoder streaming them
+class Sink {
+public:
+    virtual ~Sink() {}
+
+    /**
+     * Gets the name of the sink, for logs
+     * @return Name
+     */
+    virtual const char* GetName() const = 0;
+
+    /**
+     * Takes a frame, on the thread presenting it, with the OpenGL context current if there is
+     * one. The pixels and textures only hold the frame during the call: they're to be copied,
+     * best on the host GPU (as into a hardware encoder), not waited on.
+     * @param frame Frame presented
+     */
+    virtual void OnFrame(const Frame& frame) = 0;
+};
+
+/**
+ * Sets the sink the frames go to, before the video core is initialized
+ * @param sink Sink, owned by the module from now on, NULL for none
+ */
+void SetSink(Sink* sink);
+
+/// Whether there's a sink to hand the frames to
+bool IsActive();
+
+/**
+ * Hands a frame to the sink, from the renderer
+ * @param frame Frame presented
+ */
+void OutputFrame(const Frame& frame);
+
+} // namespace
@@ -5,10 +5,15 @@
 #pragma once
 
 #include <algorithm>
-#include <functional>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "common/hash.h"
 #include "common/log.h"
+#include "common/memory_tracker.h"
+#include "common/std_mutex.h"
 
 #include "core/hle/service/gsp.h"
 #include "pica.h"
@@ -44,21 +49,23 @@ public:
         /**
         * Called when a GX command has been processed and is ready for being
         * read via GraphicsDebugger::ReadGXCommandHistory.
-        * @param total_command_count Total number of commands in the GX history
+        * @param total_command_count Total number of commands processed so far, of which the
+        *        last GX_HISTORY_CAPACITY are kept in the history
         * @note All methods in this class are called from the GSP thread
         */
         virtual void GXCommandProcessed(int total_command_count)
         {
-            const GSP_GPU::GXCommand& cmd = observed->ReadGXCommandHistory(total_command_count-1);
-            ERROR_LOG(GSP, "Received command: id=%x", cmd.id);
+            GSP_GPU::GXCommand cmd;
+            if (observed->ReadGXCommandHistory(total_command_count-1, cmd))
+                ERROR_LOG(GSP, "Received command: id=%x", cmd.id);
         }
 
         /**
-        * @param lst command list which triggered this call
+        * @param index index of the command list which triggered this call, to be read via
+        *        GraphicsDebugger::GetCommandList
         * @param is_new true if the command list was called for the first time
-        * @todo figure out how to make sure called functions don't keep references around beyond their life time
         */
-        virtual void OnCommandListCalled(const PicaCommandList& lst, bool is_new)
+        virtual void OnCommandListCalled(size_t index, bool is_new)
         {
             ERROR_LOG(GSP, "Command list called: %d", (int)is_new);
         }
@@ -76,82 +83,242 @@ public:
         friend class GraphicsDebugger;
     };
 
+    enum {
+        GX_HISTORY_CAPACITY = 4096,     ///< Number of the latest GX commands kept, power of two
+        GX_COMMAND_WORDS    = 8,        ///< Words of a GX command in the command buffer
+    };
+
+    GraphicsDebugger() : has_observers(false), gx_command_count(0),
+                         gx_history(new HistorySlot[GX_HISTORY_CAPACITY])
+    {
+        Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_DEBUGGER_HISTORY,
+                                        GX_HISTORY_CAPACITY * sizeof(HistorySlot));
+    }
+
+    ~GraphicsDebugger()
+    {
+        Common::MemoryTracker::Free(Common::MemoryTracker::TAG_DEBUGGER_HISTORY,
+                                    GX_HISTORY_CAPACITY * sizeof(HistorySlot));
+    }
+
+    /**
+     * Tells whether any observer is registered, a relaxed load for the GSP thread so that the
+     * debugger costs nothing while no widget of it is open
+     * @return True if one is
+     */
+    bool HasObservers() const
+    {
+        return has_observers.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Records a GX command in the history, overwriting the oldest one once it is full, and tells
+     * the observers. Nothing is done without observers. Called from the GSP thread only.
+     * @param command_data Command in the GX command buffer
+     */
     void GXCommandProcessed(u8* command_data)
     {
-        gx_command_history.push_back(GSP_GPU::GXCommand());
-        GSP_GPU::GXCommand& cmd = gx_command_history[gx_command_history.size()-1];
+        // The history is only read by the observers
+        if (!HasObservers())
+            return;
+
+        const u64 index = gx_command_count.load(std::memory_order_relaxed);
+        HistorySlot& slot = gx_history[index & (GX_HISTORY_CAPACITY - 1)];
+
+        u32 words[GX_COMMAND_WORDS];
+        memcpy(words, command_data, sizeof(words));
 
-        const int cmd_length = sizeof(GSP_GPU::GXCommand);
-        memcpy(cmd.data, command_data, cmd_length);
+        // Sequence lock of the slot: 0 while it is being written, index + 1 once it holds the
+        // command of that index
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (int i = 0; i < GX_COMMAND_WORDS; i++)
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        slot.sequence.store(index + 1, std::memory_order_release);
+        gx_command_count.store(index + 1, std::memory_order_release);
 
-        ForEachObserver([this](DebuggerObserver* observer) {
-                          observer->GXCommandProcessed(this->gx_command_history.size());
+        ForEachObserver([index](DebuggerObserver* observer) {
+                          observer->GXCommandProcessed((int)(index + 1));
                         } );
     }
 
+    /**
+     * Captures a command list, only copied if it wasn't called before with the same contents at
+     * the same address, and tells the observers. Nothing is done without observers.
+     * @param address Guest address of the list
+     * @param command_list Words of the list
+     * @param size_in_words Number of words of the list
+     */
     void CommandListCalled(u32 address, u32* command_list, u32 size_in_words)
     {
-        PicaCommandList cmdlist;
-        for (u32* parse_pointer = command_list; parse_pointer < command_list + size_in_words;)
+        // Nobody to show the command list to
+        if (!HasObservers())
+            return;
+
+        const u64 hash = GetFastHash64((const u8*)command_list, size_in_words * sizeof(u32),
+                                       address);
+        size_t index = 0;
+        bool is_new = true;
         {
-            const Pica::CommandHeader header = static_cast<Pica::CommandHeader>(parse_pointer[1]);
+            std::lock_guard<std::mutex> lock(command_lists_lock);
+
+            auto range = command_list_index.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                const CapturedList& list = command_lists[it->second];
+                if (list.address == address && list.size == size_in_words &&
+                    std::equal(command_list, command_list + size_in_words,
+                               command_arena.begin() + list.offset)) {
+                    index = it->second;
+                    is_new = false;
+                    break;
+                }
+            }
+
+            if (is_new) {
+                index = command_lists.size();
+                const CapturedList list = { address, command_arena.size(), size_in_words };
+                command_arena.insert(command_arena.end(), command_list,
+                                     command_list + size_in_words);
+                command_lists.push_back(list);
+                command_list_index.insert(std::make_pair(hash, index));
+            }
+        }
+
+        ForEachObserver([&](DebuggerObserver* observer) {
+                            observer->OnCommandListCalled(index, is_new);
+                        } );
+    }
+
+    /// Gets the number of distinct command lists captured so far, from any thread
+    size_t GetCommandListCount()
+    {
+        std::lock_guard<std::mutex> lock(command_lists_lock);
+        return command_lists.size();
+    }
 
-            cmdlist.push_back(PicaCommand());
-            auto& cmd = cmdlist.back();
+    /**
+     * Splits a captured command list into its commands, from any thread
+     * @param index Index of the list, in capture order
+     * @param address Receives the guest address of the list
+     * @return Commands of the list
+     */
+    PicaCommandList GetCommandList(size_t index, u32& address)
+    {
+        std::lock_guard<std::mutex> lock(command_lists_lock);
+        const CapturedList& list = command_lists[index];
+        address = list.address;
+
+        PicaCommandList commands;
+        const u32* const begin = command_arena.data() + list.offset;
+        for (const u32* parse_pointer = begin; parse_pointer < begin + list.size;)
+        {
+            const Pica::CommandHeader header = static_cast<Pica::CommandHeader>(parse_pointer[1]);
 
             size_t size = 2 + header.extra_data_length;
             size = (size + 1) / 2 * 2; // align to 8 bytes
-            cmd.reserve(size);
-            std::copy(parse_pointer, parse_pointer + size, std::back_inserter(cmd));
+            size = std::min(size, (size_t)(begin + list.size - parse_pointer));
+            commands.push_back(PicaCommand());
+            commands.back().assign(parse_pointer, parse_pointer + size);
 
             parse_pointer += size;
         }
-
-        auto obj = std::pair<u32,PicaCommandList>(address, cmdlist);
-        auto it = std::find(command_lists.begin(), command_lists.end(), obj);
-        bool is_new = (it == command_lists.end());
-        if (is_new)
-            command_lists.push_back(obj);
-
-        ForEachObserver([&](DebuggerObserver* observer) {
-                            observer->OnCommandListCalled(obj.second, is_new);
-                        } );
+        return commands;
     }
 
-    const GSP_GPU::GXCommand& ReadGXCommandHistory(int index) const
+    /// Gets the number of GX commands processed so far, from any thread
+    u64 GetGXCommandCount() const
     {
-        // TODO: Is this thread-safe?
-        return gx_command_history[index];
+        return gx_command_count.load(std::memory_order_acquire);
     }
 
-    const std::vector<std::pair<u32,PicaCommandList>>& GetCommandLists() const
+    /**
+     * Reads a GX command of the history without locking, from any thread
+     * @param index Index of the command among all of those processed
+     * @param command Receives a copy of the command, its words past the command buffer zeroed
+     * @return False if the command isn't processed yet or was overwritten by a newer one
+     */
+    bool ReadGXCommandHistory(u64 index, GSP_GPU::GXCommand& command) const
     {
-        return command_lists;
+        const HistorySlot& slot = gx_history[index & (GX_HISTORY_CAPACITY - 1)];
+        const u64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1)
+            return false;
+
+        memset(&command, 0, sizeof(command));
+        for (int i = 0; i < GX_COMMAND_WORDS; i++)
+            command.data[i] = slot.words[i].load(std::memory_order_relaxed);
+
+        // Torn if the producer got to the slot meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
     }
 
+    /**
+     * Registers an observer to be told about the GPU events, once only however often it is
+     * registered, from any thread
+     * @param observer Observer to register
+     */
     void RegisterObserver(DebuggerObserver* observer)
     {
-        // TODO: Check for duplicates
-        observers.push_back(observer);
+        std::lock_guard<std::mutex> lock(observers_lock);
+        if (std::find(observers.begin(), observers.end(), observer) == observers.end())
+            observers.push_back(observer);
         observer->observed = this;
+        has_observers.store(true, std::memory_order_relaxed);
     }
 
+    /**
+     * Unregisters an observer, from any thread but an observer's callback
+     * @param observer Observer to unregister
+     */
     void UnregisterObserver(DebuggerObserver* observer)
     {
-        std::remove(observers.begin(), observers.end(), observer);
+        std::lock_guard<std::mutex> lock(observers_lock);
+        observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
         observer->observed = nullptr;
+        has_observers.store(!observers.empty(), std::memory_order_relaxed);
     }
 
 private:
-    void ForEachObserver(std::function<void (DebuggerObserver*)> func)
+    /// Entry of the GX command history
+    struct HistorySlot {
+        HistorySlot() : sequence(0) { }
+
+        std::atomic<u64> sequence;      ///< Index + 1 of the command held, 0 for none
+        std::atomic<u32> words[GX_COMMAND_WORDS];
+    };
+
+    /// Command list captured, its words in command_arena
+    struct CapturedList {
+        u32     address;
+        size_t  offset;     ///< In words
+        u32     size;       ///< In words
+    };
+
+    /**
+     * Calls a function for each observer, the function inlined rather than wrapped
+     * @param func Function taking the DebuggerObserver*
+     */
+    template <typename Func>
+    void ForEachObserver(const Func& func)
     {
-        std::for_each(observers.begin(),observers.end(), func);
+        std::lock_guard<std::mutex> lock(observers_lock);
+        for (DebuggerObserver* observer : observers)
+            func(observer);
     }
 
     std::vector<DebuggerObserver*> observers;
+    std::mutex observers_lock;              ///< Against observers registered from other threads
+    std::atomic<bool> has_observers;        ///< Whether observers isn't empty
 
-    std::vector<GSP_GPU::GXCommand> gx_command_history;
+    // Fixed ring of the latest GX commands, written by the GSP thread only
+    std::atomic<u64> gx_command_count;
+    std::unique_ptr<HistorySlot[]> gx_history;
 
-    // vector of pairs of command lists and their storage address
-    std::vector<std::pair<u32,PicaCommandList>> command_lists;
+    // Distinct command lists captured, their words back to back in one arena and indexed by a
+    // hash of their address and contents
+    std::vector<u32> command_arena;
+    std::vector<CapturedList> command_lists;
+    std::unordered_multimap<u64, size_t> command_list_index;
+    std::mutex command_lists_lock;          ///< Against the widgets reading the lists
 };
@@ -0,0 +1,181 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/atomic.h"
+#include "common/chunk_file.h"
+#include "common/log.h"
+#include "common/thread.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+
+namespace GPUThread {
+
+bool g_enabled = true;
+
+namespace {
+
+/// Command list waiting in the ring
+struct CommandList {
+    u32 address;
+    u32 size;
+};
+
+enum {
+    RING_SIZE = 0x100,  ///< Number of command lists in flight, a power of two
+};
+
+CommandList     g_ring[RING_SIZE];
+volatile u32    g_submitted = 0;        ///< Lists pushed so far, only written by the CPU thread
+volatile u32    g_completed = 0;        ///< Lists executed so far, only written by the GPU thread
+
+std::thread*    g_thread = nullptr;     ///< Host thread executing command lists
+Common::Event   g_work_event;           ///< Signalled by the CPU thread when it pushes a list
+Common::Event   g_done_event;           ///< Signalled by the GPU thread when it finishes a list
+volatile bool   g_quit = false;         ///< Tells the GPU thread to exit once the ring is empty
+
+/**
+ * Runs the command processor on a command list
+ * @param list Command list to execute
+ */
+void Execute(const CommandList& list) {
+    const u32* buffer = (const u32*)Memory::GetPointer(list.address);
+    if (buffer == NULL) {
+        ERROR_LOG(GPU, "command list at invalid address 0x%08X", list.address);
+        return;
+    }
+    Pica::CommandProcessor::ProcessCommandList(buffer, list.size);
+}
+
+/// GPU thread: executes command lists in the order they were submitted
+void ThreadFunc() {
+    Common::SetCurrentThreadName("GPU");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_HIGH);
+
+    u32 completed = g_completed;
+    for (;;) {
+        if (completed == Common::AtomicLoadAcquire(g_submitted)) {
+            if (g_quit) {
+                break;
+            }
+            g_work_event.Wait();
+            continue;
+        }
+        Execute(g_ring[completed & (RING_SIZE - 1)]);
+        completed++;
+        Common::AtomicStoreRelease(g_completed, completed);
+        g_done_event.Set();
+    }
+}
+
+/// Starts the GPU thread, it picks up the counters as they are
+void StartThread() {
+    g_quit = false;
+    g_thread = new std::thread(ThreadFunc);
+}
+
+/// Executes the pending command lists and joins the GPU thread
+void StopThread() {
+    g_quit = true;
+    g_work_event.Set();
+    g_thread->join();
+    delete g_thread;
+    g_thread = nullptr;
+}
+
+} // namespace
+
+/// Starts the GPU thread if the asynchronous mode is enabled
+void Init() {
+    g_submitted = g_completed = 0;
+    if (!g_enabled) {
+        return;
+    }
+    StartThread();
+
+    NOTICE_LOG(GPU, "GPU thread started");
+}
+
+/// Executes the pending command lists and joins the GPU thread
+void Shutdown() {
+    if (g_thread == nullptr) {
+        return;
+    }
+    StopThread();
+}
+
+/**
+ * Queues a command list for execution, or executes it right away without a GPU thread. Must only
+ * be called from the CPU emulation thread.
+ * @param address Guest address of the command list
+ * @param size Size of the command list in bytes
+ * @return Fence signalled once the list has been executed
+ */
+u32 SubmitCommandList(u32 address, u32 size) {
+    const CommandList list = { address, size };
+    const u32 submitted = g_submitted;
+
+    if (g_thread == nullptr) {
+        Execute(list);
+        g_submitted = g_completed = submitted + 1;
+        return submitted + 1;
+    }
+
+    // Wait for a free slot if the GPU thread has fallen a full ring behind
+    while (submitted - Common::AtomicLoadAcquire(g_completed) == RING_SIZE) {
+        g_done_event.Wait();
+    }
+    g_ring[submitted & (RING_SIZE - 1)] = list;
+    Common::AtomicStoreRelease(g_submitted, submitted + 1);
+    g_work_event.Set();
+
+    return submitted + 1;
+}
+
+/**
+ * Waits until a fence is signalled
+ * @param fence Fence returned by SubmitCommandList
+ */
+void WaitForFence(u32 fence) {
+    while ((s32)(Common::AtomicLoadAcquire(g_completed) - fence) < 0) {
+        g_done_event.Wait();
+    }
+}
+
+/// Waits until all submitted command lists have been executed
+void Sync() {
+    WaitForFence(g_submitted);
+}
+
+/**
+ * Saves or loads the fence counter, so that the fences in saved events stay meaningful. Waits
+ * until all submitted command lists have been executed.
+ * @param p Savestate the counter is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    Sync();
+
+    auto s = p.Section("GPUThread", 1);
+    if (!s) {
+        return;
+    }
+    u32 submitted = g_submitted;
+    p.Do(submitted);
+    if (p.GetMode() != PointerWrap::MODE_READ) {
+        return;
+    }
+    // The GPU thread keeps its own copy of the counter, it's restarted to pick up the new one
+    const bool running = (g_thread != nullptr);
+    if (running) {
+        StopThread();
+    }
+    g_submitted = g_completed = submitted;
+    if (running) {
+        StartThread();
+    }
+}
+
+} // namespace
@@ -0,0 +1,53 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+/**
+ * Host thread executing PICA command lists, so that the CPU emulation thread doesn't have to.
+ * Command lists are handed over through a fixed size single-producer/single-consumer ring; the
+ * command processor and its register file belong to the GPU thread while it runs. Submitting a
+ * list returns a fence, and the CPU side waits on fences only where the guest can observe the
+ * results of the GPU: interrupts, register reads and the framebuffers.
+ */
+namespace GPUThread {
+
+extern bool g_enabled;  ///< Whether command lists run asynchronously, read by Init
+
+/// Starts the GPU thread if the asynchronous mode is enabled
+void Init();
+
+/// Executes the pending command lists and joins the GPU thread
+void Shutdown();
+
+/**
+ * Queues a command list for execution, or executes it right away without a GPU thread. Must only
+ * be called from the CPU emulation thread.
+ * @param address Guest address of the command list
+ * @param size Size of the command list in bytes
+ * @return Fence signalled once the list has been executed
+ */
+u32 SubmitCommandList(u32 address, u32 size);
+
+/**
+ * Waits until a fence is signalled
+ * @param fence Fence returned by SubmitCommandList
+ */
+void WaitForFence(u32 fence);
+
+/// Waits until all submitted command lists have been executed
+void Sync();
+
+/**
+ * Saves or loads the fence counter, so that the fences in saved events stay meaningful. Waits
+ * until all submitted command lists have been executed.
+ * @param p Savestate the counter is written to or read from
+ */
+void DoState(PointerWrap& p);
+
+} // namespace
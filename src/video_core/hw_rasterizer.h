@@ -0,0 +1,65 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+#include "core/hw/gpu.h"
+
+#include "video_core/vertex_shader.h"
+
+namespace Pica {
+
+/**
+ * Backend rendering draws with the host GPU instead of the software rasterizer. It keeps host
+ * copies of the guest color buffers, which are only written back to guest memory when the guest
+ * reads them.
+ */
+class HWRasterizer : NonCopyable {
+public:
+    virtual ~HWRasterizer() {
+    }
+
+    /**
+     * Draws shaded vertices with the render state currently set in Pica::g_regs
+     * @param vertices Vertices of the draw
+     * @param count Number of vertices
+     */
+    virtual void SubmitPrimitives(const VertexShader::OutputVertex* vertices, u32 count) = 0;
+
+    /// Hands the draws submitted so far to the host GPU
+    virtual void Flush() = 0;
+
+    /**
+     * Writes the host copies of the surfaces overlapping a memory range back to guest memory
+     * @param address Physical address of the range
+     * @param size Size of the range in bytes
+     */
+    virtual void FlushRegion(u32 address, u32 size) = 0;
+
+    /**
+     * Drops the host copies of the surfaces overlapping a memory range the guest wrote to. The
+     * range is flushed before the write, so the copies hold nothing that guest memory lacks.
+     * @param address Physical address of the range
+     * @param size Size of the range in bytes
+     */
+    virtual void InvalidateRegion(u32 address, u32 size) = 0;
+
+    /**
+     * Runs a display transfer between host surfaces, without going through guest memory
+     * @param config Transfer to run
+     * @return True if done, false if the input has no host surface to serve it from
+     */
+    virtual bool AccelerateDisplayTransfer(const GPU::DisplayTransferConfig& config) = 0;
+
+    /**
+     * Runs a texture copy between host surfaces, without going through guest memory
+     * @param config Copy to run
+     * @return True if done, false if the copy isn't of a whole host surface
+     */
+    virtual bool AccelerateTextureCopy(const GPU::TextureCopyConfig& config) = 0;
+};
+
+} // namespace
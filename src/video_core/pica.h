@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <string.h>
+
 #include <initializer_list>
 #include <map>
 
@@ -15,11 +17,29 @@ namespace Pica {
 
 struct Regs {
     enum Id : u32 {
+        CullMode                   =  0x40,
         ViewportSizeX              =  0x41,
         ViewportInvSizeX           =  0x42,
         ViewportSizeY              =  0x43,
         ViewportInvSizeY           =  0x44,
+        VSOutputTotal              =  0x4F,
+        VSOutputAttributes         =  0x50, // 0x51-0x56
         ViewportCorner             =  0x68,
+        TextureUnitConfig          =  0x80,
+        Texture0BorderColor        =  0x81,
+        Texture0Size               =  0x82,
+        Texture0Parameters         =  0x83,
+        Texture0Address            =  0x85,
+        Texture0Format             =  0x8E,
+        TevStage0Source            =  0xC0, // 0xC8,0xD0,0xD8,0xF0,0xF8
+        TevStage0Operand           =  0xC1, // 0xC9,0xD1,0xD9,0xF1,0xF9
+        TevStage0Op                =  0xC2, // 0xCA,0xD2,0xDA,0xF2,0xFA
+        TevStage0Color             =  0xC3, // 0xCB,0xD3,0xDB,0xF3,0xFB
+        TevStage0Scale             =  0xC4, // 0xCC,0xD4,0xDC,0xF4,0xFC
+        ColorOperation             = 0x100,
+        BlendFunc                  = 0x101,
+        BlendColor                 = 0x103,
+        AlphaTest                  = 0x104,
         DepthBufferFormat          = 0x116,
         ColorBufferFormat          = 0x117,
         DepthBufferAddress         = 0x11C,
@@ -32,6 +52,24 @@ struct Regs {
         VertexAttributeInfo0       = 0x204, // 0x207,0x20A,0x20D,0x210,0x213,0x216,0x219,0x21C,0x21F,0x222,0x225
         VertexAttributeInfo1       = 0x205, // 0x208,0x20B,0x20E,0x211,0x214,0x217,0x21A,0x21D,0x220,0x223,0x226
 
+        IndexArrayConfig           = 0x227,
+        NumVertices                = 0x228,
+        VertexOffset               = 0x22A,
+        TriggerDraw                = 0x22E,
+        TriggerDrawIndexed         = 0x22F,
+        TriangleTopology           = 0x25E,
+
+        VSBoolUniform              = 0x2B0,
+        VSIntUniform               = 0x2B1, // 0x2B2-0x2B4
+        VSMainOffset               = 0x2BA,
+        VSInputRegisterMap         = 0x2BB, // 0x2BC
+        VSFloatUniformSetup        = 0x2C0,
+        VSFloatUniformData         = 0x2C1, // 0x2C2-0x2C8
+        VSBeginLoadProgramData     = 0x2CB,
+        VSLoadProgramData          = 0x2CC, // 0x2CD-0x2D3
+        VSBeginLoadSwizzleData     = 0x2D5,
+        VSLoadSwizzleData          = 0x2D6, // 0x2D7-0x2DD
+
         NumIds                     = 0x300,
     };
 
@@ -54,6 +92,26 @@ static inline Regs::Id VertexAttributeInfo1(int n)
     return static_cast<Regs::Id>(0x205 + 3*n);
 }
 
+static inline Regs::Id VSOutputAttributes(int n)
+{
+    return static_cast<Regs::Id>(0x50 + n);
+}
+
+static inline Regs::Id VSIntUniform(int n)
+{
+    return static_cast<Regs::Id>(0x2B1 + n);
+}
+
+enum {
+    NUM_TEV_STAGES = 6,
+};
+
+/// Register of a texture combiner stage, the last two stages come after a gap
+static inline Regs::Id TevStageRegister(int stage, Regs::Id stage0_reg)
+{
+    return static_cast<Regs::Id>(stage0_reg + 8 * stage + (stage >= 4 ? 0x10 : 0));
+}
+
 union CommandHeader {
     CommandHeader(u32 h) : hex(h) {}
 
@@ -66,16 +124,85 @@ union CommandHeader {
 };
 
 static std::map<Regs::Id, const char*> command_names = {
+    {Regs::CullMode, "CullMode" },
     {Regs::ViewportSizeX, "ViewportSizeX" },
     {Regs::ViewportInvSizeX, "ViewportInvSizeX" },
     {Regs::ViewportSizeY, "ViewportSizeY" },
     {Regs::ViewportInvSizeY, "ViewportInvSizeY" },
+    {Regs::VSOutputTotal, "VSOutputTotal" },
+    {Regs::VSOutputAttributes, "VSOutputAttributes" },
     {Regs::ViewportCorner, "ViewportCorner" },
+    {Regs::TextureUnitConfig, "TextureUnitConfig" },
+    {Regs::Texture0BorderColor, "Texture0BorderColor" },
+    {Regs::Texture0Size, "Texture0Size" },
+    {Regs::Texture0Parameters, "Texture0Parameters" },
+    {Regs::Texture0Address, "Texture0Address" },
+    {Regs::Texture0Format, "Texture0Format" },
+    {Regs::TevStage0Source, "TevStage0Source" },
+    {Regs::TevStage0Operand, "TevStage0Operand" },
+    {Regs::TevStage0Op, "TevStage0Op" },
+    {Regs::TevStage0Color, "TevStage0Color" },
+    {Regs::TevStage0Scale, "TevStage0Scale" },
+    {Regs::ColorOperation, "ColorOperation" },
+    {Regs::BlendFunc, "BlendFunc" },
+    {Regs::BlendColor, "BlendColor" },
+    {Regs::AlphaTest, "AlphaTest" },
     {Regs::DepthBufferFormat, "DepthBufferFormat" },
     {Regs::ColorBufferFormat, "ColorBufferFormat" },
     {Regs::DepthBufferAddress, "DepthBufferAddress" },
     {Regs::ColorBufferAddress, "ColorBufferAddress" },
     {Regs::ColorBufferSize, "ColorBufferSize" },
+    {Regs::VertexArrayBaseAddr, "VertexArrayBaseAddr" },
+    {Regs::VertexDescriptor, "VertexDescriptor" },
+    {Regs::IndexArrayConfig, "IndexArrayConfig" },
+    {Regs::NumVertices, "NumVertices" },
+    {Regs::VertexOffset, "VertexOffset" },
+    {Regs::TriggerDraw, "TriggerDraw" },
+    {Regs::TriggerDrawIndexed, "TriggerDrawIndexed" },
+    {Regs::TriangleTopology, "TriangleTopology" },
+    {Regs::VSBoolUniform, "VSBoolUniform" },
+    {Regs::VSIntUniform, "VSIntUniform" },
+    {Regs::VSMainOffset, "VSMainOffset" },
+    {Regs::VSInputRegisterMap, "VSInputRegisterMap" },
+    {Regs::VSFloatUniformSetup, "VSFloatUniformSetup" },
+    {Regs::VSFloatUniformData, "VSFloatUniformData" },
+    {Regs::VSBeginLoadProgramData, "VSBeginLoadProgramData" },
+    {Regs::VSLoadProgramData, "VSLoadProgramData" },
+    {Regs::VSBeginLoadSwizzleData, "VSBeginLoadSwizzleData" },
+    {Regs::VSLoadSwizzleData, "VSLoadSwizzleData" },
+};
+
+/**
+ * Converts a float24 (sign, 7 bit exponent biased by 63, 16 bit mantissa) to a float
+ * @param value Raw float24 in the low 24 bits
+ */
+static inline float Float24ToFloat(u32 value) {
+    const u32 sign = (value >> 23) & 1;
+    const u32 exponent = (value >> 16) & 0x7F;
+    const u32 mantissa = value & 0xFFFF;
+
+    u32 hex;
+    if ((value & 0x7FFFFF) == 0) {
+        hex = sign << 31;
+    } else if (exponent == 0x7F) {
+        hex = (sign << 31) | (0xFF << 23) | (mantissa << 7);
+    } else {
+        hex = (sign << 31) | ((exponent + 64) << 23) | (mantissa << 7);
+    }
+    float result;
+    memcpy(&result, &hex, sizeof(result));
+    return result;
+}
+
+template<>
+union Regs::Struct<Regs::CullMode> {
+    enum class Mode : u32 {
+        KeepAll = 0,
+        KeepClockWise = 1,
+        KeepCounterClockWise = 2,
+    };
+
+    BitField< 0,  2, Mode> mode;
 };
 
 template<>
@@ -88,6 +215,271 @@ union Regs::Struct<Regs::ViewportSizeY> {
     BitField<0, 24, u32> value;
 };
 
+template<>
+union Regs::Struct<Regs::ViewportCorner> {
+    BitField< 0, 10, u32> x;
+    BitField<16, 10, u32> y;
+};
+
+template<>
+union Regs::Struct<Regs::TextureUnitConfig> {
+    BitField< 0,  1, u32> texture0_enable;
+};
+
+template<>
+union Regs::Struct<Regs::Texture0Size> {
+    BitField< 0, 11, u32> height;
+    BitField<16, 11, u32> width;
+};
+
+template<>
+union Regs::Struct<Regs::Texture0Parameters> {
+    enum class WrapMode : u32 {
+        ClampToEdge = 0,
+        ClampToBorder = 1,
+        Repeat = 2,
+        MirroredRepeat = 3,
+    };
+
+    BitField< 8,  2, WrapMode> wrap_t;
+    BitField<12,  2, WrapMode> wrap_s;
+};
+
+template<>
+union Regs::Struct<Regs::Texture0Address> {
+    BitField< 0, 28, u32> address;
+
+    u32 GetPhysicalAddress() const {
+        return address * 8;
+    }
+};
+
+template<>
+union Regs::Struct<Regs::Texture0Format> {
+    enum class Format : u32 {
+        RGBA8 = 0,
+        RGB8 = 1,
+        RGB5A1 = 2,
+        RGB565 = 3,
+        RGBA4 = 4,
+        IA8 = 5,
+        RG8 = 6,
+        I8 = 7,
+        A8 = 8,
+        IA4 = 9,
+        I4 = 10,
+        A4 = 11,
+        ETC1 = 12,
+        ETC1A4 = 13,
+    };
+
+    BitField< 0,  4, Format> format;
+
+    // bits per texel
+    u32 GetTexelBits() const {
+        return GetTexelBits(format);
+    }
+
+    static u32 GetTexelBits(Format format) {
+        switch (format) {
+        case Format::RGBA8:
+            return 32;
+        case Format::RGB8:
+            return 24;
+        case Format::I8: case Format::A8: case Format::IA4: case Format::ETC1A4:
+            return 8;
+        case Format::I4: case Format::A4: case Format::ETC1:
+            return 4;
+        default:
+            return 16;
+        }
+    }
+};
+
+template<>
+union Regs::Struct<Regs::TevStage0Source> {
+    enum class Source : u32 {
+        PrimaryColor = 0,
+        PrimaryFragmentColor = 1,
+        SecondaryFragmentColor = 2,
+        Texture0 = 3,
+        Texture1 = 4,
+        Texture2 = 5,
+        Texture3 = 6,
+        PreviousBuffer = 13,
+        Constant = 14,
+        Previous = 15,
+    };
+
+    BitField< 0,  4, Source> color_source1;
+    BitField< 4,  4, Source> color_source2;
+    BitField< 8,  4, Source> color_source3;
+    BitField<16,  4, Source> alpha_source1;
+    BitField<20,  4, Source> alpha_source2;
+    BitField<24,  4, Source> alpha_source3;
+};
+
+template<>
+union Regs::Struct<Regs::TevStage0Operand> {
+    enum class ColorModifier : u32 {
+        SourceColor = 0,
+        OneMinusSourceColor = 1,
+        SourceAlpha = 2,
+        OneMinusSourceAlpha = 3,
+        SourceRed = 4,
+        OneMinusSourceRed = 5,
+        SourceGreen = 8,
+        OneMinusSourceGreen = 9,
+        SourceBlue = 12,
+        OneMinusSourceBlue = 13,
+    };
+
+    enum class AlphaModifier : u32 {
+        SourceAlpha = 0,
+        OneMinusSourceAlpha = 1,
+        SourceRed = 2,
+        OneMinusSourceRed = 3,
+        SourceGreen = 4,
+        OneMinusSourceGreen = 5,
+        SourceBlue = 6,
+        OneMinusSourceBlue = 7,
+    };
+
+    BitField< 0,  4, ColorModifier> color_modifier1;
+    BitField< 4,  4, ColorModifier> color_modifier2;
+    BitField< 8,  4, ColorModifier> color_modifier3;
+    BitField<12,  3, AlphaModifier> alpha_modifier1;
+    BitField<16,  3, AlphaModifier> alpha_modifier2;
+    BitField<20,  3, AlphaModifier> alpha_modifier3;
+};
+
+template<>
+union Regs::Struct<Regs::TevStage0Op> {
+    enum class Operation : u32 {
+        Replace = 0,
+        Modulate = 1,
+        Add = 2,
+        AddSigned = 3,
+        Lerp = 4,
+        Subtract = 5,
+        Dot3RGB = 6,
+        MultiplyThenAdd = 8,
+        AddThenMultiply = 9,
+    };
+
+    BitField< 0,  4, Operation> color_op;
+    BitField<16,  4, Operation> alpha_op;
+};
+
+template<>
+union Regs::Struct<Regs::TevStage0Scale> {
+    // results are multiplied by 1 << scale
+    BitField< 0,  2, u32> color_scale;
+    BitField<16,  2, u32> alpha_scale;
+};
+
+template<>
+union Regs::Struct<Regs::ColorOperation> {
+    // logic ops aren't emulated, they are drawn as a plain copy
+    BitField< 8,  1, u32> alpha_blending_enable;
+};
+
+template<>
+union Regs::Struct<Regs::BlendFunc> {
+    enum class Equation : u32 {
+        Add = 0,
+        Subtract = 1,
+        ReverseSubtract = 2,
+        Min = 3,
+        Max = 4,
+    };
+
+    enum class Factor : u32 {
+        Zero = 0,
+        One = 1,
+        SourceColor = 2,
+        OneMinusSourceColor = 3,
+        DestColor = 4,
+        OneMinusDestColor = 5,
+        SourceAlpha = 6,
+        OneMinusSourceAlpha = 7,
+        DestAlpha = 8,
+        OneMinusDestAlpha = 9,
+        ConstantColor = 10,
+        OneMinusConstantColor = 11,
+        ConstantAlpha = 12,
+        OneMinusConstantAlpha = 13,
+        SourceAlphaSaturate = 14,
+    };
+
+    BitField< 0,  3, Equation> color_equation;
+    BitField< 8,  3, Equation> alpha_equation;
+    BitField<16,  4, Factor> color_source_factor;
+    BitField<20,  4, Factor> color_dest_factor;
+    BitField<24,  4, Factor> alpha_source_factor;
+    BitField<28,  4, Factor> alpha_dest_factor;
+};
+
+template<>
+union Regs::Struct<Regs::AlphaTest> {
+    enum class Function : u32 {
+        Never = 0,
+        Always = 1,
+        Equal = 2,
+        NotEqual = 3,
+        LessThan = 4,
+        LessThanOrEqual = 5,
+        GreaterThan = 6,
+        GreaterThanOrEqual = 7,
+    };
+
+    BitField< 0,  1, u32> enable;
+    BitField< 4,  3, Function> function;
+    BitField< 8,  8, u32> reference;
+};
+
+template<>
+union Regs::Struct<Regs::ColorBufferFormat> {
+    enum class Format : u32 {
+        RGBA8 = 0,
+        RGB8 = 1,
+        RGB5A1 = 2,
+        RGB565 = 3,
+        RGBA4 = 4,
+    };
+
+    BitField<16,  3, Format> format;
+
+    // bytes per pixel
+    u32 GetPixelSize() const {
+        return format == Format::RGBA8 ? 4 : format == Format::RGB8 ? 3 : 2;
+    }
+};
+
+template<>
+union Regs::Struct<Regs::ColorBufferAddress> {
+    BitField< 0, 28, u32> address;
+
+    u32 GetPhysicalAddress() const {
+        return address * 8;
+    }
+};
+
+template<>
+union Regs::Struct<Regs::ColorBufferSize> {
+    BitField< 0, 11, u32> width;
+    BitField<12, 10, u32> height;
+};
+
+template<>
+union Regs::Struct<Regs::VertexArrayBaseAddr> {
+    BitField<1, 28, u32> base_address;
+
+    u32 GetPhysicalAddress() const {
+        return base_address * 16;
+    }
+};
+
 template<>
 union Regs::Struct<Regs::VertexDescriptor> {
     enum class Format : u64 {
@@ -124,7 +516,82 @@ union Regs::Struct<Regs::VertexDescriptor> {
 
     BitField<48, 12, u64> attribute_mask;
     BitField<60,  4, u64> num_attributes; // number of total attributes minus 1
+
+    u64 hex;
+
+    Format GetFormat(int n) const {
+        return static_cast<Format>((hex >> (4 * n)) & 3);
+    }
+
+    // number of elements of the attribute, 1 to 4
+    u32 GetNumElements(int n) const {
+        return ((hex >> (4 * n + 2)) & 3) + 1;
+    }
+
+    // fixed attributes take a constant value instead of being loaded from a vertex array
+    bool IsFixed(int n) const {
+        return ((attribute_mask >> n) & 1) != 0;
+    }
+};
+
+// Describes a vertex array, covers both VertexAttributeInfo0 and VertexAttributeInfo1
+template<>
+union Regs::Struct<Regs::VertexAttributeInfo0> {
+    BitField<48,  8, u64> byte_count;       // size of one vertex of the array
+    BitField<60,  4, u64> component_count;  // number of entries in the component list
+
+    u64 hex;
+
+    // entry of the component list: an attribute index, or 12-15 for 4, 8, 12 or 16 padding bytes
+    u32 GetComponent(int n) const {
+        return (hex >> (4 * n)) & 0xF;
+    }
+};
+
+template<>
+union Regs::Struct<Regs::IndexArrayConfig> {
+    BitField< 0, 28, u32> offset;           // relative to the vertex array base address
+    BitField<31,  1, u32> format;           // 0: 8 bit indices, 1: 16 bit indices
 };
 
+// Maps the components of a shader output register to output semantics, 0x1F for unused ones
+template<>
+union Regs::Struct<Regs::TriangleTopology> {
+    enum class Topology : u32 {
+        List = 0,
+        Strip = 1,
+        Fan = 2,
+        ShaderList = 3,     // triangles emitted by the geometry shader, assembled as a list
+    };
+
+    BitField< 8,  2, Topology> topology;
+};
+
+template<>
+union Regs::Struct<Regs::VSOutputAttributes> {
+    BitField< 0,  5, u32> map_x;
+    BitField< 8,  5, u32> map_y;
+    BitField<16,  5, u32> map_z;
+    BitField<24,  5, u32> map_w;
+
+    u32 hex;
+
+    u32 GetSemantic(int component) const {
+        return (hex >> (8 * component)) & 0x1F;
+    }
+};
+
+template<>
+union Regs::Struct<Regs::VSIntUniform> {
+    BitField< 0,  8, u32> x;               // loop iterations minus 1
+    BitField< 8,  8, u32> y;               // initial value of the loop counter
+    BitField<16,  8, u32> z;               // increment of the loop counter
+};
+
+template<>
+union Regs::Struct<Regs::VSFloatUniformSetup> {
+    BitField< 0,  7, u32> index;           // uniform written by the next VSFloatUniformData words
+    BitField<31,  1, u32> is_float32;      // 0: four float24 in three words, 1: four float32
+};
 
 } // namespace
@@ -0,0 +1,348 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/chunk_file.h"
+#include "common/file_util.h"
+#include "common/log.h"
+#include "common/lz4.h"
+#include "common/profiler.h"
+
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/savestate.h"
+#include "core/hle/service/gsp.h"
+#include "core/hw/gpu.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/pica_trace.h"
+#include "video_core/rasterizer.h"
+#include "video_core/video_core.h"
+
+namespace PicaTrace {
+
+namespace {
+
+enum {
+    MAGIC               = 0x54505443,   ///< "CTPT"
+    VERSION             = 1,
+
+    GX_COMMAND_SIZE     = 0x20,         ///< Size of a GX command in bytes
+    MAX_RUN_SIZE        = 0x100000,     ///< Longer runs of pages are split into several records
+};
+
+struct FileHeader {
+    u32 magic;
+    u32 version;
+};
+
+/// Traces are a header followed by records, a state record first
+enum RecordType : u32 {
+    RECORD_STATE        = 1,            ///< GPU and PICA states, through PointerWrap
+    RECORD_MEMORY       = 2,            ///< Run of guest pages, a MemoryHeader then the data
+    RECORD_GX_COMMAND   = 3,            ///< GX command executed
+    RECORD_FRAME        = 4,            ///< End of a frame, presented
+};
+
+struct RecordHeader {
+    u32 type;
+    u32 frame;
+    u32 size;                           ///< Size of the data following the header in bytes
+};
+
+struct MemoryHeader {
+    u32 address;                        ///< Guest address of the run
+    u32 size;                           ///< Size of the run in bytes, the LZ4 block following
+                                        ///< the header is the run as is if it's of that size
+};
+
+bool            g_recording = false;
+File::IOFile    g_file;
+u32             g_frame = 0;            ///< Frames recorded so far
+u32             g_num_frames = 0;       ///< Frames to record
+std::vector<u8> g_buffer;               ///< Compressed memory of the record being written
+
+/**
+ * Tells whether the GPU can read a memory region, FCRAM and VRAM
+ * @param region Memory region
+ */
+bool IsTraced(const SaveState::Region& region) {
+    return region.address == Memory::HEAP_VADDR || region.address == Memory::HEAP_GSP_VADDR ||
+        region.address == Memory::VRAM_VADDR;
+}
+
+/**
+ * Writes a memory record
+ * @param address Guest address of the memory
+ * @param memory Host pointer to the memory
+ * @param size Size of the memory in bytes
+ * @return True on success
+ */
+bool WriteMemoryRecord(u32 address, const u8* memory, u32 size) {
+    // Runs that don't compress are stored as is, told apart by their size
+    g_buffer.resize(size - 1);
+    const u32 compressed_size = size > 1 ?
+        (u32)Common::LZ4Compress(memory, size, g_buffer.data(), g_buffer.size()) : 0;
+    const u8* data = compressed_size != 0 ? g_buffer.data() : memory;
+    const u32 data_size = compressed_size != 0 ? compressed_size : size;
+
+    const RecordHeader header = { RECORD_MEMORY, g_frame, (u32)sizeof(MemoryHeader) + data_size };
+    const MemoryHeader memory_header = { address, size };
+    return g_file.WriteArray(&header, 1) && g_file.WriteArray(&memory_header, 1) &&
+        g_file.WriteBytes(data, data_size);
+}
+
+/**
+ * Writes the memory the GPU can read as records of consecutive pages
+ * @param written_only Write the pages written since the last call, zeroes or not, instead of the
+ *                     pages that aren't all zeroes
+ * @return True on success
+ */
+bool WritePages(bool written_only) {
+    for (const SaveState::Region& region : SaveState::g_regions) {
+        if (!IsTraced(region)) {
+            continue;
+        }
+        const u8* memory = *region.pointer;
+        u32 offset = 0;
+        while (offset < region.size) {
+            u32 end = offset;
+            while (end < region.size && end - offset < MAX_RUN_SIZE && (written_only ?
+                SaveState::IsPageWritten(region, end, Memory::DIRTY_TRACE) :
+                !SaveState::IsZeroPage(memory + end))) {
+                end += Memory::PAGE_SIZE;
+            }
+            if (end == offset) {
+                offset += Memory::PAGE_SIZE;
+                continue;
+            }
+            if (!WriteMemoryRecord(region.address + offset, memory + offset, end - offset)) {
+                return false;
+            }
+            offset = end;
+        }
+    }
+    SaveState::ClearWritten(Memory::DIRTY_TRACE);
+    return true;
+}
+
+/**
+ * Saves or loads the states a trace starts from
+ * @param p Trace state the states are written to or read from
+ */
+void DoState(PointerWrap& p) {
+    GPU::DoState(p);
+    Pica::CommandProcessor::DoState(p);
+}
+
+/**
+ * Writes the GPU and PICA states as a state record
+ * @return True on success
+ */
+bool WriteState() {
+    u8* ptr = NULL;
+    PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
+    DoState(p);
+    std::vector<u8> buffer((size_t)ptr);
+    ptr = buffer.data();
+    p.SetMode(PointerWrap::MODE_WRITE);
+    DoState(p);
+
+    const RecordHeader header = { RECORD_STATE, g_frame, (u32)buffer.size() };
+    return g_file.WriteArray(&header, 1) && g_file.WriteBytes(buffer.data(), buffer.size());
+}
+
+/// Stops recording after a write failed
+void FailRecording() {
+    ERROR_LOG(GPU, "couldn't write the trace, stopping it");
+    StopRecording();
+}
+
+/**
+ * Writes the data of a memory record to guest memory
+ * @param data Data of the record
+ * @param size Size of the data in bytes
+ * @return True on success, false if the record is broken
+ */
+bool ReplayMemory(const u8* data, u32 size) {
+    MemoryHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+
+    // Runs are within a region, which is contiguous in host memory
+    u8* const memory = header.size != 0 ? Memory::GetPointer(header.address) : NULL;
+    if (memory == NULL || Memory::GetPointer(header.address + header.size - 1) !=
+        memory + header.size - 1) {
+        return false;
+    }
+    if (size == header.size) {
+        memcpy(memory, data, size);
+    } else if (!Common::LZ4Decompress(data, size, memory, header.size)) {
+        return false;
+    }
+    Memory::MarkRangeDirty(header.address, header.size);
+    Pica::Rasterizer::InvalidateRegion(Memory::PhysicalAddressFromVirtual(header.address),
+        header.size);
+    return true;
+}
+
+} // namespace
+
+/**
+ * Starts recording a trace from the current state, stopping any trace recorded. Must be called
+ * between two CPU slices.
+ * @param filename Path of the trace
+ * @param num_frames Number of frames to record, after which the trace stops by itself
+ * @return True on success
+ */
+bool StartRecording(const std::string& filename, u32 num_frames) {
+    StopRecording();
+
+    // Guest memory has to hold what the command lists in flight and the host GPU rendered
+    SaveState::FlushMemory();
+
+    g_frame = 0;
+    g_num_frames = num_frames;
+    const FileHeader header = { MAGIC, VERSION };
+    if (!g_file.Open(filename, "wb") || !g_file.WriteArray(&header, 1) || !WriteState() ||
+        !WritePages(false)) {
+        ERROR_LOG(GPU, "couldn't create trace %s", filename.c_str());
+        g_file.Close();
+        return false;
+    }
+    g_recording = true;
+    NOTICE_LOG(GPU, "recording %u frames to trace %s", num_frames, filename.c_str());
+    return true;
+}
+
+/// Stops recording the trace
+void StopRecording() {
+    if (!g_recording) {
+        return;
+    }
+    g_recording = false;
+    g_file.Close();
+    g_buffer.clear();
+    g_buffer.shrink_to_fit();
+    NOTICE_LOG(GPU, "trace stopped after %u frames", g_frame);
+}
+
+/**
+ * Records a GX command about to be executed, along with the guest memory the CPU wrote since the
+ * last one, if recording
+ * @param command Command, 8 words, its id first
+ */
+void OnGXCommand(const u32* command) {
+    if (!g_recording) {
+        return;
+    }
+
+    // The command lists in flight may render to pages the CPU wrote too
+    GPUThread::Sync();
+
+    const RecordHeader header = { RECORD_GX_COMMAND, g_frame, GX_COMMAND_SIZE };
+    if (!WritePages(true) || !g_file.WriteArray(&header, 1) ||
+        !g_file.WriteBytes(command, GX_COMMAND_SIZE)) {
+        FailRecording();
+    }
+}
+
+/// Records the end of a frame, once it has been presented, if recording
+void OnFrame() {
+    if (!g_recording) {
+        return;
+    }
+    const RecordHeader header = { RECORD_FRAME, g_frame, 0 };
+    if (!g_file.WriteArray(&header, 1)) {
+        FailRecording();
+        return;
+    }
+    g_frame++;
+    if (g_frame >= g_num_frames) {
+        StopRecording();
+    }
+}
+
+/**
+ * Replays a trace into the video core, which must be initialized without the CPU core
+ * @param filename Path of the trace
+ * @return Number of frames replayed, -1 if the trace couldn't be read
+ */
+int Replay(const std::string& filename) {
+    File::IOFile file;
+    FileHeader file_header;
+    if (!file.Open(filename, "rb") || !file.ReadArray(&file_header, 1) ||
+        file_header.magic != MAGIC || file_header.version != VERSION) {
+        ERROR_LOG(GPU, "%s isn't a trace of version %u", filename.c_str(), (u32)VERSION);
+        return -1;
+    }
+
+    int frames = 0;
+    std::vector<u8> data;
+    RecordHeader header;
+    while (file.ReadArray(&header, 1)) {
+        data.resize(header.size);
+        // A recording stopped by a crash can end in the middle of a record
+        if (header.size != 0 && !file.ReadBytes(data.data(), header.size)) {
+            break;
+        }
+
+        switch (header.type) {
+        case RECORD_STATE:
+        {
+            GPUThread::Sync();
+            u8* ptr = data.data();
+            PointerWrap p(&ptr, PointerWrap::MODE_READ);
+            DoState(p);
+            break;
+        }
+
+        case RECORD_MEMORY:
+            // Command lists in flight may read the memory
+            GPUThread::Sync();
+            if (!ReplayMemory(data.data(), header.size)) {
+                ERROR_LOG(GPU, "trace has a broken memory record at frame %u", header.frame);
+                return -1;
+            }
+            break;
+
+        case RECORD_GX_COMMAND:
+            if (header.size < GX_COMMAND_SIZE) {
+                ERROR_LOG(GPU, "trace has a broken GX command at frame %u", header.frame);
+                return -1;
+            }
+            GSP_GPU::ExecuteGXCommand((const u32*)data.data());
+            break;
+
+        case RECORD_FRAME:
+            GPUThread::Sync();
+            VideoCore::g_renderer->SwapBuffers();
+            VideoCore::g_frame_arena.Reset();
+            Common::Profiler::EndFrame();
+
+            // The interrupts of the GPU have no guest to go to, their events are never run
+            CoreTiming::ClearPendingEvents();
+            frames++;
+            break;
+
+        default:
+            WARN_LOG(GPU, "trace has a record of unknown type %u, skipping it", header.type);
+            break;
+        }
+    }
+    GPUThread::Sync();
+    return frames;
+}
+
+} // namespace
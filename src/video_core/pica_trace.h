@@ -0,0 +1,49 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Traces of the GPU work of a sequence of frames, replayed without the CPU core as a benchmark
+ * and to bisect rendering regressions. A trace starts with the GPU and PICA states and the guest
+ * memory the GPU can read, then holds the GX commands in their order, each preceded by the pages
+ * the CPU wrote since the command before it, and the frame boundaries. Memory is LZ4 compressed;
+ * what the GPU itself writes isn't recorded, replaying the commands writes it again.
+ */
+namespace PicaTrace {
+
+/**
+ * Starts recording a trace from the current state, stopping any trace recorded. Must be called
+ * between two CPU slices.
+ * @param filename Path of the trace
+ * @param num_frames Number of frames to record, after which the trace stops by itself
+ * @return True on success
+ */
+bool StartRecording(const std::string& filename, u32 num_frames);
+
+/// Stops recording the trace
+void StopRecording();
+
+/**
+ * Records a GX command about to be executed, along with the guest memory the CPU wrote since the
+ * last one, if recording
+ * @param command Command, 8 words, its id first
+ */
+void OnGXCommand(const u32* command);
+
+/// Records the end of a frame, once it has been presented, if recording
+void OnFrame();
+
+/**
+ * Replays a trace into the video core, which must be initialized without the CPU core
+ * @param filename Path of the trace
+ * @return Number of frames replayed, -1 if the trace couldn't be read
+ */
+int Replay(const std::string& filename);
+
+} // namespace
@@ -0,0 +1,66 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/pica.h"
+
+namespace Pica {
+
+/// Assembly of the vertices of a draw into triangles, shared by the rasterizers
+namespace PrimitiveAssembler {
+
+typedef Regs::Struct<Regs::TriangleTopology>::Topology Topology;
+
+/**
+ * Calls a function with the vertices of each triangle of a draw. Every other triangle of a
+ * strip is reversed, so that all of them keep the winding of the first.
+ * @param topology How the vertices make triangles
+ * @param count Number of vertices of the draw
+ * @param func Function called with the numbers of the three vertices of each triangle
+ */
+template <typename Func>
+inline void ForEachTriangle(Topology topology, u32 count, const Func& func) {
+    switch (topology) {
+    case Topology::Strip:
+        for (u32 i = 0; i + 2 < count; i++) {
+            if (i & 1) {
+                func(i + 1, i, i + 2);
+            } else {
+                func(i, i + 1, i + 2);
+            }
+        }
+        break;
+
+    case Topology::Fan:
+        for (u32 i = 1; i + 1 < count; i++) {
+            func(0, i, i + 1);
+        }
+        break;
+
+    default:
+        for (u32 i = 0; i + 2 < count; i += 3) {
+            func(i, i + 1, i + 2);
+        }
+        break;
+    }
+}
+
+/**
+ * Calls a function with the vertices of each triangle of a draw, of the topology currently set
+ * in Pica::g_regs
+ * @param count Number of vertices of the draw
+ * @param func Function called with the numbers of the three vertices of each triangle
+ */
+template <typename Func>
+inline void ForEachTriangle(u32 count, const Func& func) {
+    ForEachTriangle(g_regs.Get<Regs::TriangleTopology>().topology, count, func);
+}
+
+} // namespace
+
+} // namespace
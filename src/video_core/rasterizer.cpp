@@ -0,0 +1,895 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "common/common.h"
+#include "common/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
+#include "common/thread_pool.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/fragment_pipeline.h"
+#include "video_core/primitive_assembler.h"
+#include "video_core/rasterizer.h"
+#include "video_core/texture_cache.h"
+#include "video_core/utils.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+namespace Pica {
+
+namespace Rasterizer {
+
+namespace {
+
+using VertexShader::OutputVertex;
+
+using VideoCore::ColorFormat;
+typedef Regs::Struct<Regs::CullMode>::Mode CullMode;
+typedef Regs::Struct<Regs::Texture0Parameters>::WrapMode WrapMode;
+
+enum {
+    TILE_SHIFT              = 4,
+    TILE_SIZE               = 1 << TILE_SHIFT,      ///< Width and height of a tile in pixels
+    SUBPIXEL_BITS           = 4,    ///< Fraction bits of the fixed point screen coordinates
+    VARYING_COLOR           = 0,    ///< Attributes interpolated over triangles: the color,
+    VARYING_TEXCOORD        = 4,    ///< then texture coordinate 0
+    NUM_VARYINGS            = 6,
+    NUM_CLIP_PLANES         = 5,
+    MAX_CLIPPED_VERTICES    = 3 + NUM_CLIP_PLANES,  ///< Each plane adds at most one vertex
+    SETUP_BATCH_SIZE        = 4,    ///< Triangles set up at once, one per SIMD lane
+    MIN_PARALLEL_TRIANGLES  = 16,   ///< Smaller batches are shaded on the calling thread alone
+};
+
+/// Vertex in clip space
+struct ClipVertex {
+    float pos[4];
+    float varyings[NUM_VARYINGS];
+};
+
+/// Viewport transform from normalized device coordinates to pixels
+struct Viewport {
+    float half_width;
+    float half_height;
+    float x;
+    float y;
+};
+
+/// Texture unit 0 as set up for a draw
+struct Sampler {
+    TextureCache::TexturePtr    texture;
+    WrapMode                    wrap_s;
+    WrapMode                    wrap_t;
+    u8                          border_color[4];
+};
+
+/// Fragment stages as set up for a draw
+struct FragmentState {
+    const FragmentPipeline::Program*    program;
+    FragmentPipeline::Uniforms          uniforms;
+};
+
+/**
+ * Half the width and height in pixels of the guard band, the region around the center of the
+ * viewport triangles are rasterized in without clipping. Within it the subpixel coordinates
+ * differ by less than 2^15, which keeps the edge functions of the pixels within 31 bits.
+ */
+static const float GUARD_BAND_PIXELS = 960.0f;
+
+/// State of a draw the triangles are set up with
+struct DrawState {
+    Viewport    viewport;
+    float       guard_band[2];          ///< Guard band in multiples of the viewport, x and y
+    int         scissor_min_x, scissor_min_y;   ///< Pixels of the viewport in the target,
+    int         scissor_max_x, scissor_max_y;   ///< inclusive
+    CullMode    cull_mode;
+    int         sampler;                ///< Index in g_samplers, -1 if untextured
+    int         fragment;               ///< Index in g_fragment_states
+};
+
+/// Triangle set up for rasterization, counter-clockwise on screen
+struct Triangle {
+    // Edge functions a * x + b * y + c of the subpixel coordinates, positive inside. Edge n is
+    // the one opposite to vertex n, its value is the weight of vertex n.
+    s32     a[3];
+    s32     b[3];
+    s64     c[3];
+    s32     min_value[3];               ///< Smallest value covered: 0 on top and left edges
+    float   inv_area;                   ///< Reciprocal of the sum of the edge functions
+    float   inv_w[3];
+    float   varyings[3][NUM_VARYINGS];
+    int     min_x, min_y;               ///< Bounding box in pixels, inclusive
+    int     max_x, max_y;
+    int     sampler;                    ///< Index in g_samplers, -1 if untextured
+    int     fragment;                   ///< Index in g_fragment_states
+};
+
+/// Color buffer the binned triangles are rendered to
+struct Target {
+    u32         address;
+    u8*         buffer;
+    u32         width;
+    u32         height;
+    ColorFormat format;
+    u32         pixel_size;
+    u32         tiles_x;
+    u32         tiles_y;
+};
+
+std::vector<Triangle>           g_triangles;    ///< Triangles binned since the last flush
+std::vector<std::vector<u32>>   g_bins;         ///< Triangles overlapping each tile, in order
+std::vector<Sampler>            g_samplers;     ///< Textures of the binned triangles
+std::vector<FragmentState>      g_fragment_states;  ///< Fragment stages of the binned triangles
+Target                          g_target;
+
+// State of the draws as last decoded from g_regs, again for the register groups changed since
+DrawState                       g_draw_state;
+FragmentState                   g_fragment_state;
+bool                            g_fragment_textured;    ///< Whether g_fragment_state samples
+
+Common::Profiler::Category      g_profile_flush("Rasterizer");
+Common::PerfCounters::Region    g_perf_shading("Rasterizer");
+
+/// Triangles waiting to be set up, which is done for a few of them at once
+struct SetupBatch {
+    ClipVertex  vertices[SETUP_BATCH_SIZE][3];
+    int         count;
+};
+
+/**
+ * Gets the signed distance of a vertex to a plane bounding the guard band
+ * @param v Vertex
+ * @param plane Plane: w > 0, then the left, right, bottom and top planes
+ * @param guard_band Guard band in multiples of the viewport, x and y
+ * @return Distance, not negative inside
+ */
+inline float ClipDistance(const ClipVertex& v, int plane, const float guard_band[2]) {
+    static const float EPSILON = 1e-5f;
+
+    switch (plane) {
+    case 0:  return v.pos[3] - EPSILON;
+    case 1:  return v.pos[3] * guard_band[0] + v.pos[0];
+    case 2:  return v.pos[3] * guard_band[0] - v.pos[0];
+    case 3:  return v.pos[3] * guard_band[1] + v.pos[1];
+    default: return v.pos[3] * guard_band[1] - v.pos[1];
+    }
+}
+
+/**
+ * Clips a polygon to the guard band
+ * @param vertices Vertices of the polygon, replaced by the ones of the clipped polygon.
+ *                 MAX_CLIPPED_VERTICES entries.
+ * @param count Number of vertices, updated
+ * @param guard_band Guard band in multiples of the viewport, x and y
+ */
+void ClipPolygon(ClipVertex* vertices, int& count, const float guard_band[2]) {
+    ClipVertex clipped[MAX_CLIPPED_VERTICES];
+
+    for (int plane = 0; plane < NUM_CLIP_PLANES && count >= 3; plane++) {
+        int num_clipped = 0;
+        for (int i = 0; i < count; i++) {
+            const ClipVertex& from = vertices[i];
+            const ClipVertex& to = vertices[(i + 1) % count];
+            const float from_distance = ClipDistance(from, plane, guard_band);
+            const float to_distance = ClipDistance(to, plane, guard_band);
+
+            if (from_distance >= 0.0f) {
+                clipped[num_clipped++] = from;
+            }
+            if ((from_distance >= 0.0f) != (to_distance >= 0.0f)) {
+                const float t = from_distance / (from_distance - to_distance);
+                ClipVertex& v = clipped[num_clipped++];
+                for (int c = 0; c < 4; c++) {
+                    v.pos[c] = from.pos[c] + (to.pos[c] - from.pos[c]) * t;
+                }
+                for (int c = 0; c < NUM_VARYINGS; c++) {
+                    v.varyings[c] = from.varyings[c] + (to.varyings[c] - from.varyings[c]) * t;
+                }
+            }
+        }
+        memcpy(vertices, clipped, num_clipped * sizeof(ClipVertex));
+        count = num_clipped;
+    }
+}
+
+/**
+ * Points the rasterizer at the color buffer currently set in Pica::g_regs
+ * @return False if the color buffer isn't in GPU memory
+ */
+bool SetupTarget() {
+    const auto& size = g_regs.Get<Regs::ColorBufferSize>();
+    const auto& format = g_regs.Get<Regs::ColorBufferFormat>();
+    const u32 address = g_regs.Get<Regs::ColorBufferAddress>().GetPhysicalAddress();
+
+    g_target.address = address;
+    g_target.buffer = VideoCore::GetPhysicalPointer(address);
+    if (g_target.buffer == NULL) {
+        ERROR_LOG(GPU, "color buffer at invalid address 0x%08X", address);
+        return false;
+    }
+    g_target.width = size.width;
+    g_target.height = size.height;
+    g_target.format = format.format;
+    g_target.pixel_size = format.GetPixelSize();
+    g_target.tiles_x = (g_target.width + TILE_SIZE - 1) >> TILE_SHIFT;
+    g_target.tiles_y = (g_target.height + TILE_SIZE - 1) >> TILE_SHIFT;
+    g_bins.resize(g_target.tiles_x * g_target.tiles_y);
+    return true;
+}
+
+/**
+ * Sets up the guard band and the scissor of a draw from its viewport
+ * @param state State of the draw, with the viewport set
+ */
+void SetupGuardBand(DrawState& state) {
+    const Viewport& viewport = state.viewport;
+    // The guard band never ends within the viewport, which is small enough for that to fit
+    state.guard_band[0] = std::max(GUARD_BAND_PIXELS / std::max(viewport.half_width, 1.0f), 1.0f);
+    state.guard_band[1] = std::max(GUARD_BAND_PIXELS / std::max(viewport.half_height, 1.0f),
+        1.0f);
+
+    // Unclipped triangles may reach past the viewport, pixels are kept to it instead
+    state.scissor_min_x = std::max((int)viewport.x, 0);
+    state.scissor_min_y = std::max((int)viewport.y, 0);
+    state.scissor_max_x = std::min((int)(viewport.x + 2.0f * viewport.half_width) - 1,
+        (int)g_target.width - 1);
+    state.scissor_max_y = std::min((int)(viewport.y + 2.0f * viewport.half_height) - 1,
+        (int)g_target.height - 1);
+}
+
+/**
+ * Sets up a triangle from its screen coordinates and adds it to the bins of the tiles it overlaps
+ * @param x Subpixel x coordinates of the vertices
+ * @param y Subpixel y coordinates of the vertices
+ * @param inv_w Reciprocals of the w coordinates of the vertices
+ * @param v Vertices in clip space
+ * @param state State of the draw
+ */
+void BinTriangle(const s32 x[3], const s32 y[3], const float inv_w[3], const ClipVertex v[3],
+    const DrawState& state) {
+
+    const CullMode cull_mode = state.cull_mode;
+    s64 area = (s64)(x[1] - x[0]) * (y[2] - y[0]) - (s64)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0 || (area > 0 && cull_mode == CullMode::KeepClockWise) ||
+        (area < 0 && cull_mode == CullMode::KeepCounterClockWise)) {
+        return;
+    }
+
+    // Make the triangle counter-clockwise
+    int order[3] = { 0, 1, 2 };
+    if (area < 0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    Triangle tri;
+    s32 min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+    for (int n = 0; n < 3; n++) {
+        const int i = order[n];
+        const int from = order[(n + 1) % 3];
+        const int to = order[(n + 2) % 3];
+
+        tri.a[n] = y[from] - y[to];
+        tri.b[n] = x[to] - x[from];
+        tri.c[n] = (s64)x[from] * y[to] - (s64)x[to] * y[from];
+        const bool top_left = tri.a[n] > 0 || (tri.a[n] == 0 && tri.b[n] < 0);
+        tri.min_value[n] = top_left ? 0 : 1;
+
+        tri.inv_w[n] = inv_w[i];
+        memcpy(tri.varyings[n], v[i].varyings, sizeof(tri.varyings[n]));
+
+        min_x = std::min(min_x, x[i]);
+        min_y = std::min(min_y, y[i]);
+        max_x = std::max(max_x, x[i]);
+        max_y = std::max(max_y, y[i]);
+    }
+    tri.inv_area = 1.0f / (float)area;
+    tri.sampler = state.sampler;
+    tri.fragment = state.fragment;
+
+    // Pixels of the scissor whose centers are in the bounding box
+    const s32 half_pixel = 1 << (SUBPIXEL_BITS - 1);
+    tri.min_x = std::max((min_x - half_pixel + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS,
+        state.scissor_min_x);
+    tri.min_y = std::max((min_y - half_pixel + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS,
+        state.scissor_min_y);
+    tri.max_x = std::min((max_x - half_pixel) >> SUBPIXEL_BITS, state.scissor_max_x);
+    tri.max_y = std::min((max_y - half_pixel) >> SUBPIXEL_BITS, state.scissor_max_y);
+    if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+        return;
+    }
+
+    const u32 index = (u32)g_triangles.size();
+    g_triangles.push_back(tri);
+    for (int ty = tri.min_y >> TILE_SHIFT; ty <= tri.max_y >> TILE_SHIFT; ty++) {
+        for (int tx = tri.min_x >> TILE_SHIFT; tx <= tri.max_x >> TILE_SHIFT; tx++) {
+            g_bins[ty * g_target.tiles_x + tx].push_back(index);
+        }
+    }
+}
+
+/**
+ * Sets up the triangles of a batch and bins them, in order, then empties the batch. The
+ * perspective divides, viewport transforms and snapping of the vertices are done for all of the
+ * triangles at once, on SSE2 hosts with a triangle in each lane.
+ * @param batch Triangles within the guard band
+ * @param state State of the draw
+ */
+void SetupTriangles(SetupBatch& batch, const DrawState& state) {
+    const Viewport& viewport = state.viewport;
+    MEMORY_ALIGNED16(s32 x[3][SETUP_BATCH_SIZE]);
+    MEMORY_ALIGNED16(s32 y[3][SETUP_BATCH_SIZE]);
+    MEMORY_ALIGNED16(float inv_w[3][SETUP_BATCH_SIZE]);
+
+#ifdef _M_X64
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 subpixels = _mm_set1_ps((float)(1 << SUBPIXEL_BITS));
+    const __m128 half_width = _mm_set1_ps(viewport.half_width);
+    const __m128 half_height = _mm_set1_ps(viewport.half_height);
+    const __m128 viewport_x = _mm_set1_ps(viewport.x);
+    const __m128 viewport_y = _mm_set1_ps(viewport.y);
+    // Rounds down, coordinates in the guard band are far within the range of the conversion
+    const auto floor_epi32 = [](__m128 value) {
+        const __m128i truncated = _mm_cvttps_epi32(value);
+        const __m128 above = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value);
+        return _mm_add_epi32(truncated, _mm_castps_si128(above));
+    };
+
+    for (int i = 0; i < 3; i++) {
+        // Transposed to a register per coordinate, lanes past the batch are a vertex at w = 1
+        __m128 pos[SETUP_BATCH_SIZE];
+        for (int t = 0; t < SETUP_BATCH_SIZE; t++) {
+            pos[t] = t < batch.count ? _mm_loadu_ps(batch.vertices[t][i].pos) :
+                _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        _MM_TRANSPOSE4_PS(pos[0], pos[1], pos[2], pos[3]);
+
+        const __m128 rcp_w = _mm_div_ps(one, pos[3]);
+        const __m128 screen_x = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(pos[0], rcp_w), one),
+            half_width), viewport_x);
+        const __m128 screen_y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(pos[1], rcp_w), one),
+            half_height), viewport_y);
+        _mm_store_ps(inv_w[i], rcp_w);
+        _mm_store_si128((__m128i*)x[i], floor_epi32(_mm_add_ps(_mm_mul_ps(screen_x, subpixels),
+            half)));
+        _mm_store_si128((__m128i*)y[i], floor_epi32(_mm_add_ps(_mm_mul_ps(screen_y, subpixels),
+            half)));
+    }
+#else
+    for (int t = 0; t < batch.count; t++) {
+        for (int i = 0; i < 3; i++) {
+            const ClipVertex& v = batch.vertices[t][i];
+            const float rcp_w = 1.0f / v.pos[3];
+            const float screen_x = (v.pos[0] * rcp_w + 1.0f) * viewport.half_width + viewport.x;
+            const float screen_y = (v.pos[1] * rcp_w + 1.0f) * viewport.half_height + viewport.y;
+            inv_w[i][t] = rcp_w;
+            x[i][t] = (s32)floorf(screen_x * (1 << SUBPIXEL_BITS) + 0.5f);
+            y[i][t] = (s32)floorf(screen_y * (1 << SUBPIXEL_BITS) + 0.5f);
+        }
+    }
+#endif
+
+    for (int t = 0; t < batch.count; t++) {
+        const s32 tri_x[3] = { x[0][t], x[1][t], x[2][t] };
+        const s32 tri_y[3] = { y[0][t], y[1][t], y[2][t] };
+        const float tri_inv_w[3] = { inv_w[0][t], inv_w[1][t], inv_w[2][t] };
+        BinTriangle(tri_x, tri_y, tri_inv_w, batch.vertices[t], state);
+    }
+    batch.count = 0;
+}
+
+/**
+ * Queues a triangle of a batch for setup
+ * @param batch Batch, set up when full
+ * @param v0 First vertex
+ * @param v1 Second vertex
+ * @param v2 Third vertex
+ * @param state State of the draw
+ */
+inline void QueueTriangle(SetupBatch& batch, const ClipVertex& v0, const ClipVertex& v1,
+    const ClipVertex& v2, const DrawState& state) {
+
+    ClipVertex* triangle = batch.vertices[batch.count];
+    triangle[0] = v0;
+    triangle[1] = v1;
+    triangle[2] = v2;
+    if (++batch.count == SETUP_BATCH_SIZE) {
+        SetupTriangles(batch, state);
+    }
+}
+
+/**
+ * Culls a triangle outside of the viewport, clips it if it leaves the guard band and queues the
+ * result for setup
+ * @param v0 First vertex
+ * @param v1 Second vertex
+ * @param v2 Third vertex
+ * @param state State of the draw
+ * @param batch Batch of triangles the result is queued in
+ */
+void AddTriangle(const OutputVertex& v0, const OutputVertex& v1, const OutputVertex& v2,
+    const DrawState& state, SetupBatch& batch) {
+
+    ClipVertex vertices[MAX_CLIPPED_VERTICES];
+    const OutputVertex* input[3] = { &v0, &v1, &v2 };
+    static const float viewport_band[2] = { 1.0f, 1.0f };
+    bool inside = true;
+    int outside_all = (1 << NUM_CLIP_PLANES) - 1;
+    for (int i = 0; i < 3; i++) {
+        memcpy(vertices[i].pos, &input[i]->pos, sizeof(vertices[i].pos));
+        // The texture coordinates follow the color
+        static_assert(offsetof(OutputVertex, tc0_u) == offsetof(OutputVertex, color) +
+            VARYING_TEXCOORD * sizeof(float), "Varyings must be contiguous");
+        memcpy(vertices[i].varyings, &input[i]->color, sizeof(vertices[i].varyings));
+
+        int outside = 0;
+        for (int plane = 0; plane < NUM_CLIP_PLANES; plane++) {
+            inside = inside && ClipDistance(vertices[i], plane, state.guard_band) >= 0.0f;
+            if (ClipDistance(vertices[i], plane, viewport_band) < 0.0f) {
+                outside |= 1 << plane;
+            }
+        }
+        outside_all &= outside;
+    }
+
+    // All of the vertices outside one of the planes of the visible volume, and so all of it
+    if (outside_all != 0) {
+        return;
+    }
+
+    int count = 3;
+    if (!inside) {
+        ClipPolygon(vertices, count, state.guard_band);
+    }
+    for (int i = 2; i < count; i++) {
+        QueueTriangle(batch, vertices[0], vertices[i - 1], vertices[i], state);
+    }
+}
+
+/**
+ * Gets a pixel of the color buffer
+ * @param x X coordinate of the pixel
+ * @param y Y coordinate of the pixel
+ * @return Pointer to the pixel
+ */
+inline u8* GetPixel(int x, int y) {
+    const u32 offset = VideoCore::GetTiledPixelOffset(x, y, g_target.width);
+    return g_target.buffer + offset * g_target.pixel_size;
+}
+
+/**
+ * Wraps a texel coordinate into a texture
+ * @param value Texel coordinate
+ * @param size Size of the texture along the coordinate
+ * @param mode Wrap mode
+ * @return Wrapped coordinate, -1 for the border color
+ */
+inline int WrapTexelCoordinate(int value, int size, WrapMode mode) {
+    switch (mode) {
+    case WrapMode::ClampToEdge:
+        return std::min(std::max(value, 0), size - 1);
+
+    case WrapMode::ClampToBorder:
+        return value >= 0 && value < size ? value : -1;
+
+    case WrapMode::MirroredRepeat:
+        value = ((value % (2 * size)) + 2 * size) % (2 * size);
+        return value < size ? value : 2 * size - 1 - value;
+
+    default:
+        return ((value % size) + size) % size;
+    }
+}
+
+/**
+ * Takes a nearest sample of texture 0
+ * @param sampler Texture unit 0
+ * @param u Texture coordinate u
+ * @param v Texture coordinate v
+ * @param texel Receives the RGBA8 texel
+ */
+inline void SampleTexture(const Sampler& sampler, float u, float v, u8* texel) {
+    const TextureCache::Texture& texture = *sampler.texture;
+    const int s = WrapTexelCoordinate((int)floorf(u * texture.width), texture.width,
+        sampler.wrap_s);
+    const int t = WrapTexelCoordinate((int)floorf(v * texture.height), texture.height,
+        sampler.wrap_t);
+    memcpy(texel, s < 0 || t < 0 ? sampler.border_color :
+        &texture.texels[(t * texture.width + s) * 4], 4);
+}
+
+#ifdef _M_X64
+
+/**
+ * Shades the covered pixels of a 2x2 quad
+ * @param tri Triangle
+ * @param x X coordinate of the top left pixel of the quad
+ * @param y Y coordinate of the top left pixel of the quad
+ * @param edges Edge function values of the four pixels
+ * @param mask Covered pixels, bit n for pixel (x + (n & 1), y + (n >> 1))
+ */
+void ShadeQuad(const Triangle& tri, int x, int y, const __m128i* edges, int mask) {
+    const __m128 inv_area = _mm_set1_ps(tri.inv_area);
+    __m128 weights[3];
+    __m128 sum = _mm_setzero_ps();
+    for (int n = 0; n < 3; n++) {
+        // Perspective correct weights: barycentric coordinates divided by w
+        weights[n] = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(edges[n]), inv_area),
+            _mm_set1_ps(tri.inv_w[n]));
+        sum = _mm_add_ps(sum, weights[n]);
+    }
+    const __m128 inv_sum = _mm_div_ps(_mm_set1_ps(1.0f), sum);
+
+    __m128 values[NUM_VARYINGS];
+    const int num_varyings = tri.sampler >= 0 ? NUM_VARYINGS : VARYING_TEXCOORD;
+    for (int c = 0; c < num_varyings; c++) {
+        __m128 value = _mm_mul_ps(weights[0], _mm_set1_ps(tri.varyings[0][c]));
+        value = _mm_add_ps(value, _mm_mul_ps(weights[1], _mm_set1_ps(tri.varyings[1][c])));
+        value = _mm_add_ps(value, _mm_mul_ps(weights[2], _mm_set1_ps(tri.varyings[2][c])));
+        values[c] = _mm_mul_ps(value, inv_sum);
+    }
+
+    FragmentPipeline::Quad quad;
+    for (int c = 0; c < 4; c++) {
+        const __m128 value = _mm_min_ps(_mm_max_ps(values[VARYING_COLOR + c], _mm_setzero_ps()),
+            _mm_set1_ps(1.0f));
+        _mm_storeu_ps(quad.color[c], value);
+    }
+    float u[4], v[4];
+    if (tri.sampler >= 0) {
+        _mm_storeu_ps(u, values[VARYING_TEXCOORD]);
+        _mm_storeu_ps(v, values[VARYING_TEXCOORD + 1]);
+    }
+    for (int n = 0; n < 4; n++) {
+        if (mask & (1 << n)) {
+            if (tri.sampler >= 0) {
+                SampleTexture(g_samplers[tri.sampler], u[n], v[n], quad.texel0[n]);
+            }
+            quad.pixels[n] = GetPixel(x + (n & 1), y + (n >> 1));
+        }
+    }
+    quad.mask = mask;
+
+    const FragmentState& fragment = g_fragment_states[tri.fragment];
+    FragmentPipeline::ShadeQuad(fragment.program, fragment.uniforms, quad, g_target.format);
+}
+
+/**
+ * Shades the pixels of a triangle in a region of a tile, 2x2 pixels at a time
+ * @param tri Triangle
+ * @param x0 Left edge of the region, even
+ * @param y0 Bottom edge of the region, even
+ * @param x1 Right edge of the region, inclusive
+ * @param y1 Top edge of the region, inclusive
+ */
+void ShadeTriangle(const Triangle& tri, int x0, int y0, int x1, int y1) {
+    __m128i row[3], step_x[3], step_y[3], threshold[3];
+    for (int n = 0; n < 3; n++) {
+        const s64 origin = (s64)tri.a[n] * ((x0 << SUBPIXEL_BITS) + (1 << (SUBPIXEL_BITS - 1))) +
+            (s64)tri.b[n] * ((y0 << SUBPIXEL_BITS) + (1 << (SUBPIXEL_BITS - 1))) + tri.c[n];
+        const s32 e = (s32)origin;
+        const s32 a = tri.a[n] << SUBPIXEL_BITS;
+        const s32 b = tri.b[n] << SUBPIXEL_BITS;
+        row[n] = _mm_setr_epi32(e, e + a, e + b, e + a + b);
+        step_x[n] = _mm_set1_epi32(2 * a);
+        step_y[n] = _mm_set1_epi32(2 * b);
+        threshold[n] = _mm_set1_epi32(tri.min_value[n] - 1);
+    }
+
+    for (int y = y0; y <= y1; y += 2) {
+        __m128i edges[3] = { row[0], row[1], row[2] };
+        const int row_mask = y + 1 > y1 ? 0x3 : 0xF;
+
+        for (int x = x0; x <= x1; x += 2) {
+            const __m128i inside = _mm_and_si128(_mm_and_si128(
+                _mm_cmpgt_epi32(edges[0], threshold[0]), _mm_cmpgt_epi32(edges[1], threshold[1])),
+                _mm_cmpgt_epi32(edges[2], threshold[2]));
+            const int mask = _mm_movemask_ps(_mm_castsi128_ps(inside)) & row_mask &
+                (x + 1 > x1 ? 0x5 : 0xF);
+            if (mask != 0) {
+                ShadeQuad(tri, x, y, edges, mask);
+            }
+            for (int n = 0; n < 3; n++) {
+                edges[n] = _mm_add_epi32(edges[n], step_x[n]);
+            }
+        }
+        for (int n = 0; n < 3; n++) {
+            row[n] = _mm_add_epi32(row[n], step_y[n]);
+        }
+    }
+}
+
+#else
+
+/**
+ * Shades the pixels of a triangle in a region of a tile
+ * @param tri Triangle
+ * @param x0 Left edge of the region
+ * @param y0 Bottom edge of the region
+ * @param x1 Right edge of the region, inclusive
+ * @param y1 Top edge of the region, inclusive
+ */
+void ShadeTriangle(const Triangle& tri, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            const s64 px = (x << SUBPIXEL_BITS) + (1 << (SUBPIXEL_BITS - 1));
+            const s64 py = (y << SUBPIXEL_BITS) + (1 << (SUBPIXEL_BITS - 1));
+            float weights[3];
+            float sum = 0.0f;
+            bool inside = true;
+            for (int n = 0; n < 3; n++) {
+                const s32 e = (s32)(tri.a[n] * px + tri.b[n] * py + tri.c[n]);
+                inside = inside && e >= tri.min_value[n];
+                weights[n] = e * tri.inv_area * tri.inv_w[n];
+                sum += weights[n];
+            }
+            if (!inside) {
+                continue;
+            }
+
+            float values[NUM_VARYINGS];
+            for (int c = 0; c < NUM_VARYINGS; c++) {
+                values[c] = (weights[0] * tri.varyings[0][c] + weights[1] * tri.varyings[1][c] +
+                    weights[2] * tri.varyings[2][c]) / sum;
+            }
+            // Shaded as the first pixel of a quad
+            FragmentPipeline::Quad quad;
+            memset(&quad, 0, sizeof(quad));
+            for (int c = 0; c < 4; c++) {
+                quad.color[c][0] = std::min(std::max(values[VARYING_COLOR + c], 0.0f), 1.0f);
+            }
+            if (tri.sampler >= 0) {
+                SampleTexture(g_samplers[tri.sampler], values[VARYING_TEXCOORD],
+                    values[VARYING_TEXCOORD + 1], quad.texel0[0]);
+            }
+            quad.pixels[0] = GetPixel(x, y);
+            quad.mask = 1;
+            const FragmentState& fragment = g_fragment_states[tri.fragment];
+            FragmentPipeline::ShadeQuad(fragment.program, fragment.uniforms, quad,
+                g_target.format);
+        }
+    }
+}
+
+#endif // _M_X64
+
+/**
+ * Shades the triangles binned into a tile
+ * @param tile Index of the tile
+ */
+void ShadeTile(u32 tile) {
+    const std::vector<u32>& bin = g_bins[tile];
+    if (bin.empty()) {
+        return;
+    }
+    const int tile_x = (tile % g_target.tiles_x) << TILE_SHIFT;
+    const int tile_y = (tile / g_target.tiles_x) << TILE_SHIFT;
+    const int tile_max_x = std::min(tile_x + TILE_SIZE, (int)g_target.width) - 1;
+    const int tile_max_y = std::min(tile_y + TILE_SIZE, (int)g_target.height) - 1;
+
+    for (u32 index : bin) {
+        const Triangle& tri = g_triangles[index];
+        // Quads are aligned to even coordinates, which never straddle tiles
+        const int x0 = std::max(tri.min_x, tile_x) & ~1;
+        const int y0 = std::max(tri.min_y, tile_y) & ~1;
+        const int x1 = std::min(tri.max_x, tile_max_x);
+        const int y1 = std::min(tri.max_y, tile_max_y);
+        ShadeTriangle(tri, x0, y0, x1, y1);
+    }
+}
+
+/**
+ * Looks up the texture of texture unit 0 as currently set in Pica::g_regs
+ * @return Index of the sampler in g_samplers, -1 if texturing is disabled
+ */
+int SetupSampler() {
+    if (!g_regs.Get<Regs::TextureUnitConfig>().texture0_enable) {
+        return -1;
+    }
+    const auto& size = g_regs.Get<Regs::Texture0Size>();
+    const auto& parameters = g_regs.Get<Regs::Texture0Parameters>();
+    const TextureCache::TexturePtr texture = TextureCache::Get(
+        g_regs.Get<Regs::Texture0Address>().GetPhysicalAddress(), size.width, size.height,
+        g_regs.Get<Regs::Texture0Format>().format);
+    if (texture == nullptr) {
+        return -1;
+    }
+
+    const u32 border_color = g_regs[Regs::Texture0BorderColor];
+    if (g_samplers.empty() || g_samplers.back().texture != texture ||
+        g_samplers.back().wrap_s != parameters.wrap_s ||
+        g_samplers.back().wrap_t != parameters.wrap_t ||
+        memcmp(g_samplers.back().border_color, &border_color, 4) != 0) {
+        Sampler sampler;
+        sampler.texture = texture;
+        sampler.wrap_s = parameters.wrap_s;
+        sampler.wrap_t = parameters.wrap_t;
+        memcpy(sampler.border_color, &border_color, sizeof(sampler.border_color));
+        g_samplers.push_back(sampler);
+    }
+    return (int)g_samplers.size() - 1;
+}
+
+/**
+ * Looks up the routine of the fragment stages as currently set in Pica::g_regs
+ * @param sampler Index of the sampler of the draw, -1 if untextured
+ * @return Index of the fragment state in g_fragment_states
+ */
+int SetupFragmentState(int sampler) {
+    using namespace CommandProcessor;
+    const bool textured = sampler >= 0;
+    if (TakeDirtyGroups(DIRTY_COMBINERS | DIRTY_BLENDING) != 0 ||
+        textured != g_fragment_textured || g_fragment_state.program == NULL) {
+        FragmentPipeline::Config config;
+        FragmentPipeline::GetConfig(&config, textured);
+        g_fragment_state.program = FragmentPipeline::GetProgram(config);
+        FragmentPipeline::GetUniforms(&g_fragment_state.uniforms);
+        g_fragment_textured = textured;
+    }
+
+    const FragmentState& state = g_fragment_state;
+    if (g_fragment_states.empty() || g_fragment_states.back().program != state.program ||
+        memcmp(&g_fragment_states.back().uniforms, &state.uniforms, sizeof(state.uniforms)) != 0) {
+        g_fragment_states.push_back(state);
+    }
+    return (int)g_fragment_states.size() - 1;
+}
+
+} // namespace
+
+HWRasterizer* g_hw_rasterizer = NULL;
+
+/**
+ * Assembles shaded vertices into triangles using the topology currently set in Pica::g_regs,
+ * then clips, culls and bins them. They're rendered by the next Flush.
+ * @param vertices Vertices of the draw
+ * @param count Number of vertices
+ */
+void SubmitPrimitives(const OutputVertex* vertices, u32 count) {
+    if (g_hw_rasterizer != NULL) {
+        g_hw_rasterizer->SubmitPrimitives(vertices, count);
+        return;
+    }
+    if (count < 3) {
+        return;
+    }
+    if (g_triangles.empty() && !SetupTarget()) {
+        return;
+    }
+
+    // The scissor depends on the size of the color buffer as well
+    DrawState& state = g_draw_state;
+    using namespace CommandProcessor;
+    if (TakeDirtyGroups(DIRTY_VIEWPORT | DIRTY_FRAMEBUFFER) != 0) {
+        state.viewport.half_width = Float24ToFloat(g_regs.Get<Regs::ViewportSizeX>().value);
+        state.viewport.half_height = Float24ToFloat(g_regs.Get<Regs::ViewportSizeY>().value);
+        state.viewport.x = (float)g_regs.Get<Regs::ViewportCorner>().x;
+        state.viewport.y = (float)g_regs.Get<Regs::ViewportCorner>().y;
+        SetupGuardBand(state);
+        state.cull_mode = g_regs.Get<Regs::CullMode>().mode;
+    }
+    state.sampler = SetupSampler();
+    state.fragment = SetupFragmentState(state.sampler);
+
+    SetupBatch batch;
+    batch.count = 0;
+    PrimitiveAssembler::ForEachTriangle(count, [&](u32 v0, u32 v1, u32 v2) {
+        AddTriangle(vertices[v0], vertices[v1], vertices[v2], state, batch);
+    });
+    SetupTriangles(batch, state);
+}
+
+/// Renders the binned triangles to the color buffer they were submitted for
+void Flush() {
+    Common::Profiler::Scope scope(g_profile_flush);
+    if (g_hw_rasterizer != NULL) {
+        g_hw_rasterizer->Flush();
+        return;
+    }
+    if (g_triangles.empty()) {
+        return;
+    }
+
+    // Tiles go to the shared thread pool, the flushing thread shading its share
+    const int num_tiles = (int)g_bins.size();
+    // Counted on every thread shading tiles, counters only see the thread that reads them
+    const auto shade_tiles = [](int begin, int end) {
+        Common::PerfCounters::Scope perf_scope(g_perf_shading);
+        for (int tile = begin; tile < end; tile++) {
+            ShadeTile(tile);
+        }
+    };
+    if (g_triangles.size() >= MIN_PARALLEL_TRIANGLES) {
+        Common::ThreadPool::GetShared().ParallelFor(0, num_tiles, 1, shade_tiles);
+    } else {
+        shade_tiles(0, num_tiles);
+    }
+
+    g_triangles.clear();
+    g_samplers.clear();
+    g_fragment_states.clear();
+    for (std::vector<u32>& bin : g_bins) {
+        bin.clear();
+    }
+
+    // Textures sampling the color buffer and the LCDs scanning it out have to see what was rendered
+    Memory::MarkRangeDirty(Memory::VirtualAddressFromPhysical(g_target.address),
+        g_target.width * g_target.height * g_target.pixel_size,
+        Memory::DIRTY_TEXTURE | Memory::DIRTY_FRAMEBUFFER |
+        Memory::DIRTY_SAVESTATE | Memory::DIRTY_REWIND);
+}
+
+/**
+ * Writes the rendered contents of a memory range back to guest memory before the guest reads it.
+ * The software rasterizer renders to guest memory by the end of each command list already.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void FlushRegion(u32 address, u32 size) {
+    if (g_hw_rasterizer != NULL) {
+        g_hw_rasterizer->FlushRegion(address, size);
+    }
+}
+
+/**
+ * Notifies the rasterizer that the guest wrote to a memory range outside of draws. The range must
+ * have been flushed before the write.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void InvalidateRegion(u32 address, u32 size) {
+    if (g_hw_rasterizer != NULL) {
+        g_hw_rasterizer->InvalidateRegion(address, size);
+    }
+}
+
+/**
+ * Runs a display transfer from a surface rendered by the host GPU without a readback
+ * @param config Transfer to run
+ * @return True if done, false if it has to go through guest memory
+ */
+bool AccelerateDisplayTransfer(const GPU::DisplayTransferConfig& config) {
+    return g_hw_rasterizer != NULL && g_hw_rasterizer->AccelerateDisplayTransfer(config);
+}
+
+/**
+ * Runs a texture copy from a surface rendered by the host GPU without a readback
+ * @param config Copy to run
+ * @return True if done, false if it has to go through guest memory
+ */
+bool AccelerateTextureCopy(const GPU::TextureCopyConfig& config) {
+    return g_hw_rasterizer != NULL && g_hw_rasterizer->AccelerateTextureCopy(config);
+}
+
+/// Starts the thread pool shading the tiles
+void Init() {
+    // Nothing to shade on the CPU when the host GPU renders the draws
+    if (g_hw_rasterizer == NULL) {
+        NOTICE_LOG(GPU, "rasterizer shades on %d pool threads besides the flushing one",
+            Common::ThreadPool::GetShared().GetNumWorkers());
+    }
+}
+
+/// Renders the pending triangles and drops the compiled fragment routines
+void Shutdown() {
+    Flush();
+    FragmentPipeline::Clear();
+    g_fragment_state.program = NULL;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,72 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+#include "video_core/hw_rasterizer.h"
+#include "video_core/vertex_shader.h"
+
+namespace Pica {
+
+/**
+ * Tile based software rasterizer. Triangles are set up and binned into 16x16 pixel tiles of the
+ * color buffer as they're submitted, and the tiles are shaded in parallel on Flush. Pixels go
+ * through the routine compiled for the fragment stage configuration of their draw.
+ */
+namespace Rasterizer {
+
+extern HWRasterizer* g_hw_rasterizer;  ///< Backend the draws are forwarded to, NULL for none
+
+/**
+ * Assembles shaded vertices into triangles using the topology currently set in Pica::g_regs,
+ * then clips, culls and bins them. They're rendered by the next Flush.
+ * @param vertices Vertices of the draw
+ * @param count Number of vertices
+ */
+void SubmitPrimitives(const VertexShader::OutputVertex* vertices, u32 count);
+
+/// Renders the binned triangles to the color buffer they were submitted for
+void Flush();
+
+/**
+ * Writes the rendered contents of a memory range back to guest memory before the guest reads it.
+ * The software rasterizer renders to guest memory by the end of each command list already.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void FlushRegion(u32 address, u32 size);
+
+/**
+ * Notifies the rasterizer that the guest wrote to a memory range outside of draws. The range must
+ * have been flushed before the write.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void InvalidateRegion(u32 address, u32 size);
+
+/**
+ * Runs a display transfer from a surface rendered by the host GPU without a readback
+ * @param config Transfer to run
+ * @return True if done, false if it has to go through guest memory
+ */
+bool AccelerateDisplayTransfer(const GPU::DisplayTransferConfig& config);
+
+/**
+ * Runs a texture copy from a surface rendered by the host GPU without a readback
+ * @param config Copy to run
+ * @return True if done, false if it has to go through guest memory
+ */
+bool AccelerateTextureCopy(const GPU::TextureCopyConfig& config);
+
+/// Starts the thread pool shading the tiles
+void Init();
+
+/// Renders the pending triangles and drops the compiled fragment routines
+void Shutdown();
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,75 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "core/hw/gpu.h"
+
+#include "video_core/frame_dumper.h"
+#include "video_core/frame_golden.h"
+#include "video_core/frame_output.h"
+#include "video_core/renderer_headless.h"
+#include "video_core/utils.h"
+
+/// RendererHeadless constructor
+RendererHeadless::RendererHeadless() : m_render_window(NULL) {
+}
+
+/// RendererHeadless destructor
+RendererHeadless::~RendererHeadless() {
+}
+
+/// Swap buffers (render frame)
+void RendererHeadless::SwapBuffers() {
+    m_current_frame++;
+
+    if (VideoCore::g_frame_callback == NULL && !FrameDumper::IsDumping() &&
+        !FrameGolden::IsActive() && !FrameOutput::IsActive()) {
+        return;
+    }
+    const u8* top = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_top_left_1);
+    const u8* bottom = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_sub_left_1);
+    FrameGolden::OnFrame(top, bottom);
+    FrameDumper::DumpFrame(top, bottom);
+    if (FrameOutput::IsActive()) {
+        // Straight from V/RAM, there are no textures
+        const u8* framebuffers[2] = { top, bottom };
+        const int widths[2] = { VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth };
+        FrameOutput::Frame frame;
+        frame.number = m_current_frame - 1;
+        for (int i = 0; i < 2; i++) {
+            FrameOutput::Screen& screen = frame.screens[i];
+            screen.width = widths[i];
+            screen.height = VideoCore::kScreenTopHeight;
+            screen.pixels = framebuffers[i];
+            screen.texture = 0;
+            screen.texture_extent = 1.0f;
+            screen.texture_scale = 1;
+        }
+        FrameOutput::OutputFrame(frame);
+    }
+    if (VideoCore::g_frame_callback == NULL || top == NULL || bottom == NULL) {
+        return;
+    }
+    VideoCore::RotateFramebuffer(top, m_top, VideoCore::kScreenTopWidth,
+        VideoCore::kScreenTopHeight);
+    VideoCore::RotateFramebuffer(bottom, m_bottom, VideoCore::kScreenBottomWidth,
+        VideoCore::kScreenBottomHeight);
+    VideoCore::g_frame_callback(m_top, m_bottom);
+}
+
+/**
+ * Set the emulator window to use for renderer
+ * @param window EmuWindow handle to emulator window to use for rendering
+ */
+void RendererHeadless::SetWindow(EmuWindow* window) {
+    m_render_window = window;
+}
+
+/// Initialize the renderer
+void RendererHeadless::Init() {
+    NOTICE_LOG(RENDER, "rendering headless");
+}
+
+/// Shutdown the renderer
+void RendererHeadless::ShutDown() {
+}
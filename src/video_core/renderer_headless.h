@@ -0,0 +1,45 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+#include "common/emu_window.h"
+
+#include "video_core/renderer_base.h"
+#include "video_core/video_core.h"
+
+/**
+ * Renderer without a graphics context, for batch runs with no display. The framebuffers are only
+ * read when VideoCore::g_frame_callback is set, rotated on the CPU and handed to it; otherwise
+ * swapping buffers does nothing but count the frame.
+ */
+class RendererHeadless : virtual public RendererBase {
+public:
+
+    RendererHeadless();
+    ~RendererHeadless();
+
+    /// Swap buffers (render frame)
+    void SwapBuffers();
+
+    /**
+     * Set the emulator window to use for renderer
+     * @param window EmuWindow handle to emulator window to use for rendering
+     */
+    void SetWindow(EmuWindow* window);
+
+    /// Initialize the renderer
+    void Init();
+
+    /// Shutdown the renderer
+    void ShutDown();
+
+private:
+
+    EmuWindow*  m_render_window;                    ///< Handle to render window
+
+    u8 m_top[VideoCore::kScreenTopWidth * VideoCore::kScreenTopHeight * 3];
+    u8 m_bottom[VideoCore::kScreenBottomWidth * VideoCore::kScreenBottomHeight * 3];
+};
@@ -0,0 +1,1304 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/log.h"
+#include "common/memory_tracker.h"
+#include "common/profiler.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/primitive_assembler.h"
+#include "video_core/texture_cache.h"
+#include "video_core/renderer_opengl/gl_rasterizer.h"
+#include "video_core/renderer_opengl/gl_shader_util.h"
+
+// Not known to GLEW yet: GL_ARB_parallel_shader_compile and GL_KHR_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+using Pica::Regs;
+using Pica::VertexShader::OutputVertex;
+
+namespace {
+
+enum {
+    ATTRIBUTE_POSITION      = 0,
+    ATTRIBUTE_COLOR         = 1,
+    ATTRIBUTE_TEXCOORD0     = 2,
+    STREAM_BUFFER_SIZE      = 4 * 1024 * 1024,  ///< Initial size, grown for larger draws
+    UPLOAD_RING_SIZE        = 32 * 1024 * 1024, ///< Holds a few frames of texture uploads
+    MAX_BATCH_VERTICES      = STREAM_BUFFER_SIZE / sizeof(OutputVertex),    ///< Unless one draw
+    COMPILE_POLLS           = 2,    ///< Flushes a compile runs for before it is waited for, when
+                                    ///< the driver can't tell whether it is done
+};
+
+const char* g_vertex_shader =
+    "#version 150\n"
+    "in vec4 vert_position;\n"
+    "in vec4 vert_color;\n"
+    "in vec2 vert_texcoord0;\n"
+    "out vec4 color;\n"
+    "out vec2 texcoord0;\n"
+    "void main() {\n"
+    "    color = vert_color;\n"
+    "    texcoord0 = vert_texcoord0;\n"
+    // PICA clips z to [-w, 0], OpenGL to [-w, w]
+    "    gl_Position = vec4(vert_position.xy, -2.0 * vert_position.z - vert_position.w,\n"
+    "        vert_position.w);\n"
+    "}\n";
+
+/// Draws a quad over the encode target, from the vertex IDs
+const char* g_encode_vertex_shader =
+    "#version 150\n"
+    "void main() {\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Every fragment is 4 bytes of the guest surface. Pixels are found and encoded as the CPU does
+// with GetTiledPixelOffset and EncodeColor, the formats numbered like VideoCore::ColorFormat.
+const char* g_encode_fragment_shader =
+    "#version 150\n"
+    "uniform sampler2D color;\n"
+    "uniform int width;\n"
+    "uniform int format;\n"
+    "uniform bool tiled;\n"
+    "out uvec4 out_bytes;\n"
+    "int PixelSize() {\n"
+    "    return format == 0 ? 4 : format == 1 ? 3 : 2;\n"
+    "}\n"
+    "uint EncodePixel(int index) {\n"
+    "    ivec2 pixel;\n"
+    "    if (tiled) {\n"
+    "        int tile = index >> 6;\n"
+    "        int morton = index & 63;\n"
+    "        int tiles_per_row = width >> 3;\n"
+    "        pixel.x = (tile % tiles_per_row) * 8 + ((morton & 1) | ((morton >> 1) & 2) |\n"
+    "            ((morton >> 2) & 4));\n"
+    "        pixel.y = (tile / tiles_per_row) * 8 + (((morton >> 1) & 1) | ((morton >> 2) & 2) |\n"
+    "            ((morton >> 3) & 4));\n"
+    "    } else {\n"
+    "        pixel = ivec2(index % width, index / width);\n"
+    "    }\n"
+    "    uvec4 c = uvec4(texelFetch(color, pixel, 0) * 255.0 + 0.5);\n"
+    "    if (format == 0) {\n"
+    "        return c.a | (c.b << 8) | (c.g << 16) | (c.r << 24);\n"
+    "    } else if (format == 1) {\n"
+    "        return c.b | (c.g << 8) | (c.r << 16);\n"
+    "    } else if (format == 2) {\n"
+    "        return ((c.r >> 3) << 11) | ((c.g >> 3) << 6) | ((c.b >> 3) << 1) | (c.a >> 7);\n"
+    "    } else if (format == 3) {\n"
+    "        return ((c.r >> 3) << 11) | ((c.g >> 2) << 5) | (c.b >> 3);\n"
+    "    }\n"
+    "    return ((c.r >> 4) << 12) | ((c.g >> 4) << 8) | ((c.b >> 4) << 4) | (c.a >> 4);\n"
+    "}\n"
+    "void main() {\n"
+    "    int pixel_size = PixelSize();\n"
+    "    ivec2 texel = ivec2(gl_FragCoord.xy);\n"
+    "    int offset = (texel.y * (width * pixel_size / 4) + texel.x) * 4;\n"
+    "    for (int i = 0; i < 4; i++) {\n"
+    "        int index = (offset + i) / pixel_size;\n"
+    "        int shift = ((offset + i) - index * pixel_size) * 8;\n"
+    "        out_bytes[i] = (EncodePixel(index) >> uint(shift)) & 0xFFu;\n"
+    "    }\n"
+    "}\n";
+
+Common::Profiler::Category g_profile_upload("Texture upload");
+Common::Profiler::Category g_profile_write_back("Framebuffer write back");
+
+/**
+ * Deletes the OpenGL copy of a cached texture
+ * @param host_texture OpenGL texture
+ */
+void ReleaseHostTexture(u32 host_texture) {
+    const GLuint texture = host_texture;
+    glDeleteTextures(1, &texture);
+}
+
+/**
+ * Gets the OpenGL wrap mode of a PICA wrap mode
+ * @param mode PICA wrap mode
+ * @return OpenGL wrap mode
+ */
+GLint GetWrapMode(Regs::Struct<Regs::Texture0Parameters>::WrapMode mode) {
+    typedef Regs::Struct<Regs::Texture0Parameters>::WrapMode WrapMode;
+    switch (mode) {
+    case WrapMode::ClampToEdge:
+        return GL_CLAMP_TO_EDGE;
+
+    case WrapMode::ClampToBorder:
+        return GL_CLAMP_TO_BORDER;
+
+    case WrapMode::MirroredRepeat:
+        return GL_MIRRORED_REPEAT;
+
+    default:
+        return GL_REPEAT;
+    }
+}
+
+/**
+ * Gets the OpenGL blend equation of a PICA blend equation
+ * @param equation PICA blend equation
+ * @return OpenGL blend equation
+ */
+GLenum GetBlendEquation(Regs::Struct<Regs::BlendFunc>::Equation equation) {
+    static const GLenum equations[] = { GL_FUNC_ADD, GL_FUNC_SUBTRACT, GL_FUNC_REVERSE_SUBTRACT,
+        GL_MIN, GL_MAX };
+    const u32 index = (u32)equation;
+    return index < ARRAY_SIZE(equations) ? equations[index] : GL_FUNC_ADD;
+}
+
+/**
+ * Gets the OpenGL blend factor of a PICA blend factor
+ * @param factor PICA blend factor
+ * @return OpenGL blend factor
+ */
+GLenum GetBlendFactor(Regs::Struct<Regs::BlendFunc>::Factor factor) {
+    static const GLenum factors[] = { GL_ZERO, GL_ONE, GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR,
+        GL_DST_COLOR, GL_ONE_MINUS_DST_COLOR, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_DST_ALPHA,
+        GL_ONE_MINUS_DST_ALPHA, GL_CONSTANT_COLOR, GL_ONE_MINUS_CONSTANT_COLOR, GL_CONSTANT_ALPHA,
+        GL_ONE_MINUS_CONSTANT_ALPHA, GL_SRC_ALPHA_SATURATE };
+    const u32 index = (u32)factor;
+    return index < ARRAY_SIZE(factors) ? factors[index] : GL_ONE;
+}
+
+/**
+ * Unpacks a PICA RGBA8 register color
+ * @param color Color, red in the low byte
+ * @param out Receives the components, from 0 to 1
+ */
+void UnpackColor(u32 color, GLfloat* out) {
+    for (int c = 0; c < 4; c++) {
+        out[c] = ((color >> (8 * c)) & 0xFF) / 255.0f;
+    }
+}
+
+/**
+ * Gets whether the driver has an extension
+ * @param name Name of the extension
+ * @return True if it is among the extensions of the context
+ */
+bool HasExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Whether two memory ranges overlap
+inline bool Overlaps(u32 address_a, u32 size_a, u32 address_b, u32 size_b) {
+    return address_a < address_b + size_b && address_b < address_a + size_a;
+}
+
+} // namespace
+
+/// Size of a pixel of the guest color buffer in bytes
+u32 RasterizerOpenGL::Framebuffer::GetPixelSize() const {
+    return VideoCore::GetPixelSize(format);
+}
+
+/// Size of the guest color buffer in bytes
+u32 RasterizerOpenGL::Framebuffer::GetSize() const {
+    return width * height * GetPixelSize();
+}
+
+/**
+ * RasterizerOpenGL constructor
+ * @param resolution_scale Multiplier of the guest resolution the framebuffers are rendered at
+ */
+RasterizerOpenGL::RasterizerOpenGL(u32 resolution_scale) : m_use_clock(0),
+    m_resolution_scale(resolution_scale), m_native_fbo(0), m_native_texture(0), m_native_width(0),
+    m_native_height(0),
+    m_encode_program(0), m_encode_uniform_width(-1), m_encode_uniform_format(-1),
+    m_encode_uniform_tiled(-1), m_encode_vao(0), m_encode_fbo(0), m_encode_texture(0),
+    m_encode_width(0), m_encode_height(0), m_vertex_shader(0), m_parallel_compile(false),
+    m_vao(0), m_stream_buffer(0), m_stream_buffer_size(0), m_stream_offset(0) {
+    memset(&m_batch_state, 0, sizeof(m_batch_state));
+    memset(&m_draw_state, 0, sizeof(m_draw_state));
+    m_draw_textured = false;
+    m_uber_program.handle = 0;
+    m_uber_program.fragment_shader = 0;
+    m_uber_program.status = PROGRAM_FAILED;
+}
+
+/// RasterizerOpenGL destructor
+RasterizerOpenGL::~RasterizerOpenGL() {
+    for (auto& it : m_framebuffers) {
+        DeleteFramebuffer(it.second);
+    }
+    glDeleteFramebuffers(1, &m_native_fbo);
+    glDeleteTextures(1, &m_native_texture);
+    glDeleteProgram(m_encode_program);
+    glDeleteVertexArrays(1, &m_encode_vao);
+    glDeleteFramebuffers(1, &m_encode_fbo);
+    glDeleteTextures(1, &m_encode_texture);
+    glDeleteBuffers(1, &m_stream_buffer);
+    glDeleteVertexArrays(1, &m_vao);
+    for (auto& it : m_programs) {
+        glDeleteShader(it.second.fragment_shader);
+        glDeleteProgram(it.second.handle);
+    }
+    Common::MemoryTracker::Adjust(Common::MemoryTracker::TAG_SHADER_CACHE, 0,
+        -(s64)m_programs.size());
+    glDeleteShader(m_uber_program.fragment_shader);
+    glDeleteProgram(m_uber_program.handle);
+    glDeleteShader(m_vertex_shader);
+
+    // Textures outliving the rasterizer keep their copies, the context goes away with them
+    m_batch_texture = nullptr;
+    Pica::TextureCache::Clear();
+    Pica::TextureCache::g_release_host_texture = NULL;
+}
+
+/// Initialize the rasterizer, the OpenGL context must be current
+void RasterizerOpenGL::Init() {
+    m_vertex_shader = ShaderUtil::CompileShader(GL_VERTEX_SHADER, g_vertex_shader);
+    m_parallel_compile = HasExtension("GL_ARB_parallel_shader_compile") ||
+        HasExtension("GL_KHR_parallel_shader_compile");
+
+    // Draws fall back to the ubershader, so it is the one program waited for
+    m_uber_program.fragment_source = ShaderGen::GetUberFragmentShader();
+    BuildProgram(m_uber_program);
+    if (m_uber_program.status == PROGRAM_COMPILING) {
+        FinishProgram(m_uber_program);
+    }
+    Pica::TextureCache::g_release_host_texture = ReleaseHostTexture;
+    InitEncodeProgram();
+
+    // Draws read OutputVertex structures straight from the stream buffer
+    m_stream_buffer_size = STREAM_BUFFER_SIZE;
+    glGenBuffers(1, &m_stream_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream_buffer);
+    glBufferData(GL_ARRAY_BUFFER, m_stream_buffer_size, NULL, GL_STREAM_DRAW);
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 4, GL_FLOAT, GL_FALSE, sizeof(OutputVertex),
+        (const GLvoid*)offsetof(OutputVertex, pos));
+    glVertexAttribPointer(ATTRIBUTE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(OutputVertex),
+        (const GLvoid*)offsetof(OutputVertex, color));
+    glVertexAttribPointer(ATTRIBUTE_TEXCOORD0, 2, GL_FLOAT, GL_FALSE, sizeof(OutputVertex),
+        (const GLvoid*)offsetof(OutputVertex, tc0_u));
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glEnableVertexAttribArray(ATTRIBUTE_COLOR);
+    glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_upload_ring.Init(UPLOAD_RING_SIZE);
+
+    NOTICE_LOG(RENDER, "hardware rasterizer initialized at %ux resolution", m_resolution_scale);
+}
+
+/**
+ * Gets the framebuffer of the color buffer currently set in Pica::g_regs, creating it from the
+ * contents of guest memory if there is none
+ * @return Framebuffer, NULL if the color buffer isn't in GPU memory
+ */
+RasterizerOpenGL::Framebuffer* RasterizerOpenGL::GetFramebuffer() {
+    const u32 color_address = Pica::g_regs.Get<Regs::ColorBufferAddress>().GetPhysicalAddress();
+    const auto& size = Pica::g_regs.Get<Regs::ColorBufferSize>();
+    const VideoCore::ColorFormat format = Pica::g_regs.Get<Regs::ColorBufferFormat>().format;
+
+    Framebuffer* framebuffer = FindFramebuffer(color_address, size.width, size.height, true);
+    if (framebuffer == NULL || framebuffer->format != format) {
+        framebuffer = CreateFramebuffer(color_address, size.width, size.height, format, true,
+            true);
+        if (framebuffer == NULL) {
+            return NULL;
+        }
+    }
+    framebuffer->depth_address = Pica::g_regs[Regs::DepthBufferAddress] * 8;
+    return framebuffer;
+}
+
+/**
+ * Gets the framebuffer of a guest surface
+ * @param address Physical address of the surface
+ * @param width Width of the surface in pixels
+ * @param height Height of the surface in pixels
+ * @param tiled Whether the surface is tiled
+ * @return Framebuffer, NULL if there is none of that layout at the address
+ */
+RasterizerOpenGL::Framebuffer* RasterizerOpenGL::FindFramebuffer(u32 address, u32 width,
+    u32 height, bool tiled) {
+    auto it = m_framebuffers.find(address);
+    if (it == m_framebuffers.end() || it->second.width != width ||
+        it->second.height != height || it->second.tiled != tiled) {
+        return NULL;
+    }
+    it->second.last_used = ++m_use_clock;
+    return &it->second;
+}
+
+/**
+ * Creates the framebuffer of a guest surface, replacing the framebuffers it overlaps
+ * @param address Physical address of the surface
+ * @param width Width of the surface in pixels
+ * @param height Height of the surface in pixels
+ * @param format Format of the surface
+ * @param tiled Whether the surface is tiled
+ * @param load Whether to fill the framebuffer from guest memory, or leave it undefined
+ * @return Framebuffer, NULL if the surface isn't in GPU memory
+ */
+RasterizerOpenGL::Framebuffer* RasterizerOpenGL::CreateFramebuffer(u32 address, u32 width,
+    u32 height, VideoCore::ColorFormat format, bool tiled, bool load) {
+    const u8* guest = VideoCore::GetPhysicalPointer(address);
+    if (guest == NULL) {
+        ERROR_LOG(RENDER, "surface at invalid address 0x%08X", address);
+        return NULL;
+    }
+
+    Framebuffer framebuffer;
+    framebuffer.color_address = address;
+    framebuffer.depth_address = 0;
+    framebuffer.width = width;
+    framebuffer.height = height;
+    framebuffer.format = format;
+    framebuffer.tiled = tiled;
+    framebuffer.dirty = false;
+    framebuffer.read_back = false;
+    framebuffer.pack_buffer = 0;
+    framebuffer.fence = 0;
+    framebuffer.encoded = false;
+    framebuffer.last_used = ++m_use_clock;
+
+    // The guest reuses the memory for a different surface
+    FlushRegion(address, framebuffer.GetSize());
+    InvalidateRegion(address, framebuffer.GetSize());
+
+    // Start from the contents of guest memory, rows bottom to top as OpenGL expects them. They
+    // are decoded straight into the upload ring when it has room.
+    u8* staged = NULL;
+    bool from_ring = false;
+    if (load) {
+        const u32 pixel_size = framebuffer.GetPixelSize();
+        staged = m_upload_ring.Map(width * height * 4);
+        from_ring = (staged != NULL);
+        if (!from_ring) {
+            m_staging.resize(width * height * 4);
+            staged = m_staging.data();
+        }
+        for (u32 y = 0; y < height; y++) {
+            for (u32 x = 0; x < width; x++) {
+                const u32 offset = tiled ? VideoCore::GetTiledPixelOffset(x, y, width) :
+                    y * width + x;
+                VideoCore::DecodeColor(format, guest + offset * pixel_size,
+                    &staged[(y * width + x) * 4]);
+            }
+        }
+    }
+
+    // Scaled framebuffers are loaded at the guest resolution and blown up on the host GPU
+    const u32 scaled_width = width * m_resolution_scale;
+    const u32 scaled_height = height * m_resolution_scale;
+    framebuffer.host_size = scaled_width * scaled_height * 8;
+    Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_SURFACE_CACHE,
+        framebuffer.host_size);
+    glGenTextures(1, &framebuffer.color_texture);
+    glBindTexture(GL_TEXTURE_2D, framebuffer.color_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, scaled_width, scaled_height, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &framebuffer.depth_renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, framebuffer.depth_renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, scaled_width, scaled_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer.fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+        framebuffer.color_texture, 0);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+        framebuffer.depth_renderbuffer);
+    if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        ERROR_LOG(RENDER, "couldn't create the framebuffer of surface 0x%08X", address);
+    }
+
+    if (staged != NULL) {
+        if (m_resolution_scale != 1) {
+            BindNativeSurface(GL_READ_FRAMEBUFFER, width, height);
+        }
+        const GLvoid* pixels = from_ring ? m_upload_ring.Unmap() : staged;
+        glBindTexture(GL_TEXTURE_2D, m_resolution_scale != 1 ? m_native_texture :
+            framebuffer.color_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (from_ring) {
+            m_upload_ring.EndUpload();
+        }
+
+        if (m_resolution_scale != 1) {
+            glDisable(GL_SCISSOR_TEST);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, scaled_width, scaled_height,
+                GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            glEnable(GL_SCISSOR_TEST);
+        }
+    }
+
+    return &(m_framebuffers[address] = framebuffer);
+}
+
+/**
+ * Writes a framebuffer back to guest memory if it was drawn to
+ * @param framebuffer Framebuffer
+ */
+void RasterizerOpenGL::WriteBack(Framebuffer& framebuffer) {
+    StartWriteBack(framebuffer);
+    FinishWriteBack(framebuffer);
+}
+
+/**
+ * Starts reading a framebuffer into its pack buffer if it was drawn to, in the guest format if it
+ * can be converted on the host GPU
+ * @param framebuffer Framebuffer
+ */
+void RasterizerOpenGL::StartWriteBack(Framebuffer& framebuffer) {
+    if (!framebuffer.dirty) {
+        return;
+    }
+    framebuffer.dirty = false;
+    DrawBatch();
+
+    // A write back still in flight has older pixels, this one replaces it
+    if (framebuffer.fence != 0) {
+        glDeleteSync(framebuffer.fence);
+        framebuffer.fence = 0;
+    }
+
+    GLuint source = framebuffer.color_texture;
+    if (m_resolution_scale != 1) {
+        // Downsampled on the host GPU, each guest pixel filtered from the pixels at its center,
+        // so that the readback stays at the guest resolution
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        BindNativeSurface(GL_DRAW_FRAMEBUFFER, framebuffer.width, framebuffer.height);
+        glDisable(GL_SCISSOR_TEST);
+        glBlitFramebuffer(0, 0, framebuffer.width * m_resolution_scale,
+            framebuffer.height * m_resolution_scale, 0, 0, framebuffer.width, framebuffer.height,
+            GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glEnable(GL_SCISSOR_TEST);
+        source = m_native_texture;
+    }
+
+    // Without the pass the pixels are read as RGBA8, which is four bytes as well
+    const u32 size = framebuffer.width * framebuffer.height * 4;
+    if (framebuffer.pack_buffer == 0) {
+        glGenBuffers(1, &framebuffer.pack_buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, framebuffer.pack_buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        framebuffer.host_size += size;
+        Common::MemoryTracker::Adjust(Common::MemoryTracker::TAG_SURFACE_CACHE, size, 0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, framebuffer.pack_buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // The pass writes whole 4 byte texels, rows of other sizes are converted on the CPU
+    framebuffer.encoded = m_encode_program != 0 &&
+        framebuffer.width * framebuffer.GetPixelSize() % 4 == 0;
+    if (framebuffer.encoded) {
+        EncodeFramebuffer(framebuffer, source);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_encode_fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, framebuffer.width * framebuffer.GetPixelSize() / 4, framebuffer.height,
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    } else {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, source == m_native_texture ? m_native_fbo :
+            framebuffer.fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, framebuffer.width, framebuffer.height, GL_RGBA, GL_UNSIGNED_BYTE,
+            NULL);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    framebuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Copies the write back StartWriteBack started to guest memory, waiting for it if needed
+ * @param framebuffer Framebuffer
+ */
+void RasterizerOpenGL::FinishWriteBack(Framebuffer& framebuffer) {
+    if (framebuffer.fence == 0) {
+        return;
+    }
+    Common::Profiler::Scope scope(g_profile_write_back);
+    while (glClientWaitSync(framebuffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+        GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(framebuffer.fence);
+    framebuffer.fence = 0;
+    framebuffer.read_back = true;
+
+    u8* guest = VideoCore::GetPhysicalPointer(framebuffer.color_address);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, framebuffer.pack_buffer);
+    const u8* pixels = (const u8*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+        framebuffer.width * framebuffer.height * 4, GL_MAP_READ_BIT);
+    if (pixels == NULL) {
+        ERROR_LOG(RENDER, "couldn't map the write back of surface 0x%08X",
+            framebuffer.color_address);
+    } else if (framebuffer.encoded) {
+        memcpy(guest, pixels, framebuffer.GetSize());
+    } else {
+        const u32 pixel_size = framebuffer.GetPixelSize();
+        for (u32 y = 0; y < framebuffer.height; y++) {
+            for (u32 x = 0; x < framebuffer.width; x++) {
+                const u32 offset = framebuffer.tiled ?
+                    VideoCore::GetTiledPixelOffset(x, y, framebuffer.width) :
+                    y * framebuffer.width + x;
+                VideoCore::EncodeColor(framebuffer.format, &pixels[(y * framebuffer.width + x) * 4],
+                    guest + offset * pixel_size);
+            }
+        }
+    }
+    if (pixels != NULL) {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Textures sampling the color buffer and the LCDs scanning it out have to see what was rendered
+    Memory::MarkRangeDirty(Memory::VirtualAddressFromPhysical(framebuffer.color_address),
+        framebuffer.GetSize(), Memory::DIRTY_TEXTURE | Memory::DIRTY_FRAMEBUFFER |
+        Memory::DIRTY_SAVESTATE | Memory::DIRTY_REWIND);
+}
+
+/**
+ * Tiles and converts a framebuffer to the guest format into the encode target
+ * @param framebuffer Framebuffer
+ * @param source Color texture of the framebuffer at the guest resolution
+ */
+void RasterizerOpenGL::EncodeFramebuffer(const Framebuffer& framebuffer, GLuint source) {
+    const u32 width = framebuffer.width * framebuffer.GetPixelSize() / 4;
+    const u32 height = framebuffer.height;
+    if (m_encode_fbo == 0) {
+        glGenTextures(1, &m_encode_texture);
+        glBindTexture(GL_TEXTURE_2D, m_encode_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenFramebuffers(1, &m_encode_fbo);
+    }
+    if (width != m_encode_width || height != m_encode_height) {
+        glBindTexture(GL_TEXTURE_2D, m_encode_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, width, height, 0, GL_RGBA_INTEGER,
+            GL_UNSIGNED_BYTE, NULL);
+        m_encode_width = width;
+        m_encode_height = height;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_encode_fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+        m_encode_texture, 0);
+
+    glViewport(0, 0, width, height);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glUseProgram(m_encode_program);
+    glUniform1i(m_encode_uniform_width, framebuffer.width);
+    glUniform1i(m_encode_uniform_format, (GLint)framebuffer.format);
+    glUniform1i(m_encode_uniform_tiled, framebuffer.tiled);
+    glBindVertexArray(m_encode_vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+}
+
+/// Compiles the program of the write back pass, which is left 0 if it doesn't link
+void RasterizerOpenGL::InitEncodeProgram() {
+    m_encode_program = glCreateProgram();
+    if (!ShaderUtil::LoadProgram(m_encode_program, g_encode_vertex_shader,
+        g_encode_fragment_shader)) {
+        const GLuint vertex_shader = ShaderUtil::CompileShader(GL_VERTEX_SHADER,
+            g_encode_vertex_shader);
+        const GLuint fragment_shader = ShaderUtil::CompileShader(GL_FRAGMENT_SHADER,
+            g_encode_fragment_shader);
+        bool linked = false;
+        if (vertex_shader != 0 && fragment_shader != 0) {
+            glAttachShader(m_encode_program, vertex_shader);
+            glAttachShader(m_encode_program, fragment_shader);
+            glBindFragDataLocation(m_encode_program, 0, "out_bytes");
+            linked = ShaderUtil::LinkProgram(m_encode_program);
+        }
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        if (!linked) {
+            glDeleteProgram(m_encode_program);
+            m_encode_program = 0;
+            NOTICE_LOG(RENDER, "converting framebuffer write backs on the CPU");
+            return;
+        }
+        ShaderUtil::StoreProgram(m_encode_program, g_encode_vertex_shader,
+            g_encode_fragment_shader);
+    }
+    glUseProgram(m_encode_program);
+    glUniform1i(glGetUniformLocation(m_encode_program, "color"), 0);
+    m_encode_uniform_width = glGetUniformLocation(m_encode_program, "width");
+    m_encode_uniform_format = glGetUniformLocation(m_encode_program, "format");
+    m_encode_uniform_tiled = glGetUniformLocation(m_encode_program, "tiled");
+    glUseProgram(0);
+
+    // The quad is generated from the vertex IDs, but drawing still needs a vertex array object
+    glGenVertexArrays(1, &m_encode_vao);
+}
+
+/**
+ * Binds the framebuffer object of the native resolution surface, loads and write backs of scaled
+ * framebuffers go through it
+ * @param target Target to bind the framebuffer object to
+ * @param width Width of the surface in pixels, it is resized if needed
+ * @param height Height of the surface in pixels
+ */
+void RasterizerOpenGL::BindNativeSurface(GLenum target, u32 width, u32 height) {
+    if (m_native_fbo == 0) {
+        glGenTextures(1, &m_native_texture);
+        glBindTexture(GL_TEXTURE_2D, m_native_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenFramebuffers(1, &m_native_fbo);
+    }
+    if (width != m_native_width || height != m_native_height) {
+        glBindTexture(GL_TEXTURE_2D, m_native_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+            NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        m_native_width = width;
+        m_native_height = height;
+    }
+    glBindFramebuffer(target, m_native_fbo);
+    glFramebufferTexture2D(target, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_native_texture, 0);
+}
+
+/**
+ * Deletes the OpenGL objects of a framebuffer
+ * @param framebuffer Framebuffer
+ */
+void RasterizerOpenGL::DeleteFramebuffer(Framebuffer& framebuffer) {
+    Common::MemoryTracker::Free(Common::MemoryTracker::TAG_SURFACE_CACHE, framebuffer.host_size);
+    glDeleteFramebuffers(1, &framebuffer.fbo);
+    glDeleteRenderbuffers(1, &framebuffer.depth_renderbuffer);
+    glDeleteTextures(1, &framebuffer.color_texture);
+    glDeleteBuffers(1, &framebuffer.pack_buffer);
+    if (framebuffer.fence != 0) {
+        glDeleteSync(framebuffer.fence);
+    }
+}
+
+/**
+ * Copies vertices to the stream buffer
+ * @param vertices Vertices
+ * @param count Number of vertices
+ * @return Index of the first vertex in the stream buffer
+ */
+GLint RasterizerOpenGL::StreamVertices(const OutputVertex* vertices, u32 count) {
+    const GLsizeiptr size = count * sizeof(OutputVertex);
+
+    // Vertices are addressed by index, so the data starts on a vertex boundary
+    GLintptr offset = (m_stream_offset + sizeof(OutputVertex) - 1) / sizeof(OutputVertex) *
+        sizeof(OutputVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, m_stream_buffer);
+    if (offset + size > m_stream_buffer_size) {
+        // Orphan the buffer: draws still reading the old storage keep it, without a stall
+        m_stream_buffer_size = std::max<GLsizeiptr>(m_stream_buffer_size, size);
+        glBufferData(GL_ARRAY_BUFFER, m_stream_buffer_size, NULL, GL_STREAM_DRAW);
+        offset = 0;
+    }
+
+    // Unsynchronized, as draws never read the part of the buffer past m_stream_offset
+    void* data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT |
+        GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(data, vertices, size);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m_stream_offset = offset + size;
+    return (GLint)(offset / sizeof(OutputVertex));
+}
+
+/**
+ * Decodes texture unit 0 as currently set in Pica::g_regs, uploading its texture if needed
+ * @param state Receives the texture state of the draw
+ * @param texture Receives the cached texture, which the draw keeps alive until issued
+ */
+void RasterizerOpenGL::SetupTexture(DrawState* state, Pica::TextureCache::TexturePtr* texture) {
+    if (!Pica::g_regs.Get<Regs::TextureUnitConfig>().texture0_enable) {
+        return;
+    }
+    const u32 address = Pica::g_regs.Get<Regs::Texture0Address>().GetPhysicalAddress();
+    const auto& size = Pica::g_regs.Get<Regs::Texture0Size>();
+    const Pica::TextureCache::TextureFormat format =
+        Pica::g_regs.Get<Regs::Texture0Format>().format;
+
+    // Render to texture samples the framebuffer, the color formats are numbered like the color
+    // buffer formats
+    const Framebuffer* framebuffer = FindFramebuffer(address, size.width, size.height, true);
+    if (framebuffer != NULL && (u32)framebuffer->format == (u32)format) {
+        state->texture = framebuffer->color_texture;
+        state->flip = GL_TRUE;
+    } else {
+        // Anything else overlapping the texture goes through guest memory, texels take at most
+        // 4 bytes
+        FlushRegion(address, size.width * size.height * 4);
+
+        *texture = Pica::TextureCache::Get(address, size.width, size.height, format);
+        if (*texture == nullptr) {
+            return;
+        }
+        UploadTexture(**texture);
+        state->texture = (*texture)->host_texture;
+    }
+
+    const auto& parameters = Pica::g_regs.Get<Regs::Texture0Parameters>();
+    state->wrap_s = GetWrapMode(parameters.wrap_s);
+    state->wrap_t = GetWrapMode(parameters.wrap_t);
+    state->border_color = Pica::g_regs[Regs::Texture0BorderColor];
+}
+
+/**
+ * Creates the OpenGL copy of a cached texture if it has none yet
+ * @param texture Texture
+ */
+void RasterizerOpenGL::UploadTexture(const Pica::TextureCache::Texture& texture) {
+    // Redecoded textures are new objects, so a copy never goes stale
+    if (texture.host_texture == 0) {
+        Common::Profiler::Scope scope(g_profile_upload);
+        GLuint host_texture;
+        glGenTextures(1, &host_texture);
+        glBindTexture(GL_TEXTURE_2D, host_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // Through the upload ring, so the driver doesn't copy the texels before returning
+        u8* staged = m_upload_ring.Map(texture.texels.size());
+        if (staged != NULL) {
+            memcpy(staged, texture.texels.data(), texture.texels.size());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture.width, texture.height, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, m_upload_ring.Unmap());
+            m_upload_ring.EndUpload();
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture.width, texture.height, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, texture.texels.data());
+        }
+        texture.host_texture = host_texture;
+    }
+}
+
+/**
+ * Draws shaded vertices with the render state currently set in Pica::g_regs. The draw joins the
+ * batch if it has the render state of the draws batched so far.
+ * @param vertices Vertices of the draw
+ * @param count Number of vertices
+ */
+void RasterizerOpenGL::SubmitPrimitives(const OutputVertex* vertices, u32 count) {
+    if (count < 3) {
+        return;
+    }
+    Framebuffer* framebuffer = GetFramebuffer();
+    if (framebuffer == NULL) {
+        return;
+    }
+
+    // Only the register groups changed since the last draw are decoded again, the texture is
+    // looked up every draw as its contents are in guest memory
+    using namespace Pica::CommandProcessor;
+    const u32 dirty = TakeDirtyGroups(DIRTY_VIEWPORT | DIRTY_COMBINERS | DIRTY_BLENDING);
+    DrawState& state = m_draw_state;
+    state.framebuffer = framebuffer;
+    if (dirty & DIRTY_VIEWPORT) {
+        SetupViewport(&state);
+    }
+
+    // Flushing the texture may write the framebuffer back, it is drawn to from here on
+    Pica::TextureCache::TexturePtr texture;
+    state.texture = 0;
+    state.wrap_s = 0;
+    state.wrap_t = 0;
+    state.border_color = 0;
+    state.flip = GL_FALSE;
+    SetupTexture(&state, &texture);
+    const bool textured = state.texture != 0;
+    if ((dirty & (DIRTY_COMBINERS | DIRTY_BLENDING)) || textured != m_draw_textured) {
+        SetupFragmentState(&state);
+        m_draw_textured = textured;
+    }
+    framebuffer->dirty = true;
+
+    if (!m_batch.empty() && (memcmp(&state, &m_batch_state, sizeof(state)) != 0 ||
+        m_batch.size() + count * 3 > MAX_BATCH_VERTICES)) {
+        DrawBatch();
+    }
+    if (m_batch.empty()) {
+        m_batch_state = state;
+        m_batch_texture = texture;
+    }
+    AppendTriangles(vertices, count);
+}
+
+/**
+ * Decodes the culling and viewport registers currently set in Pica::g_regs
+ * @param state Receives the culling and viewport state of the draw
+ */
+void RasterizerOpenGL::SetupViewport(DrawState* state) {
+    // Draws use the guest orientation, row 0 of the framebuffer is row 0 of the color buffer
+    typedef Regs::Struct<Regs::CullMode>::Mode CullMode;
+    switch (Pica::g_regs.Get<Regs::CullMode>().mode) {
+    case CullMode::KeepClockWise:
+        state->front_face = GL_CW;
+        break;
+
+    case CullMode::KeepCounterClockWise:
+        state->front_face = GL_CCW;
+        break;
+
+    default:
+        state->front_face = 0;
+        break;
+    }
+
+    const float half_width = Pica::Float24ToFloat(Pica::g_regs.Get<Regs::ViewportSizeX>().value);
+    const float half_height = Pica::Float24ToFloat(Pica::g_regs.Get<Regs::ViewportSizeY>().value);
+    const auto& corner = Pica::g_regs.Get<Regs::ViewportCorner>();
+    const GLint scale = m_resolution_scale;
+    state->viewport[0] = corner.x * scale;
+    state->viewport[1] = corner.y * scale;
+    state->viewport[2] = (GLsizei)(half_width * 2.0f) * scale;
+    state->viewport[3] = (GLsizei)(half_height * 2.0f) * scale;
+}
+
+/**
+ * Appends the triangles of a draw to the batch, strips and fans are turned into lists
+ * @param vertices Vertices of the draw
+ * @param count Number of vertices
+ */
+void RasterizerOpenGL::AppendTriangles(const OutputVertex* vertices, u32 count) {
+    Pica::PrimitiveAssembler::ForEachTriangle(count, [&](u32 v0, u32 v1, u32 v2) {
+        m_batch.push_back(vertices[v0]);
+        m_batch.push_back(vertices[v1]);
+        m_batch.push_back(vertices[v2]);
+    });
+}
+
+/// Issues the draws batched so far as a single host draw
+void RasterizerOpenGL::DrawBatch() {
+    if (m_batch.empty()) {
+        return;
+    }
+    const DrawState& state = m_batch_state;
+
+    if (state.front_face != 0) {
+        glEnable(GL_CULL_FACE);
+        glFrontFace(state.front_face);
+    } else {
+        glDisable(GL_CULL_FACE);
+    }
+    glCullFace(GL_BACK);
+    glViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+
+    // Depth testing registers aren't decoded yet
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    if (state.blend) {
+        GLfloat blend_color[4];
+        UnpackColor(state.blend_color, blend_color);
+        glEnable(GL_BLEND);
+        glBlendEquationSeparate(state.blend_equation_rgb, state.blend_equation_alpha);
+        glBlendFuncSeparate(state.blend_factors[0], state.blend_factors[1],
+            state.blend_factors[2], state.blend_factors[3]);
+        glBlendColor(blend_color[0], blend_color[1], blend_color[2], blend_color[3]);
+    } else {
+        glDisable(GL_BLEND);
+    }
+
+    if (state.texture != 0) {
+        GLfloat border[4];
+        UnpackColor(state.border_color, border);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, state.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, state.wrap_s);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, state.wrap_t);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    }
+
+    const GLint first = StreamVertices(m_batch.data(), (u32)m_batch.size());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, state.framebuffer->fbo);
+    const Program& program = GetProgram(state.fragment);
+    GLfloat const_colors[Pica::NUM_TEV_STAGES][4];
+    for (int stage = 0; stage < Pica::NUM_TEV_STAGES; stage++) {
+        UnpackColor(state.tev_const_color[stage], const_colors[stage]);
+    }
+    glUseProgram(program.handle);
+    glUniform1i(program.uniform_tex0_flip, state.flip);
+    glUniform4fv(program.uniform_tev_const_color, Pica::NUM_TEV_STAGES, &const_colors[0][0]);
+    glUniform1i(program.uniform_alpha_ref, state.alpha_ref);
+    if (&program == &m_uber_program) {
+        const ShaderGen::FragmentConfig& config = state.fragment;
+        GLint stages[Pica::NUM_TEV_STAGES][4];
+        for (int stage = 0; stage < Pica::NUM_TEV_STAGES; stage++) {
+            stages[stage][0] = config.tev_source[stage];
+            stages[stage][1] = config.tev_operand[stage];
+            stages[stage][2] = config.tev_op[stage];
+            stages[stage][3] = config.tev_scale[stage];
+        }
+        glUniform4iv(program.uniform_tev_stages, Pica::NUM_TEV_STAGES, &stages[0][0]);
+        glUniform1i(program.uniform_alpha_test_function, config.alpha_test_function);
+        glUniform1i(program.uniform_tex0_enabled, config.texture0_enable);
+    }
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLES, first, (GLsizei)m_batch.size());
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The renderer blits with the state it set up
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+
+    m_batch.clear();
+    m_batch_texture = nullptr;
+}
+
+/**
+ * Decodes the blending registers and the uniforms of the fragment shader currently set in
+ * Pica::g_regs
+ * @param state Receives the blending and fragment state of the draw
+ */
+void RasterizerOpenGL::SetupFragmentState(DrawState* state) {
+    state->blend = GL_FALSE;
+    state->blend_equation_rgb = 0;
+    state->blend_equation_alpha = 0;
+    memset(state->blend_factors, 0, sizeof(state->blend_factors));
+    state->blend_color = 0;
+    if (Pica::g_regs.Get<Regs::ColorOperation>().alpha_blending_enable) {
+        const auto& blend = Pica::g_regs.Get<Regs::BlendFunc>();
+        state->blend = GL_TRUE;
+        state->blend_equation_rgb = GetBlendEquation(blend.color_equation);
+        state->blend_equation_alpha = GetBlendEquation(blend.alpha_equation);
+        state->blend_factors[0] = GetBlendFactor(blend.color_source_factor);
+        state->blend_factors[1] = GetBlendFactor(blend.color_dest_factor);
+        state->blend_factors[2] = GetBlendFactor(blend.alpha_source_factor);
+        state->blend_factors[3] = GetBlendFactor(blend.alpha_dest_factor);
+        state->blend_color = Pica::g_regs[Regs::BlendColor];
+    }
+    for (int stage = 0; stage < Pica::NUM_TEV_STAGES; stage++) {
+        state->tev_const_color[stage] = Pica::g_regs[Pica::TevStageRegister(stage,
+            Regs::TevStage0Color)];
+    }
+    state->alpha_ref = Pica::g_regs.Get<Regs::AlphaTest>().reference;
+    ShaderGen::GetFragmentConfig(&state->fragment, state->texture != 0);
+}
+
+/**
+ * Starts building a shader program, from the disk cache or by a compile that isn't waited for.
+ * Drivers compiling on threads of their own return from it right away.
+ * @param program Program, with its fragment source set
+ */
+void RasterizerOpenGL::BuildProgram(Program& program) {
+    const char* fragment_source = program.fragment_source.c_str();
+    program.handle = glCreateProgram();
+    program.fragment_shader = 0;
+    program.polls = 0;
+    if (ShaderUtil::LoadProgram(program.handle, g_vertex_shader, fragment_source)) {
+        std::string().swap(program.fragment_source);
+        SetupProgram(program);
+        return;
+    }
+
+    // The status of the compile is only asked for once it's done, that would wait for it
+    program.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(program.fragment_shader, 1, &fragment_source, NULL);
+    glCompileShader(program.fragment_shader);
+    glAttachShader(program.handle, m_vertex_shader);
+    glAttachShader(program.handle, program.fragment_shader);
+    glBindAttribLocation(program.handle, ATTRIBUTE_POSITION, "vert_position");
+    glBindAttribLocation(program.handle, ATTRIBUTE_COLOR, "vert_color");
+    glBindAttribLocation(program.handle, ATTRIBUTE_TEXCOORD0, "vert_texcoord0");
+    glBindFragDataLocation(program.handle, 0, "out_color");
+    glLinkProgram(program.handle);
+    program.status = PROGRAM_COMPILING;
+}
+
+/**
+ * Ends the compile of a program BuildProgram started, waiting for it if it isn't done
+ * @param program Program
+ */
+void RasterizerOpenGL::FinishProgram(Program& program) {
+    glDetachShader(program.handle, m_vertex_shader);
+    glDetachShader(program.handle, program.fragment_shader);
+    glDeleteShader(program.fragment_shader);
+    program.fragment_shader = 0;
+    if (!ShaderUtil::CheckLinkStatus(program.handle)) {
+        program.status = PROGRAM_FAILED;
+    } else {
+        ShaderUtil::StoreProgram(program.handle, g_vertex_shader,
+            program.fragment_source.c_str());
+        SetupProgram(program);
+    }
+    std::string().swap(program.fragment_source);
+}
+
+/**
+ * Looks up the uniforms of a linked program
+ * @param program Program
+ */
+void RasterizerOpenGL::SetupProgram(Program& program) {
+    const GLuint handle = program.handle;
+    program.uniform_tex0_flip = glGetUniformLocation(handle, "tex0_flip");
+    program.uniform_tev_const_color = glGetUniformLocation(handle, "tev_const_color");
+    program.uniform_alpha_ref = glGetUniformLocation(handle, "alpha_ref");
+    program.uniform_tev_stages = glGetUniformLocation(handle, "tev_stages");
+    program.uniform_alpha_test_function = glGetUniformLocation(handle, "alpha_test_function");
+    program.uniform_tex0_enabled = glGetUniformLocation(handle, "tex0_enabled");
+    glUseProgram(handle);
+    glUniform1i(glGetUniformLocation(handle, "tex0"), 0);
+    glUseProgram(0);
+    program.status = PROGRAM_READY;
+}
+
+/**
+ * Gets the program a configuration is drawn with, the ubershader until its own is linked. The
+ * first draw of a configuration starts building its program.
+ * @param config Fragment shader configuration
+ * @return Program
+ */
+const RasterizerOpenGL::Program& RasterizerOpenGL::GetProgram(
+    const ShaderGen::FragmentConfig& config) {
+    const u64 hash = ShaderGen::GetFragmentConfigHash(config);
+    auto it = m_programs.find(hash);
+    if (it == m_programs.end()) {
+        // The driver keeps the binaries, programs are only counted
+        Program& program = m_programs[hash];
+        Common::MemoryTracker::Adjust(Common::MemoryTracker::TAG_SHADER_CACHE, 0, 1);
+        program.config = config;
+        program.fragment_source = ShaderGen::GenerateFragmentShader(config);
+        BuildProgram(program);
+        if (program.status == PROGRAM_COMPILING) {
+            m_compiling.push_back(&program);
+        }
+        return program.status == PROGRAM_READY ? program : m_uber_program;
+    }
+
+    // Configurations of the same hash as another are left to the ubershader
+    const Program& program = it->second;
+    if (program.status != PROGRAM_READY ||
+        memcmp(&program.config, &config, sizeof(config)) != 0) {
+        return m_uber_program;
+    }
+    return program;
+}
+
+/// Checks on the programs being compiled, the ready ones are used from the next draw on
+void RasterizerOpenGL::PollPrograms() {
+    for (auto it = m_compiling.begin(); it != m_compiling.end();) {
+        Program& program = **it;
+        program.polls++;
+        GLint done = program.polls >= COMPILE_POLLS;
+        if (m_parallel_compile) {
+            glGetProgramiv(program.handle, GL_COMPLETION_STATUS_ARB, &done);
+        }
+        if (done) {
+            FinishProgram(program);
+            it = m_compiling.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Drops the least recently used framebuffers, written back first, while the framebuffers are over
+ * the budget of Common::MemoryTracker::TAG_SURFACE_CACHE. The most recently used one always stays.
+ */
+void RasterizerOpenGL::EvictFramebuffers() {
+    while (Common::MemoryTracker::IsOverBudget(Common::MemoryTracker::TAG_SURFACE_CACHE) &&
+        m_framebuffers.size() > 1) {
+
+        auto oldest = m_framebuffers.begin();
+        for (auto it = m_framebuffers.begin(); it != m_framebuffers.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) {
+                oldest = it;
+            }
+        }
+        WriteBack(oldest->second);
+        DeleteFramebuffer(oldest->second);
+        m_framebuffers.erase(oldest);
+    }
+}
+
+/// Hands the draws submitted so far to the host GPU
+void RasterizerOpenGL::Flush() {
+    DrawBatch();
+    PollPrograms();
+    EvictFramebuffers();
+
+    // The guest is likely to read them again, the write back runs while it gets there
+    for (auto& it : m_framebuffers) {
+        if (it.second.read_back) {
+            StartWriteBack(it.second);
+        }
+    }
+    glFlush();
+}
+
+/**
+ * Writes the framebuffers overlapping a memory range back to guest memory, finishing the write
+ * backs started before
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void RasterizerOpenGL::FlushRegion(u32 address, u32 size) {
+    for (auto& it : m_framebuffers) {
+        Framebuffer& framebuffer = it.second;
+        if (Overlaps(framebuffer.color_address, framebuffer.GetSize(), address, size)) {
+            WriteBack(framebuffer);
+        }
+    }
+}
+
+/**
+ * Drops the framebuffers overlapping a memory range the guest wrote to. Callers flush the range
+ * before writing to it, so that nothing drawn outside of the write is lost.
+ * @param address Physical address of the range
+ * @param size Size of the range in bytes
+ */
+void RasterizerOpenGL::InvalidateRegion(u32 address, u32 size) {
+    for (auto it = m_framebuffers.begin(); it != m_framebuffers.end();) {
+        Framebuffer& framebuffer = it->second;
+        if (Overlaps(framebuffer.color_address, framebuffer.GetSize(), address, size)) {
+            DrawBatch();
+            DeleteFramebuffer(framebuffer);
+            it = m_framebuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Runs a display transfer between framebuffers. The host GPU converts to the output format only
+ * when the output is written back.
+ * @param config Transfer to run
+ * @return True if done, false if the input has no framebuffer to serve it from
+ */
+bool RasterizerOpenGL::AccelerateDisplayTransfer(const GPU::DisplayTransferConfig& config) {
+    DrawBatch();
+    const bool output_tiled = config.flags.output_tiled != 0;
+    const Framebuffer* source = FindFramebuffer(config.input_address, config.input_width,
+        config.input_height, !output_tiled);
+    if (source == NULL ||
+        source->format != VideoCore::GetColorFormat(config.flags.input_format)) {
+        return false;
+    }
+
+    const VideoCore::ColorFormat format = VideoCore::GetColorFormat(config.flags.output_format);
+    Framebuffer* target = FindFramebuffer(config.output_address, config.output_width,
+        config.output_height, output_tiled);
+    if (target == NULL || target->format != format) {
+        // In place transfers go through guest memory, the output would replace the input
+        if (Overlaps(source->color_address, source->GetSize(), config.output_address,
+            config.output_width * config.output_height * VideoCore::GetPixelSize(format))) {
+            return false;
+        }
+        target = CreateFramebuffer(config.output_address, config.output_width,
+            config.output_height, format, output_tiled, false);
+        if (target == NULL) {
+            return false;
+        }
+    } else if (target == source) {
+        return false;
+    }
+
+    // Downscaling by exactly a half, linear filtering averages the 2x1 or 2x2 input pixels
+    const GLenum filter = config.input_width != config.output_width ||
+        config.input_height != config.output_height ? GL_LINEAR : GL_NEAREST;
+    const GLint y0 = config.flags.flip_vertically ? config.output_height : 0;
+    const GLint y1 = config.flags.flip_vertically ? 0 : config.output_height;
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source->fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->fbo);
+    const GLint scale = m_resolution_scale;
+    glBlitFramebuffer(0, 0, config.input_width * scale, config.input_height * scale, 0, y0 * scale,
+        config.output_width * scale, y1 * scale, GL_COLOR_BUFFER_BIT, filter);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glEnable(GL_SCISSOR_TEST);
+
+    target->dirty = true;
+    return true;
+}
+
+/**
+ * Runs a texture copy between framebuffers, which is only possible for a gapless copy of a
+ * whole framebuffer
+ * @param config Copy to run
+ * @return True if done, false if the copy isn't of a whole framebuffer
+ */
+bool RasterizerOpenGL::AccelerateTextureCopy(const GPU::TextureCopyConfig& config) {
+    DrawBatch();
+    auto it = m_framebuffers.find(config.input_address);
+    if (it == m_framebuffers.end() || config.input_gap != 0 || config.output_gap != 0 ||
+        it->second.GetSize() != config.size ||
+        Overlaps(config.input_address, config.size, config.output_address, config.size)) {
+        return false;
+    }
+    const Framebuffer& source = it->second;
+
+    Framebuffer* target = FindFramebuffer(config.output_address, source.width, source.height,
+        source.tiled);
+    if (target == NULL || target->format != source.format) {
+        target = CreateFramebuffer(config.output_address, source.width, source.height,
+            source.format, source.tiled, false);
+        if (target == NULL) {
+            return false;
+        }
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->fbo);
+    const GLint width = source.width * m_resolution_scale;
+    const GLint height = source.height * m_resolution_scale;
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glEnable(GL_SCISSOR_TEST);
+
+    target->dirty = true;
+    return true;
+}
+
+/**
+ * Gets the texture of the framebuffer a display transfer wrote an LCD framebuffer to, which
+ * presenting it can read instead of guest memory
+ * @param address Physical address of the LCD framebuffer
+ * @param width Width of the framebuffer in pixels, as laid out in memory
+ * @param height Height of the framebuffer in pixels, as laid out in memory
+ * @return Color texture, rendered at the resolution scale. 0 if there is no framebuffer.
+ */
+GLuint RasterizerOpenGL::GetScreenTexture(u32 address, u32 width, u32 height) {
+    DrawBatch();
+    const Framebuffer* framebuffer = FindFramebuffer(address, width, height, false);
+    return framebuffer != NULL ? framebuffer->color_texture : 0;
+}
@@ -0,0 +1,347 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "common/common.h"
+
+#include "video_core/hw_rasterizer.h"
+#include "video_core/texture_cache.h"
+#include "video_core/utils.h"
+#include "video_core/renderer_opengl/gl_shader_gen.h"
+#include "video_core/renderer_opengl/gl_upload_ring.h"
+
+/**
+ * Renders PICA draws with OpenGL 3.2. Guest color buffers are kept in framebuffer objects, which
+ * are filled from guest memory when first drawn to and written back when the guest reads them.
+ * Write backs are tiled and converted to the guest format by a pass on the host GPU and read into
+ * a pixel buffer, framebuffers the guest read before start theirs when the draws are flushed so
+ * that only a copy is left by the time the guest reads them again.
+ * Textures, display transfers and texture copies reading a framebuffer are served from it on the
+ * host GPU, so render to texture and presenting a frame don't need a readback. Framebuffers can be
+ * rendered at a multiple of the guest resolution, they are downsampled to it on the host GPU when
+ * written back. Consecutive draws of the same render state are batched into a single host draw,
+ * which is issued when the state changes or something reads the framebuffers. The texture
+ * combiners and the alpha test run in a fragment shader generated for their configuration, which
+ * is compiled while the draws of that configuration go through the ubershader.
+ */
+class RasterizerOpenGL : public Pica::HWRasterizer {
+public:
+
+    /// @param resolution_scale Multiplier of the guest resolution the framebuffers are rendered at
+    explicit RasterizerOpenGL(u32 resolution_scale = 1);
+    ~RasterizerOpenGL();
+
+    /// Initialize the rasterizer, the OpenGL context must be current
+    void Init();
+
+    /// Draws shaded vertices with the render state currently set in Pica::g_regs
+    void SubmitPrimitives(const Pica::VertexShader::OutputVertex* vertices, u32 count);
+
+    /// Hands the draws submitted so far to the host GPU
+    void Flush();
+
+    /// Writes the framebuffers overlapping a memory range back to guest memory
+    void FlushRegion(u32 address, u32 size);
+
+    /// Drops the framebuffers overlapping a memory range the guest wrote to
+    void InvalidateRegion(u32 address, u32 size);
+
+    /// Runs a display transfer between framebuffers
+    bool AccelerateDisplayTransfer(const GPU::DisplayTransferConfig& config);
+
+    /// Runs a texture copy between framebuffers
+    bool AccelerateTextureCopy(const GPU::TextureCopyConfig& config);
+
+    /// Multiplier of the guest resolution the framebuffers are rendered at
+    u32 GetResolutionScale() const {
+        return m_resolution_scale;
+    }
+
+    /**
+     * Gets the texture of the framebuffer a display transfer wrote an LCD framebuffer to, which
+     * presenting it can read instead of guest memory
+     * @param address Physical address of the LCD framebuffer
+     * @param width Width of the framebuffer in pixels, as laid out in memory
+     * @param height Height of the framebuffer in pixels, as laid out in memory
+     * @return Color texture, rendered at the resolution scale. 0 if there is no framebuffer.
+     */
+    GLuint GetScreenTexture(u32 address, u32 width, u32 height);
+
+private:
+
+    /// Host copy of a guest color buffer and its depth buffer, or of a display transfer output
+    struct Framebuffer {
+        GLuint                  fbo;
+        GLuint                  color_texture;
+        GLuint                  depth_renderbuffer;
+        u32                     color_address;  ///< Physical address of the guest color buffer
+        u32                     depth_address;  ///< Physical address of the guest depth buffer
+        u32                     width;
+        u32                     height;
+        VideoCore::ColorFormat  format;
+        bool                    tiled;          ///< Guest layout, linear for transfer outputs
+        bool                    dirty;          ///< Drawn to since it was last written back
+        bool                    read_back;      ///< Written back before, the guest reads it
+        GLuint                  pack_buffer;    ///< Pixel buffer write backs are read into
+        GLsync                  fence;          ///< Write back in the pack buffer, 0 for none
+        bool                    encoded;        ///< It is in the guest format, not RGBA8
+        u32                     host_size;      ///< Bytes of its host GPU buffers
+        u64                     last_used;      ///< m_use_clock when it was last looked up
+
+        /// Size of a pixel of the guest color buffer in bytes
+        u32 GetPixelSize() const;
+
+        /// Size of the guest color buffer in bytes
+        u32 GetSize() const;
+    };
+
+    /// Render state of a draw as decoded from Pica::g_regs, zeroed first so it compares bytewise
+    struct DrawState {
+        Framebuffer*    framebuffer;
+        GLuint          texture;        ///< Texture 0, 0 if the draw isn't textured
+        GLint           wrap_s;
+        GLint           wrap_t;
+        u32             border_color;
+        GLint           flip;           ///< Texture 0 is a framebuffer, rows top down
+        GLenum          front_face;     ///< Winding of the faces kept, 0 to keep both
+        GLint           viewport[4];
+        GLboolean       blend;
+        GLenum          blend_equation_rgb;
+        GLenum          blend_equation_alpha;
+        GLenum          blend_factors[4];   ///< Source and dest RGB, source and dest alpha
+        u32             blend_color;
+        u32             tev_const_color[Pica::NUM_TEV_STAGES];
+        u32             alpha_ref;
+
+        ShaderGen::FragmentConfig   fragment;   ///< Configuration of the fragment shader
+    };
+
+    enum ProgramStatus {
+        PROGRAM_COMPILING,
+        PROGRAM_READY,
+        PROGRAM_FAILED,
+    };
+
+    /// Shader program of a fragment shader configuration, or the ubershader
+    struct Program {
+        GLuint                      handle;
+        GLuint                      fragment_shader;    ///< 0 once the program is linked
+        ProgramStatus               status;
+        u32                         polls;              ///< Flushes the compile was polled at
+        std::string                 fragment_source;    ///< Kept until its binary is stored
+        ShaderGen::FragmentConfig   config;             ///< Told apart from hash collisions
+        GLint                       uniform_tex0_flip;
+        GLint                       uniform_tev_const_color;
+        GLint                       uniform_alpha_ref;
+        GLint                       uniform_tev_stages;             ///< Only of the ubershader
+        GLint                       uniform_alpha_test_function;    ///< Only of the ubershader
+        GLint                       uniform_tex0_enabled;           ///< Only of the ubershader
+    };
+
+    /**
+     * Gets the framebuffer of the color buffer currently set in Pica::g_regs, creating it from
+     * the contents of guest memory if there is none
+     * @return Framebuffer, NULL if the color buffer isn't in GPU memory
+     */
+    Framebuffer* GetFramebuffer();
+
+    /**
+     * Gets the framebuffer of a guest surface
+     * @param address Physical address of the surface
+     * @param width Width of the surface in pixels
+     * @param height Height of the surface in pixels
+     * @param tiled Whether the surface is tiled
+     * @return Framebuffer, NULL if there is none of that layout at the address
+     */
+    Framebuffer* FindFramebuffer(u32 address, u32 width, u32 height, bool tiled);
+
+    /**
+     * Creates the framebuffer of a guest surface, replacing the framebuffers it overlaps
+     * @param address Physical address of the surface
+     * @param width Width of the surface in pixels
+     * @param height Height of the surface in pixels
+     * @param format Format of the surface
+     * @param tiled Whether the surface is tiled
+     * @param load Whether to fill the framebuffer from guest memory, or leave it undefined
+     * @return Framebuffer, NULL if the surface isn't in GPU memory
+     */
+    Framebuffer* CreateFramebuffer(u32 address, u32 width, u32 height,
+        VideoCore::ColorFormat format, bool tiled, bool load);
+
+    /**
+     * Writes a framebuffer back to guest memory if it was drawn to
+     * @param framebuffer Framebuffer
+     */
+    void WriteBack(Framebuffer& framebuffer);
+
+    /**
+     * Starts reading a framebuffer into its pack buffer if it was drawn to, in the guest format
+     * if it can be converted on the host GPU
+     * @param framebuffer Framebuffer
+     */
+    void StartWriteBack(Framebuffer& framebuffer);
+
+    /**
+     * Copies the write back StartWriteBack started to guest memory, waiting for it if needed
+     * @param framebuffer Framebuffer
+     */
+    void FinishWriteBack(Framebuffer& framebuffer);
+
+    /**
+     * Tiles and converts a framebuffer to the guest format into the encode target
+     * @param framebuffer Framebuffer
+     * @param source Color texture of the framebuffer at the guest resolution
+     */
+    void EncodeFramebuffer(const Framebuffer& framebuffer, GLuint source);
+
+    /// Compiles the program of the write back pass, which is left 0 if it doesn't link
+    void InitEncodeProgram();
+
+    /**
+     * Binds the framebuffer object of the native resolution surface, loads and write backs of
+     * scaled framebuffers go through it
+     * @param target Target to bind the framebuffer object to
+     * @param width Width of the surface in pixels, it is resized if needed
+     * @param height Height of the surface in pixels
+     */
+    void BindNativeSurface(GLenum target, u32 width, u32 height);
+
+    /**
+     * Deletes the OpenGL objects of a framebuffer
+     * @param framebuffer Framebuffer
+     */
+    void DeleteFramebuffer(Framebuffer& framebuffer);
+
+    /**
+     * Decodes texture unit 0 as currently set in Pica::g_regs, uploading its texture if needed
+     * @param state Receives the texture state of the draw
+     * @param texture Receives the cached texture, which the draw keeps alive until issued
+     */
+    void SetupTexture(DrawState* state, Pica::TextureCache::TexturePtr* texture);
+
+    /**
+     * Creates the OpenGL copy of a cached texture if it has none yet
+     * @param texture Texture
+     */
+    void UploadTexture(const Pica::TextureCache::Texture& texture);
+
+    /**
+     * Copies vertices to the stream buffer
+     * @param vertices Vertices
+     * @param count Number of vertices
+     * @return Index of the first vertex in the stream buffer
+     */
+    GLint StreamVertices(const Pica::VertexShader::OutputVertex* vertices, u32 count);
+
+    /**
+     * Decodes the culling and viewport registers currently set in Pica::g_regs
+     * @param state Receives the culling and viewport state of the draw
+     */
+    void SetupViewport(DrawState* state);
+
+    /**
+     * Appends the triangles of a draw to the batch, strips and fans are turned into lists
+     * @param vertices Vertices of the draw
+     * @param count Number of vertices
+     */
+    void AppendTriangles(const Pica::VertexShader::OutputVertex* vertices, u32 count);
+
+    /// Issues the draws batched so far as a single host draw
+    void DrawBatch();
+
+    /**
+     * Decodes the blending registers and the uniforms of the fragment shader currently set in
+     * Pica::g_regs
+     * @param state Receives the blending and fragment state of the draw
+     */
+    void SetupFragmentState(DrawState* state);
+
+    /**
+     * Starts building a shader program, from the disk cache or by a compile that isn't waited
+     * for. Drivers compiling on threads of their own return from it right away.
+     * @param program Program, with its fragment source set
+     */
+    void BuildProgram(Program& program);
+
+    /**
+     * Ends the compile of a program BuildProgram started, waiting for it if it isn't done
+     * @param program Program
+     */
+    void FinishProgram(Program& program);
+
+    /**
+     * Looks up the uniforms of a linked program
+     * @param program Program
+     */
+    void SetupProgram(Program& program);
+
+    /**
+     * Gets the program a configuration is drawn with, the ubershader until its own is linked. The
+     * first draw of a configuration starts building its program.
+     * @param config Fragment shader configuration
+     * @return Program
+     */
+    const Program& GetProgram(const ShaderGen::FragmentConfig& config);
+
+    /// Checks on the programs being compiled, the ready ones are used from the next draw on
+    void PollPrograms();
+
+    /**
+     * Drops the least recently used framebuffers, written back first, while the framebuffers are
+     * over the budget of Common::MemoryTracker::TAG_SURFACE_CACHE. The most recently used one
+     * always stays.
+     */
+    void EvictFramebuffers();
+
+    std::map<u32, Framebuffer>  m_framebuffers;     ///< Framebuffers by color buffer address
+    u64                         m_use_clock;        ///< Lookups of framebuffers so far
+    std::vector<u8>             m_staging;          ///< Pixels being converted from guest memory,
+                                                    ///< when the upload ring has no room
+    UploadRing                  m_upload_ring;      ///< Texture and framebuffer uploads
+    u32                         m_resolution_scale; ///< Multiplier of the guest resolution
+
+    GLuint      m_native_fbo;                       ///< Native resolution surface of the loads and
+    GLuint      m_native_texture;                   ///< write backs of scaled framebuffers
+    u32         m_native_width;
+    u32         m_native_height;
+
+    GLuint      m_encode_program;                   ///< Write back pass, 0 to convert on the CPU
+    GLint       m_encode_uniform_width;
+    GLint       m_encode_uniform_format;
+    GLint       m_encode_uniform_tiled;
+    GLuint      m_encode_vao;
+    GLuint      m_encode_fbo;                       ///< Target of the write back pass, a texel
+    GLuint      m_encode_texture;                   ///< per 4 bytes of the guest surface
+    u32         m_encode_width;
+    u32         m_encode_height;
+
+    GLuint      m_vertex_shader;                    ///< Vertex shader of all the programs
+    Program     m_uber_program;                     ///< Draws configurations being compiled
+    bool        m_parallel_compile;                 ///< Compile status can be polled, see
+                                                    ///< GL_ARB_parallel_shader_compile
+    GLuint      m_vao;                              ///< Vertex layout of the stream buffer
+    GLuint      m_stream_buffer;                    ///< Vertex buffer the draws are appended to
+    GLsizeiptr  m_stream_buffer_size;
+    GLintptr    m_stream_offset;                    ///< Offset of the free space in the stream buffer
+
+    DrawState   m_draw_state;                       ///< Render state as last decoded, again for the
+                                                    ///< register groups changed since
+    bool        m_draw_textured;                    ///< Whether the fragment state was decoded for
+                                                    ///< a textured draw
+
+    std::vector<Pica::VertexShader::OutputVertex>   m_batch;            ///< Triangles not drawn yet
+    DrawState                                       m_batch_state;      ///< Render state of them
+    Pica::TextureCache::TexturePtr                  m_batch_texture;    ///< Texture 0 of them
+
+    std::unordered_map<u64, Program>    m_programs;     ///< Programs by hash of configuration
+    std::vector<Program*>               m_compiling;    ///< Programs whose compile was started
+};
@@ -0,0 +1,466 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include "common/hash.h"
+#include "common/string_util.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/renderer_opengl/gl_shader_gen.h"
+
+using Pica::Regs;
+
+namespace ShaderGen {
+
+namespace {
+
+typedef Regs::Struct<Regs::TevStage0Source>::Source Source;
+typedef Regs::Struct<Regs::TevStage0Operand>::ColorModifier ColorModifier;
+typedef Regs::Struct<Regs::TevStage0Operand>::AlphaModifier AlphaModifier;
+typedef Regs::Struct<Regs::TevStage0Op>::Operation Operation;
+typedef Regs::Struct<Regs::AlphaTest>::Function AlphaTestFunction;
+
+enum {
+    SOURCE_FIELDS_MASK  = 0x0FFF0FFF,   ///< Fields of TevStage0Source
+    OPERAND_FIELDS_MASK = 0x00777FFF,   ///< Fields of TevStage0Operand
+    OP_FIELDS_MASK      = 0x000F000F,   ///< Fields of TevStage0Op
+    SCALE_FIELDS_MASK   = 0x00030003,   ///< Fields of TevStage0Scale
+};
+
+/// Declarations of both kinds of shaders, the stages interpret them alike
+const char g_fragment_header[] =
+    "#version 150\n"
+    "in vec4 color;\n"
+    "in vec2 texcoord0;\n"
+    "out vec4 out_color;\n"
+    "uniform sampler2D tex0;\n"
+    "uniform bool tex0_flip;\n"
+    "uniform vec4 tev_const_color[6];\n"
+    "uniform int alpha_ref;\n"
+    "vec4 SampleTexture0() {\n"
+    "    return texture(tex0, tex0_flip ? vec2(texcoord0.x, 1.0 - texcoord0.y) : texcoord0);\n"
+    "}\n";
+
+/// Rest of the ubershader, tev_stages holds the source, operand, op and scale of every stage
+const char g_uber_fragment_body[] =
+    "uniform ivec4 tev_stages[6];\n"
+    "uniform int alpha_test_function;\n"
+    "uniform bool tex0_enabled;\n"
+    "vec4 GetSource(int source, int stage, vec4 previous, vec4 tex0_color) {\n"
+    "    switch (source) {\n"
+    "    case 0: return color;\n"
+    "    case 3: return tex0_color;\n"
+    "    case 14: return tev_const_color[stage];\n"
+    "    case 15: return previous;\n"
+    "    }\n"
+    "    return vec4(0.0);\n"
+    "}\n"
+    "vec3 GetColorModifier(int modifier, vec4 s) {\n"
+    "    switch (modifier) {\n"
+    "    case 1: return vec3(1.0) - s.rgb;\n"
+    "    case 2: return s.aaa;\n"
+    "    case 3: return vec3(1.0 - s.a);\n"
+    "    case 4: return s.rrr;\n"
+    "    case 5: return vec3(1.0 - s.r);\n"
+    "    case 8: return s.ggg;\n"
+    "    case 9: return vec3(1.0 - s.g);\n"
+    "    case 12: return s.bbb;\n"
+    "    case 13: return vec3(1.0 - s.b);\n"
+    "    }\n"
+    "    return s.rgb;\n"
+    "}\n"
+    "float GetAlphaModifier(int modifier, vec4 s) {\n"
+    "    switch (modifier) {\n"
+    "    case 1: return 1.0 - s.a;\n"
+    "    case 2: return s.r;\n"
+    "    case 3: return 1.0 - s.r;\n"
+    "    case 4: return s.g;\n"
+    "    case 5: return 1.0 - s.g;\n"
+    "    case 6: return s.b;\n"
+    "    case 7: return 1.0 - s.b;\n"
+    "    }\n"
+    "    return s.a;\n"
+    "}\n"
+    "vec3 GetColorOperation(int op, vec3 in0, vec3 in1, vec3 in2) {\n"
+    "    switch (op) {\n"
+    "    case 1: return in0 * in1;\n"
+    "    case 2: return min(in0 + in1, 1.0);\n"
+    "    case 3: return clamp(in0 + in1 - 0.5, 0.0, 1.0);\n"
+    "    case 4: return in0 * in2 + in1 * (1.0 - in2);\n"
+    "    case 5: return max(in0 - in1, 0.0);\n"
+    "    case 6: return vec3(clamp(dot(in0 - 0.5, in1 - 0.5) * 4.0, 0.0, 1.0));\n"
+    "    case 8: return min(in0 * in1 + in2, 1.0);\n"
+    "    case 9: return min(in0 + in1, 1.0) * in2;\n"
+    "    }\n"
+    "    return in0;\n"
+    "}\n"
+    "float GetAlphaOperation(int op, float in0, float in1, float in2) {\n"
+    "    switch (op) {\n"
+    "    case 1: return in0 * in1;\n"
+    "    case 2: return min(in0 + in1, 1.0);\n"
+    "    case 3: return clamp(in0 + in1 - 0.5, 0.0, 1.0);\n"
+    "    case 4: return in0 * in2 + in1 * (1.0 - in2);\n"
+    "    case 5: return max(in0 - in1, 0.0);\n"
+    "    case 8: return min(in0 * in1 + in2, 1.0);\n"
+    "    case 9: return min(in0 + in1, 1.0) * in2;\n"
+    "    }\n"
+    "    return in0;\n"
+    "}\n"
+    "bool PassesAlphaTest(int value) {\n"
+    "    switch (alpha_test_function) {\n"
+    "    case 0: return false;\n"
+    "    case 2: return value == alpha_ref;\n"
+    "    case 3: return value != alpha_ref;\n"
+    "    case 4: return value < alpha_ref;\n"
+    "    case 5: return value <= alpha_ref;\n"
+    "    case 6: return value > alpha_ref;\n"
+    "    case 7: return value >= alpha_ref;\n"
+    "    }\n"
+    "    return true;\n"
+    "}\n"
+    "void main() {\n"
+    "    vec4 tex0_color = tex0_enabled ? SampleTexture0() : vec4(0.0);\n"
+    "    vec4 previous = vec4(0.0);\n"
+    "    for (int stage = 0; stage < 6; stage++) {\n"
+    "        ivec4 config = tev_stages[stage];\n"
+    "        vec3 color_in[3];\n"
+    "        float alpha_in[3];\n"
+    "        for (int i = 0; i < 3; i++) {\n"
+    "            color_in[i] = GetColorModifier((config.y >> (4 * i)) & 15,\n"
+    "                GetSource((config.x >> (4 * i)) & 15, stage, previous, tex0_color));\n"
+    "            alpha_in[i] = GetAlphaModifier((config.y >> (12 + 4 * i)) & 7,\n"
+    "                GetSource((config.x >> (16 + 4 * i)) & 15, stage, previous, tex0_color));\n"
+    "        }\n"
+    "        vec3 rgb = GetColorOperation(config.z & 15, color_in[0], color_in[1], color_in[2]);\n"
+    "        float a = GetAlphaOperation((config.z >> 16) & 15, alpha_in[0], alpha_in[1],\n"
+    "            alpha_in[2]);\n"
+    "        previous = clamp(vec4(rgb * float(1 << (config.w & 3)),\n"
+    "            a * float(1 << ((config.w >> 16) & 3))), 0.0, 1.0);\n"
+    "    }\n"
+    "    if (!PassesAlphaTest(int(previous.a * 255.0 + 0.5))) {\n"
+    "        discard;\n"
+    "    }\n"
+    "    out_color = previous;\n"
+    "}\n";
+
+/**
+ * Gets the GLSL expression of a combiner source
+ * @param config Configuration of the shader
+ * @param source Source
+ * @param stage Stage reading the source
+ * @return Expression of type vec4
+ */
+std::string GetSource(const FragmentConfig& config, Source source, int stage) {
+    switch (source) {
+    case Source::PrimaryColor:
+        return "color";
+
+    case Source::Texture0:
+        return config.texture0_enable ? "tex0_color" : "vec4(0.0)";
+
+    case Source::Constant:
+        return StringFromFormat("tev_const_color[%d]", stage);
+
+    case Source::Previous:
+        return "previous";
+
+    default:
+        // Lighting, texture units 1-3 and the combiner buffer aren't emulated yet
+        return "vec4(0.0)";
+    }
+}
+
+/**
+ * Gets the GLSL expression of a color combiner input
+ * @param modifier Modifier of the input
+ * @param source Expression of the source, of type vec4
+ * @return Expression of type vec3
+ */
+std::string GetColorModifier(ColorModifier modifier, const std::string& source) {
+    switch (modifier) {
+    case ColorModifier::OneMinusSourceColor:
+        return "vec3(1.0) - " + source + ".rgb";
+
+    case ColorModifier::SourceAlpha:
+        return source + ".aaa";
+
+    case ColorModifier::OneMinusSourceAlpha:
+        return "vec3(1.0 - " + source + ".a)";
+
+    case ColorModifier::SourceRed:
+        return source + ".rrr";
+
+    case ColorModifier::OneMinusSourceRed:
+        return "vec3(1.0 - " + source + ".r)";
+
+    case ColorModifier::SourceGreen:
+        return source + ".ggg";
+
+    case ColorModifier::OneMinusSourceGreen:
+        return "vec3(1.0 - " + source + ".g)";
+
+    case ColorModifier::SourceBlue:
+        return source + ".bbb";
+
+    case ColorModifier::OneMinusSourceBlue:
+        return "vec3(1.0 - " + source + ".b)";
+
+    default:
+        return source + ".rgb";
+    }
+}
+
+/**
+ * Gets the GLSL expression of an alpha combiner input
+ * @param modifier Modifier of the input
+ * @param source Expression of the source, of type vec4
+ * @return Expression of type float
+ */
+std::string GetAlphaModifier(AlphaModifier modifier, const std::string& source) {
+    switch (modifier) {
+    case AlphaModifier::OneMinusSourceAlpha:
+        return "1.0 - " + source + ".a";
+
+    case AlphaModifier::SourceRed:
+        return source + ".r";
+
+    case AlphaModifier::OneMinusSourceRed:
+        return "1.0 - " + source + ".r";
+
+    case AlphaModifier::SourceGreen:
+        return source + ".g";
+
+    case AlphaModifier::OneMinusSourceGreen:
+        return "1.0 - " + source + ".g";
+
+    case AlphaModifier::SourceBlue:
+        return source + ".b";
+
+    case AlphaModifier::OneMinusSourceBlue:
+        return "1.0 - " + source + ".b";
+
+    default:
+        return source + ".a";
+    }
+}
+
+/**
+ * Gets the number of inputs a combiner operation reads
+ * @param op Operation
+ * @return 1 to 3
+ */
+int GetNumInputs(Operation op) {
+    switch (op) {
+    case Operation::Lerp:
+    case Operation::MultiplyThenAdd:
+    case Operation::AddThenMultiply:
+        return 3;
+
+    case Operation::Replace:
+        return 1;
+
+    default:
+        return 2;
+    }
+}
+
+/**
+ * Gets the GLSL expression of a combiner operation, reading the inputs in0 to in2
+ * @param op Operation
+ * @param alpha Whether it is the alpha operation, Dot3RGB is only one of the color operation
+ * @return Expression of the type of the inputs
+ */
+std::string GetOperation(Operation op, bool alpha) {
+    switch (op) {
+    case Operation::Modulate:
+        return "in0 * in1";
+
+    case Operation::Add:
+        return "min(in0 + in1, 1.0)";
+
+    case Operation::AddSigned:
+        return "clamp(in0 + in1 - 0.5, 0.0, 1.0)";
+
+    case Operation::Lerp:
+        return "in0 * in2 + in1 * (1.0 - in2)";
+
+    case Operation::Subtract:
+        return "max(in0 - in1, 0.0)";
+
+    case Operation::Dot3RGB:
+        return alpha ? "in0" : "vec3(clamp(dot(in0 - 0.5, in1 - 0.5) * 4.0, 0.0, 1.0))";
+
+    case Operation::MultiplyThenAdd:
+        return "min(in0 * in1 + in2, 1.0)";
+
+    case Operation::AddThenMultiply:
+        return "min(in0 + in1, 1.0) * in2";
+
+    default:
+        return "in0";
+    }
+}
+
+/**
+ * Gets whether a stage passes the output of the previous one through unchanged, as the stages
+ * games leave unused are set up
+ * @param config Configuration of the shader
+ * @param stage Stage
+ * @return True if the stage can be left out
+ */
+bool IsPassthroughStage(const FragmentConfig& config, int stage) {
+    const u32 previous = (u32)Source::Previous;
+    return (config.tev_source[stage] & 0x000F000F) == (previous | previous << 16) &&
+        (config.tev_operand[stage] & 0x0000700F) == 0 && config.tev_op[stage] == 0 &&
+        config.tev_scale[stage] == 0;
+}
+
+/**
+ * Appends the GLSL code of a combiner stage, which updates previous
+ * @param config Configuration of the shader
+ * @param stage Stage
+ * @param out Receives the code
+ */
+void AppendStage(const FragmentConfig& config, int stage, std::string& out) {
+    Regs::Struct<Regs::TevStage0Source> source;
+    Regs::Struct<Regs::TevStage0Operand> operand;
+    Regs::Struct<Regs::TevStage0Op> op;
+    Regs::Struct<Regs::TevStage0Scale> scale;
+    memcpy(&source, &config.tev_source[stage], sizeof(u32));
+    memcpy(&operand, &config.tev_operand[stage], sizeof(u32));
+    memcpy(&op, &config.tev_op[stage], sizeof(u32));
+    memcpy(&scale, &config.tev_scale[stage], sizeof(u32));
+
+    const Source color_sources[3] = { source.color_source1, source.color_source2,
+        source.color_source3 };
+    const Source alpha_sources[3] = { source.alpha_source1, source.alpha_source2,
+        source.alpha_source3 };
+    const ColorModifier color_modifiers[3] = { operand.color_modifier1, operand.color_modifier2,
+        operand.color_modifier3 };
+    const AlphaModifier alpha_modifiers[3] = { operand.alpha_modifier1, operand.alpha_modifier2,
+        operand.alpha_modifier3 };
+
+    // Both operations read the output of the stage before, which is only replaced once both ran
+    out += StringFromFormat("    // stage %d\n    {\n", stage);
+    out += "        vec3 rgb;\n        {\n";
+    for (int i = 0; i < GetNumInputs(op.color_op); i++) {
+        out += StringFromFormat("            vec3 in%d = ", i) + GetColorModifier(
+            color_modifiers[i], GetSource(config, color_sources[i], stage)) + ";\n";
+    }
+    out += "            rgb = " + GetOperation(op.color_op, false) + ";\n        }\n";
+    out += "        float a;\n        {\n";
+    for (int i = 0; i < GetNumInputs(op.alpha_op); i++) {
+        out += StringFromFormat("            float in%d = ", i) + GetAlphaModifier(
+            alpha_modifiers[i], GetSource(config, alpha_sources[i], stage)) + ";\n";
+    }
+    out += "            a = " + GetOperation(op.alpha_op, true) + ";\n        }\n";
+    out += StringFromFormat("        previous = clamp(vec4(rgb * %d.0, a * %d.0), 0.0, 1.0);\n"
+        "    }\n", 1 << scale.color_scale, 1 << scale.alpha_scale);
+}
+
+/**
+ * Gets the GLSL comparison of an alpha test function, between value and alpha_ref
+ * @param function Function
+ * @return Boolean expression, NULL for Always
+ */
+const char* GetAlphaTest(AlphaTestFunction function) {
+    switch (function) {
+    case AlphaTestFunction::Never:
+        return "false";
+
+    case AlphaTestFunction::Equal:
+        return "value == alpha_ref";
+
+    case AlphaTestFunction::NotEqual:
+        return "value != alpha_ref";
+
+    case AlphaTestFunction::LessThan:
+        return "value < alpha_ref";
+
+    case AlphaTestFunction::LessThanOrEqual:
+        return "value <= alpha_ref";
+
+    case AlphaTestFunction::GreaterThan:
+        return "value > alpha_ref";
+
+    case AlphaTestFunction::GreaterThanOrEqual:
+        return "value >= alpha_ref";
+
+    default:
+        return NULL;
+    }
+}
+
+} // namespace
+
+/**
+ * Decodes the fragment stage configuration currently set in Pica::g_regs
+ * @param config Receives the configuration
+ * @param texture0_enable Whether the draw samples texture 0
+ */
+void GetFragmentConfig(FragmentConfig* config, bool texture0_enable) {
+    memset(config, 0, sizeof(*config));
+    for (int stage = 0; stage < Pica::NUM_TEV_STAGES; stage++) {
+        config->tev_source[stage] = Pica::g_regs[Pica::TevStageRegister(stage,
+            Regs::TevStage0Source)] & SOURCE_FIELDS_MASK;
+        config->tev_operand[stage] = Pica::g_regs[Pica::TevStageRegister(stage,
+            Regs::TevStage0Operand)] & OPERAND_FIELDS_MASK;
+        config->tev_op[stage] = Pica::g_regs[Pica::TevStageRegister(stage,
+            Regs::TevStage0Op)] & OP_FIELDS_MASK;
+        config->tev_scale[stage] = Pica::g_regs[Pica::TevStageRegister(stage,
+            Regs::TevStage0Scale)] & SCALE_FIELDS_MASK;
+    }
+    const auto& alpha_test = Pica::g_regs.Get<Regs::AlphaTest>();
+    const AlphaTestFunction function = alpha_test.function;
+    config->alpha_test_function = (u32)(alpha_test.enable ? function : AlphaTestFunction::Always);
+    config->texture0_enable = texture0_enable;
+}
+
+/**
+ * Hashes a fragment stage configuration
+ * @param config Configuration
+ * @return Hash of the configuration
+ */
+u64 GetFragmentConfigHash(const FragmentConfig& config) {
+    return GetFastHash64((const u8*)&config, sizeof(config));
+}
+
+/**
+ * Generates the GLSL fragment shader of a fragment stage configuration
+ * @param config Configuration
+ * @return GLSL source of the shader
+ */
+std::string GenerateFragmentShader(const FragmentConfig& config) {
+    std::string out = g_fragment_header;
+    out += "void main() {\n";
+    if (config.texture0_enable) {
+        out += "    vec4 tex0_color = SampleTexture0();\n";
+    }
+    out += "    vec4 previous = vec4(0.0);\n";
+    for (int stage = 0; stage < Pica::NUM_TEV_STAGES; stage++) {
+        if (!IsPassthroughStage(config, stage)) {
+            AppendStage(config, stage, out);
+        }
+    }
+    const char* alpha_test = GetAlphaTest((AlphaTestFunction)config.alpha_test_function);
+    if (alpha_test != NULL) {
+        out += "    int value = int(previous.a * 255.0 + 0.5);\n";
+        out += StringFromFormat("    if (!(%s)) {\n        discard;\n    }\n", alpha_test);
+    }
+    out += "    out_color = previous;\n}\n";
+    return out;
+}
+
+/**
+ * Gets the GLSL fragment shader of every configuration, which reads it from the uniforms
+ * tev_stages, alpha_test_function and tex0_enabled
+ * @return GLSL source of the shader
+ */
+const char* GetUberFragmentShader() {
+    static const std::string source = std::string(g_fragment_header) + g_uber_fragment_body;
+    return source.c_str();
+}
+
+} // namespace
@@ -0,0 +1,62 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+
+/**
+ * GLSL fragment shaders of the PICA texture combiners (TEV) and alpha test. Every configuration
+ * gets a shader of its own, with the stages unrolled and the passthrough ones left out, while the
+ * ubershader reads the configuration from uniforms and can draw any of them unchanged.
+ */
+namespace ShaderGen {
+
+/**
+ * Fragment stage configuration a shader is generated for, the register fields shaders depend on.
+ * Zeroed first, so that it compares and hashes bytewise. Constant colors and the alpha test
+ * reference are uniforms of the shaders, they don't take a configuration of their own.
+ */
+struct FragmentConfig {
+    u32     tev_source[Pica::NUM_TEV_STAGES];   ///< TevStage0Source of every stage
+    u32     tev_operand[Pica::NUM_TEV_STAGES];  ///< TevStage0Operand of every stage
+    u32     tev_op[Pica::NUM_TEV_STAGES];       ///< TevStage0Op of every stage
+    u32     tev_scale[Pica::NUM_TEV_STAGES];    ///< TevStage0Scale of every stage
+    u32     alpha_test_function;                ///< Always if the alpha test is disabled
+    u32     texture0_enable;                    ///< Whether texture 0 is sampled
+};
+
+/**
+ * Decodes the fragment stage configuration currently set in Pica::g_regs
+ * @param config Receives the configuration
+ * @param texture0_enable Whether the draw samples texture 0
+ */
+void GetFragmentConfig(FragmentConfig* config, bool texture0_enable);
+
+/**
+ * Hashes a fragment stage configuration
+ * @param config Configuration
+ * @return Hash of the configuration
+ */
+u64 GetFragmentConfigHash(const FragmentConfig& config);
+
+/**
+ * Generates the GLSL fragment shader of a fragment stage configuration
+ * @param config Configuration
+ * @return GLSL source of the shader
+ */
+std::string GenerateFragmentShader(const FragmentConfig& config);
+
+/**
+ * Gets the GLSL fragment shader of every configuration, which reads it from the uniforms
+ * tev_stages, alpha_test_function and tex0_enabled
+ * @return GLSL source of the shader
+ */
+const char* GetUberFragmentShader();
+
+} // namespace
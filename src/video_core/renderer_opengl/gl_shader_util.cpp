@@ -0,0 +1,170 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/log.h"
+
+#include "video_core/shader_disk_cache.h"
+#include "video_core/video_core.h"
+#include "video_core/renderer_opengl/gl_shader_util.h"
+
+namespace ShaderUtil {
+
+namespace {
+
+VideoCore::ShaderDiskCache g_program_cache;     ///< Binaries of programs, after their format
+bool g_program_cache_enabled = false;           ///< Whether the program cache is open
+
+/**
+ * Gets the disk cache key of a program
+ * @param vertex_source GLSL source of the vertex shader
+ * @param fragment_source GLSL source of the fragment shader
+ * @return Hash of the sources and of the driver
+ */
+u64 GetProgramKey(const char* vertex_source, const char* fragment_source) {
+    std::string key = std::string(vertex_source) + fragment_source;
+    const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (int i = 0; i < 3; i++) {
+        key += (const char*)glGetString(driver_strings[i]);
+    }
+    return GetMurmurHash3((const u8*)key.data(), (int)key.size(), 0);
+}
+
+} // namespace
+
+/**
+ * Compiles a shader
+ * @param type Type of the shader
+ * @param source GLSL source of the shader
+ * @return Shader, 0 on failure
+ */
+GLuint CompileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        ERROR_LOG(RENDER, "failed to compile shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+/**
+ * Links a program, the attribute and fragment data locations must be bound before
+ * @param program Program, with its shaders attached
+ * @return True on success
+ */
+bool LinkProgram(GLuint program) {
+    glLinkProgram(program);
+    return CheckLinkStatus(program);
+}
+
+/**
+ * Gets whether a program linked, logging why not. Waits for the link if the driver runs it on a
+ * thread of its own.
+ * @param program Program, glLinkProgram was called on it
+ * @return True on success
+ */
+bool CheckLinkStatus(GLuint program) {
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        ERROR_LOG(RENDER, "failed to link shader program: %s", log);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Starts reading the disk cache of program binaries, if the driver gives them out. Binaries are
+ * specific to the driver, which is part of their keys.
+ */
+void OpenProgramCache() {
+    g_program_cache_enabled = VideoCore::g_shader_cache_enabled &&
+        GLEW_ARB_get_program_binary != 0;
+    if (g_program_cache_enabled) {
+        const std::string& directory = File::GetUserPath(D_SHADERCACHE_IDX);
+        File::CreateFullPath(directory);
+        g_program_cache.Open(directory + "gl_programs.cache");
+    }
+}
+
+/// Closes the disk cache of program binaries
+void CloseProgramCache() {
+    g_program_cache.Close();
+    g_program_cache_enabled = false;
+}
+
+/**
+ * Loads a program from the binary the disk cache has for its sources. On a miss the program is
+ * left to be compiled, set up so that its binary can be stored once linked.
+ * @param program Program, with nothing attached
+ * @param vertex_source GLSL source of the vertex shader
+ * @param fragment_source GLSL source of the fragment shader
+ * @return True if the program is linked
+ */
+bool LoadProgram(GLuint program, const char* vertex_source, const char* fragment_source) {
+    if (!g_program_cache_enabled) {
+        return false;
+    }
+
+    // Programs are needed as soon as they are created, so the cache file has to be read
+    std::vector<u8> value;
+    if (g_program_cache.Find(GetProgramKey(vertex_source, fragment_source), true, &value) &&
+        value.size() > sizeof(GLenum)) {
+        GLenum format;
+        memcpy(&format, value.data(), sizeof(format));
+        glProgramBinary(program, format, value.data() + sizeof(format),
+            (GLsizei)(value.size() - sizeof(format)));
+
+        // Drivers reject binaries of other versions, which the key may not tell apart
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_TRUE) {
+            return true;
+        }
+    }
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    return false;
+}
+
+/**
+ * Stores the binary of a program LoadProgram missed to the disk cache, once linked
+ * @param program Program
+ * @param vertex_source GLSL source of the vertex shader
+ * @param fragment_source GLSL source of the fragment shader
+ */
+void StoreProgram(GLuint program, const char* vertex_source, const char* fragment_source) {
+    if (!g_program_cache_enabled) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<u8> value(sizeof(GLenum) + length);
+    GLenum format;
+    glGetProgramBinary(program, length, NULL, &format, value.data() + sizeof(format));
+    memcpy(value.data(), &format, sizeof(format));
+    g_program_cache.Store(GetProgramKey(vertex_source, fragment_source), value.data(),
+        (u32)value.size());
+}
+
+} // namespace
@@ -0,0 +1,61 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <GL/glew.h>
+
+namespace ShaderUtil {
+
+/**
+ * Compiles a shader
+ * @param type Type of the shader
+ * @param source GLSL source of the shader
+ * @return Shader, 0 on failure
+ */
+GLuint CompileShader(GLenum type, const char* source);
+
+/**
+ * Links a program, the attribute and fragment data locations must be bound before
+ * @param program Program, with its shaders attached
+ * @return True on success
+ */
+bool LinkProgram(GLuint program);
+
+/**
+ * Gets whether a program linked, logging why not. Waits for the link if the driver runs it on a
+ * thread of its own.
+ * @param program Program, glLinkProgram was called on it
+ * @return True on success
+ */
+bool CheckLinkStatus(GLuint program);
+
+/**
+ * Starts reading the disk cache of program binaries, if the driver gives them out. Binaries are
+ * specific to the driver, which is part of their keys.
+ */
+void OpenProgramCache();
+
+/// Closes the disk cache of program binaries
+void CloseProgramCache();
+
+/**
+ * Loads a program from the binary the disk cache has for its sources. On a miss the program is
+ * left to be compiled, set up so that its binary can be stored once linked.
+ * @param program Program, with nothing attached
+ * @param vertex_source GLSL source of the vertex shader
+ * @param fragment_source GLSL source of the fragment shader
+ * @return True if the program is linked
+ */
+bool LoadProgram(GLuint program, const char* vertex_source, const char* fragment_source);
+
+/**
+ * Stores the binary of a program LoadProgram missed to the disk cache, once linked
+ * @param program Program
+ * @param vertex_source GLSL source of the vertex shader
+ * @param fragment_source GLSL source of the fragment shader
+ */
+void StoreProgram(GLuint program, const char* vertex_source, const char* fragment_source);
+
+} // namespace
@@ -0,0 +1,138 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include "common/log.h"
+
+#include "video_core/renderer_opengl/gl_upload_ring.h"
+
+UploadRing::UploadRing() : m_buffer(0), m_size(0), m_persistent(NULL), m_mapped(NULL),
+    m_offset(0), m_upload_size(0), m_fenced_offset(0) {
+    memset(m_fences, 0, sizeof(m_fences));
+}
+
+UploadRing::~UploadRing() {
+    for (int i = 0; i < NUM_SYNC_POINTS; i++) {
+        if (m_fences[i] != 0) {
+            glDeleteSync(m_fences[i]);
+        }
+    }
+    if (m_persistent != NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &m_buffer);
+}
+
+/**
+ * Creates the buffer, the OpenGL context must be current
+ * @param size Size of the ring in bytes
+ */
+void UploadRing::Init(GLsizeiptr size) {
+    // Sync points start on upload boundaries
+    m_size = size / (NUM_SYNC_POINTS * ALIGNMENT) * (NUM_SYNC_POINTS * ALIGNMENT);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    if (GLEW_ARB_buffer_storage) {
+        // Coherent, so the writes need no flush before the uploads reading them
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_size, NULL, flags);
+        m_persistent = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_size, flags);
+    }
+    if (m_persistent == NULL) {
+        if (GLEW_ARB_buffer_storage) {
+            // The storage is immutable, start over with a buffer of mutable storage
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &m_buffer);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+        }
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    INFO_LOG(RENDER, "texture uploads staged in %u KB, %s", (u32)(m_size / 1024),
+        m_persistent != NULL ? "mapped persistently" : "mapped per upload");
+}
+
+/**
+ * Gets memory of the ring to write an upload to, waiting for the uploads that last read it
+ * @param size Size of the upload in bytes
+ * @return Memory to write the upload to, NULL if it doesn't fit the ring
+ */
+u8* UploadRing::Map(GLsizeiptr size) {
+    if (m_buffer == 0 || size <= 0 || size > m_size) {
+        return NULL;
+    }
+    GLintptr offset = (m_offset + ALIGNMENT - 1) & ~(GLintptr)(ALIGNMENT - 1);
+    if (offset + size > m_size) {
+        FenceUpTo(m_size);
+        offset = 0;
+        m_fenced_offset = 0;
+    }
+
+    // Usually long done, the ring holds many frames of uploads
+    for (int i = GetSyncPoint(offset); i <= GetSyncPoint(offset + size - 1); i++) {
+        if (m_fences[i] != 0) {
+            glClientWaitSync(m_fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(m_fences[i]);
+            m_fences[i] = 0;
+        }
+    }
+    m_offset = offset;
+    m_upload_size = size;
+
+    if (m_persistent != NULL) {
+        m_mapped = m_persistent + offset;
+        return m_mapped;
+    }
+    // Unsynchronized, the fences tell when the part of the buffer is no longer read
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    m_mapped = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, GL_MAP_WRITE_BIT |
+        GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return m_mapped;
+}
+
+/**
+ * Ends writing the upload Map returned the memory of, and binds the buffer to
+ * GL_PIXEL_UNPACK_BUFFER for the upload to be issued from it
+ * @return Offset of the upload in the buffer, to pass as the pixels of glTex(Sub)Image
+ */
+const GLvoid* UploadRing::Unmap() {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    if (m_persistent == NULL) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    m_mapped = NULL;
+    const GLintptr offset = m_offset;
+    m_offset += m_upload_size;
+    return (const GLvoid*)offset;
+}
+
+/// Unbinds the buffer once the upload is issued, fencing the sync points moved past
+void UploadRing::EndUpload() {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    FenceUpTo(m_offset);
+}
+
+/**
+ * Fences the sync points from m_fenced_offset up to an offset, the uploads issued so far being the
+ * last to read them
+ * @param offset End of the fenced part, m_size to fence to the end of the ring
+ */
+void UploadRing::FenceUpTo(GLintptr offset) {
+    const int end = (offset >= m_size) ? NUM_SYNC_POINTS : GetSyncPoint(offset);
+    for (int i = GetSyncPoint(m_fenced_offset); i < end; i++) {
+        // Sync points skipped when wrapping still have the fences of the last time around
+        if (m_fences[i] != 0) {
+            glDeleteSync(m_fences[i]);
+        }
+        m_fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    if (end > GetSyncPoint(m_fenced_offset)) {
+        m_fenced_offset = (GLintptr)end * (m_size / NUM_SYNC_POINTS);
+    }
+}
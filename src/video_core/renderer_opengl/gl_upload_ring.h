@@ -0,0 +1,76 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "common/common.h"
+
+/**
+ * Ring of pixel unpack buffer memory texture uploads are staged in, so that the driver copies
+ * them to the host GPU asynchronously instead of from client memory before returning. With
+ * GL_ARB_buffer_storage the buffer is mapped once, persistently, otherwise each upload maps its
+ * part unsynchronized. Either way the ring is split into sync points fenced as the uploads move
+ * past them, and a part is only written again once the uploads that read it last are done.
+ */
+class UploadRing : NonCopyable {
+public:
+    UploadRing();
+    ~UploadRing();
+
+    /**
+     * Creates the buffer, the OpenGL context must be current
+     * @param size Size of the ring in bytes
+     */
+    void Init(GLsizeiptr size);
+
+    /**
+     * Gets memory of the ring to write an upload to, waiting for the uploads that last read it
+     * @param size Size of the upload in bytes
+     * @return Memory to write the upload to, NULL if it doesn't fit the ring
+     */
+    u8* Map(GLsizeiptr size);
+
+    /**
+     * Ends writing the upload Map returned the memory of, and binds the buffer to
+     * GL_PIXEL_UNPACK_BUFFER for the upload to be issued from it
+     * @return Offset of the upload in the buffer, to pass as the pixels of glTex(Sub)Image
+     */
+    const GLvoid* Unmap();
+
+    /// Unbinds the buffer once the upload is issued, fencing the sync points moved past
+    void EndUpload();
+
+private:
+    enum {
+        NUM_SYNC_POINTS = 16,
+        ALIGNMENT       = 256,              ///< Of the uploads, enough for any pixel format
+    };
+
+    /**
+     * Gets the sync point a byte of the ring belongs to
+     * @param offset Offset of the byte in the ring
+     * @return Index of the sync point
+     */
+    int GetSyncPoint(GLintptr offset) const {
+        return (int)(offset / (m_size / NUM_SYNC_POINTS));
+    }
+
+    /**
+     * Fences the sync points from m_fenced_offset up to an offset, the uploads issued so far
+     * being the last to read them
+     * @param offset End of the fenced part, m_size to fence to the end of the ring
+     */
+    void FenceUpTo(GLintptr offset);
+
+    GLuint      m_buffer;
+    GLsizeiptr  m_size;
+    u8*         m_persistent;                   ///< Mapping of the whole ring, NULL if none
+    u8*         m_mapped;                       ///< Mapping of the upload being written
+    GLintptr    m_offset;                       ///< Of the upload being written, or of the next
+    GLsizeiptr  m_upload_size;                  ///< Of the upload being written
+    GLintptr    m_fenced_offset;                ///< Sync points before it are fenced
+    GLsync      m_fences[NUM_SYNC_POINTS];      ///< Of the uploads last reading them, 0 for none
+};
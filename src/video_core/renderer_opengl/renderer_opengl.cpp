@@ -2,16 +2,117 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/hash.h"
+#include "common/profiler.h"
+
 #include "core/hw/gpu.h"
 
+#include "video_core/frame_dumper.h"
+#include "video_core/frame_golden.h"
+#include "video_core/frame_output.h"
+#include "video_core/rasterizer.h"
+#include "video_core/utils.h"
 #include "video_core/video_core.h"
+#include "video_core/renderer_opengl/gl_shader_util.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
 
 #include "core/mem_map.h"
 
+namespace {
+
+/**
+ * Draws the quad of a screen in the render window. Framebuffers are stored column by column, the
+ * bottom row of the screen first, and are uploaded as is so that the columns are texture rows:
+ * the texture coordinates are those of the screen swapped.
+ */
+const char* g_present_vertex_shader =
+    "#version 150\n"
+    "uniform vec4 rect;\n"
+    "uniform vec2 extent;\n"
+    "out vec2 texcoord;\n"
+    "void main() {\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);\n"
+    "    texcoord = corner.yx * extent;\n"
+    "}\n";
+
+const char* g_present_fragment_shader =
+    "#version 150\n"
+    "uniform sampler2D columns;\n"
+    "in vec2 texcoord;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "    color = texture(columns, texcoord);\n"
+    "}\n";
+
+Common::Profiler::Category g_profile_present("Present");
+
+/**
+ * Gets where a layout puts a screen, in pixels of the screens
+ * @param layout Arrangement of the screens
+ * @param screen 0 for the top screen, 1 for the bottom screen
+ * @param rect Receives the left, bottom, right and top edges of the screen
+ * @return False if the layout doesn't show the screen
+ */
+bool GetScreenRect(VideoCore::ScreenLayout layout, int screen, int rect[4]) {
+    const int top_width = VideoCore::kScreenTopWidth;
+    const int top_height = VideoCore::kScreenTopHeight;
+    const int bottom_width = VideoCore::kScreenBottomWidth;
+    const int bottom_height = VideoCore::kScreenBottomHeight;
+    const int top_rects[3][4] = {
+        { 0, bottom_height, top_width, bottom_height + top_height },
+        { 0, 0, top_width, top_height },
+        { 0, 0, top_width, top_height },
+    };
+    const int bottom_rects[2][4] = {
+        // Centered under the top screen
+        { (top_width - bottom_width) / 2, 0, (top_width + bottom_width) / 2, bottom_height },
+        { top_width, 0, top_width + bottom_width, bottom_height },
+    };
+
+    const int index = (int)layout;
+    if (screen == 0) {
+        memcpy(rect, top_rects[index], sizeof(top_rects[index]));
+        return true;
+    }
+    if (layout == VideoCore::ScreenLayout::SingleScreen) {
+        return false;
+    }
+    memcpy(rect, bottom_rects[index], sizeof(bottom_rects[index]));
+    return true;
+}
+
+/**
+ * Gets the size of the area a layout shows the screens in
+ * @param layout Arrangement of the screens
+ * @param width Receives the width in pixels of the screens
+ * @param height Receives the height in pixels of the screens
+ */
+void GetLayoutSize(VideoCore::ScreenLayout layout, int& width, int& height) {
+    width = 0;
+    height = 0;
+    for (int screen = 0; screen < 2; screen++) {
+        int rect[4];
+        if (GetScreenRect(layout, screen, rect)) {
+            width = std::max(width, rect[2]);
+            height = std::max(height, rect[3]);
+        }
+    }
+}
+
+} // namespace
+
 
 /// RendererOpenGL constructor
-RendererOpenGL::RendererOpenGL() {
+RendererOpenGL::RendererOpenGL() : m_rasterizer(NULL), m_resolution_scale(1),
+    m_present_program(0), m_present_uniform_rect(-1), m_present_uniform_extent(-1),
+    m_present_vao(0), m_xfb_buffers_enabled(false), m_write_frame(0), m_ready_frame(1),
+    m_present_frame(2), m_frame_ready(false), m_presenter_thread(nullptr),
+    m_presenter_quit(false) {
     memset(m_fbo, 0, sizeof(m_fbo));  
     memset(m_fbo_rbo, 0, sizeof(m_fbo_rbo));  
     memset(m_fbo_depth_buffers, 0, sizeof(m_fbo_depth_buffers));
@@ -24,50 +125,402 @@ RendererOpenGL::RendererOpenGL() {
 
     m_xfb_top = 0;
     m_xfb_bottom = 0;
+
+    memset(m_xfb_uploads, 0, sizeof(m_xfb_uploads));
+    m_xfb_uploads[0].format = GL_BGR;
+    m_xfb_uploads[0].flipped = m_xfb_top_flipped;
+    m_xfb_uploads[1].format = GL_RGB;
+    m_xfb_uploads[1].flipped = m_xfb_bottom_flipped;
 }
 
 /// RendererOpenGL destructor
 RendererOpenGL::~RendererOpenGL() {
+    ShutDown();
+    if (m_rasterizer != NULL) {
+        Pica::Rasterizer::g_hw_rasterizer = NULL;
+        delete m_rasterizer;
+    }
 }
 
 /// Swap buffers (render frame)
 void RendererOpenGL::SwapBuffers() {
+    Common::Profiler::Scope scope(g_profile_present);
+    const u32 addresses[2] = {
+        GPU::g_regs.framebuffer_top_left_1, GPU::g_regs.framebuffer_sub_left_1
+    };
+
+    // The LCDs scan out the framebuffers the display transfers wrote on the host GPU, at the
+    // resolution scale. Anything else is read from guest memory, as is everything being dumped or
+    // hashed.
+    GLuint screen_textures[2] = { 0, 0 };
+    const bool read_back = FrameDumper::IsDumping() || FrameGolden::IsActive();
+    if (m_rasterizer != NULL) {
+        const int widths[2] = { VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth };
+        for (int i = 0; i < 2; i++) {
+            if (m_present_program != 0) {
+                screen_textures[i] = m_rasterizer->GetScreenTexture(addresses[i],
+                    VideoCore::kScreenTopHeight, widths[i]);
+            }
+            if (screen_textures[i] == 0 || read_back) {
+                m_rasterizer->FlushRegion(addresses[i],
+                    widths[i] * VideoCore::kScreenTopHeight * 3);
+            }
+        }
+    }
+    if (read_back) {
+        const u8* top = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_top_left_1);
+        const u8* bottom = GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_sub_left_1);
+        FrameGolden::OnFrame(top, bottom);
+        FrameDumper::DumpFrame(top, bottom);
+    }
+
+    if (m_presenter_thread != nullptr) {
+        PublishFrame();
+        m_render_window->PollEvents();
+        return;
+    }
+
+    const u8* framebuffers[2];
+    bool changed[2];
+    for (int i = 0; i < 2; i++) {
+        framebuffers[i] = GPU::GetFramebufferPointer(addresses[i]);
+        changed[i] = framebuffers[i] != NULL && screen_textures[i] == 0 &&
+            CheckXFB(addresses[i], framebuffers[i], m_xfb_uploads[i]);
+    }
+
+    m_render_window->PollEvents();
+    PresentFrame(framebuffers, changed, screen_textures);
+}
+
+/**
+ * Shows a frame in the render window
+ * @param framebuffers Top and bottom screen framebuffers, NULL for one that can't be read
+ * @param changed Whether each framebuffer changed since it was last loaded
+ * @param screen_textures Rasterizer textures to show instead of the framebuffers, 0 for none
+ */
+void RendererOpenGL::PresentFrame(const u8* const framebuffers[2], const bool changed[2],
+    const GLuint screen_textures[2]) {
     m_render_window->MakeCurrent();
 
-    // EFB->XFB copy
-    // TODO(bunnei): This is a hack and does not belong here. The copy should be triggered by some 
-    // register write We're also treating both framebuffers as a single one in OpenGL.
-    common::Rect framebuffer_size(0, 0, m_resolution_width, m_resolution_height);
-    RenderXFB(framebuffer_size, framebuffer_size);
+    // Update textures with contents of XFB in RAM
+    for (int i = 0; i < 2; i++) {
+        XFBUpload& upload = m_xfb_uploads[i];
+        if (screen_textures[i] != 0) {
+            // Guest memory is stale, it has to be loaded again once shown
+            upload.address = 0;
+            upload.pending = false;
+        } else if (framebuffers[i] != NULL) {
+            LoadXFB(framebuffers[i], changed[i], upload);
+        }
+    }
 
-    // XFB->Window copy
-    RenderFramebuffer();
+    if (m_present_program != 0) {
+        DrawScreens(screen_textures);
+    } else {
+        // EFB->XFB copy
+        // TODO(bunnei): This is a hack and does not belong here. The copy should be triggered by
+        // some register write We're also treating both framebuffers as a single one in OpenGL.
+        common::Rect framebuffer_size(0, 0, m_resolution_width * m_resolution_scale,
+            m_resolution_height * m_resolution_scale);
+        RenderXFB(framebuffer_size, framebuffer_size);
+
+        // XFB->Window copy
+        RenderFramebuffer();
+    }
+
+    // Before the swap, which may wait for the host display
+    if (FrameOutput::IsActive()) {
+        OutputFrame(framebuffers, screen_textures);
+    }
 
     // Swap buffers
-    m_render_window->PollEvents();
     m_render_window->SwapBuffers();
 
     // Switch back to EFB and clear
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo[kFramebuffer_EFB]);
 }
 
+/**
+ * Copies the framebuffers into the mailbox, replacing the frame the presenter thread didn't take
+ * yet if there is one
+ */
+void RendererOpenGL::PublishFrame() {
+    const u32 addresses[2] = {
+        GPU::g_regs.framebuffer_top_left_1, GPU::g_regs.framebuffer_sub_left_1
+    };
+    Frame& frame = m_frames[m_write_frame];
+    for (int i = 0; i < 2; i++) {
+        const u8* framebuffer = GPU::GetFramebufferPointer(addresses[i]);
+        frame.valid[i] = framebuffer != NULL;
+        frame.changed[i] = false;
+        if (framebuffer != NULL) {
+            // Copied even when unchanged, the frame may replace one that changed
+            frame.changed[i] = CheckXFB(addresses[i], framebuffer, m_xfb_uploads[i]);
+            memcpy(frame.framebuffers[i], framebuffer, kXFBSize);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_frame_mutex);
+        if (m_frame_ready) {
+            // The changes of the frame dropped still have to be loaded
+            for (int i = 0; i < 2; i++) {
+                frame.changed[i] = frame.changed[i] || m_frames[m_ready_frame].changed[i];
+            }
+        }
+        std::swap(m_write_frame, m_ready_frame);
+        m_frame_ready = true;
+    }
+    m_frame_event.Set();
+}
+
+/**
+ * Presenter thread: shows the newest frame published, owning the OpenGL context. Swapping buffers
+ * blocks until the host display refreshes, frames published meanwhile are dropped but the
+ * emulation thread never waits.
+ */
+void RendererOpenGL::PresenterThreadFunc() {
+    Common::SetCurrentThreadName("Presenter");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_REALTIME);
+
+    for (;;) {
+        m_frame_event.Wait();
+        if (m_presenter_quit) {
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_frame_mutex);
+            if (!m_frame_ready) {
+                continue;
+            }
+            std::swap(m_present_frame, m_ready_frame);
+            m_frame_ready = false;
+        }
+
+        const Frame& frame = m_frames[m_present_frame];
+        const u8* framebuffers[2] = {
+            frame.valid[0] ? frame.framebuffers[0] : NULL,
+            frame.valid[1] ? frame.framebuffers[1] : NULL,
+        };
+        const GLuint screen_textures[2] = { 0, 0 };
+        PresentFrame(framebuffers, frame.changed, screen_textures);
+    }
+    m_render_window->DoneCurrent();
+}
+
 /**
  * Helper function to flip framebuffer from left-to-right to top-to-bottom
  * @param in Pointer to input raw framebuffer in V/RAM
  * @param out Pointer to output buffer with flipped framebuffer
- * @todo Early on hack... I'd like to find a more efficient way of doing this /bunnei
  */
 void RendererOpenGL::FlipFramebuffer(const u8* in, u8* out) {
-    int in_coord = 0;
-    for (int x = 0; x < VideoCore::kScreenTopWidth; x++) {
-        for (int y = VideoCore::kScreenTopHeight-1; y >= 0; y--) {
-            int out_coord = (x + y * VideoCore::kScreenTopWidth) * 3;
-            out[out_coord] = in[in_coord];
-            out[out_coord + 1] = in[in_coord + 1];
-            out[out_coord + 2] = in[in_coord + 2];
-            in_coord+=3;
+    VideoCore::RotateFramebuffer(in, out, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight);
+}
+
+/**
+ * Checks whether the guest changed a framebuffer since it was last checked
+ * @param address Physical address of the framebuffer
+ * @param framebuffer Raw framebuffer in V/RAM
+ * @param upload Upload state of the screen
+ * @return True if the framebuffer has to be loaded again
+ */
+bool RendererOpenGL::CheckXFB(u32 address, const u8* framebuffer, XFBUpload& upload) {
+    // Written pages are caught by the dirty bits, cleared before reading so that writes racing
+    // with the upload are seen next frame. The sampled hash catches writes bypassing them (HLE
+    // services writing through host pointers).
+    const u32 virtual_address = GPU::GetFramebufferVirtualAddress(address);
+    bool changed = address != upload.address ||
+        Memory::IsRangeDirty(virtual_address, kXFBSize, Memory::DIRTY_FRAMEBUFFER);
+    if (changed) {
+        Memory::ClearDirtyRange(virtual_address, kXFBSize, Memory::DIRTY_FRAMEBUFFER);
+    }
+    const u64 hash = GetHash64(framebuffer, kXFBSize, kXFBHashSamples);
+    changed = changed || hash != upload.hash;
+    upload.address = address;
+    upload.hash = hash;
+    return changed;
+}
+
+/**
+ * Loads a framebuffer into its XFB texture, rotated on the host GPU if it can
+ * @param framebuffer Raw framebuffer
+ * @param changed Whether the framebuffer changed since it was last loaded
+ * @param upload Upload state of the screen
+ */
+void RendererOpenGL::LoadXFB(const u8* framebuffer, bool changed, XFBUpload& upload) {
+    if (!m_xfb_buffers_enabled) {
+        if (!changed) {
+            return;
+        }
+        if (m_present_program != 0) {
+            UploadXFB(framebuffer, upload);
+        } else {
+            FlipFramebuffer(framebuffer, upload.flipped);
+            UploadXFB(upload.flipped, upload);
+        }
+        return;
+    }
+
+    if (!changed) {
+        // A delayed upload still has to happen once the guest stops changing the framebuffer
+        if (upload.pending) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffers[upload.buffer_index]);
+            UploadXFB(NULL, upload);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            upload.pending = false;
+        }
+        return;
+    }
+
+    // The buffer written now was last read by an upload kNumXFBBuffers - 1 frames ago, so the
+    // host GPU is usually done with it and mapping doesn't wait
+    const int previous = upload.buffer_index;
+    upload.buffer_index = (upload.buffer_index + 1) % kNumXFBBuffers;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffers[upload.buffer_index]);
+    u8* mapped = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, kXFBSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != NULL) {
+        if (m_present_program != 0) {
+            memcpy(mapped, framebuffer, kXFBSize);
+        } else {
+            // Rotated straight into the buffer, with no staging copy
+            FlipFramebuffer(framebuffer, mapped);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    if (VideoCore::g_frame_latency_enabled) {
+        // Display the framebuffer of the previous frame, its upload had a frame to complete
+        if (upload.pending) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffers[previous]);
+            UploadXFB(NULL, upload);
+        }
+        upload.pending = true;
+    } else {
+        UploadXFB(NULL, upload);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/**
+ * Uploads a framebuffer to its XFB texture, from the pixel buffer bound if there is one
+ * @param pixels Framebuffer, or offset in the pixel buffer bound
+ * @param upload Upload state of the screen
+ */
+void RendererOpenGL::UploadXFB(const GLvoid* pixels, const XFBUpload& upload) {
+    if (m_present_program == 0) {
+        glBindTexture(GL_TEXTURE_2D, upload.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VideoCore::kScreenTopWidth,
+            VideoCore::kScreenTopHeight, upload.format, GL_UNSIGNED_BYTE, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    // Upload unchanged, the columns become the rows of the texture
+    glBindTexture(GL_TEXTURE_2D, upload.columns);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VideoCore::kScreenTopHeight,
+        VideoCore::kScreenTopWidth, upload.format, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Draws the screens straight into the render window as textured quads, arranged by
+ * VideoCore::g_screen_layout and scaled to fit the window keeping their aspect ratio
+ * @param screen_textures Rasterizer textures to show instead of the uploaded framebuffers, 0 for
+ *                        none
+ */
+void RendererOpenGL::DrawScreens(const GLuint screen_textures[2]) {
+    const VideoCore::ScreenLayout layout = VideoCore::g_screen_layout;
+    const int window_width = m_render_window->GetClientAreaWidth();
+    const int window_height = m_render_window->GetClientAreaHeight();
+    int layout_width, layout_height;
+    GetLayoutSize(layout, layout_width, layout_height);
+    const float scale = std::min((float)window_width / layout_width,
+        (float)window_height / layout_height);
+    // Normalized device coordinates of a pixel of the screens, centered in the window
+    const float to_ndc_x = 2.0f * scale / window_width;
+    const float to_ndc_y = 2.0f * scale / window_height;
+    const float origin_x = -0.5f * layout_width * to_ndc_x;
+    const float origin_y = -0.5f * layout_height * to_ndc_y;
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_width, window_height);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(m_present_program);
+    glBindVertexArray(m_present_vao);
+    const int widths[2] = { VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth };
+    for (int i = 0; i < 2; i++) {
+        int rect[4];
+        if (!GetScreenRect(layout, i, rect)) {
+            continue;
+        }
+        glUniform4f(m_present_uniform_rect, origin_x + rect[0] * to_ndc_x,
+            origin_y + rect[1] * to_ndc_y, origin_x + rect[2] * to_ndc_x,
+            origin_y + rect[3] * to_ndc_y);
+
+        // Rasterizer textures are as wide as the screen, uploads as the top screen
+        if (screen_textures[i] != 0) {
+            glBindTexture(GL_TEXTURE_2D, screen_textures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glUniform2f(m_present_uniform_extent, 1.0f, 1.0f);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, m_xfb_uploads[i].columns);
+            glUniform2f(m_present_uniform_extent, 1.0f,
+                (float)widths[i] / VideoCore::kScreenTopWidth);
+        }
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        // The rasterizer samples its textures unfiltered
+        if (screen_textures[i] != 0) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         }
     }
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_DEPTH_TEST);
+
+    UpdateFramerate();
+    m_current_frame++;
+}
+
+/**
+ * Hands the frame just drawn to the frame output sink, as the textures it was drawn from
+ * @param framebuffers Top and bottom screen framebuffers, NULL for one that can't be read
+ * @param screen_textures Rasterizer textures shown instead of the framebuffers, 0 for none
+ */
+void RendererOpenGL::OutputFrame(const u8* const framebuffers[2],
+    const GLuint screen_textures[2]) {
+    const int widths[2] = { VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth };
+    FrameOutput::Frame frame;
+    frame.number = m_current_frame - 1;
+    for (int i = 0; i < 2; i++) {
+        FrameOutput::Screen& screen = frame.screens[i];
+        screen.width = widths[i];
+        screen.height = VideoCore::kScreenTopHeight;
+        screen.pixels = screen_textures[i] == 0 ? framebuffers[i] : NULL;
+
+        // Without the presentation program the textures are rotated, they're left out
+        screen.texture = 0;
+        screen.texture_extent = 1.0f;
+        screen.texture_scale = 1;
+        if (screen_textures[i] != 0) {
+            screen.texture = screen_textures[i];
+            screen.texture_scale = m_resolution_scale;
+        } else if (m_present_program != 0) {
+            screen.texture = m_xfb_uploads[i].columns;
+            screen.texture_extent = (float)widths[i] / VideoCore::kScreenTopWidth;
+        }
+    }
+    FrameOutput::OutputFrame(frame);
 }
 
 /** 
@@ -76,19 +529,12 @@ void RendererOpenGL::FlipFramebuffer(const u8* in, u8* out) {
  * @param dst_rect Destination rectangle in output framebuffer to copy to
  */
 void RendererOpenGL::RenderXFB(const common::Rect& src_rect, const common::Rect& dst_rect) {
-
-    FlipFramebuffer(GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_top_left_1), m_xfb_top_flipped);
-    FlipFramebuffer(GPU::GetFramebufferPointer(GPU::g_regs.framebuffer_sub_left_1), m_xfb_bottom_flipped);
+    // Blits are scissored, which would crop them at a resolution scale
+    glDisable(GL_SCISSOR_TEST);
 
     // Blit the top framebuffer
     // ------------------------
 
-    // Update textures with contents of XFB in RAM - top
-    glBindTexture(GL_TEXTURE_2D, m_xfb_texture_top);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight,
-        GL_BGR, GL_UNSIGNED_BYTE, m_xfb_top_flipped);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Render target is destination framebuffer
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo[kFramebuffer_VirtualXFB]);
     glViewport(0, 0, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight);
@@ -107,12 +553,6 @@ void RendererOpenGL::RenderXFB(const common::Rect& src_rect, const common::Rect&
     // Blit the bottom framebuffer
     // ---------------------------
 
-    // Update textures with contents of XFB in RAM - bottom
-    glBindTexture(GL_TEXTURE_2D, m_xfb_texture_bottom);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight,
-        GL_RGB, GL_UNSIGNED_BYTE, m_xfb_bottom_flipped);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Render target is destination framebuffer
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo[kFramebuffer_VirtualXFB]);
     glViewport(0, 0,
@@ -123,16 +563,36 @@ void RendererOpenGL::RenderXFB(const common::Rect& src_rect, const common::Rect&
     glReadBuffer(GL_COLOR_ATTACHMENT0);
 
     // Blit
-    int offset = (VideoCore::kScreenTopWidth - VideoCore::kScreenBottomWidth) / 2;
-    glBlitFramebuffer(0,0, VideoCore::kScreenBottomWidth, VideoCore::kScreenBottomHeight, 
-                      offset, VideoCore::kScreenBottomHeight, VideoCore::kScreenBottomWidth + offset, 0,
+    const int scale = m_resolution_scale;
+    const int width = VideoCore::kScreenBottomWidth * scale;
+    const int height = VideoCore::kScreenBottomHeight * scale;
+    int offset = (VideoCore::kScreenTopWidth - VideoCore::kScreenBottomWidth) / 2 * scale;
+    glBlitFramebuffer(0,0, width, height, offset, height, width + offset, 0,
                       GL_COLOR_BUFFER_BIT, GL_LINEAR);
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glEnable(GL_SCISSOR_TEST);
 }
 
 /// Initialize the FBO
 void RendererOpenGL::InitFramebuffer() {
+    if (m_present_program != 0) {
+        // Textures of the framebuffer columns, drawn straight to the window
+        for (int i = 0; i < 2; i++) {
+            glGenTextures(1, &m_xfb_uploads[i].columns);
+            glBindTexture(GL_TEXTURE_2D, m_xfb_uploads[i].columns);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, VideoCore::kScreenTopHeight,
+                VideoCore::kScreenTopWidth, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        InitXFBBuffers();
+        return;
+    }
+
     // TODO(bunnei): This should probably be implemented with the top screen and bottom screen as 
     // separate framebuffers
 
@@ -143,16 +603,21 @@ void RendererOpenGL::InitFramebuffer() {
     glGenRenderbuffers(kMaxFramebuffers, m_fbo_rbo); // Generate primary RBOs
     glGenRenderbuffers(kMaxFramebuffers, m_fbo_depth_buffers); // Generate primary depth buffer
 
+    // Everything up to the window is rendered at the resolution scale
+    const int scale = m_resolution_scale;
+    const int width = VideoCore::kScreenTopWidth * scale;
+    const int height = VideoCore::kScreenTopHeight * scale;
+
     for (int i = 0; i < kMaxFramebuffers; i++) {
         // Generate color buffer storage
         glBindRenderbuffer(GL_RENDERBUFFER, m_fbo_rbo[i]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, VideoCore::kScreenTopWidth, 
-            VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width,
+            (VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight) * scale);
 
         // Generate depth buffer storage
         glBindRenderbuffer(GL_RENDERBUFFER, m_fbo_depth_buffers[i]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, VideoCore::kScreenTopWidth, 
-            VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32, width,
+            (VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight) * scale);
 
         // Attach the buffers
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_fbo[i]);
@@ -180,13 +645,11 @@ void RendererOpenGL::InitFramebuffer() {
 
     // Alocate video memorry for XFB textures
     glBindTexture(GL_TEXTURE_2D, m_xfb_texture_top);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight,
-        0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     glBindTexture(GL_TEXTURE_2D, m_xfb_texture_bottom);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, VideoCore::kScreenTopWidth, VideoCore::kScreenTopHeight,
-        0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glBindTexture(GL_TEXTURE_2D, 0);
 
     // Create the FBO and attach color/depth textures
@@ -201,21 +664,87 @@ void RendererOpenGL::InitFramebuffer() {
     glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 
         m_xfb_texture_bottom, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    m_xfb_uploads[0].texture = m_xfb_texture_top;
+    m_xfb_uploads[1].texture = m_xfb_texture_bottom;
+    InitXFBBuffers();
+}
+
+/// Initialize the pixel buffers the framebuffers are uploaded through, if mapping them works
+void RendererOpenGL::InitXFBBuffers() {
+    // Mapping needs OpenGL 3.0
+    m_xfb_buffers_enabled = GLEW_VERSION_3_0 != 0;
+    if (m_xfb_buffers_enabled) {
+        for (int i = 0; i < 2; i++) {
+            glGenBuffers(kNumXFBBuffers, m_xfb_uploads[i].buffers);
+            for (int j = 0; j < kNumXFBBuffers; j++) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_xfb_uploads[i].buffers[j]);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, kXFBSize, NULL, GL_STREAM_DRAW);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+/// Initialize drawing the screens as textured quads, if the host GPU supports GLSL 1.50
+void RendererOpenGL::InitPresentation() {
+    if (!GLEW_VERSION_3_2) {
+        NOTICE_LOG(RENDER, "rotating framebuffers on the CPU");
+        return;
+    }
+    m_present_program = glCreateProgram();
+    if (!ShaderUtil::LoadProgram(m_present_program, g_present_vertex_shader,
+        g_present_fragment_shader)) {
+        const GLuint vertex_shader = ShaderUtil::CompileShader(GL_VERTEX_SHADER,
+            g_present_vertex_shader);
+        const GLuint fragment_shader = ShaderUtil::CompileShader(GL_FRAGMENT_SHADER,
+            g_present_fragment_shader);
+        bool linked = false;
+        if (vertex_shader != 0 && fragment_shader != 0) {
+            glAttachShader(m_present_program, vertex_shader);
+            glAttachShader(m_present_program, fragment_shader);
+            glBindFragDataLocation(m_present_program, 0, "color");
+            linked = ShaderUtil::LinkProgram(m_present_program);
+        }
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        if (!linked) {
+            glDeleteProgram(m_present_program);
+            m_present_program = 0;
+            return;
+        }
+        ShaderUtil::StoreProgram(m_present_program, g_present_vertex_shader,
+            g_present_fragment_shader);
+    }
+    glUseProgram(m_present_program);
+    glUniform1i(glGetUniformLocation(m_present_program, "columns"), 0);
+    m_present_uniform_rect = glGetUniformLocation(m_present_program, "rect");
+    m_present_uniform_extent = glGetUniformLocation(m_present_program, "extent");
+    glUseProgram(0);
+
+    // The quads are generated from the vertex IDs, but drawing still needs a vertex array object
+    glGenVertexArrays(1, &m_present_vao);
+    NOTICE_LOG(RENDER, "drawing framebuffers to the window on the host GPU");
 }
 
 /// Blit the FBO to the OpenGL default framebuffer
 void RendererOpenGL::RenderFramebuffer() {
-    // Render target is default framebuffer
+    // Render target is default framebuffer, filled whatever the size of the window
+    const int window_width = m_render_window->GetClientAreaWidth();
+    const int window_height = m_render_window->GetClientAreaHeight();
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-    glViewport(0, 0, m_resolution_width, m_resolution_height);
+    glViewport(0, 0, window_width, window_height);
 
     // Render source is our XFB
     glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo[kFramebuffer_VirtualXFB]);
     glReadBuffer(GL_COLOR_ATTACHMENT0);
 
     // Blit
-    glBlitFramebuffer(0, 0, m_resolution_width, m_resolution_height, 0, 0, m_resolution_width, 
-        m_resolution_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glDisable(GL_SCISSOR_TEST);
+    glBlitFramebuffer(0, 0, m_resolution_width * m_resolution_scale,
+        m_resolution_height * m_resolution_scale, 0, 0, window_width, window_height,
+        GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glEnable(GL_SCISSOR_TEST);
 
     // Update the FPS count
     UpdateFramerate();
@@ -272,11 +801,41 @@ void RendererOpenGL::Init() {
     // Initialize everything else
     // --------------------------
 
+    ShaderUtil::OpenProgramCache();
+    InitPresentation();
+
+    // Scaled output needs the framebuffers the rasterizer renders to be drawn on the host GPU
+    if (VideoCore::g_hw_renderer_enabled && m_present_program != 0) {
+        m_resolution_scale = std::min(std::max(VideoCore::g_resolution_scale, 1), 4);
+    }
     InitFramebuffer();
 
+    if (VideoCore::g_hw_renderer_enabled) {
+        m_rasterizer = new RasterizerOpenGL(m_resolution_scale);
+        m_rasterizer->Init();
+        Pica::Rasterizer::g_hw_rasterizer = m_rasterizer;
+    }
+    ShaderUtil::CloseProgramCache();
+
     NOTICE_LOG(RENDER, "GL_VERSION: %s\n", glGetString(GL_VERSION));
+
+    // The host GPU rasterizer draws from the emulation thread, which then has to own the context
+    if (VideoCore::g_presenter_enabled && m_rasterizer == NULL) {
+        m_render_window->DoneCurrent();
+        m_presenter_quit = false;
+        m_presenter_thread = new std::thread(&RendererOpenGL::PresenterThreadFunc, this);
+        NOTICE_LOG(RENDER, "presenter thread started");
+    }
 }
 
 /// Shutdown the renderer
 void RendererOpenGL::ShutDown() {
+    if (m_presenter_thread == nullptr) {
+        return;
+    }
+    m_presenter_quit = true;
+    m_frame_event.Set();
+    m_presenter_thread->join();
+    delete m_presenter_thread;
+    m_presenter_thread = nullptr;
 }
@@ -8,14 +8,23 @@
 
 #include "common/common.h"
 #include "common/emu_window.h"
+#include "common/thread.h"
 
 #include "video_core/renderer_base.h"
+#include "video_core/renderer_opengl/gl_rasterizer.h"
 
 
 class RendererOpenGL : virtual public RendererBase {
 public:
 
     static const int kMaxFramebuffers = 2;  ///< Maximum number of framebuffers
+    static const int kNumXFBBuffers = 3;    ///< Pixel buffers each framebuffer is uploaded through
+
+    /// Size of a framebuffer read from V/RAM in bytes
+    static const int kXFBSize = VideoCore::kScreenTopWidth * VideoCore::kScreenTopHeight * 3;
+
+    /// 64-bit words of a framebuffer hashed to catch writes the dirty page bits didn't see
+    static const u32 kXFBHashSamples = 1024;
 
     RendererOpenGL();
     ~RendererOpenGL();
@@ -47,6 +56,12 @@ private:
     /// Initialize the FBO
     void InitFramebuffer();
 
+    /// Initialize the pixel buffers the framebuffers are uploaded through, if mapping them works
+    void InitXFBBuffers();
+
+    /// Initialize drawing the screens as textured quads, if the host GPU supports GLSL 1.50
+    void InitPresentation();
+
     // Blit the FBO to the OpenGL default framebuffer
     void RenderFramebuffer();
 
@@ -57,12 +72,90 @@ private:
      * Helper function to flip framebuffer from left-to-right to top-to-bottom
      * @param in Pointer to input raw framebuffer in V/RAM
      * @param out Pointer to output buffer with flipped framebuffer
-     * @todo Early on hack... I'd like to find a more efficient way of doing this /bunnei
      */
     void FlipFramebuffer(const u8* in, u8* out);
 
+    /// Upload state of the framebuffer of a screen
+    struct XFBUpload {
+        GLenum  format;                     ///< OpenGL format of the framebuffer pixels
+        GLuint  texture;                    ///< XFB texture, when rotating on the CPU
+        GLuint  columns;                    ///< Framebuffer as uploaded, for the host GPU to draw
+        u8*     flipped;                    ///< Buffer to rotate the framebuffer in on the CPU
+        GLuint  buffers[kNumXFBBuffers];    ///< Pixel buffers the uploads go through, in rotation
+        int     buffer_index;               ///< Pixel buffer written last
+        bool    pending;                    ///< Pixel buffer written, upload delayed to next frame
+        u32     address;                    ///< Physical address of the framebuffer checked last
+        u64     hash;                       ///< Sampled hash of the framebuffer checked last
+    };
+
+    /// Frame handed from the emulation thread to the presenter thread
+    struct Frame {
+        u8      framebuffers[2][kXFBSize];  ///< Top and bottom screen, as read from V/RAM
+        bool    valid[2];                   ///< Whether each framebuffer could be read
+        bool    changed[2];                 ///< Whether each framebuffer changed since last shown
+    };
+
+    /**
+     * Shows a frame in the render window
+     * @param framebuffers Top and bottom screen framebuffers, NULL for one that can't be read
+     * @param changed Whether each framebuffer changed since it was last loaded
+     * @param screen_textures Rasterizer textures to show instead of the framebuffers, 0 for none
+     */
+    void PresentFrame(const u8* const framebuffers[2], const bool changed[2],
+        const GLuint screen_textures[2]);
+
+    /**
+     * Copies the framebuffers into the mailbox, replacing the frame the presenter thread didn't
+     * take yet if there is one
+     */
+    void PublishFrame();
+
+    /// Presenter thread: shows the newest frame published, owning the OpenGL context
+    void PresenterThreadFunc();
+
+    /**
+     * Checks whether the guest changed a framebuffer since it was last checked
+     * @param address Physical address of the framebuffer
+     * @param framebuffer Raw framebuffer in V/RAM
+     * @param upload Upload state of the screen
+     * @return True if the framebuffer has to be loaded again
+     */
+    bool CheckXFB(u32 address, const u8* framebuffer, XFBUpload& upload);
+
+    /**
+     * Loads a framebuffer into its XFB texture, rotated on the host GPU if it can
+     * @param framebuffer Raw framebuffer
+     * @param changed Whether the framebuffer changed since it was last loaded
+     * @param upload Upload state of the screen
+     */
+    void LoadXFB(const u8* framebuffer, bool changed, XFBUpload& upload);
+
+    /**
+     * Uploads a framebuffer to its XFB texture, from the pixel buffer bound if there is one
+     * @param pixels Framebuffer, or offset in the pixel buffer bound
+     * @param upload Upload state of the screen
+     */
+    void UploadXFB(const GLvoid* pixels, const XFBUpload& upload);
+
+    /**
+     * Draws the screens straight into the render window as textured quads, arranged by
+     * VideoCore::g_screen_layout and scaled to fit the window keeping their aspect ratio
+     * @param screen_textures Rasterizer textures to show instead of the uploaded framebuffers, 0
+     *                        for none
+     */
+    void DrawScreens(const GLuint screen_textures[2]);
+
+    /**
+     * Hands the frame just drawn to the frame output sink, as the textures it was drawn from
+     * @param framebuffers Top and bottom screen framebuffers, NULL for one that can't be read
+     * @param screen_textures Rasterizer textures shown instead of the framebuffers, 0 for none
+     */
+    void OutputFrame(const u8* const framebuffers[2], const GLuint screen_textures[2]);
+
 
     EmuWindow*  m_render_window;                    ///< Handle to render window
+    RasterizerOpenGL* m_rasterizer;                 ///< Renders PICA draws, NULL if disabled
+    int         m_resolution_scale;                 ///< Multiplier of the rendering resolution
     u32         m_last_mode;                        ///< Last render mode
 
     int m_resolution_width;                         ///< Current resolution width
@@ -81,8 +174,29 @@ private:
     GLuint m_xfb_top;                               ///< GL handle to top framebuffer
     GLuint m_xfb_bottom;                            ///< GL handle to bottom framebuffer
 
+    GLuint m_present_program;                       ///< Draws the screens, 0 to rotate and blit
+    GLint  m_present_uniform_rect;                  ///< them on the CPU
+    GLint  m_present_uniform_extent;
+    GLuint m_present_vao;
+
+    bool      m_xfb_buffers_enabled;                ///< Whether uploads go through pixel buffers
+    XFBUpload m_xfb_uploads[2];                     ///< Top and bottom screen uploads
+
+    // Mailbox of three frames, the emulation thread writes one while the presenter thread shows
+    // another and the third holds the newest frame complete:
+
+    Frame           m_frames[3];
+    int             m_write_frame;                  ///< Frame the emulation thread writes next
+    int             m_ready_frame;                  ///< Newest frame complete
+    int             m_present_frame;                ///< Frame the presenter thread shows
+    bool            m_frame_ready;                  ///< Whether m_ready_frame wasn't shown yet
+    std::mutex      m_frame_mutex;                  ///< Guards the mailbox indices
+    Common::Event   m_frame_event;                  ///< Signalled on a frame published or on quit
+    std::thread*    m_presenter_thread;             ///< NULL when presenting from SwapBuffers
+    volatile bool   m_presenter_quit;
+
     // "Flipped" framebuffers translate scanlines from native 3DS left-to-right to top-to-bottom
-    // as OpenGL expects them in a texture. There probably is a more efficient way of doing this:
+    // as OpenGL expects them in a texture, when neither the host GPU nor pixel buffers can:
 
     u8 m_xfb_top_flipped[VideoCore::kScreenTopWidth * VideoCore::kScreenTopWidth * 4]; 
     u8 m_xfb_bottom_flipped[VideoCore::kScreenTopWidth * VideoCore::kScreenTopWidth * 4];   
@@ -0,0 +1,133 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/log.h"
+
+#include "video_core/shader_disk_cache.h"
+
+namespace VideoCore {
+
+/// ShaderDiskCache constructor
+ShaderDiskCache::ShaderDiskCache() : m_reader_thread(nullptr), m_read(false) {
+}
+
+/// ShaderDiskCache destructor
+ShaderDiskCache::~ShaderDiskCache() {
+    Close();
+}
+
+/**
+ * Starts reading a cache file, which is created if it doesn't exist or is of another build
+ * @param filename Path of the file
+ */
+void ShaderDiskCache::Open(const std::string& filename) {
+    Close();
+    m_read = false;
+    m_reader_thread = new std::thread(&ShaderDiskCache::ReaderThreadFunc, this, filename);
+}
+
+/// Waits for the file to be read, closes it and drops the entries
+void ShaderDiskCache::Close() {
+    if (m_reader_thread == nullptr) {
+        return;
+    }
+    m_reader_thread->join();
+    delete m_reader_thread;
+    m_reader_thread = nullptr;
+
+    m_file.Close();
+    m_entries.clear();
+    m_pending.clear();
+}
+
+/**
+ * Finds a compiled shader
+ * @param key Hash of what the shader was compiled from
+ * @param wait Whether to wait for the file to be read before giving up
+ * @param value Receives the compiled shader
+ * @return True if found
+ */
+bool ShaderDiskCache::Find(u64 key, bool wait, std::vector<u8>* value) {
+    if (m_reader_thread == nullptr) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() && wait) {
+        m_read_condvar.wait(lock, [this] { return m_read; });
+        it = m_entries.find(key);
+    }
+    if (it == m_entries.end()) {
+        return false;
+    }
+    *value = it->second;
+    return true;
+}
+
+/**
+ * Appends a compiled shader to the file, unless it has one of the key already
+ * @param key Hash of what the shader was compiled from
+ * @param value Compiled shader
+ * @param size Size of the compiled shader in bytes
+ */
+void ShaderDiskCache::Store(u64 key, const u8* value, u32 size) {
+    if (m_reader_thread == nullptr) {
+        return;
+    }
+    std::vector<u8> entry(value, value + size);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_read) {
+        // The file is only written once read, it may hold the shader already
+        m_pending.push_back(std::make_pair(key, std::move(entry)));
+        return;
+    }
+    Append(key, entry);
+}
+
+/**
+ * Reads the file and appends the shaders stored meanwhile, on the reader thread
+ * @param filename Path of the file
+ */
+void ShaderDiskCache::ReaderThreadFunc(std::string filename) {
+    Common::SetCurrentThreadName("ShaderDiskCache");
+    Common::SetCurrentThreadPriority(Common::PRIORITY_LOW);
+
+    const u32 count = m_file.OpenAndRead(filename.c_str(), *this);
+    INFO_LOG(RENDER, "read %u shaders from %s", count, filename.c_str());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& it : m_pending) {
+        Append(it.first, it.second);
+    }
+    m_pending.clear();
+    m_read = true;
+    m_read_condvar.notify_all();
+}
+
+/**
+ * Takes an entry of the file being read, on the reader thread
+ * @param key Hash of what the shader was compiled from
+ * @param value Compiled shader
+ * @param value_size Size of the compiled shader in bytes
+ */
+void ShaderDiskCache::Read(const u64& key, const u8* value, u32 value_size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[key].assign(value, value + value_size);
+}
+
+/**
+ * Appends a shader to the file, the mutex must be held and the file read
+ * @param key Hash of what the shader was compiled from
+ * @param value Compiled shader, moved into the entries
+ */
+void ShaderDiskCache::Append(u64 key, std::vector<u8>& value) {
+    if (m_entries.count(key) != 0) {
+        return;
+    }
+    m_file.Append(key, value.data(), (u32)value.size());
+    m_file.Sync();
+    m_entries[key] = std::move(value);
+}
+
+} // namespace
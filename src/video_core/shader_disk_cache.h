@@ -0,0 +1,75 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.h"
+#include "common/linear_disk_cache.h"
+#include "common/thread.h"
+
+namespace VideoCore {
+
+/**
+ * Compiled shaders kept across runs in a LinearDiskCache file, by hash of what they were compiled
+ * from. The file is read on a thread of its own when opened: lookups made meanwhile see the
+ * entries read so far, or wait for the rest if asked to.
+ */
+class ShaderDiskCache : NonCopyable, LinearDiskCacheReader<u64, u8> {
+public:
+    ShaderDiskCache();
+    ~ShaderDiskCache();
+
+    /**
+     * Starts reading a cache file, which is created if it doesn't exist or is of another build
+     * @param filename Path of the file
+     */
+    void Open(const std::string& filename);
+
+    /// Waits for the file to be read, closes it and drops the entries
+    void Close();
+
+    /**
+     * Finds a compiled shader
+     * @param key Hash of what the shader was compiled from
+     * @param wait Whether to wait for the file to be read before giving up
+     * @param value Receives the compiled shader
+     * @return True if found
+     */
+    bool Find(u64 key, bool wait, std::vector<u8>* value);
+
+    /**
+     * Appends a compiled shader to the file, unless it has one of the key already
+     * @param key Hash of what the shader was compiled from
+     * @param value Compiled shader
+     * @param size Size of the compiled shader in bytes
+     */
+    void Store(u64 key, const u8* value, u32 size);
+
+private:
+
+    /// Reads the file and appends the shaders stored meanwhile, on the reader thread
+    void ReaderThreadFunc(std::string filename);
+
+    /// Takes an entry of the file being read, on the reader thread
+    void Read(const u64& key, const u8* value, u32 value_size);
+
+    /// Appends a shader to the file, the mutex must be held and the file read
+    void Append(u64 key, std::vector<u8>& value);
+
+    LinearDiskCache<u64, u8>    m_file;
+    std::thread*                m_reader_thread;    ///< NULL when closed
+    std::mutex                  m_mutex;            ///< Guards everything below
+    std::condition_variable     m_read_condvar;     ///< Notified when the file was read
+    bool                        m_read;             ///< Whether the file was read
+
+    std::unordered_map<u64, std::vector<u8>>        m_entries;  ///< Shaders in the file
+    std::vector<std::pair<u64, std::vector<u8>>>    m_pending;  ///< Stored while reading
+};
+
+} // namespace
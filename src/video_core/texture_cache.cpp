@@ -0,0 +1,183 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <list>
+#include <map>
+
+#include "common/hash.h"
+#include "common/log.h"
+#include "common/memory_tracker.h"
+#include "common/profiler.h"
+
+#include "core/mem_map.h"
+
+#include "video_core/texture_cache.h"
+#include "video_core/texture_decoder.h"
+#include "video_core/utils.h"
+
+namespace Pica {
+
+namespace TextureCache {
+
+namespace {
+
+/// Identity of a cached texture
+struct Key {
+    u32             address;
+    u32             width;
+    u32             height;
+    TextureFormat   format;
+
+    bool operator<(const Key& other) const {
+        if (address != other.address) {
+            return address < other.address;
+        }
+        if (width != other.width) {
+            return width < other.width;
+        }
+        if (height != other.height) {
+            return height < other.height;
+        }
+        return format < other.format;
+    }
+};
+
+struct Entry {
+    Key         key;
+    TexturePtr  texture;
+};
+
+typedef std::list<Entry> EntryList;
+
+EntryList                           g_entries;      ///< Most recently used first
+std::map<Key, EntryList::iterator>  g_entry_map;
+
+Common::Profiler::Category          g_profile_decode("Texture decode");
+
+/**
+ * Gets the size of the guest data of a texture
+ * @param key Texture
+ * @return Size in bytes
+ */
+u32 GetDataSize(const Key& key) {
+    return key.width * key.height *
+        Regs::Struct<Regs::Texture0Format>::GetTexelBits(key.format) / 8;
+}
+
+/**
+ * Decodes a guest texture
+ * @param key Texture
+ * @param data Guest texture data
+ * @param hash Hash of the guest texture data
+ * @return Decoded texture
+ */
+std::shared_ptr<Texture> Decode(const Key& key, const u8* data, u64 hash) {
+    Common::Profiler::Scope scope(g_profile_decode);
+    std::shared_ptr<Texture> texture(new Texture);
+    texture->address = key.address;
+    texture->width = key.width;
+    texture->height = key.height;
+    texture->format = key.format;
+    texture->hash = hash;
+    texture->host_texture = 0;
+    texture->texels.resize(key.width * key.height * 4);
+
+    TextureDecoder::Decode(data, key.width, key.height, key.format, texture->texels.data());
+    return texture;
+}
+
+/**
+ * Evicts the least recently used textures until the cache fits in the budget of
+ * Common::MemoryTracker::TAG_TEXTURE_CACHE, the most recently used one always stays
+ */
+void Evict() {
+    while (Common::MemoryTracker::IsOverBudget(Common::MemoryTracker::TAG_TEXTURE_CACHE) &&
+        g_entries.size() > 1) {
+
+        const Entry& entry = g_entries.back();
+        Common::MemoryTracker::Free(Common::MemoryTracker::TAG_TEXTURE_CACHE,
+            entry.texture->texels.size());
+        g_entry_map.erase(entry.key);
+        g_entries.pop_back();
+    }
+}
+
+} // namespace
+
+void (*g_release_host_texture)(u32 host_texture) = NULL;
+
+/// Texture destructor
+Texture::~Texture() {
+    if (host_texture != 0 && g_release_host_texture != NULL) {
+        g_release_host_texture(host_texture);
+    }
+}
+
+/**
+ * Gets a texture, decoding it if it isn't cached or its guest data changed
+ * @param address Physical address of the guest texture
+ * @param width Width in texels, a multiple of 8
+ * @param height Height in texels, a multiple of 8
+ * @param format Format of the guest texture
+ * @return Texture, which stays valid while referenced even if evicted. NULL if the texture isn't
+ *         in GPU memory.
+ */
+TexturePtr Get(u32 address, u32 width, u32 height, TextureFormat format) {
+    const Key key = { address, width, height, format };
+    const u32 size = GetDataSize(key);
+    const u8* data = VideoCore::GetPhysicalPointer(address);
+    if (data == NULL || size == 0 || VideoCore::GetPhysicalPointer(address + size - 1) == NULL) {
+        ERROR_LOG(GPU, "texture at invalid address 0x%08X", address);
+        return nullptr;
+    }
+    const u32 virtual_address = Memory::VirtualAddressFromPhysical(address);
+
+    auto it = g_entry_map.find(key);
+    if (it != g_entry_map.end()) {
+        Entry& entry = *it->second;
+        g_entries.splice(g_entries.begin(), g_entries, it->second);
+        if (!Memory::IsRangeDirty(virtual_address, size, Memory::DIRTY_TEXTURE)) {
+            return entry.texture;
+        }
+
+        // Cleared before hashing, so that writes racing with the hash are seen next time
+        Memory::ClearDirtyRange(virtual_address, size, Memory::DIRTY_TEXTURE);
+        const u64 hash = GetHash64(data, size, 0);
+        if (hash == entry.texture->hash) {
+            return entry.texture;
+        }
+
+        // Textures in use keep the old texels, the new ones replace them in the cache
+        const TexturePtr texture = Decode(key, data, hash);
+        Common::MemoryTracker::Adjust(Common::MemoryTracker::TAG_TEXTURE_CACHE,
+            (s64)texture->texels.size() - (s64)entry.texture->texels.size(), 0);
+        entry.texture = texture;
+        Evict();
+        return texture;
+    }
+
+    Memory::ClearDirtyRange(virtual_address, size, Memory::DIRTY_TEXTURE);
+
+    const Entry entry = { key, Decode(key, data, GetHash64(data, size, 0)) };
+    g_entries.push_front(entry);
+    g_entry_map[key] = g_entries.begin();
+    Common::MemoryTracker::Allocate(Common::MemoryTracker::TAG_TEXTURE_CACHE,
+        entry.texture->texels.size());
+    Evict();
+    return entry.texture;
+}
+
+/// Drops all cached textures
+void Clear() {
+    for (const Entry& entry : g_entries) {
+        Common::MemoryTracker::Free(Common::MemoryTracker::TAG_TEXTURE_CACHE,
+            entry.texture->texels.size());
+    }
+    g_entry_map.clear();
+    g_entries.clear();
+}
+
+} // namespace
+
+} // namespace
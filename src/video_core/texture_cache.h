@@ -0,0 +1,60 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/common.h"
+
+#include "video_core/pica.h"
+
+namespace Pica {
+
+/**
+ * Cache of guest textures decoded to RGBA8, keyed by address, size and format. Entries are
+ * revalidated when the dirty page bits of their guest memory are set, redecoded only if the
+ * content hash changed, and evicted least recently used first once the decoded texels exceed the
+ * budget of Common::MemoryTracker::TAG_TEXTURE_CACHE.
+ */
+namespace TextureCache {
+
+typedef Regs::Struct<Regs::Texture0Format>::Format TextureFormat;
+
+/// Decoded texture, immutable once returned by Get
+struct Texture : NonCopyable {
+    ~Texture();
+
+    u32             address;        ///< Physical address of the guest texture
+    u32             width;
+    u32             height;
+    TextureFormat   format;
+    u64             hash;           ///< Hash of the guest texture data
+    std::vector<u8> texels;         ///< RGBA8, bottom row first: row t is at coordinate t / height
+    mutable u32     host_texture;   ///< Host GPU copy owned by the hardware rasterizer, 0 for none
+};
+
+typedef std::shared_ptr<const Texture> TexturePtr;
+
+/// Releases the host GPU copy of a texture when the last reference to the texture goes away
+extern void (*g_release_host_texture)(u32 host_texture);
+
+/**
+ * Gets a texture, decoding it if it isn't cached or its guest data changed
+ * @param address Physical address of the guest texture
+ * @param width Width in texels, a multiple of 8
+ * @param height Height in texels, a multiple of 8
+ * @param format Format of the guest texture
+ * @return Texture, which stays valid while referenced even if evicted. NULL if the texture isn't
+ *         in GPU memory.
+ */
+TexturePtr Get(u32 address, u32 width, u32 height, TextureFormat format);
+
+/// Drops all cached textures
+void Clear();
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,375 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include "common/common.h"
+#include "common/thread_pool.h"
+
+#include "video_core/texture_decoder.h"
+#include "video_core/utils.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#endif
+
+namespace Pica {
+
+namespace TextureDecoder {
+
+namespace {
+
+enum {
+    TILE_TEXELS         = 64,
+    MIN_PARALLEL_TEXELS = 256 * 256,    ///< Smaller textures are decoded on the calling thread
+    PARALLEL_TILE_ROWS  = 4,            ///< Rows of tiles of a chunk on the thread pool
+};
+
+/// Index in the tile stored row by row, top row first, of each texel of a tile in Morton order
+const u8 kMortonToLinear[TILE_TEXELS] = {
+     0,  1,  8,  9,  2,  3, 10, 11, 16, 17, 24, 25, 18, 19, 26, 27,
+     4,  5, 12, 13,  6,  7, 14, 15, 20, 21, 28, 29, 22, 23, 30, 31,
+    32, 33, 40, 41, 34, 35, 42, 43, 48, 49, 56, 57, 50, 51, 58, 59,
+    36, 37, 44, 45, 38, 39, 46, 47, 52, 53, 60, 61, 54, 55, 62, 63,
+};
+
+// ETC1 intensity modifiers of each table codeword
+const int kETC1Modifiers[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// ETC1 3-bit signed color deltas of the differential mode
+const int kETC1Deltas[8] = { 0, 1, 2, 3, -4, -3, -2, -1 };
+
+inline u8 Clamp8(int value) {
+    return (u8)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+/**
+ * Decodes a 4x4 ETC1 block
+ * @param block Block, the 64-bit word little endian
+ * @param alpha Alpha block of ETC1A4, 4 bits per texel, NULL for opaque
+ * @param texels Receives the RGBA8 texels, rows from top to bottom
+ */
+void DecodeETC1Block(const u8* block, const u8* alpha, u8 texels[4][4][4]) {
+    u64 data;
+    memcpy(&data, block, sizeof(data));
+    u64 alpha_data = 0;
+    if (alpha != NULL) {
+        memcpy(&alpha_data, alpha, sizeof(alpha_data));
+    }
+
+    const u32 flip = (data >> 32) & 1;
+    const u32 differential = (data >> 33) & 1;
+    const u32 tables[2] = { (u32)(data >> 37) & 7, (u32)(data >> 34) & 7 };
+
+    int colors[2][3];
+    for (int c = 0; c < 3; c++) {
+        const int shift = 59 - c * 8;
+        if (differential) {
+            const int base = (int)(data >> shift) & 0x1F;
+            const int second = (base + kETC1Deltas[(data >> (shift - 3)) & 7]) & 0x1F;
+            colors[0][c] = (base << 3) | (base >> 2);
+            colors[1][c] = (second << 3) | (second >> 2);
+        } else {
+            colors[0][c] = ((int)(data >> (shift + 1)) & 0xF) * 17;
+            colors[1][c] = ((int)(data >> (shift - 3)) & 0xF) * 17;
+        }
+    }
+
+    // The four colors of each subblock, by the MSB and LSB of a texel index
+    u8 palette[2][4][4];
+    for (int subblock = 0; subblock < 2; subblock++) {
+        for (int n = 0; n < 4; n++) {
+            const int modifier = kETC1Modifiers[tables[subblock]][n & 1] * (n & 2 ? -1 : 1);
+            for (int c = 0; c < 3; c++) {
+                palette[subblock][n][c] = Clamp8(colors[subblock][c] + modifier);
+            }
+            palette[subblock][n][3] = 255;
+        }
+    }
+
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            // Texel indices are column major
+            const int index = x * 4 + y;
+            const int subblock = flip ? (y >= 2) : (x >= 2);
+            const int n = (((data >> (16 + index)) & 1) << 1) | ((data >> index) & 1);
+            memcpy(texels[y][x], palette[subblock][n], 4);
+            if (alpha != NULL) {
+                texels[y][x][3] = (u8)(((alpha_data >> (index * 4)) & 0xF) * 17);
+            }
+        }
+    }
+}
+
+/**
+ * Decodes a texel of a texture that isn't ETC1 compressed
+ * @param data Guest texture data
+ * @param index Index of the texel in the tiled texture
+ * @param format Format of the texture
+ * @param rgba Receives the texel
+ */
+inline void DecodeTexel(const u8* data, u32 index, TextureFormat format, u8* rgba) {
+    switch (format) {
+    // The color formats are stored like the color buffer formats of the same number
+    case TextureFormat::RGBA8:
+        VideoCore::DecodeColor(VideoCore::ColorFormat::RGBA8, data + index * 4, rgba);
+        return;
+
+    case TextureFormat::RGB8:
+        VideoCore::DecodeColor(VideoCore::ColorFormat::RGB8, data + index * 3, rgba);
+        return;
+
+    case TextureFormat::RGB5A1:
+    case TextureFormat::RGB565:
+    case TextureFormat::RGBA4:
+        VideoCore::DecodeColor((VideoCore::ColorFormat)format, data + index * 2, rgba);
+        return;
+
+    case TextureFormat::IA8:
+        rgba[0] = rgba[1] = rgba[2] = data[index * 2 + 1];
+        rgba[3] = data[index * 2];
+        return;
+
+    case TextureFormat::RG8:
+        rgba[0] = data[index * 2 + 1];
+        rgba[1] = data[index * 2];
+        rgba[2] = 0;
+        rgba[3] = 255;
+        return;
+
+    case TextureFormat::I8:
+        rgba[0] = rgba[1] = rgba[2] = data[index];
+        rgba[3] = 255;
+        return;
+
+    case TextureFormat::A8:
+        rgba[0] = rgba[1] = rgba[2] = 0;
+        rgba[3] = data[index];
+        return;
+
+    case TextureFormat::IA4:
+        rgba[0] = rgba[1] = rgba[2] = (data[index] >> 4) * 17;
+        rgba[3] = (data[index] & 0xF) * 17;
+        return;
+
+    case TextureFormat::I4:
+        rgba[0] = rgba[1] = rgba[2] = ((data[index / 2] >> ((index & 1) * 4)) & 0xF) * 17;
+        rgba[3] = 255;
+        return;
+
+    default:
+        rgba[0] = rgba[1] = rgba[2] = 0;
+        rgba[3] = ((data[index / 2] >> ((index & 1) * 4)) & 0xF) * 17;
+        return;
+    }
+}
+
+#ifdef _M_X64
+
+// Channels are expanded to 8 bits as VideoCore::DecodeColor does, c * 255 / 31 and c * 255 / 63
+// being (c * 1053) >> 7 and (c * 259 + 3) >> 6 over the range of c
+
+inline __m128i Expand5(__m128i c) {
+    return _mm_srli_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(1053)), 7);
+}
+
+inline __m128i Expand6(__m128i c) {
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(c, _mm_set1_epi16(259)),
+        _mm_set1_epi16(3)), 6);
+}
+
+inline __m128i Expand4(__m128i c) {
+    return _mm_mullo_epi16(c, _mm_set1_epi16(17));
+}
+
+/**
+ * Stores eight RGBA8 texels
+ * @param r Red of every texel, a 16-bit lane each, from 0 to 255
+ * @param g Green of every texel
+ * @param b Blue of every texel
+ * @param a Alpha of every texel
+ * @param texels Receives the texels
+ */
+inline void StoreTexels(__m128i r, __m128i g, __m128i b, __m128i a, u32* texels) {
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128((__m128i*)texels, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(texels + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+/**
+ * Decodes the texels of a tile with SSE2
+ * @param src Guest data of the tile
+ * @param format Format of the texture
+ * @param texels Receives the RGBA8 texels in Morton order
+ * @return False if the format has no SSE2 decoder
+ */
+bool DecodeTexelsSSE2(const u8* src, TextureFormat format, u32* texels) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi16(255);
+    const __m128i mask4 = _mm_set1_epi16(0xF);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask8 = _mm_set1_epi16(0xFF);
+
+    switch (format) {
+    case TextureFormat::RGBA8:
+        // ABGR in memory, reversing the bytes of every texel
+        for (int i = 0; i < TILE_TEXELS; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+            v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128((__m128i*)(texels + i), v);
+        }
+        return true;
+
+    case TextureFormat::RGB565:
+        for (int i = 0; i < TILE_TEXELS; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            StoreTexels(Expand5(_mm_srli_epi16(v, 11)),
+                Expand6(_mm_and_si128(_mm_srli_epi16(v, 5), _mm_set1_epi16(0x3F))),
+                Expand5(_mm_and_si128(v, mask5)), opaque, texels + i);
+        }
+        return true;
+
+    case TextureFormat::RGB5A1:
+        for (int i = 0; i < TILE_TEXELS; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            const __m128i a = _mm_sub_epi16(zero, _mm_and_si128(v, _mm_set1_epi16(1)));
+            StoreTexels(Expand5(_mm_srli_epi16(v, 11)),
+                Expand5(_mm_and_si128(_mm_srli_epi16(v, 6), mask5)),
+                Expand5(_mm_and_si128(_mm_srli_epi16(v, 1), mask5)), _mm_and_si128(a, mask8),
+                texels + i);
+        }
+        return true;
+
+    case TextureFormat::RGBA4:
+        for (int i = 0; i < TILE_TEXELS; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            StoreTexels(Expand4(_mm_srli_epi16(v, 12)),
+                Expand4(_mm_and_si128(_mm_srli_epi16(v, 8), mask4)),
+                Expand4(_mm_and_si128(_mm_srli_epi16(v, 4), mask4)),
+                Expand4(_mm_and_si128(v, mask4)), texels + i);
+        }
+        return true;
+
+    case TextureFormat::IA8:
+        for (int i = 0; i < TILE_TEXELS; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            const __m128i intensity = _mm_srli_epi16(v, 8);
+            StoreTexels(intensity, intensity, intensity, _mm_and_si128(v, mask8), texels + i);
+        }
+        return true;
+
+    case TextureFormat::RG8:
+        for (int i = 0; i < TILE_TEXELS; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+            StoreTexels(_mm_srli_epi16(v, 8), _mm_and_si128(v, mask8), zero, opaque, texels + i);
+        }
+        return true;
+
+    case TextureFormat::I8:
+    case TextureFormat::A8:
+        for (int i = 0; i < TILE_TEXELS; i += 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128i halves[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+            for (int half = 0; half < 2; half++) {
+                if (format == TextureFormat::I8) {
+                    StoreTexels(halves[half], halves[half], halves[half], opaque,
+                        texels + i + half * 8);
+                } else {
+                    StoreTexels(zero, zero, zero, halves[half], texels + i + half * 8);
+                }
+            }
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+#endif // _M_X64
+
+/**
+ * Decodes an 8x8 tile
+ * @param src Guest data of the tile
+ * @param format Format of the texture
+ * @param dst Decoded texel the top left texel of the tile goes to
+ * @param stride Bytes from a row of the decoded texture to the next, rows being bottom row first
+ */
+void DecodeTile(const u8* src, TextureFormat format, u8* dst, u32 stride) {
+    if (format == TextureFormat::ETC1 || format == TextureFormat::ETC1A4) {
+        // Four 4x4 blocks in Z order, each alpha block precedes its color block
+        const bool has_alpha = format == TextureFormat::ETC1A4;
+        const u32 block_size = has_alpha ? 16 : 8;
+        for (u32 n = 0; n < 4; n++, src += block_size) {
+            u8 decoded[4][4][4];
+            DecodeETC1Block(has_alpha ? src + 8 : src, has_alpha ? src : NULL, decoded);
+            u8* row = dst - (n >> 1) * 4 * stride + (n & 1) * 4 * 4;
+            for (u32 y = 0; y < 4; y++, row -= stride) {
+                memcpy(row, decoded[y], sizeof(decoded[y]));
+            }
+        }
+        return;
+    }
+
+    u32 texels[TILE_TEXELS];
+#ifdef _M_X64
+    if (!DecodeTexelsSSE2(src, format, texels))
+#endif
+    {
+        for (u32 i = 0; i < TILE_TEXELS; i++) {
+            DecodeTexel(src, i, format, (u8*)&texels[i]);
+        }
+    }
+
+    u32 tile[TILE_TEXELS];
+    for (u32 i = 0; i < TILE_TEXELS; i++) {
+        tile[kMortonToLinear[i]] = texels[i];
+    }
+    for (u32 y = 0; y < 8; y++, dst -= stride) {
+        memcpy(dst, tile + y * 8, 8 * sizeof(u32));
+    }
+}
+
+} // namespace
+
+/**
+ * Decodes a guest texture
+ * @param data Guest texture data, width * height * GetTexelBits(format) / 8 bytes
+ * @param width Width in texels, a multiple of 8
+ * @param height Height in texels, a multiple of 8
+ * @param format Format of the guest texture
+ * @param texels Receives the width * height RGBA8 texels, bottom row first
+ */
+void Decode(const u8* data, u32 width, u32 height, TextureFormat format, u8* texels) {
+    const u32 tile_size =
+        TILE_TEXELS * Regs::Struct<Regs::Texture0Format>::GetTexelBits(format) / 8;
+    const u32 tiles_per_row = width / 8;
+    const u32 stride = width * 4;
+
+    auto decode_tile_rows = [&](int begin, int end) {
+        for (int tile_y = begin; tile_y < end; tile_y++) {
+            const u8* src = data + tile_y * tiles_per_row * tile_size;
+            u8* dst = texels + (height - 1 - tile_y * 8) * stride;
+            for (u32 tile_x = 0; tile_x < tiles_per_row; tile_x++) {
+                DecodeTile(src + tile_x * tile_size, format, dst + tile_x * 8 * 4, stride);
+            }
+        }
+    };
+
+    const int num_tile_rows = height / 8;
+    if (width * height >= MIN_PARALLEL_TEXELS) {
+        Common::ThreadPool::GetShared().ParallelFor(0, num_tile_rows, PARALLEL_TILE_ROWS,
+            decode_tile_rows);
+    } else {
+        decode_tile_rows(0, num_tile_rows);
+    }
+}
+
+} // namespace
+
+} // namespace
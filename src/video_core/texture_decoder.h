@@ -0,0 +1,35 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+
+namespace Pica {
+
+/**
+ * Decoders of the guest texture formats to RGBA8. Guest textures store 8x8 tiles row by row with
+ * the texels of a tile in Morton order, so a tile is decoded as a run of 64 texels, on SSE2 hosts
+ * eight or sixteen at a time for the common formats, and then put in rows through a table. Large
+ * textures are decoded a few rows of tiles at a time on the shared thread pool.
+ */
+namespace TextureDecoder {
+
+typedef Regs::Struct<Regs::Texture0Format>::Format TextureFormat;
+
+/**
+ * Decodes a guest texture
+ * @param data Guest texture data, width * height * GetTexelBits(format) / 8 bytes
+ * @param width Width in texels, a multiple of 8
+ * @param height Height in texels, a multiple of 8
+ * @param format Format of the guest texture
+ * @param texels Receives the width * height RGBA8 texels, bottom row first
+ */
+void Decode(const u8* data, u32 width, u32 height, TextureFormat format, u8* texels);
+
+} // namespace
+
+} // namespace
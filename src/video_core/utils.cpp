@@ -5,9 +5,147 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
+#include "common/cpu_detect.h"
+
+#include "core/mem_map.h"
+
 #include "video_core/utils.h"
 
+#ifdef _M_X64
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit the instructions of an extension in functions targeting it
+#if defined(_M_X64) && defined(__GNUC__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
 namespace VideoCore {
+
+namespace {
+
+/// Rotates a framebuffer in 16x16 pixel blocks, which keep the columns read in the cache
+void RotateFramebufferScalar(const u8* in, u8* out, int width, int height) {
+    for (int block_x = 0; block_x < width; block_x += 16) {
+        for (int block_y = 0; block_y < height; block_y += 16) {
+            const int end_x = std::min(block_x + 16, width);
+            const int end_y = std::min(block_y + 16, height);
+            for (int y = block_y; y < end_y; y++) {
+                u8* dst = out + (y * width + block_x) * 3;
+                for (int x = block_x; x < end_x; x++, dst += 3) {
+                    const u8* src = in + (x * height + height - 1 - y) * 3;
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                }
+            }
+        }
+    }
+}
+
+#ifdef _M_X64
+
+/// Loads 4 24-bit pixels, without reading past them
+inline __m128i Load12(const u8* src) {
+    u32 last;
+    memcpy(&last, src + 8, sizeof(last));
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)src), _mm_cvtsi32_si128(last));
+}
+
+/// Stores the low 12 bytes of a vector
+inline void Store12(u8* dst, __m128i value) {
+    _mm_storel_epi64((__m128i*)dst, value);
+    const u32 last = (u32)_mm_cvtsi128_si32(_mm_srli_si128(value, 8));
+    memcpy(dst + 8, &last, sizeof(last));
+}
+
+/**
+ * Rotates a framebuffer in 4x4 pixel blocks, each expanded to 32-bit pixels, transposed and
+ * packed again. The screen size must be a multiple of 16.
+ */
+TARGET_SSSE3 void RotateFramebufferSSSE3(const u8* in, u8* out, int width, int height) {
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    for (int block_x = 0; block_x < width; block_x += 16) {
+        for (int block_i = 0; block_i < height; block_i += 16) {
+            for (int x = block_x; x < block_x + 16; x += 4) {
+                // Pixel i of a column is in row height - 1 - i
+                for (int i = block_i; i < block_i + 16; i += 4) {
+                    __m128i columns[4];
+                    for (int c = 0; c < 4; c++) {
+                        columns[c] = _mm_shuffle_epi8(Load12(in + ((x + c) * height + i) * 3),
+                            expand);
+                    }
+                    const __m128i t0 = _mm_unpacklo_epi32(columns[0], columns[1]);
+                    const __m128i t1 = _mm_unpacklo_epi32(columns[2], columns[3]);
+                    const __m128i t2 = _mm_unpackhi_epi32(columns[0], columns[1]);
+                    const __m128i t3 = _mm_unpackhi_epi32(columns[2], columns[3]);
+                    const __m128i rows[4] = {
+                        _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                        _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3),
+                    };
+                    for (int k = 0; k < 4; k++) {
+                        Store12(out + ((height - 1 - i - k) * width + x) * 3,
+                            _mm_shuffle_epi8(rows[k], pack));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Rotates a framebuffer like RotateFramebufferSSSE3, two 4x4 pixel blocks of a column at a time.
+ * The screen size must be a multiple of 16.
+ */
+TARGET_AVX2 void RotateFramebufferAVX2(const u8* in, u8* out, int width, int height) {
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    for (int block_x = 0; block_x < width; block_x += 16) {
+        for (int block_i = 0; block_i < height; block_i += 16) {
+            for (int x = block_x; x < block_x + 16; x += 4) {
+                // The low lanes hold pixels i to i+3, the high lanes pixels i+4 to i+7
+                for (int i = block_i; i < block_i + 16; i += 8) {
+                    __m256i columns[4];
+                    for (int c = 0; c < 4; c++) {
+                        const u8* src = in + ((x + c) * height + i) * 3;
+                        columns[c] = _mm256_shuffle_epi8(_mm256_inserti128_si256(
+                            _mm256_castsi128_si256(Load12(src)), Load12(src + 12), 1), expand);
+                    }
+                    const __m256i t0 = _mm256_unpacklo_epi32(columns[0], columns[1]);
+                    const __m256i t1 = _mm256_unpacklo_epi32(columns[2], columns[3]);
+                    const __m256i t2 = _mm256_unpackhi_epi32(columns[0], columns[1]);
+                    const __m256i t3 = _mm256_unpackhi_epi32(columns[2], columns[3]);
+                    const __m256i rows[4] = {
+                        _mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1),
+                        _mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3),
+                    };
+                    for (int k = 0; k < 4; k++) {
+                        const __m256i packed = _mm256_shuffle_epi8(rows[k], pack);
+                        Store12(out + ((height - 1 - i - k) * width + x) * 3,
+                            _mm256_castsi256_si128(packed));
+                        Store12(out + ((height - 5 - i - k) * width + x) * 3,
+                            _mm256_extracti128_si256(packed, 1));
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+} // namespace
 /**
  * Dumps a texture to TGA
  * @param filename String filename to dump texture to
@@ -19,7 +157,6 @@ namespace VideoCore {
 void DumpTGA(std::string filename, int width, int height, u8* raw_data) {
     TGAHeader hdr;
     FILE* fout;
-    u8 r, g, b;
 
     memset(&hdr, 0, sizeof(hdr));
     hdr.datatypecode = 2; // uncompressed RGB
@@ -30,15 +167,49 @@ void DumpTGA(std::string filename, int width, int height, u8* raw_data) {
     fout = fopen(filename.c_str(), "wb");
     fwrite(&hdr, sizeof(TGAHeader), 1, fout);
     for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            b = raw_data[(3 * (i * width)) + (3 * j) + 0];
-            g = raw_data[(3 * (i * width)) + (3 * j) + 1];
-            r = raw_data[(3 * (i * width)) + (3 * j) + 2];
-            putc(b, fout);
-            putc(g, fout);
-            putc(r, fout);
-        }
+        fwrite(raw_data + 3 * i * width, 3, width, fout);
     }
     fclose(fout);
 }
+
+/**
+ * Gets a host pointer to a physical address seen by the GPU
+ * @param address Physical address
+ * @return Host pointer, NULL if the address is neither in FCRAM nor in VRAM
+ */
+u8* GetPhysicalPointer(u32 address) {
+    if (address >= Memory::FCRAM_PADDR && address < Memory::FCRAM_PADDR_END) {
+        return Memory::GetPointer(Memory::VirtualAddressFromPhysical_FCRAM(address));
+    }
+    if (address >= Memory::VRAM_PADDR && address < Memory::VRAM_PADDR_END) {
+        return Memory::GetPointer(Memory::VirtualAddressFromPhysical_VRAM(address));
+    }
+    return NULL;
+}
+
+/**
+ * Rotates a framebuffer from the LCD scan order, columns of pixels from the bottom up, to rows of
+ * pixels from the top down
+ * @param in Framebuffer, width columns of height 24-bit pixels
+ * @param out Receives the rotated framebuffer, height rows of width 24-bit pixels
+ * @param width Width of the screen in pixels
+ * @param height Height of the screen in pixels
+ */
+void RotateFramebuffer(const u8* in, u8* out, int width, int height) {
+#ifdef _M_X64
+    // The vector kernels need the screen size to be a multiple of 16
+    if (width % 16 == 0 && height % 16 == 0) {
+        if (cpu_info.bAVX2) {
+            RotateFramebufferAVX2(in, out, width, height);
+            return;
+        }
+        if (cpu_info.bSSSE3) {
+            RotateFramebufferSSSE3(in, out, width, height);
+            return;
+        }
+    }
+#endif
+    RotateFramebufferScalar(in, out, width, height);
+}
+
 } // namespace
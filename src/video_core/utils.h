@@ -8,6 +8,10 @@
 
 #include "common/common_types.h"
 
+#include "core/hw/gpu.h"
+
+#include "video_core/pica.h"
+
 namespace FormatPrecision {
 
 /// Adjust RGBA8 color with RGBA6 precision
@@ -36,13 +40,15 @@ static inline u32 z24_with_z16(u32 src) {
 
 namespace VideoCore {
 
-/// Structure for the TGA texture format (for dumping)
+/// Structure for the TGA texture format (for dumping), packed as it is in the file
+#pragma pack(push, 1)
 struct TGAHeader {
     char  idlength;
     char  colourmaptype;
     char  datatypecode;
     short int colourmaporigin;
     short int colourmaplength;
+    char  colourmapdepth;
     short int x_origin;
     short int y_origin;
     short width;
@@ -50,6 +56,9 @@ struct TGAHeader {
     char  bitsperpixel;
     char  imagedescriptor;
 };
+#pragma pack(pop)
+
+static_assert(sizeof(TGAHeader) == 18, "TGAHeader has padding");
 
 /**
  * Dumps a texture to TGA
@@ -61,4 +70,167 @@ struct TGAHeader {
  */
 void DumpTGA(std::string filename, int width, int height, u8* raw_data);
 
+/**
+ * Gets a host pointer to a physical address seen by the GPU
+ * @param address Physical address
+ * @return Host pointer, NULL if the address is neither in FCRAM nor in VRAM
+ */
+u8* GetPhysicalPointer(u32 address);
+
+/**
+ * Rotates a framebuffer from the LCD scan order, columns of pixels from the bottom up, to rows of
+ * pixels from the top down
+ * @param in Framebuffer, width columns of height 24-bit pixels
+ * @param out Receives the rotated framebuffer, height rows of width 24-bit pixels
+ * @param width Width of the screen in pixels
+ * @param height Height of the screen in pixels
+ */
+void RotateFramebuffer(const u8* in, u8* out, int width, int height);
+
+/**
+ * Gets the offset of a pixel within the 8x8 tile it's in, GPU surfaces store the pixels of a
+ * tile in Morton order
+ * @param x X coordinate of the pixel in the tile, 0 to 7
+ * @param y Y coordinate of the pixel in the tile, 0 to 7
+ * @return Index of the pixel in the tile
+ */
+static inline u32 GetMortonOffset(u32 x, u32 y) {
+    return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) |
+        ((y & 4) << 3);
+}
+
+/**
+ * Gets the offset of a pixel in a tiled GPU surface, which stores 8x8 pixel tiles row by row
+ * @param x X coordinate of the pixel
+ * @param y Y coordinate of the pixel
+ * @param width Width of the surface in pixels, a multiple of 8
+ * @return Index of the pixel in the surface
+ */
+static inline u32 GetTiledPixelOffset(u32 x, u32 y, u32 width) {
+    return ((y >> 3) * (width >> 3) + (x >> 3)) * 64 + GetMortonOffset(x & 7, y & 7);
+}
+
+typedef Pica::Regs::Struct<Pica::Regs::ColorBufferFormat>::Format ColorFormat;
+
+/**
+ * Gets the size of a pixel of a color buffer
+ * @param format Pixel format
+ * @return Size in bytes
+ */
+static inline u32 GetPixelSize(ColorFormat format) {
+    return format == ColorFormat::RGBA8 ? 4 : format == ColorFormat::RGB8 ? 3 : 2;
+}
+
+/**
+ * Gets the color buffer format a display transfer format stores pixels like
+ * @param format Display transfer format
+ * @return Color buffer format
+ */
+static inline ColorFormat GetColorFormat(GPU::TransferFormat format) {
+    switch (format) {
+    case GPU::TransferFormat::RGB8:
+        return ColorFormat::RGB8;
+
+    case GPU::TransferFormat::RGB565:
+        return ColorFormat::RGB565;
+
+    case GPU::TransferFormat::RGB5A1:
+        return ColorFormat::RGB5A1;
+
+    case GPU::TransferFormat::RGBA4:
+        return ColorFormat::RGBA4;
+
+    default:
+        return ColorFormat::RGBA8;
+    }
+}
+
+/**
+ * Encodes a color in the pixel format of a color buffer
+ * @param format Pixel format
+ * @param rgba Color, 8 bits per component
+ * @param dst Receives the pixel, GetPixelSize bytes
+ */
+static inline void EncodeColor(ColorFormat format, const u8* rgba, u8* dst) {
+    const u32 r = rgba[0], g = rgba[1], b = rgba[2], a = rgba[3];
+
+    u16 value;
+    switch (format) {
+    case ColorFormat::RGBA8:
+        dst[0] = a;
+        dst[1] = b;
+        dst[2] = g;
+        dst[3] = r;
+        return;
+
+    case ColorFormat::RGB8:
+        dst[0] = b;
+        dst[1] = g;
+        dst[2] = r;
+        return;
+
+    case ColorFormat::RGB5A1:
+        value = (u16)(((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7));
+        break;
+
+    case ColorFormat::RGB565:
+        value = (u16)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        break;
+
+    default:
+        value = (u16)(((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4));
+        break;
+    }
+    memcpy(dst, &value, sizeof(value));
+}
+
+/**
+ * Decodes a pixel of a color buffer, components narrower than 8 bits are expanded to the full range
+ * @param format Pixel format
+ * @param src Pixel, GetPixelSize bytes
+ * @param rgba Receives the color, 8 bits per component
+ */
+static inline void DecodeColor(ColorFormat format, const u8* src, u8* rgba) {
+    u16 value;
+    switch (format) {
+    case ColorFormat::RGBA8:
+        rgba[0] = src[3];
+        rgba[1] = src[2];
+        rgba[2] = src[1];
+        rgba[3] = src[0];
+        return;
+
+    case ColorFormat::RGB8:
+        rgba[0] = src[2];
+        rgba[1] = src[1];
+        rgba[2] = src[0];
+        rgba[3] = 255;
+        return;
+
+    case ColorFormat::RGB5A1:
+        memcpy(&value, src, sizeof(value));
+        rgba[0] = (u8)(((value >> 11) & 0x1F) * 255 / 31);
+        rgba[1] = (u8)(((value >> 6) & 0x1F) * 255 / 31);
+        rgba[2] = (u8)(((value >> 1) & 0x1F) * 255 / 31);
+        rgba[3] = (value & 1) ? 255 : 0;
+        return;
+
+    case ColorFormat::RGB565:
+        memcpy(&value, src, sizeof(value));
+        rgba[0] = (u8)(((value >> 11) & 0x1F) * 255 / 31);
+        rgba[1] = (u8)(((value >> 5) & 0x3F) * 255 / 63);
+        rgba[2] = (u8)((value & 0x1F) * 255 / 31);
+        rgba[3] = 255;
+        return;
+
+    default:
+        memcpy(&value, src, sizeof(value));
+        rgba[0] = (u8)(((value >> 12) & 0xF) * 17);
+        rgba[1] = (u8)(((value >> 8) & 0xF) * 17);
+        rgba[2] = (u8)(((value >> 4) & 0xF) * 17);
+        rgba[3] = (u8)((value & 0xF) * 17);
+        return;
+    }
+}
+
 } // namespace
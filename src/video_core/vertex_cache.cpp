@@ -0,0 +1,82 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <vector>
+
+#include "video_core/vertex_cache.h"
+
+namespace Pica {
+
+namespace VertexCache {
+
+namespace {
+
+enum {
+    CACHE_SIZE      = 64,           ///< Entries of the cache, a power of two
+    NO_INDEX        = 0xFFFFFFFF,   ///< Tag of an empty entry, indices are at most 16 bits
+};
+
+/// Entry of the cache
+struct Entry {
+    u32 index;      ///< Vertex index cached, NO_INDEX for none
+    u32 unique;     ///< Number of the vertex among those shaded for the draw
+};
+
+// Buffers of the last draw, kept to reuse memory
+std::vector<u32>                        g_unique_indices;   ///< Index of every vertex shaded
+std::vector<u32>                        g_uniques;          ///< Vertex shaded for every index
+std::vector<Float4>                     g_attributes;
+std::vector<VertexShader::OutputVertex> g_shaded;
+
+} // namespace
+
+/**
+ * Shades the vertices of an indexed draw with the vertex shader set up in Pica::g_regs
+ * @param loader Loader of the vertex layout of the draw
+ * @param indices Vertex index of every vertex of the draw
+ * @param count Number of vertices of the draw
+ * @param output Receives count shaded vertices
+ */
+void ShadeIndexedVertices(const VertexLoader& loader, const u32* indices, u32 count,
+    VertexShader::OutputVertex* output) {
+    // Shader outputs depend on the uniforms of the draw, so the cache starts empty
+    Entry cache[CACHE_SIZE];
+    for (u32 i = 0; i < CACHE_SIZE; i++) {
+        cache[i].index = NO_INDEX;
+    }
+
+    if (g_uniques.size() < count) {
+        g_uniques.resize(count);
+    }
+    g_unique_indices.clear();
+    for (u32 n = 0; n < count; n++) {
+        Entry& entry = cache[indices[n] & (CACHE_SIZE - 1)];
+        if (entry.index != indices[n]) {
+            entry.index = indices[n];
+            entry.unique = (u32)g_unique_indices.size();
+            g_unique_indices.push_back(indices[n]);
+        }
+        g_uniques[n] = entry.unique;
+    }
+
+    const u32 num_unique = (u32)g_unique_indices.size();
+    const size_t size = num_unique * loader.GetNumAttributes();
+    if (g_attributes.size() < size) {
+        g_attributes.resize(size);
+    }
+    if (g_shaded.size() < num_unique) {
+        g_shaded.resize(num_unique);
+    }
+    loader.LoadVertexList(g_unique_indices.data(), num_unique, g_attributes.data());
+    VertexShader::RunShader(g_attributes.data(), loader.GetNumAttributes(), num_unique,
+        g_shaded.data());
+
+    for (u32 n = 0; n < count; n++) {
+        output[n] = g_shaded[g_uniques[n]];
+    }
+}
+
+} // namespace
+
+} // namespace
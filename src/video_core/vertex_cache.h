@@ -0,0 +1,34 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/vertex_loader.h"
+#include "video_core/vertex_shader.h"
+
+namespace Pica {
+
+/**
+ * Post-transform vertex cache of indexed draws. Indices go through a small direct-mapped cache
+ * keyed by vertex index, the ones it misses are loaded and shaded together, four at a time as
+ * the vertex shader runs, and the ones it hits reuse the vertex shaded for the same index. Meshes
+ * reference each vertex from several triangles close together, so a vertex is shaded about once.
+ */
+namespace VertexCache {
+
+/**
+ * Shades the vertices of an indexed draw with the vertex shader set up in Pica::g_regs
+ * @param loader Loader of the vertex layout of the draw
+ * @param indices Vertex index of every vertex of the draw
+ * @param count Number of vertices of the draw
+ * @param output Receives count shaded vertices
+ */
+void ShadeIndexedVertices(const VertexLoader& loader, const u32* indices, u32 count,
+    VertexShader::OutputVertex* output);
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,360 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <memory>
+#include <unordered_map>
+
+#include "common/common.h"
+#include "common/hash.h"
+#include "common/log.h"
+#include "common/math_util.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/utils.h"
+#include "video_core/vertex_loader.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#if _M_SSE >= 0x401
+#include <smmintrin.h>
+#endif
+#endif
+
+namespace Pica {
+
+namespace {
+
+typedef Regs::Struct<Regs::VertexDescriptor>::Format Format;
+
+/// Host type of the elements of each format
+template <Format format> struct ElementType;
+template <> struct ElementType<Format::BYTE>  { typedef s8  Type; };
+template <> struct ElementType<Format::UBYTE> { typedef u8  Type; };
+template <> struct ElementType<Format::SHORT> { typedef s16 Type; };
+template <> struct ElementType<Format::FLOAT> { typedef float Type; };
+
+/**
+ * Converts an attribute of any format and number of elements to the host format
+ * @param src Guest data of the attribute
+ * @param dst Attribute to write, missing elements default to (0, 0, 0, 1)
+ */
+template <Format format, int num_elements>
+void Decode(const u8* src, Float4& dst) {
+    typedef typename ElementType<format>::Type T;
+    T elements[num_elements];
+    memcpy(elements, src, sizeof(elements));
+
+    dst.x = (float)elements[0];
+    dst.y = num_elements > 1 ? (float)elements[num_elements > 1 ? 1 : 0] : 0.0f;
+    dst.z = num_elements > 2 ? (float)elements[num_elements > 2 ? 2 : 0] : 0.0f;
+    dst.w = num_elements > 3 ? (float)elements[num_elements > 3 ? 3 : 0] : 1.0f;
+}
+
+#ifdef _M_X64
+
+// Four element attributes convert all elements at once
+
+template <>
+void Decode<Format::FLOAT, 4>(const u8* src, Float4& dst) {
+    _mm_storeu_ps(&dst.x, _mm_loadu_ps((const float*)src));
+}
+
+template <>
+void Decode<Format::SHORT, 4>(const u8* src, Float4& dst) {
+    const __m128i data = _mm_loadl_epi64((const __m128i*)src);
+#if _M_SSE >= 0x401
+    const __m128i ints = _mm_cvtepi16_epi32(data);
+#else
+    const __m128i ints = _mm_srai_epi32(_mm_unpacklo_epi16(data, data), 16);
+#endif
+    _mm_storeu_ps(&dst.x, _mm_cvtepi32_ps(ints));
+}
+
+template <>
+void Decode<Format::BYTE, 4>(const u8* src, Float4& dst) {
+    u32 word;
+    memcpy(&word, src, sizeof(word));
+    const __m128i data = _mm_cvtsi32_si128(word);
+#if _M_SSE >= 0x401
+    const __m128i ints = _mm_cvtepi8_epi32(data);
+#else
+    const __m128i shorts = _mm_unpacklo_epi8(data, data);
+    const __m128i ints = _mm_srai_epi32(_mm_unpacklo_epi16(shorts, shorts), 24);
+#endif
+    _mm_storeu_ps(&dst.x, _mm_cvtepi32_ps(ints));
+}
+
+template <>
+void Decode<Format::UBYTE, 4>(const u8* src, Float4& dst) {
+    u32 word;
+    memcpy(&word, src, sizeof(word));
+    const __m128i data = _mm_cvtsi32_si128(word);
+#if _M_SSE >= 0x401
+    const __m128i ints = _mm_cvtepu8_epi32(data);
+#else
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ints = _mm_unpacklo_epi16(_mm_unpacklo_epi8(data, zero), zero);
+#endif
+    _mm_storeu_ps(&dst.x, _mm_cvtepi32_ps(ints));
+}
+
+#endif // _M_X64
+
+/// Decoder for each format and number of elements
+template <Format format>
+struct Decoders {
+    static void (*const table[4])(const u8*, Float4&);
+};
+
+template <Format format>
+void (*const Decoders<format>::table[4])(const u8*, Float4&) = {
+    &Decode<format, 1>, &Decode<format, 2>, &Decode<format, 3>, &Decode<format, 4>,
+};
+
+/// Size in bytes of an element of each format
+const u32 kElementSizes[4] = { 1, 1, 2, 4 };
+
+/**
+ * Gets the decoder of an attribute format
+ * @param format Format of the elements
+ * @param num_elements Number of elements, 1 to 4
+ */
+void (*GetDecoder(Format format, u32 num_elements))(const u8*, Float4&) {
+    switch (format) {
+    case Format::BYTE:  return Decoders<Format::BYTE>::table[num_elements - 1];
+    case Format::UBYTE: return Decoders<Format::UBYTE>::table[num_elements - 1];
+    case Format::SHORT: return Decoders<Format::SHORT>::table[num_elements - 1];
+    default:            return Decoders<Format::FLOAT>::table[num_elements - 1];
+    }
+}
+
+/**
+ * Copies the layout registers currently in Pica::g_regs
+ * @param key Receives VertexLoader::KEY_SIZE words
+ */
+void GetKey(u32* key) {
+    key[0] = g_regs[Regs::VertexDescriptor];
+    key[1] = g_regs[static_cast<Regs::Id>(Regs::VertexDescriptor + 1)];
+    for (int i = 0; i < VertexLoader::NUM_ARRAYS; i++) {
+        key[2 + 2 * i] = g_regs[VertexAttributeInfo0(i)];
+        key[3 + 2 * i] = g_regs[VertexAttributeInfo1(i)];
+    }
+}
+
+typedef std::unordered_map<u64, std::unique_ptr<VertexLoader>> LoaderCache;
+
+LoaderCache         g_loader_cache;         ///< Loaders by hash of their layout registers
+const VertexLoader* g_last_loader = NULL;   ///< Loader returned by the last Get()
+u32                 g_last_key[VertexLoader::KEY_SIZE];
+
+} // namespace
+
+/**
+ * Builds the loader of a layout
+ * @param key Layout registers, VertexLoader::KEY_SIZE words
+ */
+VertexLoader::VertexLoader(const u32* key) : num_arrays(0), num_elements(0), num_defaults(0) {
+    memcpy(this->key, key, sizeof(this->key));
+
+    Regs::Struct<Regs::VertexDescriptor> descriptor;
+    descriptor.hex = key[0] | ((u64)key[1] << 32);
+    num_attributes = (int)descriptor.num_attributes + 1;
+
+    bool loaded[MAX_ATTRIBUTES] = {};
+
+    for (int i = 0; i < NUM_ARRAYS; i++) {
+        Regs::Struct<Regs::VertexAttributeInfo0> info;
+        info.hex = key[2 + 2 * i] | ((u64)key[3 + 2 * i] << 32);
+        if (info.component_count == 0) {
+            continue;
+        }
+
+        Array& array = arrays[num_arrays];
+        array.index = i;
+        array.stride = (u32)info.byte_count;
+        array.first_element = num_elements;
+
+        // Attributes are aligned to the size of their elements within a vertex
+        u32 offset = 0;
+        for (u32 c = 0; c < info.component_count; c++) {
+            const u32 component = info.GetComponent(c);
+            if (component >= MAX_ATTRIBUTES) {
+                offset += (component - MAX_ATTRIBUTES + 1) * 4;
+                continue;
+            }
+            const Format format = descriptor.GetFormat(component);
+            const u32 num = descriptor.GetNumElements(component);
+            const u32 element_size = kElementSizes[(u32)format];
+            offset = ROUND_UP(offset, element_size);
+
+            if ((int)component < num_attributes && !descriptor.IsFixed(component) &&
+                num_elements < MAX_ATTRIBUTES) {
+                Element& element = elements[num_elements++];
+                element.offset = offset;
+                element.attribute = component;
+                element.decode = GetDecoder(format, num);
+                loaded[component] = true;
+            }
+            offset += element_size * num;
+        }
+
+        array.num_elements = num_elements - array.first_element;
+        if (array.num_elements != 0) {
+            num_arrays++;
+        }
+    }
+
+    for (int i = 0; i < num_attributes; i++) {
+        if (!loaded[i]) {
+            defaults[num_defaults++] = i;
+        }
+    }
+}
+
+/**
+ * Gets the loader for the layout currently in Pica::g_regs, creating it if needed
+ * @return Loader, valid until ClearCache is called
+ */
+const VertexLoader& VertexLoader::Get() {
+    // Consecutive draws almost always use the same layout, left as is when no register of it
+    // changed
+    using namespace CommandProcessor;
+    if (TakeDirtyGroups(DIRTY_VERTEX_ARRAYS) == 0 && g_last_loader != NULL) {
+        return *g_last_loader;
+    }
+
+    u32 key[KEY_SIZE];
+    GetKey(key);
+    if (g_last_loader != NULL && memcmp(key, g_last_key, sizeof(key)) == 0) {
+        return *g_last_loader;
+    }
+
+    const u64 hash = GetFastHash64((const u8*)key, sizeof(key));
+    std::unique_ptr<VertexLoader>& loader = g_loader_cache[hash];
+    if (loader == nullptr || memcmp(key, loader->key, sizeof(key)) != 0) {
+        loader.reset(new VertexLoader(key));
+    }
+    memcpy(g_last_key, key, sizeof(key));
+    g_last_loader = loader.get();
+    return *loader;
+}
+
+/// Destroys all cached loaders
+void VertexLoader::ClearCache() {
+    g_loader_cache.clear();
+    g_last_loader = NULL;
+}
+
+/**
+ * Sets up host pointers to the vertex arrays currently set in Pica::g_regs
+ * @param bases Receives a pointer per array, NULL if the array isn't in guest memory
+ */
+void VertexLoader::GetArrayPointers(const u8** bases) const {
+    const u32 base_address = g_regs.Get<Regs::VertexArrayBaseAddr>().GetPhysicalAddress();
+    for (int i = 0; i < num_arrays; i++) {
+        const u32 address = base_address + g_regs[VertexAttributeOffset(arrays[i].index)];
+        bases[i] = VideoCore::GetPhysicalPointer(address);
+        if (bases[i] == NULL) {
+            ERROR_LOG(GPU, "vertex array at invalid address 0x%08X", address);
+        }
+    }
+}
+
+/**
+ * Sets an attribute to its default value
+ * @param attribute Attribute to set
+ */
+static inline void LoadDefault(Float4& attribute) {
+    attribute.x = attribute.y = attribute.z = 0.0f;
+    attribute.w = 1.0f;
+}
+
+/**
+ * Loads vertices
+ * @param index Functor returning the index of the n-th vertex to load
+ * @param count Number of vertices
+ * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+ */
+template <typename IndexFunc>
+void VertexLoader::Load(IndexFunc index, u32 count, Float4* output) const {
+    const u8* bases[NUM_ARRAYS];
+    GetArrayPointers(bases);
+
+    for (u32 v = 0; v < count; v++) {
+        Float4* vertex = output + v * num_attributes;
+        for (int i = 0; i < num_defaults; i++) {
+            LoadDefault(vertex[defaults[i]]);
+        }
+
+        const u32 vertex_index = index(v);
+        for (int i = 0; i < num_arrays; i++) {
+            const Array& array = arrays[i];
+            const Element* element = &elements[array.first_element];
+            if (bases[i] == NULL) {
+                for (u32 e = 0; e < array.num_elements; e++, element++) {
+                    LoadDefault(vertex[element->attribute]);
+                }
+                continue;
+            }
+            const u8* src = bases[i] + vertex_index * array.stride;
+            for (u32 e = 0; e < array.num_elements; e++, element++) {
+                element->decode(src + element->offset, vertex[element->attribute]);
+            }
+        }
+    }
+}
+
+/**
+ * Loads consecutive vertices from the vertex arrays currently set in Pica::g_regs
+ * @param first Index of the first vertex
+ * @param count Number of vertices
+ * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+ */
+void VertexLoader::LoadVertices(u32 first, u32 count, Float4* output) const {
+    Load([first](u32 n) { return first + n; }, count, output);
+}
+
+/**
+ * Loads the vertices at a list of indices from the vertex arrays currently set in Pica::g_regs
+ * @param indices Index of every vertex to load
+ * @param count Number of vertices
+ * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+ */
+void VertexLoader::LoadVertexList(const u32* indices, u32 count, Float4* output) const {
+    Load([indices](u32 n) { return indices[n]; }, count, output);
+}
+
+/**
+ * Reads the index array currently set in Pica::g_regs
+ * @param count Number of indices
+ * @param indices Receives the indices
+ * @return False if the index array isn't in guest memory
+ */
+bool VertexLoader::LoadIndices(u32 count, u32* indices) {
+    const auto& config = g_regs.Get<Regs::IndexArrayConfig>();
+    const u32 address = g_regs.Get<Regs::VertexArrayBaseAddr>().GetPhysicalAddress() +
+        config.offset;
+    const u8* data = VideoCore::GetPhysicalPointer(address);
+    if (data == NULL) {
+        ERROR_LOG(GPU, "index array at invalid address 0x%08X", address);
+        return false;
+    }
+
+    if (config.format) {
+        for (u32 n = 0; n < count; n++) {
+            u16 index;
+            memcpy(&index, data + 2 * n, 2);
+            indices[n] = index;
+        }
+    } else {
+        for (u32 n = 0; n < count; n++) {
+            indices[n] = data[n];
+        }
+    }
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,124 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+#include "video_core/pica.h"
+
+namespace Pica {
+
+/// Vertex attribute in the host format
+struct Float4 {
+    float x, y, z, w;
+};
+
+/**
+ * Converts the guest vertex arrays described by the vertex attribute registers to host float4
+ * attributes. The register layout is turned into a list of steps once, each step calling a
+ * routine specialised for one element format and count, and the result is cached by the
+ * contents of the layout registers.
+ */
+class VertexLoader : NonCopyable {
+public:
+    enum {
+        MAX_ATTRIBUTES  = 12,
+        NUM_ARRAYS      = 12,
+        KEY_SIZE        = 2 + 2 * NUM_ARRAYS,   ///< Register words describing the layout
+    };
+
+    /**
+     * Gets the loader for the layout currently in Pica::g_regs, creating it if needed
+     * @return Loader, valid until ClearCache is called
+     */
+    static const VertexLoader& Get();
+
+    /// Destroys all cached loaders
+    static void ClearCache();
+
+    /// Number of attributes of each vertex
+    int GetNumAttributes() const {
+        return num_attributes;
+    }
+
+    /**
+     * Loads consecutive vertices from the vertex arrays currently set in Pica::g_regs
+     * @param first Index of the first vertex
+     * @param count Number of vertices
+     * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+     */
+    void LoadVertices(u32 first, u32 count, Float4* output) const;
+
+    /**
+     * Loads the vertices at a list of indices from the vertex arrays currently set in
+     * Pica::g_regs
+     * @param indices Index of every vertex to load
+     * @param count Number of vertices
+     * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+     */
+    void LoadVertexList(const u32* indices, u32 count, Float4* output) const;
+
+    /**
+     * Reads the index array currently set in Pica::g_regs
+     * @param count Number of indices
+     * @param indices Receives the indices
+     * @return False if the index array isn't in guest memory
+     */
+    static bool LoadIndices(u32 count, u32* indices);
+
+private:
+    /**
+     * Converts one attribute to the host format
+     * @param src Guest data of the attribute
+     * @param dst Attribute to write, missing elements default to (0, 0, 0, 1)
+     */
+    typedef void (*DecodeFunc)(const u8* src, Float4& dst);
+
+    /// Attribute loaded from a vertex array
+    struct Element {
+        u32         offset;     ///< Offset of the attribute within a vertex of the array
+        u32         attribute;  ///< Index of the attribute
+        DecodeFunc  decode;
+    };
+
+    /// Vertex array used by the layout
+    struct Array {
+        u32 index;              ///< Index of the array in the vertex attribute registers
+        u32 stride;             ///< Size of one vertex
+        u32 first_element;      ///< First entry of the array in elements
+        u32 num_elements;
+    };
+
+    explicit VertexLoader(const u32* key);
+
+    /**
+     * Sets up host pointers to the vertex arrays currently set in Pica::g_regs
+     * @param bases Receives a pointer per array, NULL if the array isn't in guest memory
+     */
+    void GetArrayPointers(const u8** bases) const;
+
+    /**
+     * Loads vertices
+     * @param index Functor returning the index of the n-th vertex to load
+     * @param count Number of vertices
+     * @param output Receives count * GetNumAttributes() attributes, vertex by vertex
+     */
+    template <typename IndexFunc>
+    void Load(IndexFunc index, u32 count, Float4* output) const;
+
+    u32     key[KEY_SIZE];  ///< Layout registers the loader was built for
+    int     num_attributes;
+
+    Array   arrays[NUM_ARRAYS];
+    int     num_arrays;
+
+    Element elements[MAX_ATTRIBUTES];
+    int     num_elements;
+
+    u32     defaults[MAX_ATTRIBUTES];   ///< Attributes that aren't loaded from any array
+    int     num_defaults;
+};
+
+} // namespace
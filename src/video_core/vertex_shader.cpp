@@ -0,0 +1,1108 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+#include "common/common.h"
+#include "common/bit_field.h"
+#include "common/chunk_file.h"
+#include "common/hash.h"
+#include "common/log.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_jit.h"
+
+#ifdef _M_X64
+#include <emmintrin.h>
+#if _M_SSE >= 0x401
+#include <smmintrin.h>
+#endif
+#endif
+
+namespace Pica {
+
+namespace VertexShader {
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lanes: one float of each of four vertices
+
+#ifdef _M_X64
+
+typedef __m128 Lanes;
+
+inline Lanes Splat(float f)                 { return _mm_set1_ps(f); }
+inline Lanes Load(const float* f)           { return _mm_loadu_ps(f); }
+inline void Store(float* f, Lanes a)        { _mm_storeu_ps(f, a); }
+inline Lanes Add(Lanes a, Lanes b)          { return _mm_add_ps(a, b); }
+inline Lanes Sub(Lanes a, Lanes b)          { return _mm_sub_ps(a, b); }
+inline Lanes Mul(Lanes a, Lanes b)          { return _mm_mul_ps(a, b); }
+inline Lanes Div(Lanes a, Lanes b)          { return _mm_div_ps(a, b); }
+inline Lanes Sqrt(Lanes a)                  { return _mm_sqrt_ps(a); }
+inline Lanes Min(Lanes a, Lanes b)          { return _mm_min_ps(a, b); }
+inline Lanes Max(Lanes a, Lanes b)          { return _mm_max_ps(a, b); }
+inline Lanes And(Lanes a, Lanes b)          { return _mm_and_ps(a, b); }
+inline Lanes AndNot(Lanes a, Lanes b)       { return _mm_andnot_ps(a, b); }    ///< ~a & b
+inline Lanes Or(Lanes a, Lanes b)           { return _mm_or_ps(a, b); }
+inline Lanes Xor(Lanes a, Lanes b)          { return _mm_xor_ps(a, b); }
+inline Lanes CmpEq(Lanes a, Lanes b)        { return _mm_cmpeq_ps(a, b); }
+inline Lanes CmpNe(Lanes a, Lanes b)        { return _mm_cmpneq_ps(a, b); }
+inline Lanes CmpLt(Lanes a, Lanes b)        { return _mm_cmplt_ps(a, b); }
+inline Lanes CmpLe(Lanes a, Lanes b)        { return _mm_cmple_ps(a, b); }
+inline Lanes CmpGt(Lanes a, Lanes b)        { return _mm_cmpgt_ps(a, b); }
+inline Lanes CmpGe(Lanes a, Lanes b)        { return _mm_cmpge_ps(a, b); }
+inline int LaneMask(Lanes a)                { return _mm_movemask_ps(a); }
+
+inline Lanes AllLanes() {
+    return _mm_castsi128_ps(_mm_set1_epi32(-1));
+}
+
+inline Lanes Floor(Lanes a) {
+#if _M_SSE >= 0x401
+    return _mm_floor_ps(a);
+#else
+    // Truncate, then step down the negative non-integers. Values of 2^23 and up are integers
+    // already and are kept as they are, which also covers those out of the int range.
+    const Lanes truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    const Lanes floored = Sub(truncated, And(CmpGt(truncated, a), Splat(1.0f)));
+    const Lanes big = CmpGe(AndNot(Splat(-0.0f), a), Splat(8388608.0f));
+    return Or(And(big, a), AndNot(big, floored));
+#endif
+}
+
+/// Transposes four rows into four columns
+inline void Transpose(Lanes& a, Lanes& b, Lanes& c, Lanes& d) {
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+}
+
+#else
+
+union Lanes {
+    float f[4];
+    u32 u[4];
+};
+
+#define LANES_OP(name, expr) \
+    inline Lanes name(Lanes a, Lanes b) { Lanes r; for (int l = 0; l < 4; l++) { expr; } return r; }
+#define LANES_CMP(name, op) \
+    LANES_OP(name, r.u[l] = (a.f[l] op b.f[l]) ? 0xFFFFFFFF : 0)
+
+LANES_OP(Add, r.f[l] = a.f[l] + b.f[l])
+LANES_OP(Sub, r.f[l] = a.f[l] - b.f[l])
+LANES_OP(Mul, r.f[l] = a.f[l] * b.f[l])
+LANES_OP(Div, r.f[l] = a.f[l] / b.f[l])
+LANES_OP(Min, r.f[l] = a.f[l] < b.f[l] ? a.f[l] : b.f[l])
+LANES_OP(Max, r.f[l] = a.f[l] > b.f[l] ? a.f[l] : b.f[l])
+LANES_OP(And, r.u[l] = a.u[l] & b.u[l])
+LANES_OP(AndNot, r.u[l] = ~a.u[l] & b.u[l])
+LANES_OP(Or, r.u[l] = a.u[l] | b.u[l])
+LANES_OP(Xor, r.u[l] = a.u[l] ^ b.u[l])
+LANES_CMP(CmpEq, ==)
+LANES_CMP(CmpNe, !=)
+LANES_CMP(CmpLt, <)
+LANES_CMP(CmpLe, <=)
+LANES_CMP(CmpGt, >)
+LANES_CMP(CmpGe, >=)
+
+#undef LANES_CMP
+#undef LANES_OP
+
+inline Lanes Splat(float f) {
+    Lanes r;
+    r.f[0] = r.f[1] = r.f[2] = r.f[3] = f;
+    return r;
+}
+
+inline Lanes Load(const float* f) {
+    Lanes r;
+    memcpy(r.f, f, sizeof(r.f));
+    return r;
+}
+
+inline void Store(float* f, Lanes a) {
+    memcpy(f, a.f, sizeof(a.f));
+}
+
+inline Lanes Sqrt(Lanes a) {
+    for (int l = 0; l < 4; l++) {
+        a.f[l] = sqrtf(a.f[l]);
+    }
+    return a;
+}
+
+inline Lanes Floor(Lanes a) {
+    for (int l = 0; l < 4; l++) {
+        a.f[l] = floorf(a.f[l]);
+    }
+    return a;
+}
+
+inline int LaneMask(Lanes a) {
+    return (a.u[0] >> 31) | ((a.u[1] >> 31) << 1) | ((a.u[2] >> 31) << 2) | ((a.u[3] >> 31) << 3);
+}
+
+inline Lanes AllLanes() {
+    Lanes r;
+    r.u[0] = r.u[1] = r.u[2] = r.u[3] = 0xFFFFFFFF;
+    return r;
+}
+
+/// Transposes four rows into four columns
+inline void Transpose(Lanes& a, Lanes& b, Lanes& c, Lanes& d) {
+    Lanes* rows[4] = { &a, &b, &c, &d };
+    for (int i = 0; i < 4; i++) {
+        for (int j = i + 1; j < 4; j++) {
+            std::swap(rows[i]->f[j], rows[j]->f[i]);
+        }
+    }
+}
+
+#endif // _M_X64
+
+/// Selects a where mask is set and b elsewhere
+inline Lanes Select(Lanes mask, Lanes a, Lanes b) {
+    return Or(And(mask, a), AndNot(mask, b));
+}
+
+/// Applies a scalar function to each lane
+template <typename Func>
+inline Lanes ForEachLane(Lanes a, Func func) {
+    float f[4];
+    Store(f, a);
+    for (int l = 0; l < 4; l++) {
+        f[l] = func(f[l]);
+    }
+    return Load(f);
+}
+
+/// Four component register of four vertices, one vertex per lane
+struct Vec4 {
+    Lanes c[4];
+};
+
+static_assert(sizeof(Vec4) == 64, "register layout differs from the one of compiled shaders");
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shader memory
+
+/// Encoding of shader instructions
+union Instruction {
+    u32 hex;
+
+    BitField<26, 6, u32> opcode;
+
+    // Arithmetic with a 7 bit first and a 5 bit second source
+    union {
+        BitField< 0, 7, u32> operand_desc_id;
+        BitField< 7, 5, u32> src2;
+        BitField<12, 7, u32> src1;
+        BitField<19, 2, u32> address_register_index;
+        BitField<21, 5, u32> dest;
+    } common;
+
+    // Inverted arithmetic: src1 is the 5 bit source and src2 the 7 bit one
+    union {
+        BitField< 0, 7, u32> operand_desc_id;
+        BitField< 7, 7, u32> src2;
+        BitField<14, 5, u32> src1;
+        BitField<19, 2, u32> address_register_index;
+        BitField<21, 5, u32> dest;
+    } inverted;
+
+    union {
+        BitField< 0, 7, u32> operand_desc_id;
+        BitField< 7, 5, u32> src2;
+        BitField<12, 7, u32> src1;
+        BitField<19, 2, u32> address_register_index;
+        BitField<21, 3, u32> compare_y;
+        BitField<24, 3, u32> compare_x;
+    } compare;
+
+    // MAD: the 7 bit source is src2, MADI: src3
+    union {
+        BitField< 0, 5, u32> operand_desc_id;
+        BitField< 5, 5, u32> src3;
+        BitField<10, 7, u32> src2;
+        BitField< 5, 7, u32> src3i;
+        BitField<12, 5, u32> src2i;
+        BitField<17, 5, u32> src1;
+        BitField<22, 2, u32> address_register_index;
+        BitField<24, 5, u32> dest;
+    } mad;
+
+    union {
+        BitField< 0, 8, u32> num_instructions;
+        BitField<10, 12, u32> dest_offset;
+        BitField<22, 2, u32> condition;
+        BitField<22, 4, u32> bool_uniform_id;
+        BitField<22, 2, u32> int_uniform_id;
+        BitField<24, 1, u32> refy;
+        BitField<25, 1, u32> refx;
+    } flow_control;
+};
+
+/// Encoding of operand descriptors
+union OperandDescriptor {
+    u32 hex;
+
+    BitField< 0, 4, u32> dest_mask;     // bit 3 is x, bit 0 is w
+    BitField< 4, 1, u32> negate_src1;
+    BitField< 5, 8, u32> swizzle_src1;  // bits 7-6 select the source component of x
+    BitField<13, 1, u32> negate_src2;
+    BitField<14, 8, u32> swizzle_src2;
+    BitField<22, 1, u32> negate_src3;
+    BitField<23, 8, u32> swizzle_src3;
+};
+
+/// Shader memory as written by the upload registers, hashed to find the decoded program
+struct ShaderMemory {
+    u32 code[MAX_PROGRAM_SIZE];
+    u32 swizzle_data[MAX_SWIZZLE_DATA];
+};
+
+typedef std::unordered_map<u64, std::unique_ptr<Program>> ProgramCache;
+
+ShaderMemory    g_memory;
+u32             g_code_offset;                  ///< Next word written by VSLoadProgramData
+u32             g_swizzle_offset;               ///< Next word written by VSLoadSwizzleData
+bool            g_memory_dirty = true;          ///< Shader memory changed since the last decode
+
+Float4          g_float_uniforms[NUM_FLOAT_UNIFORMS];
+u32             g_uniform_words[4];             ///< VSFloatUniformData words of a partial uniform
+u32             g_num_uniform_words;
+bool            g_uniforms_dirty = true;        ///< Uniforms changed since the last run
+
+ProgramCache    g_program_cache;                ///< Decoded programs by hash of the shader memory
+const Program*  g_program = NULL;               ///< Program of the current shader memory
+
+void OnBeginLoadProgramData(u32 id) {
+    g_code_offset = g_regs[Regs::VSBeginLoadProgramData] & 0xFFF;
+}
+
+void OnLoadProgramData(u32 id) {
+    if (g_code_offset >= MAX_PROGRAM_SIZE) {
+        ERROR_LOG(GPU, "shader program upload past the end of program memory");
+        return;
+    }
+    g_memory.code[g_code_offset++] = g_regs[static_cast<Regs::Id>(id)];
+    g_memory_dirty = true;
+}
+
+void OnBeginLoadSwizzleData(u32 id) {
+    g_swizzle_offset = g_regs[Regs::VSBeginLoadSwizzleData] & 0xFFF;
+}
+
+void OnLoadSwizzleData(u32 id) {
+    if (g_swizzle_offset >= MAX_SWIZZLE_DATA) {
+        ERROR_LOG(GPU, "operand descriptor upload past the end of swizzle memory");
+        return;
+    }
+    g_memory.swizzle_data[g_swizzle_offset++] = g_regs[static_cast<Regs::Id>(id)];
+    g_memory_dirty = true;
+}
+
+void OnFloatUniformSetup(u32 id) {
+    g_num_uniform_words = 0;
+}
+
+/// Collects the words of a uniform and writes it once complete, the index then moves to the next
+void OnFloatUniformData(u32 id) {
+    auto& setup = g_regs.Get<Regs::VSFloatUniformSetup>();
+    g_uniform_words[g_num_uniform_words++] = g_regs[static_cast<Regs::Id>(id)];
+    if (g_num_uniform_words < (setup.is_float32 ? 4u : 3u)) {
+        return;
+    }
+    g_num_uniform_words = 0;
+
+    const u32 index = setup.index;
+    if (index >= NUM_FLOAT_UNIFORMS) {
+        ERROR_LOG(GPU, "write to invalid float uniform %u", index);
+        return;
+    }
+
+    // The words hold the components from w to x
+    Float4& uniform = g_float_uniforms[index];
+    const u32* w = g_uniform_words;
+    if (setup.is_float32) {
+        memcpy(&uniform.w, &w[0], 4);
+        memcpy(&uniform.z, &w[1], 4);
+        memcpy(&uniform.y, &w[2], 4);
+        memcpy(&uniform.x, &w[3], 4);
+    } else {
+        uniform.w = Float24ToFloat(w[0] >> 8);
+        uniform.z = Float24ToFloat(((w[0] & 0xFF) << 16) | (w[1] >> 16));
+        uniform.y = Float24ToFloat(((w[1] & 0xFFFF) << 8) | (w[2] >> 24));
+        uniform.x = Float24ToFloat(w[2] & 0xFFFFFF);
+    }
+    setup.index = index + 1;
+    g_uniforms_dirty = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+/**
+ * Sets a source of an op from the swizzle of its operand descriptor
+ * @param op Op to set up
+ * @param n Source, 0 to 2
+ * @param reg Source register
+ * @param swizzle Swizzle field of the operand descriptor
+ * @param negate Negate field of the operand descriptor
+ */
+void SetSource(Op& op, int n, u32 reg, u32 swizzle, u32 negate) {
+    op.src[n] = (u8)reg;
+    for (int i = 0; i < 4; i++) {
+        op.swizzle[n][i] = (u8)((swizzle >> (2 * (3 - i))) & 3);
+    }
+    op.negate |= negate << n;
+}
+
+/**
+ * Converts a destination register number to the decoded register numbering
+ * @param dest Destination field, o0-o15 then r0-r15
+ */
+u8 GetDestRegister(u32 dest) {
+    return (u8)(dest < 0x10 ? REG_OUTPUT + dest : dest);
+}
+
+/**
+ * Sets the destination of an op
+ * @param op Op to set up
+ * @param dest Destination field
+ * @param mask Destination mask of the operand descriptor
+ */
+void SetDest(Op& op, u32 dest, u32 mask) {
+    op.dest = GetDestRegister(dest);
+    // The descriptor has x in the high bit
+    op.dest_mask = (u8)(((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8));
+}
+
+/**
+ * Decodes a shader instruction
+ * @param instr Instruction word
+ * @param swizzle_data Operand descriptors
+ * @param address Word address of the instruction, for diagnostics
+ * @param op Receives the decoded op
+ */
+void Decode(Instruction instr, const u32* swizzle_data, u32 address, Op& op) {
+    memset(&op, 0, sizeof(op));
+    op.code = OP_NOP;
+
+    static const OpCode kArithmetic[0x20] = {
+        OP_ADD, OP_DP3, OP_DP4, OP_DPH, OP_DST, OP_EX2, OP_LG2, OP_NOP,
+        OP_MUL, OP_SGE, OP_SLT, OP_FLR, OP_MAX, OP_MIN, OP_RCP, OP_RSQ,
+        OP_NOP, OP_NOP, OP_MOVA, OP_MOV, OP_NOP, OP_NOP, OP_NOP, OP_NOP,
+        OP_DPH, OP_DST, OP_SGE, OP_SLT, OP_NOP, OP_NOP, OP_NOP, OP_NOP,
+    };
+
+    const u32 opcode = instr.opcode;
+    if (opcode < 0x20) {
+        OperandDescriptor desc;
+        desc.hex = swizzle_data[instr.common.operand_desc_id];
+
+        op.code = kArithmetic[opcode];
+        if (op.code == OP_NOP) {
+            WARN_LOG(GPU, "unimplemented shader instruction 0x%08X at 0x%03X", instr.hex, address);
+            return;
+        }
+        if (opcode >= 0x18) {
+            SetSource(op, 0, instr.inverted.src1, desc.swizzle_src1, desc.negate_src1);
+            SetSource(op, 1, instr.inverted.src2, desc.swizzle_src2, desc.negate_src2);
+            op.relative_src = 1;
+        } else {
+            SetSource(op, 0, instr.common.src1, desc.swizzle_src1, desc.negate_src1);
+            SetSource(op, 1, instr.common.src2, desc.swizzle_src2, desc.negate_src2);
+            op.relative_src = 0;
+        }
+        op.relative = (u8)instr.common.address_register_index;
+        SetDest(op, instr.common.dest, desc.dest_mask);
+        return;
+    }
+
+    if (opcode >= 0x30) {
+        OperandDescriptor desc;
+        desc.hex = swizzle_data[instr.mad.operand_desc_id];
+
+        op.code = OP_MAD;
+        SetSource(op, 0, instr.mad.src1, desc.swizzle_src1, desc.negate_src1);
+        if (opcode >= 0x38) {
+            SetSource(op, 1, instr.mad.src2, desc.swizzle_src2, desc.negate_src2);
+            SetSource(op, 2, instr.mad.src3, desc.swizzle_src3, desc.negate_src3);
+            op.relative_src = 1;
+        } else {
+            SetSource(op, 1, instr.mad.src2i, desc.swizzle_src2, desc.negate_src2);
+            SetSource(op, 2, instr.mad.src3i, desc.swizzle_src3, desc.negate_src3);
+            op.relative_src = 2;
+        }
+        op.relative = (u8)instr.mad.address_register_index;
+        SetDest(op, instr.mad.dest, desc.dest_mask);
+        return;
+    }
+
+    if (opcode >= 0x2E) {
+        OperandDescriptor desc;
+        desc.hex = swizzle_data[instr.compare.operand_desc_id];
+
+        op.code = OP_CMP;
+        SetSource(op, 0, instr.compare.src1, desc.swizzle_src1, desc.negate_src1);
+        SetSource(op, 1, instr.compare.src2, desc.swizzle_src2, desc.negate_src2);
+        op.relative = (u8)instr.compare.address_register_index;
+        op.relative_src = 0;
+        op.compare[0] = (u8)instr.compare.compare_x;
+        op.compare[1] = (u8)instr.compare.compare_y;
+        return;
+    }
+
+    op.dest_offset = (u16)instr.flow_control.dest_offset;
+    op.num_instructions = (u16)instr.flow_control.num_instructions;
+    op.condition = (u8)instr.flow_control.condition;
+    op.refx = (u8)instr.flow_control.refx;
+    op.refy = (u8)instr.flow_control.refy;
+
+    switch (opcode) {
+    case 0x20: op.code = OP_BREAK; break;
+    case 0x21: op.code = OP_NOP; break;
+    case 0x22: op.code = OP_END; break;
+    case 0x23: op.code = OP_BREAKC; break;
+    case 0x24: op.code = OP_CALL; break;
+    case 0x25: op.code = OP_CALLC; break;
+    case 0x26: op.code = OP_CALLU; op.uniform = (u8)instr.flow_control.bool_uniform_id; break;
+    case 0x27: op.code = OP_IFU; op.uniform = (u8)instr.flow_control.bool_uniform_id; break;
+    case 0x28: op.code = OP_IFC; break;
+    case 0x29: op.code = OP_LOOP; op.uniform = (u8)instr.flow_control.int_uniform_id; break;
+    case 0x2C: op.code = OP_JMPC; break;
+    case 0x2D: op.code = OP_JMPU; op.uniform = (u8)instr.flow_control.bool_uniform_id; break;
+
+    default:
+        // EMIT and SETEMIT are only used by geometry shaders
+        WARN_LOG(GPU, "unimplemented shader instruction 0x%08X at 0x%03X", instr.hex, address);
+        break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interpreter
+
+/// Entry of the call stack, shared by calls, conditionals and loops
+struct CallFrame {
+    u32 final_address;      ///< Address after the last instruction of the block
+    u32 return_address;
+    u32 loop_address;       ///< First instruction of the block, where loops start over
+    u32 repeat_count;       ///< Remaining iterations of a loop, 0 for other blocks
+    u32 loop_increment;
+    bool is_loop;
+};
+
+/// Flow control state, the same for all the lanes it runs. Copied when lanes diverge.
+struct Flow {
+    u32 pc;
+    u32 loop_counter;       ///< aL
+    int depth;
+    CallFrame stack[MAX_CALL_DEPTH];
+};
+
+/// Registers of four vertices
+struct State {
+    Vec4    regs[NUM_REGISTERS];
+    s32     address[2][4];  ///< a0.x and a0.y of each lane
+    Lanes   cond[2];        ///< Condition flags x and y, as lane masks
+};
+
+/// Guards against shaders that never reach END
+static const u32 MAX_INSTRUCTIONS = 0x100000;
+
+State g_state;
+
+/**
+ * Starts a block of code
+ * @param flow Flow control state
+ * @param address First instruction of the block
+ * @param num_instructions Length of the block
+ * @param return_address Instruction that follows the block
+ * @return False if the call stack is full
+ */
+bool Call(Flow& flow, u32 address, u32 num_instructions, u32 return_address) {
+    if (flow.depth == MAX_CALL_DEPTH) {
+        ERROR_LOG(GPU, "shader call stack overflow at 0x%03X", flow.pc - 1);
+        return false;
+    }
+    CallFrame& frame = flow.stack[flow.depth++];
+    frame.final_address = address + num_instructions;
+    frame.return_address = return_address;
+    frame.loop_address = address;
+    frame.repeat_count = 0;
+    frame.loop_increment = 0;
+    frame.is_loop = false;
+    flow.pc = address;
+    return true;
+}
+
+/// Leaves the innermost loop
+void Break(Flow& flow) {
+    for (int i = flow.depth - 1; i >= 0; i--) {
+        if (flow.stack[i].is_loop) {
+            flow.pc = flow.stack[i].return_address;
+            flow.depth = i;
+            return;
+        }
+    }
+}
+
+/**
+ * Applies the branch of a conditional flow control op for lanes where the condition is met or not
+ * @param op Flow control op
+ * @param flow Flow control state, with pc already past the op
+ * @param taken Whether the condition is met
+ */
+void Branch(const Op& op, Flow& flow, bool taken) {
+    const u32 else_address = op.dest_offset;
+    const u32 end_address = op.dest_offset + op.num_instructions;
+
+    switch (op.code) {
+    case OP_IFU:
+    case OP_IFC:
+        if (taken) {
+            Call(flow, flow.pc, else_address - flow.pc, end_address);
+        } else {
+            Call(flow, else_address, op.num_instructions, end_address);
+        }
+        break;
+
+    case OP_CALLU:
+    case OP_CALLC:
+        if (taken) {
+            Call(flow, op.dest_offset, op.num_instructions, flow.pc);
+        }
+        break;
+
+    case OP_JMPU:
+    case OP_JMPC:
+        if (taken) {
+            flow.pc = op.dest_offset;
+        }
+        break;
+
+    case OP_BREAKC:
+        if (taken) {
+            Break(flow);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * Evaluates the condition of a flow control op on the condition flags
+ * @return Mask of the lanes where the condition is met
+ */
+Lanes EvaluateCondition(const Op& op) {
+    const Lanes all = AllLanes();
+    const Lanes x = op.refx ? g_state.cond[0] : AndNot(g_state.cond[0], all);
+    const Lanes y = op.refy ? g_state.cond[1] : AndNot(g_state.cond[1], all);
+
+    switch (op.condition) {
+    case CONDITION_OR:      return Or(x, y);
+    case CONDITION_AND:     return And(x, y);
+    case CONDITION_JUST_X:  return x;
+    default:                return y;
+    }
+}
+
+/**
+ * Offsets a uniform register
+ * @param reg Register, non-uniform registers aren't offset
+ * @param offset Value of the address register
+ * @return Offset register, REG_ZERO if out of range
+ */
+inline u32 OffsetRegister(u32 reg, s32 offset) {
+    if (reg < REG_UNIFORM) {
+        return reg;
+    }
+    const s32 result = (s32)reg + offset;
+    return (result >= REG_UNIFORM && result < REG_OUTPUT) ? (u32)result : REG_ZERO;
+}
+
+/**
+ * Reads a source of an op, applying relative addressing, swizzling and negation
+ * @param op Op
+ * @param n Source, 0 to 2
+ * @param flow Flow control state, for aL
+ * @param result Receives the value
+ */
+inline void GetSource(const Op& op, int n, const Flow& flow, Vec4& result) {
+    const Vec4* reg = &g_state.regs[op.src[n]];
+    Vec4 gathered;
+
+    if (op.relative != 0 && op.relative_src == n) {
+        if (op.relative == 3) {
+            reg = &g_state.regs[OffsetRegister(op.src[n], (s32)flow.loop_counter)];
+        } else {
+            const s32* offsets = g_state.address[op.relative - 1];
+            if (offsets[0] == offsets[1] && offsets[0] == offsets[2] && offsets[0] == offsets[3]) {
+                reg = &g_state.regs[OffsetRegister(op.src[n], offsets[0])];
+            } else {
+                // Lanes read different registers, put together a register with one lane of each
+                float lanes[4][4];
+                for (int l = 0; l < 4; l++) {
+                    const Vec4& lane_reg = g_state.regs[OffsetRegister(op.src[n], offsets[l])];
+                    for (int i = 0; i < 4; i++) {
+                        float f[4];
+                        Store(f, lane_reg.c[i]);
+                        lanes[i][l] = f[l];
+                    }
+                }
+                for (int i = 0; i < 4; i++) {
+                    gathered.c[i] = Load(lanes[i]);
+                }
+                reg = &gathered;
+            }
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        result.c[i] = reg->c[op.swizzle[n][i]];
+    }
+    if (op.negate & (1 << n)) {
+        const Lanes sign = Splat(-0.0f);
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = Xor(result.c[i], sign);
+        }
+    }
+}
+
+/**
+ * Writes the result of an op to the components of the destination in its mask
+ * @param op Op
+ * @param value Result
+ * @param active Mask of the lanes to write
+ * @param all_active Whether all lanes are active
+ */
+inline void WriteDest(const Op& op, const Vec4& value, Lanes active, bool all_active) {
+    Vec4& dest = g_state.regs[op.dest];
+    for (int i = 0; i < 4; i++) {
+        if (op.dest_mask & (1 << i)) {
+            dest.c[i] = all_active ? value.c[i] : Select(active, value.c[i], dest.c[i]);
+        }
+    }
+}
+
+/// Sets all components of a register to one value
+inline void Broadcast(Vec4& result, Lanes value) {
+    result.c[0] = result.c[1] = result.c[2] = result.c[3] = value;
+}
+
+/**
+ * Runs an arithmetic op
+ * @param op Op
+ * @param flow Flow control state
+ * @param active Mask of the lanes to run
+ * @param all_active Whether all lanes are active
+ */
+void RunArithmetic(const Op& op, const Flow& flow, Lanes active, bool all_active) {
+    Vec4 src1, src2, src3, result;
+    GetSource(op, 0, flow, src1);
+
+    switch (op.code) {
+    case OP_ADD:
+        GetSource(op, 1, flow, src2);
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = Add(src1.c[i], src2.c[i]);
+        }
+        break;
+
+    case OP_MUL:
+        GetSource(op, 1, flow, src2);
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = Mul(src1.c[i], src2.c[i]);
+        }
+        break;
+
+    case OP_MAD:
+        GetSource(op, 1, flow, src2);
+        GetSource(op, 2, flow, src3);
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = Add(Mul(src1.c[i], src2.c[i]), src3.c[i]);
+        }
+        break;
+
+    case OP_DP3:
+    case OP_DP4:
+    case OP_DPH: {
+        GetSource(op, 1, flow, src2);
+        Lanes dot = Add(Add(Mul(src1.c[0], src2.c[0]), Mul(src1.c[1], src2.c[1])),
+            Mul(src1.c[2], src2.c[2]));
+        if (op.code == OP_DP4) {
+            dot = Add(dot, Mul(src1.c[3], src2.c[3]));
+        } else if (op.code == OP_DPH) {
+            dot = Add(dot, src2.c[3]);
+        }
+        Broadcast(result, dot);
+        break;
+    }
+
+    case OP_DST:
+        GetSource(op, 1, flow, src2);
+        result.c[0] = Splat(1.0f);
+        result.c[1] = Mul(src1.c[1], src2.c[1]);
+        result.c[2] = src1.c[2];
+        result.c[3] = src2.c[3];
+        break;
+
+    case OP_SGE:
+    case OP_SLT:
+        GetSource(op, 1, flow, src2);
+        for (int i = 0; i < 4; i++) {
+            const Lanes mask = op.code == OP_SGE ? CmpGe(src1.c[i], src2.c[i]) :
+                CmpLt(src1.c[i], src2.c[i]);
+            result.c[i] = And(mask, Splat(1.0f));
+        }
+        break;
+
+    case OP_MAX:
+    case OP_MIN:
+        GetSource(op, 1, flow, src2);
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = op.code == OP_MAX ? Max(src1.c[i], src2.c[i]) :
+                Min(src1.c[i], src2.c[i]);
+        }
+        break;
+
+    case OP_FLR:
+        for (int i = 0; i < 4; i++) {
+            result.c[i] = Floor(src1.c[i]);
+        }
+        break;
+
+    case OP_RCP:
+        Broadcast(result, Div(Splat(1.0f), src1.c[0]));
+        break;
+
+    case OP_RSQ:
+        Broadcast(result, Div(Splat(1.0f), Sqrt(src1.c[0])));
+        break;
+
+    case OP_EX2:
+        Broadcast(result, ForEachLane(src1.c[0], [](float f) { return powf(2.0f, f); }));
+        break;
+
+    case OP_LG2:
+        Broadcast(result, ForEachLane(src1.c[0], [](float f) { return logf(f) / logf(2.0f); }));
+        break;
+
+    case OP_MOV:
+        result = src1;
+        break;
+
+    case OP_MOVA: {
+        const int mask = LaneMask(active);
+        for (int i = 0; i < 2; i++) {
+            if (op.dest_mask & (1 << i)) {
+                float f[4];
+                Store(f, src1.c[i]);
+                for (int l = 0; l < 4; l++) {
+                    if (mask & (1 << l)) {
+                        g_state.address[i][l] = (s32)f[l];
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    case OP_CMP: {
+        GetSource(op, 1, flow, src2);
+        for (int i = 0; i < 2; i++) {
+            const Lanes a = src1.c[i], b = src2.c[i];
+            Lanes cond;
+            switch (op.compare[i]) {
+            case COMPARE_EQ: cond = CmpEq(a, b); break;
+            case COMPARE_NE: cond = CmpNe(a, b); break;
+            case COMPARE_LT: cond = CmpLt(a, b); break;
+            case COMPARE_LE: cond = CmpLe(a, b); break;
+            case COMPARE_GT: cond = CmpGt(a, b); break;
+            case COMPARE_GE: cond = CmpGe(a, b); break;
+            default:         cond = Splat(0.0f); break;
+            }
+            g_state.cond[i] = Select(active, cond, g_state.cond[i]);
+        }
+        return;
+    }
+
+    default:
+        return;
+    }
+
+    WriteDest(op, result, active, all_active);
+}
+
+/**
+ * Runs the program for a set of lanes until END. Lanes that take different branches of
+ * conditional flow control are split off and run to the end separately.
+ * @param program Decoded program
+ * @param flow Flow control state at the first instruction to run
+ * @param active Mask of the lanes to run
+ */
+void Run(const Program& program, Flow flow, Lanes active) {
+    int mask = LaneMask(active);
+
+    for (u32 steps = 0; steps < MAX_INSTRUCTIONS; steps++) {
+        // Leave the blocks that end here, loops go back to their start until done
+        while (flow.depth > 0 && flow.pc == flow.stack[flow.depth - 1].final_address) {
+            CallFrame& frame = flow.stack[flow.depth - 1];
+            if (frame.is_loop) {
+                flow.loop_counter += frame.loop_increment;
+                if (frame.repeat_count-- != 0) {
+                    flow.pc = frame.loop_address;
+                    continue;
+                }
+            }
+            flow.pc = frame.return_address;
+            flow.depth--;
+        }
+
+        if (flow.pc >= MAX_PROGRAM_SIZE) {
+            ERROR_LOG(GPU, "shader ran past the end of program memory");
+            return;
+        }
+        const Op& op = program.ops[flow.pc++];
+
+        switch (op.code) {
+        case OP_NOP:
+            break;
+
+        case OP_END:
+            return;
+
+        case OP_BREAK:
+            Break(flow);
+            break;
+
+        case OP_CALL:
+            Call(flow, op.dest_offset, op.num_instructions, flow.pc);
+            break;
+
+        case OP_CALLU:
+        case OP_IFU:
+        case OP_JMPU: {
+            bool taken = ((g_regs[Regs::VSBoolUniform] >> op.uniform) & 1) != 0;
+            if (op.code == OP_JMPU && (op.num_instructions & 1)) {
+                taken = !taken;
+            }
+            Branch(op, flow, taken);
+            break;
+        }
+
+        case OP_LOOP: {
+            const auto& loop = g_regs.Get<Regs::VSIntUniform>(VSIntUniform(op.uniform));
+            if (Call(flow, flow.pc, op.dest_offset + 1 - flow.pc, op.dest_offset + 1)) {
+                CallFrame& frame = flow.stack[flow.depth - 1];
+                frame.repeat_count = loop.x;
+                frame.loop_increment = loop.z;
+                frame.is_loop = true;
+                flow.loop_counter = loop.y;
+            }
+            break;
+        }
+
+        case OP_BREAKC:
+        case OP_CALLC:
+        case OP_IFC:
+        case OP_JMPC: {
+            const Lanes taken = And(EvaluateCondition(op), active);
+            const int taken_mask = LaneMask(taken);
+            if (taken_mask != 0 && taken_mask != mask) {
+                // The lanes that don't take the branch finish separately
+                Flow other = flow;
+                Branch(op, other, false);
+                Run(program, other, AndNot(taken, active));
+                active = taken;
+                mask = taken_mask;
+            }
+            Branch(op, flow, taken_mask != 0);
+            break;
+        }
+
+        default:
+            RunArithmetic(op, flow, active, mask == 0xF);
+            break;
+        }
+    }
+    ERROR_LOG(GPU, "shader doesn't reach END");
+}
+
+/// Broadcasts the float uniforms to all lanes of their registers
+void SetupUniforms() {
+    for (int i = 0; i < NUM_FLOAT_UNIFORMS; i++) {
+        Vec4& reg = g_state.regs[REG_UNIFORM + i];
+        reg.c[0] = Splat(g_float_uniforms[i].x);
+        reg.c[1] = Splat(g_float_uniforms[i].y);
+        reg.c[2] = Splat(g_float_uniforms[i].z);
+        reg.c[3] = Splat(g_float_uniforms[i].w);
+    }
+}
+
+} // namespace
+
+/**
+ * Gets the decoded program for the shader memory, decoding it if it was changed
+ * @return Program, valid until the shader memory is written or Init is called
+ */
+const Program& GetProgram() {
+    if (!g_memory_dirty && g_program != NULL) {
+        return *g_program;
+    }
+
+    const u64 hash = GetFastHash64((const u8*)&g_memory, sizeof(g_memory));
+    std::unique_ptr<Program>& program = g_program_cache[hash];
+    if (program == nullptr || memcmp(program->code, g_memory.code, sizeof(g_memory.code)) != 0 ||
+        memcmp(program->swizzle_data, g_memory.swizzle_data, sizeof(g_memory.swizzle_data)) != 0) {
+        program.reset(new Program);
+        memcpy(program->code, g_memory.code, sizeof(g_memory.code));
+        memcpy(program->swizzle_data, g_memory.swizzle_data, sizeof(g_memory.swizzle_data));
+        program->hash = hash;
+        for (u32 i = 0; i < MAX_PROGRAM_SIZE; i++) {
+            Instruction instr;
+            instr.hex = g_memory.code[i];
+            Decode(instr, g_memory.swizzle_data, i, program->ops[i]);
+        }
+    }
+    g_memory_dirty = false;
+    g_program = program.get();
+    return *g_program;
+}
+
+/**
+ * Runs the vertex shader set up in Pica::g_regs, four vertices at a time
+ * @param input Attributes from the vertex loader, num_attributes per vertex
+ * @param num_attributes Number of attributes of each vertex
+ * @param count Number of vertices
+ * @param output Receives count vertices
+ */
+void RunShader(const Float4* input, int num_attributes, u32 count, OutputVertex* output) {
+    const Program& program = GetProgram();
+    if (g_uniforms_dirty) {
+        SetupUniforms();
+        g_uniforms_dirty = false;
+    }
+
+    // Input register of each attribute
+    const u64 input_map = g_regs[Regs::VSInputRegisterMap] |
+        ((u64)g_regs[static_cast<Regs::Id>(Regs::VSInputRegisterMap + 1)] << 32);
+
+    // Output semantic of each component of the output registers
+    const u32 num_outputs = std::min<u32>(g_regs[Regs::VSOutputTotal] & 7, 7);
+    u32 semantics[7][4];
+    for (u32 i = 0; i < num_outputs; i++) {
+        const auto& map = g_regs.Get<Regs::VSOutputAttributes>(VSOutputAttributes(i));
+        for (int c = 0; c < 4; c++) {
+            semantics[i][c] = map.GetSemantic(c);
+        }
+    }
+
+    const u32 entry_point = g_regs[Regs::VSMainOffset] & 0xFFFF;
+    const ShaderJIT::CompiledShader compiled = ShaderJIT::g_enabled ?
+        ShaderJIT::Get(program, entry_point) : NULL;
+
+    for (u32 first = 0; first < count; first += 4) {
+        const u32 num_lanes = std::min<u32>(count - first, 4);
+
+        // Inputs are transposed to one vertex per lane, missing lanes repeat the last vertex
+        for (int a = 0; a < num_attributes; a++) {
+            const Float4* rows[4];
+            for (u32 l = 0; l < 4; l++) {
+                rows[l] = &input[(first + std::min(l, num_lanes - 1)) * num_attributes + a];
+            }
+            Vec4& reg = g_state.regs[REG_INPUT + ((input_map >> (4 * a)) & 0xF)];
+            reg.c[0] = Load(&rows[0]->x);
+            reg.c[1] = Load(&rows[1]->x);
+            reg.c[2] = Load(&rows[2]->x);
+            reg.c[3] = Load(&rows[3]->x);
+            Transpose(reg.c[0], reg.c[1], reg.c[2], reg.c[3]);
+        }
+
+        if (compiled != NULL) {
+            // Compiled shaders run all lanes, missing ones just aren't stored
+            compiled((float*)g_state.regs);
+        } else {
+            Flow flow;
+            flow.pc = entry_point;
+            flow.loop_counter = 0;
+            flow.depth = 0;
+
+            float lane_mask[4];
+            for (u32 l = 0; l < 4; l++) {
+                lane_mask[l] = l < num_lanes ? -1.0f : 0.0f;
+            }
+            Run(program, flow, CmpLt(Load(lane_mask), Splat(0.0f)));
+        }
+
+        for (u32 i = 0; i < num_outputs; i++) {
+            Vec4 reg = g_state.regs[REG_OUTPUT + i];
+            Transpose(reg.c[0], reg.c[1], reg.c[2], reg.c[3]);
+            for (u32 l = 0; l < num_lanes; l++) {
+                float components[4];
+                Store(components, reg.c[l]);
+                float* vertex = (float*)&output[first + l];
+                for (int c = 0; c < 4; c++) {
+                    if (semantics[i][c] < NUM_SEMANTICS) {
+                        vertex[semantics[i][c]] = components[c];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Clears the shader memory and installs the write handlers of the shader upload registers
+void Init() {
+    memset(&g_memory, 0, sizeof(g_memory));
+    memset(g_float_uniforms, 0, sizeof(g_float_uniforms));
+    memset(&g_state, 0, sizeof(g_state));
+    g_code_offset = g_swizzle_offset = g_num_uniform_words = 0;
+    g_memory_dirty = g_uniforms_dirty = true;
+    g_program_cache.clear();
+    g_program = NULL;
+    ShaderJIT::Init();
+
+    CommandProcessor::SetWriteHandler(Regs::VSBeginLoadProgramData, OnBeginLoadProgramData);
+    CommandProcessor::SetWriteHandler(Regs::VSBeginLoadSwizzleData, OnBeginLoadSwizzleData);
+    CommandProcessor::SetWriteHandler(Regs::VSFloatUniformSetup, OnFloatUniformSetup);
+    for (int i = 0; i < 8; i++) {
+        CommandProcessor::SetWriteHandler(static_cast<Regs::Id>(Regs::VSLoadProgramData + i),
+            OnLoadProgramData);
+        CommandProcessor::SetWriteHandler(static_cast<Regs::Id>(Regs::VSLoadSwizzleData + i),
+            OnLoadSwizzleData);
+        CommandProcessor::SetWriteHandler(static_cast<Regs::Id>(Regs::VSFloatUniformData + i),
+            OnFloatUniformData);
+    }
+}
+
+/**
+ * Saves or loads the shader memory and the float uniforms, the program is decoded again
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p) {
+    p.DoVoid(&g_memory, sizeof(g_memory));
+    p.Do(g_code_offset);
+    p.Do(g_swizzle_offset);
+    p.DoVoid(g_float_uniforms, sizeof(g_float_uniforms));
+    p.DoArray(g_uniform_words, ARRAY_SIZE(g_uniform_words));
+    p.Do(g_num_uniform_words);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        g_memory_dirty = g_uniforms_dirty = true;
+    }
+}
+
+} // namespace
+
+} // namespace
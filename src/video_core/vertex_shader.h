@@ -0,0 +1,156 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+#include "video_core/pica.h"
+#include "video_core/vertex_loader.h"
+
+class PointerWrap;
+
+namespace Pica {
+
+namespace VertexShader {
+
+enum {
+    MAX_PROGRAM_SIZE    = 1024, ///< Words of shader program memory
+    MAX_SWIZZLE_DATA    = 128,  ///< Operand descriptors
+    NUM_FLOAT_UNIFORMS  = 96,
+    NUM_SEMANTICS       = 24,   ///< Floats of an OutputVertex
+    MAX_CALL_DEPTH      = 16,   ///< Nesting of calls, conditionals and loops
+};
+
+/// Register numbering of decoded ops: the source register numbering, plus the output registers
+enum {
+    REG_INPUT           = 0x00, ///< v0-v15
+    REG_TEMPORARY       = 0x10, ///< r0-r15
+    REG_UNIFORM         = 0x20, ///< c0-c95
+    REG_OUTPUT          = 0x80, ///< o0-o15
+    REG_ZERO            = 0x90, ///< Read by relative uniform accesses out of range
+    NUM_REGISTERS       = 0x91,
+};
+
+/// Operation of a decoded op, inverted and MADI forms are folded into the plain ones
+enum OpCode : u8 {
+    OP_NOP,
+    OP_ADD,
+    OP_DP3,
+    OP_DP4,
+    OP_DPH,
+    OP_DST,
+    OP_EX2,
+    OP_LG2,
+    OP_MUL,
+    OP_SGE,
+    OP_SLT,
+    OP_FLR,
+    OP_MAX,
+    OP_MIN,
+    OP_RCP,
+    OP_RSQ,
+    OP_MOVA,
+    OP_MOV,
+    OP_MAD,
+    OP_CMP,
+
+    OP_END,
+    OP_BREAK,
+    OP_BREAKC,
+    OP_CALL,
+    OP_CALLC,
+    OP_CALLU,
+    OP_IFU,
+    OP_IFC,
+    OP_LOOP,
+    OP_JMPC,
+    OP_JMPU,
+};
+
+/// Comparison of CMP
+enum CompareOp : u8 {
+    COMPARE_EQ  = 0,
+    COMPARE_NE  = 1,
+    COMPARE_LT  = 2,
+    COMPARE_LE  = 3,
+    COMPARE_GT  = 4,
+    COMPARE_GE  = 5,
+};
+
+/// How flow control combines refx and refy with the condition flags
+enum ConditionOp : u8 {
+    CONDITION_OR     = 0,
+    CONDITION_AND    = 1,
+    CONDITION_JUST_X = 2,
+    CONDITION_JUST_Y = 3,
+};
+
+/// Shader instruction decoded into a form that is cheap to execute
+struct Op {
+    OpCode  code;
+    u8      dest;               ///< Register written
+    u8      dest_mask;          ///< Components written, bit n for component n (x is bit 0)
+    u8      negate;             ///< Bit n set if source n is negated
+    u8      src[3];             ///< Registers read
+    u8      relative;           ///< Address register added to src[relative_src]: 0 none, 1 a0.x,
+                                ///< 2 a0.y, 3 aL
+    u8      relative_src;
+    u8      swizzle[3][4];      ///< Component of each source read for each component of the op
+    u8      compare[2];         ///< CMP: CompareOp for the x and y condition flags
+    u8      condition;          ///< ConditionOp of conditional flow control
+    u8      refx;
+    u8      refy;
+    u8      uniform;            ///< Bool or int uniform of uniform flow control
+    u16     dest_offset;        ///< Target of flow control
+    u16     num_instructions;
+};
+
+/// Decoded shader program, one op per instruction word so that flow control offsets carry over
+struct Program {
+    u32 code[MAX_PROGRAM_SIZE];         ///< Program memory the ops were decoded from
+    u32 swizzle_data[MAX_SWIZZLE_DATA];
+    u64 hash;                           ///< Hash of code and swizzle_data
+    Op  ops[MAX_PROGRAM_SIZE];
+};
+
+/// Vertex after the vertex shader, the index of each float is its output semantic
+struct OutputVertex {
+    Float4 pos;
+    Float4 quat;
+    Float4 color;
+    float tc0_u, tc0_v;
+    float tc1_u, tc1_v;
+    float tc0_w, pad0;
+    float view_x, view_y, view_z, pad1;
+    float tc2_u, tc2_v;
+};
+
+/**
+ * Gets the decoded program for the shader memory, decoding it if it was changed
+ * @return Program, valid until the shader memory is written or Init is called
+ */
+const Program& GetProgram();
+
+/**
+ * Runs the vertex shader set up in Pica::g_regs, four vertices at a time
+ * @param input Attributes from the vertex loader, num_attributes per vertex
+ * @param num_attributes Number of attributes of each vertex
+ * @param count Number of vertices
+ * @param output Receives count vertices
+ */
+void RunShader(const Float4* input, int num_attributes, u32 count, OutputVertex* output);
+
+/// Clears the shader memory and installs the write handlers of the shader upload registers
+void Init();
+
+/**
+ * Saves or loads the shader memory and the float uniforms, the program is decoded again
+ * @param p Savestate the state is written to or read from
+ */
+void DoState(PointerWrap& p);
+
+} // namespace
+
+} // namespace
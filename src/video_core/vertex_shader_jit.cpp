@@ -0,0 +1,635 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/log.h"
+#include "common/memory_tracker.h"
+#include "common/memory_util.h"
+#include "common/x64_emitter.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/shader_disk_cache.h"
+#include "video_core/vertex_shader_jit.h"
+#include "video_core/video_core.h"
+
+namespace Pica {
+
+namespace ShaderJIT {
+
+bool g_enabled = true;
+
+namespace {
+
+using namespace ::JIT;
+using namespace VertexShader;
+
+const size_t CODE_SPACE_SIZE    = 8 * 1024 * 1024;  ///< Size of the compiled code buffer
+const u32 MAX_TRACE_OPS         = 1024;             ///< Most ops compiled, with loops unrolled
+const size_t MAX_OP_SIZE        = 512;              ///< Upper bound of host bytes per op
+
+/// Register holding the register file pointer
+const X64Reg REGISTERS = ABI_PARAM1;
+
+/// Constants read RIP-relative by the compiled code, at the start of the code space
+struct Constants {
+    u32 sign[4];
+    u32 abs[4];
+    float one[4];
+    float integral[4];  ///< 2^23, floats of this magnitude have no fraction bits
+};
+
+/// What a compiled shader depends on: the program and the uniforms controlling flow control
+struct Key {
+    u64 program_hash;
+    u32 entry_point;
+    u32 bool_uniforms;
+    u32 int_uniforms[4];
+};
+
+struct CacheEntry {
+    Key             key;
+    CompiledShader  code;   ///< NULL if the program has to be interpreted
+};
+
+/**
+ * Compiled shader as kept in the disk cache, followed by the relocations and the code. The code
+ * only depends on where it is through the RIP-relative displacements of the constants, which
+ * are relocated when it is loaded elsewhere.
+ */
+struct DiskCacheHeader {
+    Key key;
+    u32 code_offset;        ///< Offset of the code from the constants when compiled
+    u32 code_size;          ///< 0 if the program has to be interpreted
+    u32 num_relocations;    ///< Offsets of the displacements in the code, u32 each
+};
+
+/// Entry of the call stack walked while compiling, see the interpreter
+struct CallFrame {
+    u32 final_address;
+    u32 return_address;
+    u32 loop_address;
+    u32 repeat_count;
+    u32 loop_increment;
+    bool is_loop;
+};
+
+std::unordered_map<u64, CacheEntry> g_cache;    ///< Compiled shaders by hash of their key
+X64Emitter          g_emitter;
+u8*                 g_code_space = NULL;        ///< Executable memory holding compiled code
+const Constants*    g_constants = NULL;
+std::vector<u8*>    g_relocations;              ///< Displacements of the constants compiled
+VideoCore::ShaderDiskCache g_disk_cache;        ///< Compiled shaders by hash of their key
+size_t              g_tracked_size = 0;         ///< Code space reported to the memory tracker
+size_t              g_tracked_count = 0;        ///< Shaders reported to the memory tracker
+
+/// Reports the code space used and the shaders cached to Common::MemoryTracker
+void UpdateTracking() {
+    const size_t size = g_code_space != NULL ? g_emitter.GetCodePtr() - g_code_space : 0;
+    Common::MemoryTracker::Adjust(Common::MemoryTracker::TAG_SHADER_CACHE,
+        (s64)size - (s64)g_tracked_size, (s64)g_cache.size() - (s64)g_tracked_count);
+    g_tracked_size = size;
+    g_tracked_count = g_cache.size();
+}
+
+/// Throws away all compiled shaders and rewrites the constants
+void ClearCache() {
+    g_cache.clear();
+    if (g_code_space == NULL) {
+        UpdateTracking();
+        return;
+    }
+
+    const Constants constants = {
+        { 0x80000000, 0x80000000, 0x80000000, 0x80000000 },
+        { 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF },
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { 8388608.0f, 8388608.0f, 8388608.0f, 8388608.0f },
+    };
+    g_emitter.SetCodePtr(g_code_space, CODE_SPACE_SIZE);
+    g_constants = (const Constants*)g_emitter.GetCodePtr();
+    g_emitter.WriteData(&constants, sizeof(constants));
+    g_emitter.AlignCode(16);
+    UpdateTracking();
+}
+
+/**
+ * Makes room for some code, throwing away all compiled shaders if the code space or the budget of
+ * Common::MemoryTracker::TAG_SHADER_CACHE doesn't have it
+ * @param size Number of bytes required
+ */
+void ReserveSpace(size_t size) {
+    if (!g_emitter.HasSpace(size) ||
+        Common::MemoryTracker::IsOverBudget(Common::MemoryTracker::TAG_SHADER_CACHE, size)) {
+
+        ClearCache();
+    }
+}
+
+/**
+ * Emits op dst, [constant], noting the displacement of the constant
+ * @param op Operation
+ * @param dst Destination register
+ * @param constant Constant of g_constants
+ */
+void EmitConstantOp(X64SSEOp op, X64XmmReg dst, const void* constant) {
+    g_emitter.SSE_Rip(op, dst, constant);
+    g_relocations.push_back(g_emitter.GetCodePtr() - 4);
+}
+
+/**
+ * Emits cmpps dst, [constant], predicate, noting the displacement of the constant
+ * @param dst Destination register
+ * @param constant Constant of g_constants
+ * @param predicate Comparison
+ */
+void EmitConstantCompare(X64XmmReg dst, const void* constant, X64CmpPredicate predicate) {
+    g_emitter.CMPPS_Rip(dst, constant, predicate);
+    g_relocations.push_back(g_emitter.GetCodePtr() - 5);
+}
+
+/**
+ * Gets the byte offset of a component of a register in the register file
+ * @param reg Register in the decoded register numbering
+ * @param component Component, 0 to 3
+ */
+inline s32 Offset(u32 reg, u32 component) {
+    return (s32)((reg * 4 + component) * 16);
+}
+
+/**
+ * Loads a component of a source of an op, applying aL, swizzling and negation
+ * @param op Op
+ * @param n Source, 0 to 2
+ * @param component Component of the op
+ * @param loop_counter Value of aL
+ * @param dst Register to load to
+ */
+void LoadSource(const Op& op, int n, u32 component, u32 loop_counter, X64XmmReg dst) {
+    u32 reg = op.src[n];
+    if (op.relative == 3 && op.relative_src == n && reg >= REG_UNIFORM) {
+        reg += loop_counter;
+        if (reg >= REG_OUTPUT) {
+            reg = REG_ZERO;
+        }
+    }
+    g_emitter.MOVUPS_Load(dst, REGISTERS, Offset(reg, op.swizzle[n][component]));
+    if (op.negate & (1 << n)) {
+        EmitConstantOp(SSE_XORPS, dst, g_constants->sign);
+    }
+}
+
+/// Sets all lanes of a register to 1.0
+void LoadOne(X64XmmReg dst) {
+    g_emitter.SSE_Reg(SSE_XORPS, dst, dst);
+    EmitConstantOp(SSE_ORPS, dst, g_constants->one);
+}
+
+/**
+ * Rounds all lanes of a register down, XMM4 and XMM5 are clobbered
+ * @param reg Register to round
+ */
+void EmitFloor(X64XmmReg reg) {
+    // Truncate, then step down the negative non-integers. Values of 2^23 and up are integers
+    // already and are kept as they are, which also covers those out of the int range.
+    g_emitter.CVTTPS2DQ(XMM4, reg);
+    g_emitter.SSE_Reg(SSE_CVTDQ2PS, XMM4, XMM4);
+    g_emitter.MOVAPS_Reg(XMM5, XMM4);
+    g_emitter.CMPPS_Reg(XMM5, reg, CMP_NLE);
+    EmitConstantOp(SSE_ANDPS, XMM5, g_constants->one);
+    g_emitter.SSE_Reg(SSE_SUBPS, XMM4, XMM5);
+    g_emitter.MOVAPS_Reg(XMM5, reg);
+    EmitConstantOp(SSE_ANDPS, XMM5, g_constants->abs);
+    EmitConstantCompare(XMM5, g_constants->integral, CMP_NLT);
+    g_emitter.SSE_Reg(SSE_ANDPS, reg, XMM5);
+    g_emitter.SSE_Reg(SSE_ANDNPS, XMM5, XMM4);
+    g_emitter.SSE_Reg(SSE_ORPS, reg, XMM5);
+}
+
+/**
+ * Emits the code of an arithmetic op for all four lanes
+ * @param op Op
+ * @param loop_counter Value of aL at the op
+ * @return False if the op isn't supported
+ */
+bool CompileArithmetic(const Op& op, u32 loop_counter) {
+    // Per-vertex address registers would need a gather
+    if (op.relative == 1 || op.relative == 2) {
+        return false;
+    }
+
+    // Results go to XMM0-XMM3 and are only stored once all sources are read, since the
+    // destination may be one of them
+    static const X64XmmReg kResults[4] = { XMM0, XMM1, XMM2, XMM3 };
+    bool broadcast = false;
+
+    switch (op.code) {
+    case OP_DP3:
+    case OP_DP4:
+    case OP_DPH: {
+        const u32 num_products = op.code == OP_DP4 ? 4 : 3;
+        LoadSource(op, 0, 0, loop_counter, XMM0);
+        LoadSource(op, 1, 0, loop_counter, XMM4);
+        g_emitter.SSE_Reg(SSE_MULPS, XMM0, XMM4);
+        for (u32 i = 1; i < num_products; i++) {
+            LoadSource(op, 0, i, loop_counter, XMM1);
+            LoadSource(op, 1, i, loop_counter, XMM4);
+            g_emitter.SSE_Reg(SSE_MULPS, XMM1, XMM4);
+            g_emitter.SSE_Reg(SSE_ADDPS, XMM0, XMM1);
+        }
+        if (op.code == OP_DPH) {
+            LoadSource(op, 1, 3, loop_counter, XMM4);
+            g_emitter.SSE_Reg(SSE_ADDPS, XMM0, XMM4);
+        }
+        broadcast = true;
+        break;
+    }
+
+    case OP_RCP:
+    case OP_RSQ:
+        LoadSource(op, 0, 0, loop_counter, XMM4);
+        if (op.code == OP_RSQ) {
+            g_emitter.SSE_Reg(SSE_SQRTPS, XMM4, XMM4);
+        }
+        LoadOne(XMM0);
+        g_emitter.SSE_Reg(SSE_DIVPS, XMM0, XMM4);
+        broadcast = true;
+        break;
+
+    case OP_ADD:
+    case OP_MUL:
+    case OP_MAD:
+    case OP_MAX:
+    case OP_MIN:
+    case OP_SGE:
+    case OP_SLT:
+    case OP_MOV:
+    case OP_FLR:
+    case OP_DST:
+        for (u32 i = 0; i < 4; i++) {
+            if (!(op.dest_mask & (1 << i))) {
+                continue;
+            }
+            const X64XmmReg result = kResults[i];
+
+            if (op.code == OP_DST) {
+                switch (i) {
+                case 0:
+                    LoadOne(result);
+                    break;
+                case 1:
+                    LoadSource(op, 0, 1, loop_counter, result);
+                    LoadSource(op, 1, 1, loop_counter, XMM4);
+                    g_emitter.SSE_Reg(SSE_MULPS, result, XMM4);
+                    break;
+                case 2:
+                    LoadSource(op, 0, 2, loop_counter, result);
+                    break;
+                default:
+                    LoadSource(op, 1, 3, loop_counter, result);
+                    break;
+                }
+                continue;
+            }
+
+            LoadSource(op, 0, i, loop_counter, result);
+            if (op.code == OP_MOV) {
+                continue;
+            }
+            if (op.code == OP_FLR) {
+                EmitFloor(result);
+                continue;
+            }
+
+            LoadSource(op, 1, i, loop_counter, XMM4);
+            switch (op.code) {
+            case OP_ADD: g_emitter.SSE_Reg(SSE_ADDPS, result, XMM4); break;
+            case OP_MUL: g_emitter.SSE_Reg(SSE_MULPS, result, XMM4); break;
+            case OP_MAX: g_emitter.SSE_Reg(SSE_MAXPS, result, XMM4); break;
+            case OP_MIN: g_emitter.SSE_Reg(SSE_MINPS, result, XMM4); break;
+            case OP_SGE:
+                g_emitter.CMPPS_Reg(result, XMM4, CMP_NLT);
+                EmitConstantOp(SSE_ANDPS, result, g_constants->one);
+                break;
+            case OP_SLT:
+                g_emitter.CMPPS_Reg(result, XMM4, CMP_LT);
+                EmitConstantOp(SSE_ANDPS, result, g_constants->one);
+                break;
+            default: // OP_MAD
+                g_emitter.SSE_Reg(SSE_MULPS, result, XMM4);
+                LoadSource(op, 2, i, loop_counter, XMM4);
+                g_emitter.SSE_Reg(SSE_ADDPS, result, XMM4);
+                break;
+            }
+        }
+        break;
+
+    default:
+        // EX2, LG2, MOVA and CMP are left to the interpreter
+        return false;
+    }
+
+    for (u32 i = 0; i < 4; i++) {
+        if (op.dest_mask & (1 << i)) {
+            g_emitter.MOVUPS_Store(REGISTERS, Offset(op.dest, i), broadcast ? XMM0 : kResults[i]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Compiles a program, following flow control on the uniforms currently set in Pica::g_regs.
+ * Calls are inlined and loops unrolled, so that the code runs straight from start to END.
+ * @param program Decoded program
+ * @param entry_point Address of the first instruction to run
+ * @return Compiled shader, NULL if the program has to be interpreted
+ */
+CompiledShader Compile(const Program& program, u32 entry_point) {
+    ReserveSpace(MAX_TRACE_OPS * MAX_OP_SIZE);
+    u8* const entry = g_emitter.GetCodePtr();
+    g_relocations.clear();
+
+    const u32 bool_uniforms = g_regs[Regs::VSBoolUniform];
+    CallFrame stack[MAX_CALL_DEPTH];
+    int depth = 0;
+    u32 pc = entry_point;
+    u32 loop_counter = 0;
+
+    // Starts a block of code, as the interpreter does
+    auto call = [&](u32 address, u32 num_instructions, u32 return_address) -> CallFrame* {
+        if (depth == MAX_CALL_DEPTH) {
+            return NULL;
+        }
+        CallFrame& frame = stack[depth++];
+        frame.final_address = address + num_instructions;
+        frame.return_address = return_address;
+        frame.loop_address = address;
+        frame.repeat_count = 0;
+        frame.loop_increment = 0;
+        frame.is_loop = false;
+        pc = address;
+        return &frame;
+    };
+
+    for (u32 n = 0; n < MAX_TRACE_OPS; n++) {
+        while (depth > 0 && pc == stack[depth - 1].final_address) {
+            CallFrame& frame = stack[depth - 1];
+            if (frame.is_loop) {
+                loop_counter += frame.loop_increment;
+                if (frame.repeat_count-- != 0) {
+                    pc = frame.loop_address;
+                    continue;
+                }
+            }
+            pc = frame.return_address;
+            depth--;
+        }
+
+        if (pc >= MAX_PROGRAM_SIZE) {
+            break;
+        }
+        const u32 address = pc++;
+        const Op& op = program.ops[address];
+        bool supported = true;
+
+        switch (op.code) {
+        case OP_NOP:
+            break;
+
+        case OP_END:
+            g_emitter.RET();
+            DEBUG_LOG(GPU, "compiled shader at 0x%03X (%u ops)", entry_point, n);
+            return (CompiledShader)entry;
+
+        case OP_CALL:
+            supported = call(op.dest_offset, op.num_instructions, pc) != NULL;
+            break;
+
+        case OP_CALLU:
+        case OP_IFU:
+        case OP_JMPU: {
+            bool taken = ((bool_uniforms >> op.uniform) & 1) != 0;
+            if (op.code == OP_JMPU) {
+                if (op.num_instructions & 1) {
+                    taken = !taken;
+                }
+                if (taken) {
+                    pc = op.dest_offset;
+                }
+            } else if (op.code == OP_CALLU) {
+                if (taken) {
+                    supported = call(op.dest_offset, op.num_instructions, pc) != NULL;
+                }
+            } else {
+                const u32 end_address = op.dest_offset + op.num_instructions;
+                if (taken) {
+                    supported = call(pc, op.dest_offset - pc, end_address) != NULL;
+                } else {
+                    supported = call(op.dest_offset, op.num_instructions, end_address) != NULL;
+                }
+            }
+            break;
+        }
+
+        case OP_LOOP: {
+            const auto& loop = g_regs.Get<Regs::VSIntUniform>(VSIntUniform(op.uniform));
+            CallFrame* frame = call(pc, op.dest_offset + 1 - pc, op.dest_offset + 1);
+            if (frame != NULL) {
+                frame->repeat_count = loop.x;
+                frame->loop_increment = loop.z;
+                frame->is_loop = true;
+                loop_counter = loop.y;
+            }
+            supported = frame != NULL;
+            break;
+        }
+
+        case OP_BREAK:
+            for (int i = depth - 1; i >= 0; i--) {
+                if (stack[i].is_loop) {
+                    pc = stack[i].return_address;
+                    depth = i;
+                    break;
+                }
+            }
+            break;
+
+        case OP_BREAKC:
+        case OP_CALLC:
+        case OP_IFC:
+        case OP_JMPC:
+            // Per-vertex conditions are left to the interpreter
+            supported = false;
+            break;
+
+        default:
+            supported = CompileArithmetic(op, loop_counter);
+            break;
+        }
+
+        if (!supported) {
+            DEBUG_LOG(GPU, "shader at 0x%03X uses unsupported op %u at 0x%03X, interpreting it",
+                entry_point, op.code, address);
+            break;
+        }
+    }
+
+    // Rewind so the buffer space is reused
+    g_emitter.SetCodePtr(entry, g_code_space + CODE_SPACE_SIZE - entry);
+    return NULL;
+}
+
+/**
+ * Loads a compiled shader from the disk cache, without waiting for the cache file to be read
+ * @param key What the shader depends on
+ * @param hash Hash of the key
+ * @param code Receives the compiled shader, NULL if the program has to be interpreted
+ * @return True if found
+ */
+bool LoadFromDiskCache(const Key& key, u64 hash, CompiledShader* code) {
+    std::vector<u8> value;
+    if (!g_disk_cache.Find(hash, false, &value) || value.size() < sizeof(DiskCacheHeader)) {
+        return false;
+    }
+    DiskCacheHeader header;
+    memcpy(&header, value.data(), sizeof(header));
+    const size_t relocations_size = header.num_relocations * sizeof(u32);
+    if (memcmp(&header.key, &key, sizeof(key)) != 0 ||
+        value.size() != sizeof(header) + relocations_size + header.code_size ||
+        header.code_size > MAX_TRACE_OPS * MAX_OP_SIZE) {
+        return false;
+    }
+    if (header.code_size == 0) {
+        *code = NULL;
+        return true;
+    }
+
+    ReserveSpace(header.code_size);
+    u8* const entry = g_emitter.GetCodePtr();
+    g_emitter.WriteData(value.data() + sizeof(header) + relocations_size, header.code_size);
+
+    const s32 delta = (s32)header.code_offset - (s32)(entry - (const u8*)g_constants);
+    for (u32 i = 0; i < header.num_relocations; i++) {
+        u32 offset;
+        memcpy(&offset, value.data() + sizeof(header) + i * sizeof(u32), sizeof(offset));
+        s32 displacement;
+        memcpy(&displacement, entry + offset, sizeof(displacement));
+        displacement += delta;
+        memcpy(entry + offset, &displacement, sizeof(displacement));
+    }
+    *code = (CompiledShader)entry;
+    return true;
+}
+
+/**
+ * Stores a shader just compiled to the disk cache
+ * @param key What the shader depends on
+ * @param hash Hash of the key
+ * @param code Compiled shader, NULL if the program has to be interpreted
+ */
+void StoreToDiskCache(const Key& key, u64 hash, CompiledShader code) {
+    const u8* const entry = (const u8*)code;
+    DiskCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.key = key;
+    if (code != NULL) {
+        header.code_offset = (u32)(entry - (const u8*)g_constants);
+        header.code_size = (u32)(g_emitter.GetCodePtr() - entry);
+        header.num_relocations = (u32)g_relocations.size();
+    }
+
+    std::vector<u8> value(sizeof(header) + header.num_relocations * sizeof(u32) +
+        header.code_size);
+    memcpy(value.data(), &header, sizeof(header));
+    for (u32 i = 0; i < header.num_relocations; i++) {
+        const u32 offset = (u32)(g_relocations[i] - entry);
+        memcpy(value.data() + sizeof(header) + i * sizeof(u32), &offset, sizeof(offset));
+    }
+    if (code != NULL) {
+        memcpy(value.data() + sizeof(header) + header.num_relocations * sizeof(u32), entry,
+            header.code_size);
+    }
+    g_disk_cache.Store(hash, value.data(), (u32)value.size());
+}
+
+} // namespace
+
+/**
+ * Gets the native code of a program, compiling it on first use
+ * @param program Decoded program
+ * @param entry_point Address of the first instruction to run
+ * @return Compiled shader, NULL if the program has to be interpreted
+ */
+CompiledShader Get(const Program& program, u32 entry_point) {
+    if (g_code_space == NULL) {
+        return NULL;
+    }
+
+    Key key;
+    memset(&key, 0, sizeof(key));
+    key.program_hash = program.hash;
+    key.entry_point = entry_point;
+    key.bool_uniforms = g_regs[Regs::VSBoolUniform] & 0xFFFF;
+    for (int i = 0; i < 4; i++) {
+        key.int_uniforms[i] = g_regs[VSIntUniform(i)] & 0xFFFFFF;
+    }
+
+    const u64 hash = GetFastHash64((const u8*)&key, sizeof(key));
+    auto it = g_cache.find(hash);
+    if (it != g_cache.end() && memcmp(&it->second.key, &key, sizeof(key)) == 0) {
+        return it->second.code;
+    }
+
+    // Compile or load first, either may clear the cache
+    CompiledShader code;
+    if (!LoadFromDiskCache(key, hash, &code)) {
+        code = Compile(program, entry_point);
+        StoreToDiskCache(key, hash, code);
+    }
+    CacheEntry& entry = g_cache[hash];
+    entry.key = key;
+    entry.code = code;
+    UpdateTracking();
+    return code;
+}
+
+/**
+ * Allocates the code space on first use and throws away all compiled shaders. The disk cache
+ * starts being read, shaders compiled meanwhile are kept in memory until it is.
+ */
+void Init() {
+#ifdef _M_X64
+    if (g_code_space == NULL) {
+        g_code_space = (u8*)AllocateExecutableMemory(CODE_SPACE_SIZE, false);
+    }
+#endif
+    ClearCache();
+
+    if (g_code_space != NULL && VideoCore::g_shader_cache_enabled) {
+        const std::string& directory = File::GetUserPath(D_SHADERCACHE_IDX);
+        File::CreateFullPath(directory);
+        g_disk_cache.Open(directory + "pica_vertex_shaders_x64.cache");
+    }
+}
+
+/// Frees the code space and closes the disk cache
+void Shutdown() {
+    g_disk_cache.Close();
+    g_cache.clear();
+    if (g_code_space != NULL) {
+        FreeMemoryPages(g_code_space, CODE_SPACE_SIZE);
+        g_code_space = NULL;
+    }
+    UpdateTracking();
+}
+
+} // namespace
+
+} // namespace
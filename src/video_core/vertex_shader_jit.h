@@ -0,0 +1,45 @@
+// Copyright 2014 Citra Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common.h"
+
+#include "video_core/vertex_shader.h"
+
+namespace Pica {
+
+namespace ShaderJIT {
+
+extern bool g_enabled;  ///< Whether shaders are compiled to native code, or always interpreted
+
+/**
+ * Native code of a shader, runs four vertices at once. Registers are laid out in the decoded
+ * register numbering, each register being four components of four lanes of floats.
+ * @param registers Register file of the four vertices
+ */
+typedef void (*CompiledShader)(float* registers);
+
+/**
+ * Gets the native code of a program, compiling it on first use. Flow control on bool and int
+ * uniforms is resolved while compiling, so the code is specific to the values the uniforms
+ * currently have in Pica::g_regs.
+ * @param program Decoded program
+ * @param entry_point Address of the first instruction to run
+ * @return Compiled shader, NULL if the program has to be interpreted
+ */
+CompiledShader Get(const VertexShader::Program& program, u32 entry_point);
+
+/**
+ * Allocates the code space on first use and throws away all compiled shaders. The disk cache
+ * starts being read, shaders compiled meanwhile are kept in memory until it is.
+ */
+void Init();
+
+/// Frees the code space and closes the disk cache
+void Shutdown();
+
+} // namespace
+
+} // namespace
@@ -8,8 +8,15 @@
 
 #include "core/core.h"
 
+#include "video_core/command_processor.h"
+#include "video_core/frame_dumper.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/pica_trace.h"
+#include "video_core/rasterizer.h"
+#include "video_core/vertex_shader_jit.h"
 #include "video_core/video_core.h"
 #include "video_core/renderer_base.h"
+#include "video_core/renderer_headless.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -20,6 +27,18 @@ namespace VideoCore {
 EmuWindow*      g_emu_window    = NULL;     ///< Frontend emulator window
 RendererBase*   g_renderer      = NULL;     ///< Renderer plugin
 int             g_current_frame = 0;
+std::string     g_renderer_backend = "software";
+bool            g_hw_renderer_enabled = false;
+int             g_resolution_scale = 1;
+bool            g_frame_latency_enabled = false;
+bool            g_presenter_enabled = true;
+bool            g_headless_enabled = false;
+bool            g_shader_cache_enabled = true;
+ScreenLayout    g_screen_layout = ScreenLayout::Stacked;
+bool            g_mono_enabled = false;
+Common::BumpArena g_frame_arena;
+
+void (*g_frame_callback)(const u8* top, const u8* bottom) = NULL;
 
 /// Start the video core
 void Start() {
@@ -28,17 +47,96 @@ void Start() {
     }
 }
 
-/// Initialize the video core
-void Init(EmuWindow* emu_window) {
-    // Known problem with GLEW prevents contexts above 2.x on OSX unless glewExperimental is enabled.
+static RendererBase* CreateHeadless() {
+    // Draws have no host GPU to go to
+    g_hw_renderer_enabled = false;
+    return new RendererHeadless();
+}
+
+/**
+ * Creates an OpenGL renderer, which needs the context of the EmuWindow current
+ * @param hw_renderer Whether draws are rendered with the host GPU, on the rasterizer otherwise
+ */
+static RendererBase* CreateOpenGL(bool hw_renderer) {
+    // Known problem with GLEW prevents contexts above 2.x on OSX unless glewExperimental is
+    // enabled.
     glewExperimental = GL_TRUE;
 
-    g_emu_window = emu_window;
+    // Command lists run on the thread the OpenGL context is current on when the host GPU
+    // renders the draws
+    g_hw_renderer_enabled = hw_renderer;
+    if (g_hw_renderer_enabled) {
+        GPUThread::g_enabled = false;
+    }
+
     g_emu_window->MakeCurrent();
-    g_renderer = new RendererOpenGL();
+    return new RendererOpenGL();
+}
+
+static RendererBase* CreateSoftware() {
+    return CreateOpenGL(false);
+}
+
+static RendererBase* CreateHardware() {
+    return CreateOpenGL(true);
+}
+
+/**
+ * Gets the renderer backends Init picks from, "software", "opengl" and "headless" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+RendererBackendRegistry& GetRendererBackends() {
+    static RendererBackendRegistry registry;
+    if (registry.GetBackends().empty()) {
+        const RendererBackendRegistry::Backend software = {
+            "software", "Draws rasterized on the CPU, frames presented with OpenGL",
+            RENDERER_CAP_PRESENTS, CreateSoftware
+        };
+        const RendererBackendRegistry::Backend opengl = {
+            "opengl", "Draws rendered on the host GPU with OpenGL",
+            RENDERER_CAP_PRESENTS | RENDERER_CAP_HOST_DRAWS, CreateHardware
+        };
+        const RendererBackendRegistry::Backend headless = {
+            "headless", "Draws rasterized on the CPU, frames given to FrameOutput only", 0,
+            CreateHeadless
+        };
+        registry.Register(software);
+        registry.Register(opengl);
+        registry.Register(headless);
+    }
+    return registry;
+}
+
+/**
+ * Creates the renderer backend selected by the settings read at init, headless when the frontend
+ * has no graphics context. Backends other than OpenGL need an EmuWindow able to give them a
+ * surface, the frontends only create OpenGL contexts.
+ * @return Renderer, not initialized yet
+ */
+static RendererBase* CreateRenderer() {
+    const RendererBackendRegistry& registry = GetRendererBackends();
+    const RendererBackendRegistry::Backend* backend =
+        registry.Find(g_headless_enabled ? "headless" : g_renderer_backend);
+    if (backend == NULL) {
+        ERROR_LOG(VIDEO, "unknown renderer backend %s, one of %s, using software",
+            g_renderer_backend.c_str(), registry.GetNames().c_str());
+        backend = registry.Find("software");
+    }
+    NOTICE_LOG(VIDEO, "renderer backend %s: %s", backend->name, backend->description);
+    return backend->create();
+}
+
+/// Initialize the video core
+void Init(EmuWindow* emu_window) {
+    g_emu_window = emu_window;
+    g_renderer = CreateRenderer();
     g_renderer->SetWindow(g_emu_window);
     g_renderer->Init();
 
+    Pica::CommandProcessor::Init();
+    Pica::Rasterizer::Init();
+    GPUThread::Init();
+
     g_current_frame = 0;
 
     NOTICE_LOG(VIDEO, "initialized OK");
@@ -46,6 +144,12 @@ void Init(EmuWindow* emu_window) {
 
 /// Shutdown the video core
 void Shutdown() {
+    FrameDumper::Stop();
+    PicaTrace::StopRecording();
+    GPUThread::Shutdown();
+    Pica::Rasterizer::Shutdown();
+    Pica::ShaderJIT::Shutdown();
+    g_renderer->ShutDown();
     delete g_renderer;
     NOTICE_LOG(VIDEO, "shutdown OK");
 }
@@ -4,8 +4,12 @@
 
 #pragma once
 
+#include <string>
+
+#include "common/bump_arena.h"
 #include "common/common.h"
 #include "common/emu_window.h"
+#include "common/factory_registry.h"
 
 #include "renderer_base.h"
 
@@ -22,11 +26,60 @@ static const int kScreenTopHeight       = 240;  ///< 3DS top screen height
 static const int kScreenBottomWidth     = 320;  ///< 3DS bottom screen width
 static const int kScreenBottomHeight    = 240;  ///< 3DS bottom screen height
 
+/// Arrangement of the screens in the render window
+enum class ScreenLayout {
+    Stacked,        ///< Top screen above the bottom screen
+    SideBySide,     ///< Top screen left of the bottom screen
+    SingleScreen,   ///< Top screen alone
+};
+
+/// Capabilities a renderer backend reports
+enum RendererCapability {
+    RENDERER_CAP_PRESENTS   = 1 << 0,   ///< Shows the frames in the window, needs a GL context
+    RENDERER_CAP_HOST_DRAWS = 1 << 1,   ///< Renders draws on the host GPU, at any resolution scale
+};
+
+typedef Common::FactoryRegistry<RendererBase> RendererBackendRegistry;
+
+/**
+ * Gets the renderer backends Init picks from, "software", "opengl" and "headless" built in
+ * @return Registry, which frontends may add backends to before Init
+ */
+RendererBackendRegistry& GetRendererBackends();
+
 //  Video core renderer
 // ---------------------
 
 extern RendererBase*   g_renderer;              ///< Renderer plugin
 extern int             g_current_frame;         ///< Current frame
+extern std::string     g_renderer_backend;      ///< Name of the renderer backend, read by Init
+extern bool            g_hw_renderer_enabled;   ///< Whether draws are rendered with the host GPU,
+                                                ///< set by Init from the backend
+extern int             g_resolution_scale;      ///< Multiplier of the resolution the host GPU
+                                                ///< renders at, 1 to 4, read by Init
+extern bool            g_frame_latency_enabled; ///< Whether frames are displayed a frame late, so
+                                                ///< their upload never stalls the host GPU
+extern bool            g_presenter_enabled;     ///< Whether frames are shown from a thread of their
+                                                ///< own, paced to the host display, read by Init
+extern bool            g_headless_enabled;      ///< Whether the frontend has no graphics context,
+                                                ///< read by Init, which then renders headless
+extern bool            g_shader_cache_enabled;  ///< Whether compiled shaders are kept on disk
+                                                ///< across runs, read by Init
+extern ScreenLayout    g_screen_layout;         ///< Arrangement of the screens, read every frame
+extern bool            g_mono_enabled;          ///< Whether to skip rendering the right eye of the
+                                                ///< top screen, which isn't presented
+
+/// Scratch memory of the CPU emulation thread for data living until the end of the frame, reset
+/// after every SwapBuffers
+extern Common::BumpArena g_frame_arena;
+
+/**
+ * Receives the frames of the headless renderer, NULL to not read the framebuffers at all
+ * @param top Top screen, kScreenTopHeight rows of kScreenTopWidth pixels from the top down
+ * @param bottom Bottom screen, kScreenBottomHeight rows of kScreenBottomWidth pixels
+ * @note Pixels are 24-bit, in the byte order of the guest framebuffers
+ */
+extern void (*g_frame_callback)(const u8* top, const u8* bottom);
 
 /// Start the video core
 void Start();